@@ -1,16 +1,89 @@
 #include "ViewerApplication.hpp"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <mutex>
 #include <numeric>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
 
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/io.hpp>
 
+#include <imgui_internal.h> // ActiveIdHasBeenEditedThisFrame
+
+#include "utils/ambient_occlusion.hpp"
+#include "utils/animations.hpp"
+#include "utils/baked_occlusion.hpp"
+#include "utils/bindless_textures.hpp"
+#include "utils/bc6h.hpp"
+#include "utils/bloom.hpp"
+#include "utils/buffer_uploader.hpp"
+#include "utils/bvh.hpp"
 #include "utils/cameras.hpp"
+#include "utils/depth_pyramid.hpp"
+#include "utils/dynamic_resolution.hpp"
+#include "utils/file_watcher.hpp"
+#include "utils/frame_arena.hpp"
+#include "utils/frame_graph.hpp"
+#include "utils/frame_stats.hpp"
+#include "utils/frustum.hpp"
+#include "utils/geometry_cache.hpp"
+#include "utils/gl_extensions.hpp"
+#include "utils/gl_state.hpp"
+#include "utils/gpu_profiler.hpp"
+#include "utils/gpu_time_slicer.hpp"
 #include "utils/gltf.hpp"
+#include "utils/gpu_memory.hpp"
+#include "utils/heap_memory.hpp"
+#include "utils/ibl_cache.hpp"
+#include "utils/image_writer.hpp"
 #include "utils/images.hpp"
+#include "utils/impostors.hpp"
+#include "utils/job_system.hpp"
+#include "utils/ktx2.hpp"
+#include "utils/lights.hpp"
+#include "utils/morph_targets.hpp"
+#include "utils/node_culling.hpp"
+#include "utils/panorama.hpp"
+#include "utils/path_tracer.hpp"
+#include "utils/picking.hpp"
+#include "utils/program_cache.hpp"
+#include "utils/render_job_pool.hpp"
+#include "utils/render_queue.hpp"
+#include "utils/rgbe.hpp"
+#include "utils/runtime_model.hpp"
+#include "utils/ring_buffer.hpp"
+#include "utils/scene_graph.hpp"
+#include "utils/shading_rate.hpp"
+#include "utils/shadow_cascades.hpp"
+#include "utils/skins.hpp"
+#include "utils/software_occlusion.hpp"
+#include "utils/spherical_harmonics.hpp"
+#include "utils/static_batching.hpp"
+#include "utils/task_graph.hpp"
+#include "utils/temporal_aa.hpp"
+#include "utils/texture_arrays.hpp"
+#include "utils/texture_uploader.hpp"
+#include "utils/tonemapping.hpp"
+#include "utils/transparency.hpp"
+#include "utils/visibility_buffer.hpp"
+#include "utils/visible_sets.hpp"
+#include "utils/trace.hpp"
 
 #include <stb_image.h>
 #include <stb_image_write.h>
@@ -19,10 +92,144 @@
 #define VERTEX_ATTRIB_POSITION_IDX 0
 #define VERTEX_ATTRIB_NORMAL_IDX 1
 #define VERTEX_ATTRIB_TEXCOORD0_IDX 2
-#define SKYBOX_SIZE 512
-#define IRRADIANCEMAP_SIZE 32
-#define PREFILTERMAP_SIZE 128
-#define BRDF_LUT_SIZE 512
+#define VERTEX_ATTRIB_JOINTS0_IDX 3
+#define VERTEX_ATTRIB_WEIGHTS0_IDX 4
+#define VERTEX_ATTRIB_TANGENT_IDX 5
+#define VERTEX_ATTRIB_DRAW_INDEX_IDX 6
+#define PREFILTER_SAMPLES 1024
+#define PREFILTER_FAST_SAMPLES 64
+#define IRRADIANCE_SAMPLES 1024
+#define IRRADIANCE_FAST_SAMPLES 128
+#define SH_IRRADIANCE_BINDING 0
+#define MATERIALS_BINDING 1
+#define DRAW_TRANSFORMS_BINDING 2
+#define FRAME_CONSTANTS_BINDING 3
+#define DRAW_INDEX_BUFFER_BINDING 1
+#define PUNCTUAL_LIGHTS_BINDING 4
+#define CLUSTER_LIGHTS_BINDING 5
+#define CLUSTER_TILES_X 16
+#define CLUSTER_TILES_Y 9
+#define CLUSTER_SLICES 24
+#define CLUSTER_MAX_LIGHTS 63
+#define SHADOW_CASCADES_BINDING 4
+#define SHADOW_ITEMS_BINDING 6
+#define SKIN_JOINTS_BINDING 7
+#define SKIN_NONE 0xffffffffu
+#define SKIN_DUAL_QUATERNION_BIT 0x80000000u
+#define MORPH_TARGETS_BINDING 8
+#define MORPH_DELTAS_UNIT 9
+#define AMBIENT_OCCLUSION_UNIT 10 // And its depths on the next one
+#define MERGED_VERTICES_UNIT 12
+#define MERGED_TRANSFORMS_BINDING 13
+#define MESHLETS_BINDING 9
+#define CLUSTER_COMMANDS_BINDING 10
+#define CLUSTER_DRAWS_BINDING 11
+#define CLUSTER_COUNTS_BINDING 12
+#define CLUSTER_CONE_CULLING_BIT 1u
+#define CLUSTER_DRAW_CULLING_BIT 2u
+#define CLUSTER_SMALL_FEATURE_BIT 4u
+#define DRAW_ITEMS_BINDING 14
+#define DRAW_BOUNDS_BINDING 15
+#define DEPTH_PYRAMID_UNIT 13
+#define PATH_TRACE_NODES_BINDING 16 // And the three next ones
+#define PATH_TRACE_TEXTURE_UNITS 8 // Texture arrays bound at once
+#define PATH_TRACE_NO_TEXTURE 15u
+#define BAKED_OCCLUSION_UNIT 14
+#define BAKED_OCCLUSION_NONE 0xffffffffu
+#define BAKED_OCCLUSION_DISTANCE 0.05f // Of the scene diagonal
+#define BAKED_OCCLUSION_BATCH 65536 // Vertices per dispatch
+#define VISIBLE_SET_RAYS 4096 // Per cell
+#define VISIBLE_SET_BATCH 256 // Cells per dispatch
+#define VISIBILITY_DRAWS_BINDING 22
+#define VISIBILITY_INDICES_BINDING 23
+#define VISIBILITY_VERTICES_BINDING 24
+#define VISIBILITY_UNIT 15
+#define POINT_FRAMEBUFFER_BINDING 25
+#define POINT_JOBS_BINDING 26
+#define POINT_INDICES_BINDING 27
+#define POINT_VERTICES_BINDING 28
+#define POINT_RASTERIZE_GROUP_SIZE 256 // As in points_rasterize.cs.glsl
+#define POINT_DEFAULT_BUDGET 5.f // Millions of points drawn
+#define WIREFRAME_FORMATS_BINDING 29
+#define WIREFRAME_NONE 0xffffffffu
+#define PULLED_VERTICES_BINDING 30
+#define PULLED_LAYOUTS_BINDING 31
+#define IMPOSTOR_INSTANCES_BINDING 32
+#define IMPOSTOR_MIN_INSTANCES 16 // Objects of a mesh for it to get an impostor
+#define SHADOW_CASCADE_COUNT 4
+#define SHADOW_MAP_SIZE 2048
+#define TEXTURE_STAGING_MIN_SIZE (1 << 20)
+#define TEXTURE_STAGING_MAX_SIZE (64 << 20)
+#define BUFFER_STAGING_MIN_SIZE (1 << 20)
+#define BUFFER_STAGING_MAX_SIZE (64 << 20)
+#define DEFAULT_TILE_SIZE 1024
+#define ON_DEMAND_WAIT_TIMEOUT 0.5
+#define ON_DEMAND_SETTLE_FRAMES 3
+#define CAMERA_TICK_SECONDS (1. / 240.)
+#define CAMERA_MAX_TICKS 60 // Longer stalls are not caught up
+#define TEMPORAL_AA_SETTLE_FRAMES 16
+#define GUI_REFRESH_INTERVAL 0.25 // Seconds between rebuilds of an idle GUI
+#define GUI_SETTLE_FRAMES 2
+#define WINDOW_RESIZE_SETTLE_SECONDS 0.2
+#define TILESET_SELECTION_SECONDS 0.5 // Between selections of the tiles
+#define TARGET_SIZE_STEP 256 // Pixels targets grow by
+#define TEMPORAL_AA_FRAME_WEIGHT 0.1f
+#define DEFAULT_TARGET_FRAME_MS 16.f
+#define DEFAULT_UPSCALE_SHARPNESS 0.5f
+#define BENCH_ANIMATION_FPS 60.f
+#define ENVIRONMENT_BAKE_BUDGET_MS 4.f
+#define SCENE_UPDATE_CHUNK_SIZE 256
+#define LOD_PIXEL_ERROR 1.f
+#define LOD_DEFAULT_SCREEN_COVERAGE 0.25f
+#define AO_DEFAULT_RADIUS 0.05f
+// Pixels the largest visible item of a primitive projects to below which it
+// is shaded with the cheaper permutation, see drawPermutation
+#define SHADING_LOD_DEFAULT_PIXELS 32.f
+// Pixels the bounding sphere of an object with an impostor projects to below
+// which it is drawn as its impostor, see captureImpostors
+#define IMPOSTOR_DEFAULT_PIXELS 48.f
+// Software occlusion culling: occluders of up to OCCLUDER_MAX_TRIANGLES
+// triangles, never of a level of detail, the OCCLUDER_MAX_COUNT largest of
+// the frame whose bounding sphere covers at least OCCLUDER_MIN_COVERAGE of the
+// viewport height, drawn into a buffer OCCLUSION_BUFFER_WIDTH pixels wide
+#define OCCLUDER_MAX_TRIANGLES 4096
+#define OCCLUDER_MAX_COUNT 64
+#define OCCLUDER_MIN_COVERAGE 0.1f
+#define OCCLUSION_BUFFER_WIDTH 320
+// Fitted depth range of a frame, as factors of the depths of the visible boxes
+#define DEPTH_RANGE_NEAR_MARGIN 0.5f
+#define DEPTH_RANGE_FAR_MARGIN 1.05f
+#define MAX_VIEWS 4 // Drawn in one window frame, see drawQuadViews
+#define STEREO_EYE_SEPARATION 0.064f // Meters, the unit of glTF
+
+// Bit i of the feature mask of a PBR program variant is set if the material
+// has the map of texture unit i, the next two bits by its alpha mode. The
+// next one replaces the occlusion map bit when occlusion is the red channel of
+// the metallic-roughness texture, sampled once. The next two are set for
+// every material by the wireframe overlay and by vertex pulling, the last
+// one for the draws of distant primitives, which drop their normal map.
+static const std::vector<std::string> PBR_FEATURE_DEFINES = {
+    "HAS_BASE_COLOR_MAP", "HAS_METALLIC_ROUGHNESS_MAP", "HAS_EMISSIVE_MAP",
+    "HAS_OCCLUSION_MAP", "HAS_NORMAL_MAP", "ALPHA_MASK", "ALPHA_BLEND",
+    "OCCLUSION_FROM_METALLIC_ROUGHNESS", "WIREFRAME", "PULL_VERTICES",
+    "SHADING_LOD"};
+static const uint32_t PBR_OCCLUSION_MAP = 1u << 3;
+static const uint32_t PBR_NORMAL_MAP = 1u << 4;
+static const uint32_t PBR_ALPHA_MASK = 1u << 5;
+static const uint32_t PBR_ALPHA_BLEND = 1u << 6;
+static const uint32_t PBR_SHARED_OCCLUSION = 1u << 7;
+static const uint32_t PBR_WIREFRAME = 1u << 8;
+static const uint32_t PBR_PULL_VERTICES = 1u << 9;
+static const uint32_t PBR_SHADING_LOD = 1u << 10;
+
+static_assert(VERTEX_ATTRIB_POSITION_IDX == VERTEX_ATTRIBUTE_POSITION &&
+                  VERTEX_ATTRIB_NORMAL_IDX == VERTEX_ATTRIBUTE_NORMAL &&
+                  VERTEX_ATTRIB_TEXCOORD0_IDX == VERTEX_ATTRIBUTE_TEXCOORD0 &&
+                  VERTEX_ATTRIB_JOINTS0_IDX == VERTEX_ATTRIBUTE_JOINTS0 &&
+                  VERTEX_ATTRIB_WEIGHTS0_IDX == VERTEX_ATTRIBUTE_WEIGHTS0 &&
+                  VERTEX_ATTRIB_TANGENT_IDX == VERTEX_ATTRIBUTE_TANGENT &&
+                  VERTEX_ATTRIB_DRAW_INDEX_IDX == VERTEX_ATTRIBUTE_COUNT,
+    "Vertex layouts read attribute i at location i");
 
 void keyCallback(
     GLFWwindow *window, int key, int scancode, int action, int mods)
@@ -34,186 +241,298 @@ void keyCallback(
 
 bool ViewerApplication::loadGltfFile(tinygltf::Model& model)
 {
+	TRACE_ZONE("loadGltfFile");
 	std::string err;
 	std::string warn;
 
-	bool ret = m_gltfLoader.LoadASCIIFromFile(&model, &err, &warn, m_gltfFilePath.string());
+	const auto report = [&]()
+	{
+		if (!err.empty())
+		{
+			std::cerr << "Error: " << err << std::endl;
+		}
+
+		if (!warn.empty())
+		{
+			std::cerr << "Warning: " << warn << std::endl;
+		}
+
+		err.clear();
+		warn.clear();
+	};
 
-	if (!err.empty())
+	// .glb files are detected by their magic, and their BIN chunk is used in
+	// place by createBufferObjects through m_gltfBuffers
+	if (m_sceneFiles.size() == 1 && !m_sceneFiles[0].hasTransform())
 	{
-		std::cerr << "Error: " << err << std::endl;
+		PrefetchedModel prefetched;
+		bool ret = false;
+
+		if (m_prefetcher
+			&& m_prefetcher->take(m_sceneFiles[0].path, prefetched))
+		{
+			model = std::move(prefetched.model);
+			m_gltfBuffers = std::move(prefetched.buffers);
+			err = std::move(prefetched.err);
+			warn = std::move(prefetched.warn);
+			ret = prefetched.loaded;
+		}
+		else
+		{
+			ret = loadGltfModel(
+				m_gltfLoader,
+				m_sceneFiles[0].path,
+				model,
+				m_gltfBuffers,
+				err,
+				warn,
+				m_lazyTextures,
+				m_gltfParser);
+		}
+		report();
+
+		// duplicate images have been decoded once, the textures sampling
+		// them are uploaded once
+		if (ret)
+		{
+			const auto sharedTextures = shareSameImageTextures(model);
+
+			if (sharedTextures > 0)
+			{
+				std::clog << sharedTextures << " identical textures shared"
+					<< std::endl;
+			}
+		}
+
+		return ret;
 	}
 
-	if (!warn.empty())
+	// Each file is appended to the model under a node with its transform
+	model = tinygltf::Model();
+	model.defaultScene = 0;
+	m_gltfBuffers.clear();
+
+	// files are read and parsed by concurrent jobs, each with its own
+	// loader, then appended in order
+	const auto fileCount = m_sceneFiles.size();
+	std::vector<tinygltf::Model> fileModels(fileCount);
+	std::vector<GltfBuffers> fileBuffers(fileCount);
+	std::vector<std::string> fileErrors(fileCount);
+	std::vector<std::string> fileWarnings(fileCount);
+	std::vector<char> loaded(fileCount, 0);
+
+	JobSystem::shared().parallelFor(fileCount, 1, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			tinygltf::TinyGLTF loader;
+			loaded[i] = loadGltfModel(
+				loader,
+				m_sceneFiles[i].path,
+				fileModels[i],
+				fileBuffers[i],
+				fileErrors[i],
+				fileWarnings[i],
+				m_lazyTextures,
+				m_gltfParser);
+		}
+	});
+
+	for (size_t i = 0; i < fileCount; ++i)
 	{
-		std::cerr << "Warning: " << warn << std::endl;
+		err = std::move(fileErrors[i]);
+		warn = std::move(fileWarnings[i]);
+		report();
+
+		if (!loaded[i])
+		{
+			return false;
+		}
+
+		appendGltfModel(
+			model,
+			m_gltfBuffers,
+			std::move(fileModels[i]),
+			std::move(fileBuffers[i]),
+			m_sceneFiles[i]);
 	}
 
-	return ret;
+	const auto sharedTextures = shareIdenticalTextures(model);
+
+	std::clog << "Merged " << m_sceneFiles.size() << " models, "
+		<< sharedTextures << " identical textures shared" << std::endl;
+
+	return true;
 }
 
-GLuint ViewerApplication::loadEnvTexture()
+bool ViewerApplication::readEnvironmentImage(
+	const fs::path &path,
+	EnvironmentImage &image)
 {
-	GLuint envTexture = 0;
-
-	if (!m_cubeMapFilePath.string().empty())
-	{
-		stbi_set_flip_vertically_on_load(true);
+	TRACE_ZONE("readEnvironmentImage");
 
-		int components;
-		int width;
-		int height;
+	// Radiance files are uploaded as they are stored, 4 bytes per texel
+	// instead of 12, and decoded on the GPU by the equirectangular pass
+	std::string err;
 
-		float *data = stbi_loadf(
-			m_cubeMapFilePath.c_str(),
-			&width,
-			&height,
-			&components,
-			0);
+	if (loadRgbeImage(path, image.rgbe, err))
+	{
+		image.width = image.rgbe.width;
+		image.height = image.rgbe.height;
 
-		if (data)
-		{
-			glGenTextures(1, &envTexture);
-			glBindTexture(GL_TEXTURE_2D, envTexture);
+		return true;
+	}
 
-			glTexImage2D(
-				GL_TEXTURE_2D,
-				0,
-				GL_RGB16F,
-				width,
-				height,
-				0,
-				GL_RGB,
-				GL_FLOAT,
-				data);
+	// other formats stb_image reads, as floats
+	int components;
+	float *data = stbi_loadf(
+		path.string().c_str(),
+		&image.width,
+		&image.height,
+		&components,
+		3);
 
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-			stbi_image_free(data);
-		}
-		else
-		{
-			std::cerr << "Failed to load cubemap" << std::endl;
-		}
+	if (!data)
+	{
+		return false;
 	}
 
-	return envTexture;
+	// Not stbi_set_flip_vertically_on_load, which is global and would
+	// also flip the images being decoded by the model loader thread
+	flipImageYAxis(image.width, image.height, 3, data);
+	image.floats.assign(data, data + size_t(image.width) * image.height * 3);
+	stbi_image_free(data);
+
+	return true;
 }
 
-GLuint ViewerApplication::loadCorrectedEnvTexture()
+GLuint ViewerApplication::uploadEnvironmentImage(
+	const EnvironmentImage &image,
+	bool &rgbe)
 {
-	// prepare framebuffer to render to texture
-	GLuint captureFBO;
-	GLuint captureRBO;
-	glGenFramebuffers(1, &captureFBO);
-	glGenRenderbuffers(1, &captureRBO);
+	GLuint envTexture = 0;
+	rgbe = !image.rgbe.pixels.empty();
 
-	glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
-	glBindRenderbuffer(GL_RENDERBUFFER, captureRBO);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, SKYBOX_SIZE, SKYBOX_SIZE);
-	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, captureRBO);
+	if (!rgbe && image.floats.empty())
+	{
+		return envTexture;
+	}
 
-	// prepare output texture
-	GLuint envTexture;
+	TRACE_ZONE("uploadEnvironmentImage");
 	glGenTextures(1, &envTexture);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, envTexture);
+	glBindTexture(GL_TEXTURE_2D, envTexture);
 
-	for (GLuint i = 0; i < 6; ++i)
+	if (rgbe)
+	{
+		glTexStorage2D(
+			GL_TEXTURE_2D,
+			1,
+			GL_RGBA8,
+			image.width,
+			image.height);
+		glTexSubImage2D(
+			GL_TEXTURE_2D,
+			0,
+			0,
+			0,
+			image.width,
+			image.height,
+			GL_RGBA,
+			GL_UNSIGNED_BYTE,
+			image.rgbe.pixels.data());
+
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	}
+	else
 	{
 		glTexImage2D(
-			GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
+			GL_TEXTURE_2D,
 			0,
 			GL_RGB16F,
-			SKYBOX_SIZE,
-			SKYBOX_SIZE,
+			image.width,
+			image.height,
 			0,
 			GL_RGB,
 			GL_FLOAT,
-			nullptr);
-	}
-
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-	// cubemap-correction shaders
-	const auto glslCubemapProgram =
-		compileProgram({
-			m_ShadersRootPath / m_AppName / m_cubemapVertexShader,
-			m_ShadersRootPath / m_AppName / m_cubemapFragmentShader});
-
-	const auto cubemapEquirectangularMapLocation =
-		glGetUniformLocation(glslCubemapProgram.glId(), "uEquirectangularMap");
-	const auto cubemapModelProjMatrixLocation =
-		glGetUniformLocation(glslCubemapProgram.glId(), "uModelProjMatrix");
-	const auto cubemapModelViewMatrixLocation =
-		glGetUniformLocation(glslCubemapProgram.glId(), "uModelViewMatrix");
-
-	glslCubemapProgram.use();
-	glUniform1i(cubemapEquirectangularMapLocation, 0);
-	glUniformMatrix4fv(
-		cubemapModelProjMatrixLocation,
-		1,
-		GL_FALSE,
-		glm::value_ptr(m_captureProjection));
+			image.floats.data());
 
-	// load non-corrected cubemap texture
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, loadEnvTexture());
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	}
 
-	// render corrected cubemap texture
-	glViewport(0, 0, SKYBOX_SIZE, SKYBOX_SIZE);
-	glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
+	glBindTexture(GL_TEXTURE_2D, 0);
 
-	for (unsigned int i = 0; i < 6; ++i)
-	{
-		glUniformMatrix4fv(
-			cubemapModelViewMatrixLocation,
-			1,
-			GL_FALSE,
-			glm::value_ptr(m_captureViews[i]));
+	return envTexture;
+}
 
-		glFramebufferTexture2D(
-			GL_FRAMEBUFFER,
-			GL_COLOR_ATTACHMENT0, 
-			GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-			envTexture,
-			0);
+// Matrix taking the normals of a draw to world space, the inverse transpose of
+// the linear part of its model matrix in the columns of a std430 mat3. With a
+// uniform scale the linear part has the same directions, the shader
+// normalizes them.
+static glm::mat3x4 normalMatrix(const glm::mat4 &modelMatrix)
+{
+	const glm::mat3 linear(modelMatrix);
+	const glm::vec3 lengths(glm::dot(linear[0], linear[0]),
+		glm::dot(linear[1], linear[1]), glm::dot(linear[2], linear[2]));
+	const float tolerance =
+		1e-5f * std::max({lengths.x, lengths.y, lengths.z});
+	const bool uniformScale = std::abs(lengths.x - lengths.y) <= tolerance
+		&& std::abs(lengths.x - lengths.z) <= tolerance
+		&& std::abs(glm::dot(linear[0], linear[1])) <= tolerance
+		&& std::abs(glm::dot(linear[0], linear[2])) <= tolerance
+		&& std::abs(glm::dot(linear[1], linear[2])) <= tolerance;
+	// Degenerate matrices flatten the draw, whose normals are then left as is
+	const glm::mat3 normal = uniformScale || glm::determinant(linear) == 0.f
+		? linear
+		: glm::transpose(glm::inverse(linear));
+	return glm::mat3x4(glm::vec4(normal[0], 0), glm::vec4(normal[1], 0),
+		glm::vec4(normal[2], 0));
+}
 
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+// Width or height of a render target grown to hold size pixels. Targets only
+// grow, by steps, so that resizing the window reallocates them now and then
+// rather than at every frame, and smaller images use a corner of them.
+static GLsizei grownTargetSize(GLsizei current, GLsizei size)
+{
+	return size <= current
+		? current
+		: (size + TARGET_SIZE_STEP - 1) / TARGET_SIZE_STEP * TARGET_SIZE_STEP;
+}
 
-		renderCube();
-	}
+// GL component type, component count, offset and whether normalized of a
+// vertex attribute, as the shaders pulling vertices from storage buffers read
+// them
+static glm::ivec4 pulledVertexAttribute(const VertexFormat::Attribute &attribute)
+{
+	return glm::ivec4(GLint(attribute.componentType),
+		attribute.componentCount,
+		GLint(attribute.offset),
+		attribute.normalized ? 1 : 0);
+}
 
-	// restore framebuffer state
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+// Trilinear sampler of the environment for the bake, the environment texture
+// itself only samples its first level
+static GLSampler environmentLevelsSampler()
+{
+	GLSampler sampler;
+	sampler.generate();
+	glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-	return envTexture;
+	return sampler;
 }
 
-GLuint ViewerApplication::computeIrradianceMap(GLuint envCubemap)
+// Cube map of size with levels levels, image load/store has no RGB formats
+static GLuint createBakedCubeMap(GLsizei size, GLsizei levels)
 {
-	GLuint irradianceMap;
-	glGenTextures(1, &irradianceMap);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, irradianceMap);
+	GLuint cubeMap;
+	glGenTextures(1, &cubeMap);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMap);
 
-	for (GLuint i = 0; i < 6; ++i)
-	{
-		glTexImage2D(
-			GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-			0,
-			GL_RGB16F,
-			IRRADIANCEMAP_SIZE,
-			IRRADIANCEMAP_SIZE,
-			0, 
-			GL_RGB,
-			GL_FLOAT,
-			nullptr);
-	}
+	glTexStorage2D(GL_TEXTURE_CUBE_MAP, levels, GL_RGBA16F, size, size);
 
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
@@ -221,201 +540,385 @@ GLuint ViewerApplication::computeIrradianceMap(GLuint envCubemap)
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-	// prepare framebuffer to render to texture
-	GLuint captureFBO;
-	GLuint captureRBO;
-	glGenFramebuffers(1, &captureFBO);
-	glGenRenderbuffers(1, &captureRBO);
+	return cubeMap;
+}
 
-	glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
-	glBindRenderbuffer(GL_RENDERBUFFER, captureRBO);
+// Make the writes of a bake step visible to the texture fetches and read
+// backs of the next ones, and unbind what the step bound to unit 0
+static void finishBakeStep()
+{
+	glMemoryBarrier(
+		GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
 
-	glRenderbufferStorage(
-		GL_RENDERBUFFER,
-		GL_DEPTH_COMPONENT24,
-		IRRADIANCEMAP_SIZE,
-		IRRADIANCEMAP_SIZE);
+	glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+	glBindSampler(0, 0);
+}
 
-	glFramebufferRenderbuffer(
-		GL_FRAMEBUFFER,
-		GL_DEPTH_ATTACHMENT,
-		GL_RENDERBUFFER,
-		captureRBO);
+std::unique_ptr<ViewerApplication::EnvironmentBake>
+ViewerApplication::startEnvironmentBake(
+	const fs::path &cubeMapFile,
+	const EnvironmentImage &image,
+	const IblOptions &options,
+	bool bakeBrdfLut,
+	GLuint facesPerStep)
+{
+	TRACE_ZONE("startEnvironmentBake");
+	auto bake = std::make_unique<EnvironmentBake>();
+	auto *b = bake.get();
+	b->cubeMapFile = cubeMapFile;
+	b->options = options;
+	b->cacheable = initIblCacheKey(cubeMapFile, options, b->cacheKey);
+
+	const auto shaders = m_ShadersRootPath / m_AppName;
+	b->equirectangularProgram =
+		compileProgram({shaders / m_equirectangularComputeShader});
+	b->irradianceProgram =
+		compileProgram({shaders / m_irradianceComputeShader});
+	b->prefilterProgram =
+		compileProgram({shaders / m_prefilterComputeShader});
+	b->mipGenerator.init(shaders / m_mipmapComputeShader);
+
+	bool rgbe;
+	b->equirectangular.reset(uploadEnvironmentImage(image, rgbe));
+	b->environmentLevels = environmentLevelsSampler();
+
+	// The mipmaps of the environment are only read by the bake, through
+	// environmentLevels
+	const GLuint skyboxSize = options.skyboxSize;
+	const GLuint irradianceSize = options.irradianceMapSize;
+	const GLuint prefilterSize = options.prefilterMapSize;
+	b->environment.reset(createBakedCubeMap(
+		GLsizei(skyboxSize), GLsizei(std::log2(skyboxSize)) + 1));
+	b->irradiance.reset(createBakedCubeMap(GLsizei(irradianceSize), 1));
+	b->prefilter.reset(createBakedCubeMap(
+		GLsizei(prefilterSize), GLsizei(options.prefilterMapLevels)));
+	// still bound, its levels are sampled by roughness
+	glTexParameteri(
+		GL_TEXTURE_CUBE_MAP,
+		GL_TEXTURE_MIN_FILTER,
+		GL_LINEAR_MIPMAP_LINEAR);
+
+	// Steps cost about their texture fetches. The shader pass of the BRDF LUT
+	// is only needed when the baked LUT is missing.
+	auto &steps = b->steps;
+
+	if (bakeBrdfLut)
+	{
+		b->brdfLut.reset(loadBakedBRDF(options.brdfLutSize));
 
-	// irradiance convolution shader
-	const auto glslIrradianceProgram =
-		compileProgram({
-			m_ShadersRootPath / m_AppName / m_cubemapVertexShader,
-			m_ShadersRootPath / m_AppName / m_irradianceFragmentShader});
-
-	const auto irradianceEnvironmentMapLocation =
-		glGetUniformLocation(glslIrradianceProgram.glId(), "uEnvironmentMap");
-	const auto irradianceModelProjMatrixLocation =
-		glGetUniformLocation(glslIrradianceProgram.glId(), "uModelProjMatrix");
-	const auto irradianceModelViewMatrixLocation =
-		glGetUniformLocation(glslIrradianceProgram.glId(), "uModelViewMatrix");
-
-	glslIrradianceProgram.use();
-	glUniform1i(irradianceEnvironmentMapLocation, 0);
-	glUniformMatrix4fv(
-		irradianceModelProjMatrixLocation,
-		1,
-		GL_FALSE,
-		glm::value_ptr(m_captureProjection));
+		if (!b->brdfLut)
+		{
+			steps.push_back({
+				"BRDF LUT",
+				double(options.brdfLutSize) * options.brdfLutSize * 1024,
+				[this, b]()
+				{
+					b->brdfLut.reset(integrateBRDF(b->options.brdfLutSize));
+				}});
+		}
+	}
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, envCubemap);
+	for (GLuint firstFace = 0; firstFace < 6; firstFace += facesPerStep)
+	{
+		const GLuint faces = std::min(facesPerStep, 6 - firstFace);
 
-	glViewport(0, 0, IRRADIANCEMAP_SIZE, IRRADIANCEMAP_SIZE);
-	glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
+		steps.push_back({
+			"Environment",
+			double(skyboxSize) * skyboxSize * faces * 4,
+			[b, rgbe, firstFace, faces, skyboxSize]()
+			{
+				const auto &program = b->equirectangularProgram;
+				program.use();
+				program.setUniform("uEquirectangularMap", 0);
+				program.setUniform("uRgbe", rgbe ? 1 : 0);
+				program.setUniform("uFirstFace", GLint(firstFace));
+
+				glActiveTexture(GL_TEXTURE0);
+				glBindTexture(GL_TEXTURE_2D, b->equirectangular);
+				glBindSampler(0, 0);
+				glBindImageTexture(
+					0,
+					b->environment,
+					0,
+					GL_TRUE,
+					0,
+					GL_WRITE_ONLY,
+					GL_RGBA16F);
+
+				glDispatchCompute(
+					(skyboxSize + 7) / 8,
+					(skyboxSize + 7) / 8,
+					faces);
+				finishBakeStep();
+			}});
+	}
 
-	for (unsigned int i = 0; i < 6; ++i)
+	steps.push_back({
+		"Environment",
+		double(skyboxSize) * skyboxSize * 6,
+		[b, skyboxSize]()
+		{
+			// the negative lobes of sharper filters ring around the sun
+			b->mipGenerator.generate(
+				GL_TEXTURE_CUBE_MAP,
+				b->environment,
+				GL_RGBA16F,
+				GLsizei(skyboxSize),
+				GLsizei(skyboxSize),
+				GLsizei(std::log2(skyboxSize)) + 1,
+				MipFilter::Box,
+				false);
+			b->equirectangular.reset();
+		}});
+
+	const int irradianceSamples =
+		options.fastBake ? IRRADIANCE_FAST_SAMPLES : IRRADIANCE_SAMPLES;
+
+	for (GLuint firstFace = 0; firstFace < 6; firstFace += facesPerStep)
 	{
-		glUniformMatrix4fv(
-			irradianceModelViewMatrixLocation,
-			1,
-			GL_FALSE,
-			glm::value_ptr(m_captureViews[i]));
-
-		glFramebufferTexture2D(
-			GL_FRAMEBUFFER,
-			GL_COLOR_ATTACHMENT0, 
-			GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-			irradianceMap,
-			0);
+		const GLuint faces = std::min(facesPerStep, 6 - firstFace);
 
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		renderCube();
+		steps.push_back({
+			"Irradiance",
+			double(irradianceSize) * irradianceSize * faces * irradianceSamples,
+			[b, firstFace, faces, irradianceSize, skyboxSize, irradianceSamples]()
+			{
+				const auto &program = b->irradianceProgram;
+				program.use();
+				program.setUniform("uEnvironmentMap", 0);
+				program.setUniform("uResolution", float(skyboxSize));
+				program.setUniform("uSampleCount", irradianceSamples);
+				program.setUniform("uFirstFace", GLint(firstFace));
+
+				glActiveTexture(GL_TEXTURE0);
+				glBindTexture(GL_TEXTURE_CUBE_MAP, b->environment);
+				glBindSampler(0, b->environmentLevels);
+				glBindImageTexture(
+					0,
+					b->irradiance,
+					0,
+					GL_TRUE,
+					0,
+					GL_WRITE_ONLY,
+					GL_RGBA16F);
+
+				glDispatchCompute(
+					(irradianceSize + 7) / 8,
+					(irradianceSize + 7) / 8,
+					faces);
+				finishBakeStep();
+			}});
 	}
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	// The GGX lobe widens with roughness, so do the samples needed to cover
+	// it. The first level, without roughness, is a downsampled copy of the
+	// environment, and the cheapest although it has the most texels.
+	const int maxSamples =
+		options.fastBake ? PREFILTER_FAST_SAMPLES : PREFILTER_SAMPLES;
+	const GLuint levels = options.prefilterMapLevels;
 
-	return irradianceMap;
-}
+	for (GLuint mip = 0; mip < levels; ++mip)
+	{
+		const GLuint mipSize = std::max(prefilterSize >> mip, 1u);
+		const float roughness = (float) mip / (float) (levels - 1);
+		const int samples = std::max(int(roughness * maxSamples), 1);
 
-GLuint ViewerApplication::prefilterEnvironmentMap(GLuint envCubemap)
-{
-	GLuint prefilterMap;
-	glGenTextures(1, &prefilterMap);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, prefilterMap);
+		for (GLuint firstFace = 0; firstFace < 6; firstFace += facesPerStep)
+		{
+			const GLuint faces = std::min(facesPerStep, 6 - firstFace);
 
-	for (GLuint i = 0; i < 6; ++i)
+			steps.push_back({
+				"Prefilter",
+				double(mipSize) * mipSize * faces * samples,
+				[b, mip, mipSize, roughness, samples, firstFace, faces, skyboxSize]()
+				{
+					const auto &program = b->prefilterProgram;
+					program.use();
+					program.setUniform("uEnvironmentMap", 0);
+					program.setUniform("uResolution", float(skyboxSize));
+					program.setUniform("uRoughness", roughness);
+					program.setUniform("uSampleCount", samples);
+					program.setUniform("uFirstFace", GLint(firstFace));
+
+					glActiveTexture(GL_TEXTURE0);
+					glBindTexture(GL_TEXTURE_CUBE_MAP, b->environment);
+					glBindSampler(0, b->environmentLevels);
+					glBindImageTexture(
+						0,
+						b->prefilter,
+						mip,
+						GL_TRUE,
+						0,
+						GL_WRITE_ONLY,
+						GL_RGBA16F);
+
+					glDispatchCompute(
+						(mipSize + 7) / 8,
+						(mipSize + 7) / 8,
+						faces);
+					finishBakeStep();
+				}});
+		}
+	}
+
+	// The compressed maps replace the baked ones once no step reads these
+	// anymore. The environment keeps its first level only, as in the cache.
+	if (options.compressed)
 	{
-		glTexImage2D(
-			GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-			0,
-			GL_RGB16F,
-			PREFILTERMAP_SIZE,
-			PREFILTERMAP_SIZE,
-			0,
-			GL_RGB,
-			GL_FLOAT,
-			nullptr);
+		b->compressProgram =
+			compileProgram({shaders / m_bc6hEncodeComputeShader});
+		const auto addCompressStep =
+			[&](GLTexture EnvironmentBake::*map, GLuint size, GLuint levels)
+		{
+			if (!bc6hCompressible(size))
+			{
+				return;
+			}
+			steps.push_back({
+				"Compress",
+				double(size) * size * 6,
+				[b, map, size, levels]()
+				{
+					auto &texture = b->*map;
+					texture.reset(compressCubeMapBc6h(
+						b->compressProgram,
+						texture,
+						GLsizei(size),
+						GLsizei(levels)));
+				}});
+		};
+		addCompressStep(&EnvironmentBake::environment, skyboxSize, 1);
+		addCompressStep(&EnvironmentBake::irradiance, irradianceSize, 1);
+		addCompressStep(&EnvironmentBake::prefilter, prefilterSize, levels);
 	}
 
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	for (const auto &step : steps)
+	{
+		b->totalCost += step.cost;
+	}
 
-	// this is how we tell opengl to render to mipmaps too
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR); 
+	return bake;
+}
 
-	// automatic allocation
-	glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+std::unique_ptr<ViewerApplication::EnvironmentMaps>
+ViewerApplication::finishEnvironmentBake(
+	EnvironmentBake &bake,
+	EnvironmentMaps *previous)
+{
+	TRACE_ZONE("finishEnvironmentBake");
+	auto maps = std::make_unique<EnvironmentMaps>();
+	maps->cubeMapFile = bake.cubeMapFile;
+	maps->options = bake.options;
+	maps->environment = std::move(bake.environment);
+	maps->irradiance = std::move(bake.irradiance);
+	maps->prefilter = std::move(bake.prefilter);
+	maps->brdfLut = bake.brdfLut || !previous
+		? std::move(bake.brdfLut)
+		: std::move(previous->brdfLut);
+
+	if (bake.cacheable)
+	{
+		IblTextures ibl;
+		ibl.environment = maps->environment;
+		ibl.irradiance = maps->irradiance;
+		ibl.prefilter = maps->prefilter;
+		ibl.brdfLut = maps->brdfLut;
 
-	// prepare framebuffer to render to texture
-	GLuint captureFBO;
-	GLuint captureRBO;
-	glGenFramebuffers(1, &captureFBO);
-	glGenRenderbuffers(1, &captureRBO);
+		const auto file = iblCacheFile(
+			m_AppPath.parent_path() / "cache",
+			bake.cacheKey);
 
-	glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
-	glBindRenderbuffer(GL_RENDERBUFFER, captureRBO);
+		if (!saveIblCache(file, bake.cacheKey, ibl))
+		{
+			std::cerr << "Unable to write IBL cache " << file << std::endl;
+		}
+	}
 
-	glRenderbufferStorage(
-		GL_RENDERBUFFER,
-		GL_DEPTH_COMPONENT24,
-		PREFILTERMAP_SIZE,
-		PREFILTERMAP_SIZE);
+	// Diffuse lighting can also be evaluated from spherical harmonics, which
+	// saves the irradiance map fetch in the fragment shader
+	maps->shIrradiance =
+		projectShIrradiance(maps->environment, bake.options.skyboxSize);
 
-	glFramebufferRenderbuffer(
-		GL_FRAMEBUFFER,
-		GL_DEPTH_ATTACHMENT,
-		GL_RENDERBUFFER,
-		captureRBO);
+	return maps;
+}
 
-	// pre-filtering shader
-	const auto glslIrradianceProgram =
-		compileProgram({
-			m_ShadersRootPath / m_AppName / m_cubemapVertexShader,
-			m_ShadersRootPath / m_AppName / m_prefilterFragmentShader});
-
-	const auto prefilterEnvironmentMapLocation =
-		glGetUniformLocation(glslIrradianceProgram.glId(), "uEnvironmentMap");
-	const auto prefilterModelProjMatrixLocation =
-		glGetUniformLocation(glslIrradianceProgram.glId(), "uModelProjMatrix");
-	const auto prefilterModelViewMatrixLocation =
-		glGetUniformLocation(glslIrradianceProgram.glId(), "uModelViewMatrix");
-	const auto prefilterRoughnessLocation =
-		glGetUniformLocation(glslIrradianceProgram.glId(), "uRoughness");
-	const auto prefilterResolutionLocation =
-		glGetUniformLocation(glslIrradianceProgram.glId(), "uResolution");
-
-	glslIrradianceProgram.use();
-	glUniform1i(prefilterEnvironmentMapLocation, 0);
-	glUniform1f(prefilterResolutionLocation, SKYBOX_SIZE);
-	glUniformMatrix4fv(
-		prefilterModelProjMatrixLocation,
-		1,
-		GL_FALSE,
-		glm::value_ptr(m_captureProjection));
+std::unique_ptr<ViewerApplication::EnvironmentMaps>
+ViewerApplication::loadCachedEnvironmentMaps(
+	const fs::path &cubeMapFile,
+	const IblOptions &options)
+{
+	IblCacheKey key;
+	IblTextures ibl;
+
+	if (!initIblCacheKey(cubeMapFile, options, key)
+		|| !loadIblCache(
+			iblCacheFile(m_AppPath.parent_path() / "cache", key),
+			key,
+			ibl))
+	{
+		return nullptr;
+	}
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, envCubemap);
-	glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
+	auto maps = std::make_unique<EnvironmentMaps>();
+	maps->cubeMapFile = cubeMapFile;
+	maps->options = options;
+	maps->brdfLut.reset(ibl.brdfLut);
+	maps->environment.reset(ibl.environment);
+	maps->irradiance.reset(ibl.irradiance);
+	maps->prefilter.reset(ibl.prefilter);
+	maps->shIrradiance =
+		projectShIrradiance(ibl.environment, options.skyboxSize);
+
+	return maps;
+}
+
+GLuint ViewerApplication::loadBakedBRDF(GLuint size)
+{
+	// baked at build time by tools/bake_brdf_lut.cpp, RG16F texels
+	const auto path =
+		m_AppPath.parent_path() / "assets" / m_AppName / "brdf_lut.rg16f";
+	const size_t expectedSize = size_t(size) * size * 2 * sizeof(uint16_t);
 
-	GLuint maxMipLevels = 5;
+	std::ifstream input(path.string(), std::ios::binary | std::ios::ate);
 
-	for (GLuint mip = 0; mip < maxMipLevels; ++mip)
+	if (!input || size_t(input.tellg()) != expectedSize)
 	{
-		GLuint mipWidth = PREFILTERMAP_SIZE * std::pow(0.5, mip);
-		GLuint mipHeight = PREFILTERMAP_SIZE * std::pow(0.5, mip);
+		return 0;
+	}
 
-		glBindRenderbuffer(GL_RENDERBUFFER, captureRBO);
-		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, mipWidth, mipHeight);
-		glViewport(0, 0, mipWidth, mipHeight);
+	std::vector<char> texels(expectedSize);
+	input.seekg(0);
 
-		glUniform1f(
-			prefilterRoughnessLocation,
-			(float) mip / (float) (maxMipLevels - 1));
+	if (!input.read(texels.data(), expectedSize))
+	{
+		return 0;
+	}
 
-		for (GLuint i = 0; i < 6; ++i)
-		{
-			glUniformMatrix4fv(
-				prefilterModelViewMatrixLocation,
-				1,
-				GL_FALSE,
-				glm::value_ptr(m_captureViews[i]));
+	GLuint brdfLUTTexture;
+	glGenTextures(1, &brdfLUTTexture);
 
-			glFramebufferTexture2D(
-				GL_FRAMEBUFFER,
-				GL_COLOR_ATTACHMENT0, 
-				GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-				prefilterMap,
-				mip);
+	glBindTexture(GL_TEXTURE_2D, brdfLUTTexture);
 
-			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-			renderCube();
-		}
-	}
+	glTexImage2D(
+		GL_TEXTURE_2D,
+		0,
+		GL_RG16F,
+		size,
+		size,
+		0,
+		GL_RG,
+		GL_HALF_FLOAT,
+		texels.data());
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-	return prefilterMap;
+	return brdfLUTTexture;
 }
 
-GLuint ViewerApplication::integrateBRDF()
+GLuint ViewerApplication::integrateBRDF(GLuint size)
 {
 	GLuint brdfLUTTexture;
 	glGenTextures(1, &brdfLUTTexture);
@@ -426,8 +929,8 @@ GLuint ViewerApplication::integrateBRDF()
 		GL_TEXTURE_2D,
 		0,
 		GL_RG16F,
-		BRDF_LUT_SIZE,
-		BRDF_LUT_SIZE,
+		size,
+		size,
 		0,
 		GL_RG,
 		GL_FLOAT,
@@ -438,18 +941,18 @@ GLuint ViewerApplication::integrateBRDF()
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-	GLuint captureFBO;
-	GLuint captureRBO;
-	glGenFramebuffers(1, &captureFBO);
-	glGenRenderbuffers(1, &captureRBO);
+	GLFramebuffer captureFBO;
+	GLRenderbuffer captureRBO;
+	captureFBO.generate();
+	captureRBO.generate();
 	glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
 	glBindRenderbuffer(GL_RENDERBUFFER, captureRBO);
 
 	glRenderbufferStorage(
 		GL_RENDERBUFFER,
 		GL_DEPTH_COMPONENT24,
-		BRDF_LUT_SIZE,
-		BRDF_LUT_SIZE);
+		size,
+		size);
 
 	glFramebufferTexture2D(
 		GL_FRAMEBUFFER,
@@ -458,7 +961,7 @@ GLuint ViewerApplication::integrateBRDF()
 		brdfLUTTexture,
 		0);
 
-	glViewport(0, 0, BRDF_LUT_SIZE, BRDF_LUT_SIZE);
+	glViewport(0, 0, size, size);
 
 	const auto glslIntegrateProgram =
 		compileProgram({
@@ -474,25 +977,85 @@ GLuint ViewerApplication::integrateBRDF()
 	return brdfLUTTexture;
 }
 
-std::vector<GLuint> ViewerApplication::createBufferObjects(const tinygltf::Model& model)
+std::vector<GLuint> ViewerApplication::createBufferObjects(const PackedGeometry& geometry)
 {
-	size_t len = model.buffers.size();
+	TRACE_ZONE("createBufferObjects");
+	size_t len = geometry.vertexBuffers.size();
+
+	std::vector<GLuint> bo(len + 1, 0);
+	glGenBuffers(len + 1, bo.data());
+
+	const auto indexSize = indexTypeSize(geometry.indexType);
+	size_t totalSize = geometry.indices.size() * indexSize;
 
-	std::vector<GLuint> bo(len, 0);
-	glGenBuffers(len, bo.data());
+	for (const auto& vertexBuffer : geometry.vertexBuffers)
+	{
+		totalSize += vertexBuffer.vertices.size();
+	}
+
+	// The buffers get no storage flags and are filled with copies from the
+	// staging buffer, so that the GPU reads them from its own memory
+	BufferUploader uploader;
+
+	if (totalSize > 0)
+	{
+		uploader.init(std::min(
+			std::max(totalSize, size_t(BUFFER_STAGING_MIN_SIZE)),
+			size_t(BUFFER_STAGING_MAX_SIZE)));
+	}
 
 	for (size_t i = 0; i < len; ++i)
 	{
+		const auto& vertices = geometry.vertexBuffers[i].vertices;
+
 		glBindBuffer(GL_ARRAY_BUFFER, bo[i]);
 
+		// glBufferStorage does not accept a size of 0
 		glBufferStorage(
 			GL_ARRAY_BUFFER,
-			model.buffers[i].data.size(),
-			model.buffers[i].data.data(),
+			std::max(vertices.size(), size_t(1)),
+			nullptr,
 			0);
+		uploader.upload(bo[i], 0, vertices.data(), vertices.size());
+		trackBuffer(GpuMemoryCategory::Geometry, bo[i], vertices.size());
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, bo[len]);
+
+	glBufferStorage(
+		GL_ARRAY_BUFFER,
+		std::max(geometry.indices.size() * indexSize, sizeof(uint32_t)),
+		nullptr,
+		0);
+
+	if (geometry.indexType == GL_UNSIGNED_SHORT)
+	{
+		// Half the index bandwidth, for models whose primitives all have
+		// fewer than 65536 vertices
+		std::vector<uint16_t> shortIndices(geometry.indices.size());
+		JobSystem::shared().parallelFor(
+			shortIndices.size(),
+			size_t(1) << 20,
+			[&](size_t begin, size_t end)
+			{
+				std::copy(
+					geometry.indices.begin() + begin,
+					geometry.indices.begin() + end,
+					shortIndices.begin() + begin);
+			});
+		uploader.upload(bo[len], 0, shortIndices.data(),
+			shortIndices.size() * indexSize);
 	}
+	else
+	{
+		uploader.upload(bo[len], 0, geometry.indices.data(),
+			geometry.indices.size() * indexSize);
+	}
+	trackBuffer(GpuMemoryCategory::Geometry, bo[len],
+		geometry.indices.size() * indexSize);
 
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	uploader.finish();
 
 	return bo;
 }
@@ -545,8 +1108,8 @@ void ViewerApplication::initCube()
 		-1.0f,  1.0f,  1.0f,  0.0f,  1.0f,  0.0f, 0.0f, 0.0f  // bottom-left        
 	};
 
-	glGenVertexArrays(1, &m_unitCubeVAO);
-	glGenBuffers(1, &m_unitCubeVBO);
+	m_unitCubeVAO.generate();
+	m_unitCubeVBO.generate();
 
 	glBindBuffer(
 		GL_ARRAY_BUFFER,
@@ -556,6 +1119,7 @@ void ViewerApplication::initCube()
 		sizeof (vertices),
 		vertices,
 		GL_STATIC_DRAW);
+	trackBuffer(GpuMemoryCategory::Geometry, m_unitCubeVBO, sizeof (vertices));
 
 	glBindVertexArray(m_unitCubeVAO);
 	glEnableVertexAttribArray(0);
@@ -589,13 +1153,6 @@ void ViewerApplication::initCube()
 	glBindVertexArray(0);
 }
 
-void ViewerApplication::renderCube()
-{
-    glBindVertexArray(m_unitCubeVAO);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    glBindVertexArray(0);
-}
-
 void ViewerApplication::initQuad()
 {
 	float quadVertices[] =
@@ -606,11 +1163,12 @@ void ViewerApplication::initQuad()
 		 1.0f, -1.0f, 0.0f, 1.0f, 0.0f,
 	};
 
-	glGenVertexArrays(1, &m_quadVAO);
-	glGenBuffers(1, &m_quadVBO);
+	m_quadVAO.generate();
+	m_quadVBO.generate();
 	glBindVertexArray(m_quadVAO);
 	glBindBuffer(GL_ARRAY_BUFFER, m_quadVBO);
 	glBufferData(GL_ARRAY_BUFFER, sizeof (quadVertices), &quadVertices, GL_STATIC_DRAW);
+	trackBuffer(GpuMemoryCategory::Geometry, m_quadVBO, sizeof (quadVertices));
 	glEnableVertexAttribArray(0);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof (float), (void*) 0);
 	glEnableVertexAttribArray(1);
@@ -624,97 +1182,39 @@ void ViewerApplication::renderQuad()
     glBindVertexArray(0);
 }
 
-void vao_init(
+std::vector<GLuint> ViewerApplication::createVertexArrayObjects(
 	const tinygltf::Model& model,
-	const tinygltf::Primitive& primitive,
+	const PackedGeometry& geometry,
 	const std::vector<GLuint>& bufferObjects,
-	const char* str,
-	const GLuint index)
+	VertexLayoutCache& vertexLayouts,
+	std::vector<PrimitiveRange>& meshPrimitiveRanges)
 {
-	const auto iterator = primitive.attributes.find(str);
-
-	// If "POSITION" has been found in the map
-	if (iterator != end(primitive.attributes))
-	{
-		// (*iterator).first is the key "POSITION", (*iterator).second
-		// is the value, ie. the index of the accessor for this attribute
-		const auto accessorIdx = (*iterator).second;
-
-		// TODO get the correct tinygltf::Accessor from model.accessors
-		const auto& accessor = model.accessors[accessorIdx];
-
-		// TODO get the correct tinygltf::BufferView from model.bufferViews. You need use the accessor
-		const auto& bufferView = model.bufferViews[accessor.bufferView];
-
-		// TODO get the index of the buffer used by the bufferView (you need to use it)
-		const auto bufferIdx = bufferView.buffer;
-
-		// TODO get the correct buffer object from the buffer index
-		const auto bufferObject = model.buffers[bufferIdx];
-
-		// TODO Enable the vertex attrib array corresponding to POSITION with glEnableVertexAttribArray
-		// (you need to use VERTEX_ATTRIB_POSITION_IDX which is defined at the top of the file)
-		glEnableVertexAttribArray(index);
-
-		// TODO Bind the buffer object to GL_ARRAY_BUFFER
-		glBindBuffer(GL_ARRAY_BUFFER, bufferObjects[bufferIdx]);
-
-		// TODO Compute the total byte offset using the accessor and the buffer view
-		const auto byteOffset = bufferView.byteOffset + accessor.byteOffset;
-
-		// TODO Call glVertexAttribPointer with the correct arguments. 
-		// Remember size is obtained with accessor.type, type is obtained with accessor.componentType. 
-		// The stride is obtained in the bufferView, normalized is always GL_FALSE, and pointer is the byteOffset (cast).
-		glVertexAttribPointer(
-			index,
-			accessor.type,
-			accessor.componentType,
-			GL_FALSE,
-			bufferView.byteStride,
-			(const GLvoid*) byteOffset);
-	}
-}
-
-std::vector<GLuint> ViewerApplication::createVertexArrayObjects(
-	const tinygltf::Model& model,
-	const std::vector<GLuint>& bufferObjects,
-	std::vector<VaoRange>& meshIndexToVaoRange)
-{
-	std::vector<GLuint> vertexArrayObjects(0, 0);
-
-	size_t offset;
-	size_t primitive_len;
+	TRACE_ZONE("createVertexArrayObjects");
+	size_t offset = 0;
 	size_t mesh_len = model.meshes.size();
 
-	meshIndexToVaoRange.resize(mesh_len);
+	meshPrimitiveRanges.resize(mesh_len);
 
 	for (size_t i = 0; i < mesh_len; ++i)
 	{
-		offset = vertexArrayObjects.size();
-		primitive_len = model.meshes[i].primitives.size();
-
-		meshIndexToVaoRange[i].begin = (GLsizei) offset,
-		meshIndexToVaoRange[i].count = (GLsizei) primitive_len,
+		meshPrimitiveRanges[i].begin = (GLsizei) offset;
+		meshPrimitiveRanges[i].count = (GLsizei) model.meshes[i].primitives.size();
 
-		vertexArrayObjects.resize(offset + primitive_len);
-		glGenVertexArrays(primitive_len, vertexArrayObjects.data() + offset);
+		offset += model.meshes[i].primitives.size();
+	}
 
-		for (size_t k = 0; k < primitive_len; ++k)
-		{
-			glBindVertexArray(vertexArrayObjects[offset + k]);
-			const tinygltf::Primitive& primitive = model.meshes[i].primitives[k];
-			vao_init(model, primitive, bufferObjects, "POSITION", VERTEX_ATTRIB_POSITION_IDX);
-			vao_init(model, primitive, bufferObjects, "NORMAL", VERTEX_ATTRIB_NORMAL_IDX);
-			vao_init(model, primitive, bufferObjects, "TEXCOORD_0", VERTEX_ATTRIB_TEXCOORD0_IDX);
+	// The vertex array of each vertex buffer is the one of its layout, they all
+	// share the index buffer which comes last in bufferObjects
+	size_t len = geometry.vertexBuffers.size();
+	std::vector<GLuint> vertexArrayObjects(len, 0);
 
-			if (primitive.indices >= 0)
-			{
-				const auto& accessor = model.accessors[primitive.indices];
-				const auto& bufferView = model.bufferViews[accessor.bufferView];
+	for (size_t i = 0; i < len; ++i)
+	{
+		vertexArrayObjects[i] =
+			vertexLayouts.vertexArray(geometry.vertexBuffers[i].format);
 
-				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufferObjects[bufferView.buffer]);
-			}
-		}
+		glBindVertexArray(vertexArrayObjects[i]);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufferObjects[len]);
 	}
 
 	glBindVertexArray(0);
@@ -722,749 +1222,8866 @@ std::vector<GLuint> ViewerApplication::createVertexArrayObjects(
 	return vertexArrayObjects;
 }
 
-std::vector<GLuint> ViewerApplication::createTextureObjects(const tinygltf::Model &model) const
+std::vector<GLuint> ViewerApplication::createSamplerObjects(const tinygltf::Model &model) const
 {
-	size_t count = model.textures.size();
-	std::vector<GLuint> textureObjects(count);
-
-	for (size_t i = 0; i < count; ++i)
+	TRACE_ZONE("createSamplerObjects");
+	size_t count = model.samplers.size();
+	std::vector<GLuint> samplerObjects(count + 1);
+	glGenSamplers(GLsizei(count + 1), samplerObjects.data());
+
+	// default sampler, for textures without one
+	tinygltf::Sampler defaultSampler;
+	defaultSampler.minFilter = GL_LINEAR;
+	defaultSampler.magFilter = GL_LINEAR;
+	defaultSampler.wrapS = GL_REPEAT;
+	defaultSampler.wrapT = GL_REPEAT;
+	defaultSampler.wrapR = GL_REPEAT;
+
+	for (size_t i = 0; i <= count; ++i)
 	{
-		glGenTextures(1, &(textureObjects[i]));
-		glBindTexture(GL_TEXTURE_2D, textureObjects[i]);
-
-		// get texture
-		const auto& texture = model.textures[i];
+		const auto &sampler = (i < count) ? model.samplers[i] : defaultSampler;
 
-		// make image
-		assert(texture.source >= 0);
-		const auto& image = model.images[texture.source];
-
-		glTexImage2D(
-			GL_TEXTURE_2D,
-			0,
-			GL_RGBA,
-			image.width,
-			image.height,
-			0,
-			GL_RGBA,
-			image.pixel_type,
-			image.image.data());
-
-		// sampler
-		tinygltf::Sampler defaultSampler;
-		defaultSampler.minFilter = GL_LINEAR;
-		defaultSampler.magFilter = GL_LINEAR;
-		defaultSampler.wrapS = GL_REPEAT;
-		defaultSampler.wrapT = GL_REPEAT;
-		defaultSampler.wrapR = GL_REPEAT;
-
-		const auto &sampler =
-			(texture.sampler >= 0) ?
-				model.samplers[texture.sampler] : defaultSampler;
-
-		// parameters
-		glTexParameteri(
-			GL_TEXTURE_2D,
+		glSamplerParameteri(
+			samplerObjects[i],
 			GL_TEXTURE_MIN_FILTER,
 			(sampler.minFilter != -1) ?
 				sampler.minFilter : GL_LINEAR);
-		glTexParameteri(
-			GL_TEXTURE_2D,
+		glSamplerParameteri(
+			samplerObjects[i],
 			GL_TEXTURE_MAG_FILTER,
 			(sampler.magFilter != -1) ?
 				sampler.magFilter : GL_LINEAR);
-		glTexParameteri(
-			GL_TEXTURE_2D,
+		glSamplerParameteri(
+			samplerObjects[i],
 			GL_TEXTURE_WRAP_S,
 			sampler.wrapS);
-		glTexParameteri(
-			GL_TEXTURE_2D,
+		glSamplerParameteri(
+			samplerObjects[i],
 			GL_TEXTURE_WRAP_T,
 			sampler.wrapT);
-		glTexParameteri(
-			GL_TEXTURE_2D,
+		glSamplerParameteri(
+			samplerObjects[i],
 			GL_TEXTURE_WRAP_R,
 			sampler.wrapR);
-
-		if((sampler.minFilter == GL_NEAREST_MIPMAP_NEAREST)
-		|| (sampler.minFilter == GL_NEAREST_MIPMAP_LINEAR)
-		|| (sampler.minFilter == GL_LINEAR_MIPMAP_NEAREST)
-		|| (sampler.minFilter == GL_LINEAR_MIPMAP_LINEAR))
-		{
-			glGenerateMipmap(GL_TEXTURE_2D);
-		}
 	}
 
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	return textureObjects;
+	return samplerObjects;
 }
 
-int ViewerApplication::run()
+GLuint ViewerApplication::createTextureObject(
+	const tinygltf::Model &model,
+	size_t textureIdx,
+	unsigned usage,
+	TextureStreamer *streamer,
+	MipGenerator &mipGenerator,
+	TextureUploader &uploader) const
 {
-  glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+	// get texture
+	const auto& texture = model.textures[textureIdx];
 
-  // Loader shaders
-  const auto glslProgram =
-      compileProgram({
-		  m_ShadersRootPath / m_AppName / m_vertexShader,
-          m_ShadersRootPath / m_AppName / m_fragmentShader});
-
-  const auto modelViewProjMatrixLocation =
-      glGetUniformLocation(glslProgram.glId(), "uModelViewProjMatrix");
-  const auto modelViewMatrixLocation =
-      glGetUniformLocation(glslProgram.glId(), "uModelViewMatrix");
-  const auto modelMatrixLocation =
-      glGetUniformLocation(glslProgram.glId(), "uModelMatrix");
-  const auto normalMatrixLocation =
-      glGetUniformLocation(glslProgram.glId(), "uNormalMatrix");
-  const auto lightDirectionLocation =
-      glGetUniformLocation(glslProgram.glId(), "uLightDirection");
-  const auto lightRadianceLocation =
-      glGetUniformLocation(glslProgram.glId(), "uLightIntensity");
-  const auto baseColorLocation =
-      glGetUniformLocation(glslProgram.glId(), "uBaseColorTexture");
-  const auto baseColorFactorLocation =
-      glGetUniformLocation(glslProgram.glId(), "uBaseColorFactor");
-
-  const auto metallicFactorLocation =
-      glGetUniformLocation(glslProgram.glId(), "uMetallicFactor");
-  const auto roughnessFactorLocation =
-      glGetUniformLocation(glslProgram.glId(), "uRoughnessFactor");
-  const auto metallicRoughnessTextureLocation =
-      glGetUniformLocation(glslProgram.glId(), "uMetallicRoughnessTexture");
-
-  const auto emissiveTextureLocation =
-      glGetUniformLocation(glslProgram.glId(), "uEmissiveTexture");
-  const auto emissiveFactorLocation =
-      glGetUniformLocation(glslProgram.glId(), "uEmissiveFactor");
-
-  const auto occlusionTextureLocation =
-      glGetUniformLocation(glslProgram.glId(), "uOcclusionTexture");
-  const auto occlusionStrengthLocation =
-      glGetUniformLocation(glslProgram.glId(), "uOcclusionStrength");
-
-  const auto normalTextureLocation =
-      glGetUniformLocation(glslProgram.glId(), "uNormalTexture");
-  const auto normalScaleLocation =
-      glGetUniformLocation(glslProgram.glId(), "uNormalScale");
-
-  const auto irradianceTextureLocation =
-      glGetUniformLocation(glslProgram.glId(), "uIrradianceMap");
-  const auto prefilterTextureLocation =
-      glGetUniformLocation(glslProgram.glId(), "uPrefilterMap");
-  const auto brdfLUTLocation =
-      glGetUniformLocation(glslProgram.glId(), "uBrdfLUT");
-  const auto camDirLocation =
-      glGetUniformLocation(glslProgram.glId(), "uCamDir");
+	// make image, preferring the KTX2 alternative of KHR_texture_basisu
+	// when it is stored in a format we can upload
+	int source = texture.source;
+	Ktx2Texture ktx2Texture;
+	const auto basisu = texture.extensions.find("KHR_texture_basisu");
 
-  // Skybox
-  const auto glslSkyboxProgram =
-      compileProgram({
-		  m_ShadersRootPath / m_AppName / m_skyboxVertexShader,
-          m_ShadersRootPath / m_AppName / m_skyboxFragmentShader});
+	if (basisu != end(texture.extensions)
+	&& (*basisu).second.Has("source"))
+	{
+		const auto ktx2Source =
+			(*basisu).second.Get("source").Get<int>();
 
-  const auto skyboxEquirectangularMapLocation =
-      glGetUniformLocation(glslSkyboxProgram.glId(), "uEquirectangularMap");
-  const auto skyboxModelProjMatrixLocation =
-      glGetUniformLocation(glslSkyboxProgram.glId(), "uModelProjMatrix");
-  const auto skyboxModelViewMatrixLocation =
-      glGetUniformLocation(glslSkyboxProgram.glId(), "uModelViewMatrix");
+		if ((ktx2Source >= 0)
+		&& (size_t(ktx2Source) < model.images.size())
+		&& (model.images[ktx2Source].mimeType == "image/ktx2"))
+		{
+			const auto& ktx2Image = model.images[ktx2Source];
+			std::string err;
+
+			if (parseKtx2(
+				ktx2Image.image.data(),
+				ktx2Image.image.size(),
+				ktx2Texture,
+				err)
+			&& isKtx2FormatSupported(ktx2Texture))
+			{
+				source = ktx2Source;
+			}
+		}
+	}
 
-  // TODO Loading the glTF file
-  tinygltf::Model model;
+	// images kept encoded are decoded once a draw needs them
+	if ((source >= 0) && model.images[source].as_is)
+	{
+		return 0;
+	}
 
-  if (!loadGltfFile(model)) {
-	  std::cerr << "Failed to load glTF model" << std::endl;
+	GLuint textureObject = 0;
+	glGenTextures(1, &textureObject);
+	glBindTexture(GL_TEXTURE_2D, textureObject);
 
-	  return -1;
-  }
+	if (source < 0)
+	{
+		std::cerr << "No usable image for texture " << textureIdx << std::endl;
+		return textureObject;
+	}
 
-  // TODO Implement a new CameraController model and use it instead.
-  glm::vec3 bboxMin;
-  glm::vec3 bboxMax;
+	const auto& image = model.images[source];
 
-  computeSceneBounds(model, bboxMin, bboxMax);
+	// color texels are decoded from sRGB by the texture unit, a texture
+	// also sampled as linear data cannot be
+	const bool srgb = (usage == TEXTURE_USAGE_COLOR);
 
-  glm::vec3 diag = bboxMax - bboxMin;
+	if ((usage & TEXTURE_USAGE_COLOR) && !srgb)
+	{
+		std::cerr << "Texture " << textureIdx
+			<< " is sampled as both color and linear data, its texels"
+			" are not decoded from sRGB" << std::endl;
+	}
 
-  // Build projection matrix
-  auto maxDistance = glm::length(diag);
-  maxDistance = maxDistance > 0.f ? maxDistance : 100.f;
+	// filtering and wrapping are in the sampler objects, the texture only
+	// needs the levels its sampler reads
+	const auto minFilter = (texture.sampler >= 0)
+		? model.samplers[texture.sampler].minFilter
+		: -1;
+	const bool mipmaps = (minFilter == GL_NEAREST_MIPMAP_NEAREST)
+		|| (minFilter == GL_NEAREST_MIPMAP_LINEAR)
+		|| (minFilter == GL_LINEAR_MIPMAP_NEAREST)
+		|| (minFilter == GL_LINEAR_MIPMAP_LINEAR);
+
+	if (image.mimeType == "image/ktx2")
+	{
+		std::string err;
+
+		if (source != texture.source
+		|| (parseKtx2(
+			image.image.data(),
+			image.image.size(),
+			ktx2Texture,
+			err)
+		&& isKtx2FormatSupported(ktx2Texture)))
+		{
+			// levels above the size cap are not uploaded
+			dropKtx2Levels(ktx2Texture, m_maxTextureSize);
 
-  const auto projMatrix = glm::perspective(
-		  70.f,
-		  float(m_nWindowWidth) / m_nWindowHeight,
-          0.001f * maxDistance,
-		  1.5f * maxDistance);
+			// compressed levels cannot be generated, they must be stored
+			if (streamer
+			&& mipmaps
+			&& ((ktx2Texture.levels.size() > 1) || !ktx2Texture.compressed))
+			{
+				TextureMipChain chain;
+				chain.internalFormat = getKtx2InternalFormat(ktx2Texture, srgb);
+				chain.compressed = ktx2Texture.compressed;
+				chain.width = ktx2Texture.width;
+				chain.height = ktx2Texture.height;
 
-  // Config (IMGUI)
-  int controlsType = 0;
-  bool lightFromCamera = true;
-  float lightAngleH = 1.55f;
-  float lightAngleV = 2.0f;
-  bool featureTexture = true;
-  bool featureMetallicRoughness = true;
-  bool featureOcclusion = true;
-  bool featureEmission = true;
-  bool featureNormal = true;
-  bool featureEnvironment = true;
+				for (const auto& level : ktx2Texture.levels)
+				{
+					chain.levels.emplace_back(level.data, level.data + level.size);
+				}
 
-  glm::vec3 lightDirectionRaw = glm::vec3(1.0f, 1.0f, 1.0f);
-  glm::vec3 lightRadiance = glm::vec3(1.0f, 1.0f, 1.0f);
+				if (chain.levels.size() == 1)
+				{
+					generateMipChain(chain, srgb);
+				}
 
-  std::unique_ptr<CameraController> cameraController(
-	  std::make_unique<TrackballCameraController>(
-		  m_GLFWHandle.window()));
+				streamer->addTexture(textureIdx, textureObject, std::move(chain), uploader);
+			}
+			else
+			{
+				uploadKtx2Texture(ktx2Texture, srgb, mipmaps, uploader);
+			}
+		}
+		else
+		{
+			std::cerr << "Unsupported KTX2 image " << source << std::endl;
+		}
 
-  if (m_hasUserCamera)
-  {
-    cameraController->setCamera(m_userCamera);
-  }
-  else
-  {
-    // TODO Use scene bounds to compute a better default camera
-	glm::vec3 eye;
-	glm::vec3 up(0, 1, 0);
-	glm::vec3 center = bboxMin + (0.5f * diag);
+		return textureObject;
+	}
 
-	if (diag.z > 0)
+	if ((image.width <= 0) || (image.height <= 0))
 	{
-		eye = center + diag;
+		std::cerr << "Empty image " << source << std::endl;
+		return textureObject;
 	}
-	else
+
+	// smallest format holding the channels the material slots read
+	GLenum internalFormat = GL_RGBA8;
+
+	if (srgb)
+	{
+		internalFormat = GL_SRGB8_ALPHA8;
+	}
+	else if (usage == TEXTURE_USAGE_OCCLUSION)
 	{
-		eye = center + 2.f * glm::cross(diag, up);
+		internalFormat = GL_R8;
 	}
 
-    cameraController->setCamera(Camera{eye, center, up});
-  }
+	if (streamer
+	&& mipmaps
+	&& ((image.pixel_type == GL_UNSIGNED_BYTE)
+		|| (image.pixel_type == GL_UNSIGNED_SHORT)))
+	{
+		TextureMipChain chain;
+		chain.internalFormat = internalFormat;
+		chain.type = GLenum(image.pixel_type);
+		chain.width = image.width;
+		chain.height = image.height;
+		chain.levels.push_back(image.image);
+		generateMipChain(chain, srgb);
+		streamer->addTexture(textureIdx, textureObject, std::move(chain), uploader);
+
+		return textureObject;
+	}
 
-  // Physically-Based Materials
-  const std::vector<GLuint> textureObjects = createTextureObjects(model);
-  GLuint whiteTexture;
-  float white[] = {1, 1, 1, 1};
-  glGenTextures(1, &whiteTexture);
-  glBindTexture(GL_TEXTURE_2D, whiteTexture);
-  glTexImage2D(
-	  GL_TEXTURE_2D,
-	  0,
-	  GL_RGBA,
-	  1,
-	  1,
-	  0,
-	  GL_RGBA,
-	  GL_FLOAT,
-	  white);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_REPEAT);
+	GLsizei levelCount = 1;
 
-  GLuint greyTexture;
-  float grey[] = {0.5f, 0.5f, 0.5f, 1};
-  glGenTextures(1, &greyTexture);
-  glBindTexture(GL_TEXTURE_2D, greyTexture);
-  glTexImage2D(
-	  GL_TEXTURE_2D,
-	  0,
-	  GL_RGBA,
-	  1,
-	  1,
-	  0,
-	  GL_RGBA,
-	  GL_FLOAT,
-	  grey);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_REPEAT);
+	while (mipmaps && (std::max(image.width, image.height) >> levelCount))
+	{
+		++levelCount;
+	}
 
-	// dummy cubemap
-	GLuint whiteCube;
-	glGenTextures(1, &whiteCube);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, whiteCube);
+	glTexStorage2D(
+		GL_TEXTURE_2D,
+		levelCount,
+		internalFormat,
+		image.width,
+		image.height);
+	glTexSubImage2D(
+		GL_TEXTURE_2D,
+		0,
+		0,
+		0,
+		image.width,
+		image.height,
+		GL_RGBA,
+		image.pixel_type,
+		uploader.stage(image.image.data(), image.image.size()));
 
-	for (GLuint i = 0; i < 6; ++i)
+	if (levelCount > 1)
 	{
-		glTexImage2D(
-			GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-			0,
-			GL_RGB16F,
-			1,
-			1,
-			0, 
-			GL_RGB,
-			GL_FLOAT,
-			white);
+		// normals averaged by a filter are renormalized, unless the texture
+		// is also sampled as other data
+		mipGenerator.generate(
+			GL_TEXTURE_2D,
+			textureObject,
+			internalFormat,
+			image.width,
+			image.height,
+			levelCount,
+			m_mipFilter,
+			usage == TEXTURE_USAGE_NORMAL);
 	}
 
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-  // Cubemap
-  initQuad();
-  GLuint brdfLUT = integrateBRDF();
-  initCube();
-  GLuint envTexture = loadCorrectedEnvTexture();
-  GLuint irradianceMap = computeIrradianceMap(envTexture);
-  GLuint prefilterMap = prefilterEnvironmentMap(envTexture);
+	return textureObject;
+}
 
-  // Reset
-  glBindTexture(GL_TEXTURE_2D, 0);
+std::vector<GLuint> ViewerApplication::createTextureObjects(
+	const tinygltf::Model &model,
+	TextureStreamer *streamer,
+	MipGenerator &mipGenerator,
+	size_t &uploadedBytes) const
+{
+	TRACE_ZONE("createTextureObjects");
+	size_t count = model.textures.size();
+	std::vector<GLuint> textureObjects(count);
+	const auto usages = getTextureUsages(model);
 
-  // Creation of Buffer Objects
-  const std::vector<GLuint> bufferObjects = createBufferObjects(model);
+	// staging regions hold the largest image, up to a limit above which
+	// levels are uploaded from client memory
+	size_t largestImage = 0;
 
-  // Creation of Vertex Array Objects
-  std::vector<VaoRange> meshIndexToVaoRange;
+	for (const auto& image : model.images)
+	{
+		if (!image.as_is)
+		{
+			largestImage = std::max(largestImage, image.image.size());
+		}
+	}
 
-  const std::vector<GLuint> vertexArrayObjects = createVertexArrayObjects(
-		model,
-		bufferObjects,
-		meshIndexToVaoRange);
+	TextureUploader uploader;
 
-  // Setup OpenGL state for rendering
-  glEnable(GL_DEPTH_TEST);
-  glDepthFunc(GL_LEQUAL);
+	if (largestImage > 0)
+	{
+		uploader.init(std::min(
+			std::max(largestImage, size_t(TEXTURE_STAGING_MIN_SIZE)),
+			size_t(TEXTURE_STAGING_MAX_SIZE)));
+	}
 
-	const auto bindMaterial = [&](const auto materialIndex)
+	for (size_t i = 0; i < count; ++i)
 	{
-		if (materialIndex >= 0)
+		// without detail maps, textures only sampled as normal or occlusion
+		// maps are left out like images kept encoded
+		if (!m_detailMaps
+		&& !(usages[i] & ~(TEXTURE_USAGE_NORMAL | TEXTURE_USAGE_OCCLUSION)))
 		{
-			const auto &material =
-				model.materials[materialIndex];
+			continue;
+		}
 
-			const auto &pbrMetallicRoughness =
-				material.pbrMetallicRoughness;
+		textureObjects[i] = createTextureObject(
+			model, i, usages[i], streamer, mipGenerator, uploader);
+	}
 
-			const auto &emissiveTexture =
-				material.emissiveTexture;
+	uploader.finish();
+	uploadedBytes += uploader.uploadedBytes();
+	glBindTexture(GL_TEXTURE_2D, 0);
 
-			const auto &emissiveFactor =
-				material.emissiveFactor;
+	return textureObjects;
+}
 
-			const auto &occlusionTexture =
-				material.occlusionTexture;
+int ViewerApplication::run()
+{
+  if (m_framePacing.renderThread && !m_GLFWHandle.headless()) {
+    return m_GLFWHandle.runThreaded([&]() { return runScenes(); });
+  }
+  return runScenes();
+}
 
-			const auto &normalTexture =
-				material.normalTexture;
+int ViewerApplication::runScenes()
+{
+  for (;; ++m_sceneCount) {
+    if (m_tileset.path != m_gltfFilePath) {
+      m_tileset = Tileset();
+      m_tiles.clear();
+    }
+    if (m_sceneFiles.empty()) {
+      std::string err;
+      if (isTilesetFile(m_gltfFilePath)) {
+        // The tiles of the view of the user if known, else the coarsest ones
+        // until the camera framing them selects others
+        if (!loadTileset(m_gltfFilePath, m_tileset, err)) {
+          std::cerr << err << std::endl;
+          return -1;
+        }
+        // With the vertical field of view of the projection of runScene
+        const auto pixelsPerUnit = tileProjectionScale(
+            glm::perspective(70.f, 1.f, 1.f, 2.f), m_nWindowHeight);
+        m_tiles = selectTiles(m_tileset, m_userCamera.eye(),
+            m_hasUserCamera ? pixelsPerUnit : 0.f,
+            m_tilesetOptions.maxErrorPixels,
+            uint64_t(m_tilesetOptions.budgetMB * 1024 * 1024));
+        m_sceneFiles = tileSceneFiles(m_tileset, m_tiles);
+        if (m_sceneFiles.empty()) {
+          std::cerr << m_gltfFilePath.string() << ": no tile has content"
+                    << std::endl;
+          return -1;
+        }
+      } else if (!isSceneFile(m_gltfFilePath)) {
+        m_sceneFiles = {SceneFile{m_gltfFilePath}};
+      } else if (!loadSceneFile(m_gltfFilePath, m_sceneFiles, err)) {
+        std::cerr << err << std::endl;
+        return -1;
+      }
+    }
 
-			if (model.textures.size() > 0)
-			{
-				const auto &texture = model.textures[
-					pbrMetallicRoughness.baseColorTexture.index];
+    const auto status = runScene();
+    if (status != 0 || !m_sceneChanged) {
+      return status;
+    }
 
-				// base color
-				if (featureTexture)
-				{
-					glActiveTexture(GL_TEXTURE0);
-					glBindTexture(
-						GL_TEXTURE_2D,
-						textureObjects[texture.source]);
-				}
-				else
-				{
-					glActiveTexture(GL_TEXTURE0);
-					glBindTexture(
-						GL_TEXTURE_2D,
-						whiteTexture);
-				}
+    // The programs of the next scene are read back from the program cache,
+    // its environment maps are kept by runScene if they do not change
+    m_sceneChanged = false;
+    m_gltfFilePath = std::move(m_nextGltfFilePath);
+    m_sceneFiles = std::move(m_nextSceneFiles);
+    m_cubeMapFilePath = std::move(m_nextCubeMapFilePath);
+    m_gltfBuffers.clear();
+  }
+}
 
-				glUniform1i(baseColorLocation, 0);
+int ViewerApplication::runScene()
+{
+  FrameStatsLog frameStatsLog;
+  if (!m_statsCsvPath.empty()) {
+    std::string err;
+    if (!frameStatsLog.open(m_statsCsvPath, err)) {
+      std::cerr << err << std::endl;
+      return -1;
+    }
+  }
 
-				// metallic roughness
-				if (featureMetallicRoughness)
-				{
-					glActiveTexture(GL_TEXTURE1);
-					glBindTexture(
-						GL_TEXTURE_2D,
-						textureObjects[
-							pbrMetallicRoughness
-								.metallicRoughnessTexture
-								.index]);
-
-					glUniform4f(
-						baseColorFactorLocation,
-						pbrMetallicRoughness.baseColorFactor[0],
-						pbrMetallicRoughness.baseColorFactor[1],
-						pbrMetallicRoughness.baseColorFactor[2],
-						pbrMetallicRoughness.baseColorFactor[3]);
-					glUniform1f(
-						metallicFactorLocation,
-						pbrMetallicRoughness.metallicFactor);
-					glUniform1f(
-						roughnessFactorLocation,
-						pbrMetallicRoughness.roughnessFactor);
-				}
-				else
-				{
-					glActiveTexture(GL_TEXTURE1);
-					glBindTexture(GL_TEXTURE_2D, 0);
+  // Objects created by this thread and the loader one are counted in
+  // m_gpuMemory
+  GpuMemoryTracker::current() = &m_gpuMemory;
+
+  // Wall time of the loading steps, reported by the bench command
+  LoadTimes loadTimes;
+  const auto runStart = std::chrono::steady_clock::now();
+  const auto msSince = [](std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start)
+        .count();
+  };
+
+  // The model is parsed, or its packed geometry read from the cache, by a
+  // job started before the programs are compiled, the first step of loadGraph
+  // waits for it. Parsing is CPU bound and compiling mostly driver bound,
+  // they overlap.
+  tinygltf::Model model;
+  // Compact copy of model for the loading passes and the draws
+  RuntimeModel runtimeModel;
+  bool loadSucceeded = false;
+  glm::vec3 bboxMin;
+  glm::vec3 bboxMax;
+  PackedGeometry geometry;
+  GeometryCacheKey geometryCacheKey;
+  bool geometryCacheable = false;
+  fs::path geometryCachePath;
+  bool geometryCached = false;
+  std::vector<fs::path> sceneSourceFiles; // As in the geometry cache key
+  JobSystem::Group parseGroup;
+  JobSystem::shared().run(parseGroup, [&]() {
+    const auto parseStart = std::chrono::steady_clock::now();
+    loadSucceeded = loadGltfFile(model);
+    if (!loadSucceeded) {
+      return;
+    }
+    if (m_geometryOptions.staticBatching) {
+      const auto batchedNodes = batchStaticNodes(model, m_gltfBuffers);
+      std::clog << "Batched " << batchedNodes << " static nodes" << std::endl;
+    }
+    runtimeModel.build(model);
+    // The packed geometry and bounds of a previous load of the same files
+    // with the same options skip packing, they are ready to upload
+    sceneSourceFiles = m_gltfBuffers.files();
+    sceneSourceFiles.insert(sceneSourceFiles.begin(), m_gltfFilePath);
+    geometryCacheable =
+        m_geometryOptions.cache &&
+        initGeometryCacheKey(sceneSourceFiles, m_exactBounds, m_geometryOptions,
+            geometryCacheKey);
+    if (geometryCacheable) {
+      geometryCachePath = geometryCacheFile(
+          m_AppPath.parent_path() / "cache", geometryCacheKey);
+      geometryCached = loadGeometryCache(
+          geometryCachePath, geometryCacheKey, geometry, bboxMin, bboxMax);
+    }
+    loadTimes.parse = msSince(parseStart);
+  });
+
+  // The HDR image of an environment to bake, neither kept from the previous
+  // scene nor cached, is decoded by a job meanwhile too, the bake only waits
+  // for it
+  const bool environmentKept =
+      m_environmentMaps &&
+      m_environmentMaps->cubeMapFile == m_cubeMapFilePath &&
+      m_environmentMaps->options == m_iblOptions;
+  IblCacheKey environmentCacheKey;
+  const bool environmentKeyed =
+      initIblCacheKey(m_cubeMapFilePath, m_iblOptions, environmentCacheKey);
+  const auto environmentCacheFile = environmentKeyed
+      ? iblCacheFile(m_AppPath.parent_path() / "cache", environmentCacheKey)
+      : fs::path();
+  const bool environmentCached =
+      environmentKeyed && fs::exists(environmentCacheFile);
+  // Maps loaded by another renderer of the serve command are referenced, those
+  // loaded here are shared with the others
+  std::shared_ptr<EnvironmentMaps> sharedEnvironment;
+  if (!environmentKept && environmentKeyed && m_sharedObjects) {
+    sharedEnvironment = m_sharedObjects->find<EnvironmentMaps>(
+        environmentCacheFile.string());
+    if (sharedEnvironment &&
+        (sharedEnvironment->cubeMapFile != m_cubeMapFilePath ||
+            sharedEnvironment->options != m_iblOptions)) {
+      sharedEnvironment.reset();
+    }
+  }
+  EnvironmentImage prefetchedEnvironment;
+  bool environmentPrefetched = false;
+  bool prefetchedEnvironmentRead = false;
+  JobSystem::Group environmentPrefetchGroup;
+  if (!environmentKept && !environmentCached && !sharedEnvironment &&
+      !m_cubeMapFilePath.empty()) {
+    environmentPrefetched = true;
+    JobSystem::shared().run(environmentPrefetchGroup, [&]() {
+      prefetchedEnvironmentRead =
+          readEnvironmentImage(m_cubeMapFilePath, prefetchedEnvironment);
+    });
+  }
 
-					glUniform4f(
-						baseColorFactorLocation,
-						1,
-						1,
-						1,
-						1);
-					glUniform1f(
-						metallicFactorLocation,
-						0);
-					glUniform1f(
-						roughnessFactorLocation,
-						0);
-				}
+  glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
 
-				glUniform1i(metallicRoughnessTextureLocation, 1);
+  // Loader shaders
+  // Material textures are referenced from the material buffer when bindless
+  // textures are supported. Otherwise they are packed in texture arrays bound
+  // to texture units, so that materials sharing arrays share draw batches.
+  // Streamed and lazily decoded textures change storage and cannot be packed.
+  // Texture handles are those of a driver, not replayable from a capture
+  const bool bindlessTextures =
+      !m_glCapture.active() && loadBindlessTextures();
+  const bool textureStreaming = m_textureBudgetMB > 0;
+  const bool textureArrays =
+      !bindlessTextures && !textureStreaming && !m_lazyTextures;
+  std::clog << "Bindless textures "
+            << (bindlessTextures ? "enabled" : "not supported, using arrays")
+            << "\n";
+
+  std::vector<std::string> shaderDefines;
+  if (bindlessTextures)
+  {
+    shaderDefines.push_back("BINDLESS_TEXTURES");
+  }
+  if (textureArrays)
+  {
+    shaderDefines.push_back("TEXTURE_ARRAYS");
+  }
+  if (m_halfPrecision)
+  {
+    if (hasGLExtension("GL_AMD_gpu_shader_half_float"))
+    {
+      shaderDefines.push_back("HALF_PRECISION");
+    }
+    else
+    {
+      std::clog << "Half precision shading needs "
+                   "GL_AMD_gpu_shader_half_float, shading in full precision"
+                << std::endl;
+    }
+  }
 
-				// emissive
-				if (featureEmission)
-				{
-					glActiveTexture(GL_TEXTURE2);
-					glBindTexture(
-						GL_TEXTURE_2D,
-						textureObjects[emissiveTexture.index]);
-					glUniform3f(
-						emissiveFactorLocation,
-						emissiveFactor[0],
-						emissiveFactor[1],
-						emissiveFactor[2]);
+  // Shared by the PBR programs and the light clustering
+  const std::vector<std::string> clusterDefines = {
+      "CLUSTER_TILES_X " + std::to_string(CLUSTER_TILES_X),
+      "CLUSTER_TILES_Y " + std::to_string(CLUSTER_TILES_Y),
+      "CLUSTER_SLICES " + std::to_string(CLUSTER_SLICES),
+      "CLUSTER_MAX_LIGHTS " + std::to_string(CLUSTER_MAX_LIGHTS)};
+  shaderDefines.insert(
+      end(shaderDefines), begin(clusterDefines), end(clusterDefines));
+  shaderDefines.push_back(
+      "SHADOW_CASCADE_COUNT " + std::to_string(SHADOW_CASCADE_COUNT));
+
+  // One variant of the PBR program per set of material maps, see
+  // PBR_FEATURE_DEFINES. Texture units never change, material textures use
+  // units 0 to 4, the environment 5 to 7, the shadow map 8 and the ambient
+  // occlusion AMBIENT_OCCLUSION_UNIT and the next.
+  const auto setPbrTextureUnits = [](const GLProgram &program) {
+    program.setUniform("uBaseColorTexture", 0);
+    program.setUniform("uMetallicRoughnessTexture", 1);
+    program.setUniform("uEmissiveTexture", 2);
+    program.setUniform("uOcclusionTexture", 3);
+    program.setUniform("uNormalTexture", 4);
+    program.setUniform("uIrradianceMap", 5);
+    program.setUniform("uPrefilterMap", 6);
+    program.setUniform("uBrdfLUT", 7);
+    program.setUniform("uShadowMap", 8);
+    program.setUniform("uAmbientOcclusionMap", AMBIENT_OCCLUSION_UNIT);
+    program.setUniform("uAmbientOcclusionDepth", AMBIENT_OCCLUSION_UNIT + 1);
+    program.setUniformBlockBinding("SHIrradiance", SH_IRRADIANCE_BINDING);
+  };
+  // The wireframe overlay takes the barycentrics of the rasterizer, else it
+  // pulls the triangles of its fragments from the index and vertex buffers
+  // bound at the bindings of the visibility buffer
+  const bool wireframeBarycentrics =
+      hasGLExtension("GL_NV_fragment_shader_barycentric");
+  auto pbrDefines = shaderDefines;
+  if (wireframeBarycentrics)
+  {
+    pbrDefines.push_back("WIREFRAME_BARYCENTRICS");
+  }
+  pbrDefines.insert(end(pbrDefines),
+      {"VISIBILITY_INDICES_BINDING " +
+              std::to_string(VISIBILITY_INDICES_BINDING),
+          "VISIBILITY_VERTICES_BINDING " +
+              std::to_string(VISIBILITY_VERTICES_BINDING),
+          "WIREFRAME_FORMATS_BINDING " +
+              std::to_string(WIREFRAME_FORMATS_BINDING),
+          "PULLED_VERTICES_BINDING " + std::to_string(PULLED_VERTICES_BINDING),
+          "PULLED_LAYOUTS_BINDING " +
+              std::to_string(PULLED_LAYOUTS_BINDING)});
+  ShaderPermutations pbrPrograms(
+      {m_ShadersRootPath / m_AppName / m_vertexShader,
+          m_ShadersRootPath / m_AppName / m_fragmentShader},
+      PBR_FEATURE_DEFINES, pbrDefines, setPbrTextureUnits);
+  // The variant of materials with every map is compiled ahead of the first
+  // frame, it stands in for the others while they are built. Its alpha test
+  // passes every fragment of materials without MASK, blended materials, the
+  // wireframe overlay and vertex pulling have their own. It shades distant
+  // draws in full.
+  const uint32_t allPbrFeatures = ((1u << PBR_FEATURE_DEFINES.size()) - 1) &
+                                  ~PBR_ALPHA_BLEND & ~PBR_SHARED_OCCLUSION &
+                                  ~PBR_WIREFRAME & ~PBR_PULL_VERTICES &
+                                  ~PBR_SHADING_LOD;
+  pbrPrograms.program(allPbrFeatures);
+
+  // Per frame constants, transforms are in the per draw ring buffer created
+  // once the number of draws is known. Each of the views of a frame writes
+  // its own slot, bound by drawScene, so that they do not wait on each other.
+  GLint uniformBufferAlignment = 1;
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformBufferAlignment);
+  const auto uniformSlotSize = [&](size_t size) {
+    const auto alignment = size_t(uniformBufferAlignment);
+    return (size + alignment - 1) / alignment * alignment;
+  };
+  GLBuffer frameConstantsUBO;
+  frameConstantsUBO.generate();
+  glBindBuffer(GL_UNIFORM_BUFFER, frameConstantsUBO);
+  glBufferData(GL_UNIFORM_BUFFER,
+      MAX_VIEWS * uniformSlotSize(sizeof(FrameConstants)), nullptr,
+      GL_DYNAMIC_DRAW);
+  trackBuffer(GpuMemoryCategory::ShaderBuffers, frameConstantsUBO,
+      MAX_VIEWS * uniformSlotSize(sizeof(FrameConstants)));
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+  // KHR_lights_punctual lights, listed per cluster of the view frustum each
+  // frame so that fragments only evaluate the lights that reach them
+  const auto glslClusterLightsProgram = compileProgram(
+      {m_ShadersRootPath / m_AppName / m_clusterLightsComputeShader},
+      clusterDefines);
+  const auto clusterViewMatrixLocation =
+      glslClusterLightsProgram.getUniformLocation("uViewMatrix");
+  const auto clusterProjScaleLocation =
+      glslClusterLightsProgram.getUniformLocation("uProjScale");
+  const auto clusterProjOffsetLocation =
+      glslClusterLightsProgram.getUniformLocation("uProjOffset");
+  const auto clusterViewportSizeLocation =
+      glslClusterLightsProgram.getUniformLocation("uViewportSize");
+
+  std::vector<PunctualLight> punctualLights;
+  GLBuffer punctualLightsSSBO;
+  punctualLightsSSBO.generate();
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, punctualLightsSSBO);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(PunctualLight), nullptr,
+      GL_DYNAMIC_DRAW);
+  trackBuffer(GpuMemoryCategory::ShaderBuffers, punctualLightsSSBO,
+      sizeof(PunctualLight));
+
+  // Zero lights in every cluster until the first clustering
+  const size_t clusterCount =
+      CLUSTER_TILES_X * CLUSTER_TILES_Y * CLUSTER_SLICES;
+  const std::vector<GLuint> clusterLights(
+      clusterCount * (CLUSTER_MAX_LIGHTS + 1), 0);
+  GLBuffer clusterLightsSSBO;
+  clusterLightsSSBO.generate();
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, clusterLightsSSBO);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, clusterLights.size() * sizeof(GLuint),
+      clusterLights.data(), GL_DYNAMIC_COPY);
+  trackBuffer(GpuMemoryCategory::ShaderBuffers, clusterLightsSSBO,
+      clusterLights.size() * sizeof(GLuint));
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  glBindBufferBase(
+      GL_SHADER_STORAGE_BUFFER, PUNCTUAL_LIGHTS_BINDING, punctualLightsSSBO);
+  glBindBufferBase(
+      GL_SHADER_STORAGE_BUFFER, CLUSTER_LIGHTS_BINDING, clusterLightsSSBO);
+
+  // Cascaded shadow maps of the directional light. Casters are drawn with the
+  // indirect command of their draw item and their item index as base
+  // instance, which indexes the world matrices of the items.
+  // Meshlets culled against the view frustum and the eye before the opaque
+  // passes, each batch draws those left with one indirect count call
+  GLint storageBufferBindings = 0;
+  glGetIntegerv(GL_MAX_SHADER_STORAGE_BUFFER_BINDINGS, &storageBufferBindings);
+  const bool meshletCullingSupported =
+      storageBufferBindings > CLUSTER_COUNTS_BINDING &&
+      loadIndirectParameters();
+  // Reversed depth maps normalized device depths of [0, 1] to the depth range
+  const bool reversedZSupported = loadClipControl();
+  const auto glslCullMeshletsProgram = compileProgram(
+      {m_ShadersRootPath / m_AppName / m_cullMeshletsComputeShader});
+  const auto cullEyeLocation =
+      glslCullMeshletsProgram.getUniformLocation("uEye");
+  const auto cullJobCountLocation =
+      glslCullMeshletsProgram.getUniformLocation("uJobCount");
+  const auto cullCommandCountLocation =
+      glslCullMeshletsProgram.getUniformLocation("uCommandCount");
+  if (m_geometryOptions.meshlets && !meshletCullingSupported)
+  {
+    std::clog << "Meshlet culling not supported, drawing whole primitives\n";
+  }
+
+  // GPU culling of the draws, by the same pass, against the depth pyramid of
+  // the previous frame with occlusion culling
+  const bool gpuCullingSupported =
+      meshletCullingSupported && storageBufferBindings > DRAW_BOUNDS_BINDING;
+  const auto glslDepthPyramidProgram = compileProgram(
+      {m_ShadersRootPath / m_AppName / m_depthPyramidComputeShader});
+  if (m_gpuCulling && !gpuCullingSupported)
+  {
+    std::clog << "GPU culling not supported, culling on the CPU\n";
+  }
+
+  // Coarse shading of the opaque pass, captures do without the extension
+  const bool shadingRateSupported =
+      !m_glCapture.active() && loadShadingRateImage();
+  const auto glslShadingRateProgram = compileProgram(
+      {m_ShadersRootPath / m_AppName / m_shadingRateComputeShader});
+
+  const auto glslShadowProgram =
+      compileProgram({m_ShadersRootPath / m_AppName / m_shadowVertexShader,
+          m_ShadersRootPath / m_AppName / m_depthFragmentShader});
+  const auto shadowLightViewProjMatrixLocation =
+      glslShadowProgram.getUniformLocation("uLightViewProjMatrix");
+
+  ShadowCascades shadowCascades;
+  shadowCascades.init(SHADOW_MAP_SIZE, SHADOW_CASCADE_COUNT);
+  std::vector<uint32_t> shadowCasters;
+  std::vector<DrawElementsIndirectCommand> shadowCommands;
+  size_t redrawnCascades = 0; // Last frame
+
+  static_assert(sizeof(ShadowConstants::cascadeMatrices) ==
+                    SHADOW_CASCADE_COUNT * sizeof(glm::mat4),
+      "One matrix per shadow cascade");
+  GLBuffer shadowConstantsUBO;
+  shadowConstantsUBO.generate();
+  glBindBuffer(GL_UNIFORM_BUFFER, shadowConstantsUBO);
+  glBufferData(GL_UNIFORM_BUFFER,
+      MAX_VIEWS * uniformSlotSize(sizeof(ShadowConstants)), nullptr,
+      GL_DYNAMIC_DRAW);
+  trackBuffer(GpuMemoryCategory::ShaderBuffers, shadowConstantsUBO,
+      MAX_VIEWS * uniformSlotSize(sizeof(ShadowConstants)));
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+  GLBuffer shadowItemsSSBO;
+  shadowItemsSSBO.generate();
+  GLBuffer shadowCommandBuffer;
+  shadowCommandBuffer.generate();
+
+  // Skybox
+  const auto glslSkyboxProgram =
+      compileProgram({
+		  m_ShadersRootPath / m_AppName / m_skyboxVertexShader,
+          m_ShadersRootPath / m_AppName / m_skyboxFragmentShader});
+
+  const auto skyboxEquirectangularMapLocation =
+      glslSkyboxProgram.getUniformLocation("uEquirectangularMap");
+  const auto skyboxModelProjMatrixLocation =
+      glslSkyboxProgram.getUniformLocation("uModelProjMatrix");
+  const auto skyboxModelViewMatrixLocation =
+      glslSkyboxProgram.getUniformLocation("uModelViewMatrix");
+  const auto skyboxPreviousViewProjMatrixLocation =
+      glslSkyboxProgram.getUniformLocation("uPreviousViewProjMatrix");
+  const auto skyboxTemporalJitterLocation =
+      glslSkyboxProgram.getUniformLocation("uTemporalJitter");
+  const auto skyboxFarDepthLocation =
+      glslSkyboxProgram.getUniformLocation("uFarDepth");
+
+  // Resolve of temporal anti-aliasing, drawn over the window
+  const auto glslTemporalResolveProgram =
+      compileProgram({m_ShadersRootPath / m_AppName / m_integrateVertexShader,
+          m_ShadersRootPath / m_AppName / m_temporalResolveFragmentShader});
+
+  // Upscale of dynamic resolution frames to the window
+  const auto glslUpscaleProgram =
+      compileProgram({m_ShadersRootPath / m_AppName / m_integrateVertexShader,
+          m_ShadersRootPath / m_AppName / m_upscaleFragmentShader});
+
+  // Tonemap of the linear scene to the output framebuffer
+  const auto glslTonemapProgram =
+      compileProgram({m_ShadersRootPath / m_AppName / m_integrateVertexShader,
+          m_ShadersRootPath / m_AppName / m_tonemapFragmentShader});
+
+  // Projection of the panorama cube map to an equirectangular image
+  const auto glslPanoramaProgram =
+      compileProgram({m_ShadersRootPath / m_AppName / m_integrateVertexShader,
+          m_ShadersRootPath / m_AppName / m_panoramaFragmentShader});
+
+  // Progressive path tracing of output images, see drawPathTrace. The program
+  // is only compiled for path traced renders.
+  const bool pathTracing = m_pathTrace.enabled() &&
+                           storageBufferBindings > PATH_TRACE_NODES_BINDING + 3;
+  if (m_pathTrace.enabled() && !pathTracing)
+  {
+    std::clog << "Path tracing not supported, rasterizing\n";
+  }
+  std::unique_ptr<GLProgram> glslPathTraceProgram;
+  if (pathTracing)
+  {
+    auto pathTraceDefines = std::vector<std::string>{
+        "PATH_TRACE_NODES_BINDING " + std::to_string(PATH_TRACE_NODES_BINDING),
+        "PATH_TRACE_TEXTURE_UNITS " + std::to_string(PATH_TRACE_TEXTURE_UNITS)};
+    if (bindlessTextures)
+    {
+      pathTraceDefines.push_back("BINDLESS_TEXTURES");
+    }
+    if (textureArrays)
+    {
+      pathTraceDefines.push_back("TEXTURE_ARRAYS");
+    }
+    glslPathTraceProgram = std::make_unique<GLProgram>(compileProgram(
+        {m_ShadersRootPath / m_AppName / m_pathTraceComputeShader},
+        pathTraceDefines));
+  }
+  PathTracer pathTracer;
+
+  // Ambient occlusion baked per vertex with the BVH of the path tracer, see
+  // bakeOcclusion. Read from the cache next to the geometry cache when it
+  // was baked with the same rays.
+  const int occlusionRays = m_geometryOptions.occlusionRays;
+  const bool occlusionBaking = occlusionRays > 0 &&
+                               storageBufferBindings > PATH_TRACE_NODES_BINDING + 5;
+  if (occlusionRays > 0 && !occlusionBaking)
+  {
+    std::clog << "Occlusion baking not supported\n";
+  }
+  std::unique_ptr<GLProgram> glslBakeOcclusionProgram;
+  if (occlusionBaking)
+  {
+    auto bakeDefines = std::vector<std::string>{"BAKE_OCCLUSION",
+        "PATH_TRACE_NODES_BINDING " + std::to_string(PATH_TRACE_NODES_BINDING),
+        "PATH_TRACE_TEXTURE_UNITS " + std::to_string(PATH_TRACE_TEXTURE_UNITS)};
+    if (bindlessTextures)
+    {
+      bakeDefines.push_back("BINDLESS_TEXTURES");
+    }
+    if (textureArrays)
+    {
+      bakeDefines.push_back("TEXTURE_ARRAYS");
+    }
+    glslBakeOcclusionProgram = std::make_unique<GLProgram>(compileProgram(
+        {m_ShadersRootPath / m_AppName / m_pathTraceComputeShader},
+        bakeDefines));
+  }
+  OcclusionBaker occlusionBaker;
+  fs::path occlusionCachePath;
+  bool occlusionBaked = false; // Or read from the cache
+
+  // Draw items potentially visible from the cells of a grid, baked with the
+  // BVH of the path tracer, see bakeVisibleSets. Read from the cache next to
+  // the geometry cache when it was baked with the same cell size.
+  const float visibleSetCellSize = m_geometryOptions.visibleSetCellSize;
+  const bool visibleSetBaking = visibleSetCellSize > 0.f &&
+                                storageBufferBindings > PATH_TRACE_NODES_BINDING + 5;
+  if (visibleSetCellSize > 0.f && !visibleSetBaking)
+  {
+    std::clog << "Visible set baking not supported\n";
+  }
+  std::unique_ptr<GLProgram> glslBakeVisibilityProgram;
+  if (visibleSetBaking)
+  {
+    auto bakeDefines = std::vector<std::string>{"BAKE_VISIBILITY",
+        "PATH_TRACE_NODES_BINDING " + std::to_string(PATH_TRACE_NODES_BINDING),
+        "PATH_TRACE_TEXTURE_UNITS " + std::to_string(PATH_TRACE_TEXTURE_UNITS)};
+    if (bindlessTextures)
+    {
+      bakeDefines.push_back("BINDLESS_TEXTURES");
+    }
+    if (textureArrays)
+    {
+      bakeDefines.push_back("TEXTURE_ARRAYS");
+    }
+    glslBakeVisibilityProgram = std::make_unique<GLProgram>(compileProgram(
+        {m_ShadersRootPath / m_AppName / m_pathTraceComputeShader},
+        bakeDefines));
+  }
+  VisibleSets visibleSets;
+  fs::path visibleSetsCachePath;
+  bool visibleSetsBaked = false; // Or read from the cache
+
+  // Large opaque items rasterized on the CPU each frame, and the bounds of
+  // the others tested against them, see SoftwareOcclusion. The occluders are
+  // chosen among the candidates and drawn by a job while the frame records
+  // the shadow passes.
+  SoftwareOcclusion softwareOcclusion;
+  std::vector<uint32_t> occluderCandidates; // Items
+  std::vector<uint32_t> frameOccluders; // Items, largest first
+  std::vector<float> occluderCoverages; // Of each item, in the frame
+  std::vector<uint32_t> frameOccluderPrimitives;
+  std::vector<glm::mat4> frameOccluderMatrices;
+  std::vector<uint8_t> frameOccluderSingleSided;
+  JobSystem::Group softwareOcclusionGroup;
+
+  // Octahedral impostors of the meshes drawn by many objects, the instances
+  // of the nodes, see captureImpostors. Each object has the layer of its mesh
+  // and the first item of its finest level, whose world matrix it takes. The
+  // programs are compiled when a mesh gets an impostor.
+  const bool impostorsSupported =
+      storageBufferBindings > IMPOSTOR_INSTANCES_BINDING;
+  std::unique_ptr<GLProgram> glslImpostorCaptureProgram;
+  std::unique_ptr<GLProgram> glslImpostorProgram;
+  ImpostorAtlas impostorAtlas;
+  std::vector<glm::vec4> impostorSpheres; // Of each layer, in mesh space
+  std::vector<size_t> impostorObjectItems;
+  std::vector<GLuint> impostorObjectLayers;
+  std::vector<int> itemImpostorObjects; // Per draw item, -1 if none
+  // Objects with visible items in a frame, then those drawn as impostors
+  std::vector<char> impostorObjectsDrawn;
+  PersistentRingBuffer impostorInstances; // Of a frame
+  bool impostorsCaptured = false;
+
+  // Bloom mip chain, added to the scene by the tonemap pass
+  const auto glslBloomDownsampleProgram = compileProgram(
+      {m_ShadersRootPath / m_AppName / m_bloomDownsampleComputeShader});
+  const auto glslBloomUpsampleProgram = compileProgram(
+      {m_ShadersRootPath / m_AppName / m_bloomUpsampleComputeShader});
+
+  // Composite of weighted blended transparency over the scene
+  const auto glslTransparencyCompositeProgram =
+      compileProgram({m_ShadersRootPath / m_AppName / m_integrateVertexShader,
+          m_ShadersRootPath / m_AppName /
+              m_transparencyCompositeFragmentShader});
+
+  // Screen-space ambient occlusion of the depth pre-pass, at half resolution
+  const auto glslAmbientOcclusionDepthProgram = compileProgram(
+      {m_ShadersRootPath / m_AppName / m_ambientOcclusionDepthComputeShader});
+  const auto glslAmbientOcclusionProgram = compileProgram(
+      {m_ShadersRootPath / m_AppName / m_ambientOcclusionComputeShader});
+  const auto glslAmbientOcclusionBlurProgram = compileProgram(
+      {m_ShadersRootPath / m_AppName / m_ambientOcclusionBlurComputeShader});
+
+  // Bounding boxes for occlusion queries
+  const auto glslBoundsProgram =
+      compileProgram({
+		  m_ShadersRootPath / m_AppName / m_boundsVertexShader,
+          m_ShadersRootPath / m_AppName / m_boundsFragmentShader});
+
+  const auto boundsModelViewProjMatrixLocation =
+      glslBoundsProgram.getUniformLocation("uModelViewProjMatrix");
+
+  // Depth pre-pass, with the vertex shader of the shading pass
+  const auto glslDepthProgram =
+      compileProgram({m_ShadersRootPath / m_AppName / m_vertexShader,
+          m_ShadersRootPath / m_AppName / m_depthFragmentShader});
+
+  // Picking pass, the draw index under the clicked pixel
+  const auto glslPickProgram =
+      compileProgram({m_ShadersRootPath / m_AppName / m_vertexShader,
+          m_ShadersRootPath / m_AppName / m_pickFragmentShader});
+
+  // Visibility buffer of the opaque draws, with the vertex shader of the
+  // shading pass, and its resolve over the viewport by the PBR program
+  // sampling every map, see utils/visibility_buffer.hpp. Compiled when the
+  // mode is first enabled.
+  const bool visibilityBufferSupported =
+      storageBufferBindings > VISIBILITY_VERTICES_BINDING;
+  if (m_visibilityBuffer && !visibilityBufferSupported)
+  {
+    std::clog << "Visibility buffer not supported, shading forward\n";
+  }
+  // Without barycentrics from the rasterizer, the wireframe overlay pulls
+  // the vertices of its triangles from one more storage buffer
+  const bool wireframeSupported =
+      wireframeBarycentrics ||
+      storageBufferBindings > WIREFRAME_FORMATS_BINDING;
+  // Vertex pulling reads the vertex buffers of every layout from two more
+  // storage buffers in the vertex shader, the depth pre-pass and picking have
+  // their programs compiled with it when it is first enabled
+  GLint vertexStorageBlocks = 0;
+  glGetIntegerv(GL_MAX_VERTEX_SHADER_STORAGE_BLOCKS, &vertexStorageBlocks);
+  const bool vertexPullingSupported =
+      storageBufferBindings > PULLED_LAYOUTS_BINDING &&
+      vertexStorageBlocks >= 6;
+  if (m_vertexPulling && !vertexPullingSupported)
+  {
+    std::clog << "Vertex pulling not supported, using vertex arrays\n";
+  }
+  const std::vector<std::string> pulledVertexDefines = {"PULL_VERTICES",
+      "PULLED_VERTICES_BINDING " + std::to_string(PULLED_VERTICES_BINDING),
+      "PULLED_LAYOUTS_BINDING " + std::to_string(PULLED_LAYOUTS_BINDING)};
+  std::unique_ptr<GLProgram> glslPulledDepthProgram;
+  std::unique_ptr<GLProgram> glslPulledPickProgram;
+  const auto compilePulledVertexPrograms = [&]() {
+    if (glslPulledDepthProgram)
+    {
+      return;
+    }
+    glslPulledDepthProgram = std::make_unique<GLProgram>(compileProgram(
+        {m_ShadersRootPath / m_AppName / m_vertexShader,
+            m_ShadersRootPath / m_AppName / m_depthFragmentShader},
+        pulledVertexDefines));
+    glslPulledPickProgram = std::make_unique<GLProgram>(compileProgram(
+        {m_ShadersRootPath / m_AppName / m_vertexShader,
+            m_ShadersRootPath / m_AppName / m_pickFragmentShader},
+        pulledVertexDefines));
+  };
+  std::unique_ptr<GLProgram> glslVisibilityProgram;
+  std::unique_ptr<GLProgram> glslVisibilityResolveProgram;
+  GLint visibilityVertexAttributesLocation = -1;
+  const auto compileVisibilityPrograms = [&]() {
+    if (glslVisibilityProgram)
+    {
+      return;
+    }
+    glslVisibilityProgram = std::make_unique<GLProgram>(
+        compileProgram({m_ShadersRootPath / m_AppName / m_vertexShader,
+            m_ShadersRootPath / m_AppName / m_visibilityFragmentShader}));
+
+    auto resolveDefines = shaderDefines;
+    resolveDefines.insert(end(resolveDefines),
+        {"VISIBILITY_BUFFER", "HAS_BASE_COLOR_MAP",
+            "HAS_METALLIC_ROUGHNESS_MAP", "HAS_EMISSIVE_MAP",
+            "HAS_OCCLUSION_MAP", "HAS_NORMAL_MAP",
+            "VISIBILITY_DRAWS_BINDING " +
+                std::to_string(VISIBILITY_DRAWS_BINDING),
+            "VISIBILITY_INDICES_BINDING " +
+                std::to_string(VISIBILITY_INDICES_BINDING),
+            "VISIBILITY_VERTICES_BINDING " +
+                std::to_string(VISIBILITY_VERTICES_BINDING)});
+    glslVisibilityResolveProgram = std::make_unique<GLProgram>(
+        compileProgram({m_ShadersRootPath / m_AppName / m_integrateVertexShader,
+                           m_ShadersRootPath / m_AppName / m_fragmentShader},
+            resolveDefines));
+    setPbrTextureUnits(*glslVisibilityResolveProgram);
+    glslVisibilityResolveProgram->setUniform("uVisibility", VISIBILITY_UNIT);
+    // An ivec4 array, set with glProgramUniform4iv
+    visibilityVertexAttributesLocation = glGetUniformLocation(
+        glslVisibilityResolveProgram->glId(), "uVertexAttributes");
+  };
+
+  // Point clouds splatted by a compute shader keeping the closest point of
+  // each pixel with 64 bit atomics, and the resolve of its pixels over the
+  // viewport. Compiled when first enabled.
+  const bool pointRasterizerSupported =
+      hasGLExtension("GL_ARB_gpu_shader_int64") &&
+      hasGLExtension("GL_NV_shader_atomic_int64") &&
+      storageBufferBindings > POINT_VERTICES_BINDING;
+  std::unique_ptr<GLProgram> glslPointRasterizeProgram;
+  std::unique_ptr<GLProgram> glslPointResolveProgram;
+  GLint pointVertexAttributesLocation = -1;
+  const auto compilePointPrograms = [&]() {
+    if (glslPointRasterizeProgram)
+    {
+      return;
+    }
+    const std::vector<std::string> pointDefines = {
+        "POINT_FRAMEBUFFER_BINDING " + std::to_string(POINT_FRAMEBUFFER_BINDING),
+        "POINT_JOBS_BINDING " + std::to_string(POINT_JOBS_BINDING),
+        "POINT_INDICES_BINDING " + std::to_string(POINT_INDICES_BINDING),
+        "POINT_VERTICES_BINDING " + std::to_string(POINT_VERTICES_BINDING)};
+    glslPointRasterizeProgram = std::make_unique<GLProgram>(compileProgram(
+        {m_ShadersRootPath / m_AppName / m_pointRasterizeComputeShader},
+        pointDefines));
+    glslPointResolveProgram = std::make_unique<GLProgram>(
+        compileProgram({m_ShadersRootPath / m_AppName / m_integrateVertexShader,
+                           m_ShadersRootPath / m_AppName /
+                               m_pointResolveFragmentShader},
+            pointDefines));
+    // An ivec4 array, set with glProgramUniform4iv
+    pointVertexAttributesLocation = glGetUniformLocation(
+        glslPointRasterizeProgram->glId(), "uVertexAttributes");
+  };
+
+  // GPU time of the passes of the frames, shown in the GUI and logged after
+  // offscreen renders. A benchmark keeps the time of each of its frames.
+  GpuProfiler gpuProfiler(m_bench.frames > 0 ? m_bench.frames : 120);
+
+  // The model is parsed and its buffers and textures uploaded by loadGraph,
+  // on jobs and on a loader thread with a context shared with the main one,
+  // while the main thread bakes the environment maps and starts rendering the
+  // skybox. VAOs cannot be shared between contexts so they are created by
+  // finishGeometry() on the main thread. Buffers are uploaded first: the
+  // model is drawn, and the camera can move, while its textures are still
+  // uploading.
+  enum LoadingStage
+  {
+    LOADING_PARSE,
+    LOADING_BUFFERS,
+    LOADING_TEXTURES,
+    LOADING_DONE
+  };
+  const char *const loadingStageNames[] = {
+      "Parsing", "Uploading buffers", "Uploading textures", "Done"};
+  std::atomic<int> loadingStage{LOADING_PARSE};
+
+  SceneGraph sceneGraph;
+  Animations animations;
+  Skins skins;
+  MorphTargets morphTargets;
+  GLTextures textureObjects;
+  GLSamplers samplerObjects; // Per glTF sampler, then the default
+  TextureStreamer textureStreamer;
+  if (textureStreaming)
+  {
+    textureStreamer.init(size_t(m_textureBudgetMB * 1024 * 1024));
+  }
+  // Used by the loader, then by the textures decoded or reloaded later
+  MipGenerator mipGenerator;
+  mipGenerator.init(m_ShadersRootPath / m_AppName / m_mipmapComputeShader);
+  // Owner of bufferObjects when they are shared with other renderers
+  std::shared_ptr<SharedGeometryBuffers> sharedBufferObjects;
+  GLBuffers bufferObjects;
+  GLBuffer morphDeltaBuffer;
+  GLTexture morphDeltaTexture; // GL_TEXTURE_BUFFER of morphDeltaBuffer
+  GLBuffer meshletsSSBO; // PackedGeometry::meshlets
+  GLBuffer vertexMembersBuffer; // PackedGeometry::vertexMembers
+  GLBuffer vertexFormatsSSBO; // Of PackedGeometry::vertexBuffers
+  // Every vertex buffer one after the other and their PulledVertexLayout, with
+  // the vertex array of the draw index alone, for vertex pulling
+  GLBuffer pulledVerticesSSBO;
+  GLBuffer pulledLayoutsSSBO;
+  GLVertexArray pulledVertexArray;
+  GLTexture vertexMembersTexture; // GL_TEXTURE_BUFFER of vertexMembersBuffer
+  GLsync uploadFence = nullptr; // Of the buffers
+  GLsync textureFence = nullptr;
+
+  // The loading steps run as a task graph: CPU steps on the job system, GL
+  // steps on the loader thread, each as soon as what it reads is ready, so
+  // that bounds, scene graph, packing and morph targets overlap and the
+  // buffers upload while the cache is written. Closing the window or opening
+  // another scene cancels the steps not started yet.
+  TaskGraph loadGraph;
+  auto stepStart = std::chrono::steady_clock::now();
+  glm::vec3 sceneBboxMin; // Without the skinned bounds, as cached
+  glm::vec3 sceneBboxMax;
+  const auto parseTask = loadGraph.add(TaskGraph::TASK_WORKER, [&]() {
+    JobSystem::shared().wait(parseGroup);
+    if (!loadSucceeded) {
+      return false;
+    }
+    stepStart = std::chrono::steady_clock::now();
+    loadingStage = LOADING_BUFFERS;
+    return true;
+  });
+  const auto boundsTask = loadGraph.add(TaskGraph::TASK_WORKER, [&]() {
+    if (!geometryCached) {
+      computeSceneBounds(model, runtimeModel, m_gltfBuffers, m_exactBounds,
+          bboxMin, bboxMax);
+    }
+    sceneBboxMin = bboxMin;
+    sceneBboxMax = bboxMax;
+    return true;
+  }, {parseTask});
+  const auto sceneTask = loadGraph.add(TaskGraph::TASK_WORKER, [&]() {
+    sceneGraph.build(runtimeModel);
+    animations.build(model, m_gltfBuffers, sceneGraph);
+    skins.build(model, m_gltfBuffers, sceneGraph);
+    return true;
+  }, {parseTask});
+  const auto skinnedBoundsTask = loadGraph.add(TaskGraph::TASK_WORKER, [&]() {
+    if (skins.empty()) {
+      return true;
+    }
+    // Skinned meshes are bounded by their joints in the initial pose
+    skins.update(sceneGraph, false);
+    Aabb sceneBounds{bboxMin, bboxMax};
+    for (size_t i = 0; i < sceneGraph.size(); ++i) {
+      const auto &node = runtimeModel.nodes()[sceneGraph.node(i)];
+      if (node.mesh < 0 || node.skin < 0 ||
+          size_t(node.skin) >= skins.size()) {
+        continue;
+      }
+      for (const auto &primitive :
+          runtimeModel.meshes()[node.mesh].primitives) {
+        const auto bounds =
+            skins.skinnedBounds(size_t(node.skin), primitive.bounds);
+        if (!bounds.isEmpty()) {
+          sceneBounds.min = glm::min(sceneBounds.min, bounds.min);
+          sceneBounds.max = glm::max(sceneBounds.max, bounds.max);
+        }
+      }
+    }
+    bboxMin = sceneBounds.min;
+    bboxMax = sceneBounds.max;
+    return true;
+  }, {boundsTask, sceneTask});
+  const auto samplersTask = loadGraph.add(TaskGraph::TASK_CONTEXT, [&]() {
+    samplerObjects = GLSamplers(createSamplerObjects(model));
+    return true;
+  }, {parseTask});
+  const auto packTask = loadGraph.add(TaskGraph::TASK_WORKER, [&]() {
+    if (!geometryCached) {
+      packGeometry(model, runtimeModel, m_gltfBuffers, m_geometryOptions,
+          geometry);
+    }
+    return true;
+  }, {parseTask});
+  const auto saveCacheTask = loadGraph.add(TaskGraph::TASK_WORKER, [&]() {
+    if (geometryCacheable && !geometryCached &&
+        !saveGeometryCache(geometryCachePath, geometryCacheKey, geometry,
+            sceneBboxMin, sceneBboxMax)) {
+      std::cerr << "Unable to write geometry cache " << geometryCachePath
+                << std::endl;
+    }
+    return true;
+  }, {packTask, boundsTask});
+  const auto buffersTask = loadGraph.add(TaskGraph::TASK_CONTEXT, [&]() {
+    // The buffers of the same packed geometry uploaded by another renderer of
+    // the serve command are referenced, those uploaded here are shared with
+    // the others
+    const auto sharedKey = geometryCachePath.string();
+    if (m_sharedObjects && geometryCacheable) {
+      sharedBufferObjects =
+          m_sharedObjects->find<SharedGeometryBuffers>(sharedKey);
+      if (sharedBufferObjects &&
+          !(sharedBufferObjects->key == geometryCacheKey)) {
+        sharedBufferObjects.reset();
+      }
+    }
+    if (!sharedBufferObjects) {
+      bufferObjects = GLBuffers(createBufferObjects(geometry));
+      for (const auto &vertexBuffer : geometry.vertexBuffers) {
+        loadTimes.uploadedBytes += vertexBuffer.vertices.size();
+      }
+      loadTimes.uploadedBytes +=
+          geometry.indices.size() * indexTypeSize(geometry.indexType);
+      if (m_sharedObjects && geometryCacheable) {
+        auto shared = std::make_shared<SharedGeometryBuffers>();
+        shared->key = geometryCacheKey;
+        shared->buffers = std::move(bufferObjects);
+        sharedBufferObjects =
+            m_sharedObjects->publish(sharedKey, std::move(shared));
+      }
+    } else {
+      for (size_t i = 0; i < geometry.vertexBuffers.size(); ++i) {
+        trackBuffer(GpuMemoryCategory::Geometry,
+            sharedBufferObjects->buffers[i],
+            geometry.vertexBuffers[i].vertices.size());
+      }
+      trackBuffer(GpuMemoryCategory::Geometry,
+          sharedBufferObjects->buffers.back(),
+          geometry.indices.size() * indexTypeSize(geometry.indexType));
+    }
+    if (sharedBufferObjects) {
+      // Referenced, not owned
+      bufferObjects = GLBuffers(sharedBufferObjects->buffers.names());
+      for (size_t i = 0; i < bufferObjects.size(); ++i) {
+        bufferObjects.release(i);
+      }
+    }
+    if (!geometry.meshlets.empty()) {
+      const auto size = geometry.meshlets.size() * sizeof(PackedMeshlet);
+      meshletsSSBO.generate();
+      glBindBuffer(GL_SHADER_STORAGE_BUFFER, meshletsSSBO);
+      glBufferStorage(
+          GL_SHADER_STORAGE_BUFFER, size, geometry.meshlets.data(), 0);
+      glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+      trackBuffer(GpuMemoryCategory::Geometry, meshletsSSBO, size);
+      loadTimes.uploadedBytes += size;
+    }
+    // Read by the wireframe overlay pulling the vertices of its triangles
+    if (wireframeSupported && !wireframeBarycentrics &&
+        !geometry.vertexBuffers.empty()) {
+      std::vector<PulledVertexFormat> formats(geometry.vertexBuffers.size());
+      const int attributeIndices[] = {VERTEX_ATTRIBUTE_POSITION,
+          VERTEX_ATTRIBUTE_NORMAL, VERTEX_ATTRIBUTE_TEXCOORD0,
+          VERTEX_ATTRIBUTE_TANGENT};
+      for (size_t i = 0; i < formats.size(); ++i) {
+        const auto &format = geometry.vertexBuffers[i].format;
+        formats[i].stride = GLint(format.stride);
+        for (size_t a = 0; a < 4; ++a) {
+          formats[i].attributes[a] =
+              pulledVertexAttribute(format.attributes[attributeIndices[a]]);
+        }
+      }
+      const auto size = formats.size() * sizeof(PulledVertexFormat);
+      vertexFormatsSSBO.generate();
+      glBindBuffer(GL_SHADER_STORAGE_BUFFER, vertexFormatsSSBO);
+      glBufferStorage(GL_SHADER_STORAGE_BUFFER, size, formats.data(), 0);
+      glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+      trackBuffer(GpuMemoryCategory::Geometry, vertexFormatsSSBO, size);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, WIREFRAME_FORMATS_BINDING,
+          vertexFormatsSSBO);
+      loadTimes.uploadedBytes += size;
+    }
+    // Read by the vertex shader when pulling vertices, a second copy of the
+    // vertex buffers since shadows, points and the visibility buffer keep
+    // the vertex arrays
+    if (m_vertexPulling && vertexPullingSupported &&
+        !geometry.vertexBuffers.empty()) {
+      std::vector<PulledVertexLayout> layouts(geometry.vertexBuffers.size());
+      size_t size = 0;
+      for (size_t i = 0; i < layouts.size(); ++i) {
+        const auto &vertexBuffer = geometry.vertexBuffers[i];
+        layouts[i] = {};
+        layouts[i].firstWord = GLuint(size / 4);
+        layouts[i].stride = GLuint(vertexBuffer.format.stride);
+        for (size_t a = 0; a < VERTEX_ATTRIBUTE_COUNT; ++a) {
+          layouts[i].attributes[a] =
+              pulledVertexAttribute(vertexBuffer.format.attributes[a]);
+        }
+        size += (vertexBuffer.vertices.size() + 3) / 4 * 4;
+      }
+      pulledVerticesSSBO.generate();
+      glBindBuffer(GL_SHADER_STORAGE_BUFFER, pulledVerticesSSBO);
+      glBufferStorage(GL_SHADER_STORAGE_BUFFER, std::max(size, size_t(4)),
+          nullptr, GL_DYNAMIC_STORAGE_BIT);
+      for (size_t i = 0; i < layouts.size(); ++i) {
+        const auto &vertices = geometry.vertexBuffers[i].vertices;
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER,
+            GLintptr(layouts[i].firstWord) * 4, vertices.size(),
+            vertices.data());
+      }
+      trackBuffer(GpuMemoryCategory::Geometry, pulledVerticesSSBO, size);
+      loadTimes.uploadedBytes += size;
+
+      const auto layoutsSize = layouts.size() * sizeof(PulledVertexLayout);
+      pulledLayoutsSSBO.generate();
+      glBindBuffer(GL_SHADER_STORAGE_BUFFER, pulledLayoutsSSBO);
+      glBufferStorage(
+          GL_SHADER_STORAGE_BUFFER, layoutsSize, layouts.data(), 0);
+      glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+      trackBuffer(GpuMemoryCategory::Geometry, pulledLayoutsSSBO, layoutsSize);
+      loadTimes.uploadedBytes += layoutsSize;
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PULLED_VERTICES_BINDING,
+          pulledVerticesSSBO);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PULLED_LAYOUTS_BINDING,
+          pulledLayoutsSSBO);
+
+      // The draw index attribute is added with those of the other vertex
+      // arrays, the indices are those of every vertex array
+      pulledVertexArray.generate();
+      glBindVertexArray(pulledVertexArray);
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufferObjects.back());
+      glBindVertexArray(0);
+    }
+    if (!geometry.vertexMembers.empty()) {
+      const auto size = geometry.vertexMembers.size() * sizeof(uint32_t);
+      vertexMembersBuffer.generate();
+      glBindBuffer(GL_TEXTURE_BUFFER, vertexMembersBuffer);
+      glBufferData(GL_TEXTURE_BUFFER, size, geometry.vertexMembers.data(),
+          GL_STATIC_DRAW);
+      glBindBuffer(GL_TEXTURE_BUFFER, 0);
+      trackBuffer(GpuMemoryCategory::Geometry, vertexMembersBuffer, size);
+      vertexMembersTexture.generate();
+      glBindTexture(GL_TEXTURE_BUFFER, vertexMembersTexture);
+      glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, vertexMembersBuffer);
+      glBindTexture(GL_TEXTURE_BUFFER, 0);
+      loadTimes.uploadedBytes += size;
+      std::clog << "Merged " << geometry.mergedMembers.size()
+                << " small primitives in "
+                << std::count_if(geometry.primitives.begin(),
+                       geometry.primitives.end(),
+                       [](const PackedPrimitive &p) { return p.memberCount > 0; })
+                << " draws" << std::endl;
+    }
+    return true;
+  }, {packTask});
+  // Images above the texture size cap are downscaled while the geometry is
+  // packed, decoded images are halved by jobs
+  const auto capImagesTask = loadGraph.add(TaskGraph::TASK_WORKER, [&]() {
+    if (m_maxTextureSize > 0) {
+      for (auto &image : model.images) {
+        capImageSize(image, m_maxTextureSize);
+      }
+    }
+    return true;
+  }, {parseTask});
+  // The triangles of path traced renders, occlusion and visible set bakes are
+  // copied before compactModel() releases the buffers
+  const auto pathTraceTask = loadGraph.add(TaskGraph::TASK_WORKER, [&]() {
+    if (pathTracing || occlusionBaking || visibleSetBaking) {
+      pathTracer.readMeshes(model, m_gltfBuffers);
+    }
+    return true;
+  }, {parseTask});
+  // The occlusion baked by a previous load, else the vertices to bake it on,
+  // read before the geometry data is released
+  const auto occlusionTask = loadGraph.add(TaskGraph::TASK_WORKER, [&]() {
+    if (!occlusionBaking) {
+      return true;
+    }
+    if (geometryCacheable) {
+      occlusionCachePath = occlusionCacheFile(geometryCachePath);
+      std::vector<uint8_t> occlusion;
+      occlusionBaked = loadOcclusionCache(occlusionCachePath, geometryCacheKey,
+                           occlusionRays, occlusion) &&
+                       occlusionBaker.setOcclusion(geometry, std::move(occlusion));
+    }
+    if (!occlusionBaked) {
+      occlusionBaker.readVertices(geometry);
+    }
+    return true;
+  }, {packTask});
+  const auto occluderTask = loadGraph.add(TaskGraph::TASK_WORKER, [&]() {
+    softwareOcclusion.readOccluders(geometry, OCCLUDER_MAX_TRIANGLES);
+    return true;
+  }, {packTask});
+  const auto morphTask = loadGraph.add(TaskGraph::TASK_WORKER, [&]() {
+    morphTargets.build(model, runtimeModel, m_gltfBuffers, geometry);
+    return true;
+  }, {packTask});
+  const auto morphUploadTask = loadGraph.add(TaskGraph::TASK_CONTEXT, [&]() {
+    if (morphTargets.empty()) {
+      return true;
+    }
+    const auto size = morphTargets.deltas().size() * sizeof(glm::vec3);
+    morphDeltaBuffer.generate();
+    glBindBuffer(GL_TEXTURE_BUFFER, morphDeltaBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, size, morphTargets.deltas().data(),
+        GL_STATIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    trackBuffer(GpuMemoryCategory::Geometry, morphDeltaBuffer, size);
+    morphDeltaTexture.generate();
+    glBindTexture(GL_TEXTURE_BUFFER, morphDeltaTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGB32F, morphDeltaBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    loadTimes.uploadedBytes += size;
+    morphTargets.clearDeltas();
+    return true;
+  }, {morphTask});
+  // finishGeometry() takes over once every buffer is uploaded
+  const auto geometryTask = loadGraph.add(TaskGraph::TASK_CONTEXT, [&]() {
+    geometry.clearData();
+    uploadFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush(); // Make the fence visible to the main context
+    loadTimes.buffers = msSince(stepStart);
+    stepStart = std::chrono::steady_clock::now();
+    loadingStage = LOADING_TEXTURES;
+    return true;
+  }, {skinnedBoundsTask, samplersTask, saveCacheTask, buffersTask,
+         morphUploadTask, pathTraceTask, occlusionTask, occluderTask});
+  loadGraph.add(TaskGraph::TASK_CONTEXT, [&]() {
+    textureObjects = GLTextures(createTextureObjects(model,
+        textureStreaming ? &textureStreamer : nullptr, mipGenerator,
+        loadTimes.uploadedBytes));
+    for (const auto texture : textureObjects) {
+      trackTexture(
+          GpuMemoryCategory::MaterialTextures, GL_TEXTURE_2D, texture);
+    }
+    textureFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+    loadTimes.textures = msSince(stepStart);
+    return true;
+  }, {geometryTask, capImagesTask});
+
+  const auto loadModel = [&]() {
+    loadGraph.run();
+    loadingStage = LOADING_DONE;
+  };
+
+  loadTimes.shaders = msSince(runStart);
+  void *loaderContext = m_GLFWHandle.createSharedContext();
+  std::thread loaderThread;
+  if (loaderContext) {
+    loaderThread = std::thread([&]() {
+      m_GLFWHandle.makeContextCurrent(loaderContext);
+      initGLDebugOutput();
+      GpuMemoryTracker::current() = &m_gpuMemory;
+      loadModel();
+      m_GLFWHandle.makeContextCurrent(nullptr);
+    });
+  } else {
+    loadModel();
+  }
+
+  const auto joinLoaderThread = [&]() {
+    if (loaderThread.joinable()) {
+      loaderThread.join();
+    }
+    if (loaderContext) {
+      m_GLFWHandle.destroySharedContext(loaderContext);
+      loaderContext = nullptr;
+    }
+  };
+
+  // Config (IMGUI)
+  int controlsType = 0;
+  bool lightFromCamera = true;
+  float lightAngleH = 1.55f;
+  float lightAngleV = 2.0f;
+  bool featureTexture = true;
+  bool featureMetallicRoughness = true;
+  bool featureOcclusion = m_detailMaps;
+  bool featureEmission = true;
+  bool featureNormal = m_detailMaps;
+  bool featureEnvironment = true;
+  bool featureSHIrradiance = true;
+  bool featureFrustumCulling = true;
+  // Frustum culling through the node hierarchy instead of the BVH
+  bool featureNodeCulling = false;
+  bool featureOcclusionCulling = false;
+  // Culling by the potentially visible sets of the cell of the eye, when
+  // they were baked
+  bool featureVisibleSets = true;
+  // Culling by the largest opaque items of the frame, rasterized on the CPU
+  bool featureSoftwareOcclusion = false;
+  bool featureLevelsOfDetail = true;
+  // Draws of primitives projecting to fewer pixels than shadingLodPixels
+  // shaded with a cheaper permutation
+  bool featureShadingLod = m_shadingLod;
+  float shadingLodPixels = SHADING_LOD_DEFAULT_PIXELS;
+  // Objects projecting to fewer pixels than impostorPixels drawn as their
+  // impostor, when their mesh has one
+  bool featureImpostors = true;
+  float impostorPixels = IMPOSTOR_DEFAULT_PIXELS;
+  bool featureMeshletCulling = true;
+  bool featureGpuCulling = m_gpuCulling && gpuCullingSupported;
+  // Opaque draws shaded once per pixel from a visibility buffer
+  bool featureVisibilityBuffer =
+      m_visibilityBuffer && visibilityBufferSupported;
+  // Vertices of the forward passes pulled from storage buffers, when they
+  // were uploaded for it
+  bool featureVertexPulling = m_vertexPulling && vertexPullingSupported;
+  // POINTS primitives drawn from their octree, the nodes covering the most
+  // pixels first under a budget of points, optionally splatted by a compute
+  // shader
+  bool featurePointClouds = true;
+  bool featurePointRasterizer = false;
+  float pointBudgetMillions = POINT_DEFAULT_BUDGET;
+  float pointSizeScale = 1.f;
+  // Triangle edges drawn over the shading of every draw, in the same pass
+  bool featureWireframe = false;
+  bool featureDepthPrepass = false;
+  // Computed from the depth pre-pass, drawn with it
+  bool featureAmbientOcclusion = false;
+  bool featureShadows = m_quality.shadows;
+  // BLEND materials are drawn back to front instead of with weighted blended
+  // order-independent transparency
+  bool featureSortedBlending = false;
+  // Near and far planes fitted to the visible items of each frame
+  bool featureFittedDepthRange = true;
+  // Infinite projection with depths of 1 at the near plane down to 0, see
+  // drawScene
+  bool featureReversedZ = reversedZSupported;
+  // 2x2 views of the window, see drawQuadViews
+  bool featureQuadViews = false;
+  // Side by side stereo drawn in a single pass, see drawScene
+  bool featureStereo = false;
+  // Flat regions of the opaque pass shaded at coarser rates, the periphery in
+  // stereo, see ShadingRateImage
+  bool featureShadingRate = false;
+  float shadingRateThreshold = 0.02f;
+
+  // Work submitted by the last drawScene, see --stats-csv
+  FrameStats frameStats;
+
+  glm::vec3 lightDirectionRaw = glm::vec3(1.0f, 1.0f, 1.0f);
+  glm::vec3 lightRadiance = glm::vec3(1.0f, 1.0f, 1.0f);
+
+  std::unique_ptr<CameraController> cameraController(
+	  std::make_unique<TrackballCameraController>());
+
+  // Until the model is loaded and its bounds are known
+  glm::mat4 projMatrix = glm::perspective(
+		  70.f,
+		  float(m_nWindowWidth) / m_nWindowHeight,
+		  0.1f,
+		  100.f);
+
+  // Pixels of the image drawn by drawScene, x, y of the bottom left corner
+  // then width, height. Tiled renders draw the sub-frustum of projMatrix
+  // covering each tile, the whole image is drawn if empty.
+  glm::ivec4 drawnTile(0);
+  // Pixels of the whole image drawn by drawScene, the window size if 0.
+  // Dynamic resolution draws smaller images, with the projection of the
+  // window.
+  glm::ivec2 drawnImageSize(0);
+  // Pixel of the bound framebuffer the image drawn by drawScene is tonemapped
+  // to, and index of its view among those of the window frame, below
+  // MAX_VIEWS
+  glm::ivec2 drawnOrigin(0);
+  int drawnView = 0;
+
+  // Scenes are drawn to hdrTarget, then tonemapped to the bound framebuffer
+  // unless it stores floats, see drawScene
+  HdrTarget hdrTarget;
+
+  // Bloom of the tonemapped scenes, see drawTonemap
+  BloomChain bloomChain;
+
+  // Weighted blended transparency of BLEND materials, see drawScene
+  TransparencyTargets transparencyTargets;
+
+  // Draw and triangle of the pixels of the opaque draws, see drawScene
+  VisibilityBuffer visibilityBuffer;
+
+  // Cube map and image of --panorama renders, see drawPanorama
+  PanoramaTargets panoramaTargets;
+
+  // Passes of drawScene and their transient targets, built again by each
+  // call, and the data of the call that dies with it. Both are reset by the
+  // next call.
+  FrameArena frameArena;
+  FrameGraph frameGraph;
+
+  // Screen-space ambient occlusion, see drawScene. Its targets cover the
+  // largest viewport drawn. The radius is a fraction of the diagonal of the
+  // scene bounds.
+  glm::ivec2 ambientOcclusionExtent(0);
+  float ambientOcclusionRadius = AO_DEFAULT_RADIUS;
+  float sceneDiagonal = 100.f;
+
+  // The draw item under a click, see drawScene. Picks are read back frames
+  // after they are drawn, their draw indices are those of the queue entries
+  // of their frame, kept in pickEntryItems.
+  Picker picker;
+  bool pickRequested = false;
+  glm::vec2 pickPosition(0); // In [0, 1] of the image, from the bottom left
+  std::vector<uint32_t> pickEntryItems;
+  int pickedItem = -1; // In drawItems, -1 if none
+
+  // Temporal anti-aliasing of the window, see drawTemporalFrame. Its frames
+  // are jittered and write velocities since the previous one, from the
+  // unjittered matrices that frame was drawn with.
+  bool featureTemporalAA = m_temporalAA;
+  bool drawnTemporal = false;
+  TemporalAntiAliasing temporalAA;
+  glm::mat4 previousProjMatrix(1);
+  glm::mat4 previousViewMatrix(1);
+  std::vector<glm::mat4> previousDrawItemMatrices;
+
+  // Dynamic resolution of the window, see drawWindowFrame
+  bool featureDynamicResolution = m_framePacing.targetFrameMs > 0;
+  float targetFrameMs = featureDynamicResolution
+                            ? m_framePacing.targetFrameMs
+                            : DEFAULT_TARGET_FRAME_MS;
+  float upscaleSharpness = DEFAULT_UPSCALE_SHARPNESS;
+  DynamicResolution dynamicResolution;
+
+  // Frame of the window kept once the scene is still, see cacheWindowFrame
+  bool featureFrameReuse = true;
+  GLTexture frameCacheColor;
+  GLFramebuffer frameCacheFramebuffer;
+  glm::ivec2 frameCacheSize(0);
+
+  // The window follows its framebuffer at once. Targets of the exact window
+  // size, of temporal anti-aliasing, dynamic resolution and the frame cache,
+  // are reallocated once it has kept its size for
+  // WINDOW_RESIZE_SETTLE_SECONDS, the frames are drawn without them until
+  // then.
+  double windowResizeSeconds = -WINDOW_RESIZE_SETTLE_SECONDS;
+  bool windowResizing = false;
+
+  if (m_hasUserCamera)
+  {
+    cameraController->setCamera(m_userCamera);
+  }
+
+  // Physically-Based Materials
+  GLuint whiteTexture;
+  float white[] = {1, 1, 1, 1};
+  glGenTextures(1, &whiteTexture);
+  glBindTexture(GL_TEXTURE_2D, whiteTexture);
+  glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, 1, 1);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 1, 1, GL_RGBA, GL_FLOAT, white);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_REPEAT);
+
+  GLuint greyTexture;
+  float grey[] = {0.5f, 0.5f, 0.5f, 1};
+  glGenTextures(1, &greyTexture);
+  glBindTexture(GL_TEXTURE_2D, greyTexture);
+  glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, 1, 1);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 1, 1, GL_RGBA, GL_FLOAT, grey);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_REPEAT);
+
+  // Owner of the white and grey textures, or of the names identifying them
+  // once packed in texture arrays
+  GLTextures neutralTextures({whiteTexture, greyTexture});
+
+	// dummy cubemap
+	GLTexture whiteCube;
+	whiteCube.generate();
+	glBindTexture(GL_TEXTURE_CUBE_MAP, whiteCube);
+
+	for (GLuint i = 0; i < 6; ++i)
+	{
+		glTexImage2D(
+			GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
+			0,
+			GL_RGB16F,
+			1,
+			1,
+			0, 
+			GL_RGB,
+			GL_FLOAT,
+			white);
+	}
+
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+  // Cubemap
+  initQuad();
+  initCube();
+
+  // Image based lighting textures are read from the cache next to the
+  // executable when the same HDR file was already baked with the same sizes.
+  // The maps of the previous scene are kept if it had the same environment
+  // and m_iblOptions.
+  const auto environmentStart = std::chrono::steady_clock::now();
+  bool environmentLoaded = false;
+  if (!environmentKept) {
+    m_environmentMaps.reset();
+    if (sharedEnvironment) {
+      m_environmentMaps = std::move(sharedEnvironment);
+    } else {
+      m_environmentMaps =
+          loadCachedEnvironmentMaps(m_cubeMapFilePath, m_iblOptions);
+      environmentLoaded = true;
+    }
+  }
+  if (!m_environmentMaps) {
+    TRACE_ZONE("bakeIbl");
+    EnvironmentImage image;
+    bool imageRead = true;
+    if (environmentPrefetched) {
+      JobSystem::shared().wait(environmentPrefetchGroup);
+      image = std::move(prefetchedEnvironment);
+      imageRead = prefetchedEnvironmentRead;
+    } else if (!m_cubeMapFilePath.empty()) {
+      imageRead = readEnvironmentImage(m_cubeMapFilePath, image);
+    }
+    if (!imageRead) {
+      std::cerr << "Failed to load cubemap" << std::endl;
+    }
+    const auto bake =
+        startEnvironmentBake(m_cubeMapFilePath, image, m_iblOptions, true, 6);
+
+    GpuProfiler bakeProfiler(1);
+    bakeProfiler.beginFrame();
+    const char *stage = nullptr;
+    for (const auto &step : bake->steps) {
+      if (step.stage != stage) {
+        if (stage) {
+          bakeProfiler.end();
+        }
+        stage = step.stage;
+        bakeProfiler.begin(stage);
+      }
+      step.run();
+    }
+    bakeProfiler.endFrame();
+    bakeProfiler.flush();
+    std::clog << "IBL bake GPU time: " << bakeProfiler.summary() << "\n";
+
+    m_environmentMaps = finishEnvironmentBake(*bake, nullptr);
+    environmentLoaded = true;
+  }
+  if (environmentLoaded && environmentKeyed && m_sharedObjects) {
+    m_environmentMaps = m_sharedObjects->publish(
+        environmentCacheFile.string(), std::move(m_environmentMaps));
+  }
+
+  // Names of the current maps, replaced by those of environments switched to
+  // at runtime
+  GLuint brdfLUT = 0;
+  GLuint envTexture = 0;
+  GLuint irradianceMap = 0;
+  GLuint prefilterMap = 0;
+  GLBuffer shIrradianceUBO;
+  shIrradianceUBO.generate();
+  // The sky samples the first level of the environment whatever the sampler
+  // state left on its unit by the materials or the texture parameters of the
+  // maps switched to
+  GLSampler skyboxSampler;
+  skyboxSampler.generate();
+  glSamplerParameteri(skyboxSampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glSamplerParameteri(skyboxSampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glSamplerParameteri(skyboxSampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glSamplerParameteri(skyboxSampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glSamplerParameteri(skyboxSampler, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+  const auto useEnvironmentMaps = [&]() {
+    brdfLUT = m_environmentMaps->brdfLut;
+    envTexture = m_environmentMaps->environment;
+    irradianceMap = m_environmentMaps->irradiance;
+    prefilterMap = m_environmentMaps->prefilter;
+    trackTexture(GpuMemoryCategory::Environment, GL_TEXTURE_2D, brdfLUT);
+    trackTexture(
+        GpuMemoryCategory::Environment, GL_TEXTURE_CUBE_MAP, envTexture);
+    trackTexture(
+        GpuMemoryCategory::Environment, GL_TEXTURE_CUBE_MAP, irradianceMap);
+    trackTexture(
+        GpuMemoryCategory::Environment, GL_TEXTURE_CUBE_MAP, prefilterMap);
+
+    const auto &shIrradiance = m_environmentMaps->shIrradiance;
+    glBindBuffer(GL_UNIFORM_BUFFER, shIrradianceUBO);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(shIrradiance), &shIrradiance,
+        GL_STATIC_DRAW);
+    trackBuffer(GpuMemoryCategory::ShaderBuffers, shIrradianceUBO,
+        sizeof(shIrradiance));
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  };
+  useEnvironmentMaps();
+  trackTexture(GpuMemoryCategory::Environment, GL_TEXTURE_CUBE_MAP, whiteCube);
+  trackTexture(
+      GpuMemoryCategory::MaterialTextures, GL_TEXTURE_2D, whiteTexture);
+  trackTexture(GpuMemoryCategory::MaterialTextures, GL_TEXTURE_2D, greyTexture);
+  glBindBufferBase(
+      GL_UNIFORM_BUFFER, SH_IRRADIANCE_BINDING, shIrradianceUBO);
+  loadTimes.environment = msSince(environmentStart);
+
+  // Reset
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  // Model ready to be drawn, and its textures ready to be sampled
+  bool modelReady = false;
+  bool texturesReady = false;
+  std::vector<PrimitiveRange> meshPrimitiveRanges;
+  VertexLayoutCache vertexLayouts;
+  // Per vertex buffer of geometry, owned by vertexLayouts
+  std::vector<GLuint> vertexArrayObjects;
+  std::vector<Aabb> primitiveBounds; // Same indices as geometry.primitives
+  std::vector<float> primitiveDistances; // Of the nearest visible item
+  // Size in pixels of the largest projected visible item, for shading LOD
+  std::vector<float> primitivePixels;
+
+  // Every primitive of the scene with its world bounds, in scene graph order,
+  // then the merged primitives
+  std::vector<DrawItem> drawItems;
+  // Scene graph position of the node of each of geometry.mergedMembers
+  std::vector<size_t> mergedMemberNodes;
+  std::vector<LodNode> lodNodes; // Indexed by DrawItem::lodNode
+  std::vector<glm::mat4> instanceMatrices; // Indexed by DrawItem::instance
+  std::vector<glm::mat4> drawItemMatrices; // World matrices, with instances
+  // Normal matrices of drawItemMatrices, computed with them
+  std::vector<glm::mat3x4> drawItemNormalMatrices;
+  std::vector<Aabb> drawItemBounds;
+  Aabb sceneItemBounds; // Of every draw item
+  Bvh sceneBvh;
+  // Alternative to sceneBvh, its bounds updated by the first query after the
+  // nodes moved
+  NodeCulling nodeCulling;
+  bool nodeCullingDirty = true;
+  std::vector<uint32_t> visibleItems;
+  RenderQueue renderQueue;
+
+  // Transforms of the draws of a frame, read by the vertex shader at the index
+  // given by the draw index attribute
+  PersistentRingBuffer drawTransforms;
+  GLBuffer drawIndexBuffer;
+
+  // Indirect command of each draw item, built at load time with the index
+  // range of the level of detail selected for the frame, and the commands of
+  // the draws of a frame in queue order with the draw index as base instance
+  std::vector<DrawElementsIndirectCommand> drawItemCommands;
+  PersistentRingBuffer drawCommands;
+  // First queue entry of each command of a frame, the consecutive entries it
+  // draws as instances, and whether the command is drawn under conditional
+  // rendering
+  std::vector<size_t> commandEntries;
+  std::vector<size_t> commandInstances;
+  std::vector<char> commandConditional;
+  std::vector<size_t> commandTriangles; // Of every instance
+  // Bin + 1 of each command shaded from the visibility buffer, 0 for those
+  // shaded forward, and the bins of the frame
+  std::vector<GLuint> commandVisibility;
+  std::vector<VisibilityBin> visibilityBins;
+  // Index range and bin of the draws of a frame, at their draw index
+  PersistentRingBuffer visibilityDraws;
+
+  // Point clouds drawn from their octree: their entries in the queue of a
+  // frame, left out of its commands, the octree nodes considered and those
+  // selected, and a command, or a job of the compute rasterizer, per node of
+  // every point cloud item
+  std::vector<size_t> pointEntries;
+  std::vector<PointNodeCandidate> pointCandidates;
+  std::vector<PointNodeDraw> pointDraws;
+  std::vector<float> pointNodeSpacings; // Of the nodes of an entry
+  PersistentRingBuffer pointCommands;
+  PersistentRingBuffer pointJobs;
+  // Depth and color of the closest point of each pixel, of the compute
+  // rasterizer
+  GLBuffer pointFramebuffer;
+  size_t pointFramebufferSize = 0;
+
+  // Meshlet culling: the commands of a frame with their meshlets, and the
+  // draws and draw count of each batch written by the culling. A batch gets
+  // one draw per meshlet of each of its instances, or per command without
+  // meshlets, so the draws of every item fit in clusterDrawCapacity.
+  PersistentRingBuffer clusterCommands;
+  GLBuffer clusterDraws;
+  GLBuffer clusterCounts;
+  size_t clusterDrawCapacity = 0;
+  std::vector<GLuint> commandBatches; // Batch of each command of a frame
+  std::vector<GLuint> batchDrawOffsets; // First draw of each, and the total
+
+  // Sampler object of a glTF texture
+  const auto textureSampler = [&](int textureIndex)
+  {
+    const auto sampler = model.textures[textureIndex].sampler;
+    return sampler >= 0 ? samplerObjects[sampler] : samplerObjects.back();
+  };
+
+  // Resident bindless handle of each texture and sampler object pair
+  std::unordered_map<uint64_t, GLuint64> textureHandles;
+  const auto textureHandleKey = [](GLuint texture, GLuint sampler)
+  {
+    return (uint64_t(texture) << 32) | sampler;
+  };
+
+  // Array and layer each texture has been copied to with texture arrays, by
+  // the name identifying the deleted 2D texture, see packInTextureArrays
+  std::unordered_map<GLuint, TextureArrayLayer> textureArrayLayers;
+  GLTextures textureArrayObjects;
+
+  // One occlusion query per draw item, tested against the bounding box of the
+  // item at the end of the previous frame in which it was in the frustum
+  GLQueries occlusionQueries;
+  std::vector<char> occlusionQueryIssued;
+
+  // GPU culling: the world bounds of the items, uploaded when they change,
+  // the item of each draw of a frame, and the depth pyramid of the previous
+  // frame with the matrix and depths it was drawn with. Occlusion culling
+  // tests the pyramid instead of issuing queries.
+  GLBuffer drawBoundsSSBO;
+  bool drawBoundsUploaded = false;
+  PersistentRingBuffer drawEntryItems;
+  DepthPyramid depthPyramid;
+  bool depthPyramidValid = false;
+  glm::mat4 depthPyramidViewProjMatrix(1);
+  glm::ivec2 depthPyramidSceneSize(0);
+  bool depthPyramidReversedZ = false;
+
+  // Rates of the opaque pass computed at the end of the previous frame, of
+  // shadingRateSceneSize pixels, none if 0
+  ShadingRateImage shadingRateImage;
+  glm::ivec2 shadingRateSceneSize(0);
+
+  const auto isMergedItem = [&](const DrawItem &item)
+  {
+    return geometry.primitives[item.packedPrimitive].memberCount > 0;
+  };
+
+  // World matrix of a draw item, including the one of its instance. Skinned
+  // items are placed by their joint matrices alone, and merged items by the
+  // transforms of their members.
+  const auto drawItemMatrix = [&](const DrawItem &item)
+  {
+    const auto nodeMatrix = item.skin < 0 && !isMergedItem(item)
+        ? sceneGraph.worldMatrix(item.node)
+        : glm::mat4(1);
+    return item.instance < 0
+        ? nodeMatrix
+        : nodeMatrix * instanceMatrices[item.instance];
+  };
+
+  // Joint matrices of the skins, uploaded whenever the scene changes. Each
+  // draw item reads them from the first joint of its skin.
+  bool dualQuaternionSkinning = false;
+  bool skinsDualQuaternion = false; // Content of skinJointsSSBO
+  GLBuffer skinJointsSSBO;
+  const auto drawItemSkinJoints = [&](const DrawItem &item)
+  {
+    return item.skin < 0
+        ? SKIN_NONE
+        : skins.firstJoint(size_t(item.skin))
+            | (skinsDualQuaternion ? SKIN_DUAL_QUATERNION_BIT : 0u);
+  };
+  const auto drawItemMergedVertices = [&](const DrawItem &item)
+  {
+    const auto &packed = geometry.primitives[item.packedPrimitive];
+    return packed.memberCount > 0
+        ? geometry.vertexBuffers[packed.vertexBuffer].firstVertexMember
+        : PACKED_MERGE_NONE;
+  };
+  const auto drawItemBakedOcclusion = [&](const DrawItem &item)
+  {
+    const auto &packed = geometry.primitives[item.packedPrimitive];
+    return occlusionBaker.texture()
+        ? occlusionBaker.firstVertex(packed.vertexBuffer)
+        : BAKED_OCCLUSION_NONE;
+  };
+  // Active morph targets of the draw items, uploaded whenever a weight
+  // changes
+  GLBuffer morphTargetsSSBO;
+  const auto uploadMorphTargets = [&]()
+  {
+    const auto &activeTargets = morphTargets.activeTargets();
+    const auto size =
+        activeTargets.size() * sizeof(MorphTargets::ActiveTarget);
+    if (!morphTargetsSSBO)
+    {
+      morphTargetsSSBO.generate();
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, morphTargetsSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, size, activeTargets.data(),
+        GL_DYNAMIC_DRAW);
+    trackBuffer(GpuMemoryCategory::ShaderBuffers, morphTargetsSSBO, size);
+    frameStats.uploadedBytes += size;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(
+        GL_SHADER_STORAGE_BUFFER, MORPH_TARGETS_BINDING, morphTargetsSSBO);
+  };
+
+  // Transforms of the members of the merged primitives, uploaded whenever
+  // the world matrices change
+  GLBuffer mergedTransformsSSBO;
+  const auto uploadMergedTransforms =
+      [&](const std::vector<MergedTransform> &transforms)
+  {
+    if (transforms.empty())
+    {
+      return;
+    }
+    const auto size = transforms.size() * sizeof(MergedTransform);
+    if (!mergedTransformsSSBO)
+    {
+      mergedTransformsSSBO.generate();
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, mergedTransformsSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, size, transforms.data(),
+        GL_DYNAMIC_DRAW);
+    trackBuffer(GpuMemoryCategory::ShaderBuffers, mergedTransformsSSBO, size);
+    frameStats.uploadedBytes += size;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MERGED_TRANSFORMS_BINDING,
+        mergedTransformsSSBO);
+  };
+
+  // World bounds of the draw items for the GPU culling, empty ones keep
+  // their min above their max
+  const auto uploadDrawBounds = [&]()
+  {
+    std::vector<DrawBounds> bounds(drawItemBounds.size());
+    for (size_t i = 0; i < bounds.size(); ++i)
+    {
+      bounds[i].min = glm::vec4(drawItemBounds[i].min, 1);
+      bounds[i].max = glm::vec4(drawItemBounds[i].max, 1);
+    }
+    const auto size = bounds.size() * sizeof(DrawBounds);
+    if (!drawBoundsSSBO)
+    {
+      drawBoundsSSBO.generate();
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, drawBoundsSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, size, bounds.data(),
+        GL_DYNAMIC_DRAW);
+    trackBuffer(GpuMemoryCategory::ShaderBuffers, drawBoundsSSBO, size);
+    frameStats.uploadedBytes += size;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_BOUNDS_BINDING,
+        drawBoundsSSBO);
+    drawBoundsUploaded = true;
+  };
+
+  const auto uploadSkins = [&]()
+  {
+    const auto size = skins.palette().size() * sizeof(glm::mat4);
+    if (!skinJointsSSBO)
+    {
+      skinJointsSSBO.generate();
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, skinJointsSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, size, skins.palette().data(),
+        GL_DYNAMIC_DRAW);
+    trackBuffer(GpuMemoryCategory::ShaderBuffers, skinJointsSSBO, size);
+    frameStats.uploadedBytes += size;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(
+        GL_SHADER_STORAGE_BUFFER, SKIN_JOINTS_BINDING, skinJointsSSBO);
+  };
+
+  const auto uploadPunctualLights = [&]()
+  {
+    if (punctualLights.empty())
+    {
+      return;
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, punctualLightsSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER,
+        punctualLights.size() * sizeof(PunctualLight), punctualLights.data(),
+        GL_DYNAMIC_DRAW);
+    trackBuffer(GpuMemoryCategory::ShaderBuffers, punctualLightsSSBO,
+        punctualLights.size() * sizeof(PunctualLight));
+    frameStats.uploadedBytes += punctualLights.size() * sizeof(PunctualLight);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(
+        GL_SHADER_STORAGE_BUFFER, PUNCTUAL_LIGHTS_BINDING, punctualLightsSSBO);
+  };
+
+  // Pose of the scene computed by a job, next to the one being drawn
+  struct SceneTransforms
+  {
+    std::vector<glm::mat4> itemMatrices;
+    std::vector<glm::mat3x4> itemNormalMatrices;
+    std::vector<Aabb> itemBounds;
+    std::vector<MergedTransform> mergedTransforms;
+    Aabb sceneBounds;
+    std::vector<PunctualLight> punctualLights;
+    bool worldChanged = false;
+    bool skinsChanged = false;
+    bool weightsChanged = false;
+    bool dualQuaternions = false; // Of the skin palette
+  };
+
+  // Images kept encoded by m_lazyTextures are decoded by jobs, the first time
+  // a visible draw samples them. The main thread creates their textures.
+  // Declared before their group, which waits for the jobs when destroyed.
+  struct DecodedImage
+  {
+    int imageIdx;
+    bool decoded;
+    tinygltf::Image image;
+    std::string message; // Errors and warnings
+    // Read again from its rewritten file, the textures already created from
+    // the image are replaced
+    bool reloaded = false;
+  };
+  std::mutex decodedImagesMutex;
+  std::vector<DecodedImage> decodedImages;
+  JobSystem::Group imageDecodeGroup;
+  std::vector<char> imageDecodeRequested; // Per image of the model
+  size_t pendingImageDecodes = 0;
+
+  // Animations, world matrices, skins, morph targets, item bounds and lights
+  // are updated by a job while the main thread draws the previous pose, which
+  // finishSceneUpdate() then replaces. Until then the scene graph, the
+  // animations, the skins and the morph targets belong to the job, and GL
+  // calls stay on the main thread.
+  auto &jobs = JobSystem::shared();
+  SceneTransforms nextTransforms;
+  bool sceneUpdatePending = false;
+  // Set when the drawn pose changes, until drawScene refits the shadows
+  bool sceneTransformsChanged = false;
+
+  // World bounds of a merged item, of the ones of its members
+  const auto mergedBounds = [&](const DrawItem &item)
+  {
+    const auto &merged = geometry.primitives[item.packedPrimitive];
+    Aabb bounds;
+    for (auto i = merged.firstMember;
+         i < merged.firstMember + merged.memberCount; ++i)
+    {
+      const auto &memberBounds = primitiveBounds[geometry.mergedMembers[i]];
+      if (!memberBounds.isEmpty())
+      {
+        const auto world = transformAabb(
+            memberBounds, sceneGraph.worldMatrix(mergedMemberNodes[i]));
+        bounds.min = glm::min(bounds.min, world.min);
+        bounds.max = glm::max(bounds.max, world.max);
+      }
+    }
+    return bounds;
+  };
+
+  // Fill nextTransforms with the pose at seconds into the current animation,
+  // which loops, or the current pose if seconds is negative. With all, every
+  // part is computed whether it changed or not.
+  size_t currentAnimation = 0;
+  const auto updateSceneTransforms =
+      [&](float seconds, bool dualQuaternions, bool all)
+  {
+    TRACE_ZONE("updateSceneTransforms");
+    auto &next = nextTransforms;
+    if (seconds >= 0.f && !animations.empty())
+    {
+      const auto duration = animations.duration(currentAnimation);
+      animations.apply(
+          currentAnimation,
+          duration > 0.f ? std::fmod(seconds, duration) : 0.f,
+          sceneGraph);
+    }
+    next.worldChanged = sceneGraph.updateWorldMatrices() || all;
+    next.skinsChanged = !skins.empty()
+        && (next.worldChanged || dualQuaternions != skinsDualQuaternion);
+    next.weightsChanged = !morphTargets.activeTargets().empty()
+        && (sceneGraph.updateWeights() || all);
+    next.dualQuaternions = dualQuaternions;
+
+    // Skins, morph targets and lights only read the world matrices
+    JobSystem::Group group;
+    if (next.skinsChanged)
+    {
+      jobs.run(group, [&]() { skins.update(sceneGraph, dualQuaternions); });
+    }
+    if (next.weightsChanged)
+    {
+      jobs.run(group, [&]() { morphTargets.update(sceneGraph); });
+    }
+    if (next.worldChanged)
+    {
+      jobs.run(group,
+          [&]() { getPunctualLights(model, sceneGraph, next.punctualLights); });
+    }
+    jobs.wait(group);
+    if (!next.worldChanged)
+    {
+      return;
+    }
+
+    // Skinned bounds need the joint matrices
+    next.itemMatrices.resize(drawItems.size());
+    next.itemNormalMatrices.resize(drawItems.size());
+    next.itemBounds.resize(drawItems.size());
+    jobs.parallelFor(drawItems.size(), SCENE_UPDATE_CHUNK_SIZE,
+        [&](size_t begin, size_t end)
+        {
+          for (size_t i = begin; i < end; ++i)
+          {
+            const auto &item = drawItems[i];
+            const auto &bounds = primitiveBounds[item.packedPrimitive];
+            const auto localBounds = item.skin < 0
+                ? bounds
+                : skins.skinnedBounds(size_t(item.skin), bounds);
+            next.itemMatrices[i] = drawItemMatrix(item);
+            next.itemNormalMatrices[i] = normalMatrix(next.itemMatrices[i]);
+            if (isMergedItem(item))
+            {
+              next.itemBounds[i] = mergedBounds(item);
+            }
+            else
+            {
+              next.itemBounds[i] = localBounds.isEmpty()
+                  ? localBounds
+                  : transformAabb(localBounds, next.itemMatrices[i]);
+            }
+          }
+        });
+
+    // The dequantization of the positions of each member is folded into its
+    // matrix, the vertices of a merged primitive are read as they are
+    next.mergedTransforms.resize(geometry.mergedMembers.size());
+    for (size_t i = 0; i < geometry.mergedMembers.size(); ++i)
+    {
+      const auto &worldMatrix = sceneGraph.worldMatrix(mergedMemberNodes[i]);
+      const auto &dequantize =
+          geometry.primitives[geometry.mergedMembers[i]].positionDequantize;
+      next.mergedTransforms[i] = MergedTransform{
+          glm::scale(glm::translate(worldMatrix, glm::vec3(dequantize)),
+              glm::vec3(dequantize.w)),
+          normalMatrix(worldMatrix)};
+    }
+
+    next.sceneBounds = Aabb();
+    for (const auto &bounds : next.itemBounds)
+    {
+      if (!bounds.isEmpty())
+      {
+        next.sceneBounds.min = glm::min(next.sceneBounds.min, bounds.min);
+        next.sceneBounds.max = glm::max(next.sceneBounds.max, bounds.max);
+      }
+    }
+  };
+
+  // After what the update job reads
+  JobSystem::Group sceneUpdateGroup;
+  const auto beginSceneUpdate = [&](float seconds, bool all)
+  {
+    sceneUpdatePending = true;
+    const bool dualQuaternions = dualQuaternionSkinning;
+    jobs.run(sceneUpdateGroup, [&, seconds, dualQuaternions, all]()
+        { updateSceneTransforms(seconds, dualQuaternions, all); });
+  };
+
+  // Wait for the update job, then swap in its pose and upload what changed
+  const auto finishSceneUpdate = [&]()
+  {
+    if (!sceneUpdatePending)
+    {
+      return;
+    }
+    jobs.wait(sceneUpdateGroup);
+    sceneUpdatePending = false;
+
+    auto &next = nextTransforms;
+    if (next.worldChanged)
+    {
+      std::swap(drawItemMatrices, next.itemMatrices);
+      std::swap(drawItemNormalMatrices, next.itemNormalMatrices);
+      std::swap(drawItemBounds, next.itemBounds);
+      uploadMergedTransforms(next.mergedTransforms);
+      drawBoundsUploaded = false;
+      sceneItemBounds = next.sceneBounds;
+      sceneBvh.refit(drawItemBounds);
+      nodeCullingDirty = true;
+      std::swap(punctualLights, next.punctualLights);
+      uploadPunctualLights();
+    }
+    if (next.skinsChanged)
+    {
+      uploadSkins();
+      skinsDualQuaternion = next.dualQuaternions;
+    }
+    if (next.weightsChanged)
+    {
+      uploadMorphTargets();
+    }
+    sceneTransformsChanged = sceneTransformsChanged || next.worldChanged
+        || next.skinsChanged || next.weightsChanged;
+  };
+
+  // Pose of a frame that must show its own time, as bench and video frames
+  const auto updateScene = [&](float seconds)
+  {
+    beginSceneUpdate(seconds, false);
+    finishSceneUpdate();
+  };
+
+  // Append the draw items whose box intersects frustum, found by the BVH or
+  // through the node hierarchy
+  const auto queryFrustum = [&](const Frustum &frustum,
+      std::vector<uint32_t> &items)
+  {
+    if (!featureNodeCulling)
+    {
+      sceneBvh.queryFrustum(frustum, items);
+      return;
+    }
+    if (nodeCullingDirty)
+    {
+      nodeCulling.update(drawItemBounds);
+      nodeCullingDirty = false;
+    }
+    nodeCulling.queryFrustum(frustum, items);
+  };
+
+  // Bindless handle of a texture with a sampler object, or with its own
+  // sampling state if sampler is 0, resident until the model is left
+  const auto makeResident = [&](GLuint texture, GLuint sampler)
+  {
+    const auto key = textureHandleKey(texture, sampler);
+    if (texture != 0 && !textureHandles.count(key))
+    {
+      const auto handle = sampler
+          ? getTextureSamplerHandle(texture, sampler)
+          : getTextureHandle(texture);
+      makeTextureHandleResident(handle);
+      textureHandles[key] = handle;
+    }
+  };
+
+  // Copy the textures of owner to texture arrays. Those packed are deleted,
+  // owner then owns in their place new names without any object, which
+  // identify them: glGenTextures does not return them again until deleted,
+  // unlike the names of the deleted textures.
+  const auto packInTextureArrays = [&](GLTextures &owner)
+  {
+    std::vector<GLuint> arrays;
+    const auto layers = packTextureArrays(owner.names(), arrays);
+    for (size_t i = 0; i < owner.size(); ++i)
+    {
+      if (layers[i].texture)
+      {
+        GLuint name;
+        glGenTextures(1, &name);
+        owner.replace(i, name);
+        textureArrayLayers[name] = layers[i];
+      }
+    }
+
+    auto names = textureArrayObjects.names();
+    for (size_t i = 0; i < textureArrayObjects.size(); ++i)
+    {
+      textureArrayObjects.release(i);
+    }
+    names.insert(names.end(), arrays.begin(), arrays.end());
+    textureArrayObjects = GLTextures(std::move(names));
+  };
+
+  // Once the loader thread has uploaded the buffers, do the part of the
+  // loading that needs the main context. The model is drawn with neutral
+  // textures until finishTextures(). Return false if the model could not be
+  // loaded.
+  const auto finishGeometry = [&]()
+  {
+    const auto finishStart = std::chrono::steady_clock::now();
+
+    if (!loadSucceeded)
+    {
+      joinLoaderThread();
+      std::cerr << "Failed to load glTF model" << std::endl;
+
+      return false;
+    }
+
+    glWaitSync(uploadFence, 0, GL_TIMEOUT_IGNORED);
+    glDeleteSync(uploadFence);
+    uploadFence = nullptr;
+
+    // TODO Implement a new CameraController model and use it instead.
+    glm::vec3 diag = bboxMax - bboxMin;
+
+    // Build projection matrix
+    auto maxDistance = glm::length(diag);
+    maxDistance = maxDistance > 0.f ? maxDistance : 100.f;
+    sceneDiagonal = maxDistance;
+
+    projMatrix = glm::perspective(
+		70.f,
+		float(m_nWindowWidth) / m_nWindowHeight,
+		0.001f * maxDistance,
+		1.5f * maxDistance);
+
+    if (!m_hasUserCamera)
+    {
+      // TODO Use scene bounds to compute a better default camera
+      glm::vec3 eye;
+      glm::vec3 up(0, 1, 0);
+      glm::vec3 center = bboxMin + (0.5f * diag);
+
+      if (diag.z > 0)
+      {
+        eye = center + diag;
+      }
+      else
+      {
+        eye = center + 2.f * glm::cross(diag, up);
+      }
+
+      cameraController->setCamera(Camera{eye, center, up});
+    }
+
+    // Creation of Vertex Array Objects
+    vertexArrayObjects = createVertexArrayObjects(
+		model,
+		geometry,
+		bufferObjects.names(),
+		vertexLayouts,
+		meshPrimitiveRanges);
+
+    // Local bounds of each primitive for frustum culling
+    primitiveBounds.resize(geometry.primitives.size());
+    primitiveDistances.resize(geometry.primitives.size());
+    primitivePixels.resize(geometry.primitives.size());
+    for (size_t meshIdx = 0; meshIdx < runtimeModel.meshes().count; ++meshIdx)
+    {
+      const auto &mesh = runtimeModel.meshes()[meshIdx];
+      const auto &range = meshPrimitiveRanges[meshIdx];
+      for (GLsizei i = 0; i < range.count; ++i)
+      {
+        primitiveBounds[range.begin + i] = mesh.primitives[i].bounds;
+      }
+    }
+
+    // Member of each primitive in geometry.mergedMembers, and the scene graph
+    // position of the node of each member
+    std::vector<uint32_t> packedMembers(
+        geometry.primitives.size(), PACKED_MERGE_NONE);
+    for (size_t i = 0; i < geometry.mergedMembers.size(); ++i)
+    {
+      packedMembers[geometry.mergedMembers[i]] = uint32_t(i);
+    }
+    mergedMemberNodes.assign(geometry.mergedMembers.size(), 0);
+
+    for (size_t i = 0; i < sceneGraph.size(); ++i)
+    {
+      const auto meshIdx = sceneGraph.mesh(i);
+      if (meshIdx < 0)
+      {
+        continue;
+      }
+      // Nodes using EXT_mesh_gpu_instancing get one item per instance
+      const auto &node = model.nodes[sceneGraph.node(i)];
+      const auto instances =
+          getGpuInstanceMatrices(model, m_gltfBuffers, node);
+      const auto skin = node.skin >= 0 && size_t(node.skin) < skins.size()
+          ? node.skin
+          : -1;
+      // The meshes of the MSFT_lod levels are drawn in place of the one of
+      // the node, with its transform
+      const auto lods = getNodeLods(model, node);
+      const auto lodNode = lods.meshes.size() > 1 ? int(lodNodes.size()) : -1;
+      if (lodNode >= 0)
+      {
+        lodNodes.push_back(LodNode{drawItems.size(), 0,
+            int(lods.meshes.size()), lods.screenCoverages});
+      }
+      for (size_t level = 0; level < lods.meshes.size(); ++level)
+      {
+        const auto levelMesh = lods.meshes[level];
+        if (levelMesh < 0 || size_t(levelMesh) >= model.meshes.size())
+        {
+          continue;
+        }
+        for (GLsizei j = 0; j < meshPrimitiveRanges[levelMesh].count; ++j)
+        {
+          const auto packedIdx = meshPrimitiveRanges[levelMesh].begin + j;
+          // Members are drawn by the item of their merged primitive
+          if (packedMembers[packedIdx] != PACKED_MERGE_NONE)
+          {
+            mergedMemberNodes[packedMembers[packedIdx]] = i;
+            continue;
+          }
+          const auto morphed = morphTargets.addDraw(size_t(packedIdx), i);
+          if (instances.empty())
+          {
+            drawItems.push_back(DrawItem{i, levelMesh, j, -1, skin, morphed,
+                lodNode, int(level), packedIdx});
+          }
+          for (size_t k = 0; k < instances.size(); ++k)
+          {
+            drawItems.push_back(DrawItem{i, levelMesh, j,
+                int(instanceMatrices.size() + k), skin, morphed, lodNode,
+                int(level), packedIdx});
+          }
+        }
+      }
+      if (lodNode >= 0)
+      {
+        lodNodes.back().itemCount =
+            drawItems.size() - lodNodes.back().firstItem;
+      }
+      instanceMatrices.insert(
+          instanceMatrices.end(), instances.begin(), instances.end());
+    }
+
+    // One item per merged primitive, with the mesh, primitive and node of its
+    // first member, placed by the transforms of its members
+    for (size_t i = 0; i < geometry.primitives.size(); ++i)
+    {
+      const auto &merged = geometry.primitives[i];
+      if (merged.memberCount == 0)
+      {
+        continue;
+      }
+      const auto first = GLsizei(geometry.mergedMembers[merged.firstMember]);
+      const auto range = std::find_if(meshPrimitiveRanges.begin(),
+          meshPrimitiveRanges.end(), [&](const PrimitiveRange &r)
+          { return first >= r.begin && first < r.begin + r.count; });
+      drawItems.push_back(DrawItem{mergedMemberNodes[merged.firstMember],
+          int(range - meshPrimitiveRanges.begin()), first - (*range).begin,
+          -1, -1, MorphTargets::NONE, -1, 0, GLsizei(i)});
+    }
+
+    beginSceneUpdate(-1.f, true);
+    finishSceneUpdate();
+    sceneBvh.build(drawItemBounds);
+    // Merged items span the nodes of their members
+    std::vector<int> itemNodes(drawItems.size());
+    for (size_t i = 0; i < drawItems.size(); ++i)
+    {
+      itemNodes[i] = isMergedItem(drawItems[i]) ? -1 : int(drawItems[i].node);
+    }
+    nodeCulling.build(sceneGraph, itemNodes);
+    nodeCullingDirty = true;
+
+    // The draw index attribute is instanced and the draw calls use the draw
+    // index as base instance, so it reads drawIndices[drawIndex]
+    if (!drawItems.empty())
+    {
+      std::vector<GLuint> drawIndices(drawItems.size());
+      std::iota(drawIndices.begin(), drawIndices.end(), 0);
+
+      drawIndexBuffer.generate();
+      glBindBuffer(GL_ARRAY_BUFFER, drawIndexBuffer);
+      glBufferData(GL_ARRAY_BUFFER, drawIndices.size() * sizeof(GLuint),
+          drawIndices.data(), GL_STATIC_DRAW);
+      trackBuffer(GpuMemoryCategory::Geometry, drawIndexBuffer,
+          drawIndices.size() * sizeof(GLuint));
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+      auto drawIndexArrays = vertexArrayObjects;
+      if (pulledVertexArray)
+      {
+        drawIndexArrays.push_back(pulledVertexArray);
+      }
+      for (const auto vao : drawIndexArrays)
+      {
+        glBindVertexArray(vao);
+        glEnableVertexAttribArray(VERTEX_ATTRIB_DRAW_INDEX_IDX);
+        glVertexAttribIFormat(
+            VERTEX_ATTRIB_DRAW_INDEX_IDX, 1, GL_UNSIGNED_INT, 0);
+        glVertexAttribBinding(
+            VERTEX_ATTRIB_DRAW_INDEX_IDX, DRAW_INDEX_BUFFER_BINDING);
+        glVertexBindingDivisor(DRAW_INDEX_BUFFER_BINDING, 1);
+        glBindVertexBuffer(
+            DRAW_INDEX_BUFFER_BINDING, drawIndexBuffer, 0, sizeof(GLuint));
+      }
+      glBindVertexArray(0);
+
+      GLint alignment = 1;
+      glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+      drawTransforms.init(
+          drawItems.size() * sizeof(DrawTransform), size_t(alignment));
+      drawCommands.init(drawItems.size() * sizeof(DrawElementsIndirectCommand),
+          sizeof(GLuint));
+      if (visibilityBufferSupported)
+      {
+        visibilityDraws.init(
+            drawItems.size() * sizeof(VisibilityDraw), size_t(alignment));
+      }
+
+      size_t pointNodeCount = 0;
+      for (const auto &item : drawItems)
+      {
+        pointNodeCount += geometry.primitives[item.packedPrimitive].pointNodeCount;
+      }
+      if (pointNodeCount > 0)
+      {
+        pointCommands.init(
+            pointNodeCount * sizeof(DrawElementsIndirectCommand), sizeof(GLuint));
+        if (pointRasterizerSupported)
+        {
+          pointJobs.init(pointNodeCount * sizeof(PointJob), size_t(alignment));
+        }
+      }
+    }
+
+    clusterDrawCapacity = 0;
+    if (meshletCullingSupported && (meshletsSSBO || gpuCullingSupported))
+    {
+      for (const auto &item : drawItems)
+      {
+        const auto &packed = geometry.primitives[item.packedPrimitive];
+        clusterDrawCapacity += std::max<size_t>(packed.meshletCount, 1);
+      }
+
+      GLint alignment = 1;
+      glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+      clusterCommands.init(
+          drawItems.size() * sizeof(ClusterCommand), size_t(alignment));
+
+      const auto drawsSize =
+          clusterDrawCapacity * sizeof(DrawElementsIndirectCommand);
+      clusterDraws.generate();
+      glBindBuffer(GL_SHADER_STORAGE_BUFFER, clusterDraws);
+      glBufferStorage(GL_SHADER_STORAGE_BUFFER, drawsSize, nullptr, 0);
+      trackBuffer(GpuMemoryCategory::ShaderBuffers, clusterDraws, drawsSize);
+
+      const auto countsSize = drawItems.size() * sizeof(GLuint);
+      clusterCounts.generate();
+      glBindBuffer(GL_SHADER_STORAGE_BUFFER, clusterCounts);
+      glBufferStorage(GL_SHADER_STORAGE_BUFFER, countsSize, nullptr, 0);
+      trackBuffer(GpuMemoryCategory::ShaderBuffers, clusterCounts, countsSize);
+      glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+      glBindBufferBase(
+          GL_SHADER_STORAGE_BUFFER, MESHLETS_BINDING, meshletsSSBO);
+      glBindBufferBase(
+          GL_SHADER_STORAGE_BUFFER, CLUSTER_DRAWS_BINDING, clusterDraws);
+      glBindBufferBase(
+          GL_SHADER_STORAGE_BUFFER, CLUSTER_COUNTS_BINDING, clusterCounts);
+    }
+
+    drawItemCommands.resize(drawItems.size());
+    for (size_t i = 0; i < drawItems.size(); ++i)
+    {
+      const auto &item = drawItems[i];
+      const auto &packed = geometry.primitives[item.packedPrimitive];
+      drawItemCommands[i] = DrawElementsIndirectCommand{
+          packed.indexCount, 1, packed.firstIndex, packed.baseVertex, 0};
+    }
+
+    occlusionQueries.generate(drawItems.size());
+    occlusionQueryIssued.assign(drawItems.size(), 0);
+
+    // Static opaque items, whose bounds hold their occluder
+    occluderCandidates.clear();
+    for (size_t i = 0; i < drawItems.size(); ++i)
+    {
+      const auto &item = drawItems[i];
+      const auto material =
+          runtimeModel.primitive(item.mesh, item.primitive).material;
+      if (softwareOcclusion.triangleCount(item.packedPrimitive) > 0
+          && item.skin < 0
+          && item.morphTargets == MorphTargets::NONE
+          && (material < 0
+              || runtimeModel.materials()[material].alphaMode == AlphaMode::Opaque))
+      {
+        occluderCandidates.push_back(uint32_t(i));
+      }
+    }
+    if (gpuCullingSupported && !drawItems.empty())
+    {
+      GLint alignment = 1;
+      glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+      drawEntryItems.init(
+          drawItems.size() * sizeof(GLuint), size_t(alignment));
+    }
+    drawBoundsUploaded = false;
+    depthPyramidValid = false;
+
+    // Materials read the neutral textures until the ones of the model are
+    // ready, and in place of missing or disabled maps
+    if (bindlessTextures)
+    {
+      makeResident(whiteTexture, 0);
+      makeResident(greyTexture, 0);
+    }
+    else if (textureArrays)
+    {
+      packInTextureArrays(neutralTextures);
+      whiteTexture = neutralTextures[0];
+      greyTexture = neutralTextures[1];
+    }
+
+    std::clog << punctualLights.size() << " punctual lights\n";
+
+    modelReady = true;
+    loadTimes.finish = msSince(finishStart);
+
+    return true;
+  };
+
+  // Wait for the loader thread, then let the materials reference the textures
+  // of the model
+  const auto finishTextures = [&]()
+  {
+    const auto finishStart = std::chrono::steady_clock::now();
+    joinLoaderThread();
+
+    glWaitSync(textureFence, 0, GL_TIMEOUT_IGNORED);
+    glDeleteSync(textureFence);
+    textureFence = nullptr;
+
+    // Every texture a material can reference is resident for the lifetime of
+    // the model
+    if (bindlessTextures)
+    {
+      for (size_t i = 0; i < textureObjects.size(); ++i)
+      {
+        makeResident(textureObjects[i], textureSampler(int(i)));
+      }
+    }
+    else if (textureArrays)
+    {
+      packInTextureArrays(textureObjects);
+      std::clog << "Packed " << textureObjects.size() + 2 << " textures in "
+                << textureArrayObjects.size() << " arrays\n";
+    }
+
+    // Geometry and pixels now live on the GPU, only metadata is needed to draw
+    compactModel(model, m_gltfBuffers);
+    imageDecodeRequested.assign(model.images.size(), 0);
+
+    texturesReady = true;
+    loadTimes.finish += msSince(finishStart);
+    loadTimes.total = msSince(runStart);
+  };
+
+  // Finish the loading at once, for renders that never show a partially
+  // loaded model. Return false if the model could not be loaded.
+  const auto finishLoading = [&]()
+  {
+    joinLoaderThread();
+    if (!finishGeometry())
+    {
+      return false;
+    }
+    finishTextures();
+
+    return true;
+  };
+
+  // Setup OpenGL state for rendering
+  glEnable(GL_DEPTH_TEST);
+  glDepthFunc(GL_LEQUAL);
+
+  // State set by the draw code goes through the cache, see drawScene
+  GLStateCache glState;
+
+	// Textures of a material on units 0 to 4 and their samplers, -1 is the
+	// default material. glTF treats missing textures as white, except for
+	// normal maps, and disabled maps are replaced by their neutral texture,
+	// their factors already are in the material buffer, as are maps not
+	// loaded yet. Neutral textures have no sampler object.
+	const auto getMaterialTextures = [&](
+		const int materialIndex,
+		GLuint textures[5],
+		GLuint samplers[5])
+	{
+		int slot = 0;
+		const auto getTexture = [&](bool enabled, int textureIndex, GLuint fallback)
+		{
+			samplers[slot++] = 0;
+
+			if (enabled
+				&& texturesReady
+				&& textureIndex >= 0
+				&& textureObjects[textureIndex] != 0)
+			{
+				samplers[slot - 1] = textureSampler(textureIndex);
+
+				return textureObjects[textureIndex];
+			}
+
+			return fallback;
+		};
+
+		if (materialIndex < 0)
+		{
+			textures[0] = textures[1] = textures[2] = textures[3] = whiteTexture;
+			textures[4] = greyTexture;
+			std::fill(samplers, samplers + 5, 0);
+
+			return;
+		}
+
+		const auto &material = runtimeModel.materials()[materialIndex];
+
+		textures[0] = getTexture(
+			featureTexture,
+			material.textures[MATERIAL_TEXTURE_BASE_COLOR],
+			whiteTexture);
+		textures[1] = getTexture(
+			featureMetallicRoughness,
+			material.textures[MATERIAL_TEXTURE_METALLIC_ROUGHNESS],
+			whiteTexture);
+		textures[2] = getTexture(
+			featureEmission,
+			material.textures[MATERIAL_TEXTURE_EMISSIVE],
+			whiteTexture);
+		textures[3] = getTexture(
+			featureOcclusion,
+			material.textures[MATERIAL_TEXTURE_OCCLUSION],
+			whiteTexture);
+		textures[4] = getTexture(
+			featureNormal,
+			material.textures[MATERIAL_TEXTURE_NORMAL],
+			greyTexture);
+	};
+
+	// Array and layer a texture has been copied to with texture arrays, a
+	// texture that could not be packed reads the white layer
+	const auto textureArrayLayer = [&](GLuint texture)
+	{
+		auto it = textureArrayLayers.find(texture);
+		if (it == end(textureArrayLayers))
+		{
+			it = textureArrayLayers.find(whiteTexture);
+		}
+
+		return it != end(textureArrayLayers) ? (*it).second : TextureArrayLayer{};
+	};
+
+	// Bind the textures of a material, only needed without bindless textures
+	const auto bindMaterial = [&](const int materialIndex)
+	{
+		TRACE_ZONE("bindMaterial");
+		GLuint textures[5];
+		GLuint samplers[5];
+		getMaterialTextures(materialIndex, textures, samplers);
+
+		// occlusion packed with metallic-roughness is bound on unit 3 too, for
+		// the programs sampling every map, see PBR_SHARED_OCCLUSION
+		for (GLuint i = 0; i < 5; ++i)
+		{
+			if (textureArrays)
+			{
+				glState.bindTexture(
+					i,
+					GL_TEXTURE_2D_ARRAY,
+					textureArrayLayer(textures[i]).texture);
+			}
+			else
+			{
+				glState.bindTexture(i, GL_TEXTURE_2D, textures[i]);
+			}
+
+			glState.bindSampler(i, samplers[i]);
+		}
+	};
+
+	// The factors of every material in a shader storage buffer, the last entry
+	// is the default material. Rebuilt when a feature that changes factors is
+	// toggled.
+	GLBuffer materialBuffer;
+	int materialBufferFeatures = -1;
+
+	// Materials binding the same textures and samplers share the index of the
+	// first of them in the material buffer. Without bindless textures, a draw
+	// batch does not span several groups.
+	std::vector<int> materialTextureGroups;
+	const auto materialTextureGroup = [&](int materialIndex)
+	{
+		return materialTextureGroups[materialIndex >= 0
+			? size_t(materialIndex)
+			: materialTextureGroups.size() - 1];
+	};
+
+	// Feature mask of the PBR program variant of each material, bit j is set
+	// if the material samples a texture of its own on unit j
+	std::vector<uint32_t> materialPermutations;
+	// Whether the forward passes of the frame pull their vertices, set by
+	// drawScene
+	bool vertexPulling = false;
+	const auto materialPermutation = [&](int materialIndex)
+	{
+		return materialPermutations[materialIndex >= 0
+			? size_t(materialIndex)
+			: materialPermutations.size() - 1]
+			| (featureWireframe ? PBR_WIREFRAME : 0u)
+			| (vertexPulling ? PBR_PULL_VERTICES : 0u);
+	};
+
+	// Feature mask of the draws of the primitive of item. With shading LOD,
+	// primitives whose visible items all project small are shaded without
+	// normal map, with SH irradiance and an analytic specular BRDF, the
+	// derivative TBN and the BRDF lookup table are skipped.
+	const auto drawPermutation = [&](const DrawItem &item)
+	{
+		auto permutation = materialPermutation(
+			runtimeModel.primitive(item.mesh, item.primitive).material);
+		if (featureShadingLod
+			&& primitivePixels[item.packedPrimitive] < shadingLodPixels)
+		{
+			permutation = (permutation & ~PBR_NORMAL_MAP) | PBR_SHADING_LOD;
+		}
+		return permutation;
+	};
+
+	const auto updateMaterialBuffer = [&]()
+	{
+		const int features =
+			(featureMetallicRoughness ? 1 : 0)
+			| (featureEmission ? 2 : 0)
+			| (featureOcclusion ? 4 : 0)
+			| (featureNormal ? 8 : 0)
+			| (featureTexture ? 16 : 0)
+			| (texturesReady ? 32 : 0);
+
+		if (features == materialBufferFeatures)
+		{
+			return;
+		}
+
+		std::vector<MaterialData> materials(model.materials.size() + 1);
+
+		for (size_t i = 0; i < model.materials.size(); ++i)
+		{
+			const auto &material = model.materials[i];
+			const auto &pbrMetallicRoughness = material.pbrMetallicRoughness;
+			auto &data = materials[i];
+
+			if (featureMetallicRoughness)
+			{
+				data.baseColorFactor = glm::vec4(
+					pbrMetallicRoughness.baseColorFactor[0],
+					pbrMetallicRoughness.baseColorFactor[1],
+					pbrMetallicRoughness.baseColorFactor[2],
+					pbrMetallicRoughness.baseColorFactor[3]);
+				data.metallicFactor = float(pbrMetallicRoughness.metallicFactor);
+				data.roughnessFactor = float(pbrMetallicRoughness.roughnessFactor);
+			}
+
+			if (featureEmission)
+			{
+				data.emissiveFactor = glm::vec3(
+					material.emissiveFactor[0],
+					material.emissiveFactor[1],
+					material.emissiveFactor[2]);
+			}
+
+			if (featureOcclusion)
+			{
+				data.occlusionStrength = float(material.occlusionTexture.strength);
+			}
+
+			if (featureNormal)
+			{
+				data.normalScale = float(material.normalTexture.scale);
+			}
+
+			if (runtimeModel.materials()[i].alphaMode == AlphaMode::Mask)
+			{
+				data.alphaCutoff = runtimeModel.materials()[i].alphaCutoff;
+			}
+		}
+
+		std::map<std::array<GLuint, 10>, int> textureGroups;
+		materialTextureGroups.resize(materials.size());
+		materialPermutations.assign(materials.size(), 0);
+
+		for (size_t i = 0; i < materials.size(); ++i)
+		{
+			GLuint textures[5];
+			GLuint samplers[5];
+			getMaterialTextures(
+				i < model.materials.size() ? int(i) : -1,
+				textures,
+				samplers);
+
+			// texture objects, then sampler objects
+			std::array<GLuint, 10> bindings;
+
+			for (size_t j = 0; j < 5; ++j)
+			{
+				bindings[j] = textures[j];
+				bindings[5 + j] = samplers[j];
+
+				if (textures[j] != whiteTexture && textures[j] != greyTexture)
+				{
+					materialPermutations[i] |= 1u << j;
+				}
+
+				if (bindlessTextures)
+				{
+					materials[i].textureHandles[j] =
+						textureHandles[textureHandleKey(textures[j], samplers[j])];
+				}
+				else if (textureArrays)
+				{
+					const auto layer = textureArrayLayer(textures[j]);
+					bindings[j] = layer.texture;
+					materials[i].textureLayers[j] = GLuint(layer.layer);
+				}
+			}
+
+			// occlusion in the red channel of the metallic-roughness texture
+			// (ORM) is fetched with metallic and roughness
+			if ((materialPermutations[i] & PBR_OCCLUSION_MAP)
+				&& textures[3] == textures[1]
+				&& samplers[3] == samplers[1])
+			{
+				materialPermutations[i] &= ~PBR_OCCLUSION_MAP;
+				materialPermutations[i] |= PBR_SHARED_OCCLUSION;
+			}
+
+			materialTextureGroups[i] =
+				(*textureGroups.emplace(bindings, int(i)).first).second;
+
+			if (i < model.materials.size())
+			{
+				const auto alphaMode = runtimeModel.materials()[i].alphaMode;
+				if (alphaMode == AlphaMode::Mask)
+				{
+					materialPermutations[i] |= PBR_ALPHA_MASK;
+				}
+				else if (alphaMode == AlphaMode::Blend)
+				{
+					materialPermutations[i] |= PBR_ALPHA_BLEND;
+				}
+			}
+		}
+
+		if (!materialBuffer)
+		{
+			materialBuffer.generate();
+		}
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, materialBuffer);
+		glBufferData(
+			GL_SHADER_STORAGE_BUFFER,
+			materials.size() * sizeof(MaterialData),
+			materials.data(),
+			GL_STATIC_DRAW);
+		trackBuffer(GpuMemoryCategory::ShaderBuffers, materialBuffer,
+			materials.size() * sizeof(MaterialData));
+		frameStats.uploadedBytes += materials.size() * sizeof(MaterialData);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MATERIALS_BINDING, materialBuffer);
+
+		materialBufferFeatures = features;
+	};
+
+	// Texture arrays of the base color, metallic roughness and emissive
+	// textures bound for path tracing, on the units after the environment map,
+	// and the material buffer features of the slots uploaded for them
+	std::vector<GLuint> pathTraceArrays;
+	int pathTraceSlotsFeatures = -1;
+
+	// Slot of each material texture read by path_trace.cs.glsl, see
+	// MaterialSlots, with the alpha mode of the material. Bindless handles
+	// need no slot, materials whose arrays do not fit in
+	// PATH_TRACE_TEXTURE_UNITS are traced with their factors only.
+	const auto updatePathTraceSlots = [&]()
+	{
+		if (pathTraceSlotsFeatures == materialBufferFeatures)
+		{
+			return;
+		}
+		pathTraceSlotsFeatures = materialBufferFeatures;
+
+		pathTraceArrays.clear();
+		size_t untextured = 0;
+		std::vector<uint32_t> slots(model.materials.size() + 1, 0);
+		for (size_t i = 0; i < slots.size(); ++i)
+		{
+			GLuint textures[5];
+			GLuint samplers[5];
+			getMaterialTextures(
+				i < model.materials.size() ? int(i) : -1,
+				textures,
+				samplers);
+
+			bool textured = true;
+			for (uint32_t j = 0; j < 3; ++j)
+			{
+				auto slot = bindlessTextures ? 0u : PATH_TRACE_NO_TEXTURE;
+				if (textureArrays)
+				{
+					const auto array = textureArrayLayer(textures[j]).texture;
+					auto it = std::find(
+						pathTraceArrays.begin(),
+						pathTraceArrays.end(),
+						array);
+					if (it == pathTraceArrays.end()
+						&& pathTraceArrays.size() < PATH_TRACE_TEXTURE_UNITS)
+					{
+						it = pathTraceArrays.insert(it, array);
+					}
+					if (it != pathTraceArrays.end())
+					{
+						slot = uint32_t(it - pathTraceArrays.begin());
+					}
+					else
+					{
+						textured = false;
+					}
+				}
+				slots[i] |= slot << (4 * j);
+			}
+			untextured += textured ? 0 : 1;
+
+			if (i < model.materials.size())
+			{
+				const auto alphaMode = runtimeModel.materials()[i].alphaMode;
+				slots[i] |= alphaMode == AlphaMode::Mask
+					? 1u << 12
+					: alphaMode == AlphaMode::Blend ? 2u << 12 : 0u;
+			}
+		}
+		if (untextured > 0)
+		{
+			std::clog << untextured << " materials path traced without some "
+				<< "of their textures, their arrays do not fit in "
+				<< PATH_TRACE_TEXTURE_UNITS << " units\n";
+		}
+		pathTracer.uploadMaterialSlots(slots);
+	};
+
+	// Place the triangles of the draws of the scene in the BVH of pathTracer
+	// and upload the materials they read
+	const auto updatePathTraceScene = [&]()
+	{
+		finishSceneUpdate();
+		std::vector<PathTraceInstance> instances;
+		instances.reserve(drawItems.size());
+		for (size_t i = 0; i < drawItems.size(); ++i)
+		{
+			// The finest level of detail only
+			if (drawItems[i].lodLevel == 0)
+			{
+				instances.push_back(PathTraceInstance{
+					drawItems[i].mesh,
+					int(drawItems[i].primitive),
+					drawItemMatrices[i]});
+			}
+		}
+		if (pathTracer.build(instances))
+		{
+			std::clog << "Path tracing " << pathTracer.triangleCount()
+				<< " triangles\n";
+		}
+		updateMaterialBuffer();
+		updatePathTraceSlots();
+	};
+
+	// Bake the ambient occlusion of the vertices once the textures of the
+	// masked materials are ready, unless it was read from the cache, then
+	// upload it. Vertices are baked BAKED_OCCLUSION_BATCH at a time, each
+	// batch waited for so that no dispatch runs long enough to reset the
+	// device.
+	const auto bakeOcclusion = [&]()
+	{
+		if (!occlusionBaking || !texturesReady)
+		{
+			return;
+		}
+		if (!occlusionBaked)
+		{
+			TRACE_ZONE("bakeOcclusion");
+			const auto start = std::chrono::steady_clock::now();
+			updatePathTraceScene();
+
+			// Vertices take the place of the first draw of their primitive
+			std::vector<const glm::mat4 *> primitiveMatrices(
+				geometry.primitives.size(),
+				nullptr);
+			std::vector<char> placed(geometry.primitives.size(), 0);
+			for (size_t i = 0; i < drawItems.size(); ++i)
+			{
+				const auto &item = drawItems[i];
+				if (placed[item.packedPrimitive])
+				{
+					continue;
+				}
+				placed[item.packedPrimitive] = 1;
+				if (item.skin < 0
+					&& item.morphTargets == MorphTargets::NONE
+					&& geometry.primitives[item.packedPrimitive].memberCount == 0)
+				{
+					primitiveMatrices[item.packedPrimitive] = &drawItemMatrices[i];
+				}
+			}
+			const auto vertexCount =
+				occlusionBaker.placeVertices(geometry, primitiveMatrices);
+
+			const auto &program = *glslBakeOcclusionProgram;
+			glState.useProgram(program.glId());
+			for (GLuint i = 0; i < pathTraceArrays.size(); ++i)
+			{
+				glState.bindTexture(1 + i, GL_TEXTURE_2D_ARRAY, pathTraceArrays[i]);
+				glState.bindSampler(1 + i, 0);
+			}
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MATERIALS_BINDING, materialBuffer);
+			pathTracer.bindBuffers(PATH_TRACE_NODES_BINDING);
+			occlusionBaker.bindBuffers(PATH_TRACE_NODES_BINDING + 4);
+			program.setUniform("uRays", occlusionRays);
+			program.setUniform("uDistance", BAKED_OCCLUSION_DISTANCE * sceneDiagonal);
+			program.setUniform("uRayOffset", 1e-4f * sceneDiagonal);
+			for (size_t first = 0; first < vertexCount; first += BAKED_OCCLUSION_BATCH)
+			{
+				const auto count =
+					std::min<size_t>(vertexCount - first, BAKED_OCCLUSION_BATCH);
+				program.setUniform("uFirstVertex", GLint(first));
+				program.setUniform("uVertexCount", GLint(count));
+				glDispatchCompute(GLuint(count + 63) / 64, 1, 1);
+				glFinish();
+			}
+			glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+			occlusionBaker.readOcclusion();
+			occlusionBaked = true;
+			std::clog << "Baked the occlusion of " << vertexCount
+				<< " vertices with " << occlusionRays << " rays in "
+				<< std::chrono::duration<float>(
+					std::chrono::steady_clock::now() - start).count()
+				<< " s\n";
+
+			if (!occlusionCachePath.empty()
+				&& !saveOcclusionCache(
+					occlusionCachePath,
+					geometryCacheKey,
+					occlusionRays,
+					occlusionBaker.occlusion()))
+			{
+				std::cerr << "Unable to write occlusion cache "
+					<< occlusionCachePath << std::endl;
+			}
+		}
+		occlusionBaker.uploadTexture();
+	};
+
+	// Bake the draw items potentially visible from each cell of a grid over
+	// the scene once the textures of the masked materials are ready, unless
+	// they were read from the cache. Cells are baked VISIBLE_SET_BATCH at a
+	// time, each batch waited for and read back. Animated models are not
+	// baked, their items move away from where they would be baked.
+	const auto bakeVisibleSets = [&]()
+	{
+		if (!visibleSetBaking || visibleSetsBaked || !texturesReady)
+		{
+			return;
+		}
+		visibleSetsBaked = true;
+		if (!animations.empty())
+		{
+			std::clog << "Visible sets not baked, the model is animated\n";
+			return;
+		}
+		if (geometryCacheable)
+		{
+			visibleSetsCachePath = visibleSetsCacheFile(geometryCachePath);
+			if (loadVisibleSetsCache(
+					visibleSetsCachePath,
+					geometryCacheKey,
+					visibleSetCellSize,
+					drawItems.size(),
+					visibleSets))
+			{
+				return;
+			}
+		}
+
+		TRACE_ZONE("bakeVisibleSets");
+		const auto start = std::chrono::steady_clock::now();
+		updatePathTraceScene();
+		visibleSets.initGrid(sceneItemBounds, visibleSetCellSize, drawItems.size());
+
+		// The instances of the path tracer, as updatePathTraceScene adds
+		// them, stand for the items of their finest level
+		std::vector<uint32_t> instanceItems;
+		for (size_t i = 0; i < drawItems.size(); ++i)
+		{
+			if (drawItems[i].lodLevel == 0)
+			{
+				instanceItems.push_back(uint32_t(i));
+			}
+		}
+
+		const auto &program = *glslBakeVisibilityProgram;
+		glState.useProgram(program.glId());
+		for (GLuint i = 0; i < pathTraceArrays.size(); ++i)
+		{
+			glState.bindTexture(1 + i, GL_TEXTURE_2D_ARRAY, pathTraceArrays[i]);
+			glState.bindSampler(1 + i, 0);
+		}
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MATERIALS_BINDING, materialBuffer);
+		pathTracer.bindBuffers(PATH_TRACE_NODES_BINDING);
+		pathTracer.bindInstanceBuffer(PATH_TRACE_NODES_BINDING + 4);
+		visibleSets.allocateBake(
+			instanceItems.size(),
+			VISIBLE_SET_BATCH,
+			PATH_TRACE_NODES_BINDING + 5);
+		program.setUniform("uGridOrigin", visibleSets.origin());
+		program.setUniform("uCellSize", visibleSets.cellSize());
+		program.setUniform("uCellCounts", visibleSets.cellCounts());
+		program.setUniform("uRays", VISIBLE_SET_RAYS);
+		program.setUniform("uWords", GLint(visibleSets.bakeWordCount()));
+		const auto cellCount = visibleSets.cellCount();
+		for (size_t first = 0; first < cellCount; first += VISIBLE_SET_BATCH)
+		{
+			const auto count = std::min<size_t>(cellCount - first, VISIBLE_SET_BATCH);
+			program.setUniform("uFirstCell", GLint(first));
+			program.setUniform("uCellCount", GLint(count));
+			glDispatchCompute(GLuint(count + 63) / 64, 1, 1);
+			glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+			glFinish();
+			visibleSets.readBake(first, count, instanceItems);
+		}
+		visibleSets.releaseBake();
+
+		// Points, lines, and the items the BVH does not hold where they are
+		// drawn are always visible, the levels of a node where any of them is
+		for (size_t i = 0; i < drawItems.size(); ++i)
+		{
+			const auto &item = drawItems[i];
+			const auto &packed = geometry.primitives[item.packedPrimitive];
+			if ((packed.mode != GL_TRIANGLES
+					&& packed.mode != GL_TRIANGLE_STRIP
+					&& packed.mode != GL_TRIANGLE_FAN)
+				|| item.skin >= 0
+				|| item.morphTargets != MorphTargets::NONE
+				|| packed.memberCount > 0)
+			{
+				visibleSets.show(i);
+			}
+		}
+		for (const auto &lodNode : lodNodes)
+		{
+			visibleSets.share(lodNode.firstItem, lodNode.itemCount);
+		}
+		const auto cells = visibleSets.cellCounts();
+		std::clog << "Baked the visible sets of " << cells.x << "x" << cells.y
+			<< "x" << cells.z << " cells of " << visibleSets.cellSize()
+			<< " with " << VISIBLE_SET_RAYS << " rays in "
+			<< std::chrono::duration<float>(
+				std::chrono::steady_clock::now() - start).count()
+			<< " s\n";
+
+		if (!visibleSetsCachePath.empty()
+			&& !saveVisibleSetsCache(
+				visibleSetsCachePath,
+				geometryCacheKey,
+				visibleSetCellSize,
+				visibleSets))
+		{
+			std::cerr << "Unable to write visible sets cache "
+				<< visibleSetsCachePath << std::endl;
+		}
+	};
+
+	// Capture the impostors of the meshes drawn by at least
+	// IMPOSTOR_MIN_INSTANCES objects once the textures of their materials are
+	// ready, a layer of impostorAtlas per mesh, see utils/impostors.hpp. An
+	// object is an instance of a node with EXT_mesh_gpu_instancing, its mesh
+	// the one of its finest level, and the impostor stands for every level in
+	// the distance. Skinned, morphed and merged primitives, points, lines and
+	// blended materials keep their mesh out.
+	const auto captureImpostors = [&]()
+	{
+		if (!impostorsSupported || impostorsCaptured || !texturesReady)
+		{
+			return;
+		}
+		impostorsCaptured = true;
+
+		// Objects by instance, with the first item of their finest level
+		std::unordered_map<int, size_t> instanceObjects;
+		std::vector<size_t> objectItems;
+		std::vector<size_t> meshObjectCounts(model.meshes.size(), 0);
+		std::vector<char> meshCapturable(model.meshes.size(), 1);
+		for (size_t i = 0; i < drawItems.size(); ++i)
+		{
+			const auto &item = drawItems[i];
+			if (item.instance < 0 || item.lodLevel != 0)
+			{
+				continue;
+			}
+			if (instanceObjects.emplace(item.instance, objectItems.size()).second)
+			{
+				objectItems.push_back(i);
+				++meshObjectCounts[item.mesh];
+			}
+			const auto &packed = geometry.primitives[item.packedPrimitive];
+			const auto material =
+				runtimeModel.primitive(item.mesh, item.primitive).material;
+			if ((packed.mode != GL_TRIANGLES
+					&& packed.mode != GL_TRIANGLE_STRIP
+					&& packed.mode != GL_TRIANGLE_FAN)
+				|| item.skin >= 0
+				|| item.morphTargets != MorphTargets::NONE
+				|| packed.memberCount > 0
+				|| (material >= 0
+					&& runtimeModel.materials()[material].alphaMode == AlphaMode::Blend))
+			{
+				meshCapturable[item.mesh] = 0;
+			}
+		}
+
+		// A layer per mesh, captured from the primitives of its first object
+		std::vector<int> meshLayers(model.meshes.size(), -1);
+		std::vector<int> layerInstances;
+		std::vector<std::vector<size_t>> layerItems;
+		std::vector<Aabb> layerBounds;
+		for (size_t i = 0; i < drawItems.size(); ++i)
+		{
+			const auto &item = drawItems[i];
+			if (item.instance < 0
+				|| item.lodLevel != 0
+				|| !meshCapturable[item.mesh]
+				|| meshObjectCounts[item.mesh] < IMPOSTOR_MIN_INSTANCES)
+			{
+				continue;
+			}
+			if (meshLayers[item.mesh] < 0)
+			{
+				meshLayers[item.mesh] = int(layerItems.size());
+				layerInstances.push_back(item.instance);
+				layerItems.emplace_back();
+				layerBounds.emplace_back();
+			}
+			const auto layer = size_t(meshLayers[item.mesh]);
+			if (item.instance != layerInstances[layer])
+			{
+				continue;
+			}
+			layerItems[layer].push_back(i);
+			const auto &bounds = primitiveBounds[item.packedPrimitive];
+			if (!bounds.isEmpty())
+			{
+				layerBounds[layer].min = glm::min(layerBounds[layer].min, bounds.min);
+				layerBounds[layer].max = glm::max(layerBounds[layer].max, bounds.max);
+			}
+		}
+		if (layerItems.empty())
+		{
+			return;
+		}
+
+		TRACE_ZONE("captureImpostors");
+		const auto start = std::chrono::steady_clock::now();
+		auto captureDefines = std::vector<std::string>{"CAPTURE"};
+		if (textureArrays)
+		{
+			captureDefines.push_back("TEXTURE_ARRAYS");
+		}
+		glslImpostorCaptureProgram = std::make_unique<GLProgram>(compileProgram(
+			{m_ShadersRootPath / m_AppName / m_impostorVertexShader,
+				m_ShadersRootPath / m_AppName / m_impostorFragmentShader},
+			captureDefines));
+		glslImpostorProgram = std::make_unique<GLProgram>(compileProgram(
+			{m_ShadersRootPath / m_AppName / m_impostorVertexShader,
+				m_ShadersRootPath / m_AppName / m_impostorFragmentShader},
+			{"IMPOSTOR_INSTANCES_BINDING " + std::to_string(IMPOSTOR_INSTANCES_BINDING),
+				"IMPOSTOR_FRAMES " + std::to_string(IMPOSTOR_FRAMES)}));
+		glslImpostorProgram->setUniformBlockBinding("SHIrradiance", SH_IRRADIANCE_BINDING);
+
+		GLint previousFramebuffer = 0;
+		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+		GLint previousViewport[4];
+		glGetIntegerv(GL_VIEWPORT, previousViewport);
+
+		const auto &program = *glslImpostorCaptureProgram;
+		glState.useProgram(program.glId());
+		glState.setEnabled(GL_DEPTH_TEST, true);
+		glState.depthMask(true);
+		glState.depthFunc(GL_LESS);
+		glState.colorMask(true);
+		glState.setEnabled(GL_BLEND, false);
+		glState.setEnabled(GL_FRAMEBUFFER_SRGB, true);
+		impostorAtlas.init(GLsizei(layerItems.size()));
+		size_t drawCount = 0;
+		for (size_t layer = 0; layer < layerItems.size(); ++layer)
+		{
+			impostorAtlas.beginLayer(GLsizei(layer));
+			for (int y = 0; y < IMPOSTOR_FRAMES; ++y)
+			{
+				for (int x = 0; x < IMPOSTOR_FRAMES; ++x)
+				{
+					impostorAtlas.beginFrame(x, y);
+					program.setUniform(
+						"uViewProjMatrix",
+						impostorFrameViewProjMatrix(
+							layerBounds[layer],
+							impostorFrameDirection(x, y)));
+					for (const auto itemIdx : layerItems[layer])
+					{
+						const auto &item = drawItems[itemIdx];
+						const auto &packed = geometry.primitives[item.packedPrimitive];
+						const auto materialIndex =
+							runtimeModel.primitive(item.mesh, item.primitive).material;
+						GLuint textures[5];
+						GLuint samplers[5];
+						getMaterialTextures(materialIndex, textures, samplers);
+						if (textureArrays)
+						{
+							const auto arrayLayer = textureArrayLayer(textures[0]);
+							glState.bindTexture(0, GL_TEXTURE_2D_ARRAY, arrayLayer.texture);
+							program.setUniform("uBaseColorLayer", arrayLayer.layer);
+						}
+						else
+						{
+							glState.bindTexture(0, GL_TEXTURE_2D, textures[0]);
+						}
+						glState.bindSampler(0, samplers[0]);
+
+						auto baseColorFactor = glm::vec4(1);
+						float alphaCutoff = 0.f;
+						if (materialIndex >= 0)
+						{
+							const auto &factor =
+								model.materials[materialIndex].pbrMetallicRoughness.baseColorFactor;
+							baseColorFactor = glm::vec4(factor[0], factor[1], factor[2], factor[3]);
+							const auto &material = runtimeModel.materials()[materialIndex];
+							if (material.alphaMode == AlphaMode::Mask)
+							{
+								alphaCutoff = material.alphaCutoff;
+							}
+						}
+						program.setUniform("uBaseColorFactor", baseColorFactor);
+						program.setUniform("uAlphaCutoff", alphaCutoff);
+						program.setUniform("uPositionDequantize", packed.positionDequantize);
+
+						glState.bindVertexArray(vertexArrayObjects[packed.vertexBuffer]);
+						glState.bindVertexBuffer(
+							bufferObjects[packed.vertexBuffer],
+							0,
+							geometry.vertexBuffers[packed.vertexBuffer].format.stride);
+						glDrawElementsBaseVertex(
+							packed.mode,
+							GLsizei(packed.indexCount),
+							geometry.indexType,
+							(const GLvoid *) (size_t(packed.firstIndex)
+								* indexTypeSize(geometry.indexType)),
+							packed.baseVertex);
+						++drawCount;
+					}
+				}
+			}
+		}
+		impostorAtlas.finish();
+		glState.bindVertexArray(0);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, GLuint(previousFramebuffer));
+		glViewport(
+			previousViewport[0],
+			previousViewport[1],
+			previousViewport[2],
+			previousViewport[3]);
+
+		// Every item of the objects of the meshes with a layer
+		impostorSpheres.clear();
+		for (const auto &bounds : layerBounds)
+		{
+			impostorSpheres.emplace_back(
+				0.5f * (bounds.min + bounds.max),
+				std::max(0.5f * glm::length(bounds.max - bounds.min), 1e-6f));
+		}
+		std::vector<int> objectImpostors(objectItems.size(), -1);
+		for (size_t o = 0; o < objectItems.size(); ++o)
+		{
+			const auto layer = meshLayers[drawItems[objectItems[o]].mesh];
+			if (layer >= 0)
+			{
+				objectImpostors[o] = int(impostorObjectItems.size());
+				impostorObjectItems.push_back(objectItems[o]);
+				impostorObjectLayers.push_back(GLuint(layer));
+			}
+		}
+		itemImpostorObjects.assign(drawItems.size(), -1);
+		for (size_t i = 0; i < drawItems.size(); ++i)
+		{
+			const auto it = instanceObjects.find(drawItems[i].instance);
+			if (drawItems[i].instance >= 0 && it != end(instanceObjects))
+			{
+				itemImpostorObjects[i] = objectImpostors[(*it).second];
+			}
+		}
+		impostorObjectsDrawn.assign(impostorObjectItems.size(), 0);
+		GLint alignment = 1;
+		glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		impostorInstances.init(
+			impostorObjectItems.size() * sizeof(ImpostorInstance),
+			size_t(alignment));
+		std::clog << "Captured the impostors of " << layerItems.size()
+			<< " meshes, " << impostorObjectItems.size() << " objects, with "
+			<< drawCount << " draws in "
+			<< std::chrono::duration<float>(
+				std::chrono::steady_clock::now() - start).count()
+			<< " s\n";
+	};
+
+	// Stream texture levels in and out, materials referencing replaced texture
+	// objects are rebuilt by the next draw. Return true if a texture object has
+	// been replaced.
+	const auto streamTextures = [&]()
+	{
+		const auto uploadedBytes = textureStreamer.stats().uploadedBytes;
+		const bool replaced = textureStreamer.update(
+			[&](size_t textureIdx, GLuint previous, GLuint texture)
+			{
+				textureObjects.replace(textureIdx, texture);
+
+				if (bindlessTextures)
+				{
+					const auto sampler = textureSampler(int(textureIdx));
+					const auto handle = getTextureSamplerHandle(texture, sampler);
+					makeTextureHandleResident(handle);
+					textureHandles.erase(textureHandleKey(previous, sampler));
+					textureHandles[textureHandleKey(texture, sampler)] = handle;
+				}
+
+				materialBufferFeatures = -1;
+			});
+		frameStats.uploadedBytes += textureStreamer.stats().uploadedBytes - uploadedBytes;
+		return replaced;
+	};
+
+	// Decode the image of a texture kept encoded on a job, the neutral texture
+	// is sampled until uploadDecodedTextures creates the texture
+	const auto requestTextureImage = [&](int textureIdx)
+	{
+		const auto source = model.textures[textureIdx].source;
+
+		if (textureObjects[textureIdx] != 0
+			|| source < 0
+			|| !model.images[source].as_is
+			|| imageDecodeRequested[source])
+		{
+			return;
+		}
+
+		imageDecodeRequested[source] = 1;
+		++pendingImageDecodes;
+		jobs.run(imageDecodeGroup, [&, source]()
+		{
+			DecodedImage decoded;
+			decoded.imageIdx = source;
+			std::string err;
+			std::string warn;
+			decoded.decoded = decodeImage(
+				model.images[source], source, decoded.image, err, warn);
+			if (decoded.decoded)
+			{
+				capImageSize(decoded.image, m_maxTextureSize);
+			}
+			decoded.message = err + warn;
+
+			std::lock_guard<std::mutex> lock(decodedImagesMutex);
+			decodedImages.push_back(std::move(decoded));
+		});
+	};
+
+	// Create the textures of the images decoded since the last call, or of
+	// every image requested so far if wait is set. Return true if a texture
+	// object has been created.
+	const auto uploadDecodedTextures = [&](bool wait)
+	{
+		if (pendingImageDecodes == 0)
+		{
+			return false;
+		}
+
+		if (wait)
+		{
+			jobs.wait(imageDecodeGroup);
+		}
+
+		std::vector<DecodedImage> decoded;
+		{
+			std::lock_guard<std::mutex> lock(decodedImagesMutex);
+			decoded.swap(decodedImages);
+		}
+
+		if (decoded.empty())
+		{
+			return false;
+		}
+
+		TRACE_ZONE("uploadDecodedTextures");
+		pendingImageDecodes -= decoded.size();
+		const auto usages = getTextureUsages(model);
+		size_t largestImage = 0;
+
+		for (const auto &image : decoded)
+		{
+			largestImage = std::max(largestImage, image.image.image.size());
+		}
+
+		TextureUploader uploader;
+		uploader.init(std::min(
+			std::max(largestImage, size_t(TEXTURE_STAGING_MIN_SIZE)),
+			size_t(TEXTURE_STAGING_MAX_SIZE)));
+		bool created = false;
+
+		for (auto &image : decoded)
+		{
+			std::cerr << image.message;
+
+			// images that fail to decode keep their neutral texture
+			if (!image.decoded)
+			{
+				continue;
+			}
+
+			model.images[image.imageIdx] = std::move(image.image);
+
+			for (size_t i = 0; i < model.textures.size(); ++i)
+			{
+				if (model.textures[i].source != image.imageIdx
+					|| (textureObjects[i] != 0 && !image.reloaded))
+				{
+					continue;
+				}
+
+				// The previous texture is forgotten before the new one can reuse
+				// its name. Packed textures have already been deleted, the name
+				// identifying their layer is released with it.
+				const GLuint previous = textureObjects[i];
+				if (previous != 0)
+				{
+					if (bindlessTextures)
+					{
+						textureHandles.erase(
+							textureHandleKey(previous, textureSampler(int(i))));
+					}
+					if (textureArrayLayers.erase(previous) == 0)
+					{
+						untrackTextures(1, &previous);
+					}
+					glDeleteTextures(1, &previous);
+				}
+
+				const auto texture = createTextureObject(
+					model,
+					i,
+					usages[i],
+					textureStreaming ? &textureStreamer : nullptr,
+					mipGenerator,
+					uploader);
+				textureObjects.replace(i, texture);
+				trackTexture(
+					GpuMemoryCategory::MaterialTextures, GL_TEXTURE_2D, texture);
+
+				if (bindlessTextures)
+				{
+					makeResident(texture, textureSampler(int(i)));
+				}
+				else if (textureArrays)
+				{
+					// In an array of its own, the previous layer stays unused
+					// until the scene is loaded again
+					GLTextures packed(std::vector<GLuint>{texture});
+					packInTextureArrays(packed);
+					textureObjects.replace(i, packed[0]);
+					packed.release(0);
+				}
+
+				created = true;
+			}
+
+			// the pixels now live on the GPU, as with compactModel
+			std::vector<unsigned char>().swap(model.images[image.imageIdx].image);
+		}
+
+		uploader.finish();
+		frameStats.uploadedBytes += uploader.uploadedBytes();
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		if (created)
+		{
+			materialBufferFeatures = -1;
+		}
+
+		return created;
+	};
+
+	// Create the decoded textures and stream texture levels, waiting for the
+	// images requested so far if wait is set. Return true if textures changed,
+	// a frame drawn again then samples the new ones and may need more.
+	const auto refineTextures = [&](bool wait)
+	{
+		bool changed = uploadDecodedTextures(wait);
+
+		if (!textureStreamer.empty())
+		{
+			changed = streamTextures() || changed;
+		}
+
+		return changed;
+	};
+
+	// Downsample the linear color of a scene of size pixels, multisampled if
+	// samples > 1, to bloomChain then upsample it back to level 0
+	const auto drawBloom = [&](GLuint color, int samples, glm::ivec2 size)
+	{
+		gpuProfiler.begin("Bloom");
+		if (bloomChain.width() < size.x || bloomChain.height() < size.y)
+		{
+			bloomChain.init(
+				grownTargetSize(bloomChain.width(), GLsizei(size.x)),
+				grownTargetSize(bloomChain.height(), GLsizei(size.y)));
+		}
+		const auto dispatch = [&](glm::ivec2 texels)
+		{
+			glDispatchCompute(
+				GLuint(texels.x + 7) / 8,
+				GLuint(texels.y + 7) / 8,
+				1);
+			glMemoryBarrier(
+				GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		};
+
+		const bool multisample = samples > 1;
+		glState.useProgram(glslBloomDownsampleProgram.glId());
+		glState.bindTexture(
+			multisample ? 1 : 0,
+			multisample ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D,
+			color);
+		glState.bindSampler(multisample ? 1 : 0, 0);
+		glState.bindTexture(2, GL_TEXTURE_2D, bloomChain.texture());
+		glState.bindSampler(2, 0);
+		glslBloomDownsampleProgram.setUniform("uScene", 0);
+		glslBloomDownsampleProgram.setUniform("uSceneMS", 1);
+		glslBloomDownsampleProgram.setUniform("uBloom", 2);
+		glslBloomDownsampleProgram.setUniform(
+			"uSamples",
+			multisample ? samples : 0);
+		for (int level = 0; level < bloomChain.levels(); ++level)
+		{
+			const auto sourceSize = level > 0
+				? BloomChain::levelSize(size, level - 1)
+				: size;
+			const auto levelSize = BloomChain::levelSize(size, level);
+			glslBloomDownsampleProgram.setUniform("uSourceLevel", level - 1);
+			glslBloomDownsampleProgram.setUniform(
+				"uSourceSize",
+				glm::vec2(sourceSize));
+			glslBloomDownsampleProgram.setUniform(
+				"uDestinationSize",
+				glm::vec2(levelSize));
+			glBindImageTexture(
+				0,
+				bloomChain.texture(),
+				level,
+				GL_FALSE,
+				0,
+				GL_WRITE_ONLY,
+				GL_R11F_G11F_B10F);
+			dispatch(levelSize);
+		}
+
+		glState.useProgram(glslBloomUpsampleProgram.glId());
+		glslBloomUpsampleProgram.setUniform("uBloom", 2);
+		for (int level = bloomChain.levels() - 1; level > 0; --level)
+		{
+			const auto levelSize = BloomChain::levelSize(size, level - 1);
+			glslBloomUpsampleProgram.setUniform("uSourceLevel", level);
+			glslBloomUpsampleProgram.setUniform(
+				"uSourceSize",
+				glm::vec2(BloomChain::levelSize(size, level)));
+			glslBloomUpsampleProgram.setUniform(
+				"uDestinationSize",
+				glm::vec2(levelSize));
+			glBindImageTexture(
+				0,
+				bloomChain.texture(),
+				level - 1,
+				GL_FALSE,
+				0,
+				GL_READ_WRITE,
+				GL_R11F_G11F_B10F);
+			dispatch(levelSize);
+		}
+		glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R11F_G11F_B10F);
+		gpuProfiler.end();
+	};
+
+	// Tonemap the linear color of a scene of size pixels, multisampled if
+	// samples > 1, to the viewport of the bound framebuffer, starting at
+	// drawnOrigin. Bloom is added first if enabled, except to the tiles of
+	// tiled renders that it would not blur across.
+	const auto drawTonemap = [&](GLuint color, int samples, glm::ivec2 size)
+	{
+		const bool bloom = m_tonemap.bloom > 0 && drawnTile.z == 0;
+		if (bloom)
+		{
+			drawBloom(color, samples, size);
+		}
+
+		gpuProfiler.begin("Tonemap");
+		glState.setEnabled(GL_DEPTH_TEST, false);
+		glState.setEnabled(GL_FRAMEBUFFER_SRGB, true);
+		glState.useProgram(glslTonemapProgram.glId());
+		const bool multisample = samples > 1;
+		glState.bindTexture(
+			multisample ? 1 : 0,
+			multisample ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D,
+			color);
+		glState.bindSampler(multisample ? 1 : 0, 0);
+		glslTonemapProgram.setUniform("uColor", 0);
+		glslTonemapProgram.setUniform("uColorMS", 1);
+		glslTonemapProgram.setUniform("uSamples", multisample ? samples : 0);
+		glslTonemapProgram.setUniform("uOperator", int(m_tonemap.op));
+		glslTonemapProgram.setUniform("uExposure", m_tonemap.exposure);
+		glslTonemapProgram.setUniform("uOrigin", glm::vec2(drawnOrigin));
+		glslTonemapProgram.setUniform("uBloom", 2);
+		if (bloom)
+		{
+			glState.bindTexture(2, GL_TEXTURE_2D, bloomChain.texture());
+			glState.bindSampler(2, 0);
+			glslTonemapProgram.setUniform(
+				"uBloomSize",
+				glm::vec2(BloomChain::levelSize(size, 0)));
+		}
+		// level 0 holds the sum of the levels
+		glslTonemapProgram.setUniform(
+			"uBloomScale",
+			bloom ? m_tonemap.bloom / float(bloomChain.levels()) : 0.f);
+
+		glState.bindVertexArray(m_quadVAO);
+		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+		++frameStats.drawCalls;
+		++frameStats.drawCommands;
+		frameStats.triangles += 2;
+
+		glState.bindVertexArray(0);
+		glState.setEnabled(GL_DEPTH_TEST, true);
+		gpuProfiler.end();
+	};
+
+	// Lambda function to draw the scene
+	const auto drawScene = [&](const Camera &camera)
+	{
+		TRACE_ZONE("drawScene");
+		bakeOcclusion();
+		bakeVisibleSets();
+		captureImpostors();
+		gpuProfiler.begin("Scene");
+		// the GUI, uploads and texture streaming change state between frames,
+		// and the graph may delete the textures the cache saw bound
+		frameArena.reset();
+		frameGraph.reset(frameArena);
+		glState.invalidate();
+		glState.resetCounters();
+		frameStats = FrameStats();
+		const auto uniformUploads = GLProgram::uniformUploadCount();
+
+		const bool tiled = drawnTile.z > 0;
+		const GLsizei imageWidth =
+			drawnImageSize.x > 0 ? drawnImageSize.x : m_nWindowWidth;
+		const GLsizei imageHeight =
+			drawnImageSize.y > 0 ? drawnImageSize.y : m_nWindowHeight;
+		const GLsizei viewportWidth = tiled ? drawnTile.z : imageWidth;
+		const GLsizei viewportHeight = tiled ? drawnTile.w : imageHeight;
+
+		// The scene is shaded in linear radiance. Float framebuffers get it as
+		// is, the others a tonemap of hdrTarget, with their sample count.
+		GLint outputFramebuffer = 0;
+		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &outputFramebuffer);
+		const bool tonemapped = !drawFramebufferIsFloat();
+		if (tonemapped)
+		{
+			GLint samples = 0;
+			glGetIntegerv(GL_SAMPLES, &samples);
+			if (hdrTarget.width() < viewportWidth
+				|| hdrTarget.height() < viewportHeight
+				|| hdrTarget.samples() != std::max(samples, 1))
+			{
+				hdrTarget.init(
+					grownTargetSize(hdrTarget.width(), viewportWidth),
+					grownTargetSize(hdrTarget.height(), viewportHeight),
+					samples);
+			}
+			glState.bindFramebuffer(GL_DRAW_FRAMEBUFFER, hdrTarget.framebuffer());
+		}
+
+		// Reversed depth: the projection has no far plane and maps the near
+		// one to a depth of 1, and the depths of the camera passes decrease
+		// with the distance. Float depth buffers keep the same relative
+		// precision at every distance then. Shadow cascades keep the
+		// conventional depths.
+		const bool reversedZ = featureReversedZ && reversedZSupported;
+		const GLenum depthTest = reversedZ ? GL_GEQUAL : GL_LEQUAL;
+		if (reversedZ)
+		{
+			clipControl(GL_LOWER_LEFT, GL_ZERO_TO_ONE);
+			glClearDepth(0.);
+		}
+		glState.depthFunc(depthTest);
+
+		glState.viewport(0, 0, viewportWidth, viewportHeight);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		glClearDepth(1.);
+		if (drawnTemporal)
+		{
+			// the background does not move without a skybox
+			const GLfloat noVelocity[] = {0, 0, 0, 0};
+			glClearBufferfv(GL_COLOR, 1, noVelocity);
+		}
+
+		// shaders output linear colors, the GUI is drawn without conversion
+		glState.setEnabled(GL_FRAMEBUFFER_SRGB, true);
+
+		// Rasterization uses the projection of the tile, what depends on the
+		// whole view (shadow cascades, texture footprints) the one of the image.
+		// Temporal frames move it by their jitter. Their depth range is fitted
+		// to the visible items once culled.
+		const auto viewMatrix = camera.getViewMatrix();
+		auto unjitteredProjMatrix = tiled
+			? tileProjection(
+				imageWidth,
+				imageHeight,
+				drawnTile.x,
+				drawnTile.y,
+				drawnTile.z,
+				drawnTile.w) * projMatrix
+			: projMatrix;
+		auto tileProjMatrix = drawnTemporal
+			? temporalAA.jitterMatrix() * unjitteredProjMatrix
+			: unjitteredProjMatrix;
+
+		// Draws do not move in frames without history
+		const bool previousValid = drawnTemporal
+			&& temporalAA.historyValid()
+			&& previousDrawItemMatrices.size() == drawItemMatrices.size();
+		const auto previousViewProjMatrix = previousValid
+			? previousProjMatrix * previousViewMatrix
+			: unjitteredProjMatrix * viewMatrix;
+		const glm::vec4 temporalJitter(
+			drawnTemporal ? temporalAA.jitter() : glm::vec2(0),
+			1.f / float(viewportWidth),
+			1.f / float(viewportHeight));
+
+		// Single pass stereo, side by side: every draw is instanced for both
+		// eyes, see forward.vs.glsl. The eyes are offset along the x axis of
+		// the view by half of STEREO_EYE_SEPARATION, with parallel axes and
+		// frusta converging at the camera center, and have half of the
+		// viewport each. Tiled and temporal frames are mono.
+		const bool stereo = featureStereo && !tiled && !drawnTemporal;
+
+		// Coarse shading of the opaque pass at the rates computed from the
+		// previous frame if it had the same size. Tiled and temporal frames,
+		// whose pixels do not match those of the previous frame, and float
+		// ones are shaded at full rate.
+		const bool shadingRate = featureShadingRate && shadingRateSupported
+			&& tonemapped && !tiled && !drawnTemporal;
+		const bool shadingRateValid = shadingRate
+			&& shadingRateSceneSize == glm::ivec2(viewportWidth, viewportHeight)
+			&& shadingRateImage.samples() == hdrTarget.samples();
+		const float convergence = std::max(
+			glm::length(camera.center() - camera.eye()),
+			STEREO_EYE_SEPARATION);
+		const auto eyeOffset = [](int eye)
+		{
+			return (eye == 0 ? -0.5f : 0.5f) * STEREO_EYE_SEPARATION;
+		};
+		// Projection of an eye from one of the camera, in the view space of
+		// the eye
+		const auto eyeProjection = [&](const glm::mat4 &proj, int eye)
+		{
+			auto eyeProj = glm::scale(glm::mat4(1), glm::vec3(2, 1, 1)) * proj;
+			eyeProj[2][0] -= eyeProj[0][0] * eyeOffset(eye) / convergence;
+			return eyeProj;
+		};
+		const auto eyeViewMatrix = [&](int eye)
+		{
+			return glm::translate(glm::mat4(1), glm::vec3(-eyeOffset(eye), 0, 0))
+				* viewMatrix;
+		};
+
+		// Both eyes are culled with one frustum holding them: the one of the
+		// camera moved back until its planes, as wide as the outer planes of
+		// the eyes, pass through the eyes
+		const auto cullingViewProjMatrix = [&]()
+		{
+			if (!stereo)
+			{
+				return tileProjMatrix * viewMatrix;
+			}
+			const float slope = 1.f / eyeProjection(projMatrix, 0)[0][0]
+				+ 0.5f * STEREO_EYE_SEPARATION / convergence;
+			const float back = 0.5f * STEREO_EYE_SEPARATION / slope;
+			const float near = projMatrix[3][2] / (projMatrix[2][2] - 1.f) + back;
+			const float far = projMatrix[3][2] / (projMatrix[2][2] + 1.f) + back;
+			auto proj = projMatrix;
+			proj[0][0] = 1.f / slope;
+			proj[2][2] = (far + near) / (near - far);
+			proj[3][2] = 2.f * far * near / (near - far);
+			return proj * glm::translate(glm::mat4(1), glm::vec3(0, 0, -back))
+				* viewMatrix;
+		};
+		const Frustum frustum(cullingViewProjMatrix());
+
+
+		// Environment skybox, at the far plane. Drawn after the geometry
+		// without depth writes, so that only the background pixels are shaded.
+		const auto drawSkybox = [&]()
+		{
+			gpuProfiler.begin("Skybox");
+			glState.useProgram(glslSkyboxProgram.glId());
+			glState.bindTexture(0, GL_TEXTURE_CUBE_MAP, envTexture);
+			glState.bindSampler(0, skyboxSampler);
+			glState.depthMask(false);
+
+			glslSkyboxProgram.setUniform(skyboxEquirectangularMapLocation, 0);
+			glslSkyboxProgram.setUniform(skyboxModelProjMatrixLocation, tileProjMatrix);
+			glslSkyboxProgram.setUniform(skyboxModelViewMatrixLocation, viewMatrix);
+			glslSkyboxProgram.setUniform(
+				skyboxPreviousViewProjMatrixLocation,
+				(previousValid ? previousProjMatrix : unjitteredProjMatrix)
+					* glm::mat4(glm::mat3(previousValid ? previousViewMatrix : viewMatrix)));
+			glslSkyboxProgram.setUniform(skyboxTemporalJitterLocation, temporalJitter);
+			glslSkyboxProgram.setUniform(skyboxFarDepthLocation, reversedZ ? 0.f : 1.f);
+
+			glState.bindVertexArray(m_unitCubeVAO);
+			glState.setEnabled(GL_CLIP_DISTANCE0, false);
+			// the sky is at infinity, the eyes see it through their own
+			// projection only, one half of the viewport each
+			const int views = stereo ? 2 : 1;
+			for (int eye = 0; eye < views; ++eye)
+			{
+				if (stereo)
+				{
+					glState.viewport(
+						eye * (viewportWidth / 2),
+						0,
+						eye == 0 ? viewportWidth / 2 : viewportWidth - viewportWidth / 2,
+						viewportHeight);
+					glslSkyboxProgram.setUniform(
+						skyboxModelProjMatrixLocation,
+						eyeProjection(tileProjMatrix, eye));
+				}
+				glDrawArrays(GL_TRIANGLES, 0, 36);
+				++frameStats.drawCalls;
+				++frameStats.drawCommands;
+				frameStats.triangles += 12;
+			}
+			if (stereo)
+			{
+				glState.viewport(0, 0, viewportWidth, viewportHeight);
+			}
+			glState.depthMask(true);
+			gpuProfiler.end();
+		};
+
+		// Whether the opaque passes draw the meshlets left by the culling of
+		// the frame, whose batches are set before culling
+		bool cullMeshlets = false;
+		// Whether the wireframe overlay pulls the vertices of its triangles,
+		// from the vertex buffer of each batch
+		bool wireframeVertices = false;
+
+		// Submit the commands [begin, end) of the frame with one indirect
+		// call, their primitives must share mode, and vertex buffer unless
+		// pulling vertices, and their material must be bound
+		const auto drawBatch = [&](size_t begin, size_t end)
+		{
+			const auto &item =
+				drawItems[renderQueue.entries()[commandEntries[begin]].item];
+			const auto &packed = geometry.primitives[item.packedPrimitive];
+
+			if (vertexPulling)
+			{
+				glState.bindVertexArray(pulledVertexArray);
+			}
+			else
+			{
+				glState.bindVertexArray(vertexArrayObjects[packed.vertexBuffer]);
+				glState.bindVertexBuffer(
+					bufferObjects[packed.vertexBuffer],
+					0,
+					geometry.vertexBuffers[packed.vertexBuffer].format.stride);
+			}
+			if (wireframeVertices)
+			{
+				glBindBufferBase(
+					GL_SHADER_STORAGE_BUFFER,
+					VISIBILITY_VERTICES_BINDING,
+					bufferObjects[packed.vertexBuffer]);
+			}
+			// the eyes clip their draws to their half of the viewport
+			glState.setEnabled(GL_CLIP_DISTANCE0, stereo);
+
+			if (cullMeshlets)
+			{
+				const auto batch = commandBatches[begin];
+				const auto offset = (const GLvoid*) (batchDrawOffsets[batch]
+					* sizeof(DrawElementsIndirectCommand));
+				multiDrawElementsIndirectCount(packed.mode, geometry.indexType, offset, GLintptr(batch * sizeof(GLuint)), GLsizei(batchDrawOffsets[batch + 1] - batchDrawOffsets[batch]), sizeof(DrawElementsIndirectCommand));
+			}
+			else
+			{
+				const auto offset = (const GLvoid*) (drawCommands.regionOffset()
+					+ begin * sizeof(DrawElementsIndirectCommand));
+
+				glMultiDrawElementsIndirect(packed.mode, geometry.indexType, offset, GLsizei(end - begin), sizeof(DrawElementsIndirectCommand));
+			}
+
+			++frameStats.drawCalls;
+			frameStats.drawCommands += end - begin;
+			frameStats.triangles += std::accumulate(
+				commandTriangles.begin() + begin,
+				commandTriangles.begin() + end,
+				size_t(0));
+		};
+
+		// Render the dirty shadow cascades, each with the items in its
+		// frustum. Casters are sorted by vertex buffer and drawn with one
+		// indirect call per vertex buffer and mode, consecutive instances of a
+		// primitive become one command.
+		// Items of the MSFT_lod levels not drawn in the frame
+		const auto isHiddenLevel = [&](uint32_t itemIdx)
+		{
+			const auto &item = drawItems[itemIdx];
+			return item.lodNode >= 0
+				&& lodNodes[item.lodNode].level != item.lodLevel;
+		};
+
+		const auto drawShadowCascades = [&]()
+		{
+			TRACE_ZONE("drawShadowCascades");
+			GLint previousFramebuffer = 0;
+
+			for (size_t i = 0; i < shadowCascades.count(); ++i)
+			{
+				if (!shadowCascades.dirty(i))
+				{
+					continue;
+				}
+
+				if (redrawnCascades++ == 0)
+				{
+					FrameVector<ShadowItem> shadowItems(drawItems.size(), frameArena);
+					for (size_t j = 0; j < drawItems.size(); ++j)
+					{
+						shadowItems[j].matrix = drawItemMatrices[j];
+						shadowItems[j].skinJoints = drawItemSkinJoints(drawItems[j]);
+						shadowItems[j].morphTargets = drawItems[j].morphTargets;
+						shadowItems[j].mergedVertices =
+							drawItemMergedVertices(drawItems[j]);
+						shadowItems[j].positionDequantize = geometry.primitives[
+							drawItems[j].packedPrimitive].positionDequantize;
+					}
+					glBindBuffer(GL_SHADER_STORAGE_BUFFER, shadowItemsSSBO);
+					glBufferData(
+						GL_SHADER_STORAGE_BUFFER,
+						shadowItems.size() * sizeof(ShadowItem),
+						shadowItems.data(),
+						GL_DYNAMIC_DRAW);
+					trackBuffer(GpuMemoryCategory::ShaderBuffers, shadowItemsSSBO,
+						shadowItems.size() * sizeof(ShadowItem));
+					frameStats.uploadedBytes += shadowItems.size() * sizeof(ShadowItem);
+					glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+					glBindBufferBase(
+						GL_SHADER_STORAGE_BUFFER,
+						SHADOW_ITEMS_BINDING,
+						shadowItemsSSBO);
+
+					glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+					glState.bindFramebuffer(GL_DRAW_FRAMEBUFFER, shadowCascades.framebuffer());
+					glState.viewport(0, 0, shadowCascades.size(), shadowCascades.size());
+					glState.useProgram(glslShadowProgram.glId());
+					glState.depthMask(true);
+					glState.depthFunc(GL_LEQUAL);
+					if (reversedZ)
+					{
+						clipControl(GL_LOWER_LEFT, GL_NEGATIVE_ONE_TO_ONE);
+					}
+					glBindBuffer(GL_DRAW_INDIRECT_BUFFER, shadowCommandBuffer);
+					glEnable(GL_POLYGON_OFFSET_FILL);
+					glPolygonOffset(2.f, 4.f);
+				}
+
+				shadowCascades.beginRendering(i);
+				glClear(GL_DEPTH_BUFFER_BIT);
+				glslShadowProgram.setUniform(
+					shadowLightViewProjMatrixLocation,
+					shadowCascades.viewProjMatrix(i));
+
+				shadowCasters.clear();
+				queryFrustum(
+					Frustum(shadowCascades.viewProjMatrix(i)),
+					shadowCasters);
+				shadowCasters.erase(
+					std::remove_if(shadowCasters.begin(), shadowCasters.end(), isHiddenLevel),
+					shadowCasters.end());
+
+				const auto packedPrimitive = [&](uint32_t itemIdx) -> const PackedPrimitive &
+				{
+					const auto &item = drawItems[itemIdx];
+					return geometry.primitives[item.packedPrimitive];
+				};
+
+				std::sort(
+					shadowCasters.begin(),
+					shadowCasters.end(),
+					[&](uint32_t lhs, uint32_t rhs)
+					{
+						const auto &l = packedPrimitive(lhs);
+						const auto &r = packedPrimitive(rhs);
+						return std::tie(l.vertexBuffer, l.mode, lhs)
+							< std::tie(r.vertexBuffer, r.mode, rhs);
+					});
+
+				shadowCommands.clear();
+				for (size_t j = 0; j < shadowCasters.size(); ++j)
+				{
+					const auto itemIdx = shadowCasters[j];
+					if (j > 0
+						&& itemIdx == shadowCasters[j - 1] + 1
+						&& drawItems[itemIdx].packedPrimitive
+							== drawItems[itemIdx - 1].packedPrimitive
+						&& drawItemCommands[itemIdx].firstIndex
+							== drawItemCommands[itemIdx - 1].firstIndex)
+					{
+						++shadowCommands.back().instanceCount;
+						continue;
+					}
+					shadowCommands.push_back(drawItemCommands[itemIdx]);
+					shadowCommands.back().baseInstance = itemIdx;
+				}
+
+				if (shadowCommands.empty())
+				{
+					continue;
+				}
+
+				glBufferData(
+					GL_DRAW_INDIRECT_BUFFER,
+					shadowCommands.size() * sizeof(DrawElementsIndirectCommand),
+					shadowCommands.data(),
+					GL_STREAM_DRAW);
+				trackBuffer(GpuMemoryCategory::ShaderBuffers, shadowCommandBuffer,
+					shadowCommands.size() * sizeof(DrawElementsIndirectCommand));
+				frameStats.uploadedBytes +=
+					shadowCommands.size() * sizeof(DrawElementsIndirectCommand);
+
+				// The base instance of a command is the index of its first item
+				for (size_t batchBegin = 0; batchBegin < shadowCommands.size();)
+				{
+					const auto &packed =
+						packedPrimitive(shadowCommands[batchBegin].baseInstance);
+					size_t batchEnd = batchBegin + 1;
+
+					while (batchEnd < shadowCommands.size())
+					{
+						const auto &next =
+							packedPrimitive(shadowCommands[batchEnd].baseInstance);
+						if (next.vertexBuffer != packed.vertexBuffer
+							|| next.mode != packed.mode)
+						{
+							break;
+						}
+						++batchEnd;
+					}
+
+					glState.bindVertexArray(vertexArrayObjects[packed.vertexBuffer]);
+					glState.bindVertexBuffer(
+						bufferObjects[packed.vertexBuffer],
+						0,
+						geometry.vertexBuffers[packed.vertexBuffer].format.stride);
+
+					const auto offset = (const GLvoid*) (
+						batchBegin * sizeof(DrawElementsIndirectCommand));
+
+					glMultiDrawElementsIndirect(packed.mode, geometry.indexType, offset, GLsizei(batchEnd - batchBegin), sizeof(DrawElementsIndirectCommand));
+
+					++frameStats.drawCalls;
+					frameStats.drawCommands += batchEnd - batchBegin;
+					for (auto j = batchBegin; j < batchEnd; ++j)
+					{
+						frameStats.triangles += shadowCommands[j].instanceCount
+							* triangleCount(packed.mode, shadowCommands[j].count);
+					}
+
+					batchBegin = batchEnd;
+				}
+			}
+
+			if (redrawnCascades > 0)
+			{
+				glDisable(GL_POLYGON_OFFSET_FILL);
+				glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+				glState.bindFramebuffer(GL_DRAW_FRAMEBUFFER, GLuint(previousFramebuffer));
+				glState.viewport(0, 0, viewportWidth, viewportHeight);
+				glState.depthFunc(depthTest);
+				if (reversedZ)
+				{
+					clipControl(GL_LOWER_LEFT, GL_ZERO_TO_ONE);
+				}
+			}
+		};
+
+		// Only the skybox is drawn while the model is loading
+		if (!modelReady)
+		{
+			drawSkybox();
+		}
+		// Draw the scene referenced by gltf file
+		else if (model.defaultScene >= 0)
+		{
+			// Draw all nodes, programs are used by the batches
+			updateMaterialBuffer();
+
+			// environment maps, the irradiance map is unused with spherical
+			// harmonics
+			glState.bindTexture(
+				5,
+				GL_TEXTURE_CUBE_MAP,
+				featureEnvironment && !featureSHIrradiance ? irradianceMap : 0);
+			glState.bindTexture(
+				6,
+				GL_TEXTURE_CUBE_MAP,
+				featureEnvironment ? prefilterMap : 0);
+			glState.bindTexture(
+				7,
+				GL_TEXTURE_2D,
+				featureEnvironment ? brdfLUT : 0);
+			glState.bindTexture(
+				8,
+				GL_TEXTURE_2D_ARRAY,
+				shadowCascades.texture());
+			glState.bindTexture(
+				MORPH_DELTAS_UNIT,
+				GL_TEXTURE_BUFFER,
+				morphDeltaTexture);
+			glState.bindTexture(
+				MERGED_VERTICES_UNIT,
+				GL_TEXTURE_BUFFER,
+				vertexMembersTexture);
+			glState.bindTexture(
+				BAKED_OCCLUSION_UNIT,
+				GL_TEXTURE_BUFFER,
+				occlusionBaker.texture());
+
+			const auto lightDirection = glm::normalize(
+				lightFromCamera ? camera.getDirection() : lightDirectionRaw);
+
+			// Cascades of the directional light are kept while they cover their
+			// slice of the view frustum, the others are fitted again and marked
+			// dirty until the shadow pass renders them
+			shadowCascades.update(
+				viewMatrix,
+				projMatrix,
+				lightDirection,
+				sceneItemBounds,
+				sceneTransformsChanged);
+			sceneTransformsChanged = false;
+
+			const auto eye = camera.eye();
+			const float sceneNearPlane = projMatrix[3][2] / (projMatrix[2][2] - 1.f);
+
+			// Levels of detail of the frame, the shadow casters draw the ones
+			// of the camera. A MSFT_lod node draws the level of the fraction of
+			// the viewport height its bounding sphere covers, a primitive the
+			// coarsest generated level whose error projects to less than
+			// LOD_PIXEL_ERROR pixels.
+			{
+				TRACE_ZONE("selectLevelsOfDetail");
+				// Viewport heights a unit covers at the distance of the bounds
+				const auto unitCoverage = [&](const Aabb &bounds)
+				{
+					const float radius = 0.5f * glm::length(bounds.max - bounds.min);
+					const float distance =
+						glm::length(0.5f * (bounds.min + bounds.max) - eye) - radius;
+					return distance > sceneNearPlane && !bounds.isEmpty()
+						? 0.5f * projMatrix[1][1] / distance
+						: std::numeric_limits<float>::max();
+				};
+
+				for (auto &lodNode : lodNodes)
+				{
+					Aabb bounds;
+					for (size_t i = 0; i < lodNode.itemCount; ++i)
+					{
+						const auto &itemBounds = drawItemBounds[lodNode.firstItem + i];
+						bounds.min = glm::min(bounds.min, itemBounds.min);
+						bounds.max = glm::max(bounds.max, itemBounds.max);
+					}
+					const float coverage =
+						glm::length(bounds.max - bounds.min) * unitCoverage(bounds);
+					const auto screenCoverage = [&](int level)
+					{
+						return size_t(level) < lodNode.screenCoverages.size()
+							? lodNode.screenCoverages[level]
+							: LOD_DEFAULT_SCREEN_COVERAGE / float(1 << level);
+					};
+
+					lodNode.level = 0;
+					while (featureLevelsOfDetail
+						&& lodNode.level + 1 < lodNode.levelCount
+						&& coverage < screenCoverage(lodNode.level))
+					{
+						++lodNode.level;
+					}
+					if (featureLevelsOfDetail
+						&& lodNode.screenCoverages.size() > size_t(lodNode.levelCount)
+						&& coverage < lodNode.screenCoverages[lodNode.levelCount])
+					{
+						lodNode.level = -1;
+					}
+				}
+
+				for (size_t i = 0; i < drawItems.size(); ++i)
+				{
+					const auto &item = drawItems[i];
+					const auto &packed = geometry.primitives[item.packedPrimitive];
+					auto &command = drawItemCommands[i];
+					command.count = packed.indexCount;
+					command.firstIndex = packed.firstIndex;
+					if (packed.lods.empty() || !featureLevelsOfDetail)
+					{
+						continue;
+					}
+
+					const glm::mat3 matrix(drawItemMatrices[i]);
+					const float scale = std::max({glm::length(matrix[0]),
+						glm::length(matrix[1]), glm::length(matrix[2])});
+					const float pixelsPerError = scale * float(imageHeight)
+						* unitCoverage(drawItemBounds[i]);
+					for (const auto &lod : packed.lods)
+					{
+						if (lod.error * pixelsPerError >= LOD_PIXEL_ERROR)
+						{
+							break;
+						}
+						command.count = lod.indexCount;
+						command.firstIndex = lod.firstIndex;
+					}
+				}
+			}
+
+			// Software occlusion culling, of mono frames: the candidates in
+			// the frustum covering the most of the viewport height are
+			// rasterized by a job while the shadow passes are recorded, then
+			// tested against once the other culling is done
+			const bool softwareOcclusionCulling = featureSoftwareOcclusion
+				&& !stereo
+				&& !occluderCandidates.empty();
+			if (softwareOcclusionCulling)
+			{
+				TRACE_ZONE("selectOccluders");
+				occluderCoverages.resize(drawItems.size());
+				frameOccluders.clear();
+				for (const auto itemIdx : occluderCandidates)
+				{
+					const auto &bounds = drawItemBounds[itemIdx];
+					if (isHiddenLevel(itemIdx) || !frustum.intersects(bounds))
+					{
+						continue;
+					}
+					const float radius = 0.5f * glm::length(bounds.max - bounds.min);
+					const float distance =
+						glm::length(0.5f * (bounds.min + bounds.max) - eye) - radius;
+					occluderCoverages[itemIdx] = distance > sceneNearPlane
+						? radius * projMatrix[1][1] / distance
+						: std::numeric_limits<float>::max();
+					if (occluderCoverages[itemIdx] >= OCCLUDER_MIN_COVERAGE)
+					{
+						frameOccluders.push_back(itemIdx);
+					}
+				}
+				const auto occluderCount =
+					std::min<size_t>(frameOccluders.size(), OCCLUDER_MAX_COUNT);
+				std::partial_sort(
+					frameOccluders.begin(),
+					frameOccluders.begin() + occluderCount,
+					frameOccluders.end(),
+					[&](uint32_t a, uint32_t b)
+					{
+						return occluderCoverages[a] > occluderCoverages[b];
+					});
+				frameOccluders.resize(occluderCount);
+
+				frameOccluderPrimitives.clear();
+				frameOccluderMatrices.clear();
+				frameOccluderSingleSided.clear();
+				for (const auto itemIdx : frameOccluders)
+				{
+					const auto &item = drawItems[itemIdx];
+					const auto material =
+						runtimeModel.primitive(item.mesh, item.primitive).material;
+					frameOccluderPrimitives.push_back(item.packedPrimitive);
+					frameOccluderMatrices.push_back(drawItemMatrices[itemIdx]);
+					frameOccluderSingleSided.push_back(
+						material < 0 || !runtimeModel.materials()[material].doubleSided);
+				}
+
+				const int bufferWidth =
+					std::min(OCCLUSION_BUFFER_WIDTH, int(viewportWidth));
+				const int bufferHeight = std::max(
+					int(std::lround(float(bufferWidth) * float(viewportHeight)
+						/ float(viewportWidth))),
+					1);
+				jobs.run(
+					softwareOcclusionGroup,
+					[&, viewProjMatrix = cullingViewProjMatrix(), bufferWidth, bufferHeight]()
+					{
+						softwareOcclusion.render(
+							viewProjMatrix,
+							bufferWidth,
+							bufferHeight,
+							frameOccluderPrimitives.data(),
+							frameOccluderMatrices.data(),
+							frameOccluderSingleSided.data(),
+							frameOccluderPrimitives.size());
+					});
+			}
+
+			redrawnCascades = 0;
+
+			if (featureShadows && !drawItems.empty())
+			{
+				gpuProfiler.begin("Shadows");
+				drawShadowCascades();
+				gpuProfiler.end();
+			}
+
+			visibleItems.clear();
+
+			// The wireframe overlay without barycentrics finds the triangles
+			// of its fragments from their primitive ID, which needs the whole
+			// commands of the draws: neither meshlets nor GPU culling
+			wireframeVertices = featureWireframe && !wireframeBarycentrics;
+			// The wireframe overlay pulling its triangles reads the vertex
+			// buffer of each batch
+			vertexPulling = featureVertexPulling
+				&& pulledVertexArray
+				&& !wireframeVertices;
+			if (vertexPulling)
+			{
+				compilePulledVertexPrograms();
+			}
+			if (wireframeVertices)
+			{
+				glBindBufferBase(
+					GL_SHADER_STORAGE_BUFFER,
+					VISIBILITY_INDICES_BINDING,
+					bufferObjects.back());
+			}
+
+			// GPU culling draws every item, the culling pass leaves out those
+			// it does not see
+			const bool gpuCulling = featureGpuCulling
+				&& clusterDrawCapacity > 0
+				&& !wireframeVertices;
+			if (featureFrustumCulling && !gpuCulling)
+			{
+				queryFrustum(frustum, visibleItems);
+			}
+			else
+			{
+				visibleItems.resize(drawItems.size());
+				std::iota(visibleItems.begin(), visibleItems.end(), 0);
+			}
+			visibleItems.erase(
+				std::remove_if(visibleItems.begin(), visibleItems.end(), isHiddenLevel),
+				visibleItems.end());
+			// Then those not potentially visible from the cell of the eye
+			const auto eyeCell = featureVisibleSets ? visibleSets.cell(eye) : -1;
+			if (eyeCell >= 0)
+			{
+				visibleItems.erase(
+					std::remove_if(
+						visibleItems.begin(),
+						visibleItems.end(),
+						[&](uint32_t itemIdx)
+						{
+							return !visibleSets.visible(eyeCell, itemIdx);
+						}),
+					visibleItems.end());
+			}
+			// Then those behind the occluders of the frame. Boxes the eye may
+			// be inside of cross the near plane and are kept.
+			if (softwareOcclusionCulling)
+			{
+				jobs.wait(softwareOcclusionGroup);
+				TRACE_ZONE("softwareOcclusionCulling");
+				visibleItems.erase(
+					std::remove_if(
+						visibleItems.begin(),
+						visibleItems.end(),
+						[&](uint32_t itemIdx)
+						{
+							return !softwareOcclusion.visible(drawItemBounds[itemIdx]);
+						}),
+					visibleItems.end());
+			}
+
+			frameStats.drawnPrimitives = visibleItems.size();
+			frameStats.culledPrimitives = drawItems.size() - visibleItems.size();
+
+			// Items the camera may be inside of are always drawn, the faces of
+			// their bounding box could be clipped or behind their own geometry
+			const auto mayContainEye = [&](uint32_t itemIdx)
+			{
+				const auto &bounds = drawItemBounds[itemIdx];
+				return bounds.isEmpty()
+					|| (glm::all(glm::greaterThanEqual(eye, bounds.min - 2.f * sceneNearPlane))
+					&& glm::all(glm::lessThanEqual(eye, bounds.max + 2.f * sceneNearPlane)));
+			};
+
+			// The planes of projMatrix hold the whole scene from anywhere in
+			// it, the frame fits them to the depth range of the boxes of the
+			// visible items along the view direction so that the depth buffer
+			// keeps its precision for what is seen. They stay within those of
+			// projMatrix, with a margin for faces lying on the boxes.
+			const float sceneFarPlane = projMatrix[3][2] / (projMatrix[2][2] + 1.f);
+			const auto front = glm::normalize(camera.front());
+			float nearPlane = sceneFarPlane;
+			float farPlane = sceneNearPlane;
+			for (const auto itemIdx : visibleItems)
+			{
+				const auto &bounds = drawItemBounds[itemIdx];
+				if (bounds.isEmpty())
+				{
+					nearPlane = sceneNearPlane;
+					farPlane = sceneFarPlane;
+					break;
+				}
+				const float distance =
+					glm::dot(0.5f * (bounds.min + bounds.max) - eye, front);
+				const float extent =
+					glm::dot(glm::abs(front), 0.5f * (bounds.max - bounds.min));
+				nearPlane = std::min(nearPlane, distance - extent);
+				farPlane = std::max(farPlane, distance + extent);
+			}
+			nearPlane = std::max(DEPTH_RANGE_NEAR_MARGIN * nearPlane, sceneNearPlane);
+			farPlane = std::min(DEPTH_RANGE_FAR_MARGIN * farPlane, sceneFarPlane);
+			if (!featureFittedDepthRange || nearPlane >= farPlane)
+			{
+				nearPlane = sceneNearPlane;
+				farPlane = sceneFarPlane;
+			}
+			// Only the depth row differs from projMatrix, tiles and jitter
+			// move x and y. The reversed projection gives a clip space depth
+			// of the near plane, divided by the view space depth.
+			for (auto *matrix : {&unjitteredProjMatrix, &tileProjMatrix})
+			{
+				if (reversedZ)
+				{
+					(*matrix)[2][2] = 0.f;
+					(*matrix)[3][2] = nearPlane;
+				}
+				else if (featureFittedDepthRange)
+				{
+					(*matrix)[2][2] = (farPlane + nearPlane) / (nearPlane - farPlane);
+					(*matrix)[3][2] = 2.f * farPlane * nearPlane / (nearPlane - farPlane);
+				}
+			}
+			// 1 / view space depth as a function of the window depth, see
+			// viewDepth() in pbr_directional_light.fs.glsl
+			const glm::vec3 inverseDepth = reversedZ
+				? glm::vec3(1.f / nearPlane, 0.f, 1.f / farPlane)
+				: glm::vec3(
+					1.f / farPlane - 1.f / nearPlane,
+					1.f / nearPlane,
+					1.f / farPlane);
+
+			// Clip space of the draw transforms to the one of each eye, see
+			// forward.vs.glsl. The eyes share the depth row of the camera.
+			glm::mat4 stereoMatrices[2] = {glm::mat4(1), glm::mat4(1)};
+			if (stereo)
+			{
+				const auto inverseViewProjMatrix =
+					glm::inverse(tileProjMatrix * viewMatrix);
+				for (int eye = 0; eye < 2; ++eye)
+				{
+					stereoMatrices[eye] = eyeProjection(tileProjMatrix, eye)
+						* eyeViewMatrix(eye) * inverseViewProjMatrix;
+				}
+			}
+			const auto setStereoUniforms = [&](const GLProgram &program)
+			{
+				program.setUniform("uStereo", int(stereo));
+				program.setUniform(
+					program.getUniformLocation("uStereoMatrices"),
+					2,
+					stereoMatrices);
+			};
+
+			// Objects with an impostor whose bounding sphere projects to fewer
+			// than impostorPixels pixels leave their items for a quad each,
+			// drawn by the Impostors pass. Mono frames only, the quads are
+			// not instanced for the eyes.
+			size_t impostorCount = 0;
+			const bool impostors = featureImpostors
+				&& !stereo
+				&& !impostorObjectItems.empty();
+			if (impostors)
+			{
+				std::fill(impostorObjectsDrawn.begin(), impostorObjectsDrawn.end(), 0);
+				for (const auto itemIdx : visibleItems)
+				{
+					const auto object = itemImpostorObjects[itemIdx];
+					if (object >= 0)
+					{
+						impostorObjectsDrawn[object] = 1;
+					}
+				}
+				auto *instances =
+					static_cast<ImpostorInstance *>(impostorInstances.beginRegion());
+				const float impostorPixelsPerUnit =
+					0.5f * float(imageHeight) * projMatrix[1][1];
+				for (size_t o = 0; o < impostorObjectItems.size(); ++o)
+				{
+					if (!impostorObjectsDrawn[o])
+					{
+						continue;
+					}
+					const auto &matrix = drawItemMatrices[impostorObjectItems[o]];
+					const auto &sphere = impostorSpheres[impostorObjectLayers[o]];
+					const float radius = sphere.w * std::max({glm::length(matrix[0]),
+						glm::length(matrix[1]), glm::length(matrix[2])});
+					const float distance =
+						glm::length(glm::vec3(matrix * glm::vec4(glm::vec3(sphere), 1)) - eye);
+					if (distance <= radius
+						|| 2.f * radius * impostorPixelsPerUnit >= impostorPixels * distance)
+					{
+						impostorObjectsDrawn[o] = 0;
+						continue;
+					}
+					instances[impostorCount++] = {
+						matrix,
+						sphere,
+						glm::uvec4(impostorObjectLayers[o], 0, 0, 0)};
+				}
+				visibleItems.erase(
+					std::remove_if(
+						visibleItems.begin(),
+						visibleItems.end(),
+						[&](uint32_t itemIdx)
+						{
+							const auto object = itemImpostorObjects[itemIdx];
+							return object >= 0 && impostorObjectsDrawn[object];
+						}),
+					visibleItems.end());
+			}
+
+			// Sort by material textures then front to back, distances are measured to
+			// the center of the bounds along the view direction. The visible
+			// items of a primitive all take the distance of the nearest one so
+			// that they are adjacent in the queue and drawn instanced.
+			const auto viewDirection = glm::normalize(camera.getDirection());
+			const auto primitiveIndex = [&](const DrawItem &item)
+			{
+				return uint32_t(item.packedPrimitive);
+			};
+
+			for (const auto itemIdx : visibleItems)
+			{
+				primitiveDistances[primitiveIndex(drawItems[itemIdx])] = sceneFarPlane;
+				primitivePixels[primitiveIndex(drawItems[itemIdx])] = 0.f;
+			}
+
+			// The instances of a primitive share its shading LOD, the one of
+			// the largest on screen, so that they stay drawn together
+			const float pixelsPerUnit =
+				0.5f * float(imageHeight) * projMatrix[1][1];
+			for (const auto itemIdx : visibleItems)
+			{
+				const auto &bounds = drawItemBounds[itemIdx];
+				const float distance = bounds.isEmpty()
+					? 0.f
+					: glm::dot(0.5f * (bounds.min + bounds.max) - eye, viewDirection);
+				auto &primitiveDistance =
+					primitiveDistances[primitiveIndex(drawItems[itemIdx])];
+
+				primitiveDistance = std::min(primitiveDistance, distance);
+
+				auto &pixels = primitivePixels[primitiveIndex(drawItems[itemIdx])];
+				if (featureShadingLod && !bounds.isEmpty())
+				{
+					const float radius = 0.5f * glm::length(bounds.max - bounds.min);
+					const float eyeDistance =
+						glm::length(0.5f * (bounds.min + bounds.max) - eye) - radius;
+					pixels = std::max(
+						pixels,
+						eyeDistance > nearPlane
+							? 2.f * radius * pixelsPerUnit / eyeDistance
+							: std::numeric_limits<float>::max());
+				}
+				else
+				{
+					pixels = std::numeric_limits<float>::max();
+				}
+			}
+
+			renderQueue.clear();
+
+			for (const auto itemIdx : visibleItems)
+			{
+				const auto &item = drawItems[itemIdx];
+				const auto &primitive =
+					runtimeModel.primitive(item.mesh, item.primitive);
+
+				const auto permutation = drawPermutation(item);
+				auto layer = RenderQueue::Layer::Opaque;
+				float distance = primitiveDistances[primitiveIndex(item)];
+				if (permutation & PBR_ALPHA_BLEND)
+				{
+					layer = featureSortedBlending
+						? RenderQueue::Layer::SortedBlended
+						: RenderQueue::Layer::Blended;
+				}
+				if (layer == RenderQueue::Layer::SortedBlended)
+				{
+					// blended in order, each instance at its own distance
+					const auto &bounds = drawItemBounds[itemIdx];
+					distance = bounds.isEmpty()
+						? 0.f
+						: glm::dot(0.5f * (bounds.min + bounds.max) - eye, viewDirection);
+				}
+
+				renderQueue.push(
+					itemIdx,
+					permutation,
+					uint32_t(materialTextureGroup(primitive.material)),
+					distance / sceneFarPlane,
+					primitiveIndex(item),
+					layer);
+			}
+
+			renderQueue.sort();
+
+			// Texture levels the visible items need, from the size their
+			// bounding sphere projects to, and images they need decoded
+			if (texturesReady && (!textureStreamer.empty() || m_lazyTextures))
+			{
+				for (const auto itemIdx : visibleItems)
+				{
+					const auto &item = drawItems[itemIdx];
+					const auto &bounds = drawItemBounds[itemIdx];
+					const auto materialIndex =
+						runtimeModel.primitive(item.mesh, item.primitive).material;
+
+					if (materialIndex < 0 || bounds.isEmpty())
+					{
+						continue;
+					}
+
+					const auto &material = runtimeModel.materials()[materialIndex];
+					const float radius = 0.5f * glm::length(bounds.max - bounds.min);
+					const float distance =
+						glm::length(0.5f * (bounds.min + bounds.max) - eye) - radius;
+					const float pixels = distance > nearPlane
+						? 2.f * radius * pixelsPerUnit / distance
+						: std::numeric_limits<float>::max();
+
+					for (int slot = 0; slot < MATERIAL_TEXTURE_SLOT_COUNT; ++slot)
+					{
+						const auto textureIdx = material.textures[slot];
+						const bool detailMap = slot == MATERIAL_TEXTURE_NORMAL
+							|| slot == MATERIAL_TEXTURE_OCCLUSION;
+
+						if (textureIdx >= 0 && (m_detailMaps || !detailMap))
+						{
+							requestTextureImage(textureIdx);
+							textureStreamer.requestFootprint(size_t(textureIdx), pixels);
+						}
+					}
+				}
+			}
+
+			FrameConstants frameConstants;
+			frameConstants.camDir = glm::vec4(camera.getDirection(), 0);
+			frameConstants.lightDirection = glm::vec4(lightDirection, 0);
+			frameConstants.lightIntensity = glm::vec4(lightRadiance, 0);
+
+			// cluster slice of a view space depth d: log(d) * z + w
+			const float sliceScale =
+				CLUSTER_SLICES / std::log(farPlane / nearPlane);
+			frameConstants.clusterDepth = glm::vec4(
+				nearPlane,
+				farPlane,
+				sliceScale,
+				-sliceScale * std::log(nearPlane));
+			// each eye has half of the tiles in stereo
+			const float eyeWidth = stereo
+				? 0.5f * float(viewportWidth)
+				: float(viewportWidth);
+			const int eyeTiles = stereo ? CLUSTER_TILES_X / 2 : CLUSTER_TILES_X;
+			frameConstants.clusterTiles = glm::vec4(
+				(eyeWidth + float(eyeTiles - 1)) / float(eyeTiles),
+				float(viewportHeight + CLUSTER_TILES_Y - 1) / CLUSTER_TILES_Y,
+				float(punctualLights.size()),
+				stereo ? eyeWidth : 0.f);
+			frameConstants.temporalJitter = temporalJitter;
+			frameConstants.inverseDepth = glm::vec4(inverseDepth, 0);
+
+			// Slots of the view in the uniform buffers
+			const auto frameConstantsOffset =
+				GLintptr(drawnView * uniformSlotSize(sizeof(FrameConstants)));
+			const auto shadowConstantsOffset =
+				GLintptr(drawnView * uniformSlotSize(sizeof(ShadowConstants)));
+
+			glBindBuffer(GL_UNIFORM_BUFFER, frameConstantsUBO);
+			glBufferSubData(
+				GL_UNIFORM_BUFFER,
+				frameConstantsOffset,
+				sizeof(frameConstants),
+				&frameConstants);
+			glBindBufferRange(
+				GL_UNIFORM_BUFFER,
+				FRAME_CONSTANTS_BINDING,
+				frameConstantsUBO,
+				frameConstantsOffset,
+				sizeof(frameConstants));
+			frameStats.uploadedBytes += sizeof(frameConstants);
+
+			ShadowConstants shadowConstants;
+			for (size_t i = 0; i < shadowCascades.count(); ++i)
+			{
+				shadowConstants.cascadeMatrices[i] = shadowCascades.viewProjMatrix(i);
+				shadowConstants.cascadeSplits[i] = shadowCascades.splitDepth(i);
+				shadowConstants.cascadeTexelSizes[i] = shadowCascades.texelSize(i);
+			}
+			shadowConstants.shadowParams = glm::vec4(featureShadows ? 1 : 0, 0, 0, 0);
+
+			glBindBuffer(GL_UNIFORM_BUFFER, shadowConstantsUBO);
+			glBufferSubData(
+				GL_UNIFORM_BUFFER,
+				shadowConstantsOffset,
+				sizeof(shadowConstants),
+				&shadowConstants);
+			glBindBufferRange(
+				GL_UNIFORM_BUFFER,
+				SHADOW_CASCADES_BINDING,
+				shadowConstantsUBO,
+				shadowConstantsOffset,
+				sizeof(shadowConstants));
+			frameStats.uploadedBytes += sizeof(shadowConstants);
+			glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+			if (!punctualLights.empty())
+			{
+				gpuProfiler.begin("Light clusters");
+				glState.useProgram(glslClusterLightsProgram.glId());
+				const auto clusterProjMatrix = stereo
+					? eyeProjection(tileProjMatrix, 0)
+					: tileProjMatrix;
+				const auto rightProjMatrix = eyeProjection(tileProjMatrix, 1);
+				glslClusterLightsProgram.setUniform(
+					clusterViewMatrixLocation,
+					stereo ? eyeViewMatrix(0) : viewMatrix);
+				glslClusterLightsProgram.setUniform(
+					clusterProjScaleLocation,
+					glm::vec2(clusterProjMatrix[0][0], clusterProjMatrix[1][1]));
+				glslClusterLightsProgram.setUniform(
+					clusterProjOffsetLocation,
+					glm::vec2(clusterProjMatrix[2][0], clusterProjMatrix[2][1]));
+				glslClusterLightsProgram.setUniform(
+					clusterViewportSizeLocation,
+					glm::vec2(eyeWidth, viewportHeight));
+				glslClusterLightsProgram.setUniform("uStereo", int(stereo));
+				glslClusterLightsProgram.setUniform(
+					"uRightViewMatrix",
+					eyeViewMatrix(1));
+				glslClusterLightsProgram.setUniform(
+					"uRightProjOffset",
+					glm::vec2(rightProjMatrix[2][0], rightProjMatrix[2][1]));
+				glDispatchCompute(GLuint((clusterCount + 63) / 64), 1, 1);
+				glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+				gpuProfiler.end();
+			}
+
+			// Transforms in the order of the queue, the position of a draw in
+			// the queue is its draw index
+			const auto viewProjMatrix = tileProjMatrix * viewMatrix;
+			const auto &entries = renderQueue.entries();
+
+			// the GPU skips the draw if the box was hidden last time, without
+			// waiting for the query result. The boxes are drawn in the view of
+			// the camera, not of the eyes.
+			const bool occlusionCulling =
+				featureOcclusionCulling && !stereo && !gpuCulling;
+			const auto isConditional = [&](uint32_t itemIdx)
+			{
+				return occlusionCulling
+					&& occlusionQueryIssued[itemIdx]
+					&& !mayContainEye(itemIdx);
+			};
+
+			commandEntries.clear();
+			commandInstances.clear();
+			commandConditional.clear();
+			commandTriangles.clear();
+			pointEntries.clear();
+
+			// Point clouds of opaque materials are drawn from their octree,
+			// those in rest pose whose nodes bound their points
+			const bool pointClouds = featurePointClouds && !pointCommands.empty();
+			const auto isPointCloud = [&](uint32_t itemIdx)
+			{
+				const auto &item = drawItems[itemIdx];
+				const auto material =
+					runtimeModel.primitive(item.mesh, item.primitive).material;
+				return pointClouds
+					&& geometry.primitives[primitiveIndex(item)].pointNodeCount > 0
+					&& !(materialPermutation(material) & PBR_ALPHA_BLEND)
+					&& drawItemSkinJoints(item) == SKIN_NONE
+					&& item.morphTargets == MorphTargets::NONE
+					&& drawItemMergedVertices(item) == PACKED_MERGE_NONE;
+			};
+
+			const auto itemTriangles = [&](uint32_t itemIdx)
+			{
+				return triangleCount(
+					geometry.primitives[primitiveIndex(drawItems[itemIdx])].mode,
+					drawItemCommands[itemIdx].count);
+			};
+
+			if (!entries.empty())
+			{
+				auto *transforms =
+					static_cast<DrawTransform *>(drawTransforms.beginRegion());
+
+				// The per draw data of large scenes is the bulk of the CPU time
+				// of a frame, chunks of draws are written to the mapped buffer by
+				// jobs while GL calls stay on this thread
+				jobs.parallelFor(entries.size(), SCENE_UPDATE_CHUNK_SIZE,
+					[&](size_t begin, size_t end)
+					{
+						for (size_t i = begin; i < end; ++i)
+						{
+							const auto &item = drawItems[entries[i].item];
+							const auto &modelMatrix = drawItemMatrices[entries[i].item];
+							const auto material =
+								runtimeModel.primitive(item.mesh, item.primitive).material;
+							transforms[i].modelMatrix = modelMatrix;
+							transforms[i].modelViewProjMatrix = viewProjMatrix * modelMatrix;
+							transforms[i].previousModelViewProjMatrix = previousViewProjMatrix
+								* (previousValid
+									? previousDrawItemMatrices[entries[i].item]
+									: modelMatrix);
+							transforms[i].normalMatrix =
+								drawItemNormalMatrices[entries[i].item];
+							transforms[i].materialIndex = material < 0
+								? GLuint(model.materials.size())
+								: GLuint(material);
+							// Kept for the wireframe test, the mapping is not read back
+							const auto skinJoints = drawItemSkinJoints(item);
+							transforms[i].skinJoints = skinJoints;
+							transforms[i].morphTargets = item.morphTargets;
+							transforms[i].mergedVertices = drawItemMergedVertices(item);
+							transforms[i].positionDequantize =
+								geometry.primitives[primitiveIndex(item)].positionDequantize;
+							transforms[i].bakedOcclusion = drawItemBakedOcclusion(item);
+							// Pulled triangles are those of the index buffer in rest
+							// pose, points and lines have no edges
+							const auto &packed = geometry.primitives[primitiveIndex(item)];
+							const auto &command = drawItemCommands[entries[i].item];
+							const bool wireframe = wireframeBarycentrics
+								? packed.mode != GL_POINTS
+									&& packed.mode != GL_LINES
+									&& packed.mode != GL_LINE_LOOP
+									&& packed.mode != GL_LINE_STRIP
+								: packed.mode == GL_TRIANGLES
+									&& skinJoints == SKIN_NONE
+									&& item.morphTargets == MorphTargets::NONE;
+							transforms[i].wireframeFirstIndex =
+								wireframe ? command.firstIndex : WIREFRAME_NONE;
+							transforms[i].wireframeBaseVertex = command.baseVertex;
+							transforms[i].vertexBuffer = packed.vertexBuffer;
+						}
+					});
+
+				// The culling pass reads the bounds of the item of each draw
+				if (gpuCulling)
+				{
+					auto *items =
+						static_cast<GLuint *>(drawEntryItems.beginRegion());
+					for (size_t i = 0; i < entries.size(); ++i)
+					{
+						items[i] = entries[i].item;
+					}
+					frameStats.uploadedBytes += entries.size() * sizeof(GLuint);
+					glBindBufferRange(
+						GL_SHADER_STORAGE_BUFFER,
+						DRAW_ITEMS_BINDING,
+						drawEntryItems.buffer(),
+						drawEntryItems.regionOffset(),
+						GLsizeiptr(entries.size() * sizeof(GLuint)));
+				}
+
+				glBindBufferRange(
+					GL_SHADER_STORAGE_BUFFER,
+					DRAW_TRANSFORMS_BINDING,
+					drawTransforms.buffer(),
+					drawTransforms.regionOffset(),
+					GLsizeiptr(drawTransforms.regionSize()));
+
+				auto *commands = static_cast<DrawElementsIndirectCommand *>(
+					drawCommands.beginRegion());
+
+				// Consecutive draws of the same primitive become instances of
+				// one command, their draw indices are consecutive
+				for (size_t i = 0; i < entries.size(); ++i)
+				{
+					const auto itemIdx = entries[i].item;
+					if (isPointCloud(itemIdx))
+					{
+						pointEntries.push_back(i);
+						continue;
+					}
+					const bool conditional = isConditional(itemIdx);
+
+					if (!commandEntries.empty()
+						&& !conditional
+						&& !commandConditional.back()
+						&& commandEntries.back() + commandInstances.back() == i
+						&& primitiveIndex(drawItems[entries[commandEntries.back()].item])
+							== primitiveIndex(drawItems[itemIdx])
+						&& drawItemCommands[entries[commandEntries.back()].item].firstIndex
+							== drawItemCommands[itemIdx].firstIndex)
+					{
+						++commands[commandEntries.size() - 1].instanceCount;
+						++commandInstances.back();
+						commandTriangles.back() += itemTriangles(itemIdx);
+						continue;
+					}
+
+					commands[commandEntries.size()] = drawItemCommands[itemIdx];
+					commands[commandEntries.size()].baseInstance = GLuint(i);
+					commandEntries.push_back(i);
+					commandInstances.push_back(1);
+					commandConditional.push_back(conditional);
+					commandTriangles.push_back(itemTriangles(itemIdx));
+				}
+
+				// Instances of each eye, the culled meshlets get theirs from
+				// the culling pass
+				if (stereo)
+				{
+					for (size_t i = 0; i < commandEntries.size(); ++i)
+					{
+						commands[i].instanceCount *= 2;
+						commandTriangles[i] *= 2;
+					}
+				}
+
+				// Instance transforms and commands go through mapped memory
+				frameStats.uploadedBytes += entries.size() * sizeof(DrawTransform)
+					+ commandEntries.size() * sizeof(DrawElementsIndirectCommand);
+
+				glBindBuffer(GL_DRAW_INDIRECT_BUFFER, drawCommands.buffer());
+			}
+
+			// Commands of blended materials follow the others in the queue
+			size_t firstBlendedCommand = 0;
+			while (firstBlendedCommand < commandEntries.size())
+			{
+				const auto &item =
+					drawItems[entries[commandEntries[firstBlendedCommand]].item];
+				const auto material =
+					runtimeModel.primitive(item.mesh, item.primitive).material;
+				if (materialPermutation(material) & PBR_ALPHA_BLEND)
+				{
+					break;
+				}
+				++firstBlendedCommand;
+			}
+			commandVisibility.assign(commandEntries.size(), 0);
+
+			// Point clouds: the octree nodes of their entries are visited from
+			// those covering the most pixels, by the projected size of their
+			// bounding sphere, each after its parent, and drawn until the point
+			// budget is spent. Nodes out of the view frustum are left out with
+			// their subtree. The compute rasterizer splats them in the pose of
+			// the frame only, and in one view.
+			const bool pointRasterizer = featurePointRasterizer
+				&& pointRasterizerSupported
+				&& !stereo
+				&& !drawnTemporal;
+			pointDraws.clear();
+			if (!pointEntries.empty())
+			{
+				TRACE_ZONE("selectPointNodes");
+				const auto pointPrimitive = [&](uint32_t pointEntry) -> const PackedPrimitive &
+				{
+					return geometry.primitives[primitiveIndex(
+						drawItems[entries[pointEntries[pointEntry]].item])];
+				};
+				const auto byPriority = [](
+					const PointNodeCandidate &a,
+					const PointNodeCandidate &b)
+				{
+					return a.priority < b.priority;
+				};
+				const auto considerNode = [&](uint32_t pointEntry, uint32_t node)
+				{
+					const auto &octreeNode = geometry.pointNodes[node];
+					const auto bounds = transformAabb(
+						{octreeNode.min, octreeNode.min + glm::vec3(octreeNode.size)},
+						drawItemMatrices[entries[pointEntries[pointEntry]].item]);
+					if (!frustum.intersects(bounds))
+					{
+						return;
+					}
+					const float radius = 0.5f * glm::length(bounds.max - bounds.min);
+					const float distance =
+						glm::length(0.5f * (bounds.min + bounds.max) - eye);
+					pointCandidates.push_back({
+						distance > radius
+							? radius / distance
+							: std::numeric_limits<float>::max(),
+						pointEntry,
+						node});
+					std::push_heap(
+						pointCandidates.begin(),
+						pointCandidates.end(),
+						byPriority);
+				};
+
+				pointCandidates.clear();
+				for (size_t i = 0; i < pointEntries.size(); ++i)
+				{
+					considerNode(uint32_t(i), pointPrimitive(uint32_t(i)).firstPointNode);
+				}
+				const auto pointBudget = size_t(double(pointBudgetMillions) * 1e6);
+				size_t selectedPoints = 0;
+				while (!pointCandidates.empty())
+				{
+					std::pop_heap(
+						pointCandidates.begin(),
+						pointCandidates.end(),
+						byPriority);
+					const auto candidate = pointCandidates.back();
+					pointCandidates.pop_back();
+					const auto &node = geometry.pointNodes[candidate.node];
+					if (selectedPoints + node.indexCount > pointBudget)
+					{
+						break;
+					}
+					selectedPoints += node.indexCount;
+					pointDraws.push_back({candidate.pointEntry, candidate.node, 0});
+					const auto firstNode = pointPrimitive(candidate.pointEntry).firstPointNode;
+					for (uint32_t child = 0; child < node.childCount; ++child)
+					{
+						considerNode(
+							candidate.pointEntry,
+							firstNode + node.firstChild + child);
+					}
+				}
+
+				// Points around a node drawn with all of its children are as far
+				// apart as those of its sparsest child, else as its own. Children
+				// follow their parent in the octree.
+				std::sort(
+					pointDraws.begin(),
+					pointDraws.end(),
+					[](const PointNodeDraw &a, const PointNodeDraw &b)
+					{
+						return std::tie(a.pointEntry, a.node)
+							< std::tie(b.pointEntry, b.node);
+					});
+				for (size_t begin = 0; begin < pointDraws.size();)
+				{
+					auto end = begin + 1;
+					while (end < pointDraws.size()
+						&& pointDraws[end].pointEntry == pointDraws[begin].pointEntry)
+					{
+						++end;
+					}
+					const auto &packed = pointPrimitive(pointDraws[begin].pointEntry);
+					pointNodeSpacings.assign(packed.pointNodeCount, 0.f);
+					for (auto i = end; i-- > begin;)
+					{
+						auto &draw = pointDraws[i];
+						const auto &node = geometry.pointNodes[draw.node];
+						float childSpacing = 0.f;
+						bool childrenDrawn = node.childCount > 0;
+						for (uint32_t child = 0; child < node.childCount; ++child)
+						{
+							const float spacing = pointNodeSpacings[node.firstChild + child];
+							childrenDrawn = childrenDrawn && spacing > 0.f;
+							childSpacing = std::max(childSpacing, spacing);
+						}
+						const float spacing = childrenDrawn ? childSpacing : node.spacing;
+						pointNodeSpacings[draw.node - packed.firstPointNode] = spacing;
+						draw.spacingLevel = int(std::ceil(2.f * std::log2(spacing)));
+					}
+					begin = end;
+				}
+				// The nodes of an entry with the same point size are drawn
+				// together
+				std::sort(
+					pointDraws.begin(),
+					pointDraws.end(),
+					[](const PointNodeDraw &a, const PointNodeDraw &b)
+					{
+						return std::tie(a.pointEntry, a.spacingLevel, a.node)
+							< std::tie(b.pointEntry, b.spacingLevel, b.node);
+					});
+
+				if (pointRasterizer && !pointDraws.empty())
+				{
+					// Jobs of the nodes of a vertex buffer are dispatched
+					// together, numbering their points from the first
+					auto *jobs = static_cast<PointJob *>(pointJobs.beginRegion());
+					GLuint firstPoint = 0;
+					for (size_t i = 0; i < pointDraws.size(); ++i)
+					{
+						const auto &draw = pointDraws[i];
+						const auto &node = geometry.pointNodes[draw.node];
+						const auto &packed = pointPrimitive(draw.pointEntry);
+						if (i > 0
+							&& pointPrimitive(pointDraws[i - 1].pointEntry).vertexBuffer
+								!= packed.vertexBuffer)
+						{
+							firstPoint = 0;
+						}
+						jobs[i] = {
+							node.firstIndex,
+							node.indexCount,
+							packed.baseVertex,
+							GLuint(pointEntries[draw.pointEntry]),
+							firstPoint,
+							{}};
+						firstPoint += node.indexCount;
+					}
+					frameStats.uploadedBytes += pointDraws.size() * sizeof(PointJob);
+				}
+				else if (!pointDraws.empty())
+				{
+					auto *commands = static_cast<DrawElementsIndirectCommand *>(
+						pointCommands.beginRegion());
+					for (size_t i = 0; i < pointDraws.size(); ++i)
+					{
+						const auto &draw = pointDraws[i];
+						const auto &node = geometry.pointNodes[draw.node];
+						commands[i] = {
+							node.indexCount,
+							stereo ? 2u : 1u,
+							node.firstIndex,
+							pointPrimitive(draw.pointEntry).baseVertex,
+							GLuint(pointEntries[draw.pointEntry])};
+					}
+					frameStats.uploadedBytes +=
+						pointDraws.size() * sizeof(DrawElementsIndirectCommand);
+				}
+			}
+
+			// Consecutive commands of the same primitive state and textures are
+			// submitted together, conditional commands alone. Bindless textures
+			// let commands of different textures share a batch, not of different
+			// program variants. The depth pre-pass ignores materials, but for the
+			// alpha tested ones it leaves out. Blended commands culled on the GPU
+			// are alone too, the draws of a batch are compacted in any order.
+			// Batches are shaded forward or from the visibility buffer whole.
+			const auto canBatch = [&](
+				size_t firstCommand,
+				size_t command,
+				bool depthOnly)
+			{
+				const auto &first = drawItems[entries[commandEntries[firstCommand]].item];
+				const auto &item = drawItems[entries[commandEntries[command]].item];
+				const auto &firstPacked = geometry.primitives[primitiveIndex(first)];
+				const auto &packed = geometry.primitives[primitiveIndex(item)];
+
+				const auto firstMaterial =
+					runtimeModel.primitive(first.mesh, first.primitive).material;
+				const auto material =
+					runtimeModel.primitive(item.mesh, item.primitive).material;
+
+				return (vertexPulling
+						|| firstPacked.vertexBuffer == packed.vertexBuffer)
+					&& firstPacked.mode == packed.mode
+					&& (depthOnly
+						? !(materialPermutation(material) & PBR_ALPHA_MASK)
+						: (drawPermutation(first) == drawPermutation(item)
+						&& (bindlessTextures
+							|| materialTextureGroup(firstMaterial)
+								== materialTextureGroup(material))))
+					&& !commandConditional[command]
+					&& !(gpuCulling && cullMeshlets && command >= firstBlendedCommand)
+					&& (commandVisibility[firstCommand] != 0)
+						== (commandVisibility[command] != 0);
+			};
+
+			// Cull the meshlets of the commands, each batch of the shading pass
+			// then draws those left. The depth pre-pass splits its batches the
+			// same way, since the draws of a batch are contiguous. Commands of
+			// a generated level of detail are drawn whole. GPU culling culls
+			// their instances in the same pass.
+			const bool meshletCulling = featureMeshletCulling
+				&& meshletsSSBO
+				&& !wireframeVertices;
+			cullMeshlets = (meshletCulling || gpuCulling)
+				&& clusterDrawCapacity > 0
+				&& !commandEntries.empty();
+			if (cullMeshlets)
+			{
+				TRACE_ZONE("cullMeshlets");
+				gpuProfiler.begin("Meshlet culling");
+				// Batches of the shading pass, conditional commands alone
+				commandBatches.resize(commandEntries.size());
+				batchDrawOffsets.assign(1, 0);
+				for (size_t batchBegin = 0; batchBegin < commandEntries.size();)
+				{
+					size_t batchEnd = batchBegin + 1;
+					while (!commandConditional[batchBegin]
+						&& batchEnd < commandEntries.size()
+						&& canBatch(batchBegin, batchEnd, false))
+					{
+						++batchEnd;
+					}
+					std::fill(
+						commandBatches.begin() + batchBegin,
+						commandBatches.begin() + batchEnd,
+						GLuint(batchDrawOffsets.size() - 1));
+					batchDrawOffsets.push_back(0);
+					batchBegin = batchEnd;
+				}
+
+				// Without multisampling, triangles only cover the pixels whose
+				// center they contain. The eyes of stereo have their own.
+				GLint samples = 0;
+				glGetIntegerv(GL_SAMPLES, &samples);
+				const bool smallFeatureCulling = samples <= 1 && !stereo;
+
+				auto *clusters =
+					static_cast<ClusterCommand *>(clusterCommands.beginRegion());
+				GLuint jobCount = 0;
+				for (size_t i = 0; i < commandEntries.size(); ++i)
+				{
+					const auto entry = commandEntries[i];
+					const auto instanceCount = GLuint(commandInstances[i]);
+					const auto itemIdx = entries[entry].item;
+					const auto &item = drawItems[itemIdx];
+					const auto &packed = geometry.primitives[primitiveIndex(item)];
+					const auto &command = drawItemCommands[itemIdx];
+					const auto material =
+						runtimeModel.primitive(item.mesh, item.primitive).material;
+
+					const auto meshletCount =
+						meshletCulling && command.firstIndex == packed.firstIndex
+							? GLuint(packed.meshletCount)
+							: 0u;
+					// Blended instances are drawn in the order of the queue, the
+					// compaction would not keep it
+					const bool drawCulling = gpuCulling && i < firstBlendedCommand;
+					const auto draws = meshletCount
+						? meshletCount * instanceCount
+						: drawCulling ? instanceCount : 1u;
+
+					auto &cluster = clusters[i];
+					cluster.firstJob = jobCount;
+					cluster.firstMeshlet = GLuint(packed.firstMeshlet);
+					cluster.meshletCount = meshletCount;
+					cluster.instanceCount = instanceCount;
+					cluster.count = command.count;
+					cluster.firstIndex = command.firstIndex;
+					cluster.baseVertex = command.baseVertex;
+					cluster.baseInstance = GLuint(entry);
+					cluster.batch = commandBatches[i];
+					// Each batch starts after the draws of the previous ones, the
+					// commands of a batch being consecutive
+					if (i == 0 || commandBatches[i - 1] != cluster.batch)
+					{
+						batchDrawOffsets[cluster.batch] = jobCount;
+					}
+					cluster.batchOffset = batchDrawOffsets[cluster.batch];
+					cluster.flags =
+						material >= 0 && runtimeModel.materials()[material].doubleSided
+							? 0u
+							: CLUSTER_CONE_CULLING_BIT;
+					if (drawCulling)
+					{
+						cluster.flags |= CLUSTER_DRAW_CULLING_BIT;
+						if (smallFeatureCulling
+							&& (packed.mode == GL_TRIANGLES
+								|| packed.mode == GL_TRIANGLE_STRIP
+								|| packed.mode == GL_TRIANGLE_FAN))
+						{
+							cluster.flags |= CLUSTER_SMALL_FEATURE_BIT;
+						}
+					}
+					jobCount += draws;
+				}
+				batchDrawOffsets.back() = jobCount;
+				frameStats.uploadedBytes +=
+					commandEntries.size() * sizeof(ClusterCommand);
+
+				glBindBufferRange(
+					GL_SHADER_STORAGE_BUFFER,
+					CLUSTER_COMMANDS_BINDING,
+					clusterCommands.buffer(),
+					clusterCommands.regionOffset(),
+					GLsizeiptr(commandEntries.size() * sizeof(ClusterCommand)));
+				const GLuint zero = 0;
+				glBindBuffer(GL_SHADER_STORAGE_BUFFER, clusterCounts);
+				glClearBufferSubData(
+					GL_SHADER_STORAGE_BUFFER,
+					GL_R32UI,
+					0,
+					GLsizeiptr((batchDrawOffsets.size() - 1) * sizeof(GLuint)),
+					GL_RED_INTEGER,
+					GL_UNSIGNED_INT,
+					&zero);
+				glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+				glState.useProgram(glslCullMeshletsProgram.glId());
+				const auto eyePosition = [&](int eye)
+				{
+					return glm::vec3(glm::inverse(viewMatrix)
+						* glm::vec4(eyeOffset(eye), 0, 0, 1));
+				};
+				glslCullMeshletsProgram.setUniform(
+					cullEyeLocation,
+					stereo ? eyePosition(0) : eye);
+				glslCullMeshletsProgram.setUniform("uRightEye", eyePosition(1));
+				setStereoUniforms(glslCullMeshletsProgram);
+				glslCullMeshletsProgram.setUniform(cullJobCountLocation, GLint(jobCount));
+				if (gpuCulling)
+				{
+					if (!drawBoundsUploaded)
+					{
+						uploadDrawBounds();
+					}
+					// Hidden by the depth of the previous frame, drawn from the
+					// camera as the occlusion queries
+					const bool hiZ =
+						featureOcclusionCulling && !stereo && depthPyramidValid;
+					glslCullMeshletsProgram.setUniform(
+						"uViewProjMatrix",
+						viewProjMatrix);
+					glslCullMeshletsProgram.setUniform(
+						"uViewportSize",
+						glm::vec2(viewportWidth, viewportHeight));
+					glslCullMeshletsProgram.setUniform("uOcclusion", hiZ ? 1 : 0);
+					if (hiZ)
+					{
+						glState.bindTexture(
+							DEPTH_PYRAMID_UNIT,
+							GL_TEXTURE_2D,
+							depthPyramid.texture());
+						glState.bindSampler(DEPTH_PYRAMID_UNIT, 0);
+						glslCullMeshletsProgram.setUniform(
+							"uDepthPyramid",
+							DEPTH_PYRAMID_UNIT);
+						glslCullMeshletsProgram.setUniform(
+							"uPyramidViewProjMatrix",
+							depthPyramidViewProjMatrix);
+						glslCullMeshletsProgram.setUniform(
+							"uPyramidSceneSize",
+							depthPyramidSceneSize);
+						glslCullMeshletsProgram.setUniform(
+							"uPyramidLevels",
+							depthPyramid.levels());
+						glslCullMeshletsProgram.setUniform(
+							"uPyramidReversedZ",
+							depthPyramidReversedZ ? 1 : 0);
+					}
+				}
+				glslCullMeshletsProgram.setUniform(
+					cullCommandCountLocation,
+					GLint(commandEntries.size()));
+				glDispatchCompute((jobCount + 63) / 64, 1, 1);
+				glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+				glBindBuffer(GL_DRAW_INDIRECT_BUFFER, clusterDraws);
+				glBindBuffer(GL_PARAMETER_BUFFER_ARB, clusterCounts);
+				gpuProfiler.end();
+			}
+
+			// Opaque commands rasterized to the visibility buffer, then shaded
+			// once per pixel by a resolve pass per bin. Those the resolve
+			// cannot rebuild are shaded forward. The buffer shares the depth
+			// of the scene, single sample. Culled meshlets are batched before
+			// the commands are known and the eyes of stereo would need a
+			// buffer each, both are shaded forward, as are the wireframe
+			// overlay and the batches of vertex pulling.
+			bool visibility = false;
+			if (featureVisibilityBuffer
+				&& !stereo
+				&& !cullMeshlets
+				&& !featureWireframe
+				&& !vertexPulling
+				&& firstBlendedCommand > 0)
+			{
+				GLint samples = 0;
+				glGetIntegerv(GL_SAMPLES, &samples);
+				if (samples <= 1)
+				{
+					if (visibilityBuffer.width() < viewportWidth
+						|| visibilityBuffer.height() < viewportHeight)
+					{
+						visibilityBuffer.init(
+							grownTargetSize(visibilityBuffer.width(), viewportWidth),
+							grownTargetSize(visibilityBuffer.height(), viewportHeight));
+					}
+					visibility = visibilityBuffer.attachDepth();
+				}
+			}
+			if (visibility)
+			{
+				TRACE_ZONE("visibilityBins");
+				compileVisibilityPrograms();
+				visibilityBins.clear();
+				for (size_t i = 0; i < firstBlendedCommand; ++i)
+				{
+					const auto &item = drawItems[entries[commandEntries[i]].item];
+					const auto &packed = geometry.primitives[primitiveIndex(item)];
+					const auto material =
+						runtimeModel.primitive(item.mesh, item.primitive).material;
+					if (commandConditional[i]
+						|| packed.mode != GL_TRIANGLES
+						|| (materialPermutation(material) & PBR_ALPHA_MASK)
+						|| drawItemSkinJoints(item) != SKIN_NONE
+						|| item.morphTargets != MorphTargets::NONE)
+					{
+						continue;
+					}
+
+					const auto textureGroup =
+						bindlessTextures ? -1 : materialTextureGroup(material);
+					const auto isBin = [&](const VisibilityBin &bin)
+					{
+						return bin.vertexBuffer == GLuint(packed.vertexBuffer)
+							&& bin.textureGroup == textureGroup;
+					};
+					// Commands of a bin are mostly consecutive in the queue
+					size_t bin = visibilityBins.size();
+					if (bin == 0 || !isBin(visibilityBins.back()))
+					{
+						bin = size_t(std::find_if(
+							visibilityBins.begin(),
+							visibilityBins.end(),
+							isBin) - visibilityBins.begin());
+						if (bin == visibilityBins.size())
+						{
+							visibilityBins.push_back(
+								{GLuint(packed.vertexBuffer), textureGroup, material});
+						}
+					}
+					else
+					{
+						--bin;
+					}
+					commandVisibility[i] = GLuint(bin + 1);
+				}
+				visibility = !visibilityBins.empty();
+			}
+			if (visibility)
+			{
+				// The draws shaded forward are never read
+				auto *draws =
+					static_cast<VisibilityDraw *>(visibilityDraws.beginRegion());
+				for (size_t i = 0; i < firstBlendedCommand; ++i)
+				{
+					if (!commandVisibility[i])
+					{
+						continue;
+					}
+					const auto lastEntry = commandEntries[i] + commandInstances[i];
+					for (auto entry = commandEntries[i]; entry < lastEntry; ++entry)
+					{
+						const auto &command = drawItemCommands[entries[entry].item];
+						draws[entry] = {
+							command.firstIndex,
+							command.baseVertex,
+							commandVisibility[i] - 1,
+							0};
+					}
+				}
+				frameStats.uploadedBytes += entries.size() * sizeof(VisibilityDraw);
+				glBindBufferRange(
+					GL_SHADER_STORAGE_BUFFER,
+					VISIBILITY_DRAWS_BINDING,
+					visibilityDraws.buffer(),
+					visibilityDraws.regionOffset(),
+					GLsizeiptr(entries.size() * sizeof(VisibilityDraw)));
+			}
+
+			int boundTextureGroup = -1;
+			int64_t boundPermutation = -1;
+			// Output of the blended programs, set by the transparent pass
+			bool weightedBlended = false;
+
+			// Ambient occlusion reads the depth of the pre-pass, drawn for it.
+			// Its horizons are searched in the view of the camera, not of the
+			// eyes.
+			const GLuint sceneDepth = featureAmbientOcclusion && !stereo
+				? drawFramebufferDepthTexture()
+				: 0;
+			const bool ambientOcclusion = sceneDepth != 0;
+			const bool depthPrepass = featureDepthPrepass || ambientOcclusion;
+
+			// Use the program of a permutation of the shading passes, unless
+			// bound already
+			const GLProgram *boundProgram = nullptr;
+			const auto usePermutation = [&](int64_t permutation) -> const GLProgram &
+			{
+				if (permutation == boundPermutation)
+				{
+					return *boundProgram;
+				}
+				// The variant sampling every map renders the same while the
+				// driver builds the one of the material
+				const auto *program = pbrPrograms.tryProgram(permutation);
+				if (!program)
+				{
+					program = &pbrPrograms.program(allPbrFeatures
+						| (permutation
+							& (PBR_ALPHA_BLEND | PBR_WIREFRAME | PBR_PULL_VERTICES)));
+				}
+				glState.useProgram(program->glId());
+				setStereoUniforms(*program);
+				program->setUniform(
+					"uUseSHIrradiance",
+					int(featureEnvironment
+						&& (featureSHIrradiance || (permutation & PBR_SHADING_LOD))));
+				if (permutation & PBR_WIREFRAME)
+				{
+					program->setUniform(
+						"uShortIndices",
+						int(geometry.indexType == GL_UNSIGNED_SHORT));
+				}
+				if (permutation & PBR_ALPHA_BLEND)
+				{
+					program->setUniform("uWeightedBlended", int(weightedBlended));
 				}
 				else
 				{
-					glActiveTexture(GL_TEXTURE2);
-					glBindTexture(
+					program->setUniform(
+						"uAmbientOcclusion",
+						int(ambientOcclusion));
+				}
+				boundPermutation = permutation;
+				boundProgram = program;
+				return *program;
+			};
+
+			// Submit the commands [first, last) of the frame shaded forward,
+			// with the program and textures of their material unless depthOnly
+			const auto drawCommandBatches = [&](
+				size_t first,
+				size_t last,
+				bool depthOnly)
+			{
+				for (size_t batchBegin = first; batchBegin < last;)
+				{
+					// batches of the visibility buffer hold no other command
+					if (commandVisibility[batchBegin])
+					{
+						++batchBegin;
+						continue;
+					}
+
+					const auto itemIdx = entries[commandEntries[batchBegin]].item;
+					const auto &item = drawItems[itemIdx];
+					const auto &primitive =
+						runtimeModel.primitive(item.mesh, item.primitive);
+
+					const auto permutation = drawPermutation(item);
+					if (!depthOnly)
+					{
+						usePermutation(permutation);
+					}
+
+					if (!depthOnly
+					&& !bindlessTextures
+					&& materialTextureGroup(primitive.material) != boundTextureGroup)
+					{
+						bindMaterial(primitive.material);
+						boundTextureGroup = materialTextureGroup(primitive.material);
+					}
+
+					const bool conditional = commandConditional[batchBegin];
+					const bool masked = (permutation & PBR_ALPHA_MASK) != 0;
+					size_t batchEnd = batchBegin + 1;
+
+					// The query result may change between the passes and masked
+					// fragments are discarded by their material, so the pre-pass
+					// leaves conditional and masked commands out and the shading
+					// pass writes their depth. Blended commands never do.
+					if (depthOnly && (conditional || masked))
+					{
+						batchBegin = batchEnd;
+						continue;
+					}
+					const bool writesDepth = depthPrepass
+						&& !depthOnly
+						&& (conditional || masked)
+						&& !(permutation & PBR_ALPHA_BLEND);
+
+					if (writesDepth)
+					{
+						glState.depthMask(true);
+						glState.depthFunc(depthTest);
+					}
+
+					if (conditional)
+					{
+						glBeginConditionalRender(
+							occlusionQueries[itemIdx],
+							GL_QUERY_NO_WAIT);
+					}
+					else
+					{
+						while (batchEnd < last
+							&& canBatch(batchBegin, batchEnd, depthOnly && !cullMeshlets))
+						{
+							++batchEnd;
+						}
+					}
+
+					drawBatch(batchBegin, batchEnd);
+
+					if (conditional)
+					{
+						glEndConditionalRender();
+					}
+
+					if (writesDepth)
+					{
+						glState.depthMask(false);
+						glState.depthFunc(GL_EQUAL);
+					}
+
+					batchBegin = batchEnd;
+				}
+			};
+
+			// The draw index advances every 2 instances of the camera passes
+			// in stereo, each eye drawing its half of the viewport
+			const auto setEyeInstances = [&](bool enabled)
+			{
+				for (const auto vao : vertexArrayObjects)
+				{
+					glState.bindVertexArray(vao);
+					glVertexBindingDivisor(DRAW_INDEX_BUFFER_BINDING, enabled ? 2 : 1);
+				}
+				if (pulledVertexArray)
+				{
+					glState.bindVertexArray(pulledVertexArray);
+					glVertexBindingDivisor(DRAW_INDEX_BUFFER_BINDING, enabled ? 2 : 1);
+				}
+			};
+			if (stereo)
+			{
+				setEyeInstances(true);
+			}
+
+			// Passes of the opaque scene, run by the frame graph which gives
+			// the transient targets of ambient occlusion and their barriers.
+			// The scene resource stands for the attachments of the bound
+			// framebuffer.
+			const auto scene = frameGraph.import(sceneDepth);
+			FrameGraph::Resource halfDepth = 0;
+			FrameGraph::Resource rawOcclusion = 0;
+			FrameGraph::Resource occlusion = 0;
+			const auto visibilityTarget = visibility
+				? frameGraph.import(visibilityBuffer.texture())
+				: 0;
+
+			// The draw and triangle of the pixels of the opaque commands of
+			// the visibility buffer, and their depth
+			if (visibility)
+			{
+				frameGraph.addPass(
+					"Visibility",
+					[&](FrameGraph::PassBuilder &pass)
+					{
+						pass.write(visibilityTarget, FrameGraph::Access::Attachment);
+						pass.write(scene, FrameGraph::Access::Attachment);
+					},
+					[&]()
+					{
+						gpuProfiler.begin("Visibility");
+						GLint sceneFramebuffer = 0;
+						glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &sceneFramebuffer);
+						glState.bindFramebuffer(
+							GL_DRAW_FRAMEBUFFER,
+							visibilityBuffer.framebuffer());
+						const GLuint noDraw[] = {0, 0, 0, 0};
+						glClearBufferuiv(GL_COLOR, 0, noDraw);
+
+						glState.useProgram(glslVisibilityProgram->glId());
+						setStereoUniforms(*glslVisibilityProgram);
+						for (size_t batchBegin = 0; batchBegin < firstBlendedCommand;)
+						{
+							size_t batchEnd = batchBegin + 1;
+							if (!commandVisibility[batchBegin])
+							{
+								batchBegin = batchEnd;
+								continue;
+							}
+							while (batchEnd < firstBlendedCommand
+								&& canBatch(batchBegin, batchEnd, true))
+							{
+								++batchEnd;
+							}
+							drawBatch(batchBegin, batchEnd);
+							batchBegin = batchEnd;
+						}
+
+						glState.bindFramebuffer(GL_DRAW_FRAMEBUFFER, GLuint(sceneFramebuffer));
+						gpuProfiler.end();
+					});
+			}
+
+			// Shade each pixel once: lay the depth of the scene down first,
+			// then shade the fragments matching it only
+			if (depthPrepass)
+			{
+				frameGraph.addPass(
+					"Depth pre-pass",
+					[&](FrameGraph::PassBuilder &pass)
+					{
+						pass.write(scene, FrameGraph::Access::Attachment);
+					},
+					[&]()
+					{
+						gpuProfiler.begin("Depth pre-pass");
+						const auto &depthProgram = vertexPulling
+							? *glslPulledDepthProgram
+							: glslDepthProgram;
+						glState.useProgram(depthProgram.glId());
+						setStereoUniforms(depthProgram);
+						glState.colorMask(false);
+						drawCommandBatches(0, firstBlendedCommand, true);
+						glState.colorMask(true);
+						glState.depthMask(false);
+						glState.depthFunc(GL_EQUAL);
+						gpuProfiler.end();
+					});
+			}
+
+			// Half resolution ambient occlusion of the pre-pass depth: view
+			// space depths, horizons then blur, sampled by the shading pass.
+			// The targets keep the largest viewport drawn, scenes use their
+			// bottom left corner.
+			if (ambientOcclusion)
+			{
+				ambientOcclusionExtent = glm::max(
+					ambientOcclusionExtent,
+					glm::ivec2(viewportWidth, viewportHeight));
+				const auto depthDesc =
+					ambientOcclusionTarget(
+					GL_R32F,
+					ambientOcclusionExtent.x,
+					ambientOcclusionExtent.y);
+				const auto occlusionDesc =
+					ambientOcclusionTarget(
+					GL_R8,
+					ambientOcclusionExtent.x,
+					ambientOcclusionExtent.y);
+				const glm::vec2 viewportSize(viewportWidth, viewportHeight);
+				const GLuint groupsX = GLuint((viewportWidth + 1) / 2 + 7) / 8;
+				const GLuint groupsY = GLuint((viewportHeight + 1) / 2 + 7) / 8;
+
+				frameGraph.addPass(
+					"Ambient occlusion depth",
+					[&](FrameGraph::PassBuilder &pass)
+					{
+						pass.read(scene);
+						halfDepth = pass.create(depthDesc);
+					},
+					// timed with the passes below, culled together
+					[&]()
+					{
+						gpuProfiler.begin("Ambient occlusion");
+						GLint samples = 0;
+						glGetIntegerv(GL_SAMPLES, &samples);
+						const bool multisample = samples > 1;
+						glState.useProgram(glslAmbientOcclusionDepthProgram.glId());
+						glState.bindTexture(
+							multisample ? 1 : 0,
+							multisample ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D,
+							sceneDepth);
+						glState.bindSampler(multisample ? 1 : 0, 0);
+						glslAmbientOcclusionDepthProgram.setUniform("uDepth", 0);
+						glslAmbientOcclusionDepthProgram.setUniform("uDepthMS", 1);
+						glslAmbientOcclusionDepthProgram.setUniform(
+							"uSamples",
+							multisample ? int(samples) : 0);
+						glslAmbientOcclusionDepthProgram.setUniform(
+							"uViewportSize",
+							viewportSize);
+						glslAmbientOcclusionDepthProgram.setUniform(
+							"uInverseDepth",
+							inverseDepth);
+						glBindImageTexture(
+							0,
+							frameGraph.texture(halfDepth),
+							0,
+							GL_FALSE,
+							0,
+							GL_WRITE_ONLY,
+							GL_R32F);
+						glDispatchCompute(groupsX, groupsY, 1);
+					});
+
+				frameGraph.addPass(
+					"Ambient occlusion horizons",
+					[&](FrameGraph::PassBuilder &pass)
+					{
+						pass.read(halfDepth);
+						rawOcclusion = pass.create(occlusionDesc);
+					},
+					[&]()
+					{
+						glState.useProgram(glslAmbientOcclusionProgram.glId());
+						glState.bindTexture(0, GL_TEXTURE_2D, frameGraph.texture(halfDepth));
+						glState.bindSampler(0, 0);
+						glslAmbientOcclusionProgram.setUniform("uHalfDepth", 0);
+						glslAmbientOcclusionProgram.setUniform(
+							"uProjScale",
+							glm::vec2(tileProjMatrix[0][0], tileProjMatrix[1][1]));
+						glslAmbientOcclusionProgram.setUniform(
+							"uProjOffset",
+							glm::vec2(tileProjMatrix[2][0], tileProjMatrix[2][1]));
+						glslAmbientOcclusionProgram.setUniform(
+							"uViewportSize",
+							viewportSize);
+						glslAmbientOcclusionProgram.setUniform(
+							"uRadius",
+							ambientOcclusionRadius * sceneDiagonal);
+						glBindImageTexture(
+							0,
+							frameGraph.texture(rawOcclusion),
+							0,
+							GL_FALSE,
+							0,
+							GL_WRITE_ONLY,
+							GL_R8);
+						glDispatchCompute(groupsX, groupsY, 1);
+					});
+
+				frameGraph.addPass(
+					"Ambient occlusion blur",
+					[&](FrameGraph::PassBuilder &pass)
+					{
+						pass.read(halfDepth);
+						pass.read(rawOcclusion);
+						occlusion = pass.create(occlusionDesc);
+					},
+					[&]()
+					{
+						glState.useProgram(glslAmbientOcclusionBlurProgram.glId());
+						glState.bindTexture(
+							1,
+							GL_TEXTURE_2D,
+							frameGraph.texture(rawOcclusion));
+						glState.bindSampler(1, 0);
+						glslAmbientOcclusionBlurProgram.setUniform("uHalfDepth", 0);
+						glslAmbientOcclusionBlurProgram.setUniform("uRawOcclusion", 1);
+						glslAmbientOcclusionBlurProgram.setUniform(
+							"uViewportSize",
+							viewportSize);
+						glBindImageTexture(
+							0,
+							frameGraph.texture(occlusion),
+							0,
+							GL_FALSE,
+							0,
+							GL_WRITE_ONLY,
+							GL_R8);
+						glDispatchCompute(groupsX, groupsY, 1);
+						glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R8);
+						gpuProfiler.end();
+					});
+			}
+
+			// Occlusion sampled by the passes shading the opaque scene
+			const auto bindAmbientOcclusion = [&]()
+			{
+				if (ambientOcclusion)
+				{
+					glState.bindTexture(
+						AMBIENT_OCCLUSION_UNIT,
 						GL_TEXTURE_2D,
-						0);
-					glUniform3f(
-						emissiveFactorLocation,
-						0,
+						frameGraph.texture(occlusion));
+					glState.bindTexture(
+						AMBIENT_OCCLUSION_UNIT + 1,
+						GL_TEXTURE_2D,
+						frameGraph.texture(halfDepth));
+					glState.bindSampler(AMBIENT_OCCLUSION_UNIT, 0);
+					glState.bindSampler(AMBIENT_OCCLUSION_UNIT + 1, 0);
+				}
+			};
+
+			// Shade the pixels of the visibility buffer, one pass over the
+			// viewport per bin with the vertex buffer and textures of its
+			// draws. Depths are those of the visibility pass, or of closer
+			// draws shaded forward over them by the opaque pass.
+			if (visibility)
+			{
+				frameGraph.addPass(
+					"Visibility resolve",
+					[&](FrameGraph::PassBuilder &pass)
+					{
+						if (ambientOcclusion)
+						{
+							pass.read(occlusion);
+							pass.read(halfDepth);
+						}
+						pass.read(visibilityTarget);
+						pass.write(scene, FrameGraph::Access::Attachment);
+						pass.sideEffect();
+					},
+					[&]()
+					{
+						gpuProfiler.begin("Visibility resolve");
+						bindAmbientOcclusion();
+						const auto &program = *glslVisibilityResolveProgram;
+						glState.useProgram(program.glId());
+						program.setUniform(
+							"uUseSHIrradiance",
+							int(featureEnvironment && featureSHIrradiance));
+						program.setUniform("uAmbientOcclusion", int(ambientOcclusion));
+						program.setUniform(
+							"uShortIndices",
+							int(geometry.indexType == GL_UNSIGNED_SHORT));
+						program.setUniform("uZeroToOneDepth", int(reversedZ));
+						glState.bindTexture(
+							VISIBILITY_UNIT,
+							GL_TEXTURE_2D,
+							visibilityBuffer.texture());
+						glState.bindSampler(VISIBILITY_UNIT, 0);
+						glBindBufferBase(
+							GL_SHADER_STORAGE_BUFFER,
+							VISIBILITY_INDICES_BINDING,
+							bufferObjects.back());
+
+						glState.setEnabled(GL_DEPTH_TEST, false);
+						glState.bindVertexArray(m_quadVAO);
+						glState.setEnabled(GL_CLIP_DISTANCE0, false);
+						for (size_t bin = 0; bin < visibilityBins.size(); ++bin)
+						{
+							const auto &visibilityBin = visibilityBins[bin];
+							const auto &format =
+								geometry.vertexBuffers[visibilityBin.vertexBuffer].format;
+							glm::ivec4 attributes[4];
+							const int attributeIndices[] = {
+								VERTEX_ATTRIBUTE_POSITION,
+								VERTEX_ATTRIBUTE_NORMAL,
+								VERTEX_ATTRIBUTE_TEXCOORD0,
+								VERTEX_ATTRIBUTE_TANGENT};
+							for (size_t a = 0; a < 4; ++a)
+							{
+								attributes[a] =
+									pulledVertexAttribute(format.attributes[attributeIndices[a]]);
+							}
+							glBindBufferBase(
+								GL_SHADER_STORAGE_BUFFER,
+								VISIBILITY_VERTICES_BINDING,
+								bufferObjects[visibilityBin.vertexBuffer]);
+							program.setUniform("uVertexStride", GLint(format.stride));
+							glProgramUniform4iv(
+								program.glId(),
+								visibilityVertexAttributesLocation,
+								4,
+								glm::value_ptr(attributes[0]));
+							program.setUniform("uVisibilityBin", GLint(bin));
+							if (!bindlessTextures)
+							{
+								bindMaterial(visibilityBin.material);
+							}
+
+							glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+							++frameStats.drawCalls;
+							++frameStats.drawCommands;
+							frameStats.triangles += 2;
+						}
+						glState.setEnabled(GL_DEPTH_TEST, true);
+						// the forward passes bind their own program and textures
+						boundPermutation = -1;
+						boundTextureGroup = -1;
+						gpuProfiler.end();
+					});
+			}
+
+			frameGraph.addPass(
+				"Opaque",
+				[&](FrameGraph::PassBuilder &pass)
+				{
+					if (ambientOcclusion)
+					{
+						pass.read(occlusion);
+						pass.read(halfDepth);
+					}
+					pass.write(scene, FrameGraph::Access::Attachment);
+					pass.sideEffect();
+				},
+				[&]()
+				{
+					bindAmbientOcclusion();
+
+					gpuProfiler.begin("Opaque");
+					if (shadingRateValid)
+					{
+						shadingRateImage.begin();
+					}
+					drawCommandBatches(0, firstBlendedCommand, false);
+					if (shadingRateValid)
+					{
+						shadingRateImage.end();
+					}
+					gpuProfiler.end();
+
+					if (depthPrepass)
+					{
+						glState.depthMask(true);
+						glState.depthFunc(depthTest);
+					}
+				});
+
+			// Point clouds over the opaque scene, each group of nodes with
+			// points sized to cover their spacing on screen, or splatted by the
+			// compute rasterizer then resolved over the viewport
+			const auto drawPointNodes = [&]()
+			{
+				glState.setEnabled(GL_PROGRAM_POINT_SIZE, true);
+				glState.setEnabled(GL_CLIP_DISTANCE0, stereo);
+				GLint indirectBuffer = 0;
+				glGetIntegerv(GL_DRAW_INDIRECT_BUFFER_BINDING, &indirectBuffer);
+				glBindBuffer(GL_DRAW_INDIRECT_BUFFER, pointCommands.buffer());
+				// Pixels covered at a w of 1 by a unit of the view
+				const float pixelsPerUnit = 0.5f * tileProjMatrix[1][1]
+					* float(viewportHeight) * pointSizeScale;
+				for (size_t begin = 0; begin < pointDraws.size();)
+				{
+					auto end = begin + 1;
+					while (end < pointDraws.size()
+						&& pointDraws[end].pointEntry == pointDraws[begin].pointEntry
+						&& pointDraws[end].spacingLevel == pointDraws[begin].spacingLevel)
+					{
+						++end;
+					}
+					const auto itemIdx =
+						entries[pointEntries[pointDraws[begin].pointEntry]].item;
+					const auto &item = drawItems[itemIdx];
+					const auto &packed = geometry.primitives[primitiveIndex(item)];
+					const auto material =
+						runtimeModel.primitive(item.mesh, item.primitive).material;
+
+					const auto &program = usePermutation(materialPermutation(material));
+					if (!bindlessTextures
+						&& materialTextureGroup(material) != boundTextureGroup)
+					{
+						bindMaterial(material);
+						boundTextureGroup = materialTextureGroup(material);
+					}
+					const auto &matrix = drawItemMatrices[itemIdx];
+					const float scale = std::max({glm::length(matrix[0]),
+						glm::length(matrix[1]), glm::length(matrix[2])});
+					program.setUniform(
+						"uPointSize",
+						std::exp2(0.5f * float(pointDraws[begin].spacingLevel))
+							* scale * pixelsPerUnit);
+
+					glState.bindVertexArray(vertexArrayObjects[packed.vertexBuffer]);
+					glState.bindVertexBuffer(
+						bufferObjects[packed.vertexBuffer],
 						0,
-						0);
+						geometry.vertexBuffers[packed.vertexBuffer].format.stride);
+					const auto offset = (const GLvoid*) (pointCommands.regionOffset()
+						+ begin * sizeof(DrawElementsIndirectCommand));
+					glMultiDrawElementsIndirect(GL_POINTS, geometry.indexType, offset, GLsizei(end - begin), sizeof(DrawElementsIndirectCommand));
+					++frameStats.drawCalls;
+					frameStats.drawCommands += end - begin;
+					begin = end;
+				}
+				glBindBuffer(GL_DRAW_INDIRECT_BUFFER, GLuint(indirectBuffer));
+				glState.setEnabled(GL_PROGRAM_POINT_SIZE, false);
+			};
+
+			const auto rasterizePointNodes = [&]()
+			{
+				compilePointPrograms();
+				const auto framebufferSize =
+					size_t(viewportWidth) * size_t(viewportHeight) * sizeof(GLuint64);
+				if (pointFramebufferSize < framebufferSize)
+				{
+					pointFramebufferSize = size_t(grownTargetSize(0, viewportWidth))
+						* size_t(grownTargetSize(0, viewportHeight)) * sizeof(GLuint64);
+					if (!pointFramebuffer)
+					{
+						pointFramebuffer.generate();
+					}
+					glBindBuffer(GL_SHADER_STORAGE_BUFFER, pointFramebuffer);
+					glBufferData(
+						GL_SHADER_STORAGE_BUFFER,
+						GLsizeiptr(pointFramebufferSize),
+						nullptr,
+						GL_DYNAMIC_COPY);
+					trackBuffer(
+						GpuMemoryCategory::RenderTargets,
+						pointFramebuffer,
+						pointFramebufferSize);
+					glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+				}
+				const GLuint empty = 0xffffffffu;
+				glBindBuffer(GL_SHADER_STORAGE_BUFFER, pointFramebuffer);
+				glClearBufferSubData(
+					GL_SHADER_STORAGE_BUFFER,
+					GL_R32UI,
+					0,
+					GLsizeiptr(framebufferSize),
+					GL_RED_INTEGER,
+					GL_UNSIGNED_INT,
+					&empty);
+				glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+				glBindBufferBase(
+					GL_SHADER_STORAGE_BUFFER,
+					POINT_FRAMEBUFFER_BINDING,
+					pointFramebuffer);
+				glBindBufferRange(
+					GL_SHADER_STORAGE_BUFFER,
+					POINT_JOBS_BINDING,
+					pointJobs.buffer(),
+					pointJobs.regionOffset(),
+					GLsizeiptr(pointDraws.size() * sizeof(PointJob)));
+				glBindBufferBase(
+					GL_SHADER_STORAGE_BUFFER,
+					POINT_INDICES_BINDING,
+					bufferObjects.back());
+				glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+				const auto &program = *glslPointRasterizeProgram;
+				glState.useProgram(program.glId());
+				program.setUniform(
+					"uShortIndices",
+					int(geometry.indexType == GL_UNSIGNED_SHORT));
+				program.setUniform(
+					"uViewportSize",
+					glm::ivec2(viewportWidth, viewportHeight));
+				program.setUniform("uReversedZ", int(reversedZ));
+				program.setUniform("uLightDirection", lightDirection);
+				// Jobs of a vertex buffer are consecutive, see drawScene
+				for (size_t begin = 0; begin < pointDraws.size();)
+				{
+					const auto &packed = geometry.primitives[primitiveIndex(
+						drawItems[entries[pointEntries[pointDraws[begin].pointEntry]].item])];
+					GLuint pointCount = 0;
+					auto end = begin;
+					while (end < pointDraws.size())
+					{
+						const auto &other = geometry.primitives[primitiveIndex(
+							drawItems[entries[pointEntries[pointDraws[end].pointEntry]].item])];
+						if (other.vertexBuffer != packed.vertexBuffer)
+						{
+							break;
+						}
+						pointCount += geometry.pointNodes[pointDraws[end].node].indexCount;
+						++end;
+					}
+
+					const auto &format = geometry.vertexBuffers[packed.vertexBuffer].format;
+					glm::ivec4 attributes[2];
+					const int attributeIndices[] = {
+						VERTEX_ATTRIBUTE_POSITION,
+						VERTEX_ATTRIBUTE_NORMAL};
+					for (size_t a = 0; a < 2; ++a)
+					{
+						attributes[a] =
+							pulledVertexAttribute(format.attributes[attributeIndices[a]]);
+					}
+					glBindBufferBase(
+						GL_SHADER_STORAGE_BUFFER,
+						POINT_VERTICES_BINDING,
+						bufferObjects[packed.vertexBuffer]);
+					program.setUniform("uVertexStride", GLint(format.stride));
+					glProgramUniform4iv(
+						program.glId(),
+						pointVertexAttributesLocation,
+						2,
+						glm::value_ptr(attributes[0]));
+					program.setUniform("uFirstJob", GLint(begin));
+					program.setUniform("uJobCount", GLint(end - begin));
+					program.setUniform("uPointCount", GLint(pointCount));
+					glDispatchCompute(
+						(pointCount + POINT_RASTERIZE_GROUP_SIZE - 1)
+							/ POINT_RASTERIZE_GROUP_SIZE,
+						1,
+						1);
+					begin = end;
+				}
+				glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+				const auto &resolveProgram = *glslPointResolveProgram;
+				glState.useProgram(resolveProgram.glId());
+				resolveProgram.setUniform("uViewportWidth", GLint(viewportWidth));
+				resolveProgram.setUniform("uReversedZ", int(reversedZ));
+				resolveProgram.setUniform("uLightRadiance", lightRadiance);
+				glState.bindVertexArray(m_quadVAO);
+				glState.setEnabled(GL_CLIP_DISTANCE0, false);
+				glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+				++frameStats.drawCalls;
+				++frameStats.drawCommands;
+				frameStats.triangles += 2;
+				// the forward passes bind their own program
+				boundPermutation = -1;
+			};
+
+			if (!pointDraws.empty())
+			{
+				frameGraph.addPass(
+					"Points",
+					[&](FrameGraph::PassBuilder &pass)
+					{
+						pass.write(scene, FrameGraph::Access::Attachment);
+						pass.sideEffect();
+					},
+					[&]()
+					{
+						gpuProfiler.begin("Points");
+						if (pointRasterizer)
+						{
+							rasterizePointNodes();
+						}
+						else
+						{
+							drawPointNodes();
+						}
+						gpuProfiler.end();
+					});
+			}
+
+			// Impostors of the distant objects, over the opaque scene with
+			// the points, one instance of the quad each
+			const auto drawImpostors = [&]()
+			{
+				const auto &program = *glslImpostorProgram;
+				glState.useProgram(program.glId());
+				program.setUniform("uViewProjMatrix", viewProjMatrix);
+				program.setUniform("uEye", eye);
+				program.setUniform("uUseSHIrradiance", int(featureEnvironment));
+				glBindBufferRange(
+					GL_SHADER_STORAGE_BUFFER,
+					IMPOSTOR_INSTANCES_BINDING,
+					impostorInstances.buffer(),
+					impostorInstances.regionOffset(),
+					GLsizeiptr(impostorCount * sizeof(ImpostorInstance)));
+				glState.bindTexture(0, GL_TEXTURE_2D_ARRAY, impostorAtlas.albedo());
+				glState.bindSampler(0, 0);
+				glState.bindTexture(1, GL_TEXTURE_2D_ARRAY, impostorAtlas.normals());
+				glState.bindSampler(1, 0);
+				glState.bindVertexArray(m_quadVAO);
+				glState.setEnabled(GL_CLIP_DISTANCE0, false);
+				glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, GLsizei(impostorCount));
+				++frameStats.drawCalls;
+				frameStats.drawCommands += impostorCount;
+				frameStats.triangles += 2 * impostorCount;
+				// the forward passes bind their own program and textures
+				boundPermutation = -1;
+				boundTextureGroup = -1;
+			};
+
+			if (impostorCount > 0)
+			{
+				frameGraph.addPass(
+					"Impostors",
+					[&](FrameGraph::PassBuilder &pass)
+					{
+						pass.write(scene, FrameGraph::Access::Attachment);
+						pass.sideEffect();
+					},
+					[&]()
+					{
+						gpuProfiler.begin("Impostors");
+						drawImpostors();
+						gpuProfiler.end();
+					});
+			}
+
+			frameGraph.addPass(
+				"Skybox",
+				[&](FrameGraph::PassBuilder &pass)
+				{
+					pass.write(scene, FrameGraph::Access::Attachment);
+					pass.sideEffect();
+				},
+				drawSkybox);
+
+			frameGraph.execute();
+
+			// Blended materials over the opaque scene and the skybox, tested
+			// against their depth without writing it. Weighted blended
+			// transparency draws them in any order to the transparency targets,
+			// composited over the scene, sorted blending back to front.
+			if (firstBlendedCommand < commandEntries.size())
+			{
+				gpuProfiler.begin("Transparent");
+				GLint sceneFramebuffer = 0;
+				glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &sceneFramebuffer);
+
+				weightedBlended = !featureSortedBlending;
+				if (weightedBlended)
+				{
+					GLint samples = 0;
+					glGetIntegerv(GL_SAMPLES, &samples);
+					if (transparencyTargets.width() < viewportWidth
+						|| transparencyTargets.height() < viewportHeight
+						|| transparencyTargets.samples() != std::max(samples, 1))
+					{
+						transparencyTargets.init(
+							grownTargetSize(transparencyTargets.width(), viewportWidth),
+							grownTargetSize(
+								transparencyTargets.height(),
+								viewportHeight),
+							samples);
+					}
+					// sorted blending stands in without a depth to share
+					weightedBlended = transparencyTargets.attachDepth();
+				}
+
+				glState.depthMask(false);
+				glState.setEnabled(GL_BLEND, true);
+				if (weightedBlended)
+				{
+					glState.bindFramebuffer(
+						GL_DRAW_FRAMEBUFFER,
+						transparencyTargets.framebuffer());
+					const GLfloat noAccumulation[] = {0, 0, 0, 0};
+					const GLfloat fullRevealage[] = {1, 1, 1, 1};
+					glClearBufferfv(GL_COLOR, 0, noAccumulation);
+					glClearBufferfv(GL_COLOR, 1, fullRevealage);
+					glBlendFunci(0, GL_ONE, GL_ONE);
+					glBlendFunci(1, GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
+				}
+				else
+				{
+					// the velocities stay those of the opaque scene
+					glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+					glColorMaski(1, GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+				}
+
+				drawCommandBatches(firstBlendedCommand, commandEntries.size(), false);
+
+				if (weightedBlended)
+				{
+					glState.bindFramebuffer(GL_DRAW_FRAMEBUFFER, GLuint(sceneFramebuffer));
+					glState.setEnabled(GL_DEPTH_TEST, false);
+					glColorMaski(1, GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+					glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+					glState.useProgram(glslTransparencyCompositeProgram.glId());
+					const bool multisample = transparencyTargets.samples() > 1;
+					const GLenum target = multisample
+						? GL_TEXTURE_2D_MULTISAMPLE
+						: GL_TEXTURE_2D;
+					const GLuint unit = multisample ? 2 : 0;
+					glState.bindTexture(unit, target, transparencyTargets.accumulation());
+					glState.bindTexture(unit + 1, target, transparencyTargets.revealage());
+					glState.bindSampler(unit, 0);
+					glState.bindSampler(unit + 1, 0);
+					glslTransparencyCompositeProgram.setUniform("uAccumulation", 0);
+					glslTransparencyCompositeProgram.setUniform("uRevealage", 1);
+					glslTransparencyCompositeProgram.setUniform("uAccumulationMS", 2);
+					glslTransparencyCompositeProgram.setUniform("uRevealageMS", 3);
+					glslTransparencyCompositeProgram.setUniform(
+						"uSamples",
+						multisample ? transparencyTargets.samples() : 0);
+
+					glState.bindVertexArray(m_quadVAO);
+					glState.setEnabled(GL_CLIP_DISTANCE0, false);
+					glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+					++frameStats.drawCalls;
+					++frameStats.drawCommands;
+					frameStats.triangles += 2;
+					glState.setEnabled(GL_DEPTH_TEST, true);
+				}
+
+				glColorMaski(1, GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+				glState.setEnabled(GL_BLEND, false);
+				glState.depthMask(true);
+				gpuProfiler.end();
+			}
+
+			// Draw every command again over the clicked pixel only, opaque and
+			// blended alike, to a target of its own. Masked materials are
+			// picked whole, conditional commands unconditionally. Batches of
+			// culled meshlets are those of the shading pass.
+			if (pickRequested && !tiled)
+			{
+				pickRequested = false;
+				gpuProfiler.begin("Picking");
+				GLint sceneFramebuffer = 0;
+				glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &sceneFramebuffer);
+
+				const auto pickedX = glm::clamp(
+					GLint(pickPosition.x * float(viewportWidth)),
+					0,
+					viewportWidth - 1);
+				const auto pickedY = glm::clamp(
+					GLint(pickPosition.y * float(viewportHeight)),
+					0,
+					viewportHeight - 1);
+				glState.bindFramebuffer(GL_DRAW_FRAMEBUFFER, picker.framebuffer());
+				glState.viewport(-pickedX, -pickedY, viewportWidth, viewportHeight);
+				glState.depthMask(true);
+				glState.depthFunc(depthTest);
+				picker.clear(reversedZ ? 0.f : 1.f);
+
+				const auto &pickProgram = vertexPulling
+					? *glslPulledPickProgram
+					: glslPickProgram;
+				glState.useProgram(pickProgram.glId());
+				setStereoUniforms(pickProgram);
+				for (size_t batchBegin = 0; batchBegin < commandEntries.size();)
+				{
+					size_t batchEnd = batchBegin + 1;
+					while (!commandConditional[batchBegin]
+						&& batchEnd < commandEntries.size()
+						&& canBatch(batchBegin, batchEnd, !cullMeshlets))
+					{
+						++batchEnd;
+					}
+					drawBatch(batchBegin, batchEnd);
+					batchBegin = batchEnd;
+				}
+				picker.readBack();
+
+				pickEntryItems.resize(entries.size());
+				for (size_t i = 0; i < entries.size(); ++i)
+				{
+					pickEntryItems[i] = entries[i].item;
+				}
+
+				glState.bindFramebuffer(GL_DRAW_FRAMEBUFFER, GLuint(sceneFramebuffer));
+				glState.viewport(0, 0, viewportWidth, viewportHeight);
+				gpuProfiler.end();
+			}
+
+			if (!entries.empty())
+			{
+				glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+				drawTransforms.endRegion();
+				drawCommands.endRegion();
+				if (gpuCulling)
+				{
+					drawEntryItems.endRegion();
+				}
+			}
+			if (visibility)
+			{
+				visibilityDraws.endRegion();
+			}
+			if (!pointDraws.empty())
+			{
+				(pointRasterizer ? pointJobs : pointCommands).endRegion();
+			}
+			if (impostors)
+			{
+				impostorInstances.endRegion();
+			}
+			if (cullMeshlets)
+			{
+				glBindBuffer(GL_PARAMETER_BUFFER_ARB, 0);
+				clusterCommands.endRegion();
+			}
+			if (stereo)
+			{
+				setEyeInstances(false);
+				glState.setEnabled(GL_CLIP_DISTANCE0, false);
+			}
+
+			std::fill(
+				occlusionQueryIssued.begin(),
+				occlusionQueryIssued.end(),
+				0);
+
+			// Test the boxes of the items in the frustum against the depth
+			// buffer of this frame, for the next one
+			if (occlusionCulling)
+			{
+				gpuProfiler.begin("Occlusion queries");
+				glState.useProgram(glslBoundsProgram.glId());
+				glState.colorMask(false);
+				glState.depthMask(false);
+				glState.bindVertexArray(m_unitCubeVAO);
+
+				for (const auto itemIdx : visibleItems)
+				{
+					const auto &bounds = drawItemBounds[itemIdx];
+
+					if (bounds.isEmpty())
+					{
+						continue;
+					}
+
+					const auto center = 0.5f * (bounds.min + bounds.max);
+					const auto extents = 0.5f * (bounds.max - bounds.min);
+					const auto boxMatrix = viewProjMatrix
+						* glm::scale(glm::translate(glm::mat4(1), center), extents);
+
+					glslBoundsProgram.setUniform(
+						boundsModelViewProjMatrixLocation,
+						boxMatrix);
+
+					glBeginQuery(
+						GL_ANY_SAMPLES_PASSED_CONSERVATIVE,
+						occlusionQueries[itemIdx]);
+					glDrawArrays(GL_TRIANGLES, 0, 36);
+					glEndQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE);
+					++frameStats.drawCalls;
+					++frameStats.drawCommands;
+					frameStats.triangles += 12;
+
+					occlusionQueryIssued[itemIdx] = 1;
 				}
 
-				glUniform1i(emissiveTextureLocation, 2);
+				glState.colorMask(true);
+				glState.depthMask(true);
+				gpuProfiler.end();
+			}
 
-				// occlusion
-				if (featureOcclusion)
+			// Depth pyramid of this frame for the GPU culling of the next one
+			const GLuint pyramidDepth = featureOcclusionCulling && gpuCulling && !stereo
+				? drawFramebufferDepthTexture()
+				: 0;
+			depthPyramidValid = pyramidDepth != 0;
+			if (depthPyramidValid)
+			{
+				gpuProfiler.begin("Depth pyramid");
+				if (depthPyramid.width() < viewportWidth
+					|| depthPyramid.height() < viewportHeight)
+				{
+					depthPyramid.init(
+						grownTargetSize(depthPyramid.width(), viewportWidth),
+						grownTargetSize(depthPyramid.height(), viewportHeight));
+				}
+				GLint samples = 0;
+				glGetIntegerv(GL_SAMPLES, &samples);
+				const bool multisample = samples > 1;
+				glState.useProgram(glslDepthPyramidProgram.glId());
+				glState.bindTexture(
+					multisample ? 1 : 0,
+					multisample ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D,
+					pyramidDepth);
+				glState.bindSampler(multisample ? 1 : 0, 0);
+				glslDepthPyramidProgram.setUniform("uDepth", 0);
+				glslDepthPyramidProgram.setUniform("uDepthMS", 1);
+				glslDepthPyramidProgram.setUniform(
+					"uSamples",
+					multisample ? int(samples) : 0);
+				glslDepthPyramidProgram.setUniform("uReversedZ", reversedZ ? 1 : 0);
+
+				const glm::ivec2 sceneSize(viewportWidth, viewportHeight);
+				for (int level = 0; level < depthPyramid.levels(); ++level)
 				{
-					GLuint occlusion = textureObjects[occlusionTexture.index];
+					const auto levelSize = DepthPyramid::levelSize(sceneSize, level);
+					if (level > 0)
+					{
+						glBindImageTexture(
+							0,
+							depthPyramid.texture(),
+							level - 1,
+							GL_FALSE,
+							0,
+							GL_READ_ONLY,
+							GL_R32F);
+						glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+					}
+					glBindImageTexture(
+						1,
+						depthPyramid.texture(),
+						level,
+						GL_FALSE,
+						0,
+						GL_WRITE_ONLY,
+						GL_R32F);
+					glslDepthPyramidProgram.setUniform("uLevel", level);
+					glslDepthPyramidProgram.setUniform(
+						"uSourceSize",
+						level > 0
+							? DepthPyramid::levelSize(sceneSize, level - 1)
+							: sceneSize);
+					glslDepthPyramidProgram.setUniform("uLevelSize", levelSize);
+					glDispatchCompute(
+						GLuint(levelSize.x + 7) / 8,
+						GLuint(levelSize.y + 7) / 8,
+						1);
+				}
+				glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+				glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+				glBindImageTexture(1, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+				depthPyramidViewProjMatrix = viewProjMatrix;
+				depthPyramidSceneSize = sceneSize;
+				depthPyramidReversedZ = reversedZ;
+				gpuProfiler.end();
+			}
+		}
+
+		if (drawnTemporal)
+		{
+			previousProjMatrix = unjitteredProjMatrix;
+			previousViewMatrix = viewMatrix;
+			previousDrawItemMatrices = drawItemMatrices;
+		}
+
+		// Rates of the next frame from the radiance of this one
+		shadingRateSceneSize = glm::ivec2(0);
+		if (shadingRate)
+		{
+			gpuProfiler.begin("Shading rate");
+			if (shadingRateImage.width() < viewportWidth
+				|| shadingRateImage.height() < viewportHeight
+				|| shadingRateImage.samples() != hdrTarget.samples())
+			{
+				shadingRateImage.init(
+					grownTargetSize(shadingRateImage.width(), viewportWidth),
+					grownTargetSize(shadingRateImage.height(), viewportHeight),
+					hdrTarget.samples());
+			}
+			const bool multisample = hdrTarget.samples() > 1;
+			glState.useProgram(glslShadingRateProgram.glId());
+			glState.bindTexture(
+				multisample ? 1 : 0,
+				multisample ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D,
+				hdrTarget.color());
+			glState.bindSampler(multisample ? 1 : 0, 0);
+			glslShadingRateProgram.setUniform("uColor", 0);
+			glslShadingRateProgram.setUniform("uColorMS", 1);
+			glslShadingRateProgram.setUniform(
+				"uSamples",
+				multisample ? hdrTarget.samples() : 0);
+			const glm::ivec2 sceneSize(viewportWidth, viewportHeight);
+			glslShadingRateProgram.setUniform("uViewportSize", sceneSize);
+			glslShadingRateProgram.setUniform(
+				"uTexelSize",
+				ShadingRateImage::texelSize());
+			glslShadingRateProgram.setUniform("uExposure", m_tonemap.exposure);
+			glslShadingRateProgram.setUniform("uThreshold", shadingRateThreshold);
+			glslShadingRateProgram.setUniform("uStereo", stereo ? 1 : 0);
+			glBindImageTexture(
+				0,
+				shadingRateImage.texture(),
+				0,
+				GL_FALSE,
+				0,
+				GL_WRITE_ONLY,
+				GL_R8UI);
+			const auto imageSize = ShadingRateImage::imageSize(sceneSize);
+			glDispatchCompute(GLuint(imageSize.x), GLuint(imageSize.y), 1);
+			// Shading rate images are fetched as textures
+			glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+			glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R8UI);
+			shadingRateSceneSize = sceneSize;
+			gpuProfiler.end();
+		}
+
+		if (tonemapped)
+		{
+			glState.bindFramebuffer(GL_DRAW_FRAMEBUFFER, GLuint(outputFramebuffer));
+			glState.viewport(drawnOrigin.x, drawnOrigin.y, viewportWidth, viewportHeight);
+			drawTonemap(
+				hdrTarget.color(),
+				hdrTarget.samples(),
+				glm::ivec2(viewportWidth, viewportHeight));
+		}
 
-					if (occlusion == 0)
-					{
-						occlusion = whiteTexture;
-					}
+		if (reversedZ)
+		{
+			clipControl(GL_LOWER_LEFT, GL_NEGATIVE_ONE_TO_ONE);
+		}
+		glState.depthFunc(GL_LEQUAL);
+		glState.bindVertexArray(0);
+		glState.setEnabled(GL_FRAMEBUFFER_SRGB, false);
+		frameStats.stateChanges = glState.counters();
+		frameStats.uniformUploads = GLProgram::uniformUploadCount() - uniformUploads;
+		gpuProfiler.end();
+	};
 
-					glActiveTexture(GL_TEXTURE3);
-					glBindTexture(GL_TEXTURE_2D, occlusion);
-					glUniform1f(
-						occlusionStrengthLocation,
-						occlusionTexture.strength);
-				}
-				else
-				{
-					glActiveTexture(GL_TEXTURE3);
-					glBindTexture(GL_TEXTURE_2D, whiteTexture);
-					glUniform1f(
-						occlusionStrengthLocation,
-						1);
-				}
+	// Draw a frame of temporal anti-aliasing to the targets of temporalAA,
+	// resolve it with the history, then tonemap the result to the bound
+	// framebuffer, of the window size or of drawnImageSize. Frames are blended
+	// in linear radiance.
+	const auto drawTemporalFrame = [&](const Camera &camera)
+	{
+		if (temporalAA.width() != GLsizei(m_nWindowWidth)
+			|| temporalAA.height() != GLsizei(m_nWindowHeight))
+		{
+			temporalAA.init(GLsizei(m_nWindowWidth), GLsizei(m_nWindowHeight));
+		}
+		temporalAA.beginFrame(
+			drawnImageSize.x > 0 ? drawnImageSize.x : m_nWindowWidth,
+			drawnImageSize.y > 0 ? drawnImageSize.y : m_nWindowHeight);
+
+		GLint previousFramebuffer = 0;
+		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, temporalAA.framebuffer());
+		drawnTemporal = true;
+		drawScene(camera);
+		drawnTemporal = false;
+
+		// Only written to the history, the output framebuffer covers the frame
+		gpuProfiler.begin("Temporal resolve");
+		glState.bindFramebuffer(GL_DRAW_FRAMEBUFFER, GLuint(previousFramebuffer));
+		glState.setEnabled(GL_DEPTH_TEST, false);
+		glState.colorMask(false);
+		glState.useProgram(glslTemporalResolveProgram.glId());
+		const GLuint inputs[] = {
+			temporalAA.color(),
+			temporalAA.velocity(),
+			temporalAA.depth(),
+			temporalAA.history()};
+		for (GLuint unit = 0; unit < 4; ++unit)
+		{
+			glState.bindTexture(unit, GL_TEXTURE_2D, inputs[unit]);
+			glState.bindSampler(unit, 0);
+		}
+		glslTemporalResolveProgram.setUniform("uColor", 0);
+		glslTemporalResolveProgram.setUniform("uVelocity", 1);
+		glslTemporalResolveProgram.setUniform("uDepth", 2);
+		glslTemporalResolveProgram.setUniform("uHistory", 3);
+		glslTemporalResolveProgram.setUniform(
+			"uReversedZ",
+			int(featureReversedZ && reversedZSupported));
+		glslTemporalResolveProgram.setUniform(
+			"uHistoryValid",
+			int(temporalAA.historyValid()));
+		glslTemporalResolveProgram.setUniform(
+			"uFrameSize",
+			glm::vec2(temporalAA.frameSize()));
+		glslTemporalResolveProgram.setUniform(
+			"uHistorySize",
+			glm::vec2(temporalAA.historySize()));
+		glslTemporalResolveProgram.setUniform(
+			"uFrameWeight",
+			TEMPORAL_AA_FRAME_WEIGHT);
+		glBindImageTexture(
+			0,
+			temporalAA.resolved(),
+			0,
+			GL_FALSE,
+			0,
+			GL_WRITE_ONLY,
+			GL_RGBA16F);
+
+		glState.bindVertexArray(m_quadVAO);
+		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+		++frameStats.drawCalls;
+		++frameStats.drawCommands;
+		frameStats.triangles += 2;
+
+		// the next frame samples the history
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+		glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+		glState.bindVertexArray(0);
+		glState.colorMask(true);
+		gpuProfiler.end();
+
+		drawTonemap(temporalAA.resolved(), 1, temporalAA.frameSize());
+		glState.setEnabled(GL_FRAMEBUFFER_SRGB, false);
+		temporalAA.endFrame();
+	};
 
-				glUniform1i(occlusionTextureLocation, 3);
+	// Review layout of the window: the camera in the top left quarter, then
+	// views of the scene from above, the front and the side. Each view culls
+	// and submits its draws, and writes its own slot of the uniform buffers,
+	// the geometry, materials and poses uploaded once are shared. Views are
+	// drawn without temporal anti-aliasing, dynamic resolution or occlusion
+	// culling, whose state is kept for a single view.
+	const auto drawQuadViews = [&](const Camera &camera)
+	{
+		const GLsizei width = m_nWindowWidth / 2;
+		const GLsizei height = m_nWindowHeight / 2;
+		const auto center = sceneItemBounds.isEmpty()
+			? camera.center()
+			: 0.5f * (sceneItemBounds.min + sceneItemBounds.max);
+		const Camera views[MAX_VIEWS] = {
+			camera,
+			Camera(center + glm::vec3(0, sceneDiagonal, 0), center, glm::vec3(0, 0, -1)),
+			Camera(center + glm::vec3(0, 0, sceneDiagonal), center, glm::vec3(0, 1, 0)),
+			Camera(center + glm::vec3(sceneDiagonal, 0, 0), center, glm::vec3(0, 1, 0))};
+		const glm::ivec2 origins[MAX_VIEWS] = {
+			{0, height}, {width, height}, {0, 0}, {width, 0}};
+
+		// Odd window sizes leave a line between the views
+		glClear(GL_COLOR_BUFFER_BIT);
+
+		// The click picks in the view it fell in
+		const bool picked = pickRequested;
+		const auto clickedPixel =
+			pickPosition * glm::vec2(m_nWindowWidth, m_nWindowHeight);
+		const bool occlusionCulling = featureOcclusionCulling;
+		featureOcclusionCulling = false;
+		for (int i = 0; i < MAX_VIEWS; ++i)
+		{
+			drawnImageSize = glm::ivec2(width, height);
+			drawnOrigin = origins[i];
+			drawnView = i;
+			const auto viewPixel = clickedPixel - glm::vec2(origins[i]);
+			pickRequested = picked
+				&& glm::all(glm::greaterThanEqual(viewPixel, glm::vec2(0)))
+				&& glm::all(glm::lessThan(viewPixel, glm::vec2(width, height)));
+			if (pickRequested)
+			{
+				pickPosition = viewPixel / glm::vec2(width, height);
+			}
+			drawScene(views[i]);
+		}
+		featureOcclusionCulling = occlusionCulling;
+		pickRequested = false;
+		drawnImageSize = glm::ivec2(0);
+		drawnOrigin = glm::ivec2(0);
+		drawnView = 0;
+	};
 
-				// normal map
-				if (featureNormal)
-				{
-					glActiveTexture(GL_TEXTURE4);
-					glBindTexture(
-						GL_TEXTURE_2D,
-						textureObjects[normalTexture.index]);
-					glUniform1f(
-						normalScaleLocation,
-						normalTexture.scale);
-				}
-				else
-				{
-					glActiveTexture(GL_TEXTURE4);
-					glBindTexture(GL_TEXTURE_2D, greyTexture);
-					glUniform1f(normalScaleLocation, 1);
-				}
+	// Equirectangular panorama around the eye of camera, to the bound
+	// framebuffer of the window size. The faces of m_captureViews are drawn
+	// one after the other with a 90 degree projection, the uploads of the
+	// first shared by the others, then resolved to the cube map of
+	// panoramaTargets that is projected to the image. Bloom and the tonemap
+	// apply to the panorama, they would show the seams of the faces.
+	// frameStats sums the faces.
+	const auto drawPanorama = [&](const Camera &camera)
+	{
+		GLint outputFramebuffer = 0;
+		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &outputFramebuffer);
+		const bool tonemapped = !drawFramebufferIsFloat();
+		GLint samples = 0;
+		glGetIntegerv(GL_SAMPLES, &samples);
+		const GLsizei faceSize = std::max(GLsizei(m_nWindowWidth) / 4, 1);
+		if (panoramaTargets.faceSize() != faceSize
+			|| panoramaTargets.samples() != std::max(samples, 1)
+			|| panoramaTargets.width() != GLsizei(m_nWindowWidth)
+			|| panoramaTargets.height() != GLsizei(m_nWindowHeight))
+		{
+			panoramaTargets.init(
+				faceSize,
+				samples,
+				GLsizei(m_nWindowWidth),
+				GLsizei(m_nWindowHeight));
+		}
 
-				glUniform1i(normalTextureLocation, 4);
+		// The faces keep the planes of the window projection, and have no
+		// occlusion history of their own
+		const auto windowProjMatrix = projMatrix;
+		projMatrix = glm::perspective(
+			glm::radians(90.f),
+			1.f,
+			projMatrix[3][2] / (projMatrix[2][2] - 1.f),
+			projMatrix[3][2] / (projMatrix[2][2] + 1.f));
+		const bool occlusionCulling = featureOcclusionCulling;
+		featureOcclusionCulling = false;
+		drawnImageSize = glm::ivec2(faceSize);
+
+		FrameStats faceStats;
+		const auto eye = camera.eye();
+		for (int face = 0; face < 6; ++face)
+		{
+			const auto &view = m_captureViews[face];
+			const glm::vec3 front = -glm::vec3(view[0][2], view[1][2], view[2][2]);
+			const glm::vec3 up(view[0][1], view[1][1], view[2][1]);
+			glState.bindFramebuffer(
+				GL_DRAW_FRAMEBUFFER,
+				panoramaTargets.faceFramebuffer());
+			drawScene(Camera(eye, eye + front, up));
+			panoramaTargets.resolveFace(face);
+
+			faceStats.drawCalls += frameStats.drawCalls;
+			faceStats.drawCommands += frameStats.drawCommands;
+			faceStats.triangles += frameStats.triangles;
+			faceStats.drawnPrimitives += frameStats.drawnPrimitives;
+			faceStats.culledPrimitives += frameStats.culledPrimitives;
+			faceStats.stateChanges.programBinds += frameStats.stateChanges.programBinds;
+			faceStats.stateChanges.vertexArrayBinds += frameStats.stateChanges.vertexArrayBinds;
+			faceStats.stateChanges.textureBinds += frameStats.stateChanges.textureBinds;
+			faceStats.stateChanges.samplerBinds += frameStats.stateChanges.samplerBinds;
+			faceStats.stateChanges.otherChanges += frameStats.stateChanges.otherChanges;
+			faceStats.uniformUploads += frameStats.uniformUploads;
+			faceStats.uploadedBytes += frameStats.uploadedBytes;
+		}
+		frameStats = faceStats;
+		drawnImageSize = glm::ivec2(0);
+		featureOcclusionCulling = occlusionCulling;
+		projMatrix = windowProjMatrix;
+
+		gpuProfiler.begin("Panorama");
+		glState.bindFramebuffer(
+			GL_DRAW_FRAMEBUFFER,
+			tonemapped
+				? panoramaTargets.imageFramebuffer()
+				: GLuint(outputFramebuffer));
+		glState.viewport(0, 0, m_nWindowWidth, m_nWindowHeight);
+		glState.setEnabled(GL_DEPTH_TEST, false);
+		glState.useProgram(glslPanoramaProgram.glId());
+		glState.bindTexture(0, GL_TEXTURE_CUBE_MAP, panoramaTargets.cubeMap());
+		glState.bindSampler(0, 0);
+		glslPanoramaProgram.setUniform("uCubeMap", 0);
+
+		glState.bindVertexArray(m_quadVAO);
+		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+		++frameStats.drawCalls;
+		++frameStats.drawCommands;
+		frameStats.triangles += 2;
+
+		glState.bindVertexArray(0);
+		glState.setEnabled(GL_DEPTH_TEST, true);
+		gpuProfiler.end();
+
+		if (tonemapped)
+		{
+			glState.bindFramebuffer(GL_DRAW_FRAMEBUFFER, GLuint(outputFramebuffer));
+			drawTonemap(
+				panoramaTargets.image(),
+				1,
+				glm::ivec2(m_nWindowWidth, m_nWindowHeight));
+			glState.setEnabled(GL_FRAMEBUFFER_SRGB, false);
+		}
+	};
 
-				// environment map
-				if (featureEnvironment)
-				{
-					// irradiance map
-					glActiveTexture(GL_TEXTURE5);
-					glBindTexture(
-						GL_TEXTURE_CUBE_MAP,
-						irradianceMap);
+	// Path trace camera to the bound framebuffer of the window size, adding
+	// samples to pathTracer until m_pathTrace is reached. One sample is in
+	// flight at a time so that the time budget is spent on the GPU, not in
+	// queued work. The average is tonemapped as drawScene does.
+	const auto drawPathTrace = [&](const Camera &camera)
+	{
+		GLint outputFramebuffer = 0;
+		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &outputFramebuffer);
+		const bool tonemapped = !drawFramebufferIsFloat();
 
-					// prefilter map
-					glActiveTexture(GL_TEXTURE6);
-					glBindTexture(
-						GL_TEXTURE_CUBE_MAP,
-						prefilterMap);
+		updatePathTraceScene();
 
-					// brdf lut
-					glActiveTexture(GL_TEXTURE7);
-					glBindTexture(
-						GL_TEXTURE_2D,
-						brdfLUT);
-				}
-				else
-				{
-					// irradiance map
-					glActiveTexture(GL_TEXTURE5);
-					glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+		const GLsizei width = m_nWindowWidth;
+		const GLsizei height = m_nWindowHeight;
+		pathTracer.reset(width, height);
 
-					// prefilter map
-					glActiveTexture(GL_TEXTURE6);
-					glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+		// Rays through the pixels of projMatrix
+		const auto viewMatrix = camera.getViewMatrix();
+		const glm::vec3 right(viewMatrix[0][0], viewMatrix[1][0], viewMatrix[2][0]);
+		const glm::vec3 up(viewMatrix[0][1], viewMatrix[1][1], viewMatrix[2][1]);
+		const glm::vec3 front(-viewMatrix[0][2], -viewMatrix[1][2], -viewMatrix[2][2]);
+
+		const auto &program = *glslPathTraceProgram;
+		glState.useProgram(program.glId());
+		glState.bindTexture(0, GL_TEXTURE_CUBE_MAP, envTexture);
+		glState.bindSampler(0, 0);
+		for (GLuint i = 0; i < pathTraceArrays.size(); ++i)
+		{
+			glState.bindTexture(1 + i, GL_TEXTURE_2D_ARRAY, pathTraceArrays[i]);
+			glState.bindSampler(1 + i, 0);
+		}
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MATERIALS_BINDING, materialBuffer);
+		glBindBufferBase(
+			GL_SHADER_STORAGE_BUFFER,
+			PUNCTUAL_LIGHTS_BINDING,
+			punctualLightsSSBO);
+		pathTracer.bindBuffers(PATH_TRACE_NODES_BINDING);
+		glBindImageTexture(
+			0,
+			pathTracer.accumulation(),
+			0,
+			GL_FALSE,
+			0,
+			GL_READ_WRITE,
+			GL_RGBA32F);
+		glBindImageTexture(
+			1,
+			pathTracer.average(),
+			0,
+			GL_FALSE,
+			0,
+			GL_WRITE_ONLY,
+			GL_RGBA32F);
+
+		program.setUniform("uImageSize", glm::ivec2(width, height));
+		program.setUniform("uBounces", m_pathTrace.bounces);
+		program.setUniform("uEye", camera.eye());
+		program.setUniform("uFront", front);
+		program.setUniform("uRight", right / projMatrix[0][0]);
+		program.setUniform("uUp", up / projMatrix[1][1]);
+		program.setUniform(
+			"uLightDirection",
+			glm::normalize(lightFromCamera ? camera.getDirection() : lightDirectionRaw));
+		program.setUniform("uLightRadiance", lightRadiance);
+		program.setUniform("uLightCount", int(punctualLights.size()));
+		program.setUniform("uEnvironmentMap", 0);
+		program.setUniform("uEnvironmentLighting", int(featureEnvironment));
+		program.setUniform("uRayOffset", 1e-4f * sceneDiagonal);
+
+		gpuProfiler.begin("Path trace");
+		const auto start = std::chrono::steady_clock::now();
+		GLsync previousSample = nullptr;
+		for (;;)
+		{
+			program.setUniform("uSample", pathTracer.samples());
+			glDispatchCompute(GLuint(width + 7) / 8, GLuint(height + 7) / 8, 1);
+			glMemoryBarrier(
+				GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT
+				| GL_FRAMEBUFFER_BARRIER_BIT);
+			pathTracer.addSample();
+
+			const auto sample = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			if (previousSample)
+			{
+				glClientWaitSync(
+					previousSample,
+					GL_SYNC_FLUSH_COMMANDS_BIT,
+					GL_TIMEOUT_IGNORED);
+				glDeleteSync(previousSample);
+			}
+			previousSample = sample;
 
-					// brdf lut
-					glActiveTexture(GL_TEXTURE7);
-					glBindTexture(GL_TEXTURE_2D, 0);
-				}
+			const auto seconds = std::chrono::duration<float>(
+				std::chrono::steady_clock::now() - start).count();
+			if ((m_pathTrace.samples > 0 && pathTracer.samples() >= m_pathTrace.samples)
+				|| (m_pathTrace.seconds > 0 && seconds >= m_pathTrace.seconds))
+			{
+				break;
+			}
+		}
+		glDeleteSync(previousSample);
+		gpuProfiler.end();
+		std::clog << "Path traced " << pathTracer.samples()
+			<< " samples per pixel in "
+			<< std::chrono::duration<float>(
+				std::chrono::steady_clock::now() - start).count()
+			<< " s\n";
+
+		frameStats = FrameStats{};
+		frameStats.drawCommands = size_t(pathTracer.samples());
+		glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+		glBindImageTexture(1, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+
+		glState.bindFramebuffer(GL_DRAW_FRAMEBUFFER, GLuint(outputFramebuffer));
+		glState.viewport(0, 0, width, height);
+		if (tonemapped)
+		{
+			drawTonemap(pathTracer.average(), 1, glm::ivec2(width, height));
+			glState.setEnabled(GL_FRAMEBUFFER_SRGB, false);
+		}
+		else
+		{
+			glState.bindFramebuffer(
+				GL_READ_FRAMEBUFFER,
+				pathTracer.averageFramebuffer());
+			glBlitFramebuffer(
+				0, 0, width, height,
+				0, 0, width, height,
+				GL_COLOR_BUFFER_BIT,
+				GL_NEAREST);
+			glState.bindFramebuffer(GL_READ_FRAMEBUFFER, GLuint(outputFramebuffer));
+		}
+	};
 
-				glUniform1i(irradianceTextureLocation, 5);
-				glUniform1i(prefilterTextureLocation, 6);
-				glUniform1i(brdfLUTLocation, 7);
+	// Draw a frame of the window to the bound framebuffer, at the resolution
+	// dynamicResolution picks for targetFrameMs if enabled, then upscaled to
+	// the window size before the GUI is drawn over it. The measured GPU time
+	// includes the upscale.
+	const auto drawWindowFrame = [&](const Camera &camera)
+	{
+		if (featureQuadViews)
+		{
+			drawQuadViews(camera);
+			return;
+		}
 
-				return;
+		// Eyes have no history of their own
+		// Targets of the exact window size wait for a resize to settle
+		const bool temporal =
+			featureTemporalAA && !featureStereo && !windowResizing;
+		if (!featureDynamicResolution || windowResizing)
+		{
+			if (temporal)
+			{
+				drawTemporalFrame(camera);
+			}
+			else
+			{
+				drawScene(camera);
 			}
+			return;
 		}
 
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, whiteTexture);
-		glUniform1i(baseColorLocation, 0);
+		if (dynamicResolution.width() != GLsizei(m_nWindowWidth)
+			|| dynamicResolution.height() != GLsizei(m_nWindowHeight))
+		{
+			dynamicResolution.init(
+				GLsizei(m_nWindowWidth),
+				GLsizei(m_nWindowHeight));
+		}
+		dynamicResolution.beginFrame(targetFrameMs);
+		drawnImageSize = dynamicResolution.renderSize();
 
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, 0);
-		glUniform1i(metallicRoughnessTextureLocation, 1);
-		glUniform4f(baseColorFactorLocation, 1, 1, 1, 1);
-		glUniform1f(metallicFactorLocation, 0);
-		glUniform1f(roughnessFactorLocation, 0);
+		GLint previousFramebuffer = 0;
+		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, dynamicResolution.framebuffer());
+		if (temporal)
+		{
+			drawTemporalFrame(camera);
+		}
+		else
+		{
+			drawScene(camera);
+		}
+		drawnImageSize = glm::ivec2(0);
+
+		gpuProfiler.begin("Upscale");
+		glState.bindFramebuffer(GL_DRAW_FRAMEBUFFER, GLuint(previousFramebuffer));
+		glState.viewport(0, 0, m_nWindowWidth, m_nWindowHeight);
+		glState.setEnabled(GL_DEPTH_TEST, false);
+		glState.setEnabled(GL_FRAMEBUFFER_SRGB, true);
+		glState.useProgram(glslUpscaleProgram.glId());
+		glState.bindTexture(0, GL_TEXTURE_2D, dynamicResolution.color());
+		glState.bindSampler(0, 0);
+		glslUpscaleProgram.setUniform("uColor", 0);
+		glslUpscaleProgram.setUniform(
+			"uImageSize",
+			glm::vec2(dynamicResolution.renderSize()));
+		glslUpscaleProgram.setUniform("uSharpness", upscaleSharpness);
+
+		glState.bindVertexArray(m_quadVAO);
+		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+		++frameStats.drawCalls;
+		++frameStats.drawCommands;
+		frameStats.triangles += 2;
+
+		glState.bindVertexArray(0);
+		glState.setEnabled(GL_FRAMEBUFFER_SRGB, false);
+		glState.setEnabled(GL_DEPTH_TEST, true);
+		gpuProfiler.end();
+		dynamicResolution.endFrame();
+	};
 
-		glActiveTexture(GL_TEXTURE2);
-		glBindTexture(GL_TEXTURE_2D, 0);
-		glUniform3f(emissiveFactorLocation, 0, 0, 0);
+	// Keep the frame drawn to the window, resolved from its samples, for
+	// drawCachedFrame to draw again under the GUI while nothing the scene
+	// shows changes. Both copy the encoded values of the window as they are,
+	// GL_FRAMEBUFFER_SRGB disabled.
+	const auto cacheWindowFrame = [&]()
+	{
+		const glm::ivec2 windowSize(m_nWindowWidth, m_nWindowHeight);
+		if (!frameCacheFramebuffer || frameCacheSize != windowSize)
+		{
+			frameCacheSize = windowSize;
+			frameCacheColor.generate();
+			glBindTexture(GL_TEXTURE_2D, frameCacheColor);
+			glTexStorage2D(
+				GL_TEXTURE_2D,
+				1,
+				GL_RGBA8,
+				m_nWindowWidth,
+				m_nWindowHeight);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glBindTexture(GL_TEXTURE_2D, 0);
+			trackTexture(
+				GpuMemoryCategory::RenderTargets,
+				GL_TEXTURE_2D,
+				frameCacheColor);
+			frameCacheFramebuffer.generate();
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, frameCacheFramebuffer);
+			glFramebufferTexture(
+				GL_DRAW_FRAMEBUFFER,
+				GL_COLOR_ATTACHMENT0,
+				frameCacheColor,
+				0);
+			glState.invalidate();
+		}
 
-		glActiveTexture(GL_TEXTURE3);
-		glBindTexture(GL_TEXTURE_2D, 0);
-		glUniform1f(occlusionStrengthLocation, 1);
+		glState.setEnabled(GL_FRAMEBUFFER_SRGB, false);
+		glState.bindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+		glState.bindFramebuffer(GL_DRAW_FRAMEBUFFER, frameCacheFramebuffer);
+		glBlitFramebuffer(
+			0, 0, m_nWindowWidth, m_nWindowHeight,
+			0, 0, m_nWindowWidth, m_nWindowHeight,
+			GL_COLOR_BUFFER_BIT,
+			GL_NEAREST);
+		glState.bindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	};
 
-		glActiveTexture(GL_TEXTURE4);
-		glBindTexture(GL_TEXTURE_2D, greyTexture);
-		glUniform1f(normalScaleLocation, 1);
+	const auto drawCachedFrame = [&]()
+	{
+		gpuProfiler.begin("Cached frame");
+		glState.bindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+		glState.viewport(0, 0, m_nWindowWidth, m_nWindowHeight);
+		glState.setEnabled(GL_DEPTH_TEST, false);
+		glState.setEnabled(GL_FRAMEBUFFER_SRGB, false);
+		glState.useProgram(glslUpscaleProgram.glId());
+		glState.bindTexture(0, GL_TEXTURE_2D, frameCacheColor);
+		glState.bindSampler(0, 0);
+		glslUpscaleProgram.setUniform("uColor", 0);
+		glslUpscaleProgram.setUniform(
+			"uImageSize",
+			glm::vec2(m_nWindowWidth, m_nWindowHeight));
+		glslUpscaleProgram.setUniform("uSharpness", 0.f);
+
+		glState.bindVertexArray(m_quadVAO);
+		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+		++frameStats.drawCalls;
+		++frameStats.drawCommands;
+		frameStats.triangles += 2;
+
+		glState.bindVertexArray(0);
+		glState.setEnabled(GL_DEPTH_TEST, true);
+		gpuProfiler.end();
 	};
 
-	// Lambda function to draw the scene
-	const auto drawScene = [&](const Camera &camera)
+	// Wait for the oldest image of the renderer, of the window size
+	const auto readImage = [&](OffscreenRenderer &renderer, ImageData &image)
 	{
-		glViewport(0, 0, m_nWindowWidth, m_nWindowHeight);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		HeapTagScope heapTag(HeapTag::Staging);
+		const auto size = size_t(m_nWindowWidth) * m_nWindowHeight * image.components;
+		if (renderer.hdr())
+		{
+			image.hdrPixels.resize(size);
+			renderer.read(image.hdrPixels.data());
+		}
+		else
+		{
+			image.pixels.resize(size);
+			renderer.read(image.pixels.data());
+		}
+	};
 
-		const auto viewMatrix = camera.getViewMatrix();
+	// The caches were written while loading, the viewer reads them at its
+	// next launches with the same options
+	if (m_bakeCaches)
+	{
+		if (!finishLoading())
+		{
+			return -1;
+		}
 
-		// Environment skybox
-		const auto drawSkybox = [&]()
+		// failed writes were reported by the load and the environment bake
+		bakeOcclusion();
+		bakeVisibleSets();
+		std::vector<fs::path> cacheFiles;
+		if (geometryCacheable)
+		{
+			cacheFiles.push_back(geometryCachePath);
+		}
+		if (!occlusionCachePath.empty())
+		{
+			cacheFiles.push_back(occlusionCachePath);
+		}
+		if (!visibleSetsCachePath.empty())
 		{
-			glActiveTexture(GL_TEXTURE0);
+			cacheFiles.push_back(visibleSetsCachePath);
+		}
 
-			glBindTexture(
-				GL_TEXTURE_CUBE_MAP,
-				envTexture);
+		IblCacheKey iblKey;
+		if (initIblCacheKey(m_cubeMapFilePath, m_iblOptions, iblKey))
+		{
+			cacheFiles.push_back(
+				iblCacheFile(m_AppPath.parent_path() / "cache", iblKey));
+		}
 
-			glUniform1i(skyboxEquirectangularMapLocation, 0);
+		bool cached = true;
+		for (const auto &file : cacheFiles)
+		{
+			if (fs::exists(file))
+			{
+				std::clog << "Cached " << file.string() << "\n";
+			}
+			else
+			{
+				cached = false;
+			}
+		}
+		return cached ? 0 : -1;
+	}
 
-			glUniformMatrix4fv(
-				skyboxModelProjMatrixLocation,
-				1,
-				GL_FALSE,
-				glm::value_ptr(projMatrix));
+	// Serve the requests for the model and environment until one needs
+	// others, it is put back for the next renderer
+	if (m_jobServer)
+	{
+		RenderJob job;
 
-			glUniformMatrix4fv(
-				skyboxModelViewMatrixLocation,
-				1,
-				GL_FALSE,
-				glm::value_ptr(viewMatrix));
+		if (!finishLoading())
+		{
+			if (m_jobServer->nextJob(job))
+			{
+				m_jobServer->reply(
+					job,
+					"Unable to load " + m_gltfFilePath.string(),
+					false,
+					0);
+			}
 
-			renderCube();
-		};
+			return -1;
+		}
 
-		// The recursive function that should draw a node
-		// We use a std::function because a simple lambda cannot be recursive
-		const std::function<void(int, const glm::mat4 &)> drawNode =
-		[&](int nodeIdx, const glm::mat4 &parentMatrix)
+		// Requests change the image size, the projection keeps the planes
+		// fitted to the scene
+		const float nearPlane = projMatrix[3][2] / (projMatrix[2][2] - 1.f);
+		const float farPlane = projMatrix[3][2] / (projMatrix[2][2] + 1.f);
+		const auto sceneCamera = cameraController->getCamera();
+
+		OffscreenRenderer offscreenRenderer;
+		GLsizei rendererWidth = 0;
+		GLsizei rendererHeight = 0;
+		int rendererSamples = 0;
+		bool rendererHdr = false;
+		bool cached = false; // The first request waited for the loading
+		std::vector<fs::path> upcomingModels;
+
+		while (m_jobServer->nextJob(job))
 		{
-			// TODO The drawNode function
-			tinygltf::Node& node = model.nodes[nodeIdx];
-			glm::mat4 modelMatrix = getLocalToWorldMatrix(
-				node,
-				parentMatrix);
+			if (job.model != m_gltfFilePath
+				|| job.environment != m_cubeMapFilePath)
+			{
+				m_jobServer->putBack(job);
 
-			if (node.mesh >= 0)
+				return 0;
+			}
+
+			// The models of the next renderers load while this job renders
+			if (m_prefetcher)
 			{
-				glm::mat4 modelViewMatrix =
-					viewMatrix * modelMatrix;
-				glm::mat4 modelViewProjectionMatrix =
-					projMatrix * modelViewMatrix;
-				glm::mat4 normalMatrix =
-					glm::inverse(glm::transpose(modelViewMatrix));
-				glm::vec3 lightDirection;
+				upcomingModels.clear();
+				m_jobServer->upcomingModels(upcomingModels);
+				upcomingModels.erase(
+					std::remove(
+						upcomingModels.begin(),
+						upcomingModels.end(),
+						m_gltfFilePath),
+					upcomingModels.end());
+				m_prefetcher->prefetch(upcomingModels);
+			}
 
-				if (lightFromCamera)
+			// GLFW has no timer without a window system
+			const auto start = std::chrono::steady_clock::now();
+
+			m_nWindowWidth = GLsizei(job.width);
+			m_nWindowHeight = GLsizei(job.height);
+			const bool hdr = !job.pixels
+				&& !job.ring
+				&& isHdrImageFormat(imageFormatFromPath(job.output));
+			if (m_nWindowWidth != rendererWidth
+				|| m_nWindowHeight != rendererHeight
+				|| job.samples != rendererSamples
+				|| hdr != rendererHdr)
+			{
+				offscreenRenderer.init(
+					m_nWindowWidth,
+					m_nWindowHeight,
+					job.samples,
+					hdr);
+				rendererWidth = m_nWindowWidth;
+				rendererHeight = m_nWindowHeight;
+				rendererSamples = job.samples;
+				rendererHdr = hdr;
+			}
+			projMatrix = glm::perspective(
+				70.f,
+				float(m_nWindowWidth) / m_nWindowHeight,
+				nearPlane,
+				farPlane);
+			offscreenRenderer.render(
+				[&]()
+				{
+					do
+					{
+						drawScene(job.hasCamera ? job.camera : sceneCamera);
+					}
+					while (refineTextures(true));
+				},
+				job.pixels || job.ring ? 4 : 3);
+
+			// Caller buffers and frame ring slots are read back to directly
+			// from the pixel buffer, without an image
+			std::string error;
+			if (job.pixels)
+			{
+				offscreenRenderer.read(job.pixels);
+			}
+			else if (job.ring)
+			{
+				auto &ring = *m_jobServer->frameRing();
+				offscreenRenderer.read(ring.beginFrame(job.ringFrame));
+				ring.endFrame(
+					job.width,
+					job.height,
+					FRAME_RING_RGBA8,
+					job.id);
+			}
+			else
+			{
+				ImageData image;
+				image.path = job.output;
+				image.width = m_nWindowWidth;
+				image.height = m_nWindowHeight;
+				readImage(offscreenRenderer, image);
+				if (!writeImageFile(image))
 				{
-					lightDirection = glm::normalize(camera.getDirection());
+					error = "Unable to write " + job.output.string();
 				}
-				else
+			}
+
+			// The reply tells whether the image is written
+			m_jobServer->reply(
+				job,
+				error,
+				cached,
+				std::chrono::duration<double, std::milli>(
+					std::chrono::steady_clock::now() - start).count());
+			cached = true;
+		}
+
+		return 0;
+	}
+
+	// Frames along the camera path, or orbiting the scene, are drawn offscreen
+	// as fast as the GPU allows and timed. Nothing is read back.
+	if (m_bench.frames > 0)
+	{
+		if (!finishLoading())
+		{
+			return -1;
+		}
+
+		// One turn at the distance of the default camera, 20 degrees above the
+		// center of the scene
+		const auto center = 0.5f * (bboxMin + bboxMax);
+		const auto radius = glm::length(bboxMax - bboxMin) > 0.f
+			? glm::length(bboxMax - bboxMin)
+			: 1.f;
+		const float elevation = glm::radians(20.f);
+		const auto cameraAt = [&](float t)
+		{
+			if (!m_renderViews.empty())
+			{
+				return cameraPathAt(m_renderViews, t);
+			}
+			const auto angle = glm::two_pi<float>() * t;
+			const auto eye = center +
+				radius * glm::vec3(std::cos(elevation) * std::sin(angle),
+					std::sin(elevation), std::cos(elevation) * std::cos(angle));
+			return Camera{eye, center, glm::vec3(0, 1, 0)};
+		};
+
+		OffscreenRenderer offscreenRenderer;
+		offscreenRenderer.init(m_nWindowWidth, m_nWindowHeight, m_samples);
+
+		// Without swaps nothing bounds how far the CPU runs ahead of the GPU
+		FramePacing pacing;
+		pacing.maxFramesInFlight = 2;
+		FramePacer framePacer;
+		framePacer.init(pacing);
+
+		std::vector<double> cpuTimes;
+		std::vector<double> frameTimes;
+		double drawCalls = 0;
+		double triangles = 0;
+		auto previousStart = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < m_bench.warmupFrames + m_bench.frames; ++i)
+		{
+			// Warmup frames are drawn from the start of the path
+			const auto frame =
+				i < m_bench.warmupFrames ? 0 : i - m_bench.warmupFrames;
+			const bool measured = i >= m_bench.warmupFrames;
+			const auto camera = cameraAt(m_bench.frames > 1
+				? float(frame) / float(m_bench.frames - 1)
+				: 0.f);
+			// Animations advance by a fixed step, so that runs compare
+			updateScene(float(frame) / BENCH_ANIMATION_FPS);
+
+			framePacer.beginFrame();
+			const auto frameStart = std::chrono::steady_clock::now();
+			if (measured && frame > 0)
+			{
+				frameTimes.push_back(std::chrono::duration<double, std::milli>(
+					frameStart - previousStart).count());
+			}
+			previousStart = frameStart;
+
+			if (measured)
+			{
+				gpuProfiler.beginFrame();
+			}
+			offscreenRenderer.render([&]() { drawScene(camera); }, 0);
+			refineTextures(false);
+			if (measured)
+			{
+				gpuProfiler.endFrame();
+				cpuTimes.push_back(msSince(frameStart));
+				drawCalls += double(frameStats.drawCalls);
+				triangles += double(frameStats.triangles);
+			}
+			m_glCapture.endFrame(true);
+			framePacer.endFrame();
+		}
+		gpuProfiler.flush();
+
+		BenchReport report;
+		report.model = m_gltfFilePath.string();
+		report.renderer = reinterpret_cast<const char *>(glGetString(GL_RENDERER));
+		report.width = m_nWindowWidth;
+		report.height = m_nWindowHeight;
+		report.frames = m_bench.frames;
+		report.load = loadTimes;
+		report.cpu = summarizeTimings(cpuTimes);
+		report.frame = summarizeTimings(frameTimes);
+		for (const auto &section : gpuProfiler.sections())
+		{
+			if (section.name == "Scene")
+			{
+				std::vector<double> gpuTimes;
+				for (size_t j = 0; j < section.history.size(); ++j)
 				{
-					lightDirection = glm::normalize(lightDirectionRaw);
+					gpuTimes.push_back(section.history[
+						(section.historyEnd + j) % section.history.size()]);
 				}
+				report.gpu = summarizeTimings(gpuTimes);
+			}
+		}
+		report.averageDrawCalls = drawCalls / double(m_bench.frames);
+		report.averageTriangles = triangles / double(m_bench.frames);
+		report.peakMemory = peakMemoryBytes();
+		report.gpuMemory = m_gpuMemory.usage();
+		queryDriverMemoryInfo(report.driverMemory);
+		report.heapMemory = heapUsage();
+		report.heapSites = heapSites(16);
+
+		std::clog << "GPU time per frame: " << gpuProfiler.summary() << "\n";
+		std::string err;
+		if (!writeBenchReport(report, m_bench.report, err))
+		{
+			std::cerr << err << std::endl;
+			return -1;
+		}
+		return 0;
+	}
+
+	// Frames along the camera path are streamed to an encoder as they are
+	// read back, instead of going through image files
+	if (!m_video.path.empty())
+	{
+		if (!finishLoading())
+		{
+			return -1;
+		}
 
-				glUniformMatrix4fv(
-					modelMatrixLocation,
-					1,
-					GL_FALSE,
-					glm::value_ptr(modelMatrix));
-				glUniformMatrix4fv(
-					modelViewMatrixLocation,
-					1,
-					GL_FALSE,
-					glm::value_ptr(modelViewMatrix));
-				glUniformMatrix4fv(
-					modelViewProjMatrixLocation,
-					1,
-					GL_FALSE,
-					glm::value_ptr(modelViewProjectionMatrix));
-				glUniformMatrix4fv(
-					normalMatrixLocation,
-					1,
-					GL_FALSE,
-					glm::value_ptr(normalMatrix));
-				glUniform3fv(
-					camDirLocation,
-					1,
-					glm::value_ptr(camera.getDirection()));
+		// Without --views, the camera stands still for the duration. Recorded
+		// paths play at their own pace unless --duration is given.
+		auto keyframes = m_renderViews;
+		if (keyframes.empty())
+		{
+			keyframes.push_back(RenderView{cameraController->getCamera(), {}});
+		}
+		const auto duration = m_video.duration > 0
+			? m_video.duration
+			: cameraPathDuration(keyframes);
+		const auto frameCount = duration > 0
+			? std::max(size_t(std::lround(duration * m_video.fps)), size_t(1))
+			: keyframes.size();
+
+		RawVideoWriter video;
+		std::string err;
+		if (!video.open(m_video.path, err))
+		{
+			std::cerr << err << std::endl;
+			return -1;
+		}
+		std::clog << "Writing " << frameCount << " frames, encode with: ffmpeg "
+			<< "-f rawvideo -pix_fmt rgb24 -s " << m_nWindowWidth << "x"
+			<< m_nWindowHeight << " -r " << m_video.fps << " -i "
+			<< m_video.path.string() << " ...\n";
+
+		OffscreenRenderer offscreenRenderer;
+		offscreenRenderer.init(m_nWindowWidth, m_nWindowHeight, m_samples);
+
+		// A frame is read back once the next one is submitted
+		ImageData frame;
+		frame.width = m_nWindowWidth;
+		frame.height = m_nWindowHeight;
+		bool written = true;
+		const auto writeFrame = [&]()
+		{
+			readImage(offscreenRenderer, frame);
+			written = video.write(frame) && written;
+		};
+
+		for (size_t i = 0; i < frameCount && written; ++i)
+		{
+			const auto camera = frameCount > 1
+				? cameraPathAt(keyframes, float(i) / float(frameCount - 1))
+				: keyframes[0].camera;
+			updateScene(float(i) / m_video.fps);
+			offscreenRenderer.render(
+				[&]()
+				{
+					do
+					{
+						drawScene(camera);
+					}
+					while (refineTextures(true));
+				},
+				3);
+
+			if (offscreenRenderer.pendingCount() > 1)
+			{
+				writeFrame();
+			}
+		}
+
+		while (offscreenRenderer.pendingCount() > 0)
+		{
+			writeFrame();
+		}
+
+		if (!video.close() || !written)
+		{
+			std::cerr << "Unable to write video to " << m_video.path.string()
+				<< std::endl;
+			return -1;
+		}
+		return 0;
+	}
+
+	if (!m_OutputPath.empty() || !m_renderViews.empty())
+	{
+		const bool loaded = finishLoading();
+		if (m_viewScheduler)
+		{
+			m_viewScheduler->loaded(m_schedulerRenderer);
+		}
+		if (!loaded)
+		{
+			return -1;
+		}
+
+		// Without --views, the one image is the view of the camera
+		auto views = m_renderViews;
+		if (views.empty())
+		{
+			views.push_back(RenderView{cameraController->getCamera(), m_OutputPath});
+		}
 
-				if (lightDirectionLocation >= 0)
+		// Every view in order, or those the scheduler gives this renderer when
+		// several GPUs share the batch
+		size_t nextViewIndex = 0;
+		const auto nextView = [&](size_t &view)
+		{
+			if (m_viewScheduler)
+			{
+				return m_viewScheduler->next(m_schedulerRenderer, view);
+			}
+			view = nextViewIndex;
+			return nextViewIndex++ < views.size();
+		};
+
+		// Linear values are read back if an image stores them, 8 bits images
+		// of the same run are then encoded on the CPU
+		const bool hdr = std::any_of(
+			views.begin(),
+			views.end(),
+			[](const RenderView &view)
+			{
+				return isHdrImageFormat(imageFormatFromPath(view.output));
+			});
+
+		// Images the GPU cannot render at once are tiled
+		GLint maxTextureSize = 0;
+		GLint maxRenderbufferSize = 0;
+		GLint maxViewportDims[2] = {0, 0};
+		glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+		glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &maxRenderbufferSize);
+		glGetIntegerv(GL_MAX_VIEWPORT_DIMS, maxViewportDims);
+		const auto maxSize = std::min(
+			{maxTextureSize, maxRenderbufferSize, maxViewportDims[0], maxViewportDims[1]});
+		// Panoramas are drawn whole, their faces are smaller than the image,
+		// and path traced images are traced whole
+		const auto tileSize = m_panorama || pathTracing
+			? 0
+			: m_tileSize > 0
+				? std::min(m_tileSize, maxSize)
+				: std::max(m_nWindowWidth, m_nWindowHeight) > GLsizei(maxSize)
+					? std::min(DEFAULT_TILE_SIZE, maxSize)
+					: 0;
+
+		// Tiles are rendered a band across the image at a time, the band is
+		// then written top row first. Memory is bounded by the size of a band,
+		// except for PNG which needs the whole image.
+		if (tileSize > 0)
+		{
+			OffscreenRenderer tileRenderer;
+			tileRenderer.init(tileSize, tileSize, m_samples, hdr);
+
+			const int components = 3;
+			const auto pixelSize = components * (hdr ? sizeof(float) : 1);
+			const int columns = (m_nWindowWidth + tileSize - 1) / tileSize;
+			const int bands = (m_nWindowHeight + tileSize - 1) / tileSize;
+			std::vector<unsigned char> tilePixels(size_t(tileSize) * tileSize * pixelSize);
+			std::vector<unsigned char> bandPixels(
+				size_t(m_nWindowWidth) * tileSize * pixelSize);
+
+			size_t failed = 0;
+			size_t tiledViews = 0;
+			for (size_t viewIndex = 0; nextView(viewIndex); ++tiledViews)
+			{
+				const auto &view = views[viewIndex];
+				ImageRowWriter writer;
+				bool written = writer.open(
+					view.output,
+					m_nWindowWidth,
+					m_nWindowHeight,
+					components);
+
+				for (int band = 0; written && band < bands; ++band)
 				{
-					glUniform3f(lightDirectionLocation,
-						lightDirection[0],
-						lightDirection[1],
-						lightDirection[2]);
+					// Bands go down from the top, the last one may extend below
+					// the image
+					const int y = m_nWindowHeight - (band + 1) * tileSize;
+					for (int column = 0; column < columns; ++column)
+					{
+						drawnTile = glm::ivec4(column * tileSize, y, tileSize, tileSize);
+						tileRenderer.render(
+							[&]()
+							{
+								do
+								{
+									drawScene(view.camera);
+								}
+								while (refineTextures(true));
+							},
+							components);
+					}
+
+					// Rows of the read back tiles are bottom first
+					const int bandRows = std::min(tileSize, m_nWindowHeight - band * tileSize);
+					for (int column = 0; column < columns; ++column)
+					{
+						tileRenderer.read(tilePixels.data());
+						const int x = column * tileSize;
+						const int tileColumns = std::min(tileSize, m_nWindowWidth - x);
+						for (int row = 0; row < bandRows; ++row)
+						{
+							std::memcpy(
+								&bandPixels[(size_t(row) * m_nWindowWidth + x) * pixelSize],
+								&tilePixels[size_t(tileSize - 1 - row) * tileSize * pixelSize],
+								tileColumns * pixelSize);
+						}
+					}
+
+					written = hdr
+						? writer.write((const float *)bandPixels.data(), bandRows)
+						: writer.write(bandPixels.data(), bandRows);
 				}
 
-				if (lightRadianceLocation >= 0)
+				written = writer.close() && written;
+				if (!written)
 				{
-					glUniform3f(lightRadianceLocation,
-						lightRadiance[0],
-						lightRadiance[1],
-						lightRadiance[2]);
+					std::cerr << "Unable to write " << view.output.string() << std::endl;
+					++failed;
 				}
 			}
+			drawnTile = glm::ivec4(0);
+
+			std::clog << "Rendered " << tiledViews << " views in "
+				<< columns * bands << " tiles of " << tileSize << " pixels\n";
+
+			return failed > 0 ? -1 : 0;
+		}
+
+		OffscreenRenderer offscreenRenderer;
+		offscreenRenderer.init(m_nWindowWidth, m_nWindowHeight, m_samples, hdr);
+
+		// An image is read back once the next one is submitted, and encoded
+		// by the pool while the GPU renders the following views
+		ImageWriterPool imageWriters;
+		std::deque<size_t> pendingViews;
+		const auto writeImage = [&]()
+		{
+			ImageData image;
+			image.path = views[pendingViews.front()].output;
+			pendingViews.pop_front();
+			image.width = m_nWindowWidth;
+			image.height = m_nWindowHeight;
+			readImage(offscreenRenderer, image);
+			imageWriters.submit(std::move(image));
+		};
+
+		size_t renderedViews = 0;
+		for (size_t viewIndex = 0; nextView(viewIndex); ++renderedViews)
+		{
+			const auto &view = views[viewIndex];
+			const auto viewStart = std::chrono::steady_clock::now();
+			const auto viewAllocations = heapAllocationCount();
+			gpuProfiler.beginFrame();
+			offscreenRenderer.render(
+				[&]()
+				{
+					// stream in the levels the view needs before the final frame,
+					// path traced images are traced once over it
+					do
+					{
+						if (m_panorama)
+						{
+							drawPanorama(view.camera);
+						}
+						else
+						{
+							drawScene(view.camera);
+						}
+					}
+					while (refineTextures(true));
+					if (pathTracing)
+					{
+						drawPathTrace(view.camera);
+					}
+					// the resolve and the copy to the pixel buffer follow
+					gpuProfiler.begin("Readback");
+				},
+				3);
+			gpuProfiler.endFrame();
+			pendingViews.push_back(viewIndex);
+			frameStats.heapAllocations = heapAllocationCount() - viewAllocations;
+			if (frameStatsLog.isOpen())
+			{
+				frameStatsLog.write(
+					viewIndex,
+					std::chrono::duration<double, std::milli>(
+						std::chrono::steady_clock::now() - viewStart).count(),
+					frameStats);
+			}
 
-			tinygltf::Mesh& mesh = model.meshes[node.mesh];
-			struct VaoRange& range = meshIndexToVaoRange[node.mesh];
-
-			for (size_t i = 0; i < range.count; ++i)
+			if (offscreenRenderer.pendingCount() > 1)
 			{
-				bindMaterial(mesh.primitives[i].material);
-				glBindVertexArray(vertexArrayObjects[range.begin + i]);
-				tinygltf::Primitive& primitive = mesh.primitives[i];
-
-				if (primitive.indices >= 0)
-				{
-					const auto& accessor = model.accessors[primitive.indices];
-					const auto& bufferView = model.bufferViews[accessor.bufferView];
-					const auto byteOffset = bufferView.byteOffset + accessor.byteOffset;
-
-					glDrawElements(primitive.mode, accessor.count, accessor.componentType, (const GLvoid*) byteOffset);
-				}
-				else
-				{
-					const auto accessorIdx = (*begin(primitive.attributes)).second;
-					const auto &accessor = model.accessors[accessorIdx];
-
-					glDrawArrays(primitive.mode, 0, accessor.count);
-				}
+				writeImage();
 			}
-		};
+		}
 
-		// Draw the scene referenced by gltf file
-		if (model.defaultScene >= 0)
+		while (offscreenRenderer.pendingCount() > 0)
 		{
-			// Draw skybox
-			glslSkyboxProgram.use();
-			drawSkybox();
-
-			// Draw all nodes
-			glslProgram.use();
+			writeImage();
+		}
 
-			for (size_t i = 0; i < model.scenes[model.defaultScene].nodes.size(); ++i)
-			{
-				drawNode(model.scenes[model.defaultScene].nodes[i], glm::mat4(1));
-			}
+		if (renderedViews > 1)
+		{
+			std::clog << "Rendered " << renderedViews << " views\n";
 		}
+		gpuProfiler.flush();
+		std::clog << "GPU time per view: " << gpuProfiler.summary() << "\n";
 
-		glBindVertexArray(0);
-	};
+		return imageWriters.wait() > 0 ? -1 : 0;
+	}
 
-	if (!m_OutputPath.empty())
-	{
-		const auto strPath = m_OutputPath.string();
-		std::vector<unsigned char> pixels(m_nWindowWidth * m_nWindowHeight * 3, 0);
+  // Frames still drawn after the last change, for ImGui to catch up with the
+  // input and occlusion culling with the camera
+  int settleFrames = ON_DEMAND_SETTLE_FRAMES;
+  // GUI frames still built after the last input for it, see buildGui
+  int guiSettleFrames = GUI_SETTLE_FRAMES;
+  double guiBuildSeconds = 0.;
+
+  // The camera is updated by ticks of CAMERA_TICK_SECONDS, as many as the time
+  // since the last one covers, from input accumulated by the GLFW callbacks:
+  // its motion no longer depends on the frame time, and a drag moves it even
+  // when no full tick has elapsed
+  double cameraTickTime = glfwGetTime();
+  const auto updateCamera = [&](bool guiHasFocus) {
+    auto input = m_GLFWHandle.takeCameraInput();
+    const auto now = glfwGetTime();
+    auto ticks = int((now - cameraTickTime) / CAMERA_TICK_SECONDS);
+    cameraTickTime += ticks * CAMERA_TICK_SECONDS;
+    if (ticks > CAMERA_MAX_TICKS) {
+      ticks = CAMERA_MAX_TICKS;
+      cameraTickTime = now;
+    }
+    if (guiHasFocus) {
+      return false;
+    }
+    bool moved = false;
+    for (int i = 0; i < std::max(ticks, 1); ++i) {
+      moved = cameraController->update(
+                  input, i < ticks ? float(CAMERA_TICK_SECONDS) : 0.f) ||
+              moved;
+      input.clearDrags();
+    }
+    return moved;
+  };
+
+  // Camera of every frame since the recording started, with its time, to
+  // play back with --views in bench and --video
+  bool recordingPath = false;
+  double recordingStart = 0;
+  std::vector<RenderView> recordedPath;
+  char recordedPathFile[256] = "camera_path.json";
+  const auto saveRecordedPath = [&]() {
+    recordingPath = false;
+    std::string err;
+    if (!saveRenderViews(recordedPathFile, recordedPath, err)) {
+      std::cerr << err << std::endl;
+      return;
+    }
+    std::clog << "Recorded " << recordedPath.size() << " cameras to "
+              << recordedPathFile << "\n";
+  };
+
+  // Environments switched to once the scene is drawn are baked over frames,
+  // with at most ENVIRONMENT_BAKE_BUDGET_MS of GPU time per frame, while the
+  // current maps stay bound. Their image is read by a job, the new maps
+  // replace the current ones between two frames once the GPU is done.
+  struct EnvironmentRead
+  {
+    fs::path path;
+    EnvironmentImage image;
+    bool read = false;
+  };
+  std::shared_ptr<EnvironmentRead> environmentRead;
+  JobSystem::Group environmentReadGroup;
+  std::unique_ptr<EnvironmentBake> environmentSwitch;
+  GLsync environmentFence = nullptr;
+  GpuTimeSlicer environmentSlicer(ENVIRONMENT_BAKE_BUDGET_MS);
+
+  // HDR files next to the environment, and those opened since
+  std::vector<fs::path> environmentFiles;
+  const auto addEnvironmentFile = [&](const fs::path &path) {
+    if (std::find(begin(environmentFiles), end(environmentFiles), path) ==
+        end(environmentFiles)) {
+      environmentFiles.push_back(path);
+    }
+  };
+  if (!m_cubeMapFilePath.empty()) {
+    try {
+      const auto directory = m_cubeMapFilePath.has_parent_path()
+                                 ? m_cubeMapFilePath.parent_path()
+                                 : fs::path(".");
+      for (const auto &entry : fs::directory_iterator(directory)) {
+        auto extension = entry.path().extension().string();
+        std::transform(begin(extension), end(extension), begin(extension),
+            [](unsigned char c) { return char(std::tolower(c)); });
+        if (extension == ".hdr") {
+          environmentFiles.push_back(
+              m_cubeMapFilePath.has_parent_path()
+                  ? entry.path()
+                  : entry.path().filename());
+        }
+      }
+    } catch (const fs::filesystem_error &) {
+    }
+    std::sort(begin(environmentFiles), end(environmentFiles));
+    addEnvironmentFile(m_cubeMapFilePath);
+  }
 
-		renderToImage(
-			m_nWindowWidth,
-			m_nWindowHeight,
-			3,
-			pixels.data(),
-			[&]()
-			{
-				drawScene(cameraController->getCamera());
-			});
+  const auto cancelEnvironmentSwitch = [&]() {
+    if (environmentRead) {
+      jobs.wait(environmentReadGroup);
+      environmentRead.reset();
+    }
+    if (environmentFence) {
+      glDeleteSync(environmentFence);
+      environmentFence = nullptr;
+    }
+    environmentSwitch.reset();
+  };
+  const auto replaceEnvironmentMaps =
+      [&](std::unique_ptr<EnvironmentMaps> maps) {
+        m_cubeMapFilePath = maps->cubeMapFile;
+        m_environmentMaps = std::move(maps);
+        useEnvironmentMaps();
+      };
+  // Maps of the cache are used at once, the environment is baked with the
+  // current m_iblOptions otherwise
+  const auto switchEnvironment = [&](const fs::path &path) {
+    cancelEnvironmentSwitch();
+    addEnvironmentFile(path);
+    if (path == m_environmentMaps->cubeMapFile &&
+        m_iblOptions == m_environmentMaps->options) {
+      return;
+    }
+    if (auto maps = loadCachedEnvironmentMaps(path, m_iblOptions)) {
+      replaceEnvironmentMaps(std::move(maps));
+      return;
+    }
+    auto read = std::make_shared<EnvironmentRead>();
+    read->path = path;
+    environmentRead = read;
+    jobs.run(environmentReadGroup, [read]() {
+      read->read = readEnvironmentImage(read->path, read->image);
+    });
+  };
+  // Run the steps of the switch that fit in the budget of this frame
+  const auto advanceEnvironmentSwitch = [&]() {
+    if (environmentRead && environmentReadGroup.done()) {
+      const auto read = std::move(environmentRead);
+      if (read->read) {
+        // The LUT only depends on its size, that of maps shared with other
+        // renderers is not taken from them
+        const bool bakeBrdfLut = m_iblOptions.brdfLutSize !=
+                                     m_environmentMaps->options.brdfLutSize ||
+                                 m_environmentMaps.use_count() > 1;
+        environmentSwitch = startEnvironmentBake(
+            read->path, read->image, m_iblOptions, bakeBrdfLut, 1);
+      } else {
+        std::cerr << "Unable to read environment " << read->path
+                  << std::endl;
+      }
+    }
+    if (!environmentSwitch) {
+      return;
+    }
 
-		flipImageYAxis(
-			m_nWindowWidth,
-			m_nWindowHeight,
-			3,
-			pixels.data());
-
-		stbi_write_png(
-			strPath.c_str(),
-			m_nWindowWidth,
-			m_nWindowHeight,
-			3,
-			pixels.data(),
-			0);
+    auto &bake = *environmentSwitch;
+    if (bake.nextStep < bake.steps.size()) {
+      gpuProfiler.begin("Environment bake");
+      environmentSlicer.beginFrame();
+      while (bake.nextStep < bake.steps.size() &&
+             environmentSlicer.admit(bake.steps[bake.nextStep].cost)) {
+        const auto &step = bake.steps[bake.nextStep++];
+        step.run();
+        bake.doneCost += step.cost;
+      }
+      environmentSlicer.endFrame();
+      gpuProfiler.end();
+      glState.invalidate();
+      if (bake.nextStep == bake.steps.size()) {
+        environmentFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+      }
+      return;
+    }
 
-		return 0;
-	}
+    if (glClientWaitSync(environmentFence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) ==
+        GL_TIMEOUT_EXPIRED) {
+      return;
+    }
+    glDeleteSync(environmentFence);
+    environmentFence = nullptr;
+    replaceEnvironmentMaps(
+        finishEnvironmentBake(bake, m_environmentMaps.get()));
+    environmentSwitch.reset();
+  };
+
+  // Files dropped on the window or typed in the GUI replace the scene, or
+  // are added to it side by side along x, and HDR images replace the
+  // environment. The next scene is run once this frame is done, the camera is
+  // kept unless the scene is replaced.
+  char openedPath[256] = "";
+  char sceneFilePath[256] = "scene.json";
+  const auto changeScene = [&](const fs::path &label,
+                               std::vector<SceneFile> files,
+                               const fs::path &environment, bool keepCamera) {
+    if (keepCamera) {
+      m_hasUserCamera = true;
+      m_userCamera = cameraController->getCamera();
+    } else {
+      m_hasUserCamera = false;
+    }
+    m_nextGltfFilePath = label;
+    m_nextSceneFiles = std::move(files);
+    m_nextCubeMapFilePath = environment;
+    m_sceneChanged = true;
+  };
+  const auto openFiles = [&](const std::vector<std::string> &paths, bool add) {
+    std::vector<SceneFile> files;
+    auto environment = m_cubeMapFilePath;
+    fs::path tileset; // Replaces the scene, its tiles are selected by runScenes
+    for (const auto &path : paths) {
+      auto extension = fs::path(path).extension().string();
+      std::transform(begin(extension), end(extension), begin(extension),
+          [](unsigned char c) { return char(std::tolower(c)); });
+      std::vector<SceneFile> pathFiles;
+      std::string err;
+      if (extension == ".hdr") {
+        environment = path;
+      } else if (isTilesetFile(path)) {
+        tileset = path;
+      } else if (!isSceneFile(path)) {
+        files.push_back(SceneFile{path});
+      } else if (loadSceneFile(path, pathFiles, err)) {
+        files.insert(end(files), begin(pathFiles), end(pathFiles));
+      } else {
+        std::cerr << err << std::endl;
+      }
+    }
+
+    if (!tileset.empty()) {
+      changeScene(tileset, {}, environment, false);
+    } else if (files.empty()) {
+      if (environment != m_cubeMapFilePath) {
+        switchEnvironment(environment);
+      }
+    } else if (add) {
+      const float width = modelReady ? bboxMax.x - bboxMin.x : 0.f;
+      auto sceneFiles = m_sceneFiles;
+      for (size_t i = 0; i < files.size(); ++i) {
+        files[i].translation.x +=
+            modelReady ? bboxMax.x + (0.1f + 1.1f * i) * width : 0.f;
+        sceneFiles.push_back(files[i]);
+      }
+      changeScene(m_gltfFilePath, std::move(sceneFiles), environment, true);
+    } else {
+      const fs::path label =
+          paths.size() == 1 ? fs::path(paths[0]) : files[0].path;
+      changeScene(label, std::move(files), environment, false);
+    }
+  };
 
-  // Loop until the user closes the window
-  for (auto iterationCount = 0u; !m_GLFWHandle.shouldClose();
-       ++iterationCount) {
+  if (m_GLFWHandle.setVSync(m_framePacing.vsync) != m_framePacing.vsync) {
+    std::clog << "Adaptive VSync not supported, using VSync\n";
+  }
+  FramePacer framePacer;
+  framePacer.init(m_framePacing);
+
+  // Edited PBR shaders are rebuilt in the background, in every variant
+  // compiled so far, the scene drawing with the previous ones meanwhile and if
+  // the edit does not build
+  FileWatcher shaderWatcher;
+  shaderWatcher.watchDirectory(m_ShadersRootPath / m_AppName);
+
+  // Playback of the animation in the window, seeked from the GUI
+  bool animationPlaying = true;
+  bool animationSeeked = false;
+  float animationSpeed = 1.f;
+  float animationTime = 0.f;
+  double previousFrameSeconds = glfwGetTime();
+  float averageFrameMs = 0.f;
+  const auto animationName = [&](size_t animation) {
+    return animations.name(animation).empty()
+               ? "Animation " + std::to_string(animation)
+               : animations.name(animation);
+  };
+
+  // A scene opened from the GUI that fails to load leaves the window open,
+  // with the environment, to open another one
+  bool loadFailed = false;
+
+  // Files of the scene rewritten on disk, as by an exporter keeping the viewer
+  // in sync, are reloaded in place when the change allows: an image file is
+  // decoded again and replaces the textures sampling it, a glTF file whose
+  // new version only has other materials replaces them. Other changes load
+  // the scene again, keeping the camera and the environment. Files are known
+  // once parsed, images only in scenes of a single glTF file.
+  struct ModelReload
+  {
+    fs::path path;
+    tinygltf::Model model;
+    bool loaded = false;
+  };
+  FileWatcher sceneWatcher;
+  bool sceneWatched = false;
+  std::map<fs::path, std::vector<int>> imageFiles; // Images read from each
+  std::shared_ptr<ModelReload> modelReload;
+  JobSystem::Group modelReloadGroup;
+  const auto watchSceneFiles = [&]() {
+    sceneWatched = true;
+    sceneWatcher.watchFile(m_gltfFilePath);
+    for (const auto &file : m_sceneFiles) {
+      sceneWatcher.watchFile(file.path);
+    }
+    if (loadFailed) {
+      return;
+    }
+    for (const auto &path : sceneSourceFiles) {
+      sceneWatcher.watchFile(path);
+    }
+    if (m_sceneFiles.size() != 1 || m_sceneFiles[0].hasTransform()) {
+      return;
+    }
+    const auto directory = m_sceneFiles[0].path.parent_path();
+    for (size_t i = 0; i < model.images.size(); ++i) {
+      const auto &uri = model.images[i].uri;
+      if (!uri.empty() && uri.compare(0, 5, "data:") != 0) {
+        const auto path = gltfUriPath(directory, uri);
+        imageFiles[path].push_back(int(i));
+        sceneWatcher.watchFile(path);
+      }
+    }
+  };
+  const auto reloadScene = [&]() {
+    changeScene(m_gltfFilePath, m_sceneFiles, m_cubeMapFilePath, true);
+  };
+  // Start reloading the changed files, return true if there are any
+  const auto reloadSceneFiles = [&](const std::vector<fs::path> &changed) {
+    if (changed.empty()) {
+      return false;
+    }
+    for (const auto &path : changed) {
+      std::clog << "Reloading " << path << "\n";
+    }
+    const bool loaded = texturesReady && !loadFailed;
+    // The streamer owns the textures it streams
+    if (loaded && !textureStreaming &&
+        std::all_of(begin(changed), end(changed),
+            [&](const fs::path &path) { return imageFiles.count(path) > 0; })) {
+      for (const auto &path : changed) {
+        for (const auto imageIdx : imageFiles[path]) {
+          ++pendingImageDecodes;
+          jobs.run(imageDecodeGroup, [&, path, imageIdx,
+                                         image = model.images[imageIdx]]() {
+            DecodedImage decoded;
+            decoded.imageIdx = imageIdx;
+            decoded.image = image;
+            decoded.reloaded = true;
+            std::string err;
+            std::string warn;
+            decoded.decoded =
+                loadImageFile(path, imageIdx, decoded.image, err, warn);
+            if (decoded.decoded) {
+              capImageSize(decoded.image, m_maxTextureSize);
+            }
+            decoded.message = err + warn;
+
+            std::lock_guard<std::mutex> lock(decodedImagesMutex);
+            decodedImages.push_back(std::move(decoded));
+          });
+        }
+      }
+      return true;
+    }
+    // A .glb file may have another BIN chunk
+    if (loaded && !modelReload && changed.size() == 1 &&
+        m_sceneFiles.size() == 1 && !m_sceneFiles[0].hasTransform() &&
+        changed[0] == m_sceneFiles[0].path && !isGlbFile(changed[0])) {
+      auto reload = std::make_shared<ModelReload>();
+      reload->path = changed[0];
+      modelReload = reload;
+      jobs.run(modelReloadGroup, [this, reload]() {
+        tinygltf::TinyGLTF loader;
+        GltfBuffers buffers;
+        std::string err;
+        std::string warn;
+        reload->loaded = loadGltfModel(loader, reload->path, reload->model,
+            buffers, err, warn, true, m_gltfParser);
+        if (reload->loaded) {
+          shareSameImageTextures(reload->model);
+        }
+      });
+      return true;
+    }
+    reloadScene();
+    return true;
+  };
+  // Apply the reload of the glTF file once parsed, return true if the scene
+  // changed
+  const auto finishModelReload = [&]() {
+    if (!modelReload || !modelReloadGroup.done()) {
+      return false;
+    }
+    const auto reload = std::move(modelReload);
+    if (!reload->loaded) {
+      // Likely still being written, the next version is reloaded
+      std::cerr << "Unable to reload " << reload->path << std::endl;
+      return false;
+    }
+    if (!sameModelButMaterials(model, reload->model)) {
+      reloadScene();
+      return true;
+    }
+    model.materials = std::move(reload->model.materials);
+    runtimeModel.updateMaterials(model);
+    materialBufferFeatures = -1;
+    std::clog << "Replaced the materials of " << reload->path << "\n";
+    return true;
+  };
+
+  // Heap allocations of the last frame, see heapAllocationsCounted()
+  size_t previousFrameAllocations = 0;
+  // Jobs run by the end of the last frame, and during it
+  JobSystem::Stats jobStats = jobs.stats();
+  JobSystem::Stats frameJobStats;
+
+  // True while loading, animation, programs or textures change what the
+  // scene shows without input
+  const auto sceneChanging = [&]() {
+    return (!texturesReady && !loadFailed) ||
+           (animationPlaying && !animations.empty()) ||
+           sceneTransformsChanged || pbrPrograms.pendingCount() > 0 ||
+           picker.pending() || pendingImageDecodes > 0 || modelReload ||
+           environmentRead || environmentSwitch ||
+           (texturesReady && !textureStreamer.empty() &&
+               textureStreamer.stats().pendingCount > 0);
+  };
+
+  // The scene is drawn again when something it shows may have changed, and
+  // kept once settled: the frames after it draw the kept one under the GUI
+  bool frameCached = false;
+  int frameCacheSettleFrames = ON_DEMAND_SETTLE_FRAMES;
+  Camera previousCamera = cameraController->getCamera();
+  bool guiEdited = false; // Last GUI frame, applied to the next scene frame
+  const auto invalidateFrameCache = [&]() {
+    frameCached = false;
+    frameCacheSettleFrames = featureTemporalAA ? TEMPORAL_AA_SETTLE_FRAMES
+                                               : ON_DEMAND_SETTLE_FRAMES;
+  };
+
+  // Tiles of the camera, loaded once selected twice in a row
+  std::vector<uint32_t> pendingTiles = m_tiles;
+  double nextTileSelectionSeconds = 0.;
+
+  // Loop until the user closes the window or opens another scene
+  for (auto iterationCount = 0u;
+       !m_GLFWHandle.shouldClose() && !m_sceneChanged; ++iterationCount) {
     const auto seconds = glfwGetTime();
+    const auto frameAllocations = heapAllocationCount();
 
-    const auto camera = cameraController->getCamera();
-    drawScene(camera);
+    if (!sceneWatched && (texturesReady || loadFailed)) {
+      watchSceneFiles();
+    }
+    if (pbrPrograms.finishRebuilds() || finishModelReload()) {
+      settleFrames = featureTemporalAA ? TEMPORAL_AA_SETTLE_FRAMES
+                                       : ON_DEMAND_SETTLE_FRAMES;
+      invalidateFrameCache();
+    }
 
-    // GUI code:
-    imguiNewFrame();
+    if (!modelReady && !loadFailed && loadingStage >= LOADING_TEXTURES &&
+        !finishGeometry()) {
+      if (m_sceneCount == 0) {
+        return -1;
+      }
+      loadFailed = true;
+    }
+    if (modelReady && !texturesReady && loadingStage == LOADING_DONE) {
+      finishTextures();
+    }
+
+    // The tiles of a tileset are selected again as the camera moves, the
+    // scene is loaded again with others once the camera rests
+    if (!m_tileset.tiles.empty() && texturesReady &&
+        seconds >= nextTileSelectionSeconds) {
+      nextTileSelectionSeconds = seconds + TILESET_SELECTION_SECONDS;
+      auto tiles = selectTiles(m_tileset, cameraController->getCamera().eye(),
+          tileProjectionScale(projMatrix, m_nWindowHeight),
+          m_tilesetOptions.maxErrorPixels,
+          uint64_t(m_tilesetOptions.budgetMB * 1024 * 1024));
+      if (tiles == m_tiles || tiles != pendingTiles) {
+        pendingTiles = std::move(tiles);
+      } else {
+        m_tiles = std::move(tiles);
+        changeScene(m_gltfFilePath, tileSceneFiles(m_tileset, m_tiles),
+            m_cubeMapFilePath, true);
+      }
+    }
+
+    // The pose is updated while the previous one is drawn, and shown from
+    // the next frame on
+    if (modelReady) {
+      const bool animate =
+          !animations.empty() && (animationPlaying || animationSeeked);
+      if (animate && animationPlaying) {
+        animationTime += float(seconds - previousFrameSeconds) * animationSpeed;
+      }
+      if (animate || dualQuaternionSkinning != skinsDualQuaternion) {
+        beginSceneUpdate(animate ? animationTime : -1.f, false);
+      }
+      animationSeeked = false;
+    }
+    averageFrameMs +=
+        0.05f * (float(seconds - previousFrameSeconds) * 1000.f -
+                    averageFrameMs);
+    previousFrameSeconds = seconds;
+
+    const auto camera = cameraController->getCamera();
+    if (recordingPath) {
+      recordedPath.push_back(
+          RenderView{camera, {}, float(seconds - recordingStart)});
+    }
+    const auto framebufferSize = m_GLFWHandle.framebufferSize();
+    if (framebufferSize.x > 0 && framebufferSize.y > 0 &&
+        framebufferSize != glm::ivec2(m_nWindowWidth, m_nWindowHeight)) {
+      m_nWindowWidth = framebufferSize.x;
+      m_nWindowHeight = framebufferSize.y;
+      // Same vertical field of view, for the new aspect ratio
+      projMatrix[0][0] = projMatrix[1][1] * float(m_nWindowHeight) /
+                         float(m_nWindowWidth);
+      windowResizeSeconds = seconds;
+    }
+    windowResizing =
+        seconds - windowResizeSeconds < WINDOW_RESIZE_SETTLE_SECONDS;
+
+    gpuProfiler.beginFrame();
+    const bool cameraMoved = camera.eye() != previousCamera.eye() ||
+                             camera.center() != previousCamera.center() ||
+                             camera.up() != previousCamera.up();
+    previousCamera = camera;
+    if (!featureFrameReuse || cameraMoved || guiEdited || pickRequested ||
+        windowResizing || sceneChanging()) {
+      invalidateFrameCache();
+    }
+    if (frameCached) {
+      drawCachedFrame();
+    } else {
+      drawWindowFrame(camera);
+      if (featureFrameReuse && --frameCacheSettleFrames <= 0) {
+        cacheWindowFrame();
+        frameCached = true;
+      }
+    }
+    uint32_t pickedDraw = 0;
+    if (picker.poll(pickedDraw)) {
+      pickedItem = pickedDraw > 0 && pickedDraw <= pickEntryItems.size()
+                       ? int(pickEntryItems[pickedDraw - 1])
+                       : -1;
+    }
+    // The GUI may change the animation or the skinning the job reads
+    finishSceneUpdate();
+    if (texturesReady) {
+      refineTextures(false);
+    }
+    advanceEnvironmentSwitch();
+
+    // GUI code. The GUI is rebuilt on input for it, and at
+    // GUI_REFRESH_INTERVAL for the values it shows, its last draw lists are
+    // drawn again in between
+    if (m_GLFWHandle.takeKeyPress(GLFW_KEY_F1)) {
+      m_hideGui = !m_hideGui;
+      guiSettleFrames = GUI_SETTLE_FRAMES;
+    }
+    if (m_GLFWHandle.takeGuiInput(ImGui::GetIO().WantCaptureMouse)) {
+      guiSettleFrames = GUI_SETTLE_FRAMES;
+    }
+    const bool buildGui =
+        !m_hideGui && (guiSettleFrames > 0 ||
+                          seconds - guiBuildSeconds >= GUI_REFRESH_INTERVAL);
+    if (buildGui) {
+      guiSettleFrames = std::max(guiSettleFrames - 1, 0);
+      guiBuildSeconds = seconds;
+      m_GLFWHandle.imguiNewFrame();
 
-    {
       ImGui::Begin("GUI");
       ImGui::Text("Application average %.3f ms/frame (%.1f FPS)",
-          1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+          averageFrameMs, 1000.0f / std::max(averageFrameMs, 1e-3f));
+      ImGui::Text("Primitives: %zu drawn, %zu culled",
+          frameStats.drawnPrimitives, frameStats.culledPrimitives);
+      if (ImGui::CollapsingHeader("Frame statistics")) {
+        const auto &state = frameStats.stateChanges;
+        ImGui::Text("Draw calls: %zu, %zu commands", frameStats.drawCalls,
+            frameStats.drawCommands);
+        ImGui::Text("Triangles: %zu", frameStats.triangles);
+        ImGui::Text("Binds: %zu programs, %zu vertex arrays, %zu textures, "
+                    "%zu samplers",
+            state.programBinds, state.vertexArrayBinds, state.textureBinds,
+            state.samplerBinds);
+        ImGui::Text("Other state changes: %zu", state.otherChanges);
+        ImGui::Text("Uniform uploads: %zu", frameStats.uniformUploads);
+        ImGui::Text("Uploaded: %.1f KB", frameStats.uploadedBytes / 1024.f);
+        if (heapAllocationsCounted()) {
+          // Of the previous frame, this one is not done
+          ImGui::Text("Heap allocations: %zu", previousFrameAllocations);
+        }
+      }
+      if (loadFailed) {
+        ImGui::Text(
+            "Unable to load %s", m_gltfFilePath.filename().string().c_str());
+      } else if (!texturesReady) {
+        const int stage = loadingStage;
+        ImGui::Text("Loading %s: %s...",
+            m_gltfFilePath.filename().string().c_str(),
+            loadingStageNames[stage]);
+        ImGui::ProgressBar(float(stage) / LOADING_DONE);
+      }
+      if (ImGui::CollapsingHeader("Scene")) {
+        // Open and Add take a path in place of a file dialog, files can also
+        // be dropped on the window, with shift held to add them
+        size_t removed = m_sceneFiles.size();
+        for (size_t i = 0; i < m_sceneFiles.size(); ++i) {
+          ImGui::PushID(int(i));
+          if (m_sceneFiles.size() > 1 && ImGui::SmallButton("Remove")) {
+            removed = i;
+          }
+          ImGui::SameLine();
+          ImGui::TextUnformatted(m_sceneFiles[i].path.string().c_str());
+          ImGui::PopID();
+        }
+        if (removed < m_sceneFiles.size()) {
+          auto sceneFiles = m_sceneFiles;
+          sceneFiles.erase(begin(sceneFiles) + removed);
+          changeScene(m_gltfFilePath, std::move(sceneFiles), m_cubeMapFilePath,
+              true);
+        }
+
+        ImGui::InputText("glTF, scene or HDR file", openedPath,
+            sizeof(openedPath));
+        if (ImGui::Button("Open") && openedPath[0]) {
+          openFiles({openedPath}, false);
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Add") && openedPath[0]) {
+          openFiles({openedPath}, true);
+        }
+
+        ImGui::InputText("Scene file", sceneFilePath, sizeof(sceneFilePath));
+        if (ImGui::Button("Save scene")) {
+          std::string err;
+          if (!saveSceneFile(sceneFilePath, m_sceneFiles, err)) {
+            std::cerr << err << std::endl;
+          }
+        }
+      }
+      if (ImGui::CollapsingHeader("Picking")) {
+        if (pickedItem < 0 || size_t(pickedItem) >= drawItems.size()) {
+          ImGui::Text("Click the scene to pick a primitive");
+        } else {
+          const auto &item = drawItems[pickedItem];
+          const auto &node = model.nodes[sceneGraph.node(item.node)];
+          const auto &mesh = model.meshes[item.mesh];
+          ImGui::Text("Node %d: %s", sceneGraph.node(item.node),
+              node.name.c_str());
+          if (item.instance >= 0) {
+            ImGui::Text("Instance %d", item.instance);
+          }
+          ImGui::Text("Mesh %d: %s, primitive %d", item.mesh,
+              mesh.name.c_str(), int(item.primitive));
+          const auto memberCount =
+              geometry.primitives[item.packedPrimitive].memberCount;
+          if (memberCount > 0) {
+            ImGui::Text("Merged with %u primitives", memberCount - 1);
+          }
+          const auto materialIdx = mesh.primitives[item.primitive].material;
+          if (materialIdx < 0) {
+            ImGui::Text("Default material");
+          } else {
+            const auto &material = model.materials[materialIdx];
+            const auto &pbr = material.pbrMetallicRoughness;
+            ImGui::Text("Material %d: %s", materialIdx, material.name.c_str());
+            ImGui::Text("Base color: %.3f %.3f %.3f %.3f, texture %d",
+                pbr.baseColorFactor[0], pbr.baseColorFactor[1],
+                pbr.baseColorFactor[2], pbr.baseColorFactor[3],
+                pbr.baseColorTexture.index);
+            ImGui::Text("Metallic %.3f, roughness %.3f, texture %d",
+                pbr.metallicFactor, pbr.roughnessFactor,
+                pbr.metallicRoughnessTexture.index);
+            ImGui::Text("Emissive: %.3f %.3f %.3f, texture %d",
+                material.emissiveFactor[0], material.emissiveFactor[1],
+                material.emissiveFactor[2], material.emissiveTexture.index);
+            ImGui::Text("Normal texture %d, occlusion texture %d",
+                material.normalTexture.index,
+                material.occlusionTexture.index);
+            ImGui::Text("Alpha mode %s, cutoff %.3f%s",
+                material.alphaMode.c_str(), material.alphaCutoff,
+                material.doubleSided ? ", double sided" : "");
+          }
+        }
+      }
+      if (ImGui::CollapsingHeader("Environment")) {
+        for (const auto &path : environmentFiles) {
+          if (ImGui::Selectable(path.filename().string().c_str(),
+                  path == m_cubeMapFilePath)) {
+            switchEnvironment(path);
+          }
+        }
+        if (environmentSwitch) {
+          const auto &bake = *environmentSwitch;
+          ImGui::ProgressBar(float(bake.doneCost / bake.totalCost),
+              ImVec2(-1, 0), bake.cubeMapFile.filename().string().c_str());
+        } else if (environmentRead) {
+          ImGui::ProgressBar(0, ImVec2(-1, 0),
+              environmentRead->path.filename().string().c_str());
+        }
+
+        // Sizes of the next bake, powers of two. Bake switches to the
+        // environment again, with the maps of the cache if these sizes were
+        // already baked.
+        const auto sizeCombo = [](const char *label, uint32_t &size) {
+          if (ImGui::BeginCombo(label, std::to_string(size).c_str())) {
+            for (uint32_t option = 8; option <= 4096; option *= 2) {
+              if (ImGui::Selectable(
+                      std::to_string(option).c_str(), option == size)) {
+                size = option;
+              }
+            }
+            ImGui::EndCombo();
+          }
+        };
+        sizeCombo("Skybox", m_iblOptions.skyboxSize);
+        sizeCombo("Irradiance", m_iblOptions.irradianceMapSize);
+        sizeCombo("Prefilter", m_iblOptions.prefilterMapSize);
+        sizeCombo("BRDF LUT", m_iblOptions.brdfLutSize);
+        const auto maxLevels =
+            int(std::log2(m_iblOptions.prefilterMapSize)) + 1;
+        auto levels = std::min(int(m_iblOptions.prefilterMapLevels), maxLevels);
+        ImGui::SliderInt("Prefilter levels", &levels, 2, maxLevels);
+        m_iblOptions.prefilterMapLevels = uint32_t(levels);
+        ImGui::Checkbox("Fast bake", &m_iblOptions.fastBake);
+        ImGui::Checkbox("Compress (BC6H)", &m_iblOptions.compressed);
+
+        if (m_environmentMaps && m_environmentMaps->options != m_iblOptions &&
+            ImGui::Button("Bake")) {
+          switchEnvironment(m_cubeMapFilePath);
+        }
+      }
+      if (modelReady && !animations.empty() &&
+          ImGui::CollapsingHeader("Animation")) {
+        if (ImGui::BeginCombo(
+                "Animation", animationName(currentAnimation).c_str())) {
+          for (size_t i = 0; i < animations.size(); ++i) {
+            if (ImGui::Selectable(
+                    animationName(i).c_str(), i == currentAnimation)) {
+              currentAnimation = i;
+              animationTime = 0.f;
+              animationSeeked = true;
+            }
+          }
+          ImGui::EndCombo();
+        }
+        ImGui::Checkbox("Play", &animationPlaying);
+        ImGui::SliderFloat("Speed", &animationSpeed, 0.f, 4.f);
+        const auto duration = animations.duration(currentAnimation);
+        float time = duration > 0.f ? std::fmod(animationTime, duration) : 0.f;
+        if (ImGui::SliderFloat("Time", &time, 0.f, duration, "%.2f s")) {
+          animationTime = time;
+          animationSeeked = true;
+        }
+        ImGui::Text("%zu channels in the model", animations.channelCount());
+      }
       if (ImGui::CollapsingHeader("Camera", ImGuiTreeNodeFlags_DefaultOpen)) {
         ImGui::Text("eye: %.3f %.3f %.3f", camera.eye().x, camera.eye().y,
             camera.eye().z);
@@ -1485,7 +10102,24 @@ int ViewerApplication::run()
              << camera.center().y << "," << camera.center().z << ","
              << camera.up().x << "," << camera.up().y << "," << camera.up().z;
           const auto str = ss.str();
-          glfwSetClipboardString(m_GLFWHandle.window(), str.c_str());
+          m_GLFWHandle.setClipboard(str);
+        }
+
+        ImGui::InputText(
+            "Path file", recordedPathFile, sizeof(recordedPathFile));
+        if (ImGui::Button(
+                recordingPath ? "Stop recording" : "Record camera path")) {
+          if (recordingPath) {
+            saveRecordedPath();
+          } else {
+            recordedPath.clear();
+            recordingStart = seconds;
+            recordingPath = true;
+          }
+        }
+        if (recordingPath) {
+          ImGui::SameLine();
+          ImGui::Text("%zu cameras", recordedPath.size());
         }
 
 		ImGui::Text("Controls type");
@@ -1497,13 +10131,12 @@ int ViewerApplication::run()
 
 			if (controlsType == 0)
 			{
-				cameraController = std::make_unique<TrackballCameraController>(
-					m_GLFWHandle.window());
+				cameraController = std::make_unique<TrackballCameraController>();
 			}
 			else
 			{
-				cameraController = std::make_unique<FirstPersonCameraController>(
-					m_GLFWHandle.window());
+				cameraController =
+					std::make_unique<FirstPersonCameraController>();
 			}
 
 			cameraController->setCamera(oldCamera);
@@ -1523,6 +10156,40 @@ int ViewerApplication::run()
 			ImGui::ColorEdit3("Color#lightColor", (float*) &lightRadiance, 0);
 
 			ImGui::Checkbox("Bind to Camera", &lightFromCamera);
+			ImGui::Checkbox("Shadows", &featureShadows);
+			ImGui::Text(
+				"Shadow cascades redrawn: %zu of %zu",
+				redrawnCascades,
+				shadowCascades.count());
+			ImGui::Text(
+				"Punctual lights: %zu, up to %d per cluster",
+				punctualLights.size(),
+				CLUSTER_MAX_LIGHTS);
+		}
+
+		if (ImGui::CollapsingHeader("Tonemapping"))
+		{
+			static const char *const operatorNames[TONEMAP_OPERATOR_COUNT] = {
+				"None (clamp)",
+				"Reinhard",
+				"ACES Filmic",
+				"PBR Neutral"};
+			int tonemapOperator = int(m_tonemap.op);
+			if (ImGui::Combo(
+				"Operator",
+				&tonemapOperator,
+				operatorNames,
+				TONEMAP_OPERATOR_COUNT))
+			{
+				m_tonemap.op = TonemapOperator(tonemapOperator);
+			}
+			// in stops, the exposure is a scale
+			float exposureStops = std::log2(m_tonemap.exposure);
+			if (ImGui::SliderFloat("Exposure (EV)", &exposureStops, -4.f, 4.f))
+			{
+				m_tonemap.exposure = std::exp2(exposureStops);
+			}
+			ImGui::SliderFloat("Bloom", &m_tonemap.bloom, 0.f, 0.5f);
 		}
 
 		if (ImGui::CollapsingHeader("features"))
@@ -1533,27 +10200,409 @@ int ViewerApplication::run()
 			ImGui::Checkbox("Emission Map", &featureEmission);
 			ImGui::Checkbox("Normal Map", &featureNormal);
 			ImGui::Checkbox("Environment Map", &featureEnvironment);
+			ImGui::Checkbox("SH Irradiance", &featureSHIrradiance);
+			ImGui::Checkbox("Frustum Culling", &featureFrustumCulling);
+			if (featureFrustumCulling)
+			{
+				ImGui::Checkbox("Cull Through Node Hierarchy", &featureNodeCulling);
+			}
+			ImGui::Checkbox("Occlusion Culling", &featureOcclusionCulling);
+			if (!occluderCandidates.empty())
+			{
+				ImGui::Checkbox("Software Occlusion Culling", &featureSoftwareOcclusion);
+				if (featureSoftwareOcclusion)
+				{
+					ImGui::Text("%zu occluders, %zu triangles",
+						frameOccluders.size(),
+						softwareOcclusion.drawnTriangleCount());
+				}
+			}
+			if (!visibleSets.empty())
+			{
+				ImGui::Checkbox("Potentially Visible Sets", &featureVisibleSets);
+			}
+			ImGui::Checkbox("Levels of Detail", &featureLevelsOfDetail);
+			if (!impostorObjectItems.empty())
+			{
+				ImGui::Checkbox("Impostors", &featureImpostors);
+				if (featureImpostors)
+				{
+					ImGui::SliderFloat(
+						"Impostor Pixels",
+						&impostorPixels,
+						0.f,
+						256.f,
+						"%.0f");
+				}
+			}
+			ImGui::Checkbox("Shading LOD", &featureShadingLod);
+			if (featureShadingLod)
+			{
+				ImGui::SliderFloat(
+					"Shading LOD Pixels",
+					&shadingLodPixels,
+					0.f,
+					256.f,
+					"%.0f");
+			}
+			if (meshletsSSBO && clusterDrawCapacity > 0)
+			{
+				ImGui::Checkbox("Meshlet Culling", &featureMeshletCulling);
+			}
+			if (gpuCullingSupported && clusterDrawCapacity > 0)
+			{
+				ImGui::Checkbox("GPU Culling", &featureGpuCulling);
+			}
+			if (visibilityBufferSupported)
+			{
+				ImGui::Checkbox("Visibility Buffer", &featureVisibilityBuffer);
+			}
+			if (pulledVertexArray)
+			{
+				ImGui::Checkbox("Vertex Pulling", &featureVertexPulling);
+			}
+			if (!pointCommands.empty())
+			{
+				ImGui::Checkbox("Point Cloud LOD", &featurePointClouds);
+				if (featurePointClouds)
+				{
+					ImGui::SliderFloat(
+						"Point Budget (millions)",
+						&pointBudgetMillions,
+						0.5f,
+						50.f,
+						"%.1f");
+					ImGui::SliderFloat("Point Size", &pointSizeScale, 0.25f, 4.f);
+					if (pointRasterizerSupported)
+					{
+						ImGui::Checkbox("Compute Point Rasterizer", &featurePointRasterizer);
+					}
+				}
+			}
+			if (wireframeSupported)
+			{
+				ImGui::Checkbox("Wireframe", &featureWireframe);
+			}
+			ImGui::Checkbox("Depth Pre-pass", &featureDepthPrepass);
+			if (m_quality.ambientOcclusion)
+			{
+				ImGui::Checkbox("Ambient Occlusion", &featureAmbientOcclusion);
+			}
+			if (featureAmbientOcclusion)
+			{
+				ImGui::SliderFloat(
+					"AO radius (of the scene)",
+					&ambientOcclusionRadius,
+					0.001f,
+					0.2f,
+					"%.3f",
+					4.f);
+			}
+			ImGui::Checkbox("Sorted Blending", &featureSortedBlending);
+			ImGui::Checkbox("Fitted Depth Range", &featureFittedDepthRange);
+			if (reversedZSupported)
+			{
+				ImGui::Checkbox("Reversed Depth", &featureReversedZ);
+			}
+			if (ImGui::Checkbox("Temporal Anti-aliasing", &featureTemporalAA))
+			{
+				temporalAA.reset();
+			}
+			ImGui::Checkbox("2x2 Views", &featureQuadViews);
+			if (ImGui::Checkbox("Stereo", &featureStereo))
+			{
+				temporalAA.reset();
+			}
+			if (shadingRateSupported)
+			{
+				ImGui::Checkbox("Variable Rate Shading", &featureShadingRate);
+				if (featureShadingRate)
+				{
+					ImGui::SliderFloat(
+						"Coarse shading contrast",
+						&shadingRateThreshold,
+						0.f,
+						0.1f,
+						"%.3f");
+				}
+			}
+			ImGui::Checkbox("Dynamic Resolution", &featureDynamicResolution);
+			ImGui::Checkbox("Reuse Still Frames", &featureFrameReuse);
+			if (featureDynamicResolution)
+			{
+				const auto size = dynamicResolution.renderSize();
+				ImGui::SliderFloat(
+					"Target frame time (ms)",
+					&targetFrameMs,
+					1.f,
+					50.f);
+				ImGui::SliderFloat("Upscale sharpness", &upscaleSharpness, 0.f, 1.f);
+				ImGui::Text(
+					"Scale %.2f, %dx%d, %.2f ms",
+					dynamicResolution.scale(),
+					size.x,
+					size.y,
+					dynamicResolution.lastMs());
+			}
+			ImGui::Checkbox("Dual Quaternion Skinning", &dualQuaternionSkinning);
+			ImGui::Checkbox("Redraw on demand", &m_onDemand);
+		}
+
+		if (texturesReady
+		&& !textureStreamer.empty()
+		&& ImGui::CollapsingHeader("Texture streaming"))
+		{
+			const auto stats = textureStreamer.stats();
+
+			ImGui::Text(
+				"Resident: %.1f / %.1f MB",
+				stats.residentBytes / (1024.f * 1024.f),
+				stats.budgetBytes / (1024.f * 1024.f));
+			ImGui::Text(
+				"Textures: %zu, %zu fully resident, %zu waiting",
+				stats.textureCount,
+				stats.fullyResidentCount,
+				stats.pendingCount);
+			ImGui::Text(
+				"Levels: %zu streamed in, %zu evicted",
+				stats.streamedLevels,
+				stats.evictedLevels);
+		}
+
+		if (ImGui::CollapsingHeader("GPU memory"))
+		{
+			const auto usage = m_gpuMemory.usage();
+			for (size_t i = 0; i < size_t(GpuMemoryCategory::Count); ++i)
+			{
+				ImGui::Text(
+					"%s: %.1f MB",
+					gpuMemoryCategoryName(GpuMemoryCategory(i)),
+					usage.bytes[i] / (1024.f * 1024.f));
+			}
+			ImGui::Text(
+				"Total: %.1f MB in %zu objects",
+				usage.total / (1024.f * 1024.f),
+				usage.objectCount);
+
+			DriverMemoryInfo driverMemory;
+			if (queryDriverMemoryInfo(driverMemory))
+			{
+				if (driverMemory.totalBytes)
+				{
+					ImGui::Text(
+						"Driver: %.1f / %.1f MB available",
+						driverMemory.availableBytes / (1024.f * 1024.f),
+						driverMemory.totalBytes / (1024.f * 1024.f));
+				}
+				else
+				{
+					ImGui::Text(
+						"Driver: %.1f MB available",
+						driverMemory.availableBytes / (1024.f * 1024.f));
+				}
+			}
+		}
+
+		// Live and peak bytes of the global operator new, and where the
+		// sampled ones come from, see setHeapSampling
+		if (heapAllocationsCounted() && ImGui::CollapsingHeader("Host memory"))
+		{
+			const auto usage = heapUsage();
+			for (size_t i = 0; i < size_t(HeapTag::Count); ++i)
+			{
+				ImGui::Text(
+					"%s: %.1f MB, peak %.1f MB",
+					heapTagName(HeapTag(i)),
+					usage.bytes[i] / (1024.f * 1024.f),
+					usage.peakBytes[i] / (1024.f * 1024.f));
+			}
+			ImGui::Text(
+				"Total: %.1f MB in %zu allocations, peak %.1f MB",
+				usage.total / (1024.f * 1024.f),
+				usage.allocationCount,
+				usage.peakTotal / (1024.f * 1024.f));
+
+			if (heapSamplingInterval() && ImGui::TreeNode("Allocation sites"))
+			{
+				const auto sites = heapSites(8);
+				for (size_t i = 0; i < sites.size(); ++i)
+				{
+					const auto &site = sites[i];
+					if (ImGui::TreeNode(
+							(void *)intptr_t(i),
+							"%.1f MB (%s, %zu samples) %s",
+							site.bytes / (1024.f * 1024.f),
+							heapTagName(site.tag),
+							site.sampleCount,
+							site.frames.empty() ? "" : site.frames[0].c_str()))
+					{
+						for (const auto &frame : site.frames)
+						{
+							ImGui::TextUnformatted(frame.c_str());
+						}
+						ImGui::TreePop();
+					}
+				}
+				ImGui::TreePop();
+			}
+		}
+
+		// GPU time of the passes over the last frames, on the scale of the
+		// slowest section so that the graphs compare
+		if (ImGui::CollapsingHeader("GPU profiler", ImGuiTreeNodeFlags_DefaultOpen))
+		{
+			float scaleMs = 1.f;
+			for (const auto &section : gpuProfiler.sections())
+			{
+				for (const auto ms : section.history)
+				{
+					scaleMs = std::max(scaleMs, ms);
+				}
+			}
+
+			for (const auto &section : gpuProfiler.sections())
+			{
+				char overlay[64];
+				std::snprintf(
+					overlay,
+					sizeof(overlay),
+					"%.3f ms (average %.3f)",
+					section.lastMs,
+					section.averageMs);
+				ImGui::Indent(float(section.depth + 1) * 8.f);
+				ImGui::PlotLines(
+					section.name.c_str(),
+					section.history.data(),
+					int(section.history.size()),
+					int(section.historyEnd),
+					overlay,
+					0.f,
+					scaleMs,
+					ImVec2(0, 32));
+				ImGui::Unindent(float(section.depth + 1) * 8.f);
+			}
+
+			// Of the driver, with --gl-debug
+			const auto warnings = glPerformanceWarnings();
+			if (!warnings.empty()
+				&& ImGui::TreeNode("Performance warnings"))
+			{
+				for (const auto &warning : warnings)
+				{
+					ImGui::TextWrapped(
+						"%zux %s %u: %s",
+						warning.count,
+						warning.source.c_str(),
+						warning.id,
+						warning.message.c_str());
+				}
+				ImGui::TreePop();
+			}
+		}
+
+		if (ImGui::CollapsingHeader("Jobs"))
+		{
+			ImGui::Text("Workers: %zu", jobs.workerCount());
+			ImGui::Text(
+				"Last frame: %zu jobs, %zu stolen",
+				frameJobStats.jobsRun,
+				frameJobStats.jobsStolen);
 		}
       }
 
+      // Widgets that change a value mark it edited, buttons change what
+      // sceneChanging() watches or open another scene
+      guiEdited = ImGui::GetCurrentContext()->ActiveIdHasBeenEditedThisFrame;
       ImGui::End();
+      ImGui::Render();
+    } else {
+      guiEdited = false;
     }
 
-    imguiRenderFrame();
+    if (!m_hideGui) {
+      gpuProfiler.begin("ImGui");
+      imguiDrawFrame();
+      gpuProfiler.end();
+    }
+    gpuProfiler.endFrame();
+
+    frameStats.heapAllocations = heapAllocationCount() - frameAllocations;
+    previousFrameAllocations = frameStats.heapAllocations;
+    const auto lastJobStats = jobStats;
+    jobStats = jobs.stats();
+    frameJobStats.jobsRun = jobStats.jobsRun - lastJobStats.jobsRun;
+    frameJobStats.jobsStolen = jobStats.jobsStolen - lastJobStats.jobsStolen;
+    if (frameStatsLog.isOpen()) {
+      frameStatsLog.write(
+          iterationCount, (glfwGetTime() - seconds) * 1000., frameStats);
+    }
 
-    glfwPollEvents(); // Poll for and process events
+    m_glCapture.endFrame(texturesReady && pbrPrograms.pendingCount() == 0 &&
+                         pendingImageDecodes == 0);
+    m_GLFWHandle.swapBuffers(); // Swap front and back buffers
+    // Sample the input of the next frame as late as the limits allow
+    framePacer.endFrame();
+    framePacer.beginFrame();
+
+    auto guiHasFocus = !m_hideGui && (ImGui::GetIO().WantCaptureMouse ||
+                                         ImGui::GetIO().WantCaptureKeyboard);
+    if (settleFrames > 0) {
+      --settleFrames;
+    }
 
-    auto ellapsedTime = glfwGetTime() - seconds;
-    auto guiHasFocus =
-        ImGui::GetIO().WantCaptureMouse || ImGui::GetIO().WantCaptureKeyboard;
-    if (!guiHasFocus) {
-      cameraController->update(float(ellapsedTime));
+    // On demand, wait for events until something changes on screen. Frames
+    // are drawn continuously while the scene loads, programs compile in the
+    // background, textures stream in or the camera path is recorded, so that
+    // it keeps the timing of still cameras.
+    while (!m_GLFWHandle.shouldClose() && !m_sceneChanged) {
+      const bool busy = !m_onDemand || settleFrames > 0 || recordingPath ||
+                        windowResizing || sceneChanging();
+      // Poll for and process events
+      const bool events =
+          busy ? m_GLFWHandle.pollEvents()
+               : m_GLFWHandle.waitEvents(ON_DEMAND_WAIT_TIMEOUT);
+      // The pick is drawn with the next frame and read back a few frames
+      // later
+      glm::dvec2 click;
+      if (m_GLFWHandle.takeClick(click) && !guiHasFocus) {
+        const auto windowSize = glm::max(m_GLFWHandle.windowSize(), 1);
+        pickPosition = glm::vec2(click.x / windowSize.x,
+            1. - click.y / windowSize.y);
+        pickRequested = true;
+      }
+      const auto droppedPaths = m_GLFWHandle.takeDroppedPaths();
+      if (!droppedPaths.empty()) {
+        openFiles(droppedPaths, m_GLFWHandle.keyDown(GLFW_KEY_LEFT_SHIFT) ||
+                                    m_GLFWHandle.keyDown(GLFW_KEY_RIGHT_SHIFT));
+      }
+      const bool moved = updateCamera(guiHasFocus);
+      const bool shadersEdited = pbrPrograms.rebuild(shaderWatcher.poll());
+      const bool sceneEdited = reloadSceneFiles(sceneWatcher.poll());
+      if (events || moved) {
+        // The history of temporal anti-aliasing converges over frames
+        settleFrames = featureTemporalAA ? TEMPORAL_AA_SETTLE_FRAMES
+                                         : ON_DEMAND_SETTLE_FRAMES;
+      }
+      if (busy || events || moved || shadersEdited || sceneEdited) {
+        break;
+      }
     }
+  }
 
-    m_GLFWHandle.swapBuffers(); // Swap front and back buffers
+  if (recordingPath) {
+    saveRecordedPath();
   }
 
-  // TODO clean up allocated GL data
+  // The window may be closed, or another scene opened, before the model is
+  // loaded
+  loadGraph.cancel();
+  joinLoaderThread();
+  cancelEnvironmentSwitch();
+  for (const auto fence : {uploadFence, textureFence}) {
+    if (fence) {
+      glDeleteSync(fence);
+    }
+  }
 
   return 0;
 }
@@ -1561,7 +10610,23 @@ int ViewerApplication::run()
 ViewerApplication::ViewerApplication(const fs::path &appPath, uint32_t width,
     uint32_t height, const fs::path &gltfFile, const fs::path &cubeMapFile,
     const std::vector<float> &lookatArgs, const std::string &vertexShader,
-    const std::string &fragmentShader, const fs::path &output) :
+    const std::string &fragmentShader, const fs::path &output,
+    bool exactBounds, const GeometryOptions &geometryOptions,
+    const TilesetOptions &tilesetOptions, const IblOptions &iblOptions,
+    float textureBudgetMB, bool lazyTextures,
+    int maxTextureSize, bool detailMaps, bool halfPrecision, bool shadingLod,
+    MipFilter mipFilter, GltfParser gltfParser, int samples, bool temporalAA,
+    bool gpuCulling, bool visibilityBuffer, bool vertexPulling,
+    const TonemapOptions &tonemap,
+    int tileSize, bool panorama, const PathTraceOptions &pathTrace,
+    int eglDevice,
+    bool onDemand, bool hideGui, const FramePacing &framePacing,
+    const fs::path &statsCsv,
+    const std::vector<RenderView> &renderViews, const VideoOutput &video,
+    const BenchOptions &bench, const GLCaptureOptions &capture,
+    QualityTier quality, bool bakeCaches, RenderJobSource *jobServer,
+    ViewScheduler *viewScheduler, size_t schedulerRenderer,
+    ModelPrefetcher *prefetcher, SharedGLObjects *sharedObjects) :
     m_nWindowWidth(width),
     m_nWindowHeight(height),
     m_AppPath{appPath},
@@ -1570,7 +10635,45 @@ ViewerApplication::ViewerApplication(const fs::path &appPath, uint32_t width,
     m_ShadersRootPath{m_AppPath.parent_path() / "shaders"},
     m_gltfFilePath{gltfFile},
     m_cubeMapFilePath{cubeMapFile},
-    m_OutputPath{output}
+    m_OutputPath{output},
+    m_renderViews{renderViews},
+    m_video{video},
+    m_bench{bench},
+    m_captureOptions{capture},
+    m_bakeCaches{bakeCaches},
+    m_jobServer{jobServer},
+    m_viewScheduler{viewScheduler},
+    m_schedulerRenderer{schedulerRenderer},
+    m_prefetcher{prefetcher},
+    m_sharedObjects{sharedObjects},
+    m_exactBounds{exactBounds},
+    m_geometryOptions{geometryOptions},
+    m_tilesetOptions{tilesetOptions},
+    m_iblOptions{iblOptions},
+    m_textureBudgetMB{textureBudgetMB},
+    m_lazyTextures{lazyTextures},
+    m_maxTextureSize{maxTextureSize},
+    m_detailMaps{detailMaps},
+    m_halfPrecision{halfPrecision},
+    m_shadingLod{shadingLod},
+    m_mipFilter{mipFilter},
+    m_gltfParser{gltfParser},
+    m_samples{samples},
+    m_quality{qualitySettings(quality)},
+    m_temporalAA{temporalAA},
+    m_gpuCulling{gpuCulling},
+    m_visibilityBuffer{visibilityBuffer},
+    m_vertexPulling{vertexPulling},
+    m_tonemap{tonemap},
+    m_tileSize{tileSize},
+    m_panorama{panorama},
+    m_pathTrace{pathTrace},
+    m_eglDevice{eglDevice},
+    m_onDemand{onDemand},
+    // The GUI looks up attribute locations, not recorded by a capture
+    m_hideGui{hideGui || !capture.path.empty()},
+    m_framePacing{framePacing},
+    m_statsCsvPath{statsCsv}
 {
   if (!lookatArgs.empty()) {
     m_hasUserCamera = true;
@@ -1588,11 +10691,104 @@ ViewerApplication::ViewerApplication(const fs::path &appPath, uint32_t width,
     m_fragmentShader = fragmentShader;
   }
 
-  ImGui::GetIO().IniFilename =
-      m_ImGuiIniFilename.c_str(); // At exit, ImGUI will store its windows
-                                  // positions in this file
-
-  glfwSetKeyCallback(m_GLFWHandle.window(), keyCallback);
+  if (!m_GLFWHandle.headless()) {
+    ImGui::GetIO().IniFilename =
+        m_ImGuiIniFilename.c_str(); // At exit, ImGUI will store its windows
+                                    // positions in this file
+    m_GLFWHandle.setKeyCallback(keyCallback);
+  }
 
   printGLVersion();
+  // Program binaries are those of a driver, a capture compiles the sources
+  if (!m_glCapture.active()) {
+    initProgramCache(m_AppPath.parent_path() / "cache" / "programs");
+  }
+  if (loadParallelShaderCompile()) {
+    std::clog << "Using parallel shader compile\n";
+  }
+}
+
+namespace
+{
+
+// The loop of serveRenderJobs for a renderer. Its contexts are created with
+// setupMutex locked if any, the process-wide GL setup of the constructor
+// running on a thread at a time, and shared with sharedObjects if not null.
+void serveRendererJobs(const fs::path &appPath, int eglDevice,
+    RenderJobSource &jobs, const PrefetchOptions &prefetch,
+    std::mutex *setupMutex, SharedGLObjects *sharedObjects)
+{
+  // A renderer serves the jobs for one model and environment, the first job
+  // for others ends it and starts the next one. The next model is parsed and
+  // decoded while the current one renders, it is uploaded once the previous
+  // renderer released its GPU resources.
+  ModelPrefetcher prefetcher{prefetch};
+  RenderJob job;
+  while (jobs.nextJob(job)) {
+    jobs.putBack(job);
+    const auto taken = jobs.takenCount();
+    std::unique_lock<std::mutex> setup;
+    if (setupMutex) {
+      setup = std::unique_lock<std::mutex>(*setupMutex);
+    }
+    ViewerApplication app{appPath, job.width, job.height, job.model,
+        job.environment, {}, "", "", "", false, {}, {}, {}, 0.f, false, 0,
+        true, false, true, MipFilter::Box, GltfParser::SinglePass, job.samples,
+        false, false, false, false, {}, 0, false, {}, eglDevice, false, false,
+        {}, "", {}, {}, {}, {}, QualityTier::High, false, &jobs, nullptr, 0,
+        &prefetcher, sharedObjects};
+    if (setup) {
+      setup.unlock();
+    }
+    app.run();
+    if (jobs.takenCount() == taken && jobs.nextJob(job)) {
+      jobs.reply(job, "Unable to render " + job.model.string(), false, 0);
+    }
+  }
+}
+
+} // namespace
+
+void serveRenderJobs(const fs::path &appPath, int eglDevice,
+    RenderJobSource &jobs, const PrefetchOptions &prefetch,
+    size_t rendererCount)
+{
+  if (rendererCount <= 1) {
+    serveRendererJobs(appPath, eglDevice, jobs, prefetch, nullptr, nullptr);
+    return;
+  }
+
+  // Each renderer on its own thread and headless context, loading its own
+  // models ahead within its share of the budget. The contexts share objects
+  // with a loader context: the environment maps and geometry buffers a
+  // renderer loads are referenced by the others while any holds them. The
+  // programs are per renderer, their uniforms being state of the program
+  // objects, and are read from the program cache. Framebuffers and the
+  // buffers written by the frames are per renderer too.
+  std::string err;
+  SharedGLObjects sharedObjects;
+  if (!sharedObjects.create(eglDevice, err)) {
+    std::cerr << err << std::endl;
+    throw std::runtime_error(err);
+  }
+  PrefetchOptions rendererPrefetch = prefetch;
+  rendererPrefetch.budgetBytes /= rendererCount;
+  RenderJobPool pool{jobs, rendererCount};
+  std::mutex setupMutex;
+  std::vector<std::thread> renderers;
+  for (size_t i = 0; i < rendererCount; ++i) {
+    renderers.emplace_back([&, i]() {
+      try {
+        serveRendererJobs(appPath, eglDevice, pool.renderer(i),
+            rendererPrefetch, &setupMutex, &sharedObjects);
+      } catch (const std::exception &e) {
+        std::cerr << "Renderer " << i << ": " << e.what() << std::endl;
+      }
+      pool.stopped(i);
+    });
+  }
+  pool.run();
+  for (auto &renderer : renderers) {
+    renderer.join();
+  }
 }
@@ -1,9 +1,34 @@
 #pragma once
 
 #include "utils/GLFWHandle.hpp"
+#include "utils/bench.hpp"
 #include "utils/cameras.hpp"
 #include "utils/filesystem.hpp"
+#include "utils/frame_pacing.hpp"
+#include "utils/gl_capture.hpp"
+#include "utils/gl_objects.hpp"
+#include "utils/geometry_cache.hpp"
+#include "utils/gltf_loader.hpp"
+#include "utils/gltf_scene.hpp"
+#include "utils/ibl_cache.hpp"
+#include "utils/mip_generator.hpp"
+#include "utils/model_prefetcher.hpp"
+#include "utils/packed_geometry.hpp"
+#include "utils/path_tracer.hpp"
+#include "utils/quality_tier.hpp"
+#include "utils/render_server.hpp"
+#include "utils/render_views.hpp"
+#include "utils/rgbe.hpp"
+#include "utils/shared_gl_objects.hpp"
+#include "utils/texture_streamer.hpp"
+#include "utils/tileset.hpp"
+#include "utils/tonemapping.hpp"
+#include "utils/vertex_layout.hpp"
+#include "utils/view_scheduler.hpp"
 #include "utils/shaders.hpp"
+#include "utils/spherical_harmonics.hpp"
+#include <functional>
+#include <memory>
 #include <tiny_gltf.h>
 
 class ViewerApplication
@@ -18,46 +43,379 @@ public:
 	  const std::vector<float> &lookatArgs,
       const std::string &vertexShader,
 	  const std::string &fragmentShader,
-      const fs::path &output);
+      const fs::path &output,
+      bool exactBounds,
+      const GeometryOptions &geometryOptions,
+      const TilesetOptions &tilesetOptions,
+      const IblOptions &iblOptions,
+      float textureBudgetMB,
+      bool lazyTextures,
+      int maxTextureSize,
+      bool detailMaps,
+      bool halfPrecision,
+      bool shadingLod,
+      MipFilter mipFilter,
+      GltfParser gltfParser,
+      int samples,
+      bool temporalAA,
+      bool gpuCulling,
+      bool visibilityBuffer,
+      bool vertexPulling,
+      const TonemapOptions &tonemap,
+      int tileSize,
+      bool panorama,
+      const PathTraceOptions &pathTrace,
+      int eglDevice,
+      bool onDemand,
+      bool hideGui,
+      const FramePacing &framePacing,
+      const fs::path &statsCsv,
+      const std::vector<RenderView> &renderViews,
+      const VideoOutput &video,
+      const BenchOptions &bench,
+      const GLCaptureOptions &capture,
+      QualityTier quality,
+      bool bakeCaches = false,
+      RenderJobSource *jobServer = nullptr,
+      ViewScheduler *viewScheduler = nullptr,
+      size_t schedulerRenderer = 0,
+      ModelPrefetcher *prefetcher = nullptr,
+      SharedGLObjects *sharedObjects = nullptr);
 
+  // Run the scene, then the scenes opened from the GUI or dropped on the
+  // window, until the window is closed
   int run();
 
 private:
-  // A range of indices in a vector containing Vertex Array Objects
-  struct VaoRange
+  // A range of indices in PackedGeometry::primitives
+  struct PrimitiveRange
   {
-    GLsizei begin; // Index of first element in vertexArrayObjects
+    GLsizei begin; // Index of first primitive
     GLsizei count; // Number of elements in range
   };
 
+  // Factors of a material, std430 layout of Material in
+  // pbr_directional_light.fs.glsl. Defaults are the factors of the default
+  // material and of disabled features.
+  struct MaterialData
+  {
+    glm::vec4 baseColorFactor = glm::vec4(1);
+    glm::vec3 emissiveFactor = glm::vec3(0);
+    float metallicFactor = 0;
+    float roughnessFactor = 0;
+    float occlusionStrength = 1;
+    float normalScale = 1;
+    float alphaCutoff = 0; // Of MASK materials, the others pass the test
+    // Base color, metallic roughness, emissive, occlusion and normal texture
+    // handles, only used with bindless textures
+    GLuint64 textureHandles[5] = {};
+    // Layers of the same textures, only used with texture arrays
+    GLuint textureLayers[5] = {};
+    GLuint layersPadding = 0;
+  };
+  static_assert(sizeof(MaterialData) == 112, "MaterialData must match std430");
+
+  // Per draw data, std430 layout of DrawTransform in forward.vs.glsl
+  struct DrawTransform
+  {
+    glm::mat4 modelMatrix;
+    glm::mat4 modelViewProjMatrix;
+    // Of the previous frame, unjittered, for the velocities of temporal
+    // anti-aliasing
+    glm::mat4 previousModelViewProjMatrix;
+    // Inverse transpose of the linear part of modelMatrix, for the normals
+    glm::mat3x4 normalMatrix;
+    GLuint materialIndex;
+    // First joint of the skin in the SkinJoints palette, SKIN_NONE if the
+    // draw is not skinned, with SKIN_DUAL_QUATERNION_BIT for dual quaternions
+    GLuint skinJoints;
+    // Header of the draw in the MorphTargets storage buffer, MorphTargets::NONE
+    // if the draw is not morphed
+    GLuint morphTargets;
+    // PackedVertexBuffer::firstVertexMember of a merged primitive, whose
+    // vertices take the transform of their member in MergedTransforms,
+    // PACKED_MERGE_NONE for the other draws
+    GLuint mergedVertices;
+    // PackedPrimitive::positionDequantize of the primitive
+    glm::vec4 positionDequantize;
+    // Occlusion of the first vertex of the vertex buffer of the primitive in
+    // the buffer texture of OcclusionBaker, BAKED_OCCLUSION_NONE without
+    // baked occlusion
+    GLuint bakedOcclusion;
+    // Index range of the triangles of the draw pulled by the wireframe overlay
+    // without barycentrics, WIREFRAME_NONE for draws drawn without edges
+    GLuint wireframeFirstIndex;
+    GLint wireframeBaseVertex;
+    // Index of the packed vertex buffer of the primitive, whose layout the
+    // wireframe overlay and vertex pulling read
+    GLuint vertexBuffer;
+  };
+
+  // std430 layout of VertexFormat in pbr_directional_light.fs.glsl, the
+  // vertex format of a packed vertex buffer for the wireframe overlay
+  struct PulledVertexFormat
+  {
+    GLint stride;
+    GLint padding[3];
+    // GL component type, component count, offset and whether normalized of
+    // the position, normal, texture coordinates and tangent
+    glm::ivec4 attributes[4];
+  };
+
+  // std430 layout of PulledVertexLayout in forward.vs.glsl, where the
+  // vertices of a packed vertex buffer start in the pulled vertices and how
+  // to read them
+  struct PulledVertexLayout
+  {
+    GLuint firstWord; // Of 4 bytes
+    GLuint stride;
+    GLuint padding[2];
+    // As in PulledVertexFormat, in VertexAttribute order
+    glm::ivec4 attributes[VERTEX_ATTRIBUTE_COUNT];
+  };
+  static_assert(sizeof(PulledVertexLayout) == 112,
+      "PulledVertexLayout must match std430");
+
+  // std430 layout of ShadowItem in shadow.vs.glsl
+  struct ShadowItem
+  {
+    glm::mat4 matrix;
+    GLuint skinJoints; // As in DrawTransform
+    GLuint morphTargets;
+    GLuint mergedVertices;
+    GLuint padding;
+    glm::vec4 positionDequantize;
+  };
+
+  // std430 layout of MergedTransform in forward.vs.glsl and shadow.vs.glsl,
+  // of a member of a merged primitive: the world matrix of its node with the
+  // dequantization of its positions
+  struct MergedTransform
+  {
+    glm::mat4 modelMatrix;
+    glm::mat3x4 normalMatrix;
+  };
+
+  // std140 layout of FrameConstants in pbr_directional_light.fs.glsl, w is
+  // unused
+  struct FrameConstants
+  {
+    glm::vec4 camDir;
+    glm::vec4 lightDirection;
+    glm::vec4 lightIntensity;
+    glm::vec4 clusterDepth;
+    glm::vec4 clusterTiles;
+    glm::vec4 temporalJitter;
+    glm::vec4 inverseDepth;
+  };
+
+  // std140 layout of ShadowCascades in pbr_directional_light.fs.glsl, with
+  // SHADOW_CASCADE_COUNT cascades
+  struct ShadowConstants
+  {
+    glm::mat4 cascadeMatrices[4];
+    glm::vec4 cascadeSplits;
+    glm::vec4 cascadeTexelSizes;
+    glm::vec4 shadowParams;
+  };
+
+  // Layout read by glMultiDrawElementsIndirect
+  struct DrawElementsIndirectCommand
+  {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+  };
+
+  // std430 layout of VisibilityDraw in pbr_directional_light.fs.glsl, the
+  // indices of a draw of the visibility buffer and the resolve pass of its
+  // pixels
+  struct VisibilityDraw
+  {
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint bin;
+    GLuint padding;
+  };
+
+  // Opaque commands of a frame resolved by one pass of the visibility buffer,
+  // sharing a vertex buffer and, without bindless textures, the textures of
+  // material
+  struct VisibilityBin
+  {
+    GLuint vertexBuffer;
+    int textureGroup; // -1 with bindless textures
+    int material;
+  };
+
+  // Octree node of a point cloud considered for a frame, those covering the
+  // most pixels are drawn first, see drawScene
+  struct PointNodeCandidate
+  {
+    float priority;
+    uint32_t pointEntry; // In the point cloud entries of the frame
+    uint32_t node; // In PackedGeometry::pointNodes
+  };
+
+  // Node selected for a frame, whose points and those of the nodes drawn
+  // around it are up to 2^(spacingLevel / 2) apart
+  struct PointNodeDraw
+  {
+    uint32_t pointEntry;
+    uint32_t node;
+    int spacingLevel;
+  };
+
+  // std430 layout of PointJob in points_rasterize.cs.glsl, the points of a
+  // node splatted by the compute rasterizer
+  struct PointJob
+  {
+    GLuint firstIndex;
+    GLuint count;
+    GLint baseVertex;
+    GLuint drawIndex;
+    GLuint firstPoint; // Of the dispatch
+    GLuint padding[3];
+  };
+
+  // std430 layout of ImpostorInstance in impostor.vs.glsl, an object drawn
+  // as an impostor in a frame
+  struct ImpostorInstance
+  {
+    glm::mat4 matrix; // World matrix
+    glm::vec4 sphere; // Bounding sphere of the mesh, in its space
+    glm::uvec4 layer; // Of the atlas in x
+  };
+
+  // std430 layout of DrawBounds in cull_meshlets.cs.glsl, the world bounds of
+  // a draw item
+  struct DrawBounds
+  {
+    glm::vec4 min;
+    glm::vec4 max;
+  };
+
+  // std430 layout of ClusterCommand in cull_meshlets.cs.glsl, a command of
+  // the frame and the range of the culled draws of its batch
+  struct ClusterCommand
+  {
+    GLuint firstJob; // Sum of the jobs of the previous commands
+    // Meshlets culled per instance in PackedGeometry::meshlets, none if the
+    // command is drawn whole
+    GLuint firstMeshlet;
+    GLuint meshletCount;
+    GLuint instanceCount;
+    GLuint count;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+    GLuint batch; // Index of the draw count of the batch
+    GLuint batchOffset; // First draw of the batch in the culled draws
+    // CLUSTER_CONE_CULLING_BIT if back faces may be culled,
+    // CLUSTER_DRAW_CULLING_BIT if each instance is culled by its bounds, and
+    // CLUSTER_SMALL_FEATURE_BIT if it may also be by the pixels they cover
+    GLuint flags;
+    GLuint padding;
+  };
+
+  // A primitive of a mesh instanced by a node of the scene graph
+  struct DrawItem
+  {
+    size_t node; // Position in the scene graph
+    int mesh;
+    GLsizei primitive; // Index in the primitives of the mesh
+    int instance; // EXT_mesh_gpu_instancing instance, -1 if the node has none
+    int skin; // Index in model.skins, -1 if the node has none
+    uint32_t morphTargets; // As in DrawTransform
+    int lodNode = -1; // Index in the MSFT_lod nodes, -1 if the node has none
+    int lodLevel = 0; // MSFT_lod level of the mesh, 0 for the node mesh
+    // Index in PackedGeometry::primitives, the merged primitive for the items
+    // drawing the members of PackedGeometry::mergedMembers
+    GLsizei packedPrimitive = 0;
+  };
+
+  // Draw items of a node using MSFT_lod, of every level. Only the items of
+  // the level selected for the frame are drawn.
+  struct LodNode
+  {
+    size_t firstItem;
+    size_t itemCount;
+    int levelCount;
+    std::vector<float> screenCoverages; // As in NodeLods
+    int level = 0; // Of the frame, -1 if the node is not drawn
+  };
+
   GLsizei m_nWindowWidth = 1280;
   GLsizei m_nWindowHeight = 720;
-  GLuint m_unitCubeVAO = 0;
-  GLuint m_unitCubeVBO = 0;
-  GLuint m_quadVAO = 0;
-  GLuint m_quadVBO = 0;
 
   const fs::path m_AppPath;
   const std::string m_AppName;
   const fs::path m_ShadersRootPath;
 
+  // A glTF file, a scene file, see loadSceneFile, or a tileset, see
+  // loadTileset
   fs::path m_gltfFilePath;
+  // Models of the scene, loaded from m_gltfFilePath when empty
+  std::vector<SceneFile> m_sceneFiles;
+  // Of m_gltfFilePath when it is a tileset, kept across the scenes of its
+  // tiles, and the tiles of the scene, see selectTiles
+  Tileset m_tileset;
+  std::vector<uint32_t> m_tiles;
   std::string m_vertexShader = "forward.vs.glsl";
   std::string m_fragmentShader = "pbr_directional_light.fs.glsl";
 
   fs::path m_cubeMapFilePath;
-  std::string m_cubemapVertexShader = "cubemap.vs.glsl";
-  std::string m_cubemapFragmentShader = "cubemap.fs.glsl";
-  std::string m_irradianceFragmentShader = "irradiance.fs.glsl";
-  std::string m_prefilterFragmentShader = "prefilter.fs.glsl";
+  std::string m_equirectangularComputeShader = "equirectangular.cs.glsl";
+  std::string m_irradianceComputeShader = "irradiance.cs.glsl";
+  std::string m_prefilterComputeShader = "prefilter.cs.glsl";
   std::string m_skyboxVertexShader = "skybox.vs.glsl";
   std::string m_skyboxFragmentShader = "skybox.fs.glsl";
   std::string m_integrateVertexShader = "integrate.vs.glsl";
   std::string m_integrateFragmentShader = "integrate.fs.glsl";
+  std::string m_boundsVertexShader = "bounds.vs.glsl";
+  std::string m_boundsFragmentShader = "bounds.fs.glsl";
+  std::string m_depthFragmentShader = "depth.fs.glsl";
+  std::string m_pickFragmentShader = "pick.fs.glsl";
+  std::string m_visibilityFragmentShader = "visibility.fs.glsl";
+  std::string m_pointRasterizeComputeShader = "points_rasterize.cs.glsl";
+  std::string m_pointResolveFragmentShader = "points_resolve.fs.glsl";
+  std::string m_impostorVertexShader = "impostor.vs.glsl";
+  std::string m_impostorFragmentShader = "impostor.fs.glsl";
+  std::string m_temporalResolveFragmentShader = "temporal_resolve.fs.glsl";
+  std::string m_upscaleFragmentShader = "upscale.fs.glsl";
+  std::string m_tonemapFragmentShader = "tonemap.fs.glsl";
+  std::string m_panoramaFragmentShader = "panorama.fs.glsl";
+  std::string m_pathTraceComputeShader = "path_trace.cs.glsl";
+  std::string m_bloomDownsampleComputeShader = "bloom_downsample.cs.glsl";
+  std::string m_bloomUpsampleComputeShader = "bloom_upsample.cs.glsl";
+  std::string m_transparencyCompositeFragmentShader =
+      "transparency_composite.fs.glsl";
+  std::string m_shadowVertexShader = "shadow.vs.glsl";
+  std::string m_clusterLightsComputeShader = "cluster_lights.cs.glsl";
+  std::string m_cullMeshletsComputeShader = "cull_meshlets.cs.glsl";
+  std::string m_depthPyramidComputeShader = "depth_pyramid.cs.glsl";
+  std::string m_ambientOcclusionDepthComputeShader =
+      "ambient_occlusion_depth.cs.glsl";
+  std::string m_ambientOcclusionComputeShader = "ambient_occlusion.cs.glsl";
+  std::string m_ambientOcclusionBlurComputeShader =
+      "ambient_occlusion_blur.cs.glsl";
+  std::string m_mipmapComputeShader = "mipmap.cs.glsl";
+  std::string m_bc6hEncodeComputeShader = "bc6h_encode.cs.glsl";
+  std::string m_shadingRateComputeShader = "shading_rate.cs.glsl";
 
   bool m_hasUserCamera = false;
   Camera m_userCamera;
 
+  // Scene and environment run once the current scene is left, if
+  // m_sceneChanged
+  size_t m_sceneCount = 0; // Scenes run before the current one
+  bool m_sceneChanged = false;
+  fs::path m_nextGltfFilePath;
+  std::vector<SceneFile> m_nextSceneFiles;
+  fs::path m_nextCubeMapFilePath;
+
   glm::mat4 m_captureProjection =
 	  glm::perspective(
 		  glm::radians(90.0f),
@@ -99,13 +457,140 @@ private:
   };
 
   fs::path m_OutputPath;
+  // Rendered in sequence instead of m_OutputPath if not empty
+  std::vector<RenderView> m_renderViews;
+  // Frames along m_renderViews, or of the camera, piped out if path is set
+  VideoOutput m_video;
+  // Frames timed along m_renderViews, or an orbit, if frames is not 0
+  BenchOptions m_bench;
+  // GL calls of a frame recorded for the replay command if path is set
+  GLCaptureOptions m_captureOptions;
+  // Only load the scene and environment, writing the geometry and IBL caches
+  // the next launches read, and draw nothing
+  bool m_bakeCaches = false;
+  // Serves the requests for the model and environment if not null
+  RenderJobSource *m_jobServer = nullptr;
+  // Hands out the views of m_renderViews to this renderer if not null, the
+  // other renderers of the batch draw the other views on other GPUs
+  ViewScheduler *m_viewScheduler = nullptr;
+  size_t m_schedulerRenderer = 0;
+  // Loads the models of the jobs queued for the next renderers if not null,
+  // the model of this one is taken from it if it was loaded ahead
+  ModelPrefetcher *m_prefetcher = nullptr;
+  // The context is created shared with the renderers of the serve command
+  // running concurrently if not null, the environment maps and geometry
+  // buffers being shared through it
+  SharedGLObjects *m_sharedObjects = nullptr;
+
+  // Scan every vertex for the scene bounds instead of using accessor min/max
+  bool m_exactBounds = false;
+  GeometryOptions m_geometryOptions;
+  TilesetOptions m_tilesetOptions;
+
+  // Sizes and quality of the environment maps, changed from the GUI for the
+  // next bake
+  IblOptions m_iblOptions;
+
+  // Memory budget of streamed material textures, 0 keeps every level resident
+  float m_textureBudgetMB = 0;
+
+  // Keep PNG and JPEG images encoded until a visible draw samples them
+  bool m_lazyTextures = false;
+
+  // Largest side of material textures in texels, larger images are halved
+  // at load time and KTX2 textures start at a coarser level, 0 for no cap
+  int m_maxTextureSize = 0;
+
+  // Sample normal and occlusion maps. Without them, as toggled in the GUI,
+  // textures sampled by no other map are not uploaded.
+  bool m_detailMaps = true;
+
+  // Evaluate the Fresnel and diffuse terms of the lights with 16 bit floats
+  // where AMD_gpu_shader_half_float is supported
+  bool m_halfPrecision = false;
+
+  // Shade the draws of small primitives with a cheaper permutation, see
+  // featureShadingLod, by default. Reference images are rendered without.
+  bool m_shadingLod = true;
+
+  // Filter of the mip levels generated for material textures uploaded whole,
+  // streamed textures are box filtered
+  MipFilter m_mipFilter = MipFilter::Box;
+
+  // Parser of the glTF JSON, tinygltf only to check the other one
+  GltfParser m_gltfParser = GltfParser::SinglePass;
+
+  // Samples per pixel of the image rendered to m_OutputPath
+  int m_samples = 1;
+
+  // Of the quality tier, the window samples and the features of the GUI,
+  // see QualitySettings. main applies the options it covers.
+  QualitySettings m_quality;
+
+  // Anti-alias the window with temporal anti-aliasing rather than by
+  // multisampling its framebuffer
+  bool m_temporalAA = false;
+
+  // Cull the draws of the frame on the GPU by their bounds, the CPU only
+  // leaves out the levels of detail not drawn
+  bool m_gpuCulling = false;
+
+  // Rasterize the triangles of the opaque draws to a visibility buffer and
+  // shade each pixel once, see utils/visibility_buffer.hpp
+  bool m_visibilityBuffer = false;
+
+  // Fetch the vertex attributes of the forward passes from a storage buffer
+  // by gl_VertexID, with the layout of the vertex buffer of each draw, so that
+  // draws of every layout share the indirect calls
+  bool m_vertexPulling = false;
+
+  // Operator and exposure of the tonemap pass, changed from the GUI
+  TonemapOptions m_tonemap;
+
+  // Side of the tiles images are rendered in, 0 tiles only images larger than
+  // the GPU can render at once
+  int m_tileSize = 0;
+
+  // Render output images as equirectangular panoramas from the six faces of
+  // m_captureViews around the eye
+  bool m_panorama = false;
+
+  // Path trace output images instead of rasterizing them, see PathTracer
+  PathTraceOptions m_pathTrace;
+
+  // GPU of the headless EGL context, -1 creates a GLFW window
+  int m_eglDevice = -1;
+
+  // Draw the window only when input, the camera or loading change it
+  bool m_onDemand = false;
+
+  // Draw no GUI, toggled by F1
+  bool m_hideGui = false;
+
+  // Swap interval and limits of the window loop
+  FramePacing m_framePacing;
+
+  // Statistics of every frame are written to this CSV file if not empty
+  fs::path m_statsCsvPath;
+
+  // Bytes of the GPU objects of the scene, destroyed after the objects that
+  // untrack themselves
+  GpuMemoryTracker m_gpuMemory;
 
   // Order is important here, see comment below
   const std::string m_ImGuiIniFilename;
   // Last to be initialized, first to be destroyed:
   GLFWHandle m_GLFWHandle{int(m_nWindowWidth), int(m_nWindowHeight),
       "glTF Viewer",
-      m_OutputPath.empty()}; // show the window only if m_OutputPath is empty
+      m_OutputPath.empty() && m_renderViews.empty() &&
+          m_video.path.empty() && !m_bench.frames && !m_bakeCaches &&
+          !m_jobServer, // show the window only if there is no
+                        // image to render
+      m_eglDevice, m_temporalAA ? 0 : m_quality.windowSamples,
+      m_sharedObjects ? &m_sharedObjects->context() : nullptr};
+  // Records from the creation of the context, before any GL object
+  GLCapture m_glCapture{m_captureOptions, m_GLFWHandle, int(m_nWindowWidth),
+      int(m_nWindowHeight), m_temporalAA ? 0 : 4};
   /*
     ! THE ORDER OF DECLARATION OF MEMBER VARIABLES IS IMPORTANT !
     - m_ImGuiIniFilename.c_str() will be used by ImGUI in ImGui::Shutdown, which
@@ -118,29 +603,163 @@ private:
     before most of OpenGL function calls.
   */
 
+  // Drawn by the image based lighting bake and the skybox
+  GLVertexArray m_unitCubeVAO;
+  GLBuffer m_unitCubeVBO;
+  GLVertexArray m_quadVAO;
+  GLBuffer m_quadVBO;
+
+  // Image based lighting maps of m_cubeMapFilePath, kept while the scenes
+  // with the same environment and options follow each other, and shared by
+  // the renderers of m_sharedObjects
+  struct EnvironmentMaps
+  {
+    fs::path cubeMapFile;
+    IblOptions options;
+    GLTexture brdfLut;
+    GLTexture environment;
+    GLTexture irradiance;
+    GLTexture prefilter;
+    ShIrradiance shIrradiance;
+  };
+  std::shared_ptr<EnvironmentMaps> m_environmentMaps;
+
+  // Vertex and index buffers of createBufferObjects, shared by the renderers
+  // of m_sharedObjects drawing the same packed geometry
+  struct SharedGeometryBuffers
+  {
+    GeometryCacheKey key;
+    GLBuffers buffers;
+  };
+
   tinygltf::TinyGLTF m_gltfLoader;
+  GltfBuffers m_gltfBuffers;
 
+  // Body of run(), on the render thread of GLFWHandle::runThreaded unless
+  // FramePacing::renderThread is off
+  int runScenes();
+  int runScene();
+
+  // Load the models of m_sceneFiles, merged into model when there are several
   bool loadGltfFile(tinygltf::Model& model);
 
-  GLuint loadEnvTexture();
-  GLuint loadCorrectedEnvTexture();
-  GLuint computeIrradianceMap(GLuint envCubemap);
-  GLuint prefilterEnvironmentMap(GLuint envCubemap);
-  GLuint integrateBRDF();
+  // Pixels of an HDR file, as stored by Radiance files, or as RGB floats with
+  // the bottom row first for the other formats stb_image reads
+  struct EnvironmentImage
+  {
+    RgbeImage rgbe; // Empty for other formats
+    std::vector<float> floats;
+    int width = 0;
+    int height = 0;
+  };
+
+  // Maps being baked from an environment image by a list of steps, each
+  // dispatching a few faces of one map level. The steps of the environment of
+  // a scene run before it is drawn, those of an environment switched to at
+  // runtime are spread over frames while the current maps stay bound.
+  struct EnvironmentBake
+  {
+    struct Step
+    {
+      const char *stage; // GPU profiler section
+      double cost; // About the texture fetches of the step
+      std::function<void()> run;
+    };
+
+    fs::path cubeMapFile;
+    IblOptions options;
+    IblCacheKey cacheKey;
+    bool cacheable = false;
+    GLTexture brdfLut; // Empty to keep the LUT of the current maps
+    GLTexture environment;
+    GLTexture irradiance;
+    GLTexture prefilter;
+    // Source of the environment, see equirectangular.cs.glsl
+    GLTexture equirectangular;
+    GLSampler environmentLevels;
+    GLProgram equirectangularProgram;
+    GLProgram irradianceProgram;
+    GLProgram prefilterProgram;
+    GLProgram compressProgram; // If options.compressed
+    MipGenerator mipGenerator; // Of the levels of environment
+    std::vector<Step> steps;
+    size_t nextStep = 0;
+    double totalCost = 0;
+    double doneCost = 0; // Of the steps before nextStep
+  };
 
+  // Read the image of an HDR file, from any thread. Return false if it
+  // cannot be read.
+  static bool readEnvironmentImage(
+      const fs::path &path, EnvironmentImage &image);
+  // Equirectangular texture of image, the bytes of a Radiance file if rgbe
+  // is set, 0 if image is empty
+  GLuint uploadEnvironmentImage(const EnvironmentImage &image, bool &rgbe);
+  // Upload image, create the maps and list the steps filling them, of at
+  // most facesPerStep faces each. The BRDF LUT is only loaded or integrated
+  // if bakeBrdfLut is set.
+  std::unique_ptr<EnvironmentBake> startEnvironmentBake(
+      const fs::path &cubeMapFile, const EnvironmentImage &image,
+      const IblOptions &options, bool bakeBrdfLut, GLuint facesPerStep);
+  // Maps of a bake whose steps have all run, written to the IBL cache. The
+  // BRDF LUT of previous is taken if the bake has none.
+  std::unique_ptr<EnvironmentMaps> finishEnvironmentBake(
+      EnvironmentBake &bake, EnvironmentMaps *previous);
+  // Maps of the IBL cache, null if it has none for these options
+  std::unique_ptr<EnvironmentMaps> loadCachedEnvironmentMaps(
+      const fs::path &cubeMapFile, const IblOptions &options);
+  GLuint loadBakedBRDF(GLuint size);
+  GLuint integrateBRDF(GLuint size);
+
+  // One vertex buffer per vertex buffer of the geometry, then the index
+  // buffer
   std::vector<GLuint> createBufferObjects(
-	  const tinygltf::Model& model);
+	  const PackedGeometry& geometry);
 
   std::vector<GLuint> createVertexArrayObjects(
 	  const tinygltf::Model& model,
+	  const PackedGeometry& geometry,
 	  const std::vector<GLuint>& bufferObjects,
-	  std::vector<VaoRange>& meshIndexToVaoRange);
+	  VertexLayoutCache& vertexLayouts,
+	  std::vector<PrimitiveRange>& meshPrimitiveRanges);
 
-  std::vector<GLuint> createTextureObjects(
+  // One sampler object per glTF sampler, then the default sampler
+  std::vector<GLuint> createSamplerObjects(
 	  const tinygltf::Model &model) const;
 
+  // Textures with a mipmap filter are given to streamer if not null, only
+  // their coarse levels are uploaded, the levels of the others are generated
+  // by mipGenerator. The bytes of the uploaded levels are added to
+  // uploadedBytes. Textures of images kept encoded are left 0.
+  std::vector<GLuint> createTextureObjects(
+	  const tinygltf::Model &model,
+	  TextureStreamer *streamer,
+	  MipGenerator &mipGenerator,
+	  size_t &uploadedBytes) const;
+
+  // The texture object of model.textures[textureIdx], see
+  // createTextureObjects, through uploader
+  GLuint createTextureObject(
+	  const tinygltf::Model &model,
+	  size_t textureIdx,
+	  unsigned usage,
+	  TextureStreamer *streamer,
+	  MipGenerator &mipGenerator,
+	  TextureUploader &uploader) const;
+
   void initCube();
-  void renderCube();
   void initQuad();
   void renderQuad();
 };
+
+// Render the jobs until there are no more, through a ViewerApplication per
+// model and environment, kept for their consecutive jobs. Shaders are read
+// next to appPath. Jobs no renderer took are answered with an error. The
+// models of the jobs already queued for the next renderers are loaded ahead
+// as prefetch allows. With several renderers, each renders on a thread and
+// context of its own the jobs it takes from a RenderJobPool, so that jobs run
+// concurrently on the GPU of eglDevice. Their contexts share the environment
+// maps and geometry buffers they load, see SharedGLObjects.
+void serveRenderJobs(const fs::path &appPath, int eglDevice,
+    RenderJobSource &jobs, const PrefetchOptions &prefetch = {},
+    size_t rendererCount = 1);
@@ -1,12 +1,74 @@
 #include "ViewerApplication.hpp"
 #include "utils/GLFWHandle.hpp"
+#include "utils/egl_context.hpp"
 #include "utils/filesystem.hpp"
+#include "utils/gl_capture.hpp"
+#include "utils/heap_memory.hpp"
+#include "utils/ibl_cache.hpp"
+#include "utils/image_compare.hpp"
+#include "utils/job_system.hpp"
+#include "utils/model_stats.hpp"
+#include "utils/quality_tier.hpp"
+#include "utils/render_cache.hpp"
+#include "utils/render_server.hpp"
+#include "utils/render_views.hpp"
+#include "utils/trace.hpp"
+#include "utils/view_scheduler.hpp"
 
 #include <args.hxx>
 
+#include <algorithm>
+#include <exception>
+#include <thread>
+
 std::vector<std::string> split(
     const std::string &str, const std::string &delim);
 
+// Options of --ibl-sizes, --prefilter-levels, --fast-ibl-bake and
+// --compress-ibl, throws args::ValidationError if they are invalid
+IblOptions parseIblOptions(const std::string &sizes, int prefilterLevels,
+    bool fastBake, bool compressed);
+
+// Workers of the shared job system for --jobs, throws args::ValidationError if
+// the count is not positive
+void setJobWorkers(args::ValueFlag<int> &jobWorkers);
+
+// Allocation site sampling of --heap-sampling, in KB, throws
+// args::ValidationError if the interval is not positive
+void setHeapSamplingOption(args::ValueFlag<int> &heapSampling);
+
+// Filter of --mip-filter, box by default, throws args::ValidationError if it
+// is unknown
+MipFilter parseMipFilterOption(args::ValueFlag<std::string> &mipFilter);
+
+// Options of --capture and --capture-frame, throws args::ValidationError if the
+// frame is negative
+GLCaptureOptions parseCaptureOptions(args::ValueFlag<std::string> &capture,
+    args::ValueFlag<int> &captureFrame);
+
+// Defaults of the options chained by --preset, options given explicitly win
+struct RenderPreset
+{
+  uint32_t imageSize = 0; // Width and height, 0 for those of the command
+  std::string iblSizes; // As --ibl-sizes, empty for the default sizes
+  bool fastIblBake = false;
+  int maxTextureSize = 0;
+  bool detailMaps = true; // Normal and occlusion maps
+  int benchFrames = 0; // Of the bench command, 0 for its default
+  int benchWarmup = -1; // Idem, -1 for its default
+};
+
+// Defaults of --preset, those of the quality tier if it is not given, throws
+// args::ValidationError if it is unknown
+RenderPreset parsePresetOption(
+    args::ValueFlag<std::string> &preset, QualityTier quality);
+
+// Tier of --quality, probed on eglDevice, or the display if negative, for
+// auto and, if autoByDefault, without the option. Throws
+// args::ValidationError if it is unknown.
+QualityTier parseQualityOption(args::ValueFlag<std::string> &quality,
+    bool autoByDefault, int eglDevice);
+
 int main(int argc, char **argv)
 {
   auto returnCode = 0;
@@ -15,16 +77,77 @@ int main(int argc, char **argv)
   args::ArgumentParser parser{"glTF Viewer."};
   args::HelpFlag help{parser, "help", "Display this help menu", {'h', "help"}};
   args::Group commands{parser, "commands"};
-  args::Command info{commands, "info", "Display info about OpenGL",
+  auto modelStats = false; // info stats ran, info prints nothing else
+  args::Command info{commands, "info",
+      "Display info about OpenGL, or about a model with stats",
       [&](args::Subparser &parser) {
+        args::Flag egl{parser, "egl",
+            "Create a headless EGL context and list the EGL devices",
+            {"egl"}};
+        args::ValueFlag<int> gpu{parser, "gpu",
+            "Index of the EGL device to create the context on, implies --egl",
+            {"gpu"}};
         parser.Parse();
-        GLFWHandle handle{1, 1, "", false};
+        if (modelStats) {
+          return;
+        }
+        const auto eglDevice = gpu ? args::get(gpu) : egl ? 0 : -1;
+        if (eglDevice >= 0) {
+          const auto devices = EglContext::deviceNames();
+          for (size_t i = 0; i < devices.size(); ++i) {
+            std::clog << "EGL device " << i << ": " << devices[i] << "\n";
+          }
+        }
+        GLFWHandle handle{1, 1, "", false, eglDevice};
         printGLVersion();
+        printQualityProbe(probeQualityTier(), std::cout);
       }};
-  args::Command interactive{
-      commands, "viewer", "Run glTF viewer", [&](args::Subparser &parser) {
+  args::Command stats{info, "stats",
+      "Load a glTF file without OpenGL and report the cost of drawing "
+      "it: vertices, triangles, cache miss ratios, draw calls and "
+      "texture memory",
+      [&](args::Subparser &parser) {
         args::Positional<std::string> file{
             parser, "file", "Path to file", args::Options::Required};
+        args::Flag json{
+            parser, "json", "Report every primitive in JSON", {"json"}};
+        args::ValueFlag<int> jobWorkers{parser, "count",
+            "Worker threads of the jobs, see viewer", {"jobs"}};
+        args::ValueFlag<int> heapSampling{parser, "KB",
+            "Sample the call stacks of the heap allocations, see viewer",
+            {"heap-sampling"}};
+        parser.Parse();
+        modelStats = true;
+        setJobWorkers(jobWorkers);
+        setHeapSamplingOption(heapSampling);
+
+        // Images are only probed for their dimensions
+        tinygltf::TinyGLTF loader;
+        tinygltf::Model model;
+        GltfBuffers buffers;
+        std::string err, warn;
+        if (!loadGltfModel(loader, args::get(file), model, buffers, err,
+                warn, true)) {
+          std::cerr << err << std::endl;
+          returnCode = 1;
+          return;
+        }
+        if (!warn.empty()) {
+          std::clog << warn << std::endl;
+        }
+        const auto stats = computeModelStats(model, buffers);
+        if (json) {
+          printModelStatsJson(stats, std::cout);
+        } else {
+          printModelStats(stats, std::cout);
+        }
+      }};
+  info.RequireCommand(false);
+  args::Command interactive{
+      commands, "viewer", "Run glTF viewer", [&](args::Subparser &parser) {
+        args::Positional<std::string> file{parser, "file",
+            "Path to file, or its http:// or https:// URL",
+            args::Options::Required};
         args::Positional<std::string> cube{
             parser, "cube", "Path to cubemap file"};
         args::ValueFlag<std::string> lookat{parser, "lookat",
@@ -43,9 +166,316 @@ int main(int argc, char **argv)
             {"h", "height"}};
         args::ValueFlag<std::string> output{parser, "output",
             "Output path to render the image. If specified no window is shown. "
-            "Only png is supported.",
+            "The format is picked from the extension: png, qoi (fast "
+            "lossless), ppm or tga (uncompressed), exr (linear half floats).",
             {"o", "output"}};
+        args::Flag exactBounds{parser, "exact-bounds",
+            "Compute the scene bounds from every vertex instead of the "
+            "POSITION accessors min and max",
+            {"exact-bounds"}};
+        args::Flag optimizeMeshes{parser, "optimize-meshes",
+            "Reorder triangles and vertices at load time for the vertex "
+            "cache, overdraw and vertex fetches",
+            {"optimize-meshes"}};
+        args::Flag weldVertices{parser, "weld-vertices",
+            "Merge the equal vertices of each triangle list at load time, "
+            "indexing the unindexed ones, before the other optimizations",
+            {"weld-vertices"}};
+        args::Flag quantizeVertices{parser, "quantize-vertices",
+            "Store positions as 16 bits integers, normals as 10 bits ones and "
+            "texture coordinates as half floats, about halving the size of "
+            "vertices",
+            {"quantize-vertices"}};
+        args::ValueFlag<int> lods{parser, "count",
+            "Simplify each triangle list into up to count levels of detail at "
+            "load time, each with about half the triangles of the previous "
+            "one. The coarsest level whose error projects to less than a "
+            "pixel is drawn.",
+            {"lods"}};
+        args::Flag meshlets{parser, "meshlets",
+            "Split triangle lists into meshlets at load time, culled against "
+            "the view frustum and the eye on the GPU before drawing. Needs "
+            "GL_ARB_indirect_parameters.",
+            {"meshlets"}};
+        args::Flag staticBatching{parser, "static-batching",
+            "Merge the nodes that no animation moves into world space "
+            "primitives at load time, one draw per material instead of one "
+            "per node and primitive. Skinned, morphed and instanced nodes "
+            "keep their own draws.",
+            {"static-batching"}};
+        args::Flag mergeSmallPrimitives{parser, "merge-small-primitives",
+            "Draw the small primitives of the meshes of a single node with "
+            "one command per vertex buffer and material, each vertex moved "
+            "by the transform of its node",
+            {"merge-small-primitives"}};
+        args::Flag noGeometryCache{parser, "no-geometry-cache",
+            "Pack the geometry of the model again instead of reading the "
+            "copy a previous launch wrote in the cache directory",
+            {"no-geometry-cache"}};
+        args::ValueFlag<int> bakedOcclusion{parser, "rays",
+            "Bake the ambient occlusion of the vertices of the static "
+            "primitives once loaded, tracing this many rays per vertex, and "
+            "darken the ambient light with it. Written to the cache along "
+            "the geometry.",
+            {"baked-occlusion"}};
+        args::ValueFlag<float> visibleSets{parser, "cell-size",
+            "Bake which primitives are potentially visible from each cell of "
+            "a grid of cells of this size over the scene once loaded, and "
+            "only draw those of the cell of the eye. Meant for walking "
+            "through the interiors of static models. Written to the cache "
+            "along the geometry.",
+            {"visible-sets"}};
+        args::ValueFlag<float> textureBudget{parser, "texture-budget-mb",
+            "Memory budget of material textures in MB. Only their coarse mip "
+            "levels are loaded, finer ones are streamed in as needed.",
+            {"texture-budget-mb"}};
+        args::ValueFlag<float> tileError{parser, "pixels",
+            "Of a 3D Tiles tileset.json file: tiles whose geometric error "
+            "projects to more pixels are replaced by their children, 16 by "
+            "default. The scene is loaded again with the tiles of the view "
+            "once the camera rests.",
+            {"tile-error"}};
+        args::ValueFlag<float> tileBudget{parser, "tile-budget-mb",
+            "Memory budget of the content files of the tiles of a tileset "
+            "loaded at once in MB, 512 by default. The coarsest tiles are "
+            "always loaded.",
+            {"tile-budget-mb"}};
+        args::Flag lazyTextures{parser, "lazy-textures",
+            "Keep PNG and JPEG images encoded at load time, each is decoded "
+            "the first time a visible draw samples it. Neutral textures are "
+            "drawn meanwhile. Implies bound textures rather than texture "
+            "arrays without bindless textures.",
+            {"lazy-textures"}};
+        args::ValueFlag<int> maxTextureSize{parser, "size",
+            "Largest side of material textures in texels. Larger images are "
+            "halved with a box filter at load time, KTX2 textures skip their "
+            "finer levels. Cuts the GPU memory and load time of 8K texture "
+            "sets on small GPUs.",
+            {"max-texture-size"}};
+        args::ValueFlag<std::string> quality{parser, "tier",
+            "Quality tier giving the defaults of the options: low, medium, "
+            "high or auto, probed from the renderer, its memory and a 50 ms "
+            "shading benchmark (see info). low bakes 256,16,64 environment "
+            "maps fast, caps textures to 1024 texels without normal and "
+            "occlusion maps, and has no MSAA, shadows or ambient occlusion. "
+            "medium bakes 256,32,128 maps, caps textures to 2048 texels and "
+            "has 2x MSAA and no ambient occlusion. high is the default of "
+            "every option. auto for the window, high for images by default. "
+            "--preset and options given explicitly win.",
+            {"quality"}};
+        args::ValueFlag<std::string> preset{parser, "preset",
+            "Defaults of the options for a kind of render. thumbnail: "
+            "256x256, 256,16,64 environment maps baked fast (cached after the "
+            "first model), textures capped to 512 texels, no normal and "
+            "occlusion maps. Bounds from the accessors, no MSAA and RGBA8 "
+            "read back as by default. Options given explicitly win.",
+            {"preset"}};
+        args::Flag halfPrecision{parser, "half-precision",
+            "Evaluate the Fresnel and diffuse terms of the lights with 16 bit "
+            "floats, twice as fast on GPUs with packed half math. Needs "
+            "GL_AMD_gpu_shader_half_float. Check the images against full "
+            "precision ones with the compare command.",
+            {"half-precision"}};
+        args::Flag noShadingLod{parser, "no-shading-lod",
+            "Shade every draw with the full permutation of its material, "
+            "not the cheaper one of small primitives. The reference of "
+            "scripts/validate_performance_modes.sh.",
+            {"no-shading-lod"}};
+        args::ValueFlag<std::string> mipFilter{parser, "filter",
+            "Filter of the mip levels generated for material textures: box "
+            "(default), kaiser or lanczos, sharper. Normal maps are "
+            "renormalized at each level. Levels streamed with "
+            "--texture-budget-mb are box filtered.",
+            {"mip-filter"}};
+        args::Flag tinygltfParser{parser, "tinygltf",
+            "Parse the glTF JSON with tinygltf, the reference parser, "
+            "rather than with the single pass reader",
+            {"tinygltf"}};
+        args::ValueFlag<std::string> iblSizes{parser, "sizes",
+            "Sizes of the environment maps, as skybox,irradiance,prefilter or "
+            "skybox,irradiance,prefilter,brdf_lut. 512,32,128,512 by "
+            "default, 256,16,64 bakes several times faster.",
+            {"ibl-sizes"}};
+        args::ValueFlag<int> prefilterLevels{parser, "levels",
+            "Mip levels of the prefiltered environment map, from roughness 0 "
+            "to 1. 5 by default, fewer if the map is too small.",
+            {"prefilter-levels"}};
+        args::Flag fastIblBake{parser, "fast-ibl-bake",
+            "Bake the irradiance and prefiltered environment maps with fewer "
+            "samples, from coarser levels of the environment. Faster, a bit "
+            "blurrier, cached apart from full quality bakes.",
+            {"fast-ibl-bake"}};
+        args::Flag compressIbl{parser, "compress-ibl",
+            "Compress the baked environment, irradiance and prefiltered maps "
+            "to BC6H on the GPU, a quarter of their memory and of the "
+            "bandwidth of their fetches. Cached apart from uncompressed "
+            "bakes.",
+            {"compress-ibl"}};
+        args::ValueFlag<int> samples{parser, "samples",
+            "Samples per pixel of the output image, multisampled attachments "
+            "are resolved before being read back",
+            {"samples"}};
+        args::Flag taa{parser, "taa",
+            "Anti-alias the window with temporal anti-aliasing, jittered "
+            "frames blended with the previous ones, instead of 4x MSAA",
+            {"taa"}};
+        args::Flag gpuCulling{parser, "gpu-culling",
+            "Cull the draws by their bounds in a compute shader, against the "
+            "view frustum, the pixel centers they cover and, with occlusion "
+            "culling, the depth of the previous frame, instead of on the "
+            "CPU. Needs GL_ARB_indirect_parameters.",
+            {"gpu-culling"}};
+        args::Flag visibilityBuffer{parser, "visibility-buffer",
+            "Rasterize the draw and triangle of each pixel of the opaque "
+            "draws first, then shade each pixel once from them. Alpha tested, "
+            "skinned and morphed draws stay forward shaded. Not used with "
+            "multisampling, meshlet culling or stereo.",
+            {"visibility-buffer"}};
+        args::Flag vertexPulling{parser, "vertex-pulling",
+            "Read the vertices of the forward, depth and picking passes from "
+            "storage buffers in the vertex shader, so that primitives of "
+            "different vertex buffers share a multi-draw. Shadows, points and "
+            "the visibility buffer keep the vertex arrays.",
+            {"vertex-pulling"}};
+        args::ValueFlag<std::string> tonemap{parser, "operator",
+            "Tonemapping operator of the linear scene: neutral (Khronos PBR "
+            "Neutral, default), aces, reinhard or none, which clamps. hdr and "
+            "exr images are written linear, without it.",
+            {"tonemap"}};
+        args::ValueFlag<float> exposure{parser, "exposure",
+            "Scale of the scene radiance before tonemapping, 1 by default",
+            {"exposure"}};
+        args::ValueFlag<float> bloom{parser, "bloom",
+            "Add this share of a wide blur of the scene to it before "
+            "tonemapping, for the glow of bright and emissive surfaces. 0, "
+            "without bloom, by default. Not applied to tiled renders.",
+            {"bloom"}};
+        args::ValueFlag<int> tileSize{parser, "tile-size",
+            "Render output images in square tiles of this many pixels, "
+            "written a band of tiles at a time. Images larger than the GPU "
+            "can render at once are tiled by default. PNG still keeps the "
+            "whole image in memory, qoi, ppm, tga and exr do not.",
+            {"tile-size"}};
+        args::Flag panorama{parser, "panorama",
+            "Render output images as 360 degree equirectangular panoramas "
+            "around the eye of the view, from the six faces of a cube map "
+            "drawn once each. Faces are a quarter of the image width. Not "
+            "tiled.",
+            {"panorama"}};
+        args::ValueFlag<int> pathTraceSamples{parser, "samples",
+            "Path trace output images instead of rasterizing them, adding "
+            "this many samples per pixel. The BVH of the triangles is "
+            "traversed by a compute shader, with the glTF materials, the "
+            "lights and the environment map. Not tiled, skins and morph "
+            "targets are traced in their rest pose.",
+            {"path-trace-samples"}};
+        args::ValueFlag<float> pathTraceSeconds{parser, "seconds",
+            "Path trace output images, see --path-trace-samples, adding "
+            "samples for this many seconds per image, or until "
+            "--path-trace-samples is reached if both are given",
+            {"path-trace-seconds"}};
+        args::ValueFlag<int> pathTraceBounces{parser, "bounces",
+            "Bounces of the paths off the surfaces, 4 by default",
+            {"path-trace-bounces"}};
+        args::ValueFlag<std::string> views{parser, "views",
+            "File of camera views to render, each to its own image, after "
+            "loading the scene once. Either one --lookat tuple per line, "
+            "optionally followed by an output path, or a JSON list of "
+            "{\"lookat\": [...], \"output\": \"...\"} objects, with a "
+            "\"time\" in seconds in camera paths recorded from the GUI. "
+            "Views without an output are numbered after -o.",
+            {"views"}};
+        args::Flag egl{parser, "egl",
+            "Render with a headless EGL context, without a window or X "
+            "server. Requires -o, --views or --video.",
+            {"egl"}};
+        args::ValueFlag<int> gpu{parser, "gpu",
+            "Index of the EGL device to render on, implies --egl. "
+            "\"info --egl\" lists the devices.",
+            {"gpu"}};
+        args::ValueFlag<std::string> gpus{parser, "gpus",
+            "Comma separated indices of EGL devices to render the --views on "
+            "at once, each loading its own copy of the scene. Every GPU "
+            "starts with a contiguous share of the views and takes views "
+            "left by the others once done.",
+            {"gpus"}};
+        args::Flag onDemand{parser, "on-demand",
+            "Redraw the window only on input, camera motion or while loading, "
+            "instead of continuously",
+            {"on-demand"}};
+        args::ValueFlag<std::string> vsync{parser, "vsync",
+            "Swap interval of the window: off (default), on, or adaptive, "
+            "which tears instead of waiting when a frame is late",
+            {"vsync"}};
+        args::ValueFlag<float> maxFps{parser, "max-fps",
+            "Limit the frame rate of the window, frames are spaced evenly",
+            {"max-fps"}};
+        args::ValueFlag<int> framesInFlight{parser, "frames-in-flight",
+            "Frames the CPU may queue ahead of the GPU, fewer lower the input "
+            "latency. Left to the driver by default.",
+            {"frames-in-flight"}};
+        args::ValueFlag<float> targetFrameMs{parser, "target-frame-ms",
+            "Render the scene of the window at the resolution keeping its GPU "
+            "time near this many ms, down to half the window size, upscaled "
+            "and sharpened before the GUI is drawn",
+            {"target-frame-ms"}};
+        args::Flag hideGui{parser, "hide-gui",
+            "Start with the GUI hidden, F1 shows or hides it", {"hide-gui"}};
+        args::Flag singleThread{parser, "single-thread",
+            "Render on the thread processing the window events instead of a "
+            "thread of its own, rendering then stops while the window is "
+            "moved or resized on some systems",
+            {"single-thread"}};
+        args::ValueFlag<int> jobWorkers{parser, "count",
+            "Worker threads of the loading and scene update jobs, one less "
+            "than the hardware threads by default",
+            {"jobs"}};
+        args::ValueFlag<std::string> trace{parser, "trace",
+            "Write the CPU time of loading and rendering steps to this Chrome "
+            "trace JSON file, for Perfetto or chrome://tracing. The zones are "
+            "compiled in debug builds or with -DGLMLV_ENABLE_TRACE=ON.",
+            {"trace"}};
+        args::ValueFlag<std::string> statsCsv{parser, "stats-csv",
+            "Write the draw calls, triangles, state changes, uniform "
+            "uploads and uploaded bytes of every frame to this CSV file",
+            {"stats-csv"}};
+        args::ValueFlag<std::string> capture{parser, "capture",
+            "Record the GL calls of a frame, with everything before it, to "
+            "this file for the replay command. The GUI is hidden.",
+            {"capture"}};
+        args::ValueFlag<int> captureFrame{parser, "frame",
+            "Frames drawn once the scene has loaded before the one of "
+            "--capture, 0 by default",
+            {"capture-frame"}};
+        args::ValueFlag<std::string> video{parser, "video",
+            "Path of a file or named pipe, or - for stdout, to write raw "
+            "rgb24 video frames to instead of images, for an encoder like "
+            "ffmpeg. The frames follow the path through the --views cameras, "
+            "or show the camera for --duration.",
+            {"video"}};
+        args::ValueFlag<float> fps{
+            parser, "fps", "Frame rate of --video, 30 by default", {"fps"}};
+        args::ValueFlag<float> duration{parser, "duration",
+            "Seconds of --video to interpolate the camera path over. Without "
+            "it recorded paths play at their own pace and other views are one "
+            "frame each.",
+            {"duration"}};
+        args::Flag glDebug{parser, "gl-debug",
+            "Developer mode: create debug contexts and log the messages of "
+            "the driver, its performance warnings counted in the GPU "
+            "profiler panel. Contexts are otherwise created without debug "
+            "output, and without error checking where GL_KHR_no_error is "
+            "supported.",
+            {"gl-debug"}};
+        args::ValueFlag<int> heapSampling{parser, "KB",
+            "Sample the call stacks of the heap allocations about once every "
+            "KB allocated, reported with the host memory. Needs a build "
+            "with GLMLV_COUNT_ALLOCATIONS.",
+            {"heap-sampling"}};
         parser.Parse();
+        setJobWorkers(jobWorkers);
+        setHeapSamplingOption(heapSampling);
+        setGLDeveloperMode(glDebug);
 
         std::vector<float> lookatParams;
         if (lookat) {
@@ -61,15 +491,767 @@ int main(int argc, char **argv)
           }
         }
 
-        uint32_t width = imageWidth ? args::get(imageWidth) : 1280;
-        uint32_t height = imageHeight ? args::get(imageHeight) : 720;
+        VideoOutput videoOutput;
+        if (video) {
+          videoOutput.path = args::get(video);
+          videoOutput.fps = fps ? args::get(fps) : 30.f;
+          videoOutput.duration = duration ? args::get(duration) : 0.f;
+          if (videoOutput.fps <= 0 || videoOutput.duration < 0) {
+            throw args::ValidationError(
+                "--fps must be positive and --duration not negative");
+          }
+        }
+
+        std::vector<RenderView> renderViews;
+        if (views) {
+          // The output paths of the views are unused by videos
+          std::string err;
+          if (!loadRenderViews(args::get(views),
+                  video ? videoOutput.path : fs::path(args::get(output)),
+                  renderViews, err)) {
+            throw args::ValidationError(
+                "Unable to load --views file: " + err);
+          }
+        }
+
+        const auto eglDevice = gpu ? args::get(gpu) : egl ? 0 : -1;
+        if (eglDevice >= 0 && !output && !views && !video) {
+          throw args::ValidationError(
+              "--egl and --gpu render without a window, they require -o, "
+              "--views or --video");
+        }
+
+        const auto captureOptions = parseCaptureOptions(capture, captureFrame);
+        if (capture && (output || views || video || gpus)) {
+          throw args::ValidationError(
+              "--capture excludes -o, --views, --video and --gpus");
+        }
+
+        if (panorama && (video || (!output && !views))) {
+          throw args::ValidationError(
+              "--panorama requires -o or --views and excludes --video");
+        }
+
+        PathTraceOptions pathTrace;
+        pathTrace.samples =
+            pathTraceSamples ? args::get(pathTraceSamples) : 0;
+        pathTrace.seconds =
+            pathTraceSeconds ? args::get(pathTraceSeconds) : 0.f;
+        if (pathTraceBounces) {
+          pathTrace.bounces = args::get(pathTraceBounces);
+        }
+        if (pathTrace.samples < 0 || pathTrace.seconds < 0 ||
+            pathTrace.bounces < 0) {
+          throw args::ValidationError("--path-trace-samples, "
+                                      "--path-trace-seconds and "
+                                      "--path-trace-bounces must not be "
+                                      "negative");
+        }
+        if (pathTrace.enabled() &&
+            (video || panorama || (!output && !views))) {
+          throw args::ValidationError("Path tracing requires -o or --views "
+                                      "and excludes --video and --panorama");
+        }
+
+        std::vector<int> gpuDevices;
+        if (gpus) {
+          if (!views || video || gpu || statsCsv) {
+            throw args::ValidationError("--gpus requires --views and excludes "
+                                        "--video, --gpu and --stats-csv");
+          }
+          for (const auto &token : split(args::get(gpus), ",")) {
+            const auto device = std::stoi(token);
+            if (device < 0 || std::find(gpuDevices.begin(), gpuDevices.end(),
+                                  device) != gpuDevices.end()) {
+              throw args::ValidationError(
+                  "--gpus indices must be distinct and not negative");
+            }
+            gpuDevices.emplace_back(device);
+          }
+        }
+
+        FramePacing pacing;
+        if (vsync) {
+          const auto &mode = args::get(vsync);
+          if (mode == "on") {
+            pacing.vsync = VSyncMode::On;
+          } else if (mode == "adaptive") {
+            pacing.vsync = VSyncMode::Adaptive;
+          } else if (mode != "off") {
+            throw args::ValidationError(
+                "--vsync must be on, off or adaptive, got " + mode);
+          }
+        }
+        pacing.maxFps = maxFps ? args::get(maxFps) : 0.f;
+        const auto inFlight = framesInFlight ? args::get(framesInFlight) : 0;
+        if (pacing.maxFps < 0 || inFlight < 0) {
+          throw args::ValidationError(
+              "--max-fps and --frames-in-flight must not be negative");
+        }
+        pacing.maxFramesInFlight = size_t(inFlight);
+        pacing.targetFrameMs = targetFrameMs ? args::get(targetFrameMs) : 0.f;
+        if (pacing.targetFrameMs < 0) {
+          throw args::ValidationError("--target-frame-ms must not be negative");
+        }
+        pacing.renderThread = !singleThread;
+
+        TonemapOptions tonemapOptions;
+        if (tonemap &&
+            !parseTonemapOperator(args::get(tonemap), tonemapOptions.op)) {
+          throw args::ValidationError(
+              "--tonemap must be neutral, aces, reinhard or none, got " +
+              args::get(tonemap));
+        }
+        tonemapOptions.exposure = exposure ? args::get(exposure) : 1.f;
+        if (tonemapOptions.exposure <= 0) {
+          throw args::ValidationError("--exposure must be positive");
+        }
+        tonemapOptions.bloom = bloom ? args::get(bloom) : 0.f;
+        if (tonemapOptions.bloom < 0) {
+          throw args::ValidationError("--bloom must not be negative");
+        }
+
+        GeometryOptions geometryOptions;
+        geometryOptions.optimize = optimizeMeshes;
+        geometryOptions.weldVertices = weldVertices;
+        geometryOptions.quantize = quantizeVertices;
+        geometryOptions.lodCount = lods ? std::max(args::get(lods), 0) : 0;
+        geometryOptions.meshlets = meshlets;
+        geometryOptions.staticBatching = staticBatching;
+        geometryOptions.mergeSmallPrimitives = mergeSmallPrimitives;
+        geometryOptions.cache = !noGeometryCache;
+        geometryOptions.occlusionRays =
+            bakedOcclusion ? args::get(bakedOcclusion) : 0;
+        if (geometryOptions.occlusionRays < 0) {
+          throw args::ValidationError("--baked-occlusion must not be negative");
+        }
+        geometryOptions.visibleSetCellSize =
+            visibleSets ? args::get(visibleSets) : 0.f;
+        if (geometryOptions.visibleSetCellSize < 0.f) {
+          throw args::ValidationError("--visible-sets must not be negative");
+        }
+
+        TilesetOptions tilesetOptions;
+        if (tileError) {
+          tilesetOptions.maxErrorPixels = args::get(tileError);
+        }
+        if (tileBudget) {
+          tilesetOptions.budgetMB = args::get(tileBudget);
+        }
+        if (tilesetOptions.maxErrorPixels <= 0 || tilesetOptions.budgetMB < 0) {
+          throw args::ValidationError("--tile-error must be positive and "
+                                      "--tile-budget-mb not negative");
+        }
+
+        // Images are the same on every machine unless asked otherwise
+        const auto qualityTier = parseQualityOption(quality,
+            !output && !views && !video && !capture,
+            gpuDevices.empty() ? eglDevice : gpuDevices.front());
+        const auto presetOptions = parsePresetOption(preset, qualityTier);
+        const auto iblOptions = parseIblOptions(
+            iblSizes ? args::get(iblSizes) : presetOptions.iblSizes,
+            prefilterLevels ? args::get(prefilterLevels) : 0,
+            fastIblBake || presetOptions.fastIblBake, compressIbl);
+
+        const auto mipFilterOption = parseMipFilterOption(mipFilter);
+
+        const auto presetSize = presetOptions.imageSize;
+        uint32_t width = imageWidth ? args::get(imageWidth)
+                         : presetSize ? presetSize
+                                      : 1280;
+        uint32_t height = imageHeight ? args::get(imageHeight)
+                          : presetSize ? presetSize
+                                       : 720;
+
+        const auto runViewer = [&](int device, ViewScheduler *scheduler,
+                                   size_t renderer) {
+          ViewerApplication app{fs::path{argv[0]}, width, height,
+              args::get(file), args::get(cube), lookatParams,
+              args::get(vertexShader), args::get(fragmentShader),
+              args::get(output), exactBounds, geometryOptions,
+              tilesetOptions, iblOptions,
+              textureBudget ? args::get(textureBudget) : 0.f, lazyTextures,
+              maxTextureSize ? args::get(maxTextureSize)
+                             : presetOptions.maxTextureSize,
+              presetOptions.detailMaps, halfPrecision, !noShadingLod,
+              mipFilterOption, tinygltfParser ? GltfParser::Tinygltf : GltfParser::SinglePass,
+              // Jittered samples anti-alias path traced images
+              pathTrace.enabled() ? 1 : samples ? args::get(samples) : 1, taa,
+              gpuCulling, visibilityBuffer, vertexPulling, tonemapOptions,
+              tileSize ? args::get(tileSize) : 0,
+              panorama, pathTrace, device, onDemand, hideGui,
+              pacing,
+              statsCsv ? args::get(statsCsv) : "", renderViews, videoOutput,
+              {}, captureOptions, qualityTier, false, nullptr, scheduler,
+              renderer};
+          return app.run();
+        };
+
+        if (trace) {
+#ifndef GLMLV_ENABLE_TRACE
+          std::cerr << "Trace zones are compiled out, --trace only records "
+                       "an empty trace\n";
+#endif
+          std::string err;
+          if (!startTrace(args::get(trace), err)) {
+            throw args::ValidationError(err);
+          }
+        }
+        const auto writeTrace = [&]() {
+          std::string err;
+          if (!stopTrace(err)) {
+            std::cerr << err << std::endl;
+            returnCode = 1;
+          }
+        };
+
+        if (gpuDevices.empty()) {
+          returnCode = runViewer(eglDevice, nullptr, 0);
+          writeTrace();
+          return;
+        }
+
+        // One renderer per GPU, each on its own thread and context
+        ViewScheduler scheduler{renderViews.size(), gpuDevices.size()};
+        std::vector<int> returnCodes(gpuDevices.size(), 0);
+        std::vector<std::thread> renderers;
+        for (size_t i = 0; i < gpuDevices.size(); ++i) {
+          renderers.emplace_back([&, i]() {
+            scheduler.waitForTurn(i);
+            try {
+              returnCodes[i] = runViewer(gpuDevices[i], &scheduler, i);
+            } catch (const std::exception &e) {
+              std::cerr << "GPU " << gpuDevices[i] << ": " << e.what()
+                        << std::endl;
+              returnCodes[i] = 1;
+              scheduler.loaded(i);
+            }
+          });
+        }
+        for (auto &renderer : renderers) {
+          renderer.join();
+        }
+
+        const auto taken = scheduler.takenCounts();
+        for (size_t i = 0; i < gpuDevices.size(); ++i) {
+          std::clog << "GPU " << gpuDevices[i] << ": " << taken[i]
+                    << " views\n";
+          if (returnCodes[i] != 0) {
+            returnCode = 1;
+          }
+        }
+        writeTrace();
+      }};
+
+  args::Command bench{commands, "bench",
+      "Time the frames of a camera path offscreen, without vsync, and report "
+      "the frame time percentiles, load times and peak memory",
+      [&](args::Subparser &parser) {
+        args::Positional<std::string> file{
+            parser, "file", "Path to file", args::Options::Required};
+        args::Positional<std::string> cube{
+            parser, "cube", "Path to cubemap file"};
+        args::ValueFlag<int32_t> imageWidth{
+            parser, "width", "Width of the frames", {"w", "width"}};
+        args::ValueFlag<int32_t> imageHeight{
+            parser, "height", "Height of the frames", {"h", "height"}};
+        args::ValueFlag<int> frames{parser, "frames",
+            "Frames to time, 500 by default", {"frames"}};
+        args::ValueFlag<int> warmup{parser, "warmup",
+            "Frames drawn before timing, 30 by default", {"warmup"}};
+        args::ValueFlag<std::string> views{parser, "views",
+            "File of camera views, in the format of viewer --views, to "
+            "interpolate the path of the frames through. Recorded paths keep "
+            "their timing. Without it the camera orbits the scene.",
+            {"views"}};
+        args::ValueFlag<std::string> report{parser, "report",
+            "Write the report to this file, JSON if it ends with .json and "
+            "CSV otherwise. CSV on stdout by default.",
+            {"report"}};
+        args::ValueFlag<float> textureBudget{parser, "texture-budget-mb",
+            "Memory budget of material textures in MB, see viewer",
+            {"texture-budget-mb"}};
+        args::Flag lazyTextures{parser, "lazy-textures",
+            "Decode images on first use, see viewer", {"lazy-textures"}};
+        args::ValueFlag<int> maxTextureSize{parser, "size",
+            "Largest side of material textures, see viewer",
+            {"max-texture-size"}};
+        args::ValueFlag<std::string> preset{parser, "preset",
+            "Defaults of the options for a kind of render, see viewer. "
+            "thumbnail also times a single frame without warmup, so that the "
+            "load times report the wall time of a thumbnail.",
+            {"preset"}};
+        args::Flag halfPrecision{parser, "half-precision",
+            "Shade with 16 bit floats, see viewer", {"half-precision"}};
+        args::Flag noShadingLod{parser, "no-shading-lod",
+            "Shade every draw with the full permutation, see viewer",
+            {"no-shading-lod"}};
+        args::ValueFlag<std::string> mipFilter{parser, "filter",
+            "Filter of the generated mip levels, see viewer", {"mip-filter"}};
+        args::Flag tinygltfParser{parser, "tinygltf",
+            "Parse the glTF JSON with tinygltf, see viewer", {"tinygltf"}};
+        args::ValueFlag<std::string> iblSizes{parser, "sizes",
+            "Sizes of the environment maps, see viewer", {"ibl-sizes"}};
+        args::ValueFlag<int> prefilterLevels{parser, "levels",
+            "Mip levels of the prefiltered environment map, see viewer",
+            {"prefilter-levels"}};
+        args::Flag fastIblBake{parser, "fast-ibl-bake",
+            "Bake the environment maps with fewer samples, see viewer",
+            {"fast-ibl-bake"}};
+        args::Flag compressIbl{parser, "compress-ibl",
+            "Compress the environment maps to BC6H, see viewer",
+            {"compress-ibl"}};
+        args::ValueFlag<int> samples{
+            parser, "samples", "Samples per pixel", {"samples"}};
+        args::Flag optimizeMeshes{parser, "optimize-meshes",
+            "Reorder triangles and vertices at load time, see viewer",
+            {"optimize-meshes"}};
+        args::Flag weldVertices{parser, "weld-vertices",
+            "Merge equal vertices at load time, see viewer",
+            {"weld-vertices"}};
+        args::Flag quantizeVertices{parser, "quantize-vertices",
+            "Quantize positions, normals and texture coordinates, see viewer",
+            {"quantize-vertices"}};
+        args::ValueFlag<int> lods{parser, "count",
+            "Levels of detail generated per triangle list, see viewer",
+            {"lods"}};
+        args::Flag meshlets{parser, "meshlets",
+            "Cull meshlets on the GPU, see viewer", {"meshlets"}};
+        args::Flag gpuCulling{parser, "gpu-culling",
+            "Cull the draws on the GPU, see viewer", {"gpu-culling"}};
+        args::Flag visibilityBuffer{parser, "visibility-buffer",
+            "Shade the opaque draws from a visibility buffer, see viewer",
+            {"visibility-buffer"}};
+        args::Flag vertexPulling{parser, "vertex-pulling",
+            "Pull the vertices from storage buffers, see viewer",
+            {"vertex-pulling"}};
+        args::Flag staticBatching{parser, "static-batching",
+            "Merge the static nodes per material, see viewer",
+            {"static-batching"}};
+        args::Flag mergeSmallPrimitives{parser, "merge-small-primitives",
+            "Merge the small primitives per material, see viewer",
+            {"merge-small-primitives"}};
+        args::Flag noGeometryCache{parser, "no-geometry-cache",
+            "Pack the geometry again, see viewer", {"no-geometry-cache"}};
+        args::Flag egl{parser, "egl",
+            "Render with a headless EGL context, without a window or X server",
+            {"egl"}};
+        args::ValueFlag<int> gpu{parser, "gpu",
+            "Index of the EGL device to render on, implies --egl", {"gpu"}};
+        args::ValueFlag<std::string> capture{parser, "capture",
+            "Record the GL calls of a frame to this file, see viewer",
+            {"capture"}};
+        args::ValueFlag<int> captureFrame{parser, "frame",
+            "Frames drawn before the one of --capture, warmup included, 0 by "
+            "default",
+            {"capture-frame"}};
+        args::ValueFlag<int> jobWorkers{parser, "count",
+            "Worker threads of the jobs, see viewer", {"jobs"}};
+        args::ValueFlag<std::string> quality{parser, "tier",
+            "Quality tier giving the defaults of the options, see viewer. "
+            "high by default, so that reports compare across machines.",
+            {"quality"}};
+        args::ValueFlag<int> heapSampling{parser, "KB",
+            "Sample the call stacks of the heap allocations, see viewer",
+            {"heap-sampling"}};
+        parser.Parse();
+        setJobWorkers(jobWorkers);
+        setHeapSamplingOption(heapSampling);
+
+        const auto eglDevice = gpu ? args::get(gpu) : egl ? 0 : -1;
+        const auto qualityTier = parseQualityOption(quality, false, eglDevice);
+        const auto presetOptions = parsePresetOption(preset, qualityTier);
+        const auto captureOptions = parseCaptureOptions(capture, captureFrame);
+        BenchOptions options;
+        const auto frameCount = frames ? args::get(frames)
+                                : presetOptions.benchFrames > 0
+                                    ? presetOptions.benchFrames
+                                    : 500;
+        const auto warmupCount = warmup ? args::get(warmup)
+                                 : presetOptions.benchWarmup >= 0
+                                     ? presetOptions.benchWarmup
+                                     : 30;
+        if (frameCount <= 0 || warmupCount < 0) {
+          throw args::ValidationError(
+              "--frames must be positive and --warmup not negative");
+        }
+        options.frames = size_t(frameCount);
+        options.warmupFrames = size_t(warmupCount);
+        options.report = report ? args::get(report) : "";
+        GeometryOptions geometryOptions;
+        geometryOptions.optimize = optimizeMeshes;
+        geometryOptions.weldVertices = weldVertices;
+        geometryOptions.quantize = quantizeVertices;
+        geometryOptions.lodCount = lods ? std::max(args::get(lods), 0) : 0;
+        geometryOptions.meshlets = meshlets;
+        geometryOptions.staticBatching = staticBatching;
+        geometryOptions.mergeSmallPrimitives = mergeSmallPrimitives;
+        geometryOptions.cache = !noGeometryCache;
+        const auto iblOptions = parseIblOptions(
+            iblSizes ? args::get(iblSizes) : presetOptions.iblSizes,
+            prefilterLevels ? args::get(prefilterLevels) : 0,
+            fastIblBake || presetOptions.fastIblBake, compressIbl);
+        const auto presetSize = presetOptions.imageSize;
+
+        std::vector<RenderView> renderViews;
+        if (views) {
+          // The output paths of the views are unused
+          std::string err;
+          if (!loadRenderViews(args::get(views), "-", renderViews, err)) {
+            throw args::ValidationError(
+                "Unable to load --views file: " + err);
+          }
+        }
+
+        ViewerApplication app{fs::path{argv[0]},
+            imageWidth ? uint32_t(args::get(imageWidth))
+            : presetSize ? presetSize
+                         : 1280u,
+            imageHeight ? uint32_t(args::get(imageHeight))
+            : presetSize ? presetSize
+                         : 720u,
+            args::get(file), args::get(cube), {}, "", "", "", false,
+            geometryOptions, {}, iblOptions,
+            textureBudget ? args::get(textureBudget) : 0.f, lazyTextures,
+            maxTextureSize ? args::get(maxTextureSize)
+                           : presetOptions.maxTextureSize,
+            presetOptions.detailMaps, halfPrecision, !noShadingLod,
+            parseMipFilterOption(mipFilter), tinygltfParser ? GltfParser::Tinygltf : GltfParser::SinglePass,
+            samples ? args::get(samples) : 1, false, gpuCulling,
+            visibilityBuffer, vertexPulling, {}, 0,
+            false, {}, eglDevice, false, false, {}, "", renderViews, {},
+            options, captureOptions, qualityTier};
+        returnCode = app.run();
+      }};
+
+  args::Command bake{commands, "bake",
+      "Load a model and an environment without drawing them, writing the "
+      "packed geometry, bounds and levels of detail, and the environment "
+      "maps, to the cache next to the executable. The viewer opens them "
+      "without packing or baking when given the same options.",
+      [&](args::Subparser &parser) {
+        args::Positional<std::string> file{
+            parser, "file", "Path to file", args::Options::Required};
+        args::Positional<std::string> cube{
+            parser, "cube", "Path to cubemap file"};
+        args::Flag exactBounds{parser, "exact-bounds",
+            "Compute the scene bounds from every vertex, see viewer",
+            {"exact-bounds"}};
+        args::Flag optimizeMeshes{parser, "optimize-meshes",
+            "Reorder triangles and vertices, see viewer",
+            {"optimize-meshes"}};
+        args::Flag weldVertices{parser, "weld-vertices",
+            "Merge equal vertices, see viewer", {"weld-vertices"}};
+        args::Flag quantizeVertices{parser, "quantize-vertices",
+            "Quantize positions, normals and texture coordinates, see viewer",
+            {"quantize-vertices"}};
+        args::ValueFlag<int> lods{parser, "count",
+            "Levels of detail generated per triangle list, see viewer",
+            {"lods"}};
+        args::Flag meshlets{parser, "meshlets",
+            "Split triangle lists into meshlets, see viewer", {"meshlets"}};
+        args::Flag staticBatching{parser, "static-batching",
+            "Merge the static nodes per material, see viewer",
+            {"static-batching"}};
+        args::Flag mergeSmallPrimitives{parser, "merge-small-primitives",
+            "Merge the small primitives per material, see viewer",
+            {"merge-small-primitives"}};
+        args::ValueFlag<int> bakedOcclusion{parser, "rays",
+            "Bake the ambient occlusion of the vertices, see viewer",
+            {"baked-occlusion"}};
+        args::ValueFlag<float> visibleSets{parser, "cell-size",
+            "Bake the potentially visible sets of a grid of cells, see viewer",
+            {"visible-sets"}};
+        args::Flag tinygltfParser{parser, "tinygltf",
+            "Parse the glTF JSON with tinygltf, see viewer", {"tinygltf"}};
+        args::ValueFlag<std::string> iblSizes{parser, "sizes",
+            "Sizes of the environment maps, see viewer", {"ibl-sizes"}};
+        args::ValueFlag<int> prefilterLevels{parser, "levels",
+            "Mip levels of the prefiltered environment map, see viewer",
+            {"prefilter-levels"}};
+        args::Flag fastIblBake{parser, "fast-ibl-bake",
+            "Bake the environment maps with fewer samples, see viewer",
+            {"fast-ibl-bake"}};
+        args::Flag compressIbl{parser, "compress-ibl",
+            "Compress the environment maps to BC6H, see viewer",
+            {"compress-ibl"}};
+        args::Flag egl{parser, "egl",
+            "Bake with a headless EGL context, without a window or X server",
+            {"egl"}};
+        args::ValueFlag<int> gpu{parser, "gpu",
+            "Index of the EGL device to bake on, implies --egl", {"gpu"}};
+        args::ValueFlag<int> jobWorkers{parser, "count",
+            "Worker threads of the jobs, see viewer", {"jobs"}};
+        args::ValueFlag<std::string> quality{parser, "tier",
+            "Quality tier giving the defaults of the environment maps, see "
+            "viewer. high by default.",
+            {"quality"}};
+        parser.Parse();
+        setJobWorkers(jobWorkers);
+
+        GeometryOptions geometryOptions;
+        geometryOptions.optimize = optimizeMeshes;
+        geometryOptions.weldVertices = weldVertices;
+        geometryOptions.quantize = quantizeVertices;
+        geometryOptions.lodCount = lods ? std::max(args::get(lods), 0) : 0;
+        geometryOptions.meshlets = meshlets;
+        geometryOptions.staticBatching = staticBatching;
+        geometryOptions.mergeSmallPrimitives = mergeSmallPrimitives;
+        geometryOptions.occlusionRays =
+            bakedOcclusion ? std::max(args::get(bakedOcclusion), 0) : 0;
+        geometryOptions.visibleSetCellSize =
+            visibleSets ? std::max(args::get(visibleSets), 0.f) : 0.f;
+        const auto eglDevice = gpu ? args::get(gpu) : egl ? 0 : -1;
+        const auto qualityTier = parseQualityOption(quality, false, eglDevice);
+        const auto tierSettings = qualitySettings(qualityTier);
+        const auto iblOptions = parseIblOptions(
+            iblSizes ? args::get(iblSizes) : tierSettings.iblSizes,
+            prefilterLevels ? args::get(prefilterLevels) : 0,
+            fastIblBake || tierSettings.fastIblBake, compressIbl);
 
-        ViewerApplication app{fs::path{argv[0]}, width, height, args::get(file), args::get(cube),
-            lookatParams, args::get(vertexShader), args::get(fragmentShader),
-            args::get(output)};
+        // The window, never shown, only holds the context
+        ViewerApplication app{fs::path{argv[0]}, 1, 1, args::get(file),
+            args::get(cube), {}, "", "", "", exactBounds, geometryOptions,
+            {}, iblOptions, 0.f, false, 0, true, false, true, MipFilter::Box,
+            tinygltfParser ? GltfParser::Tinygltf : GltfParser::SinglePass, 1,
+            false, false, false, false, {}, 0, false, {}, eglDevice, false,
+            false, {}, "", {}, {}, {}, {}, qualityTier, true};
         returnCode = app.run();
       }};
 
+  args::Command serve{commands, "serve",
+      "Render JSON requests read from stdin, one per line, keeping the "
+      "model, programs and environment maps loaded between requests",
+      [&](args::Subparser &parser) {
+        args::ValueFlag<std::string> socketPath{parser, "socket",
+            "Path of a UNIX socket to accept requests on instead of stdin",
+            {"socket"}};
+        args::ValueFlag<std::string> shmRing{parser, "name",
+            "POSIX shared memory object, such as /gltf-frames, to write the "
+            "frames of requests with \"ring\": true to, as raw RGBA8 pixels "
+            "for a consumer process mapping it. See utils/frame_ring.hpp for "
+            "its layout.",
+            {"shm-ring"}};
+        args::ValueFlag<int> shmSlots{parser, "count",
+            "Frames kept in the ring, 4 by default", {"shm-slots"}};
+        args::ValueFlag<std::string> shmMaxSize{parser, "size",
+            "Largest image of the ring as widthxheight, 2048x2048 by default",
+            {"shm-max-size"}};
+        args::Flag egl{parser, "egl",
+            "Render with a headless EGL context, without a window or X server",
+            {"egl"}};
+        args::ValueFlag<int> gpu{parser, "gpu",
+            "Index of the EGL device to render on, implies --egl", {"gpu"}};
+        args::ValueFlag<int> rendererCount{parser, "count",
+            "Renderers serving requests concurrently, each on a thread and "
+            "headless context of its own, 1 by default. Small requests are "
+            "not queued behind large ones: one renderer is kept free for "
+            "requests up to 1024x1024 pixels, samples included. Implies "
+            "--egl.",
+            {"renderers"}};
+        args::ValueFlag<int> jobWorkers{parser, "count",
+            "Worker threads of the jobs, see viewer", {"jobs"}};
+        args::ValueFlag<int> prefetchModels{parser, "count",
+            "Models of the requests already received loaded ahead while the "
+            "current one renders, 1 by default, 0 to load each when its "
+            "renderer starts",
+            {"prefetch"}};
+        args::ValueFlag<float> prefetchBudget{parser, "MB",
+            "Memory of the models loaded ahead, no more is loaded past it, "
+            "1024 by default",
+            {"prefetch-budget"}};
+        args::ValueFlag<float> resultCacheMB{parser, "MB",
+            "Keep the images rendered in cache/renders next to the executable, "
+            "up to this size, and answer identical requests from them without "
+            "rendering. Requests are identical if the bytes of their model, "
+            "buffers, images and environment, their camera, size, samples and "
+            "output format, the shaders and the executable are. The least "
+            "recently used images are evicted first.",
+            {"result-cache"}};
+        parser.Parse();
+        setJobWorkers(jobWorkers);
+        const auto renderers = rendererCount ? args::get(rendererCount) : 1;
+        if (renderers <= 0) {
+          throw args::ValidationError("--renderers must be positive");
+        }
+        // Windows are not created from several threads
+        const auto eglDevice =
+            gpu ? args::get(gpu) : (egl || renderers > 1) ? 0 : -1;
+
+        PrefetchOptions prefetch;
+        if (prefetchModels) {
+          if (args::get(prefetchModels) < 0) {
+            throw args::ValidationError("--prefetch must not be negative");
+          }
+          prefetch.models = size_t(args::get(prefetchModels));
+        }
+        if (prefetchBudget) {
+          if (args::get(prefetchBudget) <= 0) {
+            throw args::ValidationError("--prefetch-budget must be positive");
+          }
+          prefetch.budgetBytes =
+              size_t(double(args::get(prefetchBudget)) * 1024 * 1024);
+        }
+
+        const auto slotCount = shmSlots ? args::get(shmSlots) : 4;
+        if (slotCount <= 0) {
+          throw args::ValidationError("--shm-slots must be positive");
+        }
+        // A frame is read back for the result cache after it is published,
+        // the frames of the other renderers must not overwrite it meanwhile
+        if (shmRing && slotCount <= renderers) {
+          throw args::ValidationError("--shm-slots must exceed --renderers");
+        }
+        size_t maxPixels = 2048 * 2048;
+        if (shmMaxSize) {
+          const auto tokens = split(args::get(shmMaxSize), "x");
+          if (tokens.size() != 2 || std::stoi(tokens[0]) <= 0 ||
+              std::stoi(tokens[1]) <= 0) {
+            throw args::ValidationError(
+                "--shm-max-size must be widthxheight, got " +
+                args::get(shmMaxSize));
+          }
+          maxPixels = size_t(std::stoi(tokens[0])) * size_t(std::stoi(tokens[1]));
+        }
+
+        RenderJobServer server;
+        std::string err;
+        if (!server.open(socketPath ? args::get(socketPath) : "", err) ||
+            (shmRing && !server.openFrameRing(args::get(shmRing),
+                            size_t(slotCount), maxPixels, err))) {
+          std::cerr << err << std::endl;
+          returnCode = 1;
+          return;
+        }
+
+        if (!resultCacheMB) {
+          serveRenderJobs(
+              fs::path{argv[0]}, eglDevice, server, prefetch, size_t(renderers));
+          return;
+        }
+        if (args::get(resultCacheMB) <= 0) {
+          throw args::ValidationError("--result-cache must be positive");
+        }
+        const fs::path appPath{argv[0]};
+        RenderResultCache resultCache{
+            appPath.parent_path() / "cache" / "renders",
+            size_t(double(args::get(resultCacheMB)) * 1024 * 1024), appPath,
+            appPath.parent_path() / "shaders"};
+        CachedJobSource cachedServer{server, resultCache};
+        serveRenderJobs(
+            appPath, eglDevice, cachedServer, prefetch, size_t(renderers));
+
+        const auto requests = resultCache.hits() + resultCache.misses();
+        std::clog << "Result cache: " << resultCache.hits() << " hits of "
+                  << requests << " requests ("
+                  << (requests ? 100. * resultCache.hits() / requests : 0.)
+                  << "%), " << resultCache.imageCount() << " images, "
+                  << resultCache.bytes() / (1024. * 1024.) << " MB"
+                  << std::endl;
+      }};
+
+  args::Command replay{commands, "replay",
+      "Replay the GL calls recorded by viewer or bench --capture: the calls "
+      "before the frame once, then the frame as many times as asked, and "
+      "report its CPU and GPU time percentiles. Compares drivers and GPUs "
+      "on the same calls, without loading or the logic of the viewer.",
+      [&](args::Subparser &parser) {
+        args::Positional<std::string> file{
+            parser, "file", "Path to the capture", args::Options::Required};
+        args::ValueFlag<int> frames{parser, "frames",
+            "Replays of the frame to time, 100 by default", {"frames"}};
+        args::ValueFlag<int> warmup{parser, "warmup",
+            "Replays of the frame before timing, 10 by default", {"warmup"}};
+        args::ValueFlag<std::string> report{parser, "report",
+            "Write the report to this file, JSON if it ends with .json and "
+            "CSV otherwise. CSV on stdout by default.",
+            {"report"}};
+        args::Flag egl{parser, "egl",
+            "Replay in a headless EGL context, without a window or X server. "
+            "Calls drawing to the window draw nothing.",
+            {"egl"}};
+        args::ValueFlag<int> gpu{parser, "gpu",
+            "Index of the EGL device to replay on, implies --egl", {"gpu"}};
+        parser.Parse();
+
+        GLReplayOptions options;
+        const auto frameCount = frames ? args::get(frames) : 100;
+        const auto warmupCount = warmup ? args::get(warmup) : 10;
+        if (frameCount <= 0 || warmupCount < 0) {
+          throw args::ValidationError(
+              "--frames must be positive and --warmup not negative");
+        }
+        options.iterations = size_t(frameCount);
+        options.warmupIterations = size_t(warmupCount);
+        options.report = report ? args::get(report) : "";
+
+        GLCaptureInfo info;
+        std::string err;
+        if (!readGLCaptureInfo(args::get(file), info, err)) {
+          std::cerr << err << std::endl;
+          returnCode = 1;
+          return;
+        }
+        // The window, never shown, has the default framebuffer of the capture
+        GLFWHandle handle(info.width, info.height, "glTF Viewer replay", false,
+            gpu ? args::get(gpu) : egl ? 0 : -1, info.samples);
+        GLReplayReport replayReport;
+        if (!replayGLCapture(
+                handle, args::get(file), options, replayReport, err) ||
+            !writeGLReplayReport(replayReport, options.report, err)) {
+          std::cerr << err << std::endl;
+          returnCode = 1;
+          return;
+        }
+        if (replayReport.renderer != replayReport.capturedRenderer) {
+          std::clog << "Captured on " << replayReport.capturedRenderer
+                    << ", replayed on " << replayReport.renderer << "\n";
+        }
+      }};
+
+  args::Command compare{commands, "compare",
+      "Compare an image to a reference one, such as renders with and without "
+      "--half-precision, and fail if they differ more than allowed",
+      [&](args::Subparser &parser) {
+        args::Positional<std::string> reference{parser, "reference",
+            "Path to the reference image", args::Options::Required};
+        args::Positional<std::string> image{
+            parser, "image", "Path to the image", args::Options::Required};
+        args::ValueFlag<float> minPsnr{parser, "dB",
+            "Lowest peak signal to noise ratio of the sRGB channels, 40 by "
+            "default",
+            {"min-psnr"}};
+        args::ValueFlag<int> maxError{parser, "error",
+            "Largest difference of a channel, in [0, 255], 255 by default",
+            {"max-error"}};
+        args::ValueFlag<float> maxFlip{parser, "error",
+            "Largest mean FLIP error, in [0, 1], 1 by default. Around 0.05 "
+            "is hard to tell apart side by side.",
+            {"max-flip"}};
+        parser.Parse();
+
+        ImageDifference difference;
+        std::string err;
+        if (!compareImageFiles(
+                args::get(reference), args::get(image), difference, err)) {
+          std::cerr << err << std::endl;
+          returnCode = 1;
+          return;
+        }
+        std::cout << difference.width << "x" << difference.height
+                  << " PSNR " << difference.psnr << " dB, max error "
+                  << difference.maxError << ", "
+                  << 100. * difference.differentPixels
+                  << "% pixels off by more than 1, FLIP " << difference.flip
+                  << std::endl;
+        if (difference.psnr < (minPsnr ? args::get(minPsnr) : 40.f) ||
+            difference.maxError > (maxError ? args::get(maxError) : 255) ||
+            difference.flip > (maxFlip ? args::get(maxFlip) : 1.f)) {
+          std::cerr << "Images differ more than allowed" << std::endl;
+          returnCode = 1;
+        }
+      }};
+
   try {
     parser.ParseCLI(argc, argv);
   } catch (const args::Completion &e) {
@@ -110,3 +1292,138 @@ std::vector<std::string> split(const std::string &str, const std::string &delim)
   } while (pos < str.length() && prev < str.length());
   return tokens;
 }
+
+IblOptions parseIblOptions(const std::string &sizes, int prefilterLevels,
+    bool fastBake, bool compressed)
+{
+  IblOptions options;
+  options.fastBake = fastBake;
+  options.compressed = compressed;
+  if (!sizes.empty()) {
+    const auto tokens = split(sizes, ",");
+    if (tokens.size() != 3 && tokens.size() != 4) {
+      throw args::ValidationError("Unable to parse --ibl-sizes argument "
+                                  "(expected 3 or 4 numbers, got " +
+                                  std::to_string(tokens.size()) + ")");
+    }
+    uint32_t *fields[] = {&options.skyboxSize, &options.irradianceMapSize,
+        &options.prefilterMapSize, &options.brdfLutSize};
+    for (size_t i = 0; i < tokens.size(); ++i) {
+      *fields[i] = uint32_t(std::max(std::stoi(tokens[i]), 0));
+    }
+  }
+
+  // The default levels are kept as long as the smallest is a texel wide
+  uint32_t maxLevels = 1;
+  while (options.prefilterMapSize >> maxLevels) {
+    ++maxLevels;
+  }
+  options.prefilterMapLevels =
+      prefilterLevels ? uint32_t(std::max(prefilterLevels, 0))
+                      : std::min(options.prefilterMapLevels, maxLevels);
+
+  std::string err;
+  if (!validIblOptions(options, err)) {
+    throw args::ValidationError(err);
+  }
+  return options;
+}
+
+void setJobWorkers(args::ValueFlag<int> &jobWorkers)
+{
+  if (!jobWorkers) {
+    return;
+  }
+  if (args::get(jobWorkers) <= 0) {
+    throw args::ValidationError("--jobs must be positive");
+  }
+  JobSystem::setSharedWorkerCount(size_t(args::get(jobWorkers)));
+}
+
+void setHeapSamplingOption(args::ValueFlag<int> &heapSampling)
+{
+  if (!heapSampling) {
+    return;
+  }
+  if (args::get(heapSampling) <= 0) {
+    throw args::ValidationError("--heap-sampling must be positive");
+  }
+  if (!setHeapSampling(size_t(args::get(heapSampling)) * 1024)) {
+    std::cerr << "--heap-sampling ignored: heap allocations are not counted "
+                 "in this build, or call stacks not captured on this "
+                 "platform\n";
+  }
+}
+
+MipFilter parseMipFilterOption(args::ValueFlag<std::string> &mipFilter)
+{
+  auto filter = MipFilter::Box;
+  if (mipFilter && !parseMipFilter(args::get(mipFilter), filter)) {
+    throw args::ValidationError(
+        "--mip-filter must be box, kaiser or lanczos, got " +
+        args::get(mipFilter));
+  }
+  return filter;
+}
+
+GLCaptureOptions parseCaptureOptions(args::ValueFlag<std::string> &capture,
+    args::ValueFlag<int> &captureFrame)
+{
+  GLCaptureOptions options;
+  if (captureFrame && args::get(captureFrame) < 0) {
+    throw args::ValidationError("--capture-frame must not be negative");
+  }
+  options.path = capture ? args::get(capture) : "";
+  options.frame = captureFrame ? size_t(args::get(captureFrame)) : 0;
+  return options;
+}
+
+RenderPreset parsePresetOption(
+    args::ValueFlag<std::string> &preset, QualityTier quality)
+{
+  RenderPreset options;
+  if (!preset) {
+    const auto settings = qualitySettings(quality);
+    options.iblSizes = settings.iblSizes;
+    options.fastIblBake = settings.fastIblBake;
+    options.maxTextureSize = settings.maxTextureSize;
+    options.detailMaps = settings.detailMaps;
+    return options;
+  }
+  const auto &name = args::get(preset);
+  if (name != "thumbnail") {
+    throw args::ValidationError("--preset must be thumbnail, got " + name);
+  }
+  // Small images of many models: every load step is cut down, details
+  // smaller than a pixel are dropped
+  options.imageSize = 256;
+  options.iblSizes = "256,16,64";
+  options.fastIblBake = true;
+  options.maxTextureSize = 512;
+  options.detailMaps = false;
+  options.benchFrames = 1;
+  options.benchWarmup = 0;
+  return options;
+}
+
+QualityTier parseQualityOption(args::ValueFlag<std::string> &quality,
+    bool autoByDefault, int eglDevice)
+{
+  const std::string name = quality ? args::get(quality)
+                           : autoByDefault ? "auto"
+                                           : "high";
+  auto tier = QualityTier::High;
+  if (name != "auto") {
+    if (!parseQualityTier(name, tier)) {
+      throw args::ValidationError(
+          "--quality must be low, medium, high or auto, got " + name);
+    }
+    return tier;
+  }
+  // Probed in a context of its own, the window picks its samples from the
+  // tier
+  GLFWHandle handle{1, 1, "", false, eglDevice, 0};
+  const auto probe = probeQualityTier();
+  printQualityProbe(probe, std::clog);
+  return probe.tier;
+}
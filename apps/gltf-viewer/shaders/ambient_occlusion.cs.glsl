@@ -0,0 +1,170 @@
+#version 430
+
+// One invocation per texel of the half resolution ambient occlusion, see
+// utils/ambient_occlusion.hpp. Ground truth ambient occlusion (Jimenez et al.
+// 2016): in each of AO_SLICES planes containing the view direction, the
+// horizons of both sides are searched in AO_STEPS depth samples and the
+// cosine weighted visibility between them integrated analytically. The slice
+// directions and sample distances rotate over a 4x4 pattern, averaged away by
+// ambient_occlusion_blur.cs.glsl.
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+
+#define AO_SLICES 2
+#define AO_STEPS 4
+// Of the search, in half resolution texels, caps the cache misses of near
+// surfaces
+#define AO_MAX_RADIUS_TEXELS 48.0
+
+const float PI = 3.14159265359;
+
+// GL_R32F view space depths of ambient_occlusion_depth.cs.glsl
+uniform sampler2D uHalfDepth;
+// Diagonal of the projection matrix, x and y
+uniform vec2 uProjScale;
+// Shift of an off-center projection, of the tiles of tiled renders
+uniform vec2 uProjOffset;
+// Of the scene, in pixels. The targets may be larger.
+uniform vec2 uViewportSize;
+// View space distance the occluders are searched within
+uniform float uRadius;
+
+layout(r8, binding = 0) writeonly uniform image2D uOcclusion;
+
+// Thresholds of the 4x4 ordered dither matrix, rotation of the slices
+const float DITHER[16] = float[16](
+	0.0, 8.0, 2.0, 10.0,
+	12.0, 4.0, 14.0, 6.0,
+	3.0, 11.0, 1.0, 9.0,
+	15.0, 7.0, 13.0, 5.0);
+
+ivec2 halfSize;
+
+// At the center of the 2x2 pixels of the texel
+vec3 viewPosition(ivec2 texel)
+{
+	texel = clamp(texel, ivec2(0), halfSize - 1);
+	float depth = texelFetch(uHalfDepth, texel, 0).r;
+	vec2 ndc = 2.0 * vec2(2 * texel + 1) / uViewportSize - 1.0;
+	return vec3((ndc + uProjOffset) * depth / uProjScale, -depth);
+}
+
+bool onScreen(ivec2 texel)
+{
+	return all(greaterThanEqual(texel, ivec2(0)))
+		&& all(lessThan(texel, halfSize));
+}
+
+void main()
+{
+	halfSize = (ivec2(uViewportSize) + 1) / 2;
+	ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+	if (any(greaterThanEqual(texel, halfSize)))
+	{
+		return;
+	}
+
+	vec3 position = viewPosition(texel);
+	vec3 viewVec = normalize(-position);
+
+	// Normal from the nearest depth differences of each axis, so that it
+	// stays the one of the surface at its edges, and from the neighbors on
+	// the screen at its borders
+	vec3 left = viewPosition(texel - ivec2(1, 0));
+	vec3 right = viewPosition(texel + ivec2(1, 0));
+	vec3 down = viewPosition(texel - ivec2(0, 1));
+	vec3 up = viewPosition(texel + ivec2(0, 1));
+	vec3 dx = texel.x == 0
+			|| (texel.x + 1 < halfSize.x
+				&& abs(right.z - position.z) < abs(position.z - left.z))
+		? right - position
+		: position - left;
+	vec3 dy = texel.y == 0
+			|| (texel.y + 1 < halfSize.y
+				&& abs(up.z - position.z) < abs(position.z - down.z))
+		? up - position
+		: position - down;
+	vec3 normal = normalize(cross(dx, dy));
+
+	// Texels covered by the radius at the depth of the texel
+	float radiusTexels = min(
+		0.25 * uRadius * uProjScale.x * uViewportSize.x / -position.z,
+		AO_MAX_RADIUS_TEXELS);
+	if (radiusTexels < 1.0)
+	{
+		imageStore(uOcclusion, texel, vec4(1.0));
+		return;
+	}
+
+	// Occluders fade out over the outer part of the radius
+	float falloffRange = 0.6 * uRadius;
+	float falloffMul = -1.0 / falloffRange;
+	float falloffAdd = (uRadius - falloffRange) / falloffRange + 1.0;
+
+	ivec2 ditherTexel = texel & 3;
+	float rotation = DITHER[ditherTexel.x + 4 * ditherTexel.y] / 16.0;
+	ditherTexel = (texel + ivec2(1, 2)) & 3;
+	float stepOffset = DITHER[ditherTexel.x + 4 * ditherTexel.y] / 16.0;
+
+	float visibility = 0.0;
+	for (int slice = 0; slice < AO_SLICES; ++slice)
+	{
+		float phi = (float(slice) + rotation) * PI / float(AO_SLICES);
+		vec2 omega = vec2(cos(phi), sin(phi));
+
+		// Slice plane, and the angle of the normal projected on it
+		vec3 directionVec = vec3(omega, 0.0);
+		vec3 orthoDirectionVec =
+			directionVec - dot(directionVec, viewVec) * viewVec;
+		vec3 axisVec = normalize(cross(orthoDirectionVec, viewVec));
+		vec3 projectedNormal = normal - axisVec * dot(normal, axisVec);
+		float projectedNormalLength = length(projectedNormal);
+		float signNormal = sign(dot(orthoDirectionVec, projectedNormal));
+		float cosNormal = clamp(
+			dot(projectedNormal, viewVec) / max(projectedNormalLength, 1e-5),
+			0.0,
+			1.0);
+		float n = signNormal * acos(cosNormal);
+
+		// Horizons start at the tangent plane, towards omega then away
+		float lowCos0 = cos(n + 0.5 * PI);
+		float lowCos1 = cos(n - 0.5 * PI);
+		float horizonCos0 = lowCos0;
+		float horizonCos1 = lowCos1;
+		for (int i = 0; i < AO_STEPS; ++i)
+		{
+			float s = (float(i) + stepOffset) / float(AO_STEPS);
+			// first samples nearer, where occluders matter most
+			s = s * s;
+			ivec2 offset = ivec2(round(omega * max(s * radiusTexels, 1.0)));
+
+			// samples off the screen do not occlude
+			ivec2 sample0 = texel + offset;
+			ivec2 sample1 = texel - offset;
+			vec3 delta0 = viewPosition(sample0) - position;
+			vec3 delta1 = viewPosition(sample1) - position;
+			float length0 = length(delta0);
+			float length1 = length(delta1);
+			float weight0 = onScreen(sample0)
+				? clamp(length0 * falloffMul + falloffAdd, 0.0, 1.0)
+				: 0.0;
+			float weight1 = onScreen(sample1)
+				? clamp(length1 * falloffMul + falloffAdd, 0.0, 1.0)
+				: 0.0;
+			float cos0 = dot(delta0, viewVec) / max(length0, 1e-5);
+			float cos1 = dot(delta1, viewVec) / max(length1, 1e-5);
+			horizonCos0 = max(horizonCos0, mix(lowCos0, cos0, weight0));
+			horizonCos1 = max(horizonCos1, mix(lowCos1, cos1, weight1));
+		}
+
+		float h0 = -acos(horizonCos1);
+		float h1 = acos(horizonCos0);
+		h0 = n + clamp(h0 - n, -0.5 * PI, 0.5 * PI);
+		h1 = n + clamp(h1 - n, -0.5 * PI, 0.5 * PI);
+		float arc0 = cosNormal + 2.0 * h0 * sin(n) - cos(2.0 * h0 - n);
+		float arc1 = cosNormal + 2.0 * h1 * sin(n) - cos(2.0 * h1 - n);
+		visibility += 0.25 * projectedNormalLength * (arc0 + arc1);
+	}
+	visibility /= float(AO_SLICES);
+
+	imageStore(uOcclusion, texel, vec4(clamp(visibility, 0.0, 1.0)));
+}
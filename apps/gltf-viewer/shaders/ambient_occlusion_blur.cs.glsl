@@ -0,0 +1,48 @@
+#version 430
+
+// One invocation per texel of the half resolution ambient occlusion, see
+// utils/ambient_occlusion.hpp. Averages the 5x5 texels around it, the outer
+// rows and columns at half weight so that each phase of the 4x4 noise pattern
+// of ambient_occlusion.cs.glsl weighs the same, and texels at other depths
+// less.
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+
+// Relative depth difference at which texels stop contributing
+#define AO_BLUR_DEPTH_TOLERANCE 0.05
+
+uniform sampler2D uHalfDepth;
+uniform sampler2D uRawOcclusion;
+// Of the scene, in pixels. The targets may be larger.
+uniform vec2 uViewportSize;
+
+layout(r8, binding = 0) writeonly uniform image2D uOcclusion;
+
+void main()
+{
+	ivec2 size = (ivec2(uViewportSize) + 1) / 2;
+	ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+	if (any(greaterThanEqual(texel, size)))
+	{
+		return;
+	}
+
+	float depth = texelFetch(uHalfDepth, texel, 0).r;
+	float tolerance = AO_BLUR_DEPTH_TOLERANCE * depth;
+	float sum = 0.0;
+	float weightSum = 0.0;
+	for (int y = -2; y <= 2; ++y)
+	{
+		for (int x = -2; x <= 2; ++x)
+		{
+			ivec2 neighbor = clamp(texel + ivec2(x, y), ivec2(0), size - 1);
+			float neighborDepth = texelFetch(uHalfDepth, neighbor, 0).r;
+			float weight = (abs(x) == 2 ? 0.5 : 1.0) * (abs(y) == 2 ? 0.5 : 1.0)
+				* clamp(1.0 - abs(neighborDepth - depth) / tolerance, 0.0, 1.0);
+			sum += weight * texelFetch(uRawOcclusion, neighbor, 0).r;
+			weightSum += weight;
+		}
+	}
+
+	// the texel itself always weighs 1
+	imageStore(uOcclusion, texel, vec4(sum / weightSum));
+}
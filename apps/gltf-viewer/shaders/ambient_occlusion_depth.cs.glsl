@@ -0,0 +1,52 @@
+#version 430
+
+// One invocation per texel of the half resolution view space depths of
+// screen-space ambient occlusion, from the 2x2 pixels of the depth pre-pass it
+// covers, see utils/ambient_occlusion.hpp. Texels alternate the nearest and
+// farthest of them in a checkerboard so that thin edges keep both sides.
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+
+uniform sampler2D uDepth;
+uniform sampler2DMS uDepthMS;
+// Samples of uDepthMS, uDepth is read instead if 0. Sample 0 stands for
+// the pixel.
+uniform int uSamples;
+// Of the scene, in pixels
+uniform vec2 uViewportSize;
+// 1 / view space depth is x * depth + y, clamped to the far plane 1 / z, see
+// FrameConstants in pbr_directional_light.fs.glsl
+uniform vec3 uInverseDepth;
+
+layout(r32f, binding = 0) writeonly uniform image2D uHalfDepth;
+
+float fetchDepth(ivec2 pixel)
+{
+	pixel = min(pixel, ivec2(uViewportSize) - 1);
+	return uSamples > 0
+		? texelFetch(uDepthMS, pixel, 0).r
+		: texelFetch(uDepth, pixel, 0).r;
+}
+
+void main()
+{
+	ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+	if (any(greaterThanEqual(texel, (ivec2(uViewportSize) + 1) / 2)))
+	{
+		return;
+	}
+
+	ivec2 pixel = 2 * texel;
+	vec4 depths = vec4(
+		fetchDepth(pixel),
+		fetchDepth(pixel + ivec2(1, 0)),
+		fetchDepth(pixel + ivec2(0, 1)),
+		fetchDepth(pixel + ivec2(1, 1)));
+	// In view space, window depths decrease with the distance if reversed
+	depths = 1.0 / max(
+		depths * uInverseDepth.x + uInverseDepth.y,
+		vec4(uInverseDepth.z));
+	float viewDepth = ((texel.x + texel.y) & 1) != 0
+		? max(max(depths.x, depths.y), max(depths.z, depths.w))
+		: min(min(depths.x, depths.y), min(depths.z, depths.w));
+	imageStore(uHalfDepth, texel, vec4(viewDepth));
+}
@@ -0,0 +1,138 @@
+#version 430
+
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+
+// One invocation per 4x4 block of a level of a cube map, see utils/bc6h.hpp,
+// gl_GlobalInvocationID.z is the face. Blocks are encoded in mode 11 of BC6H
+// unsigned: a single line of 10 bit endpoints, spanning the bounds of the
+// texels, and 4 bit indices along it. Endpoints and texels are compared as the
+// bits of their halfs, about their logarithm, as the format interpolates them.
+layout(rgba16f, binding = 0) uniform readonly imageCube uSource;
+uniform int uSize; // Of the level
+
+// Blocks of each face in rows, the faces one after the other, as read by
+// glCompressedTexSubImage2D
+layout(std430, binding = 0) writeonly buffer Blocks
+{
+	uvec4 blocks[];
+};
+
+// Of the 4 bit indices, in 64ths from the first endpoint to the second
+const float WEIGHTS[16] = float[16](
+	0.0, 4.0, 9.0, 13.0, 17.0, 21.0, 26.0, 30.0,
+	34.0, 38.0, 43.0, 47.0, 51.0, 55.0, 60.0, 64.0);
+
+// Largest finite half
+const float MAX_HALF = 65504.0;
+
+vec3 halfBits(vec3 color)
+{
+	color = clamp(color, vec3(0.0), vec3(MAX_HALF));
+	return vec3(
+		packHalf2x16(vec2(color.r, 0.0)),
+		packHalf2x16(vec2(color.g, 0.0)),
+		packHalf2x16(vec2(color.b, 0.0)));
+}
+
+// 10 bit endpoint whose unquantized value is the closest to half bits, and
+// the half bits it decodes to
+uvec3 quantize(vec3 bits)
+{
+	return uvec3(clamp(round((bits - 15.5) / 31.0), vec3(0.0), vec3(1023.0)));
+}
+
+vec3 unquantize(uvec3 endpoint)
+{
+	vec3 bits = vec3((endpoint * 64u + 32u) * 31u / 64u);
+	return mix(
+		mix(bits, vec3(0.0), equal(endpoint, uvec3(0u))),
+		vec3(31743.0),
+		equal(endpoint, uvec3(1023u)));
+}
+
+void putBits(inout uvec4 block, inout uint offset, uint value, uint count)
+{
+	uint word = offset / 32u;
+	uint shift = offset % 32u;
+	block[word] |= value << shift;
+	if (shift + count > 32u)
+	{
+		block[word + 1u] |= value >> (32u - shift);
+	}
+	offset += count;
+}
+
+void main()
+{
+	ivec3 blockCoords = ivec3(gl_GlobalInvocationID);
+	int blocksPerRow = (uSize + 3) / 4;
+	if (any(greaterThanEqual(blockCoords.xy, ivec2(blocksPerRow))))
+	{
+		return;
+	}
+
+	// Levels smaller than a block repeat their last texels
+	vec3 texels[16];
+	vec3 low = vec3(MAX_HALF);
+	vec3 high = vec3(0.0);
+	for (int i = 0; i < 16; ++i)
+	{
+		ivec2 texel = min(4 * blockCoords.xy + ivec2(i % 4, i / 4), ivec2(uSize - 1));
+		texels[i] = halfBits(imageLoad(uSource, ivec3(texel, blockCoords.z)).rgb);
+		low = min(low, texels[i]);
+		high = max(high, texels[i]);
+	}
+
+	uvec3 endpoints[2] = uvec3[2](quantize(low), quantize(high));
+	vec3 first = unquantize(endpoints[0]);
+	vec3 axis = unquantize(endpoints[1]) - first;
+	float axisLength2 = dot(axis, axis);
+
+	uint indices[16];
+	for (int i = 0; i < 16; ++i)
+	{
+		float t = axisLength2 > 0.0
+			? 64.0 * dot(texels[i] - first, axis) / axisLength2
+			: 0.0;
+		uint index = 0u;
+		for (uint w = 1u; w < 16u; ++w)
+		{
+			if (abs(WEIGHTS[w] - t) < abs(WEIGHTS[index] - t))
+			{
+				index = w;
+			}
+		}
+		indices[i] = index;
+	}
+
+	// The index of the first texel is stored without its high bit, swap the
+	// endpoints if it is set. The weights are symmetric.
+	if (indices[0] >= 8u)
+	{
+		endpoints = uvec3[2](endpoints[1], endpoints[0]);
+		for (int i = 0; i < 16; ++i)
+		{
+			indices[i] = 15u - indices[i];
+		}
+	}
+
+	uvec4 block = uvec4(0u);
+	uint offset = 0u;
+	putBits(block, offset, 3u, 5u); // Mode 11
+	for (int e = 0; e < 2; ++e)
+	{
+		for (int c = 0; c < 3; ++c)
+		{
+			putBits(block, offset, endpoints[e][c], 10u);
+		}
+	}
+	putBits(block, offset, indices[0], 3u);
+	for (int i = 1; i < 16; ++i)
+	{
+		putBits(block, offset, indices[i], 4u);
+	}
+
+	uint faceBlocks = uint(blocksPerRow * blocksPerRow);
+	blocks[uint(blockCoords.z) * faceBlocks
+		+ uint(blockCoords.y * blocksPerRow + blockCoords.x)] = block;
+}
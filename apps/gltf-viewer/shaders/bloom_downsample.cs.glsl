@@ -0,0 +1,96 @@
+#version 430
+
+// One invocation per texel of a level of the bloom mip chain, downsampled
+// from the scene or from the level above, see utils/bloom.hpp
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+
+// Linear radiance of the scene, read with texelFetch, multisampled if
+// uSamples > 0. Sample 0 stands for the pixel.
+uniform sampler2D uScene;
+uniform sampler2DMS uSceneMS;
+uniform int uSamples;
+// The bloom chain, read at uSourceLevel with textureLod. The scene is read
+// instead if negative.
+uniform sampler2D uBloom;
+uniform int uSourceLevel;
+// Texels used of the source, pixels of the scene, and of the destination
+uniform vec2 uSourceSize;
+uniform vec2 uDestinationSize;
+
+layout(r11f_g11f_b10f, binding = 0) writeonly uniform image2D uDestination;
+
+vec3 fetchScene(ivec2 pixel)
+{
+	pixel = min(pixel, ivec2(uSourceSize) - 1);
+	return uSamples > 0
+		? texelFetch(uSceneMS, pixel, 0).rgb
+		: texelFetch(uScene, pixel, 0).rgb;
+}
+
+// Weight of Karis' average, bright pixels count less
+float karisWeight(vec3 color)
+{
+	return 1.0 / (1.0 + dot(color, vec3(0.2126, 0.7152, 0.0722)));
+}
+
+// Bilinear sample of the source level at position, in its texels, clamped
+// to the texels used
+vec3 sampleSource(vec2 position)
+{
+	position = clamp(position, vec2(0.5), uSourceSize - 0.5);
+	vec2 levelSize = vec2(textureSize(uBloom, uSourceLevel));
+	return textureLod(uBloom, position / levelSize, float(uSourceLevel)).rgb;
+}
+
+void main()
+{
+	ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+	if (any(greaterThanEqual(texel, ivec2(uDestinationSize))))
+	{
+		return;
+	}
+
+	vec3 color = vec3(0.0);
+	if (uSourceLevel < 0)
+	{
+		ivec2 pixel = 2 * texel;
+		vec3 colors[4] = vec3[4](
+			fetchScene(pixel),
+			fetchScene(pixel + ivec2(1, 0)),
+			fetchScene(pixel + ivec2(0, 1)),
+			fetchScene(pixel + ivec2(1, 1)));
+		float weightSum = 0.0;
+		for (int i = 0; i < 4; ++i)
+		{
+			float weight = karisWeight(colors[i]);
+			color += weight * colors[i];
+			weightSum += weight;
+		}
+		color /= weightSum;
+	}
+	else
+	{
+		// 13 taps: 4 overlapping 2x2 boxes around the center, 1/8 each, and
+		// the inner box, 1/2
+		vec2 center = 2.0 * (vec2(texel) + 0.5);
+		vec3 a = sampleSource(center + vec2(-2.0, 2.0));
+		vec3 b = sampleSource(center + vec2(0.0, 2.0));
+		vec3 c = sampleSource(center + vec2(2.0, 2.0));
+		vec3 d = sampleSource(center + vec2(-2.0, 0.0));
+		vec3 e = sampleSource(center);
+		vec3 f = sampleSource(center + vec2(2.0, 0.0));
+		vec3 g = sampleSource(center + vec2(-2.0, -2.0));
+		vec3 h = sampleSource(center + vec2(0.0, -2.0));
+		vec3 i = sampleSource(center + vec2(2.0, -2.0));
+		vec3 j = sampleSource(center + vec2(-1.0, 1.0));
+		vec3 k = sampleSource(center + vec2(1.0, 1.0));
+		vec3 l = sampleSource(center + vec2(-1.0, -1.0));
+		vec3 m = sampleSource(center + vec2(1.0, -1.0));
+		color = 0.125 * e
+			+ 0.03125 * (a + c + g + i)
+			+ 0.0625 * (b + d + f + h)
+			+ 0.125 * (j + k + l + m);
+	}
+
+	imageStore(uDestination, texel, vec4(color, 1.0));
+}
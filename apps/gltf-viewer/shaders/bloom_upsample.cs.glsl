@@ -0,0 +1,45 @@
+#version 430
+
+// One invocation per texel of a level of the bloom mip chain, adding to it
+// the level below upsampled with a 3x3 tent filter, see utils/bloom.hpp
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+
+// The bloom chain, read at uSourceLevel with textureLod
+uniform sampler2D uBloom;
+uniform int uSourceLevel;
+// Texels used of the source level, and of the destination one
+uniform vec2 uSourceSize;
+uniform vec2 uDestinationSize;
+
+// Level uSourceLevel - 1 of the chain
+layout(r11f_g11f_b10f, binding = 0) uniform image2D uDestination;
+
+vec3 sampleSource(vec2 position)
+{
+	position = clamp(position, vec2(0.5), uSourceSize - 0.5);
+	vec2 levelSize = vec2(textureSize(uBloom, uSourceLevel));
+	return textureLod(uBloom, position / levelSize, float(uSourceLevel)).rgb;
+}
+
+void main()
+{
+	ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+	if (any(greaterThanEqual(texel, ivec2(uDestinationSize))))
+	{
+		return;
+	}
+
+	vec2 center = 0.5 * (vec2(texel) + 0.5);
+	vec3 color = 0.25 * sampleSource(center)
+		+ 0.125 * (sampleSource(center + vec2(1.0, 0.0))
+			+ sampleSource(center + vec2(-1.0, 0.0))
+			+ sampleSource(center + vec2(0.0, 1.0))
+			+ sampleSource(center + vec2(0.0, -1.0)))
+		+ 0.0625 * (sampleSource(center + vec2(1.0, 1.0))
+			+ sampleSource(center + vec2(-1.0, 1.0))
+			+ sampleSource(center + vec2(1.0, -1.0))
+			+ sampleSource(center + vec2(-1.0, -1.0)));
+
+	vec3 level = imageLoad(uDestination, texel).rgb;
+	imageStore(uDestination, texel, vec4(level + color, 1.0));
+}
@@ -0,0 +1,9 @@
+#version 330
+
+out vec3 fColor;
+
+// Only the depth test matters for occlusion queries, color writes are masked
+void main()
+{
+	fColor = vec3(1, 0, 1);
+}
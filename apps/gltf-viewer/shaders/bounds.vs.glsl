@@ -0,0 +1,11 @@
+#version 330
+
+layout(location = 0) in vec3 aPosition;
+
+// Maps the unit cube of renderCube() to a world space bounding box
+uniform mat4 uModelViewProjMatrix;
+
+void main()
+{
+	gl_Position = uModelViewProjMatrix * vec4(aPosition, 1);
+}
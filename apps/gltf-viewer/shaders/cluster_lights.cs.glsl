@@ -0,0 +1,114 @@
+#version 430
+
+// One invocation per cluster of the screen, CLUSTER_TILES_X x CLUSTER_TILES_Y
+// tiles by CLUSTER_SLICES depth slices, each listing the punctual lights whose
+// range intersects it. CLUSTER_* are defined by the application.
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+// See pbr_directional_light.fs.glsl
+layout(std140, binding = 3) uniform FrameConstants
+{
+  vec3 uCamDir;
+  vec3 uLightDirection;
+  vec3 uLightIntensity;
+  vec4 uClusterDepth;
+  vec4 uClusterTiles;
+};
+
+struct PunctualLight
+{
+  vec4 positionRange;
+  vec4 colorType;
+  vec4 directionScale;
+  vec4 spotOffset;
+};
+
+layout(std430, binding = 4) readonly buffer PunctualLights
+{
+  PunctualLight uLights[];
+};
+
+layout(std430, binding = 5) writeonly buffer ClusterLights
+{
+  uint uClusterLights[];
+};
+
+uniform mat4 uViewMatrix;
+// Diagonal of the projection matrix, x and y
+uniform vec2 uProjScale;
+// Shift of an off-center projection, of the tiles of tiled renders
+uniform vec2 uProjOffset;
+uniform vec2 uViewportSize;
+// Side by side stereo: the first half of the tiles are of the left eye, of
+// the uniforms above, the others of the right one. uViewportSize is the one
+// of an eye.
+uniform int uStereo;
+uniform mat4 uRightViewMatrix;
+uniform vec2 uRightProjOffset;
+
+void main()
+{
+	uint cluster = gl_GlobalInvocationID.x;
+	if (cluster >= CLUSTER_TILES_X * CLUSTER_TILES_Y * CLUSTER_SLICES)
+	{
+		return;
+	}
+
+	uvec3 cell = uvec3(
+		cluster % CLUSTER_TILES_X,
+		(cluster / CLUSTER_TILES_X) % CLUSTER_TILES_Y,
+		cluster / (CLUSTER_TILES_X * CLUSTER_TILES_Y));
+
+	// view space bounds of the cluster, the camera looks down -Z
+	float near = uClusterDepth.x;
+	float far = uClusterDepth.y;
+	float depths[2] = float[2](
+		near * pow(far / near, float(cell.z) / float(CLUSTER_SLICES)),
+		near * pow(far / near, float(cell.z + 1) / float(CLUSTER_SLICES)));
+	uvec2 tile = cell.xy;
+	mat4 viewMatrix = uViewMatrix;
+	vec2 projOffset = uProjOffset;
+	if (uStereo != 0 && tile.x >= uint(CLUSTER_TILES_X / 2))
+	{
+		tile.x -= uint(CLUSTER_TILES_X / 2);
+		viewMatrix = uRightViewMatrix;
+		projOffset = uRightProjOffset;
+	}
+	vec2 tileMin = vec2(tile) * uClusterTiles.xy / uViewportSize * 2.0 - 1.0;
+	vec2 tileMax =
+		vec2(tile + 1u) * uClusterTiles.xy / uViewportSize * 2.0 - 1.0;
+
+	vec3 boundsMin = vec3(1e30);
+	vec3 boundsMax = vec3(-1e30);
+	for (int i = 0; i < 2; ++i)
+	{
+		vec2 cornerMin = (tileMin + projOffset) * depths[i] / uProjScale;
+		vec2 cornerMax = (tileMax + projOffset) * depths[i] / uProjScale;
+		boundsMin = min(boundsMin, vec3(min(cornerMin, cornerMax), -depths[i]));
+		boundsMax = max(boundsMax, vec3(max(cornerMin, cornerMax), -depths[i]));
+	}
+
+	// lights of infinite range, directional ones included, are in every
+	// cluster. Spot lights are tested as spheres.
+	uint base = cluster * (CLUSTER_MAX_LIGHTS + 1);
+	uint count = 0;
+	uint lightCount = uint(uClusterTiles.z);
+	for (uint i = 0; i < lightCount && count < CLUSTER_MAX_LIGHTS; ++i)
+	{
+		float range = uLights[i].positionRange.w;
+		if (range > 0.0)
+		{
+			vec3 center =
+				(viewMatrix * vec4(uLights[i].positionRange.xyz, 1.0)).xyz;
+			vec3 offset = center - clamp(center, boundsMin, boundsMax);
+			if (dot(offset, offset) > range * range)
+			{
+				continue;
+			}
+		}
+
+		uClusterLights[base + 1 + count] = i;
+		++count;
+	}
+	uClusterLights[base] = count;
+}
@@ -0,0 +1,368 @@
+#version 430
+
+// One invocation per meshlet of each instance of the commands of a frame,
+// appending the draw of the meshlet to the commands of its batch unless it is
+// out of the view frustum or faces away from the eye. Commands without
+// meshlets, or drawing a level of detail, are copied whole.
+//
+// With GPU culling, every instance is first tested by the world bounds of
+// its draw item against the view frustum, the pixel centers of the viewport
+// and the depth pyramid of the previous frame, and commands without
+// meshlets get one invocation per instance, appending the instances left.
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+// See forward.vs.glsl
+struct DrawTransform
+{
+	mat4 modelMatrix;
+	mat4 modelViewProjMatrix;
+	mat4 previousModelViewProjMatrix;
+	mat3x4 normalMatrix;
+	uint materialIndex;
+	uint skinJoints;
+	uint morphTargets;
+	uint mergedVertices;
+	vec4 positionDequantize;
+	uint bakedOcclusion;
+};
+
+layout(std430, binding = 2) readonly buffer DrawTransforms
+{
+	DrawTransform uDrawTransforms[];
+};
+
+// See PackedMeshlet in packed_geometry.hpp
+struct Meshlet
+{
+	vec4 sphere;
+	vec4 cone;
+	uint firstIndex;
+	uint indexCount;
+	uint padding[2];
+};
+
+layout(std430, binding = 9) readonly buffer Meshlets
+{
+	Meshlet uMeshlets[];
+};
+
+// See ClusterCommand in ViewerApplication.hpp
+struct ClusterCommand
+{
+	uint firstJob;
+	uint firstMeshlet;
+	uint meshletCount;
+	uint instanceCount;
+	uint count;
+	uint firstIndex;
+	int baseVertex;
+	uint baseInstance;
+	uint batch;
+	uint batchOffset;
+	uint flags;
+	uint padding;
+};
+
+layout(std430, binding = 10) readonly buffer ClusterCommands
+{
+	ClusterCommand uCommands[];
+};
+
+struct DrawCommand
+{
+	uint count;
+	uint instanceCount;
+	uint firstIndex;
+	int baseVertex;
+	uint baseInstance;
+};
+
+layout(std430, binding = 11) writeonly buffer ClusterDraws
+{
+	DrawCommand uDraws[];
+};
+
+// Draws of each batch, zeroed before the dispatch
+layout(std430, binding = 12) buffer ClusterCounts
+{
+	uint uCounts[];
+};
+
+// World bounds of each draw item, empty if min > max, and the draw item of
+// each draw of the frame, read with CLUSTER_DRAW_CULLING_BIT
+struct DrawBounds
+{
+	vec4 min;
+	vec4 max;
+};
+
+layout(std430, binding = 14) readonly buffer DrawItems
+{
+	uint uDrawItems[];
+};
+
+layout(std430, binding = 15) readonly buffer DrawBoundsBuffer
+{
+	DrawBounds uDrawBounds[];
+};
+
+uniform vec3 uEye; // World space
+// Single pass stereo, see forward.vs.glsl: meshlets are drawn for both eyes
+// unless culled for both, uEye is the left one
+uniform int uStereo;
+uniform mat4 uStereoMatrices[2];
+uniform vec3 uRightEye;
+uniform int uJobCount;
+uniform int uCommandCount;
+// World to clip space of the frame, and its viewport in pixels
+uniform mat4 uViewProjMatrix;
+uniform vec2 uViewportSize;
+// Depth pyramid of the previous frame, see utils/depth_pyramid.hpp, of a
+// scene of uPyramidSceneSize pixels drawn with uPyramidViewProjMatrix. Not
+// read if uOcclusion is 0.
+uniform int uOcclusion;
+uniform sampler2D uDepthPyramid;
+uniform mat4 uPyramidViewProjMatrix;
+uniform ivec2 uPyramidSceneSize;
+uniform int uPyramidLevels;
+uniform int uPyramidReversedZ;
+
+#define SKIN_NONE 0xffffffffu
+#define MORPH_NONE 0xffffffffu
+#define CLUSTER_CONE_CULLING_BIT 1u
+#define CLUSTER_DRAW_CULLING_BIT 2u
+#define CLUSTER_SMALL_FEATURE_BIT 4u
+
+// Pixels of the clip space corners of a box on a viewport of size, false if
+// one of them is behind the eye
+bool projectBox(mat4 matrix, vec3 center, vec3 extent, vec2 size,
+	out vec2 low, out vec2 high, out vec2 depths)
+{
+	low = vec2(1e30);
+	high = vec2(-1e30);
+	depths = vec2(1e30, -1e30);
+	for (int i = 0; i < 8; ++i)
+	{
+		vec3 corner = center + extent * vec3(
+			(i & 1) != 0 ? 1.0 : -1.0,
+			(i & 2) != 0 ? 1.0 : -1.0,
+			(i & 4) != 0 ? 1.0 : -1.0);
+		vec4 clip = matrix * vec4(corner, 1);
+		if (clip.w <= 0.0)
+		{
+			return false;
+		}
+		vec3 ndc = clip.xyz / clip.w;
+		vec2 pixel = (0.5 * ndc.xy + 0.5) * size;
+		low = min(low, pixel);
+		high = max(high, pixel);
+		depths = vec2(min(depths.x, ndc.z), max(depths.y, ndc.z));
+	}
+	return true;
+}
+
+// Whether the bounds of the item of a draw may be seen
+bool drawVisible(uint drawIndex, uint flags, uint views)
+{
+	DrawBounds bounds = uDrawBounds[uDrawItems[drawIndex]];
+	vec3 center = 0.5 * (bounds.max.xyz + bounds.min.xyz);
+	vec3 extent = 0.5 * (bounds.max.xyz - bounds.min.xyz);
+	if (any(lessThan(extent, vec3(0.0))))
+	{
+		return true;
+	}
+
+	bool inside = false;
+	for (uint view = 0u; view < views && !inside; ++view)
+	{
+		mat4 m = transpose(uStereo != 0
+			? uStereoMatrices[view] * uViewProjMatrix
+			: uViewProjMatrix);
+		vec4 planes[6] = vec4[6](
+			m[3] + m[0], m[3] - m[0],
+			m[3] + m[1], m[3] - m[1],
+			m[3] + m[2], m[3] - m[2]);
+		inside = true;
+		for (int i = 0; i < 6 && inside; ++i)
+		{
+			inside = dot(planes[i].xyz, center) + planes[i].w
+				>= -dot(abs(planes[i].xyz), extent);
+		}
+	}
+	if (!inside)
+	{
+		return false;
+	}
+
+	// Triangles within the box cover no sample if it holds no pixel center
+	vec2 low;
+	vec2 high;
+	vec2 depths;
+	if ((flags & CLUSTER_SMALL_FEATURE_BIT) != 0u
+		&& projectBox(uViewProjMatrix, center, extent, uViewportSize,
+			low, high, depths)
+		&& any(greaterThan(ceil(low - 0.5), floor(high - 0.5))))
+	{
+		return false;
+	}
+
+	// Parts of the box out of the previous frame were not drawn there
+	if (uOcclusion == 0
+		|| !projectBox(uPyramidViewProjMatrix, center, extent,
+			vec2(uPyramidSceneSize), low, high, depths)
+		|| any(lessThan(low, vec2(0.0)))
+		|| any(greaterThan(high, vec2(uPyramidSceneSize))))
+	{
+		return true;
+	}
+
+	// The first level the box covers at most 2x2 texels of, each of
+	// 2^(level + 1) pixels
+	float size = max(high.x - low.x, high.y - low.y);
+	int level = clamp(
+		int(ceil(log2(max(0.5 * size, 1.0)))), 0, uPyramidLevels - 1);
+	ivec2 levelSize = max(((uPyramidSceneSize + 1) / 2) >> level, ivec2(1));
+	ivec2 first = min(ivec2(low) >> (level + 1), levelSize - 1);
+	ivec2 last = min(ivec2(high) >> (level + 1), levelSize - 1);
+
+	bool reversed = uPyramidReversedZ != 0;
+	float farthest = texelFetch(uDepthPyramid, first, level).r;
+	for (int y = first.y; y <= last.y; ++y)
+	{
+		for (int x = first.x; x <= last.x; ++x)
+		{
+			float depth = texelFetch(uDepthPyramid, ivec2(x, y), level).r;
+			farthest = reversed ? min(farthest, depth) : max(farthest, depth);
+		}
+	}
+
+	// Window depths are [0, 1] from the normalized device depths of [-1, 1],
+	// or of [0, 1] with the clip control of the reversed depth
+	float nearest = reversed ? depths.y : 0.5 * depths.x + 0.5;
+	return reversed ? nearest >= farthest : nearest <= farthest;
+}
+
+void emit(ClusterCommand command, DrawCommand draw)
+{
+	uint slot = atomicAdd(uCounts[command.batch], 1u);
+	uDraws[command.batchOffset + slot] = draw;
+}
+
+void main()
+{
+	uint job = gl_GlobalInvocationID.x;
+	if (job >= uint(uJobCount))
+	{
+		return;
+	}
+
+	// Last command starting at or before the job
+	uint low = 0u;
+	uint high = uint(uCommandCount);
+	while (high - low > 1u)
+	{
+		uint middle = (low + high) / 2u;
+		if (uCommands[middle].firstJob <= job)
+		{
+			low = middle;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+	ClusterCommand command = uCommands[low];
+
+	// Instances of each eye, see forward.vs.glsl
+	uint views = uStereo != 0 ? 2u : 1u;
+
+	bool drawCulling = (command.flags & CLUSTER_DRAW_CULLING_BIT) != 0u;
+	uint local = job - command.firstJob;
+
+	if (command.meshletCount == 0u)
+	{
+		if (!drawCulling)
+		{
+			emit(command, DrawCommand(command.count, views * command.instanceCount,
+				command.firstIndex, command.baseVertex, command.baseInstance));
+		}
+		else if (drawVisible(command.baseInstance + local, command.flags, views))
+		{
+			emit(command, DrawCommand(command.count, views, command.firstIndex,
+				command.baseVertex, command.baseInstance + local));
+		}
+		return;
+	}
+
+	uint instance = local / command.meshletCount;
+	Meshlet meshlet = uMeshlets[command.firstMeshlet + local % command.meshletCount];
+	uint drawIndex = command.baseInstance + instance;
+	if (drawCulling && !drawVisible(drawIndex, command.flags, views))
+	{
+		return;
+	}
+	DrawTransform transform = uDrawTransforms[drawIndex];
+
+	// Skinned and morphed vertices leave the bounds of the meshlet
+	bool bounded = transform.skinJoints == SKIN_NONE
+		&& transform.morphTargets == MORPH_NONE;
+	if (bounded)
+	{
+		// Planes of the frustum of each view in the space of the mesh,
+		// their normals are not normalized
+		bool inside = false;
+		for (uint view = 0u; view < views && !inside; ++view)
+		{
+			mat4 m = transpose(uStereo != 0
+				? uStereoMatrices[view] * transform.modelViewProjMatrix
+				: transform.modelViewProjMatrix);
+			vec4 planes[6] = vec4[6](
+				m[3] + m[0], m[3] - m[0],
+				m[3] + m[1], m[3] - m[1],
+				m[3] + m[2], m[3] - m[2]);
+			inside = true;
+			for (int i = 0; i < 6 && inside; ++i)
+			{
+				inside = dot(planes[i].xyz, meshlet.sphere.xyz) + planes[i].w
+					>= -meshlet.sphere.w * length(planes[i].xyz);
+			}
+		}
+		if (!inside)
+		{
+			return;
+		}
+
+		// The cone is tested against the eye in the space of the mesh, which
+		// is only equivalent if the transform scales uniformly and does not
+		// mirror
+		mat3 linear = mat3(transform.modelMatrix);
+		mat3 metric = transpose(linear) * linear;
+		float scale = (metric[0][0] + metric[1][1] + metric[2][2]) / 3.0;
+		mat3 distortion = metric - mat3(scale);
+		bool similar = max(
+			max(length(distortion[0]), length(distortion[1])),
+			length(distortion[2])) <= 1e-3 * scale;
+		if ((command.flags & CLUSTER_CONE_CULLING_BIT) != 0u
+			&& similar
+			&& determinant(linear) > 0.0)
+		{
+			bool facing = false;
+			for (uint view = 0u; view < views && !facing; ++view)
+			{
+				vec3 eye = inverse(linear)
+					* ((view == 0u ? uEye : uRightEye)
+						- vec3(transform.modelMatrix[3]));
+				vec3 toCenter = meshlet.sphere.xyz - eye;
+				facing = dot(toCenter, meshlet.cone.xyz)
+					< meshlet.cone.w * length(toCenter) + meshlet.sphere.w;
+			}
+			if (!facing)
+			{
+				return;
+			}
+		}
+	}
+
+	emit(command, DrawCommand(meshlet.indexCount, views, meshlet.firstIndex,
+		command.baseVertex, drawIndex));
+}
@@ -0,0 +1,6 @@
+#version 330
+
+// Depth pre-pass, only the depth of the fragments is written
+void main()
+{
+}
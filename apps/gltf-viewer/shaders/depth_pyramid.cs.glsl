@@ -0,0 +1,76 @@
+#version 430
+
+// One invocation per texel of a level of the depth pyramid, see
+// utils/depth_pyramid.hpp: the farthest depth of the pixels of the scene it
+// covers for level 0, of the texels of the level above for the others. The
+// last texel of a row or column also covers the remainder of an odd size.
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+
+uniform sampler2D uDepth;
+uniform sampler2DMS uDepthMS;
+// Samples of uDepthMS, uDepth is read instead if 0, see
+// ambient_occlusion_depth.cs.glsl. Every sample is read.
+uniform int uSamples;
+// Level written, 0 reads the depth of the scene, the others uAbove
+uniform int uLevel;
+// Of the depth of the scene or of uAbove, and of the level written
+uniform ivec2 uSourceSize;
+uniform ivec2 uLevelSize;
+// Depths decrease with the distance
+uniform int uReversedZ;
+
+layout(r32f, binding = 0) readonly uniform image2D uAbove;
+layout(r32f, binding = 1) writeonly uniform image2D uLevelImage;
+
+float farthest(float a, float b)
+{
+	return uReversedZ != 0 ? min(a, b) : max(a, b);
+}
+
+float fetchDepth(ivec2 texel)
+{
+	if (uLevel > 0)
+	{
+		return imageLoad(uAbove, texel).r;
+	}
+	if (uSamples == 0)
+	{
+		return texelFetch(uDepth, texel, 0).r;
+	}
+	float depth = texelFetch(uDepthMS, texel, 0).r;
+	for (int i = 1; i < uSamples; ++i)
+	{
+		depth = farthest(depth, texelFetch(uDepthMS, texel, i).r);
+	}
+	return depth;
+}
+
+void main()
+{
+	ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+	if (any(greaterThanEqual(texel, uLevelSize)))
+	{
+		return;
+	}
+
+	ivec2 first = 2 * texel;
+	ivec2 last = first + 1;
+	if (texel.x == uLevelSize.x - 1)
+	{
+		last.x = uSourceSize.x - 1;
+	}
+	if (texel.y == uLevelSize.y - 1)
+	{
+		last.y = uSourceSize.y - 1;
+	}
+	last = min(last, uSourceSize - 1);
+	float depth = fetchDepth(first);
+	for (int y = first.y; y <= last.y; ++y)
+	{
+		for (int x = first.x; x <= last.x; ++x)
+		{
+			depth = farthest(depth, fetchDepth(ivec2(x, y)));
+		}
+	}
+	imageStore(uLevelImage, texel, vec4(depth));
+}
@@ -0,0 +1,80 @@
+#version 430
+
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+
+// One invocation per texel, gl_GlobalInvocationID.z plus uFirstFace is the
+// cube map face, dispatches may cover some faces only
+layout(rgba16f, binding = 0) uniform writeonly imageCube uEnvironmentMap;
+uniform int uFirstFace;
+
+// With uRgbe, the bytes of a Radiance file, top row first: the shared
+// exponent cannot be interpolated, texels are decoded then filtered here.
+// Otherwise linear colors, bottom row first, filtered by the sampler.
+uniform sampler2D uEquirectangularMap;
+uniform bool uRgbe;
+
+// See irradiance.cs.glsl
+vec3 cubeMapDirection(ivec3 texel, int size)
+{
+	vec2 st = 2.0 * (vec2(texel.xy) + 0.5) / float(size) - 1.0;
+
+	switch (texel.z)
+	{
+		case 0: return vec3(1.0, -st.y, -st.x);
+		case 1: return vec3(-1.0, -st.y, st.x);
+		case 2: return vec3(st.x, 1.0, st.y);
+		case 3: return vec3(st.x, -1.0, -st.y);
+		case 4: return vec3(st.x, -st.y, 1.0);
+		default: return vec3(-st.x, -st.y, -1.0);
+	}
+}
+
+vec2 SampleSphericalMap(vec3 v)
+{
+	const vec2 invAtan = vec2(0.1591, 0.3183);
+
+	return vec2(atan(v.z, v.x), asin(v.y)) * invAtan + 0.5;
+}
+
+// Mantissas scaled by 2^(exponent - 128) / 256, as stb_image decodes them
+vec3 fetchRgbe(ivec2 texel, ivec2 size)
+{
+	vec4 rgbe = texelFetch(uEquirectangularMap, clamp(texel, ivec2(0), size - 1), 0);
+	ivec4 bytes = ivec4(rgbe * 255.0 + 0.5);
+
+	return bytes.a == 0
+		? vec3(0.0)
+		: vec3(bytes.rgb) * exp2(float(bytes.a - 136));
+}
+
+// Bilinear filtering of a clamped texture, rows flipped
+vec3 sampleRgbe(vec2 uv)
+{
+	ivec2 size = textureSize(uEquirectangularMap, 0);
+	vec2 position = vec2(uv.x, 1.0 - uv.y) * vec2(size) - 0.5;
+	ivec2 texel = ivec2(floor(position));
+	vec2 weight = position - floor(position);
+
+	return mix(
+		mix(fetchRgbe(texel, size), fetchRgbe(texel + ivec2(1, 0), size), weight.x),
+		mix(fetchRgbe(texel + ivec2(0, 1), size), fetchRgbe(texel + ivec2(1, 1), size), weight.x),
+		weight.y);
+}
+
+void main()
+{
+	int size = imageSize(uEnvironmentMap).x;
+	ivec3 texel = ivec3(gl_GlobalInvocationID) + ivec3(0, 0, uFirstFace);
+
+	if (texel.x >= size || texel.y >= size)
+	{
+		return;
+	}
+
+	vec2 uv = SampleSphericalMap(normalize(cubeMapDirection(texel, size)));
+	vec3 color = uRgbe
+		? sampleRgbe(uv)
+		: texture(uEquirectangularMap, uv).rgb;
+
+	imageStore(uEnvironmentMap, texel, vec4(color, 1.0));
+}
@@ -1,22 +1,373 @@
-#version 330
+#version 430
 
+// PULL_VERTICES is defined by the vertex pulling mode: the attributes are
+// read by pullVertex() from the storage buffer of every packed vertex buffer
+// instead of the vertex array, which only holds the draw index
+#if defined(PULL_VERTICES)
+vec3 aPosition;
+vec3 aNormal;
+vec2 aTexCoords;
+uvec4 aJoints;
+vec4 aWeights;
+vec4 aTangent;
+#else
 layout(location = 0) in vec3 aPosition;
 layout(location = 1) in vec3 aNormal;
 layout(location = 2) in vec2 aTexCoords;
+layout(location = 3) in uvec4 aJoints;
+layout(location = 4) in vec4 aWeights;
+// Handedness of the bitangent in w, zero for primitives without tangents
+layout(location = 5) in vec4 aTangent;
+#endif
+// Instanced attribute, equal to the base instance of the draw
+layout(location = 6) in uint aDrawIndex;
 
 out vec2 vTexCoords;
 out vec3 vWorldSpaceNormal;
+out vec4 vWorldSpaceTangent;
 out vec3 vWorldSpacePosition;
+flat out uint vMaterialIndex;
+// Index of the draw in DrawTransforms, written by the picking pass
+flat out uint vDrawIndex;
+// Clip space position of the vertex in the previous frame, without jitter
+out vec4 vPreviousClipPosition;
+// Fraction of the ambient light the baked occlusion of the vertex blocks
+out float vBakedOcclusion;
 
-uniform mat4 uNormalMatrix;
-uniform mat4 uModelViewProjMatrix;
-uniform mat4 uModelViewMatrix;
-uniform mat4 uModelMatrix;
+// The depth pre-pass and the shading pass compute the same depth, the shading
+// pass tests it with GL_EQUAL
+invariant gl_Position;
+
+// Single pass stereo: each draw is instanced twice, the draw index attribute
+// advancing every 2 instances, the even ones drawn for the left eye and the
+// odd ones for the right eye. uStereoMatrices take the clip space of the
+// draw transforms to that of each eye, whose x is squeezed to its half of
+// the viewport and clipped to it with gl_ClipDistance[0].
+uniform int uStereo;
+uniform mat4 uStereoMatrices[2];
+
+// Point clouds drawn from their octree, with GL_PROGRAM_POINT_SIZE: the
+// diameter in pixels of their points at a clip space w of 1, so that points
+// cover the spacing of the nodes drawn, see drawScene. Near points are
+// limited to POINT_MAX_SIZE.
+uniform float uPointSize;
+#define POINT_MAX_SIZE 64.0
+
+// Transforms of the draws of the frame, see DrawTransform in
+// ViewerApplication.hpp
+struct DrawTransform
+{
+	mat4 modelMatrix;
+	mat4 modelViewProjMatrix;
+	mat4 previousModelViewProjMatrix;
+	mat3x4 normalMatrix;
+	uint materialIndex;
+	uint skinJoints;
+	uint morphTargets;
+	// First of the members of the vertices in uMergedVertices, MERGED_NONE if
+	// the primitive is not merged
+	uint mergedVertices;
+	vec4 positionDequantize; // Offset and scale of quantized positions
+	// Occlusion of the first vertex of the draw in uBakedOcclusion,
+	// BAKED_OCCLUSION_NONE without baked occlusion
+	uint bakedOcclusion;
+	// Of the wireframe overlay, see pbr_directional_light.fs.glsl
+	uint wireframeFirstIndex;
+	int wireframeBaseVertex;
+	// Packed vertex buffer of the primitive, see PULL_VERTICES
+	uint vertexBuffer;
+};
+
+layout(std430, binding = 2) readonly buffer DrawTransforms
+{
+	DrawTransform uDrawTransforms[];
+};
+
+// Deltas of the morph targets and the targets of non-zero weight of each
+// draw, see MorphTargets in morph_targets.hpp
+layout(binding = 9) uniform samplerBuffer uMorphDeltas;
+
+struct MorphTarget
+{
+	int positions;
+	int normals;
+	float weight;
+	uint padding; // As MorphTargets::ActiveTarget, std430 would pack to 12
+};
+
+layout(std430, binding = 8) readonly buffer MorphTargets
+{
+	MorphTarget uMorphTargets[];
+};
+
+#define MORPH_NONE 0xffffffffu
+
+// Add the deltas of the active targets whose header is at first
+void morphVertex(uint first, inout vec3 position, inout vec3 normal)
+{
+	uint end = first + 1u + uint(uMorphTargets[first].positions);
+	for (uint i = first + 1u; i < end; ++i)
+	{
+		MorphTarget target = uMorphTargets[i];
+		position += target.weight
+			* texelFetch(uMorphDeltas, target.positions + gl_VertexID).xyz;
+		if (target.normals >= 0)
+		{
+			normal += target.weight
+				* texelFetch(uMorphDeltas, target.normals + gl_VertexID).xyz;
+		}
+	}
+}
+
+// Joint matrices of the skins, or dual quaternions with the rotation in column
+// 0 and the dual part in column 1, see Skins in skins.hpp
+layout(std430, binding = 7) readonly buffer SkinJoints
+{
+	mat4 uJointMatrices[];
+};
+
+#define SKIN_NONE 0xffffffffu
+#define SKIN_DUAL_QUATERNION_BIT 0x80000000u
+
+// Skin position, normal and tangent with the joints of the skin starting at
+// skinJoints
+void skinVertex(uint skinJoints, inout vec3 position, inout vec3 normal,
+	inout vec3 tangent)
+{
+	uint first = skinJoints & ~SKIN_DUAL_QUATERNION_BIT;
+	if ((skinJoints & SKIN_DUAL_QUATERNION_BIT) == 0u)
+	{
+		mat4 skinMatrix =
+			aWeights.x * uJointMatrices[first + aJoints.x] +
+			aWeights.y * uJointMatrices[first + aJoints.y] +
+			aWeights.z * uJointMatrices[first + aJoints.z] +
+			aWeights.w * uJointMatrices[first + aJoints.w];
+		position = vec3(skinMatrix * vec4(position, 1));
+		normal = mat3(skinMatrix) * normal;
+		tangent = mat3(skinMatrix) * tangent;
+		return;
+	}
+
+	// Blend in the hemisphere of the first joint so that rotations take the
+	// shortest path
+	mat4 dq0 = uJointMatrices[first + aJoints.x];
+	mat4 dq1 = uJointMatrices[first + aJoints.y];
+	mat4 dq2 = uJointMatrices[first + aJoints.z];
+	mat4 dq3 = uJointMatrices[first + aJoints.w];
+	vec4 w = aWeights * vec4(1,
+		sign(dot(dq0[0], dq1[0]) + 1e-6),
+		sign(dot(dq0[0], dq2[0]) + 1e-6),
+		sign(dot(dq0[0], dq3[0]) + 1e-6));
+	vec4 real = w.x * dq0[0] + w.y * dq1[0] + w.z * dq2[0] + w.w * dq3[0];
+	vec4 dual = w.x * dq0[1] + w.y * dq1[1] + w.z * dq2[1] + w.w * dq3[1];
+	float len = length(real);
+	real /= len;
+	dual /= len;
+
+	vec3 translation =
+		2 * (real.w * dual.xyz - dual.w * real.xyz + cross(real.xyz, dual.xyz));
+	position += 2 * cross(real.xyz, cross(real.xyz, position) + real.w * position);
+	position += translation;
+	normal += 2 * cross(real.xyz, cross(real.xyz, normal) + real.w * normal);
+	tangent += 2 * cross(real.xyz, cross(real.xyz, tangent) + real.w * tangent);
+}
+
+// Member of each vertex of the merged primitives, and the transform of each
+// member from the space of its quantized positions to world space, see
+// MergedTransform in ViewerApplication.hpp. The draw of a merged primitive
+// has identity transforms.
+layout(binding = 12) uniform usamplerBuffer uMergedVertices;
+
+struct MergedTransform
+{
+	mat4 modelMatrix;
+	mat3x4 normalMatrix;
+};
+
+layout(std430, binding = 13) readonly buffer MergedTransforms
+{
+	MergedTransform uMergedTransforms[];
+};
+
+#define MERGED_NONE 0xffffffffu
+
+void mergedVertex(uint mergedVertices, inout vec3 position, inout vec3 normal,
+	inout vec3 tangent)
+{
+	uint member =
+		texelFetch(uMergedVertices, int(mergedVertices) + gl_VertexID).r;
+	MergedTransform transform = uMergedTransforms[member];
+	position = vec3(transform.modelMatrix * vec4(position, 1));
+	normal = mat3(transform.normalMatrix) * normal;
+	tangent = mat3(transform.modelMatrix) * tangent;
+}
+
+// Ambient occlusion baked per vertex, see utils/baked_occlusion.hpp
+layout(binding = 14) uniform samplerBuffer uBakedOcclusion;
+
+#define BAKED_OCCLUSION_NONE 0xffffffffu
+
+#if defined(PULL_VERTICES)
+// The vertex buffers one after the other, and where each starts and how its
+// attributes are stored, see PulledVertexLayout in ViewerApplication.hpp
+struct PulledVertexLayout
+{
+	uint firstWord;
+	uint stride;
+	uint padding[2];
+	// GL component type, component count (0 if absent), offset and whether
+	// normalized, in attribute location order
+	ivec4 attributes[6];
+};
+
+layout(std430, binding = PULLED_LAYOUTS_BINDING) readonly buffer PulledVertexLayouts
+{
+	PulledVertexLayout uPulledLayouts[];
+};
+
+layout(std430, binding = PULLED_VERTICES_BINDING) readonly buffer PulledVertices
+{
+	uint uPulledVertices[];
+};
+
+#define COMPONENT_BYTE 0x1400
+#define COMPONENT_UNSIGNED_BYTE 0x1401
+#define COMPONENT_SHORT 0x1402
+#define COMPONENT_UNSIGNED_SHORT 0x1403
+#define COMPONENT_UNSIGNED_INT 0x1405
+#define COMPONENT_FLOAT 0x1406
+#define COMPONENT_HALF_FLOAT 0x140B
+#define COMPONENT_INT_2_10_10_10_REV 0x8D9F
+
+// Component i of an attribute at byte address of uPulledVertices, converted
+// as the vertex attribute fetch does
+float pullComponent(uint address, int type, bool normalized, int i)
+{
+	if (type == COMPONENT_FLOAT)
+	{
+		return uintBitsToFloat(uPulledVertices[(address >> 2) + uint(i)]);
+	}
+	if (type == COMPONENT_UNSIGNED_INT)
+	{
+		return float(uPulledVertices[(address >> 2) + uint(i)]);
+	}
+	if (type == COMPONENT_HALF_FLOAT
+		|| type == COMPONENT_SHORT
+		|| type == COMPONENT_UNSIGNED_SHORT)
+	{
+		uint byte = address + 2u * uint(i);
+		uint bits = (uPulledVertices[byte >> 2] >> ((byte & 2u) * 8u)) & 0xffffu;
+		if (type == COMPONENT_HALF_FLOAT)
+		{
+			return unpackHalf2x16(bits).x;
+		}
+		if (type == COMPONENT_SHORT)
+		{
+			float value = float(int(bits << 16) >> 16);
+			return normalized ? max(value / 32767.0, -1.0) : value;
+		}
+		return float(bits) / (normalized ? 65535.0 : 1.0);
+	}
+	uint byte = address + uint(i);
+	uint bits = (uPulledVertices[byte >> 2] >> ((byte & 3u) * 8u)) & 0xffu;
+	if (type == COMPONENT_BYTE)
+	{
+		float value = float(int(bits << 24) >> 24);
+		return normalized ? max(value / 127.0, -1.0) : value;
+	}
+	return float(bits) / (normalized ? 255.0 : 1.0);
+}
+
+// Attribute of the vertex of the draw, (0, 0, 0, 1) if absent as for a
+// disabled vertex attribute array
+vec4 pullAttribute(PulledVertexLayout vertexLayout, int attribute)
+{
+	ivec4 format = vertexLayout.attributes[attribute];
+	vec4 value = vec4(0, 0, 0, 1);
+	if (format.y == 0)
+	{
+		return value;
+	}
+	// gl_VertexID includes the base vertex of the command
+	uint address = 4u * vertexLayout.firstWord
+		+ uint(gl_VertexID) * vertexLayout.stride
+		+ uint(format.z);
+	if (format.x == COMPONENT_INT_2_10_10_10_REV)
+	{
+		uint bits = uPulledVertices[address >> 2];
+		ivec4 components = ivec4(
+			int(bits << 22) >> 22,
+			int(bits << 12) >> 22,
+			int(bits << 2) >> 22,
+			int(bits) >> 30);
+		return max(vec4(components) / vec4(511, 511, 511, 1), -1.0);
+	}
+	for (int i = 0; i < min(format.y, 4); ++i)
+	{
+		value[i] = pullComponent(address, format.x, format.w != 0, i);
+	}
+	return value;
+}
+
+// Read the attributes of the vertex from the vertex buffer of the draw
+void pullVertex(uint vertexBuffer)
+{
+	PulledVertexLayout vertexLayout = uPulledLayouts[vertexBuffer];
+	aPosition = pullAttribute(vertexLayout, 0).xyz;
+	aNormal = pullAttribute(vertexLayout, 1).xyz;
+	aTexCoords = pullAttribute(vertexLayout, 2).xy;
+	aJoints = uvec4(pullAttribute(vertexLayout, 3));
+	aWeights = pullAttribute(vertexLayout, 4);
+	aTangent = pullAttribute(vertexLayout, 5);
+}
+#endif
 
 void main()
 {
+	DrawTransform transform = uDrawTransforms[aDrawIndex];
+#if defined(PULL_VERTICES)
+	pullVertex(transform.vertexBuffer);
+#endif
+
+	vec3 position = transform.positionDequantize.xyz
+		+ transform.positionDequantize.w * aPosition;
+	vec3 normal = aNormal;
+	vec3 tangent = aTangent.xyz;
+	// Targets are blended in the space of the mesh, before skinning
+	if (transform.morphTargets != MORPH_NONE)
+	{
+		morphVertex(transform.morphTargets, position, normal);
+	}
+	if (transform.skinJoints != SKIN_NONE)
+	{
+		skinVertex(transform.skinJoints, position, normal, tangent);
+	}
+	if (transform.mergedVertices != MERGED_NONE)
+	{
+		mergedVertex(transform.mergedVertices, position, normal, tangent);
+	}
+
 	vTexCoords = aTexCoords;
-    vWorldSpacePosition = vec3(uModelMatrix * vec4(aPosition, 1));
-	vWorldSpaceNormal = normalize(vec3(uModelMatrix * vec4(aNormal, 1)));
-    gl_Position =  uModelViewProjMatrix * vec4(aPosition, 1);
+	vMaterialIndex = transform.materialIndex;
+	vDrawIndex = aDrawIndex;
+	vBakedOcclusion = transform.bakedOcclusion != BAKED_OCCLUSION_NONE
+		? texelFetch(uBakedOcclusion, int(transform.bakedOcclusion) + gl_VertexID).r
+		: 0.0;
+    vWorldSpacePosition = vec3(transform.modelMatrix * vec4(position, 1));
+	vWorldSpaceNormal = normalize(mat3(transform.normalMatrix) * normal);
+	// Normalized per fragment, zero stays zero
+	vWorldSpaceTangent = vec4(mat3(transform.modelMatrix) * tangent, aTangent.w);
+    gl_Position =  transform.modelViewProjMatrix * vec4(position, 1);
+	if (uStereo != 0)
+	{
+		int eye = gl_InstanceID & 1;
+		vec4 clip = uStereoMatrices[eye] * gl_Position;
+		gl_ClipDistance[0] = eye == 0 ? clip.w - clip.x : clip.w + clip.x;
+		clip.x = 0.5 * clip.x + (eye == 0 ? -0.5 : 0.5) * clip.w;
+		gl_Position = clip;
+	}
+	gl_PointSize = clamp(uPointSize / max(gl_Position.w, 1e-6), 1.0, POINT_MAX_SIZE);
+	// The previous pose of skins, morph targets and merged members is not
+	// kept, their vertices move with the draw only
+	vPreviousClipPosition = transform.previousModelViewProjMatrix * vec4(position, 1);
 }
@@ -0,0 +1,111 @@
+#version 430
+
+// See impostor.vs.glsl
+
+#if defined(CAPTURE)
+
+in vec2 vTexCoords;
+in vec3 vNormal;
+
+// Of the material of the primitive captured, the cutoff is 0 for opaque
+// materials
+uniform vec4 uBaseColorFactor;
+uniform float uAlphaCutoff;
+#if defined(TEXTURE_ARRAYS)
+layout(binding = 0) uniform sampler2DArray uBaseColorTexture;
+uniform int uBaseColorLayer;
+#else
+layout(binding = 0) uniform sampler2D uBaseColorTexture;
+#endif
+
+// The base color to an sRGB target, written with GL_FRAMEBUFFER_SRGB, and the
+// normal mapped to [0, 1]. Texels no surface covers stay 0, so that the
+// levels of the atlas average colors premultiplied by their coverage.
+layout(location = 0) out vec4 fAlbedo;
+layout(location = 1) out vec4 fNormal;
+
+void main()
+{
+#if defined(TEXTURE_ARRAYS)
+	vec4 baseColor = texture(uBaseColorTexture, vec3(vTexCoords, uBaseColorLayer));
+#else
+	vec4 baseColor = texture(uBaseColorTexture, vTexCoords);
+#endif
+	baseColor *= uBaseColorFactor;
+	if (baseColor.a < uAlphaCutoff)
+	{
+		discard;
+	}
+	// Double sided faces seen from behind
+	vec3 N = normalize(gl_FrontFacing ? vNormal : -vNormal);
+	fAlbedo = vec4(baseColor.rgb, 1);
+	fNormal = vec4(0.5 * N + 0.5, 1);
+}
+
+#else
+
+in vec3 vTexCoords;
+flat in mat3 vNormalMatrix;
+
+layout(binding = 0) uniform sampler2DArray uAlbedo;
+layout(binding = 1) uniform sampler2DArray uNormals;
+
+// Written once per frame, see FrameConstants in ViewerApplication.hpp
+layout(std140, binding = 3) uniform FrameConstants
+{
+	vec3 uCamDir;
+	vec3 uLightDirection;
+	vec3 uLightIntensity;
+};
+
+// Impostors always take their irradiance from the spherical harmonics, as the
+// distant draws of pbr_directional_light.fs.glsl, when uUseSHIrradiance is set
+uniform bool uUseSHIrradiance;
+layout(std140) uniform SHIrradiance
+{
+	vec4 uSHCoefficients[9];
+};
+
+layout(location = 0) out vec3 fColor;
+layout(location = 1) out vec2 fVelocity;
+
+// As in pbr_directional_light.fs.glsl
+vec3 SHirradiance(vec3 n)
+{
+	return uSHCoefficients[0].rgb
+		+ uSHCoefficients[1].rgb * n.y
+		+ uSHCoefficients[2].rgb * n.z
+		+ uSHCoefficients[3].rgb * n.x
+		+ uSHCoefficients[4].rgb * (n.x * n.y)
+		+ uSHCoefficients[5].rgb * (n.y * n.z)
+		+ uSHCoefficients[6].rgb * (3.0 * n.z * n.z - 1.0)
+		+ uSHCoefficients[7].rgb * (n.x * n.z)
+		+ uSHCoefficients[8].rgb * (n.x * n.x - n.y * n.y);
+}
+
+const float M_1_PI = 1.0 / 3.1415926535897932384626433832795;
+
+void main()
+{
+	vec4 albedo = texture(uAlbedo, vTexCoords);
+	if (albedo.a < 0.5)
+	{
+		discard;
+	}
+	// Coarser levels are premultiplied by the coverage, see CAPTURE
+	vec4 normal = texture(uNormals, vTexCoords);
+	vec3 diffuse = albedo.rgb / albedo.a;
+	vec3 N = normalize(vNormalMatrix * (2.0 * normal.rgb / max(normal.a, 1e-3) - 1.0));
+
+	// Lambertian only, without the shadows of the cascades
+	fColor = diffuse * M_1_PI * uLightIntensity
+		* max(dot(N, normalize(uLightDirection)), 0.0);
+	if (uUseSHIrradiance)
+	{
+		fColor += diffuse * max(SHirradiance(N), 0.0);
+	}
+	// Impostors are drawn in the pose of the frame only
+	fVelocity = vec2(0);
+}
+
+#endif
@@ -0,0 +1,111 @@
+#version 430
+
+// Octahedral impostors, see utils/impostors.hpp. CAPTURE is defined by the
+// program rendering the frames of a mesh to its layer of the atlas, one
+// primitive at a time. Otherwise every impostor of the frame is one instance
+// of the quad of integrate.vs.glsl, facing the frame closest to the eye.
+
+#if defined(CAPTURE)
+
+layout(location = 0) in vec3 aPosition;
+layout(location = 1) in vec3 aNormal;
+layout(location = 2) in vec2 aTexCoords;
+
+// Of the frame, see impostorFrameViewProjMatrix
+uniform mat4 uViewProjMatrix;
+uniform vec4 uPositionDequantize; // As in forward.vs.glsl
+
+out vec2 vTexCoords;
+out vec3 vNormal; // In the space of the mesh
+
+void main()
+{
+	vec3 position = uPositionDequantize.xyz + uPositionDequantize.w * aPosition;
+	vTexCoords = aTexCoords;
+	vNormal = aNormal;
+	gl_Position = uViewProjMatrix * vec4(position, 1);
+}
+
+#else
+
+// Corner of the quad in xy, in [-1, 1]
+layout(location = 0) in vec3 aPosition;
+
+// std430 layout of ImpostorInstance in ViewerApplication.hpp
+struct ImpostorInstance
+{
+	mat4 matrix; // World matrix of the instance
+	vec4 sphere; // Center and radius of the mesh, in its space
+	uvec4 layer; // Of the atlas in x
+};
+
+layout(std430, binding = IMPOSTOR_INSTANCES_BINDING) readonly buffer ImpostorInstances
+{
+	ImpostorInstance uInstances[];
+};
+
+uniform mat4 uViewProjMatrix;
+uniform vec3 uEye; // World position of the camera
+
+out vec3 vTexCoords; // In the layer of the instance
+// Normals of the frames to world space
+flat out mat3 vNormalMatrix;
+
+// As octahedralEncode and octahedralDecode in utils/impostors.cpp
+vec2 signNotZero(vec2 v)
+{
+	return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+vec2 octahedralEncode(vec3 direction)
+{
+	vec3 d = direction / (abs(direction.x) + abs(direction.y) + abs(direction.z));
+	vec2 p = d.xy;
+	if (d.z < 0.0)
+	{
+		p = (1.0 - abs(p.yx)) * signNotZero(p);
+	}
+	return 0.5 * p + 0.5;
+}
+
+vec3 octahedralDecode(vec2 uv)
+{
+	vec2 p = 2.0 * uv - 1.0;
+	vec3 d = vec3(p, 1.0 - abs(p.x) - abs(p.y));
+	if (d.z < 0.0)
+	{
+		d.xy = (1.0 - abs(d.yx)) * signNotZero(d.xy);
+	}
+	return normalize(d);
+}
+
+void main()
+{
+	ImpostorInstance instance = uInstances[gl_InstanceID];
+	vec3 center = instance.sphere.xyz;
+	float radius = instance.sphere.w;
+
+	// Frame of the direction of the eye in the space of the mesh, the quad
+	// spans the view of the frame, see impostorFrameViewProjMatrix
+	vec3 eye = vec3(inverse(instance.matrix) * vec4(uEye, 1));
+	vec3 toEye = eye - center;
+	toEye = dot(toEye, toEye) > 0.0 ? normalize(toEye) : vec3(0, 0, 1);
+	ivec2 frame = clamp(
+		ivec2(octahedralEncode(toEye) * float(IMPOSTOR_FRAMES)),
+		ivec2(0),
+		ivec2(IMPOSTOR_FRAMES - 1));
+	vec3 direction = octahedralDecode((vec2(frame) + 0.5) / float(IMPOSTOR_FRAMES));
+	vec3 up = abs(direction.y) < 0.999 ? vec3(0, 1, 0) : vec3(0, 0, 1);
+	vec3 right = normalize(cross(up, direction));
+	up = cross(direction, right);
+
+	vec2 corner = aPosition.xy;
+	vec3 position = center + radius * (corner.x * right + corner.y * up);
+	vTexCoords = vec3(
+		(vec2(frame) + 0.5 * corner + 0.5) / float(IMPOSTOR_FRAMES),
+		float(instance.layer.x));
+	vNormalMatrix = transpose(inverse(mat3(instance.matrix)));
+	gl_Position = uViewProjMatrix * instance.matrix * vec4(position, 1);
+}
+
+#endif
@@ -0,0 +1,93 @@
+#version 430
+
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+
+// One invocation per texel, gl_GlobalInvocationID.z plus uFirstFace is the
+// cube map face, dispatches may cover some faces only
+layout(rgba16f, binding = 0) uniform writeonly imageCube uIrradianceMap;
+uniform int uFirstFace;
+
+// Mipmapped, each sample is filtered from the level whose texels cover about
+// the solid angle of the sample, so that few samples do not alias
+uniform samplerCube uEnvironmentMap;
+uniform float uResolution; // Size of the first level of uEnvironmentMap
+uniform int uSampleCount;
+
+const float PI = 3.14159265359;
+
+float radicalInverse(uint bits)
+{
+	bits = (bits << 16u) | (bits >> 16u);
+	bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+	bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+	bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+	bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+
+	return 2.3283064365386963e-10 * float(bits);
+}
+
+// Direction of the center of a texel, following the cube map face layout of
+// the OpenGL specification (table 8.19)
+vec3 cubeMapDirection(ivec3 texel, int size)
+{
+	vec2 st = 2.0 * (vec2(texel.xy) + 0.5) / float(size) - 1.0;
+
+	switch (texel.z)
+	{
+		case 0: return vec3(1.0, -st.y, -st.x);
+		case 1: return vec3(-1.0, -st.y, st.x);
+		case 2: return vec3(st.x, 1.0, st.y);
+		case 3: return vec3(st.x, -1.0, -st.y);
+		case 4: return vec3(st.x, -st.y, 1.0);
+		default: return vec3(-st.x, -st.y, -1.0);
+	}
+}
+
+void main()
+{
+	int size = imageSize(uIrradianceMap).x;
+	ivec3 texel = ivec3(gl_GlobalInvocationID) + ivec3(0, 0, uFirstFace);
+
+	if (texel.x >= size || texel.y >= size)
+	{
+		return;
+	}
+
+	vec3 normal = normalize(cubeMapDirection(texel, size));
+	vec3 irradiance = vec3(0.0);
+
+	vec3 up = abs(normal.y) < 0.999 ? vec3(0.0, 1.0, 0.0) : vec3(0.0, 0.0, 1.0);
+	vec3 right = normalize(cross(up, normal));
+	up = cross(normal, right);
+
+	// Hammersley points mapped to a cosine-weighted hemisphere: the cosine of
+	// the integrand cancels out with the pdf, cos(theta) / PI, and the mean of
+	// the samples is the irradiance divided by PI, as the shaders expect. A
+	// sample stands for 1 / (samples * pdf) steradians, filtered from one level
+	// above the one whose texels cover that, irradiance being smooth.
+	uint samples = uint(uSampleCount);
+	float texelSolidAngle = 4.0 * PI / (6.0 * uResolution * uResolution);
+
+	for (uint i = 0u; i < samples; ++i)
+	{
+		vec2 xi = vec2(float(i) / float(samples), radicalInverse(i));
+		float phi = 2.0 * PI * xi.x;
+		float cosTheta = sqrt(1.0 - xi.y);
+		float sinTheta = sqrt(xi.y);
+
+		vec3 sampleVec =
+			sinTheta * cos(phi) * right
+			+ sinTheta * sin(phi) * up
+			+ cosTheta * normal;
+
+		float pdf = max(cosTheta, 1e-3) / PI;
+		float sampleSolidAngle = 1.0 / (float(samples) * pdf);
+		float mipLevel =
+			max(0.5 * log2(sampleSolidAngle / texelSolidAngle) + 1.0, 0.0);
+
+		irradiance += textureLod(uEnvironmentMap, sampleVec, mipLevel).rgb;
+	}
+
+	irradiance /= float(samples);
+	imageStore(uIrradianceMap, texel, vec4(irradiance, 1.0));
+}
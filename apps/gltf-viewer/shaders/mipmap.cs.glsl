@@ -0,0 +1,315 @@
+#version 430
+
+// Mip levels downsampled from the level above, see utils/mip_generator.hpp.
+// Layers are the faces of cube maps, a single one for 2D textures.
+//
+// With MIP_CHAIN, the box filter: a work group covers 64x64 texels of the
+// source, each invocation 4x4 of them, and writes up to 6 levels from its
+// 32x32 texels of the first level down to 1 texel, the levels below the
+// second from shared memory. Otherwise one invocation per texel of the single
+// level written.
+#ifdef MIP_CHAIN
+layout(local_size_x = 16, local_size_y = 16, local_size_z = 1) in;
+#else
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+#endif
+
+#if defined(FORMAT_R8)
+#define FORMAT r8
+#elif defined(FORMAT_RGBA16F)
+#define FORMAT rgba16f
+#else
+#define FORMAT rgba8
+#endif
+
+layout(FORMAT, binding = 0) readonly uniform image2DArray uSource;
+layout(FORMAT, binding = 1) writeonly uniform image2DArray uLevel0;
+layout(FORMAT, binding = 2) writeonly uniform image2DArray uLevel1;
+layout(FORMAT, binding = 3) writeonly uniform image2DArray uLevel2;
+layout(FORMAT, binding = 4) writeonly uniform image2DArray uLevel3;
+layout(FORMAT, binding = 5) writeonly uniform image2DArray uLevel4;
+layout(FORMAT, binding = 6) writeonly uniform image2DArray uLevel5;
+
+uniform vec2 uSourceSize;
+uniform int uLevelCount; // Levels written, from uLevel0
+// RGB of the texels are sRGB, or else with uNormals, normals
+uniform bool uSrgb;
+uniform bool uNormals;
+// 1 Kaiser, 2 Lanczos, as MipFilter, without MIP_CHAIN
+uniform int uFilter;
+
+const float PI = 3.14159265359;
+// Of the windowed sinc filters, in texels of the level written
+const float FILTER_RADIUS = 2.0;
+const float KAISER_ALPHA = 4.0;
+
+vec3 srgbToLinear(vec3 color)
+{
+	return mix(
+		color / 12.92,
+		pow((color + 0.055) / 1.055, vec3(2.4)),
+		greaterThan(color, vec3(0.04045)));
+}
+
+vec3 linearToSrgb(vec3 color)
+{
+	return mix(
+		color * 12.92,
+		1.055 * pow(color, vec3(1.0 / 2.4)) - 0.055,
+		greaterThan(color, vec3(0.0031308)));
+}
+
+// Filtered value of a texel
+vec4 decode(vec4 texel)
+{
+	if (uSrgb)
+	{
+		texel.rgb = srgbToLinear(texel.rgb);
+	}
+	else if (uNormals)
+	{
+		texel.xyz = 2.0 * texel.xyz - 1.0;
+	}
+	return texel;
+}
+
+// Filtered values averaging normals are shorter, they are made unit again
+vec4 renormalize(vec4 value)
+{
+	if (uNormals)
+	{
+		float len = length(value.xyz);
+		value.xyz = len > 0.0 ? value.xyz / len : vec3(0.0, 0.0, 1.0);
+	}
+	return value;
+}
+
+vec4 encode(vec4 value)
+{
+	if (uSrgb)
+	{
+		value.rgb = linearToSrgb(clamp(value.rgb, 0.0, 1.0));
+	}
+	else if (uNormals)
+	{
+		value.xyz = 0.5 * value.xyz + 0.5;
+	}
+#ifdef FORMAT_RGBA16F
+	// Negative lobes must not make radiance negative
+	value = max(value, vec4(0.0));
+#endif
+	return value;
+}
+
+ivec2 levelSize(int level)
+{
+	return max(ivec2(uSourceSize) >> (level + 1), ivec2(1));
+}
+
+vec4 loadSource(ivec2 texel, int layer)
+{
+	texel = clamp(texel, ivec2(0), ivec2(uSourceSize) - 1);
+	return decode(imageLoad(uSource, ivec3(texel, layer)));
+}
+
+void storeLevel(int level, ivec2 texel, int layer, vec4 value)
+{
+	if (any(greaterThanEqual(texel, levelSize(level))))
+	{
+		return;
+	}
+
+	ivec3 coordinates = ivec3(texel, layer);
+	value = encode(value);
+
+	switch (level)
+	{
+		case 0: imageStore(uLevel0, coordinates, value); break;
+		case 1: imageStore(uLevel1, coordinates, value); break;
+		case 2: imageStore(uLevel2, coordinates, value); break;
+		case 3: imageStore(uLevel3, coordinates, value); break;
+		case 4: imageStore(uLevel4, coordinates, value); break;
+		default: imageStore(uLevel5, coordinates, value); break;
+	}
+}
+
+#ifdef MIP_CHAIN
+
+// Filtered values of the texels of the work group in the level above the one
+// written, from the second level
+shared vec4 sTexels[16][16];
+
+// Child i of texel along an axis of the level above, of size texels. Odd
+// sizes drop their last row or column, 1 keeps it.
+int child(int texel, int i, int size)
+{
+	return min(2 * texel + i, size - 1);
+}
+
+void main()
+{
+	ivec2 local = ivec2(gl_LocalInvocationID.xy);
+	ivec2 group = ivec2(gl_WorkGroupID.xy);
+	int layer = int(gl_WorkGroupID.z);
+
+	// 2x2 texels of the first level, each of 2x2 texels of the source
+	ivec2 sourceSize = ivec2(uSourceSize);
+	ivec2 quad = 32 * group + 2 * local;
+	vec4 texels[4];
+
+	for (int i = 0; i < 4; ++i)
+	{
+		ivec2 texel = quad + ivec2(i & 1, i >> 1);
+		vec4 sum = vec4(0.0);
+
+		for (int j = 0; j < 4; ++j)
+		{
+			sum += loadSource(
+				ivec2(
+					child(texel.x, j & 1, sourceSize.x),
+					child(texel.y, j >> 1, sourceSize.y)),
+				layer);
+		}
+
+		texels[i] = renormalize(0.25 * sum);
+		storeLevel(0, texel, layer, texels[i]);
+	}
+
+	if (uLevelCount < 2)
+	{
+		return;
+	}
+
+	// The second level from the 2x2 texels of the invocation
+	ivec2 firstSize = levelSize(0);
+	ivec2 texel = 16 * group + local;
+	vec4 sum = vec4(0.0);
+
+	for (int j = 0; j < 4; ++j)
+	{
+		ivec2 offset = ivec2(
+			child(texel.x, j & 1, firstSize.x),
+			child(texel.y, j >> 1, firstSize.y)) - quad;
+		sum += texels[clamp(offset.y, 0, 1) * 2 + clamp(offset.x, 0, 1)];
+	}
+
+	vec4 value = renormalize(0.25 * sum);
+	storeLevel(1, texel, layer, value);
+
+	// Each level from the one above in shared memory, read by every invocation
+	// before it is overwritten
+	sTexels[local.y][local.x] = value;
+
+	for (int level = 2; level < uLevelCount; ++level)
+	{
+		memoryBarrierShared();
+		barrier();
+
+		int tile = 32 >> level;
+		bool reads = all(lessThan(local, ivec2(tile)));
+
+		if (reads)
+		{
+			ivec2 aboveSize = levelSize(level - 1);
+			texel = tile * group + local;
+			sum = vec4(0.0);
+
+			for (int j = 0; j < 4; ++j)
+			{
+				ivec2 offset = ivec2(
+					child(texel.x, j & 1, aboveSize.x),
+					child(texel.y, j >> 1, aboveSize.y)) - 2 * tile * group;
+				offset = clamp(offset, ivec2(0), ivec2(2 * tile - 1));
+				sum += sTexels[offset.y][offset.x];
+			}
+
+			value = renormalize(0.25 * sum);
+			storeLevel(level, texel, layer, value);
+		}
+
+		memoryBarrierShared();
+		barrier();
+
+		if (reads)
+		{
+			sTexels[local.y][local.x] = value;
+		}
+	}
+}
+
+#else
+
+float sinc(float x)
+{
+	return x == 0.0 ? 1.0 : sin(PI * x) / (PI * x);
+}
+
+// Modified Bessel function of the first kind of order 0, by its series
+float besselI0(float x)
+{
+	float sum = 1.0;
+	float term = 1.0;
+
+	for (int k = 1; k < 12; ++k)
+	{
+		term *= (0.5 * x / float(k)) * (0.5 * x / float(k));
+		sum += term;
+	}
+
+	return sum;
+}
+
+// At distance x from the center of a texel written, in texels of its level
+float filterWeight(float x)
+{
+	float t = x / FILTER_RADIUS;
+
+	if (abs(t) >= 1.0)
+	{
+		return 0.0;
+	}
+
+	float window = (uFilter == 2)
+		? sinc(t)
+		: besselI0(KAISER_ALPHA * sqrt(1.0 - t * t)) / besselI0(KAISER_ALPHA);
+	return sinc(x) * window;
+}
+
+void main()
+{
+	ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+	int layer = int(gl_GlobalInvocationID.z);
+
+	if (any(greaterThanEqual(texel, levelSize(0))))
+	{
+		return;
+	}
+
+	// The 8 texels of the source within FILTER_RADIUS along each axis, at the
+	// same distances from every texel written
+	const int TAPS = 2 * int(2.0 * FILTER_RADIUS);
+	float weights[TAPS];
+
+	for (int i = 0; i < TAPS; ++i)
+	{
+		weights[i] = filterWeight(0.5 * (float(i - TAPS / 2) + 0.5));
+	}
+
+	ivec2 first = 2 * texel - (TAPS / 2 - 1);
+	vec4 sum = vec4(0.0);
+	float weightSum = 0.0;
+
+	for (int y = 0; y < TAPS; ++y)
+	{
+		for (int x = 0; x < TAPS; ++x)
+		{
+			float weight = weights[x] * weights[y];
+			sum += weight * loadSource(first + ivec2(x, y), layer);
+			weightSum += weight;
+		}
+	}
+
+	storeLevel(0, texel, layer, renormalize(sum / weightSum));
+}
+
+#endif
@@ -0,0 +1,18 @@
+#version 330
+
+// Equirectangular projection of the cube map of a panorama, see
+// utils/panorama.hpp. The inverse of the mapping of equirectangular.cs.glsl,
+// the bottom row looking down and the center of the image along +x.
+in vec2 vTexCoords;
+
+uniform samplerCube uCubeMap;
+
+out vec4 fColor;
+
+void main()
+{
+	float phi = (vTexCoords.x - 0.5) * 6.28318531;
+	float theta = (vTexCoords.y - 0.5) * 3.14159265;
+	vec3 direction = vec3(cos(theta) * cos(phi), sin(theta), cos(theta) * sin(phi));
+	fColor = vec4(texture(uCubeMap, direction).rgb, 1.0);
+}
@@ -0,0 +1,724 @@
+#version 430
+
+// BINDLESS_TEXTURES and TEXTURE_ARRAYS are defined as for
+// pbr_directional_light.fs.glsl. Material textures are read from the handles
+// of the material buffer with the first, from the PATH_TRACE_TEXTURE_UNITS
+// arrays of uTextures with the second, and not at all without either.
+#if defined(BINDLESS_TEXTURES)
+#extension GL_ARB_bindless_texture : require
+#endif
+
+// One invocation per pixel, adding a sample of the radiance reaching the eye
+// through it to the sum of uAccumulation and writing their average to
+// uAverage, see utils/path_tracer.hpp. Paths bounce off the triangles of the
+// BVH up to uBounces times, lit at each hit by the directional light and one
+// of the punctual lights picked at random, through shadow rays, and by the
+// environment and the emissive surfaces they reach. Surfaces reflect as in
+// evaluateLight() of pbr_directional_light.fs.glsl, a GGX lobe over a
+// Lambertian one, both sampled.
+//
+// With BAKE_OCCLUSION, one invocation per vertex of BakeVertices from
+// uFirstVertex instead, writing to BakedOcclusion the fraction of uRays
+// cosine weighted rays of its hemisphere occluded within uDistance, see
+// utils/baked_occlusion.hpp.
+//
+// With BAKE_VISIBILITY, one invocation per cell of the grid from uFirstCell,
+// setting in VisibleInstances the bits of the instances of the triangles that
+// uRays rays from random points of the cell in random directions hit first,
+// see utils/visible_sets.hpp.
+#if defined(BAKE_OCCLUSION) || defined(BAKE_VISIBILITY)
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+#else
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+
+layout(rgba32f, binding = 0) uniform image2D uAccumulation;
+layout(rgba32f, binding = 1) writeonly uniform image2D uAverage;
+#endif
+
+uniform ivec2 uImageSize;
+// Index of the sample added, 0 starts a new sum
+uniform int uSample;
+uniform int uBounces;
+// Eye, direction through the center of the image, and the offsets from it
+// to the right and top edges
+uniform vec3 uEye;
+uniform vec3 uFront;
+uniform vec3 uRight;
+uniform vec3 uUp;
+// Toward the directional light
+uniform vec3 uLightDirection;
+uniform vec3 uLightRadiance;
+uniform int uLightCount;
+uniform samplerCube uEnvironmentMap;
+// Whether the environment lights the surfaces, it is always seen behind them
+uniform int uEnvironmentLighting;
+// Distance rays leave their surface at, to not hit it again
+uniform float uRayOffset;
+
+#if defined(TEXTURE_ARRAYS)
+// On the units after the one of uEnvironmentMap
+layout(binding = 1) uniform sampler2DArray uTextures[PATH_TRACE_TEXTURE_UNITS];
+#endif
+
+#define M_PI 3.14159265358979323846
+#define M_1_PI 0.318309886183790671538
+#define NO_TEXTURE 15u
+#define ALPHA_MASK 1u
+#define ALPHA_BLEND 2u
+#define STACK_SIZE 64
+#define FAR 3.0e38
+
+// See pbr_directional_light.fs.glsl
+struct Material
+{
+  vec4 baseColorFactor;
+  vec3 emissiveFactor;
+  float metallicFactor;
+  float roughnessFactor;
+  float occlusionStrength;
+  float normalScale;
+  float alphaCutoff;
+  uvec2 baseColorTexture;
+  uvec2 metallicRoughnessTexture;
+  uvec2 emissiveTexture;
+  uvec2 occlusionTexture;
+  uvec2 normalTexture;
+  uint baseColorLayer;
+  uint metallicRoughnessLayer;
+  uint emissiveLayer;
+  uint occlusionLayer;
+  uint normalLayer;
+};
+
+layout(std430, binding = 1) readonly buffer Materials
+{
+  Material uMaterials[];
+};
+
+const float LIGHT_TYPE_DIRECTIONAL = 0.0;
+const float LIGHT_TYPE_SPOT = 2.0;
+
+struct PunctualLight
+{
+  vec4 positionRange;
+  vec4 colorType;
+  vec4 directionScale;
+  vec4 spotOffset;
+};
+
+layout(std430, binding = 4) readonly buffer PunctualLights
+{
+  PunctualLight uLights[];
+};
+
+// Inner nodes have a count of 0 and their children at first and first + 1,
+// leaves count triangles from first
+struct Node
+{
+  vec3 boundsMin;
+  uint first;
+  vec3 boundsMax;
+  uint count;
+};
+
+struct Triangle
+{
+  // w are the texture coordinates of the vertices, u then v
+  vec4 positions[3];
+  vec4 normals[3];
+};
+
+layout(std430, binding = PATH_TRACE_NODES_BINDING) readonly buffer Nodes
+{
+  Node uNodes[];
+};
+
+layout(std430, binding = PATH_TRACE_NODES_BINDING + 1) readonly buffer Triangles
+{
+  Triangle uTriangles[];
+};
+
+layout(std430, binding = PATH_TRACE_NODES_BINDING + 2) readonly buffer TriangleMaterials
+{
+  uint uTriangleMaterials[];
+};
+
+// For each material, the slots of uTextures of its base color, metallic
+// roughness and emissive textures in bits 0, 4 and 8, NO_TEXTURE for factors
+// only, then its alpha mode in bits 12 and 13
+layout(std430, binding = PATH_TRACE_NODES_BINDING + 3) readonly buffer MaterialSlots
+{
+  uint uMaterialSlots[];
+};
+
+#if defined(BAKE_OCCLUSION)
+uniform int uFirstVertex;
+uniform int uVertexCount;
+uniform int uRays;
+uniform float uDistance;
+
+// World space, the normals of the vertices not baked are zero
+struct BakeVertex
+{
+  vec4 position;
+  vec4 normal;
+};
+
+layout(std430, binding = PATH_TRACE_NODES_BINDING + 4) readonly buffer BakeVertices
+{
+  BakeVertex uBakeVertices[];
+};
+
+layout(std430, binding = PATH_TRACE_NODES_BINDING + 5) writeonly buffer BakedOcclusion
+{
+  float uBakedOcclusion[];
+};
+#endif
+
+#if defined(BAKE_VISIBILITY)
+uniform vec3 uGridOrigin;
+uniform float uCellSize;
+uniform ivec3 uCellCounts;
+uniform int uFirstCell;
+uniform int uCellCount;
+uniform int uRays;
+// Of the bits of the instances of a cell
+uniform int uWords;
+
+// Index of the instance of each triangle of Triangles
+layout(std430, binding = PATH_TRACE_NODES_BINDING + 4) readonly buffer TriangleInstances
+{
+  uint uTriangleInstances[];
+};
+
+// uWords per cell of the batch, from uFirstCell
+layout(std430, binding = PATH_TRACE_NODES_BINDING + 5) buffer VisibleInstances
+{
+  uint uVisibleInstances[];
+};
+#endif
+
+uint rngState;
+
+// PCG hash (Jarzynski and Olano, Hash Functions for GPU Rendering, 2020)
+uint pcgHash(uint v)
+{
+  uint state = v * 747796405u + 2891336453u;
+  uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+  return (word >> 22u) ^ word;
+}
+
+float random()
+{
+  rngState = pcgHash(rngState);
+  return float(rngState >> 8) * (1.0 / 16777216.0);
+}
+
+vec4 materialTexture(uint slot, uvec2 handle, uint layer, vec2 uv)
+{
+  if (slot == NO_TEXTURE)
+  {
+    return vec4(1.0);
+  }
+#if defined(BINDLESS_TEXTURES)
+  return textureLod(sampler2D(handle), uv, 0.0);
+#elif defined(TEXTURE_ARRAYS)
+  // Samplers of an array are indexed with constants
+  vec3 coords = vec3(uv, float(layer));
+  switch (slot)
+  {
+  case 0u: return textureLod(uTextures[0], coords, 0.0);
+  case 1u: return textureLod(uTextures[1], coords, 0.0);
+  case 2u: return textureLod(uTextures[2], coords, 0.0);
+  case 3u: return textureLod(uTextures[3], coords, 0.0);
+  case 4u: return textureLod(uTextures[4], coords, 0.0);
+  case 5u: return textureLod(uTextures[5], coords, 0.0);
+  case 6u: return textureLod(uTextures[6], coords, 0.0);
+  case 7u: return textureLod(uTextures[7], coords, 0.0);
+  }
+#endif
+  return vec4(1.0);
+}
+
+vec2 interpolateTexCoords(Triangle triangle, vec2 barycentrics)
+{
+  vec3 weights = vec3(1.0 - barycentrics.x - barycentrics.y, barycentrics);
+  return weights.x * vec2(triangle.positions[0].w, triangle.normals[0].w)
+    + weights.y * vec2(triangle.positions[1].w, triangle.normals[1].w)
+    + weights.z * vec2(triangle.positions[2].w, triangle.normals[2].w);
+}
+
+vec4 baseColorAt(uint materialIndex, vec2 uv)
+{
+  Material material = uMaterials[materialIndex];
+  uint slot = uMaterialSlots[materialIndex] & 15u;
+  return material.baseColorFactor
+    * materialTexture(slot, material.baseColorTexture, material.baseColorLayer, uv);
+}
+
+// Whether a hit of a triangle stops the ray: masked materials let it through
+// below their cutoff, blended ones with a probability of 1 - alpha
+bool opaqueHit(uint triangleIndex, vec2 barycentrics)
+{
+  uint materialIndex = uTriangleMaterials[triangleIndex];
+  uint alphaMode = (uMaterialSlots[materialIndex] >> 12) & 3u;
+  if (alphaMode != ALPHA_MASK && alphaMode != ALPHA_BLEND)
+  {
+    return true;
+  }
+  vec2 uv = interpolateTexCoords(uTriangles[triangleIndex], barycentrics);
+  float alpha = baseColorAt(materialIndex, uv).a;
+  return alphaMode == ALPHA_MASK
+    ? alpha >= uMaterials[materialIndex].alphaCutoff
+    : random() < alpha;
+}
+
+// Moller-Trumbore, both faces, t in (0, tMax)
+bool intersectTriangle(
+  vec3 origin,
+  vec3 direction,
+  Triangle triangle,
+  float tMax,
+  out float t,
+  out vec2 barycentrics)
+{
+  vec3 p0 = triangle.positions[0].xyz;
+  vec3 e1 = triangle.positions[1].xyz - p0;
+  vec3 e2 = triangle.positions[2].xyz - p0;
+  vec3 p = cross(direction, e2);
+  float determinant = dot(e1, p);
+  if (abs(determinant) < 1e-20)
+  {
+    return false;
+  }
+  float inverse = 1.0 / determinant;
+  vec3 s = origin - p0;
+  barycentrics.x = dot(s, p) * inverse;
+  if (barycentrics.x < 0.0 || barycentrics.x > 1.0)
+  {
+    return false;
+  }
+  vec3 q = cross(s, e1);
+  barycentrics.y = dot(direction, q) * inverse;
+  if (barycentrics.y < 0.0 || barycentrics.x + barycentrics.y > 1.0)
+  {
+    return false;
+  }
+  t = dot(e2, q) * inverse;
+  return t > 0.0 && t < tMax;
+}
+
+// Distance along the ray where it enters the box, FAR if it misses it before
+// tMax
+float boxEntry(vec3 origin, vec3 inverseDirection, Node node, float tMax)
+{
+  vec3 t0 = (node.boundsMin - origin) * inverseDirection;
+  vec3 t1 = (node.boundsMax - origin) * inverseDirection;
+  vec3 near = min(t0, t1);
+  vec3 far = max(t0, t1);
+  float entry = max(max(near.x, near.y), max(near.z, 0.0));
+  float exit = min(min(far.x, far.y), min(far.z, tMax));
+  return entry <= exit ? entry : FAR;
+}
+
+// Nearest opaque hit before tMax, or any of them if anyHit, nearest child
+// first
+bool traceRay(
+  vec3 origin,
+  vec3 direction,
+  float tMax,
+  bool anyHit,
+  out float hitT,
+  out uint hitTriangle,
+  out vec2 hitBarycentrics)
+{
+  hitT = tMax;
+  hitTriangle = 0u;
+  hitBarycentrics = vec2(0.0);
+  if (uNodes.length() == 0 || uTriangles.length() == 0)
+  {
+    return false;
+  }
+
+  vec3 inverseDirection = 1.0 / direction;
+  uint stack[STACK_SIZE];
+  int top = 0;
+  bool hit = false;
+  if (boxEntry(origin, inverseDirection, uNodes[0], hitT) < FAR)
+  {
+    stack[top++] = 0u;
+  }
+  while (top > 0)
+  {
+    Node node = uNodes[stack[--top]];
+    if (node.count == 0u)
+    {
+      float left = boxEntry(origin, inverseDirection, uNodes[node.first], hitT);
+      float right =
+        boxEntry(origin, inverseDirection, uNodes[node.first + 1u], hitT);
+      uint nearChild = left <= right ? node.first : node.first + 1u;
+      uint farChild = left <= right ? node.first + 1u : node.first;
+      // The far child is visited after the near one and its hits
+      if (max(left, right) < FAR && top < STACK_SIZE)
+      {
+        stack[top++] = farChild;
+      }
+      if (min(left, right) < FAR && top < STACK_SIZE)
+      {
+        stack[top++] = nearChild;
+      }
+      continue;
+    }
+
+    for (uint i = node.first; i < node.first + node.count; ++i)
+    {
+      float t;
+      vec2 barycentrics;
+      if (intersectTriangle(origin, direction, uTriangles[i], hitT, t, barycentrics)
+        && opaqueHit(i, barycentrics))
+      {
+        hit = true;
+        hitT = t;
+        hitTriangle = i;
+        hitBarycentrics = barycentrics;
+        if (anyHit)
+        {
+          return true;
+        }
+      }
+    }
+  }
+  return hit;
+}
+
+bool occluded(vec3 origin, vec3 direction, float distance)
+{
+  float t;
+  uint triangle;
+  vec2 barycentrics;
+  return traceRay(origin, direction, distance, true, t, triangle, barycentrics);
+}
+
+// See pbr_directional_light.fs.glsl
+vec3 evaluateLight(
+  vec3 L,
+  vec3 N,
+  vec3 V,
+  vec3 diffuse,
+  vec3 F0,
+  float a_sq)
+{
+  vec3 H = normalize(L + V);
+  float NdotL = clamp(dot(N, L), 0, 1);
+  float VdotH = clamp(dot(V, H), 0, 1);
+  float NdotV = clamp(dot(N, V), 0, 1);
+  float NdotH = clamp(dot(N, H), 0, 1);
+
+  float Vis_sqrt_a = sqrt(NdotV * NdotV * (1 - a_sq) + a_sq);
+  float Vis_sqrt_b = sqrt(NdotL * NdotL * (1 - a_sq) + a_sq);
+  float Vis_denom = (NdotL * Vis_sqrt_a) + (NdotV * Vis_sqrt_b);
+  float Vis = Vis_denom <= 0 ? 0 : 0.5 / Vis_denom;
+
+  float VdotH_p5 = (1 - VdotH);
+  VdotH_p5 *= VdotH_p5 * VdotH_p5 * VdotH_p5 * VdotH_p5;
+  float D = a_sq * M_1_PI * pow((NdotH * NdotH) * (a_sq - 1) + 1, -2);
+  vec3 F = F0 + (1 - F0) * VdotH_p5;
+  vec3 f_diffuse = (1 - F) * diffuse * M_1_PI;
+  vec3 f_specular = (F * Vis * D);
+
+  return (f_diffuse + f_specular) * NdotL;
+}
+
+// Radiance of a punctual light reaching position, its direction L and its
+// distance, FAR for directional lights
+vec3 punctualLightRadiance(
+  PunctualLight light,
+  vec3 position,
+  out vec3 L,
+  out float distance)
+{
+  if (light.colorType.w == LIGHT_TYPE_DIRECTIONAL)
+  {
+    L = -light.directionScale.xyz;
+    distance = FAR;
+    return light.colorType.rgb;
+  }
+
+  vec3 toLight = light.positionRange.xyz - position;
+  float distanceSq = max(dot(toLight, toLight), 1e-8);
+  distance = sqrt(distanceSq);
+  L = toLight / distance;
+
+  float attenuation = 1.0 / distanceSq;
+  float range = light.positionRange.w;
+  if (range > 0.0)
+  {
+    float ratio = distanceSq / (range * range);
+    attenuation *= clamp(1.0 - ratio * ratio, 0.0, 1.0);
+  }
+
+  if (light.colorType.w == LIGHT_TYPE_SPOT)
+  {
+    float cd = dot(light.directionScale.xyz, -L);
+    float spot = clamp(
+      cd * light.directionScale.w + light.spotOffset.x,
+      0.0,
+      1.0);
+    attenuation *= spot * spot;
+  }
+
+  return light.colorType.rgb * attenuation;
+}
+
+// World space direction of a direction given around N
+vec3 aroundNormal(vec3 N, vec3 local)
+{
+  vec3 helper = abs(N.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
+  vec3 T = normalize(cross(helper, N));
+  vec3 B = cross(N, T);
+  return T * local.x + B * local.y + N * local.z;
+}
+
+float luminance(vec3 color)
+{
+  return dot(color, vec3(0.2126, 0.7152, 0.0722));
+}
+
+#if defined(BAKE_OCCLUSION)
+void main()
+{
+  if (int(gl_GlobalInvocationID.x) >= uVertexCount)
+  {
+    return;
+  }
+  uint vertex = uint(uFirstVertex) + gl_GlobalInvocationID.x;
+  rngState = pcgHash(vertex);
+  BakeVertex bakeVertex = uBakeVertices[vertex];
+  vec3 N = bakeVertex.normal.xyz;
+  if (dot(N, N) == 0.0)
+  {
+    uBakedOcclusion[vertex] = 0.0;
+    return;
+  }
+
+  // Rays leave the vertex along its normal, not the faces around it
+  vec3 origin = bakeVertex.position.xyz + N * uRayOffset;
+  int hits = 0;
+  for (int i = 0; i < uRays; ++i)
+  {
+    float u = random();
+    float phi = 2.0 * M_PI * random();
+    float sinTheta = sqrt(u);
+    vec3 L = aroundNormal(
+      N,
+      vec3(sinTheta * cos(phi), sinTheta * sin(phi), sqrt(1.0 - u)));
+    hits += occluded(origin, L, uDistance) ? 1 : 0;
+  }
+  uBakedOcclusion[vertex] = float(hits) / float(max(uRays, 1));
+}
+#elif defined(BAKE_VISIBILITY)
+void main()
+{
+  if (int(gl_GlobalInvocationID.x) >= uCellCount)
+  {
+    return;
+  }
+  int cell = uFirstCell + int(gl_GlobalInvocationID.x);
+  rngState = pcgHash(uint(cell));
+  ivec3 coords = ivec3(
+    cell % uCellCounts.x,
+    (cell / uCellCounts.x) % uCellCounts.y,
+    cell / (uCellCounts.x * uCellCounts.y));
+  // Only this invocation writes the bits of its cell
+  uint first = gl_GlobalInvocationID.x * uint(uWords);
+  for (int i = 0; i < uRays; ++i)
+  {
+    vec3 offset = vec3(random(), random(), random());
+    vec3 origin = uGridOrigin + (vec3(coords) + offset) * uCellSize;
+    // Uniform over the sphere
+    float z = 1.0 - 2.0 * random();
+    float phi = 2.0 * M_PI * random();
+    float r = sqrt(max(1.0 - z * z, 0.0));
+    vec3 direction = vec3(r * cos(phi), r * sin(phi), z);
+    float t;
+    uint triangle;
+    vec2 barycentrics;
+    if (traceRay(origin, direction, FAR, false, t, triangle, barycentrics))
+    {
+      uint instance = uTriangleInstances[triangle];
+      uVisibleInstances[first + instance / 32u] |= 1u << (instance % 32u);
+    }
+  }
+}
+#else
+void main()
+{
+  ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+  if (any(greaterThanEqual(pixel, uImageSize)))
+  {
+    return;
+  }
+  rngState = pcgHash(uint(pixel.x) + pcgHash(uint(pixel.y) + pcgHash(uint(uSample))));
+
+  // Jittered over the pixel, the average filters the image with a box
+  vec2 ndc = 2.0 * (vec2(pixel) + vec2(random(), random())) / vec2(uImageSize) - 1.0;
+  vec3 origin = uEye;
+  vec3 direction = normalize(uFront + ndc.x * uRight + ndc.y * uUp);
+
+  vec3 radiance = vec3(0.0);
+  vec3 throughput = vec3(1.0);
+  vec3 dielectricSpecular = vec3(0.04);
+  for (int bounce = 0; bounce <= uBounces; ++bounce)
+  {
+    float t;
+    uint triangleIndex;
+    vec2 barycentrics;
+    if (!traceRay(origin, direction, FAR, false, t, triangleIndex, barycentrics))
+    {
+      if (bounce == 0 || uEnvironmentLighting != 0)
+      {
+        radiance += throughput * textureLod(uEnvironmentMap, direction, 0.0).rgb;
+      }
+      break;
+    }
+
+    // Surface at the hit, facing the ray
+    Triangle triangle = uTriangles[triangleIndex];
+    vec3 weights = vec3(1.0 - barycentrics.x - barycentrics.y, barycentrics);
+    vec3 position = origin + t * direction;
+    vec3 V = -direction;
+    vec3 geometricNormal = normalize(cross(
+      triangle.positions[1].xyz - triangle.positions[0].xyz,
+      triangle.positions[2].xyz - triangle.positions[0].xyz));
+    if (dot(geometricNormal, V) < 0.0)
+    {
+      geometricNormal = -geometricNormal;
+    }
+    vec3 N = weights.x * triangle.normals[0].xyz
+      + weights.y * triangle.normals[1].xyz
+      + weights.z * triangle.normals[2].xyz;
+    N = dot(N, N) > 1e-12 ? normalize(N) : geometricNormal;
+    if (dot(N, geometricNormal) < 0.0)
+    {
+      N = -N;
+    }
+    vec2 uv = interpolateTexCoords(triangle, barycentrics);
+
+    uint materialIndex = uTriangleMaterials[triangleIndex];
+    Material material = uMaterials[materialIndex];
+    uint slots = uMaterialSlots[materialIndex];
+    vec4 baseColor = baseColorAt(materialIndex, uv);
+    vec4 mrSample = materialTexture((slots >> 4) & 15u,
+      material.metallicRoughnessTexture, material.metallicRoughnessLayer, uv);
+    vec4 emSample = materialTexture((slots >> 8) & 15u,
+      material.emissiveTexture, material.emissiveLayer, uv);
+    // A perfect mirror has no lobe to sample
+    float roughness = max(mrSample.g * material.roughnessFactor, 0.03);
+    float metallic = mrSample.b * material.metallicFactor;
+    float a_sq = roughness * roughness * roughness * roughness;
+    vec3 F0 = mix(dielectricSpecular, baseColor.rgb, metallic);
+    vec3 diffuse = mix(baseColor.rgb * (1 - dielectricSpecular.r), vec3(0.0), metallic);
+
+    radiance += throughput * emSample.rgb * material.emissiveFactor;
+
+    vec3 surface = position + geometricNormal * uRayOffset;
+    if (dot(uLightRadiance, uLightRadiance) > 0.0
+      && dot(N, uLightDirection) > 0.0
+      && !occluded(surface, uLightDirection, FAR))
+    {
+      radiance += throughput * uLightRadiance
+        * evaluateLight(uLightDirection, N, V, diffuse, F0, a_sq);
+    }
+    if (uLightCount > 0)
+    {
+      int lightIndex = min(int(random() * float(uLightCount)), uLightCount - 1);
+      vec3 L;
+      float distance;
+      vec3 lightRadiance =
+        punctualLightRadiance(uLights[lightIndex], position, L, distance);
+      if (dot(N, L) > 0.0
+        && dot(lightRadiance, lightRadiance) > 0.0
+        && !occluded(surface, L, distance))
+      {
+        radiance += throughput * float(uLightCount) * lightRadiance
+          * evaluateLight(L, N, V, diffuse, F0, a_sq);
+      }
+    }
+
+    if (bounce == uBounces)
+    {
+      break;
+    }
+
+    // Next direction from one of the lobes, picked by their weight seen from
+    // V, the pdf of the mixture weighs the result
+    float NdotV = max(dot(N, V), 1e-4);
+    vec3 fresnel = F0 + (1.0 - F0) * pow(1.0 - NdotV, 5.0);
+    float specularWeight = luminance(fresnel);
+    float diffuseWeight = luminance(diffuse * (1.0 - fresnel));
+    float specularProbability = clamp(
+      specularWeight / max(specularWeight + diffuseWeight, 1e-6),
+      0.1,
+      0.9);
+    vec3 L;
+    if (random() < specularProbability)
+    {
+      float u = random();
+      float cosTheta = sqrt((1.0 - u) / (1.0 + (a_sq - 1.0) * u));
+      float sinTheta = sqrt(max(1.0 - cosTheta * cosTheta, 0.0));
+      float phi = 2.0 * M_PI * random();
+      vec3 H = aroundNormal(N, vec3(sinTheta * cos(phi), sinTheta * sin(phi), cosTheta));
+      L = reflect(-V, H);
+    }
+    else
+    {
+      float u = random();
+      float phi = 2.0 * M_PI * random();
+      L = aroundNormal(N, vec3(sqrt(u) * cos(phi), sqrt(u) * sin(phi), sqrt(1.0 - u)));
+    }
+    float NdotL = dot(N, L);
+    if (NdotL <= 0.0 || dot(geometricNormal, L) <= 0.0)
+    {
+      break;
+    }
+    vec3 H = normalize(L + V);
+    float NdotH = max(dot(N, H), 0.0);
+    float VdotH = max(dot(V, H), 1e-4);
+    float D = a_sq * M_1_PI * pow((NdotH * NdotH) * (a_sq - 1) + 1, -2);
+    float pdf = specularProbability * D * NdotH / (4.0 * VdotH)
+      + (1.0 - specularProbability) * NdotL * M_1_PI;
+    if (pdf <= 0.0)
+    {
+      break;
+    }
+    throughput *= evaluateLight(L, N, V, diffuse, F0, a_sq) / pdf;
+
+    // Russian roulette after the first bounces
+    if (bounce >= 2)
+    {
+      float survival = clamp(max(throughput.r, max(throughput.g, throughput.b)), 0.05, 0.95);
+      if (random() >= survival)
+      {
+        break;
+      }
+      throughput /= survival;
+    }
+
+    origin = surface;
+    direction = L;
+  }
+
+  // Degenerate triangles would spread their NaNs through the sum
+  if (any(isnan(radiance)) || any(isinf(radiance)))
+  {
+    radiance = vec3(0.0);
+  }
+  vec4 sum = vec4(radiance, 1.0);
+  if (uSample > 0)
+  {
+    sum += imageLoad(uAccumulation, pixel);
+  }
+  imageStore(uAccumulation, pixel, sum);
+  imageStore(uAverage, pixel, vec4(sum.rgb / sum.a, 1.0));
+}
+#endif
@@ -1,117 +1,957 @@
-#version 330
+#version 430
 
+// BINDLESS_TEXTURES is defined by the application when the context supports
+// ARB_bindless_texture, material textures are then read from the handles of
+// the material buffer instead of texture units 0 to 4. Otherwise
+// TEXTURE_ARRAYS is defined and they are layers of the arrays bound to these
+// units, layers are read from the material buffer.
+//
+// VISIBILITY_BUFFER is defined for the resolve pass of the visibility buffer,
+// drawn over the whole viewport: the inputs of the fragment are rebuilt from
+// its triangle, and material textures sampled with their analytic gradients.
+#if defined(VISIBILITY_BUFFER)
+#define SAMPLE_MATERIAL(sampler, coords) \
+  textureGrad(sampler, coords, vTexCoordsDx, vTexCoordsDy)
+#else
+#define SAMPLE_MATERIAL(sampler, coords) texture(sampler, coords)
+#endif
+#if defined(BINDLESS_TEXTURES)
+#extension GL_ARB_bindless_texture : require
+#define MATERIAL_SAMPLER sampler2D
+#define MATERIAL_TEXTURE(handle, layer, unit, uv) \
+  SAMPLE_MATERIAL(sampler2D(handle), uv)
+#elif defined(TEXTURE_ARRAYS)
+#define MATERIAL_SAMPLER sampler2DArray
+#define MATERIAL_TEXTURE(handle, layer, unit, uv) \
+  SAMPLE_MATERIAL(unit, vec3(uv, float(layer)))
+#else
+#define MATERIAL_SAMPLER sampler2D
+#define MATERIAL_TEXTURE(handle, layer, unit, uv) SAMPLE_MATERIAL(unit, uv)
+#endif
+
+// HALF_PRECISION is defined by the application with --half-precision when the
+// context supports AMD_gpu_shader_half_float: the Fresnel and diffuse terms
+// of the lights are evaluated with 16 bit floats, twice as fast on GPUs with
+// packed half math.
+#if defined(HALF_PRECISION)
+#extension GL_AMD_gpu_shader_half_float : require
+#define real float16_t
+#define real3 f16vec3
+#else
+#define real float
+#define real3 vec3
+#endif
+
+// WIREFRAME is defined by the wireframe overlay: the edges of the triangles
+// are drawn over their shading, from the distance in pixels of the fragment
+// to them given by its barycentric coordinates. Those are the ones of the
+// rasterizer with NV_fragment_shader_barycentric, when the application
+// defines WIREFRAME_BARYCENTRICS, else they are computed from the triangle
+// of the fragment pulled from the index and vertex buffers, as the
+// visibility buffer does.
+#if defined(WIREFRAME) && defined(WIREFRAME_BARYCENTRICS)
+#extension GL_NV_fragment_shader_barycentric : require
+#endif
+#if defined(VISIBILITY_BUFFER) \
+  || (defined(WIREFRAME) && !defined(WIREFRAME_BARYCENTRICS))
+#define VERTEX_PULLING
+#endif
+
+#if defined(VISIBILITY_BUFFER)
+// Set by resolveVisibility(), with the screen space derivatives of the
+// texture coordinates and positions in place of dFdx and dFdy, which would
+// mix the triangles of a quad, and the window depth of the fragment in place
+// of gl_FragCoord.z, that of the full screen triangle
+vec2 vTexCoords;
+vec3 vWorldSpacePosition;
+vec3 vWorldSpaceNormal;
+vec4 vWorldSpaceTangent;
+uint vMaterialIndex;
+vec4 vPreviousClipPosition;
+float vBakedOcclusion;
+vec2 vTexCoordsDx;
+vec2 vTexCoordsDy;
+vec3 vWorldSpacePositionDx;
+vec3 vWorldSpacePositionDy;
+float vFragmentDepth;
+#define FRAGMENT_DEPTH vFragmentDepth
+#else
 in vec2 vTexCoords;
 in vec3 vWorldSpacePosition;
 in vec3 vWorldSpaceNormal;
+in vec4 vWorldSpaceTangent;
+flat in uint vMaterialIndex;
+in vec4 vPreviousClipPosition;
+in float vBakedOcclusion;
+#define FRAGMENT_DEPTH gl_FragCoord.z
+#endif
+
+// Written once per frame, see FrameConstants in ViewerApplication.hpp
+layout(std140, binding = 3) uniform FrameConstants
+{
+  vec3 uCamDir;
+  vec3 uLightDirection;
+  vec3 uLightIntensity;
+  // Near and far planes, then the scale and bias giving the cluster slice of
+  // a view space depth from its log, see clusterIndex()
+  vec4 uClusterDepth;
+  // Size of a cluster tile in pixels, number of punctual lights, and the
+  // width of an eye in side by side stereo, 0 otherwise, see clusterIndex()
+  vec4 uClusterTiles;
+  // Jitter of the projection in pixels, then the inverse of the viewport
+  // size, see fVelocity
+  vec4 uTemporalJitter;
+  // 1 / view space depth is x * window depth + y, with reversed depth too,
+  // then 1 / the far plane, see viewDepth()
+  vec4 uInverseDepth;
+};
+
+// KHR_lights_punctual lights, see PunctualLight in utils/lights.hpp
+struct PunctualLight
+{
+  vec4 positionRange;
+  vec4 colorType;
+  vec4 directionScale;
+  vec4 spotOffset;
+};
 
-uniform vec3 uLightDirection;
-uniform vec3 uLightIntensity;
+layout(std430, binding = 4) readonly buffer PunctualLights
+{
+  PunctualLight uLights[];
+};
 
-uniform vec4 uBaseColorFactor;
-uniform sampler2D uBaseColorTexture;
+// For each cluster, its number of lights then CLUSTER_MAX_LIGHTS light
+// indices, filled by cluster_lights.cs.glsl. CLUSTER_* are defined by the
+// application.
+layout(std430, binding = 5) readonly buffer ClusterLights
+{
+  uint uClusterLights[];
+};
 
-uniform float uMetallicFactor;
-uniform float uRoughnessFactor;
-uniform sampler2D uMetallicRoughnessTexture;
+// Cascaded shadow maps of the directional light, see
+// utils/shadow_cascades.hpp. SHADOW_CASCADE_COUNT is defined by the
+// application, at most 4.
+layout(std140, binding = 4) uniform ShadowCascades
+{
+  mat4 uCascadeMatrices[SHADOW_CASCADE_COUNT];
+  // View space depth up to which each cascade is used
+  vec4 uCascadeSplits;
+  // World space size of a texel of each cascade
+  vec4 uCascadeTexelSizes;
+  // Whether shadows are enabled, yzw unused
+  vec4 uShadowParams;
+};
 
-uniform vec3 uEmissiveFactor;
-uniform sampler2D uEmissiveTexture;
+// Factors of every material, uploaded once, see MaterialData in
+// ViewerApplication.hpp
+struct Material
+{
+  vec4 baseColorFactor;
+  vec3 emissiveFactor;
+  float metallicFactor;
+  float roughnessFactor;
+  float occlusionStrength;
+  float normalScale;
+  // Alpha below which fragments are discarded, with ALPHA_MASK
+  float alphaCutoff;
+  // Texture handles, only set with BINDLESS_TEXTURES
+  uvec2 baseColorTexture;
+  uvec2 metallicRoughnessTexture;
+  uvec2 emissiveTexture;
+  uvec2 occlusionTexture;
+  uvec2 normalTexture;
+  // Texture array layers, only set with TEXTURE_ARRAYS
+  uint baseColorLayer;
+  uint metallicRoughnessLayer;
+  uint emissiveLayer;
+  uint occlusionLayer;
+  uint normalLayer;
+};
 
-uniform float uOcclusionStrength;
-uniform sampler2D uOcclusionTexture;
+layout(std430, binding = 1) readonly buffer Materials
+{
+  Material uMaterials[];
+};
 
-uniform float uNormalScale;
-uniform sampler2D uNormalTexture;
+uniform MATERIAL_SAMPLER uBaseColorTexture;
+uniform MATERIAL_SAMPLER uMetallicRoughnessTexture;
+uniform MATERIAL_SAMPLER uEmissiveTexture;
+uniform MATERIAL_SAMPLER uOcclusionTexture;
+uniform MATERIAL_SAMPLER uNormalTexture;
 
 uniform samplerCube uIrradianceMap;
 uniform samplerCube uPrefilterMap;
 uniform sampler2D uBrdfLUT;
-uniform vec3 uCamDir;
+uniform sampler2DArrayShadow uShadowMap;
+
+// Irradiance as 9 spherical harmonics coefficients, used in place of
+// uIrradianceMap when uUseSHIrradiance is set
+uniform bool uUseSHIrradiance;
+layout(std140) uniform SHIrradiance
+{
+  vec4 uSHCoefficients[9];
+};
 
-out vec3 fColor;
+#ifndef ALPHA_BLEND
+// Half resolution screen-space ambient occlusion of the depth pre-pass and
+// its view space depths, see utils/ambient_occlusion.hpp. Blended materials,
+// not in the pre-pass, ignore it.
+uniform bool uAmbientOcclusion;
+uniform sampler2D uAmbientOcclusionMap;
+uniform sampler2D uAmbientOcclusionDepth;
+#endif
+
+#ifdef ALPHA_BLEND
+// Blended materials output their premultiplied color. With weighted blended
+// transparency it is scaled by the weight of the fragment and fRevealage is
+// its alpha, see utils/transparency.hpp. Otherwise they are blended in order
+// over the scene.
+uniform bool uWeightedBlended;
+
+layout(location = 0) out vec4 fColor;
+layout(location = 1) out vec4 fRevealage;
+#else
+layout(location = 0) out vec3 fColor;
+// Motion of the fragment since the previous frame in texture coordinates,
+// for temporal anti-aliasing. Dropped by framebuffers without a second
+// attachment.
+layout(location = 1) out vec2 fVelocity;
+#endif
 
 // Constants
-const float GAMMA = 2.2;
-const float INV_GAMMA = 1. / GAMMA;
 const float M_PI = 3.141592653589793;
 const float M_1_PI = 1.0 / M_PI;
 
-// We need some simple tone mapping functions
-// Basic gamma = 2.2 implementation
-// Stolen here: https://github.com/KhronosGroup/glTF-Sample-Viewer/blob/master/src/shaders/tonemapping.glsl
+const float LIGHT_TYPE_DIRECTIONAL = 0.0;
+const float LIGHT_TYPE_SPOT = 2.0;
+
+// Base color and emissive textures are sRGB textures, sampled texels are
+// already linear. The output is linear radiance, tonemapped once the scene
+// is drawn.
+
+// The coefficients are premultiplied by the basis constants and the cosine
+// lobe convolution, see utils/spherical_harmonics.hpp
+vec3 SHirradiance(vec3 n)
+{
+  return uSHCoefficients[0].rgb
+    + uSHCoefficients[1].rgb * n.y
+    + uSHCoefficients[2].rgb * n.z
+    + uSHCoefficients[3].rgb * n.x
+    + uSHCoefficients[4].rgb * (n.x * n.y)
+    + uSHCoefficients[5].rgb * (n.y * n.z)
+    + uSHCoefficients[6].rgb * (3.0 * n.z * n.z - 1.0)
+    + uSHCoefficients[7].rgb * (n.x * n.z)
+    + uSHCoefficients[8].rgb * (n.x * n.x - n.y * n.y);
+}
+
+// View space depth of the fragment
+float viewDepth()
+{
+  return 1.0 / (FRAGMENT_DEPTH * uInverseDepth.x + uInverseDepth.y);
+}
+
+#ifndef ALPHA_BLEND
+// Bilateral upsample of the ambient occlusion: the 4 half resolution texels
+// around the fragment by their bilinear weight, fading out with their
+// relative depth difference. Fragments drawn after the pre-pass, of no texel
+// depth, are unoccluded.
+float screenSpaceOcclusion()
+{
+  vec2 coords = 0.5 * gl_FragCoord.xy - 0.5;
+  ivec2 base = ivec2(floor(coords));
+  vec2 f = coords - vec2(base);
+  // of the viewport, the targets may be larger
+  ivec2 maxTexel = (ivec2(round(1.0 / uTemporalJitter.zw)) + 1) / 2 - 1;
+  float depth = viewDepth();
+  float occlusion = 0.0;
+  float weightSum = 0.0;
+  for (int i = 0; i < 4; ++i)
+  {
+    ivec2 offset = ivec2(i & 1, i >> 1);
+    ivec2 texel = clamp(base + offset, ivec2(0), maxTexel);
+    vec2 bilinear = mix(1.0 - f, f, vec2(offset));
+    float texelDepth = texelFetch(uAmbientOcclusionDepth, texel, 0).r;
+    float weight = bilinear.x * bilinear.y
+      * clamp(1.0 - 10.0 * abs(texelDepth - depth) / depth, 0.0, 1.0);
+    occlusion += weight * texelFetch(uAmbientOcclusionMap, texel, 0).r;
+    weightSum += weight;
+  }
+  return weightSum > 1e-3 ? occlusion / weightSum : 1.0;
+}
+#endif
+
+// Cluster of the fragment: screen tile and slice of its view space depth,
+// slices are distributed exponentially between the near and far planes. In
+// side by side stereo each eye has half of the tiles.
+uint clusterIndex()
+{
+  float depth = viewDepth();
+  uint slice = uint(clamp(
+    floor(log(depth) * uClusterDepth.z + uClusterDepth.w),
+    0.0,
+    float(CLUSTER_SLICES - 1)));
+  vec2 pixel = gl_FragCoord.xy;
+  uint eyeTiles = uint(CLUSTER_TILES_X);
+  uint firstTile = 0u;
+  if (uClusterTiles.w > 0.0)
+  {
+    eyeTiles = uint(CLUSTER_TILES_X / 2);
+    if (pixel.x >= uClusterTiles.w)
+    {
+      pixel.x -= uClusterTiles.w;
+      firstTile = eyeTiles;
+    }
+  }
+  uvec2 tile = min(
+    uvec2(pixel / uClusterTiles.xy),
+    uvec2(eyeTiles - 1u, CLUSTER_TILES_Y - 1));
+  tile.x += firstTile;
+  return tile.x + CLUSTER_TILES_X * (tile.y + CLUSTER_TILES_Y * slice);
+}
 
-// linear to sRGB approximation
-// see http://chilliant.blogspot.com/2012/08/srgb-approximations-for-hlsl.html
-vec3 LINEARtoSRGB(vec3 color)
+// Fraction of the directional light reaching the fragment, from the cascade of
+// its depth. The position is offset along the geometric normal by a texel
+// against self shadowing, and 3x3 bilinear comparisons soften the edges.
+float directionalShadow()
 {
-  return pow(color, vec3(INV_GAMMA));
+  float depth = viewDepth();
+  if (uShadowParams.x == 0.0
+    || depth > uCascadeSplits[SHADOW_CASCADE_COUNT - 1])
+  {
+    return 1.0;
+  }
+
+  int cascade = 0;
+  while (cascade < SHADOW_CASCADE_COUNT - 1 && depth > uCascadeSplits[cascade])
+  {
+    ++cascade;
+  }
+
+  vec3 position = vWorldSpacePosition
+    + normalize(vWorldSpaceNormal) * 1.5 * uCascadeTexelSizes[cascade];
+  vec3 coords = (uCascadeMatrices[cascade] * vec4(position, 1)).xyz * 0.5 + 0.5;
+  vec2 texel = 1.0 / vec2(textureSize(uShadowMap, 0).xy);
+
+  float lit = 0.0;
+  for (int y = -1; y <= 1; ++y)
+  {
+    for (int x = -1; x <= 1; ++x)
+    {
+      lit += texture(
+        uShadowMap,
+        vec4(coords.xy + vec2(x, y) * texel, float(cascade), coords.z));
+    }
+  }
+  return lit / 9.0;
+}
+
+// Diffuse and specular reflection of a light coming from direction L, for a
+// unit radiance
+vec3 evaluateLight(
+  vec3 L,
+  vec3 N,
+  vec3 V,
+  vec3 diffuse,
+  vec3 F0,
+  float a_sq)
+{
+  vec3 H = normalize(L+V);
+
+  // dot products
+  float NdotL = clamp(dot(N, L), 0, 1);
+  float VdotH = clamp(dot(V, H), 0, 1);
+  float NdotV = clamp(dot(N, V), 0, 1);
+  float NdotH = clamp(dot(N, H), 0, 1);
+
+  // compute Vis
+  float Vis_sqrt_a =
+    sqrt(NdotV * NdotV * (1 - a_sq) + a_sq);
+  float Vis_sqrt_b =
+    sqrt(NdotL * NdotL * (1 - a_sq) + a_sq);
+  float Vis_denom =
+    (NdotL * Vis_sqrt_a) + (NdotV * Vis_sqrt_b);
+
+  float Vis;
+
+  if (Vis_denom <= 0)
+  {
+  	Vis = 0;
+  }
+  else
+  {
+  	Vis = 0.5 / Vis_denom;
+  }
+
+  // regular point-light fresnel, in [0, 1] as the diffuse term. D and Vis
+  // of smooth surfaces exceed the range of half floats, they stay in full
+  // precision.
+  real VdotH_p5 = real(1 - VdotH);
+  VdotH_p5 *= VdotH_p5 * VdotH_p5 * VdotH_p5 * VdotH_p5;
+  float D = a_sq * M_1_PI * pow((NdotH * NdotH) * (a_sq - 1) + 1, -2);
+  real3 F = real3(F0) + (real(1) - real3(F0)) * VdotH_p5;
+  real3 f_diffuse = (real(1) - F) * real3(diffuse) * real(M_1_PI);
+  vec3 f_specular = vec3(F) * (Vis * D);
+
+  return (vec3(f_diffuse) + f_specular) * NdotL;
 }
 
-// sRGB to linear approximation
-// see http://chilliant.blogspot.com/2012/08/srgb-approximations-for-hlsl.html
-vec4 SRGBtoLINEAR(vec4 srgbIn)
+// Radiance of a punctual light reaching the fragment and its direction L,
+// with the attenuation of KHR_lights_punctual
+vec3 punctualLightRadiance(PunctualLight light, out vec3 L)
 {
-  return vec4(pow(srgbIn.xyz, vec3(GAMMA)), srgbIn.w);
+  if (light.colorType.w == LIGHT_TYPE_DIRECTIONAL)
+  {
+    L = -light.directionScale.xyz;
+    return light.colorType.rgb;
+  }
+
+  vec3 toLight = light.positionRange.xyz - vWorldSpacePosition;
+  float distanceSq = max(dot(toLight, toLight), 1e-8);
+  L = toLight * inversesqrt(distanceSq);
+
+  float attenuation = 1.0 / distanceSq;
+  float range = light.positionRange.w;
+  if (range > 0.0)
+  {
+    float ratio = distanceSq / (range * range);
+    attenuation *= clamp(1.0 - ratio * ratio, 0.0, 1.0);
+  }
+
+  if (light.colorType.w == LIGHT_TYPE_SPOT)
+  {
+    float cd = dot(light.directionScale.xyz, -L);
+    float spot = clamp(
+      cd * light.directionScale.w + light.spotOffset.x,
+      0.0,
+      1.0);
+    attenuation *= spot * spot;
+  }
+
+  return light.colorType.rgb * attenuation;
 }
 
+#if defined(VISIBILITY_BUFFER)
+// Draw index + 1 and triangle of each pixel written by visibility.fs.glsl, 0
+// where no draw of the visibility pass is visible
+uniform usampler2D uVisibility;
+// The pass resolves the pixels of the draws of its bin only, whose vertices
+// are in uVertices and, without bindless textures, whose material textures
+// are bound
+uniform int uVisibilityBin;
+// Normalized device depths are window depths, with reversed depth, else they
+// are mapped from [-1, 1]
+uniform bool uZeroToOneDepth;
+#elif defined(WIREFRAME)
+flat in uint vDrawIndex;
+#endif
+
+#if defined(WIREFRAME)
+// Draws whose fragments have no edges, see DrawTransform
+#define WIREFRAME_NONE 0xffffffffu
+#define WIREFRAME_WIDTH 1.0 // Pixels
+#define WIREFRAME_COLOR vec3(0.02)
+#endif
+
+#if defined(VISIBILITY_BUFFER) || defined(WIREFRAME)
+// Transforms of the draws of the frame, see forward.vs.glsl
+struct DrawTransform
+{
+  mat4 modelMatrix;
+  mat4 modelViewProjMatrix;
+  mat4 previousModelViewProjMatrix;
+  mat3x4 normalMatrix;
+  uint materialIndex;
+  uint skinJoints;
+  uint morphTargets;
+  uint mergedVertices;
+  vec4 positionDequantize;
+  uint bakedOcclusion;
+  uint wireframeFirstIndex;
+  int wireframeBaseVertex;
+  uint vertexBuffer;
+};
+
+layout(std430, binding = 2) readonly buffer DrawTransforms
+{
+  DrawTransform uDrawTransforms[];
+};
+#endif
+
+#if defined(VERTEX_PULLING)
+// uIndices holds two 16 bits indices per element
+uniform bool uShortIndices;
+// Bytes between vertices of uVertices, then for the position, normal,
+// texture coordinates and tangent: GL component type, component count (0 if
+// absent), offset and whether normalized, see VertexFormat in
+// utils/packed_geometry.hpp
+#if defined(VISIBILITY_BUFFER)
+uniform int uVertexStride;
+uniform ivec4 uVertexAttributes[4];
+#else
+// Of the vertex buffer of the draw, set from uVertexFormats
+int uVertexStride;
+ivec4 uVertexAttributes[4];
+
+// See PulledVertexFormat in ViewerApplication.hpp
+struct VertexFormat
+{
+  int stride;
+  int padding[3];
+  ivec4 attributes[4];
+};
+
+layout(std430, binding = WIREFRAME_FORMATS_BINDING) readonly buffer VertexFormats
+{
+  VertexFormat uVertexFormats[];
+};
+#endif
+
+#if defined(VISIBILITY_BUFFER)
+// Index range and bin of each draw of the frame, see VisibilityDraw in
+// ViewerApplication.hpp
+struct VisibilityDraw
+{
+  uint firstIndex;
+  int baseVertex;
+  uint bin;
+  uint padding;
+};
+
+layout(std430, binding = VISIBILITY_DRAWS_BINDING) readonly buffer VisibilityDraws
+{
+  VisibilityDraw uVisibilityDraws[];
+};
+#endif
+
+// The packed index buffer and the vertex buffer of the bin, see
+// utils/packed_geometry.hpp
+layout(std430, binding = VISIBILITY_INDICES_BINDING) readonly buffer VisibilityIndices
+{
+  uint uIndices[];
+};
+
+layout(std430, binding = VISIBILITY_VERTICES_BINDING) readonly buffer VisibilityVertices
+{
+  uint uVertices[];
+};
+
+// Merged primitives and baked occlusion, see forward.vs.glsl
+layout(binding = 12) uniform usamplerBuffer uMergedVertices;
+
+struct MergedTransform
+{
+  mat4 modelMatrix;
+  mat3x4 normalMatrix;
+};
+
+layout(std430, binding = 13) readonly buffer MergedTransforms
+{
+  MergedTransform uMergedTransforms[];
+};
+
+layout(binding = 14) uniform samplerBuffer uBakedOcclusion;
+
+#define MERGED_NONE 0xffffffffu
+#define BAKED_OCCLUSION_NONE 0xffffffffu
+
+#define VERTEX_POSITION 0
+#define VERTEX_NORMAL 1
+#define VERTEX_TEXCOORD0 2
+#define VERTEX_TANGENT 3
+
+#define COMPONENT_BYTE 0x1400
+#define COMPONENT_UNSIGNED_BYTE 0x1401
+#define COMPONENT_SHORT 0x1402
+#define COMPONENT_UNSIGNED_SHORT 0x1403
+#define COMPONENT_FLOAT 0x1406
+#define COMPONENT_HALF_FLOAT 0x140B
+#define COMPONENT_INT_2_10_10_10_REV 0x8D9F
+
+uint readIndex(uint i)
+{
+  if (uShortIndices)
+  {
+    return (uIndices[i >> 1] >> ((i & 1u) * 16u)) & 0xffffu;
+  }
+  return uIndices[i];
+}
+
+// Component i of an attribute at byte offset of uVertices, converted as the
+// vertex attribute fetch does, see readPackedAttribute()
+float readComponent(uint offset, int type, bool normalized, int i)
+{
+  if (type == COMPONENT_FLOAT)
+  {
+    return uintBitsToFloat(uVertices[(offset >> 2) + uint(i)]);
+  }
+  if (type == COMPONENT_HALF_FLOAT
+    || type == COMPONENT_SHORT
+    || type == COMPONENT_UNSIGNED_SHORT)
+  {
+    uint byte = offset + 2u * uint(i);
+    uint bits = (uVertices[byte >> 2] >> ((byte & 2u) * 8u)) & 0xffffu;
+    if (type == COMPONENT_HALF_FLOAT)
+    {
+      return unpackHalf2x16(bits).x;
+    }
+    if (type == COMPONENT_SHORT)
+    {
+      float value = float(int(bits << 16) >> 16);
+      return normalized ? max(value / 32767.0, -1.0) : value;
+    }
+    return float(bits) / (normalized ? 65535.0 : 1.0);
+  }
+  if (type == COMPONENT_BYTE || type == COMPONENT_UNSIGNED_BYTE)
+  {
+    uint byte = offset + uint(i);
+    uint bits = (uVertices[byte >> 2] >> ((byte & 3u) * 8u)) & 0xffu;
+    if (type == COMPONENT_BYTE)
+    {
+      float value = float(int(bits << 24) >> 24);
+      return normalized ? max(value / 127.0, -1.0) : value;
+    }
+    return float(bits) / (normalized ? 255.0 : 1.0);
+  }
+  return float(uVertices[(offset >> 2) + uint(i)]);
+}
+
+// Attribute of a vertex of uVertices, (0, 0, 0, 1) if absent
+vec4 readAttribute(uint vertex, int attribute)
+{
+  ivec4 format = uVertexAttributes[attribute];
+  vec4 value = vec4(0, 0, 0, 1);
+  if (format.y == 0)
+  {
+    return value;
+  }
+  uint offset = vertex * uint(uVertexStride) + uint(format.z);
+  if (format.x == COMPONENT_INT_2_10_10_10_REV)
+  {
+    uint bits = uVertices[offset >> 2];
+    ivec4 components = ivec4(
+      int(bits << 22) >> 22,
+      int(bits << 12) >> 22,
+      int(bits << 2) >> 22,
+      int(bits) >> 30);
+    return max(vec4(components) / vec4(511, 511, 511, 1), -1.0);
+  }
+  for (int i = 0; i < min(format.y, 4); ++i)
+  {
+    value[i] = readComponent(offset, format.x, format.w != 0, i);
+  }
+  return value;
+}
+
+// Perspective correct barycentric coordinates of the pixel at ndc in the
+// triangle of clip space vertices, and their derivatives along x and y of a
+// pixel of a viewport of size. Derived from the plane equations of 1 / w and
+// of the coordinates over w, as in "The filtered and culled visibility
+// buffer" (Wihlidal 2016).
+void barycentrics(vec4 clip0, vec4 clip1, vec4 clip2, vec2 ndc, vec2 size,
+  out vec3 lambda, out vec3 lambdaDx, out vec3 lambdaDy)
+{
+  vec3 invW = 1.0 / vec3(clip0.w, clip1.w, clip2.w);
+  vec2 ndc0 = clip0.xy * invW.x;
+  vec2 ndc1 = clip1.xy * invW.y;
+  vec2 ndc2 = clip2.xy * invW.z;
+
+  float invDet = 1.0 / determinant(mat2(ndc2 - ndc1, ndc0 - ndc1));
+  vec3 dx = vec3(ndc1.y - ndc2.y, ndc2.y - ndc0.y, ndc0.y - ndc1.y)
+    * invDet * invW;
+  vec3 dy = vec3(ndc2.x - ndc1.x, ndc0.x - ndc2.x, ndc1.x - ndc0.x)
+    * invDet * invW;
+  float dxSum = dx.x + dx.y + dx.z;
+  float dySum = dy.x + dy.y + dy.z;
+
+  vec2 delta = ndc - ndc0;
+  float interpInvW = invW.x + delta.x * dxSum + delta.y * dySum;
+  lambda = (vec3(invW.x, 0, 0) + delta.x * dx + delta.y * dy) / interpInvW;
+
+  // One pixel is 2 / size in normalized device coordinates
+  dx *= 2.0 / size.x;
+  dy *= 2.0 / size.y;
+  dxSum *= 2.0 / size.x;
+  dySum *= 2.0 / size.y;
+  lambdaDx = (lambda * interpInvW + dx) / (interpInvW + dxSum) - lambda;
+  lambdaDy = (lambda * interpInvW + dy) / (interpInvW + dySum) - lambda;
+}
+#endif
+
+#if defined(VISIBILITY_BUFFER)
+
+// Set the inputs of the fragment from the triangle of its pixel, false if
+// the pixel is not drawn by the visibility pass or not of the bin of the
+// pass. Skinned and morphed draws are left to the forward passes.
+bool resolveVisibility()
+{
+  uvec2 visibility = texelFetch(uVisibility, ivec2(gl_FragCoord.xy), 0).rg;
+  if (visibility.x == 0u)
+  {
+    return false;
+  }
+  uint drawIndex = visibility.x - 1u;
+  VisibilityDraw draw = uVisibilityDraws[drawIndex];
+  if (draw.bin != uint(uVisibilityBin))
+  {
+    return false;
+  }
+  DrawTransform transform = uDrawTransforms[drawIndex];
+
+  vec3 positions[3];
+  vec3 normals[3];
+  vec4 tangents[3];
+  vec2 texCoords[3];
+  vec4 clips[3];
+  vec3 occlusions = vec3(0);
+  for (int v = 0; v < 3; ++v)
+  {
+    uint vertex = uint(
+      int(readIndex(draw.firstIndex + 3u * visibility.y + uint(v)))
+      + draw.baseVertex);
+    vec3 position = transform.positionDequantize.xyz
+      + transform.positionDequantize.w * readAttribute(vertex, VERTEX_POSITION).xyz;
+    vec3 normal = readAttribute(vertex, VERTEX_NORMAL).xyz;
+    vec4 tangent = readAttribute(vertex, VERTEX_TANGENT);
+    if (transform.mergedVertices != MERGED_NONE)
+    {
+      uint member =
+        texelFetch(uMergedVertices, int(transform.mergedVertices + vertex)).r;
+      MergedTransform merged = uMergedTransforms[member];
+      position = vec3(merged.modelMatrix * vec4(position, 1));
+      normal = mat3(merged.normalMatrix) * normal;
+      tangent.xyz = mat3(merged.modelMatrix) * tangent.xyz;
+    }
+    if (transform.bakedOcclusion != BAKED_OCCLUSION_NONE)
+    {
+      occlusions[v] =
+        texelFetch(uBakedOcclusion, int(transform.bakedOcclusion + vertex)).r;
+    }
+    positions[v] = position;
+    normals[v] = normal;
+    tangents[v] = tangent;
+    texCoords[v] = readAttribute(vertex, VERTEX_TEXCOORD0).xy;
+    clips[v] = transform.modelViewProjMatrix * vec4(position, 1);
+  }
+
+  vec3 lambda;
+  vec3 lambdaDx;
+  vec3 lambdaDy;
+  barycentrics(
+    clips[0],
+    clips[1],
+    clips[2],
+    gl_FragCoord.xy * uTemporalJitter.zw * 2.0 - 1.0,
+    1.0 / uTemporalJitter.zw,
+    lambda,
+    lambdaDx,
+    lambdaDy);
+
+  mat3x2 uvs = mat3x2(texCoords[0], texCoords[1], texCoords[2]);
+  vTexCoords = uvs * lambda;
+  vTexCoordsDx = uvs * lambdaDx;
+  vTexCoordsDy = uvs * lambdaDy;
+
+  mat3 objectPositions = mat3(positions[0], positions[1], positions[2]);
+  vec3 position = objectPositions * lambda;
+  vWorldSpacePosition = vec3(transform.modelMatrix * vec4(position, 1));
+  vWorldSpacePositionDx = mat3(transform.modelMatrix) * (objectPositions * lambdaDx);
+  vWorldSpacePositionDy = mat3(transform.modelMatrix) * (objectPositions * lambdaDy);
+  vWorldSpaceNormal = normalize(mat3(transform.normalMatrix)
+    * (mat3(normals[0], normals[1], normals[2]) * lambda));
+  vWorldSpaceTangent = vec4(
+    mat3(transform.modelMatrix)
+      * (mat3(tangents[0].xyz, tangents[1].xyz, tangents[2].xyz) * lambda),
+    tangents[0].w);
+  vMaterialIndex = transform.materialIndex;
+  vBakedOcclusion = dot(occlusions, lambda);
+  vPreviousClipPosition =
+    transform.previousModelViewProjMatrix * vec4(position, 1);
+
+  vec4 clip = mat3x4(clips[0], clips[1], clips[2]) * lambda;
+  float depth = clip.z / clip.w;
+  vFragmentDepth = uZeroToOneDepth ? depth : 0.5 * depth + 0.5;
+  return true;
+}
+#endif
+
+#if defined(WIREFRAME)
+#if !defined(WIREFRAME_BARYCENTRICS)
+// Single pass stereo, see forward.vs.glsl
+uniform int uStereo;
+uniform mat4 uStereoMatrices[2];
+#endif
+
+// Distance in pixels from the fragment to the nearest edge of its triangle,
+// from its barycentric coordinates and their screen space derivatives
+float wireframeDistance()
+{
+  DrawTransform transform = uDrawTransforms[vDrawIndex];
+  if (transform.wireframeFirstIndex == WIREFRAME_NONE)
+  {
+    return 1e6;
+  }
+  vec3 lambda;
+  vec3 lambdaWidth;
+#if defined(WIREFRAME_BARYCENTRICS)
+  lambda = gl_BaryCoordNoPerspNV;
+  lambdaWidth = fwidth(lambda);
+#else
+  VertexFormat format = uVertexFormats[transform.vertexBuffer];
+  uVertexStride = format.stride;
+  uVertexAttributes = format.attributes;
+  // The eyes of stereo each have their half of the viewport
+  int eye = gl_FragCoord.x >= uClusterTiles.w ? 1 : 0;
+  vec4 clips[3];
+  for (int v = 0; v < 3; ++v)
+  {
+    uint vertex = uint(
+      int(readIndex(transform.wireframeFirstIndex + 3u * uint(gl_PrimitiveID) + uint(v)))
+      + transform.wireframeBaseVertex);
+    vec3 position = transform.positionDequantize.xyz
+      + transform.positionDequantize.w * readAttribute(vertex, VERTEX_POSITION).xyz;
+    if (transform.mergedVertices != MERGED_NONE)
+    {
+      uint member =
+        texelFetch(uMergedVertices, int(transform.mergedVertices + vertex)).r;
+      position = vec3(uMergedTransforms[member].modelMatrix * vec4(position, 1));
+    }
+    vec4 clip = transform.modelViewProjMatrix * vec4(position, 1);
+    if (uStereo != 0)
+    {
+      clip = uStereoMatrices[eye] * clip;
+      clip.x = 0.5 * clip.x + (eye == 0 ? -0.5 : 0.5) * clip.w;
+    }
+    clips[v] = clip;
+  }
+  vec3 lambdaDx;
+  vec3 lambdaDy;
+  barycentrics(
+    clips[0],
+    clips[1],
+    clips[2],
+    gl_FragCoord.xy * uTemporalJitter.zw * 2.0 - 1.0,
+    1.0 / uTemporalJitter.zw,
+    lambda,
+    lambdaDx,
+    lambdaDy);
+  lambdaWidth = abs(lambdaDx) + abs(lambdaDy);
+#endif
+  vec3 distances = lambda / max(lambdaWidth, 1e-6);
+  return min(distances.x, min(distances.y, distances.z));
+}
+#endif
+
 void main()
 {
-  // normal map
+#if defined(VISIBILITY_BUFFER)
+  if (!resolveVisibility())
+  {
+    discard;
+  }
+#endif
+  Material material = uMaterials[vMaterialIndex];
+
+  // normal map, the HAS_*_MAP defines of the program variant tell which maps
+  // the material has, missing ones are neutral
+#ifdef HAS_NORMAL_MAP
   vec4 normalSample =
-	  texture2D(uNormalTexture, vTexCoords);
+	  MATERIAL_TEXTURE(material.normalTexture, material.normalLayer, uNormalTexture, vTexCoords);
   vec3 scaledNormal =
 	  (normalSample.xyz * 2.0 - 1.0)
-	  * vec3(uNormalScale, uNormalScale, 1.0);
+	  * vec3(material.normalScale, material.normalScale, 1.0);
+
+  // tbn matrix, from the tangents of the vertices, else from the screen space
+  // derivatives for primitives without
+  vec3 n = normalize(vWorldSpaceNormal);
+  vec3 t = vWorldSpaceTangent.xyz - n * dot(n, vWorldSpaceTangent.xyz);
+  vec3 N;
+  if (dot(t, t) > 1e-12)
+  {
+    t = normalize(t);
+    vec3 b = cross(n, t) * (vWorldSpaceTangent.w < 0.0 ? -1.0 : 1.0);
+    N = normalize(mat3(t, b, n) * scaledNormal);
+  }
+  else
+  {
+#if defined(VISIBILITY_BUFFER)
+    vec3 fragTgX = vWorldSpacePositionDx;
+    vec3 fragTgY = vWorldSpacePositionDy;
 
-  // tbn matrix
-  vec3 fragTgX = dFdx(vWorldSpacePosition);
-  vec3 fragTgY = dFdy(vWorldSpacePosition);
+    vec2 texTgX = vTexCoordsDx;
+    vec2 texTgY = vTexCoordsDy;
+#else
+    vec3 fragTgX = dFdx(vWorldSpacePosition);
+    vec3 fragTgY = dFdy(vWorldSpacePosition);
 
-  vec2 texTgX = dFdx(vTexCoords);
-  vec2 texTgY = dFdy(vTexCoords);
+    vec2 texTgX = dFdx(vTexCoords);
+    vec2 texTgY = dFdy(vTexCoords);
+#endif
 
-  vec3 t = normalize(texTgY.y * fragTgX - texTgX.y * fragTgX);
-  vec3 b = normalize(texTgX.x * fragTgX - texTgX.x * fragTgY);
-  vec3 n = vWorldSpaceNormal;
+    t = normalize(texTgY.y * fragTgX - texTgX.y * fragTgX);
+    vec3 b = normalize(texTgX.x * fragTgX - texTgX.x * fragTgY);
 
-  t = normalize(cross(cross(n, t),n));
-  b = normalize(cross(n, cross(b, n)));
-  mat3 tbn = mat3(t, b, n);
+    t = normalize(cross(cross(n, t),n));
+    b = normalize(cross(n, cross(b, n)));
+    N = normalize(mat3(t, b, n) * scaledNormal + vWorldSpaceNormal);
+  }
+#endif
 
   // constants
   vec3 dielectricSpecular = vec3(0.04, 0.04, 0.04);
   vec3 black = vec3(0, 0, 0);
   vec3 L = uLightDirection;
-  vec3 N = normalize(tbn * scaledNormal + vWorldSpaceNormal);
+#ifndef HAS_NORMAL_MAP
+  vec3 N = normalize(vWorldSpaceNormal);
+#endif
   vec3 V = normalize(uCamDir - vWorldSpacePosition);
-  vec3 H = normalize(L+V);
-
-  // dot products
-  float NdotL = clamp(dot(N, L), 0, 1);
-  float VdotH = clamp(dot(V, H), 0, 1);
   float NdotV = clamp(dot(N, V), 0, 1);
-  float NdotH = clamp(dot(N, H), 0, 1);
 
   // metallic/roughness texture
-  vec4 mrSample = texture2D(uMetallicRoughnessTexture, vTexCoords);
-  float roughness = mrSample.g * uRoughnessFactor;
-  float metallic = mrSample.b * uMetallicFactor;
+#ifdef HAS_METALLIC_ROUGHNESS_MAP
+  vec4 mrSample = MATERIAL_TEXTURE(material.metallicRoughnessTexture,
+    material.metallicRoughnessLayer, uMetallicRoughnessTexture, vTexCoords);
+#else
+  vec4 mrSample = vec4(1.0);
+#endif
+  float roughness = mrSample.g * material.roughnessFactor;
+  float metallic = mrSample.b * material.metallicFactor;
 
   // emissive texture
+#ifdef HAS_EMISSIVE_MAP
   vec4 emSample =
-	SRGBtoLINEAR(texture2D(uEmissiveTexture, vTexCoords));
+	MATERIAL_TEXTURE(material.emissiveTexture, material.emissiveLayer, uEmissiveTexture, vTexCoords);
+#else
+  vec4 emSample = vec4(1.0);
+#endif
   vec3 emissive =
-	emSample.rgb * uEmissiveFactor;
+	emSample.rgb * material.emissiveFactor;
 
-  // occlusion texture
+  // occlusion texture, or the red channel of the metallic-roughness one
+#if defined(OCCLUSION_FROM_METALLIC_ROUGHNESS)
+  vec4 ocSample = mrSample;
+#elif defined(HAS_OCCLUSION_MAP)
   vec4 ocSample =
-	SRGBtoLINEAR(texture2D(uOcclusionTexture, vTexCoords));
+	MATERIAL_TEXTURE(material.occlusionTexture, material.occlusionLayer, uOcclusionTexture, vTexCoords);
+#else
+  vec4 ocSample = vec4(1.0);
+#endif
 
   // color texture
+#ifdef HAS_BASE_COLOR_MAP
   vec4 baseColorFromTexture =
-	SRGBtoLINEAR(texture(uBaseColorTexture, vTexCoords));
+	MATERIAL_TEXTURE(material.baseColorTexture, material.baseColorLayer, uBaseColorTexture, vTexCoords);
+#else
+  vec4 baseColorFromTexture = vec4(1.0);
+#endif
   vec4 baseColor =
-	baseColorFromTexture * uBaseColorFactor;
+	baseColorFromTexture * material.baseColorFactor;
+
+#ifdef ALPHA_MASK
+  if (baseColor.a < material.alphaCutoff)
+  {
+    discard;
+  }
+#endif
 
   // alpha squared == roughness to the 4
   float a_sq =
@@ -120,25 +960,6 @@ void main()
 	* roughness
 	* roughness;
 
-  // compute Vis
-  float Vis_sqrt_a =
-    sqrt(NdotV * NdotV * (1 - a_sq) + a_sq);
-  float Vis_sqrt_b =
-    sqrt(NdotL * NdotL * (1 - a_sq) + a_sq);
-  float Vis_denom =
-    (NdotL * Vis_sqrt_a) + (NdotV * Vis_sqrt_b);
-
-  float Vis;
-
-  if (Vis_denom <= 0)
-  {
-  	Vis = 0;
-  }
-  else
-  {
-  	Vis = 0.5 / Vis_denom;
-  }
-
   // fresnel
   vec3 F0 = mix(dielectricSpecular, baseColor.rgb, metallic);
   vec3 diffuse =
@@ -147,43 +968,111 @@ void main()
       black,
       metallic);
 
-  // regular point-light fresnel
-  float VdotH_p5 = (1 - VdotH);
-  VdotH_p5 *= VdotH_p5 * VdotH_p5 * VdotH_p5 * VdotH_p5;
-  float D = a_sq * M_1_PI * pow((NdotH * NdotH) * (a_sq - 1) + 1, -2);
-  vec3 F = F0 + (1 - F0) * VdotH_p5;
-  vec3 f_diffuse = (1 - F) * diffuse * M_1_PI;
-  vec3 f_specular = (F * Vis * D);
   vec3 unoc_color =
-	(f_diffuse + f_specular)
+	evaluateLight(L, N, V, diffuse, F0, a_sq)
 	* uLightIntensity
-	* NdotL;
+	* directionalShadow();
+
+  // punctual lights of the cluster of the fragment
+  uint cluster = clusterIndex() * (CLUSTER_MAX_LIGHTS + 1);
+  uint clusterLightCount = uClusterLights[cluster];
+  for (uint i = 0; i < clusterLightCount; ++i)
+  {
+    vec3 lightDirection;
+    vec3 radiance = punctualLightRadiance(
+      uLights[uClusterLights[cluster + 1 + i]],
+      lightDirection);
+    unoc_color +=
+      evaluateLight(lightDirection, N, V, diffuse, F0, a_sq) * radiance;
+  }
 
   // modified fresnel for irradiance accounting
   float NdotV_p5 = 1 - NdotV;
   NdotV_p5 *= NdotV_p5 * NdotV_p5 * NdotV_p5 * NdotV_p5;
-  F = F0 + (max(vec3(1.0 - roughness), F0) - F0) * NdotV_p5;
-  vec3 irradiance = texture(uIrradianceMap, N).rgb;
+  vec3 F = F0 + (max(vec3(1.0 - roughness), F0) - F0) * NdotV_p5;
+  // SHADING_LOD is defined for distant draws, which always take their
+  // irradiance from the spherical harmonics
+  vec3 irradiance =
+    uUseSHIrradiance
+    ? max(SHirradiance(N), 0.0)
+    : texture(uIrradianceMap, N).rgb;
   vec3 R = reflect(-V, N);
+  // Roughness from 0 on the first level to 1 on the last one
   vec3 prefilteredColor =
     textureLod(
 	  uPrefilterMap,
 	  R,
-	  roughness * 4.0f).rgb;
+	  roughness * float(textureQueryLevels(uPrefilterMap) - 1)).rgb;
+#if defined(SHADING_LOD)
+  // Analytic fit of the lookup table instead of sampling it, from "Physically
+  // Based Shading on Mobile" (Karis 2014)
+  vec4 brdfRoughness =
+    roughness * vec4(-1.0, -0.0275, -0.572, 0.022)
+    + vec4(1.0, 0.0425, 1.04, -0.04);
+  float brdfBias =
+    min(brdfRoughness.x * brdfRoughness.x, exp2(-9.28 * NdotV))
+    * brdfRoughness.x
+    + brdfRoughness.y;
+  vec2 envBRDF = vec2(-1.04, 1.04) * brdfBias + brdfRoughness.zw;
+#else
   vec2 envBRDF =
     texture(
       uBrdfLUT,
 	  vec2(NdotV, roughness)).rg;
+#endif
   vec3 specular =
     prefilteredColor
 	* (F * envBRDF.x + envBRDF.y);
-  f_diffuse = (1 - F) * diffuse * irradiance;
-  f_specular = specular;
+  vec3 f_diffuse = (1 - F) * diffuse * irradiance;
+  vec3 f_specular = specular;
+  // of the ambient light only, direct light has its shadows
+  f_diffuse *= 1.0 - vBakedOcclusion;
+  f_specular *= 1.0 - vBakedOcclusion;
+#ifndef ALPHA_BLEND
+  if (uAmbientOcclusion)
+  {
+    float ambientOcclusion = screenSpaceOcclusion();
+    f_diffuse *= ambientOcclusion;
+    f_specular *= ambientOcclusion;
+  }
+#endif
   unoc_color += (f_diffuse + f_specular);
 
-  fColor =
-    LINEARtoSRGB(mix(
+  vec3 color =
+    mix(
 	  unoc_color,
 	  unoc_color * ocSample.r,
-	  uOcclusionStrength) + emissive);
+	  material.occlusionStrength) + emissive;
+
+#if defined(WIREFRAME)
+  // Edges are WIREFRAME_WIDTH wide, half on each of their triangles
+  color = mix(
+    color,
+    WIREFRAME_COLOR,
+    1.0 - smoothstep(-0.5, 0.5, wireframeDistance() - 0.5 * WIREFRAME_WIDTH));
+#endif
+
+#ifdef ALPHA_BLEND
+  float alpha = baseColor.a;
+  fColor = vec4(color * alpha, alpha);
+  if (uWeightedBlended)
+  {
+    // Weight of equation 7 of the paper, nearer fragments dominate the
+    // average
+    float z = viewDepth();
+    float weight = clamp(
+      10.0 / (1e-5 + pow(z / 5.0, 2.0) + pow(z / 200.0, 6.0)),
+      1e-2,
+      3e3);
+    fColor *= weight;
+    fRevealage = vec4(alpha);
+  }
+#else
+  fColor = color;
+
+  vec2 coords = (gl_FragCoord.xy - uTemporalJitter.xy) * uTemporalJitter.zw;
+  vec2 previousCoords =
+    0.5 * vPreviousClipPosition.xy / vPreviousClipPosition.w + 0.5;
+  fVelocity = coords - previousCoords;
+#endif
 }
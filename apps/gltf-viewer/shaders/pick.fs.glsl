@@ -0,0 +1,12 @@
+#version 430
+
+// Picking pass, the index of the draw under the picked pixel + 1, see
+// utils/picking.hpp
+flat in uint vDrawIndex;
+
+layout(location = 0) out uint fPickedDraw;
+
+void main()
+{
+	fPickedDraw = vDrawIndex + 1u;
+}
@@ -0,0 +1,257 @@
+#version 430
+#extension GL_ARB_gpu_shader_int64 : require
+#extension GL_NV_shader_atomic_int64 : require
+
+// One invocation per point of the octree nodes of a frame sharing a vertex
+// buffer, see drawScene. Each point is projected to its pixel, and kept if it
+// is the closest one of the pixel: pixels of uPoints hold the depth of their
+// point in their high 32 bits and its color in the low ones, so that one 64
+// bit atomicMin keeps both, as in "Rendering Point Clouds with Compute
+// Shaders and Vertex Order Optimization" (Schütz et al. 2021). They are
+// written to the scene by points_resolve.fs.glsl.
+layout(local_size_x = 256, local_size_y = 1, local_size_z = 1) in;
+
+// See forward.vs.glsl
+struct DrawTransform
+{
+	mat4 modelMatrix;
+	mat4 modelViewProjMatrix;
+	mat4 previousModelViewProjMatrix;
+	mat3x4 normalMatrix;
+	uint materialIndex;
+	uint skinJoints;
+	uint morphTargets;
+	uint mergedVertices;
+	vec4 positionDequantize;
+	uint bakedOcclusion;
+};
+
+layout(std430, binding = 2) readonly buffer DrawTransforms
+{
+	DrawTransform uDrawTransforms[];
+};
+
+// See pbr_directional_light.fs.glsl
+struct Material
+{
+	vec4 baseColorFactor;
+	vec3 emissiveFactor;
+	float metallicFactor;
+	float roughnessFactor;
+	float occlusionStrength;
+	float normalScale;
+	float alphaCutoff;
+	uvec2 baseColorTexture;
+	uvec2 metallicRoughnessTexture;
+	uvec2 emissiveTexture;
+	uvec2 occlusionTexture;
+	uvec2 normalTexture;
+	uint baseColorLayer;
+	uint metallicRoughnessLayer;
+	uint emissiveLayer;
+	uint occlusionLayer;
+	uint normalLayer;
+};
+
+layout(std430, binding = 1) readonly buffer Materials
+{
+	Material uMaterials[];
+};
+
+// Depth then color of the closest point of each pixel, all ones where there
+// is none
+layout(std430, binding = POINT_FRAMEBUFFER_BINDING) buffer PointFramebuffer
+{
+	uint64_t uPoints[];
+};
+
+// See PointJob in ViewerApplication.hpp
+struct PointJob
+{
+	uint firstIndex;
+	uint count;
+	int baseVertex;
+	uint drawIndex;
+	uint firstPoint;
+	uint padding[3];
+};
+
+layout(std430, binding = POINT_JOBS_BINDING) readonly buffer PointJobs
+{
+	PointJob uJobs[];
+};
+
+// The packed index buffer and the vertex buffer of the jobs, see
+// utils/packed_geometry.hpp
+layout(std430, binding = POINT_INDICES_BINDING) readonly buffer PointIndices
+{
+	uint uIndices[];
+};
+
+layout(std430, binding = POINT_VERTICES_BINDING) readonly buffer PointVertices
+{
+	uint uVertices[];
+};
+
+// Jobs [uFirstJob, uFirstJob + uJobCount) of the dispatch, of uPointCount
+// points in all
+uniform int uFirstJob;
+uniform int uJobCount;
+uniform int uPointCount;
+// uIndices holds two 16 bits indices per element
+uniform bool uShortIndices;
+// Bytes between vertices of uVertices, then for the position and normal: GL
+// component type, component count (0 if absent), offset and whether
+// normalized, see VertexFormat in utils/packed_geometry.hpp
+uniform int uVertexStride;
+uniform ivec4 uVertexAttributes[2];
+uniform ivec2 uViewportSize;
+// Normalized device depths are window depths, closer ones greater, else they
+// are mapped from [-1, 1]
+uniform bool uReversedZ;
+// Towards the light, in world space
+uniform vec3 uLightDirection;
+
+#define VERTEX_POSITION 0
+#define VERTEX_NORMAL 1
+
+#define COMPONENT_BYTE 0x1400
+#define COMPONENT_UNSIGNED_BYTE 0x1401
+#define COMPONENT_SHORT 0x1402
+#define COMPONENT_UNSIGNED_SHORT 0x1403
+#define COMPONENT_FLOAT 0x1406
+#define COMPONENT_HALF_FLOAT 0x140B
+#define COMPONENT_INT_2_10_10_10_REV 0x8D9F
+
+// As in pbr_directional_light.fs.glsl
+uint readIndex(uint i)
+{
+	if (uShortIndices)
+	{
+		return (uIndices[i >> 1] >> ((i & 1u) * 16u)) & 0xffffu;
+	}
+	return uIndices[i];
+}
+
+float readComponent(uint offset, int type, bool normalized, int i)
+{
+	if (type == COMPONENT_FLOAT)
+	{
+		return uintBitsToFloat(uVertices[(offset >> 2) + uint(i)]);
+	}
+	if (type == COMPONENT_HALF_FLOAT
+		|| type == COMPONENT_SHORT
+		|| type == COMPONENT_UNSIGNED_SHORT)
+	{
+		uint byte = offset + 2u * uint(i);
+		uint bits = (uVertices[byte >> 2] >> ((byte & 2u) * 8u)) & 0xffffu;
+		if (type == COMPONENT_HALF_FLOAT)
+		{
+			return unpackHalf2x16(bits).x;
+		}
+		if (type == COMPONENT_SHORT)
+		{
+			float value = float(int(bits << 16) >> 16);
+			return normalized ? max(value / 32767.0, -1.0) : value;
+		}
+		return float(bits) / (normalized ? 65535.0 : 1.0);
+	}
+	if (type == COMPONENT_BYTE || type == COMPONENT_UNSIGNED_BYTE)
+	{
+		uint byte = offset + uint(i);
+		uint bits = (uVertices[byte >> 2] >> ((byte & 3u) * 8u)) & 0xffu;
+		if (type == COMPONENT_BYTE)
+		{
+			float value = float(int(bits << 24) >> 24);
+			return normalized ? max(value / 127.0, -1.0) : value;
+		}
+		return float(bits) / (normalized ? 255.0 : 1.0);
+	}
+	return float(uVertices[(offset >> 2) + uint(i)]);
+}
+
+vec4 readAttribute(uint vertex, int attribute)
+{
+	ivec4 format = uVertexAttributes[attribute];
+	vec4 value = vec4(0, 0, 0, 1);
+	if (format.y == 0)
+	{
+		return value;
+	}
+	uint offset = vertex * uint(uVertexStride) + uint(format.z);
+	if (format.x == COMPONENT_INT_2_10_10_10_REV)
+	{
+		uint bits = uVertices[offset >> 2];
+		ivec4 components = ivec4(
+			int(bits << 22) >> 22,
+			int(bits << 12) >> 22,
+			int(bits << 2) >> 22,
+			int(bits) >> 30);
+		return max(vec4(components) / vec4(511, 511, 511, 1), -1.0);
+	}
+	for (int i = 0; i < min(format.y, 4); ++i)
+	{
+		value[i] = readComponent(offset, format.x, format.w != 0, i);
+	}
+	return value;
+}
+
+void main()
+{
+	int point = int(gl_GlobalInvocationID.x);
+	if (point >= uPointCount)
+	{
+		return;
+	}
+
+	// Last job starting at or before the point
+	int first = uFirstJob;
+	int last = uFirstJob + uJobCount - 1;
+	while (first < last)
+	{
+		int middle = (first + last + 1) / 2;
+		if (uJobs[middle].firstPoint <= uint(point))
+		{
+			first = middle;
+		}
+		else
+		{
+			last = middle - 1;
+		}
+	}
+	PointJob job = uJobs[first];
+	DrawTransform transform = uDrawTransforms[job.drawIndex];
+
+	uint vertex = uint(int(readIndex(job.firstIndex + uint(point) - job.firstPoint))
+		+ job.baseVertex);
+	vec3 position = transform.positionDequantize.xyz
+		+ transform.positionDequantize.w * readAttribute(vertex, VERTEX_POSITION).xyz;
+	vec4 clip = transform.modelViewProjMatrix * vec4(position, 1);
+	if (clip.w <= 0.0)
+	{
+		return;
+	}
+	vec3 ndc = clip.xyz / clip.w;
+	float depth = uReversedZ ? 1.0 - ndc.z : 0.5 * ndc.z + 0.5;
+	ivec2 pixel = ivec2(floor((0.5 * ndc.xy + 0.5) * vec2(uViewportSize)));
+	if (any(lessThan(pixel, ivec2(0)))
+		|| any(greaterThanEqual(pixel, uViewportSize))
+		|| depth < 0.0
+		|| depth > 1.0)
+	{
+		return;
+	}
+
+	// Base color under a headlight, scans are lit from either side
+	vec3 color = uMaterials[transform.materialIndex].baseColorFactor.rgb;
+	if (uVertexAttributes[VERTEX_NORMAL].y != 0)
+	{
+		vec3 normal = normalize(mat3(transform.normalMatrix)
+			* readAttribute(vertex, VERTEX_NORMAL).xyz);
+		color *= 0.25 + 0.75 * abs(dot(normal, uLightDirection));
+	}
+	uint packedColor = packUnorm4x8(vec4(sqrt(clamp(color, 0.0, 1.0)), 1));
+
+	uint64_t key = (uint64_t(floatBitsToUint(depth)) << 32) | uint64_t(packedColor);
+	atomicMin(uPoints[pixel.y * uViewportSize.x + pixel.x], key);
+}
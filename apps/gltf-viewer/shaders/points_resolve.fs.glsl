@@ -0,0 +1,35 @@
+#version 430
+
+// Points splatted by points_rasterize.cs.glsl, written over the viewport with
+// the depth of the closest point of each pixel, tested against the other
+// draws of the scene. Pixels without points are discarded.
+
+// Color in the low 32 bits of each pixel, depth in the high ones
+layout(std430, binding = POINT_FRAMEBUFFER_BINDING) readonly buffer PointFramebuffer
+{
+	uvec2 uPoints[];
+};
+
+uniform int uViewportWidth;
+// See points_rasterize.cs.glsl
+uniform bool uReversedZ;
+uniform vec3 uLightRadiance;
+
+layout(location = 0) out vec3 fColor;
+layout(location = 1) out vec2 fVelocity;
+
+void main()
+{
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	uvec2 point = uPoints[pixel.y * uViewportWidth + pixel.x];
+	if (point.y == 0xffffffffu)
+	{
+		discard;
+	}
+	vec3 color = unpackUnorm4x8(point.x).rgb;
+	fColor = color * color * uLightRadiance;
+	float depth = uintBitsToFloat(point.y);
+	gl_FragDepth = uReversedZ ? 1.0 - depth : depth;
+	// Points are splatted in the pose of the frame only
+	fVelocity = vec2(0);
+}
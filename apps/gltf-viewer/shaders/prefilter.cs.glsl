@@ -1,12 +1,19 @@
-#version 330
+#version 430
 
-in vec3 vViewSpacePosition;
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
 
+// One invocation per texel of the mip level bound to uPrefilterMap,
+// gl_GlobalInvocationID.z plus uFirstFace is the cube map face, dispatches
+// may cover some faces only
+layout(rgba16f, binding = 0) uniform writeonly imageCube uPrefilterMap;
+uniform int uFirstFace;
+
+// Mipmapped, each sample is filtered from the level whose texels cover about
+// the solid angle of the sample, so that few samples do not alias
 uniform samplerCube uEnvironmentMap;
 uniform float uRoughness;
-uniform float uResolution;
-
-out vec4 fColor;
+uniform float uResolution; // Size of the first level of uEnvironmentMap
+uniform int uSampleCount;
 
 const float PI = 3.14159265359f;
 
@@ -66,14 +73,49 @@ float DistributionGGX(float NdotH2, float a)
 	return a2 / denom;
 }
   
+// Direction of the center of a texel, following the cube map face layout of
+// the OpenGL specification (table 8.19)
+vec3 cubeMapDirection(ivec3 texel, int size)
+{
+	vec2 st = 2.0f * (vec2(texel.xy) + 0.5f) / float(size) - 1.0f;
+
+	switch (texel.z)
+	{
+		case 0: return vec3(1.0f, -st.y, -st.x);
+		case 1: return vec3(-1.0f, -st.y, st.x);
+		case 2: return vec3(st.x, 1.0f, st.y);
+		case 3: return vec3(st.x, -1.0f, -st.y);
+		case 4: return vec3(st.x, -st.y, 1.0f);
+		default: return vec3(-st.x, -st.y, -1.0f);
+	}
+}
+
 void main()
 {
-    vec3 N = normalize(vViewSpacePosition);
+	int size = imageSize(uPrefilterMap).x;
+	ivec3 texel = ivec3(gl_GlobalInvocationID) + ivec3(0, 0, uFirstFace);
+
+	if (texel.x >= size || texel.y >= size)
+	{
+		return;
+	}
+
+    vec3 N = normalize(cubeMapDirection(texel, size));
+
+	// Every GGX sample is N without roughness, the environment is only
+	// downsampled to the size of the level
+	if (uRoughness == 0.0f)
+	{
+		vec3 color = textureLod(uEnvironmentMap, N, log2(uResolution / float(size))).rgb;
+		imageStore(uPrefilterMap, texel, vec4(color, 1.0f));
+		return;
+	}
+
     vec3 R = N;
     vec3 V = R;
 
-    const uint samples = 1024u;
-	const float Ni = 1.0f / samples;
+    uint samples = uint(uSampleCount);
+	float Ni = 1.0f / float(samples);
 
     float totalWeight = 0.0f;
     vec3 prefilteredColor = vec3(0.0f);
@@ -92,16 +134,7 @@ void main()
 		float pdf = ((D * NdotH) / (4.0f * HdotV)) + 0.0001f; 
 		float saTexel = 4.0f * PI / (6.0f * uResolution * uResolution);
 		float saSample = 1.0f / (float(samples) * pdf + 0.0001f);
-		float mipLevel;
-
-		if (uRoughness == 0.0f)
-		{
-			mipLevel = 0.0f;
-		}
-		else
-		{
-			mipLevel = 0.5f * log2(saSample / saTexel);
-		}
+		float mipLevel = 0.5f * log2(saSample / saTexel);
 
         if (NdotL > 0.0f)
         {
@@ -111,5 +144,5 @@ void main()
     }
 
     prefilteredColor /= totalWeight;
-    fColor = vec4(prefilteredColor, 1.0f);
+    imageStore(uPrefilterMap, texel, vec4(prefilteredColor, 1.0f));
 }
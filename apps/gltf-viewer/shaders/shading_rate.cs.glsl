@@ -0,0 +1,99 @@
+#version 430
+
+// One workgroup per texel of the shading rate image, see
+// utils/shading_rate.hpp: the index of the rate of the pixels it covers in
+// the palette, 0 at full rate to 2 at one fragment per 4x4 pixels. Mono
+// scenes get it from the contrast of the previous frame, flat regions being
+// shaded coarser, stereo ones from the distance to the center of each eye.
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+
+uniform sampler2D uColor;
+uniform sampler2DMS uColorMS;
+// Samples of uColorMS, uColor is read instead if 0. Sample 0 stands for the
+// pixel.
+uniform int uSamples;
+// Of the scene, in pixels
+uniform ivec2 uViewportSize;
+// Pixels covered by a texel of the image
+uniform ivec2 uTexelSize;
+// Of the tonemap, luminances are compared as displayed
+uniform float uExposure;
+// Standard deviation of the displayed luminance of a texel below which it is
+// shaded at one fragment per 2x2 pixels, and per 4x4 pixels below half of it
+uniform float uThreshold;
+// Side by side eyes of half the viewport each, foveated
+uniform int uStereo;
+
+layout(r8ui, binding = 0) writeonly uniform uimage2D uRates;
+
+shared vec2 sMoments[64];
+shared uint sPixels[64];
+
+float displayedLuminance(ivec2 pixel)
+{
+	vec3 color = uSamples > 0
+		? texelFetch(uColorMS, pixel, 0).rgb
+		: texelFetch(uColor, pixel, 0).rgb;
+	float luminance = uExposure * dot(color, vec3(0.2126, 0.7152, 0.0722));
+	return luminance / (1.0 + luminance);
+}
+
+void main()
+{
+	ivec2 texel = ivec2(gl_WorkGroupID.xy);
+	uint index = gl_LocalInvocationIndex;
+	ivec2 origin = texel * uTexelSize;
+	ivec2 end = min(origin + uTexelSize, uViewportSize);
+
+	if (uStereo != 0)
+	{
+		if (index == 0)
+		{
+			// Distance to the center of the eye, 1 at the border of its half
+			vec2 eyeSize = vec2(uViewportSize) * vec2(0.5, 1.0);
+			vec2 center = vec2(origin + end) * 0.5;
+			vec2 eyeCenter = vec2(center.x < eyeSize.x ? 0.5 : 1.5, 0.5) * eyeSize;
+			float distance = length((center - eyeCenter) / (0.5 * eyeSize));
+			uint rate = distance < 0.6 ? 0u : (distance < 0.9 ? 1u : 2u);
+			imageStore(uRates, texel, uvec4(rate));
+		}
+		return;
+	}
+
+	// Sum and sum of squares of the luminances of the pixels of the invocation
+	vec2 moments = vec2(0.0);
+	uint pixels = 0u;
+	for (int y = origin.y + int(gl_LocalInvocationID.y); y < end.y; y += 8)
+	{
+		for (int x = origin.x + int(gl_LocalInvocationID.x); x < end.x; x += 8)
+		{
+			float luminance = displayedLuminance(ivec2(x, y));
+			moments += vec2(luminance, luminance * luminance);
+			++pixels;
+		}
+	}
+	sMoments[index] = moments;
+	sPixels[index] = pixels;
+	barrier();
+
+	for (uint stride = 32u; stride > 0u; stride /= 2u)
+	{
+		if (index < stride)
+		{
+			sMoments[index] += sMoments[index + stride];
+			sPixels[index] += sPixels[index + stride];
+		}
+		barrier();
+	}
+
+	if (index == 0)
+	{
+		float count = float(max(sPixels[0], 1u));
+		vec2 mean = sMoments[0] / count;
+		float deviation = sqrt(max(mean.y - mean.x * mean.x, 0.0));
+		uint rate = deviation < 0.5 * uThreshold
+			? 2u
+			: (deviation < uThreshold ? 1u : 0u);
+		imageStore(uRates, texel, uvec4(rate));
+	}
+}
@@ -0,0 +1,140 @@
+#version 430
+
+layout(location = 0) in vec3 aPosition;
+layout(location = 3) in uvec4 aJoints;
+layout(location = 4) in vec4 aWeights;
+// Instanced attribute, equal to the base instance of the draw, which is the
+// index of the draw item
+layout(location = 6) in uint aDrawIndex;
+
+// World matrix and skin of every draw item, see ShadowItem in
+// ViewerApplication.hpp. Only uploaded when the scene changes since cascades
+// are not rendered every frame.
+struct ShadowItem
+{
+	mat4 matrix;
+	uint skinJoints;
+	uint morphTargets;
+	uint mergedVertices;
+	vec4 positionDequantize; // As in forward.vs.glsl
+};
+
+layout(std430, binding = 6) readonly buffer ShadowItems
+{
+	ShadowItem uItems[];
+};
+
+// As in forward.vs.glsl, without normals
+layout(binding = 9) uniform samplerBuffer uMorphDeltas;
+
+struct MorphTarget
+{
+	int positions;
+	int normals;
+	float weight;
+	uint padding; // As MorphTargets::ActiveTarget, std430 would pack to 12
+};
+
+layout(std430, binding = 8) readonly buffer MorphTargets
+{
+	MorphTarget uMorphTargets[];
+};
+
+#define MORPH_NONE 0xffffffffu
+
+vec3 morphPosition(uint first, vec3 position)
+{
+	uint end = first + 1u + uint(uMorphTargets[first].positions);
+	for (uint i = first + 1u; i < end; ++i)
+	{
+		MorphTarget target = uMorphTargets[i];
+		position += target.weight
+			* texelFetch(uMorphDeltas, target.positions + gl_VertexID).xyz;
+	}
+	return position;
+}
+
+layout(std430, binding = 7) readonly buffer SkinJoints
+{
+	mat4 uJointMatrices[];
+};
+
+#define SKIN_NONE 0xffffffffu
+#define SKIN_DUAL_QUATERNION_BIT 0x80000000u
+
+vec3 skinPosition(uint skinJoints, vec3 position)
+{
+	uint first = skinJoints & ~SKIN_DUAL_QUATERNION_BIT;
+	if ((skinJoints & SKIN_DUAL_QUATERNION_BIT) == 0u)
+	{
+		mat4 skinMatrix =
+			aWeights.x * uJointMatrices[first + aJoints.x] +
+			aWeights.y * uJointMatrices[first + aJoints.y] +
+			aWeights.z * uJointMatrices[first + aJoints.z] +
+			aWeights.w * uJointMatrices[first + aJoints.w];
+		return vec3(skinMatrix * vec4(position, 1));
+	}
+
+	mat4 dq0 = uJointMatrices[first + aJoints.x];
+	mat4 dq1 = uJointMatrices[first + aJoints.y];
+	mat4 dq2 = uJointMatrices[first + aJoints.z];
+	mat4 dq3 = uJointMatrices[first + aJoints.w];
+	vec4 w = aWeights * vec4(1,
+		sign(dot(dq0[0], dq1[0]) + 1e-6),
+		sign(dot(dq0[0], dq2[0]) + 1e-6),
+		sign(dot(dq0[0], dq3[0]) + 1e-6));
+	vec4 real = w.x * dq0[0] + w.y * dq1[0] + w.z * dq2[0] + w.w * dq3[0];
+	vec4 dual = w.x * dq0[1] + w.y * dq1[1] + w.z * dq2[1] + w.w * dq3[1];
+	float len = length(real);
+	real /= len;
+	dual /= len;
+
+	return position
+		+ 2 * cross(real.xyz, cross(real.xyz, position) + real.w * position)
+		+ 2 * (real.w * dual.xyz - dual.w * real.xyz + cross(real.xyz, dual.xyz));
+}
+
+// As in forward.vs.glsl, without normals
+layout(binding = 12) uniform usamplerBuffer uMergedVertices;
+
+struct MergedTransform
+{
+	mat4 modelMatrix;
+	mat3x4 normalMatrix;
+};
+
+layout(std430, binding = 13) readonly buffer MergedTransforms
+{
+	MergedTransform uMergedTransforms[];
+};
+
+#define MERGED_NONE 0xffffffffu
+
+vec3 mergedPosition(uint mergedVertices, vec3 position)
+{
+	uint member =
+		texelFetch(uMergedVertices, int(mergedVertices) + gl_VertexID).r;
+	return vec3(uMergedTransforms[member].modelMatrix * vec4(position, 1));
+}
+
+uniform mat4 uLightViewProjMatrix;
+
+void main()
+{
+	ShadowItem item = uItems[aDrawIndex];
+	vec3 position =
+		item.positionDequantize.xyz + item.positionDequantize.w * aPosition;
+	if (item.morphTargets != MORPH_NONE)
+	{
+		position = morphPosition(item.morphTargets, position);
+	}
+	if (item.skinJoints != SKIN_NONE)
+	{
+		position = skinPosition(item.skinJoints, position);
+	}
+	if (item.mergedVertices != MERGED_NONE)
+	{
+		position = mergedPosition(item.mergedVertices, position);
+	}
+	gl_Position = uLightViewProjMatrix * item.matrix * vec4(position, 1);
+}
@@ -1,17 +1,23 @@
 #version 330
 
 in vec3 vViewSpacePosition;
+in vec4 vPreviousClipPosition;
   
 uniform samplerCube uEnvironmentMap;
+// See FrameConstants in pbr_directional_light.fs.glsl
+uniform vec4 uTemporalJitter;
 
-out vec4 fColor;
+layout(location = 0) out vec4 fColor;
+layout(location = 1) out vec2 fVelocity;
   
 void main()
 {
+    // Linear radiance, tonemapped with the rest of the scene
     vec3 envColor = texture(uEnvironmentMap, vViewSpacePosition).rgb;
-    
-    envColor = envColor / (envColor + vec3(1.0));
-    envColor = pow(envColor, vec3(1.0/2.2)); 
   
     fColor = vec4(envColor, 1.0);
+
+    vec2 coords = (gl_FragCoord.xy - uTemporalJitter.xy) * uTemporalJitter.zw;
+    fVelocity = coords
+        - (0.5 * vPreviousClipPosition.xy / vPreviousClipPosition.w + 0.5);
 }
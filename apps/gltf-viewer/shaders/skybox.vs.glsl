@@ -3,9 +3,14 @@
 layout (location = 0) in vec3 aPosition;
 
 out vec3 vViewSpacePosition;
+out vec4 vPreviousClipPosition;
 
 uniform mat4 uModelProjMatrix;
 uniform mat4 uModelViewMatrix;
+// Unjittered projection and rotation of the view of the previous frame
+uniform mat4 uPreviousViewProjMatrix;
+// Normalized device depth of the far plane, 0 with reversed depth
+uniform float uFarDepth;
 
 void main()
 {
@@ -14,5 +19,8 @@ void main()
 	mat4 rotView = mat4(mat3(uModelViewMatrix));
 	vec4 clipPos = uModelProjMatrix * rotView * vec4(vViewSpacePosition, 1.0);
 
-	gl_Position = clipPos.xyww;
+	// depth of the far plane, drawn with GL_LEQUAL (GL_GEQUAL if reversed)
+	// after the geometry
+	gl_Position = vec4(clipPos.xy, uFarDepth * clipPos.w, clipPos.w);
+	vPreviousClipPosition = uPreviousViewProjMatrix * vec4(aPosition, 1.0);
 }
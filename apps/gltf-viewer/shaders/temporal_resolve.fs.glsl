@@ -0,0 +1,76 @@
+#version 430
+
+// Resolve of temporal anti-aliasing, see utils/temporal_aa.hpp. Drawn over the
+// frame without color writes, one fragment per texel, the tonemap pass then
+// reads the history it writes.
+uniform sampler2D uColor;
+uniform sampler2D uVelocity;
+uniform sampler2D uDepth;
+// Whether nearer texels have a greater depth
+uniform bool uReversedZ;
+uniform sampler2D uHistory;
+uniform bool uHistoryValid;
+// Pixels of the frame and of the one in uHistory, at the bottom left of the
+// textures
+uniform vec2 uFrameSize;
+uniform vec2 uHistorySize;
+// Weight of the frame in the blend, that of the history is the rest
+uniform float uFrameWeight;
+
+// History of the next frame
+layout(rgba16f, binding = 0) uniform writeonly image2D uResolved;
+
+void main()
+{
+	ivec2 size = ivec2(uFrameSize);
+	ivec2 texel = ivec2(gl_FragCoord.xy);
+	vec3 color = texelFetch(uColor, texel, 0).rgb;
+
+	// Range of the colors around the texel, the history is clamped to it so
+	// that disoccluded or changing surfaces do not ghost. The velocity is the
+	// one of the closest of these texels, so that edges of moving objects are
+	// reprojected with them.
+	vec3 minColor = color;
+	vec3 maxColor = color;
+	ivec2 closest = texel;
+	float closestDepth = texelFetch(uDepth, texel, 0).r;
+	for (int y = -1; y <= 1; ++y)
+	{
+		for (int x = -1; x <= 1; ++x)
+		{
+			ivec2 neighbor = clamp(texel + ivec2(x, y), ivec2(0), size - 1);
+			vec3 neighborColor = texelFetch(uColor, neighbor, 0).rgb;
+			minColor = min(minColor, neighborColor);
+			maxColor = max(maxColor, neighborColor);
+
+			float depth = texelFetch(uDepth, neighbor, 0).r;
+			if (uReversedZ ? depth > closestDepth : depth < closestDepth)
+			{
+				closestDepth = depth;
+				closest = neighbor;
+			}
+		}
+	}
+
+	vec2 velocity = texelFetch(uVelocity, closest, 0).xy;
+	vec2 historyCoords = (vec2(texel) + 0.5) / vec2(size) - velocity;
+
+	// Pixels coming from outside of the previous frame have no history
+	if (uHistoryValid
+		&& all(greaterThanEqual(historyCoords, vec2(0.0)))
+		&& all(lessThanEqual(historyCoords, vec2(1.0))))
+	{
+		// Filtered within the previous frame only
+		vec2 historyTexel = clamp(
+			historyCoords * uHistorySize,
+			vec2(0.5),
+			uHistorySize - 0.5);
+		vec3 history = texture(
+			uHistory,
+			historyTexel / vec2(textureSize(uHistory, 0))).rgb;
+		history = clamp(history, minColor, maxColor);
+		color = mix(history, color, uFrameWeight);
+	}
+
+	imageStore(uResolved, texel, vec4(color, 1.0));
+}
@@ -0,0 +1,95 @@
+#version 330
+
+// Tonemap pass, from the linear radiance of the scene to colors encoded to
+// sRGB by the framebuffer, see utils/tonemapping.hpp. Drawn over the frame,
+// one fragment per texel.
+uniform sampler2D uColor;
+uniform sampler2DMS uColorMS;
+// Samples of uColorMS, uColor is read instead if 0
+uniform int uSamples;
+// TonemapOperator
+uniform int uOperator;
+uniform float uExposure;
+// Pixel of the framebuffer the scene starts at
+uniform vec2 uOrigin;
+// Level 0 of the bloom chain, see utils/bloom.hpp, its texels used and the
+// scale of the sum of levels it holds. Without bloom if the scale is 0.
+uniform sampler2D uBloom;
+uniform vec2 uBloomSize;
+uniform float uBloomScale;
+
+out vec4 fColor;
+
+// Khronos PBR Neutral, see
+// https://github.com/KhronosGroup/ToneMapping/tree/main/PBR_Neutral
+vec3 pbrNeutral(vec3 color)
+{
+	const float startCompression = 0.8 - 0.04;
+	const float desaturation = 0.15;
+
+	float x = min(color.r, min(color.g, color.b));
+	float offset = x < 0.08 ? x - 6.25 * x * x : 0.04;
+	color -= offset;
+
+	float peak = max(color.r, max(color.g, color.b));
+	if (peak < startCompression)
+	{
+		return color;
+	}
+
+	const float d = 1.0 - startCompression;
+	float newPeak = 1.0 - d * d / (peak + d - startCompression);
+	color *= newPeak / peak;
+
+	float g = 1.0 - 1.0 / (desaturation * (peak - newPeak) + 1.0);
+	return mix(color, vec3(newPeak), g);
+}
+
+vec3 tonemap(vec3 color, vec3 bloom)
+{
+	color = (color + bloom) * uExposure;
+	if (uOperator == 1)
+	{
+		color = color / (color + 1.0);
+	}
+	else if (uOperator == 2)
+	{
+		color = (color * (2.51 * color + 0.03))
+			/ (color * (2.43 * color + 0.59) + 0.14);
+	}
+	else if (uOperator == 3)
+	{
+		color = pbrNeutral(color);
+	}
+	return clamp(color, 0.0, 1.0);
+}
+
+void main()
+{
+	vec2 pixel = gl_FragCoord.xy - uOrigin;
+	ivec2 texel = ivec2(pixel);
+	vec3 bloom = vec3(0.0);
+	if (uBloomScale > 0.0)
+	{
+		vec2 position = clamp(0.5 * pixel, vec2(0.5), uBloomSize - 0.5);
+		vec2 levelSize = vec2(textureSize(uBloom, 0));
+		bloom = uBloomScale * textureLod(uBloom, position / levelSize, 0.0).rgb;
+	}
+
+	vec3 color = vec3(0.0);
+	if (uSamples > 0)
+	{
+		// Averaged once in the display range, as a resolve of the output
+		// would
+		for (int i = 0; i < uSamples; ++i)
+		{
+			color += tonemap(texelFetch(uColorMS, texel, i).rgb, bloom);
+		}
+		color /= float(uSamples);
+	}
+	else
+	{
+		color = tonemap(texelFetch(uColor, texel, 0).rgb, bloom);
+	}
+	fColor = vec4(color, 1.0);
+}
@@ -0,0 +1,41 @@
+#version 430
+
+// Composite of weighted blended transparency over the scene, see
+// utils/transparency.hpp. Drawn over the frame with
+// glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA), one fragment per texel,
+// per sample of multisampled targets.
+uniform sampler2D uAccumulation;
+uniform sampler2D uRevealage;
+uniform sampler2DMS uAccumulationMS;
+uniform sampler2DMS uRevealageMS;
+// Samples of the multisampled targets, the others are read if 0
+uniform int uSamples;
+
+layout(location = 0) out vec4 fColor;
+
+void main()
+{
+	ivec2 texel = ivec2(gl_FragCoord.xy);
+	vec4 accumulation;
+	float revealage;
+	if (uSamples > 0)
+	{
+		accumulation = texelFetch(uAccumulationMS, texel, gl_SampleID);
+		revealage = texelFetch(uRevealageMS, texel, gl_SampleID).r;
+	}
+	else
+	{
+		accumulation = texelFetch(uAccumulation, texel, 0);
+		revealage = texelFetch(uRevealage, texel, 0).r;
+	}
+
+	// No blended fragment
+	if (revealage >= 1.0)
+	{
+		discard;
+	}
+
+	// Average of the fragments, their weights sum to accumulation.a
+	vec3 average = accumulation.rgb / max(accumulation.a, 1e-5);
+	fColor = vec4(average, 1.0 - revealage);
+}
@@ -0,0 +1,48 @@
+#version 330
+
+// Upscale of the scene rendered at a lower resolution to the window, see
+// utils/dynamic_resolution.hpp. Bilinear, then sharpened as the robust
+// contrast adaptive sharpening of FSR 1 does: the four neighbors of the texel
+// are subtracted with the largest weight that keeps the result within their
+// range.
+in vec2 vTexCoords;
+
+uniform sampler2D uColor;
+// Pixels of the image at the bottom left of uColor
+uniform vec2 uImageSize;
+// From 0, bilinear only, to 1
+uniform float uSharpness;
+
+out vec4 fColor;
+
+vec3 fetch(vec2 texel)
+{
+	texel = clamp(texel, vec2(0.5), uImageSize - 0.5);
+	return texture(uColor, texel / vec2(textureSize(uColor, 0))).rgb;
+}
+
+void main()
+{
+	vec2 texel = vTexCoords * uImageSize;
+	vec3 color = fetch(texel);
+
+	if (uSharpness > 0.0)
+	{
+		vec3 north = fetch(texel + vec2(0.0, 1.0));
+		vec3 south = fetch(texel - vec2(0.0, 1.0));
+		vec3 east = fetch(texel + vec2(1.0, 0.0));
+		vec3 west = fetch(texel - vec2(1.0, 0.0));
+
+		vec3 minColor = min(min(north, south), min(east, west));
+		vec3 maxColor = max(max(north, south), max(east, west));
+		vec3 hitMin = min(minColor, color) / (4.0 * maxColor + 1e-5);
+		vec3 hitMax = (1.0 - max(maxColor, color)) / (4.0 * minColor - 4.0 - 1e-5);
+		vec3 lobe3 = max(-hitMin, hitMax);
+		float lobe = clamp(max(lobe3.r, max(lobe3.g, lobe3.b)), -0.1875, 0.0)
+			* uSharpness;
+
+		color = (lobe * (north + south + east + west) + color) / (4.0 * lobe + 1.0);
+	}
+
+	fColor = vec4(color, 1.0);
+}
@@ -0,0 +1,13 @@
+#version 430
+
+// Visibility pass, the draw index + 1 and the triangle of the fragment, see
+// utils/visibility_buffer.hpp. Shaded by the resolve pass of
+// pbr_directional_light.fs.glsl built with VISIBILITY_BUFFER.
+flat in uint vDrawIndex;
+
+layout(location = 0) out uvec2 fVisibility;
+
+void main()
+{
+	fVisibility = uvec2(vDrawIndex + 1u, uint(gl_PrimitiveID));
+}
@@ -1,6 +1,11 @@
 #pragma once
 
+#include "egl_context.hpp"
+#include "frame_pacing.hpp"
 #include "gl_debug_output.hpp"
+#include "gl_extensions.hpp"
+#include "heap_memory.hpp"
+#include "cameras.hpp"
 #include "glfw.hpp"
 #include <glm/glm.hpp>
 
@@ -8,31 +13,67 @@
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_opengl3.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
 #include <iostream>
+#include <mutex>
 #include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 // Class responsible for initializing GLFW, creating a window, initializing
 // OpenGL function pointers with GLAD library and initializing ImGUI
+//
+// With an eglDevice index, the context is instead created by EGL on that GPU,
+// without any window or window system (see EglContext). There is no window
+// and no GUI then: window() is null and there is no ImGui context, so that
+// headless handles can live on several threads at once.
+//
+// samples is the number of samples per pixel of the window framebuffer.
+//
+// With eglShare as well, the EGL context is created on its display, sharing
+// its objects, for the renderers of a process to share immutable objects.
+//
+// The callbacks keep the input and window state for ImGui, the camera and
+// the render thread of runThreaded, under a mutex: the other members may be
+// called from the thread the context is current on.
 class GLFWHandle
 {
 public:
-  GLFWHandle(int width, int height, const char *title, bool visible = true)
+  GLFWHandle(int width, int height, const char *title, bool visible = true,
+      int eglDevice = -1, int samples = 4,
+      const EglContext *eglShare = nullptr)
   {
+    if (eglDevice >= 0) {
+      std::string err;
+      if (!(eglShare ? m_eglContext.create(*eglShare, err)
+                     : m_eglContext.create(eglDevice, err))) {
+        std::cerr << err << "\n";
+        throw std::runtime_error(err);
+      }
+      setGLProcAddressLoader(EglContext::getProcAddress);
+      if (!gladLoadGLLoader(
+              reinterpret_cast<GLADloadproc>(EglContext::getProcAddress))) {
+        std::cerr << "Unable to init OpenGL.\n";
+        throw std::runtime_error("Unable to init OpenGL.\n");
+      }
+      initGLDebugOutput();
+      return;
+    }
+
     if (!glfwInit()) {
       std::cerr << "Unable to init GLFW.\n";
       throw std::runtime_error("Unable to init GLFW.\n");
     }
 
-    if (!visible) {
-      glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
-    }
-
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
-    glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
-    glfwWindowHint(GLFW_SAMPLES, 4);
+    setContextHints(visible, samples);
 
     m_pWindow =
         glfwCreateWindow(int(width), int(height), title, nullptr, nullptr);
@@ -53,15 +94,125 @@ public:
 
     initGLDebugOutput();
 
-    // Setup ImGui
+    // Input and window state is kept by the callbacks, so that the render
+    // thread reads it without calling GLFW, see runThreaded
+    m_mainThread = std::this_thread::get_id();
+    glfwGetWindowSize(m_pWindow, &m_windowSize.x, &m_windowSize.y);
+    glfwGetFramebufferSize(
+        m_pWindow, &m_framebufferSize.x, &m_framebufferSize.y);
+    glfwGetCursorPos(m_pWindow, &m_cursorPosition.x, &m_cursorPosition.y);
+    m_focused = glfwGetWindowAttrib(m_pWindow, GLFW_FOCUSED) != 0;
+
+    glfwSetWindowUserPointer(m_pWindow, this);
+    glfwSetMouseButtonCallback(
+        m_pWindow, [](GLFWwindow *window, int button, int action, int) {
+          handleEvent(window, [&](GLFWHandle &handle) {
+            if (button < 0 || button > GLFW_MOUSE_BUTTON_LAST) {
+              return;
+            }
+            handle.m_buttons[button] = action == GLFW_PRESS;
+            if (action == GLFW_PRESS) {
+              handle.m_buttonPressed[button] = true;
+            }
+            if (button == GLFW_MOUSE_BUTTON_LEFT) {
+              handle.recordClick(action);
+            }
+          });
+        });
+    glfwSetScrollCallback(
+        m_pWindow, [](GLFWwindow *window, double x, double y) {
+          handleEvent(window,
+              [&](GLFWHandle &handle) { handle.m_wheel += glm::dvec2(x, y); });
+        });
+    glfwSetKeyCallback(m_pWindow,
+        [](GLFWwindow *window, int key, int scancode, int action, int mods) {
+          handleEvent(window, [&](GLFWHandle &handle) {
+            if (key >= 0 && key <= GLFW_KEY_LAST) {
+              handle.m_keys[key] = action != GLFW_RELEASE;
+              if (action == GLFW_PRESS) {
+                handle.m_keyPressed[key] = true;
+              }
+            }
+          });
+          const auto callback =
+              static_cast<GLFWHandle *>(glfwGetWindowUserPointer(window))
+                  ->m_keyCallback;
+          if (callback) {
+            callback(window, key, scancode, action, mods);
+          }
+        });
+    glfwSetCharCallback(m_pWindow, [](GLFWwindow *window, unsigned int c) {
+      handleEvent(
+          window, [&](GLFWHandle &handle) { handle.m_chars.push_back(c); });
+    });
+    glfwSetCursorPosCallback(
+        m_pWindow, [](GLFWwindow *window, double x, double y) {
+          handleEvent(window, [&](GLFWHandle &handle) {
+            handle.recordCursor(glm::dvec2(x, y));
+          });
+        });
+    glfwSetWindowSizeCallback(
+        m_pWindow, [](GLFWwindow *window, int width, int height) {
+          handleEvent(window, [&](GLFWHandle &handle) {
+            handle.m_windowSize = glm::ivec2(width, height);
+          });
+        });
+    glfwSetFramebufferSizeCallback(
+        m_pWindow, [](GLFWwindow *window, int width, int height) {
+          handleEvent(window, [&](GLFWHandle &handle) {
+            handle.m_framebufferSize = glm::ivec2(width, height);
+          });
+        });
+    glfwSetWindowRefreshCallback(m_pWindow, [](GLFWwindow *window) {
+      handleEvent(window, [](GLFWHandle &) {});
+    });
+    glfwSetWindowCloseCallback(m_pWindow, [](GLFWwindow *window) {
+      handleEvent(window, [](GLFWHandle &) {});
+    });
+    glfwSetWindowFocusCallback(m_pWindow, [](GLFWwindow *window, int focused) {
+      handleEvent(window, [&](GLFWHandle &handle) {
+        handle.m_focused = focused != 0;
+        if (!focused) {
+          // Buttons released out of the window are not reported
+          std::fill(std::begin(handle.m_buttons), std::end(handle.m_buttons),
+              false);
+        }
+      });
+    });
+    glfwSetDropCallback(
+        m_pWindow, [](GLFWwindow *window, int count, const char **paths) {
+          handleEvent(window, [&](GLFWHandle &handle) {
+            handle.m_droppedPaths.insert(
+                end(handle.m_droppedPaths), paths, paths + count);
+          });
+        });
+
+    // Setup ImGui, its memory accounted to HeapTag::Gui
+    ImGui::SetAllocatorFunctions(
+        [](size_t size, void *) { return heapAllocate(size, HeapTag::Gui); },
+        [](void *pointer, void *) { heapFree(pointer); });
     ImGui::CreateContext();
-    ImGui_ImplGlfw_InitForOpenGL(m_pWindow, true);
+    // ImGui is fed by imguiNewFrame from the state of the callbacks above,
+    // its own would write to its IO from the main thread
+    ImGui_ImplGlfw_InitForOpenGL(m_pWindow, false);
     const char *glsl_version = "#version 130";
     ImGui_ImplOpenGL3_Init(glsl_version);
+    auto &io = ImGui::GetIO();
+    io.ClipboardUserData = this;
+    io.SetClipboardTextFn = [](void *handle, const char *text) {
+      static_cast<GLFWHandle *>(handle)->setClipboard(text);
+    };
+    io.GetClipboardTextFn = [](void *handle) {
+      return static_cast<GLFWHandle *>(handle)->clipboard();
+    };
   }
 
   ~GLFWHandle()
   {
+    if (headless()) {
+      return;
+    }
+
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
@@ -74,34 +225,455 @@ public:
   GLFWHandle(const GLFWHandle &) = delete;
   GLFWHandle &operator=(const GLFWHandle &) = delete;
 
-  bool shouldClose() const { return glfwWindowShouldClose(m_pWindow); }
+  // True if the context has no window, see the constructor
+  bool headless() const { return m_pWindow == nullptr; }
+
+  bool shouldClose() const
+  {
+    return headless() || glfwWindowShouldClose(m_pWindow);
+  }
 
   glm::ivec2 framebufferSize() const
   {
-    int displayWidth, displayHeight;
-    glfwGetFramebufferSize(m_pWindow, &displayWidth, &displayHeight);
-    return glm::ivec2(displayWidth, displayHeight);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_framebufferSize;
+  }
+
+  // Size of the window in screen coordinates, those of the cursor
+  glm::ivec2 windowSize() const
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_windowSize;
+  }
+
+  // True if key, a GLFW_KEY_*, is held
+  bool keyDown(int key) const
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return key >= 0 && key <= GLFW_KEY_LAST && m_keys[key];
   }
 
   void swapBuffers() const { glfwSwapBuffers(m_pWindow); }
 
+  // Set the swap interval of the window, No VSync by default. Return the mode
+  // applied, adaptive falls back to on without *_EXT_swap_control_tear.
+  VSyncMode setVSync(VSyncMode mode) const
+  {
+    if (mode == VSyncMode::Adaptive &&
+        !glfwExtensionSupported("WGL_EXT_swap_control_tear") &&
+        !glfwExtensionSupported("GLX_EXT_swap_control_tear")) {
+      mode = VSyncMode::On;
+    }
+    glfwSwapInterval(mode == VSyncMode::Adaptive ? -1
+                     : mode == VSyncMode::On     ? 1
+                                                 : 0);
+    return mode;
+  }
+
+  // Process the pending events, or wait up to timeout seconds for one with
+  // waitEvents. Return true if there was any input or window event since the
+  // last call. On the render thread of runThreaded, they wait for the main
+  // thread to process one instead.
+  bool pollEvents()
+  {
+    if (m_threaded) {
+      return waitEvents(0.);
+    }
+    glfwPollEvents();
+    return takeEvents();
+  }
+  bool waitEvents(double timeout)
+  {
+    if (m_threaded) {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_signal.wait_for(lock, std::chrono::duration<double>(timeout),
+          [&]() { return m_eventCount != m_takenEventCount; });
+      return std::exchange(m_takenEventCount, m_eventCount) != m_eventCount;
+    }
+    glfwWaitEventsTimeout(timeout);
+    return takeEvents();
+  }
+
+  // Call render on a thread of its own, the window context current, while
+  // the calling thread processes the window events until it returns, so
+  // that rendering goes on while the window is moved or resized, and input
+  // is processed while a frame is slow. Must be called from the main thread,
+  // as GLFW requires of its event and window functions; the render thread
+  // reads the input and window state kept by the callbacks instead, and
+  // calls the others through onMainThread. Return what render returns.
+  int runThreaded(const std::function<int()> &render)
+  {
+    glfwMakeContextCurrent(nullptr);
+    m_threaded = true;
+    std::atomic<bool> done{false};
+    int status = 0;
+    std::exception_ptr error;
+    std::thread renderThread([&]() {
+      glfwMakeContextCurrent(m_pWindow);
+      try {
+        status = render();
+      } catch (...) {
+        error = std::current_exception();
+      }
+      glfwMakeContextCurrent(nullptr);
+      done = true;
+      glfwPostEmptyEvent();
+    });
+    while (!done) {
+      glfwWaitEvents();
+      runMainThreadTasks();
+    }
+    renderThread.join();
+    m_threaded = false;
+    glfwMakeContextCurrent(m_pWindow);
+    if (error) {
+      std::rethrow_exception(error);
+    }
+    return status;
+  }
+
+  // Run task on the main thread and wait for it, at once outside of
+  // runThreaded or from the main thread
+  void onMainThread(const std::function<void()> &task)
+  {
+    if (!m_threaded || std::this_thread::get_id() == m_mainThread) {
+      task();
+      return;
+    }
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_mainTasks.push_back(&task);
+    const auto ticket = ++m_mainTasksQueued;
+    glfwPostEmptyEvent();
+    m_signal.wait(lock, [&]() { return m_mainTasksDone >= ticket; });
+  }
+
+  void setClipboard(const std::string &text)
+  {
+    onMainThread([&]() { glfwSetClipboardString(m_pWindow, text.c_str()); });
+  }
+
+  // Valid until the next call
+  const char *clipboard()
+  {
+    onMainThread([&]() {
+      const auto text = glfwGetClipboardString(m_pWindow);
+      m_clipboard = text ? text : "";
+    });
+    return m_clipboard.c_str();
+  }
+
+  // Start an ImGui frame with the input received since the previous one, in
+  // place of ImGui_ImplGlfw_NewFrame which calls GLFW. The mouse cursor
+  // keeps its shape.
+  void imguiNewFrame()
+  {
+    ImGui_ImplOpenGL3_NewFrame();
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      auto &io = ImGui::GetIO();
+      io.DisplaySize = ImVec2(float(m_windowSize.x), float(m_windowSize.y));
+      if (m_windowSize.x > 0 && m_windowSize.y > 0) {
+        io.DisplayFramebufferScale =
+            ImVec2(float(m_framebufferSize.x) / m_windowSize.x,
+                float(m_framebufferSize.y) / m_windowSize.y);
+      }
+      const auto time = glfwGetTime();
+      io.DeltaTime = m_imguiTime > 0. ? float(time - m_imguiTime) : 1.f / 60.f;
+      io.DeltaTime = std::max(io.DeltaTime, 1e-6f);
+      m_imguiTime = time;
+
+      // Presses released within the frame still count as held, so that
+      // short clicks are not missed
+      for (int i = 0; i < IM_ARRAYSIZE(io.MouseDown); ++i) {
+        io.MouseDown[i] = m_buttons[i] || m_buttonPressed[i];
+        m_buttonPressed[i] = false;
+      }
+      io.MousePos = m_focused ? ImVec2(float(m_cursorPosition.x),
+                                    float(m_cursorPosition.y))
+                              : ImVec2(-FLT_MAX, -FLT_MAX);
+      io.MouseWheelH += float(m_wheel.x);
+      io.MouseWheel += float(m_wheel.y);
+      m_wheel = glm::dvec2(0);
+
+      for (int key = 0; key <= GLFW_KEY_LAST; ++key) {
+        io.KeysDown[key] = m_keys[key];
+      }
+      io.KeyCtrl =
+          m_keys[GLFW_KEY_LEFT_CONTROL] || m_keys[GLFW_KEY_RIGHT_CONTROL];
+      io.KeyShift = m_keys[GLFW_KEY_LEFT_SHIFT] || m_keys[GLFW_KEY_RIGHT_SHIFT];
+      io.KeyAlt = m_keys[GLFW_KEY_LEFT_ALT] || m_keys[GLFW_KEY_RIGHT_ALT];
+      io.KeySuper = m_keys[GLFW_KEY_LEFT_SUPER] || m_keys[GLFW_KEY_RIGHT_SUPER];
+      for (const auto c : m_chars) {
+        io.AddInputCharacter(c);
+      }
+      m_chars.clear();
+    }
+    ImGui::NewFrame();
+  }
+
+  // True if key, a GLFW_KEY_*, was pressed since the last call
+  bool takeKeyPress(int key)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return key >= 0 && key <= GLFW_KEY_LAST &&
+           std::exchange(m_keyPressed[key], false);
+  }
+
+  // True if there was input for ImGui since the last call: any event but the
+  // cursor motion with a button held, which drags the camera, unless ImGui
+  // captured the mouse
+  bool takeGuiInput(bool mouseCaptured)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto events = m_eventCount - m_guiEventCount;
+    const auto drags = m_dragEventCount - m_guiDragEventCount;
+    m_guiEventCount = m_eventCount;
+    m_guiDragEventCount = m_dragEventCount;
+    return mouseCaptured ? events > 0 : events > drags;
+  }
+
+  // Called on key events by the main thread, glfwSetKeyCallback would
+  // disconnect the state kept for ImGui and the render thread
+  void setKeyCallback(GLFWkeyfun callback) { m_keyCallback = callback; }
+
+  // Paths of the files dropped on the window since the last call
+  std::vector<std::string> takeDroppedPaths()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return std::exchange(m_droppedPaths, {});
+  }
+
+  // Cursor position, in pixels of the window from its top left, of the last
+  // left click since the last call. Presses released further than a few
+  // pixels away drag the camera and are not clicks.
+  bool takeClick(glm::dvec2 &position)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    position = m_clickPosition;
+    return std::exchange(m_clicked, false);
+  }
+
+  // Camera input since the last call: the cursor motion of every cursor
+  // event with a button held, and the keys held now, see CameraInput
+  CameraInput takeCameraInput()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto input = std::exchange(m_cameraInput, {});
+    input.middleButton = m_buttons[GLFW_MOUSE_BUTTON_MIDDLE];
+    input.forward = m_keys[GLFW_KEY_W];
+    input.back = m_keys[GLFW_KEY_S];
+    input.left = m_keys[GLFW_KEY_A];
+    input.right = m_keys[GLFW_KEY_D];
+    input.up = m_keys[GLFW_KEY_UP];
+    input.down = m_keys[GLFW_KEY_DOWN];
+    input.rollLeft = m_keys[GLFW_KEY_Q];
+    input.rollRight = m_keys[GLFW_KEY_E];
+    input.control = m_keys[GLFW_KEY_LEFT_CONTROL];
+    input.shift = m_keys[GLFW_KEY_LEFT_SHIFT];
+    return input;
+  }
+
   GLFWwindow *window() { return m_pWindow; }
 
+  // Create a GL context sharing objects (buffers, textures, programs, but not
+  // VAOs or FBOs) with the main one, so that another thread can upload data
+  // while the main thread renders: a hidden window, or an EGL context when
+  // headless. Must be called from the main thread; the returned context is
+  // made current by the worker with makeContextCurrent and destroyed with
+  // destroySharedContext once the worker has released it.
+  void *createSharedContext()
+  {
+    void *context = nullptr;
+    if (headless()) {
+      context = m_eglContext.createShared();
+    } else {
+      onMainThread([&]() {
+        setContextHints(false, 0);
+        context = glfwCreateWindow(1, 1, "", nullptr, m_pWindow);
+      });
+    }
+    if (!context) {
+      std::cerr << "Unable to create shared context.\n";
+    }
+    return context;
+  }
+
+  // Make a shared context current on the calling thread, or release the
+  // current one if context is null
+  void makeContextCurrent(void *context) const
+  {
+    if (headless()) {
+      m_eglContext.makeCurrent(context);
+    } else {
+      glfwMakeContextCurrent(static_cast<GLFWwindow *>(context));
+    }
+  }
+
+  // The context of the window, or of EGL when headless, for
+  // makeContextCurrent
+  void *context() const
+  {
+    return headless() ? m_eglContext.context()
+                      : static_cast<void *>(m_pWindow);
+  }
+
+  // The context current on the calling thread, null if none
+  void *currentContext() const
+  {
+    return headless() ? EglContext::current()
+                      : static_cast<void *>(glfwGetCurrentContext());
+  }
+
+  void destroySharedContext(void *context)
+  {
+    if (headless()) {
+      m_eglContext.destroyShared(context);
+    } else {
+      onMainThread(
+          [&]() { glfwDestroyWindow(static_cast<GLFWwindow *>(context)); });
+    }
+  }
+
 private:
+  static void setContextHints(bool visible, int samples)
+  {
+    glfwDefaultWindowHints();
+
+    if (!visible) {
+      glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    }
+
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    // The no error hint is ignored by GLFW without
+    // GLX_ARB_create_context_no_error or its WGL and EGL equivalents
+    if (glDeveloperMode()) {
+      glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
+    } else {
+      glfwWindowHint(GLFW_CONTEXT_NO_ERROR, GL_TRUE);
+    }
+    // Hidden windows only hold a context, and images of their size
+    glfwWindowHint(GLFW_RESIZABLE, visible ? GL_TRUE : GL_FALSE);
+    glfwWindowHint(GLFW_SAMPLES, samples);
+    glfwWindowHint(GLFW_SRGB_CAPABLE, GL_TRUE);
+  }
+
+  // Update the state of the handle of window by update, with its mutex
+  // locked, then count the event
+  template<typename Update>
+  static void handleEvent(GLFWwindow *window, const Update &update)
+  {
+    auto &handle = *static_cast<GLFWHandle *>(glfwGetWindowUserPointer(window));
+    {
+      std::lock_guard<std::mutex> lock(handle.m_mutex);
+      update(handle);
+      ++handle.m_eventCount;
+    }
+    handle.m_signal.notify_all();
+  }
+
+  bool takeEvents()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return std::exchange(m_takenEventCount, m_eventCount) != m_eventCount;
+  }
+
+  void runMainThreadTasks()
+  {
+    std::vector<const std::function<void()> *> tasks;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      tasks.swap(m_mainTasks);
+    }
+    if (tasks.empty()) {
+      return;
+    }
+    for (const auto task : tasks) {
+      (*task)();
+    }
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_mainTasksDone += tasks.size();
+    }
+    m_signal.notify_all();
+  }
+
+  void recordClick(int action)
+  {
+    if (action == GLFW_PRESS) {
+      m_pressPosition = m_cursorPosition;
+    } else if (glm::length(m_cursorPosition - m_pressPosition) <= 3.) {
+      m_clickPosition = m_cursorPosition;
+      m_clicked = true;
+    }
+  }
+
+  // Accumulate the motion since the previous cursor event into the drags of
+  // the buttons held
+  void recordCursor(glm::dvec2 position)
+  {
+    const auto delta = position - m_cursorPosition;
+    m_cursorPosition = position;
+    if (std::find(std::begin(m_buttons), std::end(m_buttons), true) !=
+        std::end(m_buttons)) {
+      ++m_dragEventCount;
+    }
+    if (m_buttons[GLFW_MOUSE_BUTTON_LEFT]) {
+      m_cameraInput.leftDrag += delta;
+    }
+    if (m_buttons[GLFW_MOUSE_BUTTON_MIDDLE]) {
+      m_cameraInput.middleDrag += delta;
+    }
+  }
+
   GLFWwindow *m_pWindow = nullptr;
-};
+  GLFWkeyfun m_keyCallback = nullptr;
+  std::thread::id m_mainThread;
+  bool m_threaded = false; // While runThreaded runs
 
-inline void imguiNewFrame()
-{
-  ImGui_ImplOpenGL3_NewFrame();
-  ImGui_ImplGlfw_NewFrame();
-  ImGui::NewFrame();
-}
+  // Input and window state, written by the callbacks on the main thread
+  mutable std::mutex m_mutex;
+  std::condition_variable m_signal; // On events and main thread tasks done
+  size_t m_eventCount = 0;
+  size_t m_takenEventCount = 0; // By pollEvents and waitEvents
+  size_t m_dragEventCount = 0; // Cursor events with a button held
+  size_t m_guiEventCount = 0; // Taken by takeGuiInput
+  size_t m_guiDragEventCount = 0;
+  glm::ivec2 m_windowSize{0};
+  glm::ivec2 m_framebufferSize{0};
+  bool m_focused = false;
+  glm::dvec2 m_cursorPosition{0};
+  bool m_keys[GLFW_KEY_LAST + 1] = {};
+  bool m_keyPressed[GLFW_KEY_LAST + 1] = {}; // Since takeKeyPress
+  bool m_buttons[GLFW_MOUSE_BUTTON_LAST + 1] = {};
+  // Pressed since the last ImGui frame, and input not given to ImGui yet
+  bool m_buttonPressed[GLFW_MOUSE_BUTTON_LAST + 1] = {};
+  glm::dvec2 m_wheel{0};
+  std::vector<unsigned int> m_chars;
+  double m_imguiTime = 0.;
+  std::vector<std::string> m_droppedPaths;
+  glm::dvec2 m_pressPosition{0};
+  glm::dvec2 m_clickPosition{0};
+  bool m_clicked = false;
+  CameraInput m_cameraInput; // Drags accumulated since takeCameraInput
 
-inline void imguiRenderFrame()
+  // Tasks of onMainThread, run by runThreaded
+  std::vector<const std::function<void()> *> m_mainTasks;
+  size_t m_mainTasksQueued = 0;
+  size_t m_mainTasksDone = 0;
+  std::string m_clipboard;
+
+  EglContext m_eglContext; // Unused unless headless
+};
+
+// Draw the draw lists of the last ImGui::Render, again if no frame was
+// started since
+inline void imguiDrawFrame()
 {
-  ImGui::Render();
-  ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+  if (const auto drawData = ImGui::GetDrawData()) {
+    ImGui_ImplOpenGL3_RenderDrawData(drawData);
+  }
 }
 
 inline void printGLVersion()
@@ -0,0 +1,31 @@
+#include "ambient_occlusion.hpp"
+
+FrameGraph::TextureDesc ambientOcclusionTarget(
+    GLenum format, GLsizei width, GLsizei height)
+{
+  FrameGraph::TextureDesc desc;
+  desc.format = format;
+  desc.width = (width + 1) / 2;
+  desc.height = (height + 1) / 2;
+  return desc;
+}
+
+GLuint drawFramebufferDepthTexture()
+{
+  GLint framebuffer = 0;
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+  if (!framebuffer) {
+    return 0;
+  }
+
+  GLint type = GL_NONE;
+  glGetFramebufferAttachmentParameteriv(GL_DRAW_FRAMEBUFFER,
+      GL_DEPTH_ATTACHMENT, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE, &type);
+  if (type != GL_TEXTURE) {
+    return 0;
+  }
+  GLint name = 0;
+  glGetFramebufferAttachmentParameteriv(GL_DRAW_FRAMEBUFFER,
+      GL_DEPTH_ATTACHMENT, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_NAME, &name);
+  return GLuint(name);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "frame_graph.hpp"
+
+#include <glad/glad.h>
+
+// Targets of screen-space ambient occlusion, transients of the frame graph at
+// half the resolution of the scene. Three compute passes read the depth of
+// the depth pre-pass: the first downsamples it to view space depths,
+// alternating the nearest and farthest of each 2x2 pixels so that both sides
+// of edges are kept, the second integrates the horizon angles of a few slices
+// around each texel (GTAO, Jimenez et al. 2016), the last blurs the noise of
+// the slice directions with weights falling with the depth difference. The
+// shading pass then upsamples the result, weighting the 4 nearest texels by
+// how close their depth is to the one of the fragment.
+//
+// Depths are GL_R32F, occlusion GL_R8 visibility, 1 unoccluded. Scenes may be
+// smaller than the targets and use their bottom left corner. The target of a
+// scene of width x height pixels is each half of it rounded up.
+FrameGraph::TextureDesc ambientOcclusionTarget(
+    GLenum format, GLsizei width, GLsizei height);
+
+// Depth texture attached to the framebuffer bound on GL_DRAW_FRAMEBUFFER, a
+// GL_TEXTURE_2D_MULTISAMPLE texture if the framebuffer is multisampled. 0 if
+// it has none, as the default framebuffer, or a renderbuffer.
+GLuint drawFramebufferDepthTexture();
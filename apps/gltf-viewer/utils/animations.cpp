@@ -0,0 +1,244 @@
+#include "animations.hpp"
+
+#include "gltf.hpp"
+#include "trace.hpp"
+
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+
+namespace
+{
+
+glm::quat toQuat(const glm::vec4 &v) { return glm::quat(v.w, v.x, v.y, v.z); }
+
+// Hermite spline between keyframes k and k + 1 of a cubic spline channel with
+// values v, s in [0, 1] the fraction of the interval of td seconds. Keyframes
+// with several values, like morph target weights, store each of in-tangents,
+// values and out-tangents as stride consecutive elements.
+template <typename T>
+T cubicSpline(const T *v, size_t stride, float s, float td)
+{
+  const float s2 = s * s;
+  const float s3 = s2 * s;
+  const auto &value0 = v[stride];
+  const auto &outTangent0 = v[2 * stride];
+  const auto &inTangent1 = v[3 * stride];
+  const auto &value1 = v[4 * stride];
+  return (2 * s3 - 3 * s2 + 1) * value0 + (s3 - 2 * s2 + s) * td * outTangent0 +
+         (-2 * s3 + 3 * s2) * value1 + (s3 - s2) * td * inTangent1;
+}
+
+} // namespace
+
+void Animations::build(const tinygltf::Model &model,
+    const GltfBuffers &buffers, const SceneGraph &sceneGraph)
+{
+  m_animations.clear();
+  m_channels.clear();
+  m_times.clear();
+  m_values.clear();
+  m_weightValues.clear();
+
+  // A node may be instanced at several positions of the scene graph
+  std::vector<std::vector<uint32_t>> nodePositions(model.nodes.size());
+  for (size_t i = 0; i < sceneGraph.size(); ++i) {
+    nodePositions[sceneGraph.node(i)].push_back(uint32_t(i));
+  }
+
+  const auto validAccessor = [&](int index) {
+    return index >= 0 && size_t(index) < model.accessors.size();
+  };
+
+  for (const auto &animation : model.animations) {
+    Animation entry;
+    entry.name = animation.name;
+    entry.firstChannel = uint32_t(m_channels.size());
+    entry.duration = 0;
+
+    for (const auto &channel : animation.channels) {
+      Channel entryChannel;
+      if (channel.target_path == "translation") {
+        entryChannel.path = PATH_TRANSLATION;
+      } else if (channel.target_path == "rotation") {
+        entryChannel.path = PATH_ROTATION;
+      } else if (channel.target_path == "scale") {
+        entryChannel.path = PATH_SCALE;
+      } else if (channel.target_path == "weights") {
+        entryChannel.path = PATH_WEIGHTS;
+      } else {
+        continue;
+      }
+      if (channel.sampler < 0 ||
+          size_t(channel.sampler) >= animation.samplers.size() ||
+          channel.target_node < 0 ||
+          size_t(channel.target_node) >= model.nodes.size()) {
+        continue;
+      }
+      const auto &sampler = animation.samplers[channel.sampler];
+      if (!validAccessor(sampler.input) || !validAccessor(sampler.output)) {
+        continue;
+      }
+      entryChannel.interpolation =
+          sampler.interpolation == "STEP"          ? INTERPOLATION_STEP
+          : sampler.interpolation == "CUBICSPLINE" ? INTERPOLATION_CUBICSPLINE
+                                                   : INTERPOLATION_LINEAR;
+
+      const auto times =
+          readVectors(model, buffers, model.accessors[sampler.input]);
+      const auto values =
+          readVectors(model, buffers, model.accessors[sampler.output]);
+      // One weight per morph target of the mesh for each keyframe
+      const auto &node = model.nodes[channel.target_node];
+      entryChannel.weightCount = 1;
+      if (entryChannel.path == PATH_WEIGHTS) {
+        if (node.mesh < 0 || model.meshes[node.mesh].primitives.empty()) {
+          continue;
+        }
+        entryChannel.weightCount = uint32_t(
+            model.meshes[node.mesh].primitives[0].targets.size());
+      }
+      const size_t valuesPerKey =
+          (entryChannel.interpolation == INTERPOLATION_CUBICSPLINE ? 3 : 1) *
+          entryChannel.weightCount;
+      if (times.empty() || valuesPerKey == 0 ||
+          values.size() < times.size() * valuesPerKey) {
+        continue;
+      }
+
+      // The keyframes are shared by the positions of the node
+      entryChannel.firstKey = uint32_t(m_times.size());
+      entryChannel.keyCount = uint32_t(times.size());
+      entryChannel.lastKey = 0;
+      for (const auto &time : times) {
+        m_times.push_back(time.x);
+      }
+      if (entryChannel.path == PATH_WEIGHTS) {
+        entryChannel.firstValue = uint32_t(m_weightValues.size());
+        for (size_t v = 0; v < times.size() * valuesPerKey; ++v) {
+          m_weightValues.push_back(values[v].x);
+        }
+      } else {
+        entryChannel.firstValue = uint32_t(m_values.size());
+        m_values.insert(end(m_values), begin(values),
+            begin(values) + times.size() * valuesPerKey);
+      }
+      entry.duration = std::max(entry.duration, m_times.back());
+
+      for (const auto position : nodePositions[channel.target_node]) {
+        entryChannel.target = position;
+        m_channels.push_back(entryChannel);
+      }
+    }
+
+    entry.channelCount = uint32_t(m_channels.size()) - entry.firstChannel;
+    m_animations.push_back(std::move(entry));
+  }
+}
+
+uint32_t Animations::findKey(Channel &channel, float time) const
+{
+  const auto *times = m_times.data() + channel.firstKey;
+  const auto last = channel.keyCount - 1;
+  auto k = channel.lastKey;
+
+  // Playing forward stays in the same interval or moves to the next one
+  if (times[k] <= time) {
+    if (k == last || time < times[k + 1]) {
+      return k;
+    }
+    if (k + 1 == last || time < times[k + 2]) {
+      return channel.lastKey = k + 1;
+    }
+  }
+
+  const auto next = std::upper_bound(times, times + channel.keyCount, time);
+  k = next == times ? 0 : uint32_t(next - times) - 1;
+  return channel.lastKey = k;
+}
+
+void Animations::apply(size_t animation, float time, SceneGraph &sceneGraph)
+{
+  TRACE_ZONE("applyAnimation");
+  const auto &entry = m_animations[animation];
+  const auto channelsEnd = entry.firstChannel + entry.channelCount;
+  for (auto c = entry.firstChannel; c < channelsEnd; ++c) {
+    auto &channel = m_channels[c];
+    const auto *times = m_times.data() + channel.firstKey;
+    const auto k = findKey(channel, time);
+
+    if (channel.path == PATH_WEIGHTS) {
+      applyWeights(channel, k, time, sceneGraph);
+      continue;
+    }
+
+    glm::vec4 value;
+    if (channel.interpolation == INTERPOLATION_CUBICSPLINE) {
+      const auto *values = m_values.data() + channel.firstValue + 3 * k;
+      if (k + 1 == channel.keyCount || time <= times[k]) {
+        value = values[1];
+      } else {
+        const float td = times[k + 1] - times[k];
+        value = cubicSpline(values, 1, (time - times[k]) / td, td);
+      }
+    } else {
+      const auto *values = m_values.data() + channel.firstValue + k;
+      if (channel.interpolation == INTERPOLATION_STEP ||
+          k + 1 == channel.keyCount || time <= times[k]) {
+        value = values[0];
+      } else {
+        const float s = (time - times[k]) / (times[k + 1] - times[k]);
+        if (channel.path == PATH_ROTATION) {
+          const auto rotation =
+              glm::slerp(toQuat(values[0]), toQuat(values[1]), s);
+          value = glm::vec4(rotation.x, rotation.y, rotation.z, rotation.w);
+        } else {
+          value = glm::mix(values[0], values[1], s);
+        }
+      }
+    }
+
+    switch (channel.path) {
+    case PATH_TRANSLATION:
+      sceneGraph.setTranslation(channel.target, glm::vec3(value));
+      break;
+    case PATH_ROTATION:
+      sceneGraph.setRotation(channel.target, glm::normalize(toQuat(value)));
+      break;
+    case PATH_SCALE:
+      sceneGraph.setScale(channel.target, glm::vec3(value));
+      break;
+    case PATH_WEIGHTS:
+      break;
+    }
+  }
+}
+
+void Animations::applyWeights(const Channel &channel, uint32_t k, float time,
+    SceneGraph &sceneGraph) const
+{
+  const auto *times = m_times.data() + channel.firstKey;
+  const auto n = channel.weightCount;
+  const auto count =
+      std::min(size_t(n), sceneGraph.weightCount(channel.target));
+  const bool last = k + 1 == channel.keyCount || time <= times[k];
+  const float td = last ? 0.f : times[k + 1] - times[k];
+  const float s = last ? 0.f : (time - times[k]) / td;
+
+  if (channel.interpolation == INTERPOLATION_CUBICSPLINE) {
+    const auto *values = m_weightValues.data() + channel.firstValue + 3 * n * k;
+    for (size_t w = 0; w < count; ++w) {
+      sceneGraph.setWeight(channel.target, w,
+          last ? values[n + w] : cubicSpline(values + w, n, s, td));
+    }
+    return;
+  }
+
+  const auto *values = m_weightValues.data() + channel.firstValue + n * k;
+  for (size_t w = 0; w < count; ++w) {
+    sceneGraph.setWeight(channel.target, w,
+        last || channel.interpolation == INTERPOLATION_STEP
+            ? values[w]
+            : glm::mix(values[w], values[n + w], s));
+  }
+}
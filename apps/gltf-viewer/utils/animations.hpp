@@ -0,0 +1,96 @@
+#pragma once
+
+#include "gltf_loader.hpp"
+#include "scene_graph.hpp"
+
+#include <glm/glm.hpp>
+#include <tiny_gltf.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// The translation, rotation, scale and morph target weight channels of the
+// animations of a glTF model, preprocessed for playback: the keyframe times
+// and values of the channels are read once into contiguous arrays, and each
+// channel targets a node by its position in the SceneGraph. Each channel
+// remembers the keyframe it was last evaluated at, so that playing forward
+// finds the next one in constant time, a binary search is only needed after a
+// seek. Nothing is allocated by apply().
+class Animations
+{
+public:
+  // Replace the content with the animations of the model, whose buffers must
+  // still be loaded. Channels targeting nodes out of the scene graph are
+  // skipped.
+  void build(const tinygltf::Model &model, const GltfBuffers &buffers,
+      const SceneGraph &sceneGraph);
+
+  size_t size() const { return m_animations.size(); }
+  bool empty() const { return m_animations.empty(); }
+  const std::string &name(size_t animation) const
+  {
+    return m_animations[animation].name;
+  }
+  // Seconds of the last keyframe of the animation
+  float duration(size_t animation) const
+  {
+    return m_animations[animation].duration;
+  }
+  size_t channelCount() const { return m_channels.size(); }
+
+  // Write the transforms of the animation at time seconds into the nodes it
+  // targets. Times before the first and after the last keyframe of a channel
+  // hold its first and last values, loop by wrapping time in duration().
+  void apply(size_t animation, float time, SceneGraph &sceneGraph);
+
+private:
+  enum Path : uint8_t
+  {
+    PATH_TRANSLATION,
+    PATH_ROTATION,
+    PATH_SCALE,
+    PATH_WEIGHTS
+  };
+
+  enum Interpolation : uint8_t
+  {
+    INTERPOLATION_STEP,
+    INTERPOLATION_LINEAR,
+    INTERPOLATION_CUBICSPLINE // In-tangent, value, out-tangent per keyframe
+  };
+
+  struct Channel
+  {
+    uint32_t target; // Position in the SceneGraph
+    Path path;
+    Interpolation interpolation;
+    uint32_t firstKey; // In m_times
+    uint32_t keyCount;
+    uint32_t firstValue; // In m_values, in m_weightValues for weights
+    uint32_t lastKey; // Of the last evaluation, relative to firstKey
+    uint32_t weightCount; // Values per keyframe, 1 but for weights
+  };
+
+  struct Animation
+  {
+    std::string name;
+    uint32_t firstChannel;
+    uint32_t channelCount;
+    float duration;
+  };
+
+  // Keyframe k of the channel such that its time is at most time and the
+  // next one is after it, 0 before the first keyframe
+  uint32_t findKey(Channel &channel, float time) const;
+
+  // Interpolate the weights of a weights channel at keyframe k
+  void applyWeights(const Channel &channel, uint32_t k, float time,
+      SceneGraph &sceneGraph) const;
+
+  std::vector<Animation> m_animations;
+  std::vector<Channel> m_channels; // Grouped by animation
+  std::vector<float> m_times;
+  std::vector<glm::vec4> m_values; // xyz for translations and scales
+  std::vector<float> m_weightValues;
+};
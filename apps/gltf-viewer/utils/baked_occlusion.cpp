@@ -0,0 +1,199 @@
+#include "baked_occlusion.hpp"
+
+#include "gpu_memory.hpp"
+#include "job_system.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+// std430 layout of BakeVertex in path_trace.cs.glsl, w are unused
+struct GpuBakeVertex
+{
+  glm::vec4 position;
+  glm::vec4 normal; // Zero for the vertices not baked
+};
+
+// Range of the vertices of a primitive in its vertex buffer, relative to the
+// first vertex of the buffer, empty if it has no index
+void primitiveVertices(const PackedGeometry &geometry,
+    const PackedPrimitive &primitive, uint32_t &first, uint32_t &count)
+{
+  first = count = 0;
+  if (!primitive.indexCount) {
+    return;
+  }
+  const auto begin = geometry.indices.begin() + primitive.firstIndex;
+  const auto range =
+      std::minmax_element(begin, begin + primitive.indexCount);
+  first = uint32_t(primitive.baseVertex) + *range.first;
+  count = *range.second - *range.first + 1;
+}
+
+} // namespace
+
+size_t OcclusionBaker::countVertices(const PackedGeometry &geometry)
+{
+  m_firstVertices.assign(geometry.vertexBuffers.size(), 0);
+  size_t vertexCount = 0;
+  for (size_t i = 0; i < geometry.vertexBuffers.size(); ++i) {
+    m_firstVertices[i] = uint32_t(vertexCount);
+    vertexCount += geometry.vertexBuffers[i].vertexCount;
+  }
+  return vertexCount;
+}
+
+void OcclusionBaker::readVertices(const PackedGeometry &geometry)
+{
+  TRACE_ZONE("OcclusionBaker::readVertices");
+  const auto vertexCount = countVertices(geometry);
+  m_positions.assign(vertexCount, glm::vec3(0));
+  m_normals.assign(vertexCount, glm::vec3(0));
+  m_occlusion.clear();
+
+  // The merged primitives draw the vertices of their members, which are
+  // read with their own dequantization
+  JobSystem::shared().parallelFor(
+      geometry.primitives.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t p = begin; p < end; ++p) {
+          const auto &primitive = geometry.primitives[p];
+          if (primitive.memberCount > 0) {
+            continue;
+          }
+          uint32_t first, count;
+          primitiveVertices(geometry, primitive, first, count);
+          const auto &vertexBuffer =
+              geometry.vertexBuffers[primitive.vertexBuffer];
+          const auto &dequantize = primitive.positionDequantize;
+          for (uint32_t v = first; v < first + count; ++v) {
+            const auto i = m_firstVertices[primitive.vertexBuffer] + v;
+            m_positions[i] = glm::vec3(dequantize) +
+                             dequantize.w *
+                                 glm::vec3(readPackedAttribute(vertexBuffer,
+                                     VERTEX_ATTRIBUTE_POSITION, v));
+            m_normals[i] = glm::vec3(readPackedAttribute(
+                vertexBuffer, VERTEX_ATTRIBUTE_NORMAL, v));
+          }
+        }
+      });
+
+  // Ranges are kept for placeVertices(), once the indices are released
+  m_primitiveVertices.resize(geometry.primitives.size());
+  for (size_t p = 0; p < geometry.primitives.size(); ++p) {
+    const auto &primitive = geometry.primitives[p];
+    uint32_t first, count;
+    primitiveVertices(geometry, primitive, first, count);
+    m_primitiveVertices[p] =
+        glm::uvec2(m_firstVertices[primitive.vertexBuffer] + first, count);
+  }
+}
+
+size_t OcclusionBaker::placeVertices(const PackedGeometry &geometry,
+    const std::vector<const glm::mat4 *> &primitiveMatrices)
+{
+  TRACE_ZONE("OcclusionBaker::placeVertices");
+  std::vector<GpuBakeVertex> vertices(m_positions.size(),
+      GpuBakeVertex{glm::vec4(0), glm::vec4(0)});
+  JobSystem::shared().parallelFor(
+      geometry.primitives.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t p = begin; p < end; ++p) {
+          const auto *matrix = primitiveMatrices[p];
+          if (!matrix) {
+            continue;
+          }
+          const auto normalMatrix =
+              glm::transpose(glm::inverse(glm::mat3(*matrix)));
+          const auto range = m_primitiveVertices[p];
+          for (uint32_t i = range.x; i < range.x + range.y; ++i) {
+            const auto normal = normalMatrix * m_normals[i];
+            const auto length = glm::length(normal);
+            vertices[i].position = *matrix * glm::vec4(m_positions[i], 1.f);
+            vertices[i].normal =
+                length > 0.f ? glm::vec4(normal / length, 0.f) : glm::vec4(0);
+          }
+        }
+      });
+
+  // Empty scenes still bind buffers
+  const auto vertexSize =
+      std::max<size_t>(vertices.size() * sizeof(GpuBakeVertex), 16);
+  m_vertexBuffer.generate();
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_vertexBuffer);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, GLsizeiptr(vertexSize), nullptr,
+      GL_STATIC_DRAW);
+  glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0,
+      GLsizeiptr(vertices.size() * sizeof(GpuBakeVertex)), vertices.data());
+  trackBuffer(GpuMemoryCategory::ShaderBuffers, m_vertexBuffer, vertexSize);
+
+  const auto bakeSize = std::max<size_t>(vertices.size() * sizeof(float), 16);
+  m_bakeBuffer.generate();
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_bakeBuffer);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, GLsizeiptr(bakeSize), nullptr,
+      GL_STREAM_READ);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  trackBuffer(GpuMemoryCategory::Staging, m_bakeBuffer, bakeSize);
+
+  return vertices.size();
+}
+
+void OcclusionBaker::bindBuffers(GLuint firstBinding) const
+{
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, firstBinding, m_vertexBuffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, firstBinding + 1, m_bakeBuffer);
+}
+
+void OcclusionBaker::readOcclusion()
+{
+  TRACE_ZONE("OcclusionBaker::readOcclusion");
+  std::vector<float> occlusion(m_positions.size());
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_bakeBuffer);
+  glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0,
+      GLsizeiptr(occlusion.size() * sizeof(float)), occlusion.data());
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+  m_occlusion.resize(occlusion.size());
+  for (size_t i = 0; i < occlusion.size(); ++i) {
+    m_occlusion[i] =
+        uint8_t(std::lround(255.f * glm::clamp(occlusion[i], 0.f, 1.f)));
+  }
+
+  m_vertexBuffer.reset();
+  m_bakeBuffer.reset();
+  m_positions = {};
+  m_normals = {};
+  m_primitiveVertices = {};
+}
+
+bool OcclusionBaker::setOcclusion(
+    const PackedGeometry &geometry, std::vector<uint8_t> occlusion)
+{
+  if (occlusion.size() != countVertices(geometry)) {
+    return false;
+  }
+  m_occlusion = std::move(occlusion);
+  m_positions = {};
+  m_normals = {};
+  m_primitiveVertices = {};
+  return true;
+}
+
+void OcclusionBaker::uploadTexture()
+{
+  if (m_texture || m_occlusion.empty()) {
+    return;
+  }
+  m_occlusionBuffer.generate();
+  glBindBuffer(GL_TEXTURE_BUFFER, m_occlusionBuffer);
+  glBufferData(GL_TEXTURE_BUFFER, GLsizeiptr(m_occlusion.size()),
+      m_occlusion.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+  trackBuffer(
+      GpuMemoryCategory::Geometry, m_occlusionBuffer, m_occlusion.size());
+  m_texture.generate();
+  glBindTexture(GL_TEXTURE_BUFFER, m_texture);
+  glTexBuffer(GL_TEXTURE_BUFFER, GL_R8, m_occlusionBuffer);
+  glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "gl_objects.hpp"
+#include "packed_geometry.hpp"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// Ambient occlusion of the vertices of the packed geometry, baked once by
+// path_trace.cs.glsl with BAKE_OCCLUSION against the BVH of the path tracer,
+// see GeometryOptions::occlusionRays. The occlusion of a vertex is the
+// fraction of the cosine weighted rays of its hemisphere that hit a surface
+// closer than the bake distance, stored on 8 bits. It darkens the ambient
+// light of the draws at no cost beyond a texel fetch per vertex.
+//
+// Vertices are baked where the first draw of their primitive places them:
+// instances of a mesh share the occlusion of the first one. Vertices of
+// skinned, morphed and merged primitives are not baked, their occlusion is 0.
+//
+// The occlusion of every vertex buffer is concatenated, the vertices of
+// buffer b starting at firstVertex(b), and read by the vertex shader from a
+// GL_R8 buffer texture.
+class OcclusionBaker
+{
+public:
+  // Copy the positions, in the space of their mesh, and normals of the
+  // vertices of every primitive, before the geometry data is released
+  void readVertices(const PackedGeometry &geometry);
+  bool hasVertices() const { return !m_positions.empty(); }
+
+  // Place the vertices of each primitive by primitiveMatrices[p], nullptr for
+  // the primitives not baked, and upload them with a buffer for their
+  // occlusion. Primitives are placed by jobs. Return the vertex count.
+  size_t placeVertices(const PackedGeometry &geometry,
+      const std::vector<const glm::mat4 *> &primitiveMatrices);
+
+  // Bind the placed vertices and their occlusion to firstBinding and the
+  // storage buffer binding after it
+  void bindBuffers(GLuint firstBinding) const;
+
+  // Read the occlusion written by the shader back, then release the placed
+  // vertices
+  void readOcclusion();
+
+  // Occlusion read from a cache instead of baked. Return false if it does
+  // not have one value per vertex of the geometry.
+  bool setOcclusion(
+      const PackedGeometry &geometry, std::vector<uint8_t> occlusion);
+  const std::vector<uint8_t> &occlusion() const { return m_occlusion; }
+
+  // Upload the occlusion to texture(), once per load
+  void uploadTexture();
+  GLuint texture() const { return m_texture; }
+
+  uint32_t firstVertex(uint32_t vertexBuffer) const
+  {
+    return m_firstVertices[vertexBuffer];
+  }
+
+private:
+  // Set the first vertex of each buffer, return the vertex count
+  size_t countVertices(const PackedGeometry &geometry);
+
+  std::vector<uint32_t> m_firstVertices;
+  std::vector<glm::uvec2> m_primitiveVertices; // First and count
+  std::vector<glm::vec3> m_positions;
+  std::vector<glm::vec3> m_normals;
+  std::vector<uint8_t> m_occlusion;
+
+  GLBuffer m_vertexBuffer; // Placed vertices, position and normal
+  GLBuffer m_bakeBuffer; // Float occlusion written by the shader
+  GLBuffer m_occlusionBuffer;
+  GLTexture m_texture;
+};
@@ -0,0 +1,146 @@
+#include "base64.hpp"
+
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BASE64_SSE2
+#endif
+
+namespace
+{
+
+// 6-bit value of each character, -1 outside of the alphabet
+struct DecodeTable
+{
+  int8_t values[256];
+
+  DecodeTable()
+  {
+    for (auto &value : values) {
+      value = -1;
+    }
+    const char alphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    for (int i = 0; i < 64; ++i) {
+      values[uint8_t(alphabet[i])] = int8_t(i);
+    }
+  }
+};
+
+const DecodeTable DECODE_TABLE;
+
+// Up to 4 characters into up to 3 bytes
+bool decodeQuad(const char *text, size_t count, unsigned char *bytes)
+{
+  uint32_t bits = 0;
+  int32_t invalid = 0;
+  for (size_t i = 0; i < 4; ++i) {
+    const int32_t value =
+        i < count ? DECODE_TABLE.values[uint8_t(text[i])] : 0;
+    invalid |= value;
+    bits = bits << 6 | uint32_t(value & 0x3F);
+  }
+  if (invalid < 0) {
+    return false;
+  }
+  bytes[0] = uint8_t(bits >> 16);
+  if (count > 2) {
+    bytes[1] = uint8_t(bits >> 8);
+  }
+  if (count > 3) {
+    bytes[2] = uint8_t(bits);
+  }
+  return true;
+}
+
+#if defined(BASE64_SSE2)
+
+// Characters in [first, last], compared as signed bytes: those above 127 are
+// never in the alphabet
+__m128i inRange(__m128i characters, char first, char last)
+{
+  return _mm_and_si128(
+      _mm_cmpgt_epi8(characters, _mm_set1_epi8(char(first - 1))),
+      _mm_cmplt_epi8(characters, _mm_set1_epi8(char(last + 1))));
+}
+
+// 16 characters into 12 bytes, false without writing if one of them is
+// outside of the alphabet
+bool decodeBlock(const char *text, unsigned char *bytes)
+{
+  const auto characters =
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(text));
+  const auto upper = inRange(characters, 'A', 'Z');
+  const auto lower = inRange(characters, 'a', 'z');
+  const auto digit = inRange(characters, '0', '9');
+  const auto plus = _mm_cmpeq_epi8(characters, _mm_set1_epi8('+'));
+  const auto slash = _mm_cmpeq_epi8(characters, _mm_set1_epi8('/'));
+  const auto valid = _mm_or_si128(_mm_or_si128(upper, lower),
+      _mm_or_si128(digit, _mm_or_si128(plus, slash)));
+  if (_mm_movemask_epi8(valid) != 0xFFFF) {
+    return false;
+  }
+
+  // Offsets from the characters to their values
+  auto offsets = _mm_and_si128(upper, _mm_set1_epi8(-'A'));
+  offsets = _mm_or_si128(
+      offsets, _mm_and_si128(lower, _mm_set1_epi8(char(26 - 'a'))));
+  offsets = _mm_or_si128(
+      offsets, _mm_and_si128(digit, _mm_set1_epi8(char(52 - '0'))));
+  offsets = _mm_or_si128(
+      offsets, _mm_and_si128(plus, _mm_set1_epi8(char(62 - '+'))));
+  offsets = _mm_or_si128(
+      offsets, _mm_and_si128(slash, _mm_set1_epi8(char(63 - '/'))));
+  const auto values = _mm_add_epi8(characters, offsets);
+
+  // Pairs of 6 bits into 12 bits in each 16-bit lane, the first character
+  // being the low byte, then pairs of those into 24 bits in each 32-bit lane
+  const auto pairs = _mm_or_si128(
+      _mm_slli_epi16(_mm_and_si128(values, _mm_set1_epi16(0x00FF)), 6),
+      _mm_srli_epi16(values, 8));
+  const auto quads = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+
+  alignas(16) uint32_t bits[4];
+  _mm_store_si128(reinterpret_cast<__m128i *>(bits), quads);
+  for (int i = 0; i < 4; ++i) {
+    bytes[3 * i] = uint8_t(bits[i] >> 16);
+    bytes[3 * i + 1] = uint8_t(bits[i] >> 8);
+    bytes[3 * i + 2] = uint8_t(bits[i]);
+  }
+  return true;
+}
+
+#endif
+
+} // namespace
+
+bool base64DecodedSize(size_t textSize, size_t &size)
+{
+  if (textSize % 4 == 1) {
+    return false;
+  }
+  size = textSize / 4 * 3 + (textSize % 4 ? textSize % 4 - 1 : 0);
+  return true;
+}
+
+bool decodeBase64(const char *text, size_t textSize, unsigned char *bytes)
+{
+  size_t i = 0;
+#if defined(BASE64_SSE2)
+  for (; i + 16 <= textSize; i += 16, bytes += 12) {
+    if (!decodeBlock(text + i, bytes)) {
+      // Found again by decodeQuad()
+      break;
+    }
+  }
+#endif
+  for (; i < textSize; i += 4, bytes += 3) {
+    const auto count = textSize - i < 4 ? textSize - i : 4;
+    if (count == 1 || !decodeQuad(text + i, count, bytes)) {
+      return false;
+    }
+  }
+  return true;
+}
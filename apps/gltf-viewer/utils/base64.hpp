@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstddef>
+
+// Size of the bytes encoded by a base64 text without its '=' padding, false
+// if no length of text can encode bytes
+bool base64DecodedSize(size_t textSize, size_t &size);
+
+// Decode a base64 text without padding into the base64DecodedSize() bytes it
+// encodes, 16 characters at a time where SSE2 is available. False if it has
+// characters outside of the alphabet. A text can be split at any multiple of
+// 4 characters and its parts decoded separately.
+bool decodeBase64(const char *text, size_t textSize, unsigned char *bytes);
@@ -0,0 +1,75 @@
+#include "bc6h.hpp"
+
+#include <algorithm>
+
+namespace
+{
+
+const size_t BLOCK_SIZE = 16;
+
+GLsizei levelSize(GLsizei size, GLsizei level)
+{
+  return std::max(size >> level, 1);
+}
+
+} // namespace
+
+size_t bc6hLevelSize(uint32_t size)
+{
+  const size_t blocks = (size + 3) / 4;
+  return blocks * blocks * BLOCK_SIZE;
+}
+
+bool bc6hCompressible(uint32_t size) { return size % 4 == 0; }
+
+GLuint compressCubeMapBc6h(
+    const GLProgram &program, GLuint source, GLsizei size, GLsizei levels)
+{
+  GLuint cubeMap;
+  glGenTextures(1, &cubeMap);
+  glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMap);
+  glTexStorage2D(GL_TEXTURE_CUBE_MAP, levels,
+      GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT, size, size);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER,
+      levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+  // The blocks of every face of a level, written by the shader then read by
+  // the uploads of the faces, large enough for the first level
+  const auto faceBytes = bc6hLevelSize(uint32_t(size));
+  GLuint blocks;
+  glGenBuffers(1, &blocks);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, blocks);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, GLsizeiptr(6 * faceBytes), nullptr,
+      GL_STREAM_COPY);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, blocks);
+
+  program.use();
+  for (GLsizei level = 0; level < levels; ++level) {
+    const auto texels = levelSize(size, level);
+    const auto blocksPerRow = GLuint(texels + 3) / 4;
+    program.setUniform("uSize", GLint(texels));
+    glBindImageTexture(0, source, level, GL_TRUE, 0, GL_READ_ONLY, GL_RGBA16F);
+    glDispatchCompute((blocksPerRow + 7) / 8, (blocksPerRow + 7) / 8, 6);
+    glMemoryBarrier(GL_PIXEL_BUFFER_BARRIER_BIT);
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, blocks);
+    const auto levelBytes = bc6hLevelSize(uint32_t(texels));
+    for (GLuint face = 0; face < 6; ++face) {
+      glCompressedTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level,
+          0, 0, texels, texels, GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT,
+          GLsizei(levelBytes),
+          reinterpret_cast<const void *>(face * levelBytes));
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  }
+
+  glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA16F);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
+  glDeleteBuffers(1, &blocks);
+
+  return cubeMap;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "shaders.hpp"
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <cstdint>
+
+// BC6H compression of the baked image based lighting maps, a 4x4 block of RGB
+// halfs in 16 bytes instead of 128, encoded on the GPU by bc6h_encode.cs.glsl.
+// Blocks only use the single line mode of the format: flat regions and
+// gradients keep their precision, blocks of several distinct colors lose some.
+
+// Bytes of a level of a BC6H texture of size x size texels
+size_t bc6hLevelSize(uint32_t size);
+
+// True if cube maps of faces of size texels can be compressed, in blocks
+// covering every level
+bool bc6hCompressible(uint32_t size);
+
+// New immutable GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT cube map of levels
+// levels from the first ones of source, an RGBA16F cube map of size texels,
+// with the parameters of its baked maps. program is compiled from
+// bc6h_encode.cs.glsl. Changes the bound program, image unit 0, storage
+// buffer binding 0 and GL_TEXTURE_CUBE_MAP of the active unit.
+GLuint compressCubeMapBc6h(
+    const GLProgram &program, GLuint source, GLsizei size, GLsizei levels);
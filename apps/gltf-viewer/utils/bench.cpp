@@ -0,0 +1,240 @@
+#include "bench.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+
+#include <json.hpp>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace
+{
+
+double percentile(const std::vector<double> &sorted, double p)
+{
+  const auto rank = size_t(std::ceil(p / 100 * double(sorted.size())));
+  return sorted[std::min(std::max(rank, size_t(1)), sorted.size()) - 1];
+}
+
+// "Material textures" is material_textures
+std::string nameKey(const char *name)
+{
+  std::string key = name;
+  for (auto &c : key) {
+    c = c == ' ' ? '_' : char(std::tolower(c));
+  }
+  return key;
+}
+
+std::string categoryKey(GpuMemoryCategory category)
+{
+  return nameKey(gpuMemoryCategoryName(category));
+}
+
+nlohmann::json timingJson(const TimingSummary &timing)
+{
+  return {{"min", timing.min}, {"average", timing.average},
+      {"p50", timing.p50}, {"p95", timing.p95}, {"p99", timing.p99},
+      {"max", timing.max}};
+}
+
+// Column names and values of the CSV line, in the same order
+std::vector<std::pair<std::string, std::string>> csvColumns(
+    const BenchReport &report)
+{
+  std::vector<std::pair<std::string, std::string>> columns;
+  const auto add = [&](const std::string &name, const std::string &value) {
+    columns.emplace_back(name, value);
+  };
+  const auto addNumber = [&](const std::string &name, double value) {
+    std::ostringstream stream;
+    stream << value;
+    add(name, stream.str());
+  };
+  // Not rounded to 6 digits like doubles
+  const auto addCount = [&](const std::string &name, size_t value) {
+    add(name, std::to_string(value));
+  };
+  const auto addTiming = [&](const std::string &name,
+                             const TimingSummary &timing) {
+    addNumber(name + "_min_ms", timing.min);
+    addNumber(name + "_avg_ms", timing.average);
+    addNumber(name + "_p50_ms", timing.p50);
+    addNumber(name + "_p95_ms", timing.p95);
+    addNumber(name + "_p99_ms", timing.p99);
+    addNumber(name + "_max_ms", timing.max);
+  };
+
+  // Quoted, GL_RENDERER strings often have commas
+  const auto quoted = [](const std::string &text) {
+    std::string result = "\"";
+    for (const auto c : text) {
+      result += c == '"' ? std::string("\"\"") : std::string(1, c);
+    }
+    return result + "\"";
+  };
+  add("model", quoted(report.model));
+  add("renderer", quoted(report.renderer));
+  addCount("width", report.width);
+  addCount("height", report.height);
+  addCount("frames", report.frames);
+  addNumber("load_shaders_ms", report.load.shaders);
+  addNumber("load_parse_ms", report.load.parse);
+  addNumber("load_textures_ms", report.load.textures);
+  addNumber("load_buffers_ms", report.load.buffers);
+  addNumber("load_environment_ms", report.load.environment);
+  addNumber("load_finish_ms", report.load.finish);
+  addNumber("load_total_ms", report.load.total);
+  addCount("load_uploaded_bytes", report.load.uploadedBytes);
+  addTiming("cpu", report.cpu);
+  addTiming("gpu", report.gpu);
+  addTiming("frame", report.frame);
+  addNumber("draw_calls", report.averageDrawCalls);
+  addNumber("triangles", report.averageTriangles);
+  addCount("peak_memory_bytes", report.peakMemory);
+  addCount("gpu_memory_bytes", report.gpuMemory.total);
+  for (size_t i = 0; i < size_t(GpuMemoryCategory::Count); ++i) {
+    addCount("gpu_memory_" + categoryKey(GpuMemoryCategory(i)) + "_bytes",
+        report.gpuMemory.bytes[i]);
+  }
+  addCount("gpu_memory_objects", report.gpuMemory.objectCount);
+  addCount("driver_memory_total_bytes", report.driverMemory.totalBytes);
+  addCount(
+      "driver_memory_available_bytes", report.driverMemory.availableBytes);
+  addCount("host_memory_bytes", report.heapMemory.total);
+  addCount("host_memory_peak_bytes", report.heapMemory.peakTotal);
+  for (size_t i = 0; i < size_t(HeapTag::Count); ++i) {
+    const auto key = "host_memory_" + nameKey(heapTagName(HeapTag(i)));
+    addCount(key + "_bytes", report.heapMemory.bytes[i]);
+    addCount(key + "_peak_bytes", report.heapMemory.peakBytes[i]);
+  }
+  return columns;
+}
+
+} // namespace
+
+TimingSummary summarizeTimings(std::vector<double> values)
+{
+  TimingSummary summary;
+  if (values.empty()) {
+    return summary;
+  }
+  std::sort(values.begin(), values.end());
+  summary.min = values.front();
+  summary.max = values.back();
+  summary.average = std::accumulate(values.begin(), values.end(), 0.0) /
+                    double(values.size());
+  summary.p50 = percentile(values, 50);
+  summary.p95 = percentile(values, 95);
+  summary.p99 = percentile(values, 99);
+  return summary;
+}
+
+size_t peakMemoryBytes()
+{
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS counters;
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+    return 0;
+  }
+  return size_t(counters.PeakWorkingSetSize);
+#else
+  rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+#ifdef __APPLE__
+  return size_t(usage.ru_maxrss); // In bytes on macOS, in KB elsewhere
+#else
+  return size_t(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+bool writeBenchReport(
+    const BenchReport &report, const fs::path &path, std::string &err)
+{
+  std::ofstream file;
+  if (!path.empty()) {
+    file.open(path);
+    if (!file) {
+      err = "Unable to write benchmark report to " + path.string();
+      return false;
+    }
+  }
+  auto &out = path.empty() ? std::cout : file;
+
+  if (path.extension() == ".json") {
+    const auto &load = report.load;
+    nlohmann::json gpuMemory = {{"total", report.gpuMemory.total},
+        {"objects", report.gpuMemory.objectCount}};
+    for (size_t i = 0; i < size_t(GpuMemoryCategory::Count); ++i) {
+      gpuMemory[categoryKey(GpuMemoryCategory(i))] = report.gpuMemory.bytes[i];
+    }
+    const auto &heap = report.heapMemory;
+    nlohmann::json hostMemory = {{"total", heap.total},
+        {"peak", heap.peakTotal}, {"allocations", heap.allocationCount}};
+    for (size_t i = 0; i < size_t(HeapTag::Count); ++i) {
+      const auto key = nameKey(heapTagName(HeapTag(i)));
+      hostMemory[key] = heap.bytes[i];
+      hostMemory[key + "_peak"] = heap.peakBytes[i];
+    }
+    auto hostSites = nlohmann::json::array();
+    for (const auto &site : report.heapSites) {
+      hostSites.push_back({{"bytes", site.bytes},
+          {"samples", site.sampleCount},
+          {"tag", nameKey(heapTagName(site.tag))}, {"frames", site.frames}});
+    }
+    const nlohmann::json document = {{"model", report.model},
+        {"renderer", report.renderer}, {"width", report.width},
+        {"height", report.height}, {"frames", report.frames},
+        {"load_ms",
+            {{"shaders", load.shaders}, {"parse", load.parse},
+                {"textures", load.textures}, {"buffers", load.buffers},
+                {"environment", load.environment}, {"finish", load.finish},
+                {"total", load.total}}},
+        {"load_uploaded_bytes", load.uploadedBytes},
+        {"cpu_ms", timingJson(report.cpu)}, {"gpu_ms", timingJson(report.gpu)},
+        {"frame_ms", timingJson(report.frame)},
+        {"draw_calls", report.averageDrawCalls},
+        {"triangles", report.averageTriangles},
+        {"peak_memory_bytes", report.peakMemory},
+        {"gpu_memory_bytes", gpuMemory},
+        {"driver_memory_bytes",
+            {{"total", report.driverMemory.totalBytes},
+                {"available", report.driverMemory.availableBytes}}},
+        {"host_memory_bytes", hostMemory},
+        {"host_memory_sites", hostSites}};
+    out << document.dump(2) << '\n';
+  } else {
+    const auto columns = csvColumns(report);
+    for (size_t i = 0; i < columns.size(); ++i) {
+      out << (i ? "," : "") << columns[i].first;
+    }
+    out << '\n';
+    for (size_t i = 0; i < columns.size(); ++i) {
+      out << (i ? "," : "") << columns[i].second;
+    }
+    out << '\n';
+  }
+
+  out.flush();
+  if (!out) {
+    err = "Unable to write benchmark report to " +
+          (path.empty() ? std::string("stdout") : path.string());
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "filesystem.hpp"
+#include "gpu_memory.hpp"
+#include "heap_memory.hpp"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Frames rendered offscreen, without vsync, by the bench command
+struct BenchOptions
+{
+  size_t frames = 0; // No benchmark if 0
+  size_t warmupFrames = 0; // Rendered before measuring
+  fs::path report; // JSON if .json, else CSV, stdout as CSV if empty
+};
+
+// Wall time in ms of the steps of loading a scene, and the bytes it uploads.
+// Parsing and uploads run on the loader thread while the main one bakes the
+// environment, they overlap.
+struct LoadTimes
+{
+  double shaders = 0; // Programs and GL objects created before loading
+  double parse = 0; // Started before the shaders, overlapping them
+  double textures = 0;
+  double buffers = 0;
+  double environment = 0; // Image based lighting, baked or cached
+  double finish = 0; // Main thread part, including waiting for the loader
+  double total = 0; // Up to the first frame
+  size_t uploadedBytes = 0; // Of geometry and texture levels
+};
+
+// Of a series of frame times in ms, percentiles are of the nearest rank
+struct TimingSummary
+{
+  double min = 0;
+  double average = 0;
+  double p50 = 0;
+  double p95 = 0;
+  double p99 = 0;
+  double max = 0;
+};
+
+TimingSummary summarizeTimings(std::vector<double> values);
+
+// Peak resident memory of the process in bytes, 0 if unknown
+size_t peakMemoryBytes();
+
+struct BenchReport
+{
+  std::string model;
+  std::string renderer; // GL_RENDERER
+  size_t width = 0;
+  size_t height = 0;
+  size_t frames = 0;
+  LoadTimes load;
+  TimingSummary cpu; // Submission of the frames
+  TimingSummary gpu; // "Scene" section of the GpuProfiler
+  TimingSummary frame; // Between the starts of consecutive frames
+  double averageDrawCalls = 0;
+  double averageTriangles = 0;
+  size_t peakMemory = 0;
+  GpuMemoryTracker::Usage gpuMemory; // Tracked objects after the last frame
+  DriverMemoryInfo driverMemory; // 0s if the driver does not tell
+  HeapUsage heapMemory; // After the last frame, see heapAllocationsCounted()
+  std::vector<HeapSite> heapSites; // If sampled, JSON reports only
+};
+
+bool writeBenchReport(
+    const BenchReport &report, const fs::path &path, std::string &err);
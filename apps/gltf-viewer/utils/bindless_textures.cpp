@@ -0,0 +1,60 @@
+#include "bindless_textures.hpp"
+
+#include "gl_extensions.hpp"
+
+namespace
+{
+
+typedef GLuint64(APIENTRYP PFNGETTEXTUREHANDLEPROC)(GLuint texture);
+typedef GLuint64(APIENTRYP PFNGETTEXTURESAMPLERHANDLEPROC)(
+    GLuint texture, GLuint sampler);
+typedef void(APIENTRYP PFNMAKETEXTUREHANDLERESIDENTPROC)(GLuint64 handle);
+
+PFNGETTEXTUREHANDLEPROC getTextureHandleARB = nullptr;
+PFNGETTEXTURESAMPLERHANDLEPROC getTextureSamplerHandleARB = nullptr;
+PFNMAKETEXTUREHANDLERESIDENTPROC makeTextureHandleResidentARB = nullptr;
+PFNMAKETEXTUREHANDLERESIDENTPROC makeTextureHandleNonResidentARB = nullptr;
+
+} // namespace
+
+bool loadBindlessTextures()
+{
+  if (!hasGLExtension("GL_ARB_bindless_texture")) {
+    return false;
+  }
+
+  getTextureHandleARB = reinterpret_cast<PFNGETTEXTUREHANDLEPROC>(
+      getGLProcAddress("glGetTextureHandleARB"));
+  getTextureSamplerHandleARB = reinterpret_cast<PFNGETTEXTURESAMPLERHANDLEPROC>(
+      getGLProcAddress("glGetTextureSamplerHandleARB"));
+  makeTextureHandleResidentARB =
+      reinterpret_cast<PFNMAKETEXTUREHANDLERESIDENTPROC>(
+          getGLProcAddress("glMakeTextureHandleResidentARB"));
+  makeTextureHandleNonResidentARB =
+      reinterpret_cast<PFNMAKETEXTUREHANDLERESIDENTPROC>(
+          getGLProcAddress("glMakeTextureHandleNonResidentARB"));
+
+  return getTextureHandleARB && getTextureSamplerHandleARB &&
+         makeTextureHandleResidentARB &&
+         makeTextureHandleNonResidentARB;
+}
+
+GLuint64 getTextureHandle(GLuint texture)
+{
+  return getTextureHandleARB(texture);
+}
+
+GLuint64 getTextureSamplerHandle(GLuint texture, GLuint sampler)
+{
+  return getTextureSamplerHandleARB(texture, sampler);
+}
+
+void makeTextureHandleResident(GLuint64 handle)
+{
+  makeTextureHandleResidentARB(handle);
+}
+
+void makeTextureHandleNonResident(GLuint64 handle)
+{
+  makeTextureHandleNonResidentARB(handle);
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <glad/glad.h>
+
+// Entry points of ARB_bindless_texture, which glad is not generated with.
+// Textures referenced by handle must be made resident before drawing and must
+// not have their parameters changed afterwards.
+
+// Load the entry points, return false if the current context does not expose
+// the extension
+bool loadBindlessTextures();
+
+GLuint64 getTextureHandle(GLuint texture);
+// Handle sampling texture with the state of a sampler object
+GLuint64 getTextureSamplerHandle(GLuint texture, GLuint sampler);
+void makeTextureHandleResident(GLuint64 handle);
+void makeTextureHandleNonResident(GLuint64 handle);
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// Mip chain of bloom (Jimenez, Next Generation Post Processing in Call of
+// Duty: Advanced Warfare, 2014), starting at half the resolution of the
+// scene. Each level is downsampled from the one above with a 13 tap filter,
+// the first from the scene averaged by 2x2 pixels weighted down by their
+// luminance so that single bright pixels do not flicker. The levels are then
+// upsampled back with a 3x3 tent filter, each added to the one above, and the
+// tonemap pass adds level 0 to the scene. Every pass reads a quarter of the
+// texels of the previous one, the wide blur of the sum of levels costs a
+// little more than a pass over level 0.
+//
+// Levels are GL_R11F_G11F_B10F. Scenes may be smaller than the targets and
+// use the bottom left corner of each level, of levelSize() texels.
+class BloomChain
+{
+public:
+  BloomChain() = default;
+  ~BloomChain();
+
+  BloomChain(const BloomChain &) = delete;
+  BloomChain &operator=(const BloomChain &) = delete;
+
+  // Allocate the levels of a scene of width x height pixels, at most
+  // MAX_LEVELS down to 1 texel
+  void init(GLsizei width, GLsizei height);
+
+  // Of the scene
+  GLsizei width() const { return m_width; }
+  GLsizei height() const { return m_height; }
+  int levels() const { return m_levels; }
+  GLuint texture() const { return m_texture; }
+
+  // Texels of level used by a scene of sceneSize pixels
+  static glm::ivec2 levelSize(glm::ivec2 sceneSize, int level);
+
+  static constexpr int MAX_LEVELS = 6;
+
+private:
+  void release();
+
+  GLsizei m_width = 0;
+  GLsizei m_height = 0;
+  int m_levels = 0;
+  GLuint m_texture = 0;
+};
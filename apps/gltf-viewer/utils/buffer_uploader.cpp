@@ -0,0 +1,62 @@
+#include "buffer_uploader.hpp"
+#include "job_system.hpp"
+
+#include <algorithm>
+
+namespace
+{
+
+// Offsets of staged data, GL_MIN_MAP_BUFFER_ALIGNMENT is at least 64
+const size_t STAGING_ALIGNMENT = 64;
+
+} // namespace
+
+void BufferUploader::init(size_t regionSize, size_t regionCount)
+{
+  m_staging.init(regionSize, STAGING_ALIGNMENT, regionCount,
+      GpuMemoryCategory::Staging);
+  m_region = nullptr;
+  m_offset = 0;
+}
+
+void BufferUploader::upload(
+    GLuint buffer, GLintptr offset, const void *data, size_t size)
+{
+  m_uploadedBytes += size;
+  const auto *bytes = static_cast<const unsigned char *>(data);
+  while (size > 0) {
+    if (!m_region || m_offset == m_staging.regionSize()) {
+      if (m_region) {
+        m_staging.endRegion();
+      }
+      m_region = static_cast<unsigned char *>(m_staging.beginRegion());
+      m_offset = 0;
+    }
+
+    // Large data is split over consecutive regions
+    const auto count = std::min(size, m_staging.regionSize() - m_offset);
+    parallelCopy(m_region + m_offset, bytes, count);
+    glBindBuffer(GL_COPY_READ_BUFFER, m_staging.buffer());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+        m_staging.regionOffset() + GLintptr(m_offset), offset,
+        GLsizeiptr(count));
+
+    m_offset = std::min(m_staging.regionSize(),
+        (m_offset + count + STAGING_ALIGNMENT - 1) / STAGING_ALIGNMENT *
+            STAGING_ALIGNMENT);
+    bytes += count;
+    offset += GLintptr(count);
+    size -= count;
+  }
+  glBindBuffer(GL_COPY_READ_BUFFER, 0);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void BufferUploader::finish()
+{
+  if (m_region) {
+    m_staging.endRegion();
+    m_region = nullptr;
+  }
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "ring_buffer.hpp"
+
+#include <glad/glad.h>
+
+#include <cstddef>
+
+// Fills buffer objects through a persistently mapped staging buffer: data is
+// copied to a staging region, in parallel, and glCopyBufferSubData copies it
+// from there to the destination on the GPU. The destination needs no storage
+// flags, so glBufferStorage(..., nullptr, 0) keeps it device-local, and the
+// driver never holds a copy of the whole data in client memory as it does for
+// glBufferStorage with data. A region is reused once the GPU is done with the
+// copies that read it.
+class BufferUploader
+{
+public:
+  // Allocate regionCount staging regions of regionSize bytes
+  void init(size_t regionSize, size_t regionCount = 3);
+
+  // Copy size bytes of data to buffer at offset, region by region
+  void upload(GLuint buffer, GLintptr offset, const void *data, size_t size);
+
+  // Fence the copies of the current region, call after the last upload
+  void finish();
+
+  size_t uploadedBytes() const { return m_uploadedBytes; }
+
+private:
+  PersistentRingBuffer m_staging;
+  unsigned char *m_region = nullptr; // Current region, nullptr if fenced
+  size_t m_offset = 0; // Used bytes of the current region
+  size_t m_uploadedBytes = 0;
+};
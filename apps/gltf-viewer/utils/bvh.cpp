@@ -0,0 +1,252 @@
+#include "bvh.hpp"
+
+#include "trace.hpp"
+
+#include <algorithm>
+
+namespace
+{
+
+const int SAH_BIN_COUNT = 12;
+const uint32_t MAX_LEAF_SIZE = 4;
+
+Aabb merge(const Aabb &a, const Aabb &b)
+{
+  Aabb result;
+  result.min = glm::min(a.min, b.min);
+  result.max = glm::max(a.max, b.max);
+  return result;
+}
+
+float halfArea(const Aabb &box)
+{
+  if (box.isEmpty()) {
+    return 0.f;
+  }
+  const auto d = box.max - box.min;
+  return d.x * d.y + d.y * d.z + d.z * d.x;
+}
+
+} // namespace
+
+void Bvh::build(const std::vector<Aabb> &itemBounds)
+{
+  m_nodes.clear();
+  m_items.clear();
+  m_unboundedItems.clear();
+  m_itemBounds = itemBounds;
+
+  std::vector<glm::vec3> centroids(itemBounds.size());
+  for (uint32_t i = 0; i < itemBounds.size(); ++i) {
+    if (itemBounds[i].isEmpty()) {
+      m_unboundedItems.push_back(i);
+    } else {
+      m_items.push_back(i);
+      centroids[i] = 0.5f * (itemBounds[i].min + itemBounds[i].max);
+    }
+  }
+
+  if (m_items.empty()) {
+    return;
+  }
+
+  m_nodes.reserve(2 * m_items.size());
+  m_nodes.push_back(Node{});
+  buildNode(0, 0, uint32_t(m_items.size()), itemBounds, centroids);
+}
+
+void Bvh::buildNode(uint32_t nodeIdx, uint32_t begin, uint32_t end,
+    const std::vector<Aabb> &itemBounds,
+    const std::vector<glm::vec3> &centroids)
+{
+  Aabb bounds;
+  Aabb centroidBounds;
+  for (uint32_t i = begin; i < end; ++i) {
+    bounds = merge(bounds, itemBounds[m_items[i]]);
+    centroidBounds.min = glm::min(centroidBounds.min, centroids[m_items[i]]);
+    centroidBounds.max = glm::max(centroidBounds.max, centroids[m_items[i]]);
+  }
+
+  m_nodes[nodeIdx].bounds = bounds;
+  m_nodes[nodeIdx].first = begin;
+  m_nodes[nodeIdx].count = end - begin;
+
+  const auto count = end - begin;
+  if (count <= MAX_LEAF_SIZE) {
+    return;
+  }
+
+  // Split along the axis with the largest centroid extent
+  const auto extent = centroidBounds.max - centroidBounds.min;
+  const int axis =
+      extent.x > extent.y ? (extent.x > extent.z ? 0 : 2)
+                          : (extent.y > extent.z ? 1 : 2);
+  if (extent[axis] <= 0.f) {
+    return; // All centroids at the same place, nothing to split
+  }
+
+  const auto binOf = [&](uint32_t item) {
+    const auto t = (centroids[item][axis] - centroidBounds.min[axis]) /
+                   extent[axis];
+    return std::min(int(t * SAH_BIN_COUNT), SAH_BIN_COUNT - 1);
+  };
+
+  Aabb binBounds[SAH_BIN_COUNT];
+  uint32_t binCounts[SAH_BIN_COUNT] = {};
+  for (uint32_t i = begin; i < end; ++i) {
+    const auto bin = binOf(m_items[i]);
+    binBounds[bin] = merge(binBounds[bin], itemBounds[m_items[i]]);
+    ++binCounts[bin];
+  }
+
+  // Cost of each split between bin i and bin i + 1, from sweeps on both sides
+  float rightCosts[SAH_BIN_COUNT - 1];
+  Aabb right;
+  uint32_t rightCount = 0;
+  for (int i = SAH_BIN_COUNT - 1; i > 0; --i) {
+    right = merge(right, binBounds[i]);
+    rightCount += binCounts[i];
+    rightCosts[i - 1] = halfArea(right) * rightCount;
+  }
+
+  int bestSplit = -1;
+  float bestCost = halfArea(bounds) * count; // Cost of keeping a leaf
+  Aabb left;
+  uint32_t leftCount = 0;
+  for (int i = 0; i < SAH_BIN_COUNT - 1; ++i) {
+    left = merge(left, binBounds[i]);
+    leftCount += binCounts[i];
+    const auto cost = halfArea(left) * leftCount + rightCosts[i];
+    if (leftCount > 0 && leftCount < count && cost < bestCost) {
+      bestCost = cost;
+      bestSplit = i;
+    }
+  }
+
+  if (bestSplit < 0) {
+    return;
+  }
+
+  const auto middle = uint32_t(
+      std::partition(m_items.begin() + begin, m_items.begin() + end,
+          [&](uint32_t item) { return binOf(item) <= bestSplit; }) -
+      m_items.begin());
+
+  const auto leftIdx = uint32_t(m_nodes.size());
+  m_nodes.push_back(Node{});
+  m_nodes.push_back(Node{});
+  m_nodes[nodeIdx].first = leftIdx;
+  m_nodes[nodeIdx].count = 0;
+
+  buildNode(leftIdx, begin, middle, itemBounds, centroids);
+  buildNode(leftIdx + 1, middle, end, itemBounds, centroids);
+}
+
+void Bvh::refit(const std::vector<Aabb> &itemBounds)
+{
+  m_itemBounds = itemBounds;
+
+  // Children come after their parent, so a reverse walk visits them first
+  for (size_t i = m_nodes.size(); i-- > 0;) {
+    auto &node = m_nodes[i];
+    if (node.count) {
+      Aabb bounds;
+      for (uint32_t j = node.first; j < node.first + node.count; ++j) {
+        bounds = merge(bounds, itemBounds[m_items[j]]);
+      }
+      node.bounds = bounds;
+    } else {
+      node.bounds =
+          merge(m_nodes[node.first].bounds, m_nodes[node.first + 1].bounds);
+    }
+  }
+}
+
+void Bvh::appendItems(const Node &node, std::vector<uint32_t> &items) const
+{
+  if (node.count) {
+    items.insert(items.end(), m_items.begin() + node.first,
+        m_items.begin() + node.first + node.count);
+    return;
+  }
+  appendItems(m_nodes[node.first], items);
+  appendItems(m_nodes[node.first + 1], items);
+}
+
+void Bvh::queryFrustum(
+    const Frustum &frustum, std::vector<uint32_t> &items) const
+{
+  TRACE_ZONE("queryFrustum");
+  items.insert(items.end(), m_unboundedItems.begin(), m_unboundedItems.end());
+  if (m_nodes.empty()) {
+    return;
+  }
+
+  auto &stack = m_stack;
+  stack.assign(1, 0);
+  while (!stack.empty()) {
+    const auto &node = m_nodes[stack.back()];
+    stack.pop_back();
+
+    if (!frustum.intersects(node.bounds)) {
+      continue;
+    }
+    // Everything below a node inside the frustum is visible
+    if (frustum.contains(node.bounds)) {
+      appendItems(node, items);
+      continue;
+    }
+    if (node.count) {
+      for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+        if (frustum.intersects(m_itemBounds[m_items[i]])) {
+          items.push_back(m_items[i]);
+        }
+      }
+      continue;
+    }
+    stack.push_back(node.first);
+    stack.push_back(node.first + 1);
+  }
+}
+
+void Bvh::queryRay(const glm::vec3 &origin, const glm::vec3 &direction,
+    std::vector<uint32_t> &items) const
+{
+  items.insert(items.end(), m_unboundedItems.begin(), m_unboundedItems.end());
+  if (m_nodes.empty()) {
+    return;
+  }
+
+  // Slab test, infinite components of the inverse are handled by the min/max
+  const auto invDirection = 1.f / direction;
+  const auto hits = [&](const Aabb &box) {
+    const auto t0 = (box.min - origin) * invDirection;
+    const auto t1 = (box.max - origin) * invDirection;
+    const auto tMin = glm::min(t0, t1);
+    const auto tMax = glm::max(t0, t1);
+    const auto enter = std::max(std::max(tMin.x, tMin.y), std::max(tMin.z, 0.f));
+    const auto exit = std::min(std::min(tMax.x, tMax.y), tMax.z);
+    return enter <= exit;
+  };
+
+  auto &stack = m_stack;
+  stack.assign(1, 0);
+  while (!stack.empty()) {
+    const auto &node = m_nodes[stack.back()];
+    stack.pop_back();
+
+    if (!hits(node.bounds)) {
+      continue;
+    }
+    if (node.count) {
+      for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+        if (hits(m_itemBounds[m_items[i]])) {
+          items.push_back(m_items[i]);
+        }
+      }
+      continue;
+    }
+    stack.push_back(node.first);
+    stack.push_back(node.first + 1);
+  }
+}
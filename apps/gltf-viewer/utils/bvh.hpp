@@ -0,0 +1,56 @@
+#pragma once
+
+#include "frustum.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// Bounding volume hierarchy over a set of boxes, built with a binned surface
+// area heuristic. Items are identified by their index in the vector given to
+// build(). Items with an empty box are not in the tree and are returned by
+// every query.
+class Bvh
+{
+public:
+  void build(const std::vector<Aabb> &itemBounds);
+
+  // Update the node bounds after some item boxes moved, without changing the
+  // tree. itemBounds must have the size given to build() and empty boxes must
+  // stay empty. The tree gets worse as the items move away from where they
+  // were at build time.
+  void refit(const std::vector<Aabb> &itemBounds);
+
+  // Append the items whose box intersects the frustum
+  void queryFrustum(const Frustum &frustum, std::vector<uint32_t> &items) const;
+
+  // Append the items whose box is hit by the ray, in no particular order
+  void queryRay(const glm::vec3 &origin, const glm::vec3 &direction,
+      std::vector<uint32_t> &items) const;
+
+  struct Node
+  {
+    Aabb bounds;
+    uint32_t first; // First item if leaf, else left child (right is next)
+    uint32_t count; // Number of items, 0 for inner nodes
+  };
+
+  // The tree as built, for traversals done elsewhere such as on the GPU. The
+  // root is the first node, a leaf covers items()[first, first + count).
+  // Both are empty if no item has a box.
+  const std::vector<Node> &nodes() const { return m_nodes; }
+  const std::vector<uint32_t> &items() const { return m_items; }
+
+private:
+  void buildNode(uint32_t nodeIdx, uint32_t begin, uint32_t end,
+      const std::vector<Aabb> &itemBounds,
+      const std::vector<glm::vec3> &centroids);
+  void appendItems(const Node &node, std::vector<uint32_t> &items) const;
+
+  std::vector<Node> m_nodes; // Children are always after their parent
+  std::vector<uint32_t> m_items; // Items under each leaf are contiguous
+  std::vector<uint32_t> m_unboundedItems;
+  std::vector<Aabb> m_itemBounds; // Leaves test each of their items
+  // Nodes left to visit by a query, kept for its capacity: queries of one
+  // Bvh are not concurrent
+  mutable std::vector<uint32_t> m_stack;
+};
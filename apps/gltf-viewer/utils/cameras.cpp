@@ -1,5 +1,4 @@
 #include "cameras.hpp"
-#include "glfw.hpp"
 
 #include <iostream>
 
@@ -26,68 +25,51 @@ ViewFrame fromViewToWorldMatrix(const mat4 &viewToWorldMatrix)
       -vec3(viewToWorldMatrix[2]), vec3(viewToWorldMatrix[3])};
 }
 
-bool FirstPersonCameraController::update(float elapsedTime)
+bool FirstPersonCameraController::update(
+    const CameraInput &input, float elapsedTime)
 {
-  if (glfwGetMouseButton(m_pWindow, GLFW_MOUSE_BUTTON_LEFT) &&
-      !m_LeftButtonPressed) {
-    m_LeftButtonPressed = true;
-    glfwGetCursorPos(
-        m_pWindow, &m_LastCursorPosition.x, &m_LastCursorPosition.y);
-  } else if (!glfwGetMouseButton(m_pWindow, GLFW_MOUSE_BUTTON_LEFT) &&
-             m_LeftButtonPressed) {
-    m_LeftButtonPressed = false;
-  }
-
-  const auto cursorDelta = ([&]() {
-    if (m_LeftButtonPressed) {
-      dvec2 cursorPosition;
-      glfwGetCursorPos(m_pWindow, &cursorPosition.x, &cursorPosition.y);
-      const auto delta = cursorPosition - m_LastCursorPosition;
-      m_LastCursorPosition = cursorPosition;
-      return delta;
-    }
-    return dvec2(0);
-  })();
+  const auto cursorDelta = input.leftDrag;
 
   float truckLeft = 0.f;
   float pedestalUp = 0.f;
   float dollyIn = 0.f;
   float rollRightAngle = 0.f;
 
-  if (glfwGetKey(m_pWindow, GLFW_KEY_W)) {
+  if (input.forward) {
     dollyIn += m_fSpeed * elapsedTime;
   }
 
   // Truck left
-  if (glfwGetKey(m_pWindow, GLFW_KEY_A)) {
+  if (input.left) {
     truckLeft += m_fSpeed * elapsedTime;
   }
 
   // Pedestal up
-  if (glfwGetKey(m_pWindow, GLFW_KEY_UP)) {
+  if (input.up) {
     pedestalUp += m_fSpeed * elapsedTime;
   }
 
   // Dolly out
-  if (glfwGetKey(m_pWindow, GLFW_KEY_S)) {
+  if (input.back) {
     dollyIn -= m_fSpeed * elapsedTime;
   }
 
   // Truck right
-  if (glfwGetKey(m_pWindow, GLFW_KEY_D)) {
+  if (input.right) {
     truckLeft -= m_fSpeed * elapsedTime;
   }
 
   // Pedestal down
-  if (glfwGetKey(m_pWindow, GLFW_KEY_DOWN)) {
+  if (input.down) {
     pedestalUp -= m_fSpeed * elapsedTime;
   }
 
-  if (glfwGetKey(m_pWindow, GLFW_KEY_Q)) {
-    rollRightAngle -= 0.001f;
+  // Radians per second
+  if (input.rollLeft) {
+    rollRightAngle -= 0.25f * elapsedTime;
   }
-  if (glfwGetKey(m_pWindow, GLFW_KEY_E)) {
-    rollRightAngle += 0.001f;
+  if (input.rollRight) {
+    rollRightAngle += 0.25f * elapsedTime;
   }
 
   // cursor going right, so minus because we want pan left angle:
@@ -107,45 +89,16 @@ bool FirstPersonCameraController::update(float elapsedTime)
   return true;
 }
 
-bool TrackballCameraController::update(float elapsedTime)
+bool TrackballCameraController::update(
+	const CameraInput &input,
+	float elapsedTime)
 {
-	if (glfwGetMouseButton(
-		m_pWindow,
-		GLFW_MOUSE_BUTTON_MIDDLE) && !m_MiddleButtonPressed)
-	{
-		m_MiddleButtonPressed = true;
-		glfwGetCursorPos(
-			m_pWindow,
-			&m_LastCursorPosition.x,
-			&m_LastCursorPosition.y);
-	}
-	else if (!glfwGetMouseButton(
-		m_pWindow,
-		GLFW_MOUSE_BUTTON_MIDDLE) && m_MiddleButtonPressed)
-	{
-		m_MiddleButtonPressed = false;
-	}
-
-	const auto cursorDelta = ([&]()
-	{
-		if (m_MiddleButtonPressed)
-		{
-			dvec2 cursorPosition;
-			glfwGetCursorPos(m_pWindow, &cursorPosition.x, &cursorPosition.y);
-
-			const auto delta = cursorPosition - m_LastCursorPosition;
-			m_LastCursorPosition = cursorPosition;
-
-			return delta;
-		}
-
-		return dvec2(0);
-	})();
+	const auto cursorDelta = input.middleDrag;
 
 	const float latitude = 0.01f * float(cursorDelta.x);
 	const float longitude = 0.01f * float(cursorDelta.y);
 
-	if (glfwGetKey(m_pWindow, GLFW_KEY_LEFT_CONTROL))
+	if (input.control)
 	{
 		const glm::vec3 vec =
 			(1 - longitude) * (m_camera.eye() - m_camera.center());
@@ -155,11 +108,11 @@ bool TrackballCameraController::update(float elapsedTime)
 			m_camera.setEye(m_camera.center() + vec);
 		}
 	}
-	else if (glfwGetKey(m_pWindow, GLFW_KEY_LEFT_SHIFT))
+	else if (input.shift)
 	{
 		m_camera.moveLocal(latitude, longitude, 0.0f);
 	}
-	else if (m_MiddleButtonPressed)
+	else if (input.middleButton)
 	{
 		const glm::vec3 prev = m_camera.eye() - m_camera.center();
 		const glm::vec3 perp = glm::cross(m_worldUpAxis, prev);
@@ -3,8 +3,6 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
-struct GLFWwindow;
-
 // Camera defined by an eye position, a center position and an up vector
 class Camera
 {
@@ -155,10 +153,38 @@ private:
   glm::vec3 m_up;
 };
 
+// Input of the camera controllers over a tick, filled by
+// GLFWHandle::takeCameraInput: the cursor motion accumulated by the cursor
+// callback while a button was held, so that none is lost however long the
+// frame, and the keys held when it was taken. Controllers do not poll the
+// window themselves.
+struct CameraInput
+{
+  glm::dvec2 leftDrag{0}; // Cursor motion in pixels, left button held
+  glm::dvec2 middleDrag{0};
+  bool middleButton = false;
+
+  bool forward = false; // W
+  bool back = false; // S
+  bool left = false; // A
+  bool right = false; // D
+  bool up = false; // Up arrow
+  bool down = false; // Down arrow
+  bool rollLeft = false; // Q
+  bool rollRight = false; // E
+  bool control = false; // Left control
+  bool shift = false; // Left shift
+
+  // The drags are consumed by the first tick they are given to
+  void clearDrags() { leftDrag = middleDrag = glm::dvec2(0); }
+};
+
 class CameraController
 {
 public:
-  virtual bool update(float elapsedTime) = 0;
+  // Update the camera by the input of a tick lasting elapsedTime seconds.
+  // Return true if it has moved.
+  virtual bool update(const CameraInput &input, float elapsedTime) = 0;
   virtual const Camera &getCamera() const = 0;
   virtual void setCamera(const Camera &camera) = 0;
 };
@@ -166,9 +192,8 @@ public:
 class FirstPersonCameraController : public CameraController
 {
 public:
-  FirstPersonCameraController(GLFWwindow *window, float speed = 1.f,
+  FirstPersonCameraController(float speed = 1.f,
       const glm::vec3 &worldUpAxis = glm::vec3(0, 1, 0)) :
-      m_pWindow(window),
       m_fSpeed(speed),
       m_worldUpAxis(worldUpAxis),
       m_camera{glm::vec3(0), glm::vec3(0, 0, -1), glm::vec3(0, 1, 0)}
@@ -193,9 +218,9 @@ public:
     m_worldUpAxis = worldUpAxis;
   }
 
-  // Update the view matrix based on input events and elapsed time
+  // Update the view matrix based on the input and elapsed time
   // Return true if the view matrix has been modified
-  bool update(float elapsedTime) override;
+  bool update(const CameraInput &input, float elapsedTime) override;
 
   // Get the view matrix
   const Camera &getCamera() const override { return m_camera; }
@@ -203,14 +228,9 @@ public:
   void setCamera(const Camera &camera) override { m_camera = camera; }
 
 private:
-  GLFWwindow *m_pWindow = nullptr;
   float m_fSpeed = 0.f;
   glm::vec3 m_worldUpAxis;
 
-  // Input event state
-  bool m_LeftButtonPressed = false;
-  glm::dvec2 m_LastCursorPosition;
-
   // Current camera
   Camera m_camera;
 };
@@ -219,9 +239,8 @@ private:
 class TrackballCameraController : public CameraController
 {
 public:
-  TrackballCameraController(GLFWwindow *window, float speed = 1.f,
+  TrackballCameraController(float speed = 1.f,
       const glm::vec3 &worldUpAxis = glm::vec3(0, 1, 0)) :
-      m_pWindow(window),
       m_fSpeed(speed),
       m_worldUpAxis(worldUpAxis),
       m_camera{glm::vec3(0), glm::vec3(0, 0, -1), glm::vec3(0, 1, 0)}
@@ -246,9 +265,9 @@ public:
     m_worldUpAxis = worldUpAxis;
   }
 
-  // Update the view matrix based on input events and elapsed time
+  // Update the view matrix based on the input and elapsed time
   // Return true if the view matrix has been modified
-  bool update(float elapsedTime) override;
+  bool update(const CameraInput &input, float elapsedTime) override;
 
   // Get the view matrix
   const Camera &getCamera() const override { return m_camera; }
@@ -256,14 +275,9 @@ public:
   void setCamera(const Camera &camera) override { m_camera = camera; }
 
 private:
-  GLFWwindow *m_pWindow = nullptr;
   float m_fSpeed = 0.f;
   glm::vec3 m_worldUpAxis;
 
-  // Input event state
-  bool m_MiddleButtonPressed = false;
-  glm::dvec2 m_LastCursorPosition;
-
   // Current camera
   Camera m_camera;
 };
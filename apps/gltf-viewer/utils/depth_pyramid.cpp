@@ -0,0 +1,54 @@
+#include "depth_pyramid.hpp"
+#include "gpu_memory.hpp"
+
+#include <algorithm>
+
+DepthPyramid::~DepthPyramid() { release(); }
+
+void DepthPyramid::release()
+{
+  if (m_texture) {
+    untrackTextures(1, &m_texture);
+    glDeleteTextures(1, &m_texture);
+  }
+  m_texture = 0;
+  m_levels = 0;
+}
+
+void DepthPyramid::init(GLsizei width, GLsizei height)
+{
+  release();
+  m_width = width;
+  m_height = height;
+
+  const auto size = levelSize(glm::ivec2(width, height), 0);
+  for (auto extent = std::max(size.x, size.y); extent > 0; extent /= 2) {
+    ++m_levels;
+  }
+
+  GLint previousTexture = 0;
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTexture);
+
+  // Texels are fetched, never filtered
+  glGenTextures(1, &m_texture);
+  glBindTexture(GL_TEXTURE_2D, m_texture);
+  glTexStorage2D(GL_TEXTURE_2D, m_levels, GL_R32F, size.x, size.y);
+  glTexParameteri(
+      GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  trackTexture(GpuMemoryCategory::RenderTargets, GL_TEXTURE_2D, m_texture);
+
+  glBindTexture(GL_TEXTURE_2D, GLuint(previousTexture));
+}
+
+glm::ivec2 DepthPyramid::levelSize(glm::ivec2 sceneSize, int level)
+{
+  // Rounded down below level 0 as the levels of the texture are
+  auto size = (sceneSize + 1) / 2;
+  for (int i = 0; i < level; ++i) {
+    size /= 2;
+  }
+  return glm::max(size, glm::ivec2(1));
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// Hierarchical depth of a frame, read by the GPU culling of the next one to
+// skip the draws whose bounds are behind what it drew. Level 0 is at half
+// the resolution of the scene, each texel keeping the farthest depth of the
+// 2x2 pixels it covers, and each level below the farthest of the 2x2 texels
+// of the one above, with the last row and column of odd sizes folded into
+// the texels before them. The depth of the bounds of a draw, projected with
+// the matrix of the frame drawn, is then compared to the at most 2x2 texels
+// of the first level they cover.
+//
+// Texels are the window depths of the frame, GL_R32F, farther the larger
+// unless reversed. Scenes may be smaller than the pyramid and use the bottom
+// left corner of each level, of levelSize() texels.
+class DepthPyramid
+{
+public:
+  DepthPyramid() = default;
+  ~DepthPyramid();
+
+  DepthPyramid(const DepthPyramid &) = delete;
+  DepthPyramid &operator=(const DepthPyramid &) = delete;
+
+  // Allocate every level of a scene of width x height pixels, down to 1 texel
+  void init(GLsizei width, GLsizei height);
+
+  // Of the largest scene
+  GLsizei width() const { return m_width; }
+  GLsizei height() const { return m_height; }
+  int levels() const { return m_levels; }
+  GLuint texture() const { return m_texture; }
+
+  // Texels of level used by a scene of sceneSize pixels
+  static glm::ivec2 levelSize(glm::ivec2 sceneSize, int level);
+
+private:
+  void release();
+
+  GLsizei m_width = 0;
+  GLsizei m_height = 0;
+  int m_levels = 0;
+  GLuint m_texture = 0;
+};
@@ -0,0 +1,130 @@
+#include "dynamic_resolution.hpp"
+#include "gpu_memory.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+DynamicResolution::~DynamicResolution() { release(); }
+
+void DynamicResolution::release()
+{
+  if (m_framebuffer) {
+    glDeleteFramebuffers(1, &m_framebuffer);
+  }
+  if (m_color) {
+    const GLuint textures[] = {m_color, m_depth};
+    untrackTextures(2, textures);
+    glDeleteTextures(2, textures);
+  }
+  m_framebuffer = m_color = m_depth = 0;
+  m_frames.clear();
+}
+
+void DynamicResolution::init(GLsizei width, GLsizei height)
+{
+  release();
+  m_width = width;
+  m_height = height;
+  m_scale = 1;
+  m_lastMs = 0;
+
+  GLint previousTexture = 0;
+  GLint previousFramebuffer = 0;
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTexture);
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+
+  // Linear filtering of the color is the bilinear part of the upscale
+  GLuint textures[2];
+  glGenTextures(2, textures);
+  m_color = textures[0];
+  m_depth = textures[1];
+  glBindTexture(GL_TEXTURE_2D, m_color);
+  glTexStorage2D(GL_TEXTURE_2D, 1, GL_SRGB8_ALPHA8, width, height);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  trackTexture(GpuMemoryCategory::RenderTargets, GL_TEXTURE_2D, m_color);
+  glBindTexture(GL_TEXTURE_2D, m_depth);
+  glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, width, height);
+  trackTexture(GpuMemoryCategory::RenderTargets, GL_TEXTURE_2D, m_depth);
+  glBindTexture(GL_TEXTURE_2D, GLuint(previousTexture));
+
+  glGenFramebuffers(1, &m_framebuffer);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_framebuffer);
+  glFramebufferTexture(
+      GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, m_color, 0);
+  glFramebufferTexture(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_depth, 0);
+  const GLenum drawBuffer = GL_COLOR_ATTACHMENT0;
+  glDrawBuffers(1, &drawBuffer);
+
+  const auto framebufferStatus = glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER);
+  assert(framebufferStatus == GL_FRAMEBUFFER_COMPLETE);
+  (void)framebufferStatus;
+
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, GLuint(previousFramebuffer));
+}
+
+glm::ivec2 DynamicResolution::renderSize() const
+{
+  return glm::max(
+      glm::ivec2(glm::round(m_scale * glm::vec2(m_width, m_height))),
+      glm::ivec2(1));
+}
+
+void DynamicResolution::beginFrame(float targetMs)
+{
+  read(targetMs);
+
+  Frame frame;
+  frame.queries.generate(2);
+  frame.scale = m_scale;
+  glQueryCounter(frame.queries[0], GL_TIMESTAMP);
+  m_frames.push_back(std::move(frame));
+}
+
+void DynamicResolution::endFrame()
+{
+  glQueryCounter(m_frames.back().queries[1], GL_TIMESTAMP);
+}
+
+void DynamicResolution::read(float targetMs)
+{
+  while (!m_frames.empty()) {
+    const auto &frame = m_frames.front();
+    GLint available = 0;
+    glGetQueryObjectiv(
+        frame.queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) {
+      return;
+    }
+    GLuint64 begin = 0, end = 0;
+    glGetQueryObjectui64v(frame.queries[0], GL_QUERY_RESULT, &begin);
+    glGetQueryObjectui64v(frame.queries[1], GL_QUERY_RESULT, &end);
+    const float ms = float(double(end - begin) * 1e-6);
+    const bool current = frame.scale == m_scale;
+    m_frames.pop_front();
+
+    // Frames submitted before the last change measure another scale
+    if (!current || ms <= 0) {
+      continue;
+    }
+    m_lastMs = ms;
+    if (targetMs <= 0) {
+      continue;
+    }
+
+    // Down at once to the scale meeting the target, up a step at a time
+    // and only with a margin, so that frames near the target do not
+    // alternate between two scales
+    const float wanted = m_scale * std::sqrt(targetMs / ms);
+    const int steps = int(std::round(m_scale / SCALE_STEP));
+    const int wantedSteps = int(std::floor(wanted / SCALE_STEP + 1e-3f));
+    if (wantedSteps < steps) {
+      m_scale = std::max(float(wantedSteps) * SCALE_STEP, MIN_SCALE);
+    } else if (wanted > m_scale + 1.5f * SCALE_STEP) {
+      m_scale = std::min(float(steps + 1) * SCALE_STEP, 1.f);
+    }
+  }
+}
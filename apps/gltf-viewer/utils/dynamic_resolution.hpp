@@ -0,0 +1,70 @@
+#pragma once
+
+#include "gl_objects.hpp"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <deque>
+
+// Scene of the window rendered at a fraction of the window resolution, so
+// that its GPU time stays close to a target frame time, then upscaled. The
+// GPU time of the frames is measured with GL_TIMESTAMP queries read once
+// available, frame time is taken proportional to the pixel count.
+//
+// The target is allocated at the window size, frames are rendered to its
+// bottom left corner of renderSize() pixels so that the scale changes
+// without reallocating.
+class DynamicResolution
+{
+public:
+  DynamicResolution() = default;
+  ~DynamicResolution();
+
+  DynamicResolution(const DynamicResolution &) = delete;
+  DynamicResolution &operator=(const DynamicResolution &) = delete;
+
+  // Allocate the target of width x height pixels, starting at full scale
+  void init(GLsizei width, GLsizei height);
+
+  GLsizei width() const { return m_width; }
+  GLsizei height() const { return m_height; }
+
+  // GL_SRGB8_ALPHA8 color and depth, framebuffers of the scene output linear
+  // colors with GL_FRAMEBUFFER_SRGB
+  GLuint framebuffer() const { return m_framebuffer; }
+  GLuint color() const { return m_color; }
+
+  // Bracket the GPU work of a frame at renderSize(). beginFrame() reads the
+  // frames the GPU is done with and adjusts the scale to targetMs.
+  void beginFrame(float targetMs);
+  void endFrame();
+
+  // Of the current frame, between MIN_SCALE and 1 in steps of SCALE_STEP
+  float scale() const { return m_scale; }
+  glm::ivec2 renderSize() const;
+  // GPU time of the last frame read, 0 until one is
+  float lastMs() const { return m_lastMs; }
+
+  static constexpr float MIN_SCALE = 0.5f;
+  static constexpr float SCALE_STEP = 0.05f;
+
+private:
+  struct Frame
+  {
+    GLQueries queries; // Timestamps before and after the frame
+    float scale;
+  };
+
+  void release();
+  void read(float targetMs);
+
+  GLsizei m_width = 0;
+  GLsizei m_height = 0;
+  GLuint m_framebuffer = 0;
+  GLuint m_color = 0;
+  GLuint m_depth = 0;
+  float m_scale = 1;
+  float m_lastMs = 0;
+  std::deque<Frame> m_frames; // Submitted, oldest first
+};
@@ -0,0 +1,320 @@
+#include "egl_context.hpp"
+
+#include "gl_debug_output.hpp"
+
+#ifndef _WIN32
+#define EGL_EGL_PROTOTYPES 0
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <dlfcn.h>
+#endif
+
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#ifndef _WIN32
+
+namespace
+{
+
+// Entry points of libEGL, loaded with the library
+struct Egl
+{
+  PFNEGLGETPROCADDRESSPROC getProcAddress = nullptr;
+  PFNEGLGETERRORPROC getError = nullptr;
+  PFNEGLQUERYSTRINGPROC queryString = nullptr;
+  PFNEGLINITIALIZEPROC initialize = nullptr;
+  PFNEGLTERMINATEPROC terminate = nullptr;
+  PFNEGLBINDAPIPROC bindAPI = nullptr;
+  PFNEGLCHOOSECONFIGPROC chooseConfig = nullptr;
+  PFNEGLCREATECONTEXTPROC createContext = nullptr;
+  PFNEGLDESTROYCONTEXTPROC destroyContext = nullptr;
+  PFNEGLMAKECURRENTPROC makeCurrent = nullptr;
+  PFNEGLGETCURRENTCONTEXTPROC getCurrentContext = nullptr;
+  PFNEGLQUERYDEVICESEXTPROC queryDevices = nullptr;
+  PFNEGLQUERYDEVICESTRINGEXTPROC queryDeviceString = nullptr;
+  PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = nullptr;
+};
+
+// Null if libEGL or one of its core entry points is missing, the extensions
+// may be
+const Egl *loadEgl()
+{
+  static const auto egl = []() -> const Egl * {
+    auto *library = dlopen("libEGL.so.1", RTLD_NOW | RTLD_LOCAL);
+    if (!library) {
+      library = dlopen("libEGL.so", RTLD_NOW | RTLD_LOCAL);
+    }
+    if (!library) {
+      return nullptr;
+    }
+
+    static Egl functions;
+    const auto load = [&](auto &function, const char *name) {
+      using Function = typename std::remove_reference<decltype(function)>::type;
+      function = reinterpret_cast<Function>(dlsym(library, name));
+      return function != nullptr;
+    };
+    if (!load(functions.getProcAddress, "eglGetProcAddress") ||
+        !load(functions.getError, "eglGetError") ||
+        !load(functions.queryString, "eglQueryString") ||
+        !load(functions.initialize, "eglInitialize") ||
+        !load(functions.terminate, "eglTerminate") ||
+        !load(functions.bindAPI, "eglBindAPI") ||
+        !load(functions.chooseConfig, "eglChooseConfig") ||
+        !load(functions.createContext, "eglCreateContext") ||
+        !load(functions.destroyContext, "eglDestroyContext") ||
+        !load(functions.makeCurrent, "eglMakeCurrent") ||
+        !load(functions.getCurrentContext, "eglGetCurrentContext")) {
+      return nullptr;
+    }
+    functions.queryDevices = reinterpret_cast<PFNEGLQUERYDEVICESEXTPROC>(
+        functions.getProcAddress("eglQueryDevicesEXT"));
+    functions.queryDeviceString =
+        reinterpret_cast<PFNEGLQUERYDEVICESTRINGEXTPROC>(
+            functions.getProcAddress("eglQueryDeviceStringEXT"));
+    functions.getPlatformDisplay =
+        reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+            functions.getProcAddress("eglGetPlatformDisplayEXT"));
+    return &functions;
+  }();
+  return egl;
+}
+
+bool hasExtension(const char *extensions, const char *extension)
+{
+  // Extensions are separated by spaces, a name may prefix another one
+  const auto length = std::strlen(extension);
+  for (auto *found = extensions ? std::strstr(extensions, extension) : nullptr;
+       found; found = std::strstr(found + length, extension)) {
+    if ((found == extensions || found[-1] == ' ') &&
+        (found[length] == ' ' || found[length] == '\0')) {
+      return true;
+    }
+  }
+  return false;
+}
+
+std::vector<EGLDeviceEXT> queryDevices(const Egl &egl)
+{
+  EGLint count = 0;
+  if (!egl.queryDevices || !egl.queryDevices(0, nullptr, &count) ||
+      count <= 0) {
+    return {};
+  }
+  std::vector<EGLDeviceEXT> devices(static_cast<size_t>(count));
+  egl.queryDevices(count, devices.data(), &count);
+  devices.resize(size_t(count));
+  return devices;
+}
+
+// Debug contexts in developer mode, else without error checking if display
+// offers it, see setGLDeveloperMode
+std::vector<EGLint> contextAttributes(const Egl &egl, EGLDisplay display)
+{
+  std::vector<EGLint> attributes = {EGL_CONTEXT_MAJOR_VERSION, 4,
+      EGL_CONTEXT_MINOR_VERSION, 4, EGL_CONTEXT_OPENGL_PROFILE_MASK,
+      EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT};
+  if (glDeveloperMode()) {
+    attributes.insert(end(attributes), {EGL_CONTEXT_OPENGL_DEBUG, EGL_TRUE});
+  } else if (hasExtension(egl.queryString(display, EGL_EXTENSIONS),
+                 "EGL_KHR_create_context_no_error")) {
+    attributes.insert(
+        end(attributes), {EGL_CONTEXT_OPENGL_NO_ERROR_KHR, EGL_TRUE});
+  }
+  attributes.push_back(EGL_NONE);
+  return attributes;
+}
+
+} // namespace
+
+EglContext::~EglContext()
+{
+  const auto *egl = loadEgl();
+  if (!egl || !m_display) {
+    return;
+  }
+  egl->makeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  if (m_context) {
+    egl->destroyContext(m_display, m_context);
+  }
+  if (m_ownsDisplay) {
+    egl->terminate(m_display);
+  }
+}
+
+bool EglContext::create(int gpu, std::string &err)
+{
+  const auto *egl = loadEgl();
+  if (!egl) {
+    err = "Unable to load libEGL";
+    return false;
+  }
+  if (!egl->getPlatformDisplay) {
+    err = "EGL_EXT_platform_base is not supported";
+    return false;
+  }
+
+  const auto devices = queryDevices(*egl);
+  if (!devices.empty()) {
+    if (gpu < 0 || size_t(gpu) >= devices.size()) {
+      err = "No EGL device " + std::to_string(gpu) + ", there are " +
+            std::to_string(devices.size());
+      return false;
+    }
+    m_display = egl->getPlatformDisplay(
+        EGL_PLATFORM_DEVICE_EXT, devices[size_t(gpu)], nullptr);
+  } else if (gpu == 0) {
+    m_display = egl->getPlatformDisplay(
+        EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+  } else {
+    err = "EGL devices cannot be enumerated, only GPU 0 is available";
+    return false;
+  }
+
+  EGLint major = 0;
+  EGLint minor = 0;
+  if (m_display == EGL_NO_DISPLAY ||
+      !egl->initialize(m_display, &major, &minor)) {
+    m_display = nullptr;
+    err = "Unable to initialize the EGL display of GPU " + std::to_string(gpu);
+    return false;
+  }
+  m_ownsDisplay = true;
+  if (!hasExtension(egl->queryString(m_display, EGL_EXTENSIONS),
+          "EGL_KHR_surfaceless_context")) {
+    err = "EGL_KHR_surfaceless_context is not supported";
+    return false;
+  }
+
+  // No surface is ever created, the config only has to render OpenGL
+  const EGLint configAttributes[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+      EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_NONE};
+  EGLint configCount = 0;
+  EGLConfig config = nullptr;
+  if (!egl->bindAPI(EGL_OPENGL_API) ||
+      !egl->chooseConfig(
+          m_display, configAttributes, &config, 1, &configCount) ||
+      configCount == 0) {
+    err = "No EGL config renders OpenGL";
+    return false;
+  }
+  m_config = config;
+
+  m_context = egl->createContext(m_display, config, EGL_NO_CONTEXT,
+      contextAttributes(*egl, m_display).data());
+  if (m_context == EGL_NO_CONTEXT) {
+    m_context = nullptr;
+    err = "Unable to create an OpenGL 4.4 core context, EGL error " +
+          std::to_string(egl->getError());
+    return false;
+  }
+  return makeCurrent(m_context);
+}
+
+bool EglContext::create(const EglContext &share, std::string &err)
+{
+  // The display of a device is the same for every context of the process,
+  // terminating it would destroy the contexts of the others
+  const auto *egl = loadEgl();
+  if (!egl || !share.m_context) {
+    err = "No EGL context to share objects with";
+    return false;
+  }
+  m_display = share.m_display;
+  m_config = share.m_config;
+  m_context = egl->createContext(m_display, m_config, share.m_context,
+      contextAttributes(*egl, m_display).data());
+  if (m_context == EGL_NO_CONTEXT) {
+    m_context = nullptr;
+    err = "Unable to create a shared OpenGL 4.4 core context, EGL error " +
+          std::to_string(egl->getError());
+    return false;
+  }
+  return makeCurrent(m_context);
+}
+
+void *EglContext::createShared() const
+{
+  const auto *egl = loadEgl();
+  const auto context = egl->createContext(m_display, m_config, m_context,
+      contextAttributes(*egl, m_display).data());
+  return context == EGL_NO_CONTEXT ? nullptr : context;
+}
+
+void EglContext::destroyShared(void *context) const
+{
+  loadEgl()->destroyContext(m_display, context);
+}
+
+bool EglContext::makeCurrent(void *context) const
+{
+  return loadEgl()->makeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+             context ? context : EGL_NO_CONTEXT) == EGL_TRUE;
+}
+
+void *EglContext::current()
+{
+  const auto *egl = loadEgl();
+  const auto context = egl ? egl->getCurrentContext() : EGL_NO_CONTEXT;
+  return context == EGL_NO_CONTEXT ? nullptr : context;
+}
+
+void *EglContext::getProcAddress(const char *name)
+{
+  const auto *egl = loadEgl();
+  return egl ? reinterpret_cast<void *>(egl->getProcAddress(name)) : nullptr;
+}
+
+std::vector<std::string> EglContext::deviceNames()
+{
+  std::vector<std::string> names;
+  const auto *egl = loadEgl();
+  if (!egl) {
+    return names;
+  }
+  for (const auto device : queryDevices(*egl)) {
+    const char *name = nullptr;
+    if (egl->queryDeviceString) {
+      // Hardware devices have a DRM device file, software ones only their
+      // extensions
+      name = egl->queryDeviceString(device, EGL_DRM_DEVICE_FILE_EXT);
+      if (!name) {
+        name = egl->queryDeviceString(device, EGL_EXTENSIONS);
+      }
+    }
+    names.emplace_back(name ? name : "");
+  }
+  return names;
+}
+
+#else
+
+EglContext::~EglContext() {}
+
+bool EglContext::create(int, std::string &err)
+{
+  err = "EGL contexts are not supported on Windows";
+  return false;
+}
+
+bool EglContext::create(const EglContext &, std::string &err)
+{
+  err = "EGL contexts are not supported on Windows";
+  return false;
+}
+
+void *EglContext::createShared() const { return nullptr; }
+
+void EglContext::destroyShared(void *) const {}
+
+bool EglContext::makeCurrent(void *) const { return false; }
+
+void *EglContext::current() { return nullptr; }
+
+void *EglContext::getProcAddress(const char *) { return nullptr; }
+
+std::vector<std::string> EglContext::deviceNames() { return {}; }
+
+#endif
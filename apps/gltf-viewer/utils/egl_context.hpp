@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// OpenGL 4.4 core context of an EGL display without any window system, for
+// offline rendering on GPU servers. The display is the EGL device of a given
+// index (EGL_EXT_platform_device) or, without device enumeration, the Mesa
+// surfaceless platform. Contexts are made current without surfaces
+// (EGL_KHR_surfaceless_context), everything is rendered to framebuffer
+// objects.
+//
+// libEGL is loaded at run time, so that neither the build nor windowed runs
+// depend on it. Not available on Windows.
+class EglContext
+{
+public:
+  EglContext() = default;
+  // Releases and destroys the context, terminates the display unless it is
+  // that of another context
+  ~EglContext();
+
+  EglContext(const EglContext &) = delete;
+  EglContext &operator=(const EglContext &) = delete;
+
+  // Create the context on the device of index gpu and make it current on the
+  // calling thread
+  bool create(int gpu, std::string &err);
+  // Create the context on the display of share, sharing objects with its
+  // context, and make it current on the calling thread. share must outlive
+  // this context.
+  bool create(const EglContext &share, std::string &err);
+
+  // A context sharing objects with this one, for another thread to make
+  // current with makeCurrent. Null on failure.
+  void *createShared() const;
+  void destroyShared(void *context) const;
+  // Make context current on the calling thread, or release the current one
+  // if null
+  bool makeCurrent(void *context) const;
+  // The context of create(), to make current again
+  void *context() const { return m_context; }
+  // Context current on the calling thread, null if none
+  static void *current();
+
+  // Entry point of a GL function, for glad and extensions
+  static void *getProcAddress(const char *name);
+
+  // Names of the EGL devices, in --gpu order, or their extensions when the
+  // driver exposes no name
+  static std::vector<std::string> deviceNames();
+
+private:
+  void *m_display = nullptr;
+  void *m_config = nullptr;
+  void *m_context = nullptr;
+  bool m_ownsDisplay = false; // Terminated with this context
+};
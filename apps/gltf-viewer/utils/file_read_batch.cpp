@@ -0,0 +1,390 @@
+#include "file_read_batch.hpp"
+
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+// IORING_OP_READ came with this feature, in Linux 5.6
+#if defined(IORING_FEAT_RW_CUR_POS) && defined(__NR_io_uring_setup)
+#define FILE_READ_BATCH_IO_URING
+#endif
+#endif
+#endif
+#endif
+
+namespace
+{
+
+// Reads in flight at once, and the size of each: files are split so that a
+// large one is also read in parallel
+const unsigned QUEUE_DEPTH = 64;
+const size_t READ_CHUNK_SIZE = size_t(1) << 20;
+
+// Part of a file left to read
+struct Chunk
+{
+  size_t read; // Index in the reads of the batch
+  size_t offset;
+  size_t size;
+};
+
+void splitInChunks(size_t read, size_t size, std::vector<Chunk> &chunks)
+{
+  for (size_t offset = 0; offset < size; offset += READ_CHUNK_SIZE) {
+    chunks.push_back(
+        {read, offset, std::min(READ_CHUNK_SIZE, size - offset)});
+  }
+}
+
+#ifndef _WIN32
+
+// Read the chunk with pread, false on error or if the file got shorter
+bool readChunk(int fd, unsigned char *bytes, size_t offset, size_t size)
+{
+  while (size > 0) {
+    const auto count = pread(fd, bytes + offset, size, off_t(offset));
+    if (count < 0 && errno == EINTR) {
+      continue;
+    }
+    if (count <= 0) {
+      return false;
+    }
+    offset += size_t(count);
+    size -= size_t(count);
+  }
+  return true;
+}
+
+#endif
+
+#ifdef FILE_READ_BATCH_IO_URING
+
+// Submission and completion rings of an io_uring, through the raw system
+// calls rather than liburing
+class IoUring
+{
+public:
+  explicit IoUring(unsigned entries)
+  {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    m_fd = int(syscall(__NR_io_uring_setup, entries, &params));
+    if (m_fd < 0) {
+      return;
+    }
+
+    m_sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool singleMapping = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMapping) {
+      m_sqSize = m_cqSize = std::max(m_sqSize, m_cqSize);
+    }
+    m_sq = mmap(nullptr, m_sqSize, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+    m_cq = singleMapping || m_sq == MAP_FAILED
+               ? m_sq
+               : mmap(nullptr, m_cqSize, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+    m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    m_sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+    if (m_sq == MAP_FAILED || m_cq == MAP_FAILED || m_sqes == MAP_FAILED) {
+      release();
+      return;
+    }
+
+    auto *sq = static_cast<unsigned char *>(m_sq);
+    auto *cq = static_cast<unsigned char *>(m_cq);
+    m_sqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    m_sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    m_sqMask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    m_sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    m_cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    m_cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    m_cqMask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    m_cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    m_entries = params.sq_entries;
+  }
+
+  ~IoUring() { release(); }
+
+  IoUring(const IoUring &) = delete;
+  IoUring &operator=(const IoUring &) = delete;
+
+  bool isOpen() const { return m_entries > 0; }
+  unsigned entries() const { return m_entries; }
+
+  // Queue a read for the next submit(), false if the ring is full
+  bool queueRead(int fd, void *data, unsigned size, uint64_t offset,
+      uint64_t userData)
+  {
+    const auto tail = *m_sqTail;
+    if (tail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE) == m_entries) {
+      return false;
+    }
+    const auto index = tail & m_sqMask;
+    auto &sqe = static_cast<io_uring_sqe *>(m_sqes)[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_READ;
+    sqe.fd = fd;
+    sqe.addr = uint64_t(uintptr_t(data));
+    sqe.len = size;
+    sqe.off = offset;
+    sqe.user_data = userData;
+    m_sqArray[index] = index;
+    __atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+    ++m_queued;
+    return true;
+  }
+
+  // Submit the queued reads and wait for waitCount completions, false on
+  // error
+  bool submit(unsigned waitCount)
+  {
+    for (;;) {
+      const auto submitted = syscall(__NR_io_uring_enter, m_fd, m_queued,
+          waitCount, waitCount ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+      if (submitted >= 0) {
+        m_queued -= unsigned(submitted);
+        return true;
+      }
+      if (errno != EINTR) {
+        return false;
+      }
+    }
+  }
+
+  // Call complete(userData, result) for each completed read
+  template <typename F> void reap(F &&complete)
+  {
+    auto head = *m_cqHead;
+    const auto tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+      const auto &cqe = m_cqes[head & m_cqMask];
+      complete(cqe.user_data, cqe.res);
+    }
+    __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+  }
+
+private:
+  void release()
+  {
+    if (m_sqes && m_sqes != MAP_FAILED) {
+      munmap(m_sqes, m_sqesSize);
+    }
+    if (m_cq && m_cq != MAP_FAILED && m_cq != m_sq) {
+      munmap(m_cq, m_cqSize);
+    }
+    if (m_sq && m_sq != MAP_FAILED) {
+      munmap(m_sq, m_sqSize);
+    }
+    if (m_fd >= 0) {
+      close(m_fd);
+    }
+    m_sq = m_cq = m_sqes = nullptr;
+    m_fd = -1;
+    m_entries = 0;
+  }
+
+  int m_fd = -1;
+  void *m_sq = nullptr;
+  void *m_cq = nullptr;
+  void *m_sqes = nullptr;
+  size_t m_sqSize = 0;
+  size_t m_cqSize = 0;
+  size_t m_sqesSize = 0;
+  unsigned *m_sqHead = nullptr;
+  unsigned *m_sqTail = nullptr;
+  unsigned m_sqMask = 0;
+  unsigned *m_sqArray = nullptr;
+  unsigned *m_cqHead = nullptr;
+  unsigned *m_cqTail = nullptr;
+  unsigned m_cqMask = 0;
+  io_uring_cqe *m_cqes = nullptr;
+  unsigned m_entries = 0;
+  unsigned m_queued = 0; // Not submitted yet
+};
+
+#endif
+
+} // namespace
+
+void FileReadBatch::add(const fs::path &path, std::vector<unsigned char> &bytes)
+{
+  m_reads.push_back({path, &bytes});
+}
+
+#ifdef _WIN32
+
+bool FileReadBatch::run()
+{
+  TRACE_ZONE("FileReadBatch::run");
+  std::vector<HANDLE> files(m_reads.size(), INVALID_HANDLE_VALUE);
+  std::vector<Chunk> chunks;
+  for (auto i = m_run; i < m_reads.size(); ++i) {
+    auto &read = m_reads[i];
+    files[i] = CreateFileW(read.path.wstring().c_str(), GENERIC_READ,
+        FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_FLAG_OVERLAPPED | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    LARGE_INTEGER size;
+    if (files[i] == INVALID_HANDLE_VALUE || !GetFileSizeEx(files[i], &size)) {
+      read.failed = true;
+      continue;
+    }
+    read.bytes->resize(size_t(size.QuadPart));
+    splitInChunks(i, read.bytes->size(), chunks);
+  }
+
+  // Waves of QUEUE_DEPTH overlapped reads, each waited for with its event
+  std::vector<OVERLAPPED> overlapped(QUEUE_DEPTH);
+  std::vector<char> issued(QUEUE_DEPTH);
+  for (auto &o : overlapped) {
+    o.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+  }
+  for (size_t first = 0; first < chunks.size(); first += QUEUE_DEPTH) {
+    const auto count = std::min<size_t>(QUEUE_DEPTH, chunks.size() - first);
+    for (size_t j = 0; j < count; ++j) {
+      const auto &chunk = chunks[first + j];
+      auto &o = overlapped[j];
+      auto &read = m_reads[chunk.read];
+      ResetEvent(o.hEvent);
+      o.Internal = o.InternalHigh = 0;
+      o.Offset = DWORD(uint64_t(chunk.offset));
+      o.OffsetHigh = DWORD(uint64_t(chunk.offset) >> 32);
+      issued[j] = !read.failed &&
+                  (ReadFile(files[chunk.read], read.bytes->data() + chunk.offset,
+                       DWORD(chunk.size), nullptr, &o) ||
+                      GetLastError() == ERROR_IO_PENDING);
+      read.failed = read.failed || !issued[j];
+    }
+    for (size_t j = 0; j < count; ++j) {
+      const auto &chunk = chunks[first + j];
+      DWORD size = 0;
+      if (issued[j] && (!GetOverlappedResult(files[chunk.read],
+                            &overlapped[j], &size, TRUE) ||
+                           size != chunk.size)) {
+        m_reads[chunk.read].failed = true;
+      }
+    }
+  }
+  for (auto &o : overlapped) {
+    CloseHandle(o.hEvent);
+  }
+
+  bool ret = true;
+  for (auto i = m_run; i < m_reads.size(); ++i) {
+    if (files[i] != INVALID_HANDLE_VALUE) {
+      CloseHandle(files[i]);
+    }
+    if (m_reads[i].failed) {
+      m_reads[i].bytes->clear();
+      ret = false;
+    }
+  }
+  m_run = m_reads.size();
+  return ret;
+}
+
+#else
+
+bool FileReadBatch::run()
+{
+  TRACE_ZONE("FileReadBatch::run");
+  std::vector<int> files(m_reads.size(), -1);
+  std::vector<Chunk> chunks;
+  for (auto i = m_run; i < m_reads.size(); ++i) {
+    auto &read = m_reads[i];
+    files[i] = open(read.path.c_str(), O_RDONLY);
+    struct stat st;
+    if (files[i] < 0 || fstat(files[i], &st) != 0) {
+      read.failed = true;
+      continue;
+    }
+    read.bytes->resize(size_t(st.st_size));
+    splitInChunks(i, read.bytes->size(), chunks);
+  }
+
+  // Chunks from next on are left to read, short reads queue their remainder
+  size_t next = 0;
+#ifdef FILE_READ_BATCH_IO_URING
+  IoUring ring(QUEUE_DEPTH);
+  size_t inFlight = 0;
+  while (ring.isOpen() && (next < chunks.size() || inFlight > 0)) {
+    while (next < chunks.size() && inFlight < ring.entries()) {
+      const auto &chunk = chunks[next];
+      auto &read = m_reads[chunk.read];
+      if (read.failed) {
+        ++next;
+        continue;
+      }
+      if (!ring.queueRead(files[chunk.read], read.bytes->data() + chunk.offset,
+              unsigned(chunk.size), chunk.offset, next)) {
+        break;
+      }
+      ++next;
+      ++inFlight;
+    }
+    if (!ring.submit(inFlight > 0 ? 1 : 0)) {
+      // Every chunk is read again below, the same bytes as any in flight
+      next = 0;
+      break;
+    }
+    ring.reap([&](uint64_t index, int32_t result) {
+      --inFlight;
+      const auto chunk = chunks[size_t(index)];
+      auto &read = m_reads[chunk.read];
+      if (result == -EINTR || result == -EAGAIN) {
+        chunks.push_back(chunk);
+      } else if (result < 0) {
+        // IORING_OP_READ is unknown to kernels older than 5.6
+        read.failed = read.failed ||
+                      !readChunk(files[chunk.read], read.bytes->data(),
+                          chunk.offset, chunk.size);
+      } else if (result == 0) {
+        read.failed = true; // The file got shorter
+      } else if (size_t(result) < chunk.size) {
+        chunks.push_back({chunk.read, chunk.offset + size_t(result),
+            chunk.size - size_t(result)});
+      }
+    });
+  }
+#endif
+  for (; next < chunks.size(); ++next) {
+    const auto &chunk = chunks[next];
+    auto &read = m_reads[chunk.read];
+    read.failed = read.failed ||
+                  !readChunk(files[chunk.read], read.bytes->data(),
+                      chunk.offset, chunk.size);
+  }
+
+  bool ret = true;
+  for (auto i = m_run; i < m_reads.size(); ++i) {
+    if (files[i] >= 0) {
+      close(files[i]);
+    }
+    if (m_reads[i].failed) {
+      m_reads[i].bytes->clear();
+      ret = false;
+    }
+  }
+  m_run = m_reads.size();
+  return ret;
+}
+
+#endif
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "filesystem.hpp"
+
+#include <cstddef>
+#include <vector>
+
+// Whole files read together, every read issued before waiting for any: on
+// Linux the reads are queued on an io_uring, up to QUEUE_DEPTH chunks in
+// flight, on Windows they are overlapped. Each completes straight into the
+// bytes given to add(), so network storage and NVMe arrays serve the files in
+// parallel instead of one small synchronous read at a time. Files are read in
+// turn where neither is available, as when io_uring is disabled.
+class FileReadBatch
+{
+public:
+  // Read the whole file at path into bytes, which must outlive run()
+  void add(const fs::path &path, std::vector<unsigned char> &bytes);
+
+  // Issue the reads added since the last call and wait for them. False if a
+  // file could not be read, see failed().
+  bool run();
+
+  size_t size() const { return m_reads.size(); }
+  // Of the index-th read added, its bytes are then left empty
+  bool failed(size_t index) const { return m_reads[index].failed; }
+
+private:
+  struct Read
+  {
+    fs::path path;
+    std::vector<unsigned char> *bytes;
+    bool failed = false;
+  };
+
+  std::vector<Read> m_reads;
+  size_t m_run = 0; // Reads issued by previous calls to run()
+};
@@ -0,0 +1,79 @@
+#include "file_watcher.hpp"
+
+namespace
+{
+
+// A few file times per check, frequent enough that a saved file shows before
+// the next glance at the window
+const auto POLL_INTERVAL = std::chrono::milliseconds(250);
+
+} // namespace
+
+void FileWatcher::watchDirectory(const fs::path &directory)
+{
+  m_directories.push_back(directory);
+  std::error_code error;
+  for (fs::directory_iterator it(directory, error), end; !error && it != end;
+       it.increment(error)) {
+    watchFile(directory / it->path().filename());
+  }
+}
+
+void FileWatcher::watchFile(const fs::path &path)
+{
+  auto &file = m_files[path];
+  std::error_code error;
+  file.writeTime = fs::last_write_time(path, error);
+  file.exists = !error;
+  file.changed = false;
+}
+
+std::vector<fs::path> FileWatcher::poll()
+{
+  std::vector<fs::path> ready;
+  const auto now = Clock::now();
+  if (m_files.empty() || now - m_lastPoll < POLL_INTERVAL) {
+    return ready;
+  }
+  m_lastPoll = now;
+  scan(ready);
+  return ready;
+}
+
+void FileWatcher::check(
+    const fs::path &path, WatchedFile &file, std::vector<fs::path> &ready)
+{
+  // Editors replace files as they save them, a file missing for a moment
+  // keeps its time and is reported once written again
+  std::error_code error;
+  const auto writeTime = fs::last_write_time(path, error);
+  if (error) {
+    return;
+  }
+  if (!file.exists || writeTime != file.writeTime) {
+    file.writeTime = writeTime;
+    file.exists = true;
+    file.changed = true;
+  } else if (file.changed) {
+    file.changed = false;
+    ready.push_back(path);
+  }
+}
+
+void FileWatcher::scan(std::vector<fs::path> &ready)
+{
+  // Files created in the directories are watched from their first check
+  for (const auto &directory : m_directories) {
+    std::error_code error;
+    for (fs::directory_iterator it(directory, error), end;
+         !error && it != end; it.increment(error)) {
+      const auto path = directory / it->path().filename();
+      if (!m_files.count(path)) {
+        m_files[path].changed = true;
+      }
+    }
+  }
+  for (auto &file : m_files) {
+    check(file.first, file.second, ready);
+  }
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "filesystem.hpp"
+
+#include <chrono>
+#include <map>
+#include <vector>
+
+// Modification times of files, polled by the window loop so that shaders and
+// scenes are rebuilt when they are edited, without restarting the viewer
+class FileWatcher
+{
+public:
+  // Watch the files of directory, in their current versions. Their paths are
+  // directory / file name.
+  void watchDirectory(const fs::path &directory);
+  // Watch a file in its current version, from when it exists if it does not
+  void watchFile(const fs::path &path);
+
+  // Files written or created since they were last reported, empty if none was
+  // or if the last check is too recent. A file is reported once its
+  // modification time has not changed for a check, so that files being
+  // written are not read half way.
+  std::vector<fs::path> poll();
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct WatchedFile
+  {
+    fs::file_time_type writeTime;
+    bool exists = false;
+    bool changed = false; // Not reported yet
+  };
+
+  // Check a file, add it to ready if its change is to be reported
+  void check(const fs::path &path, WatchedFile &file,
+      std::vector<fs::path> &ready);
+  // Check the files of the directories and the watched ones
+  void scan(std::vector<fs::path> &ready);
+
+  std::vector<fs::path> m_directories;
+  std::map<fs::path, WatchedFile> m_files;
+  Clock::time_point m_lastPoll = Clock::now();
+};
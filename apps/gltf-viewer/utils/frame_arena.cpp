@@ -0,0 +1,61 @@
+#include "frame_arena.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+FrameArena::FrameArena(size_t initialSize)
+{
+  Block block;
+  block.size = std::max<size_t>(initialSize, 1);
+  block.data.reset(new unsigned char[block.size]);
+  m_blocks.emplace_back(std::move(block));
+}
+
+FrameArena::~FrameArena() = default;
+
+void *FrameArena::allocate(size_t size, size_t alignment)
+{
+  const auto align = [&](const Block &block) {
+    const auto address = reinterpret_cast<uintptr_t>(block.data.get());
+    return ((address + m_offset + alignment - 1) & ~(alignment - 1)) - address;
+  };
+
+  auto offset = align(m_blocks.back());
+  if (offset + size > m_blocks.back().size) {
+    // A block of twice the last one at least, the next frame has one block
+    // covering this whole frame
+    Block block;
+    block.size = std::max(2 * m_blocks.back().size, size + alignment);
+    block.data.reset(new unsigned char[block.size]);
+    m_blocks.emplace_back(std::move(block));
+    m_offset = 0;
+    offset = align(m_blocks.back());
+  }
+
+  m_used += offset - m_offset + size;
+  m_offset = offset + size;
+  return m_blocks.back().data.get() + offset;
+}
+
+void FrameArena::reset()
+{
+  if (m_blocks.size() > 1) {
+    const auto size = capacity();
+    m_blocks.clear();
+    Block block;
+    block.size = size;
+    block.data.reset(new unsigned char[size]);
+    m_blocks.emplace_back(std::move(block));
+  }
+  m_offset = 0;
+  m_used = 0;
+}
+
+size_t FrameArena::capacity() const
+{
+  size_t size = 0;
+  for (const auto &block : m_blocks) {
+    size += block.size;
+  }
+  return size;
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Linear allocator of the data living for one frame, reset as it begins.
+// Allocations bump a pointer in the current block; a frame outgrowing it
+// chains more blocks, which reset() replaces by one block of their total
+// size, so that frames of a steady size allocate nothing from the heap.
+// Nothing is freed before reset(), which does not run destructors.
+// Single-threaded.
+class FrameArena
+{
+public:
+  explicit FrameArena(size_t initialSize = 64 * 1024);
+  ~FrameArena();
+
+  FrameArena(const FrameArena &) = delete;
+  FrameArena &operator=(const FrameArena &) = delete;
+
+  void *allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+  template <typename T, typename... Args> T *make(Args &&... args)
+  {
+    return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+  }
+
+  // Invalidate every allocation
+  void reset();
+
+  // Of the frame since reset(), and of the blocks
+  size_t usedBytes() const { return m_used; }
+  size_t capacity() const;
+
+private:
+  struct Block
+  {
+    std::unique_ptr<unsigned char[]> data;
+    size_t size = 0;
+  };
+
+  std::vector<Block> m_blocks; // Current one last
+  size_t m_offset = 0; // In the current block
+  size_t m_used = 0;
+};
+
+// Standard allocator of a FrameArena, deallocation is a no-op
+template <typename T> class FrameAllocator
+{
+public:
+  using value_type = T;
+
+  FrameAllocator(FrameArena &arena) : m_arena(&arena) {}
+  template <typename U>
+  FrameAllocator(const FrameAllocator<U> &other) : m_arena(other.arena())
+  {
+  }
+
+  T *allocate(size_t count)
+  {
+    return static_cast<T *>(m_arena->allocate(count * sizeof(T), alignof(T)));
+  }
+  void deallocate(T *, size_t) {}
+
+  FrameArena *arena() const { return m_arena; }
+
+  template <typename U> bool operator==(const FrameAllocator<U> &other) const
+  {
+    return m_arena == other.arena();
+  }
+  template <typename U> bool operator!=(const FrameAllocator<U> &other) const
+  {
+    return m_arena != other.arena();
+  }
+
+private:
+  FrameArena *m_arena;
+};
+
+// Must not outlive the frame of its arena
+template <typename T> using FrameVector = std::vector<T, FrameAllocator<T>>;
+
+// Callable stored in a FrameArena, for callbacks run within the frame. The
+// callable is not destroyed, it must be trivially destructible, as lambdas
+// capturing references and values of trivial types are.
+template <typename Signature> class FrameFunction;
+
+template <typename R, typename... Args> class FrameFunction<R(Args...)>
+{
+public:
+  FrameFunction() = default;
+
+  template <typename F> FrameFunction(FrameArena &arena, F &&function)
+  {
+    using Callable = typename std::decay<F>::type;
+    static_assert(std::is_trivially_destructible<Callable>::value,
+        "FrameFunction callables are never destroyed");
+    m_callable = arena.make<Callable>(std::forward<F>(function));
+    m_invoke = [](void *callable, Args... args) -> R {
+      return (*static_cast<Callable *>(callable))(std::forward<Args>(args)...);
+    };
+  }
+
+  explicit operator bool() const { return m_callable != nullptr; }
+
+  R operator()(Args... args) const
+  {
+    return m_invoke(m_callable, std::forward<Args>(args)...);
+  }
+
+private:
+  void *m_callable = nullptr;
+  R (*m_invoke)(void *, Args...) = nullptr;
+};
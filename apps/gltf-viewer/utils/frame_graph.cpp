@@ -0,0 +1,258 @@
+#include "frame_graph.hpp"
+#include "gpu_memory.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+namespace
+{
+
+// Executions a pooled texture survives unused, several graphs may run per
+// window frame
+const size_t MAX_IDLE_EXECUTIONS = 16;
+
+bool operator==(const FrameGraph::TextureDesc &a, const FrameGraph::TextureDesc &b)
+{
+  return a.format == b.format && a.width == b.width && a.height == b.height;
+}
+
+// Barrier before an access to what image stores wrote
+GLbitfield barrierBefore(FrameGraph::Access access)
+{
+  switch (access) {
+  case FrameGraph::Access::Sampled:
+    return GL_TEXTURE_FETCH_BARRIER_BIT;
+  case FrameGraph::Access::Image:
+    return GL_SHADER_IMAGE_ACCESS_BARRIER_BIT;
+  case FrameGraph::Access::Attachment:
+    return GL_FRAMEBUFFER_BARRIER_BIT;
+  }
+  return 0;
+}
+
+} // namespace
+
+FrameGraph::Resource FrameGraph::PassBuilder::create(
+    const TextureDesc &desc, Access access)
+{
+  ResourceEntry entry;
+  entry.desc = desc;
+  entry.transient = true;
+  m_graph.m_resources.emplace_back(entry);
+  const auto resource = m_graph.m_resources.size() - 1;
+  write(resource, access);
+  return resource;
+}
+
+void FrameGraph::PassBuilder::read(Resource resource, Access access)
+{
+  assert(resource < m_graph.m_resources.size());
+  m_graph.m_uses.push_back({resource, access, false});
+}
+
+void FrameGraph::PassBuilder::write(Resource resource, Access access)
+{
+  assert(resource < m_graph.m_resources.size());
+  m_graph.m_uses.push_back({resource, access, true});
+}
+
+void FrameGraph::PassBuilder::sideEffect()
+{
+  m_graph.m_passes[m_pass].sideEffect = true;
+}
+
+FrameGraph::~FrameGraph()
+{
+  for (const auto &pooled : m_pool) {
+    untrackTextures(1, &pooled.texture);
+    glDeleteTextures(1, &pooled.texture);
+  }
+}
+
+void FrameGraph::reset(FrameArena &arena)
+{
+  m_arena = &arena;
+  for (const auto &resource : m_resources) {
+    if (resource.transient && resource.texture) {
+      releaseTexture(resource.texture);
+    }
+  }
+  m_passes.clear();
+  m_uses.clear();
+  m_resources.clear();
+
+  const auto idle = std::remove_if(
+      m_pool.begin(), m_pool.end(), [](const PooledTexture &pooled) {
+        if (pooled.idleExecutions <= MAX_IDLE_EXECUTIONS) {
+          return false;
+        }
+        untrackTextures(1, &pooled.texture);
+        glDeleteTextures(1, &pooled.texture);
+        return true;
+      });
+  m_pool.erase(idle, m_pool.end());
+}
+
+FrameGraph::Resource FrameGraph::import(GLuint texture)
+{
+  ResourceEntry entry;
+  entry.texture = texture;
+  m_resources.emplace_back(entry);
+  return m_resources.size() - 1;
+}
+
+void FrameGraph::markOutput(Resource resource)
+{
+  assert(resource < m_resources.size());
+  m_resources[resource].output = true;
+}
+
+void FrameGraph::execute()
+{
+  // Back from the outputs, a pass is needed if it writes what a later
+  // needed pass reads, attachments keep their earlier writers
+  m_needed.assign(m_resources.size(), false);
+  for (size_t i = 0; i < m_resources.size(); ++i) {
+    m_needed[i] = m_resources[i].output;
+  }
+  m_kept.assign(m_passes.size(), false);
+  for (size_t p = m_passes.size(); p-- > 0;) {
+    const auto &pass = m_passes[p];
+    const auto first = m_uses.begin() + pass.firstUse;
+    const auto end = m_uses.begin() + pass.endUse;
+    m_kept[p] = pass.sideEffect || std::any_of(first, end, [&](const Use &use) {
+      return use.write && m_needed[use.resource];
+    });
+    if (!m_kept[p]) {
+      continue;
+    }
+    for (auto use = first; use != end; ++use) {
+      m_needed[use->resource] = true;
+    }
+  }
+
+  // Last kept pass using each transient, the outputs outlive them all
+  m_lastUse.assign(m_resources.size(), 0);
+  for (size_t p = 0; p < m_passes.size(); ++p) {
+    if (m_kept[p]) {
+      for (size_t u = m_passes[p].firstUse; u < m_passes[p].endUse; ++u) {
+        m_lastUse[m_uses[u].resource] = p;
+      }
+    }
+  }
+
+  m_executedPassCount = 0;
+  for (size_t p = 0; p < m_passes.size(); ++p) {
+    if (!m_kept[p]) {
+      continue;
+    }
+    const auto &pass = m_passes[p];
+
+    GLbitfield barriers = 0;
+    for (size_t u = pass.firstUse; u < pass.endUse; ++u) {
+      const auto &use = m_uses[u];
+      auto &resource = m_resources[use.resource];
+      if (resource.transient && !resource.texture) {
+        resource.texture = acquire(resource.desc);
+      }
+      if (resource.pendingImageWrite) {
+        barriers |= barrierBefore(use.access) & ~resource.visibleTo;
+      }
+    }
+    if (barriers) {
+      // Of every store issued so far, for the accesses it names only
+      glMemoryBarrier(barriers);
+      for (auto &resource : m_resources) {
+        resource.visibleTo |= barriers;
+      }
+    }
+    for (size_t u = pass.firstUse; u < pass.endUse; ++u) {
+      const auto &use = m_uses[u];
+      if (use.write && use.access == Access::Image) {
+        m_resources[use.resource].pendingImageWrite = true;
+        m_resources[use.resource].visibleTo = 0;
+      }
+    }
+
+    glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, pass.name);
+    pass.execute();
+    glPopDebugGroup();
+    ++m_executedPassCount;
+
+    for (size_t u = pass.firstUse; u < pass.endUse; ++u) {
+      auto &resource = m_resources[m_uses[u].resource];
+      if (resource.transient && !resource.output &&
+          m_lastUse[m_uses[u].resource] == p && resource.texture) {
+        releaseTexture(resource.texture);
+        resource.texture = 0;
+      }
+    }
+  }
+
+  // Later accesses are not declared
+  const GLbitfield outputBarriers = GL_TEXTURE_FETCH_BARRIER_BIT |
+                                   GL_SHADER_IMAGE_ACCESS_BARRIER_BIT |
+                                   GL_FRAMEBUFFER_BARRIER_BIT |
+                                   GL_TEXTURE_UPDATE_BARRIER_BIT;
+  const bool pendingOutput = std::any_of(m_resources.begin(),
+      m_resources.end(), [&](const ResourceEntry &resource) {
+        return resource.output && resource.pendingImageWrite &&
+               (outputBarriers & ~resource.visibleTo);
+      });
+  if (pendingOutput) {
+    glMemoryBarrier(outputBarriers);
+  }
+  for (auto &resource : m_resources) {
+    resource.pendingImageWrite = false;
+  }
+
+  for (auto &pooled : m_pool) {
+    pooled.idleExecutions = pooled.inUse ? 0 : pooled.idleExecutions + 1;
+  }
+}
+
+GLuint FrameGraph::texture(Resource resource) const
+{
+  assert(resource < m_resources.size());
+  return m_resources[resource].texture;
+}
+
+GLuint FrameGraph::acquire(const TextureDesc &desc)
+{
+  for (auto &pooled : m_pool) {
+    if (!pooled.inUse && pooled.desc == desc) {
+      pooled.inUse = true;
+      pooled.idleExecutions = 0;
+      return pooled.texture;
+    }
+  }
+
+  GLint previousTexture = 0;
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTexture);
+
+  PooledTexture pooled;
+  pooled.desc = desc;
+  pooled.inUse = true;
+  glGenTextures(1, &pooled.texture);
+  glBindTexture(GL_TEXTURE_2D, pooled.texture);
+  glTexStorage2D(GL_TEXTURE_2D, 1, desc.format, desc.width, desc.height);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  trackTexture(GpuMemoryCategory::RenderTargets, GL_TEXTURE_2D, pooled.texture);
+  glBindTexture(GL_TEXTURE_2D, GLuint(previousTexture));
+
+  m_pool.emplace_back(pooled);
+  return pooled.texture;
+}
+
+void FrameGraph::releaseTexture(GLuint texture)
+{
+  for (auto &pooled : m_pool) {
+    if (pooled.texture == texture) {
+      pooled.inUse = false;
+      return;
+    }
+  }
+}
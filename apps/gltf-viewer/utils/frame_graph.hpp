@@ -0,0 +1,160 @@
+#pragma once
+
+#include "frame_arena.hpp"
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <vector>
+
+// Passes of a frame declared with the textures they read and write, then
+// culled and run in declaration order. A pass is kept if it has side effects
+// or writes a resource that is an output of the graph or read by a kept pass.
+//
+// Resources are imported textures, owned by the caller, or transient 2D
+// textures described by their format and size. Transients are taken from a
+// pool when their first kept pass runs and given back after their last one,
+// so that transients of the same description whose passes do not overlap
+// alias the same texture. Textures of the pool unused by the last few
+// executions are deleted. Outputs stay allocated until the next reset().
+//
+// Before each pass, the barriers needed by its accesses to resources last
+// written with image stores are issued, framebuffer writes need none. Passes
+// run in a debug group of their name, for captures.
+//
+// The execute functions are kept in the FrameArena given to reset(), the
+// other lists keep their capacity: a graph of a steady shape allocates
+// nothing from the heap.
+class FrameGraph
+{
+public:
+  using Resource = size_t;
+
+  enum class Access
+  {
+    Sampled,
+    Image, // Load and store
+    Attachment
+  };
+
+  struct TextureDesc
+  {
+    GLenum format = GL_NONE;
+    GLsizei width = 0;
+    GLsizei height = 0;
+  };
+
+  // Declares the accesses of a pass, from its setup
+  class PassBuilder
+  {
+  public:
+    // Transient texture, first written by this pass
+    Resource create(const TextureDesc &desc, Access access = Access::Image);
+    void read(Resource resource, Access access = Access::Sampled);
+    void write(Resource resource, Access access = Access::Image);
+    // The pass is kept whatever it writes
+    void sideEffect();
+
+  private:
+    friend class FrameGraph;
+    PassBuilder(FrameGraph &graph, size_t pass) : m_graph(graph), m_pass(pass)
+    {
+    }
+
+    FrameGraph &m_graph;
+    size_t m_pass;
+  };
+
+  FrameGraph() = default;
+  ~FrameGraph();
+
+  FrameGraph(const FrameGraph &) = delete;
+  FrameGraph &operator=(const FrameGraph &) = delete;
+
+  // Remove the passes and resources, give the outputs back to the pool and
+  // delete the textures it kept idle too long. The next passes keep their
+  // execute functions in arena, which must outlive execute().
+  void reset(FrameArena &arena);
+
+  Resource import(GLuint texture);
+  // Kept alive and its writers run, readable with texture() after execute()
+  void markOutput(Resource resource);
+
+  // setup(PassBuilder &) is called at once, execute() when the pass runs.
+  // name must outlive the graph. Passes are not added from a setup.
+  template <typename Setup, typename Execute>
+  void addPass(const char *name, Setup &&setup, Execute &&execute)
+  {
+    Pass pass;
+    pass.name = name;
+    pass.execute = FrameFunction<void()>(*m_arena, std::forward<Execute>(execute));
+    pass.firstUse = m_uses.size();
+    m_passes.emplace_back(pass);
+    PassBuilder builder(*this, m_passes.size() - 1);
+    setup(builder);
+    m_passes.back().endUse = m_uses.size();
+  }
+
+  // Cull the passes, then run the others. The outputs written with image
+  // stores are made visible to any later access.
+  void execute();
+
+  // Texture of a resource, within the execute function of a pass using it
+  // or for outputs after execute()
+  GLuint texture(Resource resource) const;
+
+  // Passes run by the last execute(), and textures in the pool
+  size_t executedPassCount() const { return m_executedPassCount; }
+  size_t pooledTextureCount() const { return m_pool.size(); }
+
+private:
+  struct Use
+  {
+    Resource resource;
+    Access access;
+    bool write;
+  };
+
+  struct Pass
+  {
+    const char *name = nullptr;
+    FrameFunction<void()> execute;
+    size_t firstUse = 0; // Range of m_uses
+    size_t endUse = 0;
+    bool sideEffect = false;
+  };
+
+  struct ResourceEntry
+  {
+    TextureDesc desc;
+    GLuint texture = 0; // Imported, or taken from the pool while alive
+    bool transient = false;
+    bool output = false;
+    // Image stores since the last write, made visible to the accesses of
+    // the barriers since
+    bool pendingImageWrite = false;
+    GLbitfield visibleTo = 0;
+  };
+
+  struct PooledTexture
+  {
+    TextureDesc desc;
+    GLuint texture = 0;
+    bool inUse = false;
+    size_t idleExecutions = 0;
+  };
+
+  GLuint acquire(const TextureDesc &desc);
+  void releaseTexture(GLuint texture);
+
+  FrameArena *m_arena = nullptr;
+  std::vector<Pass> m_passes;
+  std::vector<Use> m_uses;
+  std::vector<ResourceEntry> m_resources;
+  std::vector<PooledTexture> m_pool;
+  // Of execute()
+  std::vector<bool> m_needed;
+  std::vector<bool> m_kept;
+  std::vector<size_t> m_lastUse;
+  size_t m_executedPassCount = 0;
+};
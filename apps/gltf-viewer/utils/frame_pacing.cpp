@@ -0,0 +1,57 @@
+#include "frame_pacing.hpp"
+
+#include <algorithm>
+#include <thread>
+
+namespace
+{
+
+// Sleeps may end this late, the end of a frame period is waited for by
+// spinning instead
+const auto SLEEP_SLACK = std::chrono::microseconds(1500);
+
+} // namespace
+
+FramePacer::~FramePacer()
+{
+  for (const auto fence : m_fences) {
+    glDeleteSync(fence);
+  }
+}
+
+void FramePacer::beginFrame()
+{
+  while (m_pacing.maxFramesInFlight > 0 &&
+         m_fences.size() >= m_pacing.maxFramesInFlight) {
+    glClientWaitSync(
+        m_fences.front(), GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(1e9));
+    glDeleteSync(m_fences.front());
+    m_fences.pop_front();
+  }
+
+  const auto now = Clock::now();
+  if (m_pacing.maxFps > 0 && m_started) {
+    const auto period = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(1. / m_pacing.maxFps));
+    const auto next = m_lastFrame + period;
+    if (next > now + SLEEP_SLACK) {
+      std::this_thread::sleep_until(next - SLEEP_SLACK);
+    }
+    while (Clock::now() < next) {
+      std::this_thread::yield();
+    }
+    // A late frame shifts the next ones instead of being followed by a
+    // shorter one
+    m_lastFrame = std::max(next, now);
+  } else {
+    m_lastFrame = now;
+  }
+  m_started = true;
+}
+
+void FramePacer::endFrame()
+{
+  if (m_pacing.maxFramesInFlight > 0) {
+    m_fences.push_back(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+  }
+}
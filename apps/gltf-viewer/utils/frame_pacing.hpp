@@ -0,0 +1,55 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+
+enum class VSyncMode
+{
+  Off,
+  On,
+  // Synchronized unless a frame is late, which tears instead of waiting for
+  // the next refresh, see *_EXT_swap_control_tear
+  Adaptive
+};
+
+struct FramePacing
+{
+  VSyncMode vsync = VSyncMode::Off;
+  float maxFps = 0; // No limit if 0
+  size_t maxFramesInFlight = 0; // Left to the driver if 0
+  // GPU time per frame dynamic resolution holds the scene to, off if 0
+  float targetFrameMs = 0;
+  // Render on a thread of its own while the main thread processes the
+  // window events, see GLFWHandle::runThreaded
+  bool renderThread = true;
+};
+
+// Paces the frames of the window loop: beginFrame() blocks until the previous
+// frames are no more than maxFramesInFlight ahead of the GPU, so that input
+// is not sampled long before its frame is shown, then until the frame period
+// of maxFps since the previous frame. endFrame() is called after each swap.
+class FramePacer
+{
+public:
+  FramePacer() = default;
+  ~FramePacer();
+
+  FramePacer(const FramePacer &) = delete;
+  FramePacer &operator=(const FramePacer &) = delete;
+
+  void init(const FramePacing &pacing) { m_pacing = pacing; }
+
+  void beginFrame();
+  void endFrame();
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  FramePacing m_pacing;
+  std::deque<GLsync> m_fences; // Of the frames in flight, oldest first
+  Clock::time_point m_lastFrame;
+  bool m_started = false;
+};
@@ -0,0 +1,147 @@
+#include "frame_ring.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <new>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+
+size_t alignUp(size_t size, size_t alignment)
+{
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+// Of the slots and pixels, for SIMD copies and encoders of the consumer
+const size_t FRAME_RING_ALIGNMENT = 64;
+
+} // namespace
+
+FrameRing::~FrameRing()
+{
+#ifndef _WIN32
+  if (m_memory) {
+    munmap(m_memory, m_size);
+    shm_unlink(m_name.c_str());
+  }
+#endif
+}
+
+bool FrameRing::open(const std::string &name, size_t slotCount,
+    size_t slotSize, std::string &err)
+{
+#ifdef _WIN32
+  err = "POSIX shared memory is not supported on this platform";
+  return false;
+#else
+  if (name.size() < 2 || name[0] != '/' ||
+      name.find('/', 1) != std::string::npos) {
+    err = "Shared memory names are a / followed by a file name, got " + name;
+    return false;
+  }
+  if (slotCount == 0 || slotSize == 0) {
+    err = "A frame ring needs slots of at least a byte";
+    return false;
+  }
+
+  const auto firstSlotOffset =
+      alignUp(sizeof(FrameRingHeader), FRAME_RING_ALIGNMENT);
+  const auto pixelsOffset =
+      alignUp(sizeof(FrameRingSlot), FRAME_RING_ALIGNMENT);
+  const auto slotStride = pixelsOffset + alignUp(slotSize, FRAME_RING_ALIGNMENT);
+  const auto size = firstSlotOffset + slotCount * slotStride;
+
+  // A consumer mapping a previous ring keeps it until it unmaps it
+  shm_unlink(name.c_str());
+  const auto fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0) {
+    err = "Unable to create " + name + ": " + std::strerror(errno);
+    return false;
+  }
+  if (ftruncate(fd, off_t(size)) < 0) {
+    err = "Unable to size " + name + ": " + std::strerror(errno);
+    close(fd);
+    shm_unlink(name.c_str());
+    return false;
+  }
+  auto *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (memory == MAP_FAILED) {
+    err = "Unable to map " + name + ": " + std::strerror(errno);
+    shm_unlink(name.c_str());
+    return false;
+  }
+
+  m_name = name;
+  m_memory = memory;
+  m_size = size;
+  m_frame = 0;
+
+  // Slots are zeroed by ftruncate, their sequence of 0 tells they are empty
+  auto *bytes = static_cast<unsigned char *>(memory);
+  for (size_t i = 0; i < slotCount; ++i) {
+    new (bytes + firstSlotOffset + i * slotStride) FrameRingSlot();
+  }
+  m_header = new (memory) FrameRingHeader();
+  m_header->version = FRAME_RING_VERSION;
+  m_header->slotCount = uint32_t(slotCount);
+  m_header->slotSize = slotSize;
+  m_header->firstSlotOffset = firstSlotOffset;
+  m_header->slotStride = slotStride;
+  m_header->pixelsOffset = pixelsOffset;
+  // The magic comes last, a consumer seeing it sees the layout
+  std::atomic_thread_fence(std::memory_order_release);
+  std::memcpy(m_header->magic, FRAME_RING_MAGIC, sizeof(m_header->magic));
+  return true;
+#endif
+}
+
+FrameRingSlot &FrameRing::slot(uint64_t frame) const
+{
+  auto *bytes = static_cast<unsigned char *>(m_memory);
+  return *reinterpret_cast<FrameRingSlot *>(bytes + m_header->firstSlotOffset +
+                                            (frame % m_header->slotCount) *
+                                                m_header->slotStride);
+}
+
+void *FrameRing::beginFrame(uint64_t &frame)
+{
+  m_writing.lock();
+  frame = m_frame = m_header->frameCount.load(std::memory_order_relaxed);
+  auto &frameSlot = slot(frame);
+  frameSlot.sequence.store(2 * frame + 1, std::memory_order_relaxed);
+  // Readers of the previous frame of the slot see the odd sequence before
+  // any pixel is overwritten
+  std::atomic_thread_fence(std::memory_order_release);
+  return reinterpret_cast<unsigned char *>(&frameSlot) +
+         m_header->pixelsOffset;
+}
+
+const void *FrameRing::framePixels(uint64_t frame) const
+{
+  return reinterpret_cast<const unsigned char *>(&slot(frame)) +
+         m_header->pixelsOffset;
+}
+
+void FrameRing::endFrame(uint32_t width, uint32_t height,
+    FrameRingFormat format, const std::string &id)
+{
+  auto &frameSlot = slot(m_frame);
+  frameSlot.width = width;
+  frameSlot.height = height;
+  frameSlot.format = format;
+  frameSlot.rowBytes = width * 4;
+  const auto idSize = std::min(id.size(), sizeof(frameSlot.id) - 1);
+  std::memcpy(frameSlot.id, id.data(), idSize);
+  frameSlot.id[idSize] = '\0';
+  frameSlot.sequence.store(2 * m_frame + 2, std::memory_order_release);
+  m_header->frameCount.store(m_frame + 1, std::memory_order_release);
+  m_writing.unlock();
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+// Frames of the serve command written to a POSIX shared memory object, for a
+// consumer process on the same machine to map and read in place instead of
+// decoding image files. The object starts with a FrameRingHeader, followed by
+// slotCount slots of slotStride bytes from firstSlotOffset. Each slot is a
+// FrameRingSlot then, from its pixelsOffset, slotSize bytes of pixels.
+//
+// Frame n is written to slot n % slotCount. The sequence of the slot is odd,
+// 2n + 1, while the frame is written and even, 2n + 2, once it is complete,
+// then frameCount becomes n + 1. A consumer reads the slot of the frame it was
+// told of, or of frameCount - 1, once its sequence is 2n + 2, and checks after
+// reading the pixels that the sequence did not change, else a newer frame has
+// overwritten them.
+
+#define FRAME_RING_MAGIC "GLTFRING"
+#define FRAME_RING_VERSION 1
+
+enum FrameRingFormat : uint32_t
+{
+  // 4 bytes per pixel, sRGB encoded color and linear alpha, rows bottom first
+  FRAME_RING_RGBA8 = 1
+};
+
+struct FrameRingHeader
+{
+  char magic[8]; // FRAME_RING_MAGIC, without null terminator
+  uint32_t version; // FRAME_RING_VERSION
+  uint32_t slotCount;
+  uint64_t slotSize; // Bytes of pixels of a slot
+  uint64_t firstSlotOffset; // From the start of the object
+  uint64_t slotStride;
+  uint64_t pixelsOffset; // From the start of a slot
+  std::atomic<uint64_t> frameCount; // Frames complete
+};
+
+struct FrameRingSlot
+{
+  std::atomic<uint64_t> sequence; // 0 until a frame is written
+  uint32_t width;
+  uint32_t height;
+  uint32_t format; // FrameRingFormat
+  uint32_t rowBytes;
+  char id[64]; // Of the request, null terminated, truncated if longer
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+    "Frame ring counters are shared between processes");
+
+// Writer of a frame ring, the shared memory object lives as long as it
+class FrameRing
+{
+public:
+  FrameRing() = default;
+  ~FrameRing();
+
+  FrameRing(const FrameRing &) = delete;
+  FrameRing &operator=(const FrameRing &) = delete;
+
+  // Create the shared memory object name, such as "/gltf-frames", replacing
+  // one left by a previous writer, with slotCount slots of slotSize bytes
+  bool open(const std::string &name, size_t slotCount, size_t slotSize,
+      std::string &err);
+
+  bool isOpen() const { return m_header != nullptr; }
+  size_t slotCount() const { return m_header ? m_header->slotCount : 0; }
+  size_t slotSize() const { return m_header ? m_header->slotSize : 0; }
+
+  // Start the next frame, return the slotSize bytes to write its pixels to
+  // and its number in frame. Writers on several threads take turns: the
+  // frame started by another is ended first.
+  void *beginFrame(uint64_t &frame);
+
+  // Publish the frame started last, of width * height pixels of format, by
+  // the thread that started it
+  void endFrame(uint32_t width, uint32_t height, FrameRingFormat format,
+      const std::string &id);
+
+  // Pixels of frame, until it is overwritten
+  const void *framePixels(uint64_t frame) const;
+
+private:
+  FrameRingSlot &slot(uint64_t frame) const;
+
+  std::string m_name;
+  void *m_memory = nullptr;
+  size_t m_size = 0;
+  FrameRingHeader *m_header = nullptr;
+  uint64_t m_frame = 0; // Started last
+  std::mutex m_writing; // From beginFrame to endFrame
+};
@@ -0,0 +1,39 @@
+#include "frame_stats.hpp"
+
+size_t triangleCount(GLenum mode, size_t count)
+{
+  switch (mode) {
+  case GL_TRIANGLES:
+    return count / 3;
+  case GL_TRIANGLE_STRIP:
+  case GL_TRIANGLE_FAN:
+    return count > 2 ? count - 2 : 0;
+  }
+  return 0;
+}
+
+bool FrameStatsLog::open(const fs::path &path, std::string &err)
+{
+  m_file.open(path);
+  if (!m_file) {
+    err = "Unable to write frame statistics to " + path.string();
+    return false;
+  }
+  m_file << "frame,cpu_ms,draw_calls,draw_commands,triangles,"
+            "drawn_primitives,culled_primitives,program_binds,"
+            "vertex_array_binds,texture_binds,sampler_binds,other_state,"
+            "uniform_uploads,uploaded_bytes,heap_allocations\n";
+  return true;
+}
+
+void FrameStatsLog::write(size_t frame, double cpuMs, const FrameStats &stats)
+{
+  const auto &state = stats.stateChanges;
+  m_file << frame << ',' << cpuMs << ',' << stats.drawCalls << ','
+         << stats.drawCommands << ',' << stats.triangles << ','
+         << stats.drawnPrimitives << ',' << stats.culledPrimitives << ','
+         << state.programBinds << ',' << state.vertexArrayBinds << ','
+         << state.textureBinds << ',' << state.samplerBinds << ','
+         << state.otherChanges << ',' << stats.uniformUploads << ','
+         << stats.uploadedBytes << ',' << stats.heapAllocations << '\n';
+}
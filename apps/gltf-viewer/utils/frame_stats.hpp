@@ -0,0 +1,43 @@
+#pragma once
+
+#include "filesystem.hpp"
+#include "gl_state.hpp"
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <fstream>
+#include <string>
+
+// Work submitted to the GPU for a frame by drawScene
+struct FrameStats
+{
+  size_t drawCalls = 0; // A multi-draw is one call
+  size_t drawCommands = 0; // Draws of multi-draws counted one by one
+  size_t triangles = 0; // Of every pass and instance
+  size_t drawnPrimitives = 0;
+  size_t culledPrimitives = 0;
+  GLStateCache::Counters stateChanges;
+  size_t uniformUploads = 0; // Uniform values sent to the driver
+  size_t uploadedBytes = 0; // Copied to buffers and textures
+  // Of the whole frame, GUI and loading included, if heapAllocationsCounted()
+  size_t heapAllocations = 0;
+};
+
+// Triangles drawn from count vertices or indices of mode, 0 for points and
+// lines
+size_t triangleCount(GLenum mode, size_t count);
+
+// Frame statistics written as CSV, a header then one line per frame
+class FrameStatsLog
+{
+public:
+  bool open(const fs::path &path, std::string &err);
+
+  bool isOpen() const { return m_file.is_open(); }
+
+  void write(size_t frame, double cpuMs, const FrameStats &stats);
+
+private:
+  std::ofstream m_file;
+};
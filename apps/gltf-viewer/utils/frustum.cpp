@@ -0,0 +1,58 @@
+#include "frustum.hpp"
+
+Aabb transformAabb(const Aabb &box, const glm::mat4 &matrix)
+{
+  // Arvo's method: the extents are transformed by the absolute value of the
+  // linear part of the matrix
+  const auto center = 0.5f * (box.min + box.max);
+  const auto extents = 0.5f * (box.max - box.min);
+  const auto worldCenter = glm::vec3(matrix * glm::vec4(center, 1.f));
+  const auto worldExtents = glm::abs(glm::vec3(matrix[0])) * extents.x +
+                            glm::abs(glm::vec3(matrix[1])) * extents.y +
+                            glm::abs(glm::vec3(matrix[2])) * extents.z;
+
+  Aabb result;
+  result.min = worldCenter - worldExtents;
+  result.max = worldCenter + worldExtents;
+  return result;
+}
+
+Frustum::Frustum(const glm::mat4 &viewProjMatrix)
+{
+  // Gribb and Hartmann, the planes are combinations of the rows of the matrix
+  const auto m = glm::transpose(viewProjMatrix);
+  m_planes[0] = m[3] + m[0]; // Left
+  m_planes[1] = m[3] - m[0]; // Right
+  m_planes[2] = m[3] + m[1]; // Bottom
+  m_planes[3] = m[3] - m[1]; // Top
+  m_planes[4] = m[3] + m[2]; // Near
+  m_planes[5] = m[3] - m[2]; // Far
+}
+
+bool Frustum::intersects(const Aabb &box) const
+{
+  for (const auto &plane : m_planes) {
+    // The corner of the box the furthest along the plane normal
+    const auto corner = glm::vec3(plane.x >= 0.f ? box.max.x : box.min.x,
+        plane.y >= 0.f ? box.max.y : box.min.y,
+        plane.z >= 0.f ? box.max.z : box.min.z);
+    if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.f) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool Frustum::contains(const Aabb &box) const
+{
+  for (const auto &plane : m_planes) {
+    // The corner of the box the furthest against the plane normal
+    const auto corner = glm::vec3(plane.x >= 0.f ? box.min.x : box.max.x,
+        plane.y >= 0.f ? box.min.y : box.max.y,
+        plane.z >= 0.f ? box.min.z : box.max.z);
+    if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.f) {
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <limits>
+
+// Axis aligned bounding box, empty by default
+struct Aabb
+{
+  glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+  glm::vec3 max = glm::vec3(std::numeric_limits<float>::lowest());
+
+  bool isEmpty() const
+  {
+    return min.x > max.x || min.y > max.y || min.z > max.z;
+  }
+};
+
+// Bounding box of the box transformed by an affine matrix
+Aabb transformAabb(const Aabb &box, const glm::mat4 &matrix);
+
+// The 6 clip planes of a projection, in the space viewProjMatrix transforms
+// from
+class Frustum
+{
+public:
+  explicit Frustum(const glm::mat4 &viewProjMatrix);
+
+  // Conservative test, a box outside of the frustum near one of its corners
+  // may still be reported as intersecting
+  bool intersects(const Aabb &box) const;
+
+  // True if the whole box is inside of the frustum
+  bool contains(const Aabb &box) const;
+
+private:
+  glm::vec4 m_planes[6]; // xyz is the inward normal, w the distance
+};
@@ -0,0 +1,510 @@
+#include "geometry_cache.hpp"
+
+#include "heap_memory.hpp"
+#include "mapped_file.hpp"
+#include "trace.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <thread>
+#include <utility>
+
+namespace
+{
+
+const char GEOMETRY_CACHE_MAGIC[8] = {'G', 'V', 'G', 'E', 'O', 0, 0, 5};
+const char OCCLUSION_CACHE_MAGIC[8] = {'G', 'V', 'A', 'O', 0, 0, 0, 1};
+const char VISIBLE_SETS_CACHE_MAGIC[8] = {'G', 'V', 'P', 'V', 'S', 0, 0, 1};
+
+static_assert(sizeof(PackedMeshlet) == 48, "std430 layout of Meshlet");
+static_assert(sizeof(PointOctreeNode) == 40, "Nodes are written as they are");
+
+// Header of a cache file: magic, then the key. The payload follows: vertex
+// buffers (format, then vertices), indices, primitives with their levels of
+// detail, meshlets, point octree nodes, members of the merged primitives and
+// scene bounds, in the byte order of the machine.
+std::string serializeKey(const GeometryCacheKey &key)
+{
+  std::string header(GEOMETRY_CACHE_MAGIC, sizeof(GEOMETRY_CACHE_MAGIC));
+  const auto append = [&](const auto &value) {
+    header.append(reinterpret_cast<const char *>(&value), sizeof(value));
+  };
+  append(uint8_t(key.exactBounds));
+  append(uint8_t(key.optimize));
+  append(uint8_t(key.weldVertices));
+  append(uint8_t(key.quantize));
+  append(uint8_t(key.meshlets));
+  append(uint8_t(key.staticBatching));
+  append(uint8_t(key.mergeSmallPrimitives));
+  append(key.lodCount);
+  append(uint32_t(key.files.size()));
+  for (const auto &file : key.files) {
+    append(file.size);
+    append(file.writeTime);
+    append(uint32_t(file.path.size()));
+    header += file.path;
+  }
+  return header;
+}
+
+class Writer
+{
+public:
+  template <typename T> void value(const T &value)
+  {
+    bytes(&value, sizeof(value));
+  }
+
+  void bytes(const void *data, size_t size)
+  {
+    const auto *begin = static_cast<const char *>(data);
+    m_payload.insert(m_payload.end(), begin, begin + size);
+  }
+
+  const std::string &payload() const { return m_payload; }
+
+private:
+  std::string m_payload;
+};
+
+// Reads of a mapped payload, false once past its end
+class Reader
+{
+public:
+  Reader(const unsigned char *data, size_t size) : m_data(data), m_size(size)
+  {
+  }
+
+  template <typename T> bool value(T &value)
+  {
+    return bytes(&value, sizeof(value));
+  }
+
+  bool bytes(void *data, size_t size)
+  {
+    if (size > m_size - m_offset) {
+      return false;
+    }
+    std::memcpy(data, m_data + m_offset, size);
+    m_offset += size;
+    return true;
+  }
+
+  size_t left() const { return m_size - m_offset; }
+
+private:
+  const unsigned char *m_data;
+  size_t m_size;
+  size_t m_offset = 0;
+};
+
+void writeGeometry(Writer &writer, const PackedGeometry &geometry,
+    const glm::vec3 &bboxMin, const glm::vec3 &bboxMax)
+{
+  writer.value(uint32_t(geometry.vertexBuffers.size()));
+  for (const auto &vertexBuffer : geometry.vertexBuffers) {
+    for (const auto &attribute : vertexBuffer.format.attributes) {
+      writer.value(uint32_t(attribute.componentType));
+      writer.value(int32_t(attribute.componentCount));
+      writer.value(uint8_t(attribute.normalized));
+      writer.value(uint8_t(attribute.integer));
+      writer.value(attribute.offset);
+    }
+    writer.value(vertexBuffer.format.stride);
+    writer.value(vertexBuffer.vertexCount);
+    writer.value(vertexBuffer.firstVertexMember);
+    writer.value(uint64_t(vertexBuffer.vertices.size()));
+    writer.bytes(vertexBuffer.vertices.data(), vertexBuffer.vertices.size());
+  }
+
+  writer.value(uint64_t(geometry.indices.size()));
+  writer.bytes(
+      geometry.indices.data(), geometry.indices.size() * sizeof(uint32_t));
+
+  writer.value(uint32_t(geometry.primitives.size()));
+  for (const auto &primitive : geometry.primitives) {
+    writer.value(primitive.vertexBuffer);
+    writer.value(uint32_t(primitive.mode));
+    writer.value(primitive.indexCount);
+    writer.value(primitive.firstIndex);
+    writer.value(primitive.baseVertex);
+    writer.value(primitive.positionDequantize);
+    writer.value(primitive.firstMeshlet);
+    writer.value(primitive.meshletCount);
+    writer.value(primitive.firstMember);
+    writer.value(primitive.memberCount);
+    writer.value(primitive.firstPointNode);
+    writer.value(primitive.pointNodeCount);
+    writer.value(uint32_t(primitive.lods.size()));
+    for (const auto &lod : primitive.lods) {
+      writer.value(lod.indexCount);
+      writer.value(lod.firstIndex);
+      writer.value(lod.error);
+    }
+  }
+
+  writer.value(uint64_t(geometry.meshlets.size()));
+  writer.bytes(geometry.meshlets.data(),
+      geometry.meshlets.size() * sizeof(PackedMeshlet));
+  writer.value(uint64_t(geometry.pointNodes.size()));
+  writer.bytes(geometry.pointNodes.data(),
+      geometry.pointNodes.size() * sizeof(PointOctreeNode));
+
+  writer.value(uint64_t(geometry.mergedMembers.size()));
+  writer.bytes(geometry.mergedMembers.data(),
+      geometry.mergedMembers.size() * sizeof(uint32_t));
+  writer.value(uint64_t(geometry.vertexMembers.size()));
+  writer.bytes(geometry.vertexMembers.data(),
+      geometry.vertexMembers.size() * sizeof(uint32_t));
+
+  writer.value(bboxMin);
+  writer.value(bboxMax);
+}
+
+bool readGeometry(Reader &reader, PackedGeometry &geometry,
+    glm::vec3 &bboxMin, glm::vec3 &bboxMax)
+{
+  // Counts are checked against the bytes left before allocating
+  uint32_t vertexBufferCount = 0;
+  if (!reader.value(vertexBufferCount) ||
+      vertexBufferCount > reader.left()) {
+    return false;
+  }
+  geometry.vertexBuffers.resize(vertexBufferCount);
+  for (auto &vertexBuffer : geometry.vertexBuffers) {
+    for (auto &attribute : vertexBuffer.format.attributes) {
+      uint32_t componentType = 0;
+      int32_t componentCount = 0;
+      uint8_t normalized = 0;
+      uint8_t integer = 0;
+      if (!reader.value(componentType) || !reader.value(componentCount) ||
+          !reader.value(normalized) || !reader.value(integer) ||
+          !reader.value(attribute.offset)) {
+        return false;
+      }
+      attribute.componentType = GLenum(componentType);
+      attribute.componentCount = GLint(componentCount);
+      attribute.normalized = normalized != 0;
+      attribute.integer = integer != 0;
+    }
+    uint64_t size = 0;
+    if (!reader.value(vertexBuffer.format.stride) ||
+        !reader.value(vertexBuffer.vertexCount) ||
+        !reader.value(vertexBuffer.firstVertexMember) || !reader.value(size) ||
+        size > reader.left()) {
+      return false;
+    }
+    vertexBuffer.vertices.resize(size_t(size));
+    reader.bytes(vertexBuffer.vertices.data(), vertexBuffer.vertices.size());
+  }
+
+  uint64_t indexCount = 0;
+  if (!reader.value(indexCount) ||
+      indexCount > reader.left() / sizeof(uint32_t)) {
+    return false;
+  }
+  geometry.indices.resize(size_t(indexCount));
+  reader.bytes(
+      geometry.indices.data(), geometry.indices.size() * sizeof(uint32_t));
+  geometry.indexType = packedIndexType(geometry.indices);
+
+  uint32_t primitiveCount = 0;
+  if (!reader.value(primitiveCount) || primitiveCount > reader.left()) {
+    return false;
+  }
+  geometry.primitives.resize(primitiveCount);
+  for (auto &primitive : geometry.primitives) {
+    uint32_t mode = 0;
+    uint32_t lodCount = 0;
+    if (!reader.value(primitive.vertexBuffer) || !reader.value(mode) ||
+        !reader.value(primitive.indexCount) ||
+        !reader.value(primitive.firstIndex) ||
+        !reader.value(primitive.baseVertex) ||
+        !reader.value(primitive.positionDequantize) ||
+        !reader.value(primitive.firstMeshlet) ||
+        !reader.value(primitive.meshletCount) ||
+        !reader.value(primitive.firstMember) ||
+        !reader.value(primitive.memberCount) ||
+        !reader.value(primitive.firstPointNode) ||
+        !reader.value(primitive.pointNodeCount) || !reader.value(lodCount) ||
+        lodCount > reader.left() / sizeof(PackedLod)) {
+      return false;
+    }
+    primitive.mode = GLenum(mode);
+    primitive.lods.resize(lodCount);
+    for (auto &lod : primitive.lods) {
+      reader.value(lod.indexCount);
+      reader.value(lod.firstIndex);
+      reader.value(lod.error);
+    }
+  }
+
+  uint64_t meshletCount = 0;
+  if (!reader.value(meshletCount) ||
+      meshletCount > reader.left() / sizeof(PackedMeshlet)) {
+    return false;
+  }
+  geometry.meshlets.resize(size_t(meshletCount));
+  reader.bytes(geometry.meshlets.data(),
+      geometry.meshlets.size() * sizeof(PackedMeshlet));
+
+  uint64_t pointNodeCount = 0;
+  if (!reader.value(pointNodeCount) ||
+      pointNodeCount > reader.left() / sizeof(PointOctreeNode)) {
+    return false;
+  }
+  geometry.pointNodes.resize(size_t(pointNodeCount));
+  reader.bytes(geometry.pointNodes.data(),
+      geometry.pointNodes.size() * sizeof(PointOctreeNode));
+
+  for (auto *members : {&geometry.mergedMembers, &geometry.vertexMembers}) {
+    uint64_t memberCount = 0;
+    if (!reader.value(memberCount) ||
+        memberCount > reader.left() / sizeof(uint32_t)) {
+      return false;
+    }
+    members->resize(size_t(memberCount));
+    reader.bytes(members->data(), members->size() * sizeof(uint32_t));
+  }
+
+  return reader.value(bboxMin) && reader.value(bboxMax) &&
+         reader.left() == 0;
+}
+
+// Header of an occlusion cache file: its own magic, the rays per vertex, then
+// the header of the geometry the occlusion was baked on
+std::string serializeOcclusionKey(const GeometryCacheKey &key, int32_t rays)
+{
+  std::string header(OCCLUSION_CACHE_MAGIC, sizeof(OCCLUSION_CACHE_MAGIC));
+  header.append(reinterpret_cast<const char *>(&rays), sizeof(rays));
+  return header + serializeKey(key);
+}
+
+// Header of a visible sets cache file: its own magic, the cell size asked,
+// then the header of the geometry the sets were baked on
+std::string serializeVisibleSetsKey(
+    const GeometryCacheKey &key, float cellSize)
+{
+  std::string header(
+      VISIBLE_SETS_CACHE_MAGIC, sizeof(VISIBLE_SETS_CACHE_MAGIC));
+  header.append(reinterpret_cast<const char *>(&cellSize), sizeof(cellSize));
+  return header + serializeKey(key);
+}
+
+// Write header then payload next to file, then rename it to file so that
+// concurrent processes never read a partial file
+bool writeCacheFile(
+    const fs::path &file, const std::string &header, const std::string &payload)
+{
+  // Unique per process and thread so that concurrent loads do not write the
+  // same file
+  auto tmpFile = file;
+  tmpFile += "." +
+             std::to_string(
+                 std::chrono::steady_clock::now().time_since_epoch().count()) +
+             "." +
+             std::to_string(
+                 std::hash<std::thread::id>()(std::this_thread::get_id())) +
+             ".tmp";
+
+  try {
+    fs::create_directories(file.parent_path());
+    {
+      std::ofstream output(tmpFile.string(), std::ios::binary);
+      if (!output.write(header.data(), header.size()) ||
+          !output.write(payload.data(), payload.size())) {
+        output.close();
+        fs::remove(tmpFile);
+        return false;
+      }
+    }
+    fs::rename(tmpFile, file);
+  } catch (const fs::filesystem_error &) {
+    return false;
+  }
+
+  return true;
+}
+
+} // namespace
+
+bool initGeometryCacheKey(const std::vector<fs::path> &files, bool exactBounds,
+    const GeometryOptions &options, GeometryCacheKey &key)
+{
+  key.files.clear();
+  for (const auto &path : files) {
+    if (!fs::exists(path)) {
+      return false;
+    }
+    GeometryCacheKey::File file;
+    file.path = fs::absolute(path).string();
+    file.size = uint64_t(fs::file_size(path));
+#ifdef GLMLV_USE_BOOST_FILESYSTEM
+    file.writeTime = int64_t(fs::last_write_time(path));
+#else
+    file.writeTime =
+        int64_t(fs::last_write_time(path).time_since_epoch().count());
+#endif
+    key.files.push_back(std::move(file));
+  }
+  key.exactBounds = exactBounds;
+  key.optimize = options.optimize;
+  key.weldVertices = options.weldVertices;
+  key.quantize = options.quantize;
+  key.lodCount = int32_t(options.lodCount);
+  key.meshlets = options.meshlets;
+  key.staticBatching = options.staticBatching;
+  key.mergeSmallPrimitives = options.mergeSmallPrimitives;
+  return !key.files.empty();
+}
+
+fs::path geometryCacheFile(
+    const fs::path &cacheDirectory, const GeometryCacheKey &key)
+{
+  // The key is also stored in the file, a hash collision only causes a repack
+  std::stringstream name;
+  name << fs::path(key.files.front().path).stem().string() << '-' << std::hex
+       << std::hash<std::string>()(serializeKey(key)) << ".geometry";
+  return cacheDirectory / name.str();
+}
+
+bool loadGeometryCache(const fs::path &file, const GeometryCacheKey &key,
+    PackedGeometry &geometry, glm::vec3 &bboxMin, glm::vec3 &bboxMax)
+{
+  TRACE_ZONE("loadGeometryCache");
+  HeapTagScope heapTag(HeapTag::Geometry);
+  const MappedFile mapping(file);
+  if (!mapping.isOpen()) {
+    return false;
+  }
+
+  const auto header = serializeKey(key);
+  if (mapping.size() < header.size() ||
+      std::memcmp(mapping.data(), header.data(), header.size()) != 0) {
+    return false;
+  }
+
+  Reader reader(
+      mapping.data() + header.size(), mapping.size() - header.size());
+  PackedGeometry read;
+  glm::vec3 readMin, readMax;
+  if (!readGeometry(reader, read, readMin, readMax)) {
+    return false;
+  }
+  geometry = std::move(read);
+  bboxMin = readMin;
+  bboxMax = readMax;
+  return true;
+}
+
+bool saveGeometryCache(const fs::path &file, const GeometryCacheKey &key,
+    const PackedGeometry &geometry, const glm::vec3 &bboxMin,
+    const glm::vec3 &bboxMax)
+{
+  TRACE_ZONE("saveGeometryCache");
+  Writer writer;
+  writeGeometry(writer, geometry, bboxMin, bboxMax);
+  return writeCacheFile(file, serializeKey(key), writer.payload());
+}
+
+fs::path occlusionCacheFile(const fs::path &geometryCacheFile)
+{
+  auto file = geometryCacheFile;
+  file.replace_extension(".occlusion");
+  return file;
+}
+
+bool loadOcclusionCache(const fs::path &file, const GeometryCacheKey &key,
+    int rays, std::vector<uint8_t> &occlusion)
+{
+  TRACE_ZONE("loadOcclusionCache");
+  const MappedFile mapping(file);
+  if (!mapping.isOpen()) {
+    return false;
+  }
+
+  const auto header = serializeOcclusionKey(key, int32_t(rays));
+  if (mapping.size() < header.size() ||
+      std::memcmp(mapping.data(), header.data(), header.size()) != 0) {
+    return false;
+  }
+
+  Reader reader(
+      mapping.data() + header.size(), mapping.size() - header.size());
+  uint64_t count = 0;
+  if (!reader.value(count) || count != reader.left()) {
+    return false;
+  }
+  occlusion.resize(size_t(count));
+  return reader.bytes(occlusion.data(), occlusion.size());
+}
+
+bool saveOcclusionCache(const fs::path &file, const GeometryCacheKey &key,
+    int rays, const std::vector<uint8_t> &occlusion)
+{
+  TRACE_ZONE("saveOcclusionCache");
+  Writer writer;
+  writer.value(uint64_t(occlusion.size()));
+  writer.bytes(occlusion.data(), occlusion.size());
+  return writeCacheFile(
+      file, serializeOcclusionKey(key, int32_t(rays)), writer.payload());
+}
+
+fs::path visibleSetsCacheFile(const fs::path &geometryCacheFile)
+{
+  auto file = geometryCacheFile;
+  file.replace_extension(".pvs");
+  return file;
+}
+
+bool loadVisibleSetsCache(const fs::path &file, const GeometryCacheKey &key,
+    float cellSize, size_t itemCount, VisibleSets &sets)
+{
+  TRACE_ZONE("loadVisibleSetsCache");
+  const MappedFile mapping(file);
+  if (!mapping.isOpen()) {
+    return false;
+  }
+
+  const auto header = serializeVisibleSetsKey(key, cellSize);
+  if (mapping.size() < header.size() ||
+      std::memcmp(mapping.data(), header.data(), header.size()) != 0) {
+    return false;
+  }
+
+  Reader reader(
+      mapping.data() + header.size(), mapping.size() - header.size());
+  glm::vec3 origin;
+  float gridCellSize = 0;
+  glm::ivec3 cellCounts;
+  uint64_t items = 0;
+  uint64_t count = 0;
+  if (!reader.value(origin) || !reader.value(gridCellSize) ||
+      !reader.value(cellCounts) || !reader.value(items) ||
+      items != itemCount || !reader.value(count) ||
+      count * sizeof(uint32_t) != reader.left()) {
+    return false;
+  }
+  std::vector<uint32_t> bits(count);
+  return reader.bytes(bits.data(), bits.size() * sizeof(uint32_t)) &&
+         sets.assign(origin, gridCellSize, cellCounts, itemCount,
+             std::move(bits));
+}
+
+bool saveVisibleSetsCache(const fs::path &file, const GeometryCacheKey &key,
+    float cellSize, const VisibleSets &sets)
+{
+  TRACE_ZONE("saveVisibleSetsCache");
+  Writer writer;
+  writer.value(sets.origin());
+  writer.value(sets.cellSize());
+  writer.value(sets.cellCounts());
+  writer.value(uint64_t(sets.itemCount()));
+  writer.value(uint64_t(sets.bits().size()));
+  writer.bytes(sets.bits().data(), sets.bits().size() * sizeof(uint32_t));
+  return writeCacheFile(
+      file, serializeVisibleSetsKey(key, cellSize), writer.payload());
+}
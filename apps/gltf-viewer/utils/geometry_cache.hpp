@@ -0,0 +1,99 @@
+#pragma once
+
+#include "filesystem.hpp"
+#include "packed_geometry.hpp"
+#include "visible_sets.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Parameters the packed geometry of a model depends on. A cache file is only
+// used if all of them match.
+struct GeometryCacheKey
+{
+  struct File
+  {
+    std::string path; // Absolute
+    uint64_t size = 0;
+    int64_t writeTime = 0;
+
+    bool operator==(const File &other) const
+    {
+      return path == other.path && size == other.size &&
+             writeTime == other.writeTime;
+    }
+  };
+
+  // glTF files, their external buffers and the scene file listing them
+  std::vector<File> files;
+  bool exactBounds = false;
+  bool optimize = false;
+  bool weldVertices = false;
+  bool quantize = false;
+  int32_t lodCount = 0;
+  bool meshlets = false;
+  bool staticBatching = false;
+  bool mergeSmallPrimitives = false;
+
+  bool operator==(const GeometryCacheKey &other) const
+  {
+    return files == other.files && exactBounds == other.exactBounds &&
+           optimize == other.optimize && weldVertices == other.weldVertices &&
+           quantize == other.quantize && lodCount == other.lodCount &&
+           meshlets == other.meshlets &&
+           staticBatching == other.staticBatching &&
+           mergeSmallPrimitives == other.mergeSmallPrimitives;
+  }
+};
+
+// Fill the key from the file system. Return false if a file does not exist.
+bool initGeometryCacheKey(const std::vector<fs::path> &files, bool exactBounds,
+    const GeometryOptions &options, GeometryCacheKey &key);
+
+// Path of the cache file of a model in cacheDirectory
+fs::path geometryCacheFile(
+    const fs::path &cacheDirectory, const GeometryCacheKey &key);
+
+// Read the geometry, and the scene bounds computed by computeSceneBounds, from
+// a cache file written by saveGeometryCache with the same key. The file is
+// mapped and its vertices and indices copied as they are, nothing is repacked.
+// Return false, leaving the outputs unchanged, if there is no such file.
+bool loadGeometryCache(const fs::path &file, const GeometryCacheKey &key,
+    PackedGeometry &geometry, glm::vec3 &bboxMin, glm::vec3 &bboxMax);
+
+// Write the cache file, next to its final path then renamed so that
+// concurrent processes never read a partial file
+bool saveGeometryCache(const fs::path &file, const GeometryCacheKey &key,
+    const PackedGeometry &geometry, const glm::vec3 &bboxMin,
+    const glm::vec3 &bboxMax);
+
+// Path of the ambient occlusion baked on the geometry of geometryCacheFile,
+// next to it
+fs::path occlusionCacheFile(const fs::path &geometryCacheFile);
+
+// Read the occlusion of every vertex of the packed vertex buffers, see
+// OcclusionBaker, written by saveOcclusionCache with the same key and rays.
+// Return false if there is no such file.
+bool loadOcclusionCache(const fs::path &file, const GeometryCacheKey &key,
+    int rays, std::vector<uint8_t> &occlusion);
+
+// Write the cache file as saveGeometryCache does
+bool saveOcclusionCache(const fs::path &file, const GeometryCacheKey &key,
+    int rays, const std::vector<uint8_t> &occlusion);
+
+// Path of the potentially visible sets baked on the geometry of
+// geometryCacheFile, next to it
+fs::path visibleSetsCacheFile(const fs::path &geometryCacheFile);
+
+// Read the visible sets of itemCount draw items written by
+// saveVisibleSetsCache with the same key and cellSize, the size asked, their
+// grid may have larger cells. Return false if there is no such file.
+bool loadVisibleSetsCache(const fs::path &file, const GeometryCacheKey &key,
+    float cellSize, size_t itemCount, VisibleSets &sets);
+
+// Write the cache file as saveGeometryCache does
+bool saveVisibleSetsCache(const fs::path &file, const GeometryCacheKey &key,
+    float cellSize, const VisibleSets &sets);
@@ -0,0 +1,1937 @@
+#include "gl_capture.hpp"
+
+#include "GLFWHandle.hpp"
+#include "gl_extensions.hpp"
+#include "mapped_file.hpp"
+
+#include <json.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+const char CAPTURE_MAGIC[8] = {'G', 'L', 'C', 'A', 'P', 'T', 'U', 'R'};
+const uint32_t CAPTURE_VERSION = 1;
+
+// Records are kept in memory up to this many bytes, then written but for the
+// writes to mapped buffers still open
+const size_t CAPTURE_FLUSH_BYTES = size_t(64) << 20;
+
+typedef void(APIENTRYP PFNMULTIDRAWELEMENTSINDIRECTCOUNTPROC)(GLenum mode,
+    GLenum type, const void *indirect, GLintptr drawCount,
+    GLsizei maxDrawCount, GLsizei stride);
+typedef void(APIENTRYP PFNCLIPCONTROLPROC)(GLenum origin, GLenum depth);
+
+// Calls recorded with their arguments as they are, whose kind is one char
+// each: v a value, an offset in a bound buffer included; b, t, s, p, f, r, a
+// and q the name of a buffer, texture, sampler, program or shader,
+// framebuffer, renderbuffer, vertex array or query; y a sync object, Y one
+// deleted; P a program made current; l a uniform location of the program
+// argument, L of the current program; k a uniform block index of the program
+// argument; i a texture or renderbuffer as the target argument after it
+// tells. The kind of the returned value follows a '>'.
+#define GL_CAPTURE_GENERIC_CALLS(X)                                           \
+  X(ActiveTexture, "v")                                                       \
+  X(AttachShader, "pp")                                                       \
+  X(BeginConditionalRender, "qv")                                             \
+  X(BeginQuery, "vq")                                                         \
+  X(BindBuffer, "vb")                                                         \
+  X(BindBufferBase, "vvb")                                                    \
+  X(BindBufferRange, "vvbvv")                                                 \
+  X(BindFramebuffer, "vf")                                                    \
+  X(BindImageTexture, "vtvvvvv")                                              \
+  X(BindRenderbuffer, "vr")                                                   \
+  X(BindSampler, "vs")                                                        \
+  X(BindTexture, "vt")                                                        \
+  X(BindVertexArray, "a")                                                     \
+  X(BindVertexBuffer, "vbvv")                                                 \
+  X(BlendEquation, "v")                                                       \
+  X(BlendEquationSeparate, "vv")                                              \
+  X(BlendFunc, "vv")                                                          \
+  X(BlendFunci, "vvv")                                                        \
+  X(BlendFuncSeparate, "vvvv")                                                \
+  X(BlitFramebuffer, "vvvvvvvvvv")                                            \
+  X(Clear, "v")                                                               \
+  X(ClearDepth, "v")                                                          \
+  X(ClientWaitSync, "yvv")                                                    \
+  X(ColorMask, "vvvv")                                                        \
+  X(ColorMaski, "vvvvv")                                                      \
+  X(CompileShader, "p")                                                       \
+  X(CopyBufferSubData, "vvvvv")                                               \
+  X(CopyImageSubData, "ivvvvvivvvvvvvv")                                      \
+  X(CreateProgram, ">p")                                                      \
+  X(CreateShader, "v>p")                                                      \
+  X(DeleteProgram, "p")                                                       \
+  X(DeleteShader, "p")                                                        \
+  X(DeleteSync, "Y")                                                          \
+  X(DepthFunc, "v")                                                           \
+  X(DepthMask, "v")                                                           \
+  X(DetachShader, "pp")                                                       \
+  X(Disable, "v")                                                             \
+  X(DispatchCompute, "vvv")                                                   \
+  X(DrawArrays, "vvv")                                                        \
+  X(DrawArraysInstanced, "vvvv")                                              \
+  X(DrawBuffer, "v")                                                          \
+  X(DrawElements, "vvvv")                                                     \
+  X(DrawElementsBaseVertex, "vvvvv")                                          \
+  X(Enable, "v")                                                              \
+  X(EnableVertexAttribArray, "v")                                             \
+  X(EndConditionalRender, "")                                                 \
+  X(EndQuery, "v")                                                            \
+  X(FenceSync, "vv>y")                                                        \
+  X(Finish, "")                                                               \
+  X(Flush, "")                                                                \
+  X(FramebufferRenderbuffer, "vvvr")                                          \
+  X(FramebufferTexture, "vvtv")                                               \
+  X(FramebufferTexture2D, "vvvtv")                                            \
+  X(FramebufferTextureLayer, "vvtvv")                                         \
+  X(GenerateMipmap, "v")                                                      \
+  X(LinkProgram, "p")                                                         \
+  X(MemoryBarrier, "v")                                                       \
+  X(MultiDrawElementsIndirect, "vvvvv")                                       \
+  X(PixelStorei, "vv")                                                        \
+  X(PolygonMode, "vv")                                                        \
+  X(PolygonOffset, "vv")                                                      \
+  X(PopDebugGroup, "")                                                        \
+  X(ProgramParameteri, "pvv")                                                 \
+  X(ProgramUniform1f, "plv")                                                  \
+  X(ProgramUniform1i, "plv")                                                  \
+  X(QueryCounter, "qv")                                                       \
+  X(ReadBuffer, "v")                                                          \
+  X(RenderbufferStorage, "vvvv")                                              \
+  X(RenderbufferStorageMultisample, "vvvvv")                                  \
+  X(SamplerParameteri, "svv")                                                 \
+  X(Scissor, "vvvv")                                                          \
+  X(TexBuffer, "vvb")                                                         \
+  X(TexParameteri, "vvv")                                                     \
+  X(TexStorage2D, "vvvvv")                                                    \
+  X(TexStorage2DMultisample, "vvvvvv")                                        \
+  X(TexStorage3D, "vvvvvv")                                                   \
+  X(TextureView, "tvtvvvvv")                                                  \
+  X(Uniform1i, "Lv")                                                          \
+  X(UniformBlockBinding, "pkv")                                               \
+  X(UseProgram, "P")                                                          \
+  X(VertexAttribBinding, "vv")                                                \
+  X(VertexAttribFormat, "vvvvv")                                              \
+  X(VertexAttribIFormat, "vvvv")                                              \
+  X(VertexAttribPointer, "vvvvvv")                                            \
+  X(VertexBindingDivisor, "vv")                                               \
+  X(Viewport, "vvvv")                                                         \
+  X(WaitSync, "yvv")
+
+// Generic calls recorded only when writing to GL_PIXEL_PACK_BUFFER, those
+// reading to client memory are left to the app
+#define GL_CAPTURE_PACK_CALLS(X)                                              \
+  X(GetTexImage, "vvvvv")                                                     \
+  X(ReadPixels, "vvvvvvv")
+
+// Generic calls of extensions, wrapped by captureGLProcAddress
+#define GL_CAPTURE_EXTENSION_CALLS(X)                                         \
+  X(MultiDrawElementsIndirectCountARB, "vvvvvv",                              \
+      PFNMULTIDRAWELEMENTSINDIRECTCOUNTPROC)                                  \
+  X(ClipControl, "vv", PFNCLIPCONTROLPROC)
+
+// glGen* and glDelete* of the objects of each kind
+#define GL_CAPTURE_OBJECT_CALLS(X)                                            \
+  X(Buffers, 'b')                                                             \
+  X(Framebuffers, 'f')                                                        \
+  X(Queries, 'q')                                                             \
+  X(Renderbuffers, 'r')                                                       \
+  X(Samplers, 's')                                                            \
+  X(Textures, 't')                                                            \
+  X(VertexArrays, 'a')
+
+// Calls reading arrays or strings from client memory, and the queries of
+// uniform locations and blocks, each with a struct of its name below
+#define GL_CAPTURE_SPECIAL_CALLS(X)                                           \
+  X(BindAttribLocation)                                                       \
+  X(BufferData)                                                               \
+  X(BufferStorage)                                                            \
+  X(BufferSubData)                                                            \
+  X(ClearBufferSubData)                                                       \
+  X(ClearBufferfv)                                                            \
+  X(ClearBufferuiv)                                                           \
+  X(CompressedTexSubImage2D)                                                  \
+  X(DrawBuffers)                                                              \
+  X(GetProgramResourceName)                                                   \
+  X(GetProgramResourceiv)                                                     \
+  X(GetUniformLocation)                                                       \
+  X(ProgramUniform2fv)                                                        \
+  X(ProgramUniform2iv)                                                        \
+  X(ProgramUniform3fv)                                                        \
+  X(ProgramUniform3iv)                                                        \
+  X(ProgramUniform4fv)                                                        \
+  X(ProgramUniform4iv)                                                        \
+  X(ProgramUniformMatrix3fv)                                                  \
+  X(ProgramUniformMatrix4fv)                                                  \
+  X(PushDebugGroup)                                                           \
+  X(ShaderSource)                                                             \
+  X(TexImage2D)                                                               \
+  X(TexSubImage2D)                                                            \
+  X(UniformMatrix4fv)
+
+#define GL_CAPTURE_CALL_ID(name, ...) Call##name,
+#define GL_CAPTURE_OBJECT_IDS(name, kind) CallGen##name, CallDelete##name,
+
+// Records are a call, or the following
+enum RecordId : uint16_t
+{
+  GL_CAPTURE_GENERIC_CALLS(GL_CAPTURE_CALL_ID)
+      GL_CAPTURE_PACK_CALLS(GL_CAPTURE_CALL_ID)
+          GL_CAPTURE_EXTENSION_CALLS(GL_CAPTURE_CALL_ID)
+              GL_CAPTURE_OBJECT_CALLS(GL_CAPTURE_OBJECT_IDS)
+                  GL_CAPTURE_SPECIAL_CALLS(GL_CAPTURE_CALL_ID) CallCount,
+  RecordFrameBegin = CallCount,
+  RecordFrameEnd,
+  RecordMappedWrite, // Buffer, offset, then the bytes
+  RecordUniformLocation, // Program, location, then the name
+  RecordUniformBlock // Program, block index, then the name
+};
+
+// Of the driver, what the wrappers and the replay call
+void *originals[CallCount] = {};
+
+#define GL_CAPTURE_ORIGINAL(name)                                             \
+  reinterpret_cast<decltype(glad_gl##name)>(originals[Call##name])
+
+template <typename T> uint64_t toWord(T value)
+{
+  static_assert(sizeof(T) <= sizeof(uint64_t), "Arguments fit in a word");
+  uint64_t word = 0;
+  std::memcpy(&word, &value, sizeof(T));
+  return word;
+}
+
+template <typename T> T fromWord(uint64_t word)
+{
+  T value;
+  std::memcpy(&value, &word, sizeof(T));
+  return value;
+}
+
+// Arguments described by kinds, those before '>'
+size_t kindArity(const char *kinds)
+{
+  size_t arity = 0;
+  while (kinds[arity] && kinds[arity] != '>') {
+    ++arity;
+  }
+  return arity;
+}
+
+// Bytes of a pixel of format and type, as read by uploads and clears
+size_t pixelBytes(GLenum format, GLenum type)
+{
+  switch (type) {
+  case GL_UNSIGNED_BYTE_3_3_2:
+  case GL_UNSIGNED_BYTE_2_3_3_REV:
+    return 1;
+  case GL_UNSIGNED_SHORT_5_6_5:
+  case GL_UNSIGNED_SHORT_5_6_5_REV:
+  case GL_UNSIGNED_SHORT_4_4_4_4:
+  case GL_UNSIGNED_SHORT_4_4_4_4_REV:
+  case GL_UNSIGNED_SHORT_5_5_5_1:
+  case GL_UNSIGNED_SHORT_1_5_5_5_REV:
+    return 2;
+  case GL_UNSIGNED_INT_8_8_8_8:
+  case GL_UNSIGNED_INT_8_8_8_8_REV:
+  case GL_UNSIGNED_INT_10_10_10_2:
+  case GL_UNSIGNED_INT_2_10_10_10_REV:
+  case GL_UNSIGNED_INT_24_8:
+  case GL_UNSIGNED_INT_10F_11F_11F_REV:
+  case GL_UNSIGNED_INT_5_9_9_9_REV:
+    return 4;
+  case GL_FLOAT_32_UNSIGNED_INT_24_8_REV:
+    return 8;
+  default:
+    break;
+  }
+
+  size_t components = 4;
+  switch (format) {
+  case GL_RED:
+  case GL_GREEN:
+  case GL_BLUE:
+  case GL_RED_INTEGER:
+  case GL_GREEN_INTEGER:
+  case GL_BLUE_INTEGER:
+  case GL_DEPTH_COMPONENT:
+  case GL_STENCIL_INDEX:
+    components = 1;
+    break;
+  case GL_RG:
+  case GL_RG_INTEGER:
+  case GL_DEPTH_STENCIL:
+    components = 2;
+    break;
+  case GL_RGB:
+  case GL_BGR:
+  case GL_RGB_INTEGER:
+  case GL_BGR_INTEGER:
+    components = 3;
+    break;
+  default:
+    break;
+  }
+
+  switch (type) {
+  case GL_UNSIGNED_SHORT:
+  case GL_SHORT:
+  case GL_HALF_FLOAT:
+    return components * 2;
+  case GL_UNSIGNED_INT:
+  case GL_INT:
+  case GL_FLOAT:
+    return components * 4;
+  default:
+    return components;
+  }
+}
+
+// Bytes an upload of a width by height image reads from client memory, with
+// the unpack state of the current context
+size_t unpackedBytes(
+    GLsizei width, GLsizei height, GLenum format, GLenum type)
+{
+  if (width <= 0 || height <= 0) {
+    return 0;
+  }
+  GLint rowLength = 0;
+  GLint alignment = 4;
+  GLint skipRows = 0;
+  GLint skipPixels = 0;
+  glGetIntegerv(GL_UNPACK_ROW_LENGTH, &rowLength);
+  glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+  glGetIntegerv(GL_UNPACK_SKIP_ROWS, &skipRows);
+  glGetIntegerv(GL_UNPACK_SKIP_PIXELS, &skipPixels);
+  const auto pixel = pixelBytes(format, type);
+  const auto rowAlignment = size_t(std::max(alignment, 1));
+  const auto rowBytes =
+      (size_t(rowLength > 0 ? rowLength : width) * pixel + rowAlignment - 1) /
+      rowAlignment * rowAlignment;
+  return size_t(skipRows + height - 1) * rowBytes +
+         size_t(skipPixels + width) * pixel;
+}
+
+// True if pixels is an offset in the buffer bound to GL_PIXEL_UNPACK_BUFFER
+bool unpackBufferBound()
+{
+  GLint buffer = 0;
+  glGetIntegerv(GL_PIXEL_UNPACK_BUFFER_BINDING, &buffer);
+  return buffer != 0;
+}
+
+// Records waiting to be written to the file, and the state of the capture
+struct Recorder
+{
+  std::mutex mutex;
+  std::atomic<bool> recording{false};
+  bool started = false; // Once, extensions stay wrapped after
+  const GLFWHandle *handle = nullptr;
+  std::vector<const void *> contexts; // Of the records, the first one's main
+
+  fs::path path;
+  std::ofstream file;
+  std::vector<unsigned char> records;
+  size_t base = 0; // Offset in the file of records
+  bool failed = false;
+
+  // Writes to mapped buffers recorded before their bytes, by id
+  struct MappedWrite
+  {
+    size_t position; // Of the bytes in the file
+    size_t size;
+    const void *data;
+  };
+  std::map<size_t, MappedWrite> mappedWrites;
+  size_t nextMappedWrite = 1;
+
+  // Uniform locations of glGetProgramResourceiv, by program and resource
+  // index, recorded with the name of glGetProgramResourceName
+  std::map<std::pair<GLuint, GLuint>, GLint> resourceLocations;
+
+  template <typename T> void put(const T &value)
+  {
+    const auto *bytes = reinterpret_cast<const unsigned char *>(&value);
+    records.insert(records.end(), bytes, bytes + sizeof(T));
+  }
+
+  // Blobs are aligned in the file, what the arrays of the calls replayed
+  // from it read
+  size_t putBlobSize(size_t size)
+  {
+    put(uint64_t(size));
+    while ((base + records.size()) % 8) {
+      records.push_back(0);
+    }
+    return base + records.size();
+  }
+
+  void putBlob(const void *data, size_t size)
+  {
+    putBlobSize(size);
+    const auto *bytes = static_cast<const unsigned char *>(data);
+    records.insert(records.end(), bytes, bytes + size);
+  }
+
+  void putHeader(uint16_t id)
+  {
+    put(id);
+    const auto *context = handle->currentContext();
+    auto found = std::find(contexts.begin(), contexts.end(), context);
+    if (found == contexts.end()) {
+      contexts.push_back(context);
+      found = contexts.end() - 1;
+    }
+    put(uint8_t(std::min(size_t(found - contexts.begin()), size_t(255))));
+  }
+
+  // Write the records, up to the first mapped write still open unless all
+  void write(bool all)
+  {
+    auto size = records.size();
+    if (!all && !mappedWrites.empty()) {
+      size = mappedWrites.begin()->second.position - base;
+    }
+    if (!failed && !file.write(reinterpret_cast<const char *>(records.data()),
+                        std::streamsize(size))) {
+      failed = true;
+      std::cerr << "Unable to write the GL capture to " << path.string()
+                << "\n";
+    }
+    records.erase(records.begin(), records.begin() + ptrdiff_t(size));
+    base += size;
+  }
+};
+
+Recorder recorder;
+
+// A record of the calling thread, written under the lock of the recorder
+// unless the capture stopped
+class Record
+{
+public:
+  explicit Record(uint16_t id) : m_lock(recorder.mutex)
+  {
+    m_recording = recorder.recording;
+    if (m_recording) {
+      recorder.putHeader(id);
+    }
+  }
+
+  ~Record()
+  {
+    if (m_recording && recorder.records.size() >= CAPTURE_FLUSH_BYTES) {
+      recorder.write(false);
+    }
+  }
+
+  Record(const Record &) = delete;
+  Record &operator=(const Record &) = delete;
+
+  template <typename T> void word(T value)
+  {
+    if (m_recording) {
+      recorder.put(toWord(value));
+    }
+  }
+
+  // Size then bytes, null data for none
+  void blob(const void *data, size_t size)
+  {
+    if (m_recording) {
+      recorder.putBlob(data, data ? size : 0);
+    }
+  }
+
+  void string(const char *text, GLint length = -1)
+  {
+    blob(text, text ? (length < 0 ? std::strlen(text) : size_t(length)) : 0);
+  }
+
+private:
+  std::unique_lock<std::mutex> m_lock;
+  bool m_recording = false;
+};
+
+// Records of a capture file
+struct Reader
+{
+  const unsigned char *start = nullptr;
+  const unsigned char *position = nullptr;
+  const unsigned char *end = nullptr;
+  bool failed = false;
+
+  const unsigned char *bytes(size_t size)
+  {
+    if (size > size_t(end - position)) {
+      failed = true;
+      position = end;
+      return nullptr;
+    }
+    const auto *data = position;
+    position += size;
+    return data;
+  }
+
+  template <typename T> T value()
+  {
+    T result{};
+    if (const auto *data = bytes(sizeof(T))) {
+      std::memcpy(&result, data, sizeof(T));
+    }
+    return result;
+  }
+
+  // Null if empty, see Recorder::putBlob
+  const unsigned char *blob(size_t &size)
+  {
+    size = size_t(value<uint64_t>());
+    while (size_t(position - start) % 8) {
+      bytes(1);
+    }
+    const auto *data = bytes(size);
+    return size ? data : nullptr;
+  }
+
+  std::string string()
+  {
+    size_t size;
+    const auto *data = blob(size);
+    return data ? std::string(reinterpret_cast<const char *>(data), size)
+                : std::string();
+  }
+};
+
+bool readInfo(Reader &reader, GLCaptureInfo &info, std::string &err)
+{
+  const auto *magic = reader.bytes(sizeof(CAPTURE_MAGIC));
+  if (!magic ||
+      std::memcmp(magic, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) != 0) {
+    err = "Not a GL capture";
+    return false;
+  }
+  if (reader.value<uint32_t>() != CAPTURE_VERSION) {
+    err = "GL capture of another version";
+    return false;
+  }
+  info.width = int(reader.value<uint32_t>());
+  info.height = int(reader.value<uint32_t>());
+  info.samples = int(reader.value<uint32_t>());
+  info.renderer = reader.string();
+  if (reader.failed) {
+    err = "Truncated GL capture";
+    return false;
+  }
+  return true;
+}
+
+// Plays records in the contexts of a handle, with the objects named by this
+// driver in place of the captured names
+class Replayer
+{
+public:
+  explicit Replayer(GLFWHandle &handle) : m_handle(handle)
+  {
+    m_contexts.push_back(handle.context());
+  }
+
+  ~Replayer()
+  {
+    makeCurrent(0);
+    for (size_t i = 1; i < m_contexts.size(); ++i) {
+      m_handle.destroySharedContext(m_contexts[i]);
+    }
+  }
+
+  Replayer(const Replayer &) = delete;
+  Replayer &operator=(const Replayer &) = delete;
+
+  // Play records until one of id until, false on errors
+  bool play(Reader &reader, uint16_t until, size_t &calls, std::string &err);
+
+  bool makeCurrent(uint8_t context)
+  {
+    if (context == m_context) {
+      return true;
+    }
+    // Fences of a context are waited for by others once flushed
+    glFlush();
+    while (m_contexts.size() <= context) {
+      auto *shared = m_handle.createSharedContext();
+      if (!shared) {
+        return false;
+      }
+      m_contexts.push_back(shared);
+    }
+    m_handle.makeContextCurrent(m_contexts[context]);
+    m_context = context;
+    return true;
+  }
+
+  // Replace the captured names of words by those of the replay, false if the
+  // call must be left out
+  bool translate(const char *kinds, uint64_t *words, size_t count)
+  {
+    // Locations and blocks are of the program argument, or the current one
+    auto program = m_programs[m_context];
+    for (size_t i = 0; i < count; ++i) {
+      if (kinds[i] == 'p' || kinds[i] == 'P') {
+        program = words[i];
+        break;
+      }
+    }
+    for (size_t i = 0; i < count; ++i) {
+      switch (kinds[i]) {
+      case 'v':
+        break;
+      case 'l':
+      case 'L':
+        words[i] = toWord(location(program, fromWord<GLint>(words[i])));
+        break;
+      case 'k': {
+        const auto found =
+            m_blocks.find({program, fromWord<GLuint>(words[i])});
+        if (found != m_blocks.end()) {
+          words[i] = toWord(found->second);
+        }
+        break;
+      }
+      case 'i':
+        words[i] = name(fromWord<GLenum>(words[i + 1]) == GL_RENDERBUFFER
+                            ? 'r'
+                            : 't',
+            words[i]);
+        break;
+      case 'P':
+        m_programs[m_context] = words[i];
+        words[i] = name('p', words[i]);
+        break;
+      case 'y':
+      case 'Y': {
+        // Syncs deleted in the frame are unknown to the next iterations
+        const auto captured = words[i];
+        const auto found = m_names[kindIndex('y')].find(captured);
+        if (found == m_names[kindIndex('y')].end()) {
+          return captured == 0;
+        }
+        words[i] = found->second;
+        if (kinds[i] == 'Y') {
+          m_names[kindIndex('y')].erase(found);
+        }
+        break;
+      }
+      default:
+        words[i] = name(kinds[i], words[i]);
+        break;
+      }
+    }
+    return true;
+  }
+
+  uint64_t name(char kind, uint64_t captured) const
+  {
+    const auto &names = m_names[kindIndex(kind)];
+    const auto found = names.find(key(kind, captured));
+    return found != names.end() ? found->second : captured;
+  }
+
+  // The value returned by a call, named in the replay by replayed
+  void bindResult(const char *kinds, uint64_t captured, uint64_t replayed)
+  {
+    const auto *returned = std::strchr(kinds, '>');
+    if (returned) {
+      bind(returned[1], captured, replayed);
+    }
+  }
+
+  void bind(char kind, uint64_t captured, uint64_t replayed)
+  {
+    auto &names = m_names[kindIndex(kind)];
+    if (kind == 'y') {
+      // The capture deleted the sync before the driver named another one
+      // the same, the replay left it out
+      const auto found = names.find(captured);
+      if (found != names.end()) {
+        glDeleteSync(fromWord<GLsync>(found->second));
+      }
+    } else if (kind == 'p') {
+      forgetProgram(captured);
+    }
+    names[key(kind, captured)] = replayed;
+  }
+
+  void unmap(GLuint buffer) { m_mappings.erase(buffer); }
+
+  void bindLocation(uint64_t program, GLint captured, GLint replayed)
+  {
+    m_locations[{program, captured}] = replayed;
+  }
+
+  void bindBlock(uint64_t program, GLuint captured, GLuint replayed)
+  {
+    m_blocks[{program, captured}] = replayed;
+  }
+
+  void write(Reader &reader);
+
+private:
+  static size_t kindIndex(char kind)
+  {
+    static const char kinds[] = "btspfrayq";
+    const auto *found = std::strchr(kinds, kind);
+    return found ? size_t(found - kinds) : 0;
+  }
+
+  // Vertex arrays, framebuffers and queries are not shared by contexts
+  uint64_t key(char kind, uint64_t name) const
+  {
+    return kind == 'a' || kind == 'f' || kind == 'q'
+               ? name | uint64_t(m_context) << 32
+               : name;
+  }
+
+  // Locations of the elements of arrays follow that of the first one, those
+  // not recorded are offset from the nearest recorded one below
+  GLint location(uint64_t program, GLint captured) const
+  {
+    if (captured < 0) {
+      return captured;
+    }
+    auto found = m_locations.upper_bound({program, captured});
+    if (found == m_locations.begin()) {
+      return captured;
+    }
+    --found;
+    if (found->first.first != program || found->second < 0) {
+      return captured;
+    }
+    return found->second + (captured - found->first.second);
+  }
+
+  void forgetProgram(uint64_t program)
+  {
+    m_locations.erase(m_locations.lower_bound({program, INT_MIN}),
+        m_locations.lower_bound({program + 1, INT_MIN}));
+    m_blocks.erase(m_blocks.lower_bound({program, 0}),
+        m_blocks.lower_bound({program + 1, 0}));
+  }
+
+  GLFWHandle &m_handle;
+  std::vector<void *> m_contexts; // Of the capture, created on first use
+  uint8_t m_context = 0; // Current
+  std::array<uint64_t, 256> m_programs{}; // Current one of each context
+  std::unordered_map<uint64_t, uint64_t> m_names[9]; // By kindIndex
+  std::map<std::pair<uint64_t, GLint>, GLint> m_locations;
+  std::map<std::pair<uint64_t, GLuint>, GLuint> m_blocks;
+  std::unordered_map<GLuint, unsigned char *> m_mappings; // Of buffers
+};
+
+const char *callKinds(uint16_t id);
+
+// Calls whose arguments are words, see GL_CAPTURE_GENERIC_CALLS
+template <uint16_t Id, typename Function, bool PackBufferOnly = false>
+struct Generic;
+
+template <uint16_t Id, typename R, typename... A, bool PackBufferOnly>
+struct Generic<Id, R(APIENTRYP)(A...), PackBufferOnly>
+{
+  static const size_t arity = sizeof...(A);
+
+  static R APIENTRY wrapper(A... args)
+  {
+    const auto original = reinterpret_cast<R(APIENTRYP)(A...)>(originals[Id]);
+    if (!recorder.recording) {
+      return original(args...);
+    }
+    if constexpr (std::is_void<R>::value) {
+      original(args...);
+      record(args...);
+    } else {
+      const auto result = original(args...);
+      Record record(Id);
+      (record.word(args), ...);
+      record.word(result);
+      return result;
+    }
+  }
+
+  static void record(A... args)
+  {
+    if (PackBufferOnly) {
+      GLint buffer = 0;
+      glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &buffer);
+      if (!buffer) {
+        return;
+      }
+    }
+    Record record(Id);
+    (record.word(args), ...);
+  }
+
+  static void replay(Replayer &replayer, Reader &reader)
+  {
+    const size_t count = arity + (std::is_void<R>::value ? 0 : 1);
+    std::array<uint64_t, count + 1> words{};
+    for (size_t i = 0; i < count; ++i) {
+      words[i] = reader.value<uint64_t>();
+    }
+    const auto *kinds = callKinds(Id);
+    if (!replayer.translate(kinds, words.data(), arity)) {
+      return;
+    }
+    call(replayer, kinds, words.data(), std::index_sequence_for<A...>());
+  }
+
+  template <size_t... I>
+  static void call(Replayer &replayer, const char *kinds,
+      const uint64_t *words, std::index_sequence<I...>)
+  {
+    const auto original = reinterpret_cast<R(APIENTRYP)(A...)>(originals[Id]);
+    if constexpr (std::is_void<R>::value) {
+      original(fromWord<A>(words[I])...);
+    } else {
+      const auto result = original(fromWord<A>(words[I])...);
+      replayer.bindResult(kinds, words[arity], toWord(result));
+    }
+  }
+};
+
+template <uint16_t Id, char Kind> struct Gen
+{
+  typedef void(APIENTRYP Function)(GLsizei n, GLuint *names);
+
+  static void APIENTRY wrapper(GLsizei n, GLuint *names)
+  {
+    reinterpret_cast<Function>(originals[Id])(n, names);
+    if (recorder.recording) {
+      Record record(Id);
+      record.blob(names, size_t(std::max(n, 0)) * sizeof(GLuint));
+    }
+  }
+
+  static void replay(Replayer &replayer, Reader &reader)
+  {
+    size_t size;
+    const auto *captured = reader.blob(size);
+    std::vector<GLuint> names(size / sizeof(GLuint));
+    if (names.empty()) {
+      return;
+    }
+    reinterpret_cast<Function>(originals[Id])(
+        GLsizei(names.size()), names.data());
+    for (size_t i = 0; i < names.size(); ++i) {
+      GLuint name;
+      std::memcpy(&name, captured + i * sizeof(GLuint), sizeof(GLuint));
+      replayer.bind(Kind, name, names[i]);
+    }
+  }
+};
+
+template <uint16_t Id, char Kind> struct Delete
+{
+  typedef void(APIENTRYP Function)(GLsizei n, const GLuint *names);
+
+  static void APIENTRY wrapper(GLsizei n, const GLuint *names)
+  {
+    reinterpret_cast<Function>(originals[Id])(n, names);
+    if (recorder.recording) {
+      Record record(Id);
+      record.blob(names, size_t(std::max(n, 0)) * sizeof(GLuint));
+    }
+  }
+
+  static void replay(Replayer &replayer, Reader &reader)
+  {
+    size_t size;
+    const auto *captured = reader.blob(size);
+    std::vector<GLuint> names(size / sizeof(GLuint));
+    for (size_t i = 0; i < names.size(); ++i) {
+      GLuint name;
+      std::memcpy(&name, captured + i * sizeof(GLuint), sizeof(GLuint));
+      names[i] = GLuint(replayer.name(Kind, name));
+      if (Kind == 'b') {
+        replayer.unmap(names[i]);
+      }
+    }
+    if (!names.empty()) {
+      reinterpret_cast<Function>(originals[Id])(
+          GLsizei(names.size()), names.data());
+    }
+  }
+};
+
+// glProgramUniform*v of vectors of Components T
+template <uint16_t Id, typename T, size_t Components> struct ProgramUniformVector
+{
+  typedef void(APIENTRYP Function)(
+      GLuint program, GLint location, GLsizei count, const T *value);
+
+  static void APIENTRY wrapper(
+      GLuint program, GLint location, GLsizei count, const T *value)
+  {
+    reinterpret_cast<Function>(originals[Id])(program, location, count, value);
+    if (recorder.recording) {
+      Record record(Id);
+      record.word(program);
+      record.word(location);
+      record.word(count);
+      record.blob(value, size_t(std::max(count, 0)) * Components * sizeof(T));
+    }
+  }
+
+  static void replay(Replayer &replayer, Reader &reader)
+  {
+    uint64_t words[3];
+    for (auto &word : words) {
+      word = reader.value<uint64_t>();
+    }
+    size_t size;
+    const auto *value = reader.blob(size);
+    replayer.translate("plv", words, 3);
+    reinterpret_cast<Function>(originals[Id])(fromWord<GLuint>(words[0]),
+        fromWord<GLint>(words[1]), fromWord<GLsizei>(words[2]),
+        reinterpret_cast<const T *>(value));
+  }
+};
+
+// glProgramUniformMatrix*fv of Size by Size matrices
+template <uint16_t Id, size_t Size> struct ProgramUniformMatrix
+{
+  typedef void(APIENTRYP Function)(GLuint program, GLint location,
+      GLsizei count, GLboolean transpose, const GLfloat *value);
+
+  static void APIENTRY wrapper(GLuint program, GLint location, GLsizei count,
+      GLboolean transpose, const GLfloat *value)
+  {
+    reinterpret_cast<Function>(originals[Id])(
+        program, location, count, transpose, value);
+    if (recorder.recording) {
+      Record record(Id);
+      record.word(program);
+      record.word(location);
+      record.word(count);
+      record.word(transpose);
+      record.blob(
+          value, size_t(std::max(count, 0)) * Size * Size * sizeof(GLfloat));
+    }
+  }
+
+  static void replay(Replayer &replayer, Reader &reader)
+  {
+    uint64_t words[4];
+    for (auto &word : words) {
+      word = reader.value<uint64_t>();
+    }
+    size_t size;
+    const auto *value = reader.blob(size);
+    replayer.translate("plvv", words, 4);
+    reinterpret_cast<Function>(originals[Id])(fromWord<GLuint>(words[0]),
+        fromWord<GLint>(words[1]), fromWord<GLsizei>(words[2]),
+        fromWord<GLboolean>(words[3]),
+        reinterpret_cast<const GLfloat *>(value));
+  }
+};
+
+typedef ProgramUniformVector<CallProgramUniform2fv, GLfloat, 2>
+    ProgramUniform2fv;
+typedef ProgramUniformVector<CallProgramUniform2iv, GLint, 2>
+    ProgramUniform2iv;
+typedef ProgramUniformVector<CallProgramUniform3fv, GLfloat, 3>
+    ProgramUniform3fv;
+typedef ProgramUniformVector<CallProgramUniform3iv, GLint, 3>
+    ProgramUniform3iv;
+typedef ProgramUniformVector<CallProgramUniform4fv, GLfloat, 4>
+    ProgramUniform4fv;
+typedef ProgramUniformVector<CallProgramUniform4iv, GLint, 4>
+    ProgramUniform4iv;
+typedef ProgramUniformMatrix<CallProgramUniformMatrix3fv, 3>
+    ProgramUniformMatrix3fv;
+typedef ProgramUniformMatrix<CallProgramUniformMatrix4fv, 4>
+    ProgramUniformMatrix4fv;
+
+// The uniforms of the GUI, set on the current program
+struct UniformMatrix4fv
+{
+  static void APIENTRY wrapper(GLint location, GLsizei count,
+      GLboolean transpose, const GLfloat *value)
+  {
+    GL_CAPTURE_ORIGINAL(UniformMatrix4fv)(location, count, transpose, value);
+    if (recorder.recording) {
+      Record record(CallUniformMatrix4fv);
+      record.word(location);
+      record.word(count);
+      record.word(transpose);
+      record.blob(value, size_t(std::max(count, 0)) * 16 * sizeof(GLfloat));
+    }
+  }
+
+  static void replay(Replayer &replayer, Reader &reader)
+  {
+    uint64_t words[3];
+    for (auto &word : words) {
+      word = reader.value<uint64_t>();
+    }
+    size_t size;
+    const auto *value = reader.blob(size);
+    replayer.translate("Lvv", words, 3);
+    GL_CAPTURE_ORIGINAL(UniformMatrix4fv)(fromWord<GLint>(words[0]),
+        fromWord<GLsizei>(words[1]), fromWord<GLboolean>(words[2]),
+        reinterpret_cast<const GLfloat *>(value));
+  }
+};
+
+struct BufferData
+{
+  static void APIENTRY wrapper(
+      GLenum target, GLsizeiptr size, const void *data, GLenum usage)
+  {
+    GL_CAPTURE_ORIGINAL(BufferData)(target, size, data, usage);
+    if (recorder.recording) {
+      Record record(CallBufferData);
+      record.word(target);
+      record.word(size);
+      record.word(usage);
+      record.blob(data, size_t(size));
+    }
+  }
+
+  static void replay(Replayer &, Reader &reader)
+  {
+    const auto target = GLenum(reader.value<uint64_t>());
+    const auto size = GLsizeiptr(reader.value<uint64_t>());
+    const auto usage = GLenum(reader.value<uint64_t>());
+    size_t dataSize;
+    const auto *data = reader.blob(dataSize);
+    GL_CAPTURE_ORIGINAL(BufferData)(target, size, data, usage);
+  }
+};
+
+struct BufferSubData
+{
+  static void APIENTRY wrapper(
+      GLenum target, GLintptr offset, GLsizeiptr size, const void *data)
+  {
+    GL_CAPTURE_ORIGINAL(BufferSubData)(target, offset, size, data);
+    if (recorder.recording) {
+      Record record(CallBufferSubData);
+      record.word(target);
+      record.word(offset);
+      record.blob(data, size_t(size));
+    }
+  }
+
+  static void replay(Replayer &, Reader &reader)
+  {
+    const auto target = GLenum(reader.value<uint64_t>());
+    const auto offset = GLintptr(reader.value<uint64_t>());
+    size_t size;
+    const auto *data = reader.blob(size);
+    GL_CAPTURE_ORIGINAL(BufferSubData)(target, offset, GLsizeiptr(size), data);
+  }
+};
+
+struct BufferStorage
+{
+  static void APIENTRY wrapper(
+      GLenum target, GLsizeiptr size, const void *data, GLbitfield flags)
+  {
+    GL_CAPTURE_ORIGINAL(BufferStorage)(target, size, data, flags);
+    if (recorder.recording) {
+      Record record(CallBufferStorage);
+      record.word(target);
+      record.word(size);
+      record.word(flags);
+      record.blob(data, size_t(size));
+    }
+  }
+
+  static void replay(Replayer &, Reader &reader)
+  {
+    const auto target = GLenum(reader.value<uint64_t>());
+    const auto size = GLsizeiptr(reader.value<uint64_t>());
+    const auto flags = GLbitfield(reader.value<uint64_t>());
+    size_t dataSize;
+    const auto *data = reader.blob(dataSize);
+    GL_CAPTURE_ORIGINAL(BufferStorage)(target, size, data, flags);
+  }
+};
+
+// Pixels of an upload: bytes of client memory, or an offset in the unpack
+// buffer
+void recordPixels(Record &record, const void *pixels, size_t size)
+{
+  const bool inBuffer = !pixels || unpackBufferBound();
+  record.word(inBuffer ? pixels : nullptr);
+  record.blob(inBuffer ? nullptr : pixels, size);
+}
+
+const void *readPixels(Reader &reader)
+{
+  const auto offset = fromWord<const void *>(reader.value<uint64_t>());
+  size_t size;
+  const auto *data = reader.blob(size);
+  return data ? data : offset;
+}
+
+struct TexImage2D
+{
+  static void APIENTRY wrapper(GLenum target, GLint level,
+      GLint internalformat, GLsizei width, GLsizei height, GLint border,
+      GLenum format, GLenum type, const void *pixels)
+  {
+    GL_CAPTURE_ORIGINAL(TexImage2D)(target, level, internalformat, width,
+        height, border, format, type, pixels);
+    if (recorder.recording) {
+      const auto size = unpackedBytes(width, height, format, type);
+      Record record(CallTexImage2D);
+      for (const auto word : {GLint(target), level, internalformat, width,
+               height, border, GLint(format), GLint(type)}) {
+        record.word(word);
+      }
+      recordPixels(record, pixels, size);
+    }
+  }
+
+  static void replay(Replayer &, Reader &reader)
+  {
+    GLint words[8];
+    for (auto &word : words) {
+      word = fromWord<GLint>(reader.value<uint64_t>());
+    }
+    const auto *pixels = readPixels(reader);
+    GL_CAPTURE_ORIGINAL(TexImage2D)(GLenum(words[0]), words[1], words[2],
+        words[3], words[4], words[5], GLenum(words[6]), GLenum(words[7]),
+        pixels);
+  }
+};
+
+struct TexSubImage2D
+{
+  static void APIENTRY wrapper(GLenum target, GLint level, GLint xoffset,
+      GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type,
+      const void *pixels)
+  {
+    GL_CAPTURE_ORIGINAL(TexSubImage2D)(target, level, xoffset, yoffset, width,
+        height, format, type, pixels);
+    if (recorder.recording) {
+      const auto size = unpackedBytes(width, height, format, type);
+      Record record(CallTexSubImage2D);
+      for (const auto word : {GLint(target), level, xoffset, yoffset, width,
+               height, GLint(format), GLint(type)}) {
+        record.word(word);
+      }
+      recordPixels(record, pixels, size);
+    }
+  }
+
+  static void replay(Replayer &, Reader &reader)
+  {
+    GLint words[8];
+    for (auto &word : words) {
+      word = fromWord<GLint>(reader.value<uint64_t>());
+    }
+    const auto *pixels = readPixels(reader);
+    GL_CAPTURE_ORIGINAL(TexSubImage2D)(GLenum(words[0]), words[1], words[2],
+        words[3], words[4], words[5], GLenum(words[6]), GLenum(words[7]),
+        pixels);
+  }
+};
+
+struct CompressedTexSubImage2D
+{
+  static void APIENTRY wrapper(GLenum target, GLint level, GLint xoffset,
+      GLint yoffset, GLsizei width, GLsizei height, GLenum format,
+      GLsizei imageSize, const void *data)
+  {
+    GL_CAPTURE_ORIGINAL(CompressedTexSubImage2D)(target, level, xoffset,
+        yoffset, width, height, format, imageSize, data);
+    if (recorder.recording) {
+      Record record(CallCompressedTexSubImage2D);
+      for (const auto word : {GLint(target), level, xoffset, yoffset, width,
+               height, GLint(format), imageSize}) {
+        record.word(word);
+      }
+      recordPixels(record, data, size_t(std::max(imageSize, 0)));
+    }
+  }
+
+  static void replay(Replayer &, Reader &reader)
+  {
+    GLint words[8];
+    for (auto &word : words) {
+      word = fromWord<GLint>(reader.value<uint64_t>());
+    }
+    const auto *data = readPixels(reader);
+    GL_CAPTURE_ORIGINAL(CompressedTexSubImage2D)(GLenum(words[0]), words[1],
+        words[2], words[3], words[4], words[5], GLenum(words[6]), words[7],
+        data);
+  }
+};
+
+// glClearBuffer*v of one drawbuffer, 4 values for colors and 1 for depth or
+// stencil
+template <uint16_t Id, typename T> struct ClearBuffer
+{
+  typedef void(APIENTRYP Function)(
+      GLenum buffer, GLint drawbuffer, const T *value);
+
+  static void APIENTRY wrapper(GLenum buffer, GLint drawbuffer, const T *value)
+  {
+    reinterpret_cast<Function>(originals[Id])(buffer, drawbuffer, value);
+    if (recorder.recording) {
+      Record record(Id);
+      record.word(buffer);
+      record.word(drawbuffer);
+      record.blob(value, (buffer == GL_COLOR ? 4 : 1) * sizeof(T));
+    }
+  }
+
+  static void replay(Replayer &, Reader &reader)
+  {
+    const auto buffer = GLenum(reader.value<uint64_t>());
+    const auto drawbuffer = GLint(reader.value<uint64_t>());
+    size_t size;
+    const auto *value = reader.blob(size);
+    reinterpret_cast<Function>(originals[Id])(
+        buffer, drawbuffer, reinterpret_cast<const T *>(value));
+  }
+};
+
+typedef ClearBuffer<CallClearBufferfv, GLfloat> ClearBufferfv;
+typedef ClearBuffer<CallClearBufferuiv, GLuint> ClearBufferuiv;
+
+struct ClearBufferSubData
+{
+  static void APIENTRY wrapper(GLenum target, GLenum internalformat,
+      GLintptr offset, GLsizeiptr size, GLenum format, GLenum type,
+      const void *data)
+  {
+    GL_CAPTURE_ORIGINAL(ClearBufferSubData)(
+        target, internalformat, offset, size, format, type, data);
+    if (recorder.recording) {
+      Record record(CallClearBufferSubData);
+      record.word(target);
+      record.word(internalformat);
+      record.word(offset);
+      record.word(size);
+      record.word(format);
+      record.word(type);
+      record.blob(data, pixelBytes(format, type));
+    }
+  }
+
+  static void replay(Replayer &, Reader &reader)
+  {
+    const auto target = GLenum(reader.value<uint64_t>());
+    const auto internalformat = GLenum(reader.value<uint64_t>());
+    const auto offset = GLintptr(reader.value<uint64_t>());
+    const auto size = GLsizeiptr(reader.value<uint64_t>());
+    const auto format = GLenum(reader.value<uint64_t>());
+    const auto type = GLenum(reader.value<uint64_t>());
+    size_t dataSize;
+    const auto *data = reader.blob(dataSize);
+    GL_CAPTURE_ORIGINAL(ClearBufferSubData)(
+        target, internalformat, offset, size, format, type, data);
+  }
+};
+
+struct DrawBuffers
+{
+  static void APIENTRY wrapper(GLsizei n, const GLenum *bufs)
+  {
+    GL_CAPTURE_ORIGINAL(DrawBuffers)(n, bufs);
+    if (recorder.recording) {
+      Record record(CallDrawBuffers);
+      record.blob(bufs, size_t(std::max(n, 0)) * sizeof(GLenum));
+    }
+  }
+
+  static void replay(Replayer &, Reader &reader)
+  {
+    size_t size;
+    const auto *bufs = reader.blob(size);
+    GL_CAPTURE_ORIGINAL(DrawBuffers)(GLsizei(size / sizeof(GLenum)),
+        reinterpret_cast<const GLenum *>(bufs));
+  }
+};
+
+struct ShaderSource
+{
+  static void APIENTRY wrapper(GLuint shader, GLsizei count,
+      const GLchar *const *string, const GLint *length)
+  {
+    GL_CAPTURE_ORIGINAL(ShaderSource)(shader, count, string, length);
+    if (recorder.recording) {
+      Record record(CallShaderSource);
+      record.word(shader);
+      record.word(count);
+      for (GLsizei i = 0; i < count; ++i) {
+        record.string(string[i], length ? length[i] : -1);
+      }
+    }
+  }
+
+  static void replay(Replayer &replayer, Reader &reader)
+  {
+    const auto shader = GLuint(replayer.name('p', reader.value<uint64_t>()));
+    const auto count = size_t(reader.value<uint64_t>());
+    std::vector<const GLchar *> strings;
+    std::vector<GLint> lengths;
+    for (size_t i = 0; i < count && !reader.failed; ++i) {
+      size_t size;
+      const auto *data = reader.blob(size);
+      strings.push_back(data ? reinterpret_cast<const GLchar *>(data) : "");
+      lengths.push_back(GLint(size));
+    }
+    GL_CAPTURE_ORIGINAL(ShaderSource)(
+        shader, GLsizei(strings.size()), strings.data(), lengths.data());
+  }
+};
+
+struct BindAttribLocation
+{
+  static void APIENTRY wrapper(
+      GLuint program, GLuint index, const GLchar *name)
+  {
+    GL_CAPTURE_ORIGINAL(BindAttribLocation)(program, index, name);
+    if (recorder.recording) {
+      Record record(CallBindAttribLocation);
+      record.word(program);
+      record.word(index);
+      record.string(name);
+    }
+  }
+
+  static void replay(Replayer &replayer, Reader &reader)
+  {
+    const auto program = GLuint(replayer.name('p', reader.value<uint64_t>()));
+    const auto index = GLuint(reader.value<uint64_t>());
+    const auto name = reader.string();
+    GL_CAPTURE_ORIGINAL(BindAttribLocation)(program, index, name.c_str());
+  }
+};
+
+struct PushDebugGroup
+{
+  static void APIENTRY wrapper(
+      GLenum source, GLuint id, GLsizei length, const GLchar *message)
+  {
+    GL_CAPTURE_ORIGINAL(PushDebugGroup)(source, id, length, message);
+    if (recorder.recording) {
+      Record record(CallPushDebugGroup);
+      record.word(source);
+      record.word(id);
+      record.string(message, length);
+    }
+  }
+
+  static void replay(Replayer &, Reader &reader)
+  {
+    const auto source = GLenum(reader.value<uint64_t>());
+    const auto id = GLuint(reader.value<uint64_t>());
+    const auto message = reader.string();
+    GL_CAPTURE_ORIGINAL(PushDebugGroup)(
+        source, id, GLsizei(message.size()), message.c_str());
+  }
+};
+
+// Queries recorded as the names of the locations and blocks they return, for
+// the replay to look them up in its programs
+
+void recordLocation(GLuint program, GLint location, const GLchar *name)
+{
+  Record record(RecordUniformLocation);
+  record.word(program);
+  record.word(location);
+  record.string(name);
+}
+
+struct GetUniformLocation
+{
+  static GLint APIENTRY wrapper(GLuint program, const GLchar *name)
+  {
+    const auto location = GL_CAPTURE_ORIGINAL(GetUniformLocation)(program, name);
+    if (recorder.recording && location >= 0) {
+      recordLocation(program, location, name);
+    }
+    return location;
+  }
+};
+
+struct GetProgramResourceiv
+{
+  static void APIENTRY wrapper(GLuint program, GLenum programInterface,
+      GLuint index, GLsizei propCount, const GLenum *props, GLsizei bufSize,
+      GLsizei *length, GLint *params)
+  {
+    GL_CAPTURE_ORIGINAL(GetProgramResourceiv)(program, programInterface,
+        index, propCount, props, bufSize, length, params);
+    if (!recorder.recording || programInterface != GL_UNIFORM) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(recorder.mutex);
+    for (GLsizei i = 0; i < std::min(propCount, bufSize); ++i) {
+      if (props[i] == GL_LOCATION) {
+        recorder.resourceLocations[{program, index}] = params[i];
+      }
+    }
+  }
+};
+
+struct GetProgramResourceName
+{
+  static void APIENTRY wrapper(GLuint program, GLenum programInterface,
+      GLuint index, GLsizei bufSize, GLsizei *length, GLchar *name)
+  {
+    GL_CAPTURE_ORIGINAL(GetProgramResourceName)(
+        program, programInterface, index, bufSize, length, name);
+    if (!recorder.recording || bufSize <= 0) {
+      return;
+    }
+    if (programInterface == GL_UNIFORM_BLOCK) {
+      Record record(RecordUniformBlock);
+      record.word(program);
+      record.word(index);
+      record.string(name);
+    } else if (programInterface == GL_UNIFORM) {
+      GLint location = -1;
+      {
+        std::lock_guard<std::mutex> lock(recorder.mutex);
+        const auto found = recorder.resourceLocations.find({program, index});
+        if (found != recorder.resourceLocations.end()) {
+          location = found->second;
+        }
+      }
+      if (location >= 0) {
+        recordLocation(program, location, name);
+      }
+    }
+  }
+};
+
+struct CallEntry
+{
+  const char *name; // Of the GL function
+  void **glad; // Pointer replaced by the wrapper, null for extensions
+  void *wrapper;
+  // Null for the queries recorded as records of their own
+  void (*replay)(Replayer &replayer, Reader &reader);
+  const char *kinds; // Of generic calls
+  size_t arity; // Idem
+};
+
+template <typename Function> void *address(Function function)
+{
+  return reinterpret_cast<void *>(function);
+}
+
+template <typename Call> void (*replayOf(...))(Replayer &, Reader &)
+{
+  return nullptr;
+}
+
+template <typename Call>
+auto replayOf(int) -> decltype(&Call::replay)
+{
+  return &Call::replay;
+}
+
+#define GL_CAPTURE_GENERIC_ENTRY(name, kinds)                                 \
+  {"gl" #name, reinterpret_cast<void **>(&glad_gl##name),                     \
+      address(&Generic<Call##name, decltype(glad_gl##name)>::wrapper),        \
+      &Generic<Call##name, decltype(glad_gl##name)>::replay, kinds,           \
+      Generic<Call##name, decltype(glad_gl##name)>::arity},
+#define GL_CAPTURE_PACK_ENTRY(name, kinds)                                    \
+  {"gl" #name, reinterpret_cast<void **>(&glad_gl##name),                     \
+      address(&Generic<Call##name, decltype(glad_gl##name), true>::wrapper),  \
+      &Generic<Call##name, decltype(glad_gl##name), true>::replay, kinds,     \
+      Generic<Call##name, decltype(glad_gl##name), true>::arity},
+#define GL_CAPTURE_EXTENSION_ENTRY(name, kinds, Function)                     \
+  {"gl" #name, nullptr, address(&Generic<Call##name, Function>::wrapper),     \
+      &Generic<Call##name, Function>::replay, kinds,                          \
+      Generic<Call##name, Function>::arity},
+#define GL_CAPTURE_OBJECT_ENTRIES(name, kind)                                 \
+  {"glGen" #name, reinterpret_cast<void **>(&glad_glGen##name),               \
+      address(&Gen<CallGen##name, kind>::wrapper),                            \
+      &Gen<CallGen##name, kind>::replay, nullptr, 0},                         \
+      {"glDelete" #name, reinterpret_cast<void **>(&glad_glDelete##name),     \
+          address(&Delete<CallDelete##name, kind>::wrapper),                  \
+          &Delete<CallDelete##name, kind>::replay, nullptr, 0},
+#define GL_CAPTURE_SPECIAL_ENTRY(name)                                        \
+  {"gl" #name, reinterpret_cast<void **>(&glad_gl##name),                     \
+      address(&name::wrapper), replayOf<name>(0), nullptr, 0},
+
+// In the order of RecordId
+const CallEntry callEntries[CallCount] = {
+    GL_CAPTURE_GENERIC_CALLS(GL_CAPTURE_GENERIC_ENTRY)
+        GL_CAPTURE_PACK_CALLS(GL_CAPTURE_PACK_ENTRY)
+            GL_CAPTURE_EXTENSION_CALLS(GL_CAPTURE_EXTENSION_ENTRY)
+                GL_CAPTURE_OBJECT_CALLS(GL_CAPTURE_OBJECT_ENTRIES)
+                    GL_CAPTURE_SPECIAL_CALLS(GL_CAPTURE_SPECIAL_ENTRY)};
+
+const char *callKinds(uint16_t id) { return callEntries[id].kinds; }
+
+void Replayer::write(Reader &reader)
+{
+  const auto buffer = GLuint(name('b', reader.value<uint64_t>()));
+  const auto offset = size_t(reader.value<uint64_t>());
+  size_t size;
+  const auto *data = reader.blob(size);
+  if (!data) {
+    return;
+  }
+
+  // Persistently mapped once, as the capture did
+  auto found = m_mappings.find(buffer);
+  if (found == m_mappings.end()) {
+    GLint previous = 0;
+    glGetIntegerv(GL_COPY_WRITE_BUFFER_BINDING, &previous);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    GLint64 bufferSize = 0;
+    GLint flags = 0;
+    glGetBufferParameteri64v(
+        GL_COPY_WRITE_BUFFER, GL_BUFFER_SIZE, &bufferSize);
+    glGetBufferParameteriv(
+        GL_COPY_WRITE_BUFFER, GL_BUFFER_STORAGE_FLAGS, &flags);
+    unsigned char *mapping = nullptr;
+    if ((flags & GL_MAP_PERSISTENT_BIT) && (flags & GL_MAP_WRITE_BIT)) {
+      mapping = static_cast<unsigned char *>(glMapBufferRange(
+          GL_COPY_WRITE_BUFFER, 0, GLsizeiptr(bufferSize),
+          GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT |
+              (flags & GL_MAP_COHERENT_BIT)));
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, GLuint(previous));
+    found = m_mappings.emplace(buffer, mapping).first;
+  }
+  if (found->second) {
+    std::memcpy(found->second + offset, data, size);
+  }
+}
+
+bool Replayer::play(
+    Reader &reader, uint16_t until, size_t &calls, std::string &err)
+{
+  while (reader.position < reader.end) {
+    const auto id = reader.value<uint16_t>();
+    const auto context = reader.value<uint8_t>();
+    if (reader.failed) {
+      break;
+    }
+    if (id == until) {
+      return true;
+    }
+    if (id < CallCount) {
+      const auto &entry = callEntries[id];
+      if (!entry.replay || !originals[id]) {
+        err = "Unable to replay " + std::string(entry.name) +
+              (entry.replay ? ", not exposed by the driver" : "");
+        return false;
+      }
+      if (!makeCurrent(context)) {
+        err = "Unable to create the contexts of the GL capture";
+        return false;
+      }
+      entry.replay(*this, reader);
+      ++calls;
+      continue;
+    }
+
+    switch (id) {
+    case RecordFrameBegin:
+    case RecordFrameEnd:
+      break;
+    case RecordMappedWrite:
+      write(reader);
+      break;
+    case RecordUniformLocation:
+    case RecordUniformBlock: {
+      const auto program = reader.value<uint64_t>();
+      const auto captured = reader.value<uint64_t>();
+      const auto uniform = reader.string();
+      if (!makeCurrent(context)) {
+        err = "Unable to create the contexts of the GL capture";
+        return false;
+      }
+      const auto replayProgram = GLuint(name('p', program));
+      if (id == RecordUniformLocation) {
+        bindLocation(program, fromWord<GLint>(captured),
+            glGetUniformLocation(replayProgram, uniform.c_str()));
+      } else {
+        bindBlock(program, fromWord<GLuint>(captured),
+            glGetUniformBlockIndex(replayProgram, uniform.c_str()));
+      }
+      break;
+    }
+    default:
+      err = "Unknown record in GL capture";
+      return false;
+    }
+  }
+  err = reader.failed ? "Truncated GL capture" : "The GL capture ends early";
+  return false;
+}
+
+double msSince(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+nlohmann::json timingJson(const TimingSummary &timing)
+{
+  return {{"min", timing.min}, {"average", timing.average},
+      {"p50", timing.p50}, {"p95", timing.p95}, {"p99", timing.p99},
+      {"max", timing.max}};
+}
+
+} // namespace
+
+GLCapture::GLCapture(const GLCaptureOptions &options,
+    const GLFWHandle &handle, int width, int height, int samples) :
+    m_options(options)
+{
+  if (m_options.path.empty()) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(recorder.mutex);
+  if (recorder.recording) {
+    std::cerr << "Unable to capture to " << m_options.path.string()
+              << ", another capture is recording\n";
+    return;
+  }
+  recorder.path = m_options.path;
+  recorder.file.open(m_options.path, std::ios::binary | std::ios::trunc);
+  if (!recorder.file) {
+    std::cerr << "Unable to write the GL capture to "
+              << m_options.path.string() << "\n";
+    return;
+  }
+  recorder.handle = &handle;
+  recorder.contexts.assign(1, handle.currentContext());
+  recorder.records.clear();
+  recorder.base = 0;
+  recorder.failed = false;
+  recorder.mappedWrites.clear();
+  recorder.resourceLocations.clear();
+
+  recorder.records.insert(recorder.records.end(), std::begin(CAPTURE_MAGIC),
+      std::end(CAPTURE_MAGIC));
+  recorder.put(CAPTURE_VERSION);
+  recorder.put(uint32_t(width));
+  recorder.put(uint32_t(height));
+  recorder.put(uint32_t(samples));
+  const auto *renderer =
+      reinterpret_cast<const char *>(glGetString(GL_RENDERER));
+  recorder.putBlob(renderer, renderer ? std::strlen(renderer) : 0);
+
+  for (size_t i = 0; i < CallCount; ++i) {
+    const auto &entry = callEntries[i];
+    assert(!entry.kinds || kindArity(entry.kinds) == entry.arity);
+    if (entry.glad) {
+      originals[i] = *entry.glad;
+      *entry.glad = entry.wrapper;
+    }
+  }
+  recorder.started = true;
+  recorder.recording = true;
+  m_active = true;
+}
+
+GLCapture::~GLCapture()
+{
+  if (m_active) {
+    std::cerr << "The viewer stopped before the frame to capture, "
+              << m_options.path.string() << " has no frame\n";
+    stop();
+  }
+}
+
+void GLCapture::endFrame(bool sceneReady)
+{
+  if (!m_active) {
+    return;
+  }
+  if (!m_frameStarted) {
+    if (sceneReady && m_readyFrames++ == m_options.frame) {
+      Record record(RecordFrameBegin);
+      m_frameStarted = true;
+    }
+    return;
+  }
+  {
+    Record record(RecordFrameEnd);
+  }
+  stop();
+  std::clog << "GL calls of frame " << m_options.frame
+            << " after loading captured to " << m_options.path.string()
+            << "\n";
+}
+
+void GLCapture::stop()
+{
+  std::lock_guard<std::mutex> lock(recorder.mutex);
+  recorder.recording = false;
+  m_active = false;
+  for (size_t i = 0; i < CallCount; ++i) {
+    const auto &entry = callEntries[i];
+    if (entry.glad) {
+      *entry.glad = originals[i];
+    }
+  }
+  // Writes still open get the bytes written so far
+  for (const auto &write : recorder.mappedWrites) {
+    std::memcpy(
+        recorder.records.data() + (write.second.position - recorder.base),
+        write.second.data, write.second.size);
+  }
+  recorder.mappedWrites.clear();
+  recorder.write(true);
+  recorder.file.close();
+  recorder.handle = nullptr;
+}
+
+void *captureGLProcAddress(const char *name, void *address)
+{
+  if (!recorder.started || !address) {
+    return address;
+  }
+  for (size_t i = 0; i < CallCount; ++i) {
+    const auto &entry = callEntries[i];
+    if (!entry.glad && std::strcmp(entry.name, name) == 0) {
+      originals[i] = address;
+      return entry.wrapper;
+    }
+  }
+  return address;
+}
+
+size_t beginCapturedWrite(
+    GLuint buffer, size_t offset, size_t size, const void *data)
+{
+  if (!recorder.recording) {
+    return 0;
+  }
+  std::lock_guard<std::mutex> lock(recorder.mutex);
+  if (!recorder.recording) {
+    return 0;
+  }
+  recorder.putHeader(RecordMappedWrite);
+  recorder.put(toWord(buffer));
+  recorder.put(uint64_t(offset));
+  const auto position = recorder.putBlobSize(size);
+  recorder.records.resize(recorder.records.size() + size);
+  const auto write = recorder.nextMappedWrite++;
+  recorder.mappedWrites[write] = {position, size, data};
+  return write;
+}
+
+void endCapturedWrite(size_t write)
+{
+  if (!write) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(recorder.mutex);
+  const auto found = recorder.mappedWrites.find(write);
+  if (found == recorder.mappedWrites.end()) {
+    return; // Filled when the capture stopped
+  }
+  const auto &mappedWrite = found->second;
+  std::memcpy(recorder.records.data() + (mappedWrite.position - recorder.base),
+      mappedWrite.data, mappedWrite.size);
+  recorder.mappedWrites.erase(found);
+  if (recorder.records.size() >= CAPTURE_FLUSH_BYTES) {
+    recorder.write(false);
+  }
+}
+
+bool readGLCaptureInfo(
+    const fs::path &path, GLCaptureInfo &info, std::string &err)
+{
+  MappedFile file(path);
+  if (!file.isOpen()) {
+    err = "Unable to read " + path.string();
+    return false;
+  }
+  Reader reader{file.data(), file.data(), file.data() + file.size()};
+  if (!readInfo(reader, info, err)) {
+    err += ": " + path.string();
+    return false;
+  }
+  return true;
+}
+
+bool replayGLCapture(GLFWHandle &handle, const fs::path &path,
+    const GLReplayOptions &options, GLReplayReport &report, std::string &err)
+{
+  MappedFile file(path);
+  if (!file.isOpen()) {
+    err = "Unable to read " + path.string();
+    return false;
+  }
+  Reader reader{file.data(), file.data(), file.data() + file.size()};
+  GLCaptureInfo info;
+  if (!readInfo(reader, info, err)) {
+    err += ": " + path.string();
+    return false;
+  }
+  report.capture = path.string();
+  report.capturedRenderer = info.renderer;
+  if (const auto *renderer = glGetString(GL_RENDERER)) {
+    report.renderer = reinterpret_cast<const char *>(renderer);
+  }
+  report.width = info.width;
+  report.height = info.height;
+  report.iterations = options.iterations;
+
+  for (size_t i = 0; i < CallCount; ++i) {
+    const auto &entry = callEntries[i];
+    originals[i] = entry.glad ? *entry.glad : getGLProcAddress(entry.name);
+  }
+
+  Replayer replayer(handle);
+  // Everything before the frame, loading and the frames drawn first
+  if (!replayer.play(reader, RecordFrameBegin, report.setupCalls, err)) {
+    err = path.string() + ": " + err;
+    return false;
+  }
+  const auto frame = reader.position;
+
+  const auto count = options.warmupIterations + options.iterations;
+  std::vector<GLuint> queries(2 * options.iterations);
+  replayer.makeCurrent(0);
+  glGenQueries(GLsizei(queries.size()), queries.data());
+  // As many iterations in flight as frames of the bench
+  GLsync fences[2] = {};
+  std::vector<double> cpuTimes;
+  for (size_t i = 0; i < count; ++i) {
+    auto &fence = fences[i % 2];
+    if (fence) {
+      while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                 1000000000) == GL_TIMEOUT_EXPIRED) {
+      }
+      glDeleteSync(fence);
+      fence = nullptr;
+    }
+
+    const bool measured = i >= options.warmupIterations;
+    const auto query = 2 * (i - (measured ? options.warmupIterations : 0));
+    if (measured) {
+      glQueryCounter(queries[query], GL_TIMESTAMP);
+    }
+    const auto start = std::chrono::steady_clock::now();
+    reader.position = frame;
+    size_t calls = 0;
+    if (!replayer.play(reader, RecordFrameEnd, calls, err)) {
+      err = path.string() + ": " + err;
+      return false;
+    }
+    const auto cpuTime = msSince(start);
+    replayer.makeCurrent(0);
+    if (measured) {
+      glQueryCounter(queries[query + 1], GL_TIMESTAMP);
+      cpuTimes.push_back(cpuTime);
+    }
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    report.frameCalls = calls;
+  }
+  glFinish();
+  for (auto fence : fences) {
+    if (fence) {
+      glDeleteSync(fence);
+    }
+  }
+
+  std::vector<double> gpuTimes;
+  for (size_t i = 0; i < options.iterations; ++i) {
+    GLuint64 begin = 0;
+    GLuint64 end = 0;
+    glGetQueryObjectui64v(queries[2 * i], GL_QUERY_RESULT, &begin);
+    glGetQueryObjectui64v(queries[2 * i + 1], GL_QUERY_RESULT, &end);
+    gpuTimes.push_back(double(end - begin) / 1e6);
+  }
+  glDeleteQueries(GLsizei(queries.size()), queries.data());
+  report.cpu = summarizeTimings(cpuTimes);
+  report.gpu = summarizeTimings(gpuTimes);
+  return true;
+}
+
+bool writeGLReplayReport(
+    const GLReplayReport &report, const fs::path &path, std::string &err)
+{
+  std::ofstream file;
+  if (!path.empty()) {
+    file.open(path);
+    if (!file) {
+      err = "Unable to write replay report to " + path.string();
+      return false;
+    }
+  }
+  auto &out = path.empty() ? std::cout : file;
+
+  if (path.extension() == ".json") {
+    const nlohmann::json document = {{"capture", report.capture},
+        {"captured_renderer", report.capturedRenderer},
+        {"renderer", report.renderer}, {"width", report.width},
+        {"height", report.height}, {"iterations", report.iterations},
+        {"setup_calls", report.setupCalls},
+        {"frame_calls", report.frameCalls},
+        {"cpu_ms", timingJson(report.cpu)},
+        {"gpu_ms", timingJson(report.gpu)}};
+    out << document.dump(2) << '\n';
+  } else {
+    // Quoted, GL_RENDERER strings often have commas
+    const auto quoted = [](const std::string &text) {
+      std::string result = "\"";
+      for (const auto c : text) {
+        result += c == '"' ? std::string("\"\"") : std::string(1, c);
+      }
+      return result + "\"";
+    };
+    std::ostringstream header;
+    std::ostringstream values;
+    header << "capture,captured_renderer,renderer,width,height,iterations,"
+              "setup_calls,frame_calls";
+    values << quoted(report.capture) << ',' << quoted(report.capturedRenderer)
+           << ',' << quoted(report.renderer) << ',' << report.width << ','
+           << report.height << ',' << report.iterations << ','
+           << report.setupCalls << ',' << report.frameCalls;
+    for (const auto &timing : {std::make_pair("cpu", &report.cpu),
+             std::make_pair("gpu", &report.gpu)}) {
+      for (const auto &stat :
+          {std::make_pair("min", timing.second->min),
+              std::make_pair("avg", timing.second->average),
+              std::make_pair("p50", timing.second->p50),
+              std::make_pair("p95", timing.second->p95),
+              std::make_pair("p99", timing.second->p99),
+              std::make_pair("max", timing.second->max)}) {
+        header << ',' << timing.first << '_' << stat.first << "_ms";
+        values << ',' << stat.second;
+      }
+    }
+    out << header.str() << '\n' << values.str() << '\n';
+  }
+  if (!out) {
+    err = "Unable to write replay report to " + path.string();
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "bench.hpp"
+#include "filesystem.hpp"
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <string>
+
+class GLFWHandle;
+
+// Capture of the GL calls of the viewer, with the data they read from client
+// memory and the bytes written to persistently mapped buffers, to a file
+// replayed without the viewer: everything from the creation of the context
+// is played once, then the captured frame as many times as asked and timed.
+// It compares drivers on the same calls, and measures their submission alone,
+// without loading or the logic of the app.
+//
+// Calls are recorded in the order they return, from every context, each
+// replayed in a context of its own. Queries and reads to client memory are
+// not recorded; uniform locations and block indices are looked up by name
+// again. Program binaries and bindless texture handles are specific to a
+// driver, the viewer does without them while capturing, and without shading
+// rate images, whose extension is not recorded.
+
+struct GLCaptureOptions
+{
+  fs::path path; // No capture if empty
+  // Frames drawn once the scene has loaded before the one captured
+  size_t frame = 0;
+};
+
+class GLCapture
+{
+public:
+  // Start recording if options.path is set, in the context current on the
+  // calling thread, before any GL object is created. width, height and
+  // samples are those of the default framebuffer, for the replay to create.
+  GLCapture(const GLCaptureOptions &options, const GLFWHandle &handle,
+      int width, int height, int samples);
+  ~GLCapture(); // Writes what was recorded if no frame was
+
+  GLCapture(const GLCapture &) = delete;
+  GLCapture &operator=(const GLCapture &) = delete;
+
+  // True while recording
+  bool active() const { return m_active; }
+
+  // Call once the calls of a frame are submitted, before the swap. Frames
+  // count once sceneReady; the calls of the one after options.frame of them
+  // are the captured frame, the file is written at its end.
+  void endFrame(bool sceneReady);
+
+private:
+  void stop();
+
+  GLCaptureOptions m_options;
+  bool m_active = false;
+  bool m_frameStarted = false;
+  size_t m_readyFrames = 0;
+};
+
+// Entry point of a GL function of an extension, from getGLProcAddress:
+// address, or once a capture started a wrapper recording its calls
+void *captureGLProcAddress(const char *name, void *address);
+
+// Bytes written to a persistently mapped buffer, recorded before the commands
+// that read them: begin with the size and address of the range written, end
+// once written. Return 0 when not capturing.
+size_t beginCapturedWrite(
+    GLuint buffer, size_t offset, size_t size, const void *data);
+void endCapturedWrite(size_t write);
+
+// What a replay needs to create its context
+struct GLCaptureInfo
+{
+  int width = 0;
+  int height = 0;
+  int samples = 0;
+  std::string renderer; // GL_RENDERER of the capture
+};
+
+bool readGLCaptureInfo(
+    const fs::path &path, GLCaptureInfo &info, std::string &err);
+
+struct GLReplayOptions
+{
+  size_t iterations = 100; // Of the frame, timed
+  size_t warmupIterations = 10;
+  fs::path report; // JSON if .json, else CSV, stdout as CSV if empty
+};
+
+struct GLReplayReport
+{
+  std::string capture;
+  std::string capturedRenderer;
+  std::string renderer;
+  int width = 0;
+  int height = 0;
+  size_t iterations = 0;
+  size_t setupCalls = 0; // Before the frame
+  size_t frameCalls = 0;
+  // CPU time of submitting the calls of the frame, decoding included, and GPU
+  // time between timestamps around them
+  TimingSummary cpu;
+  TimingSummary gpu;
+};
+
+// Replay a capture in the context of handle, current on the calling thread,
+// created as readGLCaptureInfo tells
+bool replayGLCapture(GLFWHandle &handle, const fs::path &path,
+    const GLReplayOptions &options, GLReplayReport &report, std::string &err);
+
+bool writeGLReplayReport(
+    const GLReplayReport &report, const fs::path &path, std::string &err);
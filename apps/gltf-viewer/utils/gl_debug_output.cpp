@@ -4,6 +4,7 @@
 #include <glad/glad.h>
 #include <imgui.h>
 #include <iostream>
+#include <mutex>
 #include <tuple>
 #include <unordered_map>
 #include <vector>
@@ -60,11 +61,30 @@ static std::array<std::tuple<const char *, bool, GLenum>, 4> severitySelector =
         std::make_tuple("LOW", true, GL_DEBUG_SEVERITY_LOW),
         std::make_tuple("NOTIFICATION", false, GL_DEBUG_SEVERITY_NOTIFICATION)};
 
+static bool developerMode = false;
+
+// Performance warnings of every context, which call back from their threads
+static std::mutex performanceWarningsMutex;
+static std::vector<GLPerformanceWarning> performanceWarnings;
+
+void setGLDeveloperMode(bool enabled) { developerMode = enabled; }
+
+bool glDeveloperMode() { return developerMode; }
+
+std::vector<GLPerformanceWarning> glPerformanceWarnings()
+{
+  std::lock_guard<std::mutex> lock(performanceWarningsMutex);
+  return performanceWarnings;
+}
+
 void logGLDebugInfo(GLenum source, GLenum type, GLuint id, GLenum severity,
     GLsizei length, const GLchar *message, GLvoid *userParam);
 
 void initGLDebugOutput()
 {
+  if (!developerMode) {
+    return;
+  }
   glDebugMessageCallback((GLDEBUGPROCARB)logGLDebugInfo, nullptr);
   glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
 
@@ -89,6 +109,22 @@ void logGLDebugInfo(GLenum source, GLenum type, GLuint id, GLenum severity,
   const auto typeStr = findStr(type, typeEnumToString);
   const auto severityStr = findStr(severity, severityEnumToString);
 
+  // Drivers repeat them for every draw: only the first of an id is logged,
+  // the GPU profiler panel shows them all with their count
+  if (type == GL_DEBUG_TYPE_PERFORMANCE) {
+    std::lock_guard<std::mutex> lock(performanceWarningsMutex);
+    const auto warning = std::find_if(begin(performanceWarnings),
+        end(performanceWarnings), [&](const GLPerformanceWarning &warning) {
+          return warning.id == id && warning.source == sourceStr;
+        });
+    if (warning != end(performanceWarnings)) {
+      warning->message = message;
+      ++warning->count;
+      return;
+    }
+    performanceWarnings.push_back({id, sourceStr, message, 1});
+  }
+
   std::clog << "OpenGL: " << message << " [source=" << sourceStr
             << " type=" << typeStr << " severity=" << severityStr
             << " id=" << id << "]\n\n";
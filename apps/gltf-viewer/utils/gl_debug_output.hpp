@@ -1,3 +1,29 @@
 #pragma once
 
-void initGLDebugOutput();
\ No newline at end of file
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Contexts are created without debug output by default, which disables fast
+// paths of several drivers, and without error checking when the driver offers
+// GL_KHR_no_error. The developer mode asks for debug contexts instead: set it
+// before the first GLFWHandle, every context of the process follows it.
+void setGLDeveloperMode(bool enabled);
+bool glDeveloperMode();
+
+// Log the debug messages of the context current on the calling thread, in
+// developer mode only. Performance warnings are counted instead, see
+// glPerformanceWarnings.
+void initGLDebugOutput();
+
+// A performance warning of the driver, its repeats counted
+struct GLPerformanceWarning
+{
+  unsigned int id = 0;
+  std::string source;
+  std::string message; // The last one of the id
+  size_t count = 0;
+};
+
+// The warnings of every context so far, in the order they first came
+std::vector<GLPerformanceWarning> glPerformanceWarnings();
@@ -0,0 +1,143 @@
+#include "gl_extensions.hpp"
+
+#include "gl_capture.hpp"
+#include "glfw.hpp"
+
+#include <cstring>
+
+namespace
+{
+
+typedef void(APIENTRYP PFNMAXSHADERCOMPILERTHREADSPROC)(GLuint count);
+typedef void(APIENTRYP PFNMULTIDRAWELEMENTSINDIRECTCOUNTPROC)(GLenum mode,
+    GLenum type, const void *indirect, GLintptr drawCount,
+    GLsizei maxDrawCount, GLsizei stride);
+typedef void(APIENTRYP PFNCLIPCONTROLPROC)(GLenum origin, GLenum depth);
+typedef void(APIENTRYP PFNBINDSHADINGRATEIMAGEPROC)(GLuint texture);
+typedef void(APIENTRYP PFNSHADINGRATEIMAGEPALETTEPROC)(
+    GLuint viewport, GLuint first, GLsizei count, const GLenum *rates);
+
+bool parallelShaderCompile = false;
+PFNMULTIDRAWELEMENTSINDIRECTCOUNTPROC multiDrawElementsIndirectCountProc =
+    nullptr;
+PFNCLIPCONTROLPROC clipControlProc = nullptr;
+PFNBINDSHADINGRATEIMAGEPROC bindShadingRateImageProc = nullptr;
+PFNSHADINGRATEIMAGEPALETTEPROC shadingRateImagePaletteProc = nullptr;
+
+void *(*procAddressLoader)(const char *name) = nullptr;
+
+} // namespace
+
+void *getGLProcAddress(const char *name)
+{
+  return captureGLProcAddress(name,
+      procAddressLoader
+          ? procAddressLoader(name)
+          : reinterpret_cast<void *>(glfwGetProcAddress(name)));
+}
+
+void setGLProcAddressLoader(void *(*loader)(const char *name))
+{
+  procAddressLoader = loader;
+}
+
+bool hasGLExtension(const char *extension)
+{
+  GLint extensionCount = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+  for (GLint i = 0; i < extensionCount; ++i) {
+    const auto *name =
+        reinterpret_cast<const char *>(glGetStringi(GL_EXTENSIONS, GLuint(i)));
+    if (name && std::strcmp(name, extension) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool loadParallelShaderCompile()
+{
+  PFNMAXSHADERCOMPILERTHREADSPROC maxShaderCompilerThreads = nullptr;
+  if (hasGLExtension("GL_KHR_parallel_shader_compile")) {
+    maxShaderCompilerThreads =
+        reinterpret_cast<PFNMAXSHADERCOMPILERTHREADSPROC>(
+            getGLProcAddress("glMaxShaderCompilerThreadsKHR"));
+  } else if (hasGLExtension("GL_ARB_parallel_shader_compile")) {
+    maxShaderCompilerThreads =
+        reinterpret_cast<PFNMAXSHADERCOMPILERTHREADSPROC>(
+            getGLProcAddress("glMaxShaderCompilerThreadsARB"));
+  }
+
+  parallelShaderCompile = maxShaderCompilerThreads != nullptr;
+  if (parallelShaderCompile) {
+    // Implementation-specific number of threads
+    maxShaderCompilerThreads(0xFFFFFFFF);
+  }
+  return parallelShaderCompile;
+}
+
+bool isProgramLinkComplete(GLuint program)
+{
+  if (!parallelShaderCompile) {
+    return true;
+  }
+  GLint status = GL_FALSE;
+  glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &status);
+  return status == GL_TRUE;
+}
+
+bool loadIndirectParameters()
+{
+  multiDrawElementsIndirectCountProc = nullptr;
+  if (hasGLExtension("GL_ARB_indirect_parameters")) {
+    multiDrawElementsIndirectCountProc =
+        reinterpret_cast<PFNMULTIDRAWELEMENTSINDIRECTCOUNTPROC>(
+            getGLProcAddress("glMultiDrawElementsIndirectCountARB"));
+  }
+  return multiDrawElementsIndirectCountProc != nullptr;
+}
+
+void multiDrawElementsIndirectCount(GLenum mode, GLenum type,
+    const void *indirect, GLintptr drawCount, GLsizei maxDrawCount,
+    GLsizei stride)
+{
+  multiDrawElementsIndirectCountProc(
+      mode, type, indirect, drawCount, maxDrawCount, stride);
+}
+
+bool loadClipControl()
+{
+  clipControlProc = nullptr;
+  if (hasGLExtension("GL_ARB_clip_control")) {
+    clipControlProc = reinterpret_cast<PFNCLIPCONTROLPROC>(
+        getGLProcAddress("glClipControl"));
+  }
+  return clipControlProc != nullptr;
+}
+
+void clipControl(GLenum origin, GLenum depth)
+{
+  clipControlProc(origin, depth);
+}
+
+bool loadShadingRateImage()
+{
+  bindShadingRateImageProc = nullptr;
+  shadingRateImagePaletteProc = nullptr;
+  if (hasGLExtension("GL_NV_shading_rate_image")) {
+    bindShadingRateImageProc = reinterpret_cast<PFNBINDSHADINGRATEIMAGEPROC>(
+        getGLProcAddress("glBindShadingRateImageNV"));
+    shadingRateImagePaletteProc =
+        reinterpret_cast<PFNSHADINGRATEIMAGEPALETTEPROC>(
+            getGLProcAddress("glShadingRateImagePaletteNV"));
+  }
+  return bindShadingRateImageProc && shadingRateImagePaletteProc;
+}
+
+void bindShadingRateImage(GLuint texture) { bindShadingRateImageProc(texture); }
+
+void shadingRateImagePalette(
+    GLuint viewport, GLuint first, GLsizei count, const GLenum *rates)
+{
+  shadingRateImagePaletteProc(viewport, first, count, rates);
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <glad/glad.h>
+
+// Extensions glad is not generated with, other than ARB_bindless_texture
+
+// Entry point of a GL function of the current context. glfwGetProcAddress
+// unless another loader is set, which contexts not created by GLFW need.
+void *getGLProcAddress(const char *name);
+void setGLProcAddressLoader(void *(*loader)(const char *name));
+
+// True if the current context exposes extension
+bool hasGLExtension(const char *extension);
+
+// KHR_parallel_shader_compile (or its ARB version): shaders compile and
+// programs link on driver threads, queries of their status no longer block
+// once GL_COMPLETION_STATUS_KHR is true.
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+
+// Load the entry points and let the driver pick its number of compiler
+// threads. Return false if the current context does not expose the extension.
+bool loadParallelShaderCompile();
+
+// True if the link of program, and the compilation of its shaders, is done.
+// Always true without parallel shader compile, the status queries that follow
+// then wait for the driver.
+bool isProgramLinkComplete(GLuint program);
+
+// ARB_indirect_parameters (core in GL 4.6): the number of draws of a multi
+// draw is read from the buffer bound to GL_PARAMETER_BUFFER_ARB, so that they
+// can be compacted by a compute shader.
+#define GL_PARAMETER_BUFFER_ARB 0x80EE
+
+// Load the entry point, return false if the current context does not expose
+// the extension
+bool loadIndirectParameters();
+
+// glMultiDrawElementsIndirectCountARB, drawing the first
+// min(drawCount value, maxDrawCount) commands
+void multiDrawElementsIndirectCount(GLenum mode, GLenum type,
+    const void *indirect, GLintptr drawCount, GLsizei maxDrawCount,
+    GLsizei stride);
+
+// ARB_clip_control (core in GL 4.5): the origin of the window and the range
+// of normalized device depths mapped to the depth range, what reversed depth
+// buffers need for their precision.
+#define GL_NEGATIVE_ONE_TO_ONE 0x935E
+#define GL_ZERO_TO_ONE 0x935F
+
+// Load the entry point, return false if the current context does not expose
+// the extension
+bool loadClipControl();
+
+// glClipControl, origin GL_LOWER_LEFT or GL_UPPER_LEFT and depth
+// GL_NEGATIVE_ONE_TO_ONE or GL_ZERO_TO_ONE
+void clipControl(GLenum origin, GLenum depth);
+
+// NV_shading_rate_image: fragments of the rasterized primitives are shaded
+// once for up to 4x4 pixels, at the rate of the palette entry the texel of an
+// image covering them stores. Coverage and depth stay per sample.
+#define GL_SHADING_RATE_IMAGE_NV 0x9563
+#define GL_SHADING_RATE_NO_INVOCATIONS_NV 0x9564
+#define GL_SHADING_RATE_1_INVOCATION_PER_PIXEL_NV 0x9565
+#define GL_SHADING_RATE_1_INVOCATION_PER_1X2_PIXELS_NV 0x9566
+#define GL_SHADING_RATE_1_INVOCATION_PER_2X1_PIXELS_NV 0x9567
+#define GL_SHADING_RATE_1_INVOCATION_PER_2X2_PIXELS_NV 0x9568
+#define GL_SHADING_RATE_1_INVOCATION_PER_2X4_PIXELS_NV 0x9569
+#define GL_SHADING_RATE_1_INVOCATION_PER_4X2_PIXELS_NV 0x956A
+#define GL_SHADING_RATE_1_INVOCATION_PER_4X4_PIXELS_NV 0x956B
+#define GL_SHADING_RATE_IMAGE_BINDING_NV 0x955B
+#define GL_SHADING_RATE_IMAGE_TEXEL_WIDTH_NV 0x955C
+#define GL_SHADING_RATE_IMAGE_TEXEL_HEIGHT_NV 0x955D
+#define GL_SHADING_RATE_IMAGE_PALETTE_SIZE_NV 0x955E
+#define GL_MAX_COARSE_FRAGMENT_SAMPLES_NV 0x955F
+
+// Load the entry points, return false if the current context does not expose
+// the extension
+bool loadShadingRateImage();
+
+// glBindShadingRateImageNV, a GL_R8UI texture of palette indices, or 0
+void bindShadingRateImage(GLuint texture);
+
+// glShadingRateImagePaletteNV, the rates of entries first to first + count of
+// the palette of viewport
+void shadingRateImagePalette(
+    GLuint viewport, GLuint first, GLsizei count, const GLenum *rates);
@@ -0,0 +1,225 @@
+#pragma once
+
+#include "gpu_memory.hpp"
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Generation and deletion of the objects of a type. Deleted buffers, textures
+// and renderbuffers are untracked from the current GpuMemoryTracker.
+struct GLBufferTraits
+{
+  static void generate(GLsizei n, GLuint *names) { glGenBuffers(n, names); }
+  static void destroy(GLsizei n, const GLuint *names)
+  {
+    untrackBuffers(n, names);
+    glDeleteBuffers(n, names);
+  }
+};
+
+struct GLTextureTraits
+{
+  static void generate(GLsizei n, GLuint *names) { glGenTextures(n, names); }
+  static void destroy(GLsizei n, const GLuint *names)
+  {
+    untrackTextures(n, names);
+    glDeleteTextures(n, names);
+  }
+};
+
+struct GLRenderbufferTraits
+{
+  static void generate(GLsizei n, GLuint *names)
+  {
+    glGenRenderbuffers(n, names);
+  }
+  static void destroy(GLsizei n, const GLuint *names)
+  {
+    untrackRenderbuffers(n, names);
+    glDeleteRenderbuffers(n, names);
+  }
+};
+
+struct GLFramebufferTraits
+{
+  static void generate(GLsizei n, GLuint *names)
+  {
+    glGenFramebuffers(n, names);
+  }
+  static void destroy(GLsizei n, const GLuint *names)
+  {
+    glDeleteFramebuffers(n, names);
+  }
+};
+
+struct GLVertexArrayTraits
+{
+  static void generate(GLsizei n, GLuint *names)
+  {
+    glGenVertexArrays(n, names);
+  }
+  static void destroy(GLsizei n, const GLuint *names)
+  {
+    glDeleteVertexArrays(n, names);
+  }
+};
+
+struct GLSamplerTraits
+{
+  static void generate(GLsizei n, GLuint *names) { glGenSamplers(n, names); }
+  static void destroy(GLsizei n, const GLuint *names)
+  {
+    glDeleteSamplers(n, names);
+  }
+};
+
+struct GLQueryTraits
+{
+  static void generate(GLsizei n, GLuint *names) { glGenQueries(n, names); }
+  static void destroy(GLsizei n, const GLuint *names)
+  {
+    glDeleteQueries(n, names);
+  }
+};
+
+// Owner of a GL object, deleted with the owner like the program of a
+// GLProgram. Converts to the name of the object, 0 if it owns none, so that it
+// is passed to GL functions as is. The context of the object must be current
+// when it is deleted.
+template <typename Traits> class GLObject
+{
+public:
+  GLObject() = default;
+  // Take ownership of an object created elsewhere
+  explicit GLObject(GLuint name) : m_name(name) {}
+  ~GLObject() { reset(); }
+
+  GLObject(const GLObject &) = delete;
+  GLObject &operator=(const GLObject &) = delete;
+
+  GLObject(GLObject &&rvalue) : m_name(rvalue.release()) {}
+  GLObject &operator=(GLObject &&rvalue)
+  {
+    reset(rvalue.release());
+    return *this;
+  }
+
+  operator GLuint() const { return m_name; }
+
+  // Delete the object and create a new one
+  void generate()
+  {
+    reset();
+    Traits::generate(1, &m_name);
+  }
+
+  // Delete the object and own name instead
+  void reset(GLuint name = 0)
+  {
+    if (m_name) {
+      Traits::destroy(1, &m_name);
+    }
+    m_name = name;
+  }
+
+  // Stop owning the object without deleting it
+  GLuint release() { return std::exchange(m_name, 0); }
+
+private:
+  GLuint m_name = 0;
+};
+
+// Owner of an array of GL objects of a type, such as the texture objects of a
+// model, deleted together. Names of 0 are skipped.
+template <typename Traits> class GLObjects
+{
+public:
+  GLObjects() = default;
+  // Take ownership of objects created elsewhere
+  explicit GLObjects(std::vector<GLuint> names) :
+      m_names(std::move(names)), m_owned(m_names.size(), 1)
+  {
+  }
+  ~GLObjects() { reset(); }
+
+  GLObjects(const GLObjects &) = delete;
+  GLObjects &operator=(const GLObjects &) = delete;
+
+  GLObjects(GLObjects &&rvalue) :
+      m_names(std::move(rvalue.m_names)), m_owned(std::move(rvalue.m_owned))
+  {
+    rvalue.m_names.clear();
+    rvalue.m_owned.clear();
+  }
+  GLObjects &operator=(GLObjects &&rvalue)
+  {
+    reset();
+    std::swap(m_names, rvalue.m_names);
+    std::swap(m_owned, rvalue.m_owned);
+    return *this;
+  }
+
+  size_t size() const { return m_names.size(); }
+  bool empty() const { return m_names.empty(); }
+  GLuint operator[](size_t i) const { return m_names[i]; }
+  GLuint back() const { return m_names.back(); }
+  const GLuint *data() const { return m_names.data(); }
+  const std::vector<GLuint> &names() const { return m_names; }
+  std::vector<GLuint>::const_iterator begin() const { return m_names.begin(); }
+  std::vector<GLuint>::const_iterator end() const { return m_names.end(); }
+
+  // Delete the objects and create count new ones
+  void generate(size_t count)
+  {
+    reset();
+    m_names.resize(count);
+    m_owned.assign(count, 1);
+    if (count) {
+      Traits::generate(GLsizei(count), m_names.data());
+    }
+  }
+
+  // Own name at i in place of the object there, which has been deleted
+  // elsewhere, like the texture objects replaced by the TextureStreamer
+  void replace(size_t i, GLuint name)
+  {
+    m_names[i] = name;
+    m_owned[i] = 1;
+  }
+
+  // Stop owning the object at i without deleting it. Its name is still
+  // returned by operator[], to identify an object that has been deleted
+  // elsewhere.
+  void release(size_t i) { m_owned[i] = 0; }
+
+  void reset()
+  {
+    for (size_t i = 0; i < m_names.size(); ++i) {
+      if (m_owned[i] && m_names[i]) {
+        Traits::destroy(1, &m_names[i]);
+      }
+    }
+    m_names.clear();
+    m_owned.clear();
+  }
+
+private:
+  std::vector<GLuint> m_names;
+  std::vector<char> m_owned;
+};
+
+using GLBuffer = GLObject<GLBufferTraits>;
+using GLTexture = GLObject<GLTextureTraits>;
+using GLRenderbuffer = GLObject<GLRenderbufferTraits>;
+using GLFramebuffer = GLObject<GLFramebufferTraits>;
+using GLVertexArray = GLObject<GLVertexArrayTraits>;
+using GLSampler = GLObject<GLSamplerTraits>;
+
+using GLBuffers = GLObjects<GLBufferTraits>;
+using GLTextures = GLObjects<GLTextureTraits>;
+using GLVertexArrays = GLObjects<GLVertexArrayTraits>;
+using GLSamplers = GLObjects<GLSamplerTraits>;
+using GLQueries = GLObjects<GLQueryTraits>;
@@ -0,0 +1,204 @@
+#include "gl_state.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+namespace
+{
+
+// Unknown values, never equal to a value set
+const GLuint UNKNOWN = ~0u;
+const int UNKNOWN_FLAG = -1;
+
+int textureTargetIndex(GLenum target)
+{
+  switch (target) {
+  case GL_TEXTURE_2D:
+    return 0;
+  case GL_TEXTURE_2D_ARRAY:
+    return 1;
+  case GL_TEXTURE_CUBE_MAP:
+    return 2;
+  case GL_TEXTURE_BUFFER:
+    return 3;
+  }
+  return -1;
+}
+
+int capabilityIndex(GLenum capability)
+{
+  switch (capability) {
+  case GL_DEPTH_TEST:
+    return 0;
+  case GL_FRAMEBUFFER_SRGB:
+    return 1;
+  case GL_CULL_FACE:
+    return 2;
+  case GL_BLEND:
+    return 3;
+  case GL_CLIP_DISTANCE0:
+    return 4;
+  }
+  return -1;
+}
+
+} // namespace
+
+void GLStateCache::invalidate()
+{
+  m_program = UNKNOWN;
+  m_vertexArray = UNKNOWN;
+  m_vertexBuffer = UNKNOWN;
+  m_activeUnit = UNKNOWN;
+  for (auto &unit : m_textures) {
+    std::fill(std::begin(unit), std::end(unit), UNKNOWN);
+  }
+  std::fill(std::begin(m_samplers), std::end(m_samplers), UNKNOWN);
+  m_drawFramebuffer = UNKNOWN;
+  m_readFramebuffer = UNKNOWN;
+  std::fill(std::begin(m_viewport), std::end(m_viewport), -1);
+  std::fill(std::begin(m_capabilities), std::end(m_capabilities), UNKNOWN_FLAG);
+  m_depthFunc = UNKNOWN;
+  m_depthMask = UNKNOWN_FLAG;
+  m_colorMask = UNKNOWN_FLAG;
+}
+
+void GLStateCache::useProgram(GLuint program)
+{
+  if (program != m_program) {
+    glUseProgram(program);
+    ++m_counters.programBinds;
+    m_program = program;
+  }
+}
+
+void GLStateCache::bindVertexArray(GLuint vertexArray)
+{
+  if (vertexArray != m_vertexArray) {
+    glBindVertexArray(vertexArray);
+    ++m_counters.vertexArrayBinds;
+    m_vertexArray = vertexArray;
+    // Vertex buffer bindings belong to the vertex array
+    m_vertexBuffer = UNKNOWN;
+  }
+}
+
+void GLStateCache::bindVertexBuffer(
+    GLuint buffer, GLintptr offset, GLsizei stride)
+{
+  if (buffer != m_vertexBuffer || offset != m_vertexBufferOffset ||
+      stride != m_vertexBufferStride) {
+    glBindVertexBuffer(0, buffer, offset, stride);
+    ++m_counters.vertexArrayBinds;
+    m_vertexBuffer = buffer;
+    m_vertexBufferOffset = offset;
+    m_vertexBufferStride = stride;
+  }
+}
+
+void GLStateCache::bindTexture(GLuint unit, GLenum target, GLuint texture)
+{
+  const auto targetIndex = textureTargetIndex(target);
+  const bool tracked = unit < TEXTURE_UNIT_COUNT && targetIndex >= 0;
+  if (tracked && m_textures[unit][targetIndex] == texture) {
+    return;
+  }
+
+  if (unit != m_activeUnit) {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    m_activeUnit = unit;
+  }
+  glBindTexture(target, texture);
+  ++m_counters.textureBinds;
+  if (tracked) {
+    m_textures[unit][targetIndex] = texture;
+  }
+}
+
+void GLStateCache::bindSampler(GLuint unit, GLuint sampler)
+{
+  if (unit < TEXTURE_UNIT_COUNT && m_samplers[unit] == sampler) {
+    return;
+  }
+  glBindSampler(unit, sampler);
+  ++m_counters.samplerBinds;
+  if (unit < TEXTURE_UNIT_COUNT) {
+    m_samplers[unit] = sampler;
+  }
+}
+
+void GLStateCache::bindFramebuffer(GLenum target, GLuint framebuffer)
+{
+  const bool draw = target != GL_READ_FRAMEBUFFER;
+  const bool read = target != GL_DRAW_FRAMEBUFFER;
+  if ((!draw || m_drawFramebuffer == framebuffer) &&
+      (!read || m_readFramebuffer == framebuffer)) {
+    return;
+  }
+  glBindFramebuffer(target, framebuffer);
+  ++m_counters.otherChanges;
+  if (draw) {
+    m_drawFramebuffer = framebuffer;
+  }
+  if (read) {
+    m_readFramebuffer = framebuffer;
+  }
+}
+
+void GLStateCache::viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+  if (x != m_viewport[0] || y != m_viewport[1] || width != m_viewport[2] ||
+      height != m_viewport[3]) {
+    glViewport(x, y, width, height);
+    ++m_counters.otherChanges;
+    m_viewport[0] = x;
+    m_viewport[1] = y;
+    m_viewport[2] = width;
+    m_viewport[3] = height;
+  }
+}
+
+void GLStateCache::setEnabled(GLenum capability, bool enabled)
+{
+  const auto index = capabilityIndex(capability);
+  if (index >= 0 && m_capabilities[index] == int(enabled)) {
+    return;
+  }
+  if (enabled) {
+    glEnable(capability);
+  } else {
+    glDisable(capability);
+  }
+  ++m_counters.otherChanges;
+  if (index >= 0) {
+    m_capabilities[index] = int(enabled);
+  }
+}
+
+void GLStateCache::depthFunc(GLenum func)
+{
+  if (func != m_depthFunc) {
+    glDepthFunc(func);
+    ++m_counters.otherChanges;
+    m_depthFunc = func;
+  }
+}
+
+void GLStateCache::depthMask(bool mask)
+{
+  if (int(mask) != m_depthMask) {
+    glDepthMask(mask ? GL_TRUE : GL_FALSE);
+    ++m_counters.otherChanges;
+    m_depthMask = int(mask);
+  }
+}
+
+void GLStateCache::colorMask(bool mask)
+{
+  if (int(mask) != m_colorMask) {
+    const auto value = mask ? GL_TRUE : GL_FALSE;
+    glColorMask(value, value, value, value);
+    ++m_counters.otherChanges;
+    m_colorMask = int(mask);
+  }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstddef>
+
+// Shadow copy of the GL state the draw loop changes, so that setting state
+// which is already current does not reach the driver. Code changing that
+// state behind the cache (GUI, texture uploads, other passes) must be followed
+// by invalidate(), the next calls then always reach the driver.
+class GLStateCache
+{
+public:
+  static const GLuint TEXTURE_UNIT_COUNT = 16;
+
+  // Calls which reached the driver since resetCounters()
+  struct Counters
+  {
+    size_t programBinds = 0;
+    size_t vertexArrayBinds = 0; // Vertex buffer bindings included
+    size_t textureBinds = 0;
+    size_t samplerBinds = 0;
+    size_t otherChanges = 0; // Framebuffers, viewport, capabilities, masks
+  };
+
+  GLStateCache() { invalidate(); }
+
+  void invalidate();
+
+  const Counters &counters() const { return m_counters; }
+  void resetCounters() { m_counters = Counters(); }
+
+  void useProgram(GLuint program);
+  void bindVertexArray(GLuint vertexArray);
+  // Vertex buffer of binding point 0 of the bound vertex array
+  void bindVertexBuffer(GLuint buffer, GLintptr offset, GLsizei stride);
+  // Units past TEXTURE_UNIT_COUNT and other targets than GL_TEXTURE_2D,
+  // GL_TEXTURE_2D_ARRAY, GL_TEXTURE_CUBE_MAP and GL_TEXTURE_BUFFER are not
+  // tracked
+  void bindTexture(GLuint unit, GLenum target, GLuint texture);
+  void bindSampler(GLuint unit, GLuint sampler);
+  // GL_FRAMEBUFFER binds both the draw and the read framebuffer
+  void bindFramebuffer(GLenum target, GLuint framebuffer);
+  void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+  // GL_DEPTH_TEST, GL_FRAMEBUFFER_SRGB, GL_CULL_FACE, GL_BLEND and
+  // GL_CLIP_DISTANCE0 are tracked
+  void setEnabled(GLenum capability, bool enabled);
+  void depthFunc(GLenum func);
+  void depthMask(bool mask);
+  void colorMask(bool mask); // All channels
+
+private:
+  static const int TEXTURE_TARGET_COUNT = 4;
+  static const int CAPABILITY_COUNT = 5;
+
+  // Unknown values never equal a value set, see invalidate()
+  GLuint m_program;
+  GLuint m_vertexArray;
+  GLuint m_vertexBuffer;
+  GLintptr m_vertexBufferOffset;
+  GLsizei m_vertexBufferStride;
+  GLuint m_activeUnit;
+  GLuint m_textures[TEXTURE_UNIT_COUNT][TEXTURE_TARGET_COUNT];
+  GLuint m_samplers[TEXTURE_UNIT_COUNT];
+  GLuint m_drawFramebuffer;
+  GLuint m_readFramebuffer;
+  GLint m_viewport[4];
+  int m_capabilities[CAPABILITY_COUNT];
+  GLenum m_depthFunc;
+  int m_depthMask;
+  int m_colorMask;
+  Counters m_counters;
+};
@@ -1,9 +1,98 @@
 #include "gltf.hpp"
 
+#include "trace.hpp"
+
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/quaternion.hpp>
 
+#include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <limits>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+// Vertices read by one thread at a time, large primitives are split in
+// several chunks
+const size_t BOUNDS_CHUNK_SIZE = 1 << 16;
+
+// A range of the vertices of a primitive to transform and bound
+struct BoundsJob
+{
+  glm::mat4 modelMatrix;
+  const tinygltf::Accessor *positions;
+  const tinygltf::Accessor *indices; // nullptr if not indexed
+  size_t begin; // Range of indices or vertices
+  size_t end;
+};
+
+struct Bounds
+{
+  glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+  glm::vec3 max = glm::vec3(std::numeric_limits<float>::lowest());
+};
+
+// One kernel per position and index type, so the loop does not switch on the
+// component types for every vertex. Indices past the positions are skipped.
+template <typename Positions, typename Indices>
+void boundIndexedVertices(const BoundsJob &job, const Positions &positions,
+    const Indices &indices, Bounds &bounds)
+{
+  for (size_t i = job.begin; i < job.end; ++i) {
+    const auto index = indices[i];
+    if (index >= positions.size()) {
+      continue;
+    }
+    const auto worldPosition =
+        glm::vec3(job.modelMatrix * glm::vec4(positions[index], 1.f));
+    bounds.min = glm::min(bounds.min, worldPosition);
+    bounds.max = glm::max(bounds.max, worldPosition);
+  }
+}
+
+template <typename Positions>
+void boundVertices(
+    const BoundsJob &job, const Positions &positions, Bounds &bounds)
+{
+  for (size_t i = job.begin; i < job.end; ++i) {
+    const auto worldPosition =
+        glm::vec3(job.modelMatrix * glm::vec4(positions[i], 1.f));
+    bounds.min = glm::min(bounds.min, worldPosition);
+    bounds.max = glm::max(bounds.max, worldPosition);
+  }
+}
+
+void boundVertices(const tinygltf::Model &model, const GltfBuffers &buffers,
+    const BoundsJob &job, Bounds &bounds)
+{
+  visitAccessor<glm::vec3>(
+      model, buffers, *job.positions, [&](const auto &positions) {
+        if (!job.indices) {
+          boundVertices(job, positions, bounds);
+          return;
+        }
+        visitIndices(model, buffers, *job.indices, [&](const auto &indices) {
+          boundIndexedVertices(job, positions, indices, bounds);
+        });
+      });
+}
+
+} // namespace
+
+std::vector<glm::vec4> readVectors(const tinygltf::Model &model,
+    const GltfBuffers &buffers, const tinygltf::Accessor &accessor)
+{
+  std::vector<glm::vec4> vectors;
+  visitAccessor<glm::vec4>(model, buffers, accessor, [&](const auto &view) {
+    vectors.resize(view.size());
+    view.read(vectors.data());
+  });
+  return vectors;
+}
 
 glm::mat4 getLocalToWorldMatrix(
     const tinygltf::Node &node, const glm::mat4 &parentMatrix)
@@ -35,119 +124,258 @@ glm::mat4 getLocalToWorldMatrix(
                                                  node.scale[1], node.scale[2]));
 };
 
-void computeSceneBounds(
-    const tinygltf::Model &model, glm::vec3 &bboxMin, glm::vec3 &bboxMax)
+void computeSceneBounds(const tinygltf::Model &model,
+    const RuntimeModel &runtimeModel, const GltfBuffers &buffers, bool exact,
+    glm::vec3 &bboxMin, glm::vec3 &bboxMax)
 {
-  // Compute scene bounding box
-  // todo refactor with scene drawing
-  // todo need a visitScene generic function that takes a accept() functor
-  bboxMin = glm::vec3(std::numeric_limits<float>::max());
-  bboxMax = glm::vec3(std::numeric_limits<float>::lowest());
-  if (model.defaultScene >= 0) {
-    const std::function<void(int, const glm::mat4 &)> updateBounds =
-        [&](int nodeIdx, const glm::mat4 &parentMatrix) {
-          const auto &node = model.nodes[nodeIdx];
-          const glm::mat4 modelMatrix =
-              getLocalToWorldMatrix(node, parentMatrix);
-          if (node.mesh >= 0) {
-            const auto &mesh = model.meshes[node.mesh];
-            for (size_t pIdx = 0; pIdx < mesh.primitives.size(); ++pIdx) {
-              const auto &primitive = mesh.primitives[pIdx];
-              const auto positionAttrIdxIt =
-                  primitive.attributes.find("POSITION");
-              if (positionAttrIdxIt == end(primitive.attributes)) {
-                continue;
-              }
-              const auto &positionAccessor =
-                  model.accessors[(*positionAttrIdxIt).second];
-              if (positionAccessor.type != 3) {
-                std::cerr << "Position accessor with type != VEC3, skipping"
-                          << std::endl;
-                continue;
-              }
-              const auto &positionBufferView =
-                  model.bufferViews[positionAccessor.bufferView];
-              const auto byteOffset =
-                  positionAccessor.byteOffset + positionBufferView.byteOffset;
-              const auto &positionBuffer =
-                  model.buffers[positionBufferView.buffer];
-              const auto positionByteStride =
-                  positionBufferView.byteStride ? positionBufferView.byteStride
-                                                : 3 * sizeof(float);
-
-              if (primitive.indices >= 0) {
-                const auto &indexAccessor = model.accessors[primitive.indices];
-                const auto &indexBufferView =
-                    model.bufferViews[indexAccessor.bufferView];
-                const auto indexByteOffset =
-                    indexAccessor.byteOffset + indexBufferView.byteOffset;
-                const auto &indexBuffer = model.buffers[indexBufferView.buffer];
-                auto indexByteStride = indexBufferView.byteStride;
-
-                switch (indexAccessor.componentType) {
-                default:
-                  std::cerr
-                      << "Primitive index accessor with bad componentType "
+  TRACE_ZONE("computeSceneBounds");
+  Bounds sceneBounds;
+  std::vector<BoundsJob> jobs;
+  const auto addJobs = [&](BoundsJob job, size_t count) {
+    for (size_t begin = 0; begin < count; begin += BOUNDS_CHUNK_SIZE) {
+      job.begin = begin;
+      job.end = std::min(begin + BOUNDS_CHUNK_SIZE, count);
+      jobs.push_back(job);
+    }
+  };
+
+  // Depth first from the roots, with the world matrix of each node
+  std::vector<std::pair<int32_t, glm::mat4>> stack;
+  for (const auto nodeIdx : runtimeModel.sceneRoots()) {
+    stack.emplace_back(nodeIdx, glm::mat4(1));
+  }
+  while (!stack.empty()) {
+    const auto nodeIdx = stack.back().first;
+    const auto &node = runtimeModel.nodes()[nodeIdx];
+    const glm::mat4 modelMatrix = stack.back().second * node.matrix;
+    stack.pop_back();
+    for (const auto childNodeIdx : node.children) {
+      stack.emplace_back(childNodeIdx, modelMatrix);
+    }
+    if (node.mesh < 0 || node.skin >= 0) {
+      continue;
+    }
+
+    const auto &mesh = runtimeModel.meshes()[node.mesh];
+    auto instanceMatrices =
+        getGpuInstanceMatrices(model, buffers, model.nodes[nodeIdx]);
+    if (instanceMatrices.empty()) {
+      instanceMatrices.push_back(glm::mat4(1));
+    }
+    for (const auto &instanceMatrix : instanceMatrices) {
+      const auto instanceModelMatrix = modelMatrix * instanceMatrix;
+      for (const auto &primitive : mesh.primitives) {
+        const auto positionAttrIdx = primitive.attributes[ATTRIBUTE_POSITION];
+        if (positionAttrIdx < 0) {
+          continue;
+        }
+        const auto &positionAccessor = model.accessors[positionAttrIdx];
+        if (positionAccessor.type != 3) {
+          std::cerr << "Position accessor with type != VEC3, skipping"
+                    << std::endl;
+          continue;
+        }
+        // min and max are required by the specification for POSITION
+        if (!exact && positionAccessor.minValues.size() == 3 &&
+            positionAccessor.maxValues.size() == 3) {
+          const auto &minValues = positionAccessor.minValues;
+          const auto &maxValues = positionAccessor.maxValues;
+          for (int corner = 0; corner < 8; ++corner) {
+            const auto localPosition =
+                glm::vec3(corner & 1 ? maxValues[0] : minValues[0],
+                    corner & 2 ? maxValues[1] : minValues[1],
+                    corner & 4 ? maxValues[2] : minValues[2]);
+            const auto worldPosition = glm::vec3(
+                instanceModelMatrix * glm::vec4(localPosition, 1.f));
+            sceneBounds.min = glm::min(sceneBounds.min, worldPosition);
+            sceneBounds.max = glm::max(sceneBounds.max, worldPosition);
+          }
+          continue;
+        }
+        BoundsJob job;
+        job.modelMatrix = instanceModelMatrix;
+        job.positions = &positionAccessor;
+        job.indices = nullptr;
+
+        if (primitive.indices >= 0) {
+          const auto &indexAccessor = model.accessors[primitive.indices];
+          switch (indexAccessor.componentType) {
+          default:
+            std::cerr << "Primitive index accessor with bad componentType "
                       << indexAccessor.componentType << ", skipping it."
                       << std::endl;
-                  continue;
-                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
-                  indexByteStride =
-                      indexByteStride ? indexByteStride : sizeof(uint8_t);
-                  break;
-                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
-                  indexByteStride =
-                      indexByteStride ? indexByteStride : sizeof(uint16_t);
-                  break;
-                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
-                  indexByteStride =
-                      indexByteStride ? indexByteStride : sizeof(uint32_t);
-                  break;
-                }
-
-                for (size_t i = 0; i < indexAccessor.count; ++i) {
-                  uint32_t index = 0;
-                  switch (indexAccessor.componentType) {
-                  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
-                    index = *((const uint8_t *)&indexBuffer
-                                  .data[indexByteOffset + indexByteStride * i]);
-                    break;
-                  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
-                    index = *((const uint16_t *)&indexBuffer
-                                  .data[indexByteOffset + indexByteStride * i]);
-                    break;
-                  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
-                    index = *((const uint32_t *)&indexBuffer
-                                  .data[indexByteOffset + indexByteStride * i]);
-                    break;
-                  }
-                  const auto &localPosition =
-                      *((const glm::vec3 *)&positionBuffer
-                              .data[byteOffset + positionByteStride * index]);
-                  const auto worldPosition =
-                      glm::vec3(modelMatrix * glm::vec4(localPosition, 1.f));
-                  bboxMin = glm::min(bboxMin, worldPosition);
-                  bboxMax = glm::max(bboxMax, worldPosition);
-                }
-              } else {
-                for (size_t i = 0; i < positionAccessor.count; ++i) {
-                  const auto &localPosition =
-                      *((const glm::vec3 *)&positionBuffer
-                              .data[byteOffset + positionByteStride * i]);
-                  const auto worldPosition =
-                      glm::vec3(modelMatrix * glm::vec4(localPosition, 1.f));
-                  bboxMin = glm::min(bboxMin, worldPosition);
-                  bboxMax = glm::max(bboxMax, worldPosition);
-                }
-              }
-            }
-          }
-          for (const auto childNodeIdx : node.children) {
-            updateBounds(childNodeIdx, modelMatrix);
+            continue;
+          case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+          case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+          case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+            break;
           }
-        };
-    for (const auto nodeIdx : model.scenes[model.defaultScene].nodes) {
-      updateBounds(nodeIdx, glm::mat4(1));
+
+          job.indices = &indexAccessor;
+          addJobs(job, indexAccessor.count);
+        } else {
+          addJobs(job, positionAccessor.count);
+        }
+      }
+    }
+  }
+
+  // Each thread reduces the jobs it takes to its own bounds
+  const auto threadCount = std::min(
+      size_t(std::max(1u, std::thread::hardware_concurrency())), jobs.size());
+  std::vector<Bounds> threadBounds(threadCount);
+  std::atomic<size_t> nextJob{0};
+  const auto bound = [&](size_t threadIdx) {
+    for (size_t i = nextJob++; i < jobs.size(); i = nextJob++) {
+      boundVertices(model, buffers, jobs[i], threadBounds[threadIdx]);
     }
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < threadCount; ++i) {
+    threads.emplace_back(bound, i);
+  }
+  if (threadCount) {
+    bound(0);
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  for (const auto &bounds : threadBounds) {
+    sceneBounds.min = glm::min(sceneBounds.min, bounds.min);
+    sceneBounds.max = glm::max(sceneBounds.max, bounds.max);
+  }
+  bboxMin = sceneBounds.min;
+  bboxMax = sceneBounds.max;
+}
+
+Aabb getPrimitiveBounds(
+    const tinygltf::Model &model, const tinygltf::Primitive &primitive)
+{
+  Aabb bounds;
+  const auto positionAttrIdxIt = primitive.attributes.find("POSITION");
+  if (positionAttrIdxIt == end(primitive.attributes)) {
+    return bounds;
+  }
+  const auto &positionAccessor = model.accessors[(*positionAttrIdxIt).second];
+  if (positionAccessor.minValues.size() != 3 ||
+      positionAccessor.maxValues.size() != 3) {
+    return bounds;
+  }
+  bounds.min = glm::vec3(positionAccessor.minValues[0],
+      positionAccessor.minValues[1], positionAccessor.minValues[2]);
+  bounds.max = glm::vec3(positionAccessor.maxValues[0],
+      positionAccessor.maxValues[1], positionAccessor.maxValues[2]);
+
+  // Each morph target moves the vertices by at most its min/max delta
+  for (const auto &target : primitive.targets) {
+    const auto it = target.find("POSITION");
+    if (it == end(target) || (*it).second < 0) {
+      continue;
+    }
+    const auto &deltas = model.accessors[(*it).second];
+    if (deltas.minValues.size() == 3 && deltas.maxValues.size() == 3) {
+      bounds.min += glm::min(glm::vec3(0), glm::vec3(deltas.minValues[0],
+                                               deltas.minValues[1],
+                                               deltas.minValues[2]));
+      bounds.max += glm::max(glm::vec3(0), glm::vec3(deltas.maxValues[0],
+                                               deltas.maxValues[1],
+                                               deltas.maxValues[2]));
+    }
+  }
+  return bounds;
+}
+
+std::vector<glm::mat4> getGpuInstanceMatrices(const tinygltf::Model &model,
+    const GltfBuffers &buffers, const tinygltf::Node &node)
+{
+  std::vector<glm::mat4> matrices;
+  const auto extension = node.extensions.find("EXT_mesh_gpu_instancing");
+  if (extension == end(node.extensions) ||
+      !(*extension).second.Has("attributes")) {
+    return matrices;
+  }
+  const auto &attributes = (*extension).second.Get("attributes");
+  const auto readAttribute = [&](const char *name) {
+    if (!attributes.Has(name)) {
+      return std::vector<glm::vec4>();
+    }
+    const auto accessorIdx = attributes.Get(name).Get<int>();
+    if (accessorIdx < 0 || size_t(accessorIdx) >= model.accessors.size()) {
+      return std::vector<glm::vec4>();
+    }
+    return readVectors(model, buffers, model.accessors[accessorIdx]);
+  };
+
+  const auto translations = readAttribute("TRANSLATION");
+  const auto rotations = readAttribute("ROTATION");
+  const auto scales = readAttribute("SCALE");
+  // All attributes have the same count, any of them may be missing
+  const auto count =
+      std::max(translations.size(), std::max(rotations.size(), scales.size()));
+
+  matrices.resize(count);
+  for (size_t i = 0; i < count; ++i) {
+    auto matrix = glm::mat4(1);
+    if (i < translations.size()) {
+      matrix = glm::translate(matrix, glm::vec3(translations[i]));
+    }
+    if (i < rotations.size()) {
+      const auto &r = rotations[i];
+      matrix = matrix * glm::mat4_cast(glm::quat(r.w, r.x, r.y, r.z));
+    }
+    if (i < scales.size()) {
+      matrix = glm::scale(matrix, glm::vec3(scales[i]));
+    }
+    matrices[i] = matrix;
+  }
+  return matrices;
+}
+
+NodeLods getNodeLods(const tinygltf::Model &model, const tinygltf::Node &node)
+{
+  NodeLods lods;
+  lods.meshes.push_back(node.mesh);
+  const auto extension = node.extensions.find("MSFT_lod");
+  if (extension == end(node.extensions) ||
+      !(*extension).second.Get("ids").IsArray()) {
+    return lods;
+  }
+  const auto &ids = (*extension).second.Get("ids");
+  for (size_t i = 0; i < ids.ArrayLen(); ++i) {
+    const auto id = ids.Get(int(i)).GetNumberAsInt();
+    lods.meshes.push_back(id >= 0 && size_t(id) < model.nodes.size()
+                              ? model.nodes[id].mesh
+                              : -1);
+  }
+  if (!node.extras.IsObject()) {
+    return lods;
+  }
+  const auto &coverages = node.extras.Get("MSFT_screencoverage");
+  for (size_t i = 0; coverages.IsArray() && i < coverages.ArrayLen(); ++i) {
+    lods.screenCoverages.push_back(
+        float(coverages.Get(int(i)).GetNumberAsDouble()));
+  }
+  return lods;
+}
+
+std::vector<unsigned> getTextureUsages(const tinygltf::Model &model)
+{
+  std::vector<unsigned> usages(model.textures.size(), 0);
+  const auto addUsage = [&](int textureIdx, TextureUsage usage) {
+    if (textureIdx >= 0 && size_t(textureIdx) < usages.size()) {
+      usages[textureIdx] |= usage;
+    }
+  };
+
+  for (const auto &material : model.materials) {
+    const auto &pbr = material.pbrMetallicRoughness;
+    addUsage(pbr.baseColorTexture.index, TEXTURE_USAGE_COLOR);
+    addUsage(material.emissiveTexture.index, TEXTURE_USAGE_COLOR);
+    addUsage(material.occlusionTexture.index, TEXTURE_USAGE_OCCLUSION);
+    addUsage(pbr.metallicRoughnessTexture.index, TEXTURE_USAGE_DATA);
+    addUsage(material.normalTexture.index, TEXTURE_USAGE_NORMAL);
   }
-}
\ No newline at end of file
+  return usages;
+}
@@ -1,10 +1,389 @@
 #pragma once
 
+#include "frustum.hpp"
+#include "gltf_loader.hpp"
+#include "runtime_model.hpp"
+
 #include <glm/glm.hpp>
 #include <tiny_gltf.h>
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+// Scalar and component count of the elements an AccessorView reads: float,
+// uint32_t or a glm vector of them
+template <typename Vector> struct AccessorElement
+{
+  using Scalar = Vector;
+  static constexpr int length = 1;
+  static Scalar &at(Vector &v, int) { return v; }
+};
+
+template <glm::length_t L, typename T, glm::qualifier Q>
+struct AccessorElement<glm::vec<L, T, Q>>
+{
+  using Scalar = T;
+  static constexpr int length = L;
+  static Scalar &at(glm::vec<L, T, Q> &v, int c) { return v[c]; }
+};
+
+// Elements of an accessor as Vector, for Component elements normalized or
+// not, so the loops reading them know both at compile time. Made by
+// visitAccessor() and visitIndices(), which switch on the component type
+// once per accessor. Components the accessor lacks are 0, those Vector lacks
+// are ignored. Normalized integers are mapped to [0, 1] or [-1, 1].
+//
+// Sparse values replace the elements at their indices, increasing as glTF
+// requires: the iterators step through them along the elements, operator[]
+// searches them.
+template <typename Vector, typename Component, bool Normalized>
+class AccessorView
+{
+public:
+  using Element = AccessorElement<Vector>;
+  using Scalar = typename Element::Scalar;
+
+  // data is nullptr for a sparse accessor without buffer view, its elements
+  // are 0 but for the sparse values
+  AccessorView(const unsigned char *data, size_t stride, size_t count,
+      int components, const unsigned char *sparseValues,
+      std::vector<uint32_t> sparseIndices)
+      : m_data(data), m_stride(stride), m_count(count),
+        m_components(std::min(components, Element::length)),
+        m_sparseStride(size_t(components) * sizeof(Component)),
+        m_sparseValues(sparseValues), m_sparseIndices(std::move(sparseIndices))
+  {
+  }
+
+  size_t size() const { return m_count; }
+  bool empty() const { return m_count == 0; }
+
+  Vector operator[](size_t i) const
+  {
+    if (!m_sparseIndices.empty()) {
+      const auto first = m_sparseIndices.begin();
+      const auto it =
+          std::lower_bound(first, m_sparseIndices.end(), uint32_t(i));
+      if (it != m_sparseIndices.end() && *it == i) {
+        return readElement(
+            m_sparseValues + size_t(it - first) * m_sparseStride);
+      }
+    }
+    return m_data ? readElement(m_data + i * m_stride) : Vector(0);
+  }
+
+  // Write the size() elements to out, a loop over the buffer view then one
+  // over the sparse values
+  void read(Vector *out) const
+  {
+    if (!m_data) {
+      std::fill(out, out + m_count, Vector(0));
+    } else if (m_components == Element::length) {
+      for (size_t i = 0; i < m_count; ++i) {
+        out[i] = readComponents<Element::length>(m_data + i * m_stride);
+      }
+    } else {
+      for (size_t i = 0; i < m_count; ++i) {
+        out[i] = readElement(m_data + i * m_stride);
+      }
+    }
+    for (size_t i = 0; i < m_sparseIndices.size(); ++i) {
+      if (m_sparseIndices[i] < m_count) {
+        out[m_sparseIndices[i]] =
+            readElement(m_sparseValues + i * m_sparseStride);
+      }
+    }
+  }
+
+  class Iterator
+  {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Vector;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Vector *;
+    using reference = Vector;
+
+    Iterator(const AccessorView *view, size_t index, size_t sparse)
+        : m_view(view), m_index(index), m_sparse(sparse)
+    {
+    }
+
+    Vector operator*() const
+    {
+      const auto &view = *m_view;
+      if (m_sparse < view.m_sparseIndices.size() &&
+          view.m_sparseIndices[m_sparse] == m_index) {
+        return view.readElement(
+            view.m_sparseValues + m_sparse * view.m_sparseStride);
+      }
+      return view.m_data
+                 ? view.readElement(view.m_data + m_index * view.m_stride)
+                 : Vector(0);
+    }
+
+    Iterator &operator++()
+    {
+      const auto &indices = m_view->m_sparseIndices;
+      while (m_sparse < indices.size() && indices[m_sparse] <= m_index) {
+        ++m_sparse;
+      }
+      ++m_index;
+      return *this;
+    }
+
+    Iterator operator++(int)
+    {
+      auto previous = *this;
+      ++*this;
+      return previous;
+    }
+
+    bool operator==(const Iterator &other) const
+    {
+      return m_index == other.m_index;
+    }
+    bool operator!=(const Iterator &other) const { return !(*this == other); }
+
+  private:
+    const AccessorView *m_view;
+    size_t m_index;
+    size_t m_sparse; // First sparse value at m_index or after
+  };
+
+  Iterator begin() const { return Iterator(this, 0, 0); }
+  Iterator end() const
+  {
+    return Iterator(this, m_count, m_sparseIndices.size());
+  }
+
+private:
+  static Scalar convert(Component value)
+  {
+    if constexpr (Normalized && std::is_integral<Component>::value) {
+      const float scaled =
+          float(value) / float(std::numeric_limits<Component>::max());
+      return Scalar(std::is_signed<Component>::value ? std::max(scaled, -1.f)
+                                                     : scaled);
+    } else {
+      return Scalar(value);
+    }
+  }
+
+  template <int Count>
+  static Vector readComponents(const unsigned char *element)
+  {
+    auto v = Vector(0);
+    for (int c = 0; c < Count; ++c) {
+      Component value;
+      std::memcpy(&value, element + c * sizeof(Component), sizeof(value));
+      Element::at(v, c) = convert(value);
+    }
+    return v;
+  }
+
+  Vector readElement(const unsigned char *element) const
+  {
+    auto v = Vector(0);
+    for (int c = 0; c < m_components; ++c) {
+      Component value;
+      std::memcpy(&value, element + c * sizeof(Component), sizeof(value));
+      Element::at(v, c) = convert(value);
+    }
+    return v;
+  }
+
+  const unsigned char *m_data;
+  size_t m_stride;
+  size_t m_count;
+  int m_components; // Read of each element, at most Element::length
+  size_t m_sparseStride;
+  const unsigned char *m_sparseValues;
+  std::vector<uint32_t> m_sparseIndices;
+};
+
+// Call function with the AccessorView<Vector, Component, Normalized> of the
+// accessor for its component type, and return true. False without calling it
+// if the accessor has neither buffer view nor sparse values, or a component
+// type glTF does not define.
+template <typename Vector, typename Function>
+bool visitAccessor(const tinygltf::Model &model, const GltfBuffers &buffers,
+    const tinygltf::Accessor &accessor, Function &&function);
+
+// visitAccessor() for index accessors, of unsigned components read as
+// uint32_t. Fewer kernels are instantiated.
+template <typename Function>
+bool visitIndices(const tinygltf::Model &model, const GltfBuffers &buffers,
+    const tinygltf::Accessor &accessor, Function &&function);
+
+// Elements of a SCALAR to VEC4 accessor, the missing components are 0.
+// Normalized integers are mapped to [0, 1] or [-1, 1]. Sparse accessors are
+// applied. Empty if the accessor has neither buffer view nor sparse values.
+std::vector<glm::vec4> readVectors(const tinygltf::Model &model,
+    const GltfBuffers &buffers, const tinygltf::Accessor &accessor);
+
 glm::mat4 getLocalToWorldMatrix(
     const tinygltf::Node &node, const glm::mat4 &parentMatrix);
 
-void computeSceneBounds(
-    const tinygltf::Model &model, glm::vec3 &bboxMin, glm::vec3 &bboxMax);
\ No newline at end of file
+// Bounds of the default scene in world space. Unless exact is set, the
+// bounding box of each primitive is the transformed min/max of its POSITION
+// accessor, vertices are only read if the accessor has no min/max. Skinned
+// meshes are skipped, they are placed by their joints (Skins::skinnedBounds).
+void computeSceneBounds(const tinygltf::Model &model,
+    const RuntimeModel &runtimeModel, const GltfBuffers &buffers, bool exact,
+    glm::vec3 &bboxMin, glm::vec3 &bboxMax);
+
+// Bounds of a primitive in its node space, from the min/max of its POSITION
+// accessor, grown by the min/max of its morph targets for weights in [0, 1].
+// Empty if the accessor has no min/max.
+Aabb getPrimitiveBounds(
+    const tinygltf::Model &model, const tinygltf::Primitive &primitive);
+
+// Transforms of the instances of a node, relative to the node, from its
+// EXT_mesh_gpu_instancing extension. Empty if the node does not use it.
+std::vector<glm::mat4> getGpuInstanceMatrices(const tinygltf::Model &model,
+    const GltfBuffers &buffers, const tinygltf::Node &node);
+
+// Authored levels of detail of a node from its MSFT_lod extension
+struct NodeLods
+{
+  // Mesh of the node then of each node of its ids, coarser and coarser, -1
+  // for a level node without mesh. Only the mesh of the node without
+  // MSFT_lod.
+  std::vector<int> meshes;
+  // Fraction of the viewport height the node must cover for each level to be
+  // drawn, from MSFT_screencoverage in the extras of the node. A value after
+  // the last level is the coverage below which the node is not drawn at all.
+  std::vector<float> screenCoverages;
+};
+
+NodeLods getNodeLods(const tinygltf::Model &model, const tinygltf::Node &node);
+
+// Material slots sampling a texture. Color slots (base color and emissive)
+// store sRGB texels, the other slots store linear data.
+enum TextureUsage
+{
+  TEXTURE_USAGE_COLOR = 1,
+  TEXTURE_USAGE_OCCLUSION = 2, // Red channel only
+  TEXTURE_USAGE_DATA = 4, // Metallic-roughness
+  TEXTURE_USAGE_NORMAL = 8 // Tangent space normals, linear data too
+};
+
+// Bitwise OR of the TextureUsage of every texture of the model, 0 for a texture
+// no material samples
+std::vector<unsigned> getTextureUsages(const tinygltf::Model &model);
+
+// View of the accessor with its buffer view and sparse values, see
+// visitAccessor() for one of the component type of the accessor
+template <typename Vector, typename Component, bool Normalized>
+AccessorView<Vector, Component, Normalized> makeAccessorView(
+    const tinygltf::Model &model, const GltfBuffers &buffers,
+    const tinygltf::Accessor &accessor)
+{
+  const auto components = tinygltf::GetNumComponentsInType(accessor.type);
+  const unsigned char *data = nullptr;
+  size_t stride = 0;
+  if (accessor.bufferView >= 0) {
+    const auto &bufferView = model.bufferViews[accessor.bufferView];
+    stride = bufferView.byteStride ? bufferView.byteStride
+                                   : size_t(components) * sizeof(Component);
+    data = buffers[bufferView.buffer].data + bufferView.byteOffset +
+           accessor.byteOffset;
+  }
+
+  // Sparse indices and values are tightly packed
+  const unsigned char *sparseValues = nullptr;
+  std::vector<uint32_t> sparseIndices;
+  const auto &sparse = accessor.sparse;
+  if (sparse.isSparse && sparse.count > 0) {
+    const auto &indexView = model.bufferViews[sparse.indices.bufferView];
+    const auto &valueView = model.bufferViews[sparse.values.bufferView];
+    const auto *indices = buffers[indexView.buffer].data +
+                          indexView.byteOffset + sparse.indices.byteOffset;
+    sparseValues = buffers[valueView.buffer].data + valueView.byteOffset +
+                   sparse.values.byteOffset;
+    sparseIndices.resize(size_t(sparse.count));
+    for (size_t i = 0; i < sparseIndices.size(); ++i) {
+      switch (sparse.indices.componentType) {
+      case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+        sparseIndices[i] = indices[i];
+        break;
+      case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+        uint16_t index;
+        std::memcpy(&index, indices + i * sizeof(index), sizeof(index));
+        sparseIndices[i] = index;
+        break;
+      }
+      default:
+        std::memcpy(&sparseIndices[i], indices + i * sizeof(uint32_t),
+            sizeof(uint32_t));
+        break;
+      }
+    }
+  }
+  return AccessorView<Vector, Component, Normalized>(data, stride,
+      accessor.count, components, sparseValues, std::move(sparseIndices));
+}
+
+template <typename Vector, typename Function>
+bool visitAccessor(const tinygltf::Model &model, const GltfBuffers &buffers,
+    const tinygltf::Accessor &accessor, Function &&function)
+{
+  if (accessor.bufferView < 0 && !accessor.sparse.isSparse) {
+    return false;
+  }
+  const auto visit = [&](auto component, auto normalized) {
+    using Component = decltype(component);
+    function(makeAccessorView<Vector, Component, decltype(normalized)::value>(
+        model, buffers, accessor));
+    return true;
+  };
+  const auto visitNormalized = [&](auto component) {
+    return accessor.normalized ? visit(component, std::true_type())
+                               : visit(component, std::false_type());
+  };
+  switch (accessor.componentType) {
+  case TINYGLTF_COMPONENT_TYPE_BYTE:
+    return visitNormalized(int8_t());
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+    return visitNormalized(uint8_t());
+  case TINYGLTF_COMPONENT_TYPE_SHORT:
+    return visitNormalized(int16_t());
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+    return visitNormalized(uint16_t());
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+    return visitNormalized(uint32_t());
+  case TINYGLTF_COMPONENT_TYPE_FLOAT:
+    return visit(float(), std::false_type());
+  }
+  return false;
+}
+
+template <typename Function>
+bool visitIndices(const tinygltf::Model &model, const GltfBuffers &buffers,
+    const tinygltf::Accessor &accessor, Function &&function)
+{
+  if (accessor.bufferView < 0 && !accessor.sparse.isSparse) {
+    return false;
+  }
+  switch (accessor.componentType) {
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+    function(makeAccessorView<uint32_t, uint8_t, false>(
+        model, buffers, accessor));
+    return true;
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+    function(makeAccessorView<uint32_t, uint16_t, false>(
+        model, buffers, accessor));
+    return true;
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+    function(makeAccessorView<uint32_t, uint32_t, false>(
+        model, buffers, accessor));
+    return true;
+  }
+  return false;
+}
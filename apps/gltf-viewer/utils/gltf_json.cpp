@@ -0,0 +1,1567 @@
+#include "gltf_json.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <iterator>
+#include <string_view>
+#include <utility>
+
+namespace
+{
+
+// Of nested arrays and objects, values are read recursively
+const int MAX_DEPTH = 256;
+
+enum class JsonType
+{
+  Object,
+  Array,
+  String,
+  Number,
+  Bool,
+  Null,
+  Invalid
+};
+
+struct JsonNumber
+{
+  double value = 0;
+  // Numbers without fraction nor exponent that fit, like nlohmann::json
+  bool integer = false;
+  int64_t integerValue = 0;
+};
+
+bool setPresent(bool *present)
+{
+  if (present) {
+    *present = true;
+  }
+  return true;
+}
+
+// Pull reader over the bytes of a JSON text: the caller reads the values in
+// order and skips those it does not need. The typed read() functions skip
+// values of another type, leaving their output unchanged, as tinygltf ignores
+// them, and set present when they set the output. The first error is kept with
+// its byte offset.
+class JsonReader
+{
+public:
+  JsonReader(const char *begin, const char *end)
+      : m_begin(begin), m_cursor(begin), m_end(end)
+  {
+    // Byte order mark
+    if (m_end - m_cursor >= 3 &&
+        std::string_view(m_cursor, 3) == "\xEF\xBB\xBF") {
+      m_cursor += 3;
+    }
+  }
+
+  const std::string &error() const { return m_error; }
+
+  bool fail(const std::string &message)
+  {
+    if (m_error.empty()) {
+      m_error = message + " at byte " + std::to_string(m_cursor - m_begin);
+    }
+    return false;
+  }
+
+  // To read a value again
+  const char *position() const { return m_cursor; }
+  void seek(const char *position) { m_cursor = position; }
+
+  // Only whitespace, or the null padding of some exporters, after the root
+  bool atEnd()
+  {
+    while (m_cursor != m_end && (isSpace(*m_cursor) || *m_cursor == '\0')) {
+      ++m_cursor;
+    }
+    return m_cursor == m_end || fail("unexpected character after the root");
+  }
+
+  JsonType peek()
+  {
+    skipSpace();
+    if (m_cursor == m_end) {
+      return JsonType::Invalid;
+    }
+    switch (*m_cursor) {
+    case '{':
+      return JsonType::Object;
+    case '[':
+      return JsonType::Array;
+    case '"':
+      return JsonType::String;
+    case 't':
+    case 'f':
+      return JsonType::Bool;
+    case 'n':
+      return JsonType::Null;
+    case '-':
+      return JsonType::Number;
+    default:
+      return *m_cursor >= '0' && *m_cursor <= '9' ? JsonType::Number
+                                                  : JsonType::Invalid;
+    }
+  }
+
+  // Call member(key) for each member of the next object, which must read or
+  // skip its value. key is only valid until then.
+  template <typename Member> bool object(Member &&member)
+  {
+    if (!enter('{')) {
+      return false;
+    }
+    if (!consume('}')) {
+      std::string escapedKey;
+      do {
+        std::string_view key;
+        if (!string(key, escapedKey) || !expect(':') || !member(key)) {
+          return false;
+        }
+      } while (consume(','));
+      if (!expect('}')) {
+        return false;
+      }
+    }
+    --m_depth;
+    return true;
+  }
+
+  // Call element() for each element of the next array, which must read or
+  // skip it
+  template <typename Element> bool array(Element &&element)
+  {
+    if (!enter('[')) {
+      return false;
+    }
+    if (!consume(']')) {
+      do {
+        if (!element()) {
+          return false;
+        }
+      } while (consume(','));
+      if (!expect(']')) {
+        return false;
+      }
+    }
+    --m_depth;
+    return true;
+  }
+
+  // View on the characters of the next string, or on storage where its
+  // escapes are decoded if it has some
+  bool string(std::string_view &value, std::string &storage)
+  {
+    if (!expect('"')) {
+      return false;
+    }
+    const auto *begin = m_cursor;
+    while (m_cursor != m_end && *m_cursor != '"' && *m_cursor != '\\' &&
+           uint8_t(*m_cursor) >= 0x20) {
+      ++m_cursor;
+    }
+    if (m_cursor != m_end && *m_cursor == '"') {
+      value = std::string_view(begin, size_t(m_cursor - begin));
+      ++m_cursor;
+      return true;
+    }
+
+    storage.assign(begin, m_cursor);
+    for (;;) {
+      if (m_cursor == m_end) {
+        return fail("unterminated string");
+      }
+      const auto c = *m_cursor++;
+      if (c == '"') {
+        break;
+      }
+      if (uint8_t(c) < 0x20) {
+        return fail("control character in string");
+      }
+      if (c != '\\') {
+        storage += c;
+        continue;
+      }
+      if (m_cursor == m_end) {
+        return fail("unterminated string");
+      }
+      switch (*m_cursor++) {
+      case '"':
+        storage += '"';
+        break;
+      case '\\':
+        storage += '\\';
+        break;
+      case '/':
+        storage += '/';
+        break;
+      case 'b':
+        storage += '\b';
+        break;
+      case 'f':
+        storage += '\f';
+        break;
+      case 'n':
+        storage += '\n';
+        break;
+      case 'r':
+        storage += '\r';
+        break;
+      case 't':
+        storage += '\t';
+        break;
+      case 'u': {
+        uint32_t code;
+        if (!hex4(code)) {
+          return false;
+        }
+        if (code >= 0xD800 && code < 0xDC00) {
+          uint32_t low;
+          if (m_end - m_cursor < 2 || m_cursor[0] != '\\' ||
+              m_cursor[1] != 'u') {
+            return fail("unpaired surrogate in string");
+          }
+          m_cursor += 2;
+          if (!hex4(low)) {
+            return false;
+          }
+          if (low < 0xDC00 || low >= 0xE000) {
+            return fail("unpaired surrogate in string");
+          }
+          code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+        } else if (code >= 0xDC00 && code < 0xE000) {
+          return fail("unpaired surrogate in string");
+        }
+        appendUtf8(storage, code);
+        break;
+      }
+      default:
+        return fail("invalid escape in string");
+      }
+    }
+    value = storage;
+    return true;
+  }
+
+  bool number(JsonNumber &number)
+  {
+    skipSpace();
+    const auto *begin = m_cursor;
+    if (m_cursor != m_end && *m_cursor == '-') {
+      ++m_cursor;
+    }
+    if (m_cursor != m_end && *m_cursor == '0') {
+      ++m_cursor;
+    } else if (!digits()) {
+      return fail("invalid number");
+    }
+    bool integer = true;
+    if (m_cursor != m_end && *m_cursor == '.') {
+      ++m_cursor;
+      integer = false;
+      if (!digits()) {
+        return fail("invalid number");
+      }
+    }
+    if (m_cursor != m_end && (*m_cursor == 'e' || *m_cursor == 'E')) {
+      ++m_cursor;
+      integer = false;
+      if (m_cursor != m_end && (*m_cursor == '+' || *m_cursor == '-')) {
+        ++m_cursor;
+      }
+      if (!digits()) {
+        return fail("invalid number");
+      }
+    }
+
+    number.integer =
+        integer &&
+        std::from_chars(begin, m_cursor, number.integerValue).ec == std::errc();
+    if (std::from_chars(begin, m_cursor, number.value).ec != std::errc()) {
+      return fail("number out of range");
+    }
+    return true;
+  }
+
+  bool boolean(bool &value)
+  {
+    if (literal("true")) {
+      value = true;
+      return true;
+    }
+    if (literal("false")) {
+      value = false;
+      return true;
+    }
+    return fail("invalid literal");
+  }
+
+  bool skip()
+  {
+    std::string_view view;
+    JsonNumber parsed;
+    bool flag;
+    switch (peek()) {
+    case JsonType::Object:
+      return object([&](std::string_view) { return skip(); });
+    case JsonType::Array:
+      return array([&]() { return skip(); });
+    case JsonType::String:
+      return string(view, m_scratch);
+    case JsonType::Number:
+      return number(parsed);
+    case JsonType::Bool:
+      return boolean(flag);
+    case JsonType::Null:
+      return literal("null") || fail("invalid literal");
+    case JsonType::Invalid:
+      break;
+    }
+    return fail(m_cursor == m_end ? "unexpected end" : "unexpected character");
+  }
+
+  bool read(bool &value, bool *present = nullptr)
+  {
+    if (peek() != JsonType::Bool) {
+      return skip();
+    }
+    return boolean(value) && setPresent(present);
+  }
+
+  bool read(int &value, bool *present = nullptr)
+  {
+    JsonNumber parsed;
+    if (peek() != JsonType::Number) {
+      return skip();
+    }
+    if (!number(parsed)) {
+      return false;
+    }
+    if (parsed.integer) {
+      value = int(parsed.integerValue);
+      setPresent(present);
+    }
+    return true;
+  }
+
+  bool read(size_t &value, bool *present = nullptr)
+  {
+    JsonNumber parsed;
+    if (peek() != JsonType::Number) {
+      return skip();
+    }
+    if (!number(parsed)) {
+      return false;
+    }
+    if (parsed.integer && parsed.integerValue >= 0) {
+      value = size_t(parsed.integerValue);
+      setPresent(present);
+    }
+    return true;
+  }
+
+  bool read(double &value, bool *present = nullptr)
+  {
+    JsonNumber parsed;
+    if (peek() != JsonType::Number) {
+      return skip();
+    }
+    if (!number(parsed)) {
+      return false;
+    }
+    value = parsed.value;
+    return setPresent(present);
+  }
+
+  bool read(std::string &value, bool *present = nullptr)
+  {
+    std::string_view view;
+    if (peek() != JsonType::String) {
+      return skip();
+    }
+    if (!string(view, value)) {
+      return false;
+    }
+    if (view.data() != value.data()) {
+      value.assign(view);
+    }
+    return setPresent(present);
+  }
+
+  bool read(std::vector<double> &values, bool *present = nullptr)
+  {
+    if (peek() != JsonType::Array) {
+      return skip();
+    }
+    values.clear();
+    return array([&]() {
+      double value;
+      bool isNumber = false;
+      if (!read(value, &isNumber)) {
+        return false;
+      }
+      if (isNumber) {
+        values.push_back(value);
+      }
+      return true;
+    }) && setPresent(present);
+  }
+
+  bool read(std::vector<int> &values)
+  {
+    if (peek() != JsonType::Array) {
+      return skip();
+    }
+    values.clear();
+    return array([&]() {
+      int value;
+      bool isInteger = false;
+      if (!read(value, &isInteger)) {
+        return false;
+      }
+      if (isInteger) {
+        values.push_back(value);
+      }
+      return true;
+    });
+  }
+
+  // Other values give empty strings
+  bool read(std::vector<std::string> &values)
+  {
+    if (peek() != JsonType::Array) {
+      return skip();
+    }
+    values.clear();
+    return array([&]() {
+      values.emplace_back();
+      return read(values.back());
+    });
+  }
+
+  // Indices of accessors by attribute name, other values are ignored
+  bool read(std::map<std::string, int> &indices)
+  {
+    if (peek() != JsonType::Object) {
+      return skip();
+    }
+    return object([&](std::string_view key) {
+      int value;
+      bool isInteger = false;
+      std::string name(key);
+      if (!read(value, &isInteger)) {
+        return false;
+      }
+      if (isInteger) {
+        indices[std::move(name)] = value;
+      }
+      return true;
+    });
+  }
+
+  // Like tinygltf: nulls are dropped, empty arrays and objects are null
+  bool read(tinygltf::Value &value)
+  {
+    JsonNumber parsed;
+    bool flag;
+    switch (peek()) {
+    case JsonType::Object: {
+      tinygltf::Value::Object members;
+      if (!object([&](std::string_view key) {
+            std::string name(key);
+            tinygltf::Value member;
+            if (!read(member)) {
+              return false;
+            }
+            if (member.Type() != tinygltf::NULL_TYPE) {
+              members[std::move(name)] = std::move(member);
+            }
+            return true;
+          })) {
+        return false;
+      }
+      value = members.empty() ? tinygltf::Value()
+                              : tinygltf::Value(std::move(members));
+      return true;
+    }
+    case JsonType::Array: {
+      tinygltf::Value::Array elements;
+      if (!array([&]() {
+            tinygltf::Value element;
+            if (!read(element)) {
+              return false;
+            }
+            if (element.Type() != tinygltf::NULL_TYPE) {
+              elements.emplace_back(std::move(element));
+            }
+            return true;
+          })) {
+        return false;
+      }
+      value = elements.empty() ? tinygltf::Value()
+                               : tinygltf::Value(std::move(elements));
+      return true;
+    }
+    case JsonType::String: {
+      std::string string;
+      if (!read(string)) {
+        return false;
+      }
+      value = tinygltf::Value(std::move(string));
+      return true;
+    }
+    case JsonType::Number:
+      if (!number(parsed)) {
+        return false;
+      }
+      value = parsed.integer ? tinygltf::Value(int(parsed.integerValue))
+                             : tinygltf::Value(parsed.value);
+      return true;
+    case JsonType::Bool:
+      if (!boolean(flag)) {
+        return false;
+      }
+      value = tinygltf::Value(flag);
+      return true;
+    case JsonType::Null:
+      value = tinygltf::Value();
+      return skip();
+    case JsonType::Invalid:
+      break;
+    }
+    return skip();
+  }
+
+  // Only objects are kept, empty ones too
+  bool read(tinygltf::ExtensionMap &extensions)
+  {
+    if (peek() != JsonType::Object) {
+      return skip();
+    }
+    extensions.clear();
+    return object([&](std::string_view key) {
+      if (peek() != JsonType::Object) {
+        return skip();
+      }
+      auto &extension = extensions[std::string(key)];
+      if (!read(extension)) {
+        return false;
+      }
+      if (extension.Type() == tinygltf::NULL_TYPE) {
+        extension = tinygltf::Value(tinygltf::Value::Object());
+      }
+      return true;
+    });
+  }
+
+private:
+  static bool isSpace(char c)
+  {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+  }
+
+  void skipSpace()
+  {
+    while (m_cursor != m_end && isSpace(*m_cursor)) {
+      ++m_cursor;
+    }
+  }
+
+  bool consume(char c)
+  {
+    skipSpace();
+    if (m_cursor != m_end && *m_cursor == c) {
+      ++m_cursor;
+      return true;
+    }
+    return false;
+  }
+
+  bool expect(char c)
+  {
+    return consume(c) ||
+           fail(m_cursor == m_end ? "unexpected end"
+                                  : std::string("expected '") + c + "'");
+  }
+
+  bool enter(char c)
+  {
+    if (m_depth == MAX_DEPTH) {
+      return fail("too deeply nested");
+    }
+    ++m_depth;
+    return expect(c);
+  }
+
+  bool literal(std::string_view word)
+  {
+    skipSpace();
+    if (size_t(m_end - m_cursor) >= word.size() &&
+        std::string_view(m_cursor, word.size()) == word) {
+      m_cursor += word.size();
+      return true;
+    }
+    return false;
+  }
+
+  bool digits()
+  {
+    const auto *begin = m_cursor;
+    while (m_cursor != m_end && *m_cursor >= '0' && *m_cursor <= '9') {
+      ++m_cursor;
+    }
+    return m_cursor != begin;
+  }
+
+  bool hex4(uint32_t &code)
+  {
+    if (m_end - m_cursor < 4) {
+      return fail("unterminated string");
+    }
+    const auto result = std::from_chars(m_cursor, m_cursor + 4, code, 16);
+    if (result.ptr != m_cursor + 4) {
+      return fail("invalid escape in string");
+    }
+    m_cursor += 4;
+    return true;
+  }
+
+  static void appendUtf8(std::string &string, uint32_t code)
+  {
+    if (code < 0x80) {
+      string += char(code);
+    } else if (code < 0x800) {
+      string += char(0xC0 | (code >> 6));
+      string += char(0x80 | (code & 0x3F));
+    } else if (code < 0x10000) {
+      string += char(0xE0 | (code >> 12));
+      string += char(0x80 | ((code >> 6) & 0x3F));
+      string += char(0x80 | (code & 0x3F));
+    } else {
+      string += char(0xF0 | (code >> 18));
+      string += char(0x80 | ((code >> 12) & 0x3F));
+      string += char(0x80 | ((code >> 6) & 0x3F));
+      string += char(0x80 | (code & 0x3F));
+    }
+  }
+
+  const char *m_begin;
+  const char *m_cursor;
+  const char *m_end;
+  int m_depth = 0;
+  std::string m_scratch; // Of the escaped strings skipped
+  std::string m_error;
+};
+
+// extensions and extras of a glTF object, or skip the member
+template <typename T>
+bool readOther(JsonReader &reader, std::string_view key, T &object)
+{
+  if (key == "extensions") {
+    return reader.read(object.extensions);
+  }
+  if (key == "extras") {
+    return reader.read(object.extras);
+  }
+  return reader.skip();
+}
+
+// Append the objects of an array to objects, each read by read(object)
+template <typename T, typename Read>
+bool readObjects(JsonReader &reader, const char *name,
+    std::vector<T> &objects, Read &&read)
+{
+  if (reader.peek() != JsonType::Array) {
+    return reader.skip();
+  }
+  return reader.array([&]() {
+    if (reader.peek() != JsonType::Object) {
+      return reader.fail(std::string(name) + "[" +
+                         std::to_string(objects.size()) +
+                         "] is not a JSON object");
+    }
+    objects.emplace_back();
+    return read(objects.back());
+  });
+}
+
+// Missing required property
+bool missing(JsonReader &reader, const char *property, const char *object,
+    size_t index)
+{
+  return reader.fail("'" + std::string(property) + "' property is missing in " +
+                     object + "[" + std::to_string(index) + "]");
+}
+
+template <typename Info>
+bool readTextureInfo(JsonReader &reader, Info &info, double *factor = nullptr,
+    std::string_view factorKey = {})
+{
+  if (reader.peek() != JsonType::Object) {
+    return reader.skip();
+  }
+  return reader.object([&](std::string_view key) {
+    if (key == "index") {
+      return reader.read(info.index);
+    }
+    if (key == "texCoord") {
+      return reader.read(info.texCoord);
+    }
+    if (factor && key == factorKey) {
+      return reader.read(*factor);
+    }
+    return readOther(reader, key, info);
+  });
+}
+
+bool readMaterial(JsonReader &reader, tinygltf::Material &material)
+{
+  material.emissiveFactor = {0., 0., 0.};
+  auto &pbr = material.pbrMetallicRoughness;
+  const auto readPbr = [&]() {
+    return reader.object([&](std::string_view key) {
+      if (key == "baseColorFactor") {
+        return reader.read(pbr.baseColorFactor);
+      }
+      if (key == "baseColorTexture") {
+        return readTextureInfo(reader, pbr.baseColorTexture);
+      }
+      if (key == "metallicFactor") {
+        return reader.read(pbr.metallicFactor);
+      }
+      if (key == "roughnessFactor") {
+        return reader.read(pbr.roughnessFactor);
+      }
+      if (key == "metallicRoughnessTexture") {
+        return readTextureInfo(reader, pbr.metallicRoughnessTexture);
+      }
+      return readOther(reader, key, pbr);
+    });
+  };
+
+  return reader.object([&](std::string_view key) {
+    if (key == "name") {
+      return reader.read(material.name);
+    }
+    if (key == "emissiveFactor") {
+      return reader.read(material.emissiveFactor);
+    }
+    if (key == "alphaMode") {
+      return reader.read(material.alphaMode);
+    }
+    if (key == "alphaCutoff") {
+      return reader.read(material.alphaCutoff);
+    }
+    if (key == "doubleSided") {
+      return reader.read(material.doubleSided);
+    }
+    if (key == "pbrMetallicRoughness") {
+      return reader.peek() == JsonType::Object ? readPbr() : reader.skip();
+    }
+    if (key == "normalTexture") {
+      return readTextureInfo(reader, material.normalTexture,
+          &material.normalTexture.scale, "scale");
+    }
+    if (key == "occlusionTexture") {
+      return readTextureInfo(reader, material.occlusionTexture,
+          &material.occlusionTexture.strength, "strength");
+    }
+    if (key == "emissiveTexture") {
+      return readTextureInfo(reader, material.emissiveTexture);
+    }
+    return readOther(reader, key, material);
+  });
+}
+
+bool readAccessor(JsonReader &reader, tinygltf::Accessor &accessor,
+    size_t index)
+{
+  bool hasComponentType = false;
+  bool hasCount = false;
+  std::string type;
+  auto &sparse = accessor.sparse;
+  const auto readSparse = [&]() {
+    sparse.isSparse = true;
+    sparse.count = 0;
+    sparse.indices = {0, -1, -1};
+    sparse.values = {-1, 0};
+    return reader.object([&](std::string_view key) {
+      if (key == "count") {
+        return reader.read(sparse.count);
+      }
+      if (key == "indices" && reader.peek() == JsonType::Object) {
+        return reader.object([&](std::string_view member) {
+          if (member == "bufferView") {
+            return reader.read(sparse.indices.bufferView);
+          }
+          if (member == "byteOffset") {
+            return reader.read(sparse.indices.byteOffset);
+          }
+          if (member == "componentType") {
+            return reader.read(sparse.indices.componentType);
+          }
+          return reader.skip();
+        });
+      }
+      if (key == "values" && reader.peek() == JsonType::Object) {
+        return reader.object([&](std::string_view member) {
+          if (member == "bufferView") {
+            return reader.read(sparse.values.bufferView);
+          }
+          if (member == "byteOffset") {
+            return reader.read(sparse.values.byteOffset);
+          }
+          return reader.skip();
+        });
+      }
+      return reader.skip();
+    });
+  };
+
+  if (!reader.object([&](std::string_view key) {
+        if (key == "bufferView") {
+          return reader.read(accessor.bufferView);
+        }
+        if (key == "byteOffset") {
+          return reader.read(accessor.byteOffset);
+        }
+        if (key == "normalized") {
+          return reader.read(accessor.normalized);
+        }
+        if (key == "componentType") {
+          return reader.read(accessor.componentType, &hasComponentType);
+        }
+        if (key == "count") {
+          return reader.read(accessor.count, &hasCount);
+        }
+        if (key == "type") {
+          return reader.read(type);
+        }
+        if (key == "name") {
+          return reader.read(accessor.name);
+        }
+        if (key == "min") {
+          return reader.read(accessor.minValues);
+        }
+        if (key == "max") {
+          return reader.read(accessor.maxValues);
+        }
+        if (key == "sparse") {
+          return reader.peek() == JsonType::Object ? readSparse()
+                                                   : reader.skip();
+        }
+        return readOther(reader, key, accessor);
+      })) {
+    return false;
+  }
+
+  if (!hasComponentType) {
+    return missing(reader, "componentType", "accessors", index);
+  }
+  if (!hasCount) {
+    return missing(reader, "count", "accessors", index);
+  }
+  if (accessor.componentType < TINYGLTF_COMPONENT_TYPE_BYTE ||
+      accessor.componentType > TINYGLTF_COMPONENT_TYPE_DOUBLE) {
+    return reader.fail(
+        "invalid componentType in accessors[" + std::to_string(index) + "]");
+  }
+  static const std::pair<const char *, int> types[] = {
+      {"SCALAR", TINYGLTF_TYPE_SCALAR}, {"VEC2", TINYGLTF_TYPE_VEC2},
+      {"VEC3", TINYGLTF_TYPE_VEC3}, {"VEC4", TINYGLTF_TYPE_VEC4},
+      {"MAT2", TINYGLTF_TYPE_MAT2}, {"MAT3", TINYGLTF_TYPE_MAT3},
+      {"MAT4", TINYGLTF_TYPE_MAT4}};
+  for (const auto &entry : types) {
+    if (type == entry.first) {
+      accessor.type = entry.second;
+      return true;
+    }
+  }
+  return reader.fail("unsupported type \"" + type + "\" in accessors[" +
+                     std::to_string(index) + "]");
+}
+
+bool readMesh(JsonReader &reader, tinygltf::Mesh &mesh, size_t index)
+{
+  const auto readPrimitive = [&](tinygltf::Primitive &primitive) {
+    bool hasAttributes = false;
+    primitive.mode = TINYGLTF_MODE_TRIANGLES;
+    if (!reader.object([&](std::string_view key) {
+          if (key == "attributes") {
+            hasAttributes = reader.peek() == JsonType::Object;
+            return reader.read(primitive.attributes);
+          }
+          if (key == "material") {
+            return reader.read(primitive.material);
+          }
+          if (key == "indices") {
+            return reader.read(primitive.indices);
+          }
+          if (key == "mode") {
+            return reader.read(primitive.mode);
+          }
+          if (key == "targets") {
+            if (reader.peek() != JsonType::Array) {
+              return reader.skip();
+            }
+            return reader.array([&]() {
+              primitive.targets.emplace_back();
+              return reader.read(primitive.targets.back());
+            });
+          }
+          return readOther(reader, key, primitive);
+        })) {
+      return false;
+    }
+    return hasAttributes ||
+           missing(reader, "attributes", "primitives of meshes", index);
+  };
+
+  return reader.object([&](std::string_view key) {
+    if (key == "name") {
+      return reader.read(mesh.name);
+    }
+    if (key == "primitives") {
+      return readObjects(reader, "primitives", mesh.primitives, readPrimitive);
+    }
+    if (key == "weights") {
+      return reader.read(mesh.weights);
+    }
+    return readOther(reader, key, mesh);
+  });
+}
+
+bool readNode(JsonReader &reader, tinygltf::Node &node)
+{
+  bool hasMatrix = false;
+  if (!reader.object([&](std::string_view key) {
+        if (key == "name") {
+          return reader.read(node.name);
+        }
+        if (key == "camera") {
+          return reader.read(node.camera);
+        }
+        if (key == "skin") {
+          return reader.read(node.skin);
+        }
+        if (key == "mesh") {
+          return reader.read(node.mesh);
+        }
+        if (key == "children") {
+          return reader.read(node.children);
+        }
+        if (key == "matrix") {
+          return reader.read(node.matrix, &hasMatrix);
+        }
+        if (key == "rotation") {
+          return reader.read(node.rotation);
+        }
+        if (key == "scale") {
+          return reader.read(node.scale);
+        }
+        if (key == "translation") {
+          return reader.read(node.translation);
+        }
+        if (key == "weights") {
+          return reader.read(node.weights);
+        }
+        return readOther(reader, key, node);
+      })) {
+    return false;
+  }
+  // The TRS are not read with a matrix
+  if (hasMatrix) {
+    node.rotation.clear();
+    node.scale.clear();
+    node.translation.clear();
+  }
+  return true;
+}
+
+bool readAnimation(JsonReader &reader, tinygltf::Animation &animation,
+    size_t index)
+{
+  const auto readChannel = [&](tinygltf::AnimationChannel &channel) {
+    bool hasSampler = false;
+    bool hasPath = false;
+    if (!reader.object([&](std::string_view key) {
+          if (key == "sampler") {
+            return reader.read(channel.sampler, &hasSampler);
+          }
+          if (key == "target" && reader.peek() == JsonType::Object) {
+            return reader.object([&](std::string_view member) {
+              if (member == "node") {
+                return reader.read(channel.target_node);
+              }
+              if (member == "path") {
+                return reader.read(channel.target_path, &hasPath);
+              }
+              return reader.skip();
+            });
+          }
+          return readOther(reader, key, channel);
+        })) {
+      return false;
+    }
+    if (!hasSampler) {
+      return missing(reader, "sampler", "channels of animations", index);
+    }
+    return hasPath || missing(reader, "path", "channels of animations", index);
+  };
+  const auto readSampler = [&](tinygltf::AnimationSampler &sampler) {
+    bool hasInput = false;
+    bool hasOutput = false;
+    if (!reader.object([&](std::string_view key) {
+          if (key == "input") {
+            return reader.read(sampler.input, &hasInput);
+          }
+          if (key == "output") {
+            return reader.read(sampler.output, &hasOutput);
+          }
+          if (key == "interpolation") {
+            return reader.read(sampler.interpolation);
+          }
+          return readOther(reader, key, sampler);
+        })) {
+      return false;
+    }
+    if (!hasInput) {
+      return missing(reader, "input", "samplers of animations", index);
+    }
+    return hasOutput ||
+           missing(reader, "output", "samplers of animations", index);
+  };
+
+  return reader.object([&](std::string_view key) {
+    if (key == "name") {
+      return reader.read(animation.name);
+    }
+    if (key == "channels") {
+      return readObjects(reader, "channels", animation.channels, readChannel);
+    }
+    if (key == "samplers") {
+      return readObjects(reader, "samplers", animation.samplers, readSampler);
+    }
+    return readOther(reader, key, animation);
+  });
+}
+
+bool readCamera(JsonReader &reader, tinygltf::Camera &camera, size_t index)
+{
+  bool hasPerspective = false;
+  bool hasOrthographic = false;
+  bool perspectiveRequired[2] = {};
+  bool orthographicRequired[4] = {};
+  auto &perspective = camera.perspective;
+  auto &orthographic = camera.orthographic;
+  if (!reader.object([&](std::string_view key) {
+        if (key == "name") {
+          return reader.read(camera.name);
+        }
+        if (key == "type") {
+          return reader.read(camera.type);
+        }
+        if (key == "perspective" && reader.peek() == JsonType::Object) {
+          hasPerspective = true;
+          return reader.object([&](std::string_view member) {
+            if (member == "aspectRatio") {
+              return reader.read(perspective.aspectRatio);
+            }
+            if (member == "yfov") {
+              return reader.read(perspective.yfov, &perspectiveRequired[0]);
+            }
+            if (member == "zfar") {
+              return reader.read(perspective.zfar);
+            }
+            if (member == "znear") {
+              return reader.read(perspective.znear, &perspectiveRequired[1]);
+            }
+            return readOther(reader, member, perspective);
+          });
+        }
+        if (key == "orthographic" && reader.peek() == JsonType::Object) {
+          hasOrthographic = true;
+          return reader.object([&](std::string_view member) {
+            if (member == "xmag") {
+              return reader.read(orthographic.xmag, &orthographicRequired[0]);
+            }
+            if (member == "ymag") {
+              return reader.read(orthographic.ymag, &orthographicRequired[1]);
+            }
+            if (member == "zfar") {
+              return reader.read(orthographic.zfar, &orthographicRequired[2]);
+            }
+            if (member == "znear") {
+              return reader.read(orthographic.znear, &orthographicRequired[3]);
+            }
+            return readOther(reader, member, orthographic);
+          });
+        }
+        return readOther(reader, key, camera);
+      })) {
+    return false;
+  }
+
+  const auto invalid = [&](const std::string &what) {
+    return reader.fail(what + " in cameras[" + std::to_string(index) + "]");
+  };
+  if (camera.type == "perspective") {
+    if (!hasPerspective) {
+      return invalid("missing perspective description");
+    }
+    return (perspectiveRequired[0] && perspectiveRequired[1]) ||
+           invalid("missing yfov or znear");
+  }
+  if (camera.type == "orthographic") {
+    if (!hasOrthographic) {
+      return invalid("missing orthographic description");
+    }
+    return std::all_of(std::begin(orthographicRequired),
+               std::end(orthographicRequired), [](bool has) { return has; }) ||
+           invalid("missing xmag, ymag, zfar or znear");
+  }
+  return invalid("invalid camera type \"" + camera.type + "\"");
+}
+
+// The lights array of KHR_lights_punctual
+bool readLights(JsonReader &reader, std::vector<tinygltf::Light> &lights)
+{
+  if (reader.peek() != JsonType::Object) {
+    return reader.skip();
+  }
+  return reader.object([&](std::string_view key) {
+    if (key != "lights") {
+      return reader.skip();
+    }
+    return readObjects(reader, "lights", lights, [&](tinygltf::Light &light) {
+      bool hasSpot = false;
+      if (!reader.object([&](std::string_view member) {
+            if (member == "name") {
+              return reader.read(light.name);
+            }
+            if (member == "type") {
+              return reader.read(light.type);
+            }
+            if (member == "color") {
+              return reader.read(light.color);
+            }
+            if (member == "intensity") {
+              return reader.read(light.intensity);
+            }
+            if (member == "range") {
+              return reader.read(light.range);
+            }
+            if (member == "spot" && reader.peek() == JsonType::Object) {
+              hasSpot = true;
+              return reader.object([&](std::string_view property) {
+                if (property == "innerConeAngle") {
+                  return reader.read(light.spot.innerConeAngle);
+                }
+                if (property == "outerConeAngle") {
+                  return reader.read(light.spot.outerConeAngle);
+                }
+                return readOther(reader, property, light.spot);
+              });
+            }
+            return readOther(reader, member, light);
+          })) {
+        return false;
+      }
+      const auto index = std::to_string(lights.size() - 1);
+      if (light.type.empty()) {
+        return reader.fail("missing type of lights[" + index + "]");
+      }
+      return light.type != "spot" || hasSpot ||
+             reader.fail("missing spot description of lights[" + index + "]");
+    });
+  });
+}
+
+bool readRoot(JsonReader &reader, tinygltf::Model &model,
+    std::vector<size_t> &bufferLengths, bool &hasVersion)
+{
+  const auto readAsset = [&]() {
+    return reader.object([&](std::string_view key) {
+      if (key == "version") {
+        return reader.read(model.asset.version, &hasVersion);
+      }
+      if (key == "generator") {
+        return reader.read(model.asset.generator);
+      }
+      if (key == "minVersion") {
+        return reader.read(model.asset.minVersion);
+      }
+      if (key == "copyright") {
+        return reader.read(model.asset.copyright);
+      }
+      return readOther(reader, key, model.asset);
+    });
+  };
+
+  const auto readBuffer = [&](tinygltf::Buffer &buffer) {
+    bool hasByteLength = false;
+    size_t byteLength = 0;
+    if (!reader.object([&](std::string_view key) {
+          if (key == "name") {
+            return reader.read(buffer.name);
+          }
+          if (key == "uri") {
+            return reader.read(buffer.uri);
+          }
+          if (key == "byteLength") {
+            return reader.read(byteLength, &hasByteLength);
+          }
+          return readOther(reader, key, buffer);
+        })) {
+      return false;
+    }
+    bufferLengths.push_back(byteLength);
+    return hasByteLength ||
+           missing(reader, "byteLength", "buffers", model.buffers.size() - 1);
+  };
+
+  const auto readBufferView = [&](tinygltf::BufferView &bufferView) {
+    const auto index = model.bufferViews.size() - 1;
+    bool hasBuffer = false;
+    bool hasByteLength = false;
+    if (!reader.object([&](std::string_view key) {
+          if (key == "name") {
+            return reader.read(bufferView.name);
+          }
+          if (key == "buffer") {
+            return reader.read(bufferView.buffer, &hasBuffer);
+          }
+          if (key == "byteOffset") {
+            return reader.read(bufferView.byteOffset);
+          }
+          if (key == "byteLength") {
+            return reader.read(bufferView.byteLength, &hasByteLength);
+          }
+          if (key == "byteStride") {
+            return reader.read(bufferView.byteStride);
+          }
+          if (key == "target") {
+            return reader.read(bufferView.target);
+          }
+          return readOther(reader, key, bufferView);
+        })) {
+      return false;
+    }
+    if (!hasBuffer) {
+      return missing(reader, "buffer", "bufferViews", index);
+    }
+    if (!hasByteLength) {
+      return missing(reader, "byteLength", "bufferViews", index);
+    }
+    if (bufferView.byteStride > 252 || bufferView.byteStride % 4) {
+      return reader.fail(
+          "invalid byteStride in bufferViews[" + std::to_string(index) + "]");
+    }
+    if (bufferView.target != TINYGLTF_TARGET_ARRAY_BUFFER &&
+        bufferView.target != TINYGLTF_TARGET_ELEMENT_ARRAY_BUFFER) {
+      bufferView.target = 0;
+    }
+    return true;
+  };
+
+  const auto readImage = [&](tinygltf::Image &image) {
+    const auto index = model.images.size() - 1;
+    bool hasBufferView = false;
+    bool hasUri = false;
+    int width = 0;
+    int height = 0;
+    if (!reader.object([&](std::string_view key) {
+          if (key == "name") {
+            return reader.read(image.name);
+          }
+          if (key == "uri") {
+            return reader.read(image.uri, &hasUri);
+          }
+          if (key == "bufferView") {
+            return reader.read(image.bufferView, &hasBufferView);
+          }
+          if (key == "mimeType") {
+            return reader.read(image.mimeType);
+          }
+          if (key == "width") {
+            return reader.read(width);
+          }
+          if (key == "height") {
+            return reader.read(height);
+          }
+          return readOther(reader, key, image);
+        })) {
+      return false;
+    }
+    if (hasBufferView == hasUri) {
+      return reader.fail("images[" + std::to_string(index) +
+                         "] needs one of bufferView or uri");
+    }
+    if (hasBufferView) {
+      image.width = width;
+      image.height = height;
+    } else {
+      image.mimeType.clear();
+    }
+    return true;
+  };
+
+  const auto readTexture = [&](tinygltf::Texture &texture) {
+    return reader.object([&](std::string_view key) {
+      if (key == "name") {
+        return reader.read(texture.name);
+      }
+      if (key == "sampler") {
+        return reader.read(texture.sampler);
+      }
+      if (key == "source") {
+        return reader.read(texture.source);
+      }
+      return readOther(reader, key, texture);
+    });
+  };
+
+  const auto readSampler = [&](tinygltf::Sampler &sampler) {
+    return reader.object([&](std::string_view key) {
+      if (key == "name") {
+        return reader.read(sampler.name);
+      }
+      if (key == "minFilter") {
+        return reader.read(sampler.minFilter);
+      }
+      if (key == "magFilter") {
+        return reader.read(sampler.magFilter);
+      }
+      if (key == "wrapS") {
+        return reader.read(sampler.wrapS);
+      }
+      if (key == "wrapT") {
+        return reader.read(sampler.wrapT);
+      }
+      if (key == "wrapR") {
+        return reader.read(sampler.wrapR);
+      }
+      return readOther(reader, key, sampler);
+    });
+  };
+
+  const auto readSkin = [&](tinygltf::Skin &skin) {
+    return reader.object([&](std::string_view key) {
+      if (key == "name") {
+        return reader.read(skin.name);
+      }
+      if (key == "joints") {
+        return reader.read(skin.joints);
+      }
+      if (key == "skeleton") {
+        return reader.read(skin.skeleton);
+      }
+      if (key == "inverseBindMatrices") {
+        return reader.read(skin.inverseBindMatrices);
+      }
+      return readOther(reader, key, skin);
+    });
+  };
+
+  const auto readScene = [&](tinygltf::Scene &scene) {
+    return reader.object([&](std::string_view key) {
+      if (key == "name") {
+        return reader.read(scene.name);
+      }
+      if (key == "nodes") {
+        return reader.read(scene.nodes);
+      }
+      return readOther(reader, key, scene);
+    });
+  };
+
+  // The lights are read from the same bytes as the extension
+  const auto readExtensions = [&]() {
+    if (reader.peek() != JsonType::Object) {
+      return reader.skip();
+    }
+    return reader.object([&](std::string_view key) {
+      if (reader.peek() != JsonType::Object) {
+        return reader.skip();
+      }
+      const auto *position = reader.position();
+      const auto isLights = key == "KHR_lights_punctual";
+      auto &extension = model.extensions[std::string(key)];
+      if (!reader.read(extension)) {
+        return false;
+      }
+      if (extension.Type() == tinygltf::NULL_TYPE) {
+        extension = tinygltf::Value(tinygltf::Value::Object());
+      }
+      if (!isLights) {
+        return true;
+      }
+      reader.seek(position);
+      return readLights(reader, model.lights);
+    });
+  };
+
+  if (reader.peek() != JsonType::Object) {
+    return reader.fail("the root is not a JSON object");
+  }
+  return reader.object([&](std::string_view key) {
+    if (key == "asset") {
+      return reader.peek() == JsonType::Object ? readAsset() : reader.skip();
+    }
+    if (key == "extensionsUsed") {
+      return reader.read(model.extensionsUsed);
+    }
+    if (key == "extensionsRequired") {
+      return reader.read(model.extensionsRequired);
+    }
+    if (key == "buffers") {
+      return readObjects(reader, "buffers", model.buffers, readBuffer);
+    }
+    if (key == "bufferViews") {
+      return readObjects(
+          reader, "bufferViews", model.bufferViews, readBufferView);
+    }
+    if (key == "accessors") {
+      return readObjects(reader, "accessors", model.accessors,
+          [&](tinygltf::Accessor &accessor) {
+            return readAccessor(reader, accessor, model.accessors.size() - 1);
+          });
+    }
+    if (key == "meshes") {
+      return readObjects(
+          reader, "meshes", model.meshes, [&](tinygltf::Mesh &mesh) {
+            return readMesh(reader, mesh, model.meshes.size() - 1);
+          });
+    }
+    if (key == "nodes") {
+      return readObjects(
+          reader, "nodes", model.nodes, [&](tinygltf::Node &node) {
+            return readNode(reader, node);
+          });
+    }
+    if (key == "scenes") {
+      return readObjects(reader, "scenes", model.scenes, readScene);
+    }
+    if (key == "scene") {
+      return reader.read(model.defaultScene);
+    }
+    if (key == "materials") {
+      return readObjects(reader, "materials", model.materials,
+          [&](tinygltf::Material &material) {
+            return readMaterial(reader, material);
+          });
+    }
+    if (key == "images") {
+      return readObjects(reader, "images", model.images, readImage);
+    }
+    if (key == "textures") {
+      return readObjects(reader, "textures", model.textures, readTexture);
+    }
+    if (key == "samplers") {
+      return readObjects(reader, "samplers", model.samplers, readSampler);
+    }
+    if (key == "animations") {
+      return readObjects(reader, "animations", model.animations,
+          [&](tinygltf::Animation &animation) {
+            return readAnimation(
+                reader, animation, model.animations.size() - 1);
+          });
+    }
+    if (key == "skins") {
+      return readObjects(reader, "skins", model.skins, readSkin);
+    }
+    if (key == "cameras") {
+      return readObjects(
+          reader, "cameras", model.cameras, [&](tinygltf::Camera &camera) {
+            return readCamera(reader, camera, model.cameras.size() - 1);
+          });
+    }
+    if (key == "extensions") {
+      return readExtensions();
+    }
+    if (key == "extras") {
+      return reader.read(model.extras);
+    }
+    return reader.skip();
+  });
+}
+
+// What needs the whole model: the targets of the buffer views of indices and
+// attributes, as tinygltf assigns them
+bool checkModel(tinygltf::Model &model, std::string &err)
+{
+  const auto accessorView = [&](int accessor) {
+    return accessor >= 0 && size_t(accessor) < model.accessors.size()
+               ? model.accessors[accessor].bufferView
+               : -2;
+  };
+  const auto validView = [&](int bufferView) {
+    return bufferView >= 0 && size_t(bufferView) < model.bufferViews.size();
+  };
+  for (size_t m = 0; m < model.meshes.size(); ++m) {
+    for (const auto &primitive : model.meshes[m].primitives) {
+      if (primitive.indices >= 0) {
+        const auto bufferView = accessorView(primitive.indices);
+        if (!validView(bufferView)) {
+          err = "Invalid indices accessor in meshes[" + std::to_string(m) + "]";
+          return false;
+        }
+        model.bufferViews[bufferView].target =
+            TINYGLTF_TARGET_ELEMENT_ARRAY_BUFFER;
+      }
+      for (const auto &attribute : primitive.attributes) {
+        const auto bufferView = accessorView(attribute.second);
+        if (bufferView == -2) {
+          err = "Invalid " + attribute.first + " accessor in meshes[" +
+                std::to_string(m) + "]";
+          return false;
+        }
+        // Sparse accessors may have no view
+        if (validView(bufferView)) {
+          model.bufferViews[bufferView].target = TINYGLTF_TARGET_ARRAY_BUFFER;
+        }
+      }
+    }
+  }
+  for (size_t i = 0; i < model.images.size(); ++i) {
+    const auto bufferView = model.images[i].bufferView;
+    if (bufferView != -1 &&
+        (!validView(bufferView) ||
+            size_t(model.bufferViews[bufferView].buffer) >=
+                model.buffers.size())) {
+      err = "Invalid bufferView of images[" + std::to_string(i) + "]";
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+bool parseGltfJson(const unsigned char *json, size_t size,
+    tinygltf::Model &model, std::vector<size_t> &bufferLengths,
+    std::string &err)
+{
+  TRACE_ZONE("parseGltfJson");
+  model = tinygltf::Model();
+  model.defaultScene = -1;
+  bufferLengths.clear();
+
+  const auto *begin = reinterpret_cast<const char *>(json);
+  JsonReader reader(begin, begin + size);
+  bool hasVersion = false;
+  if (!readRoot(reader, model, bufferLengths, hasVersion) ||
+      !reader.atEnd()) {
+    err = "Unable to parse glTF JSON: " + reader.error();
+    return false;
+  }
+  if (!hasVersion) {
+    err = "Missing version of the glTF asset";
+    return false;
+  }
+  return checkModel(model, err);
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <tiny_gltf.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Parse the JSON of a .gltf file, or the JSON chunk of a .glb file, straight
+// into model in a single pass over the bytes: no JSON document is built and
+// nothing is serialized again. Properties are read as tinygltf reads them,
+// with the same defaults, extensions and extras, except for those the viewer
+// never reads (the legacy Material::values and additionalValues, the original
+// JSON of extras and extensions), so that models are not equal to those of
+// tinygltf (operator==) once these are set. Buffers and images are only
+// described, loading them is left to the caller: buffer data stays empty and
+// its byteLength is returned in bufferLengths, images keep their uri or
+// bufferView. KHR_lights_punctual
+// lights are read into model.lights.
+bool parseGltfJson(const unsigned char *json, size_t size,
+    tinygltf::Model &model, std::vector<size_t> &bufferLengths,
+    std::string &err);
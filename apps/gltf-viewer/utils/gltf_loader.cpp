@@ -0,0 +1,1387 @@
+#include "gltf_loader.hpp"
+#include "base64.hpp"
+#include "file_read_batch.hpp"
+#include "gltf_json.hpp"
+#include "heap_memory.hpp"
+#include "http_reader.hpp"
+#include "job_system.hpp"
+#include "ktx2.hpp"
+#include "meshopt_decoder.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <string_view>
+#include <unordered_map>
+
+#include <json.hpp>
+#include <stb_image.h>
+
+namespace
+{
+
+const uint32_t GLB_MAGIC = 0x46546C67; // "glTF"
+const uint32_t GLB_CHUNK_JSON = 0x4E4F534A; // "JSON"
+const uint32_t GLB_CHUNK_BIN = 0x004E4942; // "BIN\0"
+
+// Buffers and images whose bytes we provide ourselves are rewritten in the JSON
+// to reference a fake uri starting with this prefix. The file system callbacks
+// given to tinygltf recognize it and answer without touching the disk.
+const char *const REDIRECT_PREFIX = "gltf-viewer-redirect:";
+
+struct RedirectedBuffer
+{
+  int bufferIdx;
+  std::string uri;
+};
+
+struct RedirectedImage
+{
+  int imageIdx;
+  int bufferViewIdx;
+  std::string mimeType;
+};
+
+struct RedirectContext
+{
+  // Bytes returned to tinygltf for each redirected uri
+  std::unordered_map<std::string, BufferSpan> files;
+};
+
+// Encoded bytes of an image, decoded after parsing
+struct DeferredImage
+{
+  int imageIdx;
+  std::vector<unsigned char> bytes;
+  // In the BIN chunk of a remote file, copied to bytes by decodeImages() once
+  // downloaded
+  BufferSpan remote;
+};
+
+// Of a remote file, downloaded by a first request: the header and JSON chunk
+// of most .glb files
+const size_t REMOTE_HEAD_SIZE = size_t(64) << 10;
+// Bytes of the BIN chunk between two ranges of the same priority downloaded
+// with them rather than by a request of their own
+const size_t REMOTE_MERGE_GAP = size_t(16) << 10;
+// Ranges are split in requests of at most this size, so that a large buffer
+// is also downloaded over several connections
+const size_t REMOTE_RANGE_SIZE = size_t(4) << 20;
+
+// Characters of a base64 payload decoded by one job: data uris are split at
+// multiples of 4 characters so that a large buffer is decoded by several
+const size_t BASE64_CHUNK_SIZE = size_t(1) << 20;
+
+// Part of the payload of a data uri, and where it decodes to
+struct Base64Chunk
+{
+  const char *text;
+  size_t size;
+  unsigned char *bytes;
+  size_t owner; // Given to addDataUri()
+};
+
+uint32_t readU32(const unsigned char *bytes)
+{
+  uint32_t value;
+  std::memcpy(&value, bytes, sizeof(value));
+  return value;
+}
+
+bool isDataUri(const std::string &uri) { return uri.compare(0, 5, "data:") == 0; }
+
+const BufferSpan *findRedirect(const std::string &path, void *userData)
+{
+  const auto pos = path.find(REDIRECT_PREFIX);
+  if (pos == std::string::npos) {
+    return nullptr;
+  }
+  const auto &files = static_cast<const RedirectContext *>(userData)->files;
+  const auto it = files.find(path.substr(pos));
+  return it == end(files) ? nullptr : &(*it).second;
+}
+
+bool redirectFileExists(const std::string &path, void *userData)
+{
+  return findRedirect(path, userData) ||
+         tinygltf::FileExists(path, nullptr);
+}
+
+std::string redirectExpandFilePath(const std::string &path, void *userData)
+{
+  if (findRedirect(path, userData)) {
+    return path;
+  }
+  return tinygltf::ExpandFilePath(path, nullptr);
+}
+
+bool redirectReadWholeFile(std::vector<unsigned char> *out, std::string *err,
+    const std::string &path, void *userData)
+{
+  if (const auto *span = findRedirect(path, userData)) {
+    out->assign(span->data, span->data + span->size);
+    return true;
+  }
+  return tinygltf::ReadWholeFile(out, err, path, nullptr);
+}
+
+tinygltf::FsCallbacks defaultFsCallbacks()
+{
+  return tinygltf::FsCallbacks{&tinygltf::FileExists,
+      &tinygltf::ExpandFilePath, &tinygltf::ReadWholeFile,
+      &tinygltf::WriteWholeFile, nullptr};
+}
+
+// Image loader given to tinygltf: keep a copy of the encoded bytes so that all
+// images can be decoded concurrently by decodeImages() once parsing is done
+bool deferImageData(tinygltf::Image *image, const int imageIdx,
+    std::string *err, std::string *warn, int reqWidth, int reqHeight,
+    const unsigned char *bytes, int size, void *userData)
+{
+  auto &images = *static_cast<std::vector<DeferredImage> *>(userData);
+  images.push_back({imageIdx, std::vector<unsigned char>(bytes, bytes + size)});
+  return true;
+}
+
+// Read the dimensions of an encoded image from its header, keeping the bytes
+// in image.image with as_is set so that decodeImage() can decode them later
+bool keepEncodedImage(tinygltf::Image &image, int imageIdx,
+    std::vector<unsigned char> &bytes, std::string &err)
+{
+  int width, height, component;
+  if (!stbi_info_from_memory(
+          bytes.data(), int(bytes.size()), &width, &height, &component)) {
+    err = "Unknown image format for image[" + std::to_string(imageIdx) +
+          "] name = \"" + image.name + "\".\n";
+    return false;
+  }
+  image.width = width;
+  image.height = height;
+  image.component = 4; // As decodeImage() will expand them
+  image.bits =
+      stbi_is_16_bit_from_memory(bytes.data(), int(bytes.size())) ? 16 : 8;
+  image.pixel_type = image.bits == 16 ? TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT
+                                      : TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE;
+  image.as_is = true;
+  image.image = std::move(bytes);
+  return true;
+}
+
+// Index of the first image with the same encoded bytes as each one, or -1 if
+// it is the first. Images with the same hash are compared byte for byte.
+// Those still downloading are only duplicates of the same buffer view bytes.
+std::vector<int> findDuplicateImages(const std::vector<DeferredImage> &images)
+{
+  TRACE_ZONE("findDuplicateImages");
+  std::unordered_multimap<size_t, int> imagesByHash;
+  std::vector<int> duplicateOf(images.size(), -1);
+  const auto same = [](const DeferredImage &a, const DeferredImage &b) {
+    if (a.remote.data || b.remote.data) {
+      return a.remote.data == b.remote.data && a.remote.size == b.remote.size;
+    }
+    return a.bytes == b.bytes;
+  };
+  for (size_t i = 0; i < images.size(); ++i) {
+    const auto &image = images[i];
+    const auto hash =
+        image.remote.data
+            ? std::hash<const void *>()(image.remote.data) ^ image.remote.size
+            : std::hash<std::string_view>()(std::string_view(
+                  reinterpret_cast<const char *>(image.bytes.data()),
+                  image.bytes.size()));
+    const auto candidates = imagesByHash.equal_range(hash);
+    for (auto it = candidates.first; it != candidates.second; ++it) {
+      if (same(images[(*it).second], image)) {
+        duplicateOf[i] = (*it).second;
+        break;
+      }
+    }
+    if (duplicateOf[i] < 0) {
+      imagesByHash.emplace(hash, int(i));
+    }
+  }
+  return duplicateOf;
+}
+
+// Point the textures sampling a duplicate image, directly or through an image
+// format extension such as KHR_texture_basisu, to its first copy
+void remapDuplicateImages(
+    tinygltf::Model &model, const std::vector<int> &imageRemap)
+{
+  const auto remap = [&](int source) {
+    return source >= 0 && size_t(source) < imageRemap.size()
+               ? imageRemap[source]
+               : source;
+  };
+  for (auto &texture : model.textures) {
+    texture.source = remap(texture.source);
+    for (auto &extension : texture.extensions) {
+      auto &value = extension.second;
+      if (value.IsObject() && value.Has("source") &&
+          value.Get("source").IsNumber()) {
+        auto &object = value.Get<tinygltf::Value::Object>();
+        object["source"] =
+            tinygltf::Value(remap(int(object["source"].GetNumberAsInt())));
+      }
+    }
+  }
+}
+
+// Decode images with tinygltf::LoadImageData (stb_image) on the shared job
+// system, one image per job.
+// KTX2 images are kept encoded with mimeType "image/ktx2", they are uploaded as
+// is. Since they may only be a KHR_texture_basisu alternative to another image,
+// those that cannot be used are left empty with a warning instead of an error.
+// With lazy, other images are only kept encoded by keepEncodedImage().
+// Exporters often embed the same image several times: only the first copy is
+// decoded, the textures of the others sample it and they are left empty.
+// The jobs of images in the BIN chunk of a remote file wait for their bytes,
+// each is decoded as soon as they arrive.
+bool decodeImages(tinygltf::Model &model, std::vector<DeferredImage> &images,
+    bool lazy, HttpReader *remote, std::string &err, std::string &warn)
+{
+  TRACE_ZONE("decodeImages");
+  const auto duplicateOf = findDuplicateImages(images);
+  std::vector<std::string> errors(images.size());
+  std::vector<std::string> warnings(images.size());
+  std::vector<char> decoded(images.size(), 0);
+  std::atomic<bool> downloadFailed{false};
+
+  const auto decode = [&](size_t begin, size_t end) {
+    HeapTagScope heapTag(HeapTag::Images);
+    for (size_t i = begin; i < end; ++i) {
+      TRACE_ZONE("decodeImage");
+      auto &image = images[i];
+      auto &modelImage = model.images[image.imageIdx];
+      if (duplicateOf[i] >= 0) {
+        decoded[i] = true;
+        std::vector<unsigned char>().swap(image.bytes);
+        continue;
+      }
+      if (image.remote.data) {
+        if (!remote->wait(image.remote.data, image.remote.size)) {
+          downloadFailed = true;
+          continue;
+        }
+        image.bytes.assign(
+            image.remote.data, image.remote.data + image.remote.size);
+      }
+      if (isKtx2(image.bytes.data(), image.bytes.size())) {
+        Ktx2Texture texture;
+        std::string ktx2Err;
+        if (parseKtx2(image.bytes.data(), image.bytes.size(), texture,
+                ktx2Err)) {
+          modelImage.width = texture.width;
+          modelImage.height = texture.height;
+          modelImage.mimeType = "image/ktx2";
+          modelImage.image = std::move(image.bytes);
+        } else {
+          warnings[i] = "image[" + std::to_string(image.imageIdx) +
+                        "] ignored: " + ktx2Err + "\n";
+        }
+        decoded[i] = true;
+        continue;
+      }
+      if (lazy) {
+        decoded[i] = keepEncodedImage(
+            modelImage, image.imageIdx, image.bytes, errors[i]);
+        continue;
+      }
+      decoded[i] = tinygltf::LoadImageData(&modelImage, image.imageIdx,
+          &errors[i], &warnings[i], 0, 0, image.bytes.data(),
+          int(image.bytes.size()), nullptr);
+      std::vector<unsigned char>().swap(image.bytes);
+    }
+  };
+
+  JobSystem::shared().parallelFor(images.size(), 1, decode);
+
+  bool ret = true;
+  if (downloadFailed) {
+    err += remote->error() + "\n";
+  }
+  std::vector<int> imageRemap(model.images.size());
+  for (size_t i = 0; i < model.images.size(); ++i) {
+    imageRemap[i] = int(i);
+  }
+  for (size_t i = 0; i < images.size(); ++i) {
+    err += errors[i];
+    warn += warnings[i];
+    ret = ret && decoded[i];
+    if (duplicateOf[i] >= 0) {
+      imageRemap[images[i].imageIdx] = images[duplicateOf[i]].imageIdx;
+    }
+  }
+  remapDuplicateImages(model, imageRemap);
+  return ret;
+}
+
+// Buffer without uri whose bytes are only given by the buffer views of
+// EXT_meshopt_compression that decode to it
+bool isMeshoptFallback(const nlohmann::json &buffer)
+{
+  if (buffer.count("uri") || !buffer.count("extensions")) {
+    return false;
+  }
+  const auto &extensions = buffer["extensions"];
+  const auto it = extensions.find("EXT_meshopt_compression");
+  return it != extensions.end() && (*it).is_object() &&
+         (*it).value("fallback", false);
+}
+
+bool isMeshoptFallback(const tinygltf::Buffer &buffer)
+{
+  if (!buffer.uri.empty()) {
+    return false;
+  }
+  const auto it = buffer.extensions.find("EXT_meshopt_compression");
+  if (it == end(buffer.extensions) || !(*it).second.IsObject()) {
+    return false;
+  }
+  const auto &fallback = (*it).second.Get("fallback");
+  return fallback.IsBool() && fallback.Get<bool>();
+}
+
+size_t valueSize(const tinygltf::Value &object, const char *key)
+{
+  const auto &value = object.Get(key);
+  return value.IsNumber() && value.GetNumberAsDouble() >= 0
+             ? size_t(value.GetNumberAsDouble())
+             : 0;
+}
+
+// Decode the buffer views compressed with EXT_meshopt_compression on the shared
+// job system, like images. The buffers they decode to
+// are copied once to decoded, whose bytes replace their spans, and the
+// views are decoded there in place.
+bool decodeMeshoptBufferViews(const tinygltf::Model &model,
+    std::vector<BufferSpan> &spans,
+    std::vector<std::vector<unsigned char>> &decoded, std::string &err)
+{
+  std::vector<size_t> views;
+  for (size_t i = 0; i < model.bufferViews.size(); ++i) {
+    const auto &extensions = model.bufferViews[i].extensions;
+    const auto it = extensions.find("EXT_meshopt_compression");
+    if (it != end(extensions) && (*it).second.IsObject()) {
+      views.push_back(i);
+    }
+  }
+  if (views.empty()) {
+    return true;
+  }
+  TRACE_ZONE("decodeMeshoptBufferViews");
+
+  // Fallback buffers have no bytes at all, they get those of their views
+  std::vector<size_t> decodedSizes(model.buffers.size(), 0);
+  for (const auto i : views) {
+    const auto &bufferView = model.bufferViews[i];
+    if (bufferView.buffer >= 0 && size_t(bufferView.buffer) < spans.size()) {
+      auto &size = decodedSizes[bufferView.buffer];
+      size = std::max({size, spans[bufferView.buffer].size,
+          bufferView.byteOffset + bufferView.byteLength});
+    }
+  }
+  for (size_t i = 0; i < decodedSizes.size(); ++i) {
+    if (decodedSizes[i]) {
+      const auto &span = spans[i];
+      decoded.emplace_back(decodedSizes[i], 0);
+      if (span.data) {
+        std::copy(span.data, span.data + span.size, decoded.back().data());
+      }
+      spans[i] = {decoded.back().data(), decoded.back().size()};
+    }
+  }
+
+  std::vector<std::string> errors(views.size());
+  const auto decode = [&](size_t begin, size_t end) {
+    for (size_t v = begin; v < end; ++v) {
+      const auto &bufferView = model.bufferViews[views[v]];
+      const auto &extension =
+          (*bufferView.extensions.find("EXT_meshopt_compression")).second;
+      const auto error = [&](const std::string &message) {
+        errors[v] = "bufferView[" + std::to_string(views[v]) +
+                    "]: " + message + "\n";
+      };
+
+      const auto source = extension.Get("buffer");
+      const auto sourceIdx = source.IsNumber() ? source.GetNumberAsInt() : -1;
+      const auto byteOffset = valueSize(extension, "byteOffset");
+      const auto byteLength = valueSize(extension, "byteLength");
+      const auto byteStride = valueSize(extension, "byteStride");
+      const auto count = valueSize(extension, "count");
+      const auto &mode = extension.Get("mode");
+      const auto &filterName = extension.Get("filter");
+      MeshoptFilter filter;
+      if (sourceIdx < 0 || size_t(sourceIdx) >= spans.size() ||
+          !spans[sourceIdx].data ||
+          byteOffset + byteLength > spans[sourceIdx].size ||
+          bufferView.buffer < 0 || size_t(bufferView.buffer) >= spans.size() ||
+          count * byteStride > bufferView.byteLength ||
+          bufferView.byteOffset + bufferView.byteLength >
+              spans[bufferView.buffer].size ||
+          !mode.IsString() ||
+          !parseMeshoptFilter(filterName.IsString()
+                                  ? filterName.Get<std::string>()
+                                  : std::string(),
+              filter)) {
+        error("invalid EXT_meshopt_compression properties");
+        continue;
+      }
+
+      const auto *data = spans[sourceIdx].data + byteOffset;
+      // The span is read-only for the other buffers only
+      auto *destination = const_cast<unsigned char *>(
+          spans[bufferView.buffer].data + bufferView.byteOffset);
+      const auto &modeName = mode.Get<std::string>();
+      bool ok = false;
+      if (modeName == "ATTRIBUTES") {
+        ok = decodeMeshoptAttributes(
+            destination, count, byteStride, filter, data, byteLength);
+      } else if (modeName == "TRIANGLES") {
+        ok = decodeMeshoptTriangles(
+            destination, count, byteStride, data, byteLength);
+      } else if (modeName == "INDICES") {
+        ok = decodeMeshoptIndices(
+            destination, count, byteStride, data, byteLength);
+      } else {
+        error("unknown EXT_meshopt_compression mode " + modeName);
+        continue;
+      }
+      if (!ok) {
+        error("invalid EXT_meshopt_compression " + modeName + " data");
+      }
+    }
+  };
+
+  JobSystem::shared().parallelFor(views.size(), 1, decode);
+
+  bool ret = true;
+  for (const auto &error : errors) {
+    err += error;
+    ret = ret && error.empty();
+  }
+  return ret;
+}
+
+// KHR_draco_mesh_compression primitives keep their uncompressed accessors,
+// which are drawn unless the extension is required
+bool checkDracoPrimitives(
+    const tinygltf::Model &model, std::string &err, std::string &warn)
+{
+  const auto extension = "KHR_draco_mesh_compression";
+  if (std::find(begin(model.extensionsRequired), end(model.extensionsRequired),
+          extension) != end(model.extensionsRequired)) {
+    err = std::string(extension) + " is required but not supported";
+    return false;
+  }
+  for (const auto &mesh : model.meshes) {
+    for (const auto &primitive : mesh.primitives) {
+      if (primitive.extensions.count(extension)) {
+        warn += std::string(extension) +
+                " is not supported, drawing the fallback geometry\n";
+        return true;
+      }
+    }
+  }
+  return true;
+}
+
+bool readFile(const fs::path &path, std::vector<unsigned char> &bytes)
+{
+  std::ifstream input(path.string(), std::ios::binary | std::ios::ate);
+  if (!input) {
+    return false;
+  }
+  const auto size = size_t(input.tellg());
+  input.seekg(0);
+  bytes.resize(size);
+  return bool(input.read(reinterpret_cast<char *>(bytes.data()), size));
+}
+
+// Map the file, or read it into fallback if it cannot be mapped
+bool mapFile(const fs::path &path, MappedFile &mapping,
+    std::vector<unsigned char> &fallback, BufferSpan &span)
+{
+  mapping = MappedFile(path);
+  if (mapping.isOpen()) {
+    mapping.prefetch();
+    span = {mapping.data(), mapping.size()};
+    return true;
+  }
+  if (!readFile(path, fallback)) {
+    return false;
+  }
+  span = {fallback.data(), fallback.size()};
+  return true;
+}
+
+// Parse the glTF JSON with tinygltf, except that the bytes of the GLB BIN chunk
+// and of external buffer files are never copied into tinygltf::Buffer::data.
+// Those buffers are rewritten to load a single dummy byte, external files are
+// memory mapped and spans are returned on the chunk or on the mappings. Images
+// stored in such buffers are redirected the same way so that decoding reads
+// them from the chunk or the mapping too. The paths of external buffer files
+// are appended to files.
+bool loadRedirectedModel(tinygltf::TinyGLTF &loader, const BufferSpan &json,
+    const BufferSpan &bin, const fs::path &baseDir, tinygltf::Model &model,
+    std::vector<MappedFile> &mappedFiles, std::vector<BufferSpan> &spans,
+    std::vector<fs::path> &files, std::string &err, std::string &warn)
+{
+  nlohmann::json document;
+  try {
+    document = nlohmann::json::parse(json.data, json.data + json.size);
+  } catch (const std::exception &e) {
+    err = std::string("Unable to parse glTF JSON: ") + e.what();
+    return false;
+  }
+
+  static const unsigned char dummyByte = 0;
+  RedirectContext context;
+  std::vector<RedirectedBuffer> redirectedBuffers;
+  std::vector<RedirectedImage> redirectedImages;
+
+  if (document.count("buffers") && document["buffers"].is_array()) {
+    auto &buffers = document["buffers"];
+    spans.resize(buffers.size());
+
+    for (size_t i = 0; i < buffers.size(); ++i) {
+      auto &buffer = buffers[i];
+      const auto byteLength = buffer.value("byteLength", size_t(0));
+      const auto uri = buffer.value("uri", std::string());
+
+      if (isMeshoptFallback(buffer)) {
+        // Decoded from the compressed buffer views once parsed
+      } else if (uri.empty()) {
+        if (!bin.data) {
+          // Let tinygltf report the error
+          continue;
+        }
+        spans[i] = {bin.data, std::min(byteLength, bin.size)};
+      } else if (!isDataUri(uri)) {
+        // External .bin file, relative to the glTF file like tinygltf does
+        const auto filePath = gltfUriPath(baseDir, uri);
+        MappedFile mapping(filePath);
+        files.push_back(filePath);
+        if (!mapping.isOpen()) {
+          mapping = MappedFile(fs::path(uri));
+          files.back() = fs::path(uri);
+        }
+        if (!mapping.isOpen() || mapping.size() < byteLength) {
+          // Let tinygltf load it (and report errors)
+          continue;
+        }
+        mapping.prefetch();
+        spans[i] = {mapping.data(), byteLength};
+        mappedFiles.emplace_back(std::move(mapping));
+      } else {
+        continue;
+      }
+
+      const auto redirectUri =
+          REDIRECT_PREFIX + std::string("buffer/") + std::to_string(i);
+      buffer["uri"] = redirectUri;
+      buffer["byteLength"] = 1;
+      context.files[redirectUri] = {&dummyByte, 1};
+      redirectedBuffers.push_back({int(i), uri});
+    }
+  }
+
+  if (redirectedBuffers.empty()) {
+    // Nothing to redirect, avoid serializing the document again
+    return loader.LoadASCIIFromString(&model, &err, &warn,
+        reinterpret_cast<const char *>(json.data), (unsigned int)json.size,
+        baseDir.string());
+  }
+
+  if (document.count("images") && document["images"].is_array() &&
+      document.count("bufferViews")) {
+    auto &images = document["images"];
+    const auto &bufferViews = document["bufferViews"];
+    for (size_t i = 0; i < images.size(); ++i) {
+      auto &image = images[i];
+      if (!image.count("bufferView")) {
+        continue;
+      }
+      const auto bufferViewIdx = image["bufferView"].get<int>();
+      if (bufferViewIdx < 0 || size_t(bufferViewIdx) >= bufferViews.size()) {
+        continue;
+      }
+      const auto &bufferView = bufferViews[bufferViewIdx];
+      const auto bufferIdx = bufferView.value("buffer", -1);
+      if (bufferIdx < 0 || size_t(bufferIdx) >= spans.size() ||
+          !spans[bufferIdx].data) {
+        continue;
+      }
+      const auto &span = spans[bufferIdx];
+      const auto byteOffset =
+          std::min(bufferView.value("byteOffset", size_t(0)), span.size);
+      const auto byteLength = std::min(
+          bufferView.value("byteLength", size_t(0)), span.size - byteOffset);
+      const auto uri = REDIRECT_PREFIX + std::string("bufferView/") +
+                       std::to_string(bufferViewIdx);
+      context.files[uri] = {span.data + byteOffset, byteLength};
+      redirectedImages.push_back({int(i), bufferViewIdx,
+          image.value("mimeType", std::string())});
+      image.erase("bufferView");
+      image["uri"] = uri;
+    }
+  }
+
+  const auto rewrittenJson = document.dump();
+
+  auto callbacks = defaultFsCallbacks();
+  callbacks.FileExists = &redirectFileExists;
+  callbacks.ExpandFilePath = &redirectExpandFilePath;
+  callbacks.ReadWholeFile = &redirectReadWholeFile;
+  callbacks.user_data = &context;
+  loader.SetFsCallbacks(callbacks);
+
+  const bool ret = loader.LoadASCIIFromString(&model, &err, &warn,
+      rewrittenJson.c_str(), (unsigned int)rewrittenJson.size(),
+      baseDir.string());
+
+  loader.SetFsCallbacks(defaultFsCallbacks());
+
+  if (!ret) {
+    return false;
+  }
+
+  // Put back what the JSON rewrite changed
+  for (const auto &redirectedBuffer : redirectedBuffers) {
+    auto &buffer = model.buffers[redirectedBuffer.bufferIdx];
+    buffer.uri = redirectedBuffer.uri;
+    buffer.data.clear();
+    buffer.data.shrink_to_fit();
+  }
+  for (const auto &redirectedImage : redirectedImages) {
+    auto &image = model.images[redirectedImage.imageIdx];
+    image.bufferView = redirectedImage.bufferViewIdx;
+    image.mimeType = redirectedImage.mimeType;
+    image.uri.clear();
+  }
+
+  return true;
+}
+
+// Size bytes for the payload of a base64 data uri and split it into chunks,
+// decoded by decodeDataUris(). mimeType is set unless the uri gives a generic
+// one, as tinygltf does. False if uri is not a base64 data uri.
+bool addDataUri(const std::string &uri, std::string &mimeType,
+    std::vector<unsigned char> &bytes, size_t owner,
+    std::vector<Base64Chunk> &chunks)
+{
+  const auto separator = uri.find(";base64,");
+  if (!isDataUri(uri) || separator == std::string::npos) {
+    return false;
+  }
+  const auto *text = uri.data() + separator + 8;
+  auto size = uri.size() - separator - 8;
+  for (int padding = 0; padding < 2 && size && text[size - 1] == '=';
+       ++padding) {
+    --size;
+  }
+  size_t byteSize;
+  if (!base64DecodedSize(size, byteSize) || !byteSize) {
+    return false;
+  }
+
+  bytes.resize(byteSize);
+  for (size_t offset = 0; offset < size; offset += BASE64_CHUNK_SIZE) {
+    chunks.push_back({text + offset, std::min(BASE64_CHUNK_SIZE, size - offset),
+        bytes.data() + offset / 4 * 3, owner});
+  }
+  const auto mime = uri.substr(5, separator - 5);
+  if (mime != "application/octet-stream" && mime != "application/gltf-buffer") {
+    mimeType = mime;
+  }
+  return true;
+}
+
+// Decode the chunks on the shared job system, like images, straight into the bytes given to addDataUri(). failedOwner is set to the
+// owner of a chunk with characters outside of the base64 alphabet.
+bool decodeDataUris(const std::vector<Base64Chunk> &chunks, size_t &failedOwner)
+{
+  if (chunks.empty()) {
+    return true;
+  }
+  TRACE_ZONE("decodeDataUris");
+  std::vector<char> decoded(chunks.size(), 0);
+  JobSystem::shared().parallelFor(
+      chunks.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+          const auto &chunk = chunks[i];
+          decoded[i] = decodeBase64(chunk.text, chunk.size, chunk.bytes);
+        }
+      });
+
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    if (!decoded[i]) {
+      failedOwner = chunks[i].owner;
+      return false;
+    }
+  }
+  return true;
+}
+
+// Bytes of the BIN chunk a buffer view is read from, those of the compressed
+// data for EXT_meshopt_compression. False if they are elsewhere.
+bool binViewBytes(const tinygltf::Model &model, int viewIdx,
+    const std::vector<BufferSpan> &spans, const BufferSpan &bin,
+    size_t &first, size_t &last)
+{
+  if (viewIdx < 0 || size_t(viewIdx) >= model.bufferViews.size()) {
+    return false;
+  }
+  const auto &view = model.bufferViews[viewIdx];
+  auto buffer = view.buffer;
+  auto byteOffset = view.byteOffset;
+  auto byteLength = view.byteLength;
+  const auto it = view.extensions.find("EXT_meshopt_compression");
+  if (it != end(view.extensions) && (*it).second.IsObject()) {
+    const auto &extension = (*it).second;
+    const auto &source = extension.Get("buffer");
+    buffer = source.IsNumber() ? source.GetNumberAsInt() : -1;
+    byteOffset = valueSize(extension, "byteOffset");
+    byteLength = valueSize(extension, "byteLength");
+  }
+  if (buffer < 0 || size_t(buffer) >= spans.size() ||
+      spans[buffer].data != bin.data) {
+    return false;
+  }
+  first = std::min(byteOffset, bin.size);
+  last = first + std::min(byteLength, bin.size - first);
+  return first < last;
+}
+
+// Ranges of the whole BIN chunk of a remote file, at binOffset in it, in the
+// order they are needed: the geometry of the meshes, those the nodes of the
+// default scene reach first, then the other accessors, the images, and the
+// bytes no buffer view references. Small gaps between ranges of the same
+// priority are downloaded with them.
+std::vector<HttpRange> planRemoteRanges(const tinygltf::Model &model,
+    const std::vector<BufferSpan> &spans, const BufferSpan &bin,
+    size_t binOffset)
+{
+  // Rank of each mesh
+  const auto meshCount = model.meshes.size();
+  std::vector<size_t> meshRanks(meshCount, meshCount);
+  size_t rank = 0;
+  const auto rankMesh = [&](int mesh) {
+    if (mesh >= 0 && size_t(mesh) < meshCount && meshRanks[mesh] == meshCount) {
+      meshRanks[mesh] = rank++;
+    }
+  };
+  const auto sceneIdx = model.defaultScene >= 0 ? model.defaultScene : 0;
+  if (size_t(sceneIdx) < model.scenes.size()) {
+    std::vector<int> nodes(model.scenes[sceneIdx].nodes.rbegin(),
+        model.scenes[sceneIdx].nodes.rend());
+    std::vector<char> visited(model.nodes.size(), 0);
+    while (!nodes.empty()) {
+      const auto nodeIdx = nodes.back();
+      nodes.pop_back();
+      if (nodeIdx < 0 || size_t(nodeIdx) >= model.nodes.size() ||
+          visited[nodeIdx]) {
+        continue;
+      }
+      visited[nodeIdx] = 1;
+      const auto &node = model.nodes[nodeIdx];
+      rankMesh(node.mesh);
+      nodes.insert(end(nodes), node.children.rbegin(), node.children.rend());
+    }
+  }
+  for (size_t i = 0; i < meshCount; ++i) {
+    rankMesh(int(i));
+  }
+  const auto otherAccessors = meshCount;
+  const auto imagePriority = meshCount + 1;
+  const auto restPriority = meshCount + 2;
+
+  struct Interval
+  {
+    size_t begin, end, priority;
+  };
+  std::vector<Interval> intervals;
+  const auto addView = [&](int viewIdx, size_t priority) {
+    Interval interval{0, 0, priority};
+    if (binViewBytes(
+            model, viewIdx, spans, bin, interval.begin, interval.end)) {
+      intervals.push_back(interval);
+    }
+  };
+  std::vector<size_t> accessorPriorities(
+      model.accessors.size(), otherAccessors);
+  const auto useAccessor = [&](int accessorIdx, size_t priority) {
+    if (accessorIdx >= 0 && size_t(accessorIdx) < model.accessors.size()) {
+      auto &accessorPriority = accessorPriorities[accessorIdx];
+      accessorPriority = std::min(accessorPriority, priority);
+    }
+  };
+  for (size_t i = 0; i < meshCount; ++i) {
+    for (const auto &primitive : model.meshes[i].primitives) {
+      useAccessor(primitive.indices, meshRanks[i]);
+      for (const auto &attribute : primitive.attributes) {
+        useAccessor(attribute.second, meshRanks[i]);
+      }
+      for (const auto &target : primitive.targets) {
+        for (const auto &attribute : target) {
+          useAccessor(attribute.second, meshRanks[i]);
+        }
+      }
+    }
+  }
+  for (size_t i = 0; i < model.accessors.size(); ++i) {
+    const auto &accessor = model.accessors[i];
+    addView(accessor.bufferView, accessorPriorities[i]);
+    if (accessor.sparse.isSparse) {
+      addView(accessor.sparse.indices.bufferView, accessorPriorities[i]);
+      addView(accessor.sparse.values.bufferView, accessorPriorities[i]);
+    }
+  }
+  for (const auto &image : model.images) {
+    addView(image.bufferView, imagePriority);
+  }
+
+  // The chunk cut at every interval bound, each segment with the first
+  // priority of the intervals covering it
+  struct Bound
+  {
+    size_t offset;
+    bool begin;
+    size_t priority;
+  };
+  std::vector<Bound> bounds;
+  for (const auto &interval : intervals) {
+    bounds.push_back({interval.begin, true, interval.priority});
+    bounds.push_back({interval.end, false, interval.priority});
+  }
+  bounds.push_back({bin.size, false, restPriority});
+  std::sort(begin(bounds), end(bounds),
+      [](const Bound &a, const Bound &b) { return a.offset < b.offset; });
+  std::vector<Interval> segments;
+  std::multiset<size_t> covering;
+  size_t offset = 0;
+  for (const auto &bound : bounds) {
+    if (bound.offset > offset) {
+      const auto priority = covering.empty() ? restPriority : *begin(covering);
+      if (!segments.empty() && segments.back().priority == priority) {
+        segments.back().end = bound.offset;
+      } else {
+        segments.push_back({offset, bound.offset, priority});
+      }
+      offset = bound.offset;
+    }
+    if (bound.begin) {
+      covering.insert(bound.priority);
+    } else if (bound.priority != restPriority) {
+      covering.erase(covering.find(bound.priority));
+    }
+  }
+
+  // Small segments between two of a higher priority are merged with them
+  std::vector<Interval> merged;
+  for (size_t i = 0; i < segments.size(); ++i) {
+    auto segment = segments[i];
+    if (!merged.empty() && i + 1 < segments.size() &&
+        segment.end - segment.begin <= REMOTE_MERGE_GAP &&
+        merged.back().priority == segments[i + 1].priority &&
+        merged.back().priority < segment.priority) {
+      segment.priority = merged.back().priority;
+    }
+    if (!merged.empty() && merged.back().priority == segment.priority) {
+      merged.back().end = segment.end;
+    } else {
+      merged.push_back(segment);
+    }
+  }
+  std::stable_sort(begin(merged), end(merged),
+      [](const Interval &a, const Interval &b) {
+        return a.priority < b.priority;
+      });
+
+  std::vector<HttpRange> ranges;
+  for (const auto &segment : merged) {
+    for (auto first = segment.begin; first < segment.end;
+         first += REMOTE_RANGE_SIZE) {
+      ranges.push_back({binOffset + first,
+          std::min(REMOTE_RANGE_SIZE, segment.end - first)});
+    }
+  }
+  return ranges;
+}
+
+// Parse the glTF JSON with parseGltfJson(), then give the buffers the bytes
+// loadRedirectedModel() gives them: spans on the BIN chunk and on the memory
+// mapped external files, the other buffers are decoded from their data uri
+// into tinygltf::Buffer::data. The encoded bytes of images are appended to
+// images, as deferImageData() does for tinygltf.
+// The BIN chunk of a remote file starts downloading once parsed, images in it
+// are left to decodeImages(). Its external buffers are not read.
+bool loadSinglePassModel(const BufferSpan &json, const BufferSpan &bin,
+    HttpReader *remote, const fs::path &baseDir, tinygltf::Model &model,
+    std::vector<DeferredImage> &images, std::vector<MappedFile> &mappedFiles,
+    std::vector<BufferSpan> &spans, std::vector<fs::path> &files,
+    std::string &err, std::string &warn)
+{
+  std::vector<size_t> byteLengths;
+  if (!parseGltfJson(json.data, json.size, model, byteLengths, err)) {
+    return false;
+  }
+
+  // Data uris are decoded once every buffer and image is known
+  std::vector<Base64Chunk> chunks;
+  spans.assign(model.buffers.size(), BufferSpan());
+  for (size_t i = 0; i < model.buffers.size(); ++i) {
+    auto &buffer = model.buffers[i];
+    const auto byteLength = byteLengths[i];
+    const auto error = [&](const std::string &message) {
+      err = "buffer[" + std::to_string(i) + "]: " + message;
+      return false;
+    };
+
+    if (isMeshoptFallback(buffer)) {
+      // Decoded from the compressed buffer views once parsed
+    } else if (buffer.uri.empty()) {
+      if (!bin.data) {
+        return error("missing uri");
+      }
+      if (byteLength > bin.size) {
+        return error("byteLength exceeds the BIN chunk");
+      }
+      spans[i] = {bin.data, byteLength};
+    } else if (isDataUri(buffer.uri)) {
+      std::string mimeType;
+      if (!addDataUri(buffer.uri, mimeType, buffer.data, i, chunks) ||
+          buffer.data.size() != byteLength) {
+        return error("unable to decode the data uri");
+      }
+      spans[i] = {buffer.data.data(), buffer.data.size()};
+    } else if (remote) {
+      return error("external buffer " + buffer.uri + " of a remote file");
+    } else {
+      // External .bin file, relative to the glTF file like tinygltf does
+      auto filePath = gltfUriPath(baseDir, buffer.uri);
+      MappedFile mapping(filePath);
+      if (!mapping.isOpen()) {
+        filePath = fs::path(buffer.uri);
+        mapping = MappedFile(filePath);
+      }
+      files.push_back(filePath);
+      BufferSpan file;
+      if (mapping.isOpen()) {
+        // Read ahead while the other files are opened
+        mapping.prefetch();
+        file = {mapping.data(), mapping.size()};
+      } else if (readFile(filePath, buffer.data)) {
+        file = {buffer.data.data(), buffer.data.size()};
+      } else {
+        return error("unable to read " + buffer.uri);
+      }
+      if (file.size < byteLength) {
+        return error(buffer.uri + " is smaller than byteLength");
+      }
+      spans[i] = {file.data, byteLength};
+      if (mapping.isOpen()) {
+        mappedFiles.emplace_back(std::move(mapping));
+      }
+    }
+  }
+
+  if (remote && bin.data) {
+    remote->start(planRemoteRanges(
+        model, spans, bin, size_t(bin.data - remote->data())));
+  }
+
+  // Images in buffer views, read once the buffers are decoded, and external
+  // image files, read together once every image is known
+  std::vector<size_t> bufferViewImages;
+  std::vector<size_t> fileImages;
+  for (size_t i = 0; i < model.images.size(); ++i) {
+    auto &image = model.images[i];
+    if (image.bufferView >= 0) {
+      bufferViewImages.push_back(images.size());
+    } else if (isDataUri(image.uri)) {
+      images.push_back({int(i), {}});
+      if (!addDataUri(image.uri, image.mimeType, images.back().bytes,
+              model.buffers.size() + i, chunks)) {
+        err = "Failed to decode 'uri' for image[" + std::to_string(i) +
+              "] name = [" + image.name + "]\n";
+        return false;
+      }
+      image.uri.clear();
+      continue;
+    } else {
+      fileImages.push_back(images.size());
+    }
+    images.push_back({int(i), {}});
+  }
+
+  FileReadBatch fileReads;
+  for (const auto i : fileImages) {
+    fileReads.add(
+        gltfUriPath(baseDir, model.images[images[i].imageIdx].uri),
+        images[i].bytes);
+  }
+  fileReads.run();
+  bool missingImages = false;
+  for (size_t j = 0; j < fileImages.size(); ++j) {
+    auto &image = images[fileImages[j]];
+    const auto &gltfImage = model.images[image.imageIdx];
+    if ((fileReads.failed(j) &&
+            !readFile(fs::path(gltfImage.uri), image.bytes)) ||
+        image.bytes.empty()) {
+      warn += "Failed to load external 'uri' for image[" +
+              std::to_string(image.imageIdx) + "] name = [" + gltfImage.name +
+              "]\n";
+      // Removed at the end, data uri chunks point in images
+      image.imageIdx = -1;
+      missingImages = true;
+    }
+  }
+
+  size_t failedOwner;
+  if (!decodeDataUris(chunks, failedOwner)) {
+    if (failedOwner < model.buffers.size()) {
+      err = "buffer[" + std::to_string(failedOwner) +
+            "]: unable to decode the data uri";
+    } else {
+      const auto imageIdx = failedOwner - model.buffers.size();
+      err = "Failed to decode 'uri' for image[" + std::to_string(imageIdx) +
+            "] name = [" + model.images[imageIdx].name + "]\n";
+    }
+    return false;
+  }
+
+  for (const auto i : bufferViewImages) {
+    auto &image = images[i];
+    // In range, checked by parseGltfJson()
+    const auto &bufferView =
+        model.bufferViews[model.images[image.imageIdx].bufferView];
+    const auto &span = spans[bufferView.buffer];
+    if (!span.data) {
+      err = "image[" + std::to_string(image.imageIdx) +
+            "] is in a compressed buffer";
+      return false;
+    }
+    const auto byteOffset = std::min(bufferView.byteOffset, span.size);
+    const auto byteLength =
+        std::min(bufferView.byteLength, span.size - byteOffset);
+    if (remote && !remote->complete() && span.data == bin.data) {
+      image.remote = {span.data + byteOffset, byteLength};
+    } else {
+      image.bytes.assign(
+          span.data + byteOffset, span.data + byteOffset + byteLength);
+    }
+  }
+
+  if (missingImages) {
+    images.erase(std::remove_if(images.begin(), images.end(),
+                     [](const DeferredImage &image) {
+                       return image.imageIdx < 0;
+                     }),
+        images.end());
+  }
+  return true;
+}
+
+// https://github.com/KhronosGroup/glTF/tree/master/specification/2.0#glb-file-format-specification
+bool findGlbChunks(
+    const BufferSpan &file, BufferSpan &json, BufferSpan &bin, std::string &err)
+{
+  if (file.size < 20 || readU32(file.data) != GLB_MAGIC) {
+    err = "Invalid glTF binary header";
+    return false;
+  }
+  const auto length = std::min(size_t(readU32(file.data + 8)), file.size);
+
+  for (size_t offset = 12; offset + 8 <= length;) {
+    const auto chunkLength = size_t(readU32(file.data + offset));
+    const auto chunkType = readU32(file.data + offset + 4);
+    const auto chunkBegin = offset + 8;
+    if (chunkBegin + chunkLength > length) {
+      err = "Truncated chunk in glTF binary";
+      return false;
+    }
+    if (chunkType == GLB_CHUNK_JSON && !json.data) {
+      json = {file.data + chunkBegin, chunkLength};
+    } else if (chunkType == GLB_CHUNK_BIN && !bin.data) {
+      bin = {file.data + chunkBegin, chunkLength};
+    }
+    offset = chunkBegin + ((chunkLength + 3) & ~size_t(3));
+  }
+
+  if (!json.data) {
+    err = "Missing JSON chunk in glTF binary";
+    return false;
+  }
+  return true;
+}
+
+// Download the head of a remote file to bytes: the header and JSON chunk of a
+// .glb file and the header of its BIN chunk, whose bytes are then downloaded
+// by loadSinglePassModel(), or with wholeFile everything
+bool openRemoteFile(HttpReader &remote, const std::string &url,
+    std::vector<unsigned char> &bytes, bool wholeFile, std::string &err)
+{
+  if (!remote.open(url, REMOTE_HEAD_SIZE, bytes, err)) {
+    return false;
+  }
+  const auto read = std::min(REMOTE_HEAD_SIZE, bytes.size());
+  auto head = bytes.size();
+  if (!wholeFile && bytes.size() >= 20 && readU32(bytes.data()) == GLB_MAGIC) {
+    const auto jsonLength =
+        (size_t(readU32(bytes.data() + 12)) + 3) & ~size_t(3);
+    head = std::min(20 + jsonLength + 8, bytes.size());
+  }
+  return head <= read || remote.read({read, head - read}, err);
+}
+
+} // namespace
+
+bool isGlbFile(const fs::path &path)
+{
+  std::ifstream input(path.string(), std::ios::binary);
+  unsigned char magic[4];
+  if (!input.read(reinterpret_cast<char *>(magic), sizeof(magic))) {
+    return false;
+  }
+  return readU32(magic) == GLB_MAGIC;
+}
+
+fs::path gltfUriPath(const fs::path &baseDir, const std::string &uri)
+{
+  const auto hexDigit = [](char c) {
+    return c >= '0' && c <= '9'   ? c - '0'
+           : c >= 'a' && c <= 'f' ? c - 'a' + 10
+           : c >= 'A' && c <= 'F' ? c - 'A' + 10
+                                  : -1;
+  };
+  std::string decoded;
+  decoded.reserve(uri.size());
+  for (size_t i = 0; i < uri.size(); ++i) {
+    if (uri[i] == '+') {
+      decoded += ' ';
+    } else if (uri[i] == '%' && i + 2 < uri.size() &&
+               hexDigit(uri[i + 1]) >= 0 && hexDigit(uri[i + 2]) >= 0) {
+      decoded += char(hexDigit(uri[i + 1]) * 16 + hexDigit(uri[i + 2]));
+      i += 2;
+    } else {
+      decoded += uri[i];
+    }
+  }
+
+  const auto path = baseDir / decoded;
+  if (decoded != uri && !fs::exists(path) && fs::exists(baseDir / uri)) {
+    return baseDir / uri;
+  }
+  return path;
+}
+
+bool loadGltfModel(tinygltf::TinyGLTF &loader, const fs::path &path,
+    tinygltf::Model &model, GltfBuffers &buffers, std::string &err,
+    std::string &warn, bool lazyImages, GltfParser parser)
+{
+  HeapTagScope heapTag(HeapTag::Model);
+  buffers.clear();
+
+  // A remote file is downloaded to m_fileBytes, which it writes to until
+  // cancelled
+  HttpReader remote;
+  const bool isRemote = isRemoteUrl(path.string());
+  const auto fail = [&]() {
+    remote.cancel();
+    buffers.clear();
+    return false;
+  };
+
+  BufferSpan file;
+  if (isRemote) {
+    if (!openRemoteFile(remote, path.string(), buffers.m_fileBytes,
+            parser != GltfParser::SinglePass, err)) {
+      return fail();
+    }
+    file = {buffers.m_fileBytes.data(), buffers.m_fileBytes.size()};
+  } else if (!mapFile(path, buffers.m_file, buffers.m_fileBytes, file)) {
+    err = "Unable to read file " + path.string();
+    return false;
+  }
+
+  BufferSpan json;
+  BufferSpan bin;
+  if (file.size < 4 || readU32(file.data) != GLB_MAGIC) {
+    json = file;
+  } else if (!findGlbChunks(file, json, bin, err)) {
+    return fail();
+  }
+
+  std::vector<DeferredImage> images;
+  buffers.m_files.push_back(path);
+  bool ret;
+  if (parser == GltfParser::SinglePass) {
+    ret = loadSinglePassModel(json, bin, isRemote ? &remote : nullptr,
+        path.parent_path(), model, images, buffers.m_mappedFiles,
+        buffers.m_spans, buffers.m_files, err, warn);
+  } else {
+    loader.SetImageLoader(&deferImageData, &images);
+    ret = loadRedirectedModel(loader, json, bin, path.parent_path(), model,
+        buffers.m_mappedFiles, buffers.m_spans, buffers.m_files, err, warn);
+    loader.SetImageLoader(&tinygltf::LoadImageData, nullptr);
+  }
+
+  if (!ret || !decodeImages(model, images, lazyImages,
+                  isRemote ? &remote : nullptr, err, warn)) {
+    return fail();
+  }
+  // The geometry came first, the rest of the BIN chunk last
+  if (isRemote && !remote.waitAll()) {
+    err = remote.error();
+    return fail();
+  }
+
+  // Only the BIN chunk and external buffers need the file contents, a .gltf
+  // file can be released once parsed
+  if (!bin.data) {
+    buffers.m_file = MappedFile();
+    buffers.m_fileBytes.clear();
+    buffers.m_fileBytes.shrink_to_fit();
+  }
+
+  // Every buffer not referenced in place lives in tinygltf::Buffer::data
+  buffers.m_spans.resize(model.buffers.size());
+  for (size_t i = 0; i < model.buffers.size(); ++i) {
+    const auto &data = model.buffers[i].data;
+    if (!buffers.m_spans[i].data) {
+      buffers.m_spans[i] = {data.data(), data.size()};
+    }
+  }
+
+  if (!checkDracoPrimitives(model, err, warn) ||
+      !decodeMeshoptBufferViews(
+          model, buffers.m_spans, buffers.m_decoded, err)) {
+    return fail();
+  }
+
+  return true;
+}
+
+void compactModel(tinygltf::Model &model, GltfBuffers &buffers)
+{
+  buffers.clear();
+  for (auto &buffer : model.buffers) {
+    std::vector<unsigned char>().swap(buffer.data);
+  }
+  for (auto &image : model.images) {
+    if (!image.as_is) {
+      std::vector<unsigned char>().swap(image.image);
+    }
+  }
+}
+
+bool decodeImage(const tinygltf::Image &image, int imageIdx,
+    tinygltf::Image &decoded, std::string &err, std::string &warn)
+{
+  TRACE_ZONE("decodeImage");
+  HeapTagScope heapTag(HeapTag::Images);
+  decoded = image;
+  if (!image.as_is) {
+    return true;
+  }
+  decoded.as_is = false;
+  std::vector<unsigned char>().swap(decoded.image);
+  return tinygltf::LoadImageData(&decoded, imageIdx, &err, &warn, 0, 0,
+      image.image.data(), int(image.image.size()), nullptr);
+}
+
+bool loadImageFile(const fs::path &path, int imageIdx, tinygltf::Image &image,
+    std::string &err, std::string &warn)
+{
+  TRACE_ZONE("loadImageFile");
+  HeapTagScope heapTag(HeapTag::Images);
+  std::vector<unsigned char> bytes;
+  if (!readFile(path, bytes) || bytes.empty()) {
+    err = "Unable to read image " + path.string() + "\n";
+    return false;
+  }
+  image.as_is = false;
+  if (isKtx2(bytes.data(), bytes.size())) {
+    Ktx2Texture texture;
+    if (!parseKtx2(bytes.data(), bytes.size(), texture, err)) {
+      return false;
+    }
+    image.width = texture.width;
+    image.height = texture.height;
+    image.mimeType = "image/ktx2";
+    image.image = std::move(bytes);
+    return true;
+  }
+  std::vector<unsigned char>().swap(image.image);
+  return tinygltf::LoadImageData(&image, imageIdx, &err, &warn, 0, 0,
+      bytes.data(), int(bytes.size()), nullptr);
+}
+
+namespace
+{
+
+// Average of each 2x2 texels of source into destination, of
+// max(width / 2, 1) x max(height / 2, 1) texels. The last column and row of
+// odd sizes are averaged with themselves.
+template <typename Component>
+void halveImage(const Component *source, int width, int height, int channels,
+    Component *destination)
+{
+  const auto halfWidth = std::max(width / 2, 1);
+  const auto halfHeight = std::max(height / 2, 1);
+  JobSystem::shared().parallelFor(
+      size_t(halfHeight), 64, [&](size_t begin, size_t end) {
+        for (auto y = begin; y < end; ++y) {
+          const auto *row0 = source + 2 * y * width * channels;
+          const auto *row1 =
+              source + std::min(2 * y + 1, size_t(height - 1)) * width *
+                           channels;
+          auto *out = destination + y * halfWidth * channels;
+          for (int x = 0; x < halfWidth; ++x) {
+            const auto x0 = 2 * x * channels;
+            const auto x1 = std::min(2 * x + 1, width - 1) * channels;
+            for (int c = 0; c < channels; ++c) {
+              const uint32_t sum = uint32_t(row0[x0 + c]) + row0[x1 + c] +
+                                   row1[x0 + c] + row1[x1 + c];
+              out[x * channels + c] = Component((sum + 2) / 4);
+            }
+          }
+        }
+      });
+}
+
+} // namespace
+
+void capImageSize(tinygltf::Image &image, int maxSize)
+{
+  if (maxSize <= 0 || image.as_is || image.mimeType == "image/ktx2" ||
+      std::max(image.width, image.height) <= maxSize ||
+      (image.bits != 8 && image.bits != 16) || image.component <= 0) {
+    return;
+  }
+  TRACE_ZONE("capImageSize");
+  HeapTagScope heapTag(HeapTag::Images);
+  std::vector<unsigned char> halved;
+  while (std::max(image.width, image.height) > maxSize) {
+    const auto halfWidth = std::max(image.width / 2, 1);
+    const auto halfHeight = std::max(image.height / 2, 1);
+    halved.resize(size_t(halfWidth) * halfHeight * image.component *
+                  (image.bits / 8));
+    if (image.bits == 8) {
+      halveImage(image.image.data(), image.width, image.height,
+          image.component, halved.data());
+    } else {
+      halveImage(reinterpret_cast<const uint16_t *>(image.image.data()),
+          image.width, image.height, image.component,
+          reinterpret_cast<uint16_t *>(halved.data()));
+    }
+    image.image.swap(halved);
+    image.width = halfWidth;
+    image.height = halfHeight;
+  }
+  image.image.shrink_to_fit();
+}
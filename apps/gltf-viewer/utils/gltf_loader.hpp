@@ -0,0 +1,143 @@
+#pragma once
+
+#include "filesystem.hpp"
+#include "mapped_file.hpp"
+
+#include <tiny_gltf.h>
+
+#include <string>
+#include <vector>
+
+// JSON parsers of loadGltfModel(): the single pass reader of gltf_json.hpp,
+// or tinygltf, the reference it is checked against
+enum class GltfParser
+{
+  SinglePass,
+  Tinygltf
+};
+
+// Read-only view on the bytes of a glTF buffer
+struct BufferSpan
+{
+  const unsigned char *data = nullptr;
+  size_t size = 0;
+};
+
+// Bytes of every buffer of a loaded glTF model, indexed like model.buffers.
+// For buffers decoded from data uris the spans point into
+// tinygltf::Buffer::data. The BIN chunk of a .glb file and external .bin files
+// are memory mapped and referenced in place instead: they are never copied into
+// tinygltf::Buffer::data, which stays empty. Buffers holding buffer views
+// compressed with EXT_meshopt_compression point to a decoded copy.
+class GltfBuffers
+{
+public:
+  size_t size() const { return m_spans.size(); }
+
+  const BufferSpan &operator[](size_t i) const { return m_spans[i]; }
+
+  // The glTF files and external buffer files the buffers were read from,
+  // including those of appended models
+  const std::vector<fs::path> &files() const { return m_files; }
+
+  void clear()
+  {
+    m_spans.clear();
+    m_mappedFiles.clear();
+    m_file = MappedFile();
+    m_fileBytes.clear();
+    m_fileBytes.shrink_to_fit();
+    m_decoded.clear();
+    m_appended.clear();
+    m_generated.clear();
+    m_files.clear();
+  }
+
+  // Keep the buffers of a model appended to the model of these ones, their
+  // spans follow
+  void append(GltfBuffers &&other)
+  {
+    m_spans.insert(end(m_spans), begin(other.m_spans), end(other.m_spans));
+    m_files.insert(end(m_files), begin(other.m_files), end(other.m_files));
+    m_appended.push_back(std::move(other));
+  }
+
+  // Keep bytes generated for the model, such as the static batches of
+  // static_batching.hpp, as a buffer after the others. The caller adds the
+  // matching tinygltf::Buffer, whose data stays empty.
+  void add(std::vector<unsigned char> &&bytes)
+  {
+    m_generated.push_back(std::move(bytes));
+    m_spans.push_back({m_generated.back().data(), m_generated.back().size()});
+  }
+
+private:
+  friend bool loadGltfModel(tinygltf::TinyGLTF &loader, const fs::path &path,
+      tinygltf::Model &model, GltfBuffers &buffers, std::string &err,
+      std::string &warn, bool lazyImages, GltfParser parser);
+
+  MappedFile m_file; // The .glb file, when it can be mapped
+  // Otherwise its contents, as those of a remote file
+  std::vector<unsigned char> m_fileBytes;
+  std::vector<MappedFile> m_mappedFiles; // External buffer files
+  std::vector<std::vector<unsigned char>> m_decoded; // Of compressed views
+  std::vector<BufferSpan> m_spans;
+  std::vector<GltfBuffers> m_appended; // Owners of the appended spans
+  std::vector<std::vector<unsigned char>> m_generated; // See add()
+  std::vector<fs::path> m_files;
+};
+
+// Return true if the file starts with the binary glTF magic ("glTF")
+bool isGlbFile(const fs::path &path);
+
+// File of the uri of an external buffer or image of a glTF file in baseDir.
+// URIs are percent-encoded, they are decoded as by the dlib::urldecode of
+// tinygltf: "%20" and '+' are spaces. The uri is taken as it is when only
+// that file exists.
+fs::path gltfUriPath(const fs::path &baseDir, const std::string &uri);
+
+// Load a .gltf or .glb file, detecting the container from its magic number
+// rather than from the file extension. Images and EXT_meshopt_compression
+// buffer views are decoded concurrently once the whole file is parsed, the
+// image loader of the TinyGLTF object is not used. KHR_draco_mesh_compression
+// is not supported: its fallback geometry is drawn if it is not required.
+// With lazyImages, PNG and JPEG images are only probed for their dimensions and
+// kept encoded with as_is set, see decodeImage(). Images with the same bytes
+// are decoded once: textures sample the first copy and the others are empty.
+// Both parsers give the same model but for the legacy Material::values and
+// additionalValues, left empty by SinglePass (see tools/gltf_json_test.cpp).
+// The loader is only used by Tinygltf.
+// path may be an http:// or https:// URL of a file without external buffers,
+// see http_reader.hpp: the JSON is read first, then with SinglePass the BIN
+// chunk of a .glb file is requested by ranges in parallel, geometry first,
+// and images are decoded as they arrive.
+bool loadGltfModel(tinygltf::TinyGLTF &loader, const fs::path &path,
+    tinygltf::Model &model, GltfBuffers &buffers, std::string &err,
+    std::string &warn, bool lazyImages = false,
+    GltfParser parser = GltfParser::SinglePass);
+
+// Free the heavy payloads of a model once they have been uploaded to the GPU:
+// buffer bytes (including the mapped files held by buffers) and decoded image
+// pixels. Everything else (accessors, buffer views, meshes, materials, nodes,
+// image dimensions, images kept encoded...) is kept since drawing still needs
+// it; buffers must not be read from afterwards.
+void compactModel(tinygltf::Model &model, GltfBuffers &buffers);
+
+// Copy an image kept encoded by loadGltfModel() with lazyImages to decoded,
+// with RGBA pixels as if it had been decoded at load time. Images that are not
+// encoded are copied as they are. Does not modify the model, so that images
+// can be decoded while it is drawn.
+bool decodeImage(const tinygltf::Image &image, int imageIdx,
+    tinygltf::Image &decoded, std::string &err, std::string &warn);
+
+// Read and decode the external file of image again, as loadGltfModel() does
+// without lazyImages, after the file has been rewritten. The other fields of
+// image are kept.
+bool loadImageFile(const fs::path &path, int imageIdx, tinygltf::Image &image,
+    std::string &err, std::string &warn);
+
+// Halve a decoded image of 8 or 16 bits channels with a 2x2 box filter, rows
+// by jobs, until its largest side is at most maxSize. Images kept encoded,
+// KTX2 images (see dropKtx2Levels()) and those small enough are left as they
+// are, as every image if maxSize is 0.
+void capImageSize(tinygltf::Image &image, int maxSize);
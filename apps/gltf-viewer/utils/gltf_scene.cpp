@@ -0,0 +1,483 @@
+#include "gltf_scene.hpp"
+#include "gltf.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+
+#include <json.hpp>
+
+namespace
+{
+
+template <typename T> void appendMoved(std::vector<T> &to, std::vector<T> &from)
+{
+  to.insert(end(to), std::make_move_iterator(begin(from)),
+      std::make_move_iterator(end(from)));
+  from.clear();
+}
+
+void offsetIndex(int &index, size_t base)
+{
+  if (index >= 0) {
+    index += int(base);
+  }
+}
+
+// Replace the number at key of an object value by remap(number)
+template <typename Remap>
+void remapValueIndex(tinygltf::Value &value, const std::string &key,
+    const Remap &remap)
+{
+  if (!value.IsObject() || !value.Has(key) || !value.Get(key).IsNumber()) {
+    return;
+  }
+  auto &object = value.Get<tinygltf::Value::Object>();
+  object[key] = tinygltf::Value(remap(int(object[key].GetNumberAsInt())));
+}
+
+// Texture infos of material extensions are the objects named *Texture, such
+// as clearcoatTexture of KHR_materials_clearcoat
+template <typename Remap>
+void remapExtensionTextures(tinygltf::Value &value, const Remap &remap)
+{
+  if (!value.IsObject()) {
+    return;
+  }
+  const std::string suffix = "Texture";
+  for (auto &member : value.Get<tinygltf::Value::Object>()) {
+    const auto &key = member.first;
+    if (key.size() > suffix.size() &&
+        key.compare(key.size() - suffix.size(), suffix.size(), suffix) == 0) {
+      remapValueIndex(member.second, "index", remap);
+    } else {
+      remapExtensionTextures(member.second, remap);
+    }
+  }
+}
+
+template <typename Remap>
+void remapMaterialTextures(tinygltf::Material &material, const Remap &remap)
+{
+  auto &pbr = material.pbrMetallicRoughness;
+  for (auto *index : {&pbr.baseColorTexture.index,
+           &pbr.metallicRoughnessTexture.index, &material.normalTexture.index,
+           &material.occlusionTexture.index, &material.emissiveTexture.index}) {
+    if (*index >= 0) {
+      *index = remap(*index);
+    }
+  }
+  for (auto &extension : material.extensions) {
+    remapExtensionTextures(extension.second, remap);
+  }
+}
+
+// Images of KHR_texture_basisu and the other image format extensions
+template <typename Remap>
+void remapTextureSources(tinygltf::Texture &texture, const Remap &remap)
+{
+  if (texture.source >= 0) {
+    texture.source = remap(texture.source);
+  }
+  for (auto &extension : texture.extensions) {
+    remapValueIndex(extension.second, "source", remap);
+  }
+}
+
+int basisuSource(const tinygltf::Texture &texture)
+{
+  const auto basisu = texture.extensions.find("KHR_texture_basisu");
+  if (basisu == end(texture.extensions) || !(*basisu).second.Has("source")) {
+    return -1;
+  }
+  return int((*basisu).second.Get("source").GetNumberAsInt());
+}
+
+void offsetModel(tinygltf::Model &other, const tinygltf::Model &model)
+{
+  const auto accessors = model.accessors.size();
+  const auto buffers = model.buffers.size();
+  const auto bufferViews = model.bufferViews.size();
+  const auto materials = model.materials.size();
+  const auto meshes = model.meshes.size();
+  const auto nodes = model.nodes.size();
+  const auto textures = model.textures.size();
+  const auto images = model.images.size();
+  const auto skins = model.skins.size();
+  const auto samplers = model.samplers.size();
+  const auto cameras = model.cameras.size();
+  const auto lights = model.lights.size();
+  const auto offsetBy = [](size_t base) {
+    return [base](int index) { return index + int(base); };
+  };
+
+  for (auto &accessor : other.accessors) {
+    offsetIndex(accessor.bufferView, bufferViews);
+    if (accessor.sparse.isSparse) {
+      offsetIndex(accessor.sparse.indices.bufferView, bufferViews);
+      offsetIndex(accessor.sparse.values.bufferView, bufferViews);
+    }
+  }
+  for (auto &bufferView : other.bufferViews) {
+    offsetIndex(bufferView.buffer, buffers);
+  }
+  for (auto &image : other.images) {
+    offsetIndex(image.bufferView, bufferViews);
+  }
+  for (auto &texture : other.textures) {
+    offsetIndex(texture.sampler, samplers);
+    remapTextureSources(texture, offsetBy(images));
+  }
+  for (auto &material : other.materials) {
+    remapMaterialTextures(material, offsetBy(textures));
+  }
+  for (auto &mesh : other.meshes) {
+    for (auto &primitive : mesh.primitives) {
+      for (auto &attribute : primitive.attributes) {
+        offsetIndex(attribute.second, accessors);
+      }
+      for (auto &target : primitive.targets) {
+        for (auto &attribute : target) {
+          offsetIndex(attribute.second, accessors);
+        }
+      }
+      offsetIndex(primitive.indices, accessors);
+      offsetIndex(primitive.material, materials);
+    }
+  }
+  for (auto &node : other.nodes) {
+    offsetIndex(node.mesh, meshes);
+    offsetIndex(node.skin, skins);
+    offsetIndex(node.camera, cameras);
+    for (auto &child : node.children) {
+      offsetIndex(child, nodes);
+    }
+    const auto light = node.extensions.find("KHR_lights_punctual");
+    if (light != end(node.extensions)) {
+      remapValueIndex((*light).second, "light", offsetBy(lights));
+    }
+    const auto instancing = node.extensions.find("EXT_mesh_gpu_instancing");
+    if (instancing != end(node.extensions) &&
+        (*instancing).second.Has("attributes")) {
+      auto &object = (*instancing).second.Get<tinygltf::Value::Object>();
+      auto &attributes = object["attributes"];
+      for (const auto &name : attributes.Keys()) {
+        remapValueIndex(attributes, name, offsetBy(accessors));
+      }
+    }
+  }
+  for (auto &skin : other.skins) {
+    offsetIndex(skin.inverseBindMatrices, accessors);
+    offsetIndex(skin.skeleton, nodes);
+    for (auto &joint : skin.joints) {
+      offsetIndex(joint, nodes);
+    }
+  }
+  for (auto &animation : other.animations) {
+    for (auto &channel : animation.channels) {
+      offsetIndex(channel.target_node, nodes);
+    }
+    for (auto &sampler : animation.samplers) {
+      offsetIndex(sampler.input, accessors);
+      offsetIndex(sampler.output, accessors);
+    }
+  }
+}
+
+void appendNames(
+    std::vector<std::string> &names, const std::vector<std::string> &other)
+{
+  for (const auto &name : other) {
+    if (std::find(begin(names), end(names), name) == end(names)) {
+      names.push_back(name);
+    }
+  }
+}
+
+bool sameImage(const tinygltf::Image &lhs, const tinygltf::Image &rhs)
+{
+  return lhs.width == rhs.width && lhs.height == rhs.height &&
+         lhs.component == rhs.component && lhs.bits == rhs.bits &&
+         lhs.pixel_type == rhs.pixel_type && lhs.mimeType == rhs.mimeType &&
+         lhs.image == rhs.image;
+}
+
+size_t hashImage(const tinygltf::Image &image)
+{
+  auto hash = std::hash<std::string_view>()(std::string_view(
+      reinterpret_cast<const char *>(image.image.data()), image.image.size()));
+  for (const auto value :
+      {image.width, image.height, image.component, image.bits}) {
+    hash = hash * 31 + std::hash<int>()(value);
+  }
+  return hash;
+}
+
+bool readVec(const nlohmann::json &entry, const char *key, size_t size,
+    float *values, std::string &err)
+{
+  if (!entry.count(key)) {
+    return true;
+  }
+  const auto &array = entry[key];
+  if (!array.is_array() || array.size() != size) {
+    err = std::string(key) + " must be an array of " + std::to_string(size) +
+          " numbers";
+    return false;
+  }
+  for (size_t i = 0; i < size; ++i) {
+    if (!array[i].is_number()) {
+      err = std::string(key) + " values must be numbers";
+      return false;
+    }
+    values[i] = array[i].get<float>();
+  }
+  return true;
+}
+
+} // namespace
+
+bool isSceneFile(const fs::path &path)
+{
+  auto extension = path.extension().string();
+  std::transform(begin(extension), end(extension), begin(extension),
+      [](unsigned char c) { return char(std::tolower(c)); });
+  return extension == ".json";
+}
+
+bool loadSceneFile(
+    const fs::path &path, std::vector<SceneFile> &files, std::string &err)
+{
+  std::ifstream file(path);
+  if (!file) {
+    err = "Unable to open scene file " + path.string();
+    return false;
+  }
+  std::stringstream text;
+  text << file.rdbuf();
+
+  nlohmann::json document;
+  try {
+    document = nlohmann::json::parse(text.str());
+  } catch (const std::exception &e) {
+    err = std::string("Unable to parse scene file: ") + e.what();
+    return false;
+  }
+  if (!document.is_object() || !document.count("models") ||
+      !document["models"].is_array()) {
+    err = path.string() + ": expected an object with a models array";
+    return false;
+  }
+
+  files.clear();
+  const auto &models = document["models"];
+  for (size_t i = 0; i < models.size(); ++i) {
+    const auto &entry = models[i];
+    const auto prefix = path.string() + ": model " + std::to_string(i) + ": ";
+    if (!entry.is_object() || !entry.count("file") ||
+        !entry["file"].is_string()) {
+      err = prefix + "expected an object with a file path";
+      return false;
+    }
+
+    SceneFile sceneFile;
+    sceneFile.path = path.parent_path() / entry["file"].get<std::string>();
+    float rotation[4] = {0, 0, 0, 1};
+    if (!readVec(entry, "translation", 3, &sceneFile.translation[0], err) ||
+        !readVec(entry, "rotation", 4, rotation, err) ||
+        !readVec(entry, "scale", 3, &sceneFile.scale[0], err)) {
+      err = prefix + err;
+      return false;
+    }
+    sceneFile.rotation =
+        glm::quat(rotation[3], rotation[0], rotation[1], rotation[2]);
+    files.push_back(sceneFile);
+  }
+  if (files.empty()) {
+    err = path.string() + ": the scene has no model";
+    return false;
+  }
+  return true;
+}
+
+bool saveSceneFile(const fs::path &path, const std::vector<SceneFile> &files,
+    std::string &err)
+{
+  auto models = nlohmann::json::array();
+  for (const auto &file : files) {
+    const auto &t = file.translation;
+    const auto &r = file.rotation;
+    const auto &s = file.scale;
+    models.push_back({{"file", fs::absolute(file.path).string()},
+        {"translation", {t.x, t.y, t.z}}, {"rotation", {r.x, r.y, r.z, r.w}},
+        {"scale", {s.x, s.y, s.z}}});
+  }
+
+  std::ofstream file(path);
+  file << nlohmann::json{{"models", models}}.dump(2) << "\n";
+  if (!file) {
+    err = "Unable to write scene file " + path.string();
+    return false;
+  }
+  return true;
+}
+
+void appendGltfModel(tinygltf::Model &model, GltfBuffers &buffers,
+    tinygltf::Model &&other, GltfBuffers &&otherBuffers, const SceneFile &file)
+{
+  offsetModel(other, model);
+
+  // Root of the file, parent of the roots of its default scene
+  tinygltf::Node root;
+  root.name = file.path.filename().string();
+  root.translation = {file.translation.x, file.translation.y,
+      file.translation.z};
+  root.rotation = {
+      file.rotation.x, file.rotation.y, file.rotation.z, file.rotation.w};
+  root.scale = {file.scale.x, file.scale.y, file.scale.z};
+  const int otherScene = other.defaultScene >= 0 ? other.defaultScene : 0;
+  if (size_t(otherScene) < other.scenes.size()) {
+    root.children = other.scenes[otherScene].nodes;
+    for (auto &child : root.children) {
+      offsetIndex(child, model.nodes.size());
+    }
+  }
+
+  appendMoved(model.accessors, other.accessors);
+  appendMoved(model.animations, other.animations);
+  appendMoved(model.buffers, other.buffers);
+  appendMoved(model.bufferViews, other.bufferViews);
+  appendMoved(model.materials, other.materials);
+  appendMoved(model.meshes, other.meshes);
+  appendMoved(model.nodes, other.nodes);
+  appendMoved(model.textures, other.textures);
+  appendMoved(model.images, other.images);
+  appendMoved(model.skins, other.skins);
+  appendMoved(model.samplers, other.samplers);
+  appendMoved(model.cameras, other.cameras);
+  appendMoved(model.lights, other.lights);
+  appendNames(model.extensionsUsed, other.extensionsUsed);
+  appendNames(model.extensionsRequired, other.extensionsRequired);
+  buffers.append(std::move(otherBuffers));
+
+  if (model.scenes.empty()) {
+    model.scenes.emplace_back();
+  }
+  if (model.defaultScene < 0 ||
+      size_t(model.defaultScene) >= model.scenes.size()) {
+    model.defaultScene = 0;
+  }
+  model.scenes[model.defaultScene].nodes.push_back(int(model.nodes.size()));
+  model.nodes.push_back(std::move(root));
+}
+
+size_t shareIdenticalTextures(tinygltf::Model &model)
+{
+  // Images with the same hash are compared byte for byte
+  std::unordered_multimap<size_t, int> imagesByHash;
+  std::vector<int> imageRemap(model.images.size());
+  std::vector<tinygltf::Image> images;
+  for (size_t i = 0; i < model.images.size(); ++i) {
+    auto &image = model.images[i];
+    const auto hash = hashImage(image);
+    int shared = -1;
+    const auto candidates = imagesByHash.equal_range(hash);
+    for (auto it = candidates.first; it != candidates.second; ++it) {
+      if (sameImage(images[(*it).second], image)) {
+        shared = (*it).second;
+        break;
+      }
+    }
+    if (shared < 0) {
+      shared = int(images.size());
+      imagesByHash.emplace(hash, shared);
+      images.push_back(std::move(image));
+    }
+    imageRemap[i] = shared;
+  }
+  model.images = std::move(images);
+  for (auto &texture : model.textures) {
+    remapTextureSources(texture, [&](int source) {
+      return size_t(source) < imageRemap.size() ? imageRemap[source] : source;
+    });
+  }
+  return shareSameImageTextures(model);
+}
+
+size_t shareSameImageTextures(tinygltf::Model &model)
+{
+  // Color textures are uploaded as sRGB, the same image sampled as data is a
+  // different texture
+  const auto usages = getTextureUsages(model);
+  std::map<std::tuple<int, int, int, int, int, int, unsigned>, int> keys;
+  std::vector<int> textureRemap(model.textures.size());
+  std::vector<tinygltf::Texture> textures;
+  for (size_t i = 0; i < model.textures.size(); ++i) {
+    auto &texture = model.textures[i];
+    const tinygltf::Sampler defaultSampler;
+    const auto &sampler = texture.sampler >= 0
+                              ? model.samplers[texture.sampler]
+                              : defaultSampler;
+    const auto key = std::make_tuple(texture.source, basisuSource(texture),
+        sampler.minFilter, sampler.magFilter, sampler.wrapS, sampler.wrapT,
+        usages[i]);
+    const auto inserted = keys.emplace(key, int(textures.size()));
+    if (inserted.second) {
+      textures.push_back(std::move(texture));
+    }
+    textureRemap[i] = (*inserted.first).second;
+  }
+  const auto removed = model.textures.size() - textures.size();
+  model.textures = std::move(textures);
+  for (auto &material : model.materials) {
+    remapMaterialTextures(material, [&](int texture) {
+      return size_t(texture) < textureRemap.size() ? textureRemap[texture]
+                                                   : texture;
+    });
+  }
+  return removed;
+}
+
+bool sameModelButMaterials(
+    const tinygltf::Model &model, const tinygltf::Model &other)
+{
+  const auto isFileUri = [](const std::string &uri) {
+    return !uri.empty() && uri.compare(0, 5, "data:") != 0;
+  };
+  if (model.buffers.size() != other.buffers.size() ||
+      model.images.size() != other.images.size() ||
+      model.materials.size() != other.materials.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < model.buffers.size(); ++i) {
+    const auto &uri = model.buffers[i].uri;
+    if (!isFileUri(uri) || uri != other.buffers[i].uri) {
+      return false;
+    }
+  }
+  for (size_t i = 0; i < model.images.size(); ++i) {
+    const auto &image = model.images[i];
+    const auto &otherImage = other.images[i];
+    if ((image.bufferView < 0 && !isFileUri(image.uri)) ||
+        image.uri != otherImage.uri ||
+        image.bufferView != otherImage.bufferView) {
+      return false;
+    }
+  }
+  return model.accessors == other.accessors &&
+         model.animations == other.animations &&
+         model.bufferViews == other.bufferViews &&
+         model.cameras == other.cameras && model.meshes == other.meshes &&
+         model.nodes == other.nodes && model.samplers == other.samplers &&
+         model.scenes == other.scenes && model.skins == other.skins &&
+         model.textures == other.textures && model.lights == other.lights &&
+         model.defaultScene == other.defaultScene &&
+         model.extensionsUsed == other.extensionsUsed &&
+         model.extensionsRequired == other.extensionsRequired;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "filesystem.hpp"
+#include "gltf_loader.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <tiny_gltf.h>
+
+#include <string>
+#include <vector>
+
+// A glTF file of a scene, placed in the scene by a transform applied on top of
+// the transforms of its own nodes
+struct SceneFile
+{
+  fs::path path;
+  glm::vec3 translation = glm::vec3(0);
+  glm::quat rotation = glm::quat(1, 0, 0, 0);
+  glm::vec3 scale = glm::vec3(1);
+
+  bool hasTransform() const
+  {
+    return translation != glm::vec3(0) || rotation != glm::quat(1, 0, 0, 0) ||
+           scale != glm::vec3(1);
+  }
+};
+
+// True for the .json scene files read by loadSceneFile
+bool isSceneFile(const fs::path &path);
+
+// Read a scene file, a JSON object with a "models" array of objects with a
+// "file" path, relative to the scene file, and an optional "translation",
+// "rotation" (quaternion x, y, z, w) and "scale" of the model.
+bool loadSceneFile(
+    const fs::path &path, std::vector<SceneFile> &files, std::string &err);
+
+// Write a scene file readable by loadSceneFile, with absolute paths
+bool saveSceneFile(const fs::path &path, const std::vector<SceneFile> &files,
+    std::string &err);
+
+// Move the model other, with its buffers, into model: every index of other is
+// offset past the objects of model, and the nodes of its default scene become
+// the children of a new root node with the transform of file, added to the
+// default scene of model. Every model is then drawn by the default scene.
+void appendGltfModel(tinygltf::Model &model, GltfBuffers &buffers,
+    tinygltf::Model &&other, GltfBuffers &&otherBuffers,
+    const SceneFile &file);
+
+// Merge the images with the same pixels, then the textures with the same
+// image, sampler and color usage, so that the models of a scene loading the
+// same files upload them once. Return the number of textures removed.
+size_t shareIdenticalTextures(tinygltf::Model &model);
+
+// Only merge the textures with the same image, sampler and color usage, like
+// those loadGltfModel() points to the first copy of a duplicate image
+size_t shareSameImageTextures(tinygltf::Model &model);
+
+// True if other, a version of model loaded again from its file, has other
+// materials but the same everything else, so that only the materials need to
+// be replaced. Buffers and images are compared by their uri, the files they
+// refer to are not: models embedding them, whose bytes are freed once
+// uploaded, never compare the same.
+bool sameModelButMaterials(
+    const tinygltf::Model &model, const tinygltf::Model &other);
@@ -0,0 +1,259 @@
+#include "gpu_memory.hpp"
+#include "gl_extensions.hpp"
+
+#include <algorithm>
+
+namespace
+{
+
+// GL_NVX_gpu_memory_info, in KB
+const GLenum GL_GPU_MEMORY_INFO_TOTAL_AVAILABLE_MEMORY_NVX = 0x9048;
+const GLenum GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_MEMORY_NVX = 0x9049;
+// GL_ATI_meminfo, 4 values in KB of which the first is the free memory
+const GLenum GL_TEXTURE_FREE_MEMORY_ATI = 0x87FC;
+
+// Mip levels are queried up to this one, beyond any texture size limit
+const GLint MAX_TRACKED_LEVEL = 16;
+
+GLenum textureBinding(GLenum target)
+{
+  switch (target) {
+  case GL_TEXTURE_2D_ARRAY:
+    return GL_TEXTURE_BINDING_2D_ARRAY;
+  case GL_TEXTURE_CUBE_MAP:
+    return GL_TEXTURE_BINDING_CUBE_MAP;
+  case GL_TEXTURE_3D:
+    return GL_TEXTURE_BINDING_3D;
+  case GL_TEXTURE_2D_MULTISAMPLE:
+    return GL_TEXTURE_BINDING_2D_MULTISAMPLE;
+  }
+  return GL_TEXTURE_BINDING_2D;
+}
+
+// Bytes of a level of the texture bound on target, or of a face of a cube
+// map, 0 past the last level
+size_t levelBytes(GLenum target, GLint level)
+{
+  GLint width = 0;
+  glGetTexLevelParameteriv(target, level, GL_TEXTURE_WIDTH, &width);
+  if (width == 0) {
+    return 0;
+  }
+  GLint compressed = GL_FALSE;
+  glGetTexLevelParameteriv(target, level, GL_TEXTURE_COMPRESSED, &compressed);
+  if (compressed) {
+    GLint size = 0;
+    glGetTexLevelParameteriv(
+        target, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+    return size_t(size);
+  }
+
+  GLint height = 0;
+  GLint depth = 0;
+  GLint samples = 0;
+  glGetTexLevelParameteriv(target, level, GL_TEXTURE_HEIGHT, &height);
+  glGetTexLevelParameteriv(target, level, GL_TEXTURE_DEPTH, &depth);
+  glGetTexLevelParameteriv(target, level, GL_TEXTURE_SAMPLES, &samples);
+  size_t bits = 0;
+  for (const auto component : {GL_TEXTURE_RED_SIZE, GL_TEXTURE_GREEN_SIZE,
+           GL_TEXTURE_BLUE_SIZE, GL_TEXTURE_ALPHA_SIZE, GL_TEXTURE_DEPTH_SIZE,
+           GL_TEXTURE_STENCIL_SIZE, GL_TEXTURE_SHARED_SIZE}) {
+    GLint size = 0;
+    glGetTexLevelParameteriv(target, level, component, &size);
+    bits += size_t(size);
+  }
+  return size_t(width) * size_t(std::max(height, 1)) *
+         size_t(std::max(depth, 1)) * size_t(std::max(samples, 1)) * bits / 8;
+}
+
+} // namespace
+
+const char *gpuMemoryCategoryName(GpuMemoryCategory category)
+{
+  switch (category) {
+  case GpuMemoryCategory::Geometry:
+    return "Geometry";
+  case GpuMemoryCategory::MaterialTextures:
+    return "Material textures";
+  case GpuMemoryCategory::Environment:
+    return "Environment";
+  case GpuMemoryCategory::RenderTargets:
+    return "Render targets";
+  case GpuMemoryCategory::ShaderBuffers:
+    return "Shader buffers";
+  case GpuMemoryCategory::Staging:
+    return "Staging";
+  case GpuMemoryCategory::Count:
+    break;
+  }
+  return "";
+}
+
+GpuMemoryTracker::~GpuMemoryTracker()
+{
+  if (current() == this) {
+    current() = nullptr;
+  }
+}
+
+void GpuMemoryTracker::set(
+    Kind kind, GLuint name, GpuMemoryCategory category, size_t bytes)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto &object = m_objects[{kind, name}];
+  if (object.second == 0 && bytes > 0) {
+    ++m_usage.objectCount;
+  } else if (object.second > 0 && bytes == 0) {
+    --m_usage.objectCount;
+  }
+  m_usage.bytes[size_t(object.first)] -= object.second;
+  m_usage.total -= object.second;
+  object = {category, bytes};
+  m_usage.bytes[size_t(category)] += bytes;
+  m_usage.total += bytes;
+}
+
+void GpuMemoryTracker::release(Kind kind, GLuint name)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  const auto it = m_objects.find({kind, name});
+  if (it == m_objects.end()) {
+    return;
+  }
+  if (it->second.second > 0) {
+    --m_usage.objectCount;
+  }
+  m_usage.bytes[size_t(it->second.first)] -= it->second.second;
+  m_usage.total -= it->second.second;
+  m_objects.erase(it);
+}
+
+GpuMemoryTracker::Usage GpuMemoryTracker::usage() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_usage;
+}
+
+void trackBuffer(GpuMemoryCategory category, GLuint buffer, size_t bytes)
+{
+  if (auto *tracker = GpuMemoryTracker::current()) {
+    tracker->set(GpuMemoryTracker::KIND_BUFFER, buffer, category, bytes);
+  }
+}
+
+void trackTexture(GpuMemoryCategory category, GLenum target, GLuint texture)
+{
+  auto *tracker = GpuMemoryTracker::current();
+  if (!tracker || !texture) {
+    return;
+  }
+
+  GLint previous = 0;
+  glGetIntegerv(textureBinding(target), &previous);
+  glBindTexture(target, texture);
+  size_t bytes = 0;
+  // multisampled textures have a single level, querying others is an error
+  const GLint levels =
+      target == GL_TEXTURE_2D_MULTISAMPLE ? 1 : MAX_TRACKED_LEVEL;
+  for (GLint level = 0; level < levels; ++level) {
+    size_t bytesOfLevel = 0;
+    if (target == GL_TEXTURE_CUBE_MAP) {
+      for (GLenum face = 0; face < 6; ++face) {
+        bytesOfLevel +=
+            levelBytes(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level);
+      }
+    } else {
+      bytesOfLevel = levelBytes(target, level);
+    }
+    if (bytesOfLevel == 0) {
+      break;
+    }
+    bytes += bytesOfLevel;
+  }
+  glBindTexture(target, GLuint(previous));
+
+  tracker->set(GpuMemoryTracker::KIND_TEXTURE, texture, category, bytes);
+}
+
+void trackRenderbuffer(GpuMemoryCategory category, GLuint renderbuffer)
+{
+  auto *tracker = GpuMemoryTracker::current();
+  if (!tracker || !renderbuffer) {
+    return;
+  }
+
+  GLint previous = 0;
+  glGetIntegerv(GL_RENDERBUFFER_BINDING, &previous);
+  glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+  GLint width = 0;
+  GLint height = 0;
+  GLint samples = 0;
+  glGetRenderbufferParameteriv(GL_RENDERBUFFER, GL_RENDERBUFFER_WIDTH, &width);
+  glGetRenderbufferParameteriv(
+      GL_RENDERBUFFER, GL_RENDERBUFFER_HEIGHT, &height);
+  glGetRenderbufferParameteriv(
+      GL_RENDERBUFFER, GL_RENDERBUFFER_SAMPLES, &samples);
+  size_t bits = 0;
+  for (const auto component :
+      {GL_RENDERBUFFER_RED_SIZE, GL_RENDERBUFFER_GREEN_SIZE,
+          GL_RENDERBUFFER_BLUE_SIZE, GL_RENDERBUFFER_ALPHA_SIZE,
+          GL_RENDERBUFFER_DEPTH_SIZE, GL_RENDERBUFFER_STENCIL_SIZE}) {
+    GLint size = 0;
+    glGetRenderbufferParameteriv(GL_RENDERBUFFER, component, &size);
+    bits += size_t(size);
+  }
+  glBindRenderbuffer(GL_RENDERBUFFER, GLuint(previous));
+
+  tracker->set(GpuMemoryTracker::KIND_RENDERBUFFER, renderbuffer, category,
+      size_t(width) * size_t(height) * size_t(std::max(samples, 1)) * bits /
+          8);
+}
+
+void untrackBuffers(GLsizei count, const GLuint *buffers)
+{
+  if (auto *tracker = GpuMemoryTracker::current()) {
+    for (GLsizei i = 0; i < count; ++i) {
+      tracker->release(GpuMemoryTracker::KIND_BUFFER, buffers[i]);
+    }
+  }
+}
+
+void untrackTextures(GLsizei count, const GLuint *textures)
+{
+  if (auto *tracker = GpuMemoryTracker::current()) {
+    for (GLsizei i = 0; i < count; ++i) {
+      tracker->release(GpuMemoryTracker::KIND_TEXTURE, textures[i]);
+    }
+  }
+}
+
+void untrackRenderbuffers(GLsizei count, const GLuint *renderbuffers)
+{
+  if (auto *tracker = GpuMemoryTracker::current()) {
+    for (GLsizei i = 0; i < count; ++i) {
+      tracker->release(
+          GpuMemoryTracker::KIND_RENDERBUFFER, renderbuffers[i]);
+    }
+  }
+}
+
+bool queryDriverMemoryInfo(DriverMemoryInfo &info)
+{
+  info = DriverMemoryInfo();
+  if (hasGLExtension("GL_NVX_gpu_memory_info")) {
+    GLint total = 0;
+    GLint available = 0;
+    glGetIntegerv(GL_GPU_MEMORY_INFO_TOTAL_AVAILABLE_MEMORY_NVX, &total);
+    glGetIntegerv(GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_MEMORY_NVX, &available);
+    info.totalBytes = size_t(total) * 1024;
+    info.availableBytes = size_t(available) * 1024;
+    return true;
+  }
+  if (hasGLExtension("GL_ATI_meminfo")) {
+    GLint free[4] = {};
+    glGetIntegerv(GL_TEXTURE_FREE_MEMORY_ATI, free);
+    info.availableBytes = size_t(free[0]) * 1024;
+    return true;
+  }
+  return false;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <utility>
+
+enum class GpuMemoryCategory
+{
+  Geometry, // Vertex and index buffers
+  MaterialTextures,
+  Environment, // Image based lighting maps
+  RenderTargets, // Shadow maps and offscreen framebuffers
+  ShaderBuffers, // Uniform, storage, indirect and per draw buffers
+  Staging, // Upload and readback buffers
+  Count
+};
+
+const char *gpuMemoryCategoryName(GpuMemoryCategory category);
+
+// Bytes of the buffers, textures and renderbuffers of a renderer, by
+// category. The objects are tracked by the thread that creates them, in the
+// current tracker of the thread: the threads of a renderer, whose contexts
+// share objects, share its tracker. Objects created without a current tracker
+// are not counted.
+class GpuMemoryTracker
+{
+public:
+  enum Kind
+  {
+    KIND_BUFFER,
+    KIND_TEXTURE,
+    KIND_RENDERBUFFER
+  };
+
+  struct Usage
+  {
+    size_t bytes[size_t(GpuMemoryCategory::Count)] = {};
+    size_t total = 0;
+    size_t objectCount = 0;
+  };
+
+  GpuMemoryTracker() = default;
+  ~GpuMemoryTracker();
+
+  GpuMemoryTracker(const GpuMemoryTracker &) = delete;
+  GpuMemoryTracker &operator=(const GpuMemoryTracker &) = delete;
+
+  // Tracker of the objects created on this thread, nullptr if none
+  static GpuMemoryTracker *&current()
+  {
+    thread_local GpuMemoryTracker *tracker = nullptr;
+    return tracker;
+  }
+
+  // Replace the size of the object if it is tracked already
+  void set(Kind kind, GLuint name, GpuMemoryCategory category, size_t bytes);
+  void release(Kind kind, GLuint name);
+
+  Usage usage() const;
+
+private:
+  mutable std::mutex m_mutex;
+  std::map<std::pair<Kind, GLuint>, std::pair<GpuMemoryCategory, size_t>>
+      m_objects;
+  Usage m_usage;
+};
+
+// Record the storage of an object in the current tracker, call again when it
+// is reallocated. Texture and renderbuffer sizes are queried from their
+// levels, not computed from their formats, the current bindings are restored.
+// target is the texture target, GL_TEXTURE_CUBE_MAP for cube maps.
+void trackBuffer(GpuMemoryCategory category, GLuint buffer, size_t bytes);
+void trackTexture(GpuMemoryCategory category, GLenum target, GLuint texture);
+void trackRenderbuffer(GpuMemoryCategory category, GLuint renderbuffer);
+
+// Call with the names given to glDelete*, untracked names are ignored
+void untrackBuffers(GLsizei count, const GLuint *buffers);
+void untrackTextures(GLsizei count, const GLuint *textures);
+void untrackRenderbuffers(GLsizei count, const GLuint *renderbuffers);
+
+// Video memory of the device reported by GL_NVX_gpu_memory_info or
+// GL_ATI_meminfo, false if the driver exposes neither. ATI_meminfo only tells
+// the free memory, total is then 0.
+struct DriverMemoryInfo
+{
+  size_t totalBytes = 0;
+  size_t availableBytes = 0;
+};
+bool queryDriverMemoryInfo(DriverMemoryInfo &info);
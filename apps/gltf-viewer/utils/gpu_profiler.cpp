@@ -0,0 +1,148 @@
+#include "gpu_profiler.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+GpuProfiler::GpuProfiler(size_t historySize, size_t frameLatency) :
+    m_historySize(historySize), m_frames(frameLatency + 1)
+{
+}
+
+GpuProfiler::~GpuProfiler()
+{
+  for (auto &marks : m_frames) {
+    for (const auto &mark : marks) {
+      m_freeQueries.push_back(mark.begin);
+      m_freeQueries.push_back(mark.end);
+    }
+  }
+  if (!m_freeQueries.empty()) {
+    glDeleteQueries(GLsizei(m_freeQueries.size()), m_freeQueries.data());
+  }
+}
+
+void GpuProfiler::beginFrame()
+{
+  m_frame = (m_frame + 1) % m_frames.size();
+  read(m_frames[m_frame]);
+  m_inFrame = true;
+}
+
+void GpuProfiler::endFrame()
+{
+  // Unbalanced sections end with the frame
+  while (!m_openMarks.empty()) {
+    end();
+  }
+  m_inFrame = false;
+}
+
+void GpuProfiler::begin(const char *name)
+{
+  if (!m_inFrame) {
+    return;
+  }
+
+  size_t section = 0;
+  while (section < m_names.size() && m_names[section] != name &&
+         std::strcmp(m_names[section], name) != 0) {
+    ++section;
+  }
+  if (section == m_names.size()) {
+    Section newSection;
+    newSection.name = name;
+    newSection.depth = m_openMarks.size();
+    newSection.history.assign(m_historySize, 0.f);
+    m_sections.push_back(newSection);
+    m_names.push_back(name);
+  }
+
+  auto &marks = m_frames[m_frame];
+  Mark mark;
+  mark.section = section;
+  mark.begin = newQuery();
+  mark.end = 0;
+  glQueryCounter(mark.begin, GL_TIMESTAMP);
+  m_openMarks.push_back(marks.size());
+  marks.push_back(mark);
+}
+
+void GpuProfiler::end()
+{
+  if (!m_inFrame || m_openMarks.empty()) {
+    return;
+  }
+  auto &mark = m_frames[m_frame][m_openMarks.back()];
+  m_openMarks.pop_back();
+  mark.end = newQuery();
+  glQueryCounter(mark.end, GL_TIMESTAMP);
+}
+
+void GpuProfiler::flush()
+{
+  endFrame();
+  for (size_t i = 1; i <= m_frames.size(); ++i) {
+    read(m_frames[(m_frame + i) % m_frames.size()]);
+  }
+}
+
+std::string GpuProfiler::summary() const
+{
+  std::string summary;
+  for (const auto &section : m_sections) {
+    char time[32];
+    std::snprintf(time, sizeof(time), " %.3f ms", section.averageMs);
+    summary += (summary.empty() ? "" : ", ") + section.name + time;
+  }
+  return summary;
+}
+
+void GpuProfiler::read(std::vector<Mark> &marks)
+{
+  if (marks.empty()) {
+    return;
+  }
+
+  auto &frameMs = m_frameMs;
+  frameMs.assign(m_sections.size(), 0.);
+  for (const auto &mark : marks) {
+    // Timestamps are in ns, the result waits if the GPU is not done yet
+    GLuint64 begin = 0;
+    GLuint64 end = 0;
+    glGetQueryObjectui64v(mark.begin, GL_QUERY_RESULT, &begin);
+    glGetQueryObjectui64v(mark.end, GL_QUERY_RESULT, &end);
+    frameMs[mark.section] += (end > begin ? end - begin : 0) * 1e-6;
+    m_freeQueries.push_back(mark.begin);
+    m_freeQueries.push_back(mark.end);
+  }
+  marks.clear();
+
+  for (size_t i = 0; i < m_sections.size(); ++i) {
+    auto &section = m_sections[i];
+    section.lastMs = float(frameMs[i]);
+    section.history[section.historyEnd] = section.lastMs;
+    section.historyEnd = (section.historyEnd + 1) % m_historySize;
+    ++section.frameCount;
+
+    const auto count = std::min(section.frameCount, m_historySize);
+    double sum = 0;
+    for (size_t j = 1; j <= count; ++j) {
+      sum += section.history[(section.historyEnd + m_historySize - j) %
+                             m_historySize];
+    }
+    section.averageMs = float(sum / count);
+  }
+}
+
+GLuint GpuProfiler::newQuery()
+{
+  if (m_freeQueries.empty()) {
+    GLuint query = 0;
+    glGenQueries(1, &query);
+    return query;
+  }
+  const auto query = m_freeQueries.back();
+  m_freeQueries.pop_back();
+  return query;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// GPU time of named sections of the frames, measured with pairs of
+// GL_TIMESTAMP queries so that sections can nest. The queries of a frame are
+// read once frameLatency more frames have been submitted, by then the GPU is
+// done with them and reading does not stall. Sections are only measured
+// between beginFrame() and endFrame(), begin() and end() are ignored outside
+// of a frame.
+class GpuProfiler
+{
+public:
+  struct Section
+  {
+    std::string name;
+    size_t depth = 0; // Of nesting in other sections
+    // GPU time in ms of the last historySize frames read, 0 for the frames
+    // the section was not entered in. history[historyEnd] is the oldest.
+    std::vector<float> history;
+    size_t historyEnd = 0;
+    size_t frameCount = 0; // Frames read since the section was first entered
+    float lastMs = 0;
+    float averageMs = 0; // Over the history
+  };
+
+  explicit GpuProfiler(size_t historySize = 120, size_t frameLatency = 3);
+  ~GpuProfiler();
+
+  GpuProfiler(const GpuProfiler &) = delete;
+  GpuProfiler &operator=(const GpuProfiler &) = delete;
+
+  void beginFrame();
+  void endFrame();
+
+  // name must outlive the profiler, sections are told apart by name
+  void begin(const char *name);
+  void end();
+
+  // Wait for the GPU and read every frame submitted
+  void flush();
+
+  // In order of first entry
+  const std::vector<Section> &sections() const { return m_sections; }
+
+  // "name 1.234 ms, ..." of the average time of each section
+  std::string summary() const;
+
+private:
+  struct Mark
+  {
+    size_t section;
+    GLuint begin;
+    GLuint end;
+  };
+
+  void read(std::vector<Mark> &marks);
+  GLuint newQuery();
+
+  size_t m_historySize;
+  std::vector<Section> m_sections;
+  std::vector<const char *> m_names; // Of m_sections
+  std::vector<std::vector<Mark>> m_frames; // Ring of frames in flight
+  size_t m_frame = 0;
+  bool m_inFrame = false;
+  std::vector<size_t> m_openMarks; // Of the current frame, innermost last
+  std::vector<GLuint> m_freeQueries;
+  std::vector<double> m_frameMs; // Of read(), by section
+};
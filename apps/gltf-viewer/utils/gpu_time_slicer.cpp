@@ -0,0 +1,59 @@
+#include "gpu_time_slicer.hpp"
+
+GpuTimeSlicer::GpuTimeSlicer(float budgetMs) : m_budgetMs(budgetMs) {}
+
+void GpuTimeSlicer::beginFrame()
+{
+  read();
+  m_frame = Frame();
+  m_frameItems = 0;
+}
+
+bool GpuTimeSlicer::admit(double cost)
+{
+  if (m_frameItems > 0 &&
+      (m_msPerCost == 0 || (m_frame.cost + cost) * m_msPerCost > m_budgetMs)) {
+    return false;
+  }
+  if (m_frameItems == 0) {
+    m_frame.queries.generate(2);
+    glQueryCounter(m_frame.queries[0], GL_TIMESTAMP);
+  }
+  m_frame.cost += cost;
+  ++m_frameItems;
+  return true;
+}
+
+void GpuTimeSlicer::endFrame()
+{
+  if (m_frameItems == 0) {
+    return;
+  }
+  glQueryCounter(m_frame.queries[1], GL_TIMESTAMP);
+  m_frames.push_back(std::move(m_frame));
+  m_frameItems = 0;
+}
+
+void GpuTimeSlicer::read()
+{
+  while (!m_frames.empty()) {
+    const auto &frame = m_frames.front();
+    GLint available = 0;
+    glGetQueryObjectiv(
+        frame.queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) {
+      return;
+    }
+    GLuint64 begin = 0, end = 0;
+    glGetQueryObjectui64v(frame.queries[0], GL_QUERY_RESULT, &begin);
+    glGetQueryObjectui64v(frame.queries[1], GL_QUERY_RESULT, &end);
+    if (frame.cost > 0 && end > begin) {
+      // Items of a kind cost about the same, the estimate follows the kinds
+      // as they change
+      const auto msPerCost = double(end - begin) * 1e-6 / frame.cost;
+      m_msPerCost =
+          m_msPerCost == 0 ? msPerCost : 0.5 * (m_msPerCost + msPerCost);
+    }
+    m_frames.pop_front();
+  }
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "gl_objects.hpp"
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <deque>
+
+// Spreads GPU work over frames so that each frame spends about budgetMs of GPU
+// time on it. The work is split in items of known relative costs, the GPU time
+// per unit of cost is learnt from GL_TIMESTAMP queries around the items of
+// previous frames, read once available so that the CPU never waits for them.
+// Until one is read a single item runs per frame, as does any item larger than
+// the budget.
+class GpuTimeSlicer
+{
+public:
+  explicit GpuTimeSlicer(float budgetMs);
+
+  GpuTimeSlicer(const GpuTimeSlicer &) = delete;
+  GpuTimeSlicer &operator=(const GpuTimeSlicer &) = delete;
+
+  void beginFrame();
+  // Whether an item of cost fits in what is left of the budget of the frame,
+  // in which case it must be submitted before the next call
+  bool admit(double cost);
+  void endFrame();
+
+  // Smoothed over the frames read, 0 until the first one is
+  double msPerCost() const { return m_msPerCost; }
+
+private:
+  struct Frame
+  {
+    GLQueries queries; // Timestamps before and after the items
+    double cost = 0;
+  };
+
+  // Measure the frames the GPU is done with
+  void read();
+
+  float m_budgetMs;
+  double m_msPerCost = 0;
+  std::deque<Frame> m_frames; // Submitted, oldest first
+  Frame m_frame; // Being submitted
+  size_t m_frameItems = 0;
+};
@@ -0,0 +1,452 @@
+#include "heap_memory.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+
+#ifdef GLMLV_COUNT_ALLOCATIONS
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#define GLMLV_HEAP_STACKS
+#elif defined(__GLIBC__)
+#include <cxxabi.h>
+#include <execinfo.h>
+#define GLMLV_HEAP_STACKS
+#endif
+#endif
+
+namespace
+{
+
+thread_local HeapTag t_heapTag = HeapTag::Other;
+
+} // namespace
+
+const char *heapTagName(HeapTag tag)
+{
+  switch (tag) {
+  case HeapTag::Other:
+    return "Other";
+  case HeapTag::Model:
+    return "Model";
+  case HeapTag::Images:
+    return "Images";
+  case HeapTag::Geometry:
+    return "Geometry";
+  case HeapTag::Staging:
+    return "Staging";
+  case HeapTag::Caches:
+    return "Caches";
+  case HeapTag::Gui:
+    return "GUI";
+  case HeapTag::Count:
+    break;
+  }
+  return "";
+}
+
+HeapTagScope::HeapTagScope(HeapTag tag) : m_previous(t_heapTag)
+{
+  t_heapTag = tag;
+}
+
+HeapTagScope::~HeapTagScope() { t_heapTag = m_previous; }
+
+#ifdef GLMLV_COUNT_ALLOCATIONS
+
+namespace
+{
+
+// Before every counted allocation, a multiple of the alignment of malloc so
+// that the memory returned keeps it
+struct AllocationHeader
+{
+  uint64_t size;
+  uint32_t site; // 1 + index in g_sites, 0 if not sampled
+  uint8_t tag;
+  uint8_t padding[3];
+};
+
+const size_t HEADER_SIZE = 16;
+static_assert(sizeof(AllocationHeader) <= HEADER_SIZE, "");
+static_assert(alignof(std::max_align_t) <= HEADER_SIZE,
+    "The header would break the alignment of allocations");
+
+const size_t TAG_COUNT = size_t(HeapTag::Count);
+
+std::atomic<size_t> g_heapAllocations{0};
+std::atomic<size_t> g_liveAllocations{0};
+std::atomic<size_t> g_bytes[TAG_COUNT];
+std::atomic<size_t> g_peakBytes[TAG_COUNT];
+std::atomic<size_t> g_total{0};
+std::atomic<size_t> g_peakTotal{0};
+
+void raisePeak(std::atomic<size_t> &peak, size_t value)
+{
+  auto current = peak.load(std::memory_order_relaxed);
+  while (current < value &&
+         !peak.compare_exchange_weak(
+             current, value, std::memory_order_relaxed)) {
+  }
+}
+
+// Sampling, see setHeapSampling. The sites are a fixed open addressed table,
+// so that recording a sample never allocates.
+const size_t SITE_CAPACITY = 4096;
+const int SITE_DEPTH = 12;
+// Frames of sampleSite, countedAllocation and operator new
+const int ALLOCATOR_DEPTH = 3;
+
+struct Site
+{
+  size_t hash = 0; // 0 for a free entry
+  void *frames[SITE_DEPTH] = {};
+  int depth = 0;
+  HeapTag tag = HeapTag::Other;
+  size_t bytes = 0;
+  size_t sampleCount = 0;
+};
+
+size_t g_samplingInterval = 0;
+std::mutex g_sitesMutex;
+Site g_sites[SITE_CAPACITY];
+
+// Bytes left to allocate by the thread before its next sample
+thread_local int64_t t_sampleCountdown = 0;
+// Set while the thread samples or reads the sites, so that the allocations of
+// backtrace and of heapSites are not sampled themselves
+thread_local bool t_inSampler = false;
+
+size_t sampleWeight(size_t size) { return std::max(size, g_samplingInterval); }
+
+#ifdef GLMLV_HEAP_STACKS
+
+int captureStack(void **frames, int maxDepth)
+{
+#ifdef _WIN32
+  return int(CaptureStackBackTrace(0, DWORD(maxDepth), frames, nullptr));
+#else
+  return backtrace(frames, maxDepth);
+#endif
+}
+
+// 1 + the index of the site of the calling stack, 0 if the table is full:
+// the sample is then dropped
+#if defined(_MSC_VER)
+__declspec(noinline)
+#else
+__attribute__((noinline))
+#endif
+uint32_t sampleSite(size_t size, HeapTag tag)
+{
+  t_inSampler = true;
+  void *frames[ALLOCATOR_DEPTH + SITE_DEPTH];
+  const auto captured = captureStack(frames, ALLOCATOR_DEPTH + SITE_DEPTH);
+  const auto depth = std::max(captured - ALLOCATOR_DEPTH, 0);
+  auto *const stack = frames + std::min(captured, ALLOCATOR_DEPTH);
+
+  // FNV-1a of the addresses, never 0
+  size_t hash = 14695981039346656037ull;
+  for (int i = 0; i < depth; ++i) {
+    hash = (hash ^ reinterpret_cast<uintptr_t>(stack[i])) * 1099511628211ull;
+  }
+  hash = hash ? hash : 1;
+
+  uint32_t site = 0;
+  {
+    std::lock_guard<std::mutex> lock(g_sitesMutex);
+    for (size_t probe = 0; probe < SITE_CAPACITY; ++probe) {
+      const auto index = (hash + probe) % SITE_CAPACITY;
+      auto &entry = g_sites[index];
+      if (entry.hash == 0) {
+        entry.hash = hash;
+        std::copy(stack, stack + depth, entry.frames);
+        entry.depth = depth;
+        entry.tag = tag;
+      } else if (entry.hash != hash || entry.depth != depth ||
+                 !std::equal(stack, stack + depth, entry.frames)) {
+        continue;
+      }
+      entry.bytes += sampleWeight(size);
+      ++entry.sampleCount;
+      site = uint32_t(index + 1);
+      break;
+    }
+  }
+  t_inSampler = false;
+  return site;
+}
+
+void releaseSample(uint32_t site, size_t size)
+{
+  std::lock_guard<std::mutex> lock(g_sitesMutex);
+  auto &entry = g_sites[site - 1];
+  entry.bytes -= sampleWeight(size);
+  --entry.sampleCount;
+}
+
+#endif
+
+#if defined(_MSC_VER)
+__declspec(noinline)
+#else
+__attribute__((noinline))
+#endif
+void *countedAllocation(size_t size, HeapTag tag)
+{
+  ++g_heapAllocations;
+  if (size > SIZE_MAX - HEADER_SIZE) {
+    return nullptr;
+  }
+  auto *const memory =
+      static_cast<unsigned char *>(std::malloc(HEADER_SIZE + size));
+  if (!memory) {
+    return nullptr;
+  }
+
+  AllocationHeader header = {};
+  header.size = size;
+  header.tag = uint8_t(tag);
+#ifdef GLMLV_HEAP_STACKS
+  // Allocations of an interval or more are all sampled, standing for their
+  // size, without counting down
+  if (g_samplingInterval && !t_inSampler) {
+    if (size >= g_samplingInterval) {
+      header.site = sampleSite(size, tag);
+    } else if ((t_sampleCountdown -= int64_t(size)) <= 0) {
+      t_sampleCountdown += int64_t(g_samplingInterval);
+      header.site = sampleSite(size, tag);
+    }
+  }
+#endif
+  std::memcpy(memory, &header, sizeof(header));
+
+  ++g_liveAllocations;
+  raisePeak(g_peakBytes[size_t(tag)], g_bytes[size_t(tag)] += size);
+  raisePeak(g_peakTotal, g_total += size);
+  return memory + HEADER_SIZE;
+}
+
+void countedFree(void *pointer)
+{
+  if (!pointer) {
+    return;
+  }
+  auto *const memory = static_cast<unsigned char *>(pointer) - HEADER_SIZE;
+  AllocationHeader header;
+  std::memcpy(&header, memory, sizeof(header));
+
+  --g_liveAllocations;
+  g_bytes[header.tag] -= size_t(header.size);
+  g_total -= size_t(header.size);
+#ifdef GLMLV_HEAP_STACKS
+  if (header.site) {
+    releaseSample(header.site, size_t(header.size));
+  }
+#endif
+  std::free(memory);
+}
+
+#if defined(GLMLV_HEAP_STACKS) && !defined(_WIN32)
+
+// "module(mangled+0x1f) [0x...]" from backtrace_symbols to the demangled
+// name, or the whole string if it has no name
+std::string frameName(const char *symbol)
+{
+  const char *begin = std::strchr(symbol, '(');
+  const char *end = begin ? std::strpbrk(begin, "+)") : nullptr;
+  if (!begin || !end || end == begin + 1) {
+    return symbol;
+  }
+  const std::string mangled(begin + 1, end);
+  int status = 0;
+  char *demangled =
+      abi::__cxa_demangle(mangled.c_str(), nullptr, nullptr, &status);
+  if (status != 0 || !demangled) {
+    return mangled;
+  }
+  std::string name = demangled;
+  std::free(demangled);
+  return name;
+}
+
+#endif
+
+#ifdef GLMLV_HEAP_STACKS
+
+std::vector<std::string> frameNames(void *const *frames, int depth)
+{
+  std::vector<std::string> names;
+  names.reserve(size_t(depth));
+#ifdef _WIN32
+  // Symbols need dbghelp, left to the debugger
+  for (int i = 0; i < depth; ++i) {
+    char address[32];
+    std::snprintf(address, sizeof(address), "%p", frames[i]);
+    names.emplace_back(address);
+  }
+#else
+  // Names of the functions of the executable need it to be linked with
+  // -rdynamic, addresses are printed otherwise
+  char **symbols = backtrace_symbols(frames, depth);
+  for (int i = 0; i < depth; ++i) {
+    if (symbols) {
+      names.emplace_back(frameName(symbols[i]));
+    } else {
+      char address[32];
+      std::snprintf(address, sizeof(address), "%p", frames[i]);
+      names.emplace_back(address);
+    }
+  }
+  std::free(symbols);
+#endif
+  return names;
+}
+
+#endif
+
+} // namespace
+
+void *operator new(size_t size)
+{
+  if (auto *pointer = countedAllocation(size, t_heapTag)) {
+    return pointer;
+  }
+  throw std::bad_alloc();
+}
+
+void *operator new[](size_t size)
+{
+  if (auto *pointer = countedAllocation(size, t_heapTag)) {
+    return pointer;
+  }
+  throw std::bad_alloc();
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+  return countedAllocation(size, t_heapTag);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+  return countedAllocation(size, t_heapTag);
+}
+
+void operator delete(void *pointer) noexcept { countedFree(pointer); }
+void operator delete[](void *pointer) noexcept { countedFree(pointer); }
+void operator delete(void *pointer, size_t) noexcept { countedFree(pointer); }
+void operator delete[](void *pointer, size_t) noexcept
+{
+  countedFree(pointer);
+}
+void operator delete(void *pointer, const std::nothrow_t &) noexcept
+{
+  countedFree(pointer);
+}
+void operator delete[](void *pointer, const std::nothrow_t &) noexcept
+{
+  countedFree(pointer);
+}
+
+size_t heapAllocationCount() { return g_heapAllocations.load(); }
+bool heapAllocationsCounted() { return true; }
+
+HeapUsage heapUsage()
+{
+  HeapUsage usage;
+  for (size_t i = 0; i < TAG_COUNT; ++i) {
+    usage.bytes[i] = g_bytes[i].load(std::memory_order_relaxed);
+    usage.peakBytes[i] = g_peakBytes[i].load(std::memory_order_relaxed);
+  }
+  usage.total = g_total.load(std::memory_order_relaxed);
+  usage.peakTotal = g_peakTotal.load(std::memory_order_relaxed);
+  usage.allocationCount = g_liveAllocations.load(std::memory_order_relaxed);
+  return usage;
+}
+
+void *heapAllocate(size_t size, HeapTag tag)
+{
+  return countedAllocation(size, tag);
+}
+
+void heapFree(void *pointer) { countedFree(pointer); }
+
+bool setHeapSampling(size_t intervalBytes)
+{
+#ifdef GLMLV_HEAP_STACKS
+#ifndef _WIN32
+  // The first backtrace loads libgcc, which allocates
+  void *frame = nullptr;
+  t_inSampler = true;
+  backtrace(&frame, 1);
+  t_inSampler = false;
+#endif
+  g_samplingInterval = intervalBytes;
+  t_sampleCountdown = int64_t(intervalBytes);
+  return true;
+#else
+  return intervalBytes == 0;
+#endif
+}
+
+size_t heapSamplingInterval() { return g_samplingInterval; }
+
+std::vector<HeapSite> heapSites(size_t maxCount)
+{
+  std::vector<HeapSite> sites;
+#ifdef GLMLV_HEAP_STACKS
+  // Copied under the lock into memory reserved before, neither sampled
+  std::vector<Site> live;
+  t_inSampler = true;
+  live.reserve(SITE_CAPACITY);
+  {
+    std::lock_guard<std::mutex> lock(g_sitesMutex);
+    for (const auto &entry : g_sites) {
+      if (entry.hash && entry.sampleCount) {
+        live.push_back(entry);
+      }
+    }
+  }
+  t_inSampler = false;
+
+  const auto count = std::min(maxCount, live.size());
+  std::partial_sort(live.begin(), live.begin() + count, live.end(),
+      [](const Site &a, const Site &b) { return a.bytes > b.bytes; });
+  for (size_t i = 0; i < count; ++i) {
+    HeapSite site;
+    site.tag = live[i].tag;
+    site.bytes = live[i].bytes;
+    site.sampleCount = live[i].sampleCount;
+    site.frames = frameNames(live[i].frames, live[i].depth);
+    sites.emplace_back(std::move(site));
+  }
+#else
+  (void)maxCount;
+#endif
+  return sites;
+}
+
+#else
+
+size_t heapAllocationCount() { return 0; }
+bool heapAllocationsCounted() { return false; }
+
+HeapUsage heapUsage() { return HeapUsage(); }
+
+void *heapAllocate(size_t size, HeapTag) { return std::malloc(size); }
+void heapFree(void *pointer) { std::free(pointer); }
+
+bool setHeapSampling(size_t intervalBytes) { return intervalBytes == 0; }
+size_t heapSamplingInterval() { return 0; }
+
+std::vector<HeapSite> heapSites(size_t) { return {}; }
+
+#endif
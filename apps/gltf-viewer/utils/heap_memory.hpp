@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Subsystems the host heap is accounted to, by the tag of the thread when the
+// memory is allocated, see HeapTagScope. Memory moved between subsystems,
+// like the images of a model once decoded, stays with the tag it was
+// allocated under.
+enum class HeapTag
+{
+  Other, // Allocations under no scope
+  Model, // tinygltf models and their buffers
+  Images, // Decoded images and the mip chains of the texture streamer
+  Geometry, // Packed geometry, built or read from the geometry cache
+  Staging, // Client copies of uploads and readbacks, rendered images
+  Caches, // Program binaries, render results and cache files
+  Gui, // ImGui
+  Count
+};
+
+const char *heapTagName(HeapTag tag);
+
+// Tag of the allocations of the calling thread while the scope lives. Scopes
+// nest, the innermost tag applies.
+class HeapTagScope
+{
+public:
+  explicit HeapTagScope(HeapTag tag);
+  ~HeapTagScope();
+
+  HeapTagScope(const HeapTagScope &) = delete;
+  HeapTagScope &operator=(const HeapTagScope &) = delete;
+
+private:
+  HeapTag m_previous;
+};
+
+// Live bytes of the global operator new by tag, and their peaks since the
+// start of the process, if heapAllocationsCounted(). 0s otherwise.
+struct HeapUsage
+{
+  size_t bytes[size_t(HeapTag::Count)] = {};
+  size_t peakBytes[size_t(HeapTag::Count)] = {};
+  size_t total = 0;
+  size_t peakTotal = 0;
+  size_t allocationCount = 0; // Live
+};
+
+HeapUsage heapUsage();
+
+// Calls of the global operator new since the start of the process, by any
+// thread, if compiled with GLMLV_COUNT_ALLOCATIONS, which the CMake option of
+// the same name and debug builds define. 0 otherwise.
+size_t heapAllocationCount();
+bool heapAllocationsCounted();
+
+// Memory of tag whatever the scope of the thread, for the allocator hooks of
+// libraries, ImGui's. Plain malloc and free when allocations are not
+// counted.
+void *heapAllocate(size_t size, HeapTag tag);
+void heapFree(void *pointer);
+
+// Allocation site sampling: a call stack is recorded about once every
+// intervalBytes allocated by a thread, each standing for intervalBytes of the
+// live memory of its site, or for its size if larger. Set once, before the
+// allocations to sample, 0 disables it. Only with heapAllocationsCounted(),
+// on platforms that capture call stacks: glibc and Windows.
+bool setHeapSampling(size_t intervalBytes);
+size_t heapSamplingInterval();
+
+// A call stack of sampled allocations, innermost frame first, the allocator
+// left out. Frames are symbolized where the platform can, addresses
+// otherwise.
+struct HeapSite
+{
+  HeapTag tag = HeapTag::Other; // Of its first sample
+  size_t bytes = 0; // Estimated live bytes
+  size_t sampleCount = 0; // Live
+  std::vector<std::string> frames;
+};
+
+// The maxCount sites with the most live bytes, most first
+std::vector<HeapSite> heapSites(size_t maxCount);
@@ -0,0 +1,371 @@
+#include "http_reader.hpp"
+
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef GLMLV_USE_CURL
+#include <curl/curl.h>
+#endif
+
+bool isRemoteUrl(const std::string &path)
+{
+  return path.compare(0, 7, "http://") == 0 ||
+         path.compare(0, 8, "https://") == 0;
+}
+
+#ifdef GLMLV_USE_CURL
+
+namespace
+{
+
+// Ranges requested at once, as many connections as browsers open to a host
+// over HTTP/1.1; over HTTP/2 they share one
+const size_t HTTP_CONNECTIONS = 6;
+
+// Where the body of a response goes
+struct Transfer
+{
+  unsigned char *bytes = nullptr; // At most size of them
+  size_t size = 0;
+  size_t written = 0;
+  size_t range = 0; // Index in the ranges of start()
+  // The head read by open(), of unknown size
+  std::vector<unsigned char> *head = nullptr;
+  size_t fileSize = 0; // From Content-Range
+};
+
+void initCurl()
+{
+  static std::once_flag once;
+  std::call_once(once, []() { curl_global_init(CURL_GLOBAL_DEFAULT); });
+}
+
+size_t writeBody(char *data, size_t size, size_t count, void *userData)
+{
+  auto &transfer = *static_cast<Transfer *>(userData);
+  const auto byteCount = size * count;
+  if (transfer.head) {
+    transfer.head->insert(transfer.head->end(), data, data + byteCount);
+    return byteCount;
+  }
+  // More than the range, the server sends something else: abort
+  if (byteCount > transfer.size - transfer.written) {
+    return 0;
+  }
+  std::memcpy(transfer.bytes + transfer.written, data, byteCount);
+  transfer.written += byteCount;
+  return byteCount;
+}
+
+// Content-Range: bytes <first>-<last>/<size>
+size_t readHeader(char *data, size_t size, size_t count, void *userData)
+{
+  auto &transfer = *static_cast<Transfer *>(userData);
+  const auto byteCount = size * count;
+  const std::string line(data, byteCount);
+  const std::string name = "content-range:";
+  if (line.size() > name.size() &&
+      std::equal(name.begin(), name.end(), line.begin(), [](char a, char b) {
+        return a == std::tolower(static_cast<unsigned char>(b));
+      })) {
+    const auto slash = line.find('/');
+    if (slash != std::string::npos) {
+      transfer.fileSize =
+          size_t(std::strtoull(line.c_str() + slash + 1, nullptr, 10));
+    }
+  }
+  return byteCount;
+}
+
+CURL *createTransfer(const std::string &url, const HttpRange &range,
+    Transfer &transfer)
+{
+  auto *curl = curl_easy_init();
+  if (!curl) {
+    return nullptr;
+  }
+  const auto rangeText = std::to_string(range.offset) + "-" +
+                         std::to_string(range.offset + range.size - 1);
+  curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+  curl_easy_setopt(curl, CURLOPT_RANGE, rangeText.c_str());
+  curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+  curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+  curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+  // Wait for a HTTP/2 connection to be shared rather than open another
+  curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &writeBody);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &transfer);
+  curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, &readHeader);
+  curl_easy_setopt(curl, CURLOPT_HEADERDATA, &transfer);
+  curl_easy_setopt(curl, CURLOPT_PRIVATE, &transfer);
+  return curl;
+}
+
+// Empty if the range arrived whole
+std::string transferError(const std::string &url, const HttpRange &range,
+    CURL *curl, CURLcode result, const Transfer &transfer)
+{
+  long status = 0;
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+  std::string error;
+  if (result != CURLE_OK) {
+    error = curl_easy_strerror(result);
+  } else if (status != 206 || transfer.written != range.size) {
+    error = "the server does not answer range requests";
+  } else {
+    return {};
+  }
+  return "Unable to download bytes " + std::to_string(range.offset) + "-" +
+         std::to_string(range.offset + range.size - 1) + " of " + url +
+         " (HTTP " + std::to_string(status) + "): " + error;
+}
+
+} // namespace
+
+bool HttpReader::open(const std::string &url, size_t headSize,
+    std::vector<unsigned char> &bytes, std::string &err)
+{
+  TRACE_ZONE("HttpReader::open");
+  initCurl();
+  cancel();
+  m_url = url;
+  m_ranges.clear();
+  m_states.clear();
+  m_finished = 0;
+  m_error.clear();
+
+  std::vector<unsigned char> head;
+  Transfer transfer;
+  transfer.head = &head;
+  auto *curl =
+      createTransfer(url, {0, std::max(headSize, size_t(1))}, transfer);
+  if (!curl) {
+    err = "Unable to download " + url;
+    return false;
+  }
+  const auto result = curl_easy_perform(curl);
+  long status = 0;
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+  curl_easy_cleanup(curl);
+  if (result != CURLE_OK) {
+    err = "Unable to download " + url + " (HTTP " + std::to_string(status) +
+          "): " + curl_easy_strerror(result);
+    return false;
+  }
+
+  if (status == 206) {
+    if (transfer.fileSize < head.size()) {
+      err = "Unable to download " + url + ": unknown size";
+      return false;
+    }
+    bytes.assign(transfer.fileSize, 0);
+    std::copy(head.begin(), head.end(), bytes.begin());
+    m_complete = head.size() == transfer.fileSize;
+    m_head = head.size();
+  } else {
+    // The whole file
+    bytes = std::move(head);
+    m_complete = true;
+    m_head = bytes.size();
+  }
+  m_bytes = bytes.data();
+  m_size = bytes.size();
+  return true;
+}
+
+bool HttpReader::read(const HttpRange &range, std::string &err)
+{
+  if (m_complete || !range.size) {
+    return true;
+  }
+  TRACE_ZONE("HttpReader::read");
+  if (range.offset > m_size || range.size > m_size - range.offset) {
+    err = "Unable to download " + m_url + ": range out of the file";
+    return false;
+  }
+  Transfer transfer;
+  transfer.bytes = m_bytes + range.offset;
+  transfer.size = range.size;
+  auto *curl = createTransfer(m_url, range, transfer);
+  if (!curl) {
+    err = "Unable to download " + m_url;
+    return false;
+  }
+  const auto result = curl_easy_perform(curl);
+  err = transferError(m_url, range, curl, result, transfer);
+  curl_easy_cleanup(curl);
+  if (!err.empty()) {
+    return false;
+  }
+  if (range.offset <= m_head) {
+    m_head = std::max(m_head, range.offset + range.size);
+  }
+  return true;
+}
+
+void HttpReader::download()
+{
+  TRACE_ZONE("HttpReader::download");
+  auto *multi = curl_multi_init();
+  std::vector<Transfer> transfers(m_ranges.size());
+  std::vector<CURL *> active;
+  size_t next = 0;
+  while (!m_cancel) {
+    while (active.size() < HTTP_CONNECTIONS && next < m_ranges.size()) {
+      const auto &range = m_ranges[next];
+      auto &transfer = transfers[next];
+      transfer.bytes = m_bytes + range.offset;
+      transfer.size = range.size;
+      transfer.range = next;
+      auto *curl = createTransfer(m_url, range, transfer);
+      if (!curl) {
+        finish(next++, "Unable to download " + m_url);
+        continue;
+      }
+      curl_multi_add_handle(multi, curl);
+      active.push_back(curl);
+      ++next;
+    }
+    if (active.empty()) {
+      break;
+    }
+
+    int running;
+    curl_multi_perform(multi, &running);
+    int queued;
+    while (auto *message = curl_multi_info_read(multi, &queued)) {
+      if (message->msg != CURLMSG_DONE) {
+        continue;
+      }
+      auto *curl = message->easy_handle;
+      char *privateData;
+      curl_easy_getinfo(curl, CURLINFO_PRIVATE, &privateData);
+      const auto &transfer = *reinterpret_cast<Transfer *>(privateData);
+      const auto error = transferError(m_url, m_ranges[transfer.range], curl,
+          message->data.result, transfer);
+      curl_multi_remove_handle(multi, curl);
+      curl_easy_cleanup(curl);
+      active.erase(std::find(active.begin(), active.end(), curl));
+      finish(transfer.range, error);
+    }
+    curl_multi_poll(multi, nullptr, 0, 100, nullptr);
+  }
+
+  for (auto *curl : active) {
+    curl_multi_remove_handle(multi, curl);
+    curl_easy_cleanup(curl);
+  }
+  curl_multi_cleanup(multi);
+
+  // Cancelled: nothing waits on the ranges left
+  for (size_t i = 0; i < m_ranges.size(); ++i) {
+    if (m_states[i] == Pending) {
+      finish(i, "Download of " + m_url + " cancelled");
+    }
+  }
+}
+
+#else
+
+bool HttpReader::open(const std::string &url, size_t,
+    std::vector<unsigned char> &, std::string &err)
+{
+  err = "Unable to download " + url +
+        ": built without libcurl, see the GLMLV_USE_CURL CMake option";
+  return false;
+}
+
+bool HttpReader::read(const HttpRange &, std::string &err)
+{
+  err = "Unable to download " + m_url;
+  return false;
+}
+
+void HttpReader::download()
+{
+  for (size_t i = 0; i < m_ranges.size(); ++i) {
+    finish(i, "Unable to download " + m_url);
+  }
+}
+
+#endif
+
+void HttpReader::start(std::vector<HttpRange> ranges)
+{
+  cancel();
+  m_ranges.clear();
+  if (m_complete) {
+    return;
+  }
+  for (auto range : ranges) {
+    if (range.offset < m_head) {
+      const auto skipped = std::min(m_head - range.offset, range.size);
+      range.offset += skipped;
+      range.size -= skipped;
+    }
+    if (range.size) {
+      m_ranges.push_back(range);
+    }
+  }
+  if (m_ranges.empty()) {
+    return;
+  }
+  m_states.assign(m_ranges.size(), Pending);
+  m_finished = 0;
+  m_error.clear();
+  m_thread = std::thread([this]() {
+    setTraceThreadName("HTTP download");
+    download();
+  });
+}
+
+void HttpReader::finish(size_t range, const std::string &err)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_states[range] = err.empty() ? Done : Failed;
+  if (!err.empty() && m_error.empty()) {
+    m_error = err;
+  }
+  ++m_finished;
+  m_finishedCondition.notify_all();
+}
+
+bool HttpReader::wait(const unsigned char *data, size_t size)
+{
+  const auto begin = size_t(data - m_bytes);
+  const auto end = begin + size;
+  std::unique_lock<std::mutex> lock(m_mutex);
+  for (size_t i = 0; i < m_ranges.size(); ++i) {
+    const auto &range = m_ranges[i];
+    if (range.offset >= end || range.offset + range.size <= begin) {
+      continue;
+    }
+    m_finishedCondition.wait(lock, [&]() { return m_states[i] != Pending; });
+    if (m_states[i] == Failed) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool HttpReader::waitAll()
+{
+  TRACE_ZONE("HttpReader::waitAll");
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_finishedCondition.wait(
+      lock, [&]() { return m_finished == m_ranges.size(); });
+  return m_error.empty();
+}
+
+void HttpReader::cancel()
+{
+  if (m_thread.joinable()) {
+    m_cancel = true;
+    m_thread.join();
+    m_cancel = false;
+  }
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// True for the http:// and https:// URLs read by HttpReader instead of files
+bool isRemoteUrl(const std::string &path);
+
+// Bytes of a remote file, from offset
+struct HttpRange
+{
+  size_t offset;
+  size_t size;
+};
+
+// A remote file downloaded with HTTP range requests (RFC 9110, section 14):
+// its head is read first, then the ranges given to start() are requested on a
+// thread of the reader, HTTP_CONNECTIONS at a time in the order given, so that
+// the bytes needed first arrive first. wait() blocks until some bytes have
+// arrived, letting them be used while the others download. Servers ignoring
+// ranges send the whole file at once, start() then has nothing to do.
+//
+// Needs libcurl, built in with the GLMLV_USE_CURL CMake option; otherwise
+// open() fails.
+class HttpReader
+{
+public:
+  HttpReader() = default;
+  HttpReader(const HttpReader &) = delete;
+  HttpReader &operator=(const HttpReader &) = delete;
+  ~HttpReader() { cancel(); }
+
+  // Read the first headSize bytes of url. bytes is sized to the whole file,
+  // whose other bytes are written by read() and start(); it must not be
+  // resized while the reader is in use.
+  bool open(const std::string &url, size_t headSize,
+      std::vector<unsigned char> &bytes, std::string &err);
+
+  // Base of the bytes given to open(), ranges are offsets from it
+  const unsigned char *data() const { return m_bytes; }
+  size_t size() const { return m_size; }
+  // True once open() got the whole file
+  bool complete() const { return m_complete; }
+
+  // Download a range now, on the calling thread
+  bool read(const HttpRange &range, std::string &err);
+
+  // Download ranges on the thread of the reader, in order. Bytes read by
+  // open() and read() from the start of the file are not downloaded again.
+  void start(std::vector<HttpRange> ranges);
+
+  // Block until the ranges of start() covering [data, data + size) have
+  // arrived, false if one of them failed, see error()
+  bool wait(const unsigned char *data, size_t size);
+  bool waitAll();
+  // Of the first range that failed
+  const std::string &error() const { return m_error; }
+
+  // Stop the downloads, the bytes are not written to once it returns
+  void cancel();
+
+private:
+  enum State : char
+  {
+    Pending,
+    Done,
+    Failed
+  };
+
+  void download();
+  void finish(size_t range, const std::string &err);
+
+  std::string m_url;
+  unsigned char *m_bytes = nullptr;
+  size_t m_size = 0;
+  bool m_complete = false; // The whole file came with open()
+  size_t m_head = 0; // Bytes read from the start of the file
+
+  std::vector<HttpRange> m_ranges;
+  std::vector<State> m_states; // Of m_ranges
+  size_t m_finished = 0;
+  std::string m_error; // Of the first failed range
+  std::mutex m_mutex;
+  std::condition_variable m_finishedCondition;
+  std::atomic<bool> m_cancel{false};
+  std::thread m_thread;
+};
@@ -0,0 +1,291 @@
+#include "ibl_cache.hpp"
+
+#include "bc6h.hpp"
+#include "heap_memory.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+const char IBL_CACHE_MAGIC[8] = {'G', 'V', 'I', 'B', 'L', 0, 0, 3};
+
+const size_t RGB16F_PIXEL_SIZE = 6;
+const size_t RG16F_PIXEL_SIZE = 4;
+
+// Header of a cache file: magic, then the key. Pixels follow, in this order:
+// environment faces, irradiance faces, prefilter levels (faces of each level)
+// and BRDF LUT, as GL_HALF_FLOAT or, for the compressed maps, BC6H blocks.
+std::string serializeKey(const IblCacheKey &key)
+{
+  std::string header(IBL_CACHE_MAGIC, sizeof(IBL_CACHE_MAGIC));
+  const auto append = [&](const auto &value) {
+    header.append(reinterpret_cast<const char *>(&value), sizeof(value));
+  };
+  append(key.hdrSize);
+  append(key.hdrWriteTime);
+  append(key.skyboxSize);
+  append(key.irradianceMapSize);
+  append(key.prefilterMapSize);
+  append(key.prefilterMapLevels);
+  append(key.brdfLutSize);
+  append(uint8_t(key.fastBake));
+  append(uint8_t(key.compressed));
+  append(uint32_t(key.hdrPath.size()));
+  header += key.hdrPath;
+  return header;
+}
+
+size_t levelSize(uint32_t size, uint32_t level)
+{
+  return std::max(size >> level, 1u);
+}
+
+// True if the maps of faces of size texels of the cache of key are BC6H
+bool compressedMap(const IblCacheKey &key, uint32_t size)
+{
+  return key.compressed && bc6hCompressible(size);
+}
+
+size_t faceSize(bool compressed, size_t size)
+{
+  return compressed ? bc6hLevelSize(uint32_t(size))
+                    : size * size * RGB16F_PIXEL_SIZE;
+}
+
+size_t payloadSize(const IblCacheKey &key)
+{
+  const auto cubeSize = [&](uint32_t mapSize, size_t size) {
+    return 6 * faceSize(compressedMap(key, mapSize), size);
+  };
+  size_t total = cubeSize(key.skyboxSize, key.skyboxSize) +
+                 cubeSize(key.irradianceMapSize, key.irradianceMapSize);
+  for (uint32_t level = 0; level < key.prefilterMapLevels; ++level) {
+    total += cubeSize(
+        key.prefilterMapSize, levelSize(key.prefilterMapSize, level));
+  }
+  return total + size_t(key.brdfLutSize) * key.brdfLutSize * RG16F_PIXEL_SIZE;
+}
+
+void setCubeMapParameters(GLint levelCount)
+{
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER,
+      levelCount > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+}
+
+GLuint createCubeMap(uint32_t size, uint32_t levelCount, bool compressed,
+    const unsigned char *&pixels)
+{
+  GLuint texture;
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+
+  for (uint32_t level = 0; level < levelCount; ++level) {
+    const auto texels = levelSize(size, level);
+    const auto bytes = faceSize(compressed, texels);
+    for (GLuint i = 0; i < 6; ++i) {
+      if (compressed) {
+        glCompressedTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
+            GLint(level), GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT,
+            GLsizei(texels), GLsizei(texels), 0, GLsizei(bytes), pixels);
+      } else {
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, GLint(level),
+            GL_RGB16F, GLsizei(texels), GLsizei(texels), 0, GL_RGB,
+            GL_HALF_FLOAT, pixels);
+      }
+      pixels += bytes;
+    }
+  }
+
+  setCubeMapParameters(GLint(levelCount));
+
+  return texture;
+}
+
+void readCubeMap(GLuint texture, uint32_t size, uint32_t levelCount,
+    bool compressed, unsigned char *&pixels)
+{
+  glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+
+  for (uint32_t level = 0; level < levelCount; ++level) {
+    const auto texels = levelSize(size, level);
+    for (GLuint i = 0; i < 6; ++i) {
+      if (compressed) {
+        glGetCompressedTexImage(
+            GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, GLint(level), pixels);
+      } else {
+        glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, GLint(level),
+            GL_RGB, GL_HALF_FLOAT, pixels);
+      }
+      pixels += faceSize(compressed, texels);
+    }
+  }
+}
+
+} // namespace
+
+bool validIblOptions(const IblOptions &options, std::string &err)
+{
+  const auto maxSize = 1u << 14;
+  if (!options.skyboxSize || !options.irradianceMapSize ||
+      !options.prefilterMapSize || !options.brdfLutSize ||
+      options.skyboxSize > maxSize || options.irradianceMapSize > maxSize ||
+      options.prefilterMapSize > maxSize || options.brdfLutSize > maxSize) {
+    err = "IBL sizes must be between 1 and " + std::to_string(maxSize);
+    return false;
+  }
+  uint32_t maxLevels = 1;
+  while (options.prefilterMapSize >> maxLevels) {
+    ++maxLevels;
+  }
+  if (options.prefilterMapLevels < 2 ||
+      options.prefilterMapLevels > maxLevels) {
+    err = "Prefilter levels must be between 2 and " +
+          std::to_string(maxLevels) + " for a size of " +
+          std::to_string(options.prefilterMapSize);
+    return false;
+  }
+  return true;
+}
+
+bool initIblCacheKey(
+    const fs::path &hdrPath, const IblOptions &options, IblCacheKey &key)
+{
+  key.skyboxSize = options.skyboxSize;
+  key.irradianceMapSize = options.irradianceMapSize;
+  key.prefilterMapSize = options.prefilterMapSize;
+  key.prefilterMapLevels = options.prefilterMapLevels;
+  key.brdfLutSize = options.brdfLutSize;
+  key.fastBake = options.fastBake;
+  key.compressed = options.compressed;
+  if (!fs::exists(hdrPath)) {
+    return false;
+  }
+
+  key.hdrPath = fs::absolute(hdrPath).string();
+  key.hdrSize = uint64_t(fs::file_size(hdrPath));
+#ifdef GLMLV_USE_BOOST_FILESYSTEM
+  key.hdrWriteTime = int64_t(fs::last_write_time(hdrPath));
+#else
+  key.hdrWriteTime =
+      int64_t(fs::last_write_time(hdrPath).time_since_epoch().count());
+#endif
+  return true;
+}
+
+fs::path iblCacheFile(const fs::path &cacheDirectory, const IblCacheKey &key)
+{
+  // The key is also stored in the file, a hash collision only causes a rebake
+  std::stringstream name;
+  name << fs::path(key.hdrPath).stem().string() << '-' << std::hex
+       << std::hash<std::string>()(serializeKey(key)) << ".ibl";
+  return cacheDirectory / name.str();
+}
+
+bool loadIblCache(
+    const fs::path &file, const IblCacheKey &key, IblTextures &textures)
+{
+  TRACE_ZONE("loadIblCache");
+  HeapTagScope heapTag(HeapTag::Caches);
+  std::ifstream input(file.string(), std::ios::binary);
+  if (!input) {
+    return false;
+  }
+
+  const auto expectedHeader = serializeKey(key);
+  std::string header(expectedHeader.size(), '\0');
+  if (!input.read(&header[0], header.size()) || header != expectedHeader) {
+    return false;
+  }
+
+  std::vector<unsigned char> payload(payloadSize(key));
+  if (!input.read(reinterpret_cast<char *>(payload.data()), payload.size())) {
+    return false;
+  }
+
+  const unsigned char *pixels = payload.data();
+  textures.environment = createCubeMap(
+      key.skyboxSize, 1, compressedMap(key, key.skyboxSize), pixels);
+  textures.irradiance = createCubeMap(key.irradianceMapSize, 1,
+      compressedMap(key, key.irradianceMapSize), pixels);
+  textures.prefilter = createCubeMap(key.prefilterMapSize,
+      key.prefilterMapLevels, compressedMap(key, key.prefilterMapSize),
+      pixels);
+
+  glGenTextures(1, &textures.brdfLut);
+  glBindTexture(GL_TEXTURE_2D, textures.brdfLut);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, GLsizei(key.brdfLutSize),
+      GLsizei(key.brdfLutSize), 0, GL_RG, GL_HALF_FLOAT, pixels);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+  glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  return true;
+}
+
+bool saveIblCache(
+    const fs::path &file, const IblCacheKey &key, const IblTextures &textures)
+{
+  HeapTagScope heapTag(HeapTag::Caches);
+  std::vector<unsigned char> payload(payloadSize(key));
+  unsigned char *pixels = payload.data();
+  readCubeMap(textures.environment, key.skyboxSize, 1,
+      compressedMap(key, key.skyboxSize), pixels);
+  readCubeMap(textures.irradiance, key.irradianceMapSize, 1,
+      compressedMap(key, key.irradianceMapSize), pixels);
+  readCubeMap(textures.prefilter, key.prefilterMapSize,
+      key.prefilterMapLevels, compressedMap(key, key.prefilterMapSize),
+      pixels);
+
+  glBindTexture(GL_TEXTURE_2D, textures.brdfLut);
+  glGetTexImage(GL_TEXTURE_2D, 0, GL_RG, GL_HALF_FLOAT, pixels);
+
+  glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  // Unique per process and thread so that concurrent bakes do not write the same file
+  auto tmpFile = file;
+  tmpFile += "." +
+             std::to_string(
+                 std::chrono::steady_clock::now().time_since_epoch().count()) +
+             "." +
+             std::to_string(
+                 std::hash<std::thread::id>()(std::this_thread::get_id())) +
+             ".tmp";
+
+  try {
+    fs::create_directories(file.parent_path());
+    {
+      std::ofstream output(tmpFile.string(), std::ios::binary);
+      const auto header = serializeKey(key);
+      if (!output.write(header.data(), header.size()) ||
+          !output.write(reinterpret_cast<const char *>(payload.data()),
+              payload.size())) {
+        output.close();
+        fs::remove(tmpFile);
+        return false;
+      }
+    }
+    fs::rename(tmpFile, file);
+  } catch (const fs::filesystem_error &) {
+    return false;
+  }
+
+  return true;
+}
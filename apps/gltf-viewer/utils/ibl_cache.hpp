@@ -0,0 +1,89 @@
+#pragma once
+
+#include "filesystem.hpp"
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <string>
+
+// How the image based lighting textures are baked. Smaller sizes bake in a
+// fraction of the time, for thumbnails or low end GPUs.
+struct IblOptions
+{
+  uint32_t skyboxSize = 512; // Faces of the environment cube map
+  uint32_t irradianceMapSize = 32;
+  uint32_t prefilterMapSize = 128;
+  // From roughness 0 to 1, at least 2 and at most log2(prefilterMapSize) + 1
+  uint32_t prefilterMapLevels = 5;
+  // The LUT baked at build time is only used at its size, others are
+  // integrated when the environment is baked
+  uint32_t brdfLutSize = 512;
+  // Fewer samples per texel of the irradiance and prefiltered maps, filtered
+  // from coarser levels of the environment. About ten times faster with some
+  // blur, for switching environments interactively.
+  bool fastBake = false;
+  // Environment, irradiance and prefiltered maps compressed to BC6H once
+  // baked, a quarter of the memory and of the bandwidth of their fetches, see
+  // bc6h.hpp. Maps whose size is not a multiple of 4 stay uncompressed.
+  bool compressed = false;
+
+  bool operator==(const IblOptions &other) const
+  {
+    return skyboxSize == other.skyboxSize &&
+           irradianceMapSize == other.irradianceMapSize &&
+           prefilterMapSize == other.prefilterMapSize &&
+           prefilterMapLevels == other.prefilterMapLevels &&
+           brdfLutSize == other.brdfLutSize && fastBake == other.fastBake &&
+           compressed == other.compressed;
+  }
+  bool operator!=(const IblOptions &other) const { return !(*this == other); }
+};
+
+// Check the sizes of options, return false with err set if one is invalid
+bool validIblOptions(const IblOptions &options, std::string &err);
+
+// Parameters the image based lighting textures depend on. A cache file is only
+// used if all of them match.
+struct IblCacheKey
+{
+  std::string hdrPath; // Absolute path of the equirectangular HDR image
+  uint64_t hdrSize = 0;
+  int64_t hdrWriteTime = 0;
+  uint32_t skyboxSize = 0;
+  uint32_t irradianceMapSize = 0;
+  uint32_t prefilterMapSize = 0;
+  uint32_t prefilterMapLevels = 0;
+  uint32_t brdfLutSize = 0;
+  bool fastBake = false;
+  bool compressed = false;
+};
+
+// Textures produced by the image based lighting bake
+struct IblTextures
+{
+  // RGB16F cube maps, or BC6H if compressed and of a size multiple of 4
+  GLuint environment = 0; // One level
+  GLuint irradiance = 0; // One level
+  GLuint prefilter = 0; // prefilterMapLevels levels
+  GLuint brdfLut = 0; // RG16F 2D texture
+};
+
+// Fill the key from the file system and the options. Return false if the HDR
+// file does not exist.
+bool initIblCacheKey(
+    const fs::path &hdrPath, const IblOptions &options, IblCacheKey &key);
+
+// Path of the cache file of an environment in cacheDirectory
+fs::path iblCacheFile(const fs::path &cacheDirectory, const IblCacheKey &key);
+
+// Create the textures from a cache file written by saveIblCache with the same
+// key. Return false, without creating any texture, if there is no such file.
+bool loadIblCache(
+    const fs::path &file, const IblCacheKey &key, IblTextures &textures);
+
+// Read the textures back from the GPU and write them to the cache file. The
+// file is written next to its final path then renamed, so that concurrent
+// processes never read a partial file.
+bool saveIblCache(
+    const fs::path &file, const IblCacheKey &key, const IblTextures &textures);
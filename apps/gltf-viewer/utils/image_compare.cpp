@@ -0,0 +1,349 @@
+#include "image_compare.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include <stb_image.h>
+
+namespace
+{
+
+using StbiPixels = std::unique_ptr<stbi_uc, decltype(&stbi_image_free)>;
+
+StbiPixels loadRgb(
+    const fs::path &path, int &width, int &height, std::string &err)
+{
+  int components = 0;
+  StbiPixels pixels{
+      stbi_load(path.string().c_str(), &width, &height, &components, 3),
+      &stbi_image_free};
+  if (!pixels) {
+    err = "Unable to read " + path.string() + ": " + stbi_failure_reason();
+  }
+  return pixels;
+}
+
+// LDR FLIP (Andersson et al., FLIP: A Difference Evaluator for Alternating
+// Images, 2020) for a 0.7 m wide 3840 pixels monitor seen from 0.7 m
+const float FLIP_PIXELS_PER_DEGREE = 67.0206f;
+const float FLIP_QC = 0.7f;
+const float FLIP_QF = 0.5f;
+const float FLIP_PC = 0.4f;
+const float FLIP_PT = 0.95f;
+const glm::vec3 D65_WHITE = glm::vec3(0.950428545f, 1.f, 1.088900371f);
+
+float srgbToLinear(float c)
+{
+  return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+glm::vec3 linearToXyz(const glm::vec3 &rgb)
+{
+  return glm::mat3(0.4124564f, 0.2126729f, 0.0193339f, 0.3575761f,
+             0.7151522f, 0.1191920f, 0.1804375f, 0.0721750f, 0.9503041f) *
+         rgb;
+}
+
+glm::vec3 xyzToLinear(const glm::vec3 &xyz)
+{
+  return glm::mat3(3.2404542f, -0.9692660f, 0.0556434f, -1.5371385f,
+             1.8760108f, -0.2040259f, -0.4985314f, 0.0415560f, 1.0572252f) *
+         xyz;
+}
+
+// Opponent space of the contrast sensitivity filters
+glm::vec3 xyzToYcxcz(const glm::vec3 &xyz)
+{
+  const auto normalized = xyz / D65_WHITE;
+  return glm::vec3(116.f * normalized.y - 16.f,
+      500.f * (normalized.x - normalized.y),
+      200.f * (normalized.y - normalized.z));
+}
+
+glm::vec3 ycxczToXyz(const glm::vec3 &ycxcz)
+{
+  const float y = (ycxcz.x + 16.f) / 116.f;
+  return D65_WHITE * glm::vec3(ycxcz.y / 500.f + y, y, y - ycxcz.z / 200.f);
+}
+
+// CIELAB with the Hunt effect: chroma scaled by lightness
+glm::vec3 xyzToHuntLab(const glm::vec3 &xyz)
+{
+  const float delta = 6.f / 29.f;
+  const auto f = [&](float t) {
+    return t > delta * delta * delta ? std::cbrt(t)
+                                     : t / (3.f * delta * delta) + 4.f / 29.f;
+  };
+  const auto normalized = xyz / D65_WHITE;
+  const float l = 116.f * f(normalized.y) - 16.f;
+  const float a = 500.f * (f(normalized.x) - f(normalized.y));
+  const float b = 200.f * (f(normalized.y) - f(normalized.z));
+  return glm::vec3(l, 0.01f * l * a, 0.01f * l * b);
+}
+
+float hyab(const glm::vec3 &a, const glm::vec3 &b)
+{
+  return std::abs(a.x - b.x) + glm::length(glm::vec2(a.y - b.y, a.z - b.z));
+}
+
+// Convolve each channel of image by its weights of kernel, along rows if
+// horizontal, else along columns, clamped at the edges
+std::vector<glm::vec3> convolve(const std::vector<glm::vec3> &image,
+    int width, int height, const std::vector<glm::vec3> &kernel,
+    bool horizontal)
+{
+  const int radius = int(kernel.size() / 2);
+  std::vector<glm::vec3> result(image.size(), glm::vec3(0));
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      auto &sum = result[size_t(y) * width + x];
+      for (int k = -radius; k <= radius; ++k) {
+        const int sx = horizontal ? std::min(std::max(x + k, 0), width - 1) : x;
+        const int sy =
+            horizontal ? y : std::min(std::max(y + k, 0), height - 1);
+        sum += kernel[k + radius] * image[size_t(sy) * width + sx];
+      }
+    }
+  }
+  return result;
+}
+
+// Separable Gaussian of the contrast sensitivity function
+// a sqrt(pi / b) exp(-pi^2 x^2 / b), x in degrees, normalized
+std::vector<float> csfKernel(float b, int radius)
+{
+  std::vector<float> kernel(2 * radius + 1);
+  float sum = 0.f;
+  for (int i = -radius; i <= radius; ++i) {
+    const float x = float(i) / FLIP_PIXELS_PER_DEGREE;
+    kernel[i + radius] =
+        std::exp(-glm::pi<float>() * glm::pi<float>() * x * x / b);
+    sum += kernel[i + radius];
+  }
+  for (auto &weight : kernel) {
+    weight /= sum;
+  }
+  return kernel;
+}
+
+// Images in the opponent space filtered by the contrast sensitivity
+// functions of the achromatic, red-green and blue-yellow channels. The last
+// one is the sum of two Gaussians, each separable.
+std::vector<glm::vec3> filterCsf(
+    const std::vector<glm::vec3> &image, int width, int height)
+{
+  const float b[4] = {0.0047f, 0.0053f, 0.04f, 0.025f};
+  const float a[4] = {1.f, 1.f, 34.1f, 13.5f};
+  const int radius = int(std::ceil(3.f *
+                                   std::sqrt(0.04f / (2.f * glm::pi<float>() *
+                                                         glm::pi<float>())) *
+                                   FLIP_PIXELS_PER_DEGREE));
+  std::vector<float> kernels[4];
+  float weights[4]; // Sum of the 2D filter of each Gaussian
+  for (int i = 0; i < 4; ++i) {
+    kernels[i] = csfKernel(b[i], radius);
+    float sum = 0.f;
+    for (int k = -radius; k <= radius; ++k) {
+      const float x = float(k) / FLIP_PIXELS_PER_DEGREE;
+      sum += std::exp(-glm::pi<float>() * glm::pi<float>() * x * x / b[i]);
+    }
+    weights[i] = a[i] * std::sqrt(glm::pi<float>() / b[i]) * sum * sum;
+  }
+
+  std::vector<glm::vec3> first(2 * radius + 1);
+  std::vector<glm::vec3> second(2 * radius + 1);
+  for (size_t k = 0; k < first.size(); ++k) {
+    first[k] = glm::vec3(kernels[0][k], kernels[1][k], kernels[2][k]);
+    second[k] = glm::vec3(0.f, 0.f, kernels[3][k]);
+  }
+  auto result = convolve(convolve(image, width, height, first, true), width,
+      height, first, false);
+  const auto blueYellow = convolve(convolve(image, width, height, second,
+                                       true),
+      width, height, second, false);
+  const float firstWeight = weights[2] / (weights[2] + weights[3]);
+  for (size_t i = 0; i < result.size(); ++i) {
+    result[i].z = firstWeight * result[i].z +
+                  (1.f - firstWeight) * blueYellow[i].z;
+  }
+  return result;
+}
+
+// Edges in x, points in x and edges in y, points in y in the x of the
+// second, of the normalized lightness of the opponent image
+void detectFeatures(const std::vector<glm::vec3> &image, int width,
+    int height, std::vector<glm::vec3> &features,
+    std::vector<glm::vec3> &pointsY)
+{
+  const float sigma = 0.5f * 0.082f * FLIP_PIXELS_PER_DEGREE;
+  const int radius = int(std::ceil(3.f * sigma));
+  std::vector<float> gaussian(2 * radius + 1);
+  std::vector<float> edge(gaussian.size());
+  std::vector<float> point(gaussian.size());
+  float gaussianSum = 0.f, edgeSum = 0.f, pointPositive = 0.f,
+        pointNegative = 0.f;
+  for (int i = -radius; i <= radius; ++i) {
+    const float x = float(i);
+    const float g = std::exp(-x * x / (2.f * sigma * sigma));
+    gaussian[i + radius] = g;
+    edge[i + radius] = -x * g;
+    point[i + radius] = (x * x / (sigma * sigma) - 1.f) * g;
+    gaussianSum += g;
+    edgeSum += std::max(edge[i + radius], 0.f);
+    (point[i + radius] > 0.f ? pointPositive : pointNegative) +=
+        point[i + radius];
+  }
+  // Positive weights sum to 1, negative ones to -1
+  for (size_t k = 0; k < gaussian.size(); ++k) {
+    gaussian[k] /= gaussianSum;
+    edge[k] /= edgeSum;
+    point[k] /= point[k] > 0.f ? pointPositive : -pointNegative;
+  }
+
+  std::vector<glm::vec3> lightness(image.size());
+  for (size_t i = 0; i < image.size(); ++i) {
+    lightness[i] = glm::vec3((image[i].x + 16.f) / 116.f);
+  }
+  std::vector<glm::vec3> rows(gaussian.size());
+  std::vector<glm::vec3> columns(gaussian.size());
+  std::vector<glm::vec3> pointColumns(gaussian.size());
+  for (size_t k = 0; k < gaussian.size(); ++k) {
+    rows[k] = glm::vec3(edge[k], point[k], gaussian[k]);
+    columns[k] = glm::vec3(gaussian[k], gaussian[k], edge[k]);
+    pointColumns[k] = glm::vec3(0.f, 0.f, point[k]);
+  }
+  const auto filtered = convolve(lightness, width, height, rows, true);
+  features = convolve(filtered, width, height, columns, false);
+  pointsY = convolve(filtered, width, height, pointColumns, false);
+}
+
+// Mean FLIP error of two sRGB images of the same size
+double flipError(
+    const stbi_uc *reference, const stbi_uc *image, int width, int height)
+{
+  const auto pixelCount = size_t(width) * size_t(height);
+  if (!pixelCount) {
+    return 0.;
+  }
+  const auto toOpponent = [&](const stbi_uc *pixels) {
+    std::vector<glm::vec3> opponent(pixelCount);
+    for (size_t i = 0; i < pixelCount; ++i) {
+      const glm::vec3 rgb(srgbToLinear(pixels[3 * i] / 255.f),
+          srgbToLinear(pixels[3 * i + 1] / 255.f),
+          srgbToLinear(pixels[3 * i + 2] / 255.f));
+      opponent[i] = xyzToYcxcz(linearToXyz(rgb));
+    }
+    return opponent;
+  };
+  const auto referenceOpponent = toOpponent(reference);
+  const auto imageOpponent = toOpponent(image);
+  const auto referenceFiltered =
+      filterCsf(referenceOpponent, width, height);
+  const auto imageFiltered = filterCsf(imageOpponent, width, height);
+  std::vector<glm::vec3> referenceFeatures, referencePoints, imageFeatures,
+      imagePoints;
+  detectFeatures(
+      referenceOpponent, width, height, referenceFeatures, referencePoints);
+  detectFeatures(imageOpponent, width, height, imageFeatures, imagePoints);
+
+  const auto huntLab = [](const glm::vec3 &ycxcz) {
+    return xyzToHuntLab(linearToXyz(
+        glm::clamp(xyzToLinear(ycxczToXyz(ycxcz)), 0.f, 1.f)));
+  };
+  // Largest color difference, of green and blue
+  const float maxColor =
+      std::pow(hyab(xyzToHuntLab(linearToXyz(glm::vec3(0, 1, 0))),
+                   xyzToHuntLab(linearToXyz(glm::vec3(0, 0, 1)))),
+          FLIP_QC);
+
+  double sum = 0.;
+  for (size_t i = 0; i < pixelCount; ++i) {
+    // Small differences take most of the range of the error
+    const float color = std::pow(
+        hyab(huntLab(referenceFiltered[i]), huntLab(imageFiltered[i])),
+        FLIP_QC);
+    const float threshold = FLIP_PC * maxColor;
+    const float colorError = std::min(color < threshold
+                                          ? FLIP_PT / threshold * color
+                                          : FLIP_PT + (color - threshold) /
+                                                          (maxColor - threshold) *
+                                                          (1.f - FLIP_PT),
+        1.f);
+
+    const float edges = std::abs(
+        glm::length(glm::vec2(referenceFeatures[i].x, referenceFeatures[i].z)) -
+        glm::length(glm::vec2(imageFeatures[i].x, imageFeatures[i].z)));
+    const float points = std::abs(
+        glm::length(glm::vec2(referenceFeatures[i].y, referencePoints[i].z)) -
+        glm::length(glm::vec2(imageFeatures[i].y, imagePoints[i].z)));
+    const float featureError = std::pow(
+        std::min(std::max(edges, points) / std::sqrt(2.f), 1.f), FLIP_QF);
+
+    sum += double(std::pow(colorError, 1.f - featureError));
+  }
+  return sum / double(pixelCount);
+}
+
+} // namespace
+
+bool compareImageFiles(const fs::path &reference, const fs::path &image,
+    ImageDifference &difference, std::string &err)
+{
+  int referenceWidth = 0, referenceHeight = 0, width = 0, height = 0;
+  const auto referencePixels =
+      loadRgb(reference, referenceWidth, referenceHeight, err);
+  if (!referencePixels) {
+    return false;
+  }
+  const auto pixels = loadRgb(image, width, height, err);
+  if (!pixels) {
+    return false;
+  }
+  if (width != referenceWidth || height != referenceHeight) {
+    err = image.string() + " is " + std::to_string(width) + "x" +
+          std::to_string(height) + ", " + reference.string() + " is " +
+          std::to_string(referenceWidth) + "x" +
+          std::to_string(referenceHeight);
+    return false;
+  }
+
+  const auto pixelCount = size_t(width) * size_t(height);
+  double squaredErrors = 0.;
+  int maxError = 0;
+  size_t differentPixels = 0;
+  for (size_t i = 0; i < pixelCount; ++i) {
+    auto pixelError = 0;
+    for (size_t c = 0; c < 3; ++c) {
+      const auto error = std::abs(int(referencePixels.get()[3 * i + c]) -
+                                  int(pixels.get()[3 * i + c]));
+      squaredErrors += double(error * error);
+      pixelError = std::max(pixelError, error);
+    }
+    maxError = std::max(maxError, pixelError);
+    // Off by one is the rounding of the sRGB encoding
+    if (pixelError > 1) {
+      ++differentPixels;
+    }
+  }
+
+  difference.width = width;
+  difference.height = height;
+  difference.maxError = maxError;
+  difference.differentPixels =
+      pixelCount ? double(differentPixels) / double(pixelCount) : 0.;
+  const auto meanSquaredError =
+      pixelCount ? squaredErrors / double(3 * pixelCount) : 0.;
+  difference.psnr = meanSquaredError > 0.
+                        ? 10. * std::log10(255. * 255. / meanSquaredError)
+                        : std::numeric_limits<double>::infinity();
+  difference.flip =
+      flipError(referencePixels.get(), pixels.get(), width, height);
+  return true;
+}
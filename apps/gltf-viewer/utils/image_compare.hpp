@@ -0,0 +1,27 @@
+#pragma once
+
+#include "filesystem.hpp"
+
+#include <string>
+
+// Difference of two images of the same size, of their RGB channels as 8 bits
+// sRGB encoded values, to check that a cheaper rendering path, such as
+// --half-precision, draws the same images as the reference one
+struct ImageDifference
+{
+  int width = 0;
+  int height = 0;
+  double psnr = 0.; // In dB, infinite for equal images
+  int maxError = 0; // Largest difference of a channel, in [0, 255]
+  double differentPixels = 0.; // Ratio of pixels with a channel off by > 1
+  // Mean perceived difference in [0, 1], LDR FLIP for a 4K monitor 0.7 m
+  // wide seen from 0.7 m, 0 for equal images. Unlike the PSNR, it weighs
+  // differences by what the eye sees of them at that size, such as noise
+  // on edges or banding.
+  double flip = 0.;
+};
+
+// Read two images stb_image can decode and compare them. Return false with err
+// if one cannot be read or their sizes differ.
+bool compareImageFiles(const fs::path &reference, const fs::path &image,
+    ImageDifference &difference, std::string &err);
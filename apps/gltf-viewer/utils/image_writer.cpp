@@ -0,0 +1,533 @@
+#include "image_writer.hpp"
+#include "heap_memory.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+#include <glm/gtc/packing.hpp>
+#include <stb_image_write.h>
+
+namespace
+{
+
+std::string lowercaseExtension(const fs::path &path)
+{
+  auto extension = path.extension().string();
+  std::transform(begin(extension), end(extension), begin(extension),
+      [](char c) { return char(std::tolower((unsigned char)c)); });
+  return extension;
+}
+
+unsigned char linearToSrgb8(float value)
+{
+  value = std::min(std::max(value, 0.f), 1.f);
+  const auto encoded = value <= 0.0031308f
+                           ? value * 12.92f
+                           : 1.055f * std::pow(value, 1.f / 2.4f) - 0.055f;
+  return (unsigned char)(encoded * 255.f + 0.5f);
+}
+
+// sRGB encoded bytes of linear values, alpha stays linear
+void encodeSrgb(const float *linear, size_t count, int components,
+    unsigned char *srgb)
+{
+  for (size_t i = 0; i < count; ++i) {
+    const bool alpha = components == 4 && i % 4 == 3;
+    srgb[i] = alpha ? (unsigned char)(std::min(std::max(linear[i], 0.f), 1.f) *
+                                          255.f +
+                                      0.5f)
+                    : linearToSrgb8(linear[i]);
+  }
+}
+
+// Linear values of sRGB encoded bytes, alpha is only normalized
+void decodeSrgb(const unsigned char *srgb, size_t count, int components,
+    float *linear)
+{
+  static const auto srgbTable = []() {
+    std::array<float, 256> table;
+    for (int i = 0; i < 256; ++i) {
+      const auto value = i / 255.f;
+      table[i] = value <= 0.04045f ? value / 12.92f
+                                   : std::pow((value + 0.055f) / 1.055f, 2.4f);
+    }
+    return table;
+  }();
+  for (size_t i = 0; i < count; ++i) {
+    const bool alpha = components == 4 && i % 4 == 3;
+    linear[i] = alpha ? srgb[i] / 255.f : srgbTable[srgb[i]];
+  }
+}
+
+template <typename T> void put(std::vector<unsigned char> &out, T value)
+{
+  const auto *bytes = (const unsigned char *)&value; // Little endian
+  out.insert(end(out), bytes, bytes + sizeof(T));
+}
+
+void putString(std::vector<unsigned char> &out, const char *string)
+{
+  out.insert(end(out), string, string + std::strlen(string) + 1);
+}
+
+void putBigEndian(std::vector<unsigned char> &out, uint32_t value)
+{
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    out.push_back((unsigned char)(value >> shift));
+  }
+}
+
+// Scanline OpenEXR without compression, one scanline per block and half float
+// channels in alphabetical order. Uncompressed blocks have a known size, the
+// header ends with the offset of every one of them.
+void putExrHeader(std::vector<unsigned char> &out, int width, int height,
+    int channelCount)
+{
+  const char *channelNames[] = {"A", "B", "G", "R"};
+  const int firstChannel = channelCount == 4 ? 0 : 1;
+
+  out = {0x76, 0x2f, 0x31, 0x01, 2, 0, 0, 0};
+
+  putString(out, "channels");
+  putString(out, "chlist");
+  put(out, int32_t(channelCount * 18 + 1));
+  for (int c = firstChannel; c < 4; ++c) {
+    putString(out, channelNames[c]);
+    put(out, int32_t(1)); // HALF
+    put(out, uint32_t(0)); // pLinear and reserved
+    put(out, int32_t(1)); // x sampling
+    put(out, int32_t(1)); // y sampling
+  }
+  out.push_back(0);
+
+  putString(out, "compression");
+  putString(out, "compression");
+  put(out, int32_t(1));
+  out.push_back(0); // NO_COMPRESSION
+
+  for (const auto *window : {"dataWindow", "displayWindow"}) {
+    putString(out, window);
+    putString(out, "box2i");
+    put(out, int32_t(16));
+    put(out, int32_t(0));
+    put(out, int32_t(0));
+    put(out, int32_t(width - 1));
+    put(out, int32_t(height - 1));
+  }
+
+  putString(out, "lineOrder");
+  putString(out, "lineOrder");
+  put(out, int32_t(1));
+  out.push_back(0); // INCREASING_Y
+
+  putString(out, "pixelAspectRatio");
+  putString(out, "float");
+  put(out, int32_t(4));
+  put(out, 1.f);
+
+  putString(out, "screenWindowCenter");
+  putString(out, "v2f");
+  put(out, int32_t(8));
+  put(out, 0.f);
+  put(out, 0.f);
+
+  putString(out, "screenWindowWidth");
+  putString(out, "float");
+  put(out, int32_t(4));
+  put(out, 1.f);
+
+  out.push_back(0); // End of header
+
+  const auto lineSize = size_t(width) * channelCount * 2;
+  const auto blockSize = 8 + lineSize;
+  const auto tableEnd = out.size() + size_t(height) * 8;
+  for (int y = 0; y < height; ++y) {
+    put(out, uint64_t(tableEnd + size_t(y) * blockSize));
+  }
+}
+
+} // namespace
+
+ImageFormat imageFormatFromPath(const fs::path &path)
+{
+  const auto extension = lowercaseExtension(path);
+  if (extension == ".qoi") {
+    return IMAGE_FORMAT_QOI;
+  }
+  if (extension == ".ppm") {
+    return IMAGE_FORMAT_PPM;
+  }
+  if (extension == ".tga") {
+    return IMAGE_FORMAT_TGA;
+  }
+  if (extension == ".exr") {
+    return IMAGE_FORMAT_EXR;
+  }
+  return IMAGE_FORMAT_PNG;
+}
+
+ImageRowWriter::~ImageRowWriter()
+{
+  if (m_file.is_open() || !m_pngPixels.empty()) {
+    close();
+  }
+}
+
+bool ImageRowWriter::open(
+    const fs::path &path, int width, int height, int components)
+{
+  HeapTagScope heapTag(HeapTag::Staging);
+  m_path = path;
+  m_format = imageFormatFromPath(path);
+  m_width = width;
+  m_height = height;
+  m_components = components;
+  m_writtenRows = 0;
+  m_failed = false;
+  m_out.clear();
+
+  if (m_format == IMAGE_FORMAT_PNG) {
+    m_pngPixels.resize(size_t(width) * height * components);
+    return true;
+  }
+
+  // TGA stores the sizes in 16 bits
+  if (m_format == IMAGE_FORMAT_TGA && (width > 65535 || height > 65535)) {
+    std::cerr << "TGA images are at most 65535x65535 pixels, " << path.string()
+              << " is " << width << "x" << height << std::endl;
+    m_failed = true;
+    return false;
+  }
+
+  m_file.open(path.string(), std::ios::binary);
+  switch (m_format) {
+  case IMAGE_FORMAT_QOI:
+    // The Quite OK Image format,
+    // https://qoiformat.org/qoi-specification.pdf
+    m_out = {'q', 'o', 'i', 'f'};
+    putBigEndian(m_out, uint32_t(width));
+    putBigEndian(m_out, uint32_t(height));
+    m_out.push_back((unsigned char)components);
+    m_out.push_back(0); // sRGB with linear alpha
+    std::memset(m_qoiIndex, 0, sizeof(m_qoiIndex));
+    m_qoiPrevious = 0xff000000;
+    m_qoiRun = 0;
+    break;
+  case IMAGE_FORMAT_PPM: {
+    // Binary P6, the alpha channel is dropped
+    const auto header = "P6\n" + std::to_string(width) + " " +
+                        std::to_string(height) + "\n255\n";
+    m_out.assign(begin(header), end(header));
+    break;
+  }
+  case IMAGE_FORMAT_TGA:
+    // Uncompressed true color with a top left origin
+    m_out = {0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    put(m_out, uint16_t(width));
+    put(m_out, uint16_t(height));
+    m_out.push_back((unsigned char)(components * 8));
+    m_out.push_back((unsigned char)(0x20 | (components == 4 ? 8 : 0)));
+    break;
+  default:
+    putExrHeader(m_out, width, height, components == 4 ? 4 : 3);
+    break;
+  }
+  return flush();
+}
+
+bool ImageRowWriter::write(const unsigned char *rows, int count)
+{
+  const auto rowSize = size_t(m_width) * m_components;
+  for (int i = 0; i < count && !m_failed; ++i) {
+    const auto *row = rows + i * rowSize;
+    if (m_format == IMAGE_FORMAT_EXR) {
+      m_linearRow.resize(rowSize);
+      decodeSrgb(row, rowSize, m_components, m_linearRow.data());
+      writeRow(nullptr, m_linearRow.data());
+    } else {
+      writeRow(row, nullptr);
+    }
+  }
+  return !m_failed;
+}
+
+bool ImageRowWriter::write(const float *rows, int count)
+{
+  const auto rowSize = size_t(m_width) * m_components;
+  for (int i = 0; i < count && !m_failed; ++i) {
+    const auto *row = rows + i * rowSize;
+    if (m_format == IMAGE_FORMAT_EXR) {
+      writeRow(nullptr, row);
+    } else {
+      m_srgbRow.resize(rowSize);
+      encodeSrgb(row, rowSize, m_components, m_srgbRow.data());
+      writeRow(m_srgbRow.data(), nullptr);
+    }
+  }
+  return !m_failed;
+}
+
+void ImageRowWriter::writeRow(const unsigned char *srgb, const float *linear)
+{
+  if (m_writtenRows == m_height) {
+    m_failed = true;
+    return;
+  }
+  const auto rowIndex = m_writtenRows++;
+  const auto channels = m_components;
+
+  switch (m_format) {
+  case IMAGE_FORMAT_PNG:
+    std::memcpy(&m_pngPixels[size_t(rowIndex) * m_width * channels], srgb,
+        size_t(m_width) * channels);
+    return;
+  case IMAGE_FORMAT_QOI:
+    for (int x = 0; x < m_width; ++x) {
+      const auto *p = srgb + x * channels;
+      const unsigned char r = p[0], g = p[1], b = p[2];
+      const unsigned char a = channels == 4 ? p[3] : 255;
+      const auto pixel = uint32_t(r) | uint32_t(g) << 8 | uint32_t(b) << 16 |
+                         uint32_t(a) << 24;
+
+      if (pixel == m_qoiPrevious) {
+        if (++m_qoiRun == 62) {
+          m_out.push_back((unsigned char)(0xc0 | (m_qoiRun - 1)));
+          m_qoiRun = 0;
+        }
+        continue;
+      }
+      if (m_qoiRun > 0) {
+        m_out.push_back((unsigned char)(0xc0 | (m_qoiRun - 1)));
+        m_qoiRun = 0;
+      }
+
+      const auto hash = (r * 3 + g * 5 + b * 7 + a * 11) % 64;
+      if (m_qoiIndex[hash] == pixel) {
+        m_out.push_back((unsigned char)hash);
+      } else {
+        m_qoiIndex[hash] = pixel;
+        const auto previousR = (unsigned char)m_qoiPrevious;
+        const auto previousG = (unsigned char)(m_qoiPrevious >> 8);
+        const auto previousB = (unsigned char)(m_qoiPrevious >> 16);
+        const auto previousA = (unsigned char)(m_qoiPrevious >> 24);
+        if (a == previousA) {
+          const auto dr = int8_t(r - previousR);
+          const auto dg = int8_t(g - previousG);
+          const auto db = int8_t(b - previousB);
+          const auto drg = dr - dg;
+          const auto dbg = db - dg;
+          if (dr > -3 && dr < 2 && dg > -3 && dg < 2 && db > -3 && db < 2) {
+            m_out.push_back((unsigned char)(0x40 | (dr + 2) << 4 |
+                                            (dg + 2) << 2 | (db + 2)));
+          } else if (drg > -9 && drg < 8 && dg > -33 && dg < 32 &&
+                     dbg > -9 && dbg < 8) {
+            m_out.push_back((unsigned char)(0x80 | (dg + 32)));
+            m_out.push_back((unsigned char)((drg + 8) << 4 | (dbg + 8)));
+          } else {
+            m_out.insert(end(m_out), {0xfe, r, g, b});
+          }
+        } else {
+          m_out.insert(end(m_out), {0xff, r, g, b, a});
+        }
+      }
+      m_qoiPrevious = pixel;
+    }
+    break;
+  case IMAGE_FORMAT_PPM:
+    for (int x = 0; x < m_width; ++x) {
+      m_out.insert(end(m_out), srgb + x * channels, srgb + x * channels + 3);
+    }
+    break;
+  case IMAGE_FORMAT_TGA:
+    for (int x = 0; x < m_width; ++x) {
+      const auto *p = srgb + x * channels;
+      m_out.insert(end(m_out), {p[2], p[1], p[0]});
+      if (channels == 4) {
+        m_out.push_back(p[3]);
+      }
+    }
+    break;
+  default: {
+    const int channelOffsets[] = {3, 2, 1, 0}; // In RGBA
+    const int firstChannel = channels == 4 ? 0 : 1;
+    const int channelCount = 4 - firstChannel;
+    put(m_out, int32_t(rowIndex));
+    put(m_out, int32_t(size_t(m_width) * channelCount * 2));
+    for (int c = firstChannel; c < 4; ++c) {
+      for (int x = 0; x < m_width; ++x) {
+        put(m_out, uint16_t(glm::packHalf1x16(
+                       linear[size_t(x) * channels + channelOffsets[c]])));
+      }
+    }
+    break;
+  }
+  }
+
+  // Small rows are buffered together
+  if (m_out.size() >= (1 << 16)) {
+    flush();
+  }
+}
+
+bool ImageRowWriter::flush()
+{
+  m_file.write((const char *)m_out.data(), std::streamsize(m_out.size()));
+  m_out.clear();
+  m_failed = m_failed || !m_file;
+  return !m_failed;
+}
+
+bool ImageRowWriter::close()
+{
+  m_failed = m_failed || m_writtenRows != m_height;
+
+  if (m_format == IMAGE_FORMAT_PNG) {
+    const auto path = m_path.string();
+    m_failed = m_failed ||
+               !stbi_write_png(path.c_str(), m_width, m_height, m_components,
+                   m_pngPixels.data(), m_width * m_components);
+    m_pngPixels.clear();
+    m_pngPixels.shrink_to_fit();
+    return !m_failed;
+  }
+
+  if (m_format == IMAGE_FORMAT_QOI) {
+    if (m_qoiRun > 0) {
+      m_out.push_back((unsigned char)(0xc0 | (m_qoiRun - 1)));
+      m_qoiRun = 0;
+    }
+    m_out.insert(end(m_out), {0, 0, 0, 0, 0, 0, 0, 1});
+  }
+  flush();
+  m_file.close();
+  m_failed = m_failed || !m_file;
+  return !m_failed;
+}
+
+bool writeImageFile(const ImageData &image)
+{
+  // Rows are given top first, from the end of the read back pixels
+  HeapTagScope heapTag(HeapTag::Staging);
+  ImageRowWriter writer;
+  bool written =
+      writer.open(image.path, image.width, image.height, image.components);
+  const auto stride = size_t(image.width) * image.components;
+  for (int y = image.height - 1; written && y >= 0; --y) {
+    written = image.hdrPixels.empty()
+                  ? writer.write(image.pixels.data() + y * stride, 1)
+                  : writer.write(image.hdrPixels.data() + y * stride, 1);
+  }
+  written = writer.close() && written;
+  if (!written) {
+    std::cerr << "Unable to write " << image.path.string() << std::endl;
+  }
+  return written;
+}
+
+ImageWriterPool::ImageWriterPool(size_t maxPending)
+{
+  m_maxPending =
+      maxPending ? maxPending : 2 * (JobSystem::shared().workerCount() + 1);
+}
+
+ImageWriterPool::~ImageWriterPool() { wait(); }
+
+void ImageWriterPool::submit(ImageData image)
+{
+  auto &jobs = JobSystem::shared();
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (m_pending >= m_maxPending) {
+    // Without a queued job to run, the images are being encoded by workers
+    lock.unlock();
+    const bool ran = jobs.runQueued();
+    lock.lock();
+    if (!ran) {
+      m_written.wait(lock, [&]() { return m_pending < m_maxPending; });
+    }
+  }
+  ++m_pending;
+  lock.unlock();
+
+  jobs.run(m_group, [this, image = std::move(image)]() {
+    const bool written = writeImageFile(image);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    --m_pending;
+    m_failed += written ? 0 : 1;
+    m_written.notify_all();
+  });
+}
+
+size_t ImageWriterPool::wait()
+{
+  JobSystem::shared().wait(m_group);
+  std::lock_guard<std::mutex> lock(m_mutex);
+  const auto failed = m_failed;
+  m_failed = 0;
+  return failed;
+}
+
+RawVideoWriter::~RawVideoWriter() { close(); }
+
+bool RawVideoWriter::open(const fs::path &path, std::string &err)
+{
+#ifndef _WIN32
+  // A closed pipe fails the writes instead of terminating the process
+  std::signal(SIGPIPE, SIG_IGN);
+#endif
+  m_failed = false;
+  if (path == "-") {
+    m_file = stdout;
+    m_ownsFile = false;
+    return true;
+  }
+  m_file = std::fopen(path.string().c_str(), "wb");
+  m_ownsFile = true;
+  if (!m_file) {
+    err = "Unable to open video output " + path.string() + ": " +
+          std::strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+bool RawVideoWriter::write(const ImageData &frame)
+{
+  if (!m_file || m_failed) {
+    return false;
+  }
+  m_row.resize(size_t(frame.width) * 3);
+  for (int y = frame.height - 1; y >= 0 && !m_failed; --y) {
+    const auto *row = frame.pixels.data() +
+                      size_t(y) * frame.width * frame.components;
+    const unsigned char *rgb = row;
+    if (frame.components != 3) {
+      for (int x = 0; x < frame.width; ++x) {
+        std::memcpy(&m_row[size_t(x) * 3], row + x * frame.components, 3);
+      }
+      rgb = m_row.data();
+    }
+    m_failed = std::fwrite(rgb, 3, size_t(frame.width), m_file) !=
+               size_t(frame.width);
+  }
+  return !m_failed;
+}
+
+bool RawVideoWriter::close()
+{
+  if (!m_file) {
+    return !m_failed;
+  }
+  m_failed = std::fflush(m_file) != 0 || m_failed;
+  if (m_ownsFile) {
+    m_failed = std::fclose(m_file) != 0 || m_failed;
+  }
+  m_file = nullptr;
+  return !m_failed;
+}
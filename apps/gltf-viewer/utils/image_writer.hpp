@@ -0,0 +1,153 @@
+#pragma once
+
+#include "filesystem.hpp"
+#include "job_system.hpp"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// File formats of output images, picked from the extension of their path
+enum ImageFormat
+{
+  IMAGE_FORMAT_PNG,
+  IMAGE_FORMAT_QOI, // Lossless, an order of magnitude faster than PNG
+  IMAGE_FORMAT_PPM, // Uncompressed, RGB only
+  IMAGE_FORMAT_TGA, // Uncompressed
+  IMAGE_FORMAT_EXR // Uncompressed half floats, linear
+};
+
+// PNG for unknown extensions
+ImageFormat imageFormatFromPath(const fs::path &path);
+
+// Whether the format stores linear HDR values, which should be read back
+// before any encoding
+inline bool isHdrImageFormat(ImageFormat format)
+{
+  return format == IMAGE_FORMAT_EXR;
+}
+
+// An image with rows bottom first, as read back by OpenGL: either sRGB
+// encoded bytes or linear floats
+struct ImageData
+{
+  fs::path path;
+  int width = 0;
+  int height = 0;
+  int components = 3;
+  std::vector<unsigned char> pixels; // Unused if hdrPixels is not empty
+  std::vector<float> hdrPixels;
+};
+
+// Encodes an image given a band of rows at a time, top row first, to the
+// format of its path, so that images too large for memory are written as they
+// are rendered. Every format but PNG writes rows as they come, PNG keeps the
+// whole image until close().
+class ImageRowWriter
+{
+public:
+  ImageRowWriter() = default;
+  ~ImageRowWriter(); // Closes the file if still open
+
+  ImageRowWriter(const ImageRowWriter &) = delete;
+  ImageRowWriter &operator=(const ImageRowWriter &) = delete;
+
+  bool open(const fs::path &path, int width, int height, int components);
+
+  // Write count rows of width * components sRGB encoded bytes, or linear
+  // floats. Pixels are converted as by writeImageFile.
+  bool write(const unsigned char *rows, int count);
+  bool write(const float *rows, int count);
+
+  // Return false if the file could not be written or misses rows
+  bool close();
+
+private:
+  // Exactly one of srgb and linear is set, the one the format stores
+  void writeRow(const unsigned char *srgb, const float *linear);
+  bool flush();
+
+  fs::path m_path;
+  ImageFormat m_format = IMAGE_FORMAT_PNG;
+  int m_width = 0;
+  int m_height = 0;
+  int m_components = 3;
+  int m_writtenRows = 0;
+  bool m_failed = false;
+  std::ofstream m_file;
+  std::vector<unsigned char> m_out; // Encoded and not written yet
+  std::vector<unsigned char> m_srgbRow;
+  std::vector<float> m_linearRow;
+  std::vector<unsigned char> m_pngPixels;
+  // QOI encoder state, pixels packed as RGBA from the low byte
+  uint32_t m_qoiIndex[64] = {};
+  uint32_t m_qoiPrevious = 0;
+  int m_qoiRun = 0;
+};
+
+// Encode an image with the format of its path, top row first, and write it.
+// Linear pixels are encoded to sRGB for 8 bits formats and sRGB pixels
+// decoded for EXR. Return false if the file could not be written.
+bool writeImageFile(const ImageData &image);
+
+// Encodes and writes images on the shared job system while the caller renders
+// the next ones. submit() runs queued jobs while maxPending images are being
+// encoded, which bounds the memory of the frames in flight.
+class ImageWriterPool
+{
+public:
+  // 0 maxPending is twice the threads running jobs
+  explicit ImageWriterPool(size_t maxPending = 0);
+  ~ImageWriterPool(); // Waits for every submitted image
+
+  ImageWriterPool(const ImageWriterPool &) = delete;
+  ImageWriterPool &operator=(const ImageWriterPool &) = delete;
+
+  void submit(ImageData image);
+
+  // Wait for every submitted image and return the number of images which
+  // could not be written since the previous call
+  size_t wait();
+
+private:
+  std::mutex m_mutex;
+  std::condition_variable m_written;
+  size_t m_maxPending;
+  size_t m_pending = 0; // Being encoded
+  size_t m_failed = 0;
+  JobSystem::Group m_group;
+};
+
+// Writes frames as headerless rgb24 raw video, top row first, to a file, a
+// named pipe or stdout for an encoder reading it with
+//   ffmpeg -f rawvideo -pix_fmt rgb24 -s <width>x<height> -r <fps> -i <path>
+class RawVideoWriter
+{
+public:
+  RawVideoWriter() = default;
+  ~RawVideoWriter(); // Closes the output
+
+  RawVideoWriter(const RawVideoWriter &) = delete;
+  RawVideoWriter &operator=(const RawVideoWriter &) = delete;
+
+  // "-" is stdout. A named pipe blocks until the encoder opens it.
+  bool open(const fs::path &path, std::string &err);
+
+  // Frames of 8 bits pixels with 3 or 4 components, all of the same size.
+  // Return false once the output cannot be written, e.g. the encoder exited.
+  bool write(const ImageData &frame);
+
+  // Flush the output and return false if some frame could not be written
+  bool close();
+
+private:
+  std::FILE *m_file = nullptr;
+  bool m_ownsFile = false;
+  bool m_failed = false;
+  std::vector<unsigned char> m_row;
+};
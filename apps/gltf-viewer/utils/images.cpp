@@ -1,12 +1,51 @@
 #include "images.hpp"
+#include "gpu_memory.hpp"
 
+#include <algorithm>
 #include <cassert>
-#include <glad/glad.h>
+#include <cstring>
 #include <iostream>
 
-void renderToImage(size_t width, size_t height, size_t numComponents,
-    unsigned char *outPixels, std::function<void()> drawScene)
+OffscreenRenderer::~OffscreenRenderer() { release(); }
+
+void OffscreenRenderer::release()
 {
+  for (const auto &readback : m_pending) {
+    glDeleteSync(readback.fence);
+    untrackBuffers(1, &readback.buffer);
+    glDeleteBuffers(1, &readback.buffer);
+  }
+  m_pending.clear();
+  if (!m_freeBuffers.empty()) {
+    untrackBuffers(GLsizei(m_freeBuffers.size()), m_freeBuffers.data());
+    glDeleteBuffers(GLsizei(m_freeBuffers.size()), m_freeBuffers.data());
+    m_freeBuffers.clear();
+  }
+
+  if (m_resolveFramebuffer != m_framebuffer) {
+    glDeleteFramebuffers(1, &m_resolveFramebuffer);
+  }
+  if (m_framebuffer) {
+    glDeleteFramebuffers(1, &m_framebuffer);
+  }
+  if (m_colorRenderbuffer) {
+    untrackRenderbuffers(1, &m_colorRenderbuffer);
+    glDeleteRenderbuffers(1, &m_colorRenderbuffer);
+  }
+  if (m_colorTexture) {
+    const GLuint textures[] = {m_colorTexture, m_depthTexture};
+    untrackTextures(2, textures);
+    glDeleteTextures(2, textures);
+  }
+  m_framebuffer = m_resolveFramebuffer = 0;
+  m_colorRenderbuffer = m_depthTexture = m_colorTexture = 0;
+}
+
+void OffscreenRenderer::init(
+    size_t width, size_t height, int samples, bool hdr)
+{
+  release();
+
   GLint previousTextureObject = 0;
   GLint previousFramebufferObject = 0;
 
@@ -14,40 +53,67 @@ void renderToImage(size_t width, size_t height, size_t numComponents,
   glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTextureObject);
   glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebufferObject);
 
-  GLuint textureObject = 0;
-
-  glGenTextures(1, &textureObject);
-
-  glBindTexture(GL_TEXTURE_2D, textureObject);
+  GLint maxSamples = 1;
+  glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+  samples = std::max(1, std::min(samples, int(maxSamples)));
+  const bool multisample = samples > 1;
 
   // Lets avoid warnings
-  const auto w = GLsizei(width);
-  const auto h = GLsizei(height);
-
-  // if we want better quality, we can use multisampling, but for testing
-  // purpose it is useless todo replace with glTexStorage2DMultisample (in that
-  // case need to todo glBlitFramebuffer in another one in order to be able to
-  // glGetTexImage)
-  // https://stackoverflow.com/questions/14019910/how-does-glteximage2dmultisample-work
-  glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32F, w, h);
+  m_width = GLsizei(width);
+  m_height = GLsizei(height);
+  m_hdr = hdr;
+  const GLenum colorFormat = hdr ? GL_RGBA16F : GL_SRGB8_ALPHA8;
 
-  GLuint depthTexture;
-  glGenTextures(1, &depthTexture);
+  glGenTextures(1, &m_colorTexture);
+  glBindTexture(GL_TEXTURE_2D, m_colorTexture);
+  glTexStorage2D(GL_TEXTURE_2D, 1, colorFormat, m_width, m_height);
+  glBindTexture(GL_TEXTURE_2D, previousTextureObject);
+  trackTexture(GpuMemoryCategory::RenderTargets, GL_TEXTURE_2D, m_colorTexture);
 
-  glBindTexture(GL_TEXTURE_2D, depthTexture);
+  // The depth is a texture for screen-space ambient occlusion to read, with
+  // fixed sample locations to be attached with the color renderbuffer
+  const GLenum depthTarget =
+      multisample ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D;
+  GLint previousDepthTexture = 0;
+  glGetIntegerv(multisample ? GL_TEXTURE_BINDING_2D_MULTISAMPLE
+                            : GL_TEXTURE_BINDING_2D,
+      &previousDepthTexture);
+  glGenTextures(1, &m_depthTexture);
+  glBindTexture(depthTarget, m_depthTexture);
+  if (multisample) {
+    glTexStorage2DMultisample(depthTarget, samples, GL_DEPTH_COMPONENT32F,
+        m_width, m_height, GL_TRUE);
+  } else {
+    glTexStorage2D(
+        depthTarget, 1, GL_DEPTH_COMPONENT32F, m_width, m_height);
+  }
+  glBindTexture(depthTarget, GLuint(previousDepthTexture));
+  trackTexture(GpuMemoryCategory::RenderTargets, depthTarget, m_depthTexture);
 
-  glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, w, h);
+  // Multisampled attachments are only written by drawScene and resolved by a
+  // blit to m_colorTexture, one sample per pixel is read back
 
-  glBindTexture(GL_TEXTURE_2D, previousTextureObject);
+  if (multisample) {
+    glGenRenderbuffers(1, &m_colorRenderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_colorRenderbuffer);
+    glRenderbufferStorageMultisample(
+        GL_RENDERBUFFER, samples, colorFormat, m_width, m_height);
+    trackRenderbuffer(GpuMemoryCategory::RenderTargets, m_colorRenderbuffer);
+  }
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
 
-  GLuint framebufferObject = 0;
-  glGenFramebuffers(1, &framebufferObject);
-  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebufferObject);
+  glGenFramebuffers(1, &m_framebuffer);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_framebuffer);
 
+  if (multisample) {
+    glFramebufferRenderbuffer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+        GL_RENDERBUFFER, m_colorRenderbuffer);
+  } else {
+    glFramebufferTexture(
+        GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, m_colorTexture, 0);
+  }
   glFramebufferTexture(
-      GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, textureObject, 0);
-  glFramebufferTexture(
-      GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTexture, 0);
+      GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_depthTexture, 0);
 
   GLenum drawBuffers[1] = {GL_COLOR_ATTACHMENT0};
   glDrawBuffers(1, drawBuffers);
@@ -55,11 +121,35 @@ void renderToImage(size_t width, size_t height, size_t numComponents,
   const auto framebufferStatus = glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER);
   assert(framebufferStatus == GL_FRAMEBUFFER_COMPLETE);
 
+  m_resolveFramebuffer = m_framebuffer;
+  if (multisample) {
+    glGenFramebuffers(1, &m_resolveFramebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_resolveFramebuffer);
+    glFramebufferTexture(
+        GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, m_colorTexture, 0);
+    glEnable(GL_MULTISAMPLE);
+  }
+
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, previousFramebufferObject);
+}
+
+void OffscreenRenderer::render(
+    const std::function<void()> &drawScene, size_t numComponents)
+{
+  GLint previousFramebufferObject = 0;
+  GLint previousReadFramebufferObject = 0;
+  GLint previousPackAlignment = 4;
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebufferObject);
+  glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previousReadFramebufferObject);
+  glGetIntegerv(GL_PACK_ALIGNMENT, &previousPackAlignment);
+
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_framebuffer);
+
   drawScene();
 
   GLint currentlyBoundFBO = 0;
   glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &currentlyBoundFBO);
-  if (currentlyBoundFBO != framebufferObject) {
+  if (GLuint(currentlyBoundFBO) != m_framebuffer) {
     // Display a warning on clog
     // It may not be an error because the drawScene() function might have render
     // to the framebuffer but unbound it after.
@@ -69,10 +159,101 @@ void renderToImage(size_t width, size_t height, size_t numComponents,
         << std::endl;
   }
 
-  glBindTexture(GL_TEXTURE_2D, textureObject);
-  glGetTexImage(GL_TEXTURE_2D, 0, numComponents == 3 ? GL_RGB : GL_RGBA,
-      GL_UNSIGNED_BYTE, outPixels);
+  if (m_resolveFramebuffer != m_framebuffer) {
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_resolveFramebuffer);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_framebuffer);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+
+    // Samples are decoded before being averaged, in linear space
+    glEnable(GL_FRAMEBUFFER_SRGB);
+    glBlitFramebuffer(0, 0, m_width, m_height, 0, 0, m_width, m_height,
+        GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glDisable(GL_FRAMEBUFFER_SRGB);
+  }
+
+  if (numComponents == 0) {
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, previousFramebufferObject);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, previousReadFramebufferObject);
+    return;
+  }
+
+  // The driver copies to the buffer when the GPU is done, without blocking
+  Readback readback;
+  readback.size = size_t(m_width) * m_height * numComponents *
+                  (m_hdr ? sizeof(float) : 1);
+  if (m_freeBuffers.empty()) {
+    glGenBuffers(1, &readback.buffer);
+  } else {
+    readback.buffer = m_freeBuffers.back();
+    m_freeBuffers.pop_back();
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+  glBufferData(
+      GL_PIXEL_PACK_BUFFER, GLsizeiptr(readback.size), nullptr, GL_STREAM_READ);
+  trackBuffer(GpuMemoryCategory::Staging, readback.buffer, readback.size);
+
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, m_resolveFramebuffer);
+  glReadBuffer(GL_COLOR_ATTACHMENT0);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, m_width, m_height, numComponents == 3 ? GL_RGB : GL_RGBA,
+      m_hdr ? GL_FLOAT : GL_UNSIGNED_BYTE, nullptr);
+  glPixelStorei(GL_PACK_ALIGNMENT, previousPackAlignment);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  glFlush();
+  m_pending.push_back(readback);
 
-  glBindTexture(GL_TEXTURE_2D, previousTextureObject);
   glBindFramebuffer(GL_DRAW_FRAMEBUFFER, previousFramebufferObject);
-}
\ No newline at end of file
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, previousReadFramebufferObject);
+}
+
+void OffscreenRenderer::read(void *outPixels)
+{
+  assert(!m_pending.empty());
+  const auto readback = m_pending.front();
+  m_pending.pop_front();
+
+  glClientWaitSync(
+      readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+  glDeleteSync(readback.fence);
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+  const auto *pixels = glMapBufferRange(
+      GL_PIXEL_PACK_BUFFER, 0, GLsizeiptr(readback.size), GL_MAP_READ_BIT);
+  if (pixels) {
+    std::memcpy(outPixels, pixels, readback.size);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  m_freeBuffers.push_back(readback.buffer);
+}
+
+glm::mat4 tileProjection(
+    int imageWidth, int imageHeight, int x, int y, int width, int height)
+{
+  // Scale and shift of normalized device coordinates, applied in clip space
+  // where they are multiplied by w
+  const auto scale =
+      glm::vec2(float(imageWidth) / width, float(imageHeight) / height);
+  const auto center =
+      glm::vec2(2.f * x + width, 2.f * y + height) /
+          glm::vec2(imageWidth, imageHeight) -
+      1.f;
+  glm::mat4 matrix(1);
+  matrix[0][0] = scale.x;
+  matrix[1][1] = scale.y;
+  matrix[3][0] = -scale.x * center.x;
+  matrix[3][1] = -scale.y * center.y;
+  return matrix;
+}
+
+void renderToImage(size_t width, size_t height, size_t numComponents,
+    unsigned char *outPixels, std::function<void()> drawScene, int samples)
+{
+  OffscreenRenderer renderer;
+  renderer.init(width, height, samples);
+  renderer.render(drawScene, numComponents);
+  renderer.read(outPixels);
+}
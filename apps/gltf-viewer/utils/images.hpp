@@ -1,6 +1,11 @@
 #pragma once
 
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <deque>
 #include <functional>
+#include <vector>
 
 template <typename ComponentType>
 void flipImageYAxis(
@@ -17,14 +22,80 @@ void flipImageYAxis(
   }
 }
 
-void renderToImage(size_t width, size_t height, size_t numComponents,
-    unsigned char *outPixels, std::function<void()> drawScene);
-// Setup GL state in order to render in texture, call drawScene() then get the
-// texture from the GPU and store it on outPixels[0 : width * height *
-// numComponent]. Then restore the previous GL state.
+// Framebuffer to render images without a window, kept from one image to the
+// next. Pixels are read back to pixel buffer objects behind a fence, so that
+// an image can be waited for once the next one has been submitted and the
+// GPU never idles while the CPU reads.
 //
-// For this to work, drawScene must render on the currently bound
-// GL_DRAW_FRAMEBUFFER.
-// It means that if drawScene change GL_DRAW_FRAMEBUFFER, in must restore it
-// before doing final rendering (for example for deferred rendering,
-// GL_DRAW_FRAMEBUFFER must be restored before the shading pass).
\ No newline at end of file
+// The color attachment is GL_SRGB8_ALPHA8, scenes drawn with
+// GL_FRAMEBUFFER_SRGB read back encoded, or GL_RGBA16F with hdr, read back as
+// linear floats. With more than 1 sample, drawScene
+// renders to multisampled color and depth attachments, resolved to a single
+// sample one before being read. samples is clamped to GL_MAX_SAMPLES.
+class OffscreenRenderer
+{
+public:
+  OffscreenRenderer() = default;
+  ~OffscreenRenderer();
+
+  OffscreenRenderer(const OffscreenRenderer &) = delete;
+  OffscreenRenderer &operator=(const OffscreenRenderer &) = delete;
+
+  void init(size_t width, size_t height, int samples = 1, bool hdr = false);
+
+  bool hdr() const { return m_hdr; }
+
+  // Call drawScene with the framebuffer bound on GL_DRAW_FRAMEBUFFER, then
+  // start reading back its numComponents (3 or 4) channels, or only resolve
+  // it if numComponents is 0. The previous framebuffers are restored.
+  //
+  // drawScene must render on the currently bound GL_DRAW_FRAMEBUFFER. If it
+  // changes GL_DRAW_FRAMEBUFFER, it must restore it before doing final
+  // rendering (for example for deferred rendering, GL_DRAW_FRAMEBUFFER must
+  // be restored before the shading pass).
+  void render(const std::function<void()> &drawScene, size_t numComponents);
+
+  // Images rendered and not read yet
+  size_t pendingCount() const { return m_pending.size(); }
+
+  // Wait for the oldest pending image and copy its pixels, bottom row first,
+  // to outPixels[0 : width * height * numComponents], of floats with hdr else
+  // of bytes
+  void read(void *outPixels);
+
+private:
+  struct Readback
+  {
+    GLuint buffer;
+    GLsync fence;
+    size_t size;
+  };
+
+  void release();
+
+  GLsizei m_width = 0;
+  GLsizei m_height = 0;
+  bool m_hdr = false;
+  GLuint m_framebuffer = 0; // Rendered to
+  GLuint m_resolveFramebuffer = 0; // Read from, m_framebuffer if single sample
+  GLuint m_colorTexture = 0;
+  GLuint m_colorRenderbuffer = 0; // Multisampled only
+  GLuint m_depthTexture = 0;
+  std::deque<Readback> m_pending;
+  std::vector<GLuint> m_freeBuffers;
+};
+
+// Matrix from the clip space of an image of imageWidth x imageHeight pixels to
+// the one of its tile of width x height pixels with a bottom left corner at
+// pixel (x, y). Multiplied with the projection of the image, it gives the
+// sub-frustum drawing the tile to a width x height viewport. Tiles may extend
+// past the image.
+glm::mat4 tileProjection(
+    int imageWidth, int imageHeight, int x, int y, int width, int height);
+
+// Render one image with an OffscreenRenderer and wait for its pixels, see
+// OffscreenRenderer::render() for the requirements on drawScene. The previous
+// GL state is restored.
+void renderToImage(size_t width, size_t height, size_t numComponents,
+    unsigned char *outPixels, std::function<void()> drawScene,
+    int samples = 1);
@@ -0,0 +1,139 @@
+#include "impostors.hpp"
+
+#include "gpu_memory.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cmath>
+
+namespace
+{
+
+const GLsizei IMPOSTOR_LAYER_SIZE = IMPOSTOR_FRAMES * IMPOSTOR_FRAME_SIZE;
+
+// -1 or 1, 1 for 0 unlike glm::sign
+glm::vec2 signNotZero(const glm::vec2 &v)
+{
+  return glm::vec2(v.x >= 0.f ? 1.f : -1.f, v.y >= 0.f ? 1.f : -1.f);
+}
+
+void allocateLayers(GLTexture &texture, GLenum format, GLsizei layerCount)
+{
+  texture.generate();
+  glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+  // Down to frames of 4 texels, coarser levels would blend the frames
+  const auto levels = GLsizei(std::log2(float(IMPOSTOR_FRAME_SIZE))) - 1;
+  glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, format, IMPOSTOR_LAYER_SIZE,
+      IMPOSTOR_LAYER_SIZE, layerCount);
+  glTexParameteri(
+      GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+  trackTexture(GpuMemoryCategory::MaterialTextures, GL_TEXTURE_2D_ARRAY,
+      texture);
+}
+
+} // namespace
+
+glm::vec2 octahedralEncode(const glm::vec3 &direction)
+{
+  const auto d = direction / (std::abs(direction.x) + std::abs(direction.y) +
+                                 std::abs(direction.z));
+  auto p = glm::vec2(d);
+  if (d.z < 0.f) {
+    p = (1.f - glm::abs(glm::vec2(p.y, p.x))) * signNotZero(p);
+  }
+  return 0.5f * p + 0.5f;
+}
+
+glm::vec3 octahedralDecode(const glm::vec2 &uv)
+{
+  const auto p = 2.f * uv - 1.f;
+  glm::vec3 d(p, 1.f - std::abs(p.x) - std::abs(p.y));
+  if (d.z < 0.f) {
+    const auto folded =
+        (1.f - glm::abs(glm::vec2(d.y, d.x))) * signNotZero(glm::vec2(d));
+    d.x = folded.x;
+    d.y = folded.y;
+  }
+  return glm::normalize(d);
+}
+
+glm::vec3 impostorFrameDirection(int x, int y)
+{
+  return octahedralDecode(
+      (glm::vec2(x, y) + 0.5f) / float(IMPOSTOR_FRAMES));
+}
+
+glm::mat4 impostorFrameViewProjMatrix(
+    const Aabb &bounds, const glm::vec3 &direction)
+{
+  const auto center = 0.5f * (bounds.min + bounds.max);
+  const auto radius =
+      std::max(0.5f * glm::length(bounds.max - bounds.min), 1e-6f);
+  // As the quads of impostor.vs.glsl
+  const auto up = std::abs(direction.y) < 0.999f ? glm::vec3(0, 1, 0)
+                                                 : glm::vec3(0, 0, 1);
+  const auto view = glm::lookAt(center + radius * direction, center, up);
+  // z from [-1, 1] to [0, 1]
+  const auto zeroToOne =
+      glm::translate(glm::mat4(1), glm::vec3(0, 0, 0.5f)) *
+      glm::scale(glm::mat4(1), glm::vec3(1, 1, 0.5f));
+  return zeroToOne *
+         glm::ortho(-radius, radius, -radius, radius, 0.f, 2.f * radius) *
+         view;
+}
+
+void ImpostorAtlas::init(GLsizei layerCount)
+{
+  m_layerCount = layerCount;
+  allocateLayers(m_albedo, GL_SRGB8_ALPHA8, layerCount);
+  allocateLayers(m_normals, GL_RGBA8, layerCount);
+
+  m_depth.generate();
+  glBindRenderbuffer(GL_RENDERBUFFER, m_depth);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24,
+      IMPOSTOR_LAYER_SIZE, IMPOSTOR_LAYER_SIZE);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+  trackRenderbuffer(GpuMemoryCategory::RenderTargets, m_depth);
+
+  m_framebuffer.generate();
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_framebuffer);
+  glFramebufferRenderbuffer(
+      GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depth);
+  const GLenum drawBuffers[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+  glDrawBuffers(2, drawBuffers);
+}
+
+void ImpostorAtlas::beginLayer(GLsizei layer)
+{
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_framebuffer);
+  glFramebufferTextureLayer(
+      GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, m_albedo, 0, layer);
+  glFramebufferTextureLayer(
+      GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, m_normals, 0, layer);
+  const GLfloat empty[] = {0, 0, 0, 0};
+  const GLfloat farDepth = 1.f;
+  glClearBufferfv(GL_COLOR, 0, empty);
+  glClearBufferfv(GL_COLOR, 1, empty);
+  glClearBufferfv(GL_DEPTH, 0, &farDepth);
+}
+
+void ImpostorAtlas::beginFrame(int x, int y) const
+{
+  glViewport(x * IMPOSTOR_FRAME_SIZE, y * IMPOSTOR_FRAME_SIZE,
+      IMPOSTOR_FRAME_SIZE, IMPOSTOR_FRAME_SIZE);
+}
+
+void ImpostorAtlas::finish()
+{
+  m_framebuffer.reset();
+  m_depth.reset();
+  for (GLuint texture : {GLuint(m_albedo), GLuint(m_normals)}) {
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+  }
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "frustum.hpp"
+#include "gl_objects.hpp"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// Octahedral impostors (Ryan Brucks, Octahedral Impostors, 2018): a mesh is
+// rendered once from IMPOSTOR_FRAMES x IMPOSTOR_FRAMES directions spread over
+// the sphere by an octahedral map, each view to a frame of a layer of the
+// atlas. A distant instance of the mesh is then a quad facing the direction of
+// the frame closest to the one of the eye, textured by the frame.
+//
+// The frames hold the base color and coverage of the surfaces in an sRGB
+// array, and their normals in the space of the mesh in another, so that the
+// quads are lit by the current light. See impostor.vs.glsl.
+const int IMPOSTOR_FRAMES = 8; // Per side of a layer
+const int IMPOSTOR_FRAME_SIZE = 64; // Pixels per side of a frame
+
+// Octahedral map of the unit sphere to [0, 1]^2, as octahedralEncode and
+// octahedralDecode in impostor.vs.glsl
+glm::vec2 octahedralEncode(const glm::vec3 &direction);
+glm::vec3 octahedralDecode(const glm::vec2 &uv);
+
+// Direction from the center of the mesh toward the eye of frame (x, y)
+glm::vec3 impostorFrameDirection(int x, int y);
+
+// Orthographic view of the frame of direction fitting the bounding sphere of
+// bounds, in the space of the mesh, with depths in [0, 1] so that it holds
+// with both clip control depth modes
+glm::mat4 impostorFrameViewProjMatrix(
+    const Aabb &bounds, const glm::vec3 &direction);
+
+// Frames of the impostors of the meshes, a layer per mesh
+class ImpostorAtlas
+{
+public:
+  // Allocate layerCount layers, with mipmaps down to frames of 4 texels, and
+  // the depth of the frames
+  void init(GLsizei layerCount);
+  GLsizei layerCount() const { return m_layerCount; }
+
+  // Bind the framebuffer to layer and clear it, then the frames of the
+  // layer are rendered after beginFrame. The framebuffer binding and the
+  // viewport are not restored.
+  void beginLayer(GLsizei layer);
+  // Set the viewport to frame (x, y) of the layer
+  void beginFrame(int x, int y) const;
+  // Generate the mipmaps once every layer is rendered, release the
+  // framebuffer
+  void finish();
+
+  // GL_TEXTURE_2D_ARRAY of GL_SRGB8_ALPHA8 base color and coverage, and of
+  // GL_RGBA8 normals, mapped from [-1, 1] in rgb
+  GLuint albedo() const { return m_albedo; }
+  GLuint normals() const { return m_normals; }
+
+private:
+  GLsizei m_layerCount = 0;
+  GLTexture m_albedo;
+  GLTexture m_normals;
+  GLRenderbuffer m_depth;
+  GLFramebuffer m_framebuffer;
+};
@@ -0,0 +1,250 @@
+#include "job_system.hpp"
+
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+namespace
+{
+
+// Job system and queue of the current worker thread
+thread_local const JobSystem *t_jobSystem = nullptr;
+thread_local size_t t_queue = 0;
+
+std::atomic<size_t> g_sharedWorkerCount{0};
+
+// Bytes copied by one job of parallelCopy()
+const size_t COPY_CHUNK_SIZE = 1 << 22;
+
+} // namespace
+
+JobSystem::Group::~Group()
+{
+  if (m_jobSystem) {
+    m_jobSystem->wait(*this);
+  }
+}
+
+JobSystem::JobSystem(size_t workerCount)
+{
+  if (workerCount == 0) {
+    workerCount = std::max(1u, std::thread::hardware_concurrency()) - 1;
+  }
+  for (size_t i = 0; i <= workerCount; ++i) {
+    m_queues.push_back(std::make_unique<Queue>());
+  }
+  for (size_t i = 0; i < workerCount; ++i) {
+    m_threads.emplace_back([this, i]() { workerLoop(i); });
+  }
+}
+
+JobSystem::~JobSystem()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_wakeMutex);
+    m_stop = true;
+  }
+  m_wake.notify_all();
+  for (auto &thread : m_threads) {
+    thread.join();
+  }
+  // Without workers, the jobs left run here
+  while (runOne(queueIndex())) {
+  }
+}
+
+JobSystem &JobSystem::shared()
+{
+  static JobSystem jobSystem(g_sharedWorkerCount);
+  return jobSystem;
+}
+
+void JobSystem::setSharedWorkerCount(size_t workerCount)
+{
+  g_sharedWorkerCount = workerCount;
+}
+
+size_t JobSystem::queueIndex() const
+{
+  return t_jobSystem == this ? t_queue : m_threads.size();
+}
+
+void JobSystem::Queue::pushBack(Job job)
+{
+  if (count == jobs.size()) {
+    std::vector<Job> grown(std::max<size_t>(2 * jobs.size(), 16));
+    for (size_t i = 0; i < count; ++i) {
+      grown[i] = std::move(jobs[(front + i) % jobs.size()]);
+    }
+    jobs.swap(grown);
+    front = 0;
+  }
+  jobs[(front + count) % jobs.size()] = std::move(job);
+  ++count;
+}
+
+JobSystem::Job JobSystem::Queue::popBack()
+{
+  --count;
+  return std::move(jobs[(front + count) % jobs.size()]);
+}
+
+JobSystem::Job JobSystem::Queue::popFront()
+{
+  auto job = std::move(jobs[front]);
+  front = (front + 1) % jobs.size();
+  --count;
+  return job;
+}
+
+void JobSystem::push(Group &group, JobFunction function)
+{
+  group.m_jobSystem = this;
+  ++group.m_pending;
+  enqueue(group, std::move(function));
+}
+
+void JobSystem::pushAfter(Group &after, Group &group, JobFunction function)
+{
+  group.m_jobSystem = this;
+  ++group.m_pending;
+  {
+    std::lock_guard<std::mutex> lock(after.m_mutex);
+    if (after.m_pending > 0) {
+      after.m_continuations.push_back({std::move(function), &group});
+      return;
+    }
+  }
+  enqueue(group, std::move(function));
+}
+
+void JobSystem::enqueue(Group &group, JobFunction function)
+{
+  auto &queue = *m_queues[queueIndex()];
+  {
+    Job job;
+    job.function = std::move(function);
+    job.group = &group;
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.pushBack(std::move(job));
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_wakeMutex);
+    ++m_queuedCount;
+  }
+  m_wake.notify_one();
+}
+
+void JobSystem::finish(Group &group)
+{
+  std::vector<Group::Continuation> continuations;
+  {
+    std::lock_guard<std::mutex> lock(group.m_mutex);
+    if (--group.m_pending == 0) {
+      continuations.swap(group.m_continuations);
+    }
+  }
+  for (auto &continuation : continuations) {
+    enqueue(*continuation.group, std::move(continuation.function));
+  }
+}
+
+bool JobSystem::runOne(size_t queue)
+{
+  Job job;
+  bool found = false;
+  {
+    auto &own = *m_queues[queue];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (own.count > 0) {
+      job = own.popBack();
+      found = true;
+    }
+  }
+  for (size_t i = 1; !found && i < m_queues.size(); ++i) {
+    auto &other = *m_queues[(queue + i) % m_queues.size()];
+    std::lock_guard<std::mutex> lock(other.mutex);
+    if (other.count > 0) {
+      job = other.popFront();
+      found = true;
+      ++m_jobsStolen;
+    }
+  }
+  if (!found) {
+    return false;
+  }
+
+  --m_queuedCount;
+  {
+    TRACE_ZONE("job");
+    job.function();
+  }
+  // Destroyed before a waiter may return
+  job.function = JobFunction();
+  ++m_jobsRun;
+  finish(*job.group);
+  return true;
+}
+
+void JobSystem::wait(Group &group)
+{
+  const auto queue = queueIndex();
+  while (!group.done()) {
+    if (!runOne(queue)) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+void JobSystem::parallelFor(size_t count, size_t chunkSize, const void *body,
+    void (*call)(const void *, size_t, size_t))
+{
+  chunkSize = std::max<size_t>(chunkSize, 1);
+  if (count <= chunkSize || m_threads.empty()) {
+    if (count) {
+      call(body, 0, count);
+    }
+    return;
+  }
+
+  // The calling thread takes the first range
+  Group group;
+  for (size_t begin = chunkSize; begin < count; begin += chunkSize) {
+    const auto end = std::min(begin + chunkSize, count);
+    run(group, [body, call, begin, end]() { call(body, begin, end); });
+  }
+  call(body, 0, chunkSize);
+  wait(group);
+}
+
+void JobSystem::workerLoop(size_t queue)
+{
+  t_jobSystem = this;
+  t_queue = queue;
+  setTraceThreadName("Job worker " + std::to_string(queue + 1));
+  for (;;) {
+    if (runOne(queue)) {
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(m_wakeMutex);
+    m_wake.wait(lock, [&]() { return m_stop || m_queuedCount > 0; });
+    if (m_stop && m_queuedCount == 0) {
+      return;
+    }
+  }
+}
+
+void parallelCopy(void *destination, const void *source, size_t size)
+{
+  auto *to = static_cast<unsigned char *>(destination);
+  const auto *from = static_cast<const unsigned char *>(source);
+  const auto chunkCount = (size + COPY_CHUNK_SIZE - 1) / COPY_CHUNK_SIZE;
+  JobSystem::shared().parallelFor(
+      chunkCount, 1, [&](size_t beginChunk, size_t endChunk) {
+        const auto begin = beginChunk * COPY_CHUNK_SIZE;
+        const auto end = std::min(endChunk * COPY_CHUNK_SIZE, size);
+        std::memcpy(to + begin, from + begin, end - begin);
+      });
+}
@@ -0,0 +1,251 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Callable of a job, stored in place unless larger than STORAGE_SIZE, so that
+// running jobs of small captures allocates nothing from the heap
+class JobFunction
+{
+public:
+  static const size_t STORAGE_SIZE = 64;
+
+  JobFunction() = default;
+
+  template <typename F,
+      typename = typename std::enable_if<!std::is_same<
+          typename std::decay<F>::type, JobFunction>::value>::type>
+  explicit JobFunction(F &&function)
+  {
+    using Callable = typename std::decay<F>::type;
+    using Stored = typename std::conditional<sizeof(Callable) <= STORAGE_SIZE &&
+                                                 alignof(Callable) <=
+                                                     alignof(std::max_align_t),
+        Callable, std::unique_ptr<Callable>>::type;
+    new (m_storage) Stored(makeStored<Stored>(std::forward<F>(function)));
+    m_ops = &opsOf<Stored>();
+  }
+
+  JobFunction(JobFunction &&other) noexcept { *this = std::move(other); }
+  JobFunction &operator=(JobFunction &&other) noexcept
+  {
+    if (this != &other) {
+      reset();
+      if (other.m_ops) {
+        other.m_ops->move(other.m_storage, m_storage);
+        m_ops = other.m_ops;
+        other.reset();
+      }
+    }
+    return *this;
+  }
+  ~JobFunction() { reset(); }
+
+  void operator()() { m_ops->invoke(m_storage); }
+
+private:
+  struct Ops
+  {
+    void (*invoke)(void *);
+    void (*move)(void *from, void *to); // Leaves from to be destroyed
+    void (*destroy)(void *);
+  };
+
+  template <typename T> static T &call(T &callable) { return callable; }
+  template <typename T> static T &call(std::unique_ptr<T> &callable)
+  {
+    return *callable;
+  }
+
+  template <typename Stored, typename F>
+  static typename std::enable_if<!std::is_same<Stored,
+                                     typename std::decay<F>::type>::value,
+      Stored>::type
+  makeStored(F &&function)
+  {
+    return Stored(new typename std::decay<F>::type(std::forward<F>(function)));
+  }
+  template <typename Stored, typename F>
+  static typename std::enable_if<
+      std::is_same<Stored, typename std::decay<F>::type>::value, Stored>::type
+  makeStored(F &&function)
+  {
+    return Stored(std::forward<F>(function));
+  }
+
+  template <typename Stored> static const Ops &opsOf()
+  {
+    static const Ops ops = {
+        [](void *storage) { call(*static_cast<Stored *>(storage))(); },
+        [](void *from, void *to) {
+          new (to) Stored(std::move(*static_cast<Stored *>(from)));
+        },
+        [](void *storage) { static_cast<Stored *>(storage)->~Stored(); }};
+    return ops;
+  }
+
+  void reset()
+  {
+    if (m_ops) {
+      m_ops->destroy(m_storage);
+      m_ops = nullptr;
+    }
+  }
+
+  alignas(std::max_align_t) unsigned char m_storage[STORAGE_SIZE];
+  const Ops *m_ops = nullptr;
+};
+
+// Worker threads running small jobs. Each worker takes the jobs it spawned
+// from the back of its own queue and, when it runs out, steals the oldest job
+// of another queue, so that a job splitting its work keeps the pieces on the
+// other workers busy. Jobs run in a Group that can be waited for: the
+// waiting thread runs queued jobs meanwhile, so a job may wait for the jobs it
+// spawned without blocking a worker. The loading code and the viewer share
+// the shared() job system instead of starting threads of their own.
+class JobSystem
+{
+public:
+  // Jobs of a group, waited for together. Destroying a group waits for its
+  // jobs, so a group declared after the variables its jobs capture keeps them
+  // alive on every return.
+  class Group
+  {
+  public:
+    Group() = default;
+    ~Group();
+
+    Group(const Group &) = delete;
+    Group &operator=(const Group &) = delete;
+
+    bool done() const
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      return m_pending == 0;
+    }
+
+  private:
+    friend class JobSystem;
+
+    struct Continuation
+    {
+      JobFunction function;
+      Group *group;
+    };
+
+    // Decremented with m_mutex locked, so that finishing the last job does
+    // not touch the group once a waiter may see it done
+    std::atomic<size_t> m_pending{0};
+    mutable std::mutex m_mutex;
+    std::vector<Continuation> m_continuations; // Queued when done
+    JobSystem *m_jobSystem = nullptr; // Of the last job
+  };
+
+  // Jobs run since the job system started, by every thread
+  struct Stats
+  {
+    size_t jobsRun = 0;
+    size_t jobsStolen = 0; // Taken from the queue of another thread
+  };
+
+  // One worker less than the hardware threads if workerCount is 0, the
+  // thread waiting for jobs being the last one
+  explicit JobSystem(size_t workerCount = 0);
+  ~JobSystem(); // Runs the queued jobs, then joins the workers
+
+  JobSystem(const JobSystem &) = delete;
+  JobSystem &operator=(const JobSystem &) = delete;
+
+  // Created on first use, with the workers of setSharedWorkerCount()
+  static JobSystem &shared();
+  // Workers of the shared job system, 0 for the default of the constructor.
+  // Has no effect once shared() has been called.
+  static void setSharedWorkerCount(size_t workerCount);
+
+  size_t workerCount() const { return m_threads.size(); }
+  Stats stats() const { return {m_jobsRun.load(), m_jobsStolen.load()}; }
+
+  template <typename F> void run(Group &group, F &&job)
+  {
+    push(group, JobFunction(std::forward<F>(job)));
+  }
+  // Run job in group once every job of after is done, or right away if after
+  // is already done. Waiting for group waits for the job, not for after.
+  template <typename F> void runAfter(Group &after, Group &group, F &&job)
+  {
+    pushAfter(after, group, JobFunction(std::forward<F>(job)));
+  }
+  // Run jobs until every job of the group is done
+  void wait(Group &group);
+  // Run one queued job on the calling thread, false if none is queued
+  bool runQueued() { return runOne(queueIndex()); }
+
+  // Call body(begin, end) on ranges of at most chunkSize indices covering
+  // [0, count), in parallel, and return once every range is done
+  template <typename Body>
+  void parallelFor(size_t count, size_t chunkSize, const Body &body)
+  {
+    parallelFor(count, chunkSize, &body,
+        [](const void *body, size_t begin, size_t end) {
+          (*static_cast<const Body *>(body))(begin, end);
+        });
+  }
+
+private:
+  struct Job
+  {
+    JobFunction function;
+    Group *group = nullptr;
+  };
+
+  // Ring of jobs, its capacity kept once grown
+  struct Queue
+  {
+    std::mutex mutex;
+    std::vector<Job> jobs;
+    size_t front = 0;
+    size_t count = 0;
+
+    void pushBack(Job job);
+    Job popBack();
+    Job popFront();
+  };
+
+  void push(Group &group, JobFunction job);
+  void pushAfter(Group &after, Group &group, JobFunction job);
+  // Queue a job already counted in its group
+  void enqueue(Group &group, JobFunction function);
+  // Count a job of group as done, queueing its continuations if it was the
+  // last one
+  void finish(Group &group);
+  void parallelFor(size_t count, size_t chunkSize, const void *body,
+      void (*call)(const void *, size_t, size_t));
+
+  // Queue of the calling thread, the shared one out of the workers
+  size_t queueIndex() const;
+  // Run a job of the own queue or a stolen one, false if every queue is empty
+  bool runOne(size_t queue);
+  void workerLoop(size_t queue);
+
+  // One per worker, then the one of the other threads
+  std::vector<std::unique_ptr<Queue>> m_queues;
+  std::vector<std::thread> m_threads;
+  std::atomic<size_t> m_queuedCount{0};
+  std::atomic<size_t> m_jobsRun{0};
+  std::atomic<size_t> m_jobsStolen{0};
+  std::mutex m_wakeMutex;
+  std::condition_variable m_wake;
+  bool m_stop = false;
+};
+
+// Copy size bytes with the jobs of JobSystem::shared(), in chunks of a few MB,
+// as when filling a mapped staging buffer with a large upload
+void parallelCopy(void *destination, const void *source, size_t size);
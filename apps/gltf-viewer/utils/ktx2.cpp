@@ -0,0 +1,262 @@
+#include "ktx2.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+// Not part of core OpenGL, glad is not generated with this extension
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+#define GL_COMPRESSED_RGBA_S3TC_DXT3_EXT 0x83F2
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT 0x8C4D
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT 0x8C4E
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+
+namespace
+{
+
+const unsigned char KTX2_IDENTIFIER[12] = {
+    0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+const size_t KTX2_HEADER_SIZE = 80; // Identifier, header and index
+const size_t KTX2_LEVEL_INDEX_ENTRY_SIZE = 24;
+
+struct FormatInfo
+{
+  uint32_t vkFormat;
+  GLenum internalFormat;
+  GLenum srgbInternalFormat; // 0 if the format has no sRGB variant
+  uint32_t blockSize; // Bytes per 4x4 block, 0 for uncompressed RGBA8
+  bool needsS3tc;
+};
+
+// The _UNORM and _SRGB variants of a format share their entry: how the texels
+// are decoded depends on the material slot sampling the texture, see
+// uploadKtx2Texture
+const FormatInfo FORMATS[] = {
+    {37, GL_RGBA8, GL_SRGB8_ALPHA8, 0, false}, // VK_FORMAT_R8G8B8A8_UNORM
+    {43, GL_RGBA8, GL_SRGB8_ALPHA8, 0, false}, // VK_FORMAT_R8G8B8A8_SRGB
+    {131, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_COMPRESSED_SRGB_S3TC_DXT1_EXT, 8,
+        true}, // BC1_RGB
+    {132, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_COMPRESSED_SRGB_S3TC_DXT1_EXT, 8,
+        true},
+    {133, GL_COMPRESSED_RGBA_S3TC_DXT1_EXT,
+        GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT, 8, true}, // BC1_RGBA
+    {134, GL_COMPRESSED_RGBA_S3TC_DXT1_EXT,
+        GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT, 8, true},
+    {135, GL_COMPRESSED_RGBA_S3TC_DXT3_EXT,
+        GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT, 16, true}, // BC2
+    {136, GL_COMPRESSED_RGBA_S3TC_DXT3_EXT,
+        GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT, 16, true},
+    {137, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,
+        GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT, 16, true}, // BC3
+    {138, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,
+        GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT, 16, true},
+    {139, GL_COMPRESSED_RED_RGTC1, 0, 8, false}, // BC4
+    {140, GL_COMPRESSED_SIGNED_RED_RGTC1, 0, 8, false},
+    {141, GL_COMPRESSED_RG_RGTC2, 0, 16, false}, // BC5
+    {142, GL_COMPRESSED_SIGNED_RG_RGTC2, 0, 16, false},
+    {143, GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT, 0, 16, false}, // BC6H
+    {144, GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT, 0, 16, false},
+    {145, GL_COMPRESSED_RGBA_BPTC_UNORM, GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM,
+        16, false}, // BC7
+    {146, GL_COMPRESSED_RGBA_BPTC_UNORM, GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM,
+        16, false},
+    {147, GL_COMPRESSED_RGB8_ETC2, GL_COMPRESSED_SRGB8_ETC2, 8, false},
+    {148, GL_COMPRESSED_RGB8_ETC2, GL_COMPRESSED_SRGB8_ETC2, 8, false},
+    {149, GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2,
+        GL_COMPRESSED_SRGB8_PUNCHTHROUGH_ALPHA1_ETC2, 8, false},
+    {150, GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2,
+        GL_COMPRESSED_SRGB8_PUNCHTHROUGH_ALPHA1_ETC2, 8, false},
+    {151, GL_COMPRESSED_RGBA8_ETC2_EAC, GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC, 16,
+        false},
+    {152, GL_COMPRESSED_RGBA8_ETC2_EAC, GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC, 16,
+        false},
+    {153, GL_COMPRESSED_R11_EAC, 0, 8, false},
+    {154, GL_COMPRESSED_SIGNED_R11_EAC, 0, 8, false},
+    {155, GL_COMPRESSED_RG11_EAC, 0, 16, false},
+    {156, GL_COMPRESSED_SIGNED_RG11_EAC, 0, 16, false}};
+
+uint32_t readU32(const unsigned char *bytes)
+{
+  uint32_t value;
+  std::memcpy(&value, bytes, sizeof(value));
+  return value;
+}
+
+uint64_t readU64(const unsigned char *bytes)
+{
+  uint64_t value;
+  std::memcpy(&value, bytes, sizeof(value));
+  return value;
+}
+
+size_t levelByteSize(const FormatInfo &format, uint32_t width, uint32_t height)
+{
+  if (!format.blockSize) {
+    return size_t(width) * height * 4;
+  }
+  return size_t((width + 3) / 4) * ((height + 3) / 4) * format.blockSize;
+}
+
+} // namespace
+
+bool isKtx2(const unsigned char *bytes, size_t size)
+{
+  return size >= sizeof(KTX2_IDENTIFIER) &&
+         std::memcmp(bytes, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) == 0;
+}
+
+bool parseKtx2(const unsigned char *bytes, size_t size, Ktx2Texture &texture,
+    std::string &err)
+{
+  if (!isKtx2(bytes, size) || size < KTX2_HEADER_SIZE) {
+    err = "Invalid KTX2 header";
+    return false;
+  }
+
+  const auto vkFormat = readU32(bytes + 12);
+  const auto width = readU32(bytes + 20);
+  const auto height = readU32(bytes + 24);
+  const auto depth = readU32(bytes + 28);
+  const auto layerCount = readU32(bytes + 32);
+  const auto faceCount = readU32(bytes + 36);
+  const auto levelCount = std::max(readU32(bytes + 40), 1u);
+  const auto supercompressionScheme = readU32(bytes + 44);
+
+  if (vkFormat == 0 || supercompressionScheme != 0) {
+    err = "Supercompressed or Basis Universal KTX2 textures are not supported";
+    return false;
+  }
+  if (width == 0 || height == 0 || depth > 1 || layerCount > 1 ||
+      faceCount != 1) {
+    err = "Only 2D KTX2 textures are supported";
+    return false;
+  }
+
+  const auto it = std::find_if(std::begin(FORMATS), std::end(FORMATS),
+      [&](const FormatInfo &format) { return format.vkFormat == vkFormat; });
+  if (it == std::end(FORMATS)) {
+    err = "Unsupported KTX2 format " + std::to_string(vkFormat);
+    return false;
+  }
+  const auto &format = *it;
+
+  // Levels down to 1x1 at most, so that the sizes of the levels are never
+  // shifted by 32 bits or more
+  uint32_t maxLevelCount = 1;
+  for (auto side = std::max(width, height); side > 1; side >>= 1) {
+    ++maxLevelCount;
+  }
+  if (levelCount > maxLevelCount) {
+    err = "Invalid KTX2 level count";
+    return false;
+  }
+
+  if (KTX2_HEADER_SIZE + size_t(levelCount) * KTX2_LEVEL_INDEX_ENTRY_SIZE >
+      size) {
+    err = "Truncated KTX2 level index";
+    return false;
+  }
+
+  texture.internalFormat = format.internalFormat;
+  texture.srgbInternalFormat = format.srgbInternalFormat;
+  texture.compressed = format.blockSize != 0;
+  texture.needsS3tc = format.needsS3tc;
+  texture.width = GLsizei(width);
+  texture.height = GLsizei(height);
+  texture.levels.clear();
+
+  for (uint32_t level = 0; level < levelCount; ++level) {
+    const auto *entry =
+        bytes + KTX2_HEADER_SIZE + level * KTX2_LEVEL_INDEX_ENTRY_SIZE;
+    const auto byteOffset = readU64(entry);
+    const auto byteLength = readU64(entry + 8);
+    const auto expectedLength = levelByteSize(format,
+        std::max(width >> level, 1u), std::max(height >> level, 1u));
+    if (byteOffset > size || byteLength > size - byteOffset ||
+        byteLength < expectedLength) {
+      err = "Invalid KTX2 mip level " + std::to_string(level);
+      return false;
+    }
+    texture.levels.push_back({bytes + byteOffset, expectedLength});
+  }
+
+  return true;
+}
+
+void dropKtx2Levels(Ktx2Texture &texture, int maxSize)
+{
+  while (maxSize > 0 && texture.levels.size() > 1 &&
+         std::max(texture.width, texture.height) > maxSize) {
+    texture.levels.erase(texture.levels.begin());
+    texture.width = std::max(texture.width / 2, 1);
+    texture.height = std::max(texture.height / 2, 1);
+  }
+}
+
+bool isKtx2FormatSupported(const Ktx2Texture &texture)
+{
+  if (!texture.needsS3tc) {
+    return true; // Core since OpenGL 4.3
+  }
+
+  GLint extensionCount = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+  for (GLint i = 0; i < extensionCount; ++i) {
+    const auto *name =
+        reinterpret_cast<const char *>(glGetStringi(GL_EXTENSIONS, GLuint(i)));
+    if (name && std::strcmp(name, "GL_EXT_texture_compression_s3tc") == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+GLenum getKtx2InternalFormat(const Ktx2Texture &texture, bool srgb)
+{
+  return srgb && texture.srgbInternalFormat ? texture.srgbInternalFormat
+                                            : texture.internalFormat;
+}
+
+void uploadKtx2Texture(const Ktx2Texture &texture, bool srgb, bool mipmaps,
+    TextureUploader &uploader)
+{
+  const auto internalFormat = getKtx2InternalFormat(texture, srgb);
+  // Compressed mip levels cannot be generated
+  const bool generateMipmaps =
+      mipmaps && texture.levels.size() == 1 && !texture.compressed;
+  auto levelCount = GLsizei(texture.levels.size());
+  if (generateMipmaps) {
+    while (std::max(texture.width, texture.height) >> levelCount) {
+      ++levelCount;
+    }
+  }
+  glTexStorage2D(GL_TEXTURE_2D, levelCount, internalFormat, texture.width,
+      texture.height);
+
+  for (size_t i = 0; i < texture.levels.size(); ++i) {
+    const auto &level = texture.levels[i];
+    const auto width = std::max(texture.width >> i, 1);
+    const auto height = std::max(texture.height >> i, 1);
+    const auto *data = uploader.stage(level.data, level.size);
+
+    if (texture.compressed) {
+      glCompressedTexSubImage2D(GL_TEXTURE_2D, GLint(i), 0, 0, width, height,
+          internalFormat, GLsizei(level.size), data);
+    } else {
+      glTexSubImage2D(GL_TEXTURE_2D, GLint(i), 0, 0, width, height, GL_RGBA,
+          GL_UNSIGNED_BYTE, data);
+    }
+  }
+
+  if (generateMipmaps) {
+    glGenerateMipmap(GL_TEXTURE_2D);
+  }
+}
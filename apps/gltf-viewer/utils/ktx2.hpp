@@ -0,0 +1,58 @@
+#pragma once
+
+#include "texture_uploader.hpp"
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// A 2D texture read from a KTX2 container
+// https://github.khronos.org/KTX-Specification/
+struct Ktx2Texture
+{
+  struct Level
+  {
+    const unsigned char *data = nullptr; // Points into the file bytes
+    size_t size = 0;
+  };
+
+  GLenum internalFormat = 0;
+  GLenum srgbInternalFormat = 0; // Same blocks decoded from sRGB, 0 if none
+  bool compressed = false; // Otherwise GL_RGBA / GL_UNSIGNED_BYTE pixels
+  bool needsS3tc = false; // Requires GL_EXT_texture_compression_s3tc
+  GLsizei width = 0;
+  GLsizei height = 0;
+  std::vector<Level> levels; // Level 0 is the full resolution image
+};
+
+// Return true if the bytes start with the KTX2 file identifier
+bool isKtx2(const unsigned char *bytes, size_t size);
+
+// Read the header and mip levels of a KTX2 file. Only textures stored in a
+// block-compressed format GL can sample directly (BC1-7, ETC2/EAC) or in RGBA8
+// are supported, without supercompression. Basis Universal payloads (BasisLZ
+// or UASTC) would need a transcoder and are rejected.
+bool parseKtx2(const unsigned char *bytes, size_t size, Ktx2Texture &texture,
+    std::string &err);
+
+// Drop the first levels while the largest side of the texture is above
+// maxSize texels and levels are left, none if maxSize is 0. The texture
+// starts at a coarser level instead of being resampled.
+void dropKtx2Levels(Ktx2Texture &texture, int maxSize);
+
+// Return false if the current context cannot sample the texture format
+bool isKtx2FormatSupported(const Ktx2Texture &texture);
+
+// Format the texture is uploaded with, the sRGB variant of its format if srgb is
+// true and there is one
+GLenum getKtx2InternalFormat(const Ktx2Texture &texture, bool srgb);
+
+// Allocate immutable storage for the texture bound on GL_TEXTURE_2D and upload
+// its mip levels. If srgb is true and the format has an sRGB variant, texels
+// are decoded from sRGB when sampled. If mipmaps is true and the file only
+// stores the first level of RGBA8 texels, the other levels are generated.
+// Levels are streamed through uploader.
+void uploadKtx2Texture(const Ktx2Texture &texture, bool srgb, bool mipmaps,
+    TextureUploader &uploader);
@@ -0,0 +1,64 @@
+#include "lights.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+// Index in model.lights of the light of a node, -1 if it has none
+int nodeLight(const tinygltf::Node &node)
+{
+  const auto it = node.extensions.find("KHR_lights_punctual");
+  if (it == end(node.extensions) || !(*it).second.Has("light")) {
+    return -1;
+  }
+  return int((*it).second.Get("light").GetNumberAsInt());
+}
+
+} // namespace
+
+void getPunctualLights(const tinygltf::Model &model,
+    const SceneGraph &sceneGraph, std::vector<PunctualLight> &lights)
+{
+  lights.clear();
+  for (size_t i = 0; i < sceneGraph.size(); ++i) {
+    const auto lightIdx = nodeLight(model.nodes[sceneGraph.node(i)]);
+    if (lightIdx < 0 || size_t(lightIdx) >= model.lights.size()) {
+      continue;
+    }
+
+    const auto &light = model.lights[lightIdx];
+    PunctualLight punctual;
+    glm::vec3 color(1);
+    if (light.color.size() == 3) {
+      color = glm::vec3(light.color[0], light.color[1], light.color[2]);
+    }
+    const auto type = light.type == "directional"
+                          ? LIGHT_TYPE_DIRECTIONAL
+                          : light.type == "spot" ? LIGHT_TYPE_SPOT
+                                                 : LIGHT_TYPE_POINT;
+    punctual.colorType =
+        glm::vec4(color * float(light.intensity), float(type));
+
+    // Lights point to -Z in their node space
+    const auto &worldMatrix = sceneGraph.worldMatrix(i);
+    punctual.positionRange =
+        glm::vec4(glm::vec3(worldMatrix[3]), float(light.range));
+    punctual.directionScale = glm::vec4(
+        glm::normalize(glm::mat3(worldMatrix) * glm::vec3(0, 0, -1)), 0);
+
+    // Smooth falloff between the cones, see the KHR_lights_punctual spec
+    if (type == LIGHT_TYPE_SPOT) {
+      const auto cosOuter = float(std::cos(light.spot.outerConeAngle));
+      const auto cosInner = float(std::cos(light.spot.innerConeAngle));
+      const auto scale = 1.f / std::max(0.001f, cosInner - cosOuter);
+      punctual.directionScale.w = scale;
+      punctual.spotOffset = glm::vec4(-cosOuter * scale, 0, 0, 0);
+    } else {
+      punctual.spotOffset = glm::vec4(0);
+    }
+
+    lights.push_back(punctual);
+  }
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "scene_graph.hpp"
+
+#include <glm/glm.hpp>
+#include <tiny_gltf.h>
+
+#include <vector>
+
+enum PunctualLightType
+{
+  LIGHT_TYPE_DIRECTIONAL,
+  LIGHT_TYPE_POINT,
+  LIGHT_TYPE_SPOT
+};
+
+// std430 layout of PunctualLight in pbr_directional_light.fs.glsl and
+// cluster_lights.cs.glsl
+struct PunctualLight
+{
+  glm::vec4 positionRange; // World space position, range (0 if infinite)
+  glm::vec4 colorType; // Color times intensity, PunctualLightType
+  // World space direction the light points to, spot cone angle scale
+  glm::vec4 directionScale;
+  glm::vec4 spotOffset; // Spot cone angle offset, yzw unused
+};
+
+// The KHR_lights_punctual lights of the nodes of a scene graph, placed by its
+// world matrices
+void getPunctualLights(const tinygltf::Model &model,
+    const SceneGraph &sceneGraph, std::vector<PunctualLight> &lights);
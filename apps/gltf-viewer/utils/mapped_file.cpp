@@ -0,0 +1,131 @@
+#include "mapped_file.hpp"
+
+#include <utility>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const fs::path &path)
+{
+  const auto file = CreateFileW(path.wstring().c_str(), GENERIC_READ,
+      FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN,
+      nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return;
+  }
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+    CloseHandle(file);
+    return;
+  }
+
+  const auto mapping =
+      CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!mapping) {
+    CloseHandle(file);
+    return;
+  }
+
+  const auto view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (!view) {
+    CloseHandle(mapping);
+    CloseHandle(file);
+    return;
+  }
+
+  m_file = file;
+  m_mapping = mapping;
+  m_data = static_cast<const unsigned char *>(view);
+  m_size = size_t(size.QuadPart);
+}
+
+MappedFile::~MappedFile()
+{
+  if (m_data) {
+    UnmapViewOfFile(m_data);
+    CloseHandle(m_mapping);
+    CloseHandle(m_file);
+  }
+}
+
+void MappedFile::prefetch() const
+{
+#if _WIN32_WINNT >= 0x0602
+  if (m_data) {
+    WIN32_MEMORY_RANGE_ENTRY range = {
+        const_cast<unsigned char *>(m_data), m_size};
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+  }
+#endif
+}
+
+void MappedFile::swap(MappedFile &other)
+{
+  std::swap(m_data, other.m_data);
+  std::swap(m_size, other.m_size);
+  std::swap(m_file, other.m_file);
+  std::swap(m_mapping, other.m_mapping);
+}
+
+#else
+
+MappedFile::MappedFile(const fs::path &path)
+{
+  const auto fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return;
+  }
+
+  const auto size = size_t(st.st_size);
+  void *addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping stays valid after the descriptor is closed
+  close(fd);
+  if (addr == MAP_FAILED) {
+    return;
+  }
+
+  // Buffers are uploaded front to back
+  madvise(addr, size, MADV_SEQUENTIAL);
+
+  m_data = static_cast<const unsigned char *>(addr);
+  m_size = size;
+}
+
+MappedFile::~MappedFile()
+{
+  if (m_data) {
+    munmap(const_cast<unsigned char *>(m_data), m_size);
+  }
+}
+
+void MappedFile::prefetch() const
+{
+  if (m_data) {
+    madvise(const_cast<unsigned char *>(m_data), m_size, MADV_WILLNEED);
+  }
+}
+
+void MappedFile::swap(MappedFile &other)
+{
+  std::swap(m_data, other.m_data);
+  std::swap(m_size, other.m_size);
+}
+
+#endif
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "filesystem.hpp"
+
+#include <cstddef>
+#include <utility>
+
+// Read-only memory mapping of a whole file (POSIX mmap or Win32 file mapping).
+// Reading through the mapping goes straight to the page cache, so the process
+// does not hold a private copy of the file contents.
+class MappedFile
+{
+public:
+  MappedFile() = default;
+
+  // Map the file, check isOpen() to know if it succeeded
+  explicit MappedFile(const fs::path &path);
+
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  MappedFile(MappedFile &&rvalue) { swap(rvalue); }
+
+  MappedFile &operator=(MappedFile &&rvalue)
+  {
+    MappedFile(std::move(rvalue)).swap(*this);
+    return *this;
+  }
+
+  bool isOpen() const { return m_data != nullptr; }
+
+  const unsigned char *data() const { return m_data; }
+
+  size_t size() const { return m_size; }
+
+  // Start reading the whole file into the page cache without waiting, so that
+  // the reads of several mappings overlap instead of faulting in page by page
+  void prefetch() const;
+
+private:
+  void swap(MappedFile &other);
+
+  const unsigned char *m_data = nullptr;
+  size_t m_size = 0;
+#ifdef _WIN32
+  void *m_file = nullptr;
+  void *m_mapping = nullptr;
+#endif
+};
@@ -0,0 +1,811 @@
+#include "mesh_optimizer.hpp"
+
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace
+{
+
+const uint32_t NONE = 0xffffffff;
+
+// Simulated LRU cache of optimizeVertexCache(), larger than the hardware ones
+// so that its order stays good whatever their size
+const int VERTEX_CACHE_SIZE = 32;
+const float CACHE_DECAY_POWER = 1.5f;
+const float LAST_TRIANGLE_SCORE = 0.75f;
+const float VALENCE_BOOST_SCALE = 2.f;
+const float VALENCE_BOOST_POWER = 0.5f;
+
+const size_t OVERDRAW_CACHE_SIZE = 16;
+
+float vertexScore(int cachePosition, uint32_t liveTriangles)
+{
+  if (liveTriangles == 0) {
+    return -1.f; // Nothing left to draw with it
+  }
+  float score = 0.f;
+  if (cachePosition >= 0) {
+    // The vertices of the last triangle get a fixed score, so that the next
+    // one does not simply reuse its edge
+    score = cachePosition < 3
+                ? LAST_TRIANGLE_SCORE
+                : std::pow(1.f - float(cachePosition - 3) /
+                                     float(VERTEX_CACHE_SIZE - 3),
+                      CACHE_DECAY_POWER);
+  }
+  // Vertices with few triangles left are finished first, not to leave
+  // isolated triangles behind
+  return score + VALENCE_BOOST_SCALE *
+                     std::pow(float(liveTriangles), -VALENCE_BOOST_POWER);
+}
+
+// FIFO cache of the hardware, reset by advancing the time past its size
+struct FifoCache
+{
+  std::vector<size_t> timestamps; // 0 if the vertex was never transformed
+  size_t time;
+  size_t size;
+
+  FifoCache(size_t vertexCount, size_t cacheSize) :
+      timestamps(vertexCount, 0), time(cacheSize + 1), size(cacheSize)
+  {
+  }
+
+  // Whether the vertex is transformed again, then cache it
+  bool miss(uint32_t vertex)
+  {
+    if (timestamps[vertex] && time - timestamps[vertex] <= size) {
+      return false;
+    }
+    timestamps[vertex] = time++;
+    return true;
+  }
+
+  void reset() { time += size + 1; }
+};
+
+// Sum of squared distances to the planes of the triangles around a vertex,
+// weighted by their area, as a symmetric 4x4 matrix
+struct Quadric
+{
+  double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+  double b0 = 0, b1 = 0, b2 = 0;
+  double c = 0;
+  double weight = 0;
+
+  Quadric &operator+=(const Quadric &other)
+  {
+    a00 += other.a00;
+    a01 += other.a01;
+    a02 += other.a02;
+    a11 += other.a11;
+    a12 += other.a12;
+    a22 += other.a22;
+    b0 += other.b0;
+    b1 += other.b1;
+    b2 += other.b2;
+    c += other.c;
+    weight += other.weight;
+    return *this;
+  }
+
+  void addPlane(const glm::dvec3 &normal, double distance, double area)
+  {
+    a00 += area * normal.x * normal.x;
+    a01 += area * normal.x * normal.y;
+    a02 += area * normal.x * normal.z;
+    a11 += area * normal.y * normal.y;
+    a12 += area * normal.y * normal.z;
+    a22 += area * normal.z * normal.z;
+    b0 += area * normal.x * distance;
+    b1 += area * normal.y * distance;
+    b2 += area * normal.z * distance;
+    c += area * distance * distance;
+    weight += area;
+  }
+
+  // Mean squared distance of a point to the planes
+  double error(const glm::vec3 &point) const
+  {
+    const glm::dvec3 p(point);
+    const auto value = a00 * p.x * p.x + 2 * a01 * p.x * p.y +
+                       2 * a02 * p.x * p.z + a11 * p.y * p.y +
+                       2 * a12 * p.y * p.z + a22 * p.z * p.z +
+                       2 * (b0 * p.x + b1 * p.y + b2 * p.z) + c;
+    return weight > 0 ? std::max(value, 0.) / weight : 0.;
+  }
+};
+
+struct Collapse
+{
+  uint32_t from;
+  uint32_t to;
+  double error;
+};
+
+uint64_t edgeKey(uint32_t a, uint32_t b)
+{
+  return (uint64_t(a) << 32) | b;
+}
+
+// Whether moving vertex from to the position of vertex to flips or degenerates
+// one of the triangles around it that does not also contain to
+bool collapseFlips(const uint32_t *indices, const uint32_t *triangles,
+    size_t triangleCount, const std::vector<glm::vec3> &positions,
+    uint32_t from, uint32_t to)
+{
+  for (size_t k = 0; k < triangleCount; ++k) {
+    const auto *triangle = indices + size_t(triangles[k]) * 3;
+    if (triangle[0] == to || triangle[1] == to || triangle[2] == to) {
+      continue;
+    }
+    glm::vec3 corners[3];
+    glm::vec3 moved[3];
+    for (int i = 0; i < 3; ++i) {
+      corners[i] = positions[triangle[i]];
+      moved[i] = triangle[i] == from ? positions[to] : corners[i];
+    }
+    const auto normal =
+        glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+    const auto movedNormal =
+        glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+    // Reject triangles turning by more than about 75 degrees
+    if (glm::dot(normal, movedNormal) <=
+        0.25f * glm::length(normal) * glm::length(movedNormal)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+} // namespace
+
+float averageCacheMissRatio(const uint32_t *indices, size_t indexCount,
+    size_t vertexCount, size_t cacheSize)
+{
+  if (indexCount < 3) {
+    return 0.f;
+  }
+  FifoCache cache(vertexCount, cacheSize);
+  size_t misses = 0;
+  for (size_t i = 0; i < indexCount; ++i) {
+    misses += cache.miss(indices[i]);
+  }
+  return float(misses) / float(indexCount / 3);
+}
+
+void optimizeVertexCache(
+    uint32_t *indices, size_t indexCount, size_t vertexCount)
+{
+  TRACE_ZONE("optimizeVertexCache");
+  const auto triangleCount = indexCount / 3;
+  if (triangleCount < 2) {
+    return;
+  }
+
+  // Triangles of each vertex
+  std::vector<uint32_t> liveTriangles(vertexCount, 0);
+  for (size_t i = 0; i < triangleCount * 3; ++i) {
+    ++liveTriangles[indices[i]];
+  }
+  std::vector<uint32_t> firstTriangle(vertexCount + 1, 0);
+  for (size_t v = 0; v < vertexCount; ++v) {
+    firstTriangle[v + 1] = firstTriangle[v] + liveTriangles[v];
+  }
+  std::vector<uint32_t> vertexTriangles(triangleCount * 3);
+  {
+    auto next = firstTriangle;
+    for (size_t i = 0; i < triangleCount * 3; ++i) {
+      vertexTriangles[next[indices[i]]++] = uint32_t(i / 3);
+    }
+  }
+
+  std::vector<float> vertexScores(vertexCount);
+  for (size_t v = 0; v < vertexCount; ++v) {
+    vertexScores[v] = vertexScore(-1, liveTriangles[v]);
+  }
+
+  std::vector<char> emitted(triangleCount, 0);
+  std::vector<uint32_t> order;
+  order.reserve(indexCount);
+
+  // The cache holds the vertices of the new triangle first, then the ones it
+  // had, one more than its size while they are shifted out
+  uint32_t cache[VERTEX_CACHE_SIZE + 3];
+  int cacheCount = 0;
+
+  size_t cursor = 0; // Triangles before it are emitted
+  auto best = NONE;
+  for (size_t emittedCount = 0; emittedCount < triangleCount;
+       ++emittedCount) {
+    if (best == NONE) {
+      // The cache has no vertex with triangles left, start from the next
+      // triangle in the input
+      while (emitted[cursor]) {
+        ++cursor;
+      }
+      best = uint32_t(cursor);
+    }
+
+    const auto *triangle = indices + size_t(best) * 3;
+    order.insert(order.end(), triangle, triangle + 3);
+    emitted[best] = 1;
+
+    uint32_t newCache[VERTEX_CACHE_SIZE + 3];
+    int newCount = 0;
+    for (int k = 0; k < 3; ++k) {
+      const auto v = triangle[k];
+      newCache[newCount++] = v;
+
+      // Remove the triangle from the list of live ones of the vertex
+      auto *begin = vertexTriangles.data() + firstTriangle[v];
+      auto *end = begin + liveTriangles[v];
+      *std::find(begin, end, best) = end[-1];
+      --liveTriangles[v];
+    }
+    for (int k = 0; k < cacheCount; ++k) {
+      const auto v = cache[k];
+      if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+        newCache[newCount++] = v;
+      }
+    }
+
+    // Score the vertices again, and the triangles left around them
+    best = NONE;
+    float bestScore = -1.f;
+    for (int k = 0; k < newCount; ++k) {
+      const auto v = newCache[k];
+      vertexScores[v] =
+          vertexScore(k < VERTEX_CACHE_SIZE ? k : -1, liveTriangles[v]);
+    }
+    for (int k = 0; k < newCount; ++k) {
+      const auto v = newCache[k];
+      const auto *begin = vertexTriangles.data() + firstTriangle[v];
+      for (const auto *t = begin; t != begin + liveTriangles[v]; ++t) {
+        const auto *other = indices + size_t(*t) * 3;
+        const auto score = vertexScores[other[0]] + vertexScores[other[1]] +
+                           vertexScores[other[2]];
+        if (score > bestScore) {
+          bestScore = score;
+          best = *t;
+        }
+      }
+    }
+
+    cacheCount = std::min(newCount, VERTEX_CACHE_SIZE);
+    std::copy(newCache, newCache + cacheCount, cache);
+  }
+
+  std::copy(order.begin(), order.end(), indices);
+}
+
+void optimizeOverdraw(uint32_t *indices, size_t indexCount,
+    const std::vector<glm::vec3> &positions, float threshold)
+{
+  TRACE_ZONE("optimizeOverdraw");
+  const auto triangleCount = indexCount / 3;
+  if (triangleCount < 2) {
+    return;
+  }
+
+  // Runs start where the cache holds no vertex of the triangle, as nothing
+  // is lost by moving them
+  FifoCache cache(positions.size(), OVERDRAW_CACHE_SIZE);
+  const auto triangleMisses = [&](size_t t) {
+    return size_t(cache.miss(indices[t * 3])) + cache.miss(indices[t * 3 + 1]) +
+           cache.miss(indices[t * 3 + 2]);
+  };
+  std::vector<size_t> hardBoundaries{0};
+  for (size_t t = 0; t < triangleCount; ++t) {
+    if (triangleMisses(t) == 3 && t > 0) {
+      hardBoundaries.push_back(t);
+    }
+  }
+  hardBoundaries.push_back(triangleCount);
+
+  // Split them again where the cache efficiency from the start of the run is
+  // close enough to the one of the whole run
+  std::vector<size_t> clusters;
+  for (size_t h = 0; h + 1 < hardBoundaries.size(); ++h) {
+    const auto begin = hardBoundaries[h];
+    const auto end = hardBoundaries[h + 1];
+    cache.reset();
+    size_t runMisses = 0;
+    for (size_t t = begin; t < end; ++t) {
+      runMisses += triangleMisses(t);
+    }
+    const auto runRatio = float(runMisses) / float(end - begin);
+
+    clusters.push_back(begin);
+    cache.reset();
+    size_t misses = 0;
+    size_t start = begin;
+    for (size_t t = begin; t < end; ++t) {
+      misses += triangleMisses(t);
+      const auto ratio = float(misses) / float(t - start + 1);
+      if (t + 1 < end && ratio <= threshold * runRatio) {
+        clusters.push_back(t + 1);
+        cache.reset();
+        misses = 0;
+        start = t + 1;
+      }
+    }
+  }
+  clusters.push_back(triangleCount);
+
+  // Sort the clusters by how much they face away from the center of the mesh
+  glm::vec3 meshCentroid(0);
+  float meshArea = 0.f;
+  std::vector<glm::vec3> clusterCentroids(clusters.size() - 1, glm::vec3(0));
+  std::vector<glm::vec3> clusterNormals(clusters.size() - 1, glm::vec3(0));
+  std::vector<float> clusterAreas(clusters.size() - 1, 0.f);
+  for (size_t c = 0; c + 1 < clusters.size(); ++c) {
+    for (size_t t = clusters[c]; t < clusters[c + 1]; ++t) {
+      const auto &p0 = positions[indices[t * 3]];
+      const auto &p1 = positions[indices[t * 3 + 1]];
+      const auto &p2 = positions[indices[t * 3 + 2]];
+      const auto normal = glm::cross(p1 - p0, p2 - p0);
+      const auto area = glm::length(normal);
+      clusterCentroids[c] += (p0 + p1 + p2) * (area / 3.f);
+      clusterNormals[c] += normal;
+      clusterAreas[c] += area;
+    }
+    meshCentroid += clusterCentroids[c];
+    meshArea += clusterAreas[c];
+  }
+  if (meshArea > 0.f) {
+    meshCentroid /= meshArea;
+  }
+
+  std::vector<float> sortKeys(clusters.size() - 1, 0.f);
+  for (size_t c = 0; c + 1 < clusters.size(); ++c) {
+    const auto length = glm::length(clusterNormals[c]);
+    if (clusterAreas[c] > 0.f && length > 0.f) {
+      sortKeys[c] = glm::dot(clusterCentroids[c] / clusterAreas[c] -
+                                 meshCentroid,
+          clusterNormals[c] / length);
+    }
+  }
+  std::vector<uint32_t> clusterOrder(clusters.size() - 1);
+  for (size_t c = 0; c < clusterOrder.size(); ++c) {
+    clusterOrder[c] = uint32_t(c);
+  }
+  std::stable_sort(clusterOrder.begin(), clusterOrder.end(),
+      [&](uint32_t a, uint32_t b) { return sortKeys[a] > sortKeys[b]; });
+
+  std::vector<uint32_t> order;
+  order.reserve(triangleCount * 3);
+  for (const auto c : clusterOrder) {
+    order.insert(order.end(), indices + clusters[c] * 3,
+        indices + clusters[c + 1] * 3);
+  }
+  std::copy(order.begin(), order.end(), indices);
+}
+
+std::vector<uint32_t> weldVertices(uint32_t *indices, size_t indexCount,
+    unsigned char *vertices, size_t vertexCount, size_t stride)
+{
+  TRACE_ZONE("weldVertices");
+  // Vertices are identified by where their bytes are: those kept at the
+  // front, the one looked up where it was copied, which nothing has
+  // overwritten yet
+  const auto hash = [&](uint32_t v) {
+    const auto *bytes = vertices + size_t(v) * stride;
+    size_t h = 14695981039346656037ull; // FNV-1a
+    for (size_t i = 0; i < stride; ++i) {
+      h = (h ^ bytes[i]) * 1099511628211ull;
+    }
+    return h;
+  };
+  const auto equal = [&](uint32_t a, uint32_t b) {
+    return std::memcmp(vertices + size_t(a) * stride,
+               vertices + size_t(b) * stride, stride) == 0;
+  };
+  std::unordered_set<uint32_t, decltype(hash), decltype(equal)> kept(
+      vertexCount, hash, equal);
+
+  std::vector<uint32_t> remap(vertexCount);
+  uint32_t next = 0;
+  for (size_t v = 0; v < vertexCount; ++v) {
+    const auto it = kept.find(uint32_t(v));
+    if (it != kept.end()) {
+      remap[v] = *it;
+      continue;
+    }
+    if (next != v) {
+      std::memcpy(vertices + size_t(next) * stride, vertices + v * stride,
+          stride);
+    }
+    kept.insert(next);
+    remap[v] = next++;
+  }
+  for (size_t i = 0; i < indexCount; ++i) {
+    indices[i] = remap[indices[i]];
+  }
+  return remap;
+}
+
+std::vector<uint32_t> optimizeVertexFetch(uint32_t *indices,
+    size_t indexCount, unsigned char *vertices, size_t vertexCount,
+    size_t stride)
+{
+  TRACE_ZONE("optimizeVertexFetch");
+  std::vector<uint32_t> remap(vertexCount, NONE);
+  uint32_t next = 0;
+  for (size_t i = 0; i < indexCount; ++i) {
+    auto &position = remap[indices[i]];
+    if (position == NONE) {
+      position = next++;
+    }
+    indices[i] = position;
+  }
+  for (auto &position : remap) {
+    if (position == NONE) {
+      position = next++;
+    }
+  }
+
+  std::vector<unsigned char> reordered(vertexCount * stride);
+  for (size_t v = 0; v < vertexCount; ++v) {
+    std::memcpy(
+        reordered.data() + size_t(remap[v]) * stride, vertices + v * stride,
+        stride);
+  }
+  std::copy(reordered.begin(), reordered.end(), vertices);
+  return remap;
+}
+
+size_t simplify(uint32_t *destination, const uint32_t *indices,
+    size_t indexCount, const std::vector<glm::vec3> &positions,
+    size_t targetIndexCount, float targetError, float &resultError)
+{
+  TRACE_ZONE("simplify");
+  const auto vertexCount = positions.size();
+  indexCount -= indexCount % 3;
+  std::copy(indices, indices + indexCount, destination);
+  resultError = 0.f;
+
+  // Vertices sharing a position with another one are on an attribute seam,
+  // open edges have no opposite edge once vertices are welded by position
+  std::vector<uint32_t> welded(vertexCount);
+  std::vector<char> seam(vertexCount, 0);
+  {
+    struct PositionHash
+    {
+      size_t operator()(const glm::vec3 &p) const
+      {
+        uint32_t bits[3];
+        std::memcpy(bits, &p, sizeof(bits));
+        return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^
+               (bits[2] * 83492791u);
+      }
+    };
+    std::unordered_map<glm::vec3, uint32_t, PositionHash> first;
+    first.reserve(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v) {
+      const auto it = first.emplace(positions[v], uint32_t(v)).first;
+      welded[v] = (*it).second;
+      if (welded[v] != v) {
+        seam[v] = seam[welded[v]] = 1;
+      }
+    }
+  }
+  std::vector<char> locked(seam);
+  {
+    std::unordered_set<uint64_t> edges;
+    edges.reserve(indexCount);
+    for (size_t i = 0; i < indexCount; i += 3) {
+      for (int k = 0; k < 3; ++k) {
+        edges.insert(edgeKey(welded[destination[i + k]],
+            welded[destination[i + (k + 1) % 3]]));
+      }
+    }
+    for (size_t i = 0; i < indexCount; i += 3) {
+      for (int k = 0; k < 3; ++k) {
+        const auto a = destination[i + k];
+        const auto b = destination[i + (k + 1) % 3];
+        if (!edges.count(edgeKey(welded[b], welded[a]))) {
+          locked[a] = locked[b] = 1;
+        }
+      }
+    }
+  }
+
+  std::vector<Quadric> quadrics(vertexCount);
+  for (size_t i = 0; i < indexCount; i += 3) {
+    const glm::dvec3 p0(positions[destination[i]]);
+    const glm::dvec3 p1(positions[destination[i + 1]]);
+    const glm::dvec3 p2(positions[destination[i + 2]]);
+    const auto cross = glm::cross(p1 - p0, p2 - p0);
+    const auto length = glm::length(cross);
+    if (length > 0) {
+      const auto normal = cross / length;
+      for (int k = 0; k < 3; ++k) {
+        quadrics[destination[i + k]].addPlane(
+            normal, -glm::dot(normal, p0), 0.5 * length);
+      }
+    }
+  }
+
+  const auto maxError = double(targetError) * double(targetError);
+  double error = 0;
+  std::vector<uint32_t> firstTriangle(vertexCount + 1);
+  std::vector<uint32_t> vertexTriangles;
+  std::vector<Collapse> collapses;
+  std::vector<uint32_t> collapsed(vertexCount);
+  std::vector<char> touched(vertexCount);
+  while (indexCount > targetIndexCount) {
+    // Triangles around each vertex
+    std::fill(firstTriangle.begin(), firstTriangle.end(), 0);
+    for (size_t i = 0; i < indexCount; ++i) {
+      ++firstTriangle[destination[i] + 1];
+    }
+    for (size_t v = 0; v < vertexCount; ++v) {
+      firstTriangle[v + 1] += firstTriangle[v];
+    }
+    vertexTriangles.resize(indexCount);
+    {
+      auto next = firstTriangle;
+      for (size_t i = 0; i < indexCount; ++i) {
+        vertexTriangles[next[destination[i]]++] = uint32_t(i / 3);
+      }
+    }
+
+    // Cheapest direction of every edge that can collapse, onto a vertex
+    // that is not on a seam so that attributes are not mixed
+    collapses.clear();
+    for (size_t i = 0; i < indexCount; ++i) {
+      const auto a = destination[i];
+      const auto b = destination[i - i % 3 + (i + 1) % 3];
+      if (a > b || seam[a] || seam[b] || (locked[a] && locked[b])) {
+        continue;
+      }
+      auto quadric = quadrics[a];
+      quadric += quadrics[b];
+      const auto toB = locked[a] ? maxError + 1 : quadric.error(positions[b]);
+      const auto toA = locked[b] ? maxError + 1 : quadric.error(positions[a]);
+      if (std::min(toA, toB) <= maxError) {
+        collapses.push_back(
+            toB <= toA ? Collapse{a, b, toB} : Collapse{b, a, toA});
+      }
+    }
+    if (collapses.empty()) {
+      break;
+    }
+    std::sort(collapses.begin(), collapses.end(),
+        [](const Collapse &lhs, const Collapse &rhs) {
+          return lhs.error < rhs.error;
+        });
+
+    // Collapses of a pass do not share vertices, each removes about two
+    // triangles. Those more expensive than the ones enough to reach the
+    // target wait for the next pass instead of replacing skipped ones.
+    for (size_t v = 0; v < vertexCount; ++v) {
+      collapsed[v] = uint32_t(v);
+    }
+    std::fill(touched.begin(), touched.end(), 0);
+    const auto triangleBudget = (indexCount - targetIndexCount) / 3;
+    const auto passError =
+        collapses[std::min(collapses.size(), triangleBudget / 2 + 1) - 1]
+            .error;
+    size_t removed = 0;
+    for (const auto &collapse : collapses) {
+      if (removed >= triangleBudget || collapse.error > passError) {
+        break;
+      }
+      if (touched[collapse.from] || touched[collapse.to]) {
+        continue;
+      }
+      const auto *triangles =
+          vertexTriangles.data() + firstTriangle[collapse.from];
+      const auto triangleCount =
+          firstTriangle[collapse.from + 1] - firstTriangle[collapse.from];
+      if (collapseFlips(destination, triangles, triangleCount, positions,
+              collapse.from, collapse.to)) {
+        continue;
+      }
+      // Neighbours keep their position for the flip tests of the pass
+      for (size_t k = 0; k < triangleCount; ++k) {
+        const auto *triangle = destination + size_t(triangles[k]) * 3;
+        touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] =
+            1;
+      }
+      collapsed[collapse.from] = collapse.to;
+      quadrics[collapse.to] += quadrics[collapse.from];
+      error = std::max(error, collapse.error);
+      removed += 2;
+    }
+    if (removed == 0) {
+      break;
+    }
+
+    size_t writeIndex = 0;
+    for (size_t i = 0; i < indexCount; i += 3) {
+      const auto a = collapsed[destination[i]];
+      const auto b = collapsed[destination[i + 1]];
+      const auto c = collapsed[destination[i + 2]];
+      if (a != b && b != c && c != a) {
+        destination[writeIndex++] = a;
+        destination[writeIndex++] = b;
+        destination[writeIndex++] = c;
+      }
+    }
+    indexCount = writeIndex;
+  }
+
+  resultError = float(std::sqrt(error));
+  return indexCount;
+}
+
+std::vector<Meshlet> buildMeshlets(uint32_t *indices, size_t indexCount,
+    const std::vector<glm::vec3> &positions)
+{
+  TRACE_ZONE("buildMeshlets");
+  const auto vertexCount = positions.size();
+  const auto triangleCount = indexCount / 3;
+
+  std::vector<uint32_t> firstTriangle(vertexCount + 1, 0);
+  for (size_t i = 0; i < triangleCount * 3; ++i) {
+    ++firstTriangle[indices[i] + 1];
+  }
+  for (size_t v = 0; v < vertexCount; ++v) {
+    firstTriangle[v + 1] += firstTriangle[v];
+  }
+  std::vector<uint32_t> vertexTriangles(triangleCount * 3);
+  {
+    auto next = firstTriangle;
+    for (size_t i = 0; i < triangleCount * 3; ++i) {
+      vertexTriangles[next[indices[i]]++] = uint32_t(i / 3);
+    }
+  }
+
+  std::vector<char> emitted(triangleCount, 0);
+  // Meshlet of the vertex, to count the ones a triangle would add
+  std::vector<uint32_t> vertexMeshlet(vertexCount, NONE);
+  std::vector<uint32_t> order;
+  order.reserve(triangleCount * 3);
+  std::vector<Meshlet> meshlets;
+  std::vector<uint32_t> candidates;
+  size_t cursor = 0; // Triangles before it are emitted
+
+  const auto newVertices = [&](uint32_t t) {
+    const auto meshlet = uint32_t(meshlets.size() - 1);
+    return int(vertexMeshlet[indices[t * 3]] != meshlet) +
+           int(vertexMeshlet[indices[t * 3 + 1]] != meshlet) +
+           int(vertexMeshlet[indices[t * 3 + 2]] != meshlet);
+  };
+
+  size_t meshletVertices = 0;
+  size_t meshletTriangles = 0;
+  glm::vec3 centerSum(0); // Of the vertices of the meshlet
+  for (size_t emittedCount = 0; emittedCount < triangleCount;
+       ++emittedCount) {
+    // The adjacent triangle adding the fewest vertices to the meshlet, then
+    // the closest to its center so that it stays round, the next one in the
+    // input if there is none
+    auto best = NONE;
+    int bestNew = 4;
+    float bestDistance = 0.f;
+    if (!meshlets.empty()) {
+      const auto center = centerSum / float(meshletVertices);
+      size_t kept = 0;
+      for (const auto t : candidates) {
+        if (emitted[t]) {
+          continue;
+        }
+        candidates[kept++] = t;
+        const auto added = newVertices(t);
+        if (added > bestNew) {
+          continue;
+        }
+        const auto offset = positions[indices[t * 3]] +
+                            positions[indices[t * 3 + 1]] +
+                            positions[indices[t * 3 + 2]] - 3.f * center;
+        const auto distance = glm::dot(offset, offset);
+        if (added < bestNew || distance < bestDistance) {
+          best = t;
+          bestNew = added;
+          bestDistance = distance;
+        }
+      }
+      candidates.resize(kept);
+    }
+    if (best == NONE) {
+      while (emitted[cursor]) {
+        ++cursor;
+      }
+      best = uint32_t(cursor);
+      bestNew = meshlets.empty() ? 3 : newVertices(best);
+    }
+
+    if (meshlets.empty() ||
+        meshletVertices + size_t(bestNew) > MESHLET_MAX_VERTICES ||
+        meshletTriangles + 1 > MESHLET_MAX_TRIANGLES) {
+      meshlets.push_back(Meshlet{uint32_t(order.size()), 0});
+      candidates.clear();
+      meshletVertices = 0;
+      meshletTriangles = 0;
+      centerSum = glm::vec3(0);
+      // A new meshlet starts where the input continues, not from a
+      // candidate of the previous one
+      while (emitted[cursor]) {
+        ++cursor;
+      }
+      best = uint32_t(cursor);
+    }
+
+    const auto meshlet = uint32_t(meshlets.size() - 1);
+    for (int k = 0; k < 3; ++k) {
+      const auto v = indices[best * 3 + k];
+      order.push_back(v);
+      if (vertexMeshlet[v] != meshlet) {
+        vertexMeshlet[v] = meshlet;
+        ++meshletVertices;
+        centerSum += positions[v];
+        const auto *begin = vertexTriangles.data() + firstTriangle[v];
+        const auto *end = vertexTriangles.data() + firstTriangle[v + 1];
+        for (const auto *t = begin; t != end; ++t) {
+          if (!emitted[*t]) {
+            candidates.push_back(*t);
+          }
+        }
+      }
+    }
+    emitted[best] = 1;
+    ++meshletTriangles;
+    meshlets.back().indexCount += 3;
+  }
+  std::copy(order.begin(), order.end(), indices);
+
+  for (auto &meshlet : meshlets) {
+    const auto *begin = indices + meshlet.firstIndex;
+    const auto *end = begin + meshlet.indexCount;
+    glm::vec3 min(std::numeric_limits<float>::max());
+    glm::vec3 max(std::numeric_limits<float>::lowest());
+    for (const auto *i = begin; i != end; ++i) {
+      min = glm::min(min, positions[*i]);
+      max = glm::max(max, positions[*i]);
+    }
+    meshlet.center = 0.5f * (min + max);
+    meshlet.radius = 0.f;
+    glm::vec3 normalSum(0);
+    std::vector<glm::vec3> normals;
+    for (const auto *i = begin; i != end; i += 3) {
+      for (int k = 0; k < 3; ++k) {
+        meshlet.radius = std::max(
+            meshlet.radius, glm::length(positions[i[k]] - meshlet.center));
+      }
+      const auto normal =
+          glm::cross(positions[i[1]] - positions[i[0]],
+              positions[i[2]] - positions[i[0]]);
+      const auto length = glm::length(normal);
+      if (length > 0.f) {
+        normals.push_back(normal / length);
+        normalSum += normals.back();
+      }
+    }
+
+    meshlet.coneAxis = glm::vec3(0, 0, 1);
+    meshlet.coneCutoff = 1.f;
+    const auto sumLength = glm::length(normalSum);
+    if (normals.empty() || sumLength == 0.f) {
+      continue;
+    }
+    meshlet.coneAxis = normalSum / sumLength;
+    float minDot = 1.f;
+    for (const auto &normal : normals) {
+      minDot = std::min(minDot, glm::dot(normal, meshlet.coneAxis));
+    }
+    // Normals spread too wide leave the meshlet visible from every side
+    if (minDot > 0.1f) {
+      meshlet.coneCutoff = std::sqrt(1.f - minDot * minDot);
+    }
+  }
+  return meshlets;
+}
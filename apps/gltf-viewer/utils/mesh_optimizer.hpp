@@ -0,0 +1,83 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Reordering of indexed triangle lists for the vertex stage, in place. Indices
+// are relative to the first vertex of the primitive and must all be lower
+// than vertexCount.
+
+// Average number of vertices transformed per triangle with a FIFO post
+// transform cache of cacheSize entries, 3 at worst and 0.5 at best
+float averageCacheMissRatio(const uint32_t *indices, size_t indexCount,
+    size_t vertexCount, size_t cacheSize = 16);
+
+// Reorder the triangles so that consecutive ones share vertices, with the
+// linear-speed heuristic of Forsyth scoring vertices by their position in a
+// simulated LRU cache and their count of triangles left
+void optimizeVertexCache(
+    uint32_t *indices, size_t indexCount, size_t vertexCount);
+
+// Reorder runs of triangles of an optimizeVertexCache() order so that those
+// facing outwards come first and occlude the others, as in Sander et al.,
+// "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw". A run
+// is split where its cache miss ratio is below threshold times the one of the
+// whole run, so threshold trades cache efficiency for overdraw.
+void optimizeOverdraw(uint32_t *indices, size_t indexCount,
+    const std::vector<glm::vec3> &positions, float threshold = 1.05f);
+
+// Merge the vertices equal byte for byte into the first of them: the vertices
+// left are moved to the front in their order and the indices remapped.
+// Vertices are vertexCount elements of stride bytes. Return the new position
+// of each vertex, the vertices left being those below the largest plus one.
+std::vector<uint32_t> weldVertices(uint32_t *indices, size_t indexCount,
+    unsigned char *vertices, size_t vertexCount, size_t stride);
+
+// Reorder the vertices in the order the triangles first use them, unused ones
+// last, and remap the indices. Vertices are vertexCount elements of stride
+// bytes. Return the new position of each vertex.
+std::vector<uint32_t> optimizeVertexFetch(uint32_t *indices,
+    size_t indexCount, unsigned char *vertices, size_t vertexCount,
+    size_t stride);
+
+// Simplify an indexed triangle list by collapsing edges onto one of their
+// vertices, cheapest first as measured by the quadric error metric of Garland
+// and Heckbert, until at most targetIndexCount indices are left or the next
+// collapse would move the surface by more than targetError. Vertices are kept
+// and the simplified triangles reference them, so that levels of detail share
+// the vertex buffer. Vertices on open borders and on attribute seams, where
+// several vertices share a position, are not moved. Write the indices to
+// destination, which must hold indexCount of them, and the distance the
+// surface moved to resultError. Return the number of indices written.
+size_t simplify(uint32_t *destination, const uint32_t *indices,
+    size_t indexCount, const std::vector<glm::vec3> &positions,
+    size_t targetIndexCount, float targetError, float &resultError);
+
+// Triangles of a triangle list with at most MESHLET_MAX_VERTICES distinct
+// vertices, bounded by a sphere and by a cone of their normals so that they
+// can be culled together
+struct Meshlet
+{
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  glm::vec3 center;
+  float radius;
+  glm::vec3 coneAxis;
+  // Sine of the angle between the axis and the normal furthest from it, the
+  // meshlet faces away from eye if dot(center - eye, coneAxis) >= coneCutoff
+  // * length(center - eye) + radius. 1 if the normals spread over more than a
+  // half space.
+  float coneCutoff;
+};
+
+const size_t MESHLET_MAX_VERTICES = 64;
+const size_t MESHLET_MAX_TRIANGLES = 124;
+
+// Split a triangle list into meshlets grown from triangle to adjacent
+// triangle, reordering the triangles so that those of a meshlet are
+// consecutive. Meshlet first indices are relative to indices.
+std::vector<Meshlet> buildMeshlets(uint32_t *indices, size_t indexCount,
+    const std::vector<glm::vec3> &positions);
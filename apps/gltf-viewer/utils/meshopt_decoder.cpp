@@ -0,0 +1,437 @@
+#include "meshopt_decoder.hpp"
+
+#include "trace.hpp"
+
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+
+const unsigned char VERTEX_HEADER = 0xa0;
+const unsigned char INDEX_HEADER = 0xe0;
+const unsigned char SEQUENCE_HEADER = 0xd0;
+
+// Vertices are decoded by blocks of up to VERTEX_BLOCK_MAX_SIZE elements,
+// each byte of an element in groups of BYTE_GROUP_SIZE
+const size_t BYTE_GROUP_SIZE = 16;
+const size_t VERTEX_BLOCK_MAX_SIZE = 256;
+const size_t VERTEX_BLOCK_SIZE_BYTES = 8192;
+const size_t VERTEX_TAIL_MIN_SIZE = 32;
+// Most bytes read by a group: 16 values of 4 bits and 16 exceptions
+const size_t BYTE_GROUP_DECODE_LIMIT = 24;
+
+const size_t FIFO_SIZE = 16;
+
+size_t vertexBlockSize(size_t stride)
+{
+  const auto size = (VERTEX_BLOCK_SIZE_BYTES / stride) & ~(BYTE_GROUP_SIZE - 1);
+  return size < VERTEX_BLOCK_MAX_SIZE ? size : VERTEX_BLOCK_MAX_SIZE;
+}
+
+unsigned char unzigzag8(unsigned char v)
+{
+  return (unsigned char)(-(v & 1) ^ (v >> 1));
+}
+
+// 16 values of 2 or 4 bits, a value with every bit set being followed by the
+// actual byte in the stream of exceptions
+const unsigned char *decodeBytesGroup(
+    const unsigned char *data, unsigned char *values, int bitsLog2)
+{
+  switch (bitsLog2) {
+  case 0:
+    std::memset(values, 0, BYTE_GROUP_SIZE);
+    return data;
+  case 1:
+  case 2: {
+    const auto bits = 1 << bitsLog2;
+    const auto sentinel = (1 << bits) - 1;
+    const auto *exceptions = data + BYTE_GROUP_SIZE * bits / 8;
+    for (size_t i = 0; i < BYTE_GROUP_SIZE; ++i) {
+      const auto bit = i * bits;
+      const int value =
+          (data[bit / 8] >> (8 - bits - int(bit % 8))) & sentinel;
+      values[i] = value == sentinel ? *exceptions++ : (unsigned char)(value);
+    }
+    return exceptions;
+  }
+  default:
+    std::memcpy(values, data, BYTE_GROUP_SIZE);
+    return data + BYTE_GROUP_SIZE;
+  }
+}
+
+// count values, a multiple of BYTE_GROUP_SIZE, each group with its 2 bits
+// mode in a header before the groups
+const unsigned char *decodeBytes(const unsigned char *data,
+    const unsigned char *end, unsigned char *values, size_t count)
+{
+  const auto headerSize = (count / BYTE_GROUP_SIZE + 3) / 4;
+  if (size_t(end - data) < headerSize) {
+    return nullptr;
+  }
+  const auto *header = data;
+  data += headerSize;
+  for (size_t i = 0; i < count; i += BYTE_GROUP_SIZE) {
+    if (size_t(end - data) < BYTE_GROUP_DECODE_LIMIT) {
+      return nullptr;
+    }
+    const auto group = i / BYTE_GROUP_SIZE;
+    const int bitsLog2 = (header[group / 4] >> ((group % 4) * 2)) & 3;
+    data = decodeBytesGroup(data, values + i, bitsLog2);
+  }
+  return data;
+}
+
+const unsigned char *decodeVertexBlock(const unsigned char *data,
+    const unsigned char *end, unsigned char *vertices, size_t count,
+    size_t stride, unsigned char *lastVertex)
+{
+  unsigned char deltas[VERTEX_BLOCK_MAX_SIZE];
+  const auto alignedCount =
+      (count + BYTE_GROUP_SIZE - 1) & ~(BYTE_GROUP_SIZE - 1);
+  for (size_t k = 0; k < stride; ++k) {
+    data = decodeBytes(data, end, deltas, alignedCount);
+    if (!data) {
+      return nullptr;
+    }
+    auto previous = lastVertex[k];
+    for (size_t i = 0; i < count; ++i) {
+      previous = (unsigned char)(unzigzag8(deltas[i]) + previous);
+      vertices[i * stride + k] = previous;
+    }
+  }
+  std::memcpy(lastVertex, vertices + (count - 1) * stride, stride);
+  return data;
+}
+
+template <typename T> T roundToInt(float value)
+{
+  return T(int(value + (value >= 0.f ? 0.5f : -0.5f)));
+}
+
+// Octahedral encoded unit vectors of 4 components, the third one holding the
+// value of 1 and the fourth one kept as it is
+template <typename T> void decodeOctahedral(T *data, size_t count)
+{
+  const auto max = float((1 << (sizeof(T) * 8 - 1)) - 1);
+  for (size_t i = 0; i < count; ++i) {
+    auto x = float(data[i * 4 + 0]);
+    auto y = float(data[i * 4 + 1]);
+    const auto z = float(data[i * 4 + 2]) - std::fabs(x) - std::fabs(y);
+    // Fold the lower hemisphere back
+    const auto t = z < 0.f ? z : 0.f;
+    x += x >= 0.f ? t : -t;
+    y += y >= 0.f ? t : -t;
+
+    const auto scale = max / std::sqrt(x * x + y * y + z * z);
+    data[i * 4 + 0] = roundToInt<T>(x * scale);
+    data[i * 4 + 1] = roundToInt<T>(y * scale);
+    data[i * 4 + 2] = roundToInt<T>(z * scale);
+  }
+}
+
+// Unit quaternions as 3 components and the index of the largest one, which
+// is computed back, in the 2 low bits of the fourth one
+void decodeQuaternion(int16_t *data, size_t count)
+{
+  const auto scale = 1.f / std::sqrt(2.f);
+  for (size_t i = 0; i < count; ++i) {
+    auto *q = data + i * 4;
+    const auto componentScale = scale / float(q[3] | 3);
+    const auto x = float(q[0]) * componentScale;
+    const auto y = float(q[1]) * componentScale;
+    const auto z = float(q[2]) * componentScale;
+    const auto ww = 1.f - x * x - y * y - z * z;
+    const auto w = std::sqrt(ww >= 0.f ? ww : 0.f);
+
+    const int largest = q[3] & 3;
+    q[(largest + 1) & 3] = roundToInt<int16_t>(x * 32767.f);
+    q[(largest + 2) & 3] = roundToInt<int16_t>(y * 32767.f);
+    q[(largest + 3) & 3] = roundToInt<int16_t>(z * 32767.f);
+    q[largest] = int16_t(int(w * 32767.f + 0.5f));
+  }
+}
+
+// Floats as a 24 bits signed mantissa and an 8 bits signed exponent
+void decodeExponential(uint32_t *data, size_t count)
+{
+  for (size_t i = 0; i < count; ++i) {
+    const auto mantissa = int32_t(data[i] << 8) >> 8;
+    const auto exponent = int32_t(data[i]) >> 24;
+    const auto value = std::ldexp(float(mantissa), exponent);
+    std::memcpy(&data[i], &value, sizeof(value));
+  }
+}
+
+void writeIndex(unsigned char *destination, size_t i, size_t stride,
+    uint32_t index)
+{
+  if (stride == 2) {
+    const auto value = uint16_t(index);
+    std::memcpy(destination + i * 2, &value, sizeof(value));
+  } else {
+    std::memcpy(destination + i * 4, &index, sizeof(index));
+  }
+}
+
+uint32_t decodeVByte(const unsigned char *&data)
+{
+  const auto lead = *data++;
+  if (lead < 128) {
+    return lead;
+  }
+  // Up to 4 more bytes of 7 bits, the last one without its high bit
+  uint32_t result = lead & 127;
+  uint32_t shift = 7;
+  for (int i = 0; i < 4; ++i) {
+    const auto group = *data++;
+    result |= uint32_t(group & 127) << shift;
+    shift += 7;
+    if (group < 128) {
+      break;
+    }
+  }
+  return result;
+}
+
+// Zigzag encoded difference with the previous free index
+uint32_t decodeIndex(const unsigned char *&data, uint32_t last)
+{
+  const auto v = decodeVByte(data);
+  return last + ((v >> 1) ^ uint32_t(-int32_t(v & 1)));
+}
+
+struct TriangleFifos
+{
+  uint32_t edges[FIFO_SIZE][2];
+  uint32_t vertices[FIFO_SIZE];
+  size_t edgeOffset = 0;
+  size_t vertexOffset = 0;
+
+  TriangleFifos()
+  {
+    std::memset(edges, -1, sizeof(edges));
+    std::memset(vertices, -1, sizeof(vertices));
+  }
+
+  // Edge or vertex pushed i entries before the last one
+  const uint32_t *edge(size_t i) const
+  {
+    return edges[(edgeOffset - 1 - i) & (FIFO_SIZE - 1)];
+  }
+  uint32_t vertex(size_t i) const
+  {
+    return vertices[(vertexOffset - 1 - i) & (FIFO_SIZE - 1)];
+  }
+
+  void pushEdge(uint32_t a, uint32_t b)
+  {
+    edges[edgeOffset][0] = a;
+    edges[edgeOffset][1] = b;
+    edgeOffset = (edgeOffset + 1) & (FIFO_SIZE - 1);
+  }
+  void pushVertex(uint32_t v, bool push = true)
+  {
+    vertices[vertexOffset] = v;
+    vertexOffset = (vertexOffset + (push ? 1 : 0)) & (FIFO_SIZE - 1);
+  }
+};
+
+} // namespace
+
+bool parseMeshoptFilter(const std::string &name, MeshoptFilter &filter)
+{
+  if (name.empty() || name == "NONE") {
+    filter = MeshoptFilter::None;
+  } else if (name == "OCTAHEDRAL") {
+    filter = MeshoptFilter::Octahedral;
+  } else if (name == "QUATERNION") {
+    filter = MeshoptFilter::Quaternion;
+  } else if (name == "EXPONENTIAL") {
+    filter = MeshoptFilter::Exponential;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool decodeMeshoptAttributes(unsigned char *destination, size_t count,
+    size_t stride, MeshoptFilter filter, const unsigned char *data,
+    size_t size)
+{
+  TRACE_ZONE("decodeMeshoptAttributes");
+  if (stride == 0 || stride > VERTEX_BLOCK_MAX_SIZE || stride % 4 != 0 ||
+      size < 1 + stride || (data[0] & 0xf0) != VERTEX_HEADER ||
+      (data[0] & 0x0f) != 0) {
+    return false;
+  }
+  const auto *end = data + size;
+  ++data;
+
+  // The tail holds the first vertex, the base of the first deltas
+  unsigned char lastVertex[VERTEX_BLOCK_MAX_SIZE];
+  std::memcpy(lastVertex, end - stride, stride);
+  const auto blockSize = vertexBlockSize(stride);
+  for (size_t offset = 0; offset < count; offset += blockSize) {
+    const auto blockCount =
+        offset + blockSize < count ? blockSize : count - offset;
+    data = decodeVertexBlock(data, end, destination + offset * stride,
+        blockCount, stride, lastVertex);
+    if (!data) {
+      return false;
+    }
+  }
+  const auto tailSize =
+      stride < VERTEX_TAIL_MIN_SIZE ? VERTEX_TAIL_MIN_SIZE : stride;
+  if (size_t(end - data) != tailSize) {
+    return false;
+  }
+
+  switch (filter) {
+  case MeshoptFilter::None:
+    return true;
+  case MeshoptFilter::Octahedral:
+    if (stride == 4) {
+      decodeOctahedral(reinterpret_cast<int8_t *>(destination), count);
+      return true;
+    }
+    if (stride == 8) {
+      decodeOctahedral(reinterpret_cast<int16_t *>(destination), count);
+      return true;
+    }
+    return false;
+  case MeshoptFilter::Quaternion:
+    if (stride != 8) {
+      return false;
+    }
+    decodeQuaternion(reinterpret_cast<int16_t *>(destination), count);
+    return true;
+  case MeshoptFilter::Exponential:
+    decodeExponential(
+        reinterpret_cast<uint32_t *>(destination), count * stride / 4);
+    return true;
+  }
+  return false;
+}
+
+bool decodeMeshoptTriangles(unsigned char *destination, size_t count,
+    size_t stride, const unsigned char *data, size_t size)
+{
+  TRACE_ZONE("decodeMeshoptTriangles");
+  if ((stride != 2 && stride != 4) || count % 3 != 0 ||
+      size < 1 + count / 3 + FIFO_SIZE || (data[0] & 0xf0) != INDEX_HEADER ||
+      (data[0] & 0x0f) > 1) {
+    return false;
+  }
+  const int version = data[0] & 0x0f;
+  // With version 1, 13 and 14 encode the last free index minus and plus one
+  const uint32_t fecMax = version >= 1 ? 13 : 15;
+
+  // One code per triangle, then the free indices and extra codes, then a
+  // table of the codes of new triangles
+  const auto *codes = data + 1;
+  const auto *cursor = codes + count / 3;
+  const auto *safeEnd = data + size - FIFO_SIZE;
+  const auto *codeTable = safeEnd;
+
+  TriangleFifos fifos;
+  uint32_t next = 0; // Next new vertex
+  uint32_t last = 0; // Last free index
+  for (size_t i = 0; i < count; i += 3) {
+    // A triangle reads at most 16 bytes, the size of the code table
+    if (cursor > safeEnd) {
+      return false;
+    }
+    const auto code = *codes++;
+    uint32_t a, b, c;
+    if (code < 0xf0) {
+      // Triangle on a recent edge
+      const auto *edge = fifos.edge(code >> 4);
+      a = edge[0];
+      b = edge[1];
+      const uint32_t fec = code & 15;
+      if (fec < fecMax) {
+        c = fec == 0 ? next++ : fifos.vertex(fec);
+        fifos.pushVertex(c, fec == 0);
+      } else {
+        c = last = fec != 15 ? last + (fec == 13 ? -1 : 1)
+                                : decodeIndex(cursor, last);
+        fifos.pushVertex(c);
+      }
+      fifos.pushEdge(c, b);
+      fifos.pushEdge(a, c);
+    } else {
+      // New triangle, with its vertex codes in the table or in the stream
+      uint32_t fea, feb, fec;
+      if (code < 0xfe) {
+        const auto codeAux = codeTable[code & 15];
+        fea = 0;
+        feb = codeAux >> 4;
+        fec = codeAux & 15;
+      } else {
+        const auto codeAux = *cursor++;
+        if (codeAux == 0) {
+          next = 0; // Reset
+        }
+        fea = code == 0xfe ? 0 : 15;
+        feb = codeAux >> 4;
+        fec = codeAux & 15;
+      }
+      // The vertices are counted before reading free indices, as encoded
+      a = fea == 0 ? next++ : 0;
+      b = feb == 0 ? next++ : fifos.vertex(feb - 1);
+      c = fec == 0 ? next++ : fifos.vertex(fec - 1);
+      if (fea == 15) {
+        last = a = decodeIndex(cursor, last);
+      }
+      if (feb == 15) {
+        last = b = decodeIndex(cursor, last);
+      }
+      if (fec == 15) {
+        last = c = decodeIndex(cursor, last);
+      }
+      fifos.pushVertex(a);
+      fifos.pushVertex(b, feb == 0 || feb == 15);
+      fifos.pushVertex(c, fec == 0 || fec == 15);
+      fifos.pushEdge(b, a);
+      fifos.pushEdge(c, b);
+      fifos.pushEdge(a, c);
+    }
+    writeIndex(destination, i + 0, stride, a);
+    writeIndex(destination, i + 1, stride, b);
+    writeIndex(destination, i + 2, stride, c);
+  }
+  // The stream ends where the code table starts
+  return cursor == safeEnd;
+}
+
+bool decodeMeshoptIndices(unsigned char *destination, size_t count,
+    size_t stride, const unsigned char *data, size_t size)
+{
+  TRACE_ZONE("decodeMeshoptIndices");
+  const size_t tailSize = 4;
+  if ((stride != 2 && stride != 4) || size < 1 + count + tailSize ||
+      (data[0] & 0xf0) != SEQUENCE_HEADER || (data[0] & 0x0f) > 1) {
+    return false;
+  }
+  const auto *cursor = data + 1;
+  const auto *safeEnd = data + size - tailSize;
+
+  uint32_t last[2] = {0, 0};
+  for (size_t i = 0; i < count; ++i) {
+    // An index reads at most 5 bytes, within the tail
+    if (cursor >= safeEnd) {
+      return false;
+    }
+    auto v = decodeVByte(cursor);
+    // The low bit picks the baseline, then a zigzag encoded difference
+    const auto baseline = v & 1;
+    v >>= 1;
+    const auto index = last[baseline] + ((v >> 1) ^ uint32_t(-int32_t(v & 1)));
+    last[baseline] = index;
+    writeIndex(destination, i, stride, index);
+  }
+  return cursor == safeEnd;
+}
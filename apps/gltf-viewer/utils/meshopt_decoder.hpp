@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Decoders of the bitstreams of EXT_meshopt_compression, one function per
+// mode of a compressed buffer view. They write count elements of stride bytes
+// to destination and return false if the data is not a valid stream.
+// https://github.com/KhronosGroup/glTF/tree/main/extensions/2.0/Vendor/EXT_meshopt_compression
+
+enum class MeshoptFilter
+{
+  None,
+  Octahedral,
+  Quaternion,
+  Exponential
+};
+
+// Parse the filter property, false if unknown
+bool parseMeshoptFilter(const std::string &name, MeshoptFilter &filter);
+
+// ATTRIBUTES: vertices stored as byte deltas between consecutive elements,
+// then the filter is applied
+bool decodeMeshoptAttributes(unsigned char *destination, size_t count,
+    size_t stride, MeshoptFilter filter, const unsigned char *data,
+    size_t size);
+
+// TRIANGLES: triangle list indices of 2 or 4 bytes, encoded against a FIFO of
+// recent edges and vertices
+bool decodeMeshoptTriangles(unsigned char *destination, size_t count,
+    size_t stride, const unsigned char *data, size_t size);
+
+// INDICES: any index sequence of 2 or 4 bytes, delta encoded against two
+// baselines
+bool decodeMeshoptIndices(unsigned char *destination, size_t count,
+    size_t stride, const unsigned char *data, size_t size);
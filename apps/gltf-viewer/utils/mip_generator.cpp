@@ -0,0 +1,125 @@
+#include "mip_generator.hpp"
+
+#include <algorithm>
+
+constexpr int MipGenerator::MAX_CHAIN_LEVELS;
+
+namespace
+{
+
+const char *const FILTER_NAMES[MIP_FILTER_COUNT] = {
+    "box", "kaiser", "lanczos"};
+
+// Texels of the first level written by a work group of the box filter, and
+// by a work group of the other filters, see mipmap.cs.glsl
+const GLuint CHAIN_TILE_SIZE = 32;
+const GLuint FILTER_TILE_SIZE = 8;
+
+GLint levelSize(GLsizei size, GLsizei level) { return std::max(size >> level, 1); }
+
+} // namespace
+
+const char *mipFilterName(MipFilter filter) { return FILTER_NAMES[int(filter)]; }
+
+bool parseMipFilter(const std::string &name, MipFilter &filter)
+{
+  for (int i = 0; i < MIP_FILTER_COUNT; ++i) {
+    if (name == FILTER_NAMES[i]) {
+      filter = MipFilter(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+void MipGenerator::init(fs::path shaderPath)
+{
+  m_shaderPath = std::move(shaderPath);
+  m_programs.clear();
+}
+
+GLenum MipGenerator::imageFormat(GLenum internalFormat)
+{
+  switch (internalFormat) {
+  case GL_RGBA8:
+  case GL_SRGB8_ALPHA8:
+    return GL_RGBA8;
+  case GL_R8:
+  case GL_RGBA16F:
+    return internalFormat;
+  default:
+    return 0;
+  }
+}
+
+const GLProgram &MipGenerator::program(GLenum format, bool chain)
+{
+  const auto key = std::make_pair(format, chain);
+  auto it = m_programs.find(key);
+  if (it == end(m_programs)) {
+    std::vector<std::string> defines;
+    if (format == GL_R8) {
+      defines.push_back("FORMAT_R8");
+    } else if (format == GL_RGBA16F) {
+      defines.push_back("FORMAT_RGBA16F");
+    }
+    if (chain) {
+      defines.push_back("MIP_CHAIN");
+    }
+    it = m_programs.emplace(key, compileProgram({m_shaderPath}, defines))
+             .first;
+  }
+  return (*it).second;
+}
+
+void MipGenerator::generate(GLenum target, GLuint texture,
+    GLenum internalFormat, GLsizei width, GLsizei height, GLsizei levels,
+    MipFilter filter, bool normals)
+{
+  const auto format = imageFormat(internalFormat);
+  if (!format) {
+    glBindTexture(target, texture);
+    glGenerateMipmap(target);
+    return;
+  }
+
+  const GLuint layers = target == GL_TEXTURE_CUBE_MAP ? 6 : 1;
+  GLuint view;
+  glGenTextures(1, &view);
+  glTextureView(
+      view, GL_TEXTURE_2D_ARRAY, texture, format, 0, levels, 0, layers);
+
+  const bool chain = filter == MipFilter::Box;
+  const auto &mipProgram = program(format, chain);
+  mipProgram.use();
+  mipProgram.setUniform("uSrgb", internalFormat == GL_SRGB8_ALPHA8 ? 1 : 0);
+  mipProgram.setUniform("uNormals", normals ? 1 : 0);
+  mipProgram.setUniform("uFilter", int(filter));
+
+  const GLsizei levelsPerDispatch = chain ? MAX_CHAIN_LEVELS : 1;
+  for (GLsizei source = 0; source + 1 < levels;
+       source += levelsPerDispatch) {
+    const auto count = std::min(levelsPerDispatch, levels - 1 - source);
+    glBindImageTexture(0, view, source, GL_TRUE, 0, GL_READ_ONLY, format);
+    for (GLsizei i = 0; i < count; ++i) {
+      glBindImageTexture(GLuint(1 + i), view, source + 1 + i, GL_TRUE, 0,
+          GL_WRITE_ONLY, format);
+    }
+    mipProgram.setUniform("uSourceSize",
+        glm::vec2(levelSize(width, source), levelSize(height, source)));
+    mipProgram.setUniform("uLevelCount", GLint(count));
+
+    const auto tile = chain ? CHAIN_TILE_SIZE : FILTER_TILE_SIZE;
+    glDispatchCompute((levelSize(width, source + 1) + tile - 1) / tile,
+        (levelSize(height, source + 1) + tile - 1) / tile, layers);
+    // The last level written is the source of the next dispatch
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+  }
+
+  glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT |
+                  GL_FRAMEBUFFER_BARRIER_BIT);
+  for (GLuint unit = 0; unit <= GLuint(levelsPerDispatch); ++unit) {
+    glBindImageTexture(unit, 0, 0, GL_FALSE, 0, GL_READ_ONLY, format);
+  }
+  glDeleteTextures(1, &view);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "filesystem.hpp"
+#include "shaders.hpp"
+
+#include <glad/glad.h>
+
+#include <map>
+#include <string>
+#include <utility>
+
+// Filters of the mip levels generated from the level above
+enum class MipFilter
+{
+  Box, // 2x2 average, as glGenerateMipmap
+  Kaiser, // Kaiser windowed sinc, sharper, little ringing
+  Lanczos // Lanczos-2 windowed sinc, sharpest, rings along hard edges
+};
+
+const int MIP_FILTER_COUNT = 3;
+
+// Lower case name of filter on the command line
+const char *mipFilterName(MipFilter filter);
+// False if name is not one of those of mipFilterName()
+bool parseMipFilter(const std::string &name, MipFilter &filter);
+
+// Mip levels generated by compute shaders instead of glGenerateMipmap, whose
+// filter and speed depend on the driver. The box filter downsamples a 64x64
+// tile of a level per work group to up to MAX_CHAIN_LEVELS levels, the ones
+// below 32x32 in shared memory, so that a 4096x4096 texture takes 2
+// dispatches. The windowed sinc filters cover 8x8 texels of the level above
+// per texel, a dispatch per level. sRGB texels are filtered linear, and
+// normal maps renormalized at each level rather than shortened.
+//
+// Levels are written through a GL_TEXTURE_2D_ARRAY view of the texture, whose
+// storage must be immutable, in image formats of the same size: RGBA8 for
+// sRGB textures. Other formats than those of imageFormat() fall back to
+// glGenerateMipmap.
+class MipGenerator
+{
+public:
+  static constexpr int MAX_CHAIN_LEVELS = 6;
+
+  // Programs are compiled from shaderPath, mipmap.cs.glsl, on first use
+  void init(fs::path shaderPath);
+
+  // Format of the image views of textures of internalFormat, 0 if their
+  // levels are generated by glGenerateMipmap
+  static GLenum imageFormat(GLenum internalFormat);
+
+  // Fill levels 1 to levels - 1 of texture, of target GL_TEXTURE_2D or
+  // GL_TEXTURE_CUBE_MAP, from its level 0 of width x height texels. With
+  // normals, texels are tangent space normals encoded as 0.5 * n + 0.5.
+  // Changes the bound program and image units, and GL_TEXTURE_2D or
+  // GL_TEXTURE_CUBE_MAP of the active unit on fallback.
+  void generate(GLenum target, GLuint texture, GLenum internalFormat,
+      GLsizei width, GLsizei height, GLsizei levels, MipFilter filter,
+      bool normals);
+
+private:
+  const GLProgram &program(GLenum format, bool chain);
+
+  fs::path m_shaderPath;
+  std::map<std::pair<GLenum, bool>, GLProgram> m_programs;
+};
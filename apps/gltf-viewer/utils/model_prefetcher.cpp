@@ -0,0 +1,147 @@
+#include "model_prefetcher.hpp"
+
+#include "trace.hpp"
+
+#include <algorithm>
+
+ModelPrefetcher::ModelPrefetcher(const PrefetchOptions &options) :
+    m_options{options}
+{
+  if (m_options.models > 0) {
+    m_thread = std::thread([this]() { loadModels(); });
+  }
+}
+
+ModelPrefetcher::~ModelPrefetcher()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopped = true;
+  }
+  m_signal.notify_all();
+  if (m_thread.joinable()) {
+    m_thread.join();
+  }
+}
+
+void ModelPrefetcher::prefetch(const std::vector<fs::path> &upcoming)
+{
+  if (m_options.models == 0) {
+    return;
+  }
+
+  std::vector<fs::path> wanted;
+  for (const auto &path : upcoming) {
+    if (wanted.size() == m_options.models) {
+      break;
+    }
+    if (std::find(begin(wanted), end(wanted), path) == end(wanted)) {
+      wanted.push_back(path);
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // A model being loaded for none of them is dropped once loaded
+    m_models.erase(std::remove_if(begin(m_models), end(m_models),
+                       [&](const Entry &entry) {
+                         return std::find(begin(wanted), end(wanted),
+                                    entry.model.path) == end(wanted);
+                       }),
+        end(m_models));
+    for (const auto &path : wanted) {
+      if (std::none_of(begin(m_models), end(m_models),
+              [&](const Entry &entry) { return entry.model.path == path; })) {
+        m_models.emplace_back();
+        m_models.back().model.path = path;
+      }
+    }
+  }
+  m_signal.notify_all();
+}
+
+bool ModelPrefetcher::take(const fs::path &path, PrefetchedModel &model)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  const auto it = std::find_if(begin(m_models), end(m_models),
+      [&](const Entry &entry) { return entry.model.path == path; });
+  if (it == end(m_models)) {
+    return false;
+  }
+  m_models.erase(begin(m_models), it);
+
+  // The models before it are gone, it is the next one loaded
+  m_signal.notify_all();
+  {
+    TRACE_ZONE("waitPrefetchedModel");
+    m_signal.wait(lock, [&]() { return m_models.front().done; });
+  }
+  model = std::move(m_models.front().model);
+  m_models.pop_front();
+  lock.unlock();
+  m_signal.notify_all();
+  return true;
+}
+
+void ModelPrefetcher::loadModels()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  for (;;) {
+    m_signal.wait(lock, [&]() {
+      return m_stopped ||
+             (nextQueued() && stagedBytes() < m_options.budgetBytes);
+    });
+    if (m_stopped) {
+      return;
+    }
+    auto *entry = nextQueued();
+    entry->loading = true;
+    PrefetchedModel model;
+    model.path = entry->model.path;
+    lock.unlock();
+
+    {
+      TRACE_ZONE("prefetchModel");
+      tinygltf::TinyGLTF loader;
+      model.loaded = loadGltfModel(loader, model.path, model.model,
+          model.buffers, model.err, model.warn);
+      for (size_t i = 0; i < model.buffers.size(); ++i) {
+        model.bytes += model.buffers[i].size;
+      }
+      for (const auto &image : model.model.images) {
+        model.bytes += image.image.size();
+      }
+    }
+
+    lock.lock();
+    // Not found if it was dropped meanwhile
+    for (auto &loading : m_models) {
+      if (loading.loading && loading.model.path == model.path) {
+        loading.model = std::move(model);
+        loading.loading = false;
+        loading.done = true;
+        break;
+      }
+    }
+    m_signal.notify_all();
+  }
+}
+
+ModelPrefetcher::Entry *ModelPrefetcher::nextQueued()
+{
+  for (auto &entry : m_models) {
+    if (!entry.loading && !entry.done) {
+      return &entry;
+    }
+  }
+  return nullptr;
+}
+
+size_t ModelPrefetcher::stagedBytes() const
+{
+  size_t bytes = 0;
+  for (const auto &entry : m_models) {
+    bytes += entry.done ? entry.model.bytes : 0;
+  }
+  return bytes;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "filesystem.hpp"
+#include "gltf_loader.hpp"
+
+#include <tiny_gltf.h>
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Models of the jobs queued for the next renderers of serveRenderJobs,
+// loaded ahead while the current one renders
+struct PrefetchOptions
+{
+  size_t models = 1; // Loaded ahead at most, none if 0
+  // Bytes of the buffers and decoded images of the models loaded ahead and
+  // not taken yet, no more model is started once they reach it
+  size_t budgetBytes = size_t(1) << 30;
+};
+
+// A model loaded by loadGltfModel(), as ViewerApplication::loadGltfFile()
+// loads a single file without lazy images with the single pass parser
+struct PrefetchedModel
+{
+  fs::path path;
+  bool loaded = false;
+  tinygltf::Model model;
+  GltfBuffers buffers;
+  std::string err;
+  std::string warn;
+  size_t bytes = 0; // Counted against PrefetchOptions::budgetBytes
+};
+
+// Loads models in order on a thread of its own, images and compressed buffer
+// views being decoded by the jobs of loadGltfModel(), so that the parsing and
+// decoding of the next model overlaps the draws of the current one and only
+// the upload is left once its renderer starts
+class ModelPrefetcher
+{
+public:
+  explicit ModelPrefetcher(const PrefetchOptions &options);
+  ~ModelPrefetcher(); // Waits for the model being loaded
+
+  ModelPrefetcher(const ModelPrefetcher &) = delete;
+  ModelPrefetcher &operator=(const ModelPrefetcher &) = delete;
+
+  // Models of the upcoming jobs in order, without waiting: the first ones
+  // not loaded yet are queued, within the options. Models loaded for none of
+  // them are dropped.
+  void prefetch(const std::vector<fs::path> &upcoming);
+
+  // Move the model of path to model, waiting for it if it is being loaded.
+  // False if it was not prefetched, otherwise the models queued before it
+  // are dropped.
+  bool take(const fs::path &path, PrefetchedModel &model);
+
+private:
+  struct Entry
+  {
+    PrefetchedModel model; // Only its path until done
+    bool loading = false;
+    bool done = false;
+  };
+
+  void loadModels();
+  // With m_mutex locked
+  Entry *nextQueued();
+  size_t stagedBytes() const;
+
+  PrefetchOptions m_options;
+  std::deque<Entry> m_models; // In the order of the jobs
+  bool m_stopped = false;
+  std::mutex m_mutex;
+  std::condition_variable m_signal;
+  std::thread m_thread;
+};
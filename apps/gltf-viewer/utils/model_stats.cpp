@@ -0,0 +1,435 @@
+#include "model_stats.hpp"
+
+#include "gltf.hpp"
+#include "job_system.hpp"
+#include "mesh_optimizer.hpp"
+#include "static_batching.hpp"
+#include "trace.hpp"
+
+#include <json.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iomanip>
+#include <numeric>
+#include <set>
+#include <unordered_set>
+
+namespace
+{
+
+// Call function(nodeIdx, gpuInstanceCount) for each instance of a node with a
+// mesh in the default scene
+template <typename Function>
+void visitMeshInstances(const tinygltf::Model &model,
+    const GltfBuffers &buffers, Function &&function)
+{
+  const auto scene = model.defaultScene >= 0 ? size_t(model.defaultScene) : 0;
+  if (scene >= model.scenes.size()) {
+    return;
+  }
+  std::vector<int> stack(model.scenes[scene].nodes.rbegin(),
+      model.scenes[scene].nodes.rend());
+  while (!stack.empty()) {
+    const auto nodeIdx = stack.back();
+    stack.pop_back();
+    if (nodeIdx < 0 || size_t(nodeIdx) >= model.nodes.size()) {
+      continue;
+    }
+    const auto &node = model.nodes[nodeIdx];
+    if (node.mesh >= 0 && size_t(node.mesh) < model.meshes.size()) {
+      const auto gpuInstances =
+          getGpuInstanceMatrices(model, buffers, node).size();
+      function(nodeIdx, std::max<size_t>(gpuInstances, 1));
+    }
+    stack.insert(stack.end(), node.children.rbegin(), node.children.rend());
+  }
+}
+
+// Draws of the default scene with a draw per primitive of each mesh, however
+// many nodes instance it
+size_t countInstancedDraws(
+    const tinygltf::Model &model, const GltfBuffers &buffers)
+{
+  std::set<int> meshes;
+  visitMeshInstances(model, buffers,
+      [&](int nodeIdx, size_t) { meshes.insert(model.nodes[nodeIdx].mesh); });
+  size_t draws = 0;
+  for (const auto mesh : meshes) {
+    draws += model.meshes[mesh].primitives.size();
+  }
+  return draws;
+}
+
+// Triangle list of the elements of a primitive, strips and fans unrolled
+std::vector<uint32_t> triangleList(
+    int mode, const std::vector<uint32_t> &elements, size_t vertexCount)
+{
+  std::vector<uint32_t> indices;
+  const auto addTriangle = [&](uint32_t a, uint32_t b, uint32_t c) {
+    if (a < vertexCount && b < vertexCount && c < vertexCount) {
+      indices.insert(indices.end(), {a, b, c});
+    }
+  };
+  if (mode == TINYGLTF_MODE_TRIANGLES) {
+    for (size_t j = 0; j + 2 < elements.size(); j += 3) {
+      addTriangle(elements[j], elements[j + 1], elements[j + 2]);
+    }
+  } else if (mode == TINYGLTF_MODE_TRIANGLE_STRIP) {
+    for (size_t j = 0; j + 2 < elements.size(); ++j) {
+      if (j % 2) {
+        addTriangle(elements[j + 1], elements[j], elements[j + 2]);
+      } else {
+        addTriangle(elements[j], elements[j + 1], elements[j + 2]);
+      }
+    }
+  } else if (mode == TINYGLTF_MODE_TRIANGLE_FAN) {
+    for (size_t j = 1; j + 1 < elements.size(); ++j) {
+      addTriangle(elements[0], elements[j], elements[j + 1]);
+    }
+  }
+  return indices;
+}
+
+// Vertices of the primitive whose attributes, all of them, are bitwise equal
+// to those of an earlier vertex
+size_t countDuplicateVertices(const tinygltf::Model &model,
+    const GltfBuffers &buffers, const tinygltf::Primitive &primitive,
+    size_t vertexCount)
+{
+  // Rows of the attributes of each vertex, as read by the viewer
+  std::vector<std::vector<glm::vec4>> attributes;
+  for (const auto &attribute : primitive.attributes) {
+    if (attribute.second < 0 ||
+        size_t(attribute.second) >= model.accessors.size()) {
+      continue;
+    }
+    auto values =
+        readVectors(model, buffers, model.accessors[attribute.second]);
+    if (values.size() == vertexCount) {
+      attributes.push_back(std::move(values));
+    }
+  }
+  if (attributes.empty()) {
+    return 0;
+  }
+  const auto rowSize = attributes.size() * sizeof(glm::vec4);
+  std::vector<unsigned char> rows(vertexCount * rowSize);
+  for (size_t v = 0; v < vertexCount; ++v) {
+    for (size_t a = 0; a < attributes.size(); ++a) {
+      std::memcpy(&rows[v * rowSize + a * sizeof(glm::vec4)],
+          &attributes[a][v], sizeof(glm::vec4));
+    }
+  }
+
+  // FNV-1a of the row of a vertex
+  const auto hash = [&](uint32_t v) {
+    size_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < rowSize; ++i) {
+      h = (h ^ rows[v * rowSize + i]) * 1099511628211ull;
+    }
+    return h;
+  };
+  const auto equal = [&](uint32_t a, uint32_t b) {
+    return std::memcmp(&rows[a * rowSize], &rows[b * rowSize], rowSize) == 0;
+  };
+  std::unordered_set<uint32_t, decltype(hash), decltype(equal)> unique(
+      vertexCount, hash, equal);
+  for (uint32_t v = 0; v < vertexCount; ++v) {
+    unique.insert(v);
+  }
+  return vertexCount - unique.size();
+}
+
+PrimitiveStats primitiveStats(const tinygltf::Model &model,
+    const GltfBuffers &buffers, int meshIdx, int primitiveIdx)
+{
+  const auto &primitive = model.meshes[meshIdx].primitives[primitiveIdx];
+  PrimitiveStats stats;
+  stats.mesh = meshIdx;
+  stats.primitive = primitiveIdx;
+  stats.mode = primitive.mode;
+  const auto position = primitive.attributes.find("POSITION");
+  if (position == primitive.attributes.end() || position->second < 0 ||
+      size_t(position->second) >= model.accessors.size()) {
+    return stats;
+  }
+  stats.vertexCount = model.accessors[position->second].count;
+  stats.duplicateVertexCount =
+      countDuplicateVertices(model, buffers, primitive, stats.vertexCount);
+
+  std::vector<uint32_t> elements;
+  if (primitive.indices >= 0 &&
+      size_t(primitive.indices) < model.accessors.size()) {
+    const auto &accessor = model.accessors[primitive.indices];
+    stats.indexType = accessor.componentType;
+    visitIndices(model, buffers, accessor, [&](const auto &view) {
+      elements.resize(view.size());
+      view.read(elements.data());
+    });
+  } else {
+    elements.resize(stats.vertexCount);
+    std::iota(elements.begin(), elements.end(), 0u);
+  }
+  const auto indices =
+      triangleList(primitive.mode, elements, stats.vertexCount);
+  stats.triangleCount = indices.size() / 3;
+  if (stats.triangleCount) {
+    stats.acmr = averageCacheMissRatio(
+        indices.data(), indices.size(), stats.vertexCount);
+  }
+  return stats;
+}
+
+// Bytes of the levels of a texture of width x height texels, blockBytes per
+// block of blockSize x blockSize texels
+size_t mipmappedBytes(
+    size_t width, size_t height, size_t blockSize, size_t blockBytes)
+{
+  size_t bytes = 0;
+  for (;;) {
+    bytes += (width + blockSize - 1) / blockSize *
+             ((height + blockSize - 1) / blockSize) * blockBytes;
+    if (width == 1 && height == 1) {
+      return bytes;
+    }
+    width = std::max<size_t>(width / 2, 1);
+    height = std::max<size_t>(height / 2, 1);
+  }
+}
+
+const char *modeName(int mode)
+{
+  switch (mode) {
+  case TINYGLTF_MODE_POINTS:
+    return "points";
+  case TINYGLTF_MODE_LINE:
+  case TINYGLTF_MODE_LINE_LOOP:
+  case TINYGLTF_MODE_LINE_STRIP:
+    return "lines";
+  case TINYGLTF_MODE_TRIANGLES:
+    return "triangles";
+  case TINYGLTF_MODE_TRIANGLE_STRIP:
+    return "strip";
+  case TINYGLTF_MODE_TRIANGLE_FAN:
+    return "fan";
+  }
+  return "unknown";
+}
+
+const char *indexTypeName(int indexType)
+{
+  switch (indexType) {
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+    return "u8";
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+    return "u16";
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+    return "u32";
+  }
+  return "none";
+}
+
+double percent(size_t part, size_t whole)
+{
+  return whole ? 100. * double(part) / double(whole) : 0.;
+}
+
+double megabytes(size_t bytes) { return double(bytes) / (1024. * 1024.); }
+
+// "GUI" is gui
+std::string tagKey(HeapTag tag)
+{
+  std::string key = heapTagName(tag);
+  for (auto &c : key) {
+    c = char(std::tolower(c));
+  }
+  return key;
+}
+
+} // namespace
+
+ModelStats computeModelStats(tinygltf::Model &model, GltfBuffers &buffers)
+{
+  TRACE_ZONE("computeModelStats");
+  ModelStats stats;
+
+  std::vector<std::pair<int, int>> primitives;
+  for (size_t m = 0; m < model.meshes.size(); ++m) {
+    for (size_t p = 0; p < model.meshes[m].primitives.size(); ++p) {
+      primitives.emplace_back(int(m), int(p));
+    }
+  }
+  stats.primitives.resize(primitives.size());
+  JobSystem::shared().parallelFor(
+      primitives.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+          stats.primitives[i] = primitiveStats(
+              model, buffers, primitives[i].first, primitives[i].second);
+        }
+      });
+
+  std::vector<size_t> meshTriangles(model.meshes.size(), 0);
+  for (const auto &primitive : stats.primitives) {
+    stats.vertexCount += primitive.vertexCount;
+    stats.duplicateVertexCount += primitive.duplicateVertexCount;
+    stats.triangleCount += primitive.triangleCount;
+    meshTriangles[primitive.mesh] += primitive.triangleCount;
+  }
+
+  std::vector<NodeStats> nodes(model.nodes.size());
+  visitMeshInstances(model, buffers, [&](int nodeIdx, size_t instances) {
+    const auto mesh = model.nodes[nodeIdx].mesh;
+    auto &node = nodes[nodeIdx];
+    node.instanceCount += instances;
+    node.triangleCount += meshTriangles[mesh] * instances;
+    node.drawCalls += model.meshes[mesh].primitives.size() * instances;
+  });
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    if (!nodes[i].instanceCount) {
+      continue;
+    }
+    nodes[i].node = int(i);
+    nodes[i].name = model.nodes[i].name;
+    stats.drawnTriangleCount += nodes[i].triangleCount;
+    stats.drawCalls += nodes[i].drawCalls;
+    stats.nodes.push_back(nodes[i]);
+  }
+  std::stable_sort(stats.nodes.begin(), stats.nodes.end(),
+      [](const NodeStats &a, const NodeStats &b) {
+        return a.triangleCount > b.triangleCount;
+      });
+
+  for (const auto &image : model.images) {
+    if (image.width <= 0 || image.height <= 0) {
+      continue;
+    }
+    ++stats.textureCount;
+    stats.uncompressedTextureBytes +=
+        mipmappedBytes(size_t(image.width), size_t(image.height), 1, 4);
+    stats.compressedTextureBytes +=
+        mipmappedBytes(size_t(image.width), size_t(image.height), 4, 16);
+    if (image.as_is) {
+      stats.encodedTextureBytes += image.image.size();
+    }
+  }
+
+  stats.instancedDrawCalls = countInstancedDraws(model, buffers);
+  batchStaticNodes(model, buffers);
+  stats.mergedDrawCalls = countInstancedDraws(model, buffers);
+  stats.heapMemory = heapUsage();
+  return stats;
+}
+
+void printModelStats(
+    const ModelStats &stats, std::ostream &out, size_t maxRows)
+{
+  out << std::fixed << std::setprecision(1);
+  out << "Vertices: " << stats.vertexCount << ", "
+      << stats.duplicateVertexCount << " duplicates ("
+      << percent(stats.duplicateVertexCount, stats.vertexCount) << "%)\n";
+  out << "Triangles: " << stats.triangleCount << ", "
+      << stats.drawnTriangleCount << " drawn\n";
+  out << "Draw calls: " << stats.drawCalls << ", "
+      << stats.instancedDrawCalls << " instanced, " << stats.mergedDrawCalls
+      << " merged\n";
+  out << "Textures: " << stats.textureCount << ", "
+      << megabytes(stats.uncompressedTextureBytes) << " MB as RGBA8, "
+      << megabytes(stats.compressedTextureBytes)
+      << " MB block compressed, " << megabytes(stats.encodedTextureBytes)
+      << " MB encoded\n";
+  if (heapAllocationsCounted()) {
+    const auto &heap = stats.heapMemory;
+    out << "Host memory: " << megabytes(heap.total) << " MB, peak "
+        << megabytes(heap.peakTotal) << " MB (";
+    for (size_t i = 0; i < size_t(HeapTag::Count); ++i) {
+      out << (i ? ", " : "") << heapTagName(HeapTag(i)) << ' '
+          << megabytes(heap.bytes[i]) << " MB";
+    }
+    out << ")\n";
+  }
+
+  auto primitives = stats.primitives;
+  std::stable_sort(primitives.begin(), primitives.end(),
+      [](const PrimitiveStats &a, const PrimitiveStats &b) {
+        return a.triangleCount > b.triangleCount;
+      });
+  out << "\nPrimitives, most triangles first:\n"
+      << std::setw(8) << "mesh" << std::setw(10) << "primitive"
+      << std::setw(10) << "mode" << std::setw(8) << "indices"
+      << std::setw(10) << "vertices" << std::setw(12) << "duplicates"
+      << std::setw(11) << "triangles" << std::setw(7) << "acmr" << "\n";
+  out << std::setprecision(2);
+  for (size_t i = 0; i < std::min(primitives.size(), maxRows); ++i) {
+    const auto &primitive = primitives[i];
+    out << std::setw(8) << primitive.mesh << std::setw(10)
+        << primitive.primitive << std::setw(10) << modeName(primitive.mode)
+        << std::setw(8) << indexTypeName(primitive.indexType)
+        << std::setw(10) << primitive.vertexCount << std::setw(12)
+        << primitive.duplicateVertexCount << std::setw(11)
+        << primitive.triangleCount << std::setw(7) << primitive.acmr << "\n";
+  }
+  if (primitives.size() > maxRows) {
+    out << "  ... " << primitives.size() - maxRows << " more\n";
+  }
+
+  out << "\nNodes, most triangles first:\n"
+      << std::setw(8) << "node" << std::setw(11) << "instances"
+      << std::setw(11) << "triangles" << std::setw(7) << "draws"
+      << "  name\n";
+  for (size_t i = 0; i < std::min(stats.nodes.size(), maxRows); ++i) {
+    const auto &node = stats.nodes[i];
+    out << std::setw(8) << node.node << std::setw(11) << node.instanceCount
+        << std::setw(11) << node.triangleCount << std::setw(7)
+        << node.drawCalls << "  " << node.name << "\n";
+  }
+  if (stats.nodes.size() > maxRows) {
+    out << "  ... " << stats.nodes.size() - maxRows << " more\n";
+  }
+}
+
+void printModelStatsJson(const ModelStats &stats, std::ostream &out)
+{
+  nlohmann::json primitives = nlohmann::json::array();
+  for (const auto &primitive : stats.primitives) {
+    primitives.push_back({{"mesh", primitive.mesh},
+        {"primitive", primitive.primitive},
+        {"mode", modeName(primitive.mode)},
+        {"index_type", indexTypeName(primitive.indexType)},
+        {"vertices", primitive.vertexCount},
+        {"duplicate_vertices", primitive.duplicateVertexCount},
+        {"triangles", primitive.triangleCount}, {"acmr", primitive.acmr}});
+  }
+  nlohmann::json nodes = nlohmann::json::array();
+  for (const auto &node : stats.nodes) {
+    nodes.push_back({{"node", node.node}, {"name", node.name},
+        {"instances", node.instanceCount}, {"triangles", node.triangleCount},
+        {"draw_calls", node.drawCalls}});
+  }
+  nlohmann::json document = {{"vertices", stats.vertexCount},
+      {"duplicate_vertices", stats.duplicateVertexCount},
+      {"triangles", stats.triangleCount},
+      {"drawn_triangles", stats.drawnTriangleCount},
+      {"draw_calls",
+          {{"per_instance", stats.drawCalls},
+              {"instanced", stats.instancedDrawCalls},
+              {"merged", stats.mergedDrawCalls}}},
+      {"textures", stats.textureCount},
+      {"texture_bytes",
+          {{"rgba8", stats.uncompressedTextureBytes},
+              {"block_compressed", stats.compressedTextureBytes},
+              {"encoded", stats.encodedTextureBytes}}},
+      {"primitives", primitives}, {"nodes", nodes}};
+  if (heapAllocationsCounted()) {
+    const auto &heap = stats.heapMemory;
+    nlohmann::json hostMemory = {
+        {"total", heap.total}, {"peak", heap.peakTotal}};
+    for (size_t i = 0; i < size_t(HeapTag::Count); ++i) {
+      hostMemory[tagKey(HeapTag(i))] = heap.bytes[i];
+      hostMemory[tagKey(HeapTag(i)) + "_peak"] = heap.peakBytes[i];
+    }
+    document["host_memory_bytes"] = hostMemory;
+  }
+  out << document.dump(2) << '\n';
+}
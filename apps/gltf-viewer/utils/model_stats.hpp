@@ -0,0 +1,84 @@
+#pragma once
+
+#include "gltf_loader.hpp"
+#include "heap_memory.hpp"
+
+#include <tiny_gltf.h>
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Cost of the geometry and textures of a glTF model as the viewer would draw
+// it, computed without a GL context for the info stats command, so that
+// expensive exports can be rejected before they are rendered.
+
+struct PrimitiveStats
+{
+  int mesh = -1;
+  int primitive = -1;
+  int mode = TINYGLTF_MODE_TRIANGLES;
+  // TINYGLTF_COMPONENT_TYPE_UNSIGNED_* of the indices, 0 if not indexed
+  int indexType = 0;
+  size_t vertexCount = 0;
+  // Vertices whose attributes are bitwise equal to an earlier one's
+  size_t duplicateVertexCount = 0;
+  size_t triangleCount = 0;
+  // Vertices transformed per triangle with a 16 entry FIFO cache, see
+  // averageCacheMissRatio(), 0 if the primitive has no triangle
+  float acmr = 0.f;
+};
+
+struct NodeStats
+{
+  int node = -1;
+  std::string name;
+  size_t instanceCount = 0; // Of the node in the scene, times its GPU instances
+  size_t triangleCount = 0; // Of all its instances
+  size_t drawCalls = 0; // Of all its instances, without instancing
+};
+
+struct ModelStats
+{
+  // Of each primitive drawn once
+  size_t vertexCount = 0;
+  size_t duplicateVertexCount = 0;
+  size_t triangleCount = 0;
+  // Of every instance of the default scene
+  size_t drawnTriangleCount = 0;
+
+  // Draw calls of the default scene with a draw per instance of each
+  // primitive, with a draw per primitive drawn instanced, and with a draw per
+  // primitive once the static nodes are merged by batchStaticNodes()
+  size_t drawCalls = 0;
+  size_t instancedDrawCalls = 0;
+  size_t mergedDrawCalls = 0;
+
+  size_t textureCount = 0;
+  // GPU memory of the textures with their mipmaps, as RGBA8 and as a block
+  // compressed format of a byte per texel (BC7, ASTC 4x4)
+  size_t uncompressedTextureBytes = 0;
+  size_t compressedTextureBytes = 0;
+  // Bytes of the encoded images in the files, 0 for those kept decoded
+  size_t encodedTextureBytes = 0;
+
+  // Host heap of the loaded model and the computation, reported if
+  // heapAllocationsCounted()
+  HeapUsage heapMemory;
+
+  std::vector<PrimitiveStats> primitives;
+  std::vector<NodeStats> nodes; // Most triangles first
+};
+
+// Stats of a model loaded with lazyImages, so that images are only probed.
+// Primitives are read by jobs. The static nodes of the model are merged to
+// count mergedDrawCalls, it must not be drawn afterwards.
+ModelStats computeModelStats(tinygltf::Model &model, GltfBuffers &buffers);
+
+// Human readable report, at most maxRows primitives and nodes, the costliest
+void printModelStats(const ModelStats &stats, std::ostream &out,
+    size_t maxRows = 20);
+
+// JSON report of every primitive and node
+void printModelStatsJson(const ModelStats &stats, std::ostream &out);
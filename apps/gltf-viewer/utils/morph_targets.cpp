@@ -0,0 +1,135 @@
+#include "morph_targets.hpp"
+
+#include "gltf.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+
+namespace
+{
+
+// Deltas of an attribute of a morph target, count zeros if the target has
+// no such attribute
+std::vector<glm::vec4> readDeltas(const tinygltf::Model &model,
+    const GltfBuffers &buffers, const RuntimeMorphTarget &target,
+    AttributeSemantic attribute, size_t count)
+{
+  std::vector<glm::vec4> deltas;
+  const auto accessorIdx = target.attributes[attribute];
+  if (accessorIdx >= 0 && size_t(accessorIdx) < model.accessors.size()) {
+    deltas = readVectors(model, buffers, model.accessors[accessorIdx]);
+  }
+  deltas.resize(count, glm::vec4(0));
+  return deltas;
+}
+
+} // namespace
+
+void MorphTargets::build(const tinygltf::Model &model,
+    const RuntimeModel &runtimeModel, const GltfBuffers &buffers,
+    const PackedGeometry &geometry)
+{
+  TRACE_ZONE("buildMorphTargets");
+  m_primitives.clear();
+  m_primitiveIndices.assign(geometry.primitives.size(), uint32_t(NONE));
+  m_deltas.clear();
+  clearDraws();
+
+  // Packed primitives are in glTF order
+  size_t primitiveIdx = 0;
+  for (const auto &mesh : runtimeModel.meshes()) {
+    for (const auto &primitive : mesh.primitives) {
+      const auto &packed = geometry.primitives[primitiveIdx++];
+      const auto positions = primitive.attributes[ATTRIBUTE_POSITION];
+      // Primitives out of the scene are not packed
+      if (primitive.targets.empty() || positions < 0 ||
+          packed.indexCount == 0) {
+        continue;
+      }
+
+      Primitive entry;
+      entry.firstDelta = int32_t(m_deltas.size());
+      entry.vertexCount = uint32_t(model.accessors[positions].count);
+      entry.targetCount = primitive.targets.count;
+      entry.baseVertex = packed.baseVertex;
+      entry.hasNormals = primitive.attributes[ATTRIBUTE_NORMAL] >= 0 &&
+                         std::any_of(primitive.targets.begin(),
+                             primitive.targets.end(),
+                             [](const RuntimeMorphTarget &target) {
+                               return target.attributes[ATTRIBUTE_NORMAL] >= 0;
+                             });
+
+      const auto appendDeltas = [&](const RuntimeMorphTarget &target,
+                                    AttributeSemantic attribute) {
+        for (const auto &delta : readDeltas(
+                 model, buffers, target, attribute, entry.vertexCount)) {
+          m_deltas.emplace_back(delta);
+        }
+      };
+      for (const auto &target : primitive.targets) {
+        appendDeltas(target, ATTRIBUTE_POSITION);
+        if (entry.hasNormals) {
+          appendDeltas(target, ATTRIBUTE_NORMAL);
+        }
+      }
+
+      m_primitiveIndices[primitiveIdx - 1] = uint32_t(m_primitives.size());
+      m_primitives.push_back(entry);
+    }
+  }
+}
+
+void MorphTargets::clearDeltas()
+{
+  m_deltas.clear();
+  m_deltas.shrink_to_fit();
+}
+
+uint32_t MorphTargets::addDraw(size_t primitive, size_t node)
+{
+  const auto index = m_primitiveIndices[primitive];
+  if (index == NONE) {
+    return NONE;
+  }
+  const auto first = uint32_t(m_activeTargets.size());
+  m_draws.push_back(Draw{index, uint32_t(node), first});
+  m_activeTargets.resize(
+      m_activeTargets.size() + 1 + m_primitives[index].targetCount);
+  m_activeTargets[first].positions = 0;
+  return first;
+}
+
+void MorphTargets::clearDraws()
+{
+  m_draws.clear();
+  m_activeTargets.clear();
+}
+
+void MorphTargets::update(const SceneGraph &sceneGraph)
+{
+  TRACE_ZONE("updateMorphTargets");
+  for (const auto &draw : m_draws) {
+    const auto &primitive = m_primitives[draw.primitive];
+    const auto *weights = sceneGraph.weights(draw.node);
+    const auto weightCount = std::min(
+        size_t(primitive.targetCount), sceneGraph.weightCount(draw.node));
+    const auto stride =
+        int32_t(primitive.vertexCount) * (primitive.hasNormals ? 2 : 1);
+
+    auto *header = &m_activeTargets[draw.first];
+    auto *active = header + 1;
+    for (size_t t = 0; t < weightCount; ++t) {
+      if (weights[t] == 0.f) {
+        continue;
+      }
+      active->positions =
+          primitive.firstDelta + int32_t(t) * stride - primitive.baseVertex;
+      active->normals = primitive.hasNormals
+                            ? active->positions + int32_t(primitive.vertexCount)
+                            : -1;
+      active->weight = weights[t];
+      ++active;
+    }
+    header->positions = GLint(active - header - 1);
+  }
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "gltf_loader.hpp"
+#include "packed_geometry.hpp"
+#include "runtime_model.hpp"
+#include "scene_graph.hpp"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <tiny_gltf.h>
+
+#include <cstdint>
+#include <vector>
+
+// The morph targets of the primitives of a glTF model, blended in the vertex
+// shader. The POSITION and NORMAL deltas of every target are expanded once,
+// sparse accessors included, into one array of RGB32F texels read through a
+// texture buffer at the index of the vertex. Each draw of a morphed primitive
+// has an entry in activeTargets() listing the targets of non-zero weight, so
+// that the cost of a vertex only depends on the targets in use.
+class MorphTargets
+{
+public:
+  static const uint32_t NONE = 0xffffffff;
+
+  // std430 layout of MorphTarget in forward.vs.glsl. The first entry of a
+  // draw is a header whose positions is the number of entries that follow.
+  struct ActiveTarget
+  {
+    GLint positions; // First texel of the deltas, minus the base vertex
+    GLint normals; // -1 if the target has no normal deltas
+    float weight;
+    GLuint padding;
+  };
+
+  // Replace the content with the targets of the primitives of geometry,
+  // packed from the model whose buffers must still be loaded
+  void build(const tinygltf::Model &model, const RuntimeModel &runtimeModel,
+      const GltfBuffers &buffers, const PackedGeometry &geometry);
+
+  bool empty() const { return m_primitives.empty(); }
+
+  // Texels of the texture buffer, freed by clearDeltas() once uploaded
+  const std::vector<glm::vec3> &deltas() const { return m_deltas; }
+  void clearDeltas();
+
+  // Add a draw of the primitive at index primitive of the packed geometry,
+  // instanced by the node at position node of the scene graph. Return the
+  // index of its header in activeTargets(), NONE if the primitive has no
+  // morph targets.
+  uint32_t addDraw(size_t primitive, size_t node);
+  void clearDraws();
+
+  // Fill the entries of every draw from the weights of the scene graph
+  void update(const SceneGraph &sceneGraph);
+
+  const std::vector<ActiveTarget> &activeTargets() const
+  {
+    return m_activeTargets;
+  }
+
+private:
+  struct Primitive
+  {
+    int32_t firstDelta; // In m_deltas
+    uint32_t vertexCount;
+    uint32_t targetCount;
+    int32_t baseVertex;
+    bool hasNormals; // Normal deltas follow the positions of each target
+  };
+
+  struct Draw
+  {
+    uint32_t primitive; // In m_primitives
+    uint32_t node;
+    uint32_t first; // Header in m_activeTargets
+  };
+
+  std::vector<Primitive> m_primitives;
+  // Per primitive of the packed geometry, in m_primitives or NONE
+  std::vector<uint32_t> m_primitiveIndices;
+  std::vector<glm::vec3> m_deltas;
+  std::vector<Draw> m_draws;
+  std::vector<ActiveTarget> m_activeTargets;
+};
@@ -0,0 +1,147 @@
+#include "node_culling.hpp"
+
+#include "trace.hpp"
+
+#include <utility>
+
+namespace
+{
+
+// Group the values by key, keys in [0, keyCount): offsets of each key then
+// the values in key order, stable within a key
+void groupByKey(const std::vector<std::pair<uint32_t, uint32_t>> &pairs,
+    size_t keyCount, std::vector<uint32_t> &offsets,
+    std::vector<uint32_t> &values)
+{
+  offsets.assign(keyCount + 1, 0);
+  for (const auto &pair : pairs) {
+    ++offsets[pair.first + 1];
+  }
+  for (size_t i = 0; i < keyCount; ++i) {
+    offsets[i + 1] += offsets[i];
+  }
+  values.resize(pairs.size());
+  auto next = offsets;
+  for (const auto &pair : pairs) {
+    values[next[pair.first]++] = pair.second;
+  }
+}
+
+} // namespace
+
+void NodeCulling::build(
+    const SceneGraph &sceneGraph, const std::vector<int> &itemNodes)
+{
+  const auto nodeCount = sceneGraph.size();
+  m_parents.resize(nodeCount);
+  m_roots.clear();
+  std::vector<std::pair<uint32_t, uint32_t>> pairs;
+  for (size_t i = 0; i < nodeCount; ++i) {
+    m_parents[i] = sceneGraph.parent(i);
+    if (m_parents[i] < 0) {
+      m_roots.push_back(uint32_t(i));
+    } else {
+      pairs.emplace_back(uint32_t(m_parents[i]), uint32_t(i));
+    }
+  }
+  groupByKey(pairs, nodeCount, m_childOffsets, m_children);
+
+  pairs.clear();
+  m_looseItems.clear();
+  for (size_t i = 0; i < itemNodes.size(); ++i) {
+    if (itemNodes[i] >= 0 && size_t(itemNodes[i]) < nodeCount) {
+      pairs.emplace_back(uint32_t(itemNodes[i]), uint32_t(i));
+    } else {
+      m_looseItems.push_back(uint32_t(i));
+    }
+  }
+  groupByKey(pairs, nodeCount, m_itemOffsets, m_items);
+
+  m_itemBounds.assign(itemNodes.size(), Aabb());
+  m_subtreeBounds.assign(nodeCount, Aabb());
+  m_unboundedItems.clear();
+}
+
+void NodeCulling::update(const std::vector<Aabb> &itemBounds)
+{
+  TRACE_ZONE("NodeCulling::update");
+  m_itemBounds = itemBounds;
+  m_unboundedItems.clear();
+  for (size_t i = 0; i < m_itemBounds.size(); ++i) {
+    if (m_itemBounds[i].isEmpty()) {
+      m_unboundedItems.push_back(uint32_t(i));
+    }
+  }
+
+  // Parents come before their children in the scene graph
+  for (size_t n = m_parents.size(); n-- > 0;) {
+    auto &bounds = m_subtreeBounds[n];
+    bounds = Aabb();
+    for (auto i = m_itemOffsets[n]; i < m_itemOffsets[n + 1]; ++i) {
+      const auto &box = m_itemBounds[m_items[i]];
+      bounds.min = glm::min(bounds.min, box.min);
+      bounds.max = glm::max(bounds.max, box.max);
+    }
+    for (auto i = m_childOffsets[n]; i < m_childOffsets[n + 1]; ++i) {
+      const auto &box = m_subtreeBounds[m_children[i]];
+      bounds.min = glm::min(bounds.min, box.min);
+      bounds.max = glm::max(bounds.max, box.max);
+    }
+  }
+}
+
+void NodeCulling::appendSubtree(
+    uint32_t node, std::vector<uint32_t> &items) const
+{
+  auto &stack = m_subtreeStack;
+  stack.assign(1, node);
+  while (!stack.empty()) {
+    const auto n = stack.back();
+    stack.pop_back();
+    for (auto i = m_itemOffsets[n]; i < m_itemOffsets[n + 1]; ++i) {
+      if (!m_itemBounds[m_items[i]].isEmpty()) {
+        items.push_back(m_items[i]);
+      }
+    }
+    stack.insert(stack.end(), m_children.begin() + m_childOffsets[n],
+        m_children.begin() + m_childOffsets[n + 1]);
+  }
+}
+
+void NodeCulling::queryFrustum(
+    const Frustum &frustum, std::vector<uint32_t> &items) const
+{
+  TRACE_ZONE("NodeCulling::queryFrustum");
+  items.insert(items.end(), m_unboundedItems.begin(), m_unboundedItems.end());
+  for (const auto i : m_looseItems) {
+    const auto &box = m_itemBounds[i];
+    if (!box.isEmpty() && frustum.intersects(box)) {
+      items.push_back(i);
+    }
+  }
+
+  auto &stack = m_stack;
+  stack.assign(m_roots.begin(), m_roots.end());
+  while (!stack.empty()) {
+    const auto n = stack.back();
+    stack.pop_back();
+
+    const auto &bounds = m_subtreeBounds[n];
+    if (bounds.isEmpty() || !frustum.intersects(bounds)) {
+      continue;
+    }
+    // Everything below a node inside the frustum is visible
+    if (frustum.contains(bounds)) {
+      appendSubtree(n, items);
+      continue;
+    }
+    for (auto i = m_itemOffsets[n]; i < m_itemOffsets[n + 1]; ++i) {
+      const auto &box = m_itemBounds[m_items[i]];
+      if (!box.isEmpty() && frustum.intersects(box)) {
+        items.push_back(m_items[i]);
+      }
+    }
+    stack.insert(stack.end(), m_children.begin() + m_childOffsets[n],
+        m_children.begin() + m_childOffsets[n + 1]);
+  }
+}
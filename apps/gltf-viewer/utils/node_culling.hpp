@@ -0,0 +1,50 @@
+#pragma once
+
+#include "frustum.hpp"
+#include "scene_graph.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// Frustum culling of draw items through the node hierarchy of a scene graph
+// instead of a BVH. Each node is bounded by the items of its subtree, a query
+// skips the subtrees outside of the frustum and takes those inside whole.
+// The bounds follow the grouping of the asset however its nodes move, where
+// a refitted BVH gets looser as they leave their place at build time.
+//
+// Items are identified by their index in the vectors given to build() and
+// update(). Items with an empty box are returned by every query, as by Bvh.
+class NodeCulling
+{
+public:
+  // Attach item i to the node at position itemNodes[i] of sceneGraph, or to
+  // none with -1, such items being tested one by one
+  void build(const SceneGraph &sceneGraph, const std::vector<int> &itemNodes);
+
+  // Bound each subtree by the boxes of its items, children before parents.
+  // itemBounds must have the size given to build().
+  void update(const std::vector<Aabb> &itemBounds);
+
+  // Append the items whose box intersects the frustum
+  void queryFrustum(const Frustum &frustum, std::vector<uint32_t> &items) const;
+
+private:
+  // Append the bounded items of the subtree of node
+  void appendSubtree(uint32_t node, std::vector<uint32_t> &items) const;
+
+  std::vector<int> m_parents;
+  std::vector<uint32_t> m_roots;
+  // Children and items of node n are at [offsets[n], offsets[n + 1])
+  std::vector<uint32_t> m_childOffsets;
+  std::vector<uint32_t> m_children;
+  std::vector<uint32_t> m_itemOffsets;
+  std::vector<uint32_t> m_items;
+  std::vector<uint32_t> m_looseItems; // Attached to no node
+
+  std::vector<Aabb> m_itemBounds;
+  std::vector<Aabb> m_subtreeBounds;
+  std::vector<uint32_t> m_unboundedItems;
+  // Nodes left to visit by a query, kept for its capacity
+  mutable std::vector<uint32_t> m_stack;
+  mutable std::vector<uint32_t> m_subtreeStack;
+};
@@ -0,0 +1,997 @@
+#include "packed_geometry.hpp"
+
+#include "gltf.hpp"
+#include "heap_memory.hpp"
+#include "job_system.hpp"
+#include "mesh_optimizer.hpp"
+#include "trace.hpp"
+
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <utility>
+
+namespace
+{
+
+const AttributeSemantic ATTRIBUTE_SEMANTICS[VERTEX_ATTRIBUTE_COUNT] = {
+    ATTRIBUTE_POSITION, ATTRIBUTE_NORMAL, ATTRIBUTE_TEXCOORD_0,
+    ATTRIBUTE_JOINTS_0, ATTRIBUTE_WEIGHTS_0, ATTRIBUTE_TANGENT};
+
+const tinygltf::Accessor *findAttribute(const tinygltf::Model &model,
+    const RuntimePrimitive &primitive, VertexAttribute attribute)
+{
+  const auto accessorIdx = primitive.attributes[ATTRIBUTE_SEMANTICS[attribute]];
+  return accessorIdx >= 0 ? &model.accessors[accessorIdx] : nullptr;
+}
+
+size_t elementSize(const tinygltf::Accessor &accessor)
+{
+  return size_t(tinygltf::GetComponentSizeInBytes(accessor.componentType)) *
+         tinygltf::GetNumComponentsInType(accessor.type);
+}
+
+// First element of an accessor and the distance between two elements, nullptr
+// if the accessor has no buffer view
+const unsigned char *accessorData(const tinygltf::Model &model,
+    const GltfBuffers &buffers, const tinygltf::Accessor &accessor,
+    size_t &stride)
+{
+  if (accessor.bufferView < 0) {
+    return nullptr;
+  }
+  const auto &bufferView = model.bufferViews[accessor.bufferView];
+  stride = bufferView.byteStride ? bufferView.byteStride : elementSize(accessor);
+  return buffers[bufferView.buffer].data + bufferView.byteOffset +
+         accessor.byteOffset;
+}
+
+// Size of an attribute in a vertex, before padding
+uint32_t attributeSize(const VertexFormat::Attribute &attribute)
+{
+  switch (attribute.componentType) {
+  case GL_INT_2_10_10_10_REV:
+    return 4;
+  case GL_HALF_FLOAT:
+  case GL_SHORT:
+  case GL_UNSIGNED_SHORT:
+    return 2 * uint32_t(attribute.componentCount);
+  case GL_BYTE:
+  case GL_UNSIGNED_BYTE:
+    return uint32_t(attribute.componentCount);
+  default:
+    return 4 * uint32_t(attribute.componentCount);
+  }
+}
+
+// Smaller type of a FLOAT attribute with GeometryOptions::quantize, false if
+// it keeps its accessor type
+bool quantizeAttribute(VertexAttribute attribute,
+    const tinygltf::Accessor &accessor, VertexFormat::Attribute &quantized)
+{
+  if (accessor.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT) {
+    return false;
+  }
+  if (attribute == VERTEX_ATTRIBUTE_POSITION &&
+      accessor.type == TINYGLTF_TYPE_VEC3) {
+    quantized.componentType = GL_SHORT;
+    quantized.componentCount = 3;
+    quantized.normalized = true;
+    return true;
+  }
+  if (attribute == VERTEX_ATTRIBUTE_NORMAL &&
+      accessor.type == TINYGLTF_TYPE_VEC3) {
+    quantized.componentType = GL_INT_2_10_10_10_REV;
+    quantized.componentCount = 4;
+    quantized.normalized = true;
+    return true;
+  }
+  if (attribute == VERTEX_ATTRIBUTE_TEXCOORD0 &&
+      accessor.type == TINYGLTF_TYPE_VEC2) {
+    quantized.componentType = GL_HALF_FLOAT;
+    quantized.componentCount = 2;
+    quantized.normalized = false;
+    return true;
+  }
+  return false;
+}
+
+// Whether the accessor is of FLOAT elements of componentCount components
+bool isFloatAccessor(const tinygltf::Accessor *accessor, int componentCount)
+{
+  return accessor && accessor->bufferView >= 0 &&
+         accessor->componentType == TINYGLTF_COMPONENT_TYPE_FLOAT &&
+         tinygltf::GetNumComponentsInType(accessor->type) == componentCount;
+}
+
+// Whether the primitive gets tangents: a triangle list whose material has a
+// normal map, with a FLOAT TANGENT attribute or the FLOAT positions, normals
+// and texture coordinates to generate them from
+bool hasTangents(const tinygltf::Model &model,
+    const RuntimeModel &runtimeModel, const RuntimePrimitive &primitive)
+{
+  if (primitive.mode != TINYGLTF_MODE_TRIANGLES || primitive.material < 0 ||
+      runtimeModel.materials()[primitive.material]
+              .textures[MATERIAL_TEXTURE_NORMAL] < 0) {
+    return false;
+  }
+  const auto attribute = [&](VertexAttribute attribute) {
+    return findAttribute(model, primitive, attribute);
+  };
+  return isFloatAccessor(attribute(VERTEX_ATTRIBUTE_TANGENT), 4) ||
+         (isFloatAccessor(attribute(VERTEX_ATTRIBUTE_POSITION), 3) &&
+             isFloatAccessor(attribute(VERTEX_ATTRIBUTE_NORMAL), 3) &&
+             isFloatAccessor(attribute(VERTEX_ATTRIBUTE_TEXCOORD0), 2));
+}
+
+VertexFormat getVertexFormat(const tinygltf::Model &model,
+    const RuntimePrimitive &primitive, bool tangents,
+    const GeometryOptions &options)
+{
+  VertexFormat format;
+  for (int i = 0; i < VERTEX_ATTRIBUTE_COUNT; ++i) {
+    auto &attribute = format.attributes[i];
+    if (i == VERTEX_ATTRIBUTE_TANGENT) {
+      // Read or generated in floats, whatever the accessor
+      if (!tangents) {
+        continue;
+      }
+      attribute.componentType =
+          options.quantize ? GL_INT_2_10_10_10_REV : GL_FLOAT;
+      attribute.componentCount = 4;
+      attribute.normalized = options.quantize;
+      attribute.offset = format.stride;
+      format.stride += (attributeSize(attribute) + 3) & ~3u;
+      continue;
+    }
+    const auto *accessor = findAttribute(model, primitive, VertexAttribute(i));
+    if (!accessor) {
+      continue;
+    }
+    if (!options.quantize ||
+        !quantizeAttribute(VertexAttribute(i), *accessor, attribute)) {
+      attribute.componentType = GLenum(accessor->componentType);
+      attribute.componentCount =
+          tinygltf::GetNumComponentsInType(accessor->type);
+      attribute.normalized = accessor->normalized;
+    }
+    attribute.integer = i == VERTEX_ATTRIBUTE_JOINTS0;
+    attribute.offset = format.stride;
+    // Attributes start on 4 bytes boundaries, as glTF requires for strides
+    format.stride += (attributeSize(attribute) + 3) & ~3u;
+  }
+  return format;
+}
+
+// Write count FLOAT elements of an accessor as the quantized attribute. With
+// positions, dequantize is set to the offset and scale mapping the signed
+// normalized positions back to the ones of the accessor.
+void copyQuantized(const unsigned char *data, size_t stride, size_t count,
+    const VertexFormat::Attribute &attribute, uint32_t vertexStride,
+    unsigned char *vertices, glm::vec4 &dequantize)
+{
+  const auto read = [&](size_t v) {
+    glm::vec3 value(0);
+    std::memcpy(&value, data + v * stride,
+        sizeof(float) * size_t(attribute.componentCount == 2 ? 2 : 3));
+    return value;
+  };
+
+  if (attribute.componentType == GL_SHORT && count) {
+    glm::vec3 min = read(0), max = min;
+    for (size_t v = 1; v < count; ++v) {
+      min = glm::min(min, read(v));
+      max = glm::max(max, read(v));
+    }
+    // One scale for the 3 axes, the largest extent keeps its 16 bits
+    const auto extent = 0.5f * (max - min);
+    const auto scale = std::max(std::max(extent.x, extent.y), extent.z);
+    dequantize = glm::vec4(0.5f * (min + max), scale > 0.f ? scale : 1.f);
+  }
+
+  for (size_t v = 0; v < count; ++v) {
+    auto *vertex = vertices + v * vertexStride + attribute.offset;
+    const auto value = read(v);
+    if (attribute.componentType == GL_SHORT) {
+      const auto q = glm::clamp((value - glm::vec3(dequantize)) / dequantize.w,
+          glm::vec3(-1), glm::vec3(1));
+      const int16_t packed[3] = {int16_t(std::round(q.x * 32767.f)),
+          int16_t(std::round(q.y * 32767.f)),
+          int16_t(std::round(q.z * 32767.f))};
+      std::memcpy(vertex, packed, sizeof(packed));
+    } else if (attribute.componentType == GL_INT_2_10_10_10_REV) {
+      const auto packed = glm::packSnorm3x10_1x2(glm::vec4(value, 0));
+      std::memcpy(vertex, &packed, sizeof(packed));
+    } else {
+      const auto packed = glm::packHalf2x16(glm::vec2(value));
+      std::memcpy(vertex, &packed, sizeof(packed));
+    }
+  }
+}
+
+template <typename Index>
+void copyIndices(const unsigned char *data, size_t count, uint32_t *indices)
+{
+  const auto *source = (const Index *)data;
+  std::copy(source, source + count, indices);
+}
+
+// Whether a packed primitive is a triangle list whose indices can be
+// reordered or simplified
+bool isTriangleList(const PackedPrimitive &packed, uint32_t vertexCount,
+    const uint32_t *indices)
+{
+  return packed.mode == TINYGLTF_MODE_TRIANGLES && packed.indexCount >= 6 &&
+         std::all_of(indices, indices + packed.indexCount,
+             [&](uint32_t index) { return index < vertexCount; });
+}
+
+// FLOAT elements of an attribute of a primitive read from its accessor rather
+// than from the vertices, which may be quantized. Empty for other types, or if
+// the accessor has fewer than vertexCount elements.
+template <typename T>
+std::vector<T> readFloats(const tinygltf::Model &model,
+    const GltfBuffers &buffers, const RuntimePrimitive &primitive,
+    VertexAttribute attribute, uint32_t vertexCount)
+{
+  const auto *accessor = findAttribute(model, primitive, attribute);
+  size_t stride = 0;
+  if (!isFloatAccessor(accessor, T::length()) ||
+      accessor->count < vertexCount) {
+    return {};
+  }
+  const auto *data = accessorData(model, buffers, *accessor, stride);
+  std::vector<T> values(vertexCount);
+  for (size_t v = 0; v < vertexCount; ++v) {
+    std::memcpy(&values[v], data + v * stride, sizeof(T));
+  }
+  return values;
+}
+
+std::vector<glm::vec3> readPositions(const tinygltf::Model &model,
+    const GltfBuffers &buffers, const RuntimePrimitive &primitive,
+    uint32_t vertexCount)
+{
+  return readFloats<glm::vec3>(
+      model, buffers, primitive, VERTEX_ATTRIBUTE_POSITION, vertexCount);
+}
+
+// Per vertex tangents of a triangle list, with the handedness of the
+// bitangent in w as glTF TANGENT: the texture space directions of the
+// triangles are summed at their vertices, weighted by the area of the
+// triangles, then made orthogonal to the normals
+std::vector<glm::vec4> generateTangents(const std::vector<glm::vec3> &positions,
+    const std::vector<glm::vec3> &normals,
+    const std::vector<glm::vec2> &texCoords, const uint32_t *indices,
+    uint32_t indexCount)
+{
+  const auto vertexCount = positions.size();
+  std::vector<glm::vec3> tangents(vertexCount, glm::vec3(0));
+  std::vector<glm::vec3> bitangents(vertexCount, glm::vec3(0));
+  for (uint32_t i = 0; i + 2 < indexCount; i += 3) {
+    const auto i0 = indices[i], i1 = indices[i + 1], i2 = indices[i + 2];
+    const auto e1 = positions[i1] - positions[i0];
+    const auto e2 = positions[i2] - positions[i0];
+    const auto uv1 = texCoords[i1] - texCoords[i0];
+    const auto uv2 = texCoords[i2] - texCoords[i0];
+    const auto det = uv1.x * uv2.y - uv2.x * uv1.y;
+    if (std::abs(det) < 1e-12f) {
+      continue; // Degenerate texture mapping
+    }
+    // Unnormalized, which weights them by the area in model space
+    const auto sign = det < 0.f ? -1.f : 1.f;
+    const auto tangent = (e1 * uv2.y - e2 * uv1.y) * sign;
+    const auto bitangent = (e2 * uv1.x - e1 * uv2.x) * sign;
+    for (const auto v : {i0, i1, i2}) {
+      tangents[v] += tangent;
+      bitangents[v] += bitangent;
+    }
+  }
+
+  std::vector<glm::vec4> result(vertexCount);
+  for (size_t v = 0; v < vertexCount; ++v) {
+    const auto n = normals[v];
+    auto t = tangents[v] - n * glm::dot(n, tangents[v]);
+    if (glm::dot(t, t) < 1e-20f) {
+      // Any direction orthogonal to the normal
+      t = std::abs(n.x) < 0.9f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0);
+      t -= n * glm::dot(n, t);
+    }
+    t = glm::normalize(t);
+    const auto w =
+        glm::dot(glm::cross(n, t), bitangents[v]) < 0.f ? -1.f : 1.f;
+    result[v] = glm::vec4(t, w);
+  }
+  return result;
+}
+
+// Write the tangents of a primitive in its vertices, FLOAT or quantized
+void writeTangents(const std::vector<glm::vec4> &tangents,
+    const VertexFormat &format, unsigned char *vertices)
+{
+  const auto &attribute = format.attributes[VERTEX_ATTRIBUTE_TANGENT];
+  for (size_t v = 0; v < tangents.size(); ++v) {
+    auto *vertex = vertices + v * format.stride + attribute.offset;
+    if (attribute.componentType == GL_INT_2_10_10_10_REV) {
+      const auto packed = glm::packSnorm3x10_1x2(tangents[v]);
+      std::memcpy(vertex, &packed, sizeof(packed));
+    } else {
+      std::memcpy(vertex, &tangents[v], sizeof(glm::vec4));
+    }
+  }
+}
+
+// Reorder the triangles of a packed triangle list and, unless the primitive
+// is morphed, its vertices and positions
+void optimizePrimitive(const RuntimePrimitive &primitive,
+    const PackedPrimitive &packed, PackedVertexBuffer &vertexBuffer,
+    uint32_t vertexCount, uint32_t *indices,
+    std::vector<glm::vec3> &positions)
+{
+  const auto indexCount = packed.indexCount - packed.indexCount % 3;
+  const auto &format = vertexBuffer.format;
+  auto *vertices = vertexBuffer.vertices.data() +
+                   size_t(packed.baseVertex) * format.stride;
+
+  optimizeVertexCache(indices, indexCount, vertexCount);
+  if (!positions.empty()) {
+    optimizeOverdraw(indices, indexCount, positions);
+  }
+
+  if (primitive.targets.empty()) {
+    const auto remap = optimizeVertexFetch(
+        indices, indexCount, vertices, vertexCount, format.stride);
+    if (!positions.empty()) {
+      std::vector<glm::vec3> reordered(vertexCount);
+      for (size_t v = 0; v < vertexCount; ++v) {
+        reordered[remap[v]] = positions[v];
+      }
+      positions.swap(reordered);
+    }
+  }
+}
+
+// Simplify each level from the previous one, appending their indices to
+// lodIndices. The surface may move by up to the size of the primitive.
+void generateLods(const GeometryOptions &options, PackedPrimitive &packed,
+    const uint32_t *indices, const std::vector<glm::vec3> &positions,
+    std::vector<uint32_t> &lodIndices)
+{
+  glm::vec3 min(std::numeric_limits<float>::max());
+  glm::vec3 max(std::numeric_limits<float>::lowest());
+  for (const auto &position : positions) {
+    min = glm::min(min, position);
+    max = glm::max(max, position);
+  }
+  const auto maxError = glm::length(max - min);
+
+  const auto indexCount = packed.indexCount - packed.indexCount % 3;
+  std::vector<uint32_t> source(indices, indices + indexCount);
+  std::vector<uint32_t> simplified(indexCount);
+  float error = 0.f;
+  for (int level = 0; level < options.lodCount && source.size() >= 6;
+       ++level) {
+    const auto target = source.size() / 6 * 3;
+    float levelError = 0.f;
+    const auto count = simplify(simplified.data(), source.data(),
+        source.size(), positions, target, maxError, levelError);
+    // Less than a tenth of the triangles removed, borders and seams are
+    // left
+    if (count * 10 > source.size() * 9) {
+      break;
+    }
+    if (options.optimize) {
+      optimizeVertexCache(simplified.data(), count, positions.size());
+    }
+    error = std::max(error, levelError);
+    packed.lods.push_back(
+        PackedLod{uint32_t(count), uint32_t(lodIndices.size()), error});
+    lodIndices.insert(
+        lodIndices.end(), simplified.begin(), simplified.begin() + count);
+    source.assign(simplified.begin(), simplified.begin() + count);
+  }
+}
+
+// Meshes of the nodes of the default scene, the only ones drawn, and of
+// their MSFT_lod levels, whose nodes may be out of the scene
+std::vector<bool> findDrawnMeshes(
+    const tinygltf::Model &model, const RuntimeModel &runtimeModel)
+{
+  const auto nodes = runtimeModel.nodes();
+  std::vector<bool> drawn(runtimeModel.meshes().count, false);
+  std::vector<bool> visited(nodes.count, false); // Invalid files have cycles
+  std::vector<int32_t> stack(
+      runtimeModel.sceneRoots().begin(), runtimeModel.sceneRoots().end());
+  while (!stack.empty()) {
+    const auto nodeIdx = stack.back();
+    stack.pop_back();
+    if (nodeIdx < 0 || uint32_t(nodeIdx) >= nodes.count || visited[nodeIdx]) {
+      continue;
+    }
+    visited[nodeIdx] = true;
+    const auto &node = nodes[nodeIdx];
+    if (node.mesh >= 0 && uint32_t(node.mesh) < drawn.size()) {
+      drawn[node.mesh] = true;
+    }
+    const auto &gltfNode = model.nodes[nodeIdx];
+    if (gltfNode.extensions.count("MSFT_lod")) {
+      for (const auto levelMesh : getNodeLods(model, gltfNode).meshes) {
+        if (levelMesh >= 0 && uint32_t(levelMesh) < drawn.size()) {
+          drawn[levelMesh] = true;
+        }
+      }
+    }
+    stack.insert(stack.end(), node.children.begin(), node.children.end());
+  }
+  return drawn;
+}
+
+// A primitive of a drawn mesh whose vertices and indices are copied
+struct CopiedPrimitive
+{
+  const RuntimePrimitive *primitive;
+  size_t packedIdx;
+  uint32_t vertexCount; // Left by welding
+  size_t meshIdx;
+  // New position of each vertex of the accessors if welded, else empty
+  std::vector<uint32_t> weldRemap;
+};
+
+// Merge the equal vertices of a triangle list without morph targets, whose
+// deltas follow the vertices of the accessors
+void weldPrimitive(CopiedPrimitive &c, PackedGeometry &geometry)
+{
+  const auto &packed = geometry.primitives[c.packedIdx];
+  auto &vertexBuffer = geometry.vertexBuffers[packed.vertexBuffer];
+  auto *indices = geometry.indices.data() + packed.firstIndex;
+  if (!c.primitive->targets.empty() ||
+      !isTriangleList(packed, c.vertexCount, indices)) {
+    return;
+  }
+  const auto stride = vertexBuffer.format.stride;
+  c.weldRemap = weldVertices(indices, packed.indexCount,
+      vertexBuffer.vertices.data() + size_t(packed.baseVertex) * stride,
+      c.vertexCount, stride);
+  c.vertexCount =
+      *std::max_element(c.weldRemap.begin(), c.weldRemap.end()) + 1;
+}
+
+// Close the gaps welding left in the vertex buffers, the first
+// vertexCounts[p] vertices of primitive p being kept. Primitives are in the
+// order of their vertices in each buffer.
+void compactVertexBuffers(
+    const std::vector<uint32_t> &vertexCounts, PackedGeometry &geometry)
+{
+  std::vector<uint32_t> next(geometry.vertexBuffers.size(), 0);
+  for (size_t p = 0; p < vertexCounts.size(); ++p) {
+    auto &packed = geometry.primitives[p];
+    if (!vertexCounts[p]) {
+      continue;
+    }
+    auto &vertexBuffer = geometry.vertexBuffers[packed.vertexBuffer];
+    const auto stride = vertexBuffer.format.stride;
+    auto &baseVertex = next[packed.vertexBuffer];
+    if (uint32_t(packed.baseVertex) != baseVertex) {
+      std::memmove(vertexBuffer.vertices.data() + size_t(baseVertex) * stride,
+          vertexBuffer.vertices.data() + size_t(packed.baseVertex) * stride,
+          size_t(vertexCounts[p]) * stride);
+      packed.baseVertex = int32_t(baseVertex);
+    }
+    baseVertex += vertexCounts[p];
+  }
+  for (size_t b = 0; b < geometry.vertexBuffers.size(); ++b) {
+    auto &vertexBuffer = geometry.vertexBuffers[b];
+    vertexBuffer.vertexCount = next[b];
+    vertexBuffer.vertices.resize(
+        size_t(next[b]) * vertexBuffer.format.stride);
+  }
+}
+
+// FLOAT positions of a copied primitive in the order of its vertices, those of
+// the first of the welded ones
+std::vector<glm::vec3> readCopiedPositions(const tinygltf::Model &model,
+    const GltfBuffers &buffers, const CopiedPrimitive &c)
+{
+  if (c.weldRemap.empty()) {
+    return readPositions(model, buffers, *c.primitive, c.vertexCount);
+  }
+  const auto positions = readPositions(
+      model, buffers, *c.primitive, uint32_t(c.weldRemap.size()));
+  if (positions.empty()) {
+    return {};
+  }
+  std::vector<glm::vec3> welded(c.vertexCount);
+  for (size_t v = positions.size(); v-- > 0;) {
+    welded[c.weldRemap[v]] = positions[v];
+  }
+  return welded;
+}
+
+// Meshes whose primitives may be merged: drawn once by a single node of the
+// default scene, without skin, EXT_mesh_gpu_instancing nor MSFT_lod
+std::vector<bool> findMergeableMeshes(
+    const tinygltf::Model &model, const RuntimeModel &runtimeModel)
+{
+  const auto nodes = runtimeModel.nodes();
+  const auto meshCount = runtimeModel.meshes().count;
+  // Counted up to 2: the descendants of a node visited twice are too, which
+  // also stops at the cycles of invalid files
+  std::vector<uint8_t> visits(nodes.count, 0);
+  std::vector<uint8_t> instances(meshCount, 0);
+  std::vector<bool> excluded(meshCount, false);
+  std::vector<int32_t> stack(
+      runtimeModel.sceneRoots().begin(), runtimeModel.sceneRoots().end());
+  while (!stack.empty()) {
+    const auto nodeIdx = stack.back();
+    stack.pop_back();
+    if (nodeIdx < 0 || uint32_t(nodeIdx) >= nodes.count ||
+        visits[nodeIdx] >= 2) {
+      continue;
+    }
+    ++visits[nodeIdx];
+    const auto &node = nodes[nodeIdx];
+    const auto &gltfNode = model.nodes[nodeIdx];
+    if (node.mesh >= 0 && uint32_t(node.mesh) < meshCount) {
+      instances[node.mesh] = uint8_t(std::min(instances[node.mesh] + 1, 2));
+      if (node.skin >= 0 ||
+          gltfNode.extensions.count("EXT_mesh_gpu_instancing")) {
+        excluded[node.mesh] = true;
+      }
+    }
+    if (gltfNode.extensions.count("MSFT_lod")) {
+      for (const auto levelMesh : getNodeLods(model, gltfNode).meshes) {
+        if (levelMesh >= 0 && uint32_t(levelMesh) < meshCount) {
+          excluded[levelMesh] = true;
+        }
+      }
+    }
+    stack.insert(stack.end(), node.children.begin(), node.children.end());
+  }
+
+  std::vector<bool> mergeable(meshCount);
+  for (size_t i = 0; i < meshCount; ++i) {
+    mergeable[i] = instances[i] == 1 && !excluded[i];
+  }
+  return mergeable;
+}
+
+// Whether a copied primitive of a mergeable mesh is small enough to be merged
+bool isMergedMember(const RuntimeModel &runtimeModel,
+    const RuntimePrimitive &primitive, const PackedPrimitive &packed,
+    uint32_t vertexCount, const uint32_t *indices)
+{
+  return packed.indexCount / 3 <= MERGE_MAX_TRIANGLES &&
+         primitive.targets.empty() &&
+         (primitive.material < 0 ||
+             runtimeModel.materials()[primitive.material].alphaMode !=
+                 AlphaMode::Blend) &&
+         isTriangleList(packed, vertexCount, indices);
+}
+
+// Append the merged primitives of the small primitives of each vertex buffer
+// and material, in the order of their vertices, with their indices relative
+// to the base vertex of the merged primitive
+void mergeSmallPrimitives(const tinygltf::Model &model,
+    const RuntimeModel &runtimeModel,
+    const std::vector<CopiedPrimitive> &copied, PackedGeometry &geometry)
+{
+  struct Merge
+  {
+    uint32_t vertexBuffer;
+    int32_t baseVertex;
+    std::vector<const CopiedPrimitive *> members;
+  };
+  const auto mergeable = findMergeableMeshes(model, runtimeModel);
+  std::vector<Merge> merges;
+  // Merge being filled for each vertex buffer and material
+  std::map<std::pair<uint32_t, int32_t>, size_t> openMerges;
+  for (const auto &c : copied) {
+    const auto &packed = geometry.primitives[c.packedIdx];
+    if (!mergeable[c.meshIdx] ||
+        !isMergedMember(runtimeModel, *c.primitive, packed, c.vertexCount,
+            geometry.indices.data() + packed.firstIndex)) {
+      continue;
+    }
+    const auto key = std::make_pair(packed.vertexBuffer, c.primitive->material);
+    auto it = openMerges.find(key);
+    if (it == end(openMerges) ||
+        packed.baseVertex + int32_t(c.vertexCount) -
+                merges[(*it).second].baseVertex >
+            0x10000) {
+      merges.push_back(Merge{packed.vertexBuffer, packed.baseVertex, {}});
+      it = openMerges.insert_or_assign(key, merges.size() - 1).first;
+    }
+    merges[(*it).second].members.push_back(&c);
+  }
+
+  std::vector<uint32_t> mergedIndices;
+  for (const auto &merge : merges) {
+    auto &vertexBuffer = geometry.vertexBuffers[merge.vertexBuffer];
+    if (vertexBuffer.firstVertexMember == PACKED_MERGE_NONE) {
+      vertexBuffer.firstVertexMember = uint32_t(geometry.vertexMembers.size());
+      geometry.vertexMembers.resize(
+          geometry.vertexMembers.size() + vertexBuffer.vertexCount,
+          PACKED_MERGE_NONE);
+    }
+
+    PackedPrimitive merged;
+    merged.vertexBuffer = merge.vertexBuffer;
+    merged.mode = TINYGLTF_MODE_TRIANGLES;
+    merged.indexCount = 0;
+    merged.firstIndex =
+        uint32_t(geometry.indices.size() + mergedIndices.size());
+    merged.baseVertex = merge.baseVertex;
+    merged.firstMember = uint32_t(geometry.mergedMembers.size());
+    merged.memberCount = uint32_t(merge.members.size());
+    for (const auto *c : merge.members) {
+      const auto member = uint32_t(geometry.mergedMembers.size());
+      geometry.mergedMembers.push_back(uint32_t(c->packedIdx));
+      const auto &packed = geometry.primitives[c->packedIdx];
+      const auto *indices = geometry.indices.data() + packed.firstIndex;
+      const auto offset = uint32_t(packed.baseVertex - merge.baseVertex);
+      for (uint32_t i = 0; i < packed.indexCount - packed.indexCount % 3;
+           ++i) {
+        mergedIndices.push_back(indices[i] + offset);
+      }
+      merged.indexCount += packed.indexCount - packed.indexCount % 3;
+      std::fill_n(geometry.vertexMembers.begin() +
+                      vertexBuffer.firstVertexMember + packed.baseVertex,
+          c->vertexCount, member);
+    }
+    geometry.primitives.push_back(merged);
+  }
+  geometry.indices.insert(
+      geometry.indices.end(), mergedIndices.begin(), mergedIndices.end());
+}
+
+} // namespace
+
+bool VertexFormat::operator==(const VertexFormat &other) const
+{
+  return stride == other.stride &&
+         std::equal(std::begin(attributes), std::end(attributes),
+             std::begin(other.attributes));
+}
+
+void PackedGeometry::clearData()
+{
+  for (auto &vertexBuffer : vertexBuffers) {
+    vertexBuffer.vertices.clear();
+    vertexBuffer.vertices.shrink_to_fit();
+  }
+  indices.clear();
+  indices.shrink_to_fit();
+  meshlets.clear();
+  meshlets.shrink_to_fit();
+  vertexMembers.clear();
+  vertexMembers.shrink_to_fit();
+}
+
+glm::vec4 readPackedAttribute(const PackedVertexBuffer &vertexBuffer,
+    VertexAttribute attribute, uint32_t vertex)
+{
+  const auto &format = vertexBuffer.format.attributes[attribute];
+  glm::vec4 value(0, 0, 0, 1);
+  if (!format.componentCount) {
+    return value;
+  }
+  const auto *data = vertexBuffer.vertices.data() +
+                     size_t(vertex) * vertexBuffer.format.stride +
+                     format.offset;
+  if (format.componentType == GL_INT_2_10_10_10_REV) {
+    uint32_t packed;
+    std::memcpy(&packed, data, sizeof(packed));
+    return glm::unpackSnorm3x10_1x2(packed);
+  }
+
+  const auto read = [&](auto component, int i) {
+    std::memcpy(&component, data + i * sizeof(component), sizeof(component));
+    return component;
+  };
+  // Signed normalized values clamp -128 and -32768 to -1, as GL does
+  for (int i = 0; i < format.componentCount && i < 4; ++i) {
+    switch (format.componentType) {
+    case GL_FLOAT:
+      value[i] = read(float(), i);
+      break;
+    case GL_HALF_FLOAT:
+      value[i] = glm::unpackHalf1x16(read(uint16_t(), i));
+      break;
+    case GL_SHORT:
+      value[i] = format.normalized
+                     ? std::max(float(read(int16_t(), i)) / 32767.f, -1.f)
+                     : float(read(int16_t(), i));
+      break;
+    case GL_UNSIGNED_SHORT:
+      value[i] = float(read(uint16_t(), i)) / (format.normalized ? 65535.f : 1.f);
+      break;
+    case GL_BYTE:
+      value[i] = format.normalized
+                     ? std::max(float(read(int8_t(), i)) / 127.f, -1.f)
+                     : float(read(int8_t(), i));
+      break;
+    case GL_UNSIGNED_BYTE:
+      value[i] = float(read(uint8_t(), i)) / (format.normalized ? 255.f : 1.f);
+      break;
+    default:
+      value[i] = float(read(uint32_t(), i));
+      break;
+    }
+  }
+  return value;
+}
+
+GLenum packedIndexType(const std::vector<uint32_t> &indices)
+{
+  return std::all_of(indices.begin(), indices.end(),
+             [](uint32_t index) { return index <= 0xffff; })
+             ? GL_UNSIGNED_SHORT
+             : GL_UNSIGNED_INT;
+}
+
+void packGeometry(const tinygltf::Model &model,
+    const RuntimeModel &runtimeModel, const GltfBuffers &buffers,
+    const GeometryOptions &options, PackedGeometry &geometry)
+{
+  TRACE_ZONE("packGeometry");
+  // Of the workers too where what they allocate is kept
+  HeapTagScope heapTag(HeapTag::Geometry);
+  geometry = PackedGeometry();
+
+  // Place every primitive in its vertex buffer and in the index buffer.
+  // Primitives of meshes out of the scene keep an empty range, so that
+  // neither their vertices nor the other data of their buffers are uploaded.
+  const auto drawnMeshes = findDrawnMeshes(model, runtimeModel);
+  uint32_t indexCount = 0;
+  std::vector<uint32_t> vertexCounts; // Of each primitive
+  for (size_t meshIdx = 0; meshIdx < drawnMeshes.size(); ++meshIdx) {
+    const auto &mesh = runtimeModel.meshes()[meshIdx];
+    for (const auto &primitive : mesh.primitives) {
+      if (!drawnMeshes[meshIdx]) {
+        PackedPrimitive packed;
+        packed.vertexBuffer = 0;
+        packed.mode = GLenum(primitive.mode);
+        packed.indexCount = 0;
+        packed.firstIndex = indexCount;
+        packed.baseVertex = 0;
+        geometry.primitives.push_back(packed);
+        vertexCounts.push_back(0);
+        continue;
+      }
+      const auto format = getVertexFormat(model, primitive,
+          hasTangents(model, runtimeModel, primitive), options);
+      auto it = std::find_if(begin(geometry.vertexBuffers),
+          end(geometry.vertexBuffers),
+          [&](const PackedVertexBuffer &buffer) {
+            return buffer.format == format;
+          });
+      if (it == end(geometry.vertexBuffers)) {
+        geometry.vertexBuffers.emplace_back();
+        geometry.vertexBuffers.back().format = format;
+        it = end(geometry.vertexBuffers) - 1;
+      }
+
+      const auto *positions =
+          findAttribute(model, primitive, VERTEX_ATTRIBUTE_POSITION);
+      const auto vertexCount = positions ? uint32_t(positions->count) : 0u;
+
+      PackedPrimitive packed;
+      packed.vertexBuffer = uint32_t(it - begin(geometry.vertexBuffers));
+      packed.mode = GLenum(primitive.mode);
+      packed.indexCount = primitive.indices >= 0
+                              ? uint32_t(model.accessors[primitive.indices].count)
+                              : vertexCount;
+      packed.firstIndex = indexCount;
+      packed.baseVertex = int32_t((*it).vertexCount);
+      geometry.primitives.push_back(packed);
+      vertexCounts.push_back(vertexCount);
+
+      (*it).vertexCount += vertexCount;
+      indexCount += packed.indexCount;
+    }
+  }
+
+  for (auto &vertexBuffer : geometry.vertexBuffers) {
+    vertexBuffer.vertices.resize(
+        size_t(vertexBuffer.vertexCount) * vertexBuffer.format.stride);
+  }
+  geometry.indices.resize(indexCount);
+
+  // Copy vertices and indices, then generate tangents and process the
+  // triangle lists
+  std::vector<CopiedPrimitive> copied;
+  size_t primitiveIdx = 0;
+  for (size_t meshIdx = 0; meshIdx < drawnMeshes.size(); ++meshIdx) {
+    const auto &mesh = runtimeModel.meshes()[meshIdx];
+    for (const auto &primitive : mesh.primitives) {
+      auto &packed = geometry.primitives[primitiveIdx++];
+      if (!drawnMeshes[meshIdx]) {
+        continue;
+      }
+      auto &vertexBuffer = geometry.vertexBuffers[packed.vertexBuffer];
+      const auto &format = vertexBuffer.format;
+      const auto *positions =
+          findAttribute(model, primitive, VERTEX_ATTRIBUTE_POSITION);
+      const auto vertexCount = positions ? size_t(positions->count) : 0;
+      auto *vertices = vertexBuffer.vertices.data() +
+                       size_t(packed.baseVertex) * format.stride;
+
+      for (int i = 0; i < VERTEX_ATTRIBUTE_COUNT; ++i) {
+        if (i == VERTEX_ATTRIBUTE_TANGENT) {
+          continue; // Written with the generated ones
+        }
+        const auto *accessor =
+            findAttribute(model, primitive, VertexAttribute(i));
+        size_t stride = 0;
+        const auto *data =
+            accessor ? accessorData(model, buffers, *accessor, stride) : nullptr;
+        if (!data) {
+          continue; // Vertices are zero initialized
+        }
+        const auto &attribute = format.attributes[i];
+        const auto count = std::min(vertexCount, size_t(accessor->count));
+        if (attribute.componentType != GLenum(accessor->componentType)) {
+          copyQuantized(data, stride, count, attribute, format.stride,
+              vertices, packed.positionDequantize);
+          continue;
+        }
+        const auto size = elementSize(*accessor);
+        for (size_t v = 0; v < count; ++v) {
+          std::memcpy(vertices + v * format.stride + format.attributes[i].offset,
+              data + v * stride, size);
+        }
+      }
+
+      auto *indices = geometry.indices.data() + packed.firstIndex;
+      if (primitive.indices < 0) {
+        std::iota(indices, indices + packed.indexCount, 0u);
+      } else {
+        const auto &accessor = model.accessors[primitive.indices];
+        size_t stride = 0;
+        const auto *data = accessorData(model, buffers, accessor, stride);
+        if (!data) {
+          continue; // Indices are zero initialized
+        }
+        switch (accessor.componentType) {
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+          copyIndices<uint8_t>(data, packed.indexCount, indices);
+          break;
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+          copyIndices<uint16_t>(data, packed.indexCount, indices);
+          break;
+        default:
+          copyIndices<uint32_t>(data, packed.indexCount, indices);
+          break;
+        }
+      }
+      copied.push_back(
+          {&primitive, primitiveIdx - 1, uint32_t(vertexCount), meshIdx, {}});
+    }
+  }
+
+  JobSystem::shared().parallelFor(
+      copied.size(), 1, [&](size_t begin, size_t end) {
+        for (auto c = begin; c < end; ++c) {
+          const auto &primitive = *copied[c].primitive;
+          const auto &packed = geometry.primitives[copied[c].packedIdx];
+          auto &vertexBuffer = geometry.vertexBuffers[packed.vertexBuffer];
+          const auto &format = vertexBuffer.format;
+          const auto vertexCount = copied[c].vertexCount;
+          const auto *indices = geometry.indices.data() + packed.firstIndex;
+          if (!format.attributes[VERTEX_ATTRIBUTE_TANGENT].componentCount ||
+              !isTriangleList(packed, vertexCount, indices)) {
+            continue;
+          }
+          auto tangents = readFloats<glm::vec4>(
+              model, buffers, primitive, VERTEX_ATTRIBUTE_TANGENT, vertexCount);
+          if (tangents.empty()) {
+            const auto positions =
+                readPositions(model, buffers, primitive, vertexCount);
+            const auto normals = readFloats<glm::vec3>(
+                model, buffers, primitive, VERTEX_ATTRIBUTE_NORMAL, vertexCount);
+            const auto texCoords = readFloats<glm::vec2>(model, buffers,
+                primitive, VERTEX_ATTRIBUTE_TEXCOORD0, vertexCount);
+            if (positions.empty() || normals.empty() || texCoords.empty()) {
+              continue; // Left zero, the shaders fall back on derivatives
+            }
+            tangents = generateTangents(
+                positions, normals, texCoords, indices, packed.indexCount);
+          }
+          writeTangents(tangents, format,
+              vertexBuffer.vertices.data() +
+                  size_t(packed.baseVertex) * format.stride);
+        }
+      });
+
+  // Vertices are welded once complete, their tangents written
+  if (options.weldVertices) {
+    JobSystem::shared().parallelFor(
+        copied.size(), 1, [&](size_t begin, size_t end) {
+          HeapTagScope heapTag(HeapTag::Geometry);
+          for (auto c = begin; c < end; ++c) {
+            weldPrimitive(copied[c], geometry);
+          }
+        });
+    for (const auto &c : copied) {
+      vertexCounts[c.packedIdx] = c.vertexCount;
+    }
+    compactVertexBuffers(vertexCounts, geometry);
+  }
+
+  std::vector<uint32_t> lodIndices;
+  for (const auto &c : copied) {
+    const auto &primitive = *c.primitive;
+    auto &packed = geometry.primitives[c.packedIdx];
+    auto &vertexBuffer = geometry.vertexBuffers[packed.vertexBuffer];
+    const auto vertexCount = c.vertexCount;
+    auto *indices = geometry.indices.data() + packed.firstIndex;
+    if ((!options.optimize && options.lodCount <= 0 && !options.meshlets) ||
+        !isTriangleList(packed, vertexCount, indices)) {
+      continue;
+    }
+    auto floatPositions = readCopiedPositions(model, buffers, c);
+    if (options.optimize) {
+      optimizePrimitive(
+          primitive, packed, vertexBuffer, vertexCount, indices, floatPositions);
+    }
+    if (options.lodCount > 0 && !floatPositions.empty()) {
+      generateLods(options, packed, indices, floatPositions, lodIndices);
+    }
+    if (options.meshlets && !floatPositions.empty()) {
+      const auto meshlets = buildMeshlets(indices,
+          packed.indexCount - packed.indexCount % 3, floatPositions);
+      packed.firstMeshlet = uint32_t(geometry.meshlets.size());
+      packed.meshletCount = uint32_t(meshlets.size());
+      for (const auto &meshlet : meshlets) {
+        geometry.meshlets.push_back(PackedMeshlet{
+            glm::vec4(meshlet.center, meshlet.radius),
+            glm::vec4(meshlet.coneAxis, meshlet.coneCutoff),
+            packed.firstIndex + meshlet.firstIndex, meshlet.indexCount});
+      }
+    }
+  }
+
+  std::vector<std::vector<PointOctreeNode>> octrees(copied.size());
+  JobSystem::shared().parallelFor(
+      copied.size(), 1, [&](size_t begin, size_t end) {
+        HeapTagScope heapTag(HeapTag::Geometry);
+        for (auto c = begin; c < end; ++c) {
+          const auto &packed = geometry.primitives[copied[c].packedIdx];
+          if (packed.mode != GL_POINTS || packed.indexCount == 0) {
+            continue;
+          }
+          const auto positions = readCopiedPositions(model, buffers, copied[c]);
+          octrees[c] = buildPointOctree(geometry.indices.data() +
+                                            packed.firstIndex,
+              packed.indexCount, positions);
+        }
+      });
+  for (size_t c = 0; c < copied.size(); ++c) {
+    auto &packed = geometry.primitives[copied[c].packedIdx];
+    packed.firstPointNode = uint32_t(geometry.pointNodes.size());
+    packed.pointNodeCount = uint32_t(octrees[c].size());
+    for (auto node : octrees[c]) {
+      node.firstIndex += packed.firstIndex;
+      geometry.pointNodes.push_back(node);
+    }
+  }
+
+  // Levels of detail follow the indices of every primitive
+  for (auto &packed : geometry.primitives) {
+    for (auto &lod : packed.lods) {
+      lod.firstIndex += uint32_t(geometry.indices.size());
+    }
+  }
+  geometry.indices.insert(
+      geometry.indices.end(), lodIndices.begin(), lodIndices.end());
+
+  if (options.mergeSmallPrimitives) {
+    mergeSmallPrimitives(model, runtimeModel, copied, geometry);
+  }
+  geometry.indexType = packedIndexType(geometry.indices);
+}
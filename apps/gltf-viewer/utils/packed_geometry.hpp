@@ -0,0 +1,234 @@
+#pragma once
+
+#include "gltf_loader.hpp"
+#include "point_octree.hpp"
+#include "runtime_model.hpp"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <tiny_gltf.h>
+
+#include <cstdint>
+#include <vector>
+
+// Vertex attributes read by forward.vs.glsl, in attribute location order
+enum VertexAttribute
+{
+  VERTEX_ATTRIBUTE_POSITION,
+  VERTEX_ATTRIBUTE_NORMAL,
+  VERTEX_ATTRIBUTE_TEXCOORD0,
+  VERTEX_ATTRIBUTE_JOINTS0,
+  VERTEX_ATTRIBUTE_WEIGHTS0,
+  VERTEX_ATTRIBUTE_TANGENT,
+  VERTEX_ATTRIBUTE_COUNT
+};
+
+// Layout of an interleaved vertex. Attributes keep the component type of their
+// glTF accessor unless quantized, a primitive without an attribute leaves it
+// disabled.
+struct VertexFormat
+{
+  struct Attribute
+  {
+    GLenum componentType = 0;
+    GLint componentCount = 0; // 0 if the attribute is absent
+    bool normalized = false;
+    bool integer = false; // Read as integers, for joint indices
+    uint32_t offset = 0;
+
+    bool operator==(const Attribute &other) const
+    {
+      return componentType == other.componentType &&
+             componentCount == other.componentCount &&
+             normalized == other.normalized && integer == other.integer &&
+             offset == other.offset;
+    }
+  };
+
+  Attribute attributes[VERTEX_ATTRIBUTE_COUNT];
+  uint32_t stride = 0;
+
+  bool operator==(const VertexFormat &other) const;
+};
+
+// PackedVertexBuffer::firstVertexMember of the vertex buffers without merged
+// primitives
+const uint32_t PACKED_MERGE_NONE = 0xffffffffu;
+
+// Interleaved vertices of every primitive sharing a format
+struct PackedVertexBuffer
+{
+  VertexFormat format;
+  std::vector<unsigned char> vertices;
+  uint32_t vertexCount = 0;
+  // Position of the member of its first vertex in
+  // PackedGeometry::vertexMembers, followed by those of the other vertices
+  uint32_t firstVertexMember = PACKED_MERGE_NONE;
+};
+
+// Simplified index range of a triangle list, drawn with the vertices of the
+// primitive
+struct PackedLod
+{
+  uint32_t indexCount;
+  uint32_t firstIndex;
+  // Distance the surface moved from the full resolution one, in the units of
+  // the positions of the primitive
+  float error;
+};
+
+// Draw range of a primitive in the packed buffers, indices are relative to
+// baseVertex
+struct PackedPrimitive
+{
+  uint32_t vertexBuffer; // Index in PackedGeometry::vertexBuffers
+  GLenum mode;
+  uint32_t indexCount;
+  uint32_t firstIndex;
+  int32_t baseVertex;
+  // Offset and scale of quantized positions, position = xyz + w * quantized
+  glm::vec4 positionDequantize = glm::vec4(0, 0, 0, 1);
+  std::vector<PackedLod> lods; // Coarser and coarser, see lodCount
+  // Range in PackedGeometry::meshlets, which cover the indices of the
+  // primitive, empty without GeometryOptions::meshlets
+  uint32_t firstMeshlet = 0;
+  uint32_t meshletCount = 0;
+  // Of a merged primitive, range in PackedGeometry::mergedMembers of the
+  // primitives it draws, empty for the others. See
+  // GeometryOptions::mergeSmallPrimitives.
+  uint32_t firstMember = 0;
+  uint32_t memberCount = 0;
+  // Of a point cloud, range in PackedGeometry::pointNodes of its octree,
+  // whose node first indices are those of the whole index buffer. Empty for
+  // the other modes.
+  uint32_t firstPointNode = 0;
+  uint32_t pointNodeCount = 0;
+};
+
+// Meshlet of a primitive, std430 layout of Meshlet in cull_meshlets.cs.glsl.
+// The first index is the one of the whole index buffer.
+struct PackedMeshlet
+{
+  glm::vec4 sphere; // Center and radius, in the space of the positions
+  glm::vec4 cone; // Axis and cutoff, see Meshlet
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  uint32_t padding[2];
+};
+
+// Vertex and index data of every primitive of a model, so that the whole model
+// is drawn from a few buffers without any vertex array switch between
+// primitives of the same format
+struct PackedGeometry
+{
+  std::vector<PackedVertexBuffer> vertexBuffers;
+  std::vector<uint32_t> indices; // Shared by all vertex buffers
+  // Of the uploaded index buffer, the indices are narrowed to 16 bits when
+  // they all fit, see packedIndexType()
+  GLenum indexType = GL_UNSIGNED_INT;
+  // Mesh by mesh, in glTF order, then the merged primitives
+  std::vector<PackedPrimitive> primitives;
+  std::vector<PackedMeshlet> meshlets;
+  std::vector<PointOctreeNode> pointNodes;
+  // Primitives drawn by the merged primitives, which are their members
+  std::vector<uint32_t> mergedMembers;
+  // Index in mergedMembers of the primitive of each vertex of the vertex
+  // buffers with merged primitives, PACKED_MERGE_NONE for the vertices of
+  // the other primitives. Read by the vertex shaders at
+  // firstVertexMember + gl_VertexID.
+  std::vector<uint32_t> vertexMembers;
+
+  // Free the vertices, indices, meshlets and vertex members once uploaded,
+  // primitives, members and point octrees are kept
+  void clearData();
+};
+
+// Attribute of a vertex of a packed buffer as the vertex shader reads it,
+// normalized integers mapped to [-1, 1] or [0, 1], absent components 0 and w
+// 1. Absent attributes read as (0, 0, 0, 1). Positions are still quantized,
+// see PackedPrimitive::positionDequantize.
+glm::vec4 readPackedAttribute(const PackedVertexBuffer &vertexBuffer,
+    VertexAttribute attribute, uint32_t vertex);
+
+// GL_UNSIGNED_SHORT if every index, relative to the base vertex of its
+// primitive, fits in 16 bits, which is the case of most meshes whatever the
+// type of their glTF indices, else GL_UNSIGNED_INT
+GLenum packedIndexType(const std::vector<uint32_t> &indices);
+
+// Size in bytes of an index of type, GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+inline size_t indexTypeSize(GLenum type)
+{
+  return type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+// Processing of the vertices and indices while they are packed
+struct GeometryOptions
+{
+  // Reorder the triangles of each triangle list for the post-transform
+  // vertex cache then for overdraw, and its vertices in the order they are
+  // fetched. Vertices of primitives with morph targets keep their order, the
+  // deltas following the accessors.
+  bool optimize = false;
+  // Merge the vertices of each triangle list without morph targets that are
+  // equal byte for byte once packed, quantized or not, then drop the others
+  // from the vertex buffers. Unindexed and fully split exports get an index
+  // buffer sharing their vertices, before the optimizations. Primitives are
+  // welded in parallel.
+  bool weldVertices = false;
+  // Store FLOAT positions as 16 bits normalized integers over the bounds of
+  // their primitive, normals as GL_INT_2_10_10_10_REV and texture
+  // coordinates as half floats. Attributes of other types, as the ones of
+  // KHR_mesh_quantization, are copied as they are.
+  bool quantize = false;
+  // Simplified levels of detail of each triangle list, each with about half
+  // the triangles of the previous one, stored after the indices of every
+  // primitive. Levels that barely remove triangles are not kept.
+  int lodCount = 0;
+  // Split each triangle list into meshlets of up to MESHLET_MAX_VERTICES
+  // vertices, reordering its triangles so that they are culled on the GPU
+  bool meshlets = false;
+  // Merge the static nodes sharing a material into world space primitives,
+  // see static_batching.hpp. Applied to the model before packing, not read by
+  // packGeometry.
+  bool staticBatching = false;
+  // Draw the small triangle lists of each vertex buffer and material with one
+  // command, the merged primitive appended to the primitives. Their vertices
+  // keep the space of their node, they are moved by the world matrix of
+  // their member read per vertex. Only the primitives up to
+  // MERGE_MAX_TRIANGLES triangles of meshes drawn by a single node, without
+  // skin, morph targets, instances nor levels of detail, and whose material
+  // is not blended, are merged.
+  bool mergeSmallPrimitives = false;
+  // Reuse the geometry packed by a previous load of the same files with the
+  // same options, see geometry_cache.hpp. Not read by packGeometry.
+  bool cache = true;
+  // Rays per vertex of the ambient occlusion baked into the vertices of the
+  // static primitives, 0 to not bake it, see baked_occlusion.hpp. Not read
+  // by packGeometry.
+  int occlusionRays = 0;
+  // Size of the cells of the grid whose potentially visible sets are baked
+  // for culling, 0 to not bake them, see visible_sets.hpp. Not read by
+  // packGeometry.
+  float visibleSetCellSize = 0;
+};
+
+// Triangles of the largest primitive merged by
+// GeometryOptions::mergeSmallPrimitives. A merged primitive spans at most
+// 65536 vertices of its buffer, so that its indices relative to its base
+// vertex still fit in 16 bits.
+const uint32_t MERGE_MAX_TRIANGLES = 128;
+
+// Copy the POSITION, NORMAL, TEXCOORD_0, JOINTS_0 and WEIGHTS_0 attributes of
+// every primitive into one interleaved vertex buffer per distinct vertex
+// format, and their indices into a single 32 bits index buffer. Non-indexed
+// primitives get sequential indices so that every primitive is drawn with
+// glDrawElements*. Sparse accessors are not applied. Primitives of meshes that
+// no node of the default scene draws are left empty.
+//
+// Triangle lists whose material has a normal map also get tangents: their
+// TANGENT attribute, else tangents generated from the positions, normals and
+// texture coordinates, primitives in parallel. The points of point clouds are
+// reordered into octrees, see point_octree.hpp, primitives in parallel too.
+void packGeometry(const tinygltf::Model &model,
+    const RuntimeModel &runtimeModel, const GltfBuffers &buffers,
+    const GeometryOptions &options, PackedGeometry &geometry);
@@ -0,0 +1,116 @@
+#include "panorama.hpp"
+#include "gpu_memory.hpp"
+
+#include <algorithm>
+
+PanoramaTargets::~PanoramaTargets() { release(); }
+
+void PanoramaTargets::release()
+{
+  const GLuint framebuffers[] = {
+      m_faceFramebuffer, m_resolveFramebuffer, m_imageFramebuffer};
+  if (m_faceFramebuffer) {
+    glDeleteFramebuffers(3, framebuffers);
+  }
+  if (m_faceColor) {
+    const GLuint textures[] = {m_faceColor, m_faceDepth, m_cubeMap, m_image};
+    untrackTextures(4, textures);
+    glDeleteTextures(4, textures);
+  }
+  m_faceFramebuffer = m_resolveFramebuffer = m_imageFramebuffer = 0;
+  m_faceColor = m_faceDepth = m_cubeMap = m_image = 0;
+  m_faceSize = m_width = m_height = 0;
+  m_samples = 1;
+}
+
+void PanoramaTargets::init(
+    GLsizei faceSize, int samples, GLsizei width, GLsizei height)
+{
+  release();
+  m_faceSize = faceSize;
+  m_samples = std::max(samples, 1);
+  m_width = width;
+  m_height = height;
+
+  GLint previousTexture = 0;
+  GLint previousMultisample = 0;
+  GLint previousCubeMap = 0;
+  GLint previousFramebuffer = 0;
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTexture);
+  glGetIntegerv(GL_TEXTURE_BINDING_2D_MULTISAMPLE, &previousMultisample);
+  glGetIntegerv(GL_TEXTURE_BINDING_CUBE_MAP, &previousCubeMap);
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+
+  const auto createFaceTarget = [&](GLuint &texture, GLenum format) {
+    glGenTextures(1, &texture);
+    if (m_samples > 1) {
+      glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, texture);
+      glTexStorage2DMultisample(
+          GL_TEXTURE_2D_MULTISAMPLE, m_samples, format, faceSize, faceSize,
+          GL_TRUE);
+      trackTexture(
+          GpuMemoryCategory::RenderTargets, GL_TEXTURE_2D_MULTISAMPLE, texture);
+    } else {
+      glBindTexture(GL_TEXTURE_2D, texture);
+      glTexStorage2D(GL_TEXTURE_2D, 1, format, faceSize, faceSize);
+      trackTexture(GpuMemoryCategory::RenderTargets, GL_TEXTURE_2D, texture);
+    }
+  };
+  createFaceTarget(m_faceColor, GL_RGBA16F);
+  createFaceTarget(m_faceDepth, GL_DEPTH_COMPONENT32F);
+
+  glGenTextures(1, &m_cubeMap);
+  glBindTexture(GL_TEXTURE_CUBE_MAP, m_cubeMap);
+  glTexStorage2D(GL_TEXTURE_CUBE_MAP, 1, GL_RGBA16F, faceSize, faceSize);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+  trackTexture(GpuMemoryCategory::RenderTargets, GL_TEXTURE_CUBE_MAP, m_cubeMap);
+
+  glGenTextures(1, &m_image);
+  glBindTexture(GL_TEXTURE_2D, m_image);
+  glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA16F, width, height);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  trackTexture(GpuMemoryCategory::RenderTargets, GL_TEXTURE_2D, m_image);
+
+  glBindTexture(GL_TEXTURE_2D, GLuint(previousTexture));
+  glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, GLuint(previousMultisample));
+  glBindTexture(GL_TEXTURE_CUBE_MAP, GLuint(previousCubeMap));
+
+  glGenFramebuffers(1, &m_faceFramebuffer);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_faceFramebuffer);
+  glFramebufferTexture(
+      GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, m_faceColor, 0);
+  glFramebufferTexture(
+      GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_faceDepth, 0);
+
+  // Its color attachment is the face being resolved, see resolveFace()
+  glGenFramebuffers(1, &m_resolveFramebuffer);
+
+  glGenFramebuffers(1, &m_imageFramebuffer);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_imageFramebuffer);
+  glFramebufferTexture(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, m_image, 0);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, GLuint(previousFramebuffer));
+}
+
+void PanoramaTargets::resolveFace(int face)
+{
+  GLint previousRead = 0;
+  GLint previousDraw = 0;
+  glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previousRead);
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousDraw);
+
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, m_faceFramebuffer);
+  glReadBuffer(GL_COLOR_ATTACHMENT0);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_resolveFramebuffer);
+  glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+      GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, m_cubeMap, 0);
+  glBlitFramebuffer(0, 0, m_faceSize, m_faceSize, 0, 0, m_faceSize,
+      m_faceSize, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, GLuint(previousRead));
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, GLuint(previousDraw));
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <glad/glad.h>
+
+// Targets of an equirectangular panorama captured around a point. The six
+// faces of a cube map are drawn one after the other to a framebuffer of the
+// face size, multisampled or not, each resolved to its face, then the cube
+// map is projected to the image with a full screen pass. The targets are
+// GL_RGBA16F, of linear radiance.
+class PanoramaTargets
+{
+public:
+  PanoramaTargets() = default;
+  ~PanoramaTargets();
+
+  PanoramaTargets(const PanoramaTargets &) = delete;
+  PanoramaTargets &operator=(const PanoramaTargets &) = delete;
+
+  // Allocate faces of faceSize pixels with samples per pixel, 0 or 1 being
+  // single sample, and an image of width x height
+  void init(GLsizei faceSize, int samples, GLsizei width, GLsizei height);
+
+  GLsizei faceSize() const { return m_faceSize; }
+  // 1 if single sample
+  int samples() const { return m_samples; }
+  GLsizei width() const { return m_width; }
+  GLsizei height() const { return m_height; }
+
+  // Color attachment 0 and depth to draw a face to
+  GLuint faceFramebuffer() const { return m_faceFramebuffer; }
+
+  // Resolve faceFramebuffer() to face of cubeMap(), in the order of
+  // GL_TEXTURE_CUBE_MAP_POSITIVE_X + face. The framebuffer bindings are
+  // unchanged.
+  void resolveFace(int face);
+
+  GLuint cubeMap() const { return m_cubeMap; }
+
+  // Color attachment 0 of image(), single sample
+  GLuint imageFramebuffer() const { return m_imageFramebuffer; }
+  GLuint image() const { return m_image; }
+
+private:
+  void release();
+
+  GLsizei m_faceSize = 0;
+  int m_samples = 1;
+  GLsizei m_width = 0;
+  GLsizei m_height = 0;
+  GLuint m_faceFramebuffer = 0;
+  GLuint m_faceColor = 0;
+  GLuint m_faceDepth = 0;
+  GLuint m_resolveFramebuffer = 0;
+  GLuint m_cubeMap = 0;
+  GLuint m_imageFramebuffer = 0;
+  GLuint m_image = 0;
+};
@@ -0,0 +1,341 @@
+#include "path_tracer.hpp"
+
+#include "gltf.hpp"
+#include "gpu_memory.hpp"
+#include "job_system.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+namespace
+{
+
+// std430 layouts of Node and Triangle in path_trace.cs.glsl
+struct GpuNode
+{
+  glm::vec3 min;
+  uint32_t first;
+  glm::vec3 max;
+  uint32_t count;
+};
+
+struct GpuTriangle
+{
+  glm::vec4 positions[3]; // w is the u texture coordinate
+  glm::vec4 normals[3]; // w is the v texture coordinate
+};
+
+const tinygltf::Accessor *findAccessor(const tinygltf::Model &model,
+    const tinygltf::Primitive &primitive, const char *attribute)
+{
+  const auto it = primitive.attributes.find(attribute);
+  return it != end(primitive.attributes) && (*it).second >= 0 &&
+                 size_t((*it).second) < model.accessors.size()
+             ? &model.accessors[(*it).second]
+             : nullptr;
+}
+
+template <typename Vector>
+std::vector<Vector> readAttribute(const tinygltf::Model &model,
+    const GltfBuffers &buffers, const tinygltf::Accessor *accessor)
+{
+  std::vector<Vector> values;
+  if (accessor) {
+    visitAccessor<Vector>(model, buffers, *accessor, [&](const auto &view) {
+      values.resize(view.size());
+      view.read(values.data());
+    });
+  }
+  return values;
+}
+
+void uploadBuffer(GLBuffer &buffer, const void *data, size_t size)
+{
+  if (!buffer) {
+    buffer.generate();
+  }
+  // Empty scenes still bind a buffer
+  const auto allocated = std::max<size_t>(size, 16);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, GLsizeiptr(allocated), nullptr,
+      GL_STATIC_DRAW);
+  if (size) {
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, GLsizeiptr(size), data);
+  }
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  trackBuffer(GpuMemoryCategory::ShaderBuffers, buffer, allocated);
+}
+
+} // namespace
+
+PathTracer::~PathTracer() { releaseTargets(); }
+
+void PathTracer::releaseTargets()
+{
+  if (m_averageFramebuffer) {
+    glDeleteFramebuffers(1, &m_averageFramebuffer);
+  }
+  const GLuint textures[] = {m_accumulation, m_average};
+  if (m_accumulation) {
+    untrackTextures(2, textures);
+    glDeleteTextures(2, textures);
+  }
+  m_accumulation = m_average = m_averageFramebuffer = 0;
+  m_width = m_height = 0;
+}
+
+void PathTracer::readMeshes(
+    const tinygltf::Model &model, const GltfBuffers &buffers)
+{
+  TRACE_ZONE("PathTracer::readMeshes");
+  m_meshes.assign(model.meshes.size(), {});
+  m_built = false;
+  const auto defaultMaterial = uint32_t(model.materials.size());
+
+  JobSystem::shared().parallelFor(
+      model.meshes.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t meshIdx = begin; meshIdx < end; ++meshIdx) {
+          const auto &mesh = model.meshes[meshIdx];
+          auto &primitives = m_meshes[meshIdx];
+          primitives.resize(mesh.primitives.size());
+          for (size_t i = 0; i < mesh.primitives.size(); ++i) {
+            const auto &primitive = mesh.primitives[i];
+            auto &copy = primitives[i];
+            copy.material = primitive.material >= 0 &&
+                                    size_t(primitive.material) <
+                                        model.materials.size()
+                                ? uint32_t(primitive.material)
+                                : defaultMaterial;
+            if (primitive.mode != TINYGLTF_MODE_TRIANGLES &&
+                primitive.mode != TINYGLTF_MODE_TRIANGLE_STRIP &&
+                primitive.mode != TINYGLTF_MODE_TRIANGLE_FAN) {
+              continue;
+            }
+            copy.positions = readAttribute<glm::vec3>(
+                model, buffers, findAccessor(model, primitive, "POSITION"));
+            if (copy.positions.empty()) {
+              continue;
+            }
+            copy.normals = readAttribute<glm::vec3>(
+                model, buffers, findAccessor(model, primitive, "NORMAL"));
+            copy.texCoords = readAttribute<glm::vec2>(
+                model, buffers, findAccessor(model, primitive, "TEXCOORD_0"));
+            if (copy.normals.size() != copy.positions.size()) {
+              copy.normals.clear();
+            }
+            if (copy.texCoords.size() != copy.positions.size()) {
+              copy.texCoords.clear();
+            }
+
+            std::vector<uint32_t> elements;
+            if (primitive.indices >= 0 &&
+                size_t(primitive.indices) < model.accessors.size()) {
+              visitIndices(model, buffers, model.accessors[primitive.indices],
+                  [&](const auto &view) {
+                    elements.resize(view.size());
+                    view.read(elements.data());
+                  });
+            } else {
+              elements.resize(copy.positions.size());
+              std::iota(elements.begin(), elements.end(), 0u);
+            }
+
+            // Strips alternate their winding, fans turn around the first
+            // vertex
+            const auto vertexCount = uint32_t(copy.positions.size());
+            const auto addTriangle = [&](uint32_t a, uint32_t b, uint32_t c) {
+              if (a < vertexCount && b < vertexCount && c < vertexCount) {
+                copy.indices.insert(copy.indices.end(), {a, b, c});
+              }
+            };
+            if (primitive.mode == TINYGLTF_MODE_TRIANGLES) {
+              for (size_t j = 0; j + 2 < elements.size(); j += 3) {
+                addTriangle(elements[j], elements[j + 1], elements[j + 2]);
+              }
+            } else if (primitive.mode == TINYGLTF_MODE_TRIANGLE_STRIP) {
+              for (size_t j = 0; j + 2 < elements.size(); ++j) {
+                if (j % 2) {
+                  addTriangle(elements[j + 1], elements[j], elements[j + 2]);
+                } else {
+                  addTriangle(elements[j], elements[j + 1], elements[j + 2]);
+                }
+              }
+            } else {
+              for (size_t j = 1; j + 1 < elements.size(); ++j) {
+                addTriangle(elements[0], elements[j], elements[j + 1]);
+              }
+            }
+          }
+        }
+      });
+}
+
+bool PathTracer::build(const std::vector<PathTraceInstance> &instances)
+{
+  const auto sameInstances =
+      m_built && instances.size() == m_instances.size() &&
+      std::equal(instances.begin(), instances.end(), m_instances.begin(),
+          [](const PathTraceInstance &a, const PathTraceInstance &b) {
+            return a.mesh == b.mesh && a.primitive == b.primitive &&
+                   a.matrix == b.matrix;
+          });
+  if (sameInstances) {
+    return false;
+  }
+  TRACE_ZONE("PathTracer::build");
+  m_instances = instances;
+  m_built = true;
+
+  // First triangle of each instance, of the primitive it places
+  std::vector<const MeshPrimitive *> primitives(instances.size(), nullptr);
+  std::vector<size_t> firstTriangles(instances.size() + 1, 0);
+  for (size_t i = 0; i < instances.size(); ++i) {
+    const auto &instance = instances[i];
+    if (instance.mesh >= 0 && size_t(instance.mesh) < m_meshes.size() &&
+        instance.primitive >= 0 &&
+        size_t(instance.primitive) < m_meshes[instance.mesh].size()) {
+      primitives[i] = &m_meshes[instance.mesh][instance.primitive];
+    }
+    firstTriangles[i + 1] =
+        firstTriangles[i] + (primitives[i] ? primitives[i]->indices.size() / 3
+                                           : 0);
+  }
+
+  const auto triangleCount = firstTriangles.back();
+  std::vector<GpuTriangle> triangles(triangleCount);
+  std::vector<uint32_t> materials(triangleCount);
+  std::vector<uint32_t> triangleInstances(triangleCount);
+  std::vector<Aabb> bounds(triangleCount);
+  JobSystem::shared().parallelFor(
+      instances.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+          const auto *primitive = primitives[i];
+          if (!primitive) {
+            continue;
+          }
+          const auto &matrix = instances[i].matrix;
+          const auto normalMatrix =
+              glm::transpose(glm::inverse(glm::mat3(matrix)));
+          for (size_t j = 0; j < primitive->indices.size() / 3; ++j) {
+            const auto t = firstTriangles[i] + j;
+            const uint32_t *vertices = &primitive->indices[3 * j];
+            // Flat normals without NORMAL, from the vertices as placed
+            glm::vec3 positions[3];
+            for (int k = 0; k < 3; ++k) {
+              positions[k] = glm::vec3(
+                  matrix * glm::vec4(primitive->positions[vertices[k]], 1.f));
+            }
+            const auto faceNormal = glm::cross(
+                positions[1] - positions[0], positions[2] - positions[0]);
+            Aabb box;
+            for (int k = 0; k < 3; ++k) {
+              const auto uv = primitive->texCoords.empty()
+                                  ? glm::vec2(0.f)
+                                  : primitive->texCoords[vertices[k]];
+              const auto normal =
+                  primitive->normals.empty()
+                      ? faceNormal
+                      : normalMatrix * primitive->normals[vertices[k]];
+              triangles[t].positions[k] = glm::vec4(positions[k], uv.x);
+              triangles[t].normals[k] = glm::vec4(normal, uv.y);
+              box.min = glm::min(box.min, positions[k]);
+              box.max = glm::max(box.max, positions[k]);
+            }
+            bounds[t] = box;
+            materials[t] = primitive->material;
+            triangleInstances[t] = uint32_t(i);
+          }
+        }
+      });
+
+  m_bvh.build(bounds);
+
+  // Triangles in the order of the leaves, those with an empty box are left
+  // out, the leaves then index them directly
+  const auto &order = m_bvh.items();
+  std::vector<GpuTriangle> sortedTriangles(order.size());
+  std::vector<uint32_t> sortedMaterials(order.size());
+  std::vector<uint32_t> sortedInstances(order.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    sortedTriangles[i] = triangles[order[i]];
+    sortedMaterials[i] = materials[order[i]];
+    sortedInstances[i] = triangleInstances[order[i]];
+  }
+  std::vector<GpuNode> nodes;
+  nodes.reserve(m_bvh.nodes().size());
+  for (const auto &node : m_bvh.nodes()) {
+    nodes.push_back(
+        GpuNode{node.bounds.min, node.first, node.bounds.max, node.count});
+  }
+  m_triangleCount = sortedTriangles.size();
+
+  uploadBuffer(m_nodeBuffer, nodes.data(), nodes.size() * sizeof(GpuNode));
+  uploadBuffer(m_triangleBuffer, sortedTriangles.data(),
+      sortedTriangles.size() * sizeof(GpuTriangle));
+  uploadBuffer(m_materialBuffer, sortedMaterials.data(),
+      sortedMaterials.size() * sizeof(uint32_t));
+  uploadBuffer(m_instanceBuffer, sortedInstances.data(),
+      sortedInstances.size() * sizeof(uint32_t));
+  return true;
+}
+
+void PathTracer::uploadMaterialSlots(const std::vector<uint32_t> &slots)
+{
+  uploadBuffer(
+      m_materialSlotBuffer, slots.data(), slots.size() * sizeof(uint32_t));
+}
+
+void PathTracer::bindBuffers(GLuint firstBinding) const
+{
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, firstBinding, m_nodeBuffer);
+  glBindBufferBase(
+      GL_SHADER_STORAGE_BUFFER, firstBinding + 1, m_triangleBuffer);
+  glBindBufferBase(
+      GL_SHADER_STORAGE_BUFFER, firstBinding + 2, m_materialBuffer);
+  glBindBufferBase(
+      GL_SHADER_STORAGE_BUFFER, firstBinding + 3, m_materialSlotBuffer);
+}
+
+void PathTracer::bindInstanceBuffer(GLuint binding) const
+{
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, m_instanceBuffer);
+}
+
+void PathTracer::reset(GLsizei width, GLsizei height)
+{
+  m_samples = 0;
+  if (width == m_width && height == m_height) {
+    return;
+  }
+  releaseTargets();
+  m_width = width;
+  m_height = height;
+
+  GLint previousTexture = 0;
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTexture);
+
+  // Texels are loaded and stored by the shader, fetched by the tonemap
+  GLuint textures[2];
+  glGenTextures(2, textures);
+  m_accumulation = textures[0];
+  m_average = textures[1];
+  for (const auto texture : textures) {
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32F, width, height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    trackTexture(GpuMemoryCategory::RenderTargets, GL_TEXTURE_2D, texture);
+  }
+  glBindTexture(GL_TEXTURE_2D, GLuint(previousTexture));
+
+  GLint previousFramebuffer = 0;
+  glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previousFramebuffer);
+  glGenFramebuffers(1, &m_averageFramebuffer);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, m_averageFramebuffer);
+  glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+      GL_TEXTURE_2D, m_average, 0);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, GLuint(previousFramebuffer));
+}
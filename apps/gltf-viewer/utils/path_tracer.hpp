@@ -0,0 +1,121 @@
+#pragma once
+
+#include "bvh.hpp"
+#include "gl_objects.hpp"
+#include "gltf_loader.hpp"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <tiny_gltf.h>
+
+#include <cstdint>
+#include <vector>
+
+// Budget of the path traced output images of --path-trace-samples and
+// --path-trace-seconds: samples are added to each image until either bound is
+// reached, a bound of 0 does not stop it.
+struct PathTraceOptions
+{
+  int samples = 0; // Per pixel
+  float seconds = 0; // Per image
+  int bounces = 4; // Off the surfaces, after the one seen from the eye
+
+  bool enabled() const { return samples > 0 || seconds > 0; }
+};
+
+// A primitive of a mesh of the model placed in the scene
+struct PathTraceInstance
+{
+  int mesh;
+  int primitive;
+  glm::mat4 matrix; // World matrix
+};
+
+// Scene of the progressive path tracing of path_trace.cs.glsl and the samples
+// it accumulated. The triangles of the primitives are copied once in the
+// space of their mesh, since the buffers of the model are released after
+// loading, then placed in world space by build(), which sorts them in the
+// order of the leaves of a BVH over their boxes, so that a leaf covers
+// contiguous triangles. Points and lines are not traced.
+//
+// Buffers are std430: the BVH nodes, the triangles, with the texture
+// coordinates of their vertices in the w components, the material of each
+// triangle, indexed as the material buffer of the viewer, and the texture
+// slots and alpha mode of each material, see MaterialSlots in the shader.
+class PathTracer
+{
+public:
+  PathTracer() = default;
+  ~PathTracer();
+
+  PathTracer(const PathTracer &) = delete;
+  PathTracer &operator=(const PathTracer &) = delete;
+
+  // Copy the POSITION, NORMAL and TEXCOORD_0 of the triangles of every
+  // primitive of the model, with their material, model.materials.size() for
+  // the default one
+  void readMeshes(const tinygltf::Model &model, const GltfBuffers &buffers);
+
+  // Place the primitives read, build the BVH and upload the buffers, unless
+  // instances are those of the last build. Return true if it was rebuilt, the
+  // samples accumulated before are then stale.
+  bool build(const std::vector<PathTraceInstance> &instances);
+
+  // Upload the texture slots and alpha mode of each material
+  void uploadMaterialSlots(const std::vector<uint32_t> &slots);
+
+  // Bind the nodes, triangles, triangle materials and material slots to
+  // firstBinding and the three storage buffer bindings after it
+  void bindBuffers(GLuint firstBinding) const;
+  // Bind the index in the instances of the last build of the instance of each
+  // triangle, in the order of the triangle buffer
+  void bindInstanceBuffer(GLuint binding) const;
+
+  size_t triangleCount() const { return m_triangleCount; }
+
+  // Start accumulating the samples of an image of width x height pixels,
+  // reallocating the targets if its size changed
+  void reset(GLsizei width, GLsizei height);
+  // Count a sample added to every pixel by the shader
+  void addSample() { ++m_samples; }
+
+  GLsizei width() const { return m_width; }
+  GLsizei height() const { return m_height; }
+  int samples() const { return m_samples; }
+  // GL_RGBA32F sums of the samples, and their average written along, also
+  // the color attachment of averageFramebuffer()
+  GLuint accumulation() const { return m_accumulation; }
+  GLuint average() const { return m_average; }
+  GLuint averageFramebuffer() const { return m_averageFramebuffer; }
+
+private:
+  // Triangle list of a primitive, in the space of its mesh
+  struct MeshPrimitive
+  {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals; // Empty without NORMAL
+    std::vector<glm::vec2> texCoords; // Empty without TEXCOORD_0
+    std::vector<uint32_t> indices;
+    uint32_t material = 0;
+  };
+
+  void releaseTargets();
+
+  std::vector<std::vector<MeshPrimitive>> m_meshes;
+  std::vector<PathTraceInstance> m_instances; // Of the last build
+  bool m_built = false;
+  Bvh m_bvh;
+  size_t m_triangleCount = 0;
+  GLBuffer m_nodeBuffer;
+  GLBuffer m_triangleBuffer;
+  GLBuffer m_materialBuffer;
+  GLBuffer m_instanceBuffer;
+  GLBuffer m_materialSlotBuffer;
+
+  GLsizei m_width = 0;
+  GLsizei m_height = 0;
+  int m_samples = 0;
+  GLuint m_accumulation = 0;
+  GLuint m_average = 0;
+  GLuint m_averageFramebuffer = 0;
+};
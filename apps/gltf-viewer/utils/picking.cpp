@@ -0,0 +1,117 @@
+#include "picking.hpp"
+#include "gpu_memory.hpp"
+
+Picker::~Picker() { release(); }
+
+void Picker::release()
+{
+  if (m_fence) {
+    glDeleteSync(m_fence);
+  }
+  if (m_framebuffer) {
+    glDeleteFramebuffers(1, &m_framebuffer);
+  }
+  if (m_color) {
+    const GLuint textures[] = {m_color, m_depth};
+    untrackTextures(2, textures);
+    glDeleteTextures(2, textures);
+  }
+  if (m_readBuffer) {
+    untrackBuffers(1, &m_readBuffer);
+    glDeleteBuffers(1, &m_readBuffer);
+  }
+  m_fence = nullptr;
+  m_framebuffer = m_color = m_depth = m_readBuffer = 0;
+}
+
+void Picker::init()
+{
+  release();
+
+  GLint previousTexture = 0;
+  GLint previousFramebuffer = 0;
+  GLint previousBuffer = 0;
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTexture);
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+  glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &previousBuffer);
+
+  glGenTextures(1, &m_color);
+  glBindTexture(GL_TEXTURE_2D, m_color);
+  glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32UI, 1, 1);
+  trackTexture(GpuMemoryCategory::RenderTargets, GL_TEXTURE_2D, m_color);
+
+  glGenTextures(1, &m_depth);
+  glBindTexture(GL_TEXTURE_2D, m_depth);
+  glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, 1, 1);
+  trackTexture(GpuMemoryCategory::RenderTargets, GL_TEXTURE_2D, m_depth);
+  glBindTexture(GL_TEXTURE_2D, GLuint(previousTexture));
+
+  glGenFramebuffers(1, &m_framebuffer);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_framebuffer);
+  glFramebufferTexture(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, m_color, 0);
+  glFramebufferTexture(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_depth, 0);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, GLuint(previousFramebuffer));
+
+  glGenBuffers(1, &m_readBuffer);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, m_readBuffer);
+  glBufferData(GL_PIXEL_PACK_BUFFER, sizeof(uint32_t), nullptr, GL_STREAM_READ);
+  trackBuffer(GpuMemoryCategory::Staging, m_readBuffer, sizeof(uint32_t));
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, GLuint(previousBuffer));
+}
+
+GLuint Picker::framebuffer()
+{
+  if (!m_framebuffer) {
+    init();
+  }
+  return m_framebuffer;
+}
+
+void Picker::clear(GLfloat farDepth)
+{
+  const GLuint nothing[] = {0, 0, 0, 0};
+  glClearBufferuiv(GL_COLOR, 0, nothing);
+  glClearBufferfv(GL_DEPTH, 0, &farDepth);
+}
+
+void Picker::readBack()
+{
+  if (m_fence) {
+    glDeleteSync(m_fence);
+  }
+
+  GLint previousFramebuffer = 0;
+  GLint previousBuffer = 0;
+  glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previousFramebuffer);
+  glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &previousBuffer);
+
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, m_framebuffer);
+  glReadBuffer(GL_COLOR_ATTACHMENT0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, m_readBuffer);
+  glReadPixels(0, 0, 1, 1, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+  m_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, GLuint(previousBuffer));
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, GLuint(previousFramebuffer));
+}
+
+bool Picker::poll(uint32_t &value)
+{
+  if (!m_fence) {
+    return false;
+  }
+  const auto status =
+      glClientWaitSync(m_fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+  if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+    return false;
+  }
+  glDeleteSync(m_fence);
+  m_fence = nullptr;
+
+  GLint previousBuffer = 0;
+  glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &previousBuffer);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, m_readBuffer);
+  glGetBufferSubData(GL_PIXEL_PACK_BUFFER, 0, sizeof(uint32_t), &value);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, GLuint(previousBuffer));
+  return true;
+}
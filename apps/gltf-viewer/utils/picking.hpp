@@ -0,0 +1,55 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstdint>
+
+// Picking of the draw under a pixel. The draws of the frame are drawn again
+// to a 1x1 framebuffer, their viewport offset so that the picked pixel is
+// its only one, each writing its draw index + 1 to a GL_R32UI target tested
+// against its own depth. The value is copied to a pixel pack buffer, fenced,
+// and read once the fence is signaled in a later frame: the frame never
+// waits for the GPU.
+class Picker
+{
+public:
+  Picker() = default;
+  ~Picker();
+
+  Picker(const Picker &) = delete;
+  Picker &operator=(const Picker &) = delete;
+
+  // Allocate the framebuffer and the readback buffer, done by framebuffer()
+  // on first use
+  void init();
+
+  // Color attachment 0 of GL_R32UI draw indices + 1, 0 where nothing is
+  // drawn, with a depth attachment. Draw with a viewport of
+  // (-x, -y, width, height) to pick the pixel (x, y) of a width x height
+  // viewport, after clear().
+  GLuint framebuffer();
+
+  // Clear the targets of framebuffer(), which must be bound on
+  // GL_DRAW_FRAMEBUFFER with depth writes enabled, the depth to farDepth
+  void clear(GLfloat farDepth);
+
+  // Copy the picked value to the readback buffer and fence it. The binding
+  // of GL_READ_FRAMEBUFFER is unchanged. Replaces a pick still pending.
+  void readBack();
+
+  // Whether a value is copied and not read yet
+  bool pending() const { return m_fence != nullptr; }
+
+  // True once the value of the last readBack() is available, then written to
+  // value. Never waits.
+  bool poll(uint32_t &value);
+
+private:
+  void release();
+
+  GLuint m_framebuffer = 0;
+  GLuint m_color = 0;
+  GLuint m_depth = 0;
+  GLuint m_readBuffer = 0;
+  GLsync m_fence = nullptr;
+};
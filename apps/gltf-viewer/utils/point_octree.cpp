@@ -0,0 +1,123 @@
+#include "point_octree.hpp"
+
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+std::vector<PointOctreeNode> buildPointOctree(uint32_t *indices,
+    size_t indexCount, const std::vector<glm::vec3> &positions)
+{
+  TRACE_ZONE("buildPointOctree");
+  std::vector<PointOctreeNode> nodes;
+  if (indexCount == 0 || positions.empty()) {
+    return nodes;
+  }
+  // Out of range indices, of broken files, read the last position
+  const auto position = [&](uint32_t index) {
+    return positions[std::min(size_t(index), positions.size() - 1)];
+  };
+
+  glm::vec3 min(std::numeric_limits<float>::max());
+  glm::vec3 max(std::numeric_limits<float>::lowest());
+  for (size_t i = 0; i < indexCount; ++i) {
+    min = glm::min(min, position(indices[i]));
+    max = glm::max(max, position(indices[i]));
+  }
+  const auto extent = max - min;
+  const auto size = std::max(std::max(extent.x, extent.y),
+      std::max(extent.z, std::numeric_limits<float>::min()));
+
+  // The points of the node being split, its range in points, are
+  // partitioned into those it keeps then those of each of its children
+  std::vector<uint32_t> points(indices, indices + indexCount);
+  std::vector<uint32_t> ordered;
+  ordered.reserve(indexCount);
+  std::vector<uint32_t> childPoints;
+  struct Range
+  {
+    size_t begin;
+    size_t end;
+  };
+  std::vector<Range> ranges;
+  // Node + 1 which took each cell, never reset between nodes
+  std::vector<uint32_t> cellNodes(
+      POINT_OCTREE_GRID * POINT_OCTREE_GRID * POINT_OCTREE_GRID, 0);
+
+  nodes.push_back({min, size, 0, 0, 0, 0, 0, size / POINT_OCTREE_GRID});
+  ranges.push_back({0, indexCount});
+  for (size_t n = 0; n < nodes.size(); ++n) {
+    auto node = nodes[n];
+    const auto range = ranges[n];
+    node.firstIndex = uint32_t(ordered.size());
+    if (range.end - range.begin <= POINT_OCTREE_LEAF_POINTS ||
+        node.depth >= POINT_OCTREE_MAX_DEPTH) {
+      ordered.insert(ordered.end(), points.begin() + range.begin,
+          points.begin() + range.end);
+      node.indexCount = uint32_t(range.end - range.begin);
+      // Leaves keep all their points, spaced as on a surface across the cube
+      node.spacing = node.size / std::sqrt(float(node.indexCount));
+      nodes[n] = node;
+      continue;
+    }
+
+    const auto cellScale = float(POINT_OCTREE_GRID) / node.size;
+    auto kept = range.begin;
+    for (auto i = range.begin; i < range.end; ++i) {
+      const auto cell =
+          glm::clamp(glm::ivec3((position(points[i]) - node.min) * cellScale),
+              glm::ivec3(0), glm::ivec3(POINT_OCTREE_GRID - 1));
+      auto &cellNode =
+          cellNodes[(size_t(cell.z) * POINT_OCTREE_GRID + size_t(cell.y)) *
+                        POINT_OCTREE_GRID +
+                    size_t(cell.x)];
+      if (cellNode != uint32_t(n + 1)) {
+        cellNode = uint32_t(n + 1);
+        std::swap(points[kept++], points[i]);
+      }
+    }
+    ordered.insert(
+        ordered.end(), points.begin() + range.begin, points.begin() + kept);
+    node.indexCount = uint32_t(kept - range.begin);
+
+    // Counting sort of the others by octant
+    const auto half = 0.5f * node.size;
+    const auto center = node.min + half;
+    const auto octant = [&](uint32_t index) {
+      const auto p = position(index);
+      return (p.x >= center.x ? 1 : 0) | (p.y >= center.y ? 2 : 0) |
+             (p.z >= center.z ? 4 : 0);
+    };
+    size_t octantBegins[9] = {};
+    for (auto i = kept; i < range.end; ++i) {
+      ++octantBegins[octant(points[i]) + 1];
+    }
+    octantBegins[0] = kept;
+    for (int o = 0; o < 8; ++o) {
+      octantBegins[o + 1] += octantBegins[o];
+    }
+    childPoints.assign(points.begin() + kept, points.begin() + range.end);
+    size_t next[8];
+    std::copy(octantBegins, octantBegins + 8, next);
+    for (const auto index : childPoints) {
+      points[next[octant(index)]++] = index;
+    }
+
+    node.firstChild = uint32_t(nodes.size());
+    for (int o = 0; o < 8; ++o) {
+      if (octantBegins[o] == octantBegins[o + 1]) {
+        continue;
+      }
+      nodes.push_back({node.min + half * glm::vec3(o & 1, (o >> 1) & 1,
+                                             (o >> 2) & 1),
+          half, 0, 0, 0, 0, node.depth + 1, half / POINT_OCTREE_GRID});
+      ranges.push_back({octantBegins[o], octantBegins[o + 1]});
+      ++node.childCount;
+    }
+    nodes[n] = node;
+  }
+
+  std::copy(ordered.begin(), ordered.end(), indices);
+  return nodes;
+}
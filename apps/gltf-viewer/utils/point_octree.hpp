@@ -0,0 +1,47 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Octree of a point cloud, as Potree builds them (Schütz 2016): each node keeps
+// the first point of each cell of a POINT_OCTREE_GRID^3 grid over its cube and
+// hands the others down to its children, so that the points of a node and of
+// its ancestors are an even subsample of its cube. Drawing the nodes down to
+// some depth draws the cloud at the density of that depth, a point budget
+// picks the nodes covering the most pixels first.
+//
+// Nodes are in breadth first order, and the indices of the cloud in the order
+// of their nodes, so that each node is drawn with one command.
+
+// Cells per axis of the grid subsampling the points of a node
+const uint32_t POINT_OCTREE_GRID = 64;
+// Nodes of up to this many points are not split
+const uint32_t POINT_OCTREE_LEAF_POINTS = 16384;
+// Deeper nodes are not split, for clouds of many equal points
+const uint32_t POINT_OCTREE_MAX_DEPTH = 16;
+
+struct PointOctreeNode
+{
+  // Cube of the node, in the space of the positions
+  glm::vec3 min;
+  float size;
+  // Points of the node, index range in the indices of the cloud
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  // Consecutive children, relative to the first node of the octree
+  uint32_t firstChild;
+  uint32_t childCount;
+  uint32_t depth; // 0 for the root
+  // Distance between the points of the node and of its ancestors drawn
+  // together, the size of a cell of its grid, estimated from the point count
+  // for leaves
+  float spacing;
+};
+
+// Reorder the indices of a point cloud in the order of the nodes of its
+// octree and return them. Node first indices are relative to indices.
+std::vector<PointOctreeNode> buildPointOctree(uint32_t *indices,
+    size_t indexCount, const std::vector<glm::vec3> &positions);
@@ -0,0 +1,166 @@
+#include "program_cache.hpp"
+#include "heap_memory.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+const char PROGRAM_CACHE_MAGIC[8] = {'G', 'V', 'P', 'R', 'G', 0, 0, 1};
+
+fs::path cacheDirectory;
+std::string driverString; // Empty if the cache is disabled
+
+// Stable across runs, unlike std::hash
+uint64_t fnv1a(const std::string &data)
+{
+  uint64_t hash = 14695981039346656037ull;
+  for (const auto c : data) {
+    hash = (hash ^ uint8_t(c)) * 1099511628211ull;
+  }
+  return hash;
+}
+
+// Header of a cache file: magic, hash and size of the source, driver string,
+// then the binary format and the binary
+std::string serializeKey(const std::string &source)
+{
+  std::string header(PROGRAM_CACHE_MAGIC, sizeof(PROGRAM_CACHE_MAGIC));
+  const auto append = [&](const auto &value) {
+    header.append(reinterpret_cast<const char *>(&value), sizeof(value));
+  };
+  append(fnv1a(source));
+  append(uint64_t(source.size()));
+  append(uint32_t(driverString.size()));
+  header += driverString;
+  return header;
+}
+
+fs::path cacheFile(const std::string &source)
+{
+  std::stringstream name;
+  name << std::hex << fnv1a(driverString + source) << ".bin";
+  return cacheDirectory / name.str();
+}
+
+const char *glString(GLenum name)
+{
+  const auto *string = (const char *)glGetString(name);
+  return string ? string : "";
+}
+
+} // namespace
+
+void initProgramCache(const fs::path &directory)
+{
+  GLint formatCount = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+  if (formatCount <= 0) {
+    std::clog << "No program binary format, program cache disabled\n";
+    driverString.clear();
+    return;
+  }
+
+  cacheDirectory = directory;
+  driverString = std::string(glString(GL_VENDOR)) + '\n' +
+                 glString(GL_RENDERER) + '\n' + glString(GL_VERSION);
+}
+
+bool programCacheEnabled() { return !driverString.empty(); }
+
+bool loadProgramBinary(GLuint program, const std::string &source)
+{
+  if (!programCacheEnabled()) {
+    return false;
+  }
+  HeapTagScope heapTag(HeapTag::Caches);
+
+  const auto file = cacheFile(source);
+  std::ifstream input(file.string(), std::ios::binary);
+  if (!input) {
+    return false;
+  }
+
+  const auto expectedHeader = serializeKey(source);
+  std::string header(expectedHeader.size(), '\0');
+  GLenum format = 0;
+  uint32_t size = 0;
+  if (!input.read(&header[0], header.size()) || header != expectedHeader ||
+      !input.read(reinterpret_cast<char *>(&format), sizeof(format)) ||
+      !input.read(reinterpret_cast<char *>(&size), sizeof(size))) {
+    return false;
+  }
+  std::vector<char> binary(size);
+  if (!input.read(binary.data(), binary.size())) {
+    return false;
+  }
+
+  glProgramBinary(program, format, binary.data(), GLsizei(binary.size()));
+  GLint status = GL_FALSE;
+  glGetProgramiv(program, GL_LINK_STATUS, &status);
+  if (status != GL_TRUE) {
+    // Drivers may reject their own binaries, after an update with the same
+    // version string for instance
+    std::clog << "Program binary " << file << " rejected by the driver\n";
+    return false;
+  }
+  return true;
+}
+
+bool saveProgramBinary(GLuint program, const std::string &source)
+{
+  if (!programCacheEnabled()) {
+    return false;
+  }
+  HeapTagScope heapTag(HeapTag::Caches);
+
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0) {
+    return false;
+  }
+  std::vector<char> binary(length);
+  GLenum format = 0;
+  glGetProgramBinary(program, length, &length, &format, binary.data());
+
+  const auto file = cacheFile(source);
+  // Unique per process and thread so that concurrent runs do not write the same file
+  auto tmpFile = file;
+  tmpFile += "." +
+             std::to_string(
+                 std::chrono::steady_clock::now().time_since_epoch().count()) +
+             "." +
+             std::to_string(
+                 std::hash<std::thread::id>()(std::this_thread::get_id())) +
+             ".tmp";
+
+  try {
+    fs::create_directories(file.parent_path());
+    {
+      std::ofstream output(tmpFile.string(), std::ios::binary);
+      const auto header = serializeKey(source);
+      const auto size = uint32_t(length);
+      if (!output.write(header.data(), header.size()) ||
+          !output.write(reinterpret_cast<const char *>(&format),
+              sizeof(format)) ||
+          !output.write(reinterpret_cast<const char *>(&size), sizeof(size)) ||
+          !output.write(binary.data(), size)) {
+        output.close();
+        fs::remove(tmpFile);
+        return false;
+      }
+    }
+    fs::rename(tmpFile, file);
+  } catch (const fs::filesystem_error &) {
+    return false;
+  }
+
+  return true;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "filesystem.hpp"
+
+#include <glad/glad.h>
+
+#include <string>
+
+// Cache of linked program binaries on disk. Binaries are keyed by the
+// preprocessed sources of the program and by the GL vendor, renderer and
+// version strings, since a driver only accepts its own binaries.
+
+// Enable the cache in directory, for the current context and the ones sharing
+// its driver. The cache stays disabled if the driver exposes no binary format.
+void initProgramCache(const fs::path &directory);
+
+// Link program from the cached binary of source, the concatenated sources of
+// its shaders. Return false if the cache has no binary for source or if the
+// driver rejects it, the program then has to be compiled.
+bool loadProgramBinary(GLuint program, const std::string &source);
+
+// Store the binary of program, linked from source. program must have been
+// linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set.
+bool saveProgramBinary(GLuint program, const std::string &source);
+
+// True if initProgramCache enabled the cache
+bool programCacheEnabled();
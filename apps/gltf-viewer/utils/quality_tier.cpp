@@ -0,0 +1,218 @@
+#include "quality_tier.hpp"
+#include "gl_extensions.hpp"
+#include "gpu_memory.hpp"
+#include "shaders.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+
+namespace
+{
+
+const char *const TIER_NAMES[] = {"low", "medium", "high"};
+
+// Shading rates, in gigapixels per second of the probe shader, from which
+// a GPU is at least of the medium and of the high tier: integrated GPUs
+// shade it at a few, discrete ones at tens
+const double MEDIUM_GIGAPIXELS = 3;
+const double HIGH_GIGAPIXELS = 25;
+// Devices with less memory are at most of the medium tier, whose textures
+// are capped
+const size_t HIGH_MEMORY_BYTES = size_t(3) << 30;
+
+// Of the target of the probe, and the passes over it timed at once
+const GLsizei PROBE_SIZE = 1024;
+const int PROBE_PASSES = 8;
+const auto PROBE_DURATION = std::chrono::milliseconds(50);
+
+const char *const PROBE_VERTEX_SHADER = R"(#version 330
+void main()
+{
+	vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	gl_Position = vec4(2.0 * position - 1.0, 0.0, 1.0);
+}
+)";
+
+// About the arithmetic of a lit PBR fragment, without texture fetches
+const char *const PROBE_FRAGMENT_SHADER = R"(#version 330
+uniform float uSeed;
+out vec4 fColor;
+void main()
+{
+	vec3 value = vec3(gl_FragCoord.xy * 0.001, uSeed);
+	for (int i = 0; i < 32; ++i)
+	{
+		value = fract(value.yzx * 1.618 + value * value * 0.5 + 0.123);
+		value = inversesqrt(value + 1.0) * value;
+	}
+	fColor = vec4(value, 1.0);
+}
+)";
+
+bool softwareRenderer(std::string renderer)
+{
+  std::transform(renderer.begin(), renderer.end(), renderer.begin(),
+      [](unsigned char c) { return char(std::tolower(c)); });
+  for (const char *name :
+      {"llvmpipe", "softpipe", "swiftshader", "software", "swr"}) {
+    if (renderer.find(name) != std::string::npos) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Gigapixels per second of the probe shader, 0 if it could not be timed
+double timeProbeShader()
+{
+  GLint previousFramebuffer = 0;
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+  GLint previousViewport[4] = {};
+  glGetIntegerv(GL_VIEWPORT, previousViewport);
+
+  GLuint target, framebuffer, vertexArray, query;
+  glGenTextures(1, &target);
+  glBindTexture(GL_TEXTURE_2D, target);
+  glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA16F, PROBE_SIZE, PROBE_SIZE);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glGenFramebuffers(1, &framebuffer);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+  glFramebufferTexture2D(
+      GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target, 0);
+  glGenVertexArrays(1, &vertexArray);
+  glBindVertexArray(vertexArray);
+  glGenQueries(1, &query);
+
+  auto program = buildProgram(PROBE_VERTEX_SHADER, PROBE_FRAGMENT_SHADER);
+  program.use();
+  glViewport(0, 0, PROBE_SIZE, PROBE_SIZE);
+  glDisable(GL_DEPTH_TEST);
+  glDisable(GL_BLEND);
+
+  // The first draw compiles the shader for the state of the others
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+  glFinish();
+
+  double pixels = 0;
+  double seconds = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (int batch = 0;
+       std::chrono::steady_clock::now() - start < PROBE_DURATION; ++batch) {
+    glBeginQuery(GL_TIME_ELAPSED, query);
+    for (int pass = 0; pass < PROBE_PASSES; ++pass) {
+      program.setUniform("uSeed", float(batch * PROBE_PASSES + pass));
+      glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+    glEndQuery(GL_TIME_ELAPSED);
+    GLuint64 nanoseconds = 0;
+    glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+    pixels += double(PROBE_PASSES) * PROBE_SIZE * PROBE_SIZE;
+    seconds += double(nanoseconds) * 1e-9;
+  }
+
+  glDeleteQueries(1, &query);
+  glBindVertexArray(0);
+  glDeleteVertexArrays(1, &vertexArray);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, GLuint(previousFramebuffer));
+  glDeleteFramebuffers(1, &framebuffer);
+  glDeleteTextures(1, &target);
+  glViewport(previousViewport[0], previousViewport[1], previousViewport[2],
+      previousViewport[3]);
+  glUseProgram(0);
+
+  return seconds > 0 ? pixels / seconds * 1e-9 : 0;
+}
+
+} // namespace
+
+const char *qualityTierName(QualityTier tier)
+{
+  return TIER_NAMES[int(tier)];
+}
+
+bool parseQualityTier(const std::string &name, QualityTier &tier)
+{
+  for (int i = 0; i <= int(QualityTier::High); ++i) {
+    if (name == TIER_NAMES[i]) {
+      tier = QualityTier(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+QualitySettings qualitySettings(QualityTier tier)
+{
+  QualitySettings settings;
+  switch (tier) {
+  case QualityTier::Low:
+    settings.iblSizes = "256,16,64";
+    settings.fastIblBake = true;
+    settings.maxTextureSize = 1024;
+    settings.detailMaps = false;
+    settings.windowSamples = 0;
+    settings.shadows = false;
+    settings.ambientOcclusion = false;
+    break;
+  case QualityTier::Medium:
+    settings.iblSizes = "256,32,128";
+    settings.maxTextureSize = 2048;
+    settings.windowSamples = 2;
+    settings.ambientOcclusion = false;
+    break;
+  case QualityTier::High:
+    break;
+  }
+  return settings;
+}
+
+QualityProbe probeQualityTier()
+{
+  QualityProbe probe;
+  const auto *renderer =
+      reinterpret_cast<const char *>(glGetString(GL_RENDERER));
+  probe.renderer = renderer ? renderer : "";
+  probe.software = softwareRenderer(probe.renderer);
+  probe.indirectParameters = hasGLExtension("GL_ARB_indirect_parameters");
+  DriverMemoryInfo memory;
+  if (queryDriverMemoryInfo(memory)) {
+    probe.memoryBytes =
+        memory.totalBytes ? memory.totalBytes : memory.availableBytes;
+  }
+
+  // Software rasterizers would take seconds to shade the probe
+  if (probe.software) {
+    probe.tier = QualityTier::Low;
+    return probe;
+  }
+
+  probe.gigapixelsPerSecond = timeProbeShader();
+  probe.tier = probe.gigapixelsPerSecond >= HIGH_GIGAPIXELS
+                   ? QualityTier::High
+                   : probe.gigapixelsPerSecond >= MEDIUM_GIGAPIXELS
+                         ? QualityTier::Medium
+                         : QualityTier::Low;
+  if (probe.tier == QualityTier::High &&
+      ((probe.memoryBytes && probe.memoryBytes < HIGH_MEMORY_BYTES) ||
+          !probe.indirectParameters)) {
+    probe.tier = QualityTier::Medium;
+  }
+  return probe;
+}
+
+void printQualityProbe(const QualityProbe &probe, std::ostream &out)
+{
+  out << "Quality tier: " << qualityTierName(probe.tier) << "\n";
+  out << "  Renderer: " << probe.renderer
+      << (probe.software ? " (software)" : "") << "\n";
+  if (!probe.software) {
+    out << "  Shading rate: " << probe.gigapixelsPerSecond
+        << " Gpixels/s\n";
+  }
+  if (probe.memoryBytes) {
+    out << "  Memory: " << (probe.memoryBytes >> 20) << " MB\n";
+  }
+  out << "  Indirect parameters: "
+      << (probe.indirectParameters ? "yes" : "no") << "\n";
+}
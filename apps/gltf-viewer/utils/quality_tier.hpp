@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+
+// Quality tiers, from software rasterizers and integrated GPUs to discrete
+// ones, so that the same options suit every machine the viewer runs on
+enum class QualityTier
+{
+  Low,
+  Medium,
+  High
+};
+
+// Lower case name of tier on the command line
+const char *qualityTierName(QualityTier tier);
+// False if name is not one of those of qualityTierName()
+bool parseQualityTier(const std::string &name, QualityTier &tier);
+
+// Defaults a tier gives the options, options given explicitly win. High is
+// the default of every option.
+struct QualitySettings
+{
+  std::string iblSizes; // As --ibl-sizes, empty for the default sizes
+  bool fastIblBake = false;
+  int maxTextureSize = 0; // Of material textures, no limit if 0
+  // Normal and occlusion maps, and the permutations of the PBR program
+  // sampling them
+  bool detailMaps = true;
+  int windowSamples = 4; // Of the multisampled window, unless 0 or 1
+  bool shadows = true;
+  // Screen-space ambient occlusion offered by the GUI
+  bool ambientOcclusion = true;
+};
+
+QualitySettings qualitySettings(QualityTier tier);
+
+// What the tier of the current context is chosen from: the renderer, its
+// memory and extensions, and the rate at which it shades a fragment shader
+// of about the cost of the PBR one, timed for about 50 ms
+struct QualityProbe
+{
+  std::string renderer; // GL_RENDERER
+  bool software = false; // llvmpipe and the like, not timed
+  bool indirectParameters = false; // GPU culling and meshlets
+  size_t memoryBytes = 0; // Of the device, 0 if the driver does not tell
+  double gigapixelsPerSecond = 0;
+  QualityTier tier = QualityTier::High;
+};
+
+// Probe the context current on the calling thread. Draws offscreen, the
+// objects created are deleted and the framebuffer binding restored.
+QualityProbe probeQualityTier();
+
+// One line per field of probe
+void printQualityProbe(const QualityProbe &probe, std::ostream &out);
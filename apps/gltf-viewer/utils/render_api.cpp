@@ -0,0 +1,204 @@
+#include "render_api.h"
+
+#include "../ViewerApplication.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+namespace
+{
+
+std::atomic<bool> rendererExists{false};
+
+// Jobs of the calls, one at a time, to the renderer thread. The caller waits
+// for the reply of its job.
+class InProcessJobs : public RenderJobSource
+{
+public:
+  bool nextJob(RenderJob &job) override
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_signal.wait(lock, [&]() { return !m_jobs.empty() || m_closed; });
+    if (m_jobs.empty()) {
+      return false;
+    }
+    job = m_jobs.front();
+    m_jobs.pop_front();
+    ++m_takenCount;
+    return true;
+  }
+
+  void putBack(const RenderJob &job) override
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_jobs.push_front(job);
+    --m_takenCount;
+  }
+
+  size_t takenCount() const override
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_takenCount;
+  }
+
+  void reply(const RenderJob &, const std::string &error, bool,
+      double) override
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_error = error;
+    m_replied = true;
+    m_signal.notify_all();
+  }
+
+  // Hand job to the renderer thread and wait for its reply, return its error
+  std::string submit(const RenderJob &job)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_stopped) {
+      return m_stopError;
+    }
+    m_replied = false;
+    m_jobs.push_back(job);
+    m_signal.notify_all();
+    m_signal.wait(lock, [&]() { return m_replied || m_stopped; });
+    return m_replied ? m_error : m_stopError;
+  }
+
+  // No more jobs, nextJob returns false once they are taken
+  void close()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_closed = true;
+    m_signal.notify_all();
+  }
+
+  // The renderer thread ended, with error if it failed
+  void stop(const std::string &error)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopped = true;
+    m_stopError = error.empty() ? "The renderer has stopped" : error;
+    m_jobs.clear();
+    m_signal.notify_all();
+  }
+
+private:
+  mutable std::mutex m_mutex;
+  std::condition_variable m_signal;
+  std::deque<RenderJob> m_jobs;
+  size_t m_takenCount = 0;
+  bool m_closed = false;
+  bool m_replied = false;
+  std::string m_error;
+  bool m_stopped = false;
+  std::string m_stopError;
+};
+
+} // namespace
+
+struct gltf_renderer
+{
+  fs::path model;
+  fs::path environment;
+  std::string error;
+  InProcessJobs jobs;
+  std::thread thread;
+};
+
+gltf_renderer *gltf_renderer_create(const char *viewer_path, int gpu)
+{
+  if (!viewer_path || gpu < 0 || rendererExists.exchange(true)) {
+    return nullptr;
+  }
+
+  auto *renderer = new gltf_renderer;
+  const fs::path viewerPath = viewer_path;
+  renderer->thread = std::thread([renderer, viewerPath, gpu]() {
+    std::string error;
+    try {
+      serveRenderJobs(viewerPath, gpu, renderer->jobs);
+    } catch (const std::exception &e) {
+      error = e.what();
+    }
+    renderer->jobs.stop(error);
+  });
+  return renderer;
+}
+
+void gltf_renderer_destroy(gltf_renderer *renderer)
+{
+  if (!renderer) {
+    return;
+  }
+  renderer->jobs.close();
+  renderer->thread.join();
+  delete renderer;
+  rendererExists = false;
+}
+
+const char *gltf_renderer_error(const gltf_renderer *renderer)
+{
+  return renderer ? renderer->error.c_str() : "";
+}
+
+int gltf_renderer_open_model(gltf_renderer *renderer, const char *path)
+{
+  if (!path || !fs::exists(path)) {
+    renderer->error = std::string("No such file: ") + (path ? path : "");
+    return -1;
+  }
+  renderer->model = path;
+  return 0;
+}
+
+int gltf_renderer_set_environment(gltf_renderer *renderer, const char *path)
+{
+  if (path && *path && !fs::exists(path)) {
+    renderer->error = std::string("No such file: ") + path;
+    return -1;
+  }
+  renderer->environment = path ? path : "";
+  return 0;
+}
+
+int gltf_renderer_render(gltf_renderer *renderer, const float *lookat,
+    uint32_t width, uint32_t height, void *pixels)
+{
+  if (renderer->model.empty()) {
+    renderer->error = "No model opened";
+    return -1;
+  }
+  if (width == 0 || height == 0 || width > 16384 || height > 16384) {
+    renderer->error = "width and height must be between 1 and 16384";
+    return -1;
+  }
+  if (!pixels) {
+    renderer->error = "No pixel buffer";
+    return -1;
+  }
+
+  RenderJob job;
+  job.model = renderer->model;
+  job.environment = renderer->environment;
+  job.width = width;
+  job.height = height;
+  job.pixels = pixels;
+  if (lookat) {
+    const glm::vec3 eye(lookat[0], lookat[1], lookat[2]);
+    const glm::vec3 center(lookat[3], lookat[4], lookat[5]);
+    const glm::vec3 up(lookat[6], lookat[7], lookat[8]);
+    if (eye == center || glm::cross(up, center - eye) == glm::vec3(0)) {
+      renderer->error = "Degenerate lookat";
+      return -1;
+    }
+    job.camera = Camera{eye, center, up};
+    job.hasCamera = true;
+  }
+
+  renderer->error = renderer->jobs.submit(job);
+  return renderer->error.empty() ? 0 : -1;
+}
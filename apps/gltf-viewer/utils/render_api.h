@@ -0,0 +1,48 @@
+/* C API of the gltf-renderer library, the renderer of gltf-viewer called in
+ * process instead of through the serve command. A renderer renders on a
+ * headless EGL context of its own thread, the calls block until it is done.
+ * The model and environment stay loaded from one render to the next until
+ * either changes, like the programs and environment maps.
+ *
+ * Functions returning int return 0 on success, -1 on failure with a message
+ * given by gltf_renderer_error(). A renderer must not be called from several
+ * threads at once. There is one renderer per process at a time, as the GL
+ * setup of the viewer is process-wide. */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct gltf_renderer gltf_renderer;
+
+/* Renderer on the EGL device of index gpu, with the shaders of the viewer
+ * next to viewer_path, the path of the gltf-viewer executable. Return NULL if
+ * the arguments are invalid or another renderer exists. */
+gltf_renderer *gltf_renderer_create(const char *viewer_path, int gpu);
+
+/* Wait for the renderer thread and release everything it loaded */
+void gltf_renderer_destroy(gltf_renderer *renderer);
+
+/* Message of the last call that failed, valid until the next call */
+const char *gltf_renderer_error(const gltf_renderer *renderer);
+
+/* glTF file of the next renders, loaded by the first of them */
+int gltf_renderer_open_model(gltf_renderer *renderer, const char *path);
+
+/* Environment map of the next renders, none if path is NULL or empty */
+int gltf_renderer_set_environment(gltf_renderer *renderer, const char *path);
+
+/* Render the model seen from lookat, 9 floats eye, center and up, or from the
+ * camera framing the scene if lookat is NULL. The width * height RGBA8 pixels,
+ * bottom row first, are read back straight to pixels, of at least
+ * 4 * width * height bytes. */
+int gltf_renderer_render(gltf_renderer *renderer, const float *lookat,
+    uint32_t width, uint32_t height, void *pixels);
+
+#ifdef __cplusplus
+}
+#endif
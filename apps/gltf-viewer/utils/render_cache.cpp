@@ -0,0 +1,418 @@
+#include "render_cache.hpp"
+
+#include "gltf_loader.hpp"
+#include "heap_memory.hpp"
+#include "http_reader.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <ios>
+#include <sstream>
+#include <thread>
+
+#include <json.hpp>
+
+namespace
+{
+
+const char KEY_VERSION[] = "render-cache 1\n";
+
+// Stable across runs, unlike std::hash
+uint64_t fnv1a(const char *data, size_t size, uint64_t hash)
+{
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ uint8_t(data[i])) * 1099511628211ull;
+  }
+  return hash;
+}
+
+const uint64_t FNV_OFFSET = 14695981039346656037ull;
+
+std::string hex(uint64_t value)
+{
+  std::ostringstream out;
+  out << std::hex << value;
+  return out.str();
+}
+
+int64_t writeTime(const fs::path &path)
+{
+#ifdef GLMLV_USE_BOOST_FILESYSTEM
+  return int64_t(fs::last_write_time(path));
+#else
+  return int64_t(fs::last_write_time(path).time_since_epoch().count());
+#endif
+}
+
+// The glTF file and the files of the buffers and images its JSON references,
+// as the loader finds them, false if it cannot be read
+bool modelFiles(const fs::path &model, std::vector<fs::path> &files)
+{
+  std::ifstream input(model.string(), std::ios::binary);
+  if (!input) {
+    return false;
+  }
+  std::string json;
+  if (isGlbFile(model)) {
+    // Header, then the length and type of the JSON chunk
+    unsigned char header[20];
+    if (!input.read(reinterpret_cast<char *>(header), sizeof(header))) {
+      return false;
+    }
+    const uint32_t length = uint32_t(header[12]) |
+                            uint32_t(header[13]) << 8 |
+                            uint32_t(header[14]) << 16 |
+                            uint32_t(header[15]) << 24;
+    json.resize(length);
+    if (!input.read(&json[0], length)) {
+      return false;
+    }
+  } else {
+    std::ostringstream contents;
+    contents << input.rdbuf();
+    json = contents.str();
+  }
+
+  files.push_back(model);
+  try {
+    const auto gltf = nlohmann::json::parse(json);
+    for (const auto *array : {"buffers", "images"}) {
+      if (!gltf.count(array)) {
+        continue;
+      }
+      for (const auto &object : gltf[array]) {
+        const auto uri = object.value("uri", std::string());
+        if (!uri.empty() && uri.compare(0, 5, "data:") != 0) {
+          files.push_back(gltfUriPath(model.parent_path(), uri));
+        }
+      }
+    }
+  } catch (const std::exception &) {
+    return false;
+  }
+  return true;
+}
+
+bool readFile(const fs::path &path, std::vector<unsigned char> &bytes)
+{
+  std::ifstream input(path.string(), std::ios::binary | std::ios::ate);
+  if (!input) {
+    return false;
+  }
+  bytes.resize(size_t(input.tellg()));
+  input.seekg(0);
+  return bool(input.read(reinterpret_cast<char *>(bytes.data()), bytes.size()));
+}
+
+} // namespace
+
+RenderResultCache::RenderResultCache(const fs::path &directory,
+    size_t budgetBytes, const fs::path &appPath,
+    const fs::path &shadersDirectory) :
+    m_directory{directory}, m_budgetBytes{budgetBytes}
+{
+  // Images of previous runs are used in the order of their write times, which
+  // hits refresh
+  std::vector<std::pair<int64_t, std::string>> stored;
+  try {
+    fs::create_directories(m_directory);
+    for (const auto &file : fs::directory_iterator(m_directory)) {
+      if (file.path().extension() == ".render") {
+        Entry entry;
+        entry.bytes = size_t(fs::file_size(file.path()));
+        m_entries[file.path().filename().string()] = entry;
+        m_bytes += entry.bytes;
+        stored.emplace_back(
+            writeTime(file.path()), file.path().filename().string());
+      }
+    }
+  } catch (const fs::filesystem_error &) {
+  }
+  std::sort(begin(stored), end(stored));
+  for (const auto &file : stored) {
+    m_entries[file.second].lastUse = ++m_uses;
+  }
+
+  // A change of a shader or a rebuild of the renderer misses every image
+  std::vector<fs::path> sources;
+  try {
+    for (const auto &file :
+        fs::recursive_directory_iterator(shadersDirectory)) {
+      if (fs::is_regular_file(file.path())) {
+        sources.push_back(file.path());
+      }
+    }
+  } catch (const fs::filesystem_error &) {
+  }
+  std::sort(begin(sources), end(sources));
+  sources.push_back(appPath);
+  for (const auto &source : sources) {
+    uint64_t hash = 0;
+    if (fileHash(source, hash)) {
+      m_rendererHash += source.filename().string() + " " + ::hex(hash) + "\n";
+    }
+  }
+
+  evict();
+}
+
+bool RenderResultCache::key(const RenderJob &job, std::string &key)
+{
+  // Remote files can change without the cache telling
+  if (isRemoteUrl(job.model.string()) ||
+      isRemoteUrl(job.environment.string())) {
+    return false;
+  }
+
+  std::vector<fs::path> files;
+  if (!modelFiles(job.model, files)) {
+    return false;
+  }
+  if (!job.environment.empty()) {
+    files.push_back(job.environment);
+  }
+
+  std::ostringstream out;
+  out << KEY_VERSION << m_rendererHash;
+  for (const auto &file : files) {
+    uint64_t hash = 0;
+    if (!fileHash(file, hash)) {
+      return false;
+    }
+    out << "file " << ::hex(hash) << "\n";
+  }
+  out << "environment " << !job.environment.empty() << "\n";
+  if (job.hasCamera) {
+    const auto &camera = job.camera;
+    out << "camera" << std::hexfloat;
+    for (const auto &vector : {camera.eye(), camera.center(), camera.up()}) {
+      out << " " << vector.x << " " << vector.y << " " << vector.z;
+    }
+    out << std::defaultfloat << "\n";
+  }
+  std::string format = "rgba8";
+  if (!job.pixels && !job.ring) {
+    format = job.output.extension().string();
+    std::transform(begin(format), end(format), begin(format),
+        [](unsigned char c) { return char(std::tolower(c)); });
+  }
+  out << "image " << job.width << " " << job.height << " " << job.samples
+      << " " << format << "\n";
+  key = out.str();
+  return true;
+}
+
+bool RenderResultCache::load(
+    const std::string &key, std::vector<unsigned char> &bytes)
+{
+  HeapTagScope heapTag(HeapTag::Caches);
+  const auto name = ::hex(fnv1a(key.data(), key.size(), FNV_OFFSET)) +
+                    ".render";
+  const auto entry = m_entries.find(name);
+  std::vector<unsigned char> file;
+  // The key is also stored in the file, a hash collision only causes a render
+  if (entry == end(m_entries) || !readFile(entryPath(name), file) ||
+      file.size() < key.size() ||
+      std::memcmp(file.data(), key.data(), key.size()) != 0) {
+    ++m_misses;
+    return false;
+  }
+  bytes.assign(file.begin() + key.size(), file.end());
+  entry->second.lastUse = ++m_uses;
+  try {
+#ifdef GLMLV_USE_BOOST_FILESYSTEM
+    fs::last_write_time(entryPath(name), std::time(nullptr));
+#else
+    fs::last_write_time(entryPath(name), fs::file_time_type::clock::now());
+#endif
+  } catch (const fs::filesystem_error &) {
+  }
+  ++m_hits;
+  return true;
+}
+
+void RenderResultCache::store(
+    const std::string &key, const std::vector<unsigned char> &bytes)
+{
+  HeapTagScope heapTag(HeapTag::Caches);
+  const auto name = ::hex(fnv1a(key.data(), key.size(), FNV_OFFSET)) +
+                    ".render";
+  const auto file = entryPath(name);
+
+  // Unique per process and thread so that concurrent servers do not write the
+  // same file
+  auto tmpFile = file;
+  tmpFile += "." +
+             std::to_string(
+                 std::chrono::steady_clock::now().time_since_epoch().count()) +
+             "." +
+             std::to_string(
+                 std::hash<std::thread::id>()(std::this_thread::get_id())) +
+             ".tmp";
+
+  try {
+    {
+      std::ofstream output(tmpFile.string(), std::ios::binary);
+      if (!output.write(key.data(), key.size()) ||
+          !output.write(
+              reinterpret_cast<const char *>(bytes.data()), bytes.size())) {
+        output.close();
+        fs::remove(tmpFile);
+        return;
+      }
+    }
+    fs::rename(tmpFile, file);
+  } catch (const fs::filesystem_error &) {
+    return;
+  }
+
+  auto &entry = m_entries[name];
+  m_bytes -= entry.bytes;
+  entry.bytes = key.size() + bytes.size();
+  entry.lastUse = ++m_uses;
+  m_bytes += entry.bytes;
+  evict();
+}
+
+bool RenderResultCache::fileHash(const fs::path &path, uint64_t &hash)
+{
+  FileHash file;
+  const auto absolute = fs::absolute(path).string();
+  try {
+    file.size = uint64_t(fs::file_size(path));
+    file.writeTime = writeTime(path);
+  } catch (const fs::filesystem_error &) {
+    return false;
+  }
+  const auto known = m_fileHashes.find(absolute);
+  if (known != end(m_fileHashes) && known->second.size == file.size &&
+      known->second.writeTime == file.writeTime) {
+    hash = known->second.hash;
+    return true;
+  }
+
+  std::ifstream input(path.string(), std::ios::binary);
+  if (!input) {
+    return false;
+  }
+  file.hash = FNV_OFFSET;
+  std::vector<char> chunk(1 << 20);
+  while (input.read(chunk.data(), chunk.size()) || input.gcount() > 0) {
+    file.hash = fnv1a(chunk.data(), size_t(input.gcount()), file.hash);
+  }
+  m_fileHashes[absolute] = file;
+  hash = file.hash;
+  return true;
+}
+
+fs::path RenderResultCache::entryPath(const std::string &name) const
+{
+  return m_directory / name;
+}
+
+void RenderResultCache::evict()
+{
+  while (m_bytes > m_budgetBytes && !m_entries.empty()) {
+    const auto oldest = std::min_element(begin(m_entries), end(m_entries),
+        [](const std::pair<const std::string, Entry> &a,
+            const std::pair<const std::string, Entry> &b) {
+          return a.second.lastUse < b.second.lastUse;
+        });
+    try {
+      fs::remove(entryPath(oldest->first));
+    } catch (const fs::filesystem_error &) {
+    }
+    m_bytes -= oldest->second.bytes;
+    m_entries.erase(oldest);
+  }
+}
+
+bool CachedJobSource::nextJob(RenderJob &job)
+{
+  while (m_source.nextJob(job)) {
+    // Jobs put back were misses already
+    if (m_putBack > 0) {
+      --m_putBack;
+      return true;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    std::string key;
+    std::vector<unsigned char> bytes;
+    {
+      std::lock_guard<std::mutex> lock(m_cacheMutex);
+      if (!m_cache.key(job, key) || !m_cache.load(key, bytes)) {
+        return true;
+      }
+    }
+    if (!answer(job, bytes)) {
+      return true;
+    }
+    ++m_answered;
+    m_source.reply(job, "", true,
+        std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start)
+            .count());
+  }
+  return false;
+}
+
+void CachedJobSource::reply(const RenderJob &job, const std::string &error,
+    bool cached, double milliseconds)
+{
+  std::string key;
+  bool hasKey = false;
+  if (error.empty()) {
+    std::lock_guard<std::mutex> lock(m_cacheMutex);
+    hasKey = m_cache.key(job, key);
+  }
+  if (hasKey) {
+    std::vector<unsigned char> bytes;
+    const size_t pixelBytes = size_t(job.width) * job.height * 4;
+    if (job.pixels) {
+      const auto *pixels = static_cast<const unsigned char *>(job.pixels);
+      bytes.assign(pixels, pixels + pixelBytes);
+    } else if (job.ring) {
+      const auto *pixels = static_cast<const unsigned char *>(
+          m_source.frameRing()->framePixels(job.ringFrame));
+      bytes.assign(pixels, pixels + pixelBytes);
+    } else if (!readFile(job.output, bytes)) {
+      bytes.clear();
+    }
+    if (!bytes.empty()) {
+      std::lock_guard<std::mutex> lock(m_cacheMutex);
+      m_cache.store(key, bytes);
+    }
+  }
+  m_source.reply(job, error, cached, milliseconds);
+}
+
+bool CachedJobSource::answer(
+    RenderJob &job, const std::vector<unsigned char> &bytes)
+{
+  const size_t pixelBytes = size_t(job.width) * job.height * 4;
+  if (job.pixels) {
+    if (bytes.size() != pixelBytes) {
+      return false;
+    }
+    std::memcpy(job.pixels, bytes.data(), pixelBytes);
+    return true;
+  }
+  if (job.ring) {
+    auto *ring = m_source.frameRing();
+    if (!ring || bytes.size() != pixelBytes || pixelBytes > ring->slotSize()) {
+      return false;
+    }
+    std::memcpy(ring->beginFrame(job.ringFrame), bytes.data(), pixelBytes);
+    ring->endFrame(job.width, job.height, FRAME_RING_RGBA8, job.id);
+    return true;
+  }
+  std::ofstream output(job.output.string(), std::ios::binary);
+  return bool(output.write(
+      reinterpret_cast<const char *>(bytes.data()), bytes.size()));
+}
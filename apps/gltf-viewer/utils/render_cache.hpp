@@ -0,0 +1,109 @@
+#pragma once
+
+#include "filesystem.hpp"
+#include "render_server.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Images rendered for the jobs of serveRenderJobs, stored on disk under the
+// hash of everything they depend on: the bytes of the glTF file and of the
+// buffers and images it references, of the environment, the camera, the size
+// and samples, the format of the output, the shader sources and the renderer
+// executable. Identical requests are answered from it without loading
+// anything. The least recently used images are evicted past the budget.
+class RenderResultCache
+{
+public:
+  // Cache in directory, shaders being read from shadersDirectory by appPath
+  RenderResultCache(const fs::path &directory, size_t budgetBytes,
+      const fs::path &appPath, const fs::path &shadersDirectory);
+
+  // Key of job, false for jobs that are not cached, such as those of remote
+  // models
+  bool key(const RenderJob &job, std::string &key);
+
+  // Read the image stored for key, false on a miss
+  bool load(const std::string &key, std::vector<unsigned char> &bytes);
+  // Store the image of key, then evict down to the budget
+  void store(const std::string &key, const std::vector<unsigned char> &bytes);
+
+  size_t hits() const { return m_hits; }
+  size_t misses() const { return m_misses; }
+  size_t bytes() const { return m_bytes; }
+  size_t imageCount() const { return m_entries.size(); }
+
+private:
+  struct Entry
+  {
+    size_t bytes = 0;
+    uint64_t lastUse = 0; // Order of use, files start from their write time
+  };
+
+  // Of the contents of path, kept for its size and write time
+  bool fileHash(const fs::path &path, uint64_t &hash);
+  fs::path entryPath(const std::string &name) const;
+  void evict();
+
+  struct FileHash
+  {
+    uint64_t size = 0;
+    int64_t writeTime = 0;
+    uint64_t hash = 0;
+  };
+
+  fs::path m_directory;
+  size_t m_budgetBytes = 0;
+  std::string m_rendererHash; // Of the shaders and the executable
+  std::map<std::string, FileHash> m_fileHashes;
+  std::map<std::string, Entry> m_entries; // By file name
+  size_t m_bytes = 0;
+  uint64_t m_uses = 0;
+  size_t m_hits = 0;
+  size_t m_misses = 0;
+};
+
+// Jobs of source answered from cache when it has their image, the images of
+// the others stored once rendered. Replies may come from other threads than
+// the one waiting in nextJob, as those of RenderJobPool.
+class CachedJobSource : public RenderJobSource
+{
+public:
+  CachedJobSource(RenderJobSource &source, RenderResultCache &cache) :
+      m_source{source}, m_cache{cache}
+  {
+  }
+
+  // Answer the hits in turn, return the first miss
+  bool nextJob(RenderJob &job) override;
+  void putBack(const RenderJob &job) override
+  {
+    m_source.putBack(job);
+    ++m_putBack;
+  }
+  size_t takenCount() const override
+  {
+    return m_source.takenCount() - m_answered;
+  }
+  void upcomingModels(std::vector<fs::path> &models) override
+  {
+    m_source.upcomingModels(models);
+  }
+  void reply(const RenderJob &job, const std::string &error, bool cached,
+      double milliseconds) override;
+  FrameRing *frameRing() override { return m_source.frameRing(); }
+
+private:
+  // Write the image of a hit where job wants it
+  bool answer(RenderJob &job, const std::vector<unsigned char> &bytes);
+
+  RenderJobSource &m_source;
+  RenderResultCache &m_cache;
+  std::mutex m_cacheMutex;
+  size_t m_answered = 0; // Jobs taken from m_source and answered here
+  size_t m_putBack = 0; // Jobs put back in m_source, returned first
+};
@@ -0,0 +1,256 @@
+#include "render_job_pool.hpp"
+
+#include <algorithm>
+
+namespace
+{
+
+uint64_t jobCost(const RenderJob &job)
+{
+  return uint64_t(job.width) * job.height * uint64_t(std::max(job.samples, 1));
+}
+
+bool isLarge(const RenderJob &job)
+{
+  return jobCost(job) > RENDER_POOL_LARGE_JOB;
+}
+
+} // namespace
+
+// Jobs put back by the renderer are its own, returned first
+class RenderJobPool::Renderer : public RenderJobSource
+{
+public:
+  Renderer(RenderJobPool &pool, size_t index) : m_pool{pool}, m_index{index}
+  {
+  }
+
+  bool nextJob(RenderJob &job) override
+  {
+    if (!m_putBack.empty()) {
+      job = std::move(m_putBack.front());
+      m_putBack.pop_front();
+    } else if (!m_pool.take(m_index, job)) {
+      return false;
+    }
+    ++m_takenCount;
+    return true;
+  }
+
+  void putBack(const RenderJob &job) override
+  {
+    m_putBack.push_front(job);
+    --m_takenCount;
+  }
+
+  size_t takenCount() const override { return m_takenCount; }
+
+  void upcomingModels(std::vector<fs::path> &models) override
+  {
+    for (const auto &job : m_putBack) {
+      models.push_back(job.model);
+    }
+    m_pool.upcomingModels(m_index, models);
+  }
+
+  void reply(const RenderJob &job, const std::string &error, bool cached,
+      double milliseconds) override
+  {
+    m_pool.finished(m_index, job, error, cached, milliseconds);
+  }
+
+  FrameRing *frameRing() override { return m_pool.m_source.frameRing(); }
+
+  // Also handed back to the pool by stopped(), on the thread of the renderer
+  std::deque<RenderJob> m_putBack;
+
+private:
+  RenderJobPool &m_pool;
+  size_t m_index;
+  size_t m_takenCount = 0;
+};
+
+RenderJobPool::RenderJobPool(RenderJobSource &source, size_t rendererCount) :
+    m_source{source}, m_states(rendererCount), m_runningCount{rendererCount}
+{
+  for (size_t i = 0; i < rendererCount; ++i) {
+    m_renderers.emplace_back(new Renderer(*this, i));
+  }
+}
+
+RenderJobPool::~RenderJobPool() = default;
+
+RenderJobSource &RenderJobPool::renderer(size_t index)
+{
+  return *m_renderers[index];
+}
+
+void RenderJobPool::run()
+{
+  RenderJob job;
+  while (m_source.nextJob(job)) {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (m_runningCount > 0) {
+        m_pending.push_back({job, std::chrono::steady_clock::now()});
+        m_changed.notify_all();
+        continue;
+      }
+    }
+    replyError(job, "No renderer is running");
+  }
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_closed = true;
+  m_changed.notify_all();
+}
+
+void RenderJobPool::stopped(size_t index)
+{
+  auto &putBack = m_renderers[index]->m_putBack;
+  std::deque<PendingJob> orphans;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto &state = m_states[index];
+    if (state.stopped) {
+      return;
+    }
+    state.stopped = true;
+    --m_runningCount;
+    if (state.runningLarge) {
+      state.runningLarge = false;
+      --m_largeCount;
+    }
+    const auto now = std::chrono::steady_clock::now();
+    for (auto it = putBack.rbegin(); it != putBack.rend(); ++it) {
+      m_pending.push_front({std::move(*it), now});
+    }
+    putBack.clear();
+    if (m_runningCount == 0) {
+      orphans.swap(m_pending);
+    }
+  }
+  m_changed.notify_all();
+
+  for (const auto &orphan : orphans) {
+    replyError(orphan.job, "No renderer is running");
+  }
+}
+
+size_t RenderJobPool::nextIndex(size_t renderer) const
+{
+  const auto &state = m_states[renderer];
+  // One renderer stays free for small jobs, unless it is the only one
+  const bool takesLarge =
+      m_runningCount == 1 || m_largeCount + 1 < m_runningCount;
+  const auto eligible = [&](const RenderJob &job) {
+    return takesLarge || !isLarge(job);
+  };
+
+  if (!m_pending.empty() && eligible(m_pending.front().job) &&
+      std::chrono::duration<double, std::milli>(
+          std::chrono::steady_clock::now() - m_pending.front().received)
+              .count() >= RENDER_POOL_MAX_WAIT_MS) {
+    return 0;
+  }
+
+  size_t best = m_pending.size();
+  bool bestLoaded = false;
+  uint64_t bestCost = 0;
+  for (size_t i = 0; i < m_pending.size(); ++i) {
+    const auto &job = m_pending[i].job;
+    if (!eligible(job)) {
+      continue;
+    }
+    const bool loaded =
+        job.model == state.model && job.environment == state.environment;
+    const auto cost = jobCost(job);
+    if (best == m_pending.size() || (loaded && !bestLoaded) ||
+        (loaded == bestLoaded && cost < bestCost)) {
+      best = i;
+      bestLoaded = loaded;
+      bestCost = cost;
+    }
+  }
+  return best;
+}
+
+bool RenderJobPool::take(size_t renderer, RenderJob &job)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  auto &state = m_states[renderer];
+  // Its previous job is done
+  if (state.runningLarge) {
+    state.runningLarge = false;
+    --m_largeCount;
+  }
+
+  for (;;) {
+    const auto index = nextIndex(renderer);
+    if (index < m_pending.size()) {
+      job = std::move(m_pending[index].job);
+      m_pending.erase(m_pending.begin() + index);
+      state.model = job.model;
+      state.environment = job.environment;
+      if (isLarge(job)) {
+        state.runningLarge = true;
+        ++m_largeCount;
+      }
+      return true;
+    }
+    if (m_closed && m_pending.empty()) {
+      return false;
+    }
+    // For a job, or for a large one of another renderer to end
+    m_changed.wait(lock);
+  }
+}
+
+void RenderJobPool::finished(size_t renderer, const RenderJob &job,
+    const std::string &error, bool cached, double milliseconds)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_replyMutex);
+    m_source.reply(job, error, cached, milliseconds);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto &state = m_states[renderer];
+    if (!state.runningLarge) {
+      return;
+    }
+    state.runningLarge = false;
+    --m_largeCount;
+  }
+  m_changed.notify_all();
+}
+
+void RenderJobPool::upcomingModels(
+    size_t renderer, std::vector<fs::path> &models)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  // Models of the pending jobs that no renderer has loaded, in order, shared
+  // between the renderers in turn so that each loads others ahead
+  std::vector<fs::path> waiting;
+  for (const auto &pending : m_pending) {
+    const auto &model = pending.job.model;
+    if (std::find(begin(waiting), end(waiting), model) != end(waiting) ||
+        std::any_of(begin(m_states), end(m_states),
+            [&](const RendererState &state) {
+              return !state.stopped && state.model == model;
+            })) {
+      continue;
+    }
+    waiting.push_back(model);
+  }
+  for (size_t i = renderer; i < waiting.size(); i += m_states.size()) {
+    models.push_back(waiting[i]);
+  }
+}
+
+void RenderJobPool::replyError(const RenderJob &job, const std::string &error)
+{
+  std::lock_guard<std::mutex> lock(m_replyMutex);
+  m_source.reply(job, error, false, 0);
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "filesystem.hpp"
+#include "render_server.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Jobs of pixels * samples above it are large: all renderers but one take
+// them, the last one staying free for smaller jobs
+const uint64_t RENDER_POOL_LARGE_JOB = 1024 * 1024;
+// A job waiting longer is taken before any other, for a stream of small jobs
+// not to starve the large ones
+const double RENDER_POOL_MAX_WAIT_MS = 2000.;
+
+// Jobs of a source shared by the renderers of serveRenderJobs running
+// concurrently, each on a thread of its own with its own context, so that
+// small jobs do not queue behind large ones. run() takes the jobs of the
+// source as they come, each renderer takes them from the pool through its
+// renderer(i): those of the model and environment it has loaded first, the
+// smallest first, else the smallest of the others.
+class RenderJobPool
+{
+public:
+  // Replies are sent to source from the threads of the renderers, one at a
+  // time, while run() may wait in its nextJob
+  RenderJobPool(RenderJobSource &source, size_t rendererCount);
+  ~RenderJobPool();
+
+  RenderJobPool(const RenderJobPool &) = delete;
+  RenderJobPool &operator=(const RenderJobPool &) = delete;
+
+  // Take the jobs of the source on the calling thread until there are no
+  // more, then the renderers end once the pool is empty
+  void run();
+
+  // Source of the renderer of index, for its thread only
+  RenderJobSource &renderer(size_t index);
+
+  // The renderer of index ended, the jobs it put back go to the others. Jobs
+  // left once every renderer ended are answered with an error.
+  void stopped(size_t index);
+
+private:
+  class Renderer;
+
+  struct PendingJob
+  {
+    RenderJob job;
+    std::chrono::steady_clock::time_point received;
+  };
+
+  // Of each renderer
+  struct RendererState
+  {
+    fs::path model; // Of the last job taken, loaded or being loaded
+    fs::path environment;
+    bool runningLarge = false;
+    bool stopped = false;
+  };
+
+  // Wait for the next job of renderer, false once there are no more
+  bool take(size_t renderer, RenderJob &job);
+  void finished(size_t renderer, const RenderJob &job, const std::string &error,
+      bool cached, double milliseconds);
+  void upcomingModels(size_t renderer, std::vector<fs::path> &models);
+  // With m_mutex locked, the index in m_pending of the job renderer takes
+  // next, m_pending.size() if none
+  size_t nextIndex(size_t renderer) const;
+  void replyError(const RenderJob &job, const std::string &error);
+
+  RenderJobSource &m_source;
+  std::vector<std::unique_ptr<Renderer>> m_renderers;
+  std::mutex m_replyMutex; // Of the replies to m_source
+
+  std::mutex m_mutex;
+  std::condition_variable m_changed;
+  std::deque<PendingJob> m_pending; // In the order received
+  std::vector<RendererState> m_states;
+  size_t m_runningCount; // Renderers not stopped
+  size_t m_largeCount = 0; // Renderers running a large job
+  bool m_closed = false; // The source has no more jobs
+};
@@ -0,0 +1,57 @@
+#include "render_queue.hpp"
+
+#include "trace.hpp"
+
+#include <algorithm>
+
+namespace
+{
+
+// Bits of the key, from the highest
+const int BLENDED_BITS = 1;
+// Every feature bit of a PBR permutation, with shading LOD
+const int PROGRAM_BITS = 11;
+const int MATERIAL_BITS = 16;
+const int DEPTH_BITS = 20;
+const int PRIMITIVE_BITS = 16;
+
+static_assert(BLENDED_BITS + PROGRAM_BITS + MATERIAL_BITS + DEPTH_BITS +
+                      PRIMITIVE_BITS ==
+                  64,
+    "The sort key fields must fill 64 bits");
+
+uint64_t field(uint32_t value, int bits)
+{
+  // Values that do not fit are clamped, they only sort less precisely
+  const auto maxValue = (uint64_t(1) << bits) - 1;
+  return std::min(uint64_t(value), maxValue);
+}
+
+} // namespace
+
+void RenderQueue::push(uint32_t item, uint32_t program, uint32_t material,
+    float depth, uint32_t primitive, Layer layer)
+{
+  depth = std::min(std::max(depth, 0.f), 1.f);
+  if (layer == Layer::SortedBlended) {
+    program = material = 0;
+    depth = 1.f - depth;
+  }
+  const auto depthMax = float((1 << DEPTH_BITS) - 1);
+  const auto quantizedDepth = uint32_t(depth * depthMax);
+
+  uint64_t key = layer == Layer::Opaque ? 0 : 1;
+  key = (key << PROGRAM_BITS) | field(program, PROGRAM_BITS);
+  key = (key << MATERIAL_BITS) | field(material, MATERIAL_BITS);
+  key = (key << DEPTH_BITS) | field(quantizedDepth, DEPTH_BITS);
+  key = (key << PRIMITIVE_BITS) | field(primitive, PRIMITIVE_BITS);
+
+  m_entries.push_back(Entry{key, item});
+}
+
+void RenderQueue::sort()
+{
+  TRACE_ZONE("sortRenderQueue");
+  std::sort(m_entries.begin(), m_entries.end(),
+      [](const Entry &a, const Entry &b) { return a.key < b.key; });
+}
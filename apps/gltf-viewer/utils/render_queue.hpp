@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Draws of a frame sorted by a key that puts the most expensive state changes
+// in the highest bits: program, then material, then depth front to back, then
+// primitive. Consecutive draws sharing a program and material are adjacent so
+// their state is only bound once, and draws of a primitive at the same depth
+// are adjacent so they can be drawn instanced.
+//
+// Blended draws follow the opaque ones in the same order, those blended in
+// order only by depth, back to front.
+class RenderQueue
+{
+public:
+  enum class Layer
+  {
+    Opaque,
+    Blended, // Order independent
+    SortedBlended
+  };
+
+  struct Entry
+  {
+    uint64_t key;
+    uint32_t item; // Caller defined, usually an index in a draw list
+  };
+
+  void clear() { m_entries.clear(); }
+
+  // depth is the view distance divided by the far plane, clamped to [0, 1]
+  void push(uint32_t item, uint32_t program, uint32_t material, float depth,
+      uint32_t primitive, Layer layer = Layer::Opaque);
+
+  void sort();
+
+  const std::vector<Entry> &entries() const { return m_entries; }
+
+private:
+  std::vector<Entry> m_entries;
+};
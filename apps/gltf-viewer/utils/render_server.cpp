@@ -0,0 +1,349 @@
+#include "render_server.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include <json.hpp>
+
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+
+// ringSlotSize is the size in bytes of the slots of the frame ring, 0 if the
+// server has none
+bool parseJob(const std::string &line, size_t ringSlotSize, RenderJob &job,
+    std::string &err)
+{
+  nlohmann::json request;
+  try {
+    request = nlohmann::json::parse(line);
+  } catch (const std::exception &e) {
+    err = std::string("Unable to parse request: ") + e.what();
+    return false;
+  }
+  if (!request.is_object()) {
+    err = "Expected a JSON object";
+    return false;
+  }
+
+  try {
+    job = RenderJob();
+    if (request.count("id")) {
+      job.id = request["id"].is_string() ? request["id"].get<std::string>()
+                                         : request["id"].dump();
+    }
+    job.model = request.value("model", std::string());
+    job.environment = request.value("environment", std::string());
+    job.output = request.value("output", std::string());
+    job.ring = request.value("ring", false);
+    job.width = request.value("width", job.width);
+    job.height = request.value("height", job.height);
+    job.samples = request.value("samples", job.samples);
+
+    if (request.count("lookat")) {
+      const auto &lookat = request["lookat"];
+      if (!lookat.is_array() || lookat.size() != 9) {
+        err = "lookat must be an array of 9 numbers";
+        return false;
+      }
+      const glm::vec3 eye(lookat[0].get<float>(), lookat[1].get<float>(),
+          lookat[2].get<float>());
+      const glm::vec3 center(lookat[3].get<float>(), lookat[4].get<float>(),
+          lookat[5].get<float>());
+      const glm::vec3 up(lookat[6].get<float>(), lookat[7].get<float>(),
+          lookat[8].get<float>());
+      if (eye == center || glm::cross(up, center - eye) == glm::vec3(0)) {
+        err = "Degenerate lookat";
+        return false;
+      }
+      job.camera = Camera{eye, center, up};
+      job.hasCamera = true;
+    }
+  } catch (const std::exception &e) {
+    err = std::string("Invalid request: ") + e.what();
+    return false;
+  }
+
+  if (job.model.empty() || job.output.empty() == !job.ring) {
+    err = "model and either output or ring are required";
+    return false;
+  }
+  if (job.width == 0 || job.height == 0 || job.width > 16384 ||
+      job.height > 16384) {
+    err = "width and height must be between 1 and 16384";
+    return false;
+  }
+  if (job.ring && ringSlotSize == 0) {
+    err = "The server has no frame ring, see serve --shm-ring";
+    return false;
+  }
+  if (job.ring && size_t(job.width) * job.height * 4 > ringSlotSize) {
+    err = "The image is larger than the slots of the frame ring";
+    return false;
+  }
+  return true;
+}
+
+} // namespace
+
+RenderJobServer::~RenderJobServer()
+{
+#ifndef _WIN32
+  if (m_client >= 0) {
+    close(m_client);
+  }
+  if (m_socket >= 0) {
+    close(m_socket);
+    unlink(m_socketPath.string().c_str());
+  }
+#endif
+}
+
+bool RenderJobServer::open(const fs::path &socketPath, std::string &err)
+{
+  if (socketPath.empty()) {
+    return true;
+  }
+
+#ifdef _WIN32
+  err = "UNIX sockets are not supported on this platform";
+  return false;
+#else
+  const auto path = socketPath.string();
+  sockaddr_un address = {};
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path)) {
+    err = "Socket path too long: " + path;
+    return false;
+  }
+  std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+  m_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (m_socket < 0) {
+    err = std::string("Unable to create socket: ") + std::strerror(errno);
+    return false;
+  }
+  unlink(path.c_str()); // Left by a previous server
+  if (bind(m_socket, (const sockaddr *)&address, sizeof(address)) < 0 ||
+      listen(m_socket, 8) < 0) {
+    err = "Unable to listen on " + path + ": " + std::strerror(errno);
+    close(m_socket);
+    m_socket = -1;
+    return false;
+  }
+  m_socketPath = socketPath;
+  std::clog << "Listening on " << path << std::endl;
+  return true;
+#endif
+}
+
+bool RenderJobServer::readLine(std::string &line)
+{
+#ifdef _WIN32
+  if (m_socket < 0) {
+    return bool(std::getline(std::cin, line));
+  }
+  return false;
+#else
+  // stdin is read like the connections, for upcomingModels() to see the
+  // requests sent ahead. Clients are served one after the other, a request is
+  // a line.
+  for (;;) {
+    const auto end = m_received.find('\n');
+    if (end != std::string::npos) {
+      line = m_received.substr(0, end);
+      m_received.erase(0, end + 1);
+      return true;
+    }
+
+    if (m_socket < 0 && m_inputEnded) {
+      // The last line may not end with a newline
+      if (m_received.empty()) {
+        return false;
+      }
+      line = std::move(m_received);
+      m_received.clear();
+      return true;
+    }
+
+    if (m_socket >= 0 && m_clientLeft) {
+      // Its remaining requests are dropped
+      closeClient();
+    }
+    if (m_socket >= 0 && m_client < 0) {
+      m_received.clear();
+      const int client = accept(m_socket, nullptr, nullptr);
+      if (client < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        std::cerr << "Unable to accept connection: " << std::strerror(errno)
+                  << std::endl;
+        return false;
+      }
+      std::lock_guard<std::mutex> lock(m_writeMutex);
+      m_client = client;
+      ++m_connection;
+    }
+
+    receive(true);
+  }
+#endif
+}
+
+bool RenderJobServer::receive(bool wait)
+{
+#ifdef _WIN32
+  (void)wait;
+  return false;
+#else
+  const int fd = m_socket < 0 ? (m_inputEnded ? -1 : STDIN_FILENO) : m_client;
+  if (fd < 0) {
+    return false;
+  }
+  if (!wait) {
+    pollfd ready = {fd, POLLIN, 0};
+    if (poll(&ready, 1, 0) <= 0) {
+      return false;
+    }
+  }
+
+  char buffer[4096];
+  const auto count = m_socket < 0 ? read(fd, buffer, sizeof(buffer))
+                                  : recv(fd, buffer, sizeof(buffer), 0);
+  if (count <= 0) {
+    if (count < 0 && errno == EINTR) {
+      return false;
+    }
+    if (m_socket < 0) {
+      m_inputEnded = true;
+    } else {
+      closeClient();
+    }
+    return false;
+  }
+  m_received.append(buffer, size_t(count));
+  return true;
+#endif
+}
+
+void RenderJobServer::closeClient()
+{
+#ifndef _WIN32
+  std::lock_guard<std::mutex> lock(m_writeMutex);
+  close(m_client);
+  m_client = -1;
+  m_clientLeft = false;
+#endif
+}
+
+void RenderJobServer::upcomingModels(std::vector<fs::path> &models)
+{
+  for (const auto &job : m_putBack) {
+    models.push_back(job.model);
+  }
+
+  while (m_received.size() < MAX_READ_AHEAD && receive(false)) {
+  }
+  // Invalid requests are answered once taken
+  size_t begin = 0;
+  for (auto end = m_received.find('\n'); end != std::string::npos;
+       begin = end + 1, end = m_received.find('\n', begin)) {
+    RenderJob job;
+    std::string err;
+    if (parseJob(m_received.substr(begin, end - begin),
+            m_frameRing.slotSize(), job, err)) {
+      models.push_back(job.model);
+    }
+  }
+}
+
+void RenderJobServer::writeLine(const std::string &line, uint64_t connection)
+{
+  std::lock_guard<std::mutex> lock(m_writeMutex);
+  if (m_socket < 0) {
+    std::cout << line << std::endl;
+    return;
+  }
+
+#ifndef _WIN32
+  const auto message = line + "\n";
+  size_t sent = 0;
+  while (m_client >= 0 && !m_clientLeft && connection == m_connection &&
+         sent < message.size()) {
+#ifdef MSG_NOSIGNAL
+    const int flags = MSG_NOSIGNAL; // A closed connection is not fatal
+#else
+    const int flags = 0;
+#endif
+    const auto count =
+        send(m_client, message.data() + sent, message.size() - sent, flags);
+    if (count < 0 && errno == EINTR) {
+      continue;
+    }
+    if (count <= 0) {
+      // The client left, the reader closes the connection, waking up if it
+      // waits for requests
+      shutdown(m_client, SHUT_RDWR);
+      m_clientLeft = true;
+      return;
+    }
+    sent += size_t(count);
+  }
+#endif
+}
+
+bool RenderJobServer::nextJob(RenderJob &job)
+{
+  ++m_takenCount;
+  if (!m_putBack.empty()) {
+    job = m_putBack.front();
+    m_putBack.pop_front();
+    return true;
+  }
+
+  std::string line;
+  while (readLine(line)) {
+    if (line.find_first_not_of(" \t\r") == std::string::npos) {
+      continue;
+    }
+    std::string err;
+    const bool valid = parseJob(line, m_frameRing.slotSize(), job, err);
+    job.connection = m_connection;
+    if (valid) {
+      return true;
+    }
+    reply(job, err, false, 0);
+  }
+  --m_takenCount;
+  return false;
+}
+
+void RenderJobServer::reply(const RenderJob &job, const std::string &error,
+    bool cached, double milliseconds)
+{
+  nlohmann::json response;
+  response["id"] = job.id;
+  if (!job.ring) {
+    response["output"] = job.output.string();
+  }
+  response["status"] = error.empty() ? "ok" : "error";
+  if (!error.empty()) {
+    response["error"] = error;
+  } else {
+    response["cached"] = cached;
+    response["ms"] = milliseconds;
+    if (job.ring) {
+      response["frame"] = job.ringFrame;
+      response["slot"] = job.ringFrame % m_frameRing.slotCount();
+    }
+  }
+  writeLine(response.dump(), job.connection);
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include "cameras.hpp"
+#include "filesystem.hpp"
+#include "frame_ring.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// An image to render, read from a JSON request such as
+// {"id": "42", "model": "a.gltf", "environment": "sky.hdr",
+//  "lookat": [9 numbers], "width": 512, "height": 512, "samples": 4,
+//  "output": "a.png"}
+// Only model and output are required. The camera defaults to the one framing
+// the scene. Jobs of the in-process API, see render_api.h, give pixels instead
+// of output, and requests with "ring": true instead of output are written to
+// the frame ring of the server.
+struct RenderJob
+{
+  std::string id;
+  fs::path model;
+  fs::path environment;
+  bool hasCamera = false;
+  Camera camera;
+  uint32_t width = 512;
+  uint32_t height = 512;
+  int samples = 1;
+  fs::path output;
+  // Caller buffer of width * height RGBA8 pixels, bottom row first, read back
+  // to instead of writing output
+  void *pixels = nullptr;
+  // Written as FRAME_RING_RGBA8 to the frame ring of the source instead of
+  // output, as the frame set by the renderer before replying
+  bool ring = false;
+  uint64_t ringFrame = 0;
+  // Of the server, the connection the request came from
+  uint64_t connection = 0;
+};
+
+// Where the renderers of ViewerApplication take their jobs from and reply to
+class RenderJobSource
+{
+public:
+  virtual ~RenderJobSource() = default;
+
+  // Wait for the next job, jobs put back first. Return false once there are
+  // no more.
+  virtual bool nextJob(RenderJob &job) = 0;
+
+  // Make job the next one returned by nextJob, for the renderer of another
+  // model
+  virtual void putBack(const RenderJob &job) = 0;
+
+  // Jobs returned by nextJob and not put back
+  virtual size_t takenCount() const = 0;
+
+  // Append the models of the jobs already received and not taken, in order,
+  // without waiting for more, for the next renderers to load them ahead
+  virtual void upcomingModels(std::vector<fs::path> &models) { (void)models; }
+
+  // error is empty if the job succeeded
+  virtual void reply(const RenderJob &job, const std::string &error,
+      bool cached, double milliseconds) = 0;
+
+  // Of the jobs with ring set, none if the source gives no such job
+  virtual FrameRing *frameRing() { return nullptr; }
+};
+
+// Render requests of the serve command, one JSON object per line, read from
+// stdin or from the connections to a UNIX socket. Each request gets a JSON
+// line back, on stdout or on its connection:
+// {"id": "42", "output": "a.png", "status": "ok", "cached": true, "ms": 12.5}
+// with "status": "error" and an "error" message if it failed. cached tells
+// whether the model was already loaded. Replies to frame ring requests have
+// the "frame" written and its "slot" instead of an output. Replies may be sent
+// from other threads than the one waiting in nextJob, those to a client that
+// left are dropped.
+class RenderJobServer : public RenderJobSource
+{
+public:
+  RenderJobServer() = default;
+  ~RenderJobServer() override;
+
+  RenderJobServer(const RenderJobServer &) = delete;
+  RenderJobServer &operator=(const RenderJobServer &) = delete;
+
+  // Listen on a UNIX socket at socketPath, or read stdin if it is empty
+  bool open(const fs::path &socketPath, std::string &err);
+
+  // Accept ring requests, written to the shared memory object name in
+  // slotCount slots of maxPixels pixels, see FrameRing
+  bool openFrameRing(const std::string &name, size_t slotCount,
+      size_t maxPixels, std::string &err)
+  {
+    return m_frameRing.open(name, slotCount, maxPixels * 4, err);
+  }
+
+  // Wait for the next valid request, jobs put back first. Invalid requests
+  // are answered with an error. Return false at the end of stdin.
+  bool nextJob(RenderJob &job) override;
+
+  void putBack(const RenderJob &job) override
+  {
+    m_putBack.push_front(job);
+    --m_takenCount;
+  }
+
+  size_t takenCount() const override { return m_takenCount; }
+
+  // Read what was sent so far, up to MAX_READ_AHEAD bytes
+  void upcomingModels(std::vector<fs::path> &models) override;
+
+  void reply(const RenderJob &job, const std::string &error, bool cached,
+      double milliseconds) override;
+
+  FrameRing *frameRing() override
+  {
+    return m_frameRing.isOpen() ? &m_frameRing : nullptr;
+  }
+
+private:
+  static const size_t MAX_READ_AHEAD = 1 << 20;
+
+  bool readLine(std::string &line);
+  // Append bytes of stdin or of the client to m_received, false if none were
+  // read. Without wait, only those already sent.
+  bool receive(bool wait);
+  void writeLine(const std::string &line, uint64_t connection);
+  void closeClient();
+
+  std::deque<RenderJob> m_putBack;
+  size_t m_takenCount = 0;
+  fs::path m_socketPath;
+  int m_socket = -1; // Listening socket
+  int m_client = -1; // Connection requests are read from
+  uint64_t m_connection = 0; // Number of m_client, counting from 1
+  // Of the output and of m_client, written by the reader only
+  std::mutex m_writeMutex;
+  // A reply could not be sent, the reader closes m_client
+  std::atomic<bool> m_clientLeft{false};
+  std::string m_received; // Bytes received after the last full line
+  bool m_inputEnded = false; // At the end of stdin
+  FrameRing m_frameRing;
+};
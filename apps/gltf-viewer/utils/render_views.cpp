@@ -0,0 +1,264 @@
+#include "render_views.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include <json.hpp>
+
+namespace
+{
+
+bool makeCamera(const std::vector<float> &lookat, Camera &camera)
+{
+  const glm::vec3 eye(lookat[0], lookat[1], lookat[2]);
+  const glm::vec3 center(lookat[3], lookat[4], lookat[5]);
+  const glm::vec3 up(lookat[6], lookat[7], lookat[8]);
+  if (eye == center || glm::cross(up, center - eye) == glm::vec3(0)) {
+    return false;
+  }
+  camera = Camera{eye, center, up};
+  return true;
+}
+
+fs::path indexedOutput(const fs::path &output, size_t index)
+{
+  char suffix[32];
+  std::snprintf(suffix, sizeof(suffix), "_%04zu", index);
+  return output.parent_path() /
+         (output.stem().string() + suffix + output.extension().string());
+}
+
+bool parseJsonViews(const std::string &text, std::vector<RenderView> &views,
+    std::vector<bool> &hasOutput, std::string &err)
+{
+  nlohmann::json document;
+  try {
+    document = nlohmann::json::parse(text);
+  } catch (const std::exception &e) {
+    err = std::string("Unable to parse views JSON: ") + e.what();
+    return false;
+  }
+
+  for (size_t i = 0; i < document.size(); ++i) {
+    const auto &entry = document[i];
+    const auto prefix = "View " + std::to_string(i) + ": ";
+    if (!entry.is_object() || !entry.count("lookat") ||
+        !entry["lookat"].is_array() || entry["lookat"].size() != 9) {
+      err = prefix + "expected an object with a lookat array of 9 numbers";
+      return false;
+    }
+
+    std::vector<float> lookat;
+    for (const auto &value : entry["lookat"]) {
+      if (!value.is_number()) {
+        err = prefix + "lookat values must be numbers";
+        return false;
+      }
+      lookat.push_back(value.get<float>());
+    }
+
+    RenderView view;
+    if (!makeCamera(lookat, view.camera)) {
+      err = prefix + "degenerate lookat";
+      return false;
+    }
+    const auto output = entry.value("output", std::string());
+    view.output = output;
+    if (entry.count("time")) {
+      if (!entry["time"].is_number() || entry["time"].get<float>() < 0) {
+        err = prefix + "time must be a number of seconds";
+        return false;
+      }
+      view.time = entry["time"].get<float>();
+    }
+    views.push_back(view);
+    hasOutput.push_back(!output.empty());
+  }
+  return true;
+}
+
+bool parseTextViews(const std::string &text, std::vector<RenderView> &views,
+    std::vector<bool> &hasOutput, std::string &err)
+{
+  std::istringstream lines(text);
+  std::string line;
+  for (size_t lineNumber = 1; std::getline(lines, line); ++lineNumber) {
+    const auto first = line.find_first_not_of(" \t\r");
+    if (first == std::string::npos || line[first] == '#') {
+      continue;
+    }
+    const auto prefix = "Line " + std::to_string(lineNumber) + ": ";
+
+    // Commas separate numbers like spaces, the output path ends the line
+    std::vector<float> lookat;
+    size_t position = 0;
+    for (int i = 0; i < 9; ++i) {
+      position = line.find_first_not_of(", \t", position);
+      size_t length = 0;
+      try {
+        lookat.push_back(std::stof(line.substr(position), &length));
+      } catch (const std::exception &) {
+        err = prefix + "expected 9 numbers";
+        return false;
+      }
+      position += length;
+    }
+
+    RenderView view;
+    if (!makeCamera(lookat, view.camera)) {
+      err = prefix + "degenerate lookat";
+      return false;
+    }
+
+    const auto outputBegin = line.find_first_not_of(", \t", position);
+    std::string output;
+    if (outputBegin != std::string::npos) {
+      output = line.substr(outputBegin, line.find_last_not_of(" \t\r") + 1 -
+                                            outputBegin);
+    }
+    view.output = output;
+    views.push_back(view);
+    hasOutput.push_back(!output.empty());
+  }
+  return true;
+}
+
+glm::vec3 catmullRom(const glm::vec3 &p0, const glm::vec3 &p1,
+    const glm::vec3 &p2, const glm::vec3 &p3, float t)
+{
+  return 0.5f * (2.f * p1 + (p2 - p0) * t +
+                    (2.f * p0 - 5.f * p1 + 4.f * p2 - p3) * t * t +
+                    (3.f * p1 - p0 - 3.f * p2 + p3) * t * t * t);
+}
+
+} // namespace
+
+bool loadRenderViews(const fs::path &path, const fs::path &defaultOutput,
+    std::vector<RenderView> &views, std::string &err)
+{
+  std::ifstream file(path.string(), std::ios::binary);
+  if (!file) {
+    err = "Unable to open views file " + path.string();
+    return false;
+  }
+  const std::string text(
+      (std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+  views.clear();
+  std::vector<bool> hasOutput;
+  const auto first = text.find_first_not_of(" \t\r\n");
+  const bool parsed = first != std::string::npos && text[first] == '['
+                          ? parseJsonViews(text, views, hasOutput, err)
+                          : parseTextViews(text, views, hasOutput, err);
+  if (!parsed) {
+    return false;
+  }
+  if (views.empty()) {
+    err = "No view in " + path.string();
+    return false;
+  }
+
+  for (size_t i = 1; i < views.size(); ++i) {
+    if ((views[i].time < 0) != (views[0].time < 0)) {
+      err = "View " + std::to_string(i) + ": either every view or none has "
+            "a time";
+      return false;
+    }
+    if (views[i].time < views[i - 1].time) {
+      err = "View " + std::to_string(i) + ": times must not decrease";
+      return false;
+    }
+  }
+
+  for (size_t i = 0; i < views.size(); ++i) {
+    if (hasOutput[i]) {
+      continue;
+    }
+    if (defaultOutput.empty()) {
+      err = "View " + std::to_string(i) + " has no output path and -o is "
+            "not specified";
+      return false;
+    }
+    views[i].output = indexedOutput(defaultOutput, i);
+  }
+  return true;
+}
+
+bool saveRenderViews(const fs::path &path, const std::vector<RenderView> &views,
+    std::string &err)
+{
+  std::ofstream file(path.string());
+  file << "[\n";
+  for (size_t i = 0; i < views.size(); ++i) {
+    const auto &camera = views[i].camera;
+    nlohmann::json entry;
+    if (views[i].time >= 0) {
+      entry["time"] = views[i].time;
+    }
+    entry["lookat"] = {camera.eye().x, camera.eye().y, camera.eye().z,
+        camera.center().x, camera.center().y, camera.center().z,
+        camera.up().x, camera.up().y, camera.up().z};
+    if (!views[i].output.empty()) {
+      entry["output"] = views[i].output.string();
+    }
+    file << "  " << entry.dump() << (i + 1 < views.size() ? ",\n" : "\n");
+  }
+  file << "]\n";
+  if (!file) {
+    err = "Unable to write views file " + path.string();
+    return false;
+  }
+  return true;
+}
+
+Camera cameraPathAt(const std::vector<RenderView> &keyframes, float t)
+{
+  if (keyframes.size() == 1) {
+    return keyframes[0].camera;
+  }
+  t = std::min(std::max(t, 0.f), 1.f);
+  const auto segments = keyframes.size() - 1;
+  size_t segment = 0;
+  float u = 0;
+  if (keyframes[0].time >= 0) {
+    // Recorded paths keep their timing, keyframes are not evenly spaced
+    const auto time =
+        glm::mix(keyframes.front().time, keyframes.back().time, t);
+    const auto next = std::upper_bound(keyframes.begin() + 1,
+        keyframes.end() - 1, time,
+        [](float time, const RenderView &view) { return time < view.time; });
+    segment = size_t(next - keyframes.begin()) - 1;
+    const auto length = keyframes[segment + 1].time - keyframes[segment].time;
+    u = length > 0 ? std::min((time - keyframes[segment].time) / length, 1.f)
+                   : 0.f;
+  } else {
+    const auto position = t * float(segments);
+    segment = std::min(size_t(position), segments - 1);
+    u = position - float(segment);
+  }
+
+  // The ends repeat their keyframe
+  const auto &c0 = keyframes[segment > 0 ? segment - 1 : 0].camera;
+  const auto &c1 = keyframes[segment].camera;
+  const auto &c2 = keyframes[segment + 1].camera;
+  const auto &c3 = keyframes[std::min(segment + 2, segments)].camera;
+
+  const auto eye = catmullRom(c0.eye(), c1.eye(), c2.eye(), c3.eye(), u);
+  const auto center =
+      catmullRom(c0.center(), c1.center(), c2.center(), c3.center(), u);
+  const auto up = glm::mix(c1.up(), c2.up(), u);
+  if (glm::cross(up, center - eye) == glm::vec3(0)) {
+    return u < 0.5f ? c1 : c2; // Degenerate in between keyframes
+  }
+  return Camera{eye, center, up};
+}
+
+float cameraPathDuration(const std::vector<RenderView> &keyframes)
+{
+  if (keyframes.empty() || keyframes[0].time < 0) {
+    return 0;
+  }
+  return keyframes.back().time - keyframes.front().time;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "cameras.hpp"
+#include "filesystem.hpp"
+
+#include <string>
+#include <vector>
+
+// A camera to render an image from, and the path of the image
+struct RenderView
+{
+  Camera camera;
+  fs::path output;
+  float time = -1; // Seconds into a recorded camera path, -1 if untimed
+};
+
+// Read the views of a --views file, either a JSON list of objects with a
+// "lookat" array of 9 numbers (see --lookat), an optional "output" path and
+// an optional "time" in seconds, or one view per line: 9 numbers separated by
+// commas or spaces, optionally followed by an output path. Empty lines and
+// lines starting with # are skipped. Views without an output get
+// defaultOutput with the view index appended to its stem, image_0007.png for
+// the 8th view of image.png. Either every view or none has a time, in
+// increasing order.
+bool loadRenderViews(const fs::path &path, const fs::path &defaultOutput,
+    std::vector<RenderView> &views, std::string &err);
+
+// Write views as a JSON --views file, one view per line
+bool saveRenderViews(const fs::path &path, const std::vector<RenderView> &views,
+    std::string &err);
+
+// Raw video of frames rendered along a camera path, see RawVideoWriter
+struct VideoOutput
+{
+  fs::path path; // "-" is stdout, no video if empty
+  float fps = 30;
+  // Seconds to interpolate the path over, 0 renders one frame per keyframe
+  float duration = 0;
+};
+
+// Camera at time t in [0, 1] of a path through the cameras of keyframes,
+// evenly spaced in time unless they have times, then t is the fraction of the
+// time from the first keyframe to the last. Eyes and centers follow
+// Catmull-Rom splines, which pass through every keyframe with a continuous
+// velocity.
+Camera cameraPathAt(const std::vector<RenderView> &keyframes, float t);
+
+// Seconds from the first to the last of timed keyframes, 0 if untimed
+float cameraPathDuration(const std::vector<RenderView> &keyframes);
@@ -0,0 +1,124 @@
+#include "rgbe.hpp"
+
+#include "mapped_file.hpp"
+#include "trace.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+
+// Line of the header at offset, without its newline, offset moved past it
+bool readLine(const MappedFile &file, size_t &offset, std::string &line)
+{
+  const auto *begin = file.data() + offset;
+  const auto *end = static_cast<const unsigned char *>(
+      std::memchr(begin, '\n', file.size() - offset));
+  if (!end) {
+    return false;
+  }
+  line.assign(begin, end);
+  offset += size_t(end - begin) + 1;
+  return true;
+}
+
+// Scanlines of new-style run-length encoding: a 2, 2, width marker, then each
+// component on its own as runs (count above 128) and literals
+bool decodeRleScanline(const unsigned char *&data, const unsigned char *end,
+    int width, unsigned char *pixels)
+{
+  data += 4;
+  for (int component = 0; component < 4; ++component) {
+    for (int x = 0; x < width;) {
+      if (data == end) {
+        return false;
+      }
+      int count = *data++;
+      const bool run = count > 128;
+      if (run) {
+        count -= 128;
+      }
+      if (count == 0 || count > width - x ||
+          (run ? 1 : count) > end - data) {
+        return false;
+      }
+      for (int i = 0; i < count; ++i, ++x) {
+        pixels[size_t(x) * 4 + component] = run ? *data : data[i];
+      }
+      data += run ? 1 : count;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+bool loadRgbeImage(const fs::path &path, RgbeImage &image, std::string &err)
+{
+  TRACE_ZONE("loadRgbeImage");
+  const MappedFile file(path);
+  if (!file.isOpen()) {
+    err = "Unable to read " + path.string();
+    return false;
+  }
+
+  size_t offset = 0;
+  std::string line;
+  if (!readLine(file, offset, line) ||
+      (line != "#?RADIANCE" && line != "#?RGBE")) {
+    err = path.string() + " is not a Radiance file";
+    return false;
+  }
+  // Variables until an empty line, only the pixel format matters here
+  while (readLine(file, offset, line) && !line.empty()) {
+    if (line.compare(0, 7, "FORMAT=") == 0 &&
+        line != "FORMAT=32-bit_rle_rgbe") {
+      err = "Unsupported Radiance " + line;
+      return false;
+    }
+  }
+
+  int width = 0;
+  int height = 0;
+  char tail;
+  if (!readLine(file, offset, line) ||
+      std::sscanf(line.c_str(), "-Y %d +X %d%c", &height, &width, &tail) !=
+          2 ||
+      width <= 0 || height <= 0) {
+    err = "Unsupported Radiance resolution " + line;
+    return false;
+  }
+
+  std::vector<unsigned char> pixels(size_t(width) * height * 4);
+  const auto *data = file.data() + offset;
+  const auto *end = file.data() + file.size();
+  const auto rowSize = size_t(width) * 4;
+  for (int y = 0; y < height; ++y) {
+    auto *row = pixels.data() + rowSize * y;
+    // Encoded scanlines start with a marker, narrow and wide images and
+    // files without one are flat
+    const bool rle = width >= 8 && width < 0x8000 && end - data >= 4 &&
+                     data[0] == 2 && data[1] == 2 && !(data[2] & 0x80) &&
+                     (data[2] << 8 | data[3]) == width;
+    if (rle) {
+      if (!decodeRleScanline(data, end, width, row)) {
+        err = "Corrupt Radiance scanline " + std::to_string(y);
+        return false;
+      }
+      continue;
+    }
+    // Flat for the rest of the image
+    if (size_t(end - data) < rowSize * (height - y)) {
+      err = "Truncated Radiance file " + path.string();
+      return false;
+    }
+    std::memcpy(row, data, rowSize * (height - y));
+    break;
+  }
+
+  image.width = width;
+  image.height = height;
+  image.pixels = std::move(pixels);
+  return true;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "filesystem.hpp"
+
+#include <string>
+#include <vector>
+
+// Pixels of a Radiance (.hdr) file as stored: red, green and blue mantissas
+// sharing the exponent in the fourth byte, decoded by the shaders reading them.
+// Rows are top first, in the order of the file.
+struct RgbeImage
+{
+  int width = 0;
+  int height = 0;
+  std::vector<unsigned char> pixels; // 4 bytes per pixel
+};
+
+// Read a 32-bit_rle_rgbe Radiance file with the usual -Y height +X width
+// orientation, run-length encoded or flat, without converting its pixels to
+// floats. Return false with err set otherwise.
+bool loadRgbeImage(const fs::path &path, RgbeImage &image, std::string &err);
@@ -0,0 +1,67 @@
+#include "ring_buffer.hpp"
+
+#include "gl_capture.hpp"
+
+PersistentRingBuffer::~PersistentRingBuffer()
+{
+  for (auto fence : m_fences) {
+    if (fence) {
+      glDeleteSync(fence);
+    }
+  }
+  if (m_buffer) {
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+    glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    untrackBuffers(1, &m_buffer);
+    glDeleteBuffers(1, &m_buffer);
+  }
+}
+
+void PersistentRingBuffer::init(size_t regionSize, size_t alignment,
+    size_t regionCount, GpuMemoryCategory category)
+{
+  m_regionSize = (regionSize + alignment - 1) / alignment * alignment;
+  m_fences.assign(regionCount, nullptr);
+  m_current = regionCount - 1; // So that the first region used is 0
+
+  const auto flags =
+      GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+  const auto size = GLsizeiptr(m_regionSize * regionCount);
+
+  glGenBuffers(1, &m_buffer);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+  glBufferStorage(GL_COPY_WRITE_BUFFER, size, nullptr, flags);
+  m_data = static_cast<unsigned char *>(
+      glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags));
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  trackBuffer(category, m_buffer, size_t(size));
+}
+
+void *PersistentRingBuffer::beginRegion()
+{
+  m_current = (m_current + 1) % m_fences.size();
+
+  auto &fence = m_fences[m_current];
+  if (fence) {
+    // Usually already signaled, the region was used regionCount frames ago
+    while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) ==
+           GL_TIMEOUT_EXPIRED) {
+    }
+    glDeleteSync(fence);
+    fence = nullptr;
+  }
+
+  auto *region = m_data + m_current * m_regionSize;
+  // The whole region, what was written of it is not known
+  m_capturedWrite = beginCapturedWrite(
+      m_buffer, m_current * m_regionSize, m_regionSize, region);
+  return region;
+}
+
+void PersistentRingBuffer::endRegion()
+{
+  endCapturedWrite(m_capturedWrite);
+  m_capturedWrite = 0;
+  m_fences[m_current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
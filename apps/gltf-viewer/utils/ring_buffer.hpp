@@ -0,0 +1,47 @@
+#pragma once
+
+#include "gpu_memory.hpp"
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <vector>
+
+// A buffer persistently mapped for writing, split in regions used in turn by
+// consecutive frames. A region is only written again once the GPU is done with
+// the commands of the frame that last used it.
+class PersistentRingBuffer
+{
+public:
+  PersistentRingBuffer() = default;
+  ~PersistentRingBuffer();
+
+  PersistentRingBuffer(const PersistentRingBuffer &) = delete;
+  PersistentRingBuffer &operator=(const PersistentRingBuffer &) = delete;
+
+  // Allocate regionCount regions of at least regionSize bytes, each starting
+  // at a multiple of alignment, accounted in category
+  void init(size_t regionSize, size_t alignment, size_t regionCount = 3,
+      GpuMemoryCategory category = GpuMemoryCategory::ShaderBuffers);
+
+  bool empty() const { return m_buffer == 0; }
+
+  // Wait until the next region is free and return a pointer to it
+  void *beginRegion();
+  // Fence the commands that read the current region, call after submitting
+  // them
+  void endRegion();
+
+  GLuint buffer() const { return m_buffer; }
+  // Offset in the buffer of the current region
+  GLintptr regionOffset() const { return GLintptr(m_current * m_regionSize); }
+  size_t regionSize() const { return m_regionSize; }
+
+private:
+  GLuint m_buffer = 0;
+  unsigned char *m_data = nullptr;
+  size_t m_regionSize = 0;
+  size_t m_current = 0;
+  std::vector<GLsync> m_fences;
+  size_t m_capturedWrite = 0; // Of the current region, see gl_capture.hpp
+};
@@ -0,0 +1,210 @@
+#include "runtime_model.hpp"
+
+#include "gltf.hpp"
+#include "trace.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <new>
+
+namespace
+{
+
+const char *const ATTRIBUTE_SEMANTIC_NAMES[ATTRIBUTE_SEMANTIC_COUNT] = {
+    "POSITION", "NORMAL", "TANGENT", "TEXCOORD_0", "TEXCOORD_1", "COLOR_0",
+    "JOINTS_0", "WEIGHTS_0"};
+
+// Offsets of the arrays of a block, rounded up to the alignment of each
+class BlockLayout
+{
+public:
+  template <typename T> size_t add(size_t count)
+  {
+    m_size = (m_size + alignof(T) - 1) & ~(alignof(T) - 1);
+    const auto offset = m_size;
+    m_size += count * sizeof(T);
+    return offset;
+  }
+
+  size_t size() const { return m_size; }
+
+private:
+  size_t m_size = 0;
+};
+
+template <typename T> T *carve(unsigned char *block, size_t offset)
+{
+  return reinterpret_cast<T *>(block + offset);
+}
+
+void readAttributes(
+    const std::map<std::string, int> &attributes, int32_t *accessors)
+{
+  std::fill(accessors, accessors + ATTRIBUTE_SEMANTIC_COUNT, -1);
+  for (const auto &attribute : attributes) {
+    const auto semantic = parseAttributeSemantic(attribute.first);
+    if (semantic != ATTRIBUTE_SEMANTIC_COUNT) {
+      accessors[semantic] = int32_t(attribute.second);
+    }
+  }
+}
+
+RuntimeMaterial runtimeMaterial(const tinygltf::Material &material)
+{
+  RuntimeMaterial result;
+  const auto &pbrMetallicRoughness = material.pbrMetallicRoughness;
+  result.textures[MATERIAL_TEXTURE_BASE_COLOR] =
+      pbrMetallicRoughness.baseColorTexture.index;
+  result.textures[MATERIAL_TEXTURE_METALLIC_ROUGHNESS] =
+      pbrMetallicRoughness.metallicRoughnessTexture.index;
+  result.textures[MATERIAL_TEXTURE_EMISSIVE] = material.emissiveTexture.index;
+  result.textures[MATERIAL_TEXTURE_OCCLUSION] =
+      material.occlusionTexture.index;
+  result.textures[MATERIAL_TEXTURE_NORMAL] = material.normalTexture.index;
+  result.alphaMode = material.alphaMode == "MASK"
+                         ? AlphaMode::Mask
+                         : material.alphaMode == "BLEND" ? AlphaMode::Blend
+                                                         : AlphaMode::Opaque;
+  result.alphaCutoff = float(material.alphaCutoff);
+  result.doubleSided = material.doubleSided;
+  return result;
+}
+
+} // namespace
+
+AttributeSemantic parseAttributeSemantic(const std::string &name)
+{
+  for (int i = 0; i < ATTRIBUTE_SEMANTIC_COUNT; ++i) {
+    if (name == ATTRIBUTE_SEMANTIC_NAMES[i]) {
+      return AttributeSemantic(i);
+    }
+  }
+  return ATTRIBUTE_SEMANTIC_COUNT;
+}
+
+void RuntimeModel::build(const tinygltf::Model &model)
+{
+  TRACE_ZONE("buildRuntimeModel");
+  size_t primitiveCount = 0;
+  size_t targetCount = 0;
+  size_t childCount = 0;
+  size_t weightCount = 0;
+  for (const auto &mesh : model.meshes) {
+    primitiveCount += mesh.primitives.size();
+    for (const auto &primitive : mesh.primitives) {
+      targetCount += primitive.targets.size();
+    }
+    weightCount += mesh.weights.size();
+  }
+  for (const auto &node : model.nodes) {
+    childCount += node.children.size();
+    weightCount += node.weights.size();
+  }
+  const auto rootCount = model.defaultScene >= 0
+                             ? model.scenes[model.defaultScene].nodes.size()
+                             : 0;
+
+  BlockLayout layout;
+  const auto meshesOffset = layout.add<RuntimeMesh>(model.meshes.size());
+  const auto nodesOffset = layout.add<RuntimeNode>(model.nodes.size());
+  const auto materialsOffset =
+      layout.add<RuntimeMaterial>(model.materials.size());
+  const auto primitivesOffset = layout.add<RuntimePrimitive>(primitiveCount);
+  const auto targetsOffset = layout.add<RuntimeMorphTarget>(targetCount);
+  const auto indicesOffset = layout.add<int32_t>(childCount + rootCount);
+  const auto weightsOffset = layout.add<float>(weightCount);
+
+  m_byteSize = layout.size();
+  m_storage.reset(new unsigned char[std::max<size_t>(m_byteSize, 1)]);
+  // Cursors in the arrays, filled in order
+  auto *meshes = carve<RuntimeMesh>(m_storage.get(), meshesOffset);
+  auto *nodes = carve<RuntimeNode>(m_storage.get(), nodesOffset);
+  auto *materials = carve<RuntimeMaterial>(m_storage.get(), materialsOffset);
+  auto *primitives =
+      carve<RuntimePrimitive>(m_storage.get(), primitivesOffset);
+  auto *targets = carve<RuntimeMorphTarget>(m_storage.get(), targetsOffset);
+  auto *indices = carve<int32_t>(m_storage.get(), indicesOffset);
+  auto *weights = carve<float>(m_storage.get(), weightsOffset);
+
+  const auto copyWeights = [&](const std::vector<double> &values) {
+    RuntimeRange<float> range{weights, uint32_t(values.size())};
+    for (const auto value : values) {
+      *weights++ = float(value);
+    }
+    return range;
+  };
+
+  m_meshes = {meshes, uint32_t(model.meshes.size())};
+  for (const auto &mesh : model.meshes) {
+    auto &runtimeMesh = *new (meshes++) RuntimeMesh();
+    runtimeMesh.primitives = {primitives, uint32_t(mesh.primitives.size())};
+    runtimeMesh.weights = copyWeights(mesh.weights);
+    for (const auto &primitive : mesh.primitives) {
+      auto &runtimePrimitive = *new (primitives++) RuntimePrimitive();
+      readAttributes(primitive.attributes, runtimePrimitive.attributes);
+      runtimePrimitive.indices = int32_t(primitive.indices);
+      runtimePrimitive.material = int32_t(primitive.material);
+      runtimePrimitive.mode = uint32_t(primitive.mode);
+      runtimePrimitive.bounds = getPrimitiveBounds(model, primitive);
+      runtimePrimitive.targets = {targets, uint32_t(primitive.targets.size())};
+      for (const auto &target : primitive.targets) {
+        auto &runtimeTarget = *new (targets++) RuntimeMorphTarget();
+        readAttributes(target, runtimeTarget.attributes);
+      }
+    }
+  }
+
+  m_nodes = {nodes, uint32_t(model.nodes.size())};
+  for (const auto &node : model.nodes) {
+    auto &runtimeNode = *new (nodes++) RuntimeNode();
+    runtimeNode.matrix = getLocalToWorldMatrix(node, glm::mat4(1));
+    runtimeNode.hasMatrix = !node.matrix.empty();
+    runtimeNode.translation = glm::vec3(0.f);
+    runtimeNode.rotation = glm::quat(1.f, 0.f, 0.f, 0.f);
+    runtimeNode.scale = glm::vec3(1.f);
+    if (!runtimeNode.hasMatrix) {
+      if (!node.translation.empty()) {
+        runtimeNode.translation = glm::vec3(
+            node.translation[0], node.translation[1], node.translation[2]);
+      }
+      if (!node.rotation.empty()) {
+        runtimeNode.rotation = glm::quat(float(node.rotation[3]),
+            float(node.rotation[0]), float(node.rotation[1]),
+            float(node.rotation[2]));
+      }
+      if (!node.scale.empty()) {
+        runtimeNode.scale =
+            glm::vec3(node.scale[0], node.scale[1], node.scale[2]);
+      }
+    }
+    runtimeNode.mesh = int32_t(node.mesh);
+    runtimeNode.skin = int32_t(node.skin);
+    runtimeNode.children = {indices, uint32_t(node.children.size())};
+    for (const auto child : node.children) {
+      *indices++ = int32_t(child);
+    }
+    runtimeNode.weights = copyWeights(node.weights);
+  }
+
+  m_materials = {materials, uint32_t(model.materials.size())};
+  for (const auto &material : model.materials) {
+    new (materials++) RuntimeMaterial(runtimeMaterial(material));
+  }
+
+  m_sceneRoots = {indices, uint32_t(rootCount)};
+  if (model.defaultScene >= 0) {
+    for (const auto root : model.scenes[model.defaultScene].nodes) {
+      *indices++ = int32_t(root);
+    }
+  }
+}
+
+void RuntimeModel::updateMaterials(const tinygltf::Model &model)
+{
+  // The storage is owned, only the ranges read it as const
+  auto *materials = const_cast<RuntimeMaterial *>(m_materials.first);
+  for (size_t i = 0; i < m_materials.count; ++i) {
+    materials[i] = runtimeMaterial(model.materials[i]);
+  }
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "frustum.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <tiny_gltf.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Attribute semantics read by the viewer, interned from the attribute names
+// of glTF primitives and morph targets
+enum AttributeSemantic
+{
+  ATTRIBUTE_POSITION,
+  ATTRIBUTE_NORMAL,
+  ATTRIBUTE_TANGENT,
+  ATTRIBUTE_TEXCOORD_0,
+  ATTRIBUTE_TEXCOORD_1,
+  ATTRIBUTE_COLOR_0,
+  ATTRIBUTE_JOINTS_0,
+  ATTRIBUTE_WEIGHTS_0,
+  ATTRIBUTE_SEMANTIC_COUNT
+};
+
+// ATTRIBUTE_SEMANTIC_COUNT for the other names
+AttributeSemantic parseAttributeSemantic(const std::string &name);
+
+enum class AlphaMode : uint8_t
+{
+  Opaque,
+  Mask,
+  Blend
+};
+
+// Texture slots of a material, in the order of the units of the PBR programs
+enum MaterialTextureSlot
+{
+  MATERIAL_TEXTURE_BASE_COLOR,
+  MATERIAL_TEXTURE_METALLIC_ROUGHNESS,
+  MATERIAL_TEXTURE_EMISSIVE,
+  MATERIAL_TEXTURE_OCCLUSION,
+  MATERIAL_TEXTURE_NORMAL,
+  MATERIAL_TEXTURE_SLOT_COUNT
+};
+
+// Range of one of the flat arrays of a RuntimeModel
+template <typename T> struct RuntimeRange
+{
+  const T *first = nullptr;
+  uint32_t count = 0;
+
+  const T *begin() const { return first; }
+  const T *end() const { return first + count; }
+  bool empty() const { return count == 0; }
+  const T &operator[](size_t i) const { return first[i]; }
+};
+
+// Accessor indices of the attributes of a morph target, -1 if absent
+struct RuntimeMorphTarget
+{
+  int32_t attributes[ATTRIBUTE_SEMANTIC_COUNT];
+};
+
+struct RuntimePrimitive
+{
+  int32_t attributes[ATTRIBUTE_SEMANTIC_COUNT]; // Accessor indices, -1 if absent
+  int32_t indices; // -1 if not indexed
+  int32_t material; // -1 for the default material
+  uint32_t mode;
+  // In node space, grown by the morph targets for weights in [0, 1]. Empty if
+  // the POSITION accessor has no min/max.
+  Aabb bounds;
+  RuntimeRange<RuntimeMorphTarget> targets;
+};
+
+struct RuntimeMesh
+{
+  RuntimeRange<RuntimePrimitive> primitives;
+  RuntimeRange<float> weights; // Default morph target weights
+};
+
+struct RuntimeNode
+{
+  // The authored matrix, or the product of the authored TRS
+  glm::mat4 matrix;
+  // Identity components if the node has a matrix, see hasMatrix
+  glm::vec3 translation;
+  glm::quat rotation;
+  glm::vec3 scale;
+  bool hasMatrix;
+  int32_t mesh; // -1 if none
+  int32_t skin; // -1 if none
+  RuntimeRange<int32_t> children;
+  RuntimeRange<float> weights; // Empty to use the ones of the mesh
+};
+
+struct RuntimeMaterial
+{
+  int32_t textures[MATERIAL_TEXTURE_SLOT_COUNT]; // Of model.textures, -1 if none
+  AlphaMode alphaMode;
+  float alphaCutoff;
+  bool doubleSided;
+};
+
+// Compact copy of the parts of a tinygltf::Model read on every frame and by
+// the loading passes over the whole scene: attribute names are interned,
+// transforms and weights are floats, and every array lives in one block
+// allocated by build(). Accessors, buffer views and extensions are still read
+// from the tinygltf::Model, which the indices refer to.
+class RuntimeModel
+{
+public:
+  RuntimeModel() = default;
+  RuntimeModel(const RuntimeModel &) = delete;
+  RuntimeModel &operator=(const RuntimeModel &) = delete;
+
+  // Replace the content with a copy of model
+  void build(const tinygltf::Model &model);
+  // Copy the materials of model again, it has as many as when built
+  void updateMaterials(const tinygltf::Model &model);
+
+  RuntimeRange<RuntimeMesh> meshes() const { return m_meshes; }
+  RuntimeRange<RuntimeNode> nodes() const { return m_nodes; }
+  RuntimeRange<RuntimeMaterial> materials() const { return m_materials; }
+  // Root nodes of the default scene, empty without one
+  RuntimeRange<int32_t> sceneRoots() const { return m_sceneRoots; }
+
+  const RuntimePrimitive &primitive(size_t mesh, size_t primitive) const
+  {
+    return m_meshes[mesh].primitives[primitive];
+  }
+
+  // Size of the block holding the arrays
+  size_t byteSize() const { return m_byteSize; }
+
+private:
+  std::unique_ptr<unsigned char[]> m_storage;
+  size_t m_byteSize = 0;
+  RuntimeRange<RuntimeMesh> m_meshes;
+  RuntimeRange<RuntimeNode> m_nodes;
+  RuntimeRange<RuntimeMaterial> m_materials;
+  RuntimeRange<int32_t> m_sceneRoots;
+};
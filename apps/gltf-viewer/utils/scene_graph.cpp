@@ -0,0 +1,229 @@
+#include "scene_graph.hpp"
+
+#include "trace.hpp"
+
+#include <glm/gtx/matrix_decompose.hpp>
+
+#if defined(__SSE__) || defined(_M_X64) ||                                     \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define SCENE_GRAPH_SSE
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SCENE_GRAPH_NEON
+#endif
+
+namespace
+{
+
+// Same as glm::translate(glm::mat4_cast(r), t) then glm::scale(s), without the
+// intermediate matrix products
+glm::mat4 composeTransform(
+    const glm::vec3 &t, const glm::quat &r, const glm::vec3 &s)
+{
+  const auto rotation = glm::mat3_cast(r);
+  return glm::mat4(glm::vec4(rotation[0] * s.x, 0.f),
+      glm::vec4(rotation[1] * s.y, 0.f), glm::vec4(rotation[2] * s.z, 0.f),
+      glm::vec4(t, 1.f));
+}
+
+// parent * local, where the last row of local is (0, 0, 0, 1). Each column of
+// the result is a combination of the columns of parent, computed 4 floats at
+// a time.
+void multiplyAffine(
+    const glm::mat4 &parent, const glm::mat4 &local, glm::mat4 &result)
+{
+  const float *a = &parent[0][0];
+  const float *b = &local[0][0];
+  float *r = &result[0][0];
+
+#if defined(SCENE_GRAPH_SSE)
+  const __m128 a0 = _mm_loadu_ps(a);
+  const __m128 a1 = _mm_loadu_ps(a + 4);
+  const __m128 a2 = _mm_loadu_ps(a + 8);
+  const __m128 a3 = _mm_loadu_ps(a + 12);
+  for (int j = 0; j < 4; ++j) {
+    const float *column = b + 4 * j;
+    __m128 sum = _mm_add_ps(_mm_mul_ps(a0, _mm_set1_ps(column[0])),
+        _mm_add_ps(_mm_mul_ps(a1, _mm_set1_ps(column[1])),
+            _mm_mul_ps(a2, _mm_set1_ps(column[2]))));
+    if (j == 3) {
+      sum = _mm_add_ps(sum, a3);
+    }
+    _mm_storeu_ps(r + 4 * j, sum);
+  }
+#elif defined(SCENE_GRAPH_NEON)
+  const float32x4_t a0 = vld1q_f32(a);
+  const float32x4_t a1 = vld1q_f32(a + 4);
+  const float32x4_t a2 = vld1q_f32(a + 8);
+  const float32x4_t a3 = vld1q_f32(a + 12);
+  for (int j = 0; j < 4; ++j) {
+    const float *column = b + 4 * j;
+    float32x4_t sum = vmulq_n_f32(a0, column[0]);
+    sum = vmlaq_n_f32(sum, a1, column[1]);
+    sum = vmlaq_n_f32(sum, a2, column[2]);
+    if (j == 3) {
+      sum = vaddq_f32(sum, a3);
+    }
+    vst1q_f32(r + 4 * j, sum);
+  }
+#else
+  result = parent * local;
+  (void)a;
+  (void)b;
+  (void)r;
+#endif
+}
+
+} // namespace
+
+void SceneGraph::build(const RuntimeModel &model)
+{
+  m_nodes.clear();
+  m_parents.clear();
+  m_meshes.clear();
+  m_translations.clear();
+  m_rotations.clear();
+  m_scales.clear();
+  m_localMatrices.clear();
+  m_worldMatrices.clear();
+  m_dirty.clear();
+  m_anyDirty = false;
+  m_weightRanges.clear();
+  m_weights.clear();
+  m_weightsChanged = false;
+
+
+  // Breadth first, so the nodes are sorted by depth and every parent is
+  // visited before its children
+  for (const auto nodeIdx : model.sceneRoots()) {
+    m_nodes.push_back(nodeIdx);
+    m_parents.push_back(-1);
+  }
+  for (size_t i = 0; i < m_nodes.size(); ++i) {
+    for (const auto childIdx : model.nodes()[m_nodes[i]].children) {
+      m_nodes.push_back(childIdx);
+      m_parents.push_back(int(i));
+    }
+  }
+
+  const auto count = m_nodes.size();
+  m_meshes.reserve(count);
+  m_translations.reserve(count);
+  m_rotations.reserve(count);
+  m_scales.reserve(count);
+  m_localMatrices.reserve(count);
+  m_worldMatrices.resize(count);
+  for (size_t i = 0; i < count; ++i) {
+    const auto &node = model.nodes()[m_nodes[i]];
+    const auto &localMatrix = node.matrix;
+    m_meshes.push_back(node.mesh);
+    m_localMatrices.push_back(localMatrix);
+
+    auto translation = node.translation;
+    auto rotation = node.rotation;
+    auto scale = node.scale;
+    if (node.hasMatrix) {
+      glm::vec3 skew;
+      glm::vec4 perspective;
+      glm::decompose(
+          localMatrix, scale, rotation, translation, skew, perspective);
+    }
+    m_translations.push_back(translation);
+    m_rotations.push_back(rotation);
+    m_scales.push_back(scale);
+
+    WeightRange weights{uint32_t(m_weights.size()), 0};
+    if (node.mesh >= 0) {
+      const auto &mesh = model.meshes()[node.mesh];
+      const auto targetCount =
+          mesh.primitives.empty() ? 0 : mesh.primitives[0].targets.count;
+      const auto &defaults = node.weights.empty() ? mesh.weights : node.weights;
+      weights.count = targetCount;
+      for (uint32_t t = 0; t < targetCount; ++t) {
+        m_weights.push_back(t < defaults.count ? defaults[t] : 0.f);
+      }
+    }
+    m_weightRanges.push_back(weights);
+
+    if (m_parents[i] < 0) {
+      m_worldMatrices[i] = localMatrix;
+    } else {
+      multiplyAffine(
+          m_worldMatrices[m_parents[i]], localMatrix, m_worldMatrices[i]);
+    }
+  }
+  m_dirty.assign(count, 0);
+}
+
+void SceneGraph::markDirty(size_t i)
+{
+  m_dirty[i] = DIRTY_LOCAL;
+  m_anyDirty = true;
+}
+
+void SceneGraph::setTranslation(size_t i, const glm::vec3 &translation)
+{
+  m_translations[i] = translation;
+  markDirty(i);
+}
+
+void SceneGraph::setRotation(size_t i, const glm::quat &rotation)
+{
+  m_rotations[i] = rotation;
+  markDirty(i);
+}
+
+void SceneGraph::setScale(size_t i, const glm::vec3 &scale)
+{
+  m_scales[i] = scale;
+  markDirty(i);
+}
+
+void SceneGraph::setWeight(size_t i, size_t target, float weight)
+{
+  auto &current = m_weights[m_weightRanges[i].first + target];
+  if (current != weight) {
+    current = weight;
+    m_weightsChanged = true;
+  }
+}
+
+bool SceneGraph::updateWorldMatrices()
+{
+  if (!m_anyDirty) {
+    return false;
+  }
+  TRACE_ZONE("updateWorldMatrices");
+
+  // Local matrices first, the loop only reads the transform arrays
+  const auto count = m_nodes.size();
+  for (size_t i = 0; i < count; ++i) {
+    if (m_dirty[i] == DIRTY_LOCAL) {
+      m_localMatrices[i] =
+          composeTransform(m_translations[i], m_rotations[i], m_scales[i]);
+    }
+  }
+
+  // A node needs a new world matrix if it or one of its ancestors is dirty,
+  // parents are updated first so the flag only has to look one level up
+  for (size_t i = 0; i < count; ++i) {
+    const auto parentIdx = m_parents[i];
+    if (parentIdx >= 0 && m_dirty[parentIdx] && !m_dirty[i]) {
+      m_dirty[i] = DIRTY_WORLD;
+    }
+    if (!m_dirty[i]) {
+      continue;
+    }
+    if (parentIdx < 0) {
+      m_worldMatrices[i] = m_localMatrices[i];
+    } else {
+      multiplyAffine(m_worldMatrices[parentIdx], m_localMatrices[i],
+          m_worldMatrices[i]);
+    }
+  }
+
+  m_dirty.assign(count, 0);
+  m_anyDirty = false;
+  return true;
+}
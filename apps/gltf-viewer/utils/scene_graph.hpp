@@ -0,0 +1,90 @@
+#pragma once
+
+#include "runtime_model.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <tiny_gltf.h>
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// The nodes of a glTF scene flattened in topological order (a parent always
+// comes before its children). Local transforms are stored as separate
+// translation, rotation and scale arrays, with cached local and world
+// matrices. Changing a transform only marks the node dirty, world matrices are
+// recomputed by updateWorldMatrices() in one linear pass over the dirty
+// subtrees.
+class SceneGraph
+{
+public:
+  // Replace the content with the nodes reachable from the default scene of
+  // the model, nothing without one
+  void build(const RuntimeModel &model);
+
+  size_t size() const { return m_nodes.size(); }
+
+  // Index in model.nodes of the node at position i
+  int node(size_t i) const { return m_nodes[i]; }
+  // Position of the parent of the node at position i, -1 for roots
+  int parent(size_t i) const { return m_parents[i]; }
+  // Index in model.meshes, -1 if the node has no mesh
+  int mesh(size_t i) const { return m_meshes[i]; }
+
+  // Node matrices are decomposed, glTF requires them to be TRS
+  const glm::vec3 &translation(size_t i) const { return m_translations[i]; }
+  const glm::quat &rotation(size_t i) const { return m_rotations[i]; }
+  const glm::vec3 &scale(size_t i) const { return m_scales[i]; }
+  void setTranslation(size_t i, const glm::vec3 &translation);
+  void setRotation(size_t i, const glm::quat &rotation);
+  void setScale(size_t i, const glm::vec3 &scale);
+
+  // Valid after updateWorldMatrices() if a transform changed
+  const glm::mat4 &localMatrix(size_t i) const { return m_localMatrices[i]; }
+  const glm::mat4 &worldMatrix(size_t i) const { return m_worldMatrices[i]; }
+
+  // Return true if any world matrix changed
+  bool updateWorldMatrices();
+
+  // Morph target weights of the node at position i, from the node or else its
+  // mesh, one per target of the mesh
+  size_t weightCount(size_t i) const { return m_weightRanges[i].count; }
+  const float *weights(size_t i) const
+  {
+    return m_weights.data() + m_weightRanges[i].first;
+  }
+  void setWeight(size_t i, size_t target, float weight);
+
+  // Return true if any weight changed since the last call
+  bool updateWeights() { return std::exchange(m_weightsChanged, false); }
+
+private:
+  enum DirtyFlags : char
+  {
+    DIRTY_LOCAL = 1, // The transform changed
+    DIRTY_WORLD = 2 // Only an ancestor changed
+  };
+
+  void markDirty(size_t i);
+
+  struct WeightRange
+  {
+    uint32_t first; // In m_weights
+    uint32_t count;
+  };
+
+  std::vector<int> m_nodes;
+  std::vector<int> m_parents;
+  std::vector<int> m_meshes;
+  std::vector<glm::vec3> m_translations;
+  std::vector<glm::quat> m_rotations;
+  std::vector<glm::vec3> m_scales;
+  std::vector<glm::mat4> m_localMatrices;
+  std::vector<glm::mat4> m_worldMatrices;
+  std::vector<char> m_dirty; // char since vector<bool> is slow to index
+  bool m_anyDirty = false;
+  std::vector<WeightRange> m_weightRanges;
+  std::vector<float> m_weights;
+  bool m_weightsChanged = false;
+};
@@ -1,14 +1,24 @@
 #pragma once
 
 #include "filesystem.hpp"
+#include "gl_extensions.hpp"
+#include "program_cache.hpp"
+#include <algorithm>
+#include <cstdint>
 #include <fstream>
+#include <functional>
 #include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
 #include <iostream>
+#include <map>
 #include <memory>
 #include <sstream>
 #include <stdexcept>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 
 class GLShader
@@ -93,12 +103,36 @@ GLShader compileShader(GLenum type, StringType &&src)
   return shader;
 }
 
-// Load and compile a shader according to the following naming convention:
+// Insert a #define line for each of defines after the #version line of src
+inline std::string addShaderDefines(
+    const std::string &src, const std::vector<std::string> &defines)
+{
+  if (defines.empty()) {
+    return src;
+  }
+  const auto version = src.find("#version");
+  const auto lineEnd = version == std::string::npos
+                           ? std::string::npos
+                           : src.find('\n', version);
+  const auto position = lineEnd == std::string::npos ? 0 : lineEnd + 1;
+
+  std::string lines;
+  for (const auto &define : defines) {
+    lines += "#define " + define + "\n";
+  }
+  return src.substr(0, position) + lines + src.substr(position);
+}
+
+// Start compiling the source of a shader file, of the type its name tells
+// according to the following naming convention:
 // *.vs.glsl -> vertex shader
 // *.fs.glsl -> fragment shader
 // *.gs.glsl -> geometry shader
 // *.cs.glsl -> compute shader
-inline GLShader loadShader(const fs::path &shaderPath)
+// The compile status is not checked, so that parallel shader compile does not
+// wait for the driver.
+inline GLShader startShaderFile(
+    const fs::path &shaderPath, const std::string &source)
 {
   static auto extToShaderType =
       std::unordered_map<std::string, std::pair<GLenum, std::string>>(
@@ -118,8 +152,16 @@ inline GLShader loadShader(const fs::path &shaderPath)
             << "\n";
 
   GLShader shader{(*it).second.first};
-  shader.setSource(loadShaderSource(shaderPath));
-  shader.compile();
+  shader.setSource(source);
+  glCompileShader(shader.glId());
+  return shader;
+}
+
+// Compile the source of a shader file, see startShaderFile
+inline GLShader compileShaderFile(
+    const fs::path &shaderPath, const std::string &source)
+{
+  auto shader = startShaderFile(shaderPath, source);
   if (!shader.getCompileStatus()) {
     std::cerr << "Shader compilation error:" << shader.getInfoLog()
               << std::endl;
@@ -128,12 +170,58 @@ inline GLShader loadShader(const fs::path &shaderPath)
   return shader;
 }
 
+// Load and compile a shader, see compileShaderFile
+inline GLShader loadShader(const fs::path &shaderPath,
+    const std::vector<std::string> &defines = {})
+{
+  return compileShaderFile(
+      shaderPath, addShaderDefines(loadShaderSource(shaderPath), defines));
+}
+
 class GLProgram
 {
   GLuint m_GLId;
   typedef std::unique_ptr<char[]> CharBuffer;
 
+  // Active uniforms and blocks, reflected after linking. Arrays are found
+  // both with and without their "[0]" suffix. Ordered with a transparent
+  // comparison, so that lookups by C string build no std::string.
+  std::map<std::string, GLint, std::less<>> m_uniformLocations;
+  std::map<std::string, GLuint, std::less<>> m_uniformBlockIndices;
+  // Last value set by setUniform, by location. Empty if not set yet.
+  mutable std::vector<std::vector<unsigned char>> m_uniformValues;
+
+  // Record value for location, return false if it is already the value of
+  // the uniform
+  bool updateUniformValue(GLint location, const void *value, size_t size) const
+  {
+    if (location < 0) {
+      return false;
+    }
+    if (size_t(location) >= m_uniformValues.size()) {
+      ++uniformUploadCount();
+      return true;
+    }
+    auto &cached = m_uniformValues[location];
+    const auto *bytes = static_cast<const unsigned char *>(value);
+    if (cached.size() == size &&
+        std::equal(bytes, bytes + size, begin(cached))) {
+      return false;
+    }
+    cached.assign(bytes, bytes + size);
+    ++uniformUploadCount();
+    return true;
+  }
+
 public:
+  // Uniform values setUniform sent to the driver on this thread, for the
+  // frame statistics
+  static size_t &uniformUploadCount()
+  {
+    thread_local size_t count = 0;
+    return count;
+  }
+
   GLProgram() : m_GLId(glCreateProgram()) {}
 
   ~GLProgram() { glDeleteProgram(m_GLId); }
@@ -142,12 +230,22 @@ public:
 
   GLProgram &operator=(const GLProgram &) = delete;
 
-  GLProgram(GLProgram &&rvalue) : m_GLId(rvalue.m_GLId) { rvalue.m_GLId = 0; }
+  GLProgram(GLProgram &&rvalue) :
+      m_GLId(rvalue.m_GLId),
+      m_uniformLocations(std::move(rvalue.m_uniformLocations)),
+      m_uniformBlockIndices(std::move(rvalue.m_uniformBlockIndices)),
+      m_uniformValues(std::move(rvalue.m_uniformValues))
+  {
+    rvalue.m_GLId = 0;
+  }
 
   GLProgram &operator=(GLProgram &&rvalue)
   {
-    this->~GLProgram();
+    glDeleteProgram(m_GLId);
     m_GLId = rvalue.m_GLId;
+    m_uniformLocations = std::move(rvalue.m_uniformLocations);
+    m_uniformBlockIndices = std::move(rvalue.m_uniformBlockIndices);
+    m_uniformValues = std::move(rvalue.m_uniformValues);
     rvalue.m_GLId = 0;
     return *this;
   }
@@ -162,7 +260,11 @@ public:
   bool link()
   {
     glLinkProgram(m_GLId);
-    return getLinkStatus();
+    if (!getLinkStatus()) {
+      return false;
+    }
+    reflect();
+    return true;
   }
 
   bool getLinkStatus() const
@@ -183,12 +285,158 @@ public:
     return std::string(buffer.get());
   }
 
+  // Query the active uniforms and uniform blocks of the linked program. Called
+  // by link(), and to be called by code linking the program otherwise.
+  void reflect()
+  {
+    m_uniformLocations.clear();
+    m_uniformBlockIndices.clear();
+    m_uniformValues.clear();
+
+    GLint count = 0, maxNameLength = 0;
+    glGetProgramInterfaceiv(m_GLId, GL_UNIFORM, GL_ACTIVE_RESOURCES, &count);
+    glGetProgramInterfaceiv(
+        m_GLId, GL_UNIFORM, GL_MAX_NAME_LENGTH, &maxNameLength);
+    std::vector<GLchar> name(std::max(maxNameLength, 1));
+    GLint maxLocation = -1;
+    for (GLint i = 0; i < count; ++i) {
+      const GLenum property = GL_LOCATION;
+      GLint location = -1;
+      glGetProgramResourceiv(
+          m_GLId, GL_UNIFORM, GLuint(i), 1, &property, 1, nullptr, &location);
+      if (location < 0) {
+        continue; // In a uniform block
+      }
+      glGetProgramResourceName(m_GLId, GL_UNIFORM, GLuint(i),
+          GLsizei(name.size()), nullptr, name.data());
+      std::string uniformName(name.data());
+      m_uniformLocations[uniformName] = location;
+      const auto arraySuffix = uniformName.rfind("[0]");
+      if (arraySuffix != std::string::npos &&
+          arraySuffix + 3 == uniformName.size()) {
+        m_uniformLocations[uniformName.substr(0, arraySuffix)] = location;
+      }
+      maxLocation = std::max(maxLocation, location);
+    }
+    m_uniformValues.resize(size_t(maxLocation + 1));
+
+    glGetProgramInterfaceiv(
+        m_GLId, GL_UNIFORM_BLOCK, GL_ACTIVE_RESOURCES, &count);
+    glGetProgramInterfaceiv(
+        m_GLId, GL_UNIFORM_BLOCK, GL_MAX_NAME_LENGTH, &maxNameLength);
+    name.resize(std::max(maxNameLength, 1));
+    for (GLint i = 0; i < count; ++i) {
+      glGetProgramResourceName(m_GLId, GL_UNIFORM_BLOCK, GLuint(i),
+          GLsizei(name.size()), nullptr, name.data());
+      m_uniformBlockIndices[name.data()] = GLuint(i);
+    }
+  }
+
   void use() const { glUseProgram(m_GLId); }
 
+  // -1 if the program has no such active uniform
   GLint getUniformLocation(const GLchar *name) const
   {
-    GLint location = glGetUniformLocation(m_GLId, name);
-    return location;
+    const auto it = m_uniformLocations.find(name);
+    return it == end(m_uniformLocations) ? -1 : (*it).second;
+  }
+
+  // GL_INVALID_INDEX if the program has no such active uniform block
+  GLuint getUniformBlockIndex(const GLchar *name) const
+  {
+    const auto it = m_uniformBlockIndices.find(name);
+    return it == end(m_uniformBlockIndices) ? GL_INVALID_INDEX : (*it).second;
+  }
+
+  // Set a uniform of the program, bound or not, unless it already has value.
+  // Uniforms set with glUniform* directly are not tracked.
+  void setUniform(GLint location, GLint value) const
+  {
+    if (updateUniformValue(location, &value, sizeof(value))) {
+      glProgramUniform1i(m_GLId, location, value);
+    }
+  }
+
+  void setUniform(GLint location, GLfloat value) const
+  {
+    if (updateUniformValue(location, &value, sizeof(value))) {
+      glProgramUniform1f(m_GLId, location, value);
+    }
+  }
+
+  void setUniform(GLint location, const glm::ivec2 &value) const
+  {
+    if (updateUniformValue(location, &value, sizeof(value))) {
+      glProgramUniform2iv(m_GLId, location, 1, glm::value_ptr(value));
+    }
+  }
+
+  void setUniform(GLint location, const glm::ivec3 &value) const
+  {
+    if (updateUniformValue(location, &value, sizeof(value))) {
+      glProgramUniform3iv(m_GLId, location, 1, glm::value_ptr(value));
+    }
+  }
+
+  void setUniform(GLint location, const glm::vec2 &value) const
+  {
+    if (updateUniformValue(location, &value, sizeof(value))) {
+      glProgramUniform2fv(m_GLId, location, 1, glm::value_ptr(value));
+    }
+  }
+
+  void setUniform(GLint location, const glm::vec3 &value) const
+  {
+    if (updateUniformValue(location, &value, sizeof(value))) {
+      glProgramUniform3fv(m_GLId, location, 1, glm::value_ptr(value));
+    }
+  }
+
+  void setUniform(GLint location, const glm::vec4 &value) const
+  {
+    if (updateUniformValue(location, &value, sizeof(value))) {
+      glProgramUniform4fv(m_GLId, location, 1, glm::value_ptr(value));
+    }
+  }
+
+  void setUniform(GLint location, const glm::mat3 &value) const
+  {
+    if (updateUniformValue(location, &value, sizeof(value))) {
+      glProgramUniformMatrix3fv(
+          m_GLId, location, 1, GL_FALSE, glm::value_ptr(value));
+    }
+  }
+
+  void setUniform(GLint location, const glm::mat4 &value) const
+  {
+    if (updateUniformValue(location, &value, sizeof(value))) {
+      glProgramUniformMatrix4fv(
+          m_GLId, location, 1, GL_FALSE, glm::value_ptr(value));
+    }
+  }
+
+  // Set the count first elements of an array of matrices
+  void setUniform(GLint location, GLsizei count, const glm::mat4 *values) const
+  {
+    if (updateUniformValue(location, values, count * sizeof(glm::mat4))) {
+      glProgramUniformMatrix4fv(
+          m_GLId, location, count, GL_FALSE, glm::value_ptr(values[0]));
+    }
+  }
+
+  template <typename T>
+  void setUniform(const GLchar *name, const T &value) const
+  {
+    setUniform(getUniformLocation(name), value);
+  }
+
+  // Bind a uniform block of the program, if it is active, to binding
+  void setUniformBlockBinding(const GLchar *name, GLuint binding) const
+  {
+    const auto index = getUniformBlockIndex(name);
+    if (index != GL_INVALID_INDEX) {
+      glUniformBlockBinding(m_GLId, index, binding);
+    }
   }
 
   GLint getAttribLocation(const GLchar *name) const
@@ -244,17 +492,258 @@ template <typename CSrc> GLProgram buildComputeProgram(CSrc &&src)
   ;
 }
 
-inline GLProgram compileProgram(std::vector<fs::path> shaderPaths)
+// Program linked from shader files, or from its binary in the program cache
+// if the sources did not change since it was stored. The driver may compile
+// and link in the background until finish() is called.
+class ProgramBuild
 {
-  GLProgram program;
-  for (const auto &path : shaderPaths) {
-    auto shader = loadShader(path);
-    program.attachShader(shader);
+public:
+  ProgramBuild(std::vector<fs::path> shaderPaths,
+      const std::vector<std::string> &defines = {}) :
+      m_shaderPaths(std::move(shaderPaths))
+  {
+    std::vector<std::string> sources;
+    for (const auto &path : m_shaderPaths) {
+      sources.push_back(addShaderDefines(loadShaderSource(path), defines));
+      // The extension gives the shader type
+      m_cacheKey += path.filename().string() + '\n' + sources.back() + '\0';
+    }
+
+    m_fromCache = loadProgramBinary(m_program.glId(), m_cacheKey);
+    if (m_fromCache) {
+      return;
+    }
+
+    m_shaders.reserve(m_shaderPaths.size());
+    for (size_t i = 0; i < m_shaderPaths.size(); ++i) {
+      m_shaders.push_back(startShaderFile(m_shaderPaths[i], sources[i]));
+      m_program.attachShader(m_shaders.back());
+    }
+    if (programCacheEnabled()) {
+      glProgramParameteri(
+          m_program.glId(), GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+    glLinkProgram(m_program.glId());
   }
-  program.link();
-  if (!program.getLinkStatus()) {
-    std::cerr << "Program link error:" << program.getInfoLog() << std::endl;
-    throw std::runtime_error("Program link error:" + program.getInfoLog());
+
+  // True if finish() would not wait for the driver
+  bool ready() const
+  {
+    return m_fromCache || isProgramLinkComplete(m_program.glId());
   }
-  return program;
+
+  // Check the shaders and the program, throw on errors. Can only be called
+  // once.
+  GLProgram finish()
+  {
+    if (m_fromCache) {
+      m_program.reflect();
+      return std::move(m_program);
+    }
+
+    for (size_t i = 0; i < m_shaders.size(); ++i) {
+      if (!m_shaders[i].getCompileStatus()) {
+        std::cerr << "Shader compilation error:" << m_shaderPaths[i] << ":"
+                  << m_shaders[i].getInfoLog() << std::endl;
+        throw std::runtime_error(
+            "Shader compilation error:" + m_shaders[i].getInfoLog());
+      }
+    }
+    if (!m_program.getLinkStatus()) {
+      std::cerr << "Program link error:" << m_program.getInfoLog()
+                << std::endl;
+      throw std::runtime_error("Program link error:" + m_program.getInfoLog());
+    }
+    m_program.reflect();
+    if (programCacheEnabled() &&
+        !saveProgramBinary(m_program.glId(), m_cacheKey)) {
+      std::cerr << "Unable to write program binary to the cache" << std::endl;
+    }
+    m_shaders.clear();
+    return std::move(m_program);
+  }
+
+private:
+  std::vector<fs::path> m_shaderPaths;
+  std::string m_cacheKey;
+  bool m_fromCache = false;
+  GLProgram m_program;
+  std::vector<GLShader> m_shaders;
+};
+
+inline GLProgram compileProgram(std::vector<fs::path> shaderPaths,
+    const std::vector<std::string> &defines = {})
+{
+  return ProgramBuild(std::move(shaderPaths), defines).finish();
 }
+
+// Variants of a program, each compiled with a #define for every feature bit it
+// is built for. Variants are compiled on first use, in the background with
+// tryProgram, and kept for the lifetime of the object.
+class ShaderPermutations
+{
+public:
+  // Bit i of a feature mask enables featureDefines[i], defines are shared by
+  // every variant. setup is called with each new variant, not bound, to set
+  // the state it keeps (sampler units, block bindings).
+  ShaderPermutations(std::vector<fs::path> shaderPaths,
+      std::vector<std::string> featureDefines,
+      std::vector<std::string> defines = {},
+      std::function<void(const GLProgram &)> setup = {}) :
+      m_shaderPaths(std::move(shaderPaths)),
+      m_featureDefines(std::move(featureDefines)),
+      m_defines(std::move(defines)),
+      m_setup(std::move(setup))
+  {
+  }
+
+  // The variant of features, compiled first if needed
+  const GLProgram &program(uint32_t features)
+  {
+    const auto it = m_programs.find(features);
+    if (it != end(m_programs)) {
+      return (*it).second;
+    }
+    startBuild(features);
+    return finishBuild(features);
+  }
+
+  // The variant of features if it is ready, nullptr while the driver builds
+  // it in the background or if it failed to build, until the next rebuild().
+  // Without parallel shader compile, builds finish as soon as they start.
+  const GLProgram *tryProgram(uint32_t features)
+  {
+    const auto it = m_programs.find(features);
+    if (it != end(m_programs)) {
+      return &(*it).second;
+    }
+    if (m_failedBuilds.count(features)) {
+      return nullptr;
+    }
+    const auto &build = startBuild(features);
+    if (!build.ready()) {
+      return nullptr;
+    }
+    try {
+      return &finishBuild(features);
+    } catch (const std::runtime_error &) {
+      // Logged by ProgramBuild::finish, the caller draws with another variant
+      m_builds.erase(features);
+      m_failedBuilds.insert(features);
+      return nullptr;
+    }
+  }
+
+  size_t size() const { return m_programs.size(); }
+
+  // Builds started and not finished yet, rebuilds included
+  size_t pendingCount() const { return m_builds.size() + m_rebuilds.size(); }
+
+  // Rebuild the variants from the current sources of their shaders if paths
+  // has one of them, false if it does not. Compiled variants are rebuilt in
+  // the background and keep their program until finishRebuilds() replaces
+  // it, builds are restarted.
+  bool rebuild(const std::vector<fs::path> &paths)
+  {
+    if (std::none_of(begin(paths), end(paths), [&](const fs::path &path) {
+          return std::find(begin(m_shaderPaths), end(m_shaderPaths), path) !=
+                 end(m_shaderPaths);
+        })) {
+      return false;
+    }
+
+    std::vector<uint32_t> variants;
+    for (const auto &build : m_builds) {
+      variants.push_back(build.first);
+    }
+    m_builds.clear();
+    m_failedBuilds.clear();
+    for (const auto features : variants) {
+      startBuild(features);
+    }
+
+    m_rebuilds.clear();
+    for (const auto &program : m_programs) {
+      try {
+        m_rebuilds.emplace(program.first,
+            ProgramBuild(m_shaderPaths, variantDefines(program.first)));
+      } catch (const std::runtime_error &e) {
+        std::cerr << "Keeping the previous program: " << e.what() << std::endl;
+      }
+    }
+    return true;
+  }
+
+  // Replace the programs of the rebuilt variants the driver is done with. A
+  // variant that fails to build keeps its previous program. True if a program
+  // was replaced.
+  bool finishRebuilds()
+  {
+    bool replaced = false;
+    for (auto it = begin(m_rebuilds); it != end(m_rebuilds);) {
+      if (!(*it).second.ready()) {
+        ++it;
+        continue;
+      }
+      try {
+        auto &program = m_programs[(*it).first];
+        program = (*it).second.finish();
+        if (m_setup) {
+          m_setup(program);
+        }
+        replaced = true;
+      } catch (const std::runtime_error &) {
+        std::cerr << "Keeping the previous program" << std::endl;
+      }
+      it = m_rebuilds.erase(it);
+    }
+    return replaced;
+  }
+
+private:
+  std::vector<std::string> variantDefines(uint32_t features) const
+  {
+    auto defines = m_defines;
+    for (size_t i = 0; i < m_featureDefines.size(); ++i) {
+      if (features & (1u << i)) {
+        defines.push_back(m_featureDefines[i]);
+      }
+    }
+    return defines;
+  }
+
+  const ProgramBuild &startBuild(uint32_t features)
+  {
+    const auto it = m_builds.find(features);
+    if (it != end(m_builds)) {
+      return (*it).second;
+    }
+
+    return (*m_builds
+                 .emplace(features,
+                     ProgramBuild(m_shaderPaths, variantDefines(features)))
+                 .first)
+        .second;
+  }
+
+  const GLProgram &finishBuild(uint32_t features)
+  {
+    const auto it = m_builds.find(features);
+    auto &program =
+        (*m_programs.emplace(features, (*it).second.finish()).first).second;
+    m_builds.erase(it);
+    if (m_setup) {
+      m_setup(program);
+    }
+    return program;
+  }
+
+  std::vector<fs::path> m_shaderPaths;
+  std::vector<std::string> m_featureDefines;
+  std::vector<std::string> m_defines;
+  std::function<void(const GLProgram &)> m_setup;
+  std::unordered_map<uint32_t, GLProgram> m_programs;
+  std::unordered_map<uint32_t, ProgramBuild> m_builds;
+  std::unordered_map<uint32_t, ProgramBuild> m_rebuilds; // Of m_programs
+  std::unordered_set<uint32_t> m_failedBuilds;
+};
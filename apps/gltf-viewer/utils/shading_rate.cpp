@@ -0,0 +1,85 @@
+#include "shading_rate.hpp"
+#include "gl_extensions.hpp"
+#include "gpu_memory.hpp"
+
+#include <algorithm>
+#include <vector>
+
+ShadingRateImage::~ShadingRateImage() { release(); }
+
+void ShadingRateImage::release()
+{
+  if (m_texture) {
+    untrackTextures(1, &m_texture);
+    glDeleteTextures(1, &m_texture);
+  }
+  m_texture = 0;
+}
+
+void ShadingRateImage::init(GLsizei width, GLsizei height, int samples)
+{
+  release();
+  m_width = width;
+  m_height = height;
+  m_samples = std::max(samples, 1);
+
+  GLint previousTexture = 0;
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTexture);
+
+  const auto size = imageSize(glm::ivec2(width, height));
+  glGenTextures(1, &m_texture);
+  glBindTexture(GL_TEXTURE_2D, m_texture);
+  glTexStorage2D(GL_TEXTURE_2D, 1, GL_R8UI, size.x, size.y);
+  // Full rate until the first texels are computed
+  const std::vector<GLubyte> fullRate(size_t(size.x) * size_t(size.y), 0);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size.x, size.y, GL_RED_INTEGER,
+      GL_UNSIGNED_BYTE, fullRate.data());
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  trackTexture(GpuMemoryCategory::RenderTargets, GL_TEXTURE_2D, m_texture);
+
+  glBindTexture(GL_TEXTURE_2D, GLuint(previousTexture));
+
+  // Fragments of more samples than the implementation shades at once are
+  // shaded at the coarsest rate that fits
+  GLint maxCoarseSamples = 0;
+  glGetIntegerv(GL_MAX_COARSE_FRAGMENT_SAMPLES_NV, &maxCoarseSamples);
+  const auto rate = [&](int pixels) -> GLenum {
+    if (pixels >= 16 && 16 * m_samples <= maxCoarseSamples) {
+      return GL_SHADING_RATE_1_INVOCATION_PER_4X4_PIXELS_NV;
+    }
+    if (pixels >= 4 && 4 * m_samples <= maxCoarseSamples) {
+      return GL_SHADING_RATE_1_INVOCATION_PER_2X2_PIXELS_NV;
+    }
+    return GL_SHADING_RATE_1_INVOCATION_PER_PIXEL_NV;
+  };
+  const GLenum palette[PALETTE_SIZE] = {rate(1), rate(4), rate(16)};
+  shadingRateImagePalette(0, 0, PALETTE_SIZE, palette);
+}
+
+glm::ivec2 ShadingRateImage::texelSize()
+{
+  GLint width = 0;
+  GLint height = 0;
+  glGetIntegerv(GL_SHADING_RATE_IMAGE_TEXEL_WIDTH_NV, &width);
+  glGetIntegerv(GL_SHADING_RATE_IMAGE_TEXEL_HEIGHT_NV, &height);
+  return glm::max(glm::ivec2(width, height), glm::ivec2(1));
+}
+
+glm::ivec2 ShadingRateImage::imageSize(glm::ivec2 sceneSize)
+{
+  const auto texel = texelSize();
+  return glm::max((sceneSize + texel - 1) / texel, glm::ivec2(1));
+}
+
+void ShadingRateImage::begin() const
+{
+  bindShadingRateImage(m_texture);
+  glEnable(GL_SHADING_RATE_IMAGE_NV);
+}
+
+void ShadingRateImage::end() const
+{
+  glDisable(GL_SHADING_RATE_IMAGE_NV);
+  bindShadingRateImage(0);
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// Coarse shading of the opaque forward pass with NV_shading_rate_image. Each
+// texel of the image covers texelSize() pixels of the scene and stores the
+// index of its rate in the palette of viewport 0: full rate, one fragment per
+// 2x2 pixels, then per 4x4 pixels. Coarser rates than the sample count allows
+// fall back to the finest one that fits.
+//
+// Texels are GL_R8UI, written by shading_rate.cs.glsl from the luminance of
+// the previous frame or the distance to the eyes in stereo. Scenes may be
+// smaller than the image and use its bottom left corner.
+class ShadingRateImage
+{
+public:
+  static constexpr int PALETTE_SIZE = 3;
+
+  ShadingRateImage() = default;
+  ~ShadingRateImage();
+
+  ShadingRateImage(const ShadingRateImage &) = delete;
+  ShadingRateImage &operator=(const ShadingRateImage &) = delete;
+
+  // Allocate the texels of a scene of width x height pixels, at full rate,
+  // and set the palette for samples per pixel
+  void init(GLsizei width, GLsizei height, int samples);
+
+  // Of the largest scene
+  GLsizei width() const { return m_width; }
+  GLsizei height() const { return m_height; }
+  int samples() const { return m_samples; }
+  GLuint texture() const { return m_texture; }
+
+  // Pixels covered by a texel, from the implementation
+  static glm::ivec2 texelSize();
+  // Texels used by a scene of sceneSize pixels
+  static glm::ivec2 imageSize(glm::ivec2 sceneSize);
+
+  // Shade the draws that follow at the rates of the image, until end()
+  void begin() const;
+  void end() const;
+
+private:
+  void release();
+
+  GLsizei m_width = 0;
+  GLsizei m_height = 0;
+  int m_samples = 1;
+  GLuint m_texture = 0;
+};
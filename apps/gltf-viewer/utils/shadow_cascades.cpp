@@ -0,0 +1,145 @@
+#include "shadow_cascades.hpp"
+#include "gpu_memory.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+// Blend of logarithmic and uniform splits of the view depth range, the
+// logarithmic ones alone leave too small a first cascade
+const float CASCADE_SPLIT_LAMBDA = 0.8f;
+
+// A cascade covers this much more than the bounding sphere of its slice, the
+// slice can move by the difference before the cascade is rendered again
+const float CASCADE_MARGIN = 0.25f;
+
+} // namespace
+
+ShadowCascades::~ShadowCascades()
+{
+  if (m_framebuffer) {
+    glDeleteFramebuffers(1, &m_framebuffer);
+  }
+  if (m_texture) {
+    untrackTextures(1, &m_texture);
+    glDeleteTextures(1, &m_texture);
+  }
+}
+
+void ShadowCascades::init(GLsizei size, size_t cascadeCount)
+{
+  m_size = size;
+  m_cascades.assign(cascadeCount, Cascade());
+
+  // Depth comparisons are filtered by the sampler, see directionalShadow() in
+  // pbr_directional_light.fs.glsl
+  glGenTextures(1, &m_texture);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, m_texture);
+  glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_DEPTH_COMPONENT32F, size, size,
+      GLsizei(cascadeCount));
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE,
+      GL_COMPARE_REF_TO_TEXTURE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+  trackTexture(
+      GpuMemoryCategory::RenderTargets, GL_TEXTURE_2D_ARRAY, m_texture);
+
+  GLint previous = 0;
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previous);
+  glGenFramebuffers(1, &m_framebuffer);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_framebuffer);
+  glFramebufferTextureLayer(
+      GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_texture, 0, 0);
+  glDrawBuffer(GL_NONE);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, GLuint(previous));
+}
+
+void ShadowCascades::update(const glm::mat4 &viewMatrix,
+    const glm::mat4 &projMatrix, const glm::vec3 &lightDirection,
+    const Aabb &sceneBounds, bool sceneChanged)
+{
+  const bool invalidated = sceneChanged || lightDirection != m_lightDirection ||
+                           projMatrix != m_projMatrix;
+  m_lightDirection = lightDirection;
+  m_projMatrix = projMatrix;
+
+  const auto up = std::abs(lightDirection.y) > 0.99f ? glm::vec3(1, 0, 0)
+                                                     : glm::vec3(0, 1, 0);
+  const auto lightView = glm::lookAt(glm::vec3(0), -lightDirection, up);
+  const auto inverseView = glm::inverse(viewMatrix);
+
+  const float nearPlane = projMatrix[3][2] / (projMatrix[2][2] - 1.f);
+  const float farPlane = projMatrix[3][2] / (projMatrix[2][2] + 1.f);
+  // Distance of the frustum corners to the view axis per unit of depth
+  const float cornerSlope = std::sqrt(
+      1 / (projMatrix[0][0] * projMatrix[0][0]) +
+      1 / (projMatrix[1][1] * projMatrix[1][1]));
+
+  float sliceNear = nearPlane;
+  for (size_t i = 0; i < m_cascades.size(); ++i) {
+    auto &cascade = m_cascades[i];
+    const auto t = float(i + 1) / float(m_cascades.size());
+    const float sliceFar =
+        CASCADE_SPLIT_LAMBDA * nearPlane * std::pow(farPlane / nearPlane, t) +
+        (1 - CASCADE_SPLIT_LAMBDA) * (nearPlane + (farPlane - nearPlane) * t);
+
+    // Smallest sphere containing the slice, its center is on the view axis
+    // and its radius does not depend on the orientation of the camera
+    const float k = 1 + cornerSlope * cornerSlope;
+    auto centerDepth = std::min(0.5f * (sliceNear + sliceFar) * k, sliceFar);
+    const auto radius = std::sqrt((sliceFar - centerDepth) *
+                                      (sliceFar - centerDepth) +
+                                  sliceFar * sliceFar * (k - 1));
+    const auto center = glm::vec3(
+        lightView * inverseView * glm::vec4(0, 0, -centerDepth, 1));
+
+    cascade.splitDepth = sliceFar;
+    cascade.coveredRadius = radius * (1 + CASCADE_MARGIN);
+    sliceNear = sliceFar;
+
+    if (invalidated) {
+      // Light space depth range of every caster
+      float minDepth = 0;
+      float maxDepth = 0;
+      if (!sceneBounds.isEmpty()) {
+        const auto bounds = transformAabb(sceneBounds, lightView);
+        minDepth = -bounds.max.z;
+        maxDepth = -bounds.min.z;
+      }
+      const auto padding = 0.01f * (maxDepth - minDepth) + 1e-3f;
+      cascade.nearPlane = minDepth - padding;
+      cascade.farPlane = maxDepth + padding;
+    } else if (glm::length(glm::vec2(center) - cascade.center) <=
+               cascade.coveredRadius - radius) {
+      continue;
+    }
+
+    // Texel aligned center, the texels of a moved cascade sample the scene at
+    // the same places
+    const auto texel = texelSize(i);
+    cascade.center = glm::floor(glm::vec2(center) / texel) * texel;
+    cascade.viewProjMatrix =
+        glm::ortho(cascade.center.x - cascade.coveredRadius,
+            cascade.center.x + cascade.coveredRadius,
+            cascade.center.y - cascade.coveredRadius,
+            cascade.center.y + cascade.coveredRadius, cascade.nearPlane,
+            cascade.farPlane) *
+        lightView;
+    cascade.dirty = true;
+  }
+}
+
+void ShadowCascades::beginRendering(size_t cascade)
+{
+  glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+      m_texture, 0, GLint(cascade));
+  m_cascades[cascade].dirty = false;
+}
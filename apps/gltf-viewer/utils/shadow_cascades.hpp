@@ -0,0 +1,80 @@
+#pragma once
+
+#include "frustum.hpp"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Cascaded shadow maps of a directional light: the view frustum is split in
+// slices along the view depth, each covered by an orthographic projection of
+// the light rendered to a layer of a depth texture array. A cascade covers a
+// bit more than its slice and is only moved, and has to be rendered again,
+// once its slice leaves the covered area or the light or scene change.
+// Cascades have a constant size and texel aligned positions, so that shadow
+// edges do not shimmer as the camera moves.
+class ShadowCascades
+{
+public:
+  ShadowCascades() = default;
+  ~ShadowCascades();
+
+  ShadowCascades(const ShadowCascades &) = delete;
+  ShadowCascades &operator=(const ShadowCascades &) = delete;
+
+  // Allocate a size x size layer per cascade, every cascade is dirty
+  void init(GLsizei size, size_t cascadeCount);
+
+  // Fit the cascades to the view frustum of the camera and mark dirty those
+  // which move. lightDirection points to the light, sceneBounds must contain
+  // every shadow caster. sceneChanged marks every cascade dirty.
+  void update(const glm::mat4 &viewMatrix, const glm::mat4 &projMatrix,
+      const glm::vec3 &lightDirection, const Aabb &sceneBounds,
+      bool sceneChanged);
+
+  size_t count() const { return m_cascades.size(); }
+  GLsizei size() const { return m_size; }
+  GLuint texture() const { return m_texture; }
+
+  // World to light clip space matrix of a cascade
+  const glm::mat4 &viewProjMatrix(size_t cascade) const
+  {
+    return m_cascades[cascade].viewProjMatrix;
+  }
+  // View space depth up to which a cascade is used
+  float splitDepth(size_t cascade) const
+  {
+    return m_cascades[cascade].splitDepth;
+  }
+  // World space size of a texel of a cascade
+  float texelSize(size_t cascade) const
+  {
+    return 2 * m_cascades[cascade].coveredRadius / float(m_size);
+  }
+
+  bool dirty(size_t cascade) const { return m_cascades[cascade].dirty; }
+  // Attach the layer of a cascade to the framebuffer, bound on
+  // GL_DRAW_FRAMEBUFFER, and mark it clean
+  void beginRendering(size_t cascade);
+  GLuint framebuffer() const { return m_framebuffer; }
+
+private:
+  struct Cascade
+  {
+    glm::mat4 viewProjMatrix = glm::mat4(1);
+    float splitDepth = 0;
+    float coveredRadius = 0; // Half the side of the projection
+    glm::vec2 center = glm::vec2(0); // In light space
+    float nearPlane = 0; // Light space depth range of the scene
+    float farPlane = 0;
+    bool dirty = true;
+  };
+
+  std::vector<Cascade> m_cascades;
+  glm::vec3 m_lightDirection = glm::vec3(0);
+  glm::mat4 m_projMatrix = glm::mat4(0);
+  GLsizei m_size = 0;
+  GLuint m_texture = 0;
+  GLuint m_framebuffer = 0;
+};
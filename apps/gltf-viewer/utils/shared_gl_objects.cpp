@@ -0,0 +1,37 @@
+#include "shared_gl_objects.hpp"
+
+#include <glad/glad.h>
+
+#include <iterator>
+
+bool SharedGLObjects::create(int gpu, std::string &err)
+{
+  // Only the root of the share group, no object is created on it
+  return m_context.create(gpu, err) && m_context.makeCurrent(nullptr);
+}
+
+std::shared_ptr<void> SharedGLObjects::findObjects(const std::string &key)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  const auto it = m_objects.find(key);
+  return it == m_objects.end() ? nullptr : it->second.lock();
+}
+
+std::shared_ptr<void> SharedGLObjects::publishObjects(
+    const std::string &key, std::shared_ptr<void> objects)
+{
+  // The other contexts only see the content of the objects once the commands
+  // filling them are complete
+  glFinish();
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (auto it = m_objects.begin(); it != m_objects.end();) {
+    it = it->second.expired() ? m_objects.erase(it) : std::next(it);
+  }
+  auto &published = m_objects[key];
+  if (auto previous = published.lock()) {
+    return previous;
+  }
+  published = objects;
+  return objects;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "egl_context.hpp"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// Immutable GL objects of the renderers of serveRenderJobs, each on a thread
+// and headless context of its own. Their contexts are created shared with
+// the loader context of this one, so that the environment maps or geometry
+// buffers loaded by a renderer are referenced by the others instead of being
+// loaded again. Objects are kept while a renderer holds them, the last one
+// deletes them on its context.
+class SharedGLObjects
+{
+public:
+  SharedGLObjects() = default;
+
+  SharedGLObjects(const SharedGLObjects &) = delete;
+  SharedGLObjects &operator=(const SharedGLObjects &) = delete;
+
+  // Create the loader context on the EGL device of index gpu, current on no
+  // thread. It must outlive the contexts created shared with it.
+  bool create(int gpu, std::string &err);
+
+  // The context those of the renderers are created shared with
+  const EglContext &context() const { return m_context; }
+
+  // Objects published under key and still held by a renderer, null if none.
+  // T must be the type they were published with.
+  template <typename T> std::shared_ptr<T> find(const std::string &key)
+  {
+    return std::static_pointer_cast<T>(findObjects(key));
+  }
+
+  // Share objects created by the calling thread under key, once the GPU
+  // commands of its context are finished. The objects another renderer
+  // published meanwhile are returned instead if any.
+  template <typename T>
+  std::shared_ptr<T> publish(const std::string &key, std::shared_ptr<T> objects)
+  {
+    return std::static_pointer_cast<T>(publishObjects(key, std::move(objects)));
+  }
+
+private:
+  std::shared_ptr<void> findObjects(const std::string &key);
+  std::shared_ptr<void> publishObjects(
+      const std::string &key, std::shared_ptr<void> objects);
+
+  EglContext m_context;
+  std::mutex m_mutex;
+  std::map<std::string, std::weak_ptr<void>> m_objects;
+};
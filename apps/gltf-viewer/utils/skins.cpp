@@ -0,0 +1,123 @@
+#include "skins.hpp"
+
+#include "trace.hpp"
+
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstring>
+
+namespace
+{
+
+// The FLOAT MAT4 elements of an accessor, empty if it has no buffer view
+std::vector<glm::mat4> readMatrices(const tinygltf::Model &model,
+    const GltfBuffers &buffers, const tinygltf::Accessor &accessor)
+{
+  std::vector<glm::mat4> matrices;
+  if (accessor.bufferView < 0 ||
+      accessor.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT ||
+      accessor.type != TINYGLTF_TYPE_MAT4) {
+    return matrices;
+  }
+  const auto &bufferView = model.bufferViews[accessor.bufferView];
+  const auto stride =
+      bufferView.byteStride ? bufferView.byteStride : sizeof(glm::mat4);
+  const auto *data = buffers[bufferView.buffer].data + bufferView.byteOffset +
+                     accessor.byteOffset;
+
+  matrices.resize(accessor.count);
+  for (size_t i = 0; i < accessor.count; ++i) {
+    std::memcpy(&matrices[i], data + i * stride, sizeof(glm::mat4));
+  }
+  return matrices;
+}
+
+// Rotation and dual part of the rigid transform of matrix, x, y, z, w
+glm::mat4 toDualQuaternion(const glm::mat4 &matrix)
+{
+  const auto rotation = glm::normalize(
+      glm::quat_cast(glm::mat3(glm::normalize(glm::vec3(matrix[0])),
+          glm::normalize(glm::vec3(matrix[1])),
+          glm::normalize(glm::vec3(matrix[2])))));
+  const auto dual = 0.5f * (glm::quat(0, glm::vec3(matrix[3])) * rotation);
+
+  glm::mat4 packed(0);
+  packed[0] = glm::vec4(rotation.x, rotation.y, rotation.z, rotation.w);
+  packed[1] = glm::vec4(dual.x, dual.y, dual.z, dual.w);
+  return packed;
+}
+
+} // namespace
+
+void Skins::build(const tinygltf::Model &model, const GltfBuffers &buffers,
+    const SceneGraph &sceneGraph)
+{
+  m_skins.clear();
+  m_joints.clear();
+  m_inverseBindMatrices.clear();
+
+  // A joint instanced at several positions of the scene graph uses the first
+  std::vector<int> nodePositions(model.nodes.size(), -1);
+  for (size_t i = 0; i < sceneGraph.size(); ++i) {
+    auto &position = nodePositions[sceneGraph.node(i)];
+    if (position < 0) {
+      position = int(i);
+    }
+  }
+
+  for (const auto &skin : model.skins) {
+    Skin entry;
+    entry.firstJoint = uint32_t(m_joints.size());
+    entry.jointCount = uint32_t(skin.joints.size());
+
+    std::vector<glm::mat4> inverseBindMatrices;
+    if (skin.inverseBindMatrices >= 0 &&
+        size_t(skin.inverseBindMatrices) < model.accessors.size()) {
+      inverseBindMatrices = readMatrices(
+          model, buffers, model.accessors[skin.inverseBindMatrices]);
+    }
+    // Missing inverse bind matrices are identities
+    inverseBindMatrices.resize(skin.joints.size(), glm::mat4(1));
+
+    for (size_t j = 0; j < skin.joints.size(); ++j) {
+      const auto node = skin.joints[j];
+      m_joints.push_back(node >= 0 && size_t(node) < model.nodes.size()
+                             ? nodePositions[node]
+                             : -1);
+      m_inverseBindMatrices.push_back(inverseBindMatrices[j]);
+    }
+    m_skins.push_back(entry);
+  }
+
+  m_jointMatrices.assign(m_joints.size(), glm::mat4(1));
+  m_palette.assign(m_joints.size(), glm::mat4(1));
+}
+
+void Skins::update(const SceneGraph &sceneGraph, bool dualQuaternions)
+{
+  TRACE_ZONE("updateSkins");
+  for (size_t j = 0; j < m_joints.size(); ++j) {
+    m_jointMatrices[j] = m_joints[j] < 0
+                             ? glm::mat4(1)
+                             : sceneGraph.worldMatrix(size_t(m_joints[j])) *
+                                   m_inverseBindMatrices[j];
+    m_palette[j] = dualQuaternions ? toDualQuaternion(m_jointMatrices[j])
+                                   : m_jointMatrices[j];
+  }
+}
+
+Aabb Skins::skinnedBounds(size_t skin, const Aabb &bounds) const
+{
+  const auto &entry = m_skins[skin];
+  if (bounds.isEmpty() || entry.jointCount == 0) {
+    return bounds;
+  }
+  Aabb skinned;
+  for (uint32_t j = 0; j < entry.jointCount; ++j) {
+    const auto box =
+        transformAabb(bounds, m_jointMatrices[entry.firstJoint + j]);
+    skinned.min = glm::min(skinned.min, box.min);
+    skinned.max = glm::max(skinned.max, box.max);
+  }
+  return skinned;
+}
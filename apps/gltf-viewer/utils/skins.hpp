@@ -0,0 +1,58 @@
+#pragma once
+
+#include "frustum.hpp"
+#include "gltf_loader.hpp"
+#include "scene_graph.hpp"
+
+#include <glm/glm.hpp>
+#include <tiny_gltf.h>
+
+#include <cstdint>
+#include <vector>
+
+// The skins of a glTF model, with the joint matrices of all of them in one
+// palette uploaded for skinning in the vertex shader. The joint matrix of a
+// joint is its world matrix times its inverse bind matrix, computed once per
+// frame for every skin whatever the number of meshes using it. The world
+// matrix of a skinned node is ignored, as glTF requires.
+class Skins
+{
+public:
+  // Replace the content with the skins of the model, whose buffers must still
+  // be loaded. Joints out of the scene graph keep their bind pose.
+  void build(const tinygltf::Model &model, const GltfBuffers &buffers,
+      const SceneGraph &sceneGraph);
+
+  size_t size() const { return m_skins.size(); }
+  bool empty() const { return m_skins.empty(); }
+  size_t jointCount() const { return m_jointMatrices.size(); }
+
+  // Index in the palette of the first joint of the skin
+  uint32_t firstJoint(size_t skin) const { return m_skins[skin].firstJoint; }
+
+  // Compute the joint matrices from the world matrices of the scene graph.
+  // With dualQuaternions, the palette holds the rotation of each joint matrix
+  // in column 0 and its dual part in column 1 instead, for dual quaternion
+  // skinning, which ignores scales.
+  void update(const SceneGraph &sceneGraph, bool dualQuaternions);
+
+  // One mat4 per joint, std430 layout of SkinJoints in forward.vs.glsl
+  const std::vector<glm::mat4> &palette() const { return m_palette; }
+
+  // Bounds of a primitive with the local bounds bounds, skinned by the skin:
+  // the union of the bounds transformed by every joint matrix
+  Aabb skinnedBounds(size_t skin, const Aabb &bounds) const;
+
+private:
+  struct Skin
+  {
+    uint32_t firstJoint; // In m_joints and the palette
+    uint32_t jointCount;
+  };
+
+  std::vector<Skin> m_skins;
+  std::vector<int> m_joints; // Positions in the SceneGraph, -1 if absent
+  std::vector<glm::mat4> m_inverseBindMatrices;
+  std::vector<glm::mat4> m_jointMatrices;
+  std::vector<glm::mat4> m_palette;
+};
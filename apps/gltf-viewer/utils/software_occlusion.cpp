@@ -0,0 +1,546 @@
+#include "software_occlusion.hpp"
+#include "job_system.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SOFTWARE_OCCLUSION_SSE2
+#endif
+
+static_assert(OCCLUSION_TILE_WIDTH == 8 &&
+                  OCCLUSION_TILE_WIDTH * OCCLUSION_TILE_HEIGHT == 32,
+    "A row of a tile is a byte of its mask");
+
+namespace
+{
+
+const uint32_t FULL_MASK = 0xffffffffu;
+
+// Bits lo to hi of a row of a tile, in [0, 7]
+uint32_t rowBits(int lo, int hi) { return (0xffu >> (7 - (hi - lo))) << lo; }
+
+#if defined(SOFTWARE_OCCLUSION_SSE2)
+static_assert(OCCLUSION_TILE_HEIGHT == 4, "A lane per row of a tile");
+
+// Span of covered pixels of each row of the tile row, first > last where
+// none is, for the rows in [y0, y1] and pixels in [x0, x1]. Lanes are rows,
+// as the scalar spans of drawTriangle.
+void rowSpans(const glm::vec3 *v, const float *a, const float *b, int row,
+    int x0, int x1, int y0, int y1, float *first, float *last)
+{
+  const __m128 y = _mm_add_ps(
+      _mm_set1_ps(float(row * OCCLUSION_TILE_HEIGHT)), _mm_set_ps(3, 2, 1, 0));
+  __m128 covered = _mm_and_ps(_mm_cmpge_ps(y, _mm_set1_ps(float(y0))),
+      _mm_cmple_ps(y, _mm_set1_ps(float(y1))));
+  const __m128 yc = _mm_add_ps(y, _mm_set1_ps(0.5f));
+  __m128 left = _mm_set1_ps(float(x0));
+  __m128 right = _mm_set1_ps(float(x1));
+  for (int e = 0; e < 3; ++e) {
+    const __m128 s =
+        _mm_mul_ps(_mm_set1_ps(b[e]), _mm_sub_ps(yc, _mm_set1_ps(v[e].y)));
+    if (a[e] == 0.f) {
+      covered = _mm_andnot_ps(_mm_cmplt_ps(s, _mm_setzero_ps()), covered);
+      continue;
+    }
+    const __m128 x = _mm_sub_ps(
+        _mm_sub_ps(_mm_set1_ps(v[e].x), _mm_div_ps(s, _mm_set1_ps(a[e]))),
+        _mm_set1_ps(0.5f));
+    // A NaN intersection leaves the bound as it is
+    if (a[e] > 0.f) {
+      left = _mm_max_ps(x, left);
+    } else {
+      right = _mm_min_ps(x, right);
+    }
+  }
+  covered = _mm_and_ps(covered, _mm_cmple_ps(left, right));
+
+  // Rounded by truncation, left >= x0 >= 0 and right >= left where covered
+  const __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(left));
+  const __m128 ceiled = _mm_add_ps(truncated,
+      _mm_and_ps(_mm_cmplt_ps(truncated, left), _mm_set1_ps(1.f)));
+  const __m128 floored = _mm_cvtepi32_ps(_mm_cvttps_epi32(right));
+  _mm_storeu_ps(first, _mm_or_ps(_mm_and_ps(covered, ceiled),
+                           _mm_andnot_ps(covered, _mm_set1_ps(1.f))));
+  _mm_storeu_ps(last, _mm_and_ps(covered, floored));
+}
+
+// 2^n of integers n in [-1, 8]: their float exponent, converted back
+__m128i powersOfTwo(__m128 n)
+{
+  return _mm_cvttps_epi32(_mm_castsi128_ps(_mm_slli_epi32(
+      _mm_add_epi32(_mm_cvttps_epi32(n), _mm_set1_epi32(127)), 23)));
+}
+
+// Coverage masks of the 4 tiles from column, lanes are tiles
+__m128i tileMasks(const float *first, const float *last, int column)
+{
+  const __m128 tileX =
+      _mm_add_ps(_mm_set1_ps(float(column * OCCLUSION_TILE_WIDTH)),
+          _mm_set_ps(3 * OCCLUSION_TILE_WIDTH, 2 * OCCLUSION_TILE_WIDTH,
+              OCCLUSION_TILE_WIDTH, 0));
+  __m128i mask = _mm_setzero_si128();
+  for (int r = 0; r < OCCLUSION_TILE_HEIGHT; ++r) {
+    const __m128 lo =
+        _mm_min_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(first[r]), tileX),
+                       _mm_setzero_ps()),
+            _mm_set1_ps(float(OCCLUSION_TILE_WIDTH)));
+    const __m128 hi =
+        _mm_max_ps(_mm_min_ps(_mm_sub_ps(_mm_set1_ps(last[r]), tileX),
+                       _mm_set1_ps(float(OCCLUSION_TILE_WIDTH - 1))),
+            _mm_set1_ps(-1.f));
+    // Bits lo to hi are 2^(hi + 1) - 2^lo
+    const __m128i bits =
+        _mm_and_si128(_mm_castps_si128(_mm_cmple_ps(lo, hi)),
+            _mm_sub_epi32(powersOfTwo(_mm_add_ps(hi, _mm_set1_ps(1.f))),
+                powersOfTwo(lo)));
+    mask = _mm_or_si128(mask,
+        _mm_sll_epi32(bits, _mm_cvtsi32_si128(OCCLUSION_TILE_WIDTH * r)));
+  }
+  return mask;
+}
+#endif
+
+} // namespace
+
+void MaskedOcclusionBuffer::resize(int width, int height)
+{
+  m_tileColumns = std::max(width, 0) / OCCLUSION_TILE_WIDTH +
+                  (width % OCCLUSION_TILE_WIDTH > 0);
+  m_tileRows = std::max(height, 0) / OCCLUSION_TILE_HEIGHT +
+               (height % OCCLUSION_TILE_HEIGHT > 0);
+  m_width = m_tileColumns * OCCLUSION_TILE_WIDTH;
+  m_height = m_tileRows * OCCLUSION_TILE_HEIGHT;
+  const auto tileCount = size_t(m_tileColumns) * m_tileRows;
+  m_masks.resize(tileCount);
+  m_referenceDepths.resize(tileCount);
+  m_workingDepths.resize(tileCount);
+  clear(0, m_tileRows);
+}
+
+void MaskedOcclusionBuffer::clear(int firstRow, int endRow)
+{
+  const auto first = size_t(firstRow) * m_tileColumns;
+  const auto end = size_t(endRow) * m_tileColumns;
+  std::fill(m_masks.begin() + first, m_masks.begin() + end, 0u);
+  std::fill(m_referenceDepths.begin() + first,
+      m_referenceDepths.begin() + end, 0.f);
+  std::fill(
+      m_workingDepths.begin() + first, m_workingDepths.begin() + end, 0.f);
+}
+
+void MaskedOcclusionBuffer::projectTriangles(const glm::vec4 *positions,
+    const uint32_t *indices, size_t indexCount, OccluderFaces faces,
+    std::vector<OccluderTriangle> &triangles) const
+{
+  const auto project = [&](const glm::vec4 &position) {
+    const float depth = 1.f / position.w;
+    return glm::vec3((0.5f * position.x * depth + 0.5f) * float(m_width),
+        (0.5f * position.y * depth + 0.5f) * float(m_height), depth);
+  };
+  const auto append = [&](const glm::vec4 &a, const glm::vec4 &b,
+                          const glm::vec4 &c) {
+    OccluderTriangle triangle = {{project(a), project(b), project(c)}};
+    auto *v = triangle.vertices;
+    const float area =
+        (v[1].x - v[0].x) * (v[2].y - v[0].y) -
+        (v[1].y - v[0].y) * (v[2].x - v[0].x);
+    if (!(area != 0.f)) {
+      return; // Degenerate, or not finite
+    }
+    if ((faces == OccluderFaces::CounterClockwise && area < 0.f) ||
+        (faces == OccluderFaces::Clockwise && area > 0.f)) {
+      return;
+    }
+    if (area < 0.f) {
+      std::swap(v[1], v[2]);
+    }
+    if (std::max({v[0].x, v[1].x, v[2].x}) < 0.f ||
+        std::min({v[0].x, v[1].x, v[2].x}) > float(m_width) ||
+        std::max({v[0].y, v[1].y, v[2].y}) < 0.f ||
+        std::min({v[0].y, v[1].y, v[2].y}) > float(m_height)) {
+      return;
+    }
+    triangles.push_back(triangle);
+  };
+
+  for (size_t i = 0; i + 2 < indexCount; i += 3) {
+    const glm::vec4 v[3] = {positions[indices[i]], positions[indices[i + 1]],
+        positions[indices[i + 2]]};
+    // Distances to the near plane, z = -w
+    float d[3];
+    int inside = 0;
+    for (int k = 0; k < 3; ++k) {
+      d[k] = v[k].z + v[k].w;
+      inside += d[k] >= 0.f;
+    }
+    if (inside == 3) {
+      append(v[0], v[1], v[2]);
+    } else if (inside > 0) {
+      glm::vec4 polygon[4];
+      int n = 0;
+      for (int k = 0; k < 3; ++k) {
+        const int next = (k + 1) % 3;
+        if (d[k] >= 0.f) {
+          polygon[n++] = v[k];
+        }
+        if ((d[k] >= 0.f) != (d[next] >= 0.f)) {
+          polygon[n++] = glm::mix(v[k], v[next], d[k] / (d[k] - d[next]));
+        }
+      }
+      for (int k = 1; k + 1 < n; ++k) {
+        append(polygon[0], polygon[k], polygon[k + 1]);
+      }
+    }
+  }
+}
+
+void MaskedOcclusionBuffer::drawTriangles(const OccluderTriangle *triangles,
+    size_t count, int firstRow, int endRow)
+{
+  for (size_t i = 0; i < count; ++i) {
+    drawTriangle(triangles[i], firstRow, endRow);
+  }
+}
+
+void MaskedOcclusionBuffer::drawTriangle(
+    const OccluderTriangle &triangle, int firstRow, int endRow)
+{
+  const auto *v = triangle.vertices;
+
+  // Pixels whose center may be covered
+  const auto firstPixel = [](float min) {
+    return int(std::ceil(std::max(min - 0.5f, 0.f)));
+  };
+  const auto lastPixel = [](float max, int size) {
+    return int(std::floor(std::min(max - 0.5f, float(size - 1))));
+  };
+  const int x0 = firstPixel(std::min({v[0].x, v[1].x, v[2].x}));
+  const int x1 = lastPixel(std::max({v[0].x, v[1].x, v[2].x}), m_width);
+  const int y0 = firstPixel(std::min({v[0].y, v[1].y, v[2].y}));
+  const int y1 = lastPixel(std::max({v[0].y, v[1].y, v[2].y}), m_height);
+  const int row0 = std::max(y0 / OCCLUSION_TILE_HEIGHT, firstRow);
+  const int row1 = std::min(y1 / OCCLUSION_TILE_HEIGHT, endRow - 1);
+  if (x0 > x1 || y0 > y1 || row0 > row1) {
+    return;
+  }
+  const int column0 = x0 / OCCLUSION_TILE_WIDTH;
+  const int column1 = x1 / OCCLUSION_TILE_WIDTH;
+
+  // Edge functions a (x - p.x) + b (y - p.y), positive inside
+  float a[3], b[3];
+  for (int e = 0; e < 3; ++e) {
+    const auto &p = v[e];
+    const auto &q = v[(e + 1) % 3];
+    a[e] = p.y - q.y;
+    b[e] = q.x - p.x;
+  }
+
+  // Depth plane, of which the farthest point of the triangle within a tile
+  // is bounded by the farthest corner of the pixels it may cover there
+  const glm::vec3 e1 = v[1] - v[0];
+  const glm::vec3 e2 = v[2] - v[0];
+  const float area = e1.x * e2.y - e1.y * e2.x;
+  const float dx = (e1.z * e2.y - e2.z * e1.y) / area;
+  const float dy = (e2.z * e1.x - e1.z * e2.x) / area;
+  const float farthestVertex = std::min({v[0].z, v[1].z, v[2].z});
+
+  for (int row = row0; row <= row1; ++row) {
+    const float tileY0 =
+        float(std::max(row * OCCLUSION_TILE_HEIGHT, y0)) + 0.5f;
+    const float tileY1 =
+        float(std::min(row * OCCLUSION_TILE_HEIGHT + OCCLUSION_TILE_HEIGHT - 1,
+            y1)) +
+        0.5f;
+    const auto drawTile = [&](int column, uint32_t mask) {
+      const int tileX = column * OCCLUSION_TILE_WIDTH;
+      const float tileX0 = float(std::max(tileX, x0)) + 0.5f;
+      const float tileX1 =
+          float(std::min(tileX + OCCLUSION_TILE_WIDTH - 1, x1)) + 0.5f;
+      const float farthest = std::max(farthestVertex,
+          v[0].z + dx * (tileX0 - v[0].x) + dy * (tileY0 - v[0].y) +
+              std::min(dx * (tileX1 - tileX0), 0.f) +
+              std::min(dy * (tileY1 - tileY0), 0.f));
+
+      // Merged into the working layer unless not nearer than the reference,
+      // or much nearer than the working layer is from the reference: the
+      // triangle then replaces it
+      const auto tile = size_t(row) * m_tileColumns + column;
+      const float reference = m_referenceDepths[tile];
+      auto &working = m_workingDepths[tile];
+      auto &covered = m_masks[tile];
+      if (farthest <= reference) {
+        return;
+      }
+      if (!covered || farthest - working > working - reference) {
+        working = farthest;
+        covered = mask;
+      } else {
+        working = std::min(working, farthest);
+        covered |= mask;
+      }
+      if (covered == FULL_MASK) {
+        m_referenceDepths[tile] = working;
+        covered = 0;
+      }
+    };
+
+#if defined(SOFTWARE_OCCLUSION_SSE2)
+    // The rows of a tile then 4 tiles at a time
+    float first[OCCLUSION_TILE_HEIGHT];
+    float last[OCCLUSION_TILE_HEIGHT];
+    rowSpans(v, a, b, row, x0, x1, y0, y1, first, last);
+    for (int column = column0; column <= column1; column += 4) {
+      alignas(16) uint32_t masks[4];
+      _mm_store_si128(reinterpret_cast<__m128i *>(masks),
+          tileMasks(first, last, column));
+      for (int c = 0; c < 4 && column + c <= column1; ++c) {
+        if (masks[c]) {
+          drawTile(column + c, masks[c]);
+        }
+      }
+    }
+#else
+    // Span of covered pixels of each row of the tiles
+    int first[OCCLUSION_TILE_HEIGHT];
+    int last[OCCLUSION_TILE_HEIGHT];
+    for (int r = 0; r < OCCLUSION_TILE_HEIGHT; ++r) {
+      const int y = row * OCCLUSION_TILE_HEIGHT + r;
+      first[r] = 1;
+      last[r] = 0;
+      if (y < y0 || y > y1) {
+        continue;
+      }
+      const float yc = float(y) + 0.5f;
+      float left = float(x0);
+      float right = float(x1);
+      bool empty = false;
+      for (int e = 0; e < 3; ++e) {
+        const float s = b[e] * (yc - v[e].y);
+        if (a[e] > 0.f) {
+          left = std::max(left, v[e].x - s / a[e] - 0.5f);
+        } else if (a[e] < 0.f) {
+          right = std::min(right, v[e].x - s / a[e] - 0.5f);
+        } else {
+          empty = empty || s < 0.f;
+        }
+      }
+      if (!empty && left <= right) {
+        first[r] = int(std::ceil(left));
+        last[r] = int(std::floor(right));
+      }
+    }
+
+    for (int column = column0; column <= column1; ++column) {
+      const int tileX = column * OCCLUSION_TILE_WIDTH;
+      uint32_t mask = 0;
+      for (int r = 0; r < OCCLUSION_TILE_HEIGHT; ++r) {
+        const int lo = std::max(first[r], tileX) - tileX;
+        const int hi =
+            std::min(last[r], tileX + OCCLUSION_TILE_WIDTH - 1) - tileX;
+        if (lo <= hi) {
+          mask |= rowBits(lo, hi) << (OCCLUSION_TILE_WIDTH * r);
+        }
+      }
+      if (mask) {
+        drawTile(column, mask);
+      }
+    }
+#endif
+  }
+}
+
+bool MaskedOcclusionBuffer::testBox(
+    const glm::mat4 &viewProjMatrix, const Aabb &box) const
+{
+  if (box.isEmpty() || m_masks.empty()) {
+    return true;
+  }
+
+  float minX = std::numeric_limits<float>::max();
+  float minY = std::numeric_limits<float>::max();
+  float maxX = std::numeric_limits<float>::lowest();
+  float maxY = std::numeric_limits<float>::lowest();
+  float nearest = 0.f;
+  for (int corner = 0; corner < 8; ++corner) {
+    const glm::vec3 position(corner & 1 ? box.max.x : box.min.x,
+        corner & 2 ? box.max.y : box.min.y,
+        corner & 4 ? box.max.z : box.min.z);
+    const auto clip = viewProjMatrix * glm::vec4(position, 1);
+    if (clip.z < -clip.w) {
+      return true;
+    }
+    const float depth = 1.f / clip.w;
+    const float x = (0.5f * clip.x * depth + 0.5f) * float(m_width);
+    const float y = (0.5f * clip.y * depth + 0.5f) * float(m_height);
+    minX = std::min(minX, x);
+    minY = std::min(minY, y);
+    maxX = std::max(maxX, x);
+    maxY = std::max(maxY, y);
+    nearest = std::max(nearest, depth);
+  }
+
+  // Every pixel the box touches, out of the buffer it is left to frustum
+  // culling
+  const int x0 = int(std::floor(std::max(minX, 0.f)));
+  const int x1 = int(std::floor(std::min(maxX, float(m_width - 1))));
+  const int y0 = int(std::floor(std::max(minY, 0.f)));
+  const int y1 = int(std::floor(std::min(maxY, float(m_height - 1))));
+  if (x0 > x1 || y0 > y1) {
+    return true;
+  }
+
+  for (int row = y0 / OCCLUSION_TILE_HEIGHT;
+       row <= y1 / OCCLUSION_TILE_HEIGHT; ++row) {
+    const int tileY = row * OCCLUSION_TILE_HEIGHT;
+    const int rowLo = std::max(y0, tileY) - tileY;
+    const int rowHi = std::min(y1, tileY + OCCLUSION_TILE_HEIGHT - 1) - tileY;
+    for (int column = x0 / OCCLUSION_TILE_WIDTH;
+         column <= x1 / OCCLUSION_TILE_WIDTH; ++column) {
+      const int tileX = column * OCCLUSION_TILE_WIDTH;
+      const uint32_t bits =
+          rowBits(std::max(x0, tileX) - tileX,
+              std::min(x1, tileX + OCCLUSION_TILE_WIDTH - 1) - tileX);
+      uint32_t mask = 0;
+      for (int r = rowLo; r <= rowHi; ++r) {
+        mask |= bits << (OCCLUSION_TILE_WIDTH * r);
+      }
+      // The pixels of the box out of the working layer are only bounded by
+      // the reference
+      const auto tile = size_t(row) * m_tileColumns + column;
+      const float farthest = (mask & ~m_masks[tile])
+                                 ? m_referenceDepths[tile]
+                                 : m_workingDepths[tile];
+      if (nearest >= farthest) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void SoftwareOcclusion::readOccluders(
+    const PackedGeometry &geometry, uint32_t maxTriangles)
+{
+  TRACE_ZONE("SoftwareOcclusion::readOccluders");
+  m_meshes.assign(geometry.primitives.size(), Mesh());
+  JobSystem::shared().parallelFor(
+      geometry.primitives.size(), 16, [&](size_t begin, size_t end) {
+        for (size_t p = begin; p < end; ++p) {
+          const auto &primitive = geometry.primitives[p];
+          if (primitive.mode != GL_TRIANGLES || primitive.memberCount > 0) {
+            continue;
+          }
+          // Levels of detail move the surface by their error, which could
+          // hide what lies just behind it: larger meshes are no occluders
+          if (primitive.indexCount / 3 > maxTriangles) {
+            continue;
+          }
+          const uint32_t firstIndex = primitive.firstIndex;
+          uint32_t indexCount = primitive.indexCount;
+          indexCount -= indexCount % 3;
+          if (indexCount == 0) {
+            continue;
+          }
+
+          // Only the vertices of the triangles, renumbered
+          const auto *indices = geometry.indices.data() + firstIndex;
+          std::vector<uint32_t> vertices(indices, indices + indexCount);
+          std::sort(vertices.begin(), vertices.end());
+          vertices.erase(
+              std::unique(vertices.begin(), vertices.end()), vertices.end());
+          auto &mesh = m_meshes[p];
+          const auto &vertexBuffer =
+              geometry.vertexBuffers[primitive.vertexBuffer];
+          const auto &dequantize = primitive.positionDequantize;
+          mesh.positions.reserve(vertices.size());
+          for (const auto vertex : vertices) {
+            mesh.positions.push_back(glm::vec3(dequantize) +
+                                     dequantize.w *
+                                         glm::vec3(readPackedAttribute(
+                                             vertexBuffer,
+                                             VERTEX_ATTRIBUTE_POSITION,
+                                             uint32_t(primitive.baseVertex) +
+                                                 vertex)));
+          }
+          mesh.indices.reserve(indexCount);
+          for (uint32_t i = 0; i < indexCount; ++i) {
+            mesh.indices.push_back(uint32_t(
+                std::lower_bound(vertices.begin(), vertices.end(), indices[i]) -
+                vertices.begin()));
+          }
+        }
+      });
+}
+
+void SoftwareOcclusion::clear()
+{
+  m_meshes.clear();
+  m_drawnTriangles = 0;
+}
+
+void SoftwareOcclusion::render(const glm::mat4 &viewProjMatrix, int width,
+    int height, const uint32_t *primitives, const glm::mat4 *matrices,
+    const uint8_t *cullBackFaces, size_t count)
+{
+  TRACE_ZONE("SoftwareOcclusion::render");
+  m_viewProjMatrix = viewProjMatrix;
+  if (m_buffer.width() < width ||
+      m_buffer.width() >= width + OCCLUSION_TILE_WIDTH ||
+      m_buffer.height() < height ||
+      m_buffer.height() >= height + OCCLUSION_TILE_HEIGHT) {
+    m_buffer.resize(width, height);
+  }
+  if (m_triangles.size() < count) {
+    m_clipPositions.resize(count);
+    m_triangles.resize(count);
+  }
+
+  auto &jobs = JobSystem::shared();
+  jobs.parallelFor(count, 1, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      const auto &mesh = m_meshes[primitives[i]];
+      const auto matrix = viewProjMatrix * matrices[i];
+      auto &positions = m_clipPositions[i];
+      positions.resize(mesh.positions.size());
+      for (size_t v = 0; v < positions.size(); ++v) {
+        positions[v] = matrix * glm::vec4(mesh.positions[v], 1);
+      }
+      // Mirroring matrices turn the front faces clockwise
+      const auto faces = !cullBackFaces[i]
+                             ? OccluderFaces::Both
+                             : glm::determinant(glm::mat3(matrices[i])) < 0.f
+                                   ? OccluderFaces::Clockwise
+                                   : OccluderFaces::CounterClockwise;
+      m_triangles[i].clear();
+      m_buffer.projectTriangles(positions.data(), mesh.indices.data(),
+          mesh.indices.size(), faces, m_triangles[i]);
+    }
+  });
+  m_drawnTriangles = 0;
+  for (size_t i = 0; i < count; ++i) {
+    m_drawnTriangles += m_triangles[i].size();
+  }
+
+  // Bands of tile rows, a few per worker so that the bands the occluders
+  // crowd are balanced
+  const int rows = m_buffer.tileRowCount();
+  const int bands =
+      std::max(std::min(rows, int(4 * (jobs.workerCount() + 1))), 1);
+  jobs.parallelFor(size_t(bands), 1, [&](size_t begin, size_t end) {
+    for (size_t band = begin; band < end; ++band) {
+      const int firstRow = int(band) * rows / bands;
+      const int endRow = int(band + 1) * rows / bands;
+      m_buffer.clear(firstRow, endRow);
+      for (size_t i = 0; i < count; ++i) {
+        m_buffer.drawTriangles(
+            m_triangles[i].data(), m_triangles[i].size(), firstRow, endRow);
+      }
+    }
+  });
+}
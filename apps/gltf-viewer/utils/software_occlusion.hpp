@@ -0,0 +1,145 @@
+#pragma once
+
+#include "frustum.hpp"
+#include "packed_geometry.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Occlusion culling on the CPU, without the latency of the depth of a previous
+// frame (Andersson et al., Masked Software Occlusion Culling, 2016): a few
+// large occluders are rasterized at low resolution into a masked depth
+// buffer, then the bounds of the draws are tested against it before they are
+// submitted.
+//
+// The buffer is made of tiles of OCCLUSION_TILE_WIDTH x OCCLUSION_TILE_HEIGHT
+// pixels, each with a coverage mask of a bit per pixel and two depths instead
+// of a depth per pixel: every pixel of the tile is at least as near as the
+// reference depth, and those of the mask at least as near as the working
+// depth. The triangles covering a tile are merged into the working layer,
+// which replaces the reference once it covers the whole tile. The coverage of
+// a row of a tile is computed at once from the span of the triangle, shifted
+// into the mask.
+//
+// Depths are the reciprocal of the clip space w, which is linear across a
+// triangle in screen space and the larger the nearer. The view is the one of
+// a perspective projection: under an orthographic one every depth is 1 and
+// nothing is culled.
+const int OCCLUSION_TILE_WIDTH = 8;
+const int OCCLUSION_TILE_HEIGHT = 4;
+
+// Faces of the triangles kept by MaskedOcclusionBuffer::projectTriangles, by
+// their winding in clip space
+enum class OccluderFaces
+{
+  Both,
+  CounterClockwise,
+  Clockwise
+};
+
+// A triangle projected to the pixels of the buffer, counter clockwise, with
+// the depth of each vertex in z
+struct OccluderTriangle
+{
+  glm::vec3 vertices[3];
+};
+
+class MaskedOcclusionBuffer
+{
+public:
+  // Of width x height pixels, rounded up to whole tiles, cleared
+  void resize(int width, int height);
+  int width() const { return m_width; }
+  int height() const { return m_height; }
+  int tileRowCount() const { return m_tileRows; }
+
+  // Nothing occludes the tile rows [firstRow, endRow)
+  void clear(int firstRow, int endRow);
+
+  // Clip the triangles of indices into positions, in clip space, against the
+  // near plane and append those facing as faces to triangles, as the buffer
+  // rasterizes them
+  void projectTriangles(const glm::vec4 *positions, const uint32_t *indices,
+      size_t indexCount, OccluderFaces faces,
+      std::vector<OccluderTriangle> &triangles) const;
+
+  // Rasterize triangles into the tile rows [firstRow, endRow) only, so that
+  // bands of rows are drawn by concurrent jobs
+  void drawTriangles(const OccluderTriangle *triangles, size_t count,
+      int firstRow, int endRow);
+
+  // False if the box, in the space viewProjMatrix transforms from, is behind
+  // the occluders wherever it projects. Boxes crossing the near plane are
+  // visible.
+  bool testBox(const glm::mat4 &viewProjMatrix, const Aabb &box) const;
+
+private:
+  void drawTriangle(const OccluderTriangle &triangle, int firstRow,
+      int endRow);
+
+  int m_width = 0;
+  int m_height = 0;
+  int m_tileColumns = 0;
+  int m_tileRows = 0;
+  // Of each tile, row by row
+  std::vector<uint32_t> m_masks; // Bit x + 8 * y for pixel (x, y)
+  std::vector<float> m_referenceDepths;
+  std::vector<float> m_workingDepths;
+};
+
+// Occluder meshes of the primitives and the buffer they are drawn to for each
+// view
+class SoftwareOcclusion
+{
+public:
+  // Copy the triangles of each triangle list of up to maxTriangles
+  // triangles, for those drawn as occluders. Larger ones are not occluders:
+  // their levels of detail are not conservative. Must be called before the
+  // geometry data is released.
+  void readOccluders(const PackedGeometry &geometry, uint32_t maxTriangles);
+  void clear();
+
+  // Triangles of the occluder of a packed primitive, 0 if it has none
+  size_t triangleCount(size_t primitive) const
+  {
+    return primitive < m_meshes.size() ? m_meshes[primitive].indices.size() / 3
+                                       : 0;
+  }
+
+  // Rasterize the occluders of primitives, each placed by its matrix, seen
+  // with viewProjMatrix, into a buffer of width x height pixels. The back
+  // faces of those with nonzero cullBackFaces, single sided, are left out.
+  // Occluders are transformed then tile rows drawn by the jobs of
+  // JobSystem::shared().
+  void render(const glm::mat4 &viewProjMatrix, int width, int height,
+      const uint32_t *primitives, const glm::mat4 *matrices,
+      const uint8_t *cullBackFaces, size_t count);
+
+  // See MaskedOcclusionBuffer::testBox, against the last render
+  bool visible(const Aabb &box) const
+  {
+    return m_buffer.testBox(m_viewProjMatrix, box);
+  }
+
+  // Of the last render
+  size_t drawnTriangleCount() const { return m_drawnTriangles; }
+
+private:
+  struct Mesh
+  {
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+  };
+
+  std::vector<Mesh> m_meshes; // Of each packed primitive
+
+  MaskedOcclusionBuffer m_buffer;
+  glm::mat4 m_viewProjMatrix = glm::mat4(1);
+  // Of each occluder rendered, capacities kept across frames
+  std::vector<std::vector<glm::vec4>> m_clipPositions;
+  std::vector<std::vector<OccluderTriangle>> m_triangles;
+  size_t m_drawnTriangles = 0;
+};
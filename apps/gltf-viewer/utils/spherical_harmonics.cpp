@@ -0,0 +1,115 @@
+#include "spherical_harmonics.hpp"
+#include "job_system.hpp"
+
+#include <cmath>
+#include <vector>
+
+namespace
+{
+
+// Real spherical harmonics basis constants
+const float SH_Y00 = 0.282095f;
+const float SH_Y1 = 0.488603f;
+const float SH_Y2 = 1.092548f;
+const float SH_Y20 = 0.315392f;
+const float SH_Y22 = 0.546274f;
+
+// Convolution with the clamped cosine lobe, divided by pi
+const float SH_A0 = 1.f;
+const float SH_A1 = 2.f / 3.f;
+const float SH_A2 = 1.f / 4.f;
+
+// Direction of the center of a texel, following the cube map face layout of
+// the OpenGL specification (table 8.19), same as the bake compute shaders
+glm::vec3 cubeMapDirection(int face, float s, float t)
+{
+  switch (face) {
+  case 0:
+    return {1.f, -t, -s};
+  case 1:
+    return {-1.f, -t, s};
+  case 2:
+    return {s, 1.f, t};
+  case 3:
+    return {s, -1.f, -t};
+  case 4:
+    return {s, -t, 1.f};
+  default:
+    return {-s, -t, -1.f};
+  }
+}
+
+// Radiance of one face weighted by the basis functions and texel solid angles
+void projectFace(
+    const float *pixels, int face, GLsizei size, glm::vec3 *coefficients)
+{
+  const float texelSize = 2.f / float(size);
+
+  for (GLsizei y = 0; y < size; ++y) {
+    const float t = (float(y) + 0.5f) * texelSize - 1.f;
+    for (GLsizei x = 0; x < size; ++x) {
+      const float s = (float(x) + 0.5f) * texelSize - 1.f;
+      const float lengthSq = s * s + t * t + 1.f;
+      const float solidAngle =
+          texelSize * texelSize / (lengthSq * std::sqrt(lengthSq));
+      const auto d = cubeMapDirection(face, s, t) / std::sqrt(lengthSq);
+      const auto *texel = pixels + 3 * (size_t(y) * size + x);
+      const auto radiance =
+          glm::vec3(texel[0], texel[1], texel[2]) * solidAngle;
+
+      coefficients[0] += radiance;
+      coefficients[1] += radiance * d.y;
+      coefficients[2] += radiance * d.z;
+      coefficients[3] += radiance * d.x;
+      coefficients[4] += radiance * (d.x * d.y);
+      coefficients[5] += radiance * (d.y * d.z);
+      coefficients[6] += radiance * (3.f * d.z * d.z - 1.f);
+      coefficients[7] += radiance * (d.x * d.z);
+      coefficients[8] += radiance * (d.x * d.x - d.y * d.y);
+    }
+  }
+}
+
+} // namespace
+
+ShIrradiance projectShIrradiance(GLuint cubeMap, GLsizei size)
+{
+  const size_t faceSize = 3 * size_t(size) * size;
+  std::vector<float> pixels(6 * faceSize);
+
+  glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMap);
+  for (GLuint i = 0; i < 6; ++i) {
+    glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, GL_FLOAT,
+        pixels.data() + i * faceSize);
+  }
+  glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+  // One job per face, summed afterwards so that no locking is needed
+  glm::vec3 faceCoefficients[6][9] = {};
+  JobSystem::shared().parallelFor(6, 1, [&](size_t begin, size_t end) {
+    for (auto face = begin; face < end; ++face) {
+      projectFace(pixels.data() + face * faceSize, int(face), size,
+          faceCoefficients[face]);
+    }
+  });
+
+  glm::vec3 c[9] = {};
+  for (const auto &face : faceCoefficients) {
+    for (int i = 0; i < 9; ++i) {
+      c[i] += face[i];
+    }
+  }
+
+  // Each projected coefficient is multiplied by its basis constant once for
+  // the projection and once for the evaluation
+  const float scales[9] = {SH_A0 * SH_Y00 * SH_Y00, SH_A1 * SH_Y1 * SH_Y1,
+      SH_A1 * SH_Y1 * SH_Y1, SH_A1 * SH_Y1 * SH_Y1, SH_A2 * SH_Y2 * SH_Y2,
+      SH_A2 * SH_Y2 * SH_Y2, SH_A2 * SH_Y20 * SH_Y20, SH_A2 * SH_Y2 * SH_Y2,
+      SH_A2 * SH_Y22 * SH_Y22};
+
+  ShIrradiance irradiance;
+  for (int i = 0; i < 9; ++i) {
+    irradiance.coefficients[i] = glm::vec4(c[i] * scales[i], 0.f);
+  }
+  return irradiance;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// Diffuse irradiance of an environment as 9 spherical harmonics coefficients
+// (bands 0 to 2), laid out as a std140 uniform block. The coefficients are
+// premultiplied by the basis constants and the cosine lobe convolution so that
+// the irradiance in direction n, divided by pi like the irradiance cube map, is
+//   c0 + c1 y + c2 z + c3 x + c4 xy + c5 yz + c6 (3z^2 - 1) + c7 xz
+//   + c8 (x^2 - y^2)
+struct ShIrradiance
+{
+  glm::vec4 coefficients[9]; // w is unused
+};
+
+// Read back level 0 of a cube map and project it on the basis
+ShIrradiance projectShIrradiance(GLuint cubeMap, GLsizei size);
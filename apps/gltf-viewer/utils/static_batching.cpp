@@ -0,0 +1,509 @@
+#include "static_batching.hpp"
+
+#include "gltf.hpp"
+#include "job_system.hpp"
+#include "trace.hpp"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) ||                                     \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define STATIC_BATCHING_SSE
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define STATIC_BATCHING_NEON
+#endif
+
+namespace
+{
+
+// Attributes of the batches, in the order of their arrays in the buffer
+enum BatchAttribute
+{
+  BATCH_POSITION,
+  BATCH_NORMAL,
+  BATCH_TANGENT,
+  BATCH_TEXCOORD0,
+  BATCH_ATTRIBUTE_COUNT
+};
+
+const char *const ATTRIBUTE_NAMES[BATCH_ATTRIBUTE_COUNT] = {
+    "POSITION", "NORMAL", "TANGENT", "TEXCOORD_0"};
+const int ATTRIBUTE_TYPES[BATCH_ATTRIBUTE_COUNT] = {TINYGLTF_TYPE_VEC3,
+    TINYGLTF_TYPE_VEC3, TINYGLTF_TYPE_VEC4, TINYGLTF_TYPE_VEC2};
+const size_t ATTRIBUTE_COMPONENTS[BATCH_ATTRIBUTE_COUNT] = {3, 3, 4, 2};
+
+const int ARRAY_BUFFER = 34962;
+const int ELEMENT_ARRAY_BUFFER = 34963;
+
+// A primitive of an instance of a static node, copied into a batch
+struct BatchedPrimitive
+{
+  const tinygltf::Primitive *primitive;
+  glm::mat4 matrix; // World matrix of the node
+  size_t batch;
+  uint32_t vertexCount;
+  uint32_t indexCount;
+  uint32_t firstVertex; // In the batch
+  uint32_t firstIndex;
+  Aabb bounds; // In world space, computed with the vertices
+};
+
+struct Batch
+{
+  int material;
+  unsigned attributes; // Bit i set if the batch has BatchAttribute i
+  uint32_t vertexCount = 0;
+  uint32_t indexCount = 0;
+  // Byte offsets of the attribute arrays and of the indices in the buffer
+  size_t offsets[BATCH_ATTRIBUTE_COUNT] = {};
+  size_t indicesOffset = 0;
+  Aabb bounds;
+};
+
+const tinygltf::Accessor *findAttribute(const tinygltf::Model &model,
+    const tinygltf::Primitive &primitive, BatchAttribute attribute)
+{
+  const auto it = primitive.attributes.find(ATTRIBUTE_NAMES[attribute]);
+  return it != end(primitive.attributes) && (*it).second >= 0 &&
+                 size_t((*it).second) < model.accessors.size()
+             ? &model.accessors[(*it).second]
+             : nullptr;
+}
+
+// First element of an accessor and the distance between two elements, nullptr
+// if the accessor has no buffer view
+const unsigned char *accessorData(const tinygltf::Model &model,
+    const GltfBuffers &buffers, const tinygltf::Accessor &accessor,
+    size_t &stride)
+{
+  if (accessor.bufferView < 0) {
+    return nullptr;
+  }
+  const auto &bufferView = model.bufferViews[accessor.bufferView];
+  const auto elementSize =
+      size_t(tinygltf::GetComponentSizeInBytes(accessor.componentType)) *
+      tinygltf::GetNumComponentsInType(accessor.type);
+  stride = bufferView.byteStride ? bufferView.byteStride : elementSize;
+  return buffers[bufferView.buffer].data + bufferView.byteOffset +
+         accessor.byteOffset;
+}
+
+// Bit i set for each BatchAttribute i of the primitive, 0 if the primitive
+// cannot be batched
+unsigned batchAttributes(
+    const tinygltf::Model &model, const tinygltf::Primitive &primitive)
+{
+  if (primitive.mode != TINYGLTF_MODE_TRIANGLES ||
+      !primitive.targets.empty() || !primitive.extensions.empty()) {
+    return 0;
+  }
+  const auto *positions = findAttribute(model, primitive, BATCH_POSITION);
+  if (!positions || !positions->count ||
+      positions->count > STATIC_BATCH_MAX_VERTICES) {
+    return 0;
+  }
+  unsigned attributes = 0;
+  for (int i = 0; i < BATCH_ATTRIBUTE_COUNT; ++i) {
+    const auto *accessor = findAttribute(model, primitive, BatchAttribute(i));
+    if (!accessor) {
+      continue;
+    }
+    if (accessor->bufferView < 0 || accessor->sparse.isSparse ||
+        accessor->componentType != TINYGLTF_COMPONENT_TYPE_FLOAT ||
+        accessor->type != ATTRIBUTE_TYPES[i] ||
+        accessor->count < positions->count) {
+      return 0;
+    }
+    attributes |= 1u << i;
+  }
+  if (primitive.indices >= 0) {
+    if (size_t(primitive.indices) >= model.accessors.size()) {
+      return 0;
+    }
+    const auto &indices = model.accessors[primitive.indices];
+    if (indices.bufferView < 0 || indices.sparse.isSparse ||
+        (indices.componentType != TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE &&
+            indices.componentType != TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT &&
+            indices.componentType != TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT)) {
+      return 0;
+    }
+  }
+  return attributes;
+}
+
+// matrix * (x, y, z, w) of count vec3 read every stride bytes from data,
+// written every resultStride floats of result. The columns of the matrix are
+// combined 4 floats at a time, as in SceneGraph.
+void transformVectors(const glm::mat4 &matrix, float w,
+    const unsigned char *data, size_t stride, size_t count, float *result,
+    size_t resultStride)
+{
+#if defined(STATIC_BATCHING_SSE) || defined(STATIC_BATCHING_NEON)
+  const float *m = &matrix[0][0];
+  alignas(16) float transformed[4];
+#endif
+#if defined(STATIC_BATCHING_SSE)
+  const __m128 c0 = _mm_loadu_ps(m);
+  const __m128 c1 = _mm_loadu_ps(m + 4);
+  const __m128 c2 = _mm_loadu_ps(m + 8);
+  const __m128 c3 = _mm_mul_ps(_mm_loadu_ps(m + 12), _mm_set1_ps(w));
+#elif defined(STATIC_BATCHING_NEON)
+  const float32x4_t c0 = vld1q_f32(m);
+  const float32x4_t c1 = vld1q_f32(m + 4);
+  const float32x4_t c2 = vld1q_f32(m + 8);
+  const float32x4_t c3 = vmulq_n_f32(vld1q_f32(m + 12), w);
+#endif
+  for (size_t v = 0; v < count; ++v) {
+    float vector[3];
+    std::memcpy(vector, data + v * stride, sizeof(vector));
+#if defined(STATIC_BATCHING_SSE)
+    const __m128 sum =
+        _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(vector[0])),
+                       _mm_mul_ps(c1, _mm_set1_ps(vector[1]))),
+            _mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(vector[2])), c3));
+    _mm_store_ps(transformed, sum);
+    std::memcpy(result + v * resultStride, transformed, 3 * sizeof(float));
+#elif defined(STATIC_BATCHING_NEON)
+    float32x4_t sum = vmlaq_n_f32(c3, c0, vector[0]);
+    sum = vmlaq_n_f32(sum, c1, vector[1]);
+    sum = vmlaq_n_f32(sum, c2, vector[2]);
+    vst1q_f32(transformed, sum);
+    std::memcpy(result + v * resultStride, transformed, 3 * sizeof(float));
+#else
+    const glm::vec3 transformed =
+        matrix * glm::vec4(vector[0], vector[1], vector[2], w);
+    std::memcpy(result + v * resultStride, &transformed, sizeof(transformed));
+#endif
+  }
+}
+
+// Make the xyz of count vectors written every stride floats unit length, zero
+// stays zero
+void normalizeVectors(float *vectors, size_t stride, size_t count)
+{
+  for (size_t v = 0; v < count; ++v) {
+    glm::vec3 vector;
+    std::memcpy(&vector, vectors + v * stride, sizeof(vector));
+    const auto length2 = glm::dot(vector, vector);
+    if (length2 > 0.f) {
+      vector /= std::sqrt(length2);
+      std::memcpy(vectors + v * stride, &vector, sizeof(vector));
+    }
+  }
+}
+
+// Write the vertices and indices of a batched primitive in the buffer of its
+// batch
+void copyPrimitive(const tinygltf::Model &model, const GltfBuffers &buffers,
+    const Batch &batch, BatchedPrimitive &batched, unsigned char *bytes)
+{
+  const auto &primitive = *batched.primitive;
+  const auto vertexCount = size_t(batched.vertexCount);
+  const auto attributeArray = [&](BatchAttribute attribute) {
+    return reinterpret_cast<float *>(bytes + batch.offsets[attribute]) +
+           size_t(batched.firstVertex) * ATTRIBUTE_COMPONENTS[attribute];
+  };
+  // Degenerate matrices flatten the node, whose normals are then left as is
+  const glm::mat3 linear(batched.matrix);
+  const auto normalMatrix = glm::determinant(linear) == 0.f
+                                ? glm::mat4(linear)
+                                : glm::mat4(glm::transpose(glm::inverse(linear)));
+
+  for (int i = 0; i < BATCH_ATTRIBUTE_COUNT; ++i) {
+    const auto attribute = BatchAttribute(i);
+    if (!(batch.attributes & (1u << i))) {
+      continue;
+    }
+    size_t stride = 0;
+    const auto *data = accessorData(model, buffers,
+        *findAttribute(model, primitive, attribute), stride);
+    auto *result = attributeArray(attribute);
+    const auto components = ATTRIBUTE_COMPONENTS[attribute];
+    switch (attribute) {
+    case BATCH_POSITION:
+      transformVectors(
+          batched.matrix, 1.f, data, stride, vertexCount, result, components);
+      for (size_t v = 0; v < vertexCount; ++v) {
+        glm::vec3 position;
+        std::memcpy(&position, result + 3 * v, sizeof(position));
+        batched.bounds.min = glm::min(batched.bounds.min, position);
+        batched.bounds.max = glm::max(batched.bounds.max, position);
+      }
+      break;
+    case BATCH_NORMAL:
+      transformVectors(
+          normalMatrix, 0.f, data, stride, vertexCount, result, components);
+      normalizeVectors(result, components, vertexCount);
+      break;
+    case BATCH_TANGENT:
+      // The handedness is kept: the shaders build the bitangent from the
+      // transformed normal and tangent either way
+      transformVectors(
+          batched.matrix, 0.f, data, stride, vertexCount, result, components);
+      normalizeVectors(result, components, vertexCount);
+      for (size_t v = 0; v < vertexCount; ++v) {
+        std::memcpy(result + 4 * v + 3, data + v * stride + 3 * sizeof(float),
+            sizeof(float));
+      }
+      break;
+    default:
+      for (size_t v = 0; v < vertexCount; ++v) {
+        std::memcpy(result + 2 * v, data + v * stride, 2 * sizeof(float));
+      }
+      break;
+    }
+  }
+
+  auto *indices = reinterpret_cast<uint32_t *>(bytes + batch.indicesOffset) +
+                  batched.firstIndex;
+  if (primitive.indices < 0) {
+    std::iota(indices, indices + batched.indexCount, batched.firstVertex);
+    return;
+  }
+  // Invalid indices are clamped rather than read into the next primitive
+  visitIndices(model, buffers, model.accessors[primitive.indices],
+      [&](const auto &view) {
+        for (size_t i = 0; i < batched.indexCount; ++i) {
+          indices[i] = batched.firstVertex +
+                       std::min(view[i], batched.vertexCount - 1);
+        }
+      });
+}
+
+} // namespace
+
+size_t batchStaticNodes(tinygltf::Model &model, GltfBuffers &buffers)
+{
+  TRACE_ZONE("batchStaticNodes");
+  if (model.defaultScene < 0 ||
+      size_t(model.defaultScene) >= model.scenes.size()) {
+    return 0;
+  }
+
+  std::vector<char> animated(model.nodes.size(), 0);
+  for (const auto &animation : model.animations) {
+    for (const auto &channel : animation.channels) {
+      if (channel.target_node >= 0 &&
+          size_t(channel.target_node) < model.nodes.size()) {
+        animated[channel.target_node] = 1;
+      }
+    }
+  }
+
+  // Every instance of the nodes with a mesh in the default scene, depth
+  // first in the order of the children, which keeps the nodes of a batch
+  // close in most files. Nodes with a dynamic instance are never batched.
+  struct Instance
+  {
+    int node;
+    glm::mat4 matrix;
+  };
+  struct Visit
+  {
+    int node;
+    glm::mat4 parentMatrix;
+    bool dynamic;
+  };
+  std::vector<Instance> instances;
+  std::vector<char> dynamicNodes(model.nodes.size(), 0);
+  std::vector<Visit> stack;
+  const auto &roots = model.scenes[model.defaultScene].nodes;
+  for (auto it = roots.rbegin(); it != roots.rend(); ++it) {
+    stack.push_back(Visit{*it, glm::mat4(1), false});
+  }
+  while (!stack.empty()) {
+    const auto visit = stack.back();
+    stack.pop_back();
+    if (visit.node < 0 || size_t(visit.node) >= model.nodes.size()) {
+      continue;
+    }
+    const auto &node = model.nodes[visit.node];
+    const auto matrix = getLocalToWorldMatrix(node, visit.parentMatrix);
+    const auto dynamic = visit.dynamic || animated[visit.node];
+    dynamicNodes[visit.node] |= char(dynamic);
+    if (node.mesh >= 0 && size_t(node.mesh) < model.meshes.size()) {
+      instances.push_back(Instance{visit.node, matrix});
+    }
+    for (auto it = node.children.rbegin(); it != node.children.rend(); ++it) {
+      stack.push_back(Visit{*it, matrix, dynamic});
+    }
+  }
+
+  // Attributes of the primitives of each mesh, empty if one of them cannot
+  // be batched
+  std::vector<std::vector<unsigned>> meshAttributes(model.meshes.size());
+  std::vector<char> meshChecked(model.meshes.size(), 0);
+  const auto batchedNode = [&](int nodeIdx) {
+    const auto &node = model.nodes[nodeIdx];
+    if (dynamicNodes[nodeIdx] || node.skin >= 0 ||
+        node.extensions.count("EXT_mesh_gpu_instancing") ||
+        node.extensions.count("MSFT_lod")) {
+      return false;
+    }
+    if (!meshChecked[node.mesh]) {
+      meshChecked[node.mesh] = 1;
+      auto &attributes = meshAttributes[node.mesh];
+      for (const auto &primitive : model.meshes[node.mesh].primitives) {
+        const auto primitiveAttributes = batchAttributes(model, primitive);
+        if (!primitiveAttributes) {
+          attributes.clear();
+          break;
+        }
+        attributes.push_back(primitiveAttributes);
+      }
+    }
+    return !meshAttributes[node.mesh].empty();
+  };
+
+  // Primitives with the same material and attributes fill a batch, then the
+  // next one
+  std::vector<Batch> batches;
+  std::vector<BatchedPrimitive> batched;
+  std::map<std::pair<int, unsigned>, size_t> openBatches;
+  std::vector<char> batchedNodes(model.nodes.size(), 0);
+  for (const auto &instance : instances) {
+    if (!batchedNode(instance.node)) {
+      continue;
+    }
+    batchedNodes[instance.node] = 1;
+    const auto &mesh = model.meshes[model.nodes[instance.node].mesh];
+    for (size_t i = 0; i < mesh.primitives.size(); ++i) {
+      const auto &primitive = mesh.primitives[i];
+      const auto attributes =
+          meshAttributes[model.nodes[instance.node].mesh][i];
+      const auto vertexCount = uint32_t(
+          findAttribute(model, primitive, BATCH_POSITION)->count);
+      const auto indexCount = primitive.indices >= 0
+                                  ? uint32_t(model.accessors[primitive.indices].count)
+                                  : vertexCount;
+
+      const auto key = std::make_pair(primitive.material, attributes);
+      auto it = openBatches.find(key);
+      if (it == end(openBatches) ||
+          batches[(*it).second].vertexCount + vertexCount >
+              STATIC_BATCH_MAX_VERTICES) {
+        Batch batch;
+        batch.material = primitive.material;
+        batch.attributes = attributes;
+        batches.push_back(batch);
+        it = openBatches.insert_or_assign(key, batches.size() - 1).first;
+      }
+      auto &batch = batches[(*it).second];
+      batched.push_back(BatchedPrimitive{&primitive, instance.matrix,
+          (*it).second, vertexCount, indexCount, batch.vertexCount,
+          batch.indexCount, Aabb()});
+      batch.vertexCount += vertexCount;
+      batch.indexCount += indexCount;
+    }
+  }
+  if (batches.empty()) {
+    return 0;
+  }
+
+  // Arrays of each batch, one attribute after the other then the indices
+  size_t size = 0;
+  for (auto &batch : batches) {
+    for (int i = 0; i < BATCH_ATTRIBUTE_COUNT; ++i) {
+      if (batch.attributes & (1u << i)) {
+        batch.offsets[i] = size;
+        size += size_t(batch.vertexCount) * ATTRIBUTE_COMPONENTS[i] *
+                sizeof(float);
+      }
+    }
+    batch.indicesOffset = size;
+    size += size_t(batch.indexCount) * sizeof(uint32_t);
+  }
+  std::vector<unsigned char> bytes(size);
+  JobSystem::shared().parallelFor(
+      batched.size(), 1, [&](size_t begin, size_t end) {
+        for (auto i = begin; i < end; ++i) {
+          copyPrimitive(model, buffers, batches[batched[i].batch], batched[i],
+              bytes.data());
+        }
+      });
+  for (const auto &primitive : batched) {
+    auto &bounds = batches[primitive.batch].bounds;
+    bounds.min = glm::min(bounds.min, primitive.bounds.min);
+    bounds.max = glm::max(bounds.max, primitive.bounds.max);
+  }
+
+  const auto bufferIdx = int(model.buffers.size());
+  tinygltf::Buffer buffer;
+  buffer.name = "Static batches";
+  model.buffers.push_back(std::move(buffer));
+  buffers.add(std::move(bytes));
+
+  const auto addAccessor = [&](size_t offset, size_t length, int target,
+                               int componentType, int type, size_t count) {
+    tinygltf::BufferView bufferView;
+    bufferView.buffer = bufferIdx;
+    bufferView.byteOffset = offset;
+    bufferView.byteLength = length;
+    bufferView.target = target;
+    model.bufferViews.push_back(std::move(bufferView));
+
+    tinygltf::Accessor accessor;
+    accessor.bufferView = int(model.bufferViews.size()) - 1;
+    accessor.componentType = componentType;
+    accessor.type = type;
+    accessor.count = count;
+    model.accessors.push_back(std::move(accessor));
+    return int(model.accessors.size()) - 1;
+  };
+
+  tinygltf::Mesh mesh;
+  mesh.name = "Static batches";
+  for (const auto &batch : batches) {
+    tinygltf::Primitive primitive;
+    primitive.mode = TINYGLTF_MODE_TRIANGLES;
+    primitive.material = batch.material;
+    for (int i = 0; i < BATCH_ATTRIBUTE_COUNT; ++i) {
+      if (batch.attributes & (1u << i)) {
+        primitive.attributes[ATTRIBUTE_NAMES[i]] = addAccessor(
+            batch.offsets[i],
+            size_t(batch.vertexCount) * ATTRIBUTE_COMPONENTS[i] * sizeof(float),
+            ARRAY_BUFFER, TINYGLTF_COMPONENT_TYPE_FLOAT, ATTRIBUTE_TYPES[i],
+            batch.vertexCount);
+      }
+    }
+    // Bounds of the batch for culling, as glTF requires for positions
+    auto &positions =
+        model.accessors[primitive.attributes[ATTRIBUTE_NAMES[BATCH_POSITION]]];
+    positions.minValues = {
+        batch.bounds.min.x, batch.bounds.min.y, batch.bounds.min.z};
+    positions.maxValues = {
+        batch.bounds.max.x, batch.bounds.max.y, batch.bounds.max.z};
+    primitive.indices = addAccessor(batch.indicesOffset,
+        size_t(batch.indexCount) * sizeof(uint32_t), ELEMENT_ARRAY_BUFFER,
+        TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT, TINYGLTF_TYPE_SCALAR,
+        batch.indexCount);
+    mesh.primitives.push_back(std::move(primitive));
+  }
+  model.meshes.push_back(std::move(mesh));
+
+  size_t nodeCount = 0;
+  for (size_t i = 0; i < model.nodes.size(); ++i) {
+    if (batchedNodes[i]) {
+      model.nodes[i].mesh = -1;
+      ++nodeCount;
+    }
+  }
+  tinygltf::Node node;
+  node.name = "Static batches";
+  node.mesh = int(model.meshes.size()) - 1;
+  model.nodes.push_back(std::move(node));
+  model.scenes[model.defaultScene].nodes.push_back(
+      int(model.nodes.size()) - 1);
+  return nodeCount;
+}
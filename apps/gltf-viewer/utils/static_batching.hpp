@@ -0,0 +1,26 @@
+#pragma once
+
+#include "gltf_loader.hpp"
+
+#include <tiny_gltf.h>
+
+#include <cstddef>
+
+// Primitives of a static batch have at most this many vertices, so that their
+// indices still fit in 16 bits (see packedIndexType()) and the batches stay
+// small enough to be culled. Larger primitives keep their node.
+const size_t STATIC_BATCH_MAX_VERTICES = 65536;
+
+// Merge the meshes of the static nodes of the default scene into a mesh with
+// one primitive per material, in world space, drawn by a new root node with
+// no transform. A node is static if neither it nor any ancestor is the target
+// of an animation channel, wherever it is instanced, and it has no skin,
+// EXT_mesh_gpu_instancing nor MSFT_lod. It is batched if every primitive of
+// its mesh is a triangle list without morph targets nor extensions, whose
+// FLOAT attributes have at most STATIC_BATCH_MAX_VERTICES vertices.
+// Batched nodes lose their mesh but stay in the scene, for their children.
+//
+// Vertices are transformed by jobs, one per batched primitive, into a buffer
+// added to buffers. Only the POSITION, NORMAL, TANGENT and TEXCOORD_0
+// attributes the viewer draws are kept. Return the number of nodes batched.
+size_t batchStaticNodes(tinygltf::Model &model, GltfBuffers &buffers);
@@ -0,0 +1,102 @@
+#include "task_graph.hpp"
+
+#include "trace.hpp"
+
+TaskGraph::~TaskGraph() { JobSystem::shared().wait(m_group); }
+
+TaskGraph::Task TaskGraph::add(TaskThread thread,
+    std::function<bool()> function, std::initializer_list<Task> dependencies)
+{
+  const auto task = m_nodes.size();
+  m_nodes.emplace_back();
+  auto &node = m_nodes.back();
+  node.thread = thread;
+  node.function = std::move(function);
+  for (const auto dependency : dependencies) {
+    m_nodes[dependency].dependents.push_back(task);
+    ++node.dependencyCount;
+  }
+  return task;
+}
+
+bool TaskGraph::run()
+{
+  TRACE_ZONE("TaskGraph::run");
+  for (auto &node : m_nodes) {
+    node.pending = node.dependencyCount;
+  }
+  for (Task task = 0; task < m_nodes.size(); ++task) {
+    if (m_nodes[task].dependencyCount == 0) {
+      ready(task);
+    }
+  }
+
+  auto &jobs = JobSystem::shared();
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (m_doneCount < m_nodes.size()) {
+    if (!m_contextTasks.empty()) {
+      const auto task = m_contextTasks.front();
+      m_contextTasks.pop_front();
+      lock.unlock();
+      execute(task);
+      lock.lock();
+      continue;
+    }
+
+    // Worker tasks queued while none of the workers is free, or without
+    // workers, run here
+    const auto queuedJobs = m_queuedJobs;
+    lock.unlock();
+    const bool ran = jobs.runQueued();
+    lock.lock();
+    if (!ran) {
+      m_changed.wait(lock, [&]() {
+        return !m_contextTasks.empty() || m_doneCount == m_nodes.size() ||
+               m_queuedJobs != queuedJobs;
+      });
+    }
+  }
+  lock.unlock();
+
+  jobs.wait(m_group);
+  return !m_failed && !m_cancelled;
+}
+
+void TaskGraph::cancel()
+{
+  m_cancelled = true;
+}
+
+void TaskGraph::ready(Task task)
+{
+  if (m_nodes[task].thread == TASK_WORKER) {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      ++m_queuedJobs;
+    }
+    JobSystem::shared().run(m_group, [this, task]() { execute(task); });
+  } else {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_contextTasks.push_back(task);
+  }
+  m_changed.notify_all();
+}
+
+void TaskGraph::execute(Task task)
+{
+  auto &node = m_nodes[task];
+  if (!m_failed && !m_cancelled && !node.function()) {
+    m_failed = true;
+  }
+  // Skipped dependents still complete, so that run() returns
+  for (const auto dependent : node.dependents) {
+    if (--m_nodes[dependent].pending == 0) {
+      ready(dependent);
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_doneCount;
+  }
+  m_changed.notify_all();
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "job_system.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <mutex>
+#include <vector>
+
+// Steps of a pipeline, each run once the steps it depends on are done:
+// worker tasks on the jobs of JobSystem::shared(), context tasks on the thread
+// calling run(), which owns the GL context they need. Independent steps
+// overlap, CPU work on the workers while the context thread uploads. A task
+// returning false, or cancel(), skips every task not started yet.
+class TaskGraph
+{
+public:
+  using Task = size_t;
+
+  enum TaskThread
+  {
+    TASK_WORKER,
+    TASK_CONTEXT
+  };
+
+  TaskGraph() = default;
+  ~TaskGraph(); // Waits for the worker tasks
+
+  TaskGraph(const TaskGraph &) = delete;
+  TaskGraph &operator=(const TaskGraph &) = delete;
+
+  // Tasks are added before run(), after the tasks they depend on
+  Task add(TaskThread thread, std::function<bool()> function,
+      std::initializer_list<Task> dependencies = {});
+
+  // Run the context tasks as they get ready, and queued jobs while none is,
+  // until every task is done or skipped. False if a task failed or the graph
+  // was cancelled.
+  bool run();
+
+  // From any thread: run() returns once the running tasks are done
+  void cancel();
+  // For long tasks to return early
+  bool cancelled() const { return m_cancelled; }
+
+private:
+  struct Node
+  {
+    TaskThread thread;
+    std::function<bool()> function;
+    std::vector<Task> dependents;
+    size_t dependencyCount = 0;
+    std::atomic<size_t> pending{0}; // Dependencies not done yet
+  };
+
+  // Queue a task whose dependencies are done
+  void ready(Task task);
+  // Run or skip a task, then ready the dependents it was the last one of
+  void execute(Task task);
+
+  std::deque<Node> m_nodes; // Stable addresses for the jobs
+  std::atomic<bool> m_cancelled{false};
+  std::atomic<bool> m_failed{false};
+
+  std::mutex m_mutex;
+  std::condition_variable m_changed;
+  std::deque<Task> m_contextTasks; // Ready, in order
+  size_t m_doneCount = 0;
+  size_t m_queuedJobs = 0; // Worker tasks queued so far
+  JobSystem::Group m_group;
+};
@@ -0,0 +1,126 @@
+#include "temporal_aa.hpp"
+#include "gpu_memory.hpp"
+
+#include <cassert>
+
+namespace
+{
+
+// Jitters cycle through the first points of the Halton sequence of bases 2
+// and 3, evenly spread over the pixel whatever the number of frames
+const size_t JITTER_COUNT = 8;
+
+float halton(size_t index, size_t base)
+{
+  float result = 0;
+  float fraction = 1;
+  for (; index > 0; index /= base) {
+    fraction /= float(base);
+    result += fraction * float(index % base);
+  }
+  return result;
+}
+
+GLuint createTarget(GLenum format, GLsizei width, GLsizei height)
+{
+  GLuint texture = 0;
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexStorage2D(GL_TEXTURE_2D, 1, format, width, height);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  trackTexture(GpuMemoryCategory::RenderTargets, GL_TEXTURE_2D, texture);
+  return texture;
+}
+
+} // namespace
+
+TemporalAntiAliasing::~TemporalAntiAliasing() { release(); }
+
+void TemporalAntiAliasing::release()
+{
+  if (m_framebuffer) {
+    glDeleteFramebuffers(1, &m_framebuffer);
+  }
+  const GLuint textures[] = {
+      m_color, m_velocity, m_depth, m_history[0], m_history[1]};
+  if (m_color) {
+    untrackTextures(5, textures);
+    glDeleteTextures(5, textures);
+  }
+  m_framebuffer = m_color = m_velocity = m_depth = 0;
+  m_history[0] = m_history[1] = 0;
+}
+
+void TemporalAntiAliasing::init(GLsizei width, GLsizei height)
+{
+  release();
+  m_width = width;
+  m_height = height;
+  m_frameSize = m_historySize = glm::ivec2(width, height);
+  m_frameIndex = 0;
+  m_historyValid = false;
+
+  GLint previousTexture = 0;
+  GLint previousFramebuffer = 0;
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTexture);
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+
+  // Frames are linear radiance, tonemapped after the resolve. The history
+  // keeps the precision of the blend of many of them.
+  m_color = createTarget(GL_R11F_G11F_B10F, width, height);
+  m_velocity = createTarget(GL_RG16F, width, height);
+  m_depth = createTarget(GL_DEPTH_COMPONENT32F, width, height);
+  for (auto &history : m_history) {
+    history = createTarget(GL_RGBA16F, width, height);
+  }
+  glBindTexture(GL_TEXTURE_2D, GLuint(previousTexture));
+
+  glGenFramebuffers(1, &m_framebuffer);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_framebuffer);
+  glFramebufferTexture(
+      GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, m_color, 0);
+  glFramebufferTexture(
+      GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, m_velocity, 0);
+  glFramebufferTexture(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_depth, 0);
+  const GLenum drawBuffers[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+  glDrawBuffers(2, drawBuffers);
+
+  const auto framebufferStatus = glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER);
+  assert(framebufferStatus == GL_FRAMEBUFFER_COMPLETE);
+  (void)framebufferStatus;
+
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, GLuint(previousFramebuffer));
+}
+
+void TemporalAntiAliasing::beginFrame(GLsizei width, GLsizei height)
+{
+  assert(width <= m_width && height <= m_height);
+  m_frameSize = glm::ivec2(width, height);
+}
+
+glm::vec2 TemporalAntiAliasing::jitter() const
+{
+  const auto index = m_frameIndex % JITTER_COUNT + 1;
+  return glm::vec2(halton(index, 2), halton(index, 3)) - 0.5f;
+}
+
+glm::mat4 TemporalAntiAliasing::jitterMatrix() const
+{
+  // A shift of normalized device coordinates, applied in clip space where
+  // they are multiplied by w
+  const auto offset = 2.f * jitter() / glm::vec2(m_frameSize);
+  glm::mat4 matrix(1);
+  matrix[3][0] = offset.x;
+  matrix[3][1] = offset.y;
+  return matrix;
+}
+
+void TemporalAntiAliasing::endFrame()
+{
+  ++m_frameIndex;
+  m_historySize = m_frameSize;
+  m_historyValid = true;
+}
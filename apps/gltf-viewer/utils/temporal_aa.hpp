@@ -0,0 +1,77 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+
+// Targets of temporal anti-aliasing: frames are rendered with their projection
+// moved by a sub-pixel jitter that changes every frame, to a color, a velocity
+// and a depth texture. A resolve pass then blends each frame with the history
+// of the previous ones, reprojected along the velocities, and writes the
+// result to the other history texture to be read by the next frame.
+//
+// Colors are the linear radiance the shaders output, tonemapped once
+// resolved, velocities the motion in texture coordinates of the unjittered
+// image since the previous frame, current minus previous.
+//
+// Frames may be smaller than the targets and cover their bottom left corner,
+// for dynamic resolution. The history is resampled when their size changes.
+class TemporalAntiAliasing
+{
+public:
+  TemporalAntiAliasing() = default;
+  ~TemporalAntiAliasing();
+
+  TemporalAntiAliasing(const TemporalAntiAliasing &) = delete;
+  TemporalAntiAliasing &operator=(const TemporalAntiAliasing &) = delete;
+
+  // Allocate the targets of width x height pixels, the history is reset
+  void init(GLsizei width, GLsizei height);
+
+  GLsizei width() const { return m_width; }
+  GLsizei height() const { return m_height; }
+
+  // Start a frame of width x height pixels, at most the size of the targets
+  void beginFrame(GLsizei width, GLsizei height);
+  glm::ivec2 frameSize() const { return m_frameSize; }
+  // Of the frame written to history()
+  glm::ivec2 historySize() const { return m_historySize; }
+
+  // Color attachment 0 of colors, 1 of velocities, and depth
+  GLuint framebuffer() const { return m_framebuffer; }
+  GLuint color() const { return m_color; }
+  GLuint velocity() const { return m_velocity; }
+  GLuint depth() const { return m_depth; }
+
+  // Offset of the current frame in pixels, within half a pixel of 0
+  glm::vec2 jitter() const;
+  // Clip space matrix moving the image drawn with a projection by jitter()
+  glm::mat4 jitterMatrix() const;
+
+  // History written by the previous frame, meaningless unless historyValid()
+  GLuint history() const { return m_history[m_frameIndex % 2]; }
+  // Written by the resolve of the current frame
+  GLuint resolved() const { return m_history[(m_frameIndex + 1) % 2]; }
+  bool historyValid() const { return m_historyValid; }
+
+  // The next frame is resolved without history, as after init()
+  void reset() { m_historyValid = false; }
+  // Once resolved() is written, it becomes the history of the next frame
+  void endFrame();
+
+private:
+  void release();
+
+  GLsizei m_width = 0;
+  GLsizei m_height = 0;
+  glm::ivec2 m_frameSize = glm::ivec2(0);
+  glm::ivec2 m_historySize = glm::ivec2(0);
+  GLuint m_framebuffer = 0;
+  GLuint m_color = 0;
+  GLuint m_velocity = 0;
+  GLuint m_depth = 0;
+  GLuint m_history[2] = {0, 0};
+  size_t m_frameIndex = 0;
+  bool m_historyValid = false;
+};
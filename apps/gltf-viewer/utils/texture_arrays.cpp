@@ -0,0 +1,107 @@
+#include "texture_arrays.hpp"
+#include "gpu_memory.hpp"
+
+#include <algorithm>
+
+namespace
+{
+
+// Storage shared by the layers of an array
+struct TextureArrayFormat
+{
+  GLint internalFormat = 0;
+  GLint width = 0;
+  GLint height = 0;
+  GLint levels = 0;
+
+  bool operator==(const TextureArrayFormat &other) const
+  {
+    return internalFormat == other.internalFormat && width == other.width &&
+           height == other.height && levels == other.levels;
+  }
+};
+
+TextureArrayFormat getTextureFormat(GLuint texture)
+{
+  TextureArrayFormat format;
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glGetTexLevelParameteriv(
+      GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &format.internalFormat);
+  glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &format.width);
+  glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &format.height);
+  glGetTexParameteriv(
+      GL_TEXTURE_2D, GL_TEXTURE_IMMUTABLE_LEVELS, &format.levels);
+  return format;
+}
+
+} // namespace
+
+std::vector<TextureArrayLayer> packTextureArrays(
+    const std::vector<GLuint> &textures, std::vector<GLuint> &arrays)
+{
+  GLint maxLayers = 0;
+  glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+
+  // Assign layers, an array is full once it has maxLayers layers
+  std::vector<TextureArrayFormat> formats;
+  std::vector<GLint> layerCounts;
+  std::vector<int> textureArrays(textures.size(), -1);
+  std::vector<TextureArrayLayer> layers(textures.size());
+  for (size_t i = 0; i < textures.size(); ++i) {
+    if (!textures[i]) {
+      continue;
+    }
+    const auto format = getTextureFormat(textures[i]);
+    if (!format.width || !format.height || !format.levels) {
+      continue;
+    }
+    size_t arrayIdx = 0;
+    while (arrayIdx < formats.size() &&
+           (!(formats[arrayIdx] == format) ||
+               layerCounts[arrayIdx] == maxLayers)) {
+      ++arrayIdx;
+    }
+    if (arrayIdx == formats.size()) {
+      formats.push_back(format);
+      layerCounts.push_back(0);
+    }
+    textureArrays[i] = int(arrayIdx);
+    layers[i].layer = layerCounts[arrayIdx]++;
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  std::vector<GLuint> arrayObjects(formats.size());
+  if (!arrayObjects.empty()) {
+    glGenTextures(GLsizei(arrayObjects.size()), arrayObjects.data());
+  }
+  for (size_t i = 0; i < arrayObjects.size(); ++i) {
+    const auto &format = formats[i];
+    glBindTexture(GL_TEXTURE_2D_ARRAY, arrayObjects[i]);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, format.levels,
+        GLenum(format.internalFormat), format.width, format.height,
+        layerCounts[i]);
+    trackTexture(GpuMemoryCategory::MaterialTextures, GL_TEXTURE_2D_ARRAY,
+        arrayObjects[i]);
+  }
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+  // The copy stays on the GPU, compressed blocks included
+  for (size_t i = 0; i < textures.size(); ++i) {
+    if (textureArrays[i] < 0) {
+      continue;
+    }
+    const auto &format = formats[textureArrays[i]];
+    layers[i].texture = arrayObjects[textureArrays[i]];
+    for (GLint level = 0; level < format.levels; ++level) {
+      glCopyImageSubData(textures[i], GL_TEXTURE_2D, level, 0, 0, 0,
+          layers[i].texture, GL_TEXTURE_2D_ARRAY, level, 0, 0, layers[i].layer,
+          std::max(format.width >> level, 1),
+          std::max(format.height >> level, 1), 1);
+    }
+    untrackTextures(1, &textures[i]);
+    glDeleteTextures(1, &textures[i]);
+  }
+
+  arrays.insert(end(arrays), begin(arrayObjects), end(arrayObjects));
+  return layers;
+}
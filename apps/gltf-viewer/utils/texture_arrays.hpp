@@ -0,0 +1,20 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <vector>
+
+// Layer of a GL_TEXTURE_2D_ARRAY a 2D texture has been copied to
+struct TextureArrayLayer
+{
+  GLuint texture = 0; // 0 if the texture has not been packed
+  GLint layer = 0;
+};
+
+// Copy 2D textures sharing their internal format, size and number of levels to
+// the layers of a GL_TEXTURE_2D_ARRAY, so that materials referencing them bind
+// the same texture objects. Textures must have immutable storage, those
+// without storage are skipped. Packed textures are deleted, the arrays created
+// are appended to arrays. Return the layer of each texture.
+std::vector<TextureArrayLayer> packTextureArrays(
+    const std::vector<GLuint> &textures, std::vector<GLuint> &arrays);
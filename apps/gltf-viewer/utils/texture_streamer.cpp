@@ -0,0 +1,327 @@
+#include "texture_streamer.hpp"
+#include "gpu_memory.hpp"
+#include "heap_memory.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+
+// Levels up to this size are uploaded with the texture and never evicted
+const GLsizei STREAMING_MIN_SIZE = 64;
+
+// Levels streamed in by one update, so that a frame never uploads much
+const size_t STREAMING_LEVELS_PER_UPDATE = 4;
+
+// Staging regions of the levels streamed in by one update
+const size_t STREAMING_STAGING_SIZE = 16 << 20;
+
+// Replaced texture objects are deleted after this many updates, frames in
+// flight may still sample them before
+const uint64_t RETIRE_UPDATES = 3;
+
+float srgbToLinear(float value)
+{
+  return value <= 0.04045f ? value / 12.92f
+                           : std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+float linearToSrgb(float value)
+{
+  return value <= 0.0031308f ? value * 12.92f
+                             : 1.055f * std::pow(value, 1.f / 2.4f) - 0.055f;
+}
+
+template <typename Component>
+void downsample(const Component *source, GLsizei width, GLsizei height,
+    Component *destination, bool srgb)
+{
+  const auto maxValue = float(std::numeric_limits<Component>::max());
+  float srgbTable[256];
+  if (srgb) {
+    for (int i = 0; i < 256; ++i) {
+      srgbTable[i] = srgbToLinear(i / 255.f);
+    }
+  }
+
+  const auto levelWidth = std::max(width / 2, 1);
+  const auto levelHeight = std::max(height / 2, 1);
+  for (GLsizei y = 0; y < levelHeight; ++y) {
+    for (GLsizei x = 0; x < levelWidth; ++x) {
+      for (int c = 0; c < 4; ++c) {
+        // Odd sizes drop their last row or column
+        float sum = 0;
+        for (GLsizei j = 0; j < 2; ++j) {
+          for (GLsizei i = 0; i < 2; ++i) {
+            const auto sx = std::min(2 * x + i, width - 1);
+            const auto sy = std::min(2 * y + j, height - 1);
+            const auto value = source[(size_t(sy) * width + sx) * 4 + c];
+            sum += srgb && c < 3 ? srgbTable[value] : value / maxValue;
+          }
+        }
+        const auto average = sum / 4;
+        const auto encoded =
+            srgb && c < 3 ? linearToSrgb(average) : average;
+        destination[(size_t(y) * levelWidth + x) * 4 + c] =
+            Component(encoded * maxValue + 0.5f);
+      }
+    }
+  }
+}
+
+// Immutable storage for the levels of a chain from level to the last one, on
+// the texture bound to GL_TEXTURE_2D
+void allocateLevels(const TextureMipChain &chain, size_t level)
+{
+  glTexStorage2D(GL_TEXTURE_2D, GLsizei(chain.levels.size() - level),
+      chain.internalFormat, std::max(chain.width >> level, 1),
+      std::max(chain.height >> level, 1));
+}
+
+void uploadLevel(const TextureMipChain &chain, size_t level,
+    GLint storageLevel, TextureUploader &uploader)
+{
+  const auto &pixels = chain.levels[level];
+  const auto *data = uploader.stage(pixels.data(), pixels.size());
+  const auto width = std::max(chain.width >> level, 1);
+  const auto height = std::max(chain.height >> level, 1);
+  if (chain.compressed) {
+    glCompressedTexSubImage2D(GL_TEXTURE_2D, storageLevel, 0, 0, width, height,
+        chain.internalFormat, GLsizei(pixels.size()), data);
+  } else {
+    glTexSubImage2D(GL_TEXTURE_2D, storageLevel, 0, 0, width, height, GL_RGBA,
+        chain.type, data);
+  }
+}
+
+} // namespace
+
+void generateMipChain(TextureMipChain &chain, bool srgb)
+{
+  HeapTagScope heapTag(HeapTag::Images);
+  chain.levels.resize(1);
+  const auto componentSize = chain.type == GL_UNSIGNED_SHORT ? 2 : 1;
+  for (size_t level = 1;
+       std::max(chain.width, chain.height) >> (level - 1) > 1; ++level) {
+    const auto width = std::max(chain.width >> (level - 1), 1);
+    const auto height = std::max(chain.height >> (level - 1), 1);
+    std::vector<unsigned char> pixels(size_t(std::max(width / 2, 1)) *
+                                      std::max(height / 2, 1) * 4 *
+                                      componentSize);
+    const auto &source = chain.levels.back();
+    if (componentSize == 2) {
+      downsample((const uint16_t *)source.data(), width, height,
+          (uint16_t *)pixels.data(), false);
+    } else {
+      downsample(source.data(), width, height, pixels.data(), srgb);
+    }
+    chain.levels.push_back(std::move(pixels));
+  }
+}
+
+TextureStreamer::~TextureStreamer()
+{
+  for (const auto &retired : m_retired) {
+    untrackTextures(1, &retired.first);
+    glDeleteTextures(1, &retired.first);
+  }
+}
+
+void TextureStreamer::init(size_t budgetBytes)
+{
+  m_budgetBytes = budgetBytes;
+  m_uploader.init(STREAMING_STAGING_SIZE);
+}
+
+void TextureStreamer::addTexture(size_t textureIdx, GLuint texture,
+    TextureMipChain chain, TextureUploader &uploader)
+{
+  if (textureIdx >= m_textures.size()) {
+    m_textures.resize(textureIdx + 1);
+  }
+
+  auto &streamed = m_textures[textureIdx];
+  streamed.chain = std::move(chain);
+  streamed.texture = texture;
+  const auto &levels = streamed.chain.levels;
+
+  // The coarse levels, or at least the last one
+  streamed.residentLevel = levels.size() - 1;
+  while (streamed.residentLevel > 0 &&
+         std::max(streamed.chain.width, streamed.chain.height) >>
+                 (streamed.residentLevel - 1) <=
+             STREAMING_MIN_SIZE) {
+    --streamed.residentLevel;
+  }
+  streamed.requestedLevel = levels.size();
+
+  allocateLevels(streamed.chain, streamed.residentLevel);
+  for (auto level = streamed.residentLevel; level < levels.size(); ++level) {
+    uploadLevel(streamed.chain, level, GLint(level - streamed.residentLevel),
+        uploader);
+    m_residentBytes += levelSize(streamed, level);
+    m_uploadedBytes += levelSize(streamed, level);
+  }
+
+  ++m_textureCount;
+}
+
+void TextureStreamer::requestFootprint(size_t textureIdx, float pixels)
+{
+  if (textureIdx >= m_textures.size() ||
+      m_textures[textureIdx].chain.levels.empty()) {
+    return;
+  }
+
+  // One texel per pixel if the texture is mapped once on the footprint
+  auto &texture = m_textures[textureIdx];
+  const auto size = float(std::max(texture.chain.width, texture.chain.height));
+  const auto level =
+      pixels >= size ? 0 : size_t(std::log2(size / std::max(pixels, 1.f)));
+  texture.requestedLevel = std::min(texture.requestedLevel, level);
+}
+
+void TextureStreamer::setResidentLevel(
+    size_t textureIdx, size_t level, const ReplaceCallback &onReplace)
+{
+  auto &texture = m_textures[textureIdx];
+  const auto &levels = texture.chain.levels;
+
+  GLuint replacement;
+  glGenTextures(1, &replacement);
+  glBindTexture(GL_TEXTURE_2D, replacement);
+  allocateLevels(texture.chain, level);
+  trackTexture(GpuMemoryCategory::MaterialTextures, GL_TEXTURE_2D, replacement);
+
+  // Levels already resident are copied on the GPU
+  for (auto i = level; i < levels.size(); ++i) {
+    if (i < texture.residentLevel) {
+      uploadLevel(texture.chain, i, GLint(i - level), m_uploader);
+      m_residentBytes += levelSize(texture, i);
+      m_uploadedBytes += levelSize(texture, i);
+      continue;
+    }
+    glCopyImageSubData(texture.texture, GL_TEXTURE_2D,
+        GLint(i - texture.residentLevel), 0, 0, 0, replacement, GL_TEXTURE_2D,
+        GLint(i - level), 0, 0, 0, std::max(texture.chain.width >> i, 1),
+        std::max(texture.chain.height >> i, 1), 1);
+  }
+  for (auto i = texture.residentLevel; i < level; ++i) {
+    m_residentBytes -= levelSize(texture, i);
+  }
+
+  onReplace(textureIdx, texture.texture, replacement);
+  m_retired.emplace_back(texture.texture, m_update);
+  texture.texture = replacement;
+  texture.residentLevel = level;
+}
+
+bool TextureStreamer::update(const ReplaceCallback &onReplace)
+{
+  ++m_update;
+
+  const auto retiredEnd = std::partition(begin(m_retired), end(m_retired),
+      [&](const std::pair<GLuint, uint64_t> &retired) {
+        return retired.second + RETIRE_UPDATES > m_update;
+      });
+  for (auto it = retiredEnd; it != end(m_retired); ++it) {
+    untrackTextures(1, &(*it).first);
+    glDeleteTextures(1, &(*it).first);
+  }
+  m_retired.erase(retiredEnd, end(m_retired));
+
+  // Textures needing finer levels, those missing the most levels first
+  std::vector<size_t> pending;
+  for (size_t i = 0; i < m_textures.size(); ++i) {
+    auto &texture = m_textures[i];
+    if (texture.chain.levels.empty()) {
+      continue;
+    }
+    if (texture.requestedLevel <= texture.residentLevel) {
+      texture.lastNeeded = m_update;
+    }
+    if (texture.requestedLevel < texture.residentLevel) {
+      pending.push_back(i);
+    }
+  }
+  m_pendingCount = pending.size();
+  std::sort(begin(pending), end(pending), [&](size_t lhs, size_t rhs) {
+    const auto &l = m_textures[lhs];
+    const auto &r = m_textures[rhs];
+    return l.residentLevel - l.requestedLevel >
+           r.residentLevel - r.requestedLevel;
+  });
+
+  bool replaced = false;
+  size_t streamedLevels = 0;
+  for (const auto textureIdx : pending) {
+    if (streamedLevels == STREAMING_LEVELS_PER_UPDATE) {
+      break;
+    }
+    const auto &texture = m_textures[textureIdx];
+    const auto size = levelSize(texture, texture.residentLevel - 1);
+
+    // Evict the finest level of the texture needed least recently, levels
+    // needed by this update are kept
+    while (m_residentBytes + size > m_budgetBytes) {
+      size_t victim = m_textures.size();
+      for (size_t i = 0; i < m_textures.size(); ++i) {
+        const auto &candidate = m_textures[i];
+        if (i == textureIdx || candidate.chain.levels.empty() ||
+            candidate.lastNeeded == m_update ||
+            std::max(candidate.chain.width, candidate.chain.height) >>
+                    candidate.residentLevel <=
+                STREAMING_MIN_SIZE) {
+          continue;
+        }
+        if (victim == m_textures.size() ||
+            candidate.lastNeeded < m_textures[victim].lastNeeded) {
+          victim = i;
+        }
+      }
+      if (victim == m_textures.size()) {
+        break;
+      }
+      setResidentLevel(victim, m_textures[victim].residentLevel + 1, onReplace);
+      ++m_evictedLevels;
+      replaced = true;
+    }
+    if (m_residentBytes + size > m_budgetBytes) {
+      break; // Everything resident is needed
+    }
+
+    setResidentLevel(textureIdx, texture.residentLevel - 1, onReplace);
+    ++m_streamedLevels;
+    ++streamedLevels;
+    replaced = true;
+  }
+
+  for (auto &texture : m_textures) {
+    texture.requestedLevel = texture.chain.levels.size();
+  }
+
+  m_uploader.finish();
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  return replaced;
+}
+
+TextureStreamer::Stats TextureStreamer::stats() const
+{
+  Stats stats;
+  stats.residentBytes = m_residentBytes;
+  stats.budgetBytes = m_budgetBytes;
+  stats.textureCount = m_textureCount;
+  stats.streamedLevels = m_streamedLevels;
+  stats.evictedLevels = m_evictedLevels;
+  stats.uploadedBytes = m_uploadedBytes;
+  stats.pendingCount = m_pendingCount;
+  for (const auto &texture : m_textures) {
+    if (!texture.chain.levels.empty() && texture.residentLevel == 0) {
+      ++stats.fullyResidentCount;
+    }
+  }
+  return stats;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "texture_uploader.hpp"
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Every mip level of a texture, kept in memory while it is streamed
+struct TextureMipChain
+{
+  GLenum internalFormat = 0;
+  bool compressed = false;
+  GLenum type = GL_UNSIGNED_BYTE; // Of GL_RGBA pixels if not compressed
+  GLsizei width = 0;
+  GLsizei height = 0;
+  std::vector<std::vector<unsigned char>> levels; // Level 0 is the largest
+};
+
+// Fill the levels of a chain from its level 0 of GL_RGBA / GL_UNSIGNED_BYTE or
+// GL_UNSIGNED_SHORT pixels with a box filter, down to 1x1. 8 bits texels are
+// averaged in linear space if srgb is set.
+void generateMipChain(TextureMipChain &chain, bool srgb);
+
+// Keeps the coarse mip levels of textures resident and streams the finer ones
+// in as their on-screen footprint requires, evicting the levels needed least
+// recently to stay under a memory budget. Changing the resident levels of a
+// texture replaces its texture object, since the storage of immutable textures
+// cannot be resized.
+class TextureStreamer
+{
+public:
+  struct Stats
+  {
+    size_t residentBytes = 0;
+    size_t budgetBytes = 0;
+    size_t textureCount = 0;
+    size_t fullyResidentCount = 0;
+    size_t pendingCount = 0; // Textures needing finer levels, last update
+    size_t streamedLevels = 0; // Since initialization
+    size_t evictedLevels = 0;
+    size_t uploadedBytes = 0;
+  };
+
+  // Called with the index of a texture, its previous texture object and the
+  // one replacing it. The previous object is deleted a few updates later, once
+  // the frames that may sample it are done.
+  using ReplaceCallback =
+      std::function<void(size_t textureIdx, GLuint previous, GLuint texture)>;
+
+  ~TextureStreamer();
+
+  void init(size_t budgetBytes);
+
+  bool empty() const { return m_textureCount == 0; }
+
+  // Stream the texture of index textureIdx from chain. Only its coarse levels
+  // are uploaded, to texture which must be bound on GL_TEXTURE_2D and have no
+  // storage.
+  void addTexture(size_t textureIdx, GLuint texture, TextureMipChain chain,
+      TextureUploader &uploader);
+
+  // Request the level of a texture covering pixels pixels on screen for the
+  // next update. Ignored for textures which are not streamed.
+  void requestFootprint(size_t textureIdx, float pixels);
+
+  // Stream in a few of the requested levels and forget the requests. Return
+  // true if a texture object has been replaced.
+  bool update(const ReplaceCallback &onReplace);
+
+  Stats stats() const;
+
+private:
+  struct Texture
+  {
+    TextureMipChain chain; // No levels if the texture is not streamed
+    GLuint texture = 0;
+    size_t residentLevel = 0; // Finest resident level
+    size_t requestedLevel = 0; // Finest level requested since last update
+    uint64_t lastNeeded = 0; // Last update the finest level was requested at
+  };
+
+  size_t levelSize(const Texture &texture, size_t level) const
+  {
+    return texture.chain.levels[level].size();
+  }
+  // Replace the texture object by one whose finest level is level
+  void setResidentLevel(size_t textureIdx, size_t level,
+      const ReplaceCallback &onReplace);
+
+  std::vector<Texture> m_textures;
+  size_t m_textureCount = 0;
+  size_t m_budgetBytes = 0;
+  size_t m_residentBytes = 0;
+  uint64_t m_update = 1;
+  size_t m_streamedLevels = 0;
+  size_t m_evictedLevels = 0;
+  size_t m_uploadedBytes = 0;
+  size_t m_pendingCount = 0;
+  TextureUploader m_uploader;
+  // Replaced texture objects and the update they were replaced at
+  std::vector<std::pair<GLuint, uint64_t>> m_retired;
+};
@@ -0,0 +1,52 @@
+#include "texture_uploader.hpp"
+#include "job_system.hpp"
+
+namespace
+{
+
+// Offsets of staged data, enough for any pixel type and compressed block
+const size_t STAGING_ALIGNMENT = 16;
+
+} // namespace
+
+void TextureUploader::init(size_t regionSize, size_t regionCount)
+{
+  m_staging.init(regionSize, STAGING_ALIGNMENT, regionCount,
+      GpuMemoryCategory::Staging);
+  m_region = nullptr;
+  m_offset = 0;
+}
+
+const void *TextureUploader::stage(const void *data, size_t size)
+{
+  m_uploadedBytes += size;
+  if (m_staging.empty() || size > m_staging.regionSize()) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return data;
+  }
+
+  if (!m_region || m_offset + size > m_staging.regionSize()) {
+    if (m_region) {
+      m_staging.endRegion();
+    }
+    m_region = static_cast<unsigned char *>(m_staging.beginRegion());
+    m_offset = 0;
+  }
+
+  parallelCopy(m_region + m_offset, data, size);
+  const auto offset = size_t(m_staging.regionOffset()) + m_offset;
+  m_offset += (size + STAGING_ALIGNMENT - 1) / STAGING_ALIGNMENT *
+              STAGING_ALIGNMENT;
+
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_staging.buffer());
+  return reinterpret_cast<const void *>(offset);
+}
+
+void TextureUploader::finish()
+{
+  if (m_region) {
+    m_staging.endRegion();
+    m_region = nullptr;
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "ring_buffer.hpp"
+
+#include <glad/glad.h>
+
+#include <cstddef>
+
+// Streams pixels to textures through a persistently mapped pixel unpack
+// buffer. Pixels are copied to a staging region and the upload command reads
+// them from there, so that the driver copies them to the texture
+// asynchronously instead of from client memory. A region is reused once the
+// GPU is done with the uploads that read it.
+class TextureUploader
+{
+public:
+  // Allocate regionCount staging regions of regionSize bytes
+  void init(size_t regionSize, size_t regionCount = 3);
+
+  // Copy size bytes to the staging buffer and bind it on
+  // GL_PIXEL_UNPACK_BUFFER. Return the pointer to pass to glTexSubImage2D or
+  // glCompressedTexSubImage2D, which must be called before the next stage().
+  // Data larger than a region is not staged: the buffer is unbound and data
+  // is returned.
+  const void *stage(const void *data, size_t size);
+
+  // Fence the uploads of the current region and unbind the buffer, call after
+  // the last upload
+  void finish();
+
+  // Of every stage() call, staged or not
+  size_t uploadedBytes() const { return m_uploadedBytes; }
+
+private:
+  PersistentRingBuffer m_staging;
+  unsigned char *m_region = nullptr; // Current region, nullptr if fenced
+  size_t m_offset = 0; // Used bytes of the current region
+  size_t m_uploadedBytes = 0;
+};
@@ -0,0 +1,461 @@
+#include "tileset.hpp"
+
+#include "trace.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtx/matrix_decompose.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <queue>
+#include <sstream>
+
+#include <json.hpp>
+
+namespace
+{
+
+// Roots farther from the origin are on the globe, in earth centered
+// coordinates
+const double GLOBE_MIN_DISTANCE = 1e6;
+// External tilesets referring back to the ones loading them stop there
+const size_t MAX_EXTERNAL_DEPTH = 32;
+
+std::string lowerExtension(const fs::path &path)
+{
+  auto extension = path.extension().string();
+  std::transform(begin(extension), end(extension), begin(extension),
+      [](unsigned char c) { return char(std::tolower(c)); });
+  return extension;
+}
+
+bool readJson(const fs::path &path, nlohmann::json &document, std::string &err)
+{
+  std::ifstream file(path);
+  if (!file) {
+    err = "Unable to open tileset " + path.string();
+    return false;
+  }
+  std::stringstream text;
+  text << file.rdbuf();
+  try {
+    document = nlohmann::json::parse(text.str());
+  } catch (const std::exception &e) {
+    err = "Unable to parse tileset " + path.string() + ": " + e.what();
+    return false;
+  }
+  if (!document.is_object() || !document.count("root") ||
+      !document["root"].is_object()) {
+    err = path.string() + ": expected an object with a root tile";
+    return false;
+  }
+  return true;
+}
+
+bool readNumbers(const nlohmann::json &object, const char *key, size_t size,
+    double *values)
+{
+  const auto &array = object[key];
+  if (!array.is_array() || array.size() != size) {
+    return false;
+  }
+  for (size_t i = 0; i < size; ++i) {
+    if (!array[i].is_number()) {
+      return false;
+    }
+    values[i] = array[i].get<double>();
+  }
+  return true;
+}
+
+double maxScale(const glm::dmat4 &transform)
+{
+  return std::max({glm::length(glm::dvec3(transform[0])),
+      glm::length(glm::dvec3(transform[1])),
+      glm::length(glm::dvec3(transform[2]))});
+}
+
+// Bounding sphere of a tile in the space of the tileset, center then radius
+bool readBounds(const nlohmann::json &tile, const glm::dmat4 &transform,
+    glm::dvec4 &sphere, std::string &err)
+{
+  if (!tile.count("boundingVolume") || !tile["boundingVolume"].is_object()) {
+    err = "expected a bounding volume";
+    return false;
+  }
+  const auto &volume = tile["boundingVolume"];
+  double values[12];
+  if (volume.count("box")) {
+    if (!readNumbers(volume, "box", 12, values)) {
+      err = "box bounding volumes are 12 numbers";
+      return false;
+    }
+    // Center then half axes, the farthest corner bounds the box
+    const glm::dmat3 axes(transform);
+    const glm::dvec3 x = axes * glm::dvec3(values[3], values[4], values[5]);
+    const glm::dvec3 y = axes * glm::dvec3(values[6], values[7], values[8]);
+    const glm::dvec3 z = axes * glm::dvec3(values[9], values[10], values[11]);
+    const double radius =
+        std::max({glm::length(x + y + z), glm::length(x + y - z),
+            glm::length(x - y + z), glm::length(x - y - z)});
+    sphere = glm::dvec4(
+        glm::dvec3(transform *
+                   glm::dvec4(values[0], values[1], values[2], 1.0)),
+        radius);
+    return true;
+  }
+  if (volume.count("sphere")) {
+    if (!readNumbers(volume, "sphere", 4, values)) {
+      err = "sphere bounding volumes are 4 numbers";
+      return false;
+    }
+    sphere = glm::dvec4(
+        glm::dvec3(transform *
+                   glm::dvec4(values[0], values[1], values[2], 1.0)),
+        values[3] * maxScale(transform));
+    return true;
+  }
+  err = volume.count("region")
+            ? "region bounding volumes are not supported"
+            : "expected a box or sphere bounding volume";
+  return false;
+}
+
+bool readTransform(const nlohmann::json &tile, glm::dmat4 &transform)
+{
+  if (!tile.count("transform")) {
+    return true;
+  }
+  double values[16];
+  if (!readNumbers(tile, "transform", 16, values)) {
+    return false;
+  }
+  glm::dmat4 matrix;
+  for (int i = 0; i < 16; ++i) {
+    matrix[i / 4][i % 4] = values[i]; // Column major, as glTF
+  }
+  transform = transform * matrix;
+  return true;
+}
+
+class TilesetReader
+{
+public:
+  TilesetReader(Tileset &tileset, std::string &err) :
+      m_tileset(tileset), m_err(err)
+  {
+  }
+
+  bool read(const fs::path &path)
+  {
+    nlohmann::json document;
+    if (!readJson(path, document, m_err)) {
+      return false;
+    }
+    const auto &root = document["root"];
+
+    // The tileset is z up, glTF contents y up like the viewer
+    glm::dvec3 origin(0);
+    glm::dvec3 east(1, 0, 0);
+    glm::dvec3 up(0, 0, 1);
+    glm::dmat4 rootTransform(1);
+    glm::dvec4 rootSphere;
+    if (!readTransform(root, rootTransform)) {
+      m_err = path.string() + ": tile: transforms are 16 numbers";
+      return false;
+    }
+    if (!readBounds(root, rootTransform, rootSphere, m_err)) {
+      m_err = path.string() + ": tile: " + m_err;
+      return false;
+    }
+    if (glm::length(glm::dvec3(rootSphere)) > GLOBE_MIN_DISTANCE) {
+      origin = glm::dvec3(rootSphere);
+      up = glm::normalize(origin);
+      const auto axisEast = glm::cross(glm::dvec3(0, 0, 1), up);
+      east = glm::length(axisEast) > 1e-6 ? glm::normalize(axisEast)
+                                          : glm::dvec3(1, 0, 0);
+    }
+    const auto north = glm::cross(up, east);
+    // Rows east, up and south
+    m_toViewer =
+        glm::dmat4(glm::transpose(glm::dmat3(east, up, -north))) *
+        glm::translate(glm::dmat4(1), -origin);
+
+    m_tileset.path = path;
+    m_tileset.tiles.clear();
+    m_err.clear();
+    uint32_t index;
+    return readTile(root, path.parent_path(), glm::dmat4(1), false, path,
+        index);
+  }
+
+private:
+  bool readTile(const nlohmann::json &tile, const fs::path &directory,
+      glm::dmat4 transform, bool parentAdd, const fs::path &file,
+      uint32_t &index)
+  {
+    index = uint32_t(m_tileset.tiles.size());
+    const auto prefix = file.string() + ": tile: ";
+    if (!tile.is_object()) {
+      m_err = prefix + "expected an object";
+      return false;
+    }
+    if (tile.count("implicitTiling")) {
+      m_err = prefix + "implicit tiling is not supported";
+      return false;
+    }
+    if (!readTransform(tile, transform)) {
+      m_err = prefix + "transforms are 16 numbers";
+      return false;
+    }
+    glm::dvec4 sphere;
+    if (!readBounds(tile, transform, sphere, m_err)) {
+      m_err = prefix + m_err;
+      return false;
+    }
+
+    TilesetTile result;
+    result.center =
+        glm::vec3(m_toViewer * glm::dvec4(glm::dvec3(sphere), 1.0));
+    result.radius = float(sphere.w);
+    result.geometricError = float(
+        (tile.count("geometricError") && tile["geometricError"].is_number()
+                ? tile["geometricError"].get<double>()
+                : 0.0) *
+        maxScale(transform));
+    result.refineAdd = parentAdd;
+    if (tile.count("refine") && tile["refine"].is_string()) {
+      auto refine = tile["refine"].get<std::string>();
+      std::transform(begin(refine), end(refine), begin(refine),
+          [](unsigned char c) { return char(std::toupper(c)); });
+      result.refineAdd = refine == "ADD";
+    }
+    // The tileset is z up, glTF contents y up
+    const glm::dmat4 yUpToZUp(
+        1, 0, 0, 0, 0, 0, 1, 0, 0, -1, 0, 0, 0, 0, 0, 1);
+    result.contentTransform = glm::mat4(m_toViewer * transform * yUpToZUp);
+    m_tileset.tiles.push_back(result);
+
+    // Contents are glTF files, external tilesets are read as children
+    std::vector<std::string> uris;
+    const auto addUri = [&](const nlohmann::json &content) {
+      for (const auto key : {"uri", "url"}) {
+        if (content.is_object() && content.count(key) &&
+            content[key].is_string()) {
+          uris.push_back(content[key].get<std::string>());
+          return;
+        }
+      }
+    };
+    if (tile.count("content")) {
+      addUri(tile["content"]);
+    }
+    if (tile.count("contents") && tile["contents"].is_array()) {
+      for (const auto &content : tile["contents"]) {
+        addUri(content);
+      }
+    }
+    std::vector<uint32_t> children;
+    for (const auto &uri : uris) {
+      if (uri.find("://") != std::string::npos) {
+        m_err = prefix + uri + ": remote contents are not supported";
+        return false;
+      }
+      const auto path = directory / uri;
+      const auto extension = lowerExtension(path);
+      if (extension == ".json") {
+        if (m_external.size() >= MAX_EXTERNAL_DEPTH ||
+            std::find(begin(m_external), end(m_external), path) !=
+                end(m_external)) {
+          m_err = prefix + uri + ": external tilesets refer to each other";
+          return false;
+        }
+        nlohmann::json document;
+        if (!readJson(path, document, m_err)) {
+          return false;
+        }
+        m_external.push_back(path);
+        uint32_t child;
+        if (!readTile(document["root"], path.parent_path(), transform,
+                result.refineAdd, path, child)) {
+          return false;
+        }
+        m_external.pop_back();
+        children.push_back(child);
+        continue;
+      }
+      if (extension != ".glb" && extension != ".gltf") {
+        m_err = prefix + uri + ": only glTF contents are supported";
+        return false;
+      }
+      if (!fs::exists(path)) {
+        m_err = prefix + "no content file " + path.string();
+        return false;
+      }
+      m_tileset.tiles[index].contents.push_back(path);
+      m_tileset.tiles[index].contentBytes += uint64_t(fs::file_size(path));
+    }
+
+    if (tile.count("children")) {
+      if (!tile["children"].is_array()) {
+        m_err = prefix + "children are an array of tiles";
+        return false;
+      }
+      for (const auto &childTile : tile["children"]) {
+        uint32_t child;
+        if (!readTile(childTile, directory, transform, result.refineAdd, file,
+                child)) {
+          return false;
+        }
+        children.push_back(child);
+      }
+    }
+    m_tileset.tiles[index].children = std::move(children);
+    return true;
+  }
+
+  Tileset &m_tileset;
+  std::string &m_err;
+  glm::dmat4 m_toViewer = glm::dmat4(1);
+  std::vector<fs::path> m_external; // Being read
+};
+
+} // namespace
+
+bool isTilesetFile(const fs::path &path)
+{
+  auto name = path.filename().string();
+  std::transform(begin(name), end(name), begin(name),
+      [](unsigned char c) { return char(std::tolower(c)); });
+  const std::string suffix = "tileset.json";
+  return name.size() >= suffix.size() &&
+         name.compare(name.size() - suffix.size(), suffix.size(), suffix) ==
+             0 &&
+         (name.size() == suffix.size() ||
+             name[name.size() - suffix.size() - 1] == '.');
+}
+
+bool loadTileset(const fs::path &path, Tileset &tileset, std::string &err)
+{
+  TRACE_ZONE("loadTileset");
+  Tileset result;
+  if (!TilesetReader(result, err).read(path)) {
+    return false;
+  }
+  tileset = std::move(result);
+  return true;
+}
+
+std::vector<uint32_t> selectTiles(const Tileset &tileset,
+    const glm::vec3 &eye, float pixelsPerUnit, float maxErrorPixels,
+    uint64_t budgetBytes)
+{
+  TRACE_ZONE("selectTiles");
+  std::vector<uint32_t> tiles;
+  if (tileset.tiles.empty()) {
+    return tiles;
+  }
+
+  struct Candidate
+  {
+    float pixels; // Of the error of the tile
+    uint32_t tile;
+
+    bool operator<(const Candidate &other) const
+    {
+      return pixels < other.pixels;
+    }
+  };
+  std::priority_queue<Candidate> candidates;
+  const auto addCandidate = [&](uint32_t index) {
+    const auto &tile = tileset.tiles[index];
+    if (tile.children.empty()) {
+      return;
+    }
+    float pixels = std::numeric_limits<float>::infinity();
+    if (!tile.contents.empty()) {
+      const auto distance = glm::length(eye - tile.center) - tile.radius;
+      pixels = distance <= 0.f ? std::numeric_limits<float>::max()
+                               : tile.geometricError * pixelsPerUnit / distance;
+    }
+    candidates.push({pixels, index});
+  };
+
+  // Bytes of the tiles covering each tile at its coarsest: its content, or
+  // that of its children for tiles without content. Children follow their
+  // parent.
+  std::vector<int64_t> coverBytes(tileset.tiles.size(), 0);
+  for (size_t i = tileset.tiles.size(); i-- > 0;) {
+    const auto &tile = tileset.tiles[i];
+    if (!tile.contents.empty()) {
+      coverBytes[i] = int64_t(tile.contentBytes);
+      continue;
+    }
+    for (const auto child : tile.children) {
+      coverBytes[i] += coverBytes[child];
+    }
+  }
+
+  std::vector<char> selected(tileset.tiles.size(), 0);
+  selected[0] = 1;
+  int64_t bytes = coverBytes[0];
+  addCandidate(0);
+  while (!candidates.empty()) {
+    const auto candidate = candidates.top();
+    candidates.pop();
+    const auto &tile = tileset.tiles[candidate.tile];
+    // Tiles without content come first, the others in decreasing error
+    if (!tile.contents.empty() && candidate.pixels <= maxErrorPixels) {
+      break;
+    }
+    // Tiles without content are already covered by their children
+    const bool add = tile.refineAdd && !tile.contents.empty();
+    int64_t cost = add ? 0 : -coverBytes[candidate.tile];
+    for (const auto child : tile.children) {
+      cost += coverBytes[child];
+    }
+    if (bytes + cost > int64_t(budgetBytes)) {
+      continue;
+    }
+    bytes += cost;
+    selected[candidate.tile] = add ? 1 : 0;
+    for (const auto child : tile.children) {
+      selected[child] = 1;
+      addCandidate(child);
+    }
+  }
+
+  for (uint32_t i = 0; i < tileset.tiles.size(); ++i) {
+    if (selected[i] && !tileset.tiles[i].contents.empty()) {
+      tiles.push_back(i);
+    }
+  }
+  return tiles;
+}
+
+float tileProjectionScale(const glm::mat4 &projMatrix, int viewportHeight)
+{
+  return 0.5f * projMatrix[1][1] * float(viewportHeight);
+}
+
+std::vector<SceneFile> tileSceneFiles(
+    const Tileset &tileset, const std::vector<uint32_t> &tiles)
+{
+  std::vector<SceneFile> files;
+  for (const auto index : tiles) {
+    const auto &tile = tileset.tiles[index];
+    SceneFile file;
+    glm::vec3 skew;
+    glm::vec4 perspective;
+    glm::decompose(tile.contentTransform, file.scale, file.rotation,
+        file.translation, skew, perspective);
+    for (const auto &content : tile.contents) {
+      file.path = content;
+      files.push_back(file);
+    }
+  }
+  return files;
+}
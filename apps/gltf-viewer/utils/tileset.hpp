@@ -0,0 +1,80 @@
+#pragma once
+
+#include "filesystem.hpp"
+#include "gltf_scene.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Scenes too large to be loaded at once, split into spatial tiles: the
+// tileset.json index of 3D Tiles 1.1 (OGC 2023), a tree of tiles each with a
+// bounding volume, glTF content and the geometric error of drawing the tile
+// instead of its descendants. Children refine their parent by replacing it
+// (REPLACE) or being drawn along with it (ADD). selectTiles picks the tiles of
+// a viewpoint under a memory budget, whose content is then loaded as the
+// models of a scene.
+//
+// Tiles with .glb or .gltf content and external tilesets are read, box and
+// sphere bounding volumes. Geographic regions, implicit tiling and the legacy
+// b3dm, i3dm, pnts and cmpt formats are not.
+
+struct TilesetOptions
+{
+  // Tiles whose geometric error projects to more pixels are refined
+  float maxErrorPixels = 16.f;
+  // Of the content files of the selected tiles
+  float budgetMB = 512.f;
+};
+
+struct TilesetTile
+{
+  // Bounding sphere, in the space of the viewer
+  glm::vec3 center = glm::vec3(0);
+  float radius = 0.f;
+  float geometricError = 0.f; // In the space of the viewer too
+  bool refineAdd = false;
+  std::vector<fs::path> contents; // glTF files, none for empty tiles
+  uint64_t contentBytes = 0; // Sizes of the files of contents
+  // From the y up glTF space of the contents to the space of the viewer
+  glm::mat4 contentTransform = glm::mat4(1);
+  std::vector<uint32_t> children;
+};
+
+// The space of the viewer is y up, the z up space of the tileset rotated. The
+// tilesets on the globe, whose root is far from the origin, are also
+// translated to the center of their root and rotated to have the up of the
+// surface there as y.
+struct Tileset
+{
+  fs::path path;
+  std::vector<TilesetTile> tiles; // The root first
+};
+
+// True for the files named tileset.json or ending in .tileset.json
+bool isTilesetFile(const fs::path &path);
+
+// Read a tileset and the external tilesets of its tiles, and the size of
+// every content file
+bool loadTileset(const fs::path &path, Tileset &tileset, std::string &err);
+
+// Tiles to load for an eye, in ascending order, as long as their content fits
+// in budgetBytes: tiles are refined from the root, the one whose error
+// projects to the most pixels first, while it projects to more than
+// maxErrorPixels. Tiles without content are refined whatever their error,
+// the content covering the root at its coarsest is always selected.
+// pixelsPerUnit is the size in pixels of a unit at distance 1, see
+// tileProjectionScale; with 0 the coarsest tiles are returned.
+std::vector<uint32_t> selectTiles(const Tileset &tileset,
+    const glm::vec3 &eye, float pixelsPerUnit, float maxErrorPixels,
+    uint64_t budgetBytes);
+
+// pixelsPerUnit of selectTiles for a perspective projection
+float tileProjectionScale(const glm::mat4 &projMatrix, int viewportHeight);
+
+// The models of the scene of the selected tiles, their content transform
+// decomposed into translation, rotation and scale
+std::vector<SceneFile> tileSceneFiles(
+    const Tileset &tileset, const std::vector<uint32_t> &tiles);
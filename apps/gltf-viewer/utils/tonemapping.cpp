@@ -0,0 +1,109 @@
+#include "tonemapping.hpp"
+#include "gpu_memory.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+namespace
+{
+
+const char *const OPERATOR_NAMES[TONEMAP_OPERATOR_COUNT] = {
+    "none", "reinhard", "aces", "neutral"};
+
+} // namespace
+
+const char *tonemapOperatorName(TonemapOperator op)
+{
+  return OPERATOR_NAMES[int(op)];
+}
+
+bool parseTonemapOperator(const std::string &name, TonemapOperator &op)
+{
+  for (int i = 0; i < TONEMAP_OPERATOR_COUNT; ++i) {
+    if (name == OPERATOR_NAMES[i]) {
+      op = TonemapOperator(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool drawFramebufferIsFloat()
+{
+  GLint framebuffer = 0;
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+  if (!framebuffer) {
+    return false;
+  }
+  GLint componentType = GL_NONE;
+  glGetFramebufferAttachmentParameteriv(GL_DRAW_FRAMEBUFFER,
+      GL_COLOR_ATTACHMENT0, GL_FRAMEBUFFER_ATTACHMENT_COMPONENT_TYPE,
+      &componentType);
+  return componentType == GL_FLOAT;
+}
+
+HdrTarget::~HdrTarget() { release(); }
+
+void HdrTarget::release()
+{
+  if (m_framebuffer) {
+    glDeleteFramebuffers(1, &m_framebuffer);
+  }
+  if (m_color) {
+    const GLuint textures[] = {m_color, m_depth};
+    untrackTextures(2, textures);
+    glDeleteTextures(2, textures);
+  }
+  m_framebuffer = m_color = m_depth = 0;
+}
+
+void HdrTarget::init(GLsizei width, GLsizei height, int samples)
+{
+  release();
+  m_width = width;
+  m_height = height;
+  m_samples = std::max(samples, 1);
+
+  const GLenum target =
+      m_samples > 1 ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D;
+  GLint previousTexture = 0;
+  GLint previousFramebuffer = 0;
+  glGetIntegerv(m_samples > 1 ? GL_TEXTURE_BINDING_2D_MULTISAMPLE
+                              : GL_TEXTURE_BINDING_2D,
+      &previousTexture);
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+
+  // Read with texelFetch by the tonemap pass, one texel per pixel
+  const auto createTarget = [&](GLenum format) {
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    glBindTexture(target, texture);
+    if (m_samples > 1) {
+      glTexStorage2DMultisample(
+          target, m_samples, format, width, height, GL_TRUE);
+    } else {
+      glTexStorage2D(target, 1, format, width, height);
+      glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+      glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+    trackTexture(GpuMemoryCategory::RenderTargets, target, texture);
+    return texture;
+  };
+  m_color = createTarget(GL_R11F_G11F_B10F);
+  m_depth = createTarget(GL_DEPTH_COMPONENT32F);
+  glBindTexture(target, GLuint(previousTexture));
+
+  glGenFramebuffers(1, &m_framebuffer);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_framebuffer);
+  glFramebufferTexture(
+      GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, m_color, 0);
+  glFramebufferTexture(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_depth, 0);
+  const GLenum drawBuffer = GL_COLOR_ATTACHMENT0;
+  glDrawBuffers(1, &drawBuffer);
+
+  const auto framebufferStatus = glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER);
+  assert(framebufferStatus == GL_FRAMEBUFFER_COMPLETE);
+  (void)framebufferStatus;
+
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, GLuint(previousFramebuffer));
+}
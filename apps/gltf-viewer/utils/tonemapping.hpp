@@ -0,0 +1,77 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <string>
+
+// Curves mapping the linear radiance the scene is shaded in to the display
+// range, applied by the tonemap pass after a scale by the exposure
+enum class TonemapOperator
+{
+  None, // Clamped to 1
+  Reinhard, // x / (1 + x)
+  AcesFilmic, // Narkowicz's fit of the ACES filmic curve
+  PbrNeutral // Khronos PBR Neutral, base colors below 0.8 are kept as is
+};
+
+const int TONEMAP_OPERATOR_COUNT = 4;
+
+struct TonemapOptions
+{
+  TonemapOperator op = TonemapOperator::PbrNeutral;
+  float exposure = 1;
+  // Share of the bloom blur added to the scene before tonemapping, none if 0
+  float bloom = 0;
+};
+
+// Lower case name of op on the command line, "aces" for AcesFilmic and
+// "neutral" for PbrNeutral
+const char *tonemapOperatorName(TonemapOperator op);
+// False if name is not one of those of tonemapOperatorName()
+bool parseTonemapOperator(const std::string &name, TonemapOperator &op);
+
+// Whether color attachment 0 of the framebuffer bound on GL_DRAW_FRAMEBUFFER
+// stores floats. Such framebuffers, of hdr images or of temporal
+// anti-aliasing, get the linear radiance of the scene instead of tonemapped
+// colors.
+bool drawFramebufferIsFloat();
+
+// Linear HDR color and depth the scene is drawn to before the tonemap pass
+// writes it to the output framebuffer. The color is GL_R11F_G11F_B10F, enough
+// for radiance without the alpha and sign bits of GL_RGBA16F, at half the
+// bandwidth. With more than 1 sample it is a GL_TEXTURE_2D_MULTISAMPLE
+// texture, tonemapped per sample before being averaged so that the edges of
+// bright surfaces stay anti-aliased. The depth is a GL_DEPTH_COMPONENT32F
+// texture of the same kind, read by screen-space ambient occlusion.
+class HdrTarget
+{
+public:
+  HdrTarget() = default;
+  ~HdrTarget();
+
+  HdrTarget(const HdrTarget &) = delete;
+  HdrTarget &operator=(const HdrTarget &) = delete;
+
+  // Allocate the targets of width x height pixels, samples of 0 or 1 are
+  // single sample
+  void init(GLsizei width, GLsizei height, int samples);
+
+  GLsizei width() const { return m_width; }
+  GLsizei height() const { return m_height; }
+  // 1 if single sample
+  int samples() const { return m_samples; }
+
+  GLuint framebuffer() const { return m_framebuffer; }
+  GLuint color() const { return m_color; }
+  GLuint depth() const { return m_depth; }
+
+private:
+  void release();
+
+  GLsizei m_width = 0;
+  GLsizei m_height = 0;
+  int m_samples = 1;
+  GLuint m_framebuffer = 0;
+  GLuint m_color = 0;
+  GLuint m_depth = 0;
+};
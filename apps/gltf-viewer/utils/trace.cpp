@@ -0,0 +1,117 @@
+#include "trace.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+
+struct TraceEvent
+{
+  const char *name;
+  size_t thread;
+  TraceZone::Clock::time_point begin;
+  TraceZone::Clock::time_point end;
+};
+
+std::atomic<bool> g_enabled{false};
+std::mutex g_mutex;
+fs::path g_path;
+TraceZone::Clock::time_point g_start;
+std::vector<TraceEvent> g_events;
+std::unordered_map<std::thread::id, size_t> g_threads; // Ids in the trace
+std::unordered_map<std::thread::id, std::string> g_threadNames;
+
+double microseconds(TraceZone::Clock::duration duration)
+{
+  return std::chrono::duration<double, std::micro>(duration).count();
+}
+
+} // namespace
+
+bool startTrace(const fs::path &path, std::string &err)
+{
+  // Fail before loading anything rather than when writing the trace
+  std::ofstream file(path);
+  if (!file) {
+    err = "Unable to write trace " + path.string();
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(g_mutex);
+  g_path = path;
+  g_start = TraceZone::Clock::now();
+  g_events.clear();
+  g_threads.clear();
+  g_enabled = true;
+  return true;
+}
+
+bool stopTrace(std::string &err)
+{
+  std::lock_guard<std::mutex> lock(g_mutex);
+  if (!g_enabled) {
+    return true;
+  }
+  g_enabled = false;
+
+  std::ofstream file(g_path);
+  file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  char event[256];
+  for (size_t i = 0; i < g_events.size(); ++i) {
+    const auto &e = g_events[i];
+    std::snprintf(event, sizeof(event),
+        "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%zu,"
+        "\"ts\":%.3f,\"dur\":%.3f}",
+        i ? "," : "", e.name, e.thread, microseconds(e.begin - g_start),
+        microseconds(e.end - e.begin));
+    file << event;
+  }
+  for (const auto &thread : g_threads) {
+    const auto name = g_threadNames.find(thread.first);
+    if (name != g_threadNames.end()) {
+      std::snprintf(event, sizeof(event),
+          "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+          "\"tid\":%zu,\"args\":{\"name\":\"%s\"}}",
+          g_events.empty() ? "" : ",", thread.second, name->second.c_str());
+      file << event;
+    }
+  }
+  file << "\n]}\n";
+  g_events.clear();
+
+  if (!file) {
+    err = "Unable to write trace " + g_path.string();
+    return false;
+  }
+  return true;
+}
+
+bool traceEnabled() { return g_enabled; }
+
+void setTraceThreadName(const std::string &name)
+{
+  std::lock_guard<std::mutex> lock(g_mutex);
+  g_threadNames[std::this_thread::get_id()] = name;
+}
+
+TraceZone::~TraceZone()
+{
+  if (!name) {
+    return;
+  }
+  const auto end = Clock::now();
+  std::lock_guard<std::mutex> lock(g_mutex);
+  if (!g_enabled) {
+    return;
+  }
+  const auto thread =
+      g_threads.emplace(std::this_thread::get_id(), g_threads.size() + 1)
+          .first->second;
+  g_events.push_back({name, thread, begin, end});
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "filesystem.hpp"
+
+#include <chrono>
+#include <string>
+
+// CPU zones recorded to a Chrome trace event file, viewable in Perfetto or
+// chrome://tracing: TRACE_ZONE("name") times the enclosing scope on the
+// calling thread. Zones are compiled in with GLMLV_ENABLE_TRACE, which the
+// GLMLV_ENABLE_TRACE CMake option and debug builds define, and only recorded
+// between startTrace() and stopTrace(). Names must be string literals.
+bool startTrace(const fs::path &path, std::string &err);
+// Write the zones recorded since startTrace(), false on error
+bool stopTrace(std::string &err);
+
+bool traceEnabled();
+
+// Name of the calling thread in the traces, which otherwise only number the
+// threads. Kept from one trace to the next.
+void setTraceThreadName(const std::string &name);
+
+struct TraceZone
+{
+  using Clock = std::chrono::steady_clock;
+
+  explicit TraceZone(const char *name) :
+      name(traceEnabled() ? name : nullptr), begin(Clock::now())
+  {
+  }
+  ~TraceZone();
+
+  TraceZone(const TraceZone &) = delete;
+  TraceZone &operator=(const TraceZone &) = delete;
+
+  const char *name; // Not recorded if null
+  Clock::time_point begin;
+};
+
+#ifdef GLMLV_ENABLE_TRACE
+#define TRACE_ZONE_CONCAT_(a, b) a##b
+#define TRACE_ZONE_CONCAT(a, b) TRACE_ZONE_CONCAT_(a, b)
+#define TRACE_ZONE(name) TraceZone TRACE_ZONE_CONCAT(traceZone, __LINE__)(name)
+#else
+#define TRACE_ZONE(name) ((void)0)
+#endif
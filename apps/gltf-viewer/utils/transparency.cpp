@@ -0,0 +1,109 @@
+#include "transparency.hpp"
+#include "gpu_memory.hpp"
+
+#include <algorithm>
+
+namespace
+{
+
+GLuint createTarget(GLenum format, GLsizei width, GLsizei height, int samples)
+{
+  const GLenum target = samples > 1 ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D;
+  GLuint texture = 0;
+  glGenTextures(1, &texture);
+  glBindTexture(target, texture);
+  if (samples > 1) {
+    // Fixed sample locations, to be attached with renderbuffers
+    glTexStorage2DMultisample(
+        target, samples, format, width, height, GL_TRUE);
+  } else {
+    glTexStorage2D(target, 1, format, width, height);
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  }
+  trackTexture(GpuMemoryCategory::RenderTargets, target, texture);
+  return texture;
+}
+
+} // namespace
+
+TransparencyTargets::~TransparencyTargets() { release(); }
+
+void TransparencyTargets::release()
+{
+  if (m_framebuffer) {
+    glDeleteFramebuffers(1, &m_framebuffer);
+  }
+  if (m_accumulation) {
+    const GLuint textures[] = {m_accumulation, m_revealage};
+    untrackTextures(2, textures);
+    glDeleteTextures(2, textures);
+  }
+  m_framebuffer = m_accumulation = m_revealage = 0;
+}
+
+void TransparencyTargets::init(GLsizei width, GLsizei height, int samples)
+{
+  release();
+  m_width = width;
+  m_height = height;
+  m_samples = std::max(samples, 1);
+
+  GLint previousTexture = 0;
+  GLint previousFramebuffer = 0;
+  glGetIntegerv(m_samples > 1 ? GL_TEXTURE_BINDING_2D_MULTISAMPLE
+                              : GL_TEXTURE_BINDING_2D,
+      &previousTexture);
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+
+  m_accumulation = createTarget(GL_RGBA16F, width, height, m_samples);
+  m_revealage = createTarget(GL_R16F, width, height, m_samples);
+  glBindTexture(m_samples > 1 ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D,
+      GLuint(previousTexture));
+
+  glGenFramebuffers(1, &m_framebuffer);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_framebuffer);
+  glFramebufferTexture(
+      GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, m_accumulation, 0);
+  glFramebufferTexture(
+      GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, m_revealage, 0);
+  const GLenum drawBuffers[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+  glDrawBuffers(2, drawBuffers);
+
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, GLuint(previousFramebuffer));
+}
+
+bool TransparencyTargets::attachDepth()
+{
+  GLint framebuffer = 0;
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+  if (!framebuffer || !m_framebuffer) {
+    return false;
+  }
+
+  GLint type = GL_NONE;
+  GLint name = 0;
+  glGetFramebufferAttachmentParameteriv(GL_DRAW_FRAMEBUFFER,
+      GL_DEPTH_ATTACHMENT, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE, &type);
+  if (type != GL_RENDERBUFFER && type != GL_TEXTURE) {
+    return false;
+  }
+  glGetFramebufferAttachmentParameteriv(GL_DRAW_FRAMEBUFFER,
+      GL_DEPTH_ATTACHMENT, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_NAME, &name);
+
+  // Attached again every frame, the scene targets may have been reallocated
+  // under the same name
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_framebuffer);
+  if (type == GL_RENDERBUFFER) {
+    glFramebufferRenderbuffer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+        GL_RENDERBUFFER, GLuint(name));
+  } else {
+    glFramebufferTexture(
+        GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GLuint(name), 0);
+  }
+  const bool complete =
+      glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, GLuint(framebuffer));
+
+  return complete;
+}
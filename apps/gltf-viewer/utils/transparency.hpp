@@ -0,0 +1,53 @@
+#pragma once
+
+#include <glad/glad.h>
+
+// Targets of weighted blended order-independent transparency (McGuire and
+// Bavoil, 2013). Blended fragments add their premultiplied color and alpha,
+// scaled by a weight decreasing with depth, to the accumulation target and
+// multiply the revealage target by their transparency, in any order. A
+// composite pass then covers the scene with the weighted average color, by 1
+// minus the revealage.
+//
+// The fragments are tested against the depth of the opaque scene, whose
+// attachment is shared rather than copied. The targets must then have the
+// sample count of the scene, multisampled ones are GL_TEXTURE_2D_MULTISAMPLE
+// textures.
+class TransparencyTargets
+{
+public:
+  TransparencyTargets() = default;
+  ~TransparencyTargets();
+
+  TransparencyTargets(const TransparencyTargets &) = delete;
+  TransparencyTargets &operator=(const TransparencyTargets &) = delete;
+
+  // Allocate the targets of width x height pixels, samples of 0 or 1 are
+  // single sample
+  void init(GLsizei width, GLsizei height, int samples);
+
+  GLsizei width() const { return m_width; }
+  GLsizei height() const { return m_height; }
+  // 1 if single sample
+  int samples() const { return m_samples; }
+
+  // Attach the depth of the framebuffer bound on GL_DRAW_FRAMEBUFFER to
+  // framebuffer(), the binding is unchanged. False if it has none, as the
+  // default framebuffer, or if the attachments are not complete together.
+  bool attachDepth();
+
+  // Color attachment 0 of GL_RGBA16F accumulation, 1 of GL_R16F revealage
+  GLuint framebuffer() const { return m_framebuffer; }
+  GLuint accumulation() const { return m_accumulation; }
+  GLuint revealage() const { return m_revealage; }
+
+private:
+  void release();
+
+  GLsizei m_width = 0;
+  GLsizei m_height = 0;
+  int m_samples = 1;
+  GLuint m_framebuffer = 0;
+  GLuint m_accumulation = 0;
+  GLuint m_revealage = 0;
+};
@@ -0,0 +1,48 @@
+#include "vertex_layout.hpp"
+
+#include <algorithm>
+
+VertexLayoutCache::~VertexLayoutCache()
+{
+  for (const auto &layout : m_layouts) {
+    glDeleteVertexArrays(1, &layout.second);
+  }
+}
+
+GLuint VertexLayoutCache::vertexArray(const VertexFormat &format)
+{
+  const auto it = std::find_if(begin(m_layouts), end(m_layouts),
+      [&](const std::pair<VertexFormat, GLuint> &layout) {
+        return layout.first == format;
+      });
+  if (it != end(m_layouts)) {
+    return (*it).second;
+  }
+
+  GLuint vertexArray = 0;
+  glGenVertexArrays(1, &vertexArray);
+  glBindVertexArray(vertexArray);
+
+  for (GLuint i = 0; i < VERTEX_ATTRIBUTE_COUNT; ++i) {
+    const auto &attribute = format.attributes[i];
+    // Absent attributes keep their default value
+    if (attribute.componentCount == 0) {
+      continue;
+    }
+    glEnableVertexAttribArray(i);
+    if (attribute.integer) {
+      glVertexAttribIFormat(i, attribute.componentCount,
+          attribute.componentType, attribute.offset);
+    } else {
+      glVertexAttribFormat(i, attribute.componentCount,
+          attribute.componentType, attribute.normalized ? GL_TRUE : GL_FALSE,
+          attribute.offset);
+    }
+    glVertexAttribBinding(i, VERTEX_BUFFER_BINDING);
+  }
+
+  glBindVertexArray(0);
+
+  m_layouts.emplace_back(format, vertexArray);
+  return vertexArray;
+}
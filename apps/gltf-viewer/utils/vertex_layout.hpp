@@ -0,0 +1,33 @@
+#pragma once
+
+#include "packed_geometry.hpp"
+
+#include <glad/glad.h>
+
+#include <utility>
+#include <vector>
+
+// Vertex arrays that only hold the format of their attributes
+// (glVertexAttribFormat), one per distinct vertex layout. Every vertex buffer
+// with that layout shares it, the buffer itself is attached to
+// VERTEX_BUFFER_BINDING with glBindVertexBuffer before drawing. Attribute i of
+// a format is read at location i.
+class VertexLayoutCache
+{
+public:
+  static const GLuint VERTEX_BUFFER_BINDING = 0;
+
+  VertexLayoutCache() = default;
+  ~VertexLayoutCache();
+
+  VertexLayoutCache(const VertexLayoutCache &) = delete;
+  VertexLayoutCache &operator=(const VertexLayoutCache &) = delete;
+
+  // Return the vertex array of a layout, creating it on first use
+  GLuint vertexArray(const VertexFormat &format);
+
+  size_t size() const { return m_layouts.size(); }
+
+private:
+  std::vector<std::pair<VertexFormat, GLuint>> m_layouts;
+};
@@ -0,0 +1,58 @@
+#include "view_scheduler.hpp"
+
+#include <algorithm>
+
+ViewScheduler::ViewScheduler(size_t viewCount, size_t rendererCount) :
+    m_taken(rendererCount, 0)
+{
+  for (size_t i = 0; i < rendererCount; ++i) {
+    m_shards.emplace_back(
+        viewCount * i / rendererCount, viewCount * (i + 1) / rendererCount);
+  }
+}
+
+bool ViewScheduler::next(size_t renderer, size_t &view)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto &shard = m_shards[renderer];
+  if (shard.first < shard.second) {
+    view = shard.first++;
+    ++m_taken[renderer];
+    return true;
+  }
+
+  // The back of the largest shard is the furthest from the views its
+  // renderer is about to draw
+  const auto victim = std::max_element(begin(m_shards), end(m_shards),
+      [](const std::pair<size_t, size_t> &lhs,
+          const std::pair<size_t, size_t> &rhs) {
+        return lhs.second - lhs.first < rhs.second - rhs.first;
+      });
+  if (victim->first == victim->second) {
+    return false;
+  }
+  view = --victim->second;
+  ++m_taken[renderer];
+  return true;
+}
+
+void ViewScheduler::waitForTurn(size_t renderer)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_loadedChanged.wait(lock, [&]() { return m_loadedCount >= renderer; });
+}
+
+void ViewScheduler::loaded(size_t renderer)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_loadedCount = std::max(m_loadedCount, renderer + 1);
+  }
+  m_loadedChanged.notify_all();
+}
+
+std::vector<size_t> ViewScheduler::takenCounts() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_taken;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Distributes the views of a batch across renderers, one per GPU, each with
+// its own context and loaded copy of the scene. Every renderer starts with a
+// contiguous shard of the views, since nearby views need the same texture
+// levels, and steals from the back of the largest remaining shard once its
+// own is done.
+//
+// Renderers start one after the other: one is constructed once the previous
+// one has loaded its scene, so that it finds the environment maps and
+// programs in the disk caches instead of baking them again, and so that the
+// process-wide GL setup (entry points, caches) never runs on two threads.
+class ViewScheduler
+{
+public:
+  ViewScheduler(size_t viewCount, size_t rendererCount);
+
+  // Take the next view of renderer, false once every view is taken
+  bool next(size_t renderer, size_t &view);
+
+  // Block until the renderers before renderer have loaded their scene
+  void waitForTurn(size_t renderer);
+  // Let the next renderer start, whether renderer loaded its scene or failed
+  void loaded(size_t renderer);
+
+  // Views taken by each renderer, stolen ones included
+  std::vector<size_t> takenCounts() const;
+
+private:
+  mutable std::mutex m_mutex;
+  std::condition_variable m_loadedChanged;
+  std::vector<std::pair<size_t, size_t>> m_shards; // Views [first, second)
+  std::vector<size_t> m_taken;
+  size_t m_loadedCount = 0;
+};
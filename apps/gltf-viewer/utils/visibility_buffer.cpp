@@ -0,0 +1,78 @@
+#include "visibility_buffer.hpp"
+#include "gpu_memory.hpp"
+
+VisibilityBuffer::~VisibilityBuffer() { release(); }
+
+void VisibilityBuffer::release()
+{
+  if (m_framebuffer) {
+    glDeleteFramebuffers(1, &m_framebuffer);
+  }
+  if (m_texture) {
+    untrackTextures(1, &m_texture);
+    glDeleteTextures(1, &m_texture);
+  }
+  m_framebuffer = m_texture = 0;
+}
+
+void VisibilityBuffer::init(GLsizei width, GLsizei height)
+{
+  release();
+  m_width = width;
+  m_height = height;
+
+  GLint previousTexture = 0;
+  GLint previousFramebuffer = 0;
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTexture);
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+
+  // Integer textures are read with texelFetch only
+  glGenTextures(1, &m_texture);
+  glBindTexture(GL_TEXTURE_2D, m_texture);
+  glTexStorage2D(GL_TEXTURE_2D, 1, GL_RG32UI, width, height);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  trackTexture(GpuMemoryCategory::RenderTargets, GL_TEXTURE_2D, m_texture);
+  glBindTexture(GL_TEXTURE_2D, GLuint(previousTexture));
+
+  glGenFramebuffers(1, &m_framebuffer);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_framebuffer);
+  glFramebufferTexture(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, m_texture, 0);
+
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, GLuint(previousFramebuffer));
+}
+
+bool VisibilityBuffer::attachDepth()
+{
+  GLint framebuffer = 0;
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+  if (!framebuffer || !m_framebuffer) {
+    return false;
+  }
+
+  GLint type = GL_NONE;
+  GLint name = 0;
+  glGetFramebufferAttachmentParameteriv(GL_DRAW_FRAMEBUFFER,
+      GL_DEPTH_ATTACHMENT, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE, &type);
+  if (type != GL_RENDERBUFFER && type != GL_TEXTURE) {
+    return false;
+  }
+  glGetFramebufferAttachmentParameteriv(GL_DRAW_FRAMEBUFFER,
+      GL_DEPTH_ATTACHMENT, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_NAME, &name);
+
+  // Attached again every frame, the scene targets may have been reallocated
+  // under the same name
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_framebuffer);
+  if (type == GL_RENDERBUFFER) {
+    glFramebufferRenderbuffer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+        GL_RENDERBUFFER, GLuint(name));
+  } else {
+    glFramebufferTexture(
+        GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GLuint(name), 0);
+  }
+  const bool complete =
+      glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, GLuint(framebuffer));
+
+  return complete;
+}
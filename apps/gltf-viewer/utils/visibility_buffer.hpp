@@ -0,0 +1,53 @@
+#pragma once
+
+#include <glad/glad.h>
+
+// Visibility buffer rendering (Burns and Hunt, 2013): the opaque draws are
+// first rasterized with visibility.fs.glsl, which only writes the draw index
+// + 1 and the triangle of each pixel to a GL_RG32UI target, 0 where no draw
+// is visible, and the depth of the scene. A resolve pass over the viewport
+// then rebuilds the attributes of the triangle of each pixel from the packed
+// vertex and index buffers and shades it once, whatever the number of
+// triangles covering it. Tiny triangles no longer shade the helper lanes of
+// their 2x2 quads.
+//
+// Pixels are resolved by bins of draws sharing a vertex buffer and, without
+// bindless textures, material textures, one pass per bin discarding the
+// pixels of the others. The draws the resolve cannot rebuild, alpha tested,
+// under conditional rendering, skinned or with morph targets, and those of
+// other modes than GL_TRIANGLES, are drawn by the forward passes afterwards.
+//
+// The target is single sample and shares the depth attachment of the scene,
+// which must be single sample too.
+class VisibilityBuffer
+{
+public:
+  VisibilityBuffer() = default;
+  ~VisibilityBuffer();
+
+  VisibilityBuffer(const VisibilityBuffer &) = delete;
+  VisibilityBuffer &operator=(const VisibilityBuffer &) = delete;
+
+  // Allocate the target of width x height pixels
+  void init(GLsizei width, GLsizei height);
+
+  GLsizei width() const { return m_width; }
+  GLsizei height() const { return m_height; }
+
+  // Attach the depth of the framebuffer bound on GL_DRAW_FRAMEBUFFER to
+  // framebuffer(), the binding is unchanged. False if it has none, as the
+  // default framebuffer, or if the attachments are not complete together.
+  bool attachDepth();
+
+  // Color attachment 0 of GL_RG32UI draw index + 1 and triangle
+  GLuint framebuffer() const { return m_framebuffer; }
+  GLuint texture() const { return m_texture; }
+
+private:
+  void release();
+
+  GLsizei m_width = 0;
+  GLsizei m_height = 0;
+  GLuint m_framebuffer = 0;
+  GLuint m_texture = 0;
+};
@@ -0,0 +1,129 @@
+#include "visible_sets.hpp"
+
+#include "gpu_memory.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+void VisibleSets::initGrid(
+    const Aabb &bounds, float cellSize, size_t itemCount)
+{
+  m_origin = bounds.isEmpty() ? glm::vec3(0) : bounds.min;
+  const auto size =
+      bounds.isEmpty() ? glm::vec3(0) : bounds.max - bounds.min;
+  m_cellSize = std::max(cellSize, 1e-6f);
+  for (;;) {
+    m_cellCounts = glm::max(glm::ivec3(glm::ceil(size / m_cellSize)), 1);
+    if (cellCount() <= VISIBLE_SET_MAX_CELLS) {
+      break;
+    }
+    m_cellSize *=
+        std::cbrt(float(cellCount()) / float(VISIBLE_SET_MAX_CELLS)) * 1.01f;
+  }
+  m_itemCount = itemCount;
+  m_bits.assign(cellCount() * wordCount(), 0);
+}
+
+bool VisibleSets::assign(const glm::vec3 &origin, float cellSize,
+    const glm::ivec3 &cellCounts, size_t itemCount, std::vector<uint32_t> bits)
+{
+  if (cellSize <= 0.f || glm::any(glm::lessThan(cellCounts, glm::ivec3(1))) ||
+      bits.size() != size_t(cellCounts.x) * cellCounts.y * cellCounts.z *
+                         ((itemCount + 31) / 32)) {
+    return false;
+  }
+  m_origin = origin;
+  m_cellSize = cellSize;
+  m_cellCounts = cellCounts;
+  m_itemCount = itemCount;
+  m_bits = std::move(bits);
+  return true;
+}
+
+int VisibleSets::cell(const glm::vec3 &point) const
+{
+  if (m_bits.empty()) {
+    return -1;
+  }
+  const auto coords = glm::ivec3(glm::floor((point - m_origin) / m_cellSize));
+  if (glm::any(glm::lessThan(coords, glm::ivec3(0))) ||
+      glm::any(glm::greaterThanEqual(coords, m_cellCounts))) {
+    return -1;
+  }
+  return (coords.z * m_cellCounts.y + coords.y) * m_cellCounts.x + coords.x;
+}
+
+void VisibleSets::allocateBake(
+    size_t instanceCount, size_t batchCells, GLuint binding)
+{
+  m_bakeInstances = instanceCount;
+  const auto size =
+      std::max<size_t>(batchCells * bakeWordCount() * sizeof(uint32_t), 16);
+  m_bakeBuffer.generate();
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_bakeBuffer);
+  glBufferData(
+      GL_SHADER_STORAGE_BUFFER, GLsizeiptr(size), nullptr, GL_STREAM_READ);
+  glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 0,
+      GLsizeiptr(size), GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  trackBuffer(GpuMemoryCategory::Staging, m_bakeBuffer, size);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, m_bakeBuffer);
+}
+
+void VisibleSets::readBake(
+    size_t first, size_t count, const std::vector<uint32_t> &instanceItems)
+{
+  TRACE_ZONE("VisibleSets::readBake");
+  const auto bakeWords = bakeWordCount();
+  std::vector<uint32_t> baked(count * bakeWords);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_bakeBuffer);
+  glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0,
+      GLsizeiptr(baked.size() * sizeof(uint32_t)), baked.data());
+  glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 0,
+      GLsizeiptr(baked.size() * sizeof(uint32_t)), GL_RED_INTEGER,
+      GL_UNSIGNED_INT, nullptr);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+  const auto words = wordCount();
+  for (size_t c = 0; c < count; ++c) {
+    const auto *instanceBits = &baked[c * bakeWords];
+    auto *itemBits = &m_bits[(first + c) * words];
+    for (size_t i = 0; i < m_bakeInstances; ++i) {
+      if ((instanceBits[i / 32] >> (i % 32)) & 1u) {
+        const auto item = instanceItems[i];
+        itemBits[item / 32] |= 1u << (item % 32);
+      }
+    }
+  }
+}
+
+void VisibleSets::releaseBake()
+{
+  m_bakeBuffer.reset();
+  m_bakeInstances = 0;
+}
+
+void VisibleSets::show(size_t item)
+{
+  const auto words = wordCount();
+  for (size_t c = 0; c < cellCount(); ++c) {
+    m_bits[c * words + item / 32] |= 1u << (item % 32);
+  }
+}
+
+void VisibleSets::share(size_t first, size_t count)
+{
+  const auto words = wordCount();
+  for (size_t c = 0; c < cellCount(); ++c) {
+    auto *itemBits = &m_bits[c * words];
+    bool any = false;
+    for (size_t i = first; i < first + count && !any; ++i) {
+      any = (itemBits[i / 32] >> (i % 32)) & 1u;
+    }
+    for (size_t i = first; any && i < first + count; ++i) {
+      itemBits[i / 32] |= 1u << (i % 32);
+    }
+  }
+}
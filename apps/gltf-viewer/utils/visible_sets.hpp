@@ -0,0 +1,90 @@
+#pragma once
+
+#include "frustum.hpp"
+#include "gl_objects.hpp"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Cells of the grid of VisibleSets at most, its cells grow past the size asked
+// to stay within it
+const size_t VISIBLE_SET_MAX_CELLS = size_t(1) << 15;
+
+// Potentially visible sets of the draw items from the cells of a grid over the
+// scene, baked once by path_trace.cs.glsl with BAKE_VISIBILITY against the BVH
+// of the path tracer, see GeometryOptions::visibleSetCellSize. Rays leave
+// random points of a cell in random directions, the items they hit first are
+// visible from it. Culling is then a lookup of the bits of the cell of the
+// eye, which leaves out the rooms of an interior behind its walls.
+//
+// It is a sampling: an item seen through a gap no ray of the cell went through
+// is missed. The scene is assumed static, items are baked where they are once
+// loaded.
+//
+// The bits of cell c start at word c * wordCount(), those of item i at bit
+// i % 32 of word i / 32.
+class VisibleSets
+{
+public:
+  // Grid over bounds of cubic cells of cellSize, or larger so that there are
+  // at most VISIBLE_SET_MAX_CELLS of them, each seeing no item
+  void initGrid(const Aabb &bounds, float cellSize, size_t itemCount);
+
+  // Grid and bits read from a cache instead of baked. Return false if they do
+  // not have the bits of itemCount items per cell.
+  bool assign(const glm::vec3 &origin, float cellSize,
+      const glm::ivec3 &cellCounts, size_t itemCount,
+      std::vector<uint32_t> bits);
+
+  bool empty() const { return m_bits.empty(); }
+  const glm::vec3 &origin() const { return m_origin; }
+  float cellSize() const { return m_cellSize; }
+  const glm::ivec3 &cellCounts() const { return m_cellCounts; }
+  size_t cellCount() const
+  {
+    return size_t(m_cellCounts.x) * m_cellCounts.y * m_cellCounts.z;
+  }
+  size_t itemCount() const { return m_itemCount; }
+  size_t wordCount() const { return (m_itemCount + 31) / 32; }
+  const std::vector<uint32_t> &bits() const { return m_bits; }
+
+  // Cell containing point, -1 outside the grid
+  int cell(const glm::vec3 &point) const;
+  bool visible(int cell, size_t item) const
+  {
+    return (m_bits[size_t(cell) * wordCount() + item / 32] >>
+               (item % 32)) & 1u;
+  }
+
+  // Allocate the buffer the shader sets the bits of instanceCount instances
+  // in for batchCells cells at a time, cleared, and bind it
+  void allocateBake(size_t instanceCount, size_t batchCells, GLuint binding);
+  size_t bakeWordCount() const { return (m_bakeInstances + 31) / 32; }
+  // Read the bits written by the shader for the cells of [first, first +
+  // count) back, instance i standing for item instanceItems[i], then clear
+  // them for the next batch
+  void readBake(
+      size_t first, size_t count, const std::vector<uint32_t> &instanceItems);
+  void releaseBake();
+
+  // Make item visible from every cell, for those not traced or not drawn
+  // where they were baked
+  void show(size_t item);
+  // Make the items of [first, first + count) visible from the cells any of
+  // them is visible from
+  void share(size_t first, size_t count);
+
+private:
+  glm::vec3 m_origin = glm::vec3(0);
+  float m_cellSize = 0;
+  glm::ivec3 m_cellCounts = glm::ivec3(0);
+  size_t m_itemCount = 0;
+  std::vector<uint32_t> m_bits;
+
+  size_t m_bakeInstances = 0;
+  GLBuffer m_bakeBuffer; // Bits of the instances written by the shader
+};
@@ -0,0 +1,159 @@
+#!/bin/bash
+#
+# Run the bench command of gltf-viewer headless on every model of the glTF
+# sample models repository (see clone_gltf_samples.sh) and compare the
+# results of each model to a baseline. Exits with 1 if a metric of a model
+# regressed by more than the tolerance or a model failed to render.
+
+SCRIPT_DIR=`dirname "$0"`
+if [ -r $SCRIPT_DIR/env.env ]; then
+    source $SCRIPT_DIR/env.env
+fi
+
+VIEWER=$SCRIPT_DIR/../build/bin/gltf-viewer
+MODELS=$GLTF_MODELS_REPO_PATH/2.0
+ENVIRONMENT=""
+RESULTS=bench_results.csv
+BASELINE=$SCRIPT_DIR/bench_baseline.csv
+TOLERANCE=10
+FRAMES=200
+GPU=0
+UPDATE=0
+# Compared to the baseline, lower is better for each of them
+METRICS=load_total_ms,load_uploaded_bytes,cpu_avg_ms,gpu_avg_ms,frame_p95_ms,peak_memory_bytes,gpu_memory_bytes
+# Below this many ms times are noise, they are never regressions
+MIN_MS=0.1
+
+function usage {
+    echo "Usage: $0 [-b viewer] [-m models_dir] [-e environment.hdr]"
+    echo "          [-o results.csv] [-B baseline.csv] [-t tolerance_percent]"
+    echo "          [-f frames] [-g gpu] [-M metric,...] [-u]"
+    echo ""
+    echo "-u writes the results to the baseline instead of comparing."
+    echo "Models default to \$GLTF_MODELS_REPO_PATH/2.0, from env.env."
+    exit 1
+}
+
+while getopts "b:m:e:o:B:t:f:g:M:uh" option; do
+    case $option in
+        b) VIEWER=$OPTARG ;;
+        m) MODELS=$OPTARG ;;
+        e) ENVIRONMENT=$OPTARG ;;
+        o) RESULTS=$OPTARG ;;
+        B) BASELINE=$OPTARG ;;
+        t) TOLERANCE=$OPTARG ;;
+        f) FRAMES=$OPTARG ;;
+        g) GPU=$OPTARG ;;
+        M) METRICS=$OPTARG ;;
+        u) UPDATE=1 ;;
+        *) usage ;;
+    esac
+done
+
+if [ ! -x "$VIEWER" ]; then
+    echo "$VIEWER is not an executable, build gltf-viewer or pass -b"
+    usage
+fi
+if [ ! -d "$MODELS" ]; then
+    echo "$MODELS is not a directory, run clone_gltf_samples.sh or pass -m"
+    usage
+fi
+
+REPORT=`mktemp`
+LOG=${RESULTS%.csv}.log
+trap 'rm -f "$REPORT"' EXIT
+: > "$LOG"
+
+# Every model has a <Name>/glTF/<Name>.gltf variant, the others are skipped
+FAILED=0
+HEADER=""
+ROWS=""
+for model in `find "$MODELS" -path '*/glTF/*.gltf' | sort`; do
+    name=`basename "$(dirname "$(dirname "$model")")"`
+    echo "Benchmarking $name"
+    if ! "$VIEWER" bench --gpu "$GPU" --frames "$FRAMES" --report "$REPORT" \
+            "$model" $ENVIRONMENT >> "$LOG" 2>&1; then
+        echo "  failed, see $LOG"
+        FAILED=1
+        continue
+    fi
+    # The model and renderer columns are quoted and may hold commas
+    if [ -z "$HEADER" ]; then
+        HEADER="name,`head -n 1 "$REPORT" | cut -d, -f3-`"
+        echo "Renderer: `tail -n 1 "$REPORT" | sed 's/^"[^"]*","\([^"]*\)".*/\1/'`"
+    fi
+    ROWS="$ROWS$name,`tail -n 1 "$REPORT" | sed 's/^"[^"]*","[^"]*",//'`
+"
+done
+
+if [ -z "$HEADER" ]; then
+    echo "No model could be benchmarked"
+    exit 1
+fi
+printf "%s\n%s" "$HEADER" "$ROWS" > "$RESULTS"
+echo "Results written to $RESULTS"
+
+if [ $UPDATE -eq 1 ]; then
+    cp "$RESULTS" "$BASELINE"
+    echo "Baseline written to $BASELINE"
+    exit $FAILED
+fi
+if [ ! -r "$BASELINE" ]; then
+    echo "No baseline $BASELINE to compare to, create it with -u"
+    exit $FAILED
+fi
+
+# Columns are found by name, baselines of older builds may have other ones
+awk -F, -v metrics="$METRICS" -v tolerance="$TOLERANCE" -v minMs="$MIN_MS" '
+    FNR == 1 {
+        for (i = 1; i <= NF; ++i) {
+            column[FILENAME, $i] = i
+        }
+        next
+    }
+    FILENAME == ARGV[1] {
+        for (i = 1; i <= NF; ++i) {
+            baseline[$1, i] = $i
+        }
+        inBaseline[$1] = 1
+        next
+    }
+    {
+        if (!($1 in inBaseline)) {
+            print "  " $1 ": not in the baseline"
+            next
+        }
+        count = split(metrics, names, ",")
+        for (m = 1; m <= count; ++m) {
+            metric = names[m]
+            baseColumn = column[ARGV[1], metric]
+            resultColumn = column[FILENAME, metric]
+            if (!baseColumn || !resultColumn) {
+                continue
+            }
+            base = baseline[$1, baseColumn] + 0
+            value = $resultColumn + 0
+            limit = base * (1 + tolerance / 100)
+            if (metric ~ /_ms$/ && limit < base + minMs) {
+                limit = base + minMs
+            }
+            if (value > limit) {
+                printf "  %s: %s regressed from %g to %g (%+.1f%%)\n", \
+                    $1, metric, base, value, \
+                    (base > 0 ? 100 * (value - base) / base : 100)
+                regressions = 1
+            }
+        }
+    }
+    END {
+        exit regressions
+    }
+' "$BASELINE" "$RESULTS"
+REGRESSED=$?
+
+if [ $REGRESSED -ne 0 ]; then
+    echo "Regressions beyond $TOLERANCE% of $BASELINE"
+    exit 1
+fi
+echo "No regression beyond $TOLERANCE% of $BASELINE"
+exit $FAILED
@@ -0,0 +1,74 @@
+#!/bin/bash
+#
+# Render every model of the glTF sample models repository (see
+# clone_gltf_samples.sh) headless with and without --half-precision and
+# compare the images with the compare command of gltf-viewer. Exits with 1 if
+# the images of a model differ more than allowed or a model failed to render.
+
+SCRIPT_DIR=`dirname "$0"`
+if [ -r $SCRIPT_DIR/env.env ]; then
+    source $SCRIPT_DIR/env.env
+fi
+
+VIEWER=$SCRIPT_DIR/../build/bin/gltf-viewer
+MODELS=$GLTF_MODELS_REPO_PATH/2.0
+ENVIRONMENT=""
+OUTPUT=half_precision_images
+MIN_PSNR=40
+GPU=0
+
+function usage {
+    echo "Usage: $0 [-b viewer] [-m models_dir] [-e environment.hdr]"
+    echo "          [-o output_dir] [-p min_psnr] [-g gpu]"
+    echo ""
+    echo "Models default to \$GLTF_MODELS_REPO_PATH/2.0, from env.env."
+    exit 1
+}
+
+while getopts "b:m:e:o:p:g:h" option; do
+    case $option in
+        b) VIEWER=$OPTARG ;;
+        m) MODELS=$OPTARG ;;
+        e) ENVIRONMENT=$OPTARG ;;
+        o) OUTPUT=$OPTARG ;;
+        p) MIN_PSNR=$OPTARG ;;
+        g) GPU=$OPTARG ;;
+        *) usage ;;
+    esac
+done
+
+if [ ! -x "$VIEWER" ]; then
+    echo "$VIEWER is not an executable, build gltf-viewer or pass -b"
+    usage
+fi
+if [ ! -d "$MODELS" ]; then
+    echo "$MODELS is not a directory, run clone_gltf_samples.sh or pass -m"
+    usage
+fi
+
+mkdir -p "$OUTPUT"
+LOG=$OUTPUT/compare.log
+: > "$LOG"
+
+# Every model has a <Name>/glTF/<Name>.gltf variant, the others are skipped
+FAILED=0
+for model in `find "$MODELS" -path '*/glTF/*.gltf' | sort`; do
+    name=`basename "$(dirname "$(dirname "$model")")"`
+    echo "Comparing $name"
+    if ! "$VIEWER" viewer --gpu "$GPU" -o "$OUTPUT/$name.png" \
+            "$model" $ENVIRONMENT >> "$LOG" 2>&1 ||
+        ! "$VIEWER" viewer --gpu "$GPU" --half-precision \
+            -o "$OUTPUT/$name.half.png" "$model" $ENVIRONMENT >> "$LOG" 2>&1; then
+        echo "  failed to render, see $LOG"
+        FAILED=1
+        continue
+    fi
+    result=`"$VIEWER" compare --min-psnr "$MIN_PSNR" "$OUTPUT/$name.png" \
+        "$OUTPUT/$name.half.png" 2>&1`
+    if [ $? -ne 0 ]; then
+        FAILED=1
+    fi
+    echo "$result" | sed 's/^/  /'
+done
+
+exit $FAILED
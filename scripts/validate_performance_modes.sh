@@ -0,0 +1,166 @@
+#!/bin/bash
+#
+# Render every model of the glTF sample models repository (see
+# clone_gltf_samples.sh) headless in each performance mode and compare the
+# images to reference renders drawn without any of them, with the compare
+# command of gltf-viewer. The speedup of each mode over the reference, from
+# the GPU frame times of the bench command, is reported next to its error.
+# Exits with 1 if an image differs from its reference more than allowed or a
+# model failed to render.
+#
+# The references are golden images kept in a directory across runs, the
+# missing ones are rendered. -u renders them all again, after a change of
+# the reference path itself.
+
+SCRIPT_DIR=`dirname "$0"`
+if [ -r $SCRIPT_DIR/env.env ]; then
+    source $SCRIPT_DIR/env.env
+fi
+
+VIEWER=$SCRIPT_DIR/../build/bin/gltf-viewer
+MODELS=$GLTF_MODELS_REPO_PATH/2.0
+ENVIRONMENT=""
+OUTPUT=performance_modes
+REFERENCES=performance_references
+MIN_PSNR=35
+MAX_FLIP=0.05
+SIZE=512
+FRAMES=100
+GPU=0
+BENCH=1
+UPDATE=0
+# Options of the reference renders: every performance mode off
+REFERENCE_OPTIONS="--no-shading-lod"
+# name=options of each mode, separated by ;. The options replace those of
+# the reference, shading_lod is the default shading of small draws.
+MODES="shading_lod=;\
+half_precision=--no-shading-lod --half-precision;\
+quantize_vertices=--no-shading-lod --quantize-vertices;\
+compress_ibl=--no-shading-lod --compress-ibl;\
+fast_ibl_bake=--no-shading-lod --fast-ibl-bake;\
+lods=--no-shading-lod --lods 4;\
+all=--half-precision --quantize-vertices --compress-ibl --lods 4"
+
+function usage {
+    echo "Usage: $0 [-b viewer] [-m models_dir] [-e environment.hdr]"
+    echo "          [-o output_dir] [-r references_dir] [-p min_psnr]"
+    echo "          [-l max_flip] [-s size] [-f frames] [-g gpu]"
+    echo "          [-M 'name=options;...'] [-n] [-u]"
+    echo ""
+    echo "-n skips the benchmarks, -u renders the references again."
+    echo "Models default to \$GLTF_MODELS_REPO_PATH/2.0, from env.env."
+    exit 1
+}
+
+while getopts "b:m:e:o:r:p:l:s:f:g:M:nuh" option; do
+    case $option in
+        b) VIEWER=$OPTARG ;;
+        m) MODELS=$OPTARG ;;
+        e) ENVIRONMENT=$OPTARG ;;
+        o) OUTPUT=$OPTARG ;;
+        r) REFERENCES=$OPTARG ;;
+        p) MIN_PSNR=$OPTARG ;;
+        l) MAX_FLIP=$OPTARG ;;
+        s) SIZE=$OPTARG ;;
+        f) FRAMES=$OPTARG ;;
+        g) GPU=$OPTARG ;;
+        M) MODES=$OPTARG ;;
+        n) BENCH=0 ;;
+        u) UPDATE=1 ;;
+        *) usage ;;
+    esac
+done
+
+if [ ! -x "$VIEWER" ]; then
+    echo "$VIEWER is not an executable, build gltf-viewer or pass -b"
+    usage
+fi
+if [ ! -d "$MODELS" ]; then
+    echo "$MODELS is not a directory, run clone_gltf_samples.sh or pass -m"
+    usage
+fi
+
+mkdir -p "$OUTPUT" "$REFERENCES"
+LOG=$OUTPUT/validate.log
+RESULTS=$OUTPUT/results.csv
+REPORT=`mktemp`
+trap 'rm -f "$REPORT"' EXIT
+: > "$LOG"
+echo "name,mode,psnr_db,flip,gpu_avg_ms,speedup,passed" > "$RESULTS"
+
+# Image of a model, render <model> <image> <options...>
+function render {
+    local model=$1 image=$2
+    shift 2
+    "$VIEWER" viewer --gpu "$GPU" --width "$SIZE" --height "$SIZE" "$@" \
+        -o "$image" "$model" $ENVIRONMENT >> "$LOG" 2>&1
+}
+
+# Average GPU frame time of a model in ms, empty if it could not be timed,
+# bench <model> <options...>
+function bench {
+    local model=$1
+    shift
+    [ $BENCH -eq 1 ] || return
+    "$VIEWER" bench --gpu "$GPU" --width "$SIZE" --height "$SIZE" \
+        --frames "$FRAMES" --report "$REPORT" "$@" "$model" $ENVIRONMENT \
+        >> "$LOG" 2>&1 || return
+    # The model and renderer columns are quoted and may hold commas
+    paste -d '\n' <(head -n 1 "$REPORT" | cut -d, -f3- | tr , '\n') \
+        <(tail -n 1 "$REPORT" | sed 's/^"[^"]*","[^"]*",//' | tr , '\n') |
+        awk 'NR % 2 == 1 { name = $0; next } name == "gpu_avg_ms" { print }'
+}
+
+# Every model has a <Name>/glTF/<Name>.gltf variant, the others are skipped
+FAILED=0
+for model in `find "$MODELS" -path '*/glTF/*.gltf' | sort`; do
+    name=`basename "$(dirname "$(dirname "$model")")"`
+    echo "Validating $name"
+    reference=$REFERENCES/$name.png
+    if [ $UPDATE -eq 1 ] || [ ! -r "$reference" ]; then
+        if ! render "$model" "$reference" $REFERENCE_OPTIONS; then
+            echo "  failed to render the reference, see $LOG"
+            FAILED=1
+            continue
+        fi
+        echo "  reference rendered to $reference"
+    fi
+    referenceMs=`bench "$model" $REFERENCE_OPTIONS`
+
+    IFS=';' read -ra modes <<< "$MODES"
+    for mode in "${modes[@]}"; do
+        modeName=${mode%%=*}
+        options=${mode#*=}
+        image=$OUTPUT/$name.$modeName.png
+        if ! render "$model" "$image" $options; then
+            printf "  %-18s failed to render, see %s\n" "$modeName" "$LOG"
+            echo "$name,$modeName,,,,,0" >> "$RESULTS"
+            FAILED=1
+            continue
+        fi
+        result=`"$VIEWER" compare --min-psnr "$MIN_PSNR" \
+            --max-flip "$MAX_FLIP" "$reference" "$image" 2>&1`
+        if [ $? -eq 0 ]; then
+            passed=1
+        else
+            passed=0
+            FAILED=1
+        fi
+        psnr=`echo "$result" | sed -n 's/.* PSNR \([^ ]*\) dB.*/\1/p'`
+        flip=`echo "$result" | sed -n 's/.*FLIP \([^ ]*\)$/\1/p'`
+        ms=`bench "$model" $options`
+        speedup=`awk -v reference="$referenceMs" -v ms="$ms" 'BEGIN {
+            if (reference > 0 && ms > 0) printf "%.2f", reference / ms }'`
+        echo "$name,$modeName,$psnr,$flip,$ms,$speedup,$passed" >> "$RESULTS"
+        if [ -z "$psnr" ]; then
+            printf "  %-18s %s\n" "$modeName" "`echo "$result" | head -n 1`"
+            continue
+        fi
+        printf "  %-18s PSNR %6s dB  FLIP %-8s %s%s\n" "$modeName" \
+            "$psnr" "$flip" "${speedup:+${speedup}x over ${referenceMs} ms}" \
+            "`[ $passed -eq 1 ] || echo '  differs more than allowed'`"
+    done
+done
+
+echo "Results written to $RESULTS"
+exit $FAILED
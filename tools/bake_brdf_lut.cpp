@@ -0,0 +1,154 @@
+// Bake the split-sum BRDF integration LUT used by gltf-viewer for image based
+// lighting. This is a CPU port of apps/gltf-viewer/shaders/integrate.fs.glsl,
+// keep both in sync: the viewer falls back to the shader when the baked file
+// is missing or does not have the expected size.
+//
+// Output is size * size texels, RG 16-bit floats, rows from roughness 0 to 1
+// and columns from NdotV 0 to 1 (the layout of the GL_RG16F texture).
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+const float PI = 3.14159265359f;
+const uint32_t SAMPLES = 1024u;
+
+float radicalInverseVdC(uint32_t bits)
+{
+  bits = (bits << 16u) | (bits >> 16u);
+  bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+  bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+  bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+  bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+
+  return 0.00000000023283064365386963f * float(bits);
+}
+
+// Same expression as the shader, which multiplies by the sample count
+glm::vec2 hammersley(uint32_t i, float Ni)
+{
+  return glm::vec2(float(i) * Ni, radicalInverseVdC(i));
+}
+
+glm::vec3 importanceSampleGGX(glm::vec2 Xi, glm::vec3 N, float roughness)
+{
+  const float a = roughness * roughness;
+
+  const float phi = 2.0f * PI * Xi.x;
+  const float cosTheta =
+      std::sqrt((1.0f - Xi.y) / (1.0f + (((a * a) - 1.0f) * Xi.y)));
+  const float sinTheta = std::sqrt(1.0f - cosTheta * cosTheta);
+
+  const glm::vec3 H(
+      std::cos(phi) * sinTheta, std::sin(phi) * sinTheta, cosTheta);
+  const glm::vec3 up = std::abs(N.z) < 0.999f ? glm::vec3(0.0f, 0.0f, 1.0f)
+                                              : glm::vec3(1.0f, 0.0f, 0.0f);
+
+  const glm::vec3 tangent = glm::normalize(glm::cross(up, N));
+  const glm::vec3 bitangent = glm::cross(N, tangent);
+
+  return glm::normalize((tangent * H.x) + (bitangent * H.y) + (N * H.z));
+}
+
+float geometrySchlickGGX(float NdotV, float roughness)
+{
+  const float k = (roughness * roughness) * 0.5f;
+
+  return NdotV / (NdotV * (1.0f - k) + k);
+}
+
+float geometrySmith(glm::vec3 N, glm::vec3 V, glm::vec3 L, float roughness)
+{
+  const float NdotV = std::max(glm::dot(N, V), 0.0f);
+  const float NdotL = std::max(glm::dot(N, L), 0.0f);
+
+  return geometrySchlickGGX(NdotL, roughness) *
+         geometrySchlickGGX(NdotV, roughness);
+}
+
+glm::vec2 integrateBRDF(float NdotV, float roughness)
+{
+  const glm::vec3 V(std::sqrt(1.0f - NdotV * NdotV), 0.0f, NdotV);
+  const glm::vec3 N(0.0f, 0.0f, 1.0f);
+
+  float A = 0.0f;
+  float B = 0.0f;
+
+  for (uint32_t i = 0u; i < SAMPLES; ++i) {
+    const glm::vec2 Xi = hammersley(i, float(SAMPLES));
+    const glm::vec3 H = importanceSampleGGX(Xi, N, roughness);
+    const glm::vec3 L = glm::normalize(2.0f * glm::dot(V, H) * H - V);
+
+    const float NdotL = std::max(L.z, 0.0f);
+    const float NdotH = std::max(H.z, 0.0f);
+    const float VdotH = std::max(glm::dot(V, H), 0.0f);
+
+    if (NdotL > 0.0f) {
+      const float G = geometrySmith(N, V, L, roughness);
+      const float G_Vis = (G * VdotH) / (NdotH * NdotV);
+      const float Fc = std::pow(1.0f - VdotH, 5.0f);
+
+      A += (1.0f - Fc) * G_Vis;
+      B += Fc * G_Vis;
+    }
+  }
+
+  return glm::vec2(A, B) / float(SAMPLES);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  if (argc != 3) {
+    std::cerr << "Usage: " << argv[0] << " <size> <output file>" << std::endl;
+    return 1;
+  }
+
+  const auto size = size_t(std::stoul(argv[1]));
+  std::vector<uint16_t> texels(size * size * 2);
+
+  // Rows are independent, each thread bakes the next row not yet taken
+  std::atomic<size_t> nextRow{0};
+  const auto bakeRows = [&]() {
+    for (size_t y = nextRow++; y < size; y = nextRow++) {
+      for (size_t x = 0; x < size; ++x) {
+        // Texel centers, as the fragment shader sees them
+        const auto value = integrateBRDF(
+            (float(x) + 0.5f) / float(size), (float(y) + 0.5f) / float(size));
+        texels[2 * (y * size + x)] = glm::packHalf1x16(value.x);
+        texels[2 * (y * size + x) + 1] = glm::packHalf1x16(value.y);
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned i = 1; i < std::max(1u, std::thread::hardware_concurrency());
+       ++i) {
+    threads.emplace_back(bakeRows);
+  }
+  bakeRows();
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  std::ofstream output(argv[2], std::ios::binary);
+  if (!output.write(reinterpret_cast<const char *>(texels.data()),
+          texels.size() * sizeof(uint16_t))) {
+    std::cerr << "Unable to write " << argv[2] << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
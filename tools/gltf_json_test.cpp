@@ -0,0 +1,102 @@
+// Tests of the single pass glTF reader of gltf_json.hpp against tinygltf,
+// registered with CTest. Each check prints what failed, the exit code is the
+// number of failures.
+//
+// gltf-viewer-json-tests
+
+#include "utils/gltf_json.hpp"
+
+#include <tiny_gltf.h>
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+int failures = 0;
+
+void check(bool condition, const std::string &what)
+{
+  if (!condition) {
+    std::cerr << "FAILED: " << what << std::endl;
+    ++failures;
+  }
+}
+
+// Scenes, nodes, cameras, samplers and materials, without buffers or images
+// for tinygltf to load
+const char MODEL_JSON[] = R"({
+  "asset": {"version": "2.0", "generator": "gltf-json-test"},
+  "scene": 0,
+  "scenes": [{"name": "scene", "nodes": [0, 1]}],
+  "nodes": [
+    {"name": "parent", "children": [2], "translation": [1, 2, 3],
+      "rotation": [0, 0, 0.7071068, 0.7071068], "scale": [2, 2, 2]},
+    {"camera": 0, "matrix": [1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 4, 5, 6, 1],
+      "extras": {"tag": "camera", "weights": [1, 2.5]}},
+    {"name": "child", "extensions": {"EXT_custom": {"value": true}}}
+  ],
+  "cameras": [{"type": "perspective",
+    "perspective": {"yfov": 0.8, "znear": 0.1, "zfar": 100, "aspectRatio": 1.5}}],
+  "samplers": [{"magFilter": 9729, "minFilter": 9987, "wrapS": 33648}],
+  "materials": [
+    {"name": "opaque",
+      "pbrMetallicRoughness": {"baseColorFactor": [0.5, 0.25, 1, 1],
+        "metallicFactor": 0.2, "roughnessFactor": 0.7},
+      "emissiveFactor": [1, 0.5, 0],
+      "extensions": {"KHR_materials_emissive_strength":
+        {"emissiveStrength": 4}}},
+    {"name": "masked", "alphaMode": "MASK", "alphaCutoff": 0.3,
+      "doubleSided": true, "extras": {"id": 7}},
+    {}
+  ]
+})";
+
+void testSameModelAsTinygltf()
+{
+  const std::string json = MODEL_JSON;
+
+  tinygltf::TinyGLTF loader;
+  tinygltf::Model expected;
+  std::string err;
+  std::string warn;
+  check(loader.LoadASCIIFromString(&expected, &err, &warn, json.data(),
+            (unsigned int)json.size(), ""),
+      "tinygltf parses the model: " + err);
+
+  tinygltf::Model model;
+  std::vector<size_t> bufferLengths;
+  err.clear();
+  check(parseGltfJson(reinterpret_cast<const unsigned char *>(json.data()),
+            json.size(), model, bufferLengths, err),
+      "the single pass reader parses the model: " + err);
+
+  // Equal but for the legacy Material::values and additionalValues, which
+  // the single pass reader leaves empty since the viewer never reads them
+  check(!expected.materials.empty() && !expected.materials[0].values.empty(),
+      "tinygltf fills the legacy material values");
+  for (const auto &material : model.materials) {
+    check(material.values.empty() && material.additionalValues.empty(),
+        "the single pass reader leaves the legacy material values empty");
+  }
+  for (auto &material : expected.materials) {
+    material.values.clear();
+    material.additionalValues.clear();
+  }
+  check(model == expected,
+      "the model equals that of tinygltf but for the legacy material values");
+}
+
+} // namespace
+
+int main()
+{
+  testSameModelAsTinygltf();
+  if (failures == 0) {
+    std::cout << "All tests passed" << std::endl;
+  }
+  return failures;
+}
@@ -0,0 +1,455 @@
+// Microbenchmarks of the CPU hot paths of gltf-viewer on synthetic scenes:
+// node transforms, scene bounds, accessor readers, scene graph flattening,
+// culling, draw sorting, material binding and image flips. Each kernel runs
+// --iterations times after a warmup, the report gives its median and minimum
+// time and the time per item, so that performance changes come with numbers.
+//
+// GL calls of the material binding are no-op stubs: only the CPU side of
+// bindMaterial, the texture lookups and the state cache, is measured.
+//
+// gltf-viewer-microbench [--nodes N] [--meshes N] [--vertices N]
+//     [--materials N] [--image-size N] [--iterations N] [--filter TEXT]
+
+#include "utils/gl_state.hpp"
+#include "utils/gltf.hpp"
+#include "utils/images.hpp"
+#include "utils/node_culling.hpp"
+#include "utils/render_queue.hpp"
+#include "utils/runtime_model.hpp"
+#include "utils/scene_graph.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+const size_t WARMUP_ITERATIONS = 3;
+// Children of each node of the synthetic scenes
+const size_t NODE_BRANCHING = 4;
+// Texture units bound per material, as the PBR programs
+const GLuint MATERIAL_TEXTURE_UNITS = 5;
+
+struct Options
+{
+  size_t nodes = 10000; // Each with a mesh
+  size_t meshes = 100; // One triangle list each, shared by the nodes
+  size_t vertices = 1024; // Per mesh
+  size_t materials = 64;
+  size_t imageSize = 2048; // Side of the RGBA8 image flipped
+  size_t iterations = 50;
+  std::string filter; // Only the benchmarks whose name contains it
+};
+
+struct Benchmark
+{
+  std::string name;
+  size_t items; // Processed by one run, for the time per item
+  std::function<void()> run;
+};
+
+// Results written there are not optimized out
+volatile float sink;
+
+// Deterministic values in [0, 1) of an index, the scenes are the same on
+// every run
+float hashUnit(uint32_t i)
+{
+  i ^= i >> 16;
+  i *= 0x7feb352du;
+  i ^= i >> 15;
+  i *= 0x846ca68bu;
+  i ^= i >> 16;
+  return float(i >> 8) / float(1u << 24);
+}
+
+void APIENTRY noActiveTexture(GLenum) {}
+void APIENTRY noBindTexture(GLenum, GLuint) {}
+void APIENTRY noBindSampler(GLuint, GLuint) {}
+
+// A tree of nodes with TRS transforms, each drawing one of the meshes, whose
+// positions and indices are in one buffer. Material textures are only indices.
+struct SyntheticScene
+{
+  tinygltf::Model model;
+  GltfBuffers buffers;
+  RuntimeModel runtimeModel;
+
+  explicit SyntheticScene(const Options &options)
+  {
+    const auto meshCount = std::max(options.meshes, size_t(1));
+    const auto vertexCount = std::max(options.vertices, size_t(3));
+    const auto materialCount = std::max(options.materials, size_t(1));
+
+    const auto positionBytes = meshCount * vertexCount * sizeof(glm::vec3);
+    const auto indexBytes = meshCount * vertexCount * sizeof(uint32_t);
+    std::vector<unsigned char> bytes(positionBytes + indexBytes);
+    for (size_t i = 0; i < meshCount * vertexCount; ++i) {
+      const auto position = glm::vec3(hashUnit(uint32_t(3 * i)),
+                                hashUnit(uint32_t(3 * i + 1)),
+                                hashUnit(uint32_t(3 * i + 2))) *
+                                2.f -
+                            1.f;
+      std::memcpy(bytes.data() + i * sizeof(glm::vec3), &position,
+          sizeof(glm::vec3));
+      const auto index = uint32_t(i % vertexCount);
+      std::memcpy(bytes.data() + positionBytes + i * sizeof(uint32_t), &index,
+          sizeof(uint32_t));
+    }
+    buffers.add(std::move(bytes));
+    model.buffers.emplace_back();
+
+    tinygltf::BufferView positionView;
+    positionView.buffer = 0;
+    positionView.byteLength = positionBytes;
+    positionView.target = TINYGLTF_TARGET_ARRAY_BUFFER;
+    model.bufferViews.push_back(positionView);
+    tinygltf::BufferView indexView;
+    indexView.buffer = 0;
+    indexView.byteOffset = positionBytes;
+    indexView.byteLength = indexBytes;
+    indexView.target = TINYGLTF_TARGET_ELEMENT_ARRAY_BUFFER;
+    model.bufferViews.push_back(indexView);
+
+    for (size_t i = 0; i < materialCount * 2; ++i) {
+      model.textures.emplace_back();
+      model.textures.back().source = int(i);
+    }
+    for (size_t i = 0; i < materialCount; ++i) {
+      tinygltf::Material material;
+      material.pbrMetallicRoughness.baseColorTexture.index = int(2 * i);
+      material.normalTexture.index = int(2 * i + 1);
+      model.materials.push_back(material);
+    }
+
+    for (size_t i = 0; i < meshCount; ++i) {
+      tinygltf::Accessor positions;
+      positions.bufferView = 0;
+      positions.byteOffset = i * vertexCount * sizeof(glm::vec3);
+      positions.componentType = TINYGLTF_COMPONENT_TYPE_FLOAT;
+      positions.count = vertexCount;
+      positions.type = TINYGLTF_TYPE_VEC3;
+      positions.minValues = {-1., -1., -1.};
+      positions.maxValues = {1., 1., 1.};
+      model.accessors.push_back(positions);
+      tinygltf::Accessor indices;
+      indices.bufferView = 1;
+      indices.byteOffset = i * vertexCount * sizeof(uint32_t);
+      indices.componentType = TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT;
+      indices.count = vertexCount / 3 * 3;
+      indices.type = TINYGLTF_TYPE_SCALAR;
+      model.accessors.push_back(indices);
+
+      tinygltf::Primitive primitive;
+      primitive.attributes["POSITION"] = int(2 * i);
+      primitive.indices = int(2 * i + 1);
+      primitive.material = int(i % materialCount);
+      primitive.mode = TINYGLTF_MODE_TRIANGLES;
+      model.meshes.emplace_back();
+      model.meshes.back().primitives.push_back(primitive);
+    }
+
+    const auto nodeCount = std::max(options.nodes, size_t(1));
+    model.nodes.resize(nodeCount);
+    for (size_t i = 0; i < nodeCount; ++i) {
+      auto &node = model.nodes[i];
+      node.mesh = int(i % meshCount);
+      node.translation = {4. * hashUnit(uint32_t(i)) - 2.,
+          4. * hashUnit(uint32_t(i + nodeCount)) - 2.,
+          4. * hashUnit(uint32_t(i + 2 * nodeCount)) - 2.};
+      const auto rotation = glm::angleAxis(
+          6.28f * hashUnit(uint32_t(i + 3 * nodeCount)), glm::vec3(0, 1, 0));
+      node.rotation = {rotation.x, rotation.y, rotation.z, rotation.w};
+      node.scale = {0.9, 0.9, 0.9};
+      if (i > 0) {
+        model.nodes[(i - 1) / NODE_BRANCHING].children.push_back(int(i));
+      }
+    }
+    model.scenes.emplace_back();
+    model.scenes.back().nodes.push_back(0);
+    model.defaultScene = 0;
+
+    runtimeModel.build(model);
+  }
+};
+
+double median(std::vector<double> values)
+{
+  std::sort(values.begin(), values.end());
+  return values[values.size() / 2];
+}
+
+void runBenchmarks(
+    const Options &options, const std::vector<Benchmark> &benchmarks)
+{
+  std::cout << std::left << std::setw(36) << "benchmark" << std::right
+            << std::setw(12) << "items" << std::setw(12) << "median ms"
+            << std::setw(12) << "min ms" << std::setw(12) << "ns/item"
+            << "\n";
+  for (const auto &benchmark : benchmarks) {
+    if (benchmark.name.find(options.filter) == std::string::npos) {
+      continue;
+    }
+    std::vector<double> times;
+    for (size_t i = 0; i < WARMUP_ITERATIONS + options.iterations; ++i) {
+      const auto start = std::chrono::steady_clock::now();
+      benchmark.run();
+      const auto time = std::chrono::duration<double, std::milli>(
+          std::chrono::steady_clock::now() - start)
+                            .count();
+      if (i >= WARMUP_ITERATIONS) {
+        times.push_back(time);
+      }
+    }
+    const auto medianTime = median(times);
+    std::cout << std::left << std::setw(36) << benchmark.name << std::right
+              << std::setw(12) << benchmark.items << std::fixed
+              << std::setprecision(3) << std::setw(12) << medianTime
+              << std::setw(12) << *std::min_element(times.begin(), times.end())
+              << std::setprecision(2) << std::setw(12)
+              << medianTime * 1e6 / double(std::max(benchmark.items, size_t(1)))
+              << std::defaultfloat << "\n";
+  }
+}
+
+// The benchmarks of the scene, run before returning: they refer to its locals
+void benchmarkScene(const Options &options, const SyntheticScene &scene)
+{
+  std::vector<Benchmark> benchmarks;
+  const auto &model = scene.model;
+  const auto &buffers = scene.buffers;
+  const auto &runtimeModel = scene.runtimeModel;
+  const auto nodeCount = model.nodes.size();
+  const auto vertexCount = model.meshes.size() * model.accessors[0].count;
+
+  benchmarks.push_back({"getLocalToWorldMatrix", nodeCount, [&]() {
+                          std::vector<glm::mat4> matrices(model.nodes.size());
+                          std::function<void(int, const glm::mat4 &)> visit =
+                              [&](int node, const glm::mat4 &parent) {
+                                matrices[size_t(node)] = getLocalToWorldMatrix(
+                                    model.nodes[size_t(node)], parent);
+                                for (const auto child :
+                                    model.nodes[size_t(node)].children) {
+                                  visit(child, matrices[size_t(node)]);
+                                }
+                              };
+                          visit(0, glm::mat4(1));
+                          sink = matrices.back()[3][0];
+                        }});
+
+  for (const auto exact : {false, true}) {
+    benchmarks.push_back(
+        {exact ? "computeSceneBounds exact" : "computeSceneBounds",
+            exact ? nodeCount * model.accessors[0].count : nodeCount, [&, exact]() {
+              glm::vec3 bboxMin, bboxMax;
+              computeSceneBounds(
+                  model, runtimeModel, buffers, exact, bboxMin, bboxMax);
+              sink = bboxMax.x - bboxMin.x;
+            }});
+  }
+
+  benchmarks.push_back({"readVectors", vertexCount, [&]() {
+                          float sum = 0.f;
+                          for (size_t i = 0; i < model.accessors.size();
+                               i += 2) {
+                            const auto positions =
+                                readVectors(model, buffers, model.accessors[i]);
+                            sum += positions.back().x;
+                          }
+                          sink = sum;
+                        }});
+
+  benchmarks.push_back(
+      {"visitIndices", vertexCount, [&]() {
+         uint32_t maxIndex = 0;
+         for (size_t i = 1; i < model.accessors.size(); i += 2) {
+           visitIndices(model, buffers, model.accessors[i], [&](auto view) {
+             for (const auto index : view) {
+               maxIndex = std::max(maxIndex, index);
+             }
+           });
+         }
+         sink = float(maxIndex);
+       }});
+
+  SceneGraph sceneGraph;
+  sceneGraph.build(runtimeModel);
+  sceneGraph.updateWorldMatrices();
+
+  benchmarks.push_back({"SceneGraph::build", nodeCount, [&]() {
+                          SceneGraph graph;
+                          graph.build(runtimeModel);
+                          sink = float(graph.size());
+                        }});
+
+  benchmarks.push_back({"SceneGraph::updateWorldMatrices", nodeCount,
+      [&]() {
+        // Every node is below the root
+        sceneGraph.setTranslation(0, sceneGraph.translation(0));
+        sceneGraph.updateWorldMatrices();
+        sink = sceneGraph.worldMatrix(nodeCount - 1)[3][0];
+      }});
+
+  // One item per node, bounded by its primitive
+  std::vector<int> itemNodes(sceneGraph.size());
+  for (size_t i = 0; i < itemNodes.size(); ++i) {
+    itemNodes[i] = int(i);
+  }
+  NodeCulling culling;
+  culling.build(sceneGraph, itemNodes);
+  const auto viewProj =
+      glm::perspective(glm::radians(60.f), 16.f / 9.f, 0.1f, 100.f) *
+      glm::lookAt(glm::vec3(0, 2, 6), glm::vec3(0), glm::vec3(0, 1, 0));
+
+  benchmarks.push_back(
+      {"NodeCulling::update+queryFrustum", nodeCount, [&]() {
+         std::vector<Aabb> bounds(sceneGraph.size());
+         for (size_t i = 0; i < bounds.size(); ++i) {
+           const auto mesh = sceneGraph.mesh(i);
+           bounds[i] = mesh < 0 ? Aabb()
+                                : transformAabb(runtimeModel.primitive(
+                                                    size_t(mesh), 0)
+                                                    .bounds,
+                                      sceneGraph.worldMatrix(i));
+         }
+         culling.update(bounds);
+         std::vector<uint32_t> visible;
+         culling.queryFrustum(Frustum(viewProj), visible);
+         sink = float(visible.size());
+       }});
+
+  // The draws of every node, as the draw loop queues them
+  const auto queueDraws = [&](RenderQueue &queue) {
+    queue.clear();
+    for (size_t i = 0; i < sceneGraph.size(); ++i) {
+      const auto material =
+          uint32_t(model.meshes[size_t(sceneGraph.mesh(i))]
+                       .primitives[0]
+                       .material);
+      queue.push(uint32_t(i), material % 8, material, hashUnit(uint32_t(i)),
+          uint32_t(sceneGraph.mesh(i)));
+    }
+    queue.sort();
+  };
+
+  benchmarks.push_back({"RenderQueue::push+sort", nodeCount, [&]() {
+                          RenderQueue queue;
+                          queueDraws(queue);
+                          sink = float(queue.entries().front().item);
+                        }});
+
+  // Textures and samplers of each texture of the model, as bindMaterial gets
+  // them, 1 and 2 being the white and grey defaults
+  std::vector<GLuint> textureObjects(model.textures.size());
+  for (size_t i = 0; i < textureObjects.size(); ++i) {
+    textureObjects[i] = GLuint(i + 3);
+  }
+  RenderQueue queue;
+  queueDraws(queue);
+
+  benchmarks.push_back({"bindMaterial", nodeCount, [&]() {
+    const auto texture = [&](int index, GLuint defaultTexture) {
+      return index >= 0 ? textureObjects[size_t(index)] : defaultTexture;
+    };
+    GLStateCache glState;
+    for (const auto &entry : queue.entries()) {
+      const auto &primitive =
+          model.meshes[size_t(sceneGraph.mesh(entry.item))].primitives[0];
+      const auto &material =
+          runtimeModel.materials()[size_t(primitive.material)];
+      GLuint textures[MATERIAL_TEXTURE_UNITS];
+      for (GLuint i = 0; i < MATERIAL_TEXTURE_UNITS; ++i) {
+        textures[i] = texture(
+            material.textures[i], i == MATERIAL_TEXTURE_NORMAL ? 2 : 1);
+      }
+      for (GLuint i = 0; i < MATERIAL_TEXTURE_UNITS; ++i) {
+        glState.bindTexture(i, GL_TEXTURE_2D, textures[i]);
+        glState.bindSampler(i, textures[i]);
+      }
+    }
+    sink = float(glState.counters().textureBinds);
+  }});
+
+  const auto imageSize = std::max(options.imageSize, size_t(1));
+  std::vector<unsigned char> image(imageSize * imageSize * 4);
+  benchmarks.push_back({"flipImageYAxis", imageSize * imageSize, [&]() {
+                          flipImageYAxis(imageSize, imageSize, 4, image.data());
+                          sink = float(image.front());
+                        }});
+
+  runBenchmarks(options, benchmarks);
+}
+
+bool parseCount(const char *text, size_t &count)
+{
+  char *end = nullptr;
+  const auto value = std::strtoull(text, &end, 10);
+  if (end == text || *end || value == 0) {
+    return false;
+  }
+  count = size_t(value);
+  return true;
+}
+
+void printUsage()
+{
+  std::cerr
+      << "Usage: gltf-viewer-microbench [--nodes N] [--meshes N] "
+         "[--vertices N] [--materials N] [--image-size N] [--iterations N] "
+         "[--filter TEXT]\n";
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  Options options;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "-h" || arg == "--help") {
+      printUsage();
+      return 0;
+    }
+    if (i + 1 >= argc) {
+      printUsage();
+      return 1;
+    }
+    const char *value = argv[++i];
+    size_t *count = arg == "--nodes"        ? &options.nodes
+                    : arg == "--meshes"     ? &options.meshes
+                    : arg == "--vertices"   ? &options.vertices
+                    : arg == "--materials"  ? &options.materials
+                    : arg == "--image-size" ? &options.imageSize
+                    : arg == "--iterations" ? &options.iterations
+                                            : nullptr;
+    if (arg == "--filter") {
+      options.filter = value;
+    } else if (!count || !parseCount(value, *count)) {
+      std::cerr << "Invalid argument " << arg << " " << value << "\n";
+      printUsage();
+      return 1;
+    }
+  }
+
+  glad_glActiveTexture = &noActiveTexture;
+  glad_glBindTexture = &noBindTexture;
+  glad_glBindSampler = &noBindSampler;
+
+  std::cout << options.nodes << " nodes, " << options.meshes << " meshes of "
+            << options.vertices << " vertices, " << options.materials
+            << " materials, " << options.iterations << " iterations\n";
+  const SyntheticScene scene(options);
+  benchmarkScene(options, scene);
+  return 0;
+}
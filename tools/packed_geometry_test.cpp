@@ -0,0 +1,126 @@
+// Tests of the geometry packed by packGeometry on small synthetic models,
+// registered with CTest. Each check prints what failed, the exit code is the
+// number of failures.
+//
+// gltf-viewer-tests
+
+#include "utils/gltf_loader.hpp"
+#include "utils/packed_geometry.hpp"
+#include "utils/runtime_model.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+int failures = 0;
+
+void check(bool condition, const std::string &what)
+{
+  if (!condition) {
+    std::cerr << "FAILED: " << what << std::endl;
+    ++failures;
+  }
+}
+
+// A model of meshCount meshes of one indexed triangle each, in one buffer,
+// without nodes
+void addTriangleMeshes(
+    tinygltf::Model &model, GltfBuffers &buffers, size_t meshCount)
+{
+  const glm::vec3 positions[] = {{0, 0, 0}, {1, 0, 0}, {0, 1, 0}};
+  const uint32_t indices[] = {0, 1, 2};
+  std::vector<unsigned char> bytes(sizeof(positions) + sizeof(indices));
+  std::memcpy(bytes.data(), positions, sizeof(positions));
+  std::memcpy(bytes.data() + sizeof(positions), indices, sizeof(indices));
+  buffers.add(std::move(bytes));
+  model.buffers.emplace_back();
+
+  tinygltf::BufferView positionView;
+  positionView.buffer = 0;
+  positionView.byteLength = sizeof(positions);
+  positionView.target = TINYGLTF_TARGET_ARRAY_BUFFER;
+  model.bufferViews.push_back(positionView);
+  tinygltf::BufferView indexView;
+  indexView.buffer = 0;
+  indexView.byteOffset = sizeof(positions);
+  indexView.byteLength = sizeof(indices);
+  indexView.target = TINYGLTF_TARGET_ELEMENT_ARRAY_BUFFER;
+  model.bufferViews.push_back(indexView);
+
+  tinygltf::Accessor positionAccessor;
+  positionAccessor.bufferView = 0;
+  positionAccessor.componentType = TINYGLTF_COMPONENT_TYPE_FLOAT;
+  positionAccessor.count = 3;
+  positionAccessor.type = TINYGLTF_TYPE_VEC3;
+  positionAccessor.minValues = {0., 0., 0.};
+  positionAccessor.maxValues = {1., 1., 0.};
+  model.accessors.push_back(positionAccessor);
+  tinygltf::Accessor indexAccessor;
+  indexAccessor.bufferView = 1;
+  indexAccessor.componentType = TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT;
+  indexAccessor.count = 3;
+  indexAccessor.type = TINYGLTF_TYPE_SCALAR;
+  model.accessors.push_back(indexAccessor);
+
+  for (size_t i = 0; i < meshCount; ++i) {
+    tinygltf::Primitive primitive;
+    primitive.attributes["POSITION"] = 0;
+    primitive.indices = 1;
+    primitive.mode = TINYGLTF_MODE_TRIANGLES;
+    model.meshes.emplace_back();
+    model.meshes.back().primitives.push_back(primitive);
+  }
+}
+
+// The coarser level of a MSFT_lod node is drawn in place of the node, its
+// own node being out of the scene
+void testLodOutOfScene()
+{
+  tinygltf::Model model;
+  GltfBuffers buffers;
+  addTriangleMeshes(model, buffers, 3);
+
+  model.nodes.resize(3);
+  model.nodes[0].mesh = 0;
+  tinygltf::Value::Array ids{tinygltf::Value(1)};
+  tinygltf::Value::Object lod;
+  lod["ids"] = tinygltf::Value(ids);
+  model.nodes[0].extensions["MSFT_lod"] = tinygltf::Value(lod);
+  model.nodes[1].mesh = 1; // Only referenced by MSFT_lod
+  model.nodes[2].mesh = 2; // Out of the scene
+  model.scenes.emplace_back();
+  model.scenes.back().nodes.push_back(0);
+  model.defaultScene = 0;
+
+  RuntimeModel runtimeModel;
+  runtimeModel.build(model);
+  PackedGeometry geometry;
+  packGeometry(model, runtimeModel, buffers, GeometryOptions(), geometry);
+
+  check(geometry.primitives.size() == 3, "a packed primitive per primitive");
+  if (geometry.primitives.size() == 3) {
+    check(geometry.primitives[0].indexCount == 3, "the scene mesh is packed");
+    check(geometry.primitives[1].indexCount == 3,
+        "the MSFT_lod level out of the scene is packed");
+    check(geometry.primitives[2].indexCount == 0,
+        "the mesh out of the scene is left empty");
+  }
+}
+
+} // namespace
+
+int main()
+{
+  testLodOutOfScene();
+  if (failures == 0) {
+    std::cout << "All tests passed" << std::endl;
+  }
+  return failures;
+}